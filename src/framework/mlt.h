@@ -58,6 +58,15 @@ extern "C"
 #include "mlt_cache.h"
 #include "mlt_version.h"
 #include "mlt_slices.h"
+#include "mlt_queue.h"
+#include "mlt_ring.h"
+#include "mlt_peaks.h"
+#include "mlt_job.h"
+#include "mlt_sidecar.h"
+#include "mlt_memory.h"
+#include "mlt_trace.h"
+#include "mlt_metrics.h"
+#include "mlt_scale.h"
 
 #ifdef __cplusplus
 }
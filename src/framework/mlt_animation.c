@@ -52,8 +52,108 @@ struct mlt_animation_s
 	double fps;           /**< framerate to use when converting time clock strings to frame units */
 	locale_t locale;      /**< pointer to a locale to use when converting strings to numeric values */
 	animation_node nodes; /**< a linked list of keyframes (and possibly non-keyframe values) */
+	animation_node *index;/**< the nodes in order, rebuilt on demand after a change */
+	int count;            /**< the number of nodes in index or -1 if it must be rebuilt */
+	int sorted;           /**< whether the frames of index are ascending so it can be searched */
+	int cursor;           /**< the index of the node found last */
+	int relative;         /**< whether a keyframe time was negative and so depends on length */
 };
 
+static animation_node animation_insert( mlt_animation self, mlt_animation_item item, animation_node tail );
+
+/** Mark the index of nodes stale after the list or a frame changed.
+ *
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ */
+
+static inline void index_invalidate( mlt_animation self )
+{
+	self->count = -1;
+}
+
+/** Rebuild the index of nodes if needed.
+ *
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ * \return the number of nodes
+ */
+
+static int index_update( mlt_animation self )
+{
+	if ( self->count < 0 )
+	{
+		animation_node node;
+		int count = 0;
+
+		for ( node = self->nodes; node; node = node->next )
+			count ++;
+		free( self->index );
+		self->index = count ? malloc( count * sizeof( *self->index ) ) : NULL;
+		self->count = 0;
+		self->sorted = 1;
+		self->cursor = 0;
+		if ( self->index )
+		{
+			for ( node = self->nodes; node; node = node->next )
+			{
+				if ( self->count && node->item.frame <= self->index[ self->count - 1 ]->item.frame )
+					self->sorted = 0;
+				self->index[ self->count ++ ] = node;
+			}
+		}
+	}
+	return self->count;
+}
+
+/** Find the index of the node that covers a position.
+ *
+ * This is the last node whose frame is not after \p position, or the first
+ * node when \p position precedes all of them. Sequential access is answered
+ * from the node found last and its successor without a search.
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ * \param position a frame number
+ * \return the index of the node or -1 if there are none
+ */
+
+static int index_find( mlt_animation self, int position )
+{
+	int count = index_update( self );
+	int i = self->cursor;
+
+	if ( count == 0 )
+		return -1;
+
+	if ( !self->sorted )
+	{
+		// Keep the order of the list if a frame was moved out of order.
+		for ( i = 0; i + 1 < count && position >= self->index[ i + 1 ]->item.frame; i ++ );
+		return i;
+	}
+
+	if ( !( i < count && position >= self->index[ i ]->item.frame ) && i > 0 )
+		i = -1;
+	else if ( i + 1 < count && position >= self->index[ i + 1 ]->item.frame )
+		i = ( i + 2 < count && position >= self->index[ i + 2 ]->item.frame ) ? -1 : i + 1;
+
+	if ( i < 0 )
+	{
+		int low = 0, high = count - 1;
+		while ( low < high )
+		{
+			int middle = ( low + high + 1 ) / 2;
+			if ( position >= self->index[ middle ]->item.frame )
+				low = middle;
+			else
+				high = middle - 1;
+		}
+		i = low;
+	}
+	self->cursor = i;
+	return i;
+}
+
 /** Create a new animation object.
  *
  * \public \memberof mlt_animation_s
@@ -146,6 +246,7 @@ static int mlt_animation_drop( mlt_animation self, animation_node node )
 	}
 	mlt_property_close( node->item.property );
 	free( node );
+	index_invalidate( self );
 
 	return 0;
 }
@@ -162,8 +263,10 @@ static void mlt_animation_clean( mlt_animation self )
 
 	free( self->data );
 	self->data = NULL;
+	self->relative = 0;
 	while ( self->nodes )
 		mlt_animation_drop( self, self->nodes );
+	index_invalidate( self );
 }
 
 /** Parse a string representing an animation.
@@ -186,6 +289,7 @@ int mlt_animation_parse(mlt_animation self, const char *data, int length, double
 	int error = 0;
 	int i = 0;
 	struct mlt_animation_item_s item;
+	animation_node tail = NULL;
 	mlt_tokeniser tokens = mlt_tokeniser_init( );
 
 	// Clean the existing geometry
@@ -227,12 +331,18 @@ int mlt_animation_parse(mlt_animation self, const char *data, int length, double
 		}
 		else
 		{
+			// Note a time relative to the length, which must be parsed again
+			// when it changes.
+			char *equal = strchr( value, '=' );
+			if ( equal && memchr( value, '-', equal - value ) )
+				self->relative = 1;
+
 			// Now parse the item
 			mlt_animation_parse_item( self, &item, value );
 		}
 
-		// Now insert into place
-		mlt_animation_insert( self, &item );
+		// Now insert into place, appending when the keyframes are in order
+		tail = animation_insert( self, &item, tail );
 	}
 	mlt_animation_interpolate( self );
 
@@ -245,6 +355,8 @@ int mlt_animation_parse(mlt_animation self, const char *data, int length, double
 
 /** Conditionally refresh the animation if it is modified.
  *
+ * The string is parsed again only if it differs or if the length changed and
+ * a keyframe time is relative to it.
  * \public \memberof mlt_animation_s
  * \param self an animation
  * \param data the string representing an animation
@@ -257,8 +369,19 @@ int mlt_animation_refresh( mlt_animation self, const char *data, int length )
 {
 	if (!self) return 1;
 
-	if ( ( length != self->length )|| ( data && ( !self->data || strcmp( data, self->data ) ) ) )
+	if ( data && ( !self->data || strcmp( data, self->data ) ) )
 		return mlt_animation_parse( self, data, length, self->fps, self->locale );
+	if ( length != self->length )
+	{
+		if ( self->relative )
+		{
+			char *copy = self->data ? strdup( self->data ) : NULL;
+			int error = mlt_animation_parse( self, copy, length, self->fps, self->locale );
+			free( copy );
+			return error;
+		}
+		self->length = length;
+	}
 	return 0;
 }
 
@@ -278,6 +401,9 @@ int mlt_animation_get_length( mlt_animation self )
 		if ( self->length > 0 ) {
 			length = self->length;
 		}
+		else if ( index_update( self ) && self->sorted ) {
+			length = MAX( 0, self->index[ self->count - 1 ]->item.frame );
+		}
 		else if ( self->nodes ) {
 			animation_node node = self->nodes;
 			while ( node ) {
@@ -335,16 +461,19 @@ int mlt_animation_parse_item( mlt_animation self, mlt_animation_item item, const
 			// Null terminate the string at the equal sign to prevent interpreting
 			// a colon in the part to the right of the equal sign as indicative of a
 			// a time value string.
-			char *s = strdup( value );
-			char *p = strchr( s, '=' );
-			p[0] = '\0';
+			char *p = strchr( value, '=' );
+			char time[ 64 ];
+			char *s = ( size_t )( p - value ) < sizeof( time ) ? time : malloc( p - value + 1 );
+			memcpy( s, value, p - value );
+			s[ p - value ] = '\0';
 			mlt_property_set_string( item->property, s );
-			
+
 			item->frame = mlt_property_get_int( item->property, self->fps, self->locale );
-			free( s );
+			if ( s != time )
+				free( s );
 
 			// The character preceding the equal sign indicates interpolation method.
-			p = strchr( value, '=' ) - 1;
+			p --;
 			if ( p[0] == '|' || p[0] == '!' )
 				item->keyframe_type = mlt_keyframe_discrete;
 			else if ( p[0] == '~' )
@@ -394,11 +523,8 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 
 	int error = 0;
 	// Need to find the nearest keyframe to the position specified
-	animation_node node = self->nodes;
-
-	// Iterate through the keyframes until we reach last or have
-	while ( node && node->next && position >= node->next->item.frame )
-		node = node->next;
+	int i = index_find( self, position );
+	animation_node node = i < 0 ? NULL : self->index[ i ];
 
 	if ( node )
 	{
@@ -454,29 +580,33 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 	return error;
 }
 
-/** Insert an animation item.
+/** Insert an item and get the node that holds it.
  *
- * \public \memberof mlt_animation_s
+ * \private \memberof mlt_animation_s
  * \param self an animation
  * \param item an animation item
- * \return true if there was an error
- * \see mlt_animation_parse_item
+ * \param tail the last node of a list whose frames ascend, or NULL
+ * \return the node of the item
  */
 
-int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
+static animation_node animation_insert( mlt_animation self, mlt_animation_item item, animation_node tail )
 {
-	if (!self || !item) return 1;
-
-	int error = 0;
 	animation_node node = calloc( 1, sizeof( *node ) );
 	node->item.frame = item->frame;
 	node->item.is_key = 1;
 	node->item.keyframe_type = item->keyframe_type;
 	node->item.property = mlt_property_init();
 	mlt_property_pass( node->item.property, item->property );
+	index_invalidate( self );
 
+	// Append after the tail without a search when the list is parsed in order
+	if ( tail && !tail->next && item->frame > tail->item.frame )
+	{
+		tail->next = node;
+		node->prev = tail;
+	}
 	// Determine if we need to insert or append to the list, or if it's a new list
-	if ( self->nodes )
+	else if ( self->nodes )
 	{
 		// Get the first item
 		animation_node current = self->nodes;
@@ -512,6 +642,7 @@ int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
 			mlt_property_close( current->item.property );
 			current->item.property = node->item.property;
 			free( node );
+			node = current;
 		}
 	}
 	else
@@ -520,9 +651,26 @@ int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
 		self->nodes = node;
 	}
 
-	return error;
+	return node;
+}
+
+/** Insert an animation item.
+ *
+ * \public \memberof mlt_animation_s
+ * \param self an animation
+ * \param item an animation item
+ * \return true if there was an error
+ * \see mlt_animation_parse_item
+ */
+
+int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
+{
+	if (!self || !item) return 1;
+	animation_insert( self, item, NULL );
+	return 0;
 }
 
+
 /** Remove the keyframe at the specified position.
  *
  * \public \memberof mlt_animation_s
@@ -536,10 +684,15 @@ int mlt_animation_remove( mlt_animation self, int position )
 	if (!self) return 1;
 
 	int error = 1;
-	animation_node node = self->nodes;
+	int i = index_find( self, position );
+	animation_node node = i < 0 ? NULL : self->index[ i ];
 
-	while ( node && position != node->item.frame )
-		node = node->next;
+	if ( !self->sorted )
+	{
+		node = self->nodes;
+		while ( node && position != node->item.frame )
+			node = node->next;
+	}
 
 	if ( node && position == node->item.frame )
 		error = mlt_animation_drop( self, node );
@@ -560,10 +713,22 @@ int mlt_animation_next_key( mlt_animation self, mlt_animation_item item, int pos
 {
 	if (!self || !item) return 1;
 
-	animation_node node = self->nodes;
+	animation_node node;
+	int i = index_find( self, position );
 
-	while ( node && position > node->item.frame )
-		node = node->next;
+	if ( self->sorted )
+	{
+		// The node found is at or before the position, otherwise it is the first.
+		if ( i >= 0 && position > self->index[ i ]->item.frame )
+			i ++;
+		node = i >= 0 && i < self->count ? self->index[ i ] : NULL;
+	}
+	else
+	{
+		node = self->nodes;
+		while ( node && position > node->item.frame )
+			node = node->next;
+	}
 
 	if ( node )
 	{
@@ -590,10 +755,8 @@ int mlt_animation_prev_key( mlt_animation self, mlt_animation_item item, int pos
 {
 	if (!self || !item) return 1;
 
-	animation_node node = self->nodes;
-
-	while ( node && node->next && position >= node->next->item.frame )
-		node = node->next;
+	int i = index_find( self, position );
+	animation_node node = i < 0 ? NULL : self->index[ i ];
 
 	if ( node )
 	{
@@ -810,14 +973,7 @@ char *mlt_animation_serialize( mlt_animation self )
 
 int mlt_animation_key_count( mlt_animation self )
 {
-	int count = -1;
-	if ( self )
-	{
-		animation_node node = self->nodes;
-		for ( count = 0; node; ++count )
-			node = node->next;
-	}
-	return count;
+	return self ? index_update( self ) : -1;
 }
 
 /** Get an animation item for the N-th keyframe.
@@ -834,12 +990,7 @@ int mlt_animation_key_get( mlt_animation self, mlt_animation_item item, int inde
 	if (!self || !item) return 1;
 
 	int error = 0;
-	animation_node node = self->nodes;
-
-	// Iterate through the keyframes.
-	int i = index;
-	while ( i-- && node )
-		node = node->next;
+	animation_node node = index >= 0 && index < index_update( self ) ? self->index[ index ] : NULL;
 
 	if ( node )
 	{
@@ -869,6 +1020,7 @@ void mlt_animation_close( mlt_animation self )
 	if ( self )
 	{
 		mlt_animation_clean( self );
+		free( self->index );
 		free( self );
 	}
 }
@@ -887,12 +1039,7 @@ int mlt_animation_key_set_type(mlt_animation self, int index, mlt_keyframe_type
 	if (!self) return 1;
 
 	int error = 0;
-	animation_node node = self->nodes;
-
-	// Iterate through the keyframes.
-	int i = index;
-	while ( i-- && node )
-		node = node->next;
+	animation_node node = index >= 0 && index < index_update( self ) ? self->index[ index ] : NULL;
 
 	if ( node ) {
 		node->item.keyframe_type = type;
@@ -918,15 +1065,11 @@ int mlt_animation_key_set_frame(mlt_animation self, int index, int frame)
 	if (!self) return 1;
 
 	int error = 0;
-	animation_node node = self->nodes;
-
-	// Iterate through the keyframes.
-	int i = index;
-	while ( i-- && node )
-		node = node->next;
+	animation_node node = index >= 0 && index < index_update( self ) ? self->index[ index ] : NULL;
 
 	if ( node ) {
 		node->item.frame = frame;
+		index_invalidate( self );
 		mlt_animation_interpolate(self);
 	} else {
 		error = 1;
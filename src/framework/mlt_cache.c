@@ -25,9 +25,16 @@
 #include "mlt_properties.h"
 #include "mlt_cache.h"
 #include "mlt_frame.h"
+#include "mlt_factory.h"
+#include "mlt_memory.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 /** the maximum number of data objects to cache per line */
 #define MAX_CACHE_SIZE (200)
@@ -95,6 +102,8 @@ struct mlt_cache_s
 	                            are outstanding references to the old data object. */
 };
 
+static void shared_data_release( mlt_cache_item item );
+
 /** Get the data pointer from the cache item.
  *
  * \public \memberof mlt_cache_s
@@ -179,7 +188,11 @@ static void cache_object_close( mlt_cache cache, void *object, void* data )
 
 void mlt_cache_item_close( mlt_cache_item item )
 {
-	if ( item )
+	if ( item && !item->cache )
+	{
+		shared_data_release( item );
+	}
+	else if ( item )
 	{
 		pthread_mutex_lock( &item->cache->mutex );
 		cache_object_close( item->cache, item->object, item->data );
@@ -602,3 +615,601 @@ mlt_frame mlt_cache_get_frame( mlt_cache cache, mlt_position position )
 
 	return result;
 }
+
+/** \brief private to mlt_cache_s, an entry in a shared cache
+ */
+
+typedef struct shared_entry_s
+{
+	char *key;                   /**< the identity of the frame or data */
+	unsigned int hash;           /**< the hash of \p key */
+	mlt_frame frame;             /**< a deep copy of the cached frame */
+	mlt_cache_item item;         /**< the cached data, which holds a reference for the cache */
+	int64_t size;                /**< the number of bytes of image, alpha, and audio or data held */
+	struct shared_entry_s *chain;/**< the next entry in the same bucket */
+	struct shared_entry_s *prev; /**< the more recently used neighbour */
+	struct shared_entry_s *next; /**< the less recently used neighbour */
+} *shared_entry;
+
+/** \brief private to mlt_cache_s, a process-wide least recently used cache limited by bytes
+ *
+ * Unlike the per-service caches, entries are found by a string key and not
+ * an object, so services that open the same media share the decoded frames
+ * or other data derived from it. There is one for frames and one for data,
+ * each with its own budget.
+ */
+
+typedef struct shared_cache_s
+{
+	pthread_mutex_t mutex;
+	const char *budget_env;      /**< the environment variable with the default budget */
+	int64_t default_budget;
+	int initialized;
+	shared_entry *buckets;
+	int bucket_count;
+	int count;
+	shared_entry head;           /**< the most recently used entry */
+	shared_entry tail;           /**< the least recently used entry */
+	int64_t bytes;
+	int64_t budget;
+	int64_t hits;
+	int64_t misses;
+	mlt_memory_client client;    /**< the registration with the memory budget */
+} *shared_cache;
+
+static struct shared_cache_s shared_frames = { PTHREAD_MUTEX_INITIALIZER, "MLT_FRAME_CACHE_BYTES", 0 };
+static struct shared_cache_s shared_data = { PTHREAD_MUTEX_INITIALIZER, "MLT_DATA_CACHE_BYTES", 64 * 1024 * 1024 };
+
+static unsigned int shared_hash( const char *key )
+{
+	unsigned int hash = 5381;
+	while ( *key )
+		hash = hash * 33 + (unsigned int) ( *key ++ );
+	return hash;
+}
+
+static void shared_unlink( shared_cache shared, shared_entry entry )
+{
+	if ( entry->prev )
+		entry->prev->next = entry->next;
+	else
+		shared->head = entry->next;
+	if ( entry->next )
+		entry->next->prev = entry->prev;
+	else
+		shared->tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void shared_push_front( shared_cache shared, shared_entry entry )
+{
+	entry->prev = NULL;
+	entry->next = shared->head;
+	if ( shared->head )
+		shared->head->prev = entry;
+	shared->head = entry;
+	if ( !shared->tail )
+		shared->tail = entry;
+}
+
+static shared_entry *shared_find( shared_cache shared, const char *key, unsigned int hash )
+{
+	shared_entry *link = &shared->buckets[ hash & ( shared->bucket_count - 1 ) ];
+	while ( *link && ( (*link)->hash != hash || strcmp( (*link)->key, key ) ) )
+		link = &(*link)->chain;
+	return link;
+}
+
+/* Release a reference to shared data, called with the mutex of shared_data held */
+static void shared_item_release( mlt_cache_item item )
+{
+	if ( --item->refcount <= 0 )
+	{
+		if ( item->destructor )
+			item->destructor( item->data );
+		free( item );
+	}
+}
+
+static void shared_remove( shared_cache shared, shared_entry *link )
+{
+	shared_entry entry = *link;
+	*link = entry->chain;
+	shared_unlink( shared, entry );
+	shared->bytes -= entry->size;
+	shared->count--;
+	if ( entry->frame )
+		mlt_frame_close( entry->frame );
+	if ( entry->item )
+		shared_item_release( entry->item );
+	free( entry->key );
+	free( entry );
+}
+
+static void shared_evict( shared_cache shared, int64_t needed )
+{
+	while ( shared->tail && shared->bytes + needed > shared->budget )
+		shared_remove( shared, shared_find( shared, shared->tail->key, shared->tail->hash ) );
+}
+
+static void shared_grow( shared_cache shared )
+{
+	int count = shared->bucket_count ? shared->bucket_count * 2 : 256;
+	shared_entry *buckets = calloc( count, sizeof( shared_entry ) );
+	int i;
+
+	if ( !buckets )
+		return;
+	for ( i = 0; i < shared->bucket_count; i++ )
+	{
+		shared_entry entry = shared->buckets[ i ];
+		while ( entry )
+		{
+			shared_entry chain = entry->chain;
+			entry->chain = buckets[ entry->hash & ( count - 1 ) ];
+			buckets[ entry->hash & ( count - 1 ) ] = entry;
+			entry = chain;
+		}
+	}
+	free( shared->buckets );
+	shared->buckets = buckets;
+	shared->bucket_count = count;
+}
+
+/* Report the bytes held to the memory budget */
+static int64_t shared_usage( void *arg )
+{
+	shared_cache shared = arg;
+	int64_t result;
+	pthread_mutex_lock( &shared->mutex );
+	result = shared->bytes;
+	pthread_mutex_unlock( &shared->mutex );
+	return result;
+}
+
+/* Evict the least recently used entries when the memory budget is exceeded */
+static int64_t shared_reclaim( void *arg, int64_t bytes )
+{
+	shared_cache shared = arg;
+	int64_t before;
+	pthread_mutex_lock( &shared->mutex );
+	before = shared->bytes;
+	while ( shared->tail && before - shared->bytes < bytes )
+		shared_remove( shared, shared_find( shared, shared->tail->key, shared->tail->hash ) );
+	before -= shared->bytes;
+	pthread_mutex_unlock( &shared->mutex );
+	return before;
+}
+
+static void shared_close( void *arg )
+{
+	shared_cache shared = arg;
+	mlt_memory_unregister( shared->client );
+	pthread_mutex_lock( &shared->mutex );
+	shared->client = NULL;
+	while ( shared->tail )
+		shared_remove( shared, shared_find( shared, shared->tail->key, shared->tail->hash ) );
+	free( shared->buckets );
+	shared->buckets = NULL;
+	shared->bucket_count = 0;
+	shared->initialized = 0;
+	pthread_mutex_unlock( &shared->mutex );
+}
+
+/* Initialize a shared cache, called with its mutex held */
+static void shared_init( shared_cache shared )
+{
+	if ( !shared->initialized )
+	{
+		const char *env = getenv( shared->budget_env );
+		shared->initialized = 1;
+		if ( shared->budget == 0 )
+			shared->budget = env ? strtoll( env, NULL, 10 ) : shared->default_budget;
+		shared_grow( shared );
+		mlt_factory_register_for_clean_up( shared, shared_close );
+
+		// Frames are cheaper to recreate than decoded data and their images belong to the pool
+		if ( shared == &shared_frames )
+			shared->client = mlt_memory_register( "cache.frames", 10, 1, shared_usage, shared_reclaim, shared );
+		else
+			shared->client = mlt_memory_register( "cache.data", 20, 0, shared_usage, shared_reclaim, shared );
+	}
+}
+
+static void shared_set_budget( shared_cache shared, int64_t bytes )
+{
+	pthread_mutex_lock( &shared->mutex );
+	shared_init( shared );
+	shared->budget = bytes > 0 ? bytes : 0;
+	shared_evict( shared, 0 );
+	pthread_mutex_unlock( &shared->mutex );
+}
+
+static int64_t shared_get_budget( shared_cache shared )
+{
+	int64_t result;
+	pthread_mutex_lock( &shared->mutex );
+	shared_init( shared );
+	result = shared->budget;
+	pthread_mutex_unlock( &shared->mutex );
+	return result;
+}
+
+/* Add an entry after evicting enough to make room, called with the mutex held */
+static shared_entry shared_insert( shared_cache shared, const char *key, int64_t size )
+{
+	unsigned int hash = shared_hash( key );
+	shared_entry *link = shared_find( shared, key, hash );
+	shared_entry entry;
+
+	// Replace an older copy
+	if ( *link )
+		shared_remove( shared, link );
+	shared_evict( shared, size );
+	entry = calloc( 1, sizeof( *entry ) );
+	if ( entry )
+	{
+		entry->key = strdup( key );
+		entry->hash = hash;
+		entry->size = size;
+		if ( shared->count >= shared->bucket_count )
+			shared_grow( shared );
+		link = &shared->buckets[ hash & ( shared->bucket_count - 1 ) ];
+		entry->chain = *link;
+		*link = entry;
+		shared_push_front( shared, entry );
+		shared->bytes += size;
+		shared->count++;
+	}
+	return entry;
+}
+
+/* Find an entry and make it the most recently used, called with the mutex held */
+static shared_entry shared_lookup( shared_cache shared, const char *key )
+{
+	shared_entry entry = *shared_find( shared, key, shared_hash( key ) );
+	if ( entry )
+	{
+		shared_unlink( shared, entry );
+		shared_push_front( shared, entry );
+		shared->hits++;
+	}
+	else
+	{
+		shared->misses++;
+	}
+	return entry;
+}
+
+/** Set the maximum number of bytes held by the shared frame cache.
+ *
+ * The budget defaults to the value of the environment variable
+ * \envvar MLT_FRAME_CACHE_BYTES or 0, which disables the shared cache.
+ *
+ * \public \memberof mlt_cache_s
+ * \param bytes the byte budget
+ */
+
+void mlt_cache_shared_set_budget( int64_t bytes )
+{
+	shared_set_budget( &shared_frames, bytes );
+}
+
+/** Get the maximum number of bytes held by the shared frame cache.
+ *
+ * \public \memberof mlt_cache_s
+ * \return the byte budget, 0 if the shared cache is disabled
+ */
+
+int64_t mlt_cache_shared_get_budget( )
+{
+	return shared_get_budget( &shared_frames );
+}
+
+/** Put a frame in the shared frame cache.
+ *
+ * The frame is cloned with deep copy. The key should identify everything that
+ * determines the image and audio, for example the resource, stream, position,
+ * format, and size.
+ *
+ * \public \memberof mlt_cache_s
+ * \param key a string that identifies the frame
+ * \param frame the frame to cache
+ */
+
+void mlt_cache_shared_put_frame( const char *key, mlt_frame frame )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int image_size = 0, alpha_size = 0, audio_size = 0;
+	int64_t size;
+
+	if ( !key || !frame || mlt_cache_shared_get_budget( ) <= 0 )
+		return;
+
+	mlt_properties_get_data( properties, "image", &image_size );
+	mlt_properties_get_data( properties, "alpha", &alpha_size );
+	mlt_properties_get_data( properties, "audio", &audio_size );
+	size = (int64_t) image_size + alpha_size + audio_size;
+
+	pthread_mutex_lock( &shared_frames.mutex );
+	if ( size <= shared_frames.budget )
+	{
+		shared_entry entry = shared_insert( &shared_frames, key, size );
+		if ( entry )
+			entry->frame = mlt_frame_clone( frame, 1 );
+	}
+	pthread_mutex_unlock( &shared_frames.mutex );
+}
+
+/** Get a frame from the shared frame cache.
+ *
+ * You must call mlt_frame_close() on the frame you receive from this.
+ *
+ * \public \memberof mlt_cache_s
+ * \param key a string that identifies the frame
+ * \return a deep copy of the frame or NULL if it is not in the cache
+ */
+
+mlt_frame mlt_cache_shared_get_frame( const char *key )
+{
+	mlt_frame result = NULL;
+
+	if ( !key || mlt_cache_shared_get_budget( ) <= 0 )
+		return NULL;
+
+	pthread_mutex_lock( &shared_frames.mutex );
+	shared_entry entry = shared_lookup( &shared_frames, key );
+	if ( entry )
+		result = mlt_frame_clone( entry->frame, 1 );
+	pthread_mutex_unlock( &shared_frames.mutex );
+
+	return result;
+}
+
+/** Get the counters of the shared frame cache.
+ *
+ * Any of the parameters may be NULL.
+ *
+ * \public \memberof mlt_cache_s
+ * \param[out] hits the number of lookups that found a frame
+ * \param[out] misses the number of lookups that did not find a frame
+ * \param[out] bytes the number of bytes currently held
+ * \param[out] count the number of frames currently held
+ */
+
+void mlt_cache_shared_stats( int64_t *hits, int64_t *misses, int64_t *bytes, int *count )
+{
+	pthread_mutex_lock( &shared_frames.mutex );
+	if ( hits ) *hits = shared_frames.hits;
+	if ( misses ) *misses = shared_frames.misses;
+	if ( bytes ) *bytes = shared_frames.bytes;
+	if ( count ) *count = shared_frames.count;
+	mlt_log_debug( NULL, "%s: %d frames, %" PRId64 " of %" PRId64 " bytes, hit rate %.1f%%\n", __FUNCTION__,
+		shared_frames.count, shared_frames.bytes, shared_frames.budget,
+		shared_frames.hits + shared_frames.misses ? 100.0 * shared_frames.hits / ( shared_frames.hits + shared_frames.misses ) : 0.0 );
+	pthread_mutex_unlock( &shared_frames.mutex );
+}
+
+/** Set the maximum number of bytes held by the shared data cache.
+ *
+ * The budget defaults to the value of the environment variable
+ * \envvar MLT_DATA_CACHE_BYTES or 64 MiB. Data that is referenced by a
+ * cache item is not released when it is evicted.
+ *
+ * \public \memberof mlt_cache_s
+ * \param bytes the byte budget, 0 to disable caching
+ */
+
+void mlt_cache_shared_set_data_budget( int64_t bytes )
+{
+	shared_set_budget( &shared_data, bytes );
+}
+
+/** Get the maximum number of bytes held by the shared data cache.
+ *
+ * \public \memberof mlt_cache_s
+ * \return the byte budget
+ */
+
+int64_t mlt_cache_shared_get_data_budget( )
+{
+	return shared_get_budget( &shared_data );
+}
+
+/** Put a chunk of data in the shared data cache.
+ *
+ * The cache takes ownership of the data. The returned item holds a
+ * reference for the caller even if the data is too big to be cached, so the
+ * data stays valid until you call mlt_cache_item_close().
+ *
+ * \public \memberof mlt_cache_s
+ * \param key a string that identifies the data
+ * \param data an opaque pointer to the data to cache
+ * \param size the size of the data in bytes
+ * \param destructor a function to release the data
+ * \return a cache item or NULL if out of memory, in which case the data is released
+ */
+
+mlt_cache_item mlt_cache_shared_put_data( const char *key, void *data, int size, mlt_destructor destructor )
+{
+	mlt_cache_item item = calloc( 1, sizeof( mlt_cache_item_s ) );
+
+	if ( !item )
+	{
+		if ( destructor )
+			destructor( data );
+		return NULL;
+	}
+	item->data = data;
+	item->size = size;
+	item->destructor = destructor;
+	item->refcount = 1;
+
+	pthread_mutex_lock( &shared_data.mutex );
+	shared_init( &shared_data );
+	if ( key && size <= shared_data.budget )
+	{
+		shared_entry entry = shared_insert( &shared_data, key, size );
+		if ( entry )
+		{
+			entry->item = item;
+			item->refcount++;
+		}
+	}
+	pthread_mutex_unlock( &shared_data.mutex );
+
+	return item;
+}
+
+/** Get a chunk of data from the shared data cache.
+ *
+ * You must call mlt_cache_item_close() when you no longer need the data.
+ *
+ * \public \memberof mlt_cache_s
+ * \param key a string that identifies the data
+ * \return a cache item or NULL if the data is not in the cache
+ */
+
+mlt_cache_item mlt_cache_shared_get_data( const char *key )
+{
+	mlt_cache_item result = NULL;
+
+	if ( !key )
+		return NULL;
+
+	pthread_mutex_lock( &shared_data.mutex );
+	shared_init( &shared_data );
+	shared_entry entry = shared_lookup( &shared_data, key );
+	if ( entry )
+	{
+		result = entry->item;
+		result->refcount++;
+	}
+	pthread_mutex_unlock( &shared_data.mutex );
+
+	return result;
+}
+
+static void shared_data_release( mlt_cache_item item )
+{
+	pthread_mutex_lock( &shared_data.mutex );
+	shared_item_release( item );
+	pthread_mutex_unlock( &shared_data.mutex );
+}
+
+// Get the directory of a cache, or NULL.
+static char *cache_directory( const char *env, const char *name )
+{
+	const char *value = getenv( env );
+	char *dir = NULL;
+
+	if ( value )
+	{
+		dir = strdup( value );
+	}
+	else
+	{
+		const char *base = getenv( "XDG_CACHE_HOME" );
+		const char *prefix = "/mlt/";
+		if ( !base )
+		{
+			base = getenv( "HOME" );
+			prefix = "/.cache/mlt/";
+		}
+		if ( base )
+		{
+			dir = malloc( strlen( base ) + strlen( prefix ) + strlen( name ) + 1 );
+			if ( dir )
+				sprintf( dir, "%s%s%s", base, prefix, name );
+		}
+	}
+	return dir;
+}
+
+// Create a directory and its parents.
+static int make_directory( char *path )
+{
+	char *p;
+	struct stat st;
+
+	for ( p = path + 1; *p; p++ )
+	{
+		if ( *p == '/' )
+		{
+			*p = '\0';
+#ifdef _WIN32
+			mkdir( path );
+#else
+			mkdir( path, 0755 );
+#endif
+			*p = '/';
+		}
+	}
+#ifdef _WIN32
+	mkdir( path );
+#else
+	mkdir( path, 0755 );
+#endif
+	return stat( path, &st ) || !S_ISDIR( st.st_mode );
+}
+
+/** Get the directory of an on-disk cache.
+ *
+ * The directory is $env, or else mlt/name in $XDG_CACHE_HOME or $HOME/.cache.
+ *
+ * \public \memberof mlt_cache_s
+ * \param env the environment variable that can override the directory
+ * \param name the name of the cache
+ * \param create whether to create the directory
+ * \return the directory for the caller to free or NULL if there is none
+ */
+
+char *mlt_cache_directory( const char *env, const char *name, int create )
+{
+	char *dir = cache_directory( env, name );
+	if ( dir && create && make_directory( dir ) )
+	{
+		free( dir );
+		dir = NULL;
+	}
+	return dir;
+}
+
+/** Get the name of a file in an on-disk cache about a media file.
+ *
+ * The name is keyed by the resource, its size and modification time, so a
+ * changed file does not find the cache of its previous version. The cache
+ * directory is $env, or else mlt/name in $XDG_CACHE_HOME or $HOME/.cache.
+ *
+ * \public \memberof mlt_cache_s
+ * \param resource the name of a regular file
+ * \param env the environment variable that can override the directory
+ * \param name the name of the cache
+ * \param suffix appended to the file name
+ * \param create whether to create the directory
+ * \return the file name for the caller to free or NULL if there is none
+ */
+
+char *mlt_cache_filename( const char *resource, const char *env, const char *name, const char *suffix, int create )
+{
+	struct stat st;
+	uint64_t hash = 14695981039346656037ULL;
+	const char *s;
+	char *dir;
+	char *filename = NULL;
+
+	if ( !resource || stat( resource, &st ) || !S_ISREG( st.st_mode ) )
+		return NULL;
+	for ( s = resource; *s; s++ )
+		hash = ( hash ^ (unsigned char) *s ) * 1099511628211ULL;
+	dir = mlt_cache_directory( env, name, create );
+	if ( dir )
+	{
+		filename = malloc( strlen( dir ) + strlen( suffix ) + 56 );
+		if ( filename )
+			sprintf( filename, "%s/%016" PRIx64 "-%" PRIx64 "-%" PRIx64 "%s", dir, hash,
+				(uint64_t) st.st_size, (uint64_t) st.st_mtime, suffix );
+	}
+	free( dir );
+	return filename;
+}
@@ -37,5 +37,16 @@ extern void mlt_cache_put( mlt_cache cache, void *object, void* data, int size,
 extern mlt_cache_item mlt_cache_get( mlt_cache cache, void *object );
 extern void mlt_cache_put_frame( mlt_cache cache, mlt_frame frame );
 extern mlt_frame mlt_cache_get_frame( mlt_cache cache, mlt_position position );
+extern void mlt_cache_shared_set_budget( int64_t bytes );
+extern int64_t mlt_cache_shared_get_budget( );
+extern void mlt_cache_shared_put_frame( const char *key, mlt_frame frame );
+extern mlt_frame mlt_cache_shared_get_frame( const char *key );
+extern void mlt_cache_shared_stats( int64_t *hits, int64_t *misses, int64_t *bytes, int *count );
+extern void mlt_cache_shared_set_data_budget( int64_t bytes );
+extern int64_t mlt_cache_shared_get_data_budget( );
+extern mlt_cache_item mlt_cache_shared_put_data( const char *key, void *data, int size, mlt_destructor destructor );
+extern mlt_cache_item mlt_cache_shared_get_data( const char *key );
+extern char *mlt_cache_directory( const char *env, const char *name, int create );
+extern char *mlt_cache_filename( const char *resource, const char *env, const char *name, const char *suffix, int create );
 
 #endif
@@ -26,6 +26,12 @@
 #include "mlt_frame.h"
 #include "mlt_profile.h"
 #include "mlt_log.h"
+#include "mlt_queue.h"
+#include "mlt_slices.h"
+#include "mlt_memory.h"
+#include "mlt_trace.h"
+#include "mlt_metrics.h"
+#include "mlt_job.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -52,15 +58,20 @@ typedef struct
 	mlt_audio_format audio_format;
 	mlt_deque queue;
 	void *ahead_thread;
+	mlt_deque audio_queue;
+	void *audio_thread;
+	int audio_purge;
 	pthread_mutex_t queue_mutex;
 	pthread_cond_t queue_cond;
 	pthread_mutex_t put_mutex;
 	pthread_cond_t put_cond;
-	mlt_frame put;
+	mlt_deque put;
 	int put_active;
+	int64_t put_latency;
 	mlt_event event_listener;
 	mlt_position position;
 	int is_purge;
+	int scrub_serial;
 	int aud_counter;
 	double fps;
 	int channels;
@@ -73,8 +84,30 @@ typedef struct
 	int consecutive_dropped;
 	int consecutive_rendered;
 	int process_head;
+	mlt_queue work;
+	int work_pushed;
+	int work_played;
 	int started;
-	pthread_t *threads; /**< used to deallocate all threads */
+	int trace;
+	int worker_count;
+	mlt_memory_client memory;
+	int64_t trace_shown;
+	mlt_metric metric_frames;
+	mlt_metric metric_dropped;
+	mlt_metric metric_render;
+	mlt_metric metric_encode;
+	mlt_metric metric_queue;
+	mlt_metric metric_speculated;
+	int64_t metric_shown;
+	mlt_position speculate_center;  /**< the paused position that the speculation is around */
+	int speculate_index;            /**< the next of the positions around it to render */
+	int speculate_serial;           /**< the purge the speculation was started after */
+	int holds_jobs;                 /**< whether playback holds the background jobs */
+	int fast_start;                 /**< whether to show the first frame before the prefill */
+	int growing;                    /**< whether the read-ahead is still filling after a fast start */
+	int first_frame_pending;        /**< whether the first frame since the start is still to come */
+	int64_t start_time;             /**< when the consumer was started, in microseconds */
+	mlt_metric metric_first_frame;
 }
 consumer_private;
 
@@ -82,14 +115,18 @@ typedef void* ( *thread_function_t )( void* );
 
 static void mlt_consumer_frame_render( mlt_listener listener, mlt_properties owner, mlt_service self, void **args );
 static void mlt_consumer_frame_show( mlt_listener listener, mlt_properties owner, mlt_service self, void **args );
+static void mlt_consumer_frame_stats( mlt_listener listener, mlt_properties owner, mlt_service self, void **args );
 static void mlt_consumer_property_changed( mlt_properties owner, mlt_consumer self, char *name );
 static void apply_profile_properties( mlt_consumer self, mlt_profile profile, mlt_properties properties );
 static void on_consumer_frame_show( mlt_properties owner, mlt_consumer self, mlt_frame frame );
+static void on_profile_changed( mlt_properties owner, mlt_consumer self );
 static void transmit_thread_create( mlt_listener listener, mlt_properties owner, mlt_service self, void **args );
-static void mlt_thread_create( mlt_consumer self, thread_function_t function );
+static void *mlt_thread_create( mlt_consumer self, thread_function_t function );
 static void transmit_thread_join( mlt_listener listener, mlt_properties owner, mlt_service self, void **args );
-static void mlt_thread_join( mlt_consumer self );
+static void mlt_thread_join( mlt_consumer self, void *handle );
 static void consumer_read_ahead_start( mlt_consumer self );
+static void worker_queue_purge( mlt_consumer self );
+static void put_clear( consumer_private *priv );
 
 /** Initialize a consumer service.
  *
@@ -148,6 +185,7 @@ int mlt_consumer_init( mlt_consumer self, void *child, mlt_profile profile )
 
 		mlt_events_register( properties, "consumer-frame-show", ( mlt_transmitter )mlt_consumer_frame_show );
 		mlt_events_register( properties, "consumer-frame-render", ( mlt_transmitter )mlt_consumer_frame_render );
+		mlt_events_register( properties, "consumer-frame-stats", ( mlt_transmitter )mlt_consumer_frame_stats );
 		mlt_events_register( properties, "consumer-thread-started", NULL );
 		mlt_events_register( properties, "consumer-thread-stopped", NULL );
 		mlt_events_register( properties, "consumer-stopping", NULL );
@@ -155,19 +193,47 @@ int mlt_consumer_init( mlt_consumer self, void *child, mlt_profile profile )
 		mlt_events_register( properties, "consumer-thread-create", ( mlt_transmitter )transmit_thread_create );
 		mlt_events_register( properties, "consumer-thread-join", ( mlt_transmitter )transmit_thread_join );
 		mlt_events_listen( properties, self, "consumer-frame-show", ( mlt_listener )on_consumer_frame_show );
+		mlt_events_listen( properties, self, "profile-changed", ( mlt_listener )on_profile_changed );
 
 		// Register a property-changed listener to handle the profile property -
 		// subsequent properties can override the profile
 		priv->event_listener = mlt_events_listen( properties, self, "property-changed", ( mlt_listener )mlt_consumer_property_changed );
 
-		// Create the push mutex and condition
+		// Create the push mutex, condition and queue
 		pthread_mutex_init( &priv->put_mutex, NULL );
 		pthread_cond_init( &priv->put_cond, NULL );
+		priv->put = mlt_deque_init( );
 
 	}
 	return error;
 }
 
+/** The profile-changed event handler.
+ *
+ * Takes the new profile into the properties and drops the frames that were
+ * rendered in the old one, so the next frame is already in the new profile.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param owner the events object
+ * \param self the consumer
+ */
+
+static void on_profile_changed( mlt_properties owner, mlt_consumer self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( self ) );
+	consumer_private *priv = self->local;
+
+	if ( profile == NULL )
+		return;
+	apply_profile_properties( self, profile, properties );
+	if ( profile->frame_rate_num && profile->frame_rate_den )
+		mlt_properties_set_int( properties, "frame_duration", 1000000 / profile->frame_rate_num * profile->frame_rate_den );
+	priv->fps = mlt_profile_fps( profile );
+	if ( !mlt_consumer_is_stopped( self ) )
+		mlt_consumer_purge( self );
+}
+
 /** Convert the profile into properties on the consumer.
  *
  * \private \memberof mlt_consumer_s
@@ -234,6 +300,10 @@ static void mlt_consumer_property_changed( mlt_properties owner, mlt_consumer se
 			// Apply to properties
 			apply_profile_properties( self, profile, properties );
 			mlt_profile_close( new_profile );
+
+			// Switch the connected services over without rebuilding them
+			if ( mlt_service_producer( MLT_CONSUMER_SERVICE( self ) ) )
+				mlt_service_profile_changed( MLT_CONSUMER_SERVICE( self ) );
 		}
  	}
 	else if ( !strcmp( name, "frame_rate_num" ) )
@@ -360,9 +430,26 @@ static void mlt_consumer_frame_render( mlt_listener listener, mlt_properties own
 		listener( owner, self, ( mlt_frame )args[ 0 ] );
 }
 
+/** The transmitter for the consumer-frame-stats event
+ *
+ * Invokes the listener with the frame and its stats.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param listener a function pointer that will be invoked
+ * \param owner the events object that will be passed to \p listener
+ * \param self a service that will be passed to \p listener
+ * \param args an array of pointers - the first is the frame and the second its stats
+ */
+
+static void mlt_consumer_frame_stats( mlt_listener listener, mlt_properties owner, mlt_service self, void **args )
+{
+	if ( listener != NULL )
+		listener( owner, self, ( mlt_frame )args[ 0 ], ( mlt_properties )args[ 1 ] );
+}
+
 /** A listener on the consumer-frame-show event
  *
- * Saves the position of the frame shown.
+ * Saves the position of the frame shown and sends the stats of a traced frame.
  *
  * \private \memberof mlt_consumer_s
  * \param owner the events object
@@ -373,7 +460,14 @@ static void mlt_consumer_frame_render( mlt_listener listener, mlt_properties own
 static void on_consumer_frame_show( mlt_properties owner, mlt_consumer consumer, mlt_frame frame )
 {
 	if ( frame )
-		( ( consumer_private*) consumer->local )->position = mlt_frame_get_position( frame );
+	{
+		consumer_private *priv = consumer->local;
+		mlt_properties stats = priv->trace ? mlt_frame_trace_stats( frame, 0 ) : NULL;
+
+		priv->position = mlt_frame_get_position( frame );
+		if ( stats )
+			mlt_events_fire( MLT_CONSUMER_PROPERTIES( consumer ), "consumer-frame-stats", frame, stats, NULL );
+	}
 }
 
 /** Create a new consumer.
@@ -524,8 +618,9 @@ int mlt_consumer_start( mlt_consumer self )
 
 	// Just to make sure nothing is hanging around...
 	pthread_mutex_lock( &priv->put_mutex );
-	priv->put = NULL;
+	put_clear( priv );
 	priv->put_active = 1;
+	priv->put_latency = 0;
 	pthread_mutex_unlock( &priv->put_mutex );
 
 	// Deal with it now.
@@ -580,6 +675,50 @@ int mlt_consumer_start( mlt_consumer self )
 	// Set the real_time preference
 	priv->real_time = mlt_properties_get_int( properties, "real_time" );
 
+	// Time the first frame and see whether to show it before the prefill
+	priv->start_time = mlt_trace_now( );
+	priv->first_frame_pending = 1;
+	priv->fast_start = priv->real_time && mlt_properties_get_int( properties, "fast_start" );
+	priv->growing = priv->fast_start;
+
+	// Hold the background jobs while frames may be dropped
+	if ( priv->real_time > 0 && !priv->holds_jobs )
+	{
+		mlt_job_realtime_enter( );
+		priv->holds_jobs = 1;
+	}
+
+	// Get the metrics for monitoring, NULL unless they are enabled
+	priv->metric_frames = mlt_metrics_service( mlt_metric_counter, "mlt_consumer_frames_total",
+		"Frames delivered to the consumer.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_dropped = mlt_metrics_service( mlt_metric_counter, "mlt_consumer_frames_dropped_total",
+		"Frames delivered without rendering their image in time.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_render = mlt_metrics_service( mlt_metric_histogram, "mlt_consumer_render_seconds",
+		"Time to render the image of a frame.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_encode = mlt_metrics_service( mlt_metric_histogram, "mlt_consumer_encode_seconds",
+		"Time the consumer spent on a frame between requests, such as to encode or show it.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_queue = mlt_metrics_service( mlt_metric_gauge, "mlt_consumer_queue_frames",
+		"Frames waiting in the read-ahead queue.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_speculated = mlt_metrics_service( mlt_metric_counter, "mlt_consumer_speculated_frames_total",
+		"Frames rendered around the paused position while idle.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_first_frame = mlt_metrics_service( mlt_metric_histogram, "mlt_consumer_first_frame_seconds",
+		"Time from starting the consumer to its first frame.", MLT_CONSUMER_SERVICE( self ) );
+	priv->metric_shown = 0;
+
+	// Have the services time their work on the frames
+	priv->trace = mlt_properties_get_int( properties, "trace" );
+	if ( priv->trace )
+		mlt_frame_trace_enable( 1 );
+
+	// Let the transitions of a connected tractor render its tracks concurrently
+	if ( mlt_properties_get( properties, "parallel_tracks" ) )
+	{
+		mlt_service producer = mlt_service_producer( MLT_CONSUMER_SERVICE( self ) );
+		if ( producer && mlt_service_identify( producer ) == tractor_type )
+			mlt_properties_set_int( MLT_SERVICE_PROPERTIES( producer ), "parallel_tracks",
+				mlt_properties_get_int( properties, "parallel_tracks" ) );
+	}
+
 	// For worker threads implementation, buffer must be at least # threads
 	if ( abs( priv->real_time ) > 1 && mlt_properties_get_int( properties, "buffer" ) <= abs( priv->real_time ) )
 		mlt_properties_set_int( properties, "_buffer", abs( priv->real_time ) + 1 );
@@ -603,9 +742,66 @@ int mlt_consumer_start( mlt_consumer self )
 	return error;
 }
 
+static int64_t put_time( )
+{
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	return ( int64_t ) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/* Close the frames put but not taken, called with the put mutex held. */
+static void put_clear( consumer_private *priv )
+{
+	while ( mlt_deque_count( priv->put ) )
+		mlt_frame_close( mlt_deque_pop_front( priv->put ) );
+}
+
+/* Queue a frame put into the consumer, waiting up to \p timeout
+ * milliseconds for room, or while the consumer runs if it is negative.
+ * The caller keeps the frame if this fails.
+ */
+static int put_frame( mlt_consumer self, mlt_frame frame, int timeout )
+{
+	consumer_private *priv = self->local;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	int depth = MAX( 1, mlt_properties_get_int( properties, "put_depth" ) );
+	int64_t deadline = timeout > 0 ? put_time( ) + timeout * 1000LL : 0;
+	struct timespec tm;
+	int error = 1;
+
+	mlt_properties_set_int( properties, "put_pending", 1 );
+	pthread_mutex_lock( &priv->put_mutex );
+	while ( priv->put_active && mlt_deque_count( priv->put ) >= depth && timeout != 0 )
+	{
+		int64_t now = put_time( );
+		int64_t wake = now + 1000000;
+		if ( timeout > 0 )
+		{
+			if ( now >= deadline )
+				break;
+			wake = MIN( wake, deadline );
+		}
+		tm.tv_sec = wake / 1000000;
+		tm.tv_nsec = ( wake % 1000000 ) * 1000;
+		pthread_cond_timedwait( &priv->put_cond, &priv->put_mutex, &tm );
+	}
+	mlt_properties_set_int( properties, "put_pending", 0 );
+	if ( priv->put_active && mlt_deque_count( priv->put ) < depth )
+	{
+		mlt_properties_set_int64( MLT_FRAME_PROPERTIES( frame ), "_put_time", put_time( ) );
+		mlt_deque_push_back( priv->put, frame );
+		error = 0;
+	}
+	pthread_cond_broadcast( &priv->put_cond );
+	pthread_mutex_unlock( &priv->put_mutex );
+
+	return error;
+}
+
 /** An alternative method to feed frames into the consumer.
  *
- * Only valid if the consumer itself is not connected.
+ * Only valid if the consumer itself is not connected. This waits while the
+ * consumer has \em put_depth frames that it has not taken yet.
  *
  * \public \memberof mlt_consumer_s
  * \param self a consumer
@@ -615,40 +811,68 @@ int mlt_consumer_start( mlt_consumer self )
 
 int mlt_consumer_put_frame( mlt_consumer self, mlt_frame frame )
 {
-	int error = 1;
+	if ( mlt_service_producer( MLT_CONSUMER_SERVICE( self ) ) != NULL || put_frame( self, frame, -1 ) )
+		mlt_frame_close( frame );
 
-	// Get the service associated to the consumer
-	mlt_service service = MLT_CONSUMER_SERVICE( self );
+	return 1;
+}
 
-	if ( mlt_service_producer( service ) == NULL )
-	{
-		struct timeval now;
-		struct timespec tm;
-		consumer_private *priv = self->local;
+/** Feed a frame into the consumer without waiting long for room.
+ *
+ * This is mlt_consumer_put_frame() for callers that apply flow control:
+ * when the consumer already has \em put_depth frames it has not taken, it
+ * waits at most \p timeout milliseconds and then gives the frame back.
+ *
+ * \public \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param frame a frame, which the consumer takes if this succeeds
+ * \param timeout the milliseconds to wait for room, 0 to not wait
+ * \return true if the frame was not queued and still belongs to the caller
+ */
 
-		mlt_properties_set_int( MLT_CONSUMER_PROPERTIES(self), "put_pending", 1 );
-		pthread_mutex_lock( &priv->put_mutex );
-		while ( priv->put_active && priv->put != NULL )
-		{
-			gettimeofday( &now, NULL );
-			tm.tv_sec = now.tv_sec + 1;
-			tm.tv_nsec = now.tv_usec * 1000;
-			pthread_cond_timedwait( &priv->put_cond, &priv->put_mutex, &tm );
-		}
-		mlt_properties_set_int( MLT_CONSUMER_PROPERTIES(self), "put_pending", 0 );
-		if ( priv->put_active && priv->put == NULL )
-			priv->put = frame;
-		else
-			mlt_frame_close( frame );
-		pthread_cond_broadcast( &priv->put_cond );
-		pthread_mutex_unlock( &priv->put_mutex );
-	}
-	else
-	{
-		mlt_frame_close( frame );
-	}
+int mlt_consumer_put_frame_timeout( mlt_consumer self, mlt_frame frame, int timeout )
+{
+	if ( mlt_service_producer( MLT_CONSUMER_SERVICE( self ) ) != NULL )
+		return 1;
+	return put_frame( self, frame, MAX( 0, timeout ) );
+}
 
-	return error;
+/** Get the number of frames put into the consumer that it has not taken.
+ *
+ * \public \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return the number of frames queued
+ */
+
+int mlt_consumer_put_count( mlt_consumer self )
+{
+	consumer_private *priv = self->local;
+	int count;
+
+	pthread_mutex_lock( &priv->put_mutex );
+	count = mlt_deque_count( priv->put );
+	pthread_mutex_unlock( &priv->put_mutex );
+
+	return count;
+}
+
+/** Get how long the last frame taken from those put waited in the queue.
+ *
+ * \public \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return the time in seconds
+ */
+
+double mlt_consumer_put_latency( mlt_consumer self )
+{
+	consumer_private *priv = self->local;
+	int64_t latency;
+
+	pthread_mutex_lock( &priv->put_mutex );
+	latency = priv->put_latency;
+	pthread_mutex_unlock( &priv->put_mutex );
+
+	return latency / 1000000.0;
 }
 
 /** Protected method for consumer to get frames from connected service
@@ -669,6 +893,9 @@ mlt_frame mlt_consumer_get_frame( mlt_consumer self )
 	// Get the consumer properties
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
 
+	// Time the whole of getting the frame when tracing
+	int64_t trace_begin = ( ( consumer_private* ) self->local )->trace ? mlt_log_timings_now() : 0;
+
 	// Get the frame
 	if ( mlt_service_producer( service ) == NULL && mlt_properties_get_int( properties, "put_mode" ) )
 	{
@@ -677,15 +904,16 @@ mlt_frame mlt_consumer_get_frame( mlt_consumer self )
 		consumer_private *priv = self->local;
 
 		pthread_mutex_lock( &priv->put_mutex );
-		while ( priv->put_active && priv->put == NULL )
+		while ( priv->put_active && mlt_deque_count( priv->put ) == 0 )
 		{
 			gettimeofday( &now, NULL );
 			tm.tv_sec = now.tv_sec + 1;
 			tm.tv_nsec = now.tv_usec * 1000;
 			pthread_cond_timedwait( &priv->put_cond, &priv->put_mutex, &tm );
 		}
-		frame = priv->put;
-		priv->put = NULL;
+		frame = mlt_deque_pop_front( priv->put );
+		if ( frame )
+			priv->put_latency = put_time( ) - mlt_properties_get_int64( MLT_FRAME_PROPERTIES( frame ), "_put_time" );
 		pthread_cond_broadcast( &priv->put_cond );
 		pthread_mutex_unlock( &priv->put_mutex );
 		if ( frame != NULL )
@@ -715,11 +943,25 @@ mlt_frame mlt_consumer_get_frame( mlt_consumer self )
 		// Pass along the interpolation and deinterlace options
 		// TODO: get rid of consumer_deinterlace and use profile.progressive
 		mlt_properties_set( frame_properties, "rescale.interp", mlt_properties_get( properties, "rescale" ) );
+		mlt_properties_set( frame_properties, "resample.quality", mlt_properties_get( properties, "resample_quality" ) );
 		mlt_properties_set_int( frame_properties, "consumer_deinterlace", mlt_properties_get_int( properties, "progressive" ) | mlt_properties_get_int( properties, "deinterlace" ) );
 		mlt_properties_set( frame_properties, "deinterlace_method", mlt_properties_get( properties, "deinterlace_method" ) );
 		mlt_properties_set_int( frame_properties, "consumer_tff", mlt_properties_get_int( properties, "top_field_first" ) );
 		mlt_properties_set( frame_properties, "consumer_color_trc", mlt_properties_get( properties, "color_trc" ) );
 		mlt_properties_set( frame_properties, "consumer_channel_layout", mlt_properties_get( properties, "channel_layout" ) );
+
+		// While scrubbing, ask for fast decoding and remember the seek this frame belongs to
+		if ( mlt_properties_get_int( properties, "scrub" ) )
+		{
+			mlt_properties_set_int( frame_properties, "consumer_scrub", 1 );
+			mlt_properties_set_int( frame_properties, "_scrub_serial", ( ( consumer_private* ) self->local )->scrub_serial );
+			mlt_properties_set( frame_properties, "rescale.interp", "nearest" );
+			mlt_properties_set( frame_properties, "deinterlace_method", "onefield" );
+		}
+
+		// Start the stats of a traced frame
+		if ( trace_begin && mlt_frame_trace_stats( frame, 1 ) )
+			mlt_frame_trace( frame, NULL, "frame", mlt_log_timings_now() - trace_begin );
 	}
 
 	// Return the frame
@@ -742,6 +984,180 @@ static inline long time_difference( struct timeval *time1 )
 	return time1->tv_sec * 1000000 + time1->tv_usec - time2.tv_sec * 1000000 - time2.tv_usec;
 }
 
+/** Determine if a frame of a scrub was overtaken by a later seek.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param frame a frame
+ * \return true if the frame should not be rendered
+ */
+
+static inline int scrub_is_stale( mlt_consumer self, mlt_frame frame )
+{
+	consumer_private *priv = self->local;
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	return mlt_properties_get_int( properties, "consumer_scrub" )
+		&& mlt_properties_get_int( properties, "_scrub_serial" ) != priv->scrub_serial;
+}
+
+/** Get the audio of a frame, reduced to a short grain while scrubbing.
+ *
+ * The grain is the start of the audio of the frame, scrub_grain milliseconds
+ * long with a fade at either end, followed by silence. It is a copy, because
+ * the audio may be shared with a cache.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param frame a frame
+ */
+
+static void consumer_get_audio( mlt_consumer self, mlt_frame frame )
+{
+	consumer_private *priv = self->local;
+	int samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
+	void *audio = NULL;
+
+	mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
+	if ( audio && samples > 0 && priv->channels > 0 && mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_scrub" ) )
+	{
+		int grain = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "scrub_grain" );
+		int size = mlt_audio_format_size( priv->audio_format, samples, priv->channels );
+		int channels = priv->channels;
+		uint8_t *copy = mlt_pool_alloc( size );
+		int length, fade, i, c;
+
+		if ( !copy || priv->audio_format == mlt_audio_none )
+		{
+			mlt_pool_release( copy );
+			return;
+		}
+		memcpy( copy, audio, size );
+		length = MIN( MAX( ( grain > 0 ? grain : 20 ) * priv->frequency / 1000, 1 ), samples );
+		fade = MAX( length / 4, 1 );
+		for ( i = 0; i < samples; i++ )
+		{
+			double gain = i >= length ? 0.0 : i < fade ? (double) i / fade : i >= length - fade ? (double) ( length - i ) / fade : 1.0;
+			if ( gain == 1.0 )
+				continue;
+			for ( c = 0; c < channels; c++ )
+			{
+				switch ( priv->audio_format )
+				{
+				case mlt_audio_s16:
+					( ( int16_t* ) copy )[ i * channels + c ] *= gain;
+					break;
+				case mlt_audio_s32le:
+					( ( int32_t* ) copy )[ i * channels + c ] *= gain;
+					break;
+				case mlt_audio_f32le:
+					( ( float* ) copy )[ i * channels + c ] *= gain;
+					break;
+				case mlt_audio_s32:
+					( ( int32_t* ) copy )[ c * samples + i ] *= gain;
+					break;
+				case mlt_audio_float:
+					( ( float* ) copy )[ c * samples + i ] *= gain;
+					break;
+				case mlt_audio_u8:
+					copy[ i * channels + c ] = 128 + ( copy[ i * channels + c ] - 128 ) * gain;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+		mlt_frame_set_audio( frame, copy, priv->audio_format, size, mlt_pool_release );
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "audio_samples", samples );
+	}
+}
+
+/** The thread procedure for rendering the audio of frames ahead of their images.
+ *
+ * It gets the frames and their audio up to audio_buffer frames before the
+ * read-ahead thread, which renders the images, so that a slow image holds
+ * back only the images behind it.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param arg a consumer
+ */
+
+static void *consumer_audio_ahead_thread( void *arg )
+{
+	mlt_consumer self = arg;
+	consumer_private *priv = self->local;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	int audio_off = mlt_properties_get_int( properties, "audio_off" );
+	int speed = 1;
+
+	mlt_events_fire( properties, "consumer-thread-started", NULL );
+	mlt_trace_thread( "consumer audio" );
+
+	while ( priv->ahead )
+	{
+		mlt_frame frame = mlt_consumer_get_frame( self );
+		if ( frame )
+		{
+			speed = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_speed" );
+			if ( !audio_off )
+				consumer_get_audio( self, frame );
+		}
+
+		// Stay no further ahead than the audio buffer, and a frame while paused
+		int buffer = speed == 0 || mlt_properties_get_int( properties, "scrub" ) ? 1 :
+			MAX( mlt_properties_get_int( properties, "audio_buffer" ), 1 );
+		if ( mlt_memory_check( ) )
+			buffer = MIN( buffer, 2 );
+		pthread_mutex_lock( &priv->queue_mutex );
+		while ( priv->ahead && !priv->audio_purge && mlt_deque_count( priv->audio_queue ) >= buffer )
+			pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
+		if ( priv->audio_purge || !priv->ahead )
+		{
+			mlt_frame_close( frame );
+			priv->audio_purge = 0;
+		}
+		else if ( frame )
+		{
+			mlt_deque_push_back( priv->audio_queue, frame );
+		}
+		pthread_cond_broadcast( &priv->queue_cond );
+		pthread_mutex_unlock( &priv->queue_mutex );
+	}
+
+	mlt_events_fire( properties, "consumer-thread-stopped", NULL );
+
+	return NULL;
+}
+
+/** Get the next frame for the read-ahead thread with its audio.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param audio_off whether to skip the audio
+ * \return a frame or NULL when stopping
+ */
+
+static mlt_frame consumer_ahead_frame( mlt_consumer self, int audio_off )
+{
+	consumer_private *priv = self->local;
+	mlt_frame frame = NULL;
+
+	if ( !priv->audio_queue )
+	{
+		frame = mlt_consumer_get_frame( self );
+		if ( frame && !audio_off )
+			consumer_get_audio( self, frame );
+		return frame;
+	}
+
+	pthread_mutex_lock( &priv->queue_mutex );
+	while ( priv->ahead && !mlt_deque_count( priv->audio_queue ) )
+		pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
+	frame = mlt_deque_pop_front( priv->audio_queue );
+	pthread_cond_broadcast( &priv->queue_cond );
+	pthread_mutex_unlock( &priv->queue_mutex );
+	return frame;
+}
+
 /** The thread procedure for asynchronously pulling frames through the service
  * network connected to a consumer.
  *
@@ -749,6 +1165,161 @@ static inline long time_difference( struct timeval *time1 )
  * \param arg a consumer
  */
 
+/** Get the size of the images that the rendering threads request.
+ *
+ * This is the size of the consumer reduced by its preview_scale.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param properties the properties of a consumer
+ * \param[out] width the width of the images to render
+ * \param[out] height the height of the images to render
+ */
+
+static void get_render_size( mlt_properties properties, int *width, int *height )
+{
+	double scale = mlt_properties_get_double( properties, "preview_scale" );
+
+	*width = mlt_properties_get_int( properties, "width" );
+	*height = mlt_properties_get_int( properties, "height" );
+	if ( scale > 0.0 && scale < 1.0 )
+	{
+		*width = MAX( 2, ( int )( *width * scale + 0.5 ) & ~1 );
+		*height = MAX( 2, ( int )( *height * scale + 0.5 ) & ~1 );
+	}
+}
+
+/** Get the producer whose position a speculative render may move.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return the producer connected to the consumer or NULL if it is another kind of service
+ */
+
+static mlt_producer speculate_producer( mlt_consumer self )
+{
+	mlt_service service = mlt_service_producer( MLT_CONSUMER_SERVICE( self ) );
+
+	switch ( mlt_service_identify( service ) )
+	{
+	case producer_type:
+	case playlist_type:
+	case tractor_type:
+	case multitrack_type:
+		return MLT_PRODUCER( service );
+	default:
+		return NULL;
+	}
+}
+
+/** Choose the next position to render around the paused position.
+ *
+ * The positions alternate ahead and behind, nearest first, up to speculate
+ * frames ahead and speculate_behind frames behind. Moving the paused position
+ * or a purge starts again from the nearest.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param[out] position the position to render
+ * \return true if there is a position to render
+ */
+
+static int speculate_next( mlt_consumer self, mlt_position *position )
+{
+	consumer_private *priv = self->local;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	int ahead = mlt_properties_get_int( properties, "speculate" );
+	int behind = mlt_properties_get_int( properties, "speculate_behind" );
+	mlt_producer producer = speculate_producer( self );
+	mlt_position center, length;
+
+	// The audio thread would get frames while the position is moved
+	if ( ( ahead <= 0 && behind <= 0 ) || !producer || priv->audio_queue || mlt_memory_check( ) )
+		return 0;
+	center = mlt_producer_position( producer );
+	length = mlt_producer_get_playtime( producer );
+	if ( center != priv->speculate_center || priv->speculate_serial != priv->scrub_serial )
+	{
+		priv->speculate_center = center;
+		priv->speculate_serial = priv->scrub_serial;
+		priv->speculate_index = 0;
+	}
+	while ( priv->speculate_index < 2 * MAX( ahead, behind ) )
+	{
+		int distance = priv->speculate_index / 2 + 1;
+		int is_behind = priv->speculate_index % 2;
+
+		priv->speculate_index++;
+		*position = center + ( is_behind ? -distance : distance );
+		if ( distance <= ( is_behind ? behind : ahead ) && *position >= 0 && *position < length )
+			return 1;
+	}
+	return 0;
+}
+
+/** Render a frame at a position around the paused one to warm the caches.
+ *
+ * The image is rendered as for playback and dropped, so that the producers
+ * find it in their caches and the shared frame cache when the playback or a
+ * step reaches it. The position of the producer is put back, unless the
+ * application moved it meanwhile.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param position the position to render
+ */
+
+static void speculate( mlt_consumer self, mlt_position position )
+{
+	consumer_private *priv = self->local;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	mlt_producer producer = speculate_producer( self );
+	mlt_frame frame;
+
+	mlt_producer_seek( producer, position );
+	frame = mlt_consumer_get_frame( self );
+	if ( mlt_producer_position( producer ) == position )
+		mlt_producer_seek( producer, priv->speculate_center );
+
+	if ( frame )
+	{
+		if ( !mlt_properties_get_int( properties, "video_off" ) )
+		{
+			mlt_image_format format = priv->image_format;
+			uint8_t *image = NULL;
+			int width, height;
+
+			get_render_size( properties, &width, &height );
+			mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+		}
+		mlt_frame_close( frame );
+		mlt_metrics_add( priv->metric_speculated, 1 );
+	}
+}
+
+/** Estimate the bytes of the frames waiting in the queue for the memory budget.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param arg a consumer
+ * \return the number of frames times the size of a 4:2:2 image
+ */
+
+static int64_t queue_memory_usage( void *arg )
+{
+	mlt_consumer self = arg;
+	consumer_private *priv = self->local;
+	int width, height;
+	int64_t count;
+
+	get_render_size( MLT_CONSUMER_PROPERTIES( self ), &width, &height );
+	pthread_mutex_lock( &priv->queue_mutex );
+	count = priv->queue ? mlt_deque_count( priv->queue ) : 0;
+	pthread_mutex_unlock( &priv->queue_mutex );
+	pthread_mutex_lock( &priv->put_mutex );
+	count += mlt_deque_count( priv->put );
+	pthread_mutex_unlock( &priv->put_mutex );
+	return count * width * height * 2;
+}
+
 static void *consumer_read_ahead_thread( void *arg )
 {
 	// The argument is the consumer
@@ -759,18 +1330,14 @@ static void *consumer_read_ahead_thread( void *arg )
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
 
 	// Get the width and height
-	int width = mlt_properties_get_int( properties, "width" );
-	int height = mlt_properties_get_int( properties, "height" );
+	int width, height;
+	get_render_size( properties, &width, &height );
 
 	// See if video is turned off
 	int video_off = mlt_properties_get_int( properties, "video_off" );
 	int preview_off = mlt_properties_get_int( properties, "preview_off" );
 	int preview_format = mlt_properties_get_int( properties, "preview_format" );
 
-	// Audio processing variables
-	int samples = 0;
-	void *audio = NULL;
-
 	// See if audio is turned off
 	int audio_off = mlt_properties_get_int( properties, "audio_off" );
 
@@ -792,6 +1359,15 @@ static void *consumer_read_ahead_thread( void *arg )
 	int frame_duration = mlt_properties_get_int( properties, "frame_duration" );
 	int drop_max = mlt_properties_get_int( properties, "drop_max" );
 
+	// Quality is lowered step by step by the average render time before frames are skipped
+	int adaptive = MIN( MAX( mlt_properties_get_int( properties, "adaptive" ), 0 ), 3 );
+	int degrade = 0;
+	int degrade_hold = 0;
+	int degrade_wait = priv->fps;
+	int recovering = 0;
+	int64_t time_render = 0;
+	struct timeval render_start;
+
 	if ( preview_off && preview_format != 0 )
 		priv->image_format = preview_format;
 
@@ -799,20 +1375,14 @@ static void *consumer_read_ahead_thread( void *arg )
 	set_image_format( self );
 
 	mlt_events_fire( properties, "consumer-thread-started", NULL );
+	mlt_trace_thread( "consumer read-ahead" );
 
-	// Get the first frame
-	frame = mlt_consumer_get_frame( self );
+	// Get the first frame with its audio
+	frame = consumer_ahead_frame( self, audio_off );
 	priv->speed = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_speed" );
 
 	if ( frame )
 	{
-		// Get the audio of the first frame
-		if ( !audio_off )
-		{
-			samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
-			mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
-		}
-
 		// Get the image of the first frame
 		if ( !video_off )
 		{
@@ -831,13 +1401,32 @@ static void *consumer_read_ahead_thread( void *arg )
 	// Continue to read ahead
 	while ( priv->ahead )
 	{
-		// Get the maximum size of the buffer
-		int buffer = (priv->speed == 0) ? 1 : MAX(mlt_properties_get_int( properties, "buffer" ), 0) + 1;
+		// Get the maximum size of the buffer, rendering only the latest position while scrubbing
+		int scrub = mlt_properties_get_int( properties, "scrub" );
+		int buffer = (priv->speed == 0 || scrub) ? 1 : MAX(mlt_properties_get_int( properties, "buffer" ), 0) + 1;
+
+		// Hold back to a couple of frames while over the memory budget
+		if ( mlt_memory_check( ) )
+			buffer = MIN( buffer, 2 );
 	
 		// Put the current frame into the queue
+		int64_t trace = mlt_trace_begin( );
+		mlt_position position;
 		pthread_mutex_lock( &priv->queue_mutex );
 		while( priv->ahead && mlt_deque_count( priv->queue ) >= buffer )
-			pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
+		{
+			// Use the time waiting while paused to render around the position, a frame at a time
+			if ( priv->speed == 0 && !priv->is_purge && speculate_next( self, &position ) )
+			{
+				pthread_mutex_unlock( &priv->queue_mutex );
+				speculate( self, position );
+				pthread_mutex_lock( &priv->queue_mutex );
+			}
+			else
+			{
+				pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
+			}
+		}
 		if ( priv->is_purge )
 		{
 			mlt_frame_close( frame );
@@ -847,12 +1436,25 @@ static void *consumer_read_ahead_thread( void *arg )
 		{
 			mlt_deque_push_back( priv->queue, frame );
 		}
+
+		// After a fast start the quality stays lowered until the queue reaches the prefill
+		if ( priv->growing )
+		{
+			int prefill = mlt_properties_get_int( properties, "prefill" );
+			prefill = prefill > 0 && prefill < buffer ? prefill : buffer;
+			if ( priv->speed == 0 || scrub || mlt_deque_count( priv->queue ) >= prefill )
+				priv->growing = 0;
+		}
 		pthread_cond_broadcast( &priv->queue_cond );
 		pthread_mutex_unlock( &priv->queue_mutex );
+		mlt_trace_end( "consumer", "queue full", trace );
 
+		gettimeofday( &render_start, NULL );
 		mlt_log_timings_begin();
-		// Get the next frame
-		frame = mlt_consumer_get_frame( self );
+		// Get the next frame with its audio
+		trace = mlt_trace_begin( );
+		frame = consumer_ahead_frame( self, audio_off );
+		mlt_trace_end( "consumer", "get_frame", trace );
 		mlt_log_timings_end( NULL, "mlt_consumer_get_frame" );
 
 		// If there's no frame, we're probably stopped...
@@ -867,13 +1469,6 @@ static void *consumer_read_ahead_thread( void *arg )
 		// Increment the counter used for averaging processing cost
 		count ++;
 
-		// Always process audio
-		if ( !audio_off )
-		{
-			samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
-			mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
-		}
-
 		// All non-normal playback frames should be shown
 		if ( priv->speed != 1 )
 		{
@@ -884,19 +1479,41 @@ static void *consumer_read_ahead_thread( void *arg )
 			start_pos = pos;
 		}
 
+		// Pass on the quality level
+		if ( degrade || priv->growing )
+		{
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_degrade", MAX( degrade, 1 ) );
+			mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "rescale.interp", "nearest" );
+			mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "deinterlace_method", "onefield" );
+		}
+
+		// A frame of a scrub that was overtaken by a seek is dropped without its image
+		if ( scrub_is_stale( self, frame ) )
+		{
+			mlt_log_debug( self, "dropped stale scrub frame " MLT_POSITION_FMT "\n", pos );
+		}
 		// If skip flag not set or frame-dropping disabled
-		if ( !skip_next || priv->real_time == -1 )
+		else if ( !skip_next || priv->real_time == -1 )
 		{
 			if ( !video_off )
 			{
 				// Reset width/height - could have been changed by previous mlt_frame_get_image
-				width = mlt_properties_get_int( properties, "width" );
-				height = mlt_properties_get_int( properties, "height" );
+				get_render_size( properties, &width, &height );
+				if ( degrade >= 3 || mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_scrub" ) )
+				{
+					width = width / 4 * 2;
+					height = height / 4 * 2;
+				}
 
 				// Get the image
 				mlt_events_fire( MLT_CONSUMER_PROPERTIES( self ), "consumer-frame-render", frame, NULL );
 				mlt_log_timings_begin();
+				trace = mlt_trace_begin( );
+				int64_t metric = priv->metric_render ? mlt_trace_now( ) : 0;
 				mlt_frame_get_image( frame, &image, &priv->image_format, &width, &height, 0 );
+				mlt_trace_end( "consumer", "render", trace );
+				if ( metric )
+					mlt_metrics_observe( priv->metric_render, ( mlt_trace_now( ) - metric ) / 1000000.0 );
 				mlt_log_timings_end( NULL, "mlt_frame_get_image" );
 			}
 
@@ -905,6 +1522,35 @@ static void *consumer_read_ahead_thread( void *arg )
 
 			// Reset consecutively-skipped counter
 			skipped = 0;
+
+			// Follow the render time, leaving each level in place for a while
+			int64_t time_current = time_difference( &render_start );
+			time_render = time_render ? ( time_render * 7 + time_current ) / 8 : time_current;
+			if ( adaptive && ++degrade_hold >= 5 )
+			{
+				if ( time_render > frame_duration && degrade < adaptive )
+				{
+					// Wait longer before trying again if raising the quality did not last
+					if ( recovering )
+						degrade_wait = MIN( degrade_wait * 2, 30 * priv->fps );
+					recovering = 0;
+					mlt_log_verbose( self, "render %"PRId64" usec exceeds %d - lowering quality to %d\n",
+						time_render, frame_duration, ++degrade );
+					degrade_hold = 0;
+				}
+				else if ( degrade > 0 && time_render < frame_duration / 2 && degrade_hold >= degrade_wait )
+				{
+					recovering = 1;
+					mlt_log_verbose( self, "render %"PRId64" usec has headroom - raising quality to %d\n",
+						time_render, --degrade );
+					degrade_hold = 0;
+				}
+				else if ( recovering && degrade_hold >= priv->fps )
+				{
+					recovering = 0;
+					degrade_wait = priv->fps;
+				}
+			}
 		}
 		else // Skip image processing
 		{
@@ -957,8 +1603,8 @@ static void *consumer_read_ahead_thread( void *arg )
 		// Only consider skipping if the buffer level is low (or really small)
 		if ( mlt_deque_count( priv->queue ) <= buffer / 5 + 1 && count > 1 )
 		{
-			// Skip next frame if average cost exceeds frame duration.
-			if ( time_process / count > frame_duration )
+			// Skip next frame if average cost exceeds frame duration and quality is already lowered.
+			if ( time_process / count > frame_duration && degrade >= adaptive )
 				skip_next = 1;
 			if ( skip_next )
 				mlt_log_debug( self, "avg usec %"PRId64" (%"PRId64"/%d) duration %d\n",
@@ -969,6 +1615,9 @@ static void *consumer_read_ahead_thread( void *arg )
 	// Remove the last frame
 	mlt_frame_close( frame );
 
+	mlt_memory_unregister( priv->memory );
+	priv->memory = NULL;
+
 	// Wipe the queue
 	pthread_mutex_lock( &priv->queue_mutex );
 	while ( mlt_deque_count( priv->queue ) )
@@ -1025,8 +1674,8 @@ static void *consumer_worker_thread( void *arg )
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
 
 	// Get the width and height
-	int width = mlt_properties_get_int( properties, "width" );
-	int height = mlt_properties_get_int( properties, "height" );
+	int width, height;
+	get_render_size( properties, &width, &height );
 	mlt_image_format format = priv->image_format;
 
 	// See if video is turned off
@@ -1041,32 +1690,49 @@ static void *consumer_worker_thread( void *arg )
 	if ( preview_off && preview_format != 0 )
 		format = preview_format;
 
+	// Spread the workers over the memory nodes
+	int nodes = mlt_slices_numa_nodes();
+	if ( nodes > 1 && ( !mlt_properties_get( properties, "numa" ) || mlt_properties_get_int( properties, "numa" ) ) )
+	{
+		int index = __sync_fetch_and_add( &priv->worker_count, 1 );
+		mlt_slices_bind_node( index % nodes, index / nodes );
+	}
+
 	mlt_events_fire( properties, "consumer-thread-started", NULL );
+	mlt_trace_thread( "consumer worker" );
 
 	// Continue to read ahead
 	while ( priv->ahead )
 	{
-		// Get the next unprocessed frame from the work queue
-		pthread_mutex_lock( &priv->queue_mutex );
-		int index = first_unprocessed_frame( self );
-		while ( priv->ahead && index >= mlt_deque_count( priv->queue ) )
+		// Get the next frame from the work queue, only waiting when it is empty
+		frame = mlt_queue_pop( priv->work );
+		if ( !frame )
 		{
-			mlt_log_debug( MLT_CONSUMER_SERVICE(self), "waiting in worker index = %d queue count = %d\n",
-				index, mlt_deque_count( priv->queue ) );
-			pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
-			index = first_unprocessed_frame( self );
+			pthread_mutex_lock( &priv->queue_mutex );
+			while ( priv->ahead && !( frame = mlt_queue_pop( priv->work ) ) )
+			{
+				mlt_log_debug( MLT_CONSUMER_SERVICE(self), "waiting in worker queue count = %d\n",
+					mlt_deque_count( priv->queue ) );
+				pthread_cond_wait( &priv->queue_cond, &priv->queue_mutex );
+			}
+			pthread_mutex_unlock( &priv->queue_mutex );
+		}
+
+		// Skip a frame that is played or due too soon to finish before it is, or overtaken by a seek
+		if ( frame && ( scrub_is_stale( self, frame ) || ( priv->real_time > 0 &&
+			mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_work_serial" ) - priv->work_played < priv->process_head ) ) )
+		{
+			mlt_frame_close( frame );
+			continue;
 		}
 
 		// Mark the frame for processing
-		frame = mlt_deque_peek( priv->queue, index );
 		if ( frame )
 		{
-			mlt_log_debug( MLT_CONSUMER_SERVICE(self), "worker processing index = %d frame " MLT_POSITION_FMT " queue count = %d\n",
-				index, mlt_frame_get_position(frame), mlt_deque_count( priv->queue ) );
+			mlt_log_debug( MLT_CONSUMER_SERVICE(self), "worker processing frame " MLT_POSITION_FMT " queue count = %d\n",
+				mlt_frame_get_position(frame), mlt_deque_count( priv->queue ) );
 			frame->is_processing = 1;
-			mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( frame ) );
 		}
-		pthread_mutex_unlock( &priv->queue_mutex );
 
 		// If there's no frame, we're probably stopped...
 		if ( frame == NULL )
@@ -1085,10 +1751,14 @@ static void *consumer_worker_thread( void *arg )
 		if ( !video_off )
 		{
 			// Fetch width/height again
-			width = mlt_properties_get_int( properties, "width" );
-			height = mlt_properties_get_int( properties, "height" );
+			get_render_size( properties, &width, &height );
 			mlt_events_fire( MLT_CONSUMER_PROPERTIES( self ), "consumer-frame-render", frame, NULL );
+			int64_t trace = mlt_trace_begin( );
+			int64_t metric = priv->metric_render ? mlt_trace_now( ) : 0;
 			mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+			mlt_trace_end( "consumer", "render", trace );
+			if ( metric )
+				mlt_metrics_observe( priv->metric_render, ( mlt_trace_now( ) - metric ) / 1000000.0 );
 		}
 		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "rendered", 1 );
 		mlt_frame_close( frame );
@@ -1099,6 +1769,8 @@ static void *consumer_worker_thread( void *arg )
 		pthread_mutex_unlock( &priv->done_mutex );
 	}
 
+	mlt_events_fire( properties, "consumer-thread-stopped", NULL );
+
 	return NULL;
 }
 
@@ -1127,8 +1799,20 @@ static void consumer_read_ahead_start( mlt_consumer self )
 	// Create the condition
 	pthread_cond_init( &priv->queue_cond, NULL );
 
+	// The queued frames count against the memory budget through the pool
+	priv->memory = mlt_memory_register( "consumer", 40, 1, queue_memory_usage, NULL, self );
+
+	// Render the audio further ahead on its own thread, unless there are no images to wait for
+	if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "audio_buffer" ) > 0
+		 && !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "video_off" ) )
+	{
+		priv->audio_queue = mlt_deque_init( );
+		priv->audio_purge = 0;
+		priv->audio_thread = mlt_thread_create( self, (thread_function_t) consumer_audio_ahead_thread );
+	}
+
 	// Create the read ahead
-	mlt_thread_create( self, (thread_function_t) consumer_read_ahead_thread );
+	priv->ahead_thread = mlt_thread_create( self, (thread_function_t) consumer_read_ahead_thread );
 	priv->started = 1;
 }
 
@@ -1142,16 +1826,12 @@ static void consumer_work_start( mlt_consumer self )
 {
 	consumer_private *priv = self->local;
 	int n = abs( priv->real_time );
-	pthread_t *thread;
 
 	if ( priv->started )
 		return;
 
-	thread = calloc( 1, sizeof( pthread_t ) * n );
-
 	// We're running now
 	priv->ahead = 1;
-	priv->threads = thread;
 	
 	// These keep track of the acceleration of frame dropping or recovery.
 	priv->consecutive_dropped = 0;
@@ -1162,9 +1842,15 @@ static void consumer_work_start( mlt_consumer self )
 	// before the frame is played out.
 	priv->process_head = 0;
 
-	// Create the queues
+	// Create the queues, leaving room in the work queue for frames played before a worker took them
+	int buffer = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "_buffer" );
+	buffer = buffer > 0 ? buffer : mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "buffer" );
 	priv->queue = mlt_deque_init();
 	priv->worker_threads = mlt_deque_init();
+	priv->work = mlt_queue_init( 2 * MAX( buffer, 2 + n * n ) );
+	priv->work_pushed = 0;
+	priv->work_played = 0;
+	priv->worker_count = 0;
 
 	// Create the mutexes
 	pthread_mutex_init( &priv->queue_mutex, NULL );
@@ -1174,41 +1860,19 @@ static void consumer_work_start( mlt_consumer self )
 	pthread_cond_init( &priv->queue_cond, NULL );
 	pthread_cond_init( &priv->done_cond, NULL );
 
-	// Create the read ahead
-	if ( mlt_properties_get( MLT_CONSUMER_PROPERTIES( self ), "priority" ) )
-	{
-
-		struct sched_param priority;
-		pthread_attr_t thread_attributes;
-
-		priority.sched_priority = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "priority" );
-		pthread_attr_init( &thread_attributes );
-		pthread_attr_setschedpolicy( &thread_attributes, SCHED_OTHER );
-		pthread_attr_setschedparam( &thread_attributes, &priority );
-		pthread_attr_setinheritsched( &thread_attributes, PTHREAD_EXPLICIT_SCHED );
-		pthread_attr_setscope( &thread_attributes, PTHREAD_SCOPE_SYSTEM );
-
-		while ( n-- )
-		{
-			if ( pthread_create( thread, &thread_attributes, consumer_worker_thread, self ) < 0 ) {
-				if ( pthread_create( thread, NULL, consumer_worker_thread, self ) == 0 )
-					mlt_deque_push_back( priv->worker_threads, thread );
-			} else {
-				mlt_deque_push_back( priv->worker_threads, thread );
-			}
-			thread++;
-		}
-		pthread_attr_destroy( &thread_attributes );
-	}
+	// The queued frames count against the memory budget through the pool
+	priv->memory = mlt_memory_register( "consumer", 40, 1, queue_memory_usage, NULL, self );
 
-	else
+	// Create the workers, each through consumer-thread-create so that a
+	// listener can give every one of them its own rendering context.
+	// An audio-only render has no images for them.
+	if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "video_off" ) )
+		n = 0;
+	while ( n-- )
 	{
-		while ( n-- )
-		{
-			if ( pthread_create( thread, NULL, consumer_worker_thread, self ) == 0 )
-				mlt_deque_push_back( priv->worker_threads, thread );
-			thread++;
-		}
+		void *thread = mlt_thread_create( self, (thread_function_t) consumer_worker_thread );
+		if ( thread )
+			mlt_deque_push_back( priv->worker_threads, thread );
 	}
 	priv->started = 1;
 }
@@ -1247,8 +1911,19 @@ static void consumer_read_ahead_stop( mlt_consumer self )
 		pthread_cond_broadcast( &priv->put_cond );
 		pthread_mutex_unlock( &priv->put_mutex );
 
-		// Join the thread
-		mlt_thread_join( self );
+		// Join the threads
+		mlt_thread_join( self, priv->ahead_thread );
+		priv->ahead_thread = NULL;
+		if ( priv->audio_thread )
+			mlt_thread_join( self, priv->audio_thread );
+		priv->audio_thread = NULL;
+		if ( priv->audio_queue )
+		{
+			while ( mlt_deque_count( priv->audio_queue ) )
+				mlt_frame_close( mlt_deque_pop_back( priv->audio_queue ) );
+			mlt_deque_close( priv->audio_queue );
+			priv->audio_queue = NULL;
+		}
 
 		// Destroy the frame queue mutex
 		pthread_mutex_destroy( &priv->queue_mutex );
@@ -1297,12 +1972,12 @@ static void consumer_work_stop( mlt_consumer self )
 		pthread_mutex_unlock( &priv->done_mutex );
 
 		// Join the threads
-		pthread_t *thread;
+		void *thread;
 		while ( ( thread = mlt_deque_pop_back( priv->worker_threads ) ) )
-			pthread_join( *thread, NULL );
+			mlt_thread_join( self, thread );
 
-		// Deallocate the array of threads
-		free( priv->threads );
+		mlt_memory_unregister( priv->memory );
+		priv->memory = NULL;
 
 		// Destroy the mutexes
 		pthread_mutex_destroy( &priv->queue_mutex );
@@ -1317,10 +1992,11 @@ static void consumer_work_stop( mlt_consumer self )
 			mlt_frame_close( mlt_deque_pop_back( priv->queue ) );
 
 		// Close the queues
+		worker_queue_purge( self );
 		mlt_deque_close( priv->queue );
 		mlt_deque_close( priv->worker_threads );
-
-		mlt_events_fire( MLT_CONSUMER_PROPERTIES(self), "consumer-thread-stopped", NULL );
+		mlt_queue_close( priv->work );
+		priv->work = NULL;
 	}
 }
 
@@ -1337,10 +2013,7 @@ void mlt_consumer_purge( mlt_consumer self )
 		consumer_private *priv = self->local;
 
 		pthread_mutex_lock( &priv->put_mutex );
-		if ( priv->put ) {
-			mlt_frame_close( priv->put );
-			priv->put = NULL;
-		}
+		put_clear( priv );
 		pthread_cond_broadcast( &priv->put_cond );
 		pthread_mutex_unlock( &priv->put_mutex );
 
@@ -1352,10 +2025,20 @@ void mlt_consumer_purge( mlt_consumer self )
 
 		while ( priv->started && mlt_deque_count( priv->queue ) )
 			mlt_frame_close( mlt_deque_pop_back( priv->queue ) );
+		if ( priv->started && priv->audio_queue )
+		{
+			while ( mlt_deque_count( priv->audio_queue ) )
+				mlt_frame_close( mlt_deque_pop_back( priv->audio_queue ) );
+			priv->audio_purge = 1;
+		}
+		if ( priv->started && abs( priv->real_time ) > 1 )
+			worker_queue_purge( self );
 
 		if ( priv->started && priv->real_time )
 		{
 			priv->is_purge = 1;
+			// The frames of a scrub that are still being made are now stale
+			priv->scrub_serial++;
 			pthread_cond_broadcast( &priv->queue_cond );
 			pthread_mutex_unlock( &priv->queue_mutex );
 			if ( abs( priv->real_time ) > 1 )
@@ -1367,15 +2050,62 @@ void mlt_consumer_purge( mlt_consumer self )
 		}
 
 		pthread_mutex_lock( &priv->put_mutex );
-		if ( priv->put ) {
-			mlt_frame_close( priv->put );
-			priv->put = NULL;
-		}
+		put_clear( priv );
 		pthread_cond_broadcast( &priv->put_cond );
 		pthread_mutex_unlock( &priv->put_mutex );
 	}
 }
 
+/** Queue a frame for display and for the worker threads.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param frame a frame
+ */
+
+static void worker_queue_frame( mlt_consumer self, mlt_frame frame )
+{
+	consumer_private *priv = self->local;
+
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "_work_serial", priv->work_pushed++ );
+	if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "video_off" ) )
+	{
+		// Without an image, the audio already got is all there is to render
+		frame->is_processing = 1;
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "rendered", 1 );
+	}
+	else
+	{
+		mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( frame ) );
+		if ( mlt_queue_push( priv->work, frame ) )
+		{
+			// Only stale frames can fill it, which are already dropped.
+			mlt_log_debug( MLT_CONSUMER_SERVICE(self), "work queue full\n" );
+			mlt_frame_close( frame );
+		}
+	}
+	pthread_mutex_lock( &priv->queue_mutex );
+	mlt_deque_push_back( priv->queue, frame );
+	pthread_cond_signal( &priv->queue_cond );
+	pthread_mutex_unlock( &priv->queue_mutex );
+}
+
+/** Release the frames no worker thread has taken.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ */
+
+static void worker_queue_purge( mlt_consumer self )
+{
+	consumer_private *priv = self->local;
+	mlt_frame frame;
+
+	while ( ( frame = mlt_queue_pop( priv->work ) ) )
+		mlt_frame_close( frame );
+	priv->work_played = priv->work_pushed;
+}
+
 /** Use multiple worker threads and a work queue.
  */
 
@@ -1386,19 +2116,19 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 	consumer_private *priv = self->local;
 	int threads = abs( priv->real_time );
 	int audio_off = mlt_properties_get_int( properties, "audio_off" );
-	int samples = 0;
-	void *audio = NULL;
 	int buffer = mlt_properties_get_int( properties, "_buffer" );
 	buffer = buffer > 0 ? buffer : mlt_properties_get_int( properties, "buffer" );
 	// This is a heuristic to determine a suitable minimum buffer size for the number of threads.
 	int headroom = (priv->real_time < 0) ? threads : (2 + threads * threads);
 	buffer = MAX(buffer, headroom);
+	if ( priv->work )
+		buffer = MIN(buffer, mlt_queue_size( priv->work ) / 2);
 
 	// Start worker threads if not already started.
 	if ( ! priv->ahead )
 	{
 		int prefill = mlt_properties_get_int( properties, "prefill" );
-		prefill = prefill > 0 && prefill < buffer ? prefill : buffer;
+		prefill = priv->fast_start ? 1 : prefill > 0 && prefill < buffer ? prefill : buffer;
 
 		set_audio_format( self );
 		set_image_format( self );
@@ -1413,21 +2143,15 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 			{
 				// Process the audio
 				if ( !audio_off )
-				{
-					samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
-					mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
-				}
-				pthread_mutex_lock( &priv->queue_mutex );
-				mlt_deque_push_back( priv->queue, frame );
-				pthread_cond_signal( &priv->queue_cond );
-				pthread_mutex_unlock( &priv->queue_mutex );
+					consumer_get_audio( self, frame );
+				worker_queue_frame( self, frame );
 				priv->speed = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_speed" );
-				buffer = (priv->speed == 0) ? 1 : buffer;
+				buffer = (priv->speed == 0 || mlt_properties_get_int( properties, "scrub" )) ? 1 : buffer;
 			}
 		}
 
-		// Wait for prefill
-		while ( priv->ahead && first_unprocessed_frame( self ) < prefill )
+		// Wait for prefill, unless a purge emptied the queue
+		while ( priv->ahead && !priv->is_purge && first_unprocessed_frame( self ) < prefill )
 		{
 			pthread_mutex_lock( &priv->done_mutex );
 			pthread_cond_wait( &priv->done_cond, &priv->done_mutex );
@@ -1439,6 +2163,10 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 //	mlt_log_verbose( MLT_CONSUMER_SERVICE(self), "size %d done count %d work count %d process_head %d\n",
 //		threads, first_unprocessed_frame( self ), mlt_deque_count( priv->queue ), priv->process_head );
 
+	// Keep no more than a frame per worker queued while over the memory budget
+	if ( mlt_memory_check( ) )
+		buffer = MIN( buffer, threads + 1 );
+
 	// Feed the work queue
 	while ( priv->ahead && mlt_deque_count( priv->queue ) < buffer )
 	{
@@ -1447,16 +2175,10 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 		{
 			// Process the audio
 			if ( !audio_off )
-			{
-				samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
-				mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
-			}
-			pthread_mutex_lock( &priv->queue_mutex );
-			mlt_deque_push_back( priv->queue, frame );
-			pthread_cond_signal( &priv->queue_cond );
-			pthread_mutex_unlock( &priv->queue_mutex );
+				consumer_get_audio( self, frame );
+			worker_queue_frame( self, frame );
 			priv->speed = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_speed" );
-			buffer = (priv->speed == 0) ? 1 : buffer;
+			buffer = (priv->speed == 0 || mlt_properties_get_int( properties, "scrub" )) ? 1 : buffer;
 		}
 	}
 
@@ -1472,6 +2194,8 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 	// Get the frame from the queue.
 	pthread_mutex_lock( &priv->queue_mutex );
 	frame = mlt_deque_pop_front( priv->queue );
+	if ( frame )
+		priv->work_played++;
 	pthread_mutex_unlock( &priv->queue_mutex );
 	if ( ! frame ) {
 		priv->is_purge = 0;
@@ -1527,6 +2251,7 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 		{
 			int dropped = mlt_properties_get_int( properties, "drop_count" );
 			mlt_properties_set_int( properties, "drop_count", ++dropped );
+			mlt_metrics_add( priv->metric_dropped, 1 );
 			mlt_log_verbose( MLT_CONSUMER_SERVICE(self), "dropped video frame %d\n", dropped );
 		}
 	}
@@ -1540,16 +2265,12 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 
 /** Get the next frame from the producer connected to a consumer.
  *
- * Typically, one uses this instead of \p mlt_consumer_get_frame to make
- * the asynchronous/real-time behavior configurable at runtime.
- * You should close the frame returned from this when you are done with it.
- *
- * \public \memberof mlt_consumer_s
+ * \private \memberof mlt_consumer_s
  * \param self a consumer
  * \return a frame
  */
 
-mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
+static mlt_frame consumer_rt_frame( mlt_consumer self )
 {
 	// Frame to return
 	mlt_frame frame = NULL;
@@ -1562,7 +2283,7 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 	if ( priv->real_time > 1 || priv->real_time < -1 )
 	{
 		// see above
-		return worker_get_frame( self, properties );
+		frame = worker_get_frame( self, properties );
 	}
 	else if ( priv->real_time == 1 || priv->real_time == -1 )
 	{
@@ -1575,7 +2296,7 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 #ifndef _WIN32
 			consumer_read_ahead_start( self );
 #endif
-			if ( buffer > 1 && priv->speed )
+			if ( buffer > 1 && priv->speed && !priv->fast_start )
 				size = prefill > 0 && prefill < buffer ? prefill : buffer;
 			priv->preroll = 0;
 		}
@@ -1594,6 +2315,7 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 		{
 			int dropped = mlt_properties_get_int( properties, "drop_count" );
 			mlt_properties_set_int( properties, "drop_count", ++dropped );
+			mlt_metrics_add( priv->metric_dropped, 1 );
 			mlt_log_verbose( MLT_CONSUMER_SERVICE(self), "dropped video frame %d\n", dropped );
 		}
 	}
@@ -1602,6 +2324,7 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 		if ( !priv->ahead )
 		{
 			priv->ahead = 1;
+			set_audio_format( self );
 			mlt_events_fire( properties, "consumer-thread-started", NULL );
 		}
 		// Get the frame in non real time
@@ -1612,11 +2335,83 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 		{
 			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "rendered", 1 );
 
+			// The audio of a scrub is cut to a grain before the consumer gets it
+			if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_scrub" ) &&
+				 !mlt_properties_get_int( properties, "audio_off" ) )
+				consumer_get_audio( self, frame );
+
 			// WebVfx uses this to setup a consumer-stopping event handler.
 			mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "consumer", self, 0, NULL, NULL );
 		}
 	}
 
+	// Report how long the first frame took
+	if ( frame && priv->first_frame_pending )
+	{
+		int64_t latency = mlt_trace_now( ) - priv->start_time;
+		priv->first_frame_pending = 0;
+		mlt_properties_set_double( properties, "first_frame_latency", latency / 1000.0 );
+		mlt_metrics_observe( priv->metric_first_frame, latency / 1000000.0 );
+	}
+
+	return frame;
+}
+
+/** Get the next frame from the producer connected to a consumer.
+ *
+ * Typically, one uses this instead of \p mlt_consumer_get_frame to make
+ * the asynchronous/real-time behavior configurable at runtime.
+ * You should close the frame returned from this when you are done with it.
+ *
+ * On the timeline, the time between the calls is what the consumer took to
+ * encode or show the previous frame.
+ *
+ * \public \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return a frame
+ */
+
+mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
+{
+	consumer_private *priv = self->local;
+	int64_t begin = mlt_trace_begin( );
+	const char *id = begin ? mlt_properties_get( MLT_CONSUMER_PROPERTIES( self ), "mlt_service" ) : NULL;
+	int64_t metric = priv->metric_frames ? mlt_trace_now( ) : 0;
+	mlt_frame frame;
+	char name[64];
+
+	if ( begin )
+	{
+		if ( priv->trace_shown )
+		{
+			snprintf( name, sizeof( name ), "%s encode", id );
+			mlt_trace_end( "consumer", name, priv->trace_shown );
+		}
+		else
+		{
+			snprintf( name, sizeof( name ), "consumer %s", id );
+			mlt_trace_thread( name );
+		}
+	}
+	if ( metric && priv->metric_shown )
+		mlt_metrics_observe( priv->metric_encode, ( metric - priv->metric_shown ) / 1000000.0 );
+
+	frame = consumer_rt_frame( self );
+
+	if ( begin )
+	{
+		snprintf( name, sizeof( name ), "%s wait", id );
+		mlt_trace_end( "consumer", name, begin );
+		priv->trace_shown = mlt_trace_now( );
+	}
+	if ( metric )
+	{
+		if ( frame )
+			mlt_metrics_add( priv->metric_frames, 1 );
+		if ( priv->started && priv->queue )
+			mlt_metrics_set( priv->metric_queue, mlt_deque_count( priv->queue ) );
+		priv->metric_shown = mlt_trace_now( );
+	}
 	return frame;
 }
 
@@ -1679,6 +2474,18 @@ int mlt_consumer_stop( mlt_consumer self )
 	// Kill the test card
 	mlt_properties_set_data( properties, "test_card_producer", NULL, 0, NULL, NULL );
 
+	if ( priv->holds_jobs )
+	{
+		mlt_job_realtime_leave( );
+		priv->holds_jobs = 0;
+	}
+
+	if ( priv->trace )
+	{
+		mlt_frame_trace_enable( 0 );
+		priv->trace = 0;
+	}
+
 	// Check and run a post command
 	if ( mlt_properties_get( properties, "post" ) )
 		if (system( mlt_properties_get( properties, "post" ) ) == -1 )
@@ -1733,7 +2540,12 @@ void mlt_consumer_close( mlt_consumer self )
 			// Make sure it only gets called once
 			self->parent.close = NULL;
 
-			// Destroy the push mutex and condition
+			if ( priv->holds_jobs )
+				mlt_job_realtime_leave( );
+
+			// Destroy the push mutex, condition and queue
+			put_clear( priv );
+			mlt_deque_close( priv->put );
 			pthread_mutex_destroy( &priv->put_mutex );
 			pthread_cond_destroy( &priv->put_cond );
 
@@ -1762,17 +2574,17 @@ static void transmit_thread_create( mlt_listener listener, mlt_properties owner,
 			(void**) args[0] /* handle */, (int*) args[1] /* priority */, (thread_function_t) args[2], (void*) args[3] /* data */ );
 }
 
-static void mlt_thread_create( mlt_consumer self, thread_function_t function )
+static void *mlt_thread_create( mlt_consumer self, thread_function_t function )
 {
-	consumer_private *priv = self->local;
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	void *thread = NULL;
 
 	if ( mlt_properties_get( MLT_CONSUMER_PROPERTIES( self ), "priority" ) )
 	{
 		struct sched_param priority;
 		priority.sched_priority = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "priority" );
 		if ( mlt_events_fire( properties, "consumer-thread-create",
-		     &priv->ahead_thread, &priority.sched_priority, function, self, NULL ) < 1 )
+		     &thread, &priority.sched_priority, function, self, NULL ) < 1 )
 		{
 			pthread_attr_t thread_attributes;
 			pthread_attr_init( &thread_attributes );
@@ -1780,10 +2592,13 @@ static void mlt_thread_create( mlt_consumer self, thread_function_t function )
 			pthread_attr_setschedparam( &thread_attributes, &priority );
 			pthread_attr_setinheritsched( &thread_attributes, PTHREAD_EXPLICIT_SCHED );
 			pthread_attr_setscope( &thread_attributes, PTHREAD_SCOPE_SYSTEM );
-			priv->ahead_thread = malloc( sizeof( pthread_t ) );
-			pthread_t *handle = priv->ahead_thread;
-			if ( pthread_create( ( pthread_t* ) &( *handle ), &thread_attributes, function, self ) < 0 )
-				pthread_create( ( pthread_t* ) &( *handle ), NULL, function, self );
+			pthread_t *handle = thread = malloc( sizeof( pthread_t ) );
+			if ( pthread_create( handle, &thread_attributes, function, self ) != 0 &&
+			     pthread_create( handle, NULL, function, self ) != 0 )
+			{
+				free( thread );
+				thread = NULL;
+			}
 			pthread_attr_destroy( &thread_attributes );
 		}
 	}
@@ -1791,13 +2606,17 @@ static void mlt_thread_create( mlt_consumer self, thread_function_t function )
 	{
 		int priority = -1;
 		if ( mlt_events_fire( properties, "consumer-thread-create",
-		     &priv->ahead_thread, &priority, function, self, NULL ) < 1 )
+		     &thread, &priority, function, self, NULL ) < 1 )
 		{
-			priv->ahead_thread = malloc( sizeof( pthread_t ) );
-			pthread_t *handle = priv->ahead_thread;
-			pthread_create( ( pthread_t* ) &( *handle ), NULL, function, self );
+			pthread_t *handle = thread = malloc( sizeof( pthread_t ) );
+			if ( pthread_create( handle, NULL, function, self ) != 0 )
+			{
+				free( thread );
+				thread = NULL;
+			}
 		}
 	}
+	return thread;
 }
 
 static void transmit_thread_join( mlt_listener listener, mlt_properties owner, mlt_service self, void **args )
@@ -1806,14 +2625,12 @@ static void transmit_thread_join( mlt_listener listener, mlt_properties owner, m
 		listener( owner, self, (void*) args[0] /* handle */ );
 }
 
-static void mlt_thread_join( mlt_consumer self )
+static void mlt_thread_join( mlt_consumer self, void *handle )
 {
-	consumer_private *priv = self->local;
-	if ( mlt_events_fire( MLT_CONSUMER_PROPERTIES(self), "consumer-thread-join", priv->ahead_thread, NULL ) < 1 )
+	if ( handle && mlt_events_fire( MLT_CONSUMER_PROPERTIES(self), "consumer-thread-join", handle, NULL ) < 1 )
 	{
-		pthread_t *handle = priv->ahead_thread;
-		pthread_join( *handle, NULL );
-		free( priv->ahead_thread );
+		pthread_t *thread = handle;
+		pthread_join( *thread, NULL );
+		free( handle );
 	}
-	priv->ahead_thread = NULL;
 }
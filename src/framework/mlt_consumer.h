@@ -36,11 +36,39 @@
  * \extends mlt_service_s
  * \properties \em rescale the scaling algorithm to pass on to all scaling
  * filters, defaults to "bilinear"
+ * \properties \em resample_quality the quality of audio resampling to pass on to the
+ * resampling filters: fast, medium (default) or best
  * \properties \em buffer the number of frames to use in the asynchronous
  * render thread, defaults to 25
+ * \properties \em audio_buffer the number of frames whose audio is rendered on a thread of
+ * its own ahead of the images when real_time is 1 or -1, defaults to 0 (the audio is rendered
+ * with the images)
  * \properties \em prefill the number of frames to render before commencing
  * output when real_time <> 0, defaults to the size of buffer
+ * \properties \em fast_start set to show the first frame as soon as it is rendered instead of
+ * waiting for the prefill; the read-ahead of real_time 1 or -1 then renders at the first level of
+ * adaptive until the queue reaches the prefill, defaults to 0
+ * \properties \em first_frame_latency the milliseconds from starting the consumer to getting
+ * its first frame (read only)
  * \properties \em drop_max the maximum number of consecutively dropped frames, defaults to 5
+ * \properties \em put_depth the number of frames given to mlt_consumer_put_frame() that
+ * may wait to be taken, defaults to 1
+ * \properties \em adaptive how far to lower the quality before dropping frames when
+ * real_time is 1 or -1: 0 (default) never, 1 nearest scaling and one field deinterlacing,
+ * 2 also skip the images of filters with the optional property, 3 also render at half size.
+ * The level in use is set on each frame as consumer_degrade.
+ * \properties \em scrub set while the position is being dragged: only the latest position
+ * is rendered, a purge drops the frames still being made, images are rendered at half size
+ * from the nearest keyframe where the producer supports it, and the audio of each frame is
+ * cut to a faded grain. Each frame is marked with consumer_scrub.
+ * \properties \em scrub_grain the length of the audio grains of a scrub in milliseconds,
+ * defaults to 20
+ * \properties \em speculate the number of frames after the position to render while paused and waiting
+ * when real_time is 1 or -1, so that the caches of the producers hold them when the playback or a step
+ * gets there; a frame at a time, stopping when a frame is taken or the position moves, defaults to 0
+ * \properties \em speculate_behind the number of frames before the position to render likewise, defaults to 0
+ * \properties \em trace set to time the work of the services on each frame,
+ * see mlt_frame_trace_stats() and the consumer-frame-stats event
  * \properties \em frequency the audio sample rate to use in Hertz, defaults to 48000
  * \properties \em channels the number of audio channels to use, defaults to 2
  * \properties \em channel_layout the layout of the audio channels, defaults to auto.
@@ -53,14 +81,18 @@
  * \event \em consumer-frame-show Subclass implementations fire this immediately after showing a frame
  * or when a frame should be shown (if audio-only consumer).
  * \event \em consumer-frame-render The base class fires this immediately before rendering a frame.
+ * \event \em consumer-frame-stats The base class fires this with the frame and its stats
+ *   after a frame is shown when the trace property is set.
  * \event \em consumer-thread-create Override the implementation of creating and
- *   starting a thread by listening and responding to this (real_time 1 or -1 only).
+ *   starting a thread by listening and responding to this, once for each rendering thread.
  * \event \em consumer-thread-join Override the implementation of waiting and
- *   joining a terminated thread  by listening and responding to this (real_time 1 or -1 only).
+ *   joining a terminated thread  by listening and responding to this.
  * \event \em consumer-thread-started The base class fires when beginning execution of a rendering thread.
  * \event \em consumer-thread-stopped The base class fires when a rendering thread has ended.
  * \event \em consumer-stopping This is fired when stop was requested, but before render threads are joined.
  * \event \em consumer-stopped This is fired when the subclass implementation calls mlt_consumer_stopped().
+ * \properties \em mlt_profile the name of a profile to copy into the profile of the consumer,
+ * which the connected services are told of with mlt_service_profile_changed()
  * \properties \em fps video frames per second as floating point (read only)
  * \properties \em frame_rate_num the numerator of the video frame rate, overrides \p mlt_profile_s
  * \properties \em frame_rate_den the denominator of the video frame rate, overrides \p mlt_profile_s
@@ -80,8 +112,14 @@
  * \properties \em mlt_image_format the image format to request in rendering threads, defaults to yuv422
  * \properties \em mlt_audio_format the audio format to request in rendering threads, defaults to S16
  * \properties \em audio_off set non-zero to disable audio processing
- * \properties \em video_off set non-zero to disable video processing
+ * \properties \em video_off set non-zero to disable video processing; the worker threads
+ * of more than one rendering thread are then not started and the frames only render their audio
  * \properties \em drop_count the number of video frames not rendered since starting consumer
+ * \properties \em parallel_tracks set to let the transitions of a connected tractor render its tracks concurrently
+ * \properties \em preview_scale a factor between 0 and 1 to reduce the size of the images the rendering threads
+ *   request when real_time is not 0, for a preview; producers and filters see the smaller size, see mlt_profile_scale_width()
+ * \properties \em numa set to 0 to let the rendering threads run on any memory node when \envvar MLT_NUMA is set,
+ *   otherwise they are spread over the nodes so that each frame is rendered and allocated on one node
  */
 
 struct mlt_consumer_s
@@ -137,6 +175,9 @@ extern int mlt_consumer_connect( mlt_consumer self, mlt_service producer );
 extern int mlt_consumer_start( mlt_consumer self );
 extern void mlt_consumer_purge( mlt_consumer self );
 extern int mlt_consumer_put_frame( mlt_consumer self, mlt_frame frame );
+extern int mlt_consumer_put_frame_timeout( mlt_consumer self, mlt_frame frame, int timeout );
+extern int mlt_consumer_put_count( mlt_consumer self );
+extern double mlt_consumer_put_latency( mlt_consumer self );
 extern mlt_frame mlt_consumer_get_frame( mlt_consumer self );
 extern mlt_frame mlt_consumer_rt_frame( mlt_consumer self );
 extern int mlt_consumer_stop( mlt_consumer self );
@@ -3,7 +3,7 @@
  * \brief double ended queue
  * \see mlt_deque_s
  *
- * Copyright (C) 2003-2014 Meltytech, LLC
+ * Copyright (C) 2003-2019 Meltytech, LLC
  *
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Lesser General Public
@@ -43,6 +43,9 @@ deque_entry;
  *
  * The double-ended queue is a very versatile data structure. MLT uses it as
  * list, stack, and circular queue.
+ *
+ * The items are kept in a ring whose size is a power of two, so pushing and
+ * popping at either end never moves the other items.
  */
 
 struct mlt_deque_s
@@ -50,8 +53,12 @@ struct mlt_deque_s
 	deque_entry *list;
 	int size;
 	int count;
+	int head;
 };
 
+/** The entry at a position in the deque. */
+#define ENTRY( self, index ) ( self )->list[ ( ( self )->head + ( index ) ) & ( ( self )->size - 1 ) ]
+
 /** Create a deque.
  *
  * \public \memberof mlt_deque_s
@@ -90,8 +97,16 @@ static int mlt_deque_allocate( mlt_deque self )
 {
 	if ( self->count == self->size )
 	{
-		self->list = realloc( self->list, sizeof( deque_entry ) * ( self->size + 20 ) );
-		self->size += 20;
+		int size = self->size ? self->size * 2 : 16;
+		deque_entry *list = realloc( self->list, sizeof( deque_entry ) * size );
+		if ( list == NULL )
+			return 1;
+
+		// Unwrap the items that wrapped around the end of the old ring.
+		if ( self->head + self->count > self->size )
+			memcpy( &list[ self->size ], list, ( self->head + self->count - self->size ) * sizeof( deque_entry ) );
+		self->list = list;
+		self->size = size;
 	}
 	return self->list == NULL;
 }
@@ -109,7 +124,7 @@ int mlt_deque_push_back( mlt_deque self, void *item )
 	int error = mlt_deque_allocate( self );
 
 	if ( error == 0 )
-		self->list[ self->count ++ ].addr = item;
+		ENTRY( self, self->count ++ ).addr = item;
 
 	return error;
 }
@@ -123,7 +138,7 @@ int mlt_deque_push_back( mlt_deque self, void *item )
 
 void *mlt_deque_pop_back( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ -- self->count ].addr : NULL;
+	return self->count > 0 ? ENTRY( self, -- self->count ).addr : NULL;
 }
 
 /** Queue an item at the start.
@@ -140,8 +155,9 @@ int mlt_deque_push_front( mlt_deque self, void *item )
 
 	if ( error == 0 )
 	{
-		memmove( &self->list[ 1 ], self->list, ( self->count ++ ) * sizeof( deque_entry ) );
-		self->list[ 0 ].addr = item;
+		self->head = ( self->head - 1 ) & ( self->size - 1 );
+		self->count ++;
+		ENTRY( self, 0 ).addr = item;
 	}
 
 	return error;
@@ -160,8 +176,9 @@ void *mlt_deque_pop_front( mlt_deque self )
 
 	if ( self->count > 0 )
 	{
-		item = self->list[ 0 ].addr;
-		memmove( self->list, &self->list[ 1 ], ( -- self->count ) * sizeof( deque_entry ) );
+		item = ENTRY( self, 0 ).addr;
+		self->head = ( self->head + 1 ) & ( self->size - 1 );
+		self->count --;
 	}
 
 	return item;
@@ -176,7 +193,7 @@ void *mlt_deque_pop_front( mlt_deque self )
 
 void *mlt_deque_peek_back( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ self->count - 1 ].addr : NULL;
+	return self->count > 0 ? ENTRY( self, self->count - 1 ).addr : NULL;
 }
 
 /** Inquire on item at front of deque but don't remove.
@@ -188,7 +205,7 @@ void *mlt_deque_peek_back( mlt_deque self )
 
 void *mlt_deque_peek_front( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ 0 ].addr : NULL;
+	return self->count > 0 ? ENTRY( self, 0 ).addr : NULL;
 }
 
 /** Inquire on item in deque but don't remove.
@@ -201,7 +218,7 @@ void *mlt_deque_peek_front( mlt_deque self )
 
 void *mlt_deque_peek( mlt_deque self, int index )
 {
-	return self->count > index ? self->list[ index ].addr : NULL;
+	return index >= 0 && self->count > index ? ENTRY( self, index ).addr : NULL;
 }
 
 /** Insert an item in a sorted fashion.
@@ -222,11 +239,13 @@ int mlt_deque_insert( mlt_deque self, void *item, mlt_deque_compare cmp )
 	if ( error == 0 )
 	{
 		int n = self->count + 1;
+		int i;
 		while ( --n )
-			if ( cmp( item, self->list[ n - 1 ].addr ) >= 0 )
+			if ( cmp( item, ENTRY( self, n - 1 ).addr ) >= 0 )
 				break;
-		memmove( &self->list[ n + 1 ], &self->list[ n ], ( self->count - n ) * sizeof( deque_entry ) );
-		self->list[ n ].addr = item;
+		for ( i = self->count; i > n; i-- )
+			ENTRY( self, i ) = ENTRY( self, i - 1 );
+		ENTRY( self, n ).addr = item;
 		self->count++;
 	}
 	return error;
@@ -245,7 +264,7 @@ int mlt_deque_push_back_int( mlt_deque self, int item )
 	int error = mlt_deque_allocate( self );
 
 	if ( error == 0 )
-		self->list[ self->count ++ ].value = item;
+		ENTRY( self, self->count ++ ).value = item;
 
 	return error;
 }
@@ -259,7 +278,7 @@ int mlt_deque_push_back_int( mlt_deque self, int item )
 
 int mlt_deque_pop_back_int( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ -- self->count ].value : 0;
+	return self->count > 0 ? ENTRY( self, -- self->count ).value : 0;
 }
 
 /** Queue an integer at the start.
@@ -276,8 +295,9 @@ int mlt_deque_push_front_int( mlt_deque self, int item )
 
 	if ( error == 0 )
 	{
-		memmove( &self->list[ 1 ], self->list, ( self->count ++ ) * sizeof( deque_entry ) );
-		self->list[ 0 ].value = item;
+		self->head = ( self->head - 1 ) & ( self->size - 1 );
+		self->count ++;
+		ENTRY( self, 0 ).value = item;
 	}
 
 	return error;
@@ -296,8 +316,9 @@ int mlt_deque_pop_front_int( mlt_deque self )
 
 	if ( self->count > 0 )
 	{
-		item = self->list[ 0 ].value;
-		memmove( self->list, &self->list[ 1 ], ( -- self->count ) * sizeof( deque_entry ) );
+		item = ENTRY( self, 0 ).value;
+		self->head = ( self->head + 1 ) & ( self->size - 1 );
+		self->count --;
 	}
 
 	return item;
@@ -312,7 +333,7 @@ int mlt_deque_pop_front_int( mlt_deque self )
 
 int mlt_deque_peek_back_int( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ self->count - 1 ].value : 0;
+	return self->count > 0 ? ENTRY( self, self->count - 1 ).value : 0;
 }
 
 /** Inquire on an integer at front of deque but don't remove.
@@ -324,7 +345,7 @@ int mlt_deque_peek_back_int( mlt_deque self )
 
 int mlt_deque_peek_front_int( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ 0 ].value : 0;
+	return self->count > 0 ? ENTRY( self, 0 ).value : 0;
 }
 
 /** Push a double float to the end.
@@ -340,7 +361,7 @@ int mlt_deque_push_back_double( mlt_deque self, double item )
 	int error = mlt_deque_allocate( self );
 
 	if ( error == 0 )
-		self->list[ self->count ++ ].floating = item;
+		ENTRY( self, self->count ++ ).floating = item;
 
 	return error;
 }
@@ -354,7 +375,7 @@ int mlt_deque_push_back_double( mlt_deque self, double item )
 
 double mlt_deque_pop_back_double( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ -- self->count ].floating : 0;
+	return self->count > 0 ? ENTRY( self, -- self->count ).floating : 0;
 }
 
 /** Queue a double float at the start.
@@ -371,8 +392,9 @@ int mlt_deque_push_front_double( mlt_deque self, double item )
 
 	if ( error == 0 )
 	{
-		memmove( &self->list[ 1 ], self->list, ( self->count ++ ) * sizeof( deque_entry ) );
-		self->list[ 0 ].floating = item;
+		self->head = ( self->head - 1 ) & ( self->size - 1 );
+		self->count ++;
+		ENTRY( self, 0 ).floating = item;
 	}
 
 	return error;
@@ -391,8 +413,9 @@ double mlt_deque_pop_front_double( mlt_deque self )
 
 	if ( self->count > 0 )
 	{
-		item = self->list[ 0 ].floating;
-		memmove( self->list, &self->list[ 1 ], ( -- self->count ) * sizeof( deque_entry ) );
+		item = ENTRY( self, 0 ).floating;
+		self->head = ( self->head + 1 ) & ( self->size - 1 );
+		self->count --;
 	}
 
 	return item;
@@ -407,7 +430,7 @@ double mlt_deque_pop_front_double( mlt_deque self )
 
 double mlt_deque_peek_back_double( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ self->count - 1 ].floating : 0;
+	return self->count > 0 ? ENTRY( self, self->count - 1 ).floating : 0;
 }
 
 /** Inquire on a double float at front of deque but don't remove.
@@ -419,7 +442,7 @@ double mlt_deque_peek_back_double( mlt_deque self )
 
 double mlt_deque_peek_front_double( mlt_deque self )
 {
-	return self->count > 0 ? self->list[ 0 ].floating : 0;
+	return self->count > 0 ? ENTRY( self, 0 ).floating : 0;
 }
 
 /** Destroy the queue.
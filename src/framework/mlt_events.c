@@ -3,7 +3,7 @@
  * \brief event handling
  * \see mlt_events_struct
  *
- * Copyright (C) 2004-2014 Meltytech, LLC
+ * Copyright (C) 2004-2019 Meltytech, LLC
  *
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Lesser General Public
@@ -28,6 +28,11 @@
 #include "mlt_properties.h"
 #include "mlt_events.h"
 
+/* Private to the framework, see mlt_properties.c. */
+
+extern void *mlt_properties_get_events( mlt_properties self );
+extern void mlt_properties_set_events( mlt_properties self, void *events );
+
 /* Memory leak checks. */
 
 #undef _MLT_EVENT_CHECKS_
@@ -45,10 +50,16 @@ static int events_destroyed = 0;
  * services.
  */
 
+typedef struct event_snapshot_s *event_snapshot;
+typedef struct event_type_s *event_type;
+
 struct mlt_events_struct
 {
 	mlt_properties owner;
-	mlt_properties list;
+	event_type types;
+	pthread_mutex_t mutex;
+	int firing;
+	event_snapshot retired;
 };
 
 typedef struct mlt_events_struct *mlt_events;
@@ -64,6 +75,36 @@ struct mlt_event_struct
 	int block_count;
 	mlt_listener listener;
 	void *service;
+	int snapshot_count;
+};
+
+/** \brief Listener snapshot class
+ *
+ * Firing reads an immutable copy of the listeners of an event, which is
+ * replaced whenever they change. A replaced copy is freed once no event is
+ * being fired, and each copy keeps the events it holds from being freed.
+ */
+
+struct event_snapshot_s
+{
+	event_snapshot next;
+	int count;
+	mlt_event list[];
+};
+
+/** \brief Registered event class
+ *
+ * The registered events of an object form a list that only grows, so it can
+ * be searched without a lock.
+ */
+
+struct event_type_s
+{
+	event_type next;
+	char *id;
+	mlt_transmitter transmitter;
+	mlt_properties listeners;
+	event_snapshot snapshot;
 };
 
 /** Increment the reference count on self event.
@@ -114,7 +155,12 @@ void mlt_event_close( mlt_event self )
 	{
 		if ( -- self->ref_count == 1 )
 			self->owner = NULL;
-		if ( self->ref_count <= 0 )
+		if ( self->ref_count <= 0 && self->snapshot_count > 0 )
+		{
+			// A listener snapshot still holds it.
+			self->owner = NULL;
+		}
+		else if ( self->ref_count <= 0 )
 		{
 #ifdef _MLT_EVENT_CHECKS_
 			mlt_log( NULL, MLT_LOG_DEBUG, "Events created %d, destroyed %d\n", events_created, ++events_destroyed );
@@ -131,6 +177,101 @@ static mlt_events mlt_events_fetch( mlt_properties );
 static void mlt_events_store( mlt_properties, mlt_events );
 static void mlt_events_close( mlt_events );
 
+/** Free a listener snapshot and the events only it still holds.
+ *
+ * \private \memberof mlt_events_struct
+ * \param snapshot a listener snapshot
+ */
+
+static void snapshot_free( event_snapshot snapshot )
+{
+	int i;
+	for ( i = 0; i < snapshot->count; i ++ )
+	{
+		mlt_event event = snapshot->list[ i ];
+		if ( -- event->snapshot_count == 0 && event->ref_count <= 0 )
+			free( event );
+	}
+	free( snapshot );
+}
+
+/** Free the replaced listener snapshots if no event is being fired.
+ *
+ * This must be called with the events mutex held.
+ *
+ * \private \memberof mlt_events_struct
+ * \param events an events object
+ */
+
+static void snapshot_reclaim( mlt_events events )
+{
+	if ( __atomic_load_n( &events->firing, __ATOMIC_SEQ_CST ) == 0 )
+	{
+		while ( events->retired )
+		{
+			event_snapshot snapshot = events->retired;
+			events->retired = snapshot->next;
+			snapshot_free( snapshot );
+		}
+	}
+}
+
+/** Replace the listener snapshot of an event after its listeners changed.
+ *
+ * This must be called with the events mutex held.
+ *
+ * \private \memberof mlt_events_struct
+ * \param events an events object
+ * \param type a registered event
+ */
+
+static void snapshot_update( mlt_events events, event_type type )
+{
+	int count = mlt_properties_count( type->listeners );
+	event_snapshot snapshot = NULL;
+	int i;
+
+	if ( count > 0 && ( snapshot = malloc( sizeof( struct event_snapshot_s ) + count * sizeof( mlt_event ) ) ) )
+	{
+		snapshot->next = NULL;
+		snapshot->count = 0;
+		for ( i = 0; i < count; i ++ )
+		{
+			mlt_event event = mlt_properties_get_data_at( type->listeners, i, NULL );
+			if ( event != NULL && event->owner != NULL )
+			{
+				event->snapshot_count ++;
+				snapshot->list[ snapshot->count ++ ] = event;
+			}
+		}
+	}
+
+	event_snapshot old = __atomic_exchange_n( &type->snapshot, snapshot, __ATOMIC_SEQ_CST );
+	if ( old != NULL )
+	{
+		old->next = events->retired;
+		events->retired = old;
+	}
+	snapshot_reclaim( events );
+}
+
+/** Find a registered event.
+ *
+ * \private \memberof mlt_events_struct
+ * \param events an events object
+ * \param id the name of an event
+ * \return the registered event or NULL
+ */
+
+static event_type type_find( mlt_events events, const char *id )
+{
+	event_type type = __atomic_load_n( &events->types, __ATOMIC_ACQUIRE );
+	for ( ; type != NULL; type = type->next )
+		if ( !strcmp( type->id, id ) )
+			return type;
+	return NULL;
+}
+
 /** Initialise the events structure.
  *
  * \public \memberof mlt_events_struct
@@ -143,7 +284,7 @@ void mlt_events_init( mlt_properties self )
 	if ( events == NULL )
 	{
 		events = calloc( 1, sizeof( struct mlt_events_struct ) );
-		events->list = mlt_properties_new( );
+		pthread_mutex_init( &events->mutex, NULL );
 		mlt_events_store( self, events );
 	}
 }
@@ -161,14 +302,23 @@ int mlt_events_register( mlt_properties self, const char *id, mlt_transmitter tr
 {
 	int error = 1;
 	mlt_events events = mlt_events_fetch( self );
-	if ( events != NULL )
+	if ( events != NULL && id != NULL )
 	{
-		mlt_properties list = events->list;
-		char temp[ 128 ];
-		error = mlt_properties_set_data( list, id, transmitter, 0, NULL, NULL );
-		sprintf( temp, "list:%s", id );
-		if ( mlt_properties_get_data( list, temp, NULL ) == NULL )
-			mlt_properties_set_data( list, temp, mlt_properties_new( ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+		pthread_mutex_lock( &events->mutex );
+		event_type type = type_find( events, id );
+		if ( type == NULL && ( type = calloc( 1, sizeof( struct event_type_s ) ) ) )
+		{
+			type->id = strdup( id );
+			type->listeners = mlt_properties_new( );
+			type->next = events->types;
+			__atomic_store_n( &events->types, type, __ATOMIC_RELEASE );
+		}
+		if ( type != NULL )
+		{
+			type->transmitter = transmitter;
+			error = 0;
+		}
+		pthread_mutex_unlock( &events->mutex );
 	}
 	return error;
 }
@@ -187,17 +337,15 @@ int mlt_events_fire( mlt_properties self, const char *id, ... )
 {
 	int result = 0;
 	mlt_events events = mlt_events_fetch( self );
-	if ( events != NULL )
+	event_type type = events != NULL ? type_find( events, id ) : NULL;
+
+	// Do nothing more for an event without listeners.
+	if ( type != NULL && __atomic_load_n( &type->snapshot, __ATOMIC_RELAXED ) != NULL )
 	{
 		int i = 0;
 		va_list alist;
 		void *args[ 10 ];
-		mlt_properties list = events->list;
-		mlt_properties listeners = NULL;
-		char temp[ 128 ];
-		mlt_transmitter transmitter = mlt_properties_get_data( list, id, NULL );
-		sprintf( temp, "list:%s", id );
-		listeners = mlt_properties_get_data( list, temp, NULL );
+		mlt_transmitter transmitter = type->transmitter;
 
 		va_start( alist, id );
 		do
@@ -205,21 +353,22 @@ int mlt_events_fire( mlt_properties self, const char *id, ... )
 		while( args[ i ++ ] != NULL );
 		va_end( alist );
 
-		if ( listeners != NULL )
+		// Keep the snapshot from being freed while it is used.
+		__atomic_add_fetch( &events->firing, 1, __ATOMIC_SEQ_CST );
+		event_snapshot snapshot = __atomic_load_n( &type->snapshot, __ATOMIC_SEQ_CST );
+		for ( i = 0; snapshot != NULL && i < snapshot->count; i ++ )
 		{
-			for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
+			mlt_event event = snapshot->list[ i ];
+			if ( event->owner != NULL && event->block_count == 0 )
 			{
-				mlt_event event = mlt_properties_get_data_at( listeners, i, NULL );
-				if ( event != NULL && event->owner != NULL && event->block_count == 0 )
-				{
-					if ( transmitter != NULL )
-						transmitter( event->listener, event->owner, event->service, args );
-					else
-						event->listener( event->owner, event->service );
-					++result;
-				}
+				if ( transmitter != NULL )
+					transmitter( event->listener, event->owner, event->service, args );
+				else
+					event->listener( event->owner, event->service );
+				++result;
 			}
 		}
+		__atomic_sub_fetch( &events->firing, 1, __ATOMIC_SEQ_CST );
 	}
 	return result;
 }
@@ -238,13 +387,12 @@ mlt_event mlt_events_listen( mlt_properties self, void *service, const char *id,
 {
 	mlt_event event = NULL;
 	mlt_events events = mlt_events_fetch( self );
-	if ( events != NULL )
+	if ( events != NULL && id != NULL )
 	{
-		mlt_properties list = events->list;
-		mlt_properties listeners = NULL;
-		char temp[ 128 ];
-		sprintf( temp, "list:%s", id );
-		listeners = mlt_properties_get_data( list, temp, NULL );
+		pthread_mutex_lock( &events->mutex );
+		event_type type = type_find( events, id );
+		mlt_properties listeners = type ? type->listeners : NULL;
+		char temp[ 20 ];
 		if ( listeners != NULL )
 		{
 			int first_null = -1;
@@ -277,12 +425,15 @@ mlt_event mlt_events_listen( mlt_properties self, void *service, const char *id,
 					event->block_count = 0;
 					event->listener = listener;
 					event->service = service;
+					event->snapshot_count = 0;
 					mlt_properties_set_data( listeners, temp, event, 0, ( mlt_destructor )mlt_event_close, NULL );
 					mlt_event_inc_ref( event );
+					snapshot_update( events, type );
 				}
 			}
 
 		}
+		pthread_mutex_unlock( &events->mutex );
 	}
 	return event;
 }
@@ -299,14 +450,13 @@ void mlt_events_block( mlt_properties self, void *service )
 	mlt_events events = mlt_events_fetch( self );
 	if ( events != NULL )
 	{
-		int i = 0, j = 0;
-		mlt_properties list = events->list;
-		for ( j = 0; j < mlt_properties_count( list ); j ++ )
+		int i = 0;
+		event_type type;
+		pthread_mutex_lock( &events->mutex );
+		for ( type = events->types; type != NULL; type = type->next )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = type->listeners;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
@@ -315,6 +465,7 @@ void mlt_events_block( mlt_properties self, void *service )
 				}
 			}
 		}
+		pthread_mutex_unlock( &events->mutex );
 	}
 }
 
@@ -330,14 +481,13 @@ void mlt_events_unblock( mlt_properties self, void *service )
 	mlt_events events = mlt_events_fetch( self );
 	if ( events != NULL )
 	{
-		int i = 0, j = 0;
-		mlt_properties list = events->list;
-		for ( j = 0; j < mlt_properties_count( list ); j ++ )
+		int i = 0;
+		event_type type;
+		pthread_mutex_lock( &events->mutex );
+		for ( type = events->types; type != NULL; type = type->next )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = type->listeners;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
@@ -346,6 +496,7 @@ void mlt_events_unblock( mlt_properties self, void *service )
 				}
 			}
 		}
+		pthread_mutex_unlock( &events->mutex );
 	}
 }
 
@@ -361,23 +512,29 @@ void mlt_events_disconnect( mlt_properties self, void *service )
 	mlt_events events = mlt_events_fetch( self );
 	if ( events != NULL )
 	{
-		int i = 0, j = 0;
-		mlt_properties list = events->list;
-		for ( j = 0; j < mlt_properties_count( list ); j ++ )
+		int i = 0;
+		event_type type;
+		pthread_mutex_lock( &events->mutex );
+		for ( type = events->types; type != NULL; type = type->next )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = type->listeners;
+				int changed = 0;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
 					char *name = mlt_properties_get_name( listeners, i );
 					if ( entry != NULL && entry->service == service )
+					{
 						mlt_properties_set_data( listeners, name, NULL, 0, NULL, NULL );
+						changed = 1;
+					}
 				}
+				if ( changed )
+					snapshot_update( events, type );
 			}
 		}
+		pthread_mutex_unlock( &events->mutex );
 	}
 }
 
@@ -466,10 +623,7 @@ void mlt_events_close_wait_for( mlt_properties self, mlt_event event )
 
 static mlt_events mlt_events_fetch( mlt_properties self )
 {
-	mlt_events events = NULL;
-	if ( self != NULL )
-		events = mlt_properties_get_data( self, "_events", NULL );
-	return events;
+	return mlt_properties_get_events( self );
 }
 
 /** Store the events object.
@@ -482,7 +636,11 @@ static mlt_events mlt_events_fetch( mlt_properties self )
 static void mlt_events_store( mlt_properties self, mlt_events events )
 {
 	if ( self != NULL && events != NULL )
+	{
+		events->owner = self;
 		mlt_properties_set_data( self, "_events", events, 0, ( mlt_destructor )mlt_events_close, NULL );
+		mlt_properties_set_events( self, events );
+	}
 }
 
 /** Close the events object.
@@ -495,7 +653,24 @@ static void mlt_events_close( mlt_events events )
 {
 	if ( events != NULL )
 	{
-		mlt_properties_close( events->list );
+		mlt_properties_set_events( events->owner, NULL );
+		while ( events->types )
+		{
+			event_type type = events->types;
+			events->types = type->next;
+			mlt_properties_close( type->listeners );
+			if ( type->snapshot )
+				snapshot_free( type->snapshot );
+			free( type->id );
+			free( type );
+		}
+		while ( events->retired )
+		{
+			event_snapshot snapshot = events->retired;
+			events->retired = snapshot->next;
+			snapshot_free( snapshot );
+		}
+		pthread_mutex_destroy( &events->mutex );
 		free( events );
 	}
 }
@@ -62,6 +62,9 @@ static mlt_properties event_object = NULL;
 /** for tracking the unique_id set on each constructed service */
 static int unique_id = 0;
 
+extern void mlt_frame_pool_close( );
+extern void mlt_properties_files_close( );
+
 /* Event transmitters. */
 
 /** the -create-request event transmitter
@@ -134,6 +137,9 @@ mlt_repository mlt_factory_init( const char *directory )
 	if ( ! global_properties )
 		global_properties = mlt_properties_new( );
 
+	if ( getenv( "MLT_LOG_BUFFERED" ) )
+		mlt_log_set_buffered( atoi( getenv( "MLT_LOG_BUFFERED" ) ) );
+
 	// Allow property refresh on a subsequent initialisation
 	if ( global_properties )
 	{
@@ -199,6 +205,12 @@ mlt_repository mlt_factory_init( const char *directory )
 		// Initialise the pool
 		mlt_pool_init( );
 
+		// Start the timeline if MLT_TRACE is set
+		mlt_trace_init( );
+
+		// Serve or write the metrics if MLT_METRICS or MLT_METRICS_PORT is set
+		mlt_metrics_init( );
+
 		// Create and set up the events object
 		event_object = mlt_properties_new( );
 		mlt_events_init( event_object );
@@ -495,6 +507,10 @@ void mlt_factory_close( )
 		}
 		free( mlt_directory );
 		mlt_directory = NULL;
+		mlt_trace_close( );
+		mlt_metrics_close( );
+		mlt_frame_pool_close( );
+		mlt_properties_files_close( );
 		mlt_pool_close( );
 	}
 }
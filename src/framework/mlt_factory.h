@@ -34,6 +34,9 @@
  * \envvar \em MLT_PROFILE selects the default mlt_profile_s, defaults to "dv_pal"
  * \envvar \em MLT_REPOSITORY overrides the default location of the plugin modules, defaults to \p PREFIX_LIB.
  * MLT_REPOSITORY is ignored on Windows and OS X relocatable builds.
+ * \envvar \em MLT_REPOSITORY_INDEX the full path of an index of the services of the modules, which is written
+ * when missing or out of date; when set, each module is loaded only when one of its services is first used
+ * \envvar \em MLT_LOG_BUFFERED when 1, log messages are buffered per thread and written to stderr a line at a time
  * \envvar \em MLT_PRESETS_PATH overrides the default full path to the properties preset files, defaults to \p MLT_DATA/presets
  * \event \em producer-create-request fired when mlt_factory_producer is called
  * \event \em producer-create-done fired when a producer registers itself
@@ -248,7 +248,8 @@ void mlt_field_disconnect_service( mlt_field self, mlt_service service )
 	mlt_service p = mlt_service_producer( service );
 	mlt_service c = mlt_service_consumer( service);
 	int i;
-	switch ( mlt_service_identify(c) )
+	// The tractor may not identify as one, as the root of an XML file
+	switch ( c == MLT_TRACTOR_SERVICE( self->tractor ) ? tractor_type : mlt_service_identify( c ) )
 	{
 		case filter_type:
 			i = mlt_filter_get_track( MLT_FILTER(c) );
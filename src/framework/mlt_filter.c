@@ -282,12 +282,31 @@ double mlt_filter_get_progress( mlt_filter self, mlt_frame frame )
 		return 1.0;
 }
 
+/** Skip the image operations of an optional filter on a degraded frame.
+ *
+ * \private \memberof mlt_filter_s
+ */
+
+static int optional_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	int count = mlt_frame_pop_service_int( frame );
+
+	if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_degrade" ) >= 2 )
+		while ( count-- > 0 )
+			mlt_deque_pop_back( MLT_FRAME_IMAGE_STACK( frame ) );
+	return mlt_frame_get_image( frame, image, format, width, height, writable );
+}
+
 /** Process the frame.
  *
  * When fetching the frame position in a subclass process method, the frame's
  * position is relative to the filter's producer - not the filter's in point
  * or timeline.
  *
+ * The image operations of a filter with the property "optional" are skipped
+ * when a consumer lowers the quality to keep up (see consumer_degrade), so
+ * its get_image must not be the only place that releases what it pushes.
+ *
  * \public \memberof mlt_filter_s
  * \param self a filter
  * \param frame a frame
@@ -322,7 +341,25 @@ mlt_frame mlt_filter_process( mlt_filter self, mlt_frame frame )
 		mlt_properties_set_data( MLT_FRAME_PROPERTIES(frame), name, self, 0,
 			(mlt_destructor) mlt_filter_close, NULL );
 
-		return self->process( self, frame );
+		int image = mlt_deque_count( MLT_FRAME_IMAGE_STACK( frame ) );
+		int audio = mlt_deque_count( MLT_FRAME_AUDIO_STACK( frame ) );
+		mlt_frame result = self->process( self, frame );
+		if ( result != frame )
+			return result;
+		mlt_frame_trace_push( frame, MLT_FILTER_SERVICE( self ),
+			mlt_deque_count( MLT_FRAME_IMAGE_STACK( frame ) ) - image,
+			mlt_deque_count( MLT_FRAME_AUDIO_STACK( frame ) ) - audio );
+
+		if ( mlt_properties_get_int( properties, "optional" ) )
+		{
+			int count = mlt_deque_count( MLT_FRAME_IMAGE_STACK( frame ) ) - image;
+			if ( count > 0 )
+			{
+				mlt_frame_push_service_int( frame, count );
+				mlt_frame_push_get_image( frame, optional_get_image );
+			}
+		}
+		return frame;
 	}
 }
 
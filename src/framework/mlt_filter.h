@@ -34,6 +34,8 @@
  * \properties \em service a reference to the service to which this filter is attached.
  * \properties \em disable Set this to disable the filter while keeping it in the object model.
  * Currently this is not cleared when the filter is detached.
+ * \properties \em optional Set this to let a consumer with the adaptive property skip the
+ * filter's image processing when it cannot keep up.
  */
 
 struct mlt_filter_s
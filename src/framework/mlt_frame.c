@@ -25,10 +25,493 @@
 #include "mlt_factory.h"
 #include "mlt_profile.h"
 #include "mlt_log.h"
+#include "mlt_slices.h"
+#include "mlt_peaks.h"
+#include "mlt_trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+/** \brief private to mlt_frame_s, an image being rendered by mlt_frame_prefetch_image()
+ */
+
+typedef struct
+{
+	mlt_frame frame;
+	uint8_t *image;
+	mlt_image_format format;
+	int width;
+	int height;
+	int writable;
+	int error;
+	mlt_slices_runtime runtime;
+}
+*frame_prefetch;
+
+static pthread_key_t prefetch_key;
+static pthread_once_t prefetch_key_once = PTHREAD_ONCE_INIT;
+
+static void prefetch_key_init( )
+{
+	pthread_key_create( &prefetch_key, NULL );
+}
+
+/* The number of tracing consumers, and the accumulator of the time spent
+ * below the operation being timed on this thread.
+ */
+static int trace_users = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static void trace_key_init( )
+{
+	pthread_key_create( &trace_key, NULL );
+}
+
+extern int mlt_properties_reset( mlt_properties self );
+extern mlt_destructor mlt_properties_get_destructor( mlt_properties self, const char *name );
+
+/** the maximum number of closed frames a per-thread magazine holds */
+
+#define FRAME_MAGAZINE_MAX 16
+
+/** the default maximum number of closed frames shared by the threads (override with MLT_FRAME_POOL) */
+
+#define FRAME_POOL_MAX 256
+
+/** \brief private to mlt_frame_s, a per-thread stack of closed frames for reuse
+ *
+ * Only the owning thread touches the magazine, so no lock is needed to take
+ * or return a frame unless it runs empty or full. Then half a magazine is
+ * moved to or from the shared stack under one lock.
+ */
+
+typedef struct frame_magazine_s
+{
+	int count;
+	mlt_frame items[ FRAME_MAGAZINE_MAX ];
+	struct frame_magazine_s *next;
+	struct frame_magazine_s *prev;
+}
+*frame_magazine;
+
+static frame_magazine magazines = NULL;
+static mlt_deque frame_stack = NULL;
+static int frame_pool_max = 0;
+static pthread_mutex_t frame_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t magazine_key;
+static pthread_once_t magazine_key_once = PTHREAD_ONCE_INIT;
+
+// Free a frame and everything it holds.
+static void frame_destroy( mlt_frame self )
+{
+	mlt_deque_close( self->stack_image );
+	mlt_deque_close( self->stack_audio );
+	while( mlt_deque_peek_back( self->stack_service ) )
+		mlt_service_close( mlt_deque_pop_back( self->stack_service ) );
+	mlt_deque_close( self->stack_service );
+	mlt_properties_close( &self->parent );
+	free( self );
+}
+
+/** Move frames from a magazine to the shared stack, freeing those that do not fit.
+ *
+ * \private \memberof mlt_frame_s
+ * \param magazine a magazine
+ * \param n the number of frames to move
+ */
+
+static void magazine_flush( frame_magazine magazine, int n )
+{
+	mlt_frame excess[ FRAME_MAGAZINE_MAX ];
+	int count = 0;
+
+	pthread_mutex_lock( &frame_pool_lock );
+	if ( !frame_stack )
+		frame_stack = mlt_deque_init( );
+	while ( n-- > 0 && magazine->count )
+	{
+		mlt_frame frame = magazine->items[ -- magazine->count ];
+		if ( frame_stack && mlt_deque_count( frame_stack ) < frame_pool_max )
+			mlt_deque_push_back( frame_stack, frame );
+		else
+			excess[ count ++ ] = frame;
+	}
+	pthread_mutex_unlock( &frame_pool_lock );
+
+	while ( count )
+		frame_destroy( excess[ -- count ] );
+}
+
+/** Destroy the magazine of a terminating thread, returning its frames to the shared stack.
+ *
+ * \private \memberof mlt_frame_s
+ * \param arg a magazine
+ */
+
+static void magazine_close( void *arg )
+{
+	frame_magazine magazine = arg;
+
+	magazine_flush( magazine, magazine->count );
+	pthread_mutex_lock( &frame_pool_lock );
+	if ( magazine->prev )
+		magazine->prev->next = magazine->next;
+	else
+		magazines = magazine->next;
+	if ( magazine->next )
+		magazine->next->prev = magazine->prev;
+	pthread_mutex_unlock( &frame_pool_lock );
+	free( magazine );
+}
+
+static void magazine_key_init( )
+{
+	const char *env = getenv( "MLT_FRAME_POOL" );
+	frame_pool_max = env ? atoi( env ) : FRAME_POOL_MAX;
+	pthread_key_create( &magazine_key, magazine_close );
+}
+
+/** Get the magazine of the calling thread, creating it on first use.
+ *
+ * \private \memberof mlt_frame_s
+ * \return the magazine or NULL if frames are not pooled
+ */
+
+static frame_magazine magazine_get( )
+{
+	frame_magazine magazine;
+
+	pthread_once( &magazine_key_once, magazine_key_init );
+	if ( frame_pool_max <= 0 )
+		return NULL;
+	magazine = pthread_getspecific( magazine_key );
+	if ( !magazine && ( magazine = calloc( 1, sizeof( *magazine ) ) ) )
+	{
+		pthread_mutex_lock( &frame_pool_lock );
+		magazine->next = magazines;
+		if ( magazines )
+			magazines->prev = magazine;
+		magazines = magazine;
+		pthread_mutex_unlock( &frame_pool_lock );
+		pthread_setspecific( magazine_key, magazine );
+	}
+	return magazine;
+}
+
+/** Take a closed frame for reuse.
+ *
+ * \private \memberof mlt_frame_s
+ * \return a frame with empty properties and stacks or NULL
+ */
+
+static mlt_frame frame_fetch( )
+{
+	frame_magazine magazine = magazine_get( );
+
+	if ( !magazine )
+		return NULL;
+
+	// Refill an empty magazine with half its capacity from the shared stack
+	if ( magazine->count == 0 && frame_stack )
+	{
+		pthread_mutex_lock( &frame_pool_lock );
+		while ( magazine->count < FRAME_MAGAZINE_MAX / 2 && mlt_deque_count( frame_stack ) )
+			magazine->items[ magazine->count ++ ] = mlt_deque_pop_back( frame_stack );
+		pthread_mutex_unlock( &frame_pool_lock );
+	}
+	return magazine->count ? magazine->items[ -- magazine->count ] : NULL;
+}
+
+/** Empty a frame whose last reference was closed and keep it for reuse.
+ *
+ * \private \memberof mlt_frame_s
+ * \param self a frame
+ * \return true if the frame was kept, otherwise the caller must destroy it
+ */
+
+static int frame_recycle( mlt_frame self )
+{
+	frame_magazine magazine = magazine_get( );
+
+	if ( !magazine || MLT_FRAME_PROPERTIES( self )->close != NULL )
+		return 0;
+
+	while ( mlt_deque_count( self->stack_image ) )
+		mlt_deque_pop_back( self->stack_image );
+	while ( mlt_deque_count( self->stack_audio ) )
+		mlt_deque_pop_back( self->stack_audio );
+	while( mlt_deque_peek_back( self->stack_service ) )
+		mlt_service_close( mlt_deque_pop_back( self->stack_service ) );
+	while ( mlt_deque_count( self->stack_service ) )
+		mlt_deque_pop_back( self->stack_service );
+	mlt_properties_reset( MLT_FRAME_PROPERTIES( self ) );
+	self->get_alpha_mask = NULL;
+	self->convert_image = NULL;
+	self->convert_audio = NULL;
+	self->is_processing = 0;
+
+	// Spill half of a full magazine to the shared stack
+	if ( magazine->count == FRAME_MAGAZINE_MAX )
+		magazine_flush( magazine, FRAME_MAGAZINE_MAX / 2 );
+	magazine->items[ magazine->count ++ ] = self;
+	return 1;
+}
+
+/** Free the closed frames kept for reuse.
+ *
+ * This is private to the framework and called by mlt_factory_close(); the
+ * frames must no longer be in use.
+ * \private \memberof mlt_frame_s
+ */
+
+void mlt_frame_pool_close( )
+{
+	frame_magazine magazine;
+
+	pthread_mutex_lock( &frame_pool_lock );
+	for ( magazine = magazines; magazine; magazine = magazine->next )
+		while ( magazine->count )
+			frame_destroy( magazine->items[ -- magazine->count ] );
+	if ( frame_stack )
+	{
+		while ( mlt_deque_count( frame_stack ) )
+			frame_destroy( mlt_deque_pop_back( frame_stack ) );
+		mlt_deque_close( frame_stack );
+		frame_stack = NULL;
+	}
+	pthread_mutex_unlock( &frame_pool_lock );
+}
+
+// Get the start time of an operation when tracing the frame.
+static int64_t trace_begin( mlt_frame self )
+{
+	if ( trace_users && mlt_properties_get_data( MLT_FRAME_PROPERTIES( self ), "_trace", NULL ) )
+	{
+		pthread_once( &trace_key_once, trace_key_init );
+		return mlt_log_timings_now();
+	}
+	return 0;
+}
+
+// Add the time of an operation to the stats and to the operation that called it.
+static void trace_end( mlt_frame self, const char *stage, int64_t begin )
+{
+	if ( begin )
+	{
+		int64_t time = mlt_log_timings_now() - begin;
+		int64_t *outer = pthread_getspecific( trace_key );
+		if ( outer )
+			*outer += time;
+		mlt_frame_trace( self, NULL, stage, time );
+	}
+}
+
+// Put an operation of a service on the timeline.
+static void trace_timeline( mlt_service service, const char *operation, int64_t begin )
+{
+	if ( begin )
+	{
+		const char *category;
+		char name[64];
+
+		switch ( mlt_service_identify( service ) )
+		{
+			case producer_type:
+			case playlist_type:
+			case tractor_type:
+			case multitrack_type:
+				category = "producer"; break;
+			case filter_type: category = "filter"; break;
+			case transition_type: category = "transition"; break;
+			default: category = "service"; break;
+		}
+		snprintf( name, sizeof( name ), "%s %s",
+			mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "mlt_service" ), operation );
+		mlt_trace_end( category, name, begin );
+	}
+}
+
+// Time the image operations that a service pushed, less those that they call.
+static int trace_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_service service = mlt_frame_pop_service( self );
+	int64_t begin = trace_begin( self );
+	int64_t inner = 0;
+	int64_t *outer = NULL;
+	int64_t timeline = mlt_trace_begin( );
+	int error;
+
+	if ( begin )
+	{
+		outer = pthread_getspecific( trace_key );
+		pthread_setspecific( trace_key, &inner );
+	}
+	error = mlt_frame_get_image( self, buffer, format, width, height, writable );
+	trace_timeline( service, "image", timeline );
+	if ( begin )
+	{
+		int64_t time = mlt_log_timings_now() - begin;
+		pthread_setspecific( trace_key, outer );
+		if ( outer )
+			*outer += time;
+		mlt_frame_trace( self, service, "image", time - inner );
+	}
+	return error;
+}
+
+static int trace_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	mlt_service service = mlt_frame_pop_audio( self );
+	int64_t begin = trace_begin( self );
+	int64_t inner = 0;
+	int64_t *outer = NULL;
+	int64_t timeline = mlt_trace_begin( );
+	int error;
+
+	if ( begin )
+	{
+		outer = pthread_getspecific( trace_key );
+		pthread_setspecific( trace_key, &inner );
+	}
+	error = mlt_frame_get_audio( self, buffer, format, frequency, channels, samples );
+	trace_timeline( service, "audio", timeline );
+	if ( begin )
+	{
+		int64_t time = mlt_log_timings_now() - begin;
+		pthread_setspecific( trace_key, outer );
+		if ( outer )
+			*outer += time;
+		mlt_frame_trace( self, service, "audio", time - inner );
+	}
+	return error;
+}
+
+/** Count the consumers that trace their frames.
+ *
+ * Services only time their operations while a consumer is tracing, and only
+ * on the frames that carry stats from mlt_frame_trace_stats().
+ *
+ * \public \memberof mlt_frame_s
+ * \param enable true to add a tracing consumer, false to remove one
+ */
+
+void mlt_frame_trace_enable( int enable )
+{
+	if ( enable )
+		__sync_add_and_fetch( &trace_users, 1 );
+	else
+		__sync_sub_and_fetch( &trace_users, 1 );
+}
+
+/** Get the stats of a traced frame.
+ *
+ * The stats hold the microseconds spent in each stage of the frame, named
+ * \em stage.service.id for the operations of the services. \p create adds
+ * them to a frame that has none.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param create whether to start tracing the frame
+ * \return the stats or NULL if the frame is not traced
+ */
+
+mlt_properties mlt_frame_trace_stats( mlt_frame self, int create )
+{
+	mlt_properties stats = NULL;
+	if ( self )
+	{
+		stats = mlt_properties_get_data( MLT_FRAME_PROPERTIES( self ), "_trace", NULL );
+		if ( !stats && create && ( stats = mlt_properties_new() ) )
+			mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "_trace", stats, 0,
+				( mlt_destructor )mlt_properties_close, NULL );
+	}
+	return stats;
+}
+
+/** Add the time of a stage to the stats of a traced frame.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param service the service that did the work or NULL
+ * \param stage the name of the stage, such as "image" or "encode"
+ * \param time the microseconds spent
+ */
+
+void mlt_frame_trace( mlt_frame self, mlt_service service, const char *stage, int64_t time )
+{
+	mlt_properties stats = mlt_frame_trace_stats( self, 0 );
+	if ( stats && stage )
+	{
+		char key[128];
+		if ( service )
+		{
+			mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
+			const char *name = mlt_properties_get( properties, "mlt_service" );
+			snprintf( key, sizeof(key), "%s.%s.%d", stage, name ? name : "unknown",
+				mlt_properties_get_int( properties, "_unique_id" ) );
+		}
+		else
+		{
+			snprintf( key, sizeof(key), "%s", stage );
+		}
+		pthread_mutex_lock( &trace_mutex );
+		mlt_properties_set_int64( stats, key, mlt_properties_get_int64( stats, key ) + time );
+		pthread_mutex_unlock( &trace_mutex );
+	}
+}
+
+/** Time the operations that a service has just pushed on a frame.
+ *
+ * \p image and \p audio are how many entries the service added to the top
+ * of the image and audio stacks. While a consumer traces, they are covered by
+ * an operation that records their time, without that of the operations they
+ * call, in the stats of the frame. The operations also go on the timeline
+ * when MLT_TRACE is set. This does nothing unless a consumer traces or the
+ * timeline is on.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param service the service that pushed the operations
+ * \param image the number of new image stack entries
+ * \param audio the number of new audio stack entries
+ */
+
+void mlt_frame_trace_push( mlt_frame self, mlt_service service, int image, int audio )
+{
+	if ( self && service && ( trace_users || mlt_trace_enabled( ) ) )
+	{
+		if ( image > 0 )
+		{
+			mlt_frame_push_service( self, service );
+			mlt_frame_push_get_image( self, trace_get_image );
+		}
+		if ( audio > 0 )
+		{
+			mlt_frame_push_audio( self, service );
+			mlt_frame_push_audio( self, trace_get_audio );
+		}
+	}
+}
+
+// Convert the image, timing it when tracing.
+static void frame_convert_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, mlt_image_format requested )
+{
+	int64_t begin = trace_begin( self );
+	self->convert_image( self, buffer, format, requested );
+	trace_end( self, "convert_image", begin );
+}
+
+static void frame_convert_audio( mlt_frame self, void **buffer, mlt_audio_format *format, mlt_audio_format requested )
+{
+	int64_t begin = trace_begin( self );
+	self->convert_audio( self, buffer, format, requested );
+	trace_end( self, "convert_audio", begin );
+}
 
 /** Construct a frame object.
  *
@@ -39,16 +522,22 @@
 
 mlt_frame mlt_frame_init( mlt_service service )
 {
-	// Allocate a frame
-	mlt_frame self = calloc( 1, sizeof( struct mlt_frame_s ) );
+	// Reuse a closed frame or allocate one
+	mlt_frame self = frame_fetch( );
+
+	if ( self == NULL && ( self = calloc( 1, sizeof( struct mlt_frame_s ) ) ) )
+	{
+		// Initialise the properties and construct stacks for frames and methods
+		mlt_properties_init( &self->parent, self );
+		self->stack_image = mlt_deque_init( );
+		self->stack_audio = mlt_deque_init( );
+		self->stack_service = mlt_deque_init( );
+	}
 
 	if ( self != NULL )
 	{
 		mlt_profile profile = mlt_service_profile( service );
-
-		// Initialise the properties
 		mlt_properties properties = &self->parent;
-		mlt_properties_init( properties, self );
 
 		// Set default properties on the frame
 		mlt_properties_set_position( properties, "_position", 0.0 );
@@ -58,11 +547,6 @@ mlt_frame mlt_frame_init( mlt_service service )
 		mlt_properties_set_double( properties, "aspect_ratio", mlt_profile_sar( NULL ) );
 		mlt_properties_set_data( properties, "audio", NULL, 0, NULL, NULL );
 		mlt_properties_set_data( properties, "alpha", NULL, 0, NULL, NULL );
-
-		// Construct stacks for frames and methods
-		self->stack_image = mlt_deque_init( );
-		self->stack_audio = mlt_deque_init( );
-		self->stack_service = mlt_deque_init( );
 	}
 
 	return self;
@@ -309,6 +793,190 @@ void *mlt_frame_pop_audio( mlt_frame self )
 	return mlt_deque_pop_back( self->stack_audio );
 }
 
+/** \brief private to mlt_frame_s, a band of an image that a lookup table stage maps
+ */
+
+typedef struct
+{
+	mlt_lut *lut;
+	uint8_t *image;
+	uint8_t *alpha;
+	mlt_image_format format;
+	int width;
+	int height;
+}
+frame_lut_desc;
+
+#define LUT_MIN_SLICE_HEIGHT (16)
+
+static int lut_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	frame_lut_desc *desc = cookie;
+	const uint8_t *t0 = desc->lut->table[0];
+	const uint8_t *t1 = desc->lut->table[1];
+	const uint8_t *t2 = desc->lut->table[2];
+	const uint8_t *t3 = desc->lut->table[3];
+	int width = desc->width;
+	int y = desc->height * index / jobs;
+	int end = desc->height * ( index + 1 ) / jobs;
+	int x;
+
+	for ( ; y < end; y++ )
+	{
+		if ( desc->format == mlt_image_yuv422 )
+		{
+			// U and V alternate from the start of each row.
+			uint8_t *p = desc->image + y * width * 2;
+			for ( x = 0; x + 1 < width; x += 2, p += 4 )
+			{
+				p[0] = t0[ p[0] ];
+				p[1] = t1[ p[1] ];
+				p[2] = t0[ p[2] ];
+				p[3] = t2[ p[3] ];
+			}
+			if ( x < width )
+			{
+				p[0] = t0[ p[0] ];
+				p[1] = t1[ p[1] ];
+			}
+			if ( desc->alpha )
+			{
+				p = desc->alpha + y * width;
+				for ( x = 0; x < width; x++ )
+					p[x] = t3[ p[x] ];
+			}
+		}
+		else if ( desc->format == mlt_image_rgb24a )
+		{
+			uint8_t *p = desc->image + y * width * 4;
+			if ( desc->lut->alpha )
+			{
+				for ( x = 0; x < width; x++, p += 4 )
+				{
+					p[0] = t0[ p[0] ];
+					p[1] = t1[ p[1] ];
+					p[2] = t2[ p[2] ];
+					p[3] = t3[ p[3] ];
+				}
+			}
+			else
+			{
+				for ( x = 0; x < width; x++, p += 4 )
+				{
+					p[0] = t0[ p[0] ];
+					p[1] = t1[ p[1] ];
+					p[2] = t2[ p[2] ];
+				}
+			}
+		}
+		else
+		{
+			uint8_t *p = desc->image + y * width * 3;
+			for ( x = 0; x < width; x++, p += 3 )
+			{
+				p[0] = t0[ p[0] ];
+				p[1] = t1[ p[1] ];
+				p[2] = t2[ p[2] ];
+			}
+		}
+	}
+	return 0;
+}
+
+/** Get the image of a lookup table stage (get_image callback).
+ *
+ * \private \memberof mlt_frame_s
+ */
+
+static int lut_get_image( mlt_frame self, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_lut *lut = mlt_frame_pop_service( self );
+	int error;
+
+	if ( lut->format == mlt_image_rgb24 )
+	{
+		if ( *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
+			*format = mlt_image_rgb24;
+	}
+	else
+	{
+		*format = lut->format;
+	}
+
+	error = mlt_frame_get_image( self, image, format, width, height, 1 );
+
+	if ( !error && *image && *width > 0 && *height > 0 &&
+		( *format == lut->format || ( lut->format == mlt_image_rgb24 && *format == mlt_image_rgb24a ) ) )
+	{
+		frame_lut_desc desc = { lut, *image, NULL, *format, *width, *height };
+		int jobs = MIN( mlt_slices_count_normal(), *height / LUT_MIN_SLICE_HEIGHT );
+
+		// A missing alpha channel is opaque, which stays so unless the table changes 255
+		if ( lut->alpha && *format == mlt_image_yuv422 && ( lut->table[3][255] != 255 || mlt_frame_get_alpha( self ) ) )
+			desc.alpha = mlt_frame_get_alpha_mask( self );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, lut_slice_proc, &desc );
+		else
+			lut_slice_proc( 0, 0, 1, &desc );
+	}
+
+	return error;
+}
+
+/** Get the lookup tables that a point filter composes its operation into.
+ *
+ * A filter that maps every channel value on its own, like brightness or
+ * gamma, can call this from its process function instead of pushing a
+ * get_image and sweeping the image itself. It applies its operation to every
+ * entry of the tables in place, for example table[0][i] = f( table[0][i] ).
+ * While the top of the image stack is a lookup table stage of the same
+ * format, consecutive filters compose into it, and the image is then mapped in
+ * a single pass with one conversion; otherwise a new stage of identity tables
+ * is pushed. Set \p alpha on the tables after changing table[3]; it applies to
+ * the alpha mask of yuv422, and to the alpha bytes of rgb24a.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param format mlt_image_yuv422, or either of mlt_image_rgb24 and mlt_image_rgb24a
+ * for a stage that takes the one of those the caller requests and otherwise rgb24
+ * \return the lookup tables or NULL if the format is not supported
+ */
+
+mlt_lut *mlt_frame_push_lut( mlt_frame self, mlt_image_format format )
+{
+	int count = mlt_deque_count( self->stack_image );
+	mlt_lut *lut;
+	char name[32];
+	int i;
+
+	if ( format == mlt_image_rgb24a )
+		format = mlt_image_rgb24;
+	if ( format != mlt_image_yuv422 && format != mlt_image_rgb24 )
+		return NULL;
+
+	if ( count >= 2 && mlt_deque_peek_back( self->stack_image ) == (void*) lut_get_image )
+	{
+		lut = mlt_deque_peek( self->stack_image, count - 2 );
+		if ( lut->format == format )
+			return lut;
+	}
+
+	lut = calloc( 1, sizeof( *lut ) );
+	if ( lut == NULL )
+		return NULL;
+	lut->format = format;
+	for ( i = 0; i < 256; i++ )
+		lut->table[0][i] = lut->table[1][i] = lut->table[2][i] = lut->table[3][i] = i;
+
+	// The stage belongs to the frame, and its position on the stack makes it unique.
+	snprintf( name, sizeof( name ), "_lut.%d", count );
+	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), name, lut, sizeof( *lut ), free, NULL );
+	mlt_frame_push_service( self, lut );
+	mlt_frame_push_get_image( self, lut_get_image );
+
+	return lut;
+}
+
 /** Return the service stack
  *
  * \public \memberof mlt_frame_s
@@ -321,6 +989,275 @@ mlt_deque mlt_frame_service_stack( mlt_frame self )
 	return self->stack_service;
 }
 
+// Get the size of the image buffer, which a view keeps whole.
+static int image_size( mlt_properties properties )
+{
+	if ( mlt_properties_get_int( properties, "_view.full_width" ) )
+		return mlt_image_format_size( mlt_properties_get_int( properties, "format" ),
+			mlt_properties_get_int( properties, "_view.full_width" ),
+			mlt_properties_get_int( properties, "_view.full_height" ), NULL );
+	return mlt_image_format_size( mlt_properties_get_int( properties, "format" ),
+		mlt_properties_get_int( properties, "width" ),
+		mlt_properties_get_int( properties, "height" ), NULL );
+}
+
+/** Copy a buffer of the frame that another frame shares before it is written.
+ *
+ * \private \memberof mlt_frame_s
+ * \param self a frame
+ * \param name the name of the buffer property
+ * \param size the size of the buffer if the property does not have it
+ * \return the buffer, which the frame now holds alone
+ */
+
+static void *frame_unshare( mlt_frame self, const char *name, int size )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	int length = 0;
+	void *data = mlt_properties_get_data( properties, name, &length );
+
+	if ( data && mlt_properties_get_destructor( properties, name ) == mlt_pool_release && mlt_pool_is_shared( data ) )
+	{
+		void *copy;
+		if ( length > 0 )
+			size = length;
+		if ( size > 0 && ( copy = mlt_pool_alloc( size ) ) )
+		{
+			memcpy( copy, data, size );
+			mlt_properties_set_data( properties, name, copy, length, mlt_pool_release, NULL );
+			data = copy;
+		}
+	}
+	return data;
+}
+
+// Unshare the image and alpha of the frame before the caller writes to buffer.
+static void unshare_image( mlt_frame self, uint8_t **buffer )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	int size = 0;
+	uint8_t *image = mlt_properties_get_data( properties, "image", &size );
+
+	if ( image )
+	{
+		if ( size <= 0 )
+			size = image_size( properties );
+		if ( *buffer >= image && *buffer < image + size )
+			*buffer = ( uint8_t * )frame_unshare( self, "image", size ) + ( *buffer - image );
+	}
+	frame_unshare( self, "alpha", mlt_properties_get_int( properties, "width" ) * mlt_properties_get_int( properties, "height" ) );
+}
+
+/** Get a buffer of the frame to share it with another frame.
+ *
+ * A buffer allocated with mlt_pool is shared with a new reference, which the
+ * caller must drop with mlt_pool_release(), normally by setting it as the
+ * destructor of the buffer on the other frame. A frame copies a shared image
+ * when it is asked for a writable one, a shared alpha channel when it is
+ * asked for a writable image or by mlt_frame_get_alpha_mask(), and shared
+ * audio when it is asked for audio, so neither frame sees the writes of the
+ * other.
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param name the name of the buffer property: "image", "alpha" or "audio"
+ * \param[out] size the size of the buffer in bytes if available (optional)
+ * \return the buffer or NULL if it cannot be shared and must be copied
+ */
+
+void *mlt_frame_share_data( mlt_frame self, const char *name, int *size )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	void *data = mlt_properties_get_data( properties, name, size );
+
+	if ( data && mlt_properties_get_destructor( properties, name ) == mlt_pool_release )
+		return mlt_pool_retain( data );
+	return NULL;
+}
+
+/** Mark the image of a frame as static content.
+ *
+ * A producer calls this when it generates the same image for every frame with
+ * the same content, for example a solid colour or a still picture. The content
+ * describes everything that determines the image before scaling, such as the
+ * resource and the index of the picture. The mark is removed when a filter
+ * other than a normaliser, or a transition, processes the frame. Services that
+ * see it can reuse what they made from an earlier frame with the same hash.
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param content a string that identifies the content of the image
+ */
+
+void mlt_frame_set_static_image( mlt_frame self, const char *content )
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char *c;
+
+	for ( c = ( const unsigned char * )( content ? content : "" ); *c; c++ )
+		hash = ( hash ^ *c ) * 1099511628211ULL;
+	mlt_properties_set_int64( MLT_FRAME_PROPERTIES( self ), "static_image", hash ? ( int64_t )hash : 1 );
+}
+
+/** Get the hash of the static content of the image of a frame.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \return the hash of the content or 0 if the image is not known to be static
+ * \see mlt_frame_set_static_image
+ */
+
+uint64_t mlt_frame_get_static_image( mlt_frame self )
+{
+	return ( uint64_t )mlt_properties_get_int64( MLT_FRAME_PROPERTIES( self ), "static_image" );
+}
+
+/** Get the value of an alpha channel that is the same everywhere.
+ *
+ * This uses the constant_alpha property when a producer has set it. Otherwise,
+ * it looks at the alpha channel only until it finds a different value, so it
+ * is cheap for most images that are not constant.
+ * An image without an alpha channel is opaque.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param alpha the alpha channel of the image or NULL if it has none
+ * \param size the number of values in \p alpha
+ * \return the value of every pixel of the alpha channel or -1 if it is not constant
+ */
+
+int mlt_frame_get_constant_alpha( mlt_frame self, const uint8_t *alpha, int size )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	const uint8_t *p;
+
+	if ( mlt_properties_get( properties, "constant_alpha" ) )
+		return mlt_properties_get_int( properties, "constant_alpha" );
+	if ( !alpha )
+		return 255;
+	if ( size <= 0 )
+		return -1;
+	for ( p = alpha + 1; p < alpha + size; p++ )
+		if ( *p != *alpha )
+			return -1;
+	return *alpha;
+}
+
+/** Forget what is known about the content of the image of a frame.
+ *
+ * Call this when the image is changed by something other than its producer
+ * and the normalising filters. It clears the static_image, solid_colour,
+ * constant_alpha and alpha_box properties, and an alpha box that the producer
+ * sets later, when it makes the image, is ignored.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ */
+
+void mlt_frame_clear_image_hints( mlt_frame self )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+
+	if ( mlt_properties_get_int64( properties, "static_image" ) )
+		mlt_properties_set_int64( properties, "static_image", 0 );
+	if ( mlt_properties_get( properties, "solid_colour" ) )
+		mlt_properties_set( properties, "solid_colour", NULL );
+	if ( mlt_properties_get( properties, "constant_alpha" ) )
+		mlt_properties_set( properties, "constant_alpha", NULL );
+	if ( mlt_properties_get( properties, "alpha_box" ) )
+		mlt_properties_set( properties, "alpha_box", NULL );
+	mlt_properties_set_int( properties, "_image_hints_cleared", 1 );
+}
+
+/** Set the bounding box of the pixels of the alpha channel that are not transparent.
+ *
+ * Everything outside of the box has an alpha of 0. It is kept relative to the
+ * size of the image so that it follows the image when it is scaled.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param box the box in pixels, with a width or height of 0 when all of the alpha is 0
+ * \param width the width of the image that \p box is in
+ * \param height the height of the image that \p box is in
+ * \see mlt_frame_get_alpha_box, mlt_image_alpha_box
+ */
+
+void mlt_frame_set_alpha_box( mlt_frame self, mlt_rect box, int width, int height )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+
+	if ( width <= 0 || height <= 0 || mlt_properties_get_int( properties, "_image_hints_cleared" ) )
+		return;
+	box.o = 1.0;
+	mlt_properties_set_rect( properties, "alpha_box", box );
+	mlt_properties_set_int( properties, "alpha_box.width", width );
+	mlt_properties_set_int( properties, "alpha_box.height", height );
+}
+
+/** Get the bounding box of the pixels of the alpha channel that are not transparent.
+ *
+ * The box is scaled to the size of the image and grown by enough pixels to
+ * cover what scaling with interpolation spreads beyond its edges.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param width the width of the image
+ * \param height the height of the image
+ * \param[out] box the box in pixels within the image
+ * \return true if the box is known
+ * \see mlt_frame_set_alpha_box
+ */
+
+int mlt_frame_get_alpha_box( mlt_frame self, int width, int height, mlt_rect *box )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	int box_width = mlt_properties_get_int( properties, "alpha_box.width" );
+	int box_height = mlt_properties_get_int( properties, "alpha_box.height" );
+
+	if ( !mlt_properties_get( properties, "alpha_box" ) || box_width <= 0 || box_height <= 0 || width <= 0 || height <= 0 )
+		return 0;
+
+	mlt_rect r = mlt_properties_get_rect( properties, "alpha_box" );
+	double sx = ( double )width / box_width;
+	double sy = ( double )height / box_height;
+	if ( r.w <= 0 || r.h <= 0 )
+	{
+		box->x = box->y = box->w = box->h = 0;
+		box->o = 1.0;
+		return 1;
+	}
+
+	// Allow for an interpolation filter reaching 3 pixels of the source
+	int mx = ceil( 3 * ( sx > 1.0 ? sx : 1.0 ) );
+	int my = ceil( 3 * ( sy > 1.0 ? sy : 1.0 ) );
+	int x0 = floor( r.x * sx ) - mx;
+	int y0 = floor( r.y * sy ) - my;
+	int x1 = ceil( ( r.x + r.w ) * sx ) + mx;
+	int y1 = ceil( ( r.y + r.h ) * sy ) + my;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 > width ? width : x1;
+	y1 = y1 > height ? height : y1;
+	box->x = x0;
+	box->y = y0;
+	box->w = x1 > x0 ? x1 - x0 : 0;
+	box->h = y1 > y0 ? y1 - y0 : 0;
+	box->o = 1.0;
+	return 1;
+}
+
+// Forget the view of the image when the image is replaced.
+static void clear_image_view( mlt_frame self )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	if ( mlt_properties_get_int( properties, "_view.full_width" ) )
+	{
+		mlt_properties_set_int( properties, "_view.full_width", 0 );
+		mlt_properties_set_int( properties, "_view.full_height", 0 );
+		mlt_properties_set_int( properties, "_view.x", 0 );
+		mlt_properties_set_int( properties, "_view.y", 0 );
+	}
+}
+
 /** Set a new image on the frame.
   *
   * \public \memberof mlt_frame_s
@@ -333,6 +1270,7 @@ mlt_deque mlt_frame_service_stack( mlt_frame self )
 
 int mlt_frame_set_image( mlt_frame self, uint8_t *image, int size, mlt_destructor destroy )
 {
+	clear_image_view( self );
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, size, destroy, NULL );
 }
 
@@ -372,23 +1310,183 @@ int mlt_frame_set_alpha( mlt_frame self, uint8_t *alpha, int size, mlt_destructo
  *
  * \public \memberof mlt_frame_s
  * \param self a frame
- * \param image a new image
- * \param format the image format
- * \param width the width of the new image
- * \param height the height of the new image
+ * \param image a new image
+ * \param format the image format
+ * \param width the width of the new image
+ * \param height the height of the new image
+ */
+
+void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_format format, int width, int height )
+{
+	// Remove all items from the stack
+	while( mlt_deque_pop_back( self->stack_image ) ) ;
+
+	// Update the information
+	clear_image_view( self );
+	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, 0, NULL, NULL );
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "width", width );
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "height", height );
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "format", format );
+	self->get_alpha_mask = NULL;
+}
+
+/** Make the image of the frame a view of a region of it.
+ *
+ * The image is not copied: a view keeps the buffer of the frame and only
+ * changes its width, height and the address and stride of its planes. Use
+ * mlt_frame_get_image_planes() to address a view. Views are only handed out
+ * by mlt_frame_get_image_view(); mlt_frame_get_image() packs them. Setting
+ * a new image with mlt_frame_set_image() discards the view. The "format",
+ * "width" and "height" properties must describe the current image.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param x the left of the region in pixels of the current image
+ * \param y the top of the region in pixels of the current image
+ * \param width the width of the region in pixels
+ * \param height the height of the region in pixels
+ * \return true if error, for example if the region is not aligned to the chroma subsampling
+ */
+
+int mlt_frame_set_image_view( mlt_frame self, int x, int y, int width, int height )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	uint8_t *image = mlt_properties_get_data( properties, "image", NULL );
+	mlt_image_format format = mlt_properties_get_int( properties, "format" );
+	int full_width = mlt_properties_get_int( properties, "_view.full_width" );
+	int full_height = mlt_properties_get_int( properties, "_view.full_height" );
+	uint8_t *planes[4];
+	int strides[4];
+
+	if ( !image || x < 0 || y < 0 || width <= 0 || height <= 0
+		 || x + width > mlt_properties_get_int( properties, "width" )
+		 || y + height > mlt_properties_get_int( properties, "height" ) )
+		return 1;
+
+	// Views of views are relative to the same buffer.
+	if ( full_width )
+	{
+		x += mlt_properties_get_int( properties, "_view.x" );
+		y += mlt_properties_get_int( properties, "_view.y" );
+	}
+	else
+	{
+		full_width = mlt_properties_get_int( properties, "width" );
+		full_height = mlt_properties_get_int( properties, "height" );
+	}
+	if ( mlt_image_format_planes_view( format, full_width, full_height, image, x, y, planes, strides ) )
+		return 1;
+
+	mlt_properties_set_int( properties, "_view.full_width", full_width );
+	mlt_properties_set_int( properties, "_view.full_height", full_height );
+	mlt_properties_set_int( properties, "_view.x", x );
+	mlt_properties_set_int( properties, "_view.y", y );
+	mlt_properties_set_int( properties, "width", width );
+	mlt_properties_set_int( properties, "height", height );
+
+	return 0;
+}
+
+/** Get the planes of the image of the frame.
+ *
+ * This works for packed images and views alike.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param[out] planes the address of the first pixel of each plane
+ * \param[out] strides the number of bytes between the lines of each plane
+ * \return true if there is no image
+ */
+
+int mlt_frame_get_image_planes( mlt_frame self, uint8_t *planes[4], int strides[4] )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	uint8_t *image = mlt_properties_get_data( properties, "image", NULL );
+	mlt_image_format format = mlt_properties_get_int( properties, "format" );
+	int full_width = mlt_properties_get_int( properties, "_view.full_width" );
+
+	if ( !image )
+	{
+		memset( planes, 0, 4 * sizeof( *planes ) );
+		memset( strides, 0, 4 * sizeof( *strides ) );
+		return 1;
+	}
+	if ( full_width )
+		mlt_image_format_planes_view( format, full_width, mlt_properties_get_int( properties, "_view.full_height" ), image,
+			mlt_properties_get_int( properties, "_view.x" ), mlt_properties_get_int( properties, "_view.y" ), planes, strides );
+	else
+		mlt_image_format_planes( format, mlt_properties_get_int( properties, "width" ),
+			mlt_properties_get_int( properties, "height" ), image, planes, strides );
+	return 0;
+}
+
+/** Get the planes of one field of the image of the frame.
+ *
+ * The field is an image of half the height in the same buffer, so that
+ * a filter can process an interlaced image a field at a time without
+ * deinterlacing it. See mlt_image_field_planes().
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param field 0 for the field of the even lines, 1 for the odd lines
+ * \param[out] planes the address of the first pixel of each plane of the field
+ * \param[out] strides the number of bytes between the lines of the field
+ * \return the height of the field, or 0 if there is no image
+ */
+
+int mlt_frame_get_field_planes( mlt_frame self, int field, uint8_t *planes[4], int strides[4] )
+{
+	if ( mlt_frame_get_image_planes( self, planes, strides ) )
+		return 0;
+	return mlt_image_field_planes( field, mlt_properties_get_int( MLT_FRAME_PROPERTIES( self ), "height" ), planes, strides );
+}
+
+/** Copy a view of the image into a packed image of its own.
+ *
+ * This does nothing if the image is not a view.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param[in,out] buffer the image returned by mlt_frame_get_image_view()
+ * \return true if error
  */
 
-void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_format format, int width, int height )
+int mlt_frame_pack_image( mlt_frame self, uint8_t **buffer )
 {
-	// Remove all items from the stack
-	while( mlt_deque_pop_back( self->stack_image ) ) ;
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	uint8_t *src[4], *dst[4];
+	int src_strides[4], dst_strides[4];
 
-	// Update the information
-	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, 0, NULL, NULL );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "width", width );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "height", height );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "format", format );
-	self->get_alpha_mask = NULL;
+	if ( !mlt_properties_get_int( properties, "_view.full_width" ) || mlt_frame_get_image_planes( self, src, src_strides ) )
+		return 0;
+
+	// Someone replaced the image without telling the frame.
+	if ( *buffer != src[0] )
+	{
+		clear_image_view( self );
+		return 0;
+	}
+
+	mlt_image_format format = mlt_properties_get_int( properties, "format" );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	int size = mlt_image_format_size( format, width, height, NULL );
+	uint8_t *image = mlt_pool_alloc( size );
+	int i, y;
+
+	if ( !image )
+		return 1;
+	mlt_image_format_planes( format, width, height, image, dst, dst_strides );
+	for ( i = 0; i < 4 && dst[i]; i++ )
+	{
+		int lines = ( ( format == mlt_image_yuv420p || format == mlt_image_yuv420p10 ) && i > 0 ) ? height / 2 : height;
+		for ( y = 0; y < lines; y++ )
+			memcpy( dst[i] + y * dst_strides[i], src[i] + y * src_strides[i], dst_strides[i] );
+	}
+	mlt_frame_set_image( self, image, size, mlt_pool_release );
+	*buffer = image;
+
+	return 0;
 }
 
 /** Get the short name for an image format.
@@ -411,6 +1509,10 @@ const char * mlt_image_format_name( mlt_image_format format )
 		case mlt_image_glsl:    return "glsl";
 		case mlt_image_glsl_texture: return "glsl_texture";
 		case mlt_image_yuv422p16: return "yuv422p16";
+		case mlt_image_hwsurface: return "hwsurface";
+		case mlt_image_yuv420p10: return "yuv420p10";
+		case mlt_image_yuv444p16: return "yuv444p16";
+		case mlt_image_rgba64:  return "rgba64";
 		case mlt_image_invalid: return "invalid";
 	}
 	return "invalid";
@@ -437,6 +1539,49 @@ mlt_image_format mlt_image_format_id( const char * name )
 	return mlt_image_invalid;
 }
 
+/** Find the bounding box of the pixels of an alpha channel that are not transparent.
+ *
+ * \public \memberof mlt_frame_s
+ * \param alpha the alpha channel
+ * \param width the width of the image in pixels
+ * \param height the height of the image in pixels
+ * \return the box in pixels, which has a width and height of 0 when all of \p alpha is 0
+ * \see mlt_frame_set_alpha_box
+ */
+
+mlt_rect mlt_image_alpha_box( const uint8_t *alpha, int width, int height )
+{
+	mlt_rect box = { 0, 0, 0, 0, 1.0 };
+	int x0 = width, x1 = 0, y0 = -1, y1 = 0;
+	int x, y;
+
+	for ( y = 0; alpha && y < height; y++ )
+	{
+		const uint8_t *line = alpha + y * width;
+
+		for ( x = 0; x < width && !line[ x ]; x++ );
+		if ( x == width )
+			continue;
+		if ( x < x0 )
+			x0 = x;
+		// Only look at the pixels on the right that can grow the box
+		for ( x = width - 1; x >= x1 && !line[ x ]; x-- );
+		if ( x + 1 > x1 )
+			x1 = x + 1;
+		if ( y0 < 0 )
+			y0 = y;
+		y1 = y + 1;
+	}
+	if ( y0 >= 0 )
+	{
+		box.x = x0;
+		box.y = y0;
+		box.w = x1 - x0;
+		box.h = y1 - y0;
+	}
+	return box;
+}
+
 /** Get the number of bytes needed for an image.
   *
   * \public \memberof mlt_frame_s
@@ -471,6 +1616,18 @@ int mlt_image_format_size( mlt_image_format format, int width, int height, int *
 		case mlt_image_yuv422p16:
 			if ( bpp ) *bpp = 0;
 			return 4 * height * width ;
+		case mlt_image_hwsurface:
+			if ( bpp ) *bpp = 0;
+			return sizeof( void* );
+		case mlt_image_yuv420p10:
+			if ( bpp ) *bpp = 0;
+			return width * height * 3;
+		case mlt_image_yuv444p16:
+			if ( bpp ) *bpp = 0;
+			return width * height * 6;
+		case mlt_image_rgba64:
+			if ( bpp ) *bpp = 8;
+			return width * height * 8;
 		default:
 			if ( bpp ) *bpp = 0;
 			return 0;
@@ -542,6 +1699,7 @@ static int generate_test_image( mlt_properties properties, uint8_t **buffer,  ml
 			case mlt_image_none:
 			case mlt_image_glsl:
 			case mlt_image_glsl_texture:
+			case mlt_image_hwsurface:
 				*format = mlt_image_yuv422;
 			case mlt_image_yuv422:
 				size *= 2;
@@ -575,6 +1733,29 @@ static int generate_test_image( mlt_properties properties, uint8_t **buffer,  ml
 					memset(planes[2], 128, h * strides[2]);
 				}
 				break;
+			case mlt_image_yuv420p10:
+			case mlt_image_yuv444p16:
+			case mlt_image_rgba64:
+				size = mlt_image_format_size( *format, *width, *height, NULL );
+				*buffer = mlt_pool_alloc( size );
+				if ( *buffer )
+				{
+					int strides[4];
+					uint8_t* planes[4];
+					int i, n, h;
+					mlt_image_format_planes( *format, *width, *height, *buffer, planes, strides );
+					for ( i = 0; i < 4 && planes[i]; i++ )
+					{
+						uint16_t *p = (uint16_t*) planes[i];
+						uint16_t value = *format == mlt_image_rgba64 ? 0xffff
+							: *format == mlt_image_yuv420p10 ? ( i ? 512 : 940 )
+							: ( i ? 128 << 8 : 235 << 8 );
+						h = ( *format == mlt_image_yuv420p10 && i ) ? *height / 2 : *height;
+						for ( n = h * strides[i] / 2; n--; )
+							*p++ = value;
+					}
+				}
+				break;
 			default:
 				size = 0;
 				break;
@@ -587,33 +1768,39 @@ static int generate_test_image( mlt_properties properties, uint8_t **buffer,  ml
 }
 
 
-/** Get the image associated to the frame.
- *
- * You should express the desired format, width, and height as inputs. As long
- * as the loader producer was used to generate this or the imageconvert filter
- * was attached, then you will get the image back in the format you desire.
- * However, you do not always get the width and height you request depending
- * on properties and filters. You do not need to supply a pre-allocated
- * buffer, but you should always supply the desired image format.
- *
- * \public \memberof mlt_frame_s
- * \param self a frame
- * \param[out] buffer an image buffer
- * \param[in,out] format the image format
- * \param[in,out] width the horizontal size in pixels
- * \param[in,out] height the vertical size in pixels
- * \param writable whether or not you will need to be able to write to the memory returned in \p buffer
- * \return true if error
- * \todo Better describe the width and height as inputs.
- */
-
-int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+// Get the image, packing a view of it unless \p view is set.
+static int frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable, int view )
 {
 	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
-	mlt_get_image get_image = mlt_frame_pop_get_image( self );
+	frame_prefetch prefetch = mlt_properties_get_data( properties, "_prefetch_image", NULL );
 	mlt_image_format requested_format = *format;
 	int error = 0;
 
+	// Collect the result of a background render unless this is the render itself
+	if ( prefetch && pthread_getspecific( prefetch_key ) != prefetch )
+	{
+		mlt_slices_wait( prefetch->runtime );
+		mlt_properties_set_data( properties, "_prefetch_image", NULL, 0, NULL, NULL );
+		error = prefetch->error;
+		if ( !error && prefetch->image )
+		{
+			*buffer = prefetch->image;
+			*format = prefetch->format;
+			*width = prefetch->width;
+			*height = prefetch->height;
+			if ( self->convert_image && requested_format != mlt_image_none && *format != requested_format )
+			{
+				frame_convert_image( self, buffer, format, requested_format );
+				mlt_properties_set_int( properties, "format", *format );
+			}
+		}
+		free( prefetch );
+		if ( !error && buffer && *buffer )
+			return error;
+	}
+
+	mlt_get_image get_image = mlt_frame_pop_get_image( self );
+
 	if ( get_image )
 	{
 		mlt_properties_set_int( properties, "image_count", mlt_properties_get_int( properties, "image_count" ) - 1 );
@@ -623,7 +1810,15 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 			mlt_properties_set_int( properties, "width", *width );
 			mlt_properties_set_int( properties, "height", *height );
 			if ( self->convert_image && requested_format != mlt_image_none )
-				self->convert_image( self, buffer, format, requested_format );
+			{
+				// The converters need a packed image.
+				if ( *format != requested_format )
+				{
+					mlt_properties_set_int( properties, "format", *format );
+					mlt_frame_pack_image( self, buffer );
+				}
+				frame_convert_image( self, buffer, format, requested_format );
+			}
 			mlt_properties_set_int( properties, "format", *format );
 		}
 		else
@@ -633,13 +1828,18 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 	}
 	else if ( mlt_properties_get_data( properties, "image", NULL ) && buffer )
 	{
+		uint8_t *planes[4];
+		int strides[4];
+		mlt_frame_get_image_planes( self, planes, strides );
 		*format = mlt_properties_get_int( properties, "format" );
-		*buffer = mlt_properties_get_data( properties, "image", NULL );
+		*buffer = planes[0];
 		*width = mlt_properties_get_int( properties, "width" );
 		*height = mlt_properties_get_int( properties, "height" );
 		if ( self->convert_image && *buffer && requested_format != mlt_image_none )
 		{
-			self->convert_image( self, buffer, format, requested_format );
+			if ( *format != requested_format )
+				mlt_frame_pack_image( self, buffer );
+			frame_convert_image( self, buffer, format, requested_format );
 			mlt_properties_set_int( properties, "format", *format );
 		}
 	}
@@ -648,13 +1848,70 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 		error = generate_test_image( properties, buffer, format, width, height, writable );
 	}
 
+	if ( !view && !error && buffer && *buffer )
+		mlt_frame_pack_image( self, buffer );
+	if ( writable && !error && buffer && *buffer )
+		unshare_image( self, buffer );
+
 	return error;
 }
 
+/** Get the image associated to the frame.
+ *
+ * You should express the desired format, width, and height as inputs. As long
+ * as the loader producer was used to generate this or the imageconvert filter
+ * was attached, then you will get the image back in the format you desire.
+ * However, you do not always get the width and height you request depending
+ * on properties and filters. You do not need to supply a pre-allocated
+ * buffer, but you should always supply the desired image format.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param[out] buffer an image buffer
+ * \param[in,out] format the image format
+ * \param[in,out] width the horizontal size in pixels
+ * \param[in,out] height the vertical size in pixels
+ * \param writable whether or not you will need to be able to write to the memory returned in \p buffer
+ * \return true if error
+ * \todo Better describe the width and height as inputs.
+ */
+
+int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+{
+	return frame_get_image( self, buffer, format, width, height, writable, 0 );
+}
+
+/** Get the image associated to the frame or a view of it.
+ *
+ * This is mlt_frame_get_image() for services that understand views made by
+ * mlt_frame_set_image_view(). The image may be a region of a larger buffer,
+ * and \p buffer is only the first plane: use mlt_frame_get_image_planes()
+ * to get the strides and the other planes, or mlt_frame_pack_image() to get
+ * a packed image. A view that reaches a caller of mlt_frame_get_image() is
+ * packed then, so crops and pads are fused into a single copy by the
+ * services that support views.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param[out] buffer the first plane of the image
+ * \param[in,out] format the image format
+ * \param[in,out] width the horizontal size in pixels
+ * \param[in,out] height the vertical size in pixels
+ * \param writable whether or not you will need to be able to write to the memory returned in \p buffer
+ * \return true if error
+ */
+
+int mlt_frame_get_image_view( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+{
+	return frame_get_image( self, buffer, format, width, height, writable, 1 );
+}
+
 /** Get the alpha channel associated to the frame.
  *
  * Unlike mlt_frame_get_alpha(), this function WILL create an opaque alpha
- * channel if one does not already exist.
+ * channel if one does not already exist. Only call it to write the alpha
+ * channel: a frame without one is opaque, which readers can take from a NULL
+ * mlt_frame_get_alpha() without the allocation.
  *
  * \public \memberof mlt_frame_s
  * \deprecated use mlt_frame_get_alpha() instead
@@ -670,7 +1927,8 @@ uint8_t *mlt_frame_get_alpha_mask( mlt_frame self )
 		if ( self->get_alpha_mask != NULL )
 			alpha = self->get_alpha_mask( self );
 		if ( alpha == NULL )
-			alpha = mlt_properties_get_data( &self->parent, "alpha", NULL );
+			alpha = frame_unshare( self, "alpha",
+				mlt_properties_get_int( &self->parent, "width" ) * mlt_properties_get_int( &self->parent, "height" ) );
 		if ( alpha == NULL )
 		{
 			int size = mlt_properties_get_int( &self->parent, "width" ) * mlt_properties_get_int( &self->parent, "height" );
@@ -682,6 +1940,71 @@ uint8_t *mlt_frame_get_alpha_mask( mlt_frame self )
 	return alpha;
 }
 
+/** Run a prefetched mlt_frame_get_image() on a slices thread.
+ *
+ * \private \memberof mlt_frame_s
+ */
+
+static int prefetch_image_proc( int id, int idx, int jobs, void *cookie )
+{
+	frame_prefetch prefetch = cookie;
+	void *previous = pthread_getspecific( prefetch_key );
+	pthread_setspecific( prefetch_key, prefetch );
+	prefetch->error = mlt_frame_get_image( prefetch->frame, &prefetch->image, &prefetch->format,
+		&prefetch->width, &prefetch->height, prefetch->writable );
+	pthread_setspecific( prefetch_key, previous );
+	return 0;
+}
+
+/** Start rendering the image of a frame in the background.
+ *
+ * Transitions call this on the b frame before getting the image of the a
+ * frame so that the two tracks are rendered concurrently on the normal
+ * slices pool. The following call to mlt_frame_get_image() on this frame
+ * waits for and returns the result, so the arguments should be the same as
+ * those that call will use. This does nothing unless the frame has the
+ * \em parallel_tracks property, which mlt_tractor sets on the frames of its
+ * tracks.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param format the image format to request
+ * \param width the horizontal size in pixels to request
+ * \param height the vertical size in pixels to request
+ * \param writable whether or not the caller will write to the image
+ * \return true if the image is not being prefetched
+ */
+
+int mlt_frame_prefetch_image( mlt_frame self, mlt_image_format format, int width, int height, int writable )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	frame_prefetch prefetch;
+
+	if ( !self || !mlt_properties_get_int( properties, "parallel_tracks" ) ||
+		 mlt_deque_count( self->stack_image ) == 0 ||
+		 mlt_properties_get_data( properties, "_prefetch_image", NULL ) )
+		return 1;
+
+	pthread_once( &prefetch_key_once, prefetch_key_init );
+	prefetch = calloc( 1, sizeof( *prefetch ) );
+	if ( !prefetch )
+		return 1;
+	prefetch->frame = self;
+	prefetch->format = format;
+	prefetch->width = width;
+	prefetch->height = height;
+	prefetch->writable = writable;
+	mlt_properties_set_data( properties, "_prefetch_image", prefetch, 0, NULL, NULL );
+	prefetch->runtime = mlt_slices_submit_normal( 1, prefetch_image_proc, prefetch );
+	if ( !prefetch->runtime )
+	{
+		mlt_properties_set_data( properties, "_prefetch_image", NULL, 0, NULL, NULL );
+		free( prefetch );
+		return 1;
+	}
+	return 0;
+}
+
 /** Get the alpha channel associated to the frame (without creating if it has not).
  *
  * Unlike mlt_frame_get_alpha_mask(), this function does NOT create an alpha
@@ -760,7 +2083,11 @@ int mlt_audio_format_size( mlt_audio_format format, int samples, int channels )
  * However, you do not always get the channels and samples you request depending
  * on properties and filters. You do not need to supply a pre-allocated
  * buffer, but you should always supply the desired audio format.
- * The audio is always in interleaved format.
+ * The audio is in the format requested, which may be planar (mlt_audio_float
+ * or mlt_audio_s32). A service that gets the audio of another should pass on
+ * the format that was requested of it when it can process that format
+ * natively, and only convert when it cannot, so that the audio is not
+ * interleaved and deinterleaved at each step.
  * You should use the \p mlt_sample_calculator to determine the number of samples you want.
  *
  * \public \memberof mlt_frame_s
@@ -788,7 +2115,7 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 		mlt_properties_set_int( properties, "audio_samples", *samples );
 		mlt_properties_set_int( properties, "audio_format", *format );
 		if ( self->convert_audio && *buffer && requested_format != mlt_audio_none )
-			self->convert_audio( self, buffer, format, requested_format );
+			frame_convert_audio( self, buffer, format, requested_format );
 	}
 	else if ( mlt_properties_get_data( properties, "audio", NULL ) )
 	{
@@ -798,7 +2125,7 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 		*channels = mlt_properties_get_int( properties, "audio_channels" );
 		*samples = mlt_properties_get_int( properties, "audio_samples" );
 		if ( self->convert_audio && *buffer && requested_format != mlt_audio_none )
-			self->convert_audio( self, buffer, format, requested_format );
+			frame_convert_audio( self, buffer, format, requested_format );
 	}
 	else
 	{
@@ -822,6 +2149,10 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 		mlt_properties_set_int( properties, "test_audio", 1 );
 	}
 
+	// The caller may write to the audio
+	if ( *buffer && *buffer == mlt_properties_get_data( properties, "audio", NULL ) )
+		*buffer = frame_unshare( self, "audio", mlt_audio_format_size( *format, *samples, *channels ) );
+
 	// TODO: This does not belong here
 	if ( *format == mlt_audio_s16 && mlt_properties_get( properties, "meta.volume" ) && *buffer )
 	{
@@ -865,6 +2196,52 @@ int mlt_frame_set_audio( mlt_frame self, void *buffer, mlt_audio_format format,
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "audio", buffer, size, destructor, NULL );
 }
 
+/** Draw the waveform of a frame from the peaks of its media.
+ *
+ * \private \memberof mlt_frame_s
+ * \return true if the producer does not use peaks or they are not ready
+ */
+
+static int draw_waveform_peaks( mlt_frame self, unsigned char *bitmap, int w, int h )
+{
+	mlt_producer producer = mlt_frame_get_original_producer( self );
+	mlt_peaks peaks;
+	double fps, start;
+	int channels, j, x, y;
+
+	if ( !producer )
+		return 1;
+	producer = mlt_producer_cut_parent( producer );
+	if ( !mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( producer ), "peaks" ) )
+		return 1;
+	peaks = mlt_peaks_of_producer( producer );
+	channels = mlt_peaks_channels( peaks );
+	if ( channels <= 0 )
+		return 1;
+	fps = mlt_producer_get_fps( producer );
+	start = mlt_frame_original_position( self ) / fps;
+
+	for ( j = 0; j < channels; j++ )
+	{
+		// Each channel has a band with its zero line in the middle
+		int centre = h * ( j * 2 + 1 ) / channels / 2;
+		int half = h / channels / 2;
+		for ( x = 0; x < w; x++ )
+		{
+			float min, max;
+			if ( mlt_peaks_get( peaks, j, start + x / fps / w, start + ( x + 1 ) / fps / w, &min, &max, NULL ) )
+				continue;
+			int top = centre - lrintf( max * half );
+			int bottom = centre - lrintf( min * half );
+			top = CLAMP( MIN( top, centre ), 0, h - 1 );
+			bottom = CLAMP( MAX( bottom, centre ), 0, h - 1 );
+			for ( y = top; y <= bottom; y++ )
+				bitmap[ y * w + x ] = 0xFF;
+		}
+	}
+	return 0;
+}
+
 /** Get audio on a frame as a waveform image.
  *
  * This generates an 8-bit grayscale image representation of the audio in a
@@ -872,6 +2249,11 @@ int mlt_frame_set_audio( mlt_frame self, void *buffer, mlt_audio_format format,
  * This allocates the bitmap using mlt_pool so you should release the return
  * value with \p mlt_pool_release.
  *
+ * When the producer of the frame has the property \p peaks set to 1, the
+ * waveform is drawn from the peaks of its media, see mlt_peaks_s, without
+ * reading the audio of the frame. The peaks are generated in the background
+ * the first time, and until then the audio is read as usual.
+ *
  * \public \memberof mlt_frame_s
  * \param self a frame
  * \param w the width of the image
@@ -890,16 +2272,6 @@ unsigned char *mlt_frame_get_waveform( mlt_frame self, int w, int h )
 	double fps = mlt_producer_get_fps( mlt_producer_cut_parent( producer ) );
 	int samples = mlt_sample_calculator( fps, frequency, mlt_frame_get_position( self ) );
 
-	// Increase audio resolution proportional to requested image size
-	while ( samples < w )
-	{
-		frequency += 16000;
-		samples = mlt_sample_calculator( fps, frequency, mlt_frame_get_position( self ) );
-	}
-
-	// Get the pcm data
-	mlt_frame_get_audio( self, (void**)&pcm, &format, &frequency, &channels, &samples );
-
 	// Make an 8-bit buffer large enough to hold rendering
 	int size = w * h;
 	if ( size <= 0 )
@@ -911,6 +2283,19 @@ unsigned char *mlt_frame_get_waveform( mlt_frame self, int w, int h )
 		return NULL;
 	mlt_properties_set_data( properties, "waveform", bitmap, size, ( mlt_destructor )mlt_pool_release, NULL );
 
+	if ( !draw_waveform_peaks( self, bitmap, w, h ) )
+		return bitmap;
+
+	// Increase audio resolution proportional to requested image size
+	while ( samples < w )
+	{
+		frequency += 16000;
+		samples = mlt_sample_calculator( fps, frequency, mlt_frame_get_position( self ) );
+	}
+
+	// Get the pcm data
+	mlt_frame_get_audio( self, (void**)&pcm, &format, &frequency, &channels, &samples );
+
 	// Render vertical lines
 	int16_t *ubound = pcm + samples * channels;
 	int skip = samples / w;
@@ -973,13 +2358,14 @@ void mlt_frame_close( mlt_frame self )
 {
 	if ( self != NULL && mlt_properties_dec_ref( MLT_FRAME_PROPERTIES( self ) ) <= 0 )
 	{
-		mlt_deque_close( self->stack_image );
-		mlt_deque_close( self->stack_audio );
-		while( mlt_deque_peek_back( self->stack_service ) )
-			mlt_service_close( mlt_deque_pop_back( self->stack_service ) );
-		mlt_deque_close( self->stack_service );
-		mlt_properties_close( &self->parent );
-		free( self );
+		frame_prefetch prefetch = mlt_properties_get_data( MLT_FRAME_PROPERTIES( self ), "_prefetch_image", NULL );
+		if ( prefetch )
+		{
+			mlt_slices_wait( prefetch->runtime );
+			free( prefetch );
+		}
+		if ( !frame_recycle( self ) )
+			frame_destroy( self );
 	}
 }
 
@@ -1141,21 +2527,28 @@ mlt_frame mlt_frame_clone( mlt_frame self, int is_deep )
 				size = mlt_audio_format_size( mlt_properties_get_int( properties, "audio_format" ),
 					mlt_properties_get_int( properties, "audio_samples" ),
 					mlt_properties_get_int( properties, "audio_channels" ) );
-			copy = mlt_pool_alloc( size );
-			memcpy( copy, data, size );
+			if ( !( copy = mlt_frame_share_data( self, "audio", NULL ) ) )
+			{
+				copy = mlt_pool_alloc( size );
+				memcpy( copy, data, size );
+			}
 			mlt_properties_set_data( new_props, "audio", copy, size, mlt_pool_release, NULL );
 		}
 		data = mlt_properties_get_data( properties, "image", &size );
-		if ( data )
+		// A hardware surface is owned by its producer and cannot be copied
+		if ( data && mlt_properties_get_int( properties, "format" ) != mlt_image_hwsurface )
 		{
 			int width = mlt_properties_get_int( properties, "width" );
 			int height = mlt_properties_get_int( properties, "height" );
 
+			// Share buffers from the pool and copy the others.
 			if ( ! size )
-				size = mlt_image_format_size( mlt_properties_get_int( properties, "format" ),
-					width, height, NULL );
-			copy = mlt_pool_alloc( size );
-			memcpy( copy, data, size );
+				size = image_size( properties );
+			if ( !( copy = mlt_frame_share_data( self, "image", NULL ) ) )
+			{
+				copy = mlt_pool_alloc( size );
+				memcpy( copy, data, size );
+			}
 			mlt_properties_set_data( new_props, "image", copy, size, mlt_pool_release, NULL );
 
 			data = mlt_properties_get_data( properties, "alpha", &size );
@@ -1163,8 +2556,11 @@ mlt_frame mlt_frame_clone( mlt_frame self, int is_deep )
 			{
 				if ( ! size )
 					size = width * height;
-				copy = mlt_pool_alloc( size );
-				memcpy( copy, data, size );
+				if ( !( copy = mlt_frame_share_data( self, "alpha", NULL ) ) )
+				{
+					copy = mlt_pool_alloc( size );
+					memcpy( copy, data, size );
+				}
 				mlt_properties_set_data( new_props, "alpha", copy, size, mlt_pool_release, NULL );
 			};
 		}
@@ -1228,6 +2624,30 @@ int mlt_image_format_planes( mlt_image_format format, int width, int height, voi
 		planes[2] = (unsigned char*)data + ( 5 * width * height ) / 4;
 		planes[3] = 0;
 	}
+	else if ( mlt_image_yuv420p10 == format )
+	{
+		strides[0] = width * 2;
+		strides[1] = ( width >> 1 ) * 2;
+		strides[2] = ( width >> 1 ) * 2;
+		strides[3] = 0;
+
+		planes[0] = (unsigned char*)data;
+		planes[1] = planes[0] + height * strides[0];
+		planes[2] = planes[1] + ( height >> 1 ) * strides[1];
+		planes[3] = 0;
+	}
+	else if ( mlt_image_yuv444p16 == format )
+	{
+		strides[0] = width * 2;
+		strides[1] = width * 2;
+		strides[2] = width * 2;
+		strides[3] = 0;
+
+		planes[0] = (unsigned char*)data;
+		planes[1] = planes[0] + height * strides[0];
+		planes[2] = planes[1] + height * strides[1];
+		planes[3] = 0;
+	}
 	else
 	{
 		int bpp;
@@ -1248,6 +2668,96 @@ int mlt_image_format_planes( mlt_image_format format, int width, int height, voi
 	return 0;
 }
 
+/** Get the planes of a region of an image.
+ *
+ * This extends mlt_image_format_planes() to a view of the image starting at
+ * \p x, \p y, which keeps the strides of the whole image.
+ *
+ * \public \memberof mlt_frame_s
+ * \param format the image format
+ * \param width width of the whole image in pixels
+ * \param height height of the whole image in pixels
+ * \param[in] data pointer to allocated image
+ * \param x the left of the view in pixels
+ * \param y the top of the view in pixels
+ * \param[out] planes pointers to plane's pointers will be set
+ * \param[out] strides pointers to plane's strides will be set
+ * \return true if the format can not be addressed at \p x, \p y
+ */
+int mlt_image_format_planes_view( mlt_image_format format, int width, int height, void* data, int x, int y, unsigned char *planes[4], int strides[4] )
+{
+	int bpp = 0;
+
+	mlt_image_format_planes( format, width, height, data, planes, strides );
+	if ( mlt_image_yuv422p16 == format )
+	{
+		if ( x & 1 )
+			return 1;
+		planes[0] += y * strides[0] + x * 2;
+		planes[1] += y * strides[1] + x;
+		planes[2] += y * strides[2] + x;
+	}
+	else if ( mlt_image_yuv420p == format )
+	{
+		if ( ( x & 1 ) || ( y & 1 ) )
+			return 1;
+		planes[0] += y * strides[0] + x;
+		planes[1] += y / 2 * strides[1] + x / 2;
+		planes[2] += y / 2 * strides[2] + x / 2;
+	}
+	else if ( mlt_image_yuv420p10 == format )
+	{
+		if ( ( x & 1 ) || ( y & 1 ) )
+			return 1;
+		planes[0] += y * strides[0] + x * 2;
+		planes[1] += y / 2 * strides[1] + x;
+		planes[2] += y / 2 * strides[2] + x;
+	}
+	else if ( mlt_image_yuv444p16 == format )
+	{
+		planes[0] += y * strides[0] + x * 2;
+		planes[1] += y * strides[1] + x * 2;
+		planes[2] += y * strides[2] + x * 2;
+	}
+	else
+	{
+		mlt_image_format_size( format, width, height, &bpp );
+		if ( bpp == 0 || ( format == mlt_image_yuv422 && ( x & 1 ) ) )
+			return 1;
+		planes[0] += y * strides[0] + x * bpp;
+	}
+
+	return 0;
+}
+
+/** Turn the planes of an image into the planes of one of its fields.
+ *
+ * The lines of a field are every other line of the image, so the planes
+ * start \p field lines down and the strides are doubled. The chroma lines
+ * of the vertically subsampled formats alternate between the fields too.
+ *
+ * \public \memberof mlt_frame_s
+ * \param field 0 for the field of the even lines, 1 for the odd lines
+ * \param height the height of the image in pixels
+ * \param[in,out] planes the planes of the image, which become those of the field
+ * \param[in,out] strides the strides of the image, which become those of the field
+ * \return the height of the field in pixels
+ */
+
+int mlt_image_field_planes( int field, int height, unsigned char *planes[4], int strides[4] )
+{
+	int i;
+
+	field = !!field;
+	for ( i = 0; i < 4; i++ )
+	{
+		if ( planes[i] )
+			planes[i] += field * strides[i];
+		strides[i] *= 2;
+	}
+	return ( height + 1 - field ) / 2;
+}
+
 /** Get the short name for a channel configuration.
  *
  * You do not need to deallocate the returned string.
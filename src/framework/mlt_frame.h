@@ -67,6 +67,15 @@ typedef int ( *mlt_get_audio )( mlt_frame self, void **buffer, mlt_audio_format
  * \properties \em width the horizontal resolution of the image
  * \properties \em height the vertical resolution of the image
  * \properties \em aspect_ratio the sample aspect ratio of the image
+ * \properties \em hwsurface.type the hardware API of an mlt_image_hwsurface image, for example vaapi, cuda, or videotoolbox
+ * \properties \em hwsurface.sw_format the name of the pixel format the surface downloads to
+ * \properties \em parallel_tracks set to allow transitions to render this frame concurrently with another track
+ * \properties \em static_image the hash of the content of an image that does not change between frames, see mlt_frame_set_static_image()
+ * \properties \em solid_colour the mlt_color of every pixel of the image when it is known to be a single colour
+ * \properties \em constant_alpha the value of every pixel of the alpha channel when it is known to be the same, see mlt_frame_get_constant_alpha()
+ * \properties \em alpha_box the mlt_rect outside of which the alpha channel is 0, see mlt_frame_set_alpha_box()
+ * \properties \em alpha_box.width the width of the image that alpha_box is in
+ * \properties \em alpha_box.height the height of the image that alpha_box is in
  */
 
 struct mlt_frame_s
@@ -121,9 +130,19 @@ extern int mlt_frame_set_image( mlt_frame self, uint8_t *image, int size, mlt_de
 extern int mlt_frame_set_alpha( mlt_frame self, uint8_t *alpha, int size, mlt_destructor destroy );
 extern void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_format format, int width, int height );
 extern int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable );
+extern int mlt_frame_get_image_view( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable );
+extern int mlt_frame_set_image_view( mlt_frame self, int x, int y, int width, int height );
+extern int mlt_frame_get_image_planes( mlt_frame self, uint8_t *planes[4], int strides[4] );
+extern int mlt_frame_get_field_planes( mlt_frame self, int field, uint8_t *planes[4], int strides[4] );
+extern int mlt_frame_pack_image( mlt_frame self, uint8_t **buffer );
+extern int mlt_frame_prefetch_image( mlt_frame self, mlt_image_format format, int width, int height, int writable );
 extern uint8_t *mlt_frame_get_alpha_mask( mlt_frame self );
 extern uint8_t *mlt_frame_get_alpha( mlt_frame self );
 extern int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples );
+extern void mlt_frame_trace_enable( int enable );
+extern mlt_properties mlt_frame_trace_stats( mlt_frame self, int create );
+extern void mlt_frame_trace( mlt_frame self, mlt_service service, const char *stage, int64_t time );
+extern void mlt_frame_trace_push( mlt_frame self, mlt_service service, int image, int audio );
 extern int mlt_frame_set_audio( mlt_frame self, void *buffer, mlt_audio_format, int size, mlt_destructor );
 extern unsigned char *mlt_frame_get_waveform( mlt_frame self, int w, int h );
 extern int mlt_frame_push_get_image( mlt_frame self, mlt_get_image get_image );
@@ -136,12 +155,20 @@ extern int mlt_frame_push_service_int( mlt_frame self, int that );
 extern int mlt_frame_pop_service_int( mlt_frame self );
 extern int mlt_frame_push_audio( mlt_frame self, void *that );
 extern void *mlt_frame_pop_audio( mlt_frame self );
+extern mlt_lut *mlt_frame_push_lut( mlt_frame self, mlt_image_format format );
 extern mlt_deque mlt_frame_service_stack( mlt_frame self );
 extern mlt_producer mlt_frame_get_original_producer( mlt_frame self );
 extern void mlt_frame_close( mlt_frame self );
 extern mlt_properties mlt_frame_unique_properties( mlt_frame self, mlt_service service );
 extern mlt_properties mlt_frame_get_unique_properties( mlt_frame self, mlt_service service );
 extern mlt_frame mlt_frame_clone( mlt_frame self, int is_deep );
+extern void *mlt_frame_share_data( mlt_frame self, const char *name, int *size );
+extern void mlt_frame_set_static_image( mlt_frame self, const char *content );
+extern uint64_t mlt_frame_get_static_image( mlt_frame self );
+extern int mlt_frame_get_constant_alpha( mlt_frame self, const uint8_t *alpha, int size );
+extern void mlt_frame_clear_image_hints( mlt_frame self );
+extern void mlt_frame_set_alpha_box( mlt_frame self, mlt_rect box, int width, int height );
+extern int mlt_frame_get_alpha_box( mlt_frame self, int width, int height, mlt_rect *box );
 
 /* convenience functions */
 extern int mlt_sample_calculator( float fps, int frequency, int64_t position );
@@ -152,7 +179,10 @@ extern const char * mlt_audio_format_name( mlt_audio_format format );
 extern int mlt_audio_format_size( mlt_audio_format format, int samples, int channels );
 extern void mlt_frame_write_ppm( mlt_frame frame );
 extern int mlt_image_format_planes( mlt_image_format format, int width, int height, void* data, unsigned char *planes[4], int strides[4]);
+extern int mlt_image_format_planes_view( mlt_image_format format, int width, int height, void* data, int x, int y, unsigned char *planes[4], int strides[4] );
+extern int mlt_image_field_planes( int field, int height, unsigned char *planes[4], int strides[4] );
 extern mlt_image_format mlt_image_format_id( const char * name );
+extern mlt_rect mlt_image_alpha_box( const uint8_t *alpha, int width, int height );
 extern const char * mlt_channel_layout_name( mlt_channel_layout layout );
 extern mlt_channel_layout mlt_channel_layout_id( const char * name );
 extern int mlt_channel_layout_channels( mlt_channel_layout layout );
@@ -0,0 +1,499 @@
+/**
+ * \file mlt_job.c
+ * \brief background jobs by priority
+ * \see mlt_job_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_job.h"
+#include "mlt_factory.h"
+#include "mlt_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define PRIORITIES ( mlt_job_low + 1 )
+
+typedef enum
+{
+	job_queued,
+	job_running,
+	job_done
+}
+job_state;
+
+/** \brief Job class
+ *
+ * A job is a function run once by a pool of threads shared by the process,
+ * for the work that competes with playback for the CPU: analysis, indexes,
+ * proxies and the like. The queued jobs start most urgent first.
+ *
+ * A job is expected to call mlt_job_yield() between its steps. That returns
+ * true once the job is cancelled, runs any queued job that is more urgent on
+ * the same thread first, and holds the jobs below \p mlt_job_high while a
+ * consumer plays in real time, see mlt_job_realtime_enter().
+ */
+
+struct mlt_job_s
+{
+	mlt_job_priority priority;
+	mlt_job_proc proc;
+	void *cookie;
+	job_state state;
+	int cancel;
+	int result;
+	int refs;                /**< the caller and, until the job is done, the pool */
+	double progress;
+	struct mlt_job_s *next;  /**< in a queue or in the list of running jobs */
+};
+
+/* One mutex covers the queues and all of the jobs. The condition is
+ * broadcast whenever a job may start or a held job may go on, and the other
+ * whenever a job is done. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static mlt_job queues[ PRIORITIES ];
+static mlt_job running = NULL;
+static pthread_t *threads = NULL;
+static int thread_count = 0;
+static int shutting_down = 0;
+static int realtime = 0;
+
+static void release( mlt_job self )
+{
+	if ( --self->refs == 0 )
+		free( self );
+}
+
+static void unlink_job( mlt_job *list, mlt_job self )
+{
+	for ( ; *list; list = &(*list)->next )
+	{
+		if ( *list == self )
+		{
+			*list = self->next;
+			self->next = NULL;
+			break;
+		}
+	}
+}
+
+static void enqueue( mlt_job self )
+{
+	mlt_job *list = &queues[ self->priority ];
+	while ( *list )
+		list = &(*list)->next;
+	self->next = NULL;
+	*list = self;
+}
+
+/** Take a queued job more urgent than a priority that may start now.
+ */
+
+static mlt_job take( int below )
+{
+	int priority;
+
+	for ( priority = 0; priority < below && priority < PRIORITIES; priority++ )
+	{
+		mlt_job self = queues[ priority ];
+		if ( priority > mlt_job_high && realtime > 0 )
+			break;
+		if ( self )
+		{
+			queues[ priority ] = self->next;
+			return self;
+		}
+	}
+	return NULL;
+}
+
+/** Run a job that is no longer queued, with the mutex held.
+ */
+
+static void run( mlt_job self )
+{
+	int result;
+
+	self->state = job_running;
+	self->next = running;
+	running = self;
+	pthread_mutex_unlock( &mutex );
+	result = self->proc( self, self->cookie );
+	pthread_mutex_lock( &mutex );
+	unlink_job( &running, self );
+	self->result = result;
+	self->state = job_done;
+	pthread_cond_broadcast( &done_cond );
+	release( self );
+}
+
+static void *worker( void *arg )
+{
+	pthread_mutex_lock( &mutex );
+	while ( !shutting_down )
+	{
+		mlt_job self = take( PRIORITIES );
+		if ( self )
+			run( self );
+		else
+			pthread_cond_wait( &cond, &mutex );
+	}
+	pthread_mutex_unlock( &mutex );
+	return NULL;
+}
+
+/** Stop the threads, cancelling the jobs that run and dropping the queued ones.
+ */
+
+static void pool_close( void *arg )
+{
+	int i, count;
+	mlt_job self;
+
+	pthread_mutex_lock( &mutex );
+	shutting_down = 1;
+	for ( self = running; self; self = self->next )
+		self->cancel = 1;
+	for ( i = 0; i < PRIORITIES; i++ )
+	{
+		while ( ( self = queues[i] ) )
+		{
+			queues[i] = self->next;
+			self->cancel = 1;
+			self->result = -1;
+			self->state = job_done;
+			release( self );
+		}
+	}
+	pthread_cond_broadcast( &cond );
+	pthread_cond_broadcast( &done_cond );
+	count = thread_count;
+	pthread_mutex_unlock( &mutex );
+
+	for ( i = 0; i < count; i++ )
+		pthread_join( threads[i], NULL );
+
+	pthread_mutex_lock( &mutex );
+	free( threads );
+	threads = NULL;
+	thread_count = 0;
+	shutting_down = 0;
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Start the threads on first use, with the mutex held.
+ */
+
+static int pool_start( )
+{
+	const char *env = getenv( "MLT_JOBS_COUNT" );
+	int count = env ? atoi( env ) : 0;
+
+	if ( threads || shutting_down )
+		return shutting_down;
+	if ( count <= 0 )
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		count = info.dwNumberOfProcessors / 2;
+#else
+		count = sysconf( _SC_NPROCESSORS_ONLN ) / 2;
+#endif
+		count = MAX( count, 1 );
+	}
+	threads = calloc( count, sizeof( pthread_t ) );
+	if ( !threads )
+		return 1;
+	for ( thread_count = 0; thread_count < count; thread_count++ )
+		if ( pthread_create( &threads[ thread_count ], NULL, worker, NULL ) )
+			break;
+	if ( !thread_count )
+	{
+		free( threads );
+		threads = NULL;
+		return 1;
+	}
+	mlt_log_debug( NULL, "[job] started %d threads\n", thread_count );
+	mlt_factory_register_for_clean_up( &thread_count, pool_close );
+	return 0;
+}
+
+/** Queue a job.
+ *
+ * \public \memberof mlt_job_s
+ * \param priority the priority class of the job
+ * \param proc the function of the job
+ * \param cookie the argument of the function, which must outlive the job
+ * \return the job, to be closed with mlt_job_close(), or NULL on error
+ */
+
+mlt_job mlt_job_submit( mlt_job_priority priority, mlt_job_proc proc, void *cookie )
+{
+	mlt_job self = calloc( 1, sizeof( struct mlt_job_s ) );
+
+	if ( !self || !proc )
+	{
+		free( self );
+		return NULL;
+	}
+	self->priority = CLAMP( priority, mlt_job_high, mlt_job_low );
+	self->proc = proc;
+	self->cookie = cookie;
+	self->state = job_queued;
+	self->refs = 2;
+
+	pthread_mutex_lock( &mutex );
+	if ( pool_start( ) )
+	{
+		pthread_mutex_unlock( &mutex );
+		free( self );
+		return NULL;
+	}
+	enqueue( self );
+	pthread_cond_broadcast( &cond );
+	pthread_mutex_unlock( &mutex );
+	return self;
+}
+
+/** Change the priority class of a job.
+ *
+ * A job that the user comes to wait on can be raised to \p mlt_job_high,
+ * which also lets it run through real-time playback.
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ * \param priority the new priority class
+ */
+
+void mlt_job_set_priority( mlt_job self, mlt_job_priority priority )
+{
+	if ( !self )
+		return;
+	pthread_mutex_lock( &mutex );
+	priority = CLAMP( priority, mlt_job_high, mlt_job_low );
+	if ( self->state == job_queued && self->priority != priority )
+	{
+		unlink_job( &queues[ self->priority ], self );
+		self->priority = priority;
+		enqueue( self );
+	}
+	self->priority = priority;
+	pthread_cond_broadcast( &cond );
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Let more urgent work go first and check for cancellation.
+ *
+ * A job calls this between its steps. It runs the queued jobs that are more
+ * urgent on the calling thread, and while a consumer plays in real time it
+ * waits unless the job is \p mlt_job_high. It may be called with NULL by code
+ * that also runs outside of a job.
+ *
+ * \public \memberof mlt_job_s
+ * \param self the job that calls
+ * \return true if the job is cancelled and should return
+ */
+
+int mlt_job_yield( mlt_job self )
+{
+	int cancel;
+
+	if ( !self )
+		return 0;
+	pthread_mutex_lock( &mutex );
+	while ( !self->cancel )
+	{
+		mlt_job urgent = take( self->priority );
+		if ( urgent )
+			run( urgent );
+		else if ( realtime > 0 && self->priority > mlt_job_high )
+			pthread_cond_wait( &cond, &mutex );
+		else
+			break;
+	}
+	cancel = self->cancel;
+	pthread_mutex_unlock( &mutex );
+	return cancel;
+}
+
+/** Report the progress of a job.
+ *
+ * \public \memberof mlt_job_s
+ * \param self the job that calls
+ * \param progress the fraction done from 0 to 1
+ */
+
+void mlt_job_set_progress( mlt_job self, double progress )
+{
+	if ( !self )
+		return;
+	pthread_mutex_lock( &mutex );
+	self->progress = CLAMP( progress, 0.0, 1.0 );
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Get the progress of a job.
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ * \return the fraction done from 0 to 1 as last reported by the job
+ */
+
+double mlt_job_get_progress( mlt_job self )
+{
+	double progress = 0.0;
+
+	if ( self )
+	{
+		pthread_mutex_lock( &mutex );
+		progress = self->progress;
+		pthread_mutex_unlock( &mutex );
+	}
+	return progress;
+}
+
+/** Determine if a job is done.
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ * \return true if the job returned or was cancelled before it started
+ */
+
+int mlt_job_is_done( mlt_job self )
+{
+	int done = 1;
+
+	if ( self )
+	{
+		pthread_mutex_lock( &mutex );
+		done = self->state == job_done;
+		pthread_mutex_unlock( &mutex );
+	}
+	return done;
+}
+
+/** Cancel a job.
+ *
+ * A queued job is dropped, and a running one sees it in mlt_job_yield().
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ */
+
+void mlt_job_cancel( mlt_job self )
+{
+	if ( !self )
+		return;
+	pthread_mutex_lock( &mutex );
+	self->cancel = 1;
+	if ( self->state == job_queued )
+	{
+		unlink_job( &queues[ self->priority ], self );
+		self->result = -1;
+		self->state = job_done;
+		pthread_cond_broadcast( &done_cond );
+		release( self );
+	}
+	pthread_cond_broadcast( &cond );
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Wait for a job to be done.
+ *
+ * A job that has not started yet is run on the calling thread.
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ * \return the result of the job, or -1 if it was cancelled before it started
+ */
+
+int mlt_job_wait( mlt_job self )
+{
+	int result;
+
+	if ( !self )
+		return -1;
+	pthread_mutex_lock( &mutex );
+	if ( self->state == job_queued )
+	{
+		unlink_job( &queues[ self->priority ], self );
+		run( self );
+	}
+	while ( self->state != job_done )
+		pthread_cond_wait( &done_cond, &mutex );
+	result = self->result;
+	pthread_mutex_unlock( &mutex );
+	return result;
+}
+
+/** Close a job.
+ *
+ * This cancels the job if it is not done and waits for it, so its function
+ * no longer uses the cookie afterwards.
+ *
+ * \public \memberof mlt_job_s
+ * \param self a job
+ */
+
+void mlt_job_close( mlt_job self )
+{
+	if ( !self )
+		return;
+	mlt_job_cancel( self );
+	mlt_job_wait( self );
+	pthread_mutex_lock( &mutex );
+	release( self );
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Hold the background jobs while a consumer plays in real time.
+ *
+ * The consumer calls this when it starts and mlt_job_realtime_leave() when it
+ * stops. The jobs below \p mlt_job_high do not start and wait in
+ * mlt_job_yield() as long as any consumer plays.
+ *
+ * \public \memberof mlt_job_s
+ */
+
+void mlt_job_realtime_enter( )
+{
+	pthread_mutex_lock( &mutex );
+	realtime ++;
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Let the background jobs go on after real-time playback.
+ *
+ * \public \memberof mlt_job_s
+ */
+
+void mlt_job_realtime_leave( )
+{
+	pthread_mutex_lock( &mutex );
+	if ( realtime > 0 && --realtime == 0 )
+		pthread_cond_broadcast( &cond );
+	pthread_mutex_unlock( &mutex );
+}
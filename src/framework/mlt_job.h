@@ -0,0 +1,57 @@
+/**
+ * \file mlt_job.h
+ * \brief background jobs by priority
+ * \see mlt_job_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_JOB_H
+#define MLT_JOB_H
+
+#include "mlt_types.h"
+
+/**
+ * \envvar \em MLT_JOBS_COUNT the number of threads that run background jobs, which defaults to half of the CPUs
+ */
+
+/** The priority classes of background jobs, most urgent first */
+
+typedef enum
+{
+	mlt_job_high = 0, /**< something the user waits on, which keeps running during real-time playback */
+	mlt_job_normal,   /**< the analysis of media in use, as its peaks or seek index */
+	mlt_job_low       /**< work that is only useful later, as proxies */
+}
+mlt_job_priority;
+
+/** The function of a job, which returns its result. */
+typedef int ( *mlt_job_proc )( mlt_job job, void *cookie );
+
+extern mlt_job mlt_job_submit( mlt_job_priority priority, mlt_job_proc proc, void *cookie );
+extern void mlt_job_set_priority( mlt_job self, mlt_job_priority priority );
+extern int mlt_job_yield( mlt_job self );
+extern void mlt_job_set_progress( mlt_job self, double progress );
+extern double mlt_job_get_progress( mlt_job self );
+extern int mlt_job_is_done( mlt_job self );
+extern void mlt_job_cancel( mlt_job self );
+extern int mlt_job_wait( mlt_job self );
+extern void mlt_job_close( mlt_job self );
+extern void mlt_job_realtime_enter( );
+extern void mlt_job_realtime_leave( );
+
+#endif
@@ -22,23 +22,179 @@
 #include "mlt_log.h"
 #include "mlt_service.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#ifndef NDEBUG
 #include <sys/time.h>
+#include <unistd.h>
+#ifndef NDEBUG
 #include <time.h>
 #endif
 
+#define LOG_BUFFER_SIZE (4096)
+#define LOG_BUFFER_DELAY (100000) // microseconds
+
 static int log_level = MLT_LOG_WARNING;
+static int log_buffered = 0;
+
+/** The most verbose level that reaches the callback.
+ *
+ * The logging macros compare with this before they evaluate their arguments.
+ * A callback set by the application receives all levels.
+ */
+
+int mlt_log_threshold = MLT_LOG_WARNING;
+
+/** \brief The messages of a thread that are not written yet
+ */
+
+typedef struct
+{
+	int used;
+	int print_prefix;
+	int64_t flushed;
+	char data[ LOG_BUFFER_SIZE ];
+}
+log_buffer;
+
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+
+static int64_t time_us( void )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return ( int64_t ) tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/** Write to stderr without taking the lock of the stdio stream. */
+
+static void write_all( const char *data, size_t size )
+{
+	while ( size > 0 )
+	{
+		ssize_t n = write( STDERR_FILENO, data, size );
+		if ( n <= 0 )
+			break;
+		data += n;
+		size -= n;
+	}
+}
+
+static void buffer_flush( log_buffer *buffer )
+{
+	write_all( buffer->data, buffer->used );
+	buffer->used = 0;
+	buffer->flushed = time_us();
+}
+
+static void buffer_close( void *buffer )
+{
+	buffer_flush( buffer );
+	free( buffer );
+}
+
+static void buffer_close_main( void )
+{
+	log_buffer *buffer = pthread_getspecific( buffer_key );
+	if ( buffer )
+	{
+		pthread_setspecific( buffer_key, NULL );
+		buffer_close( buffer );
+	}
+}
+
+static void buffer_init( void )
+{
+	pthread_key_create( &buffer_key, buffer_close );
+	atexit( buffer_close_main );
+}
+
+static log_buffer *buffer_get( void )
+{
+	log_buffer *buffer;
+
+	pthread_once( &buffer_once, buffer_init );
+	buffer = pthread_getspecific( buffer_key );
+	if ( !buffer )
+	{
+		buffer = calloc( 1, sizeof( *buffer ) );
+		if ( buffer )
+		{
+			buffer->print_prefix = 1;
+			buffer->flushed = time_us();
+			pthread_setspecific( buffer_key, buffer );
+		}
+	}
+	return buffer;
+}
+
+/** Append to the buffer of the thread, or print to stderr without one. */
+
+static void log_vprintf( log_buffer *buffer, const char *fmt, va_list vl )
+{
+	va_list copy;
+	int n;
+
+	if ( !buffer )
+	{
+		vfprintf( stderr, fmt, vl );
+		return;
+	}
+	va_copy( copy, vl );
+	n = vsnprintf( buffer->data + buffer->used, LOG_BUFFER_SIZE - buffer->used, fmt, copy );
+	va_end( copy );
+	if ( n < 0 )
+		return;
+	if ( buffer->used + n < LOG_BUFFER_SIZE )
+	{
+		buffer->used += n;
+	}
+	else
+	{
+		// It did not fit: write what is already there and retry
+		buffer_flush( buffer );
+		if ( n < LOG_BUFFER_SIZE )
+		{
+			buffer->used = vsnprintf( buffer->data, LOG_BUFFER_SIZE, fmt, vl );
+		}
+		else
+		{
+			char *message = malloc( n + 1 );
+			if ( message )
+			{
+				vsnprintf( message, n + 1, fmt, vl );
+				write_all( message, n );
+				free( message );
+			}
+		}
+	}
+}
+
+static void log_printf( log_buffer *buffer, const char *fmt, ... )
+{
+	va_list vl;
+
+	va_start( vl, fmt );
+	log_vprintf( buffer, fmt, vl );
+	va_end( vl );
+}
 
 void default_callback( void* ptr, int level, const char* fmt, va_list vl )
 {
-	static int print_prefix = 1;
+	static int global_print_prefix = 1;
+	int *print_prefix = &global_print_prefix;
+	log_buffer *buffer = NULL;
 	mlt_properties properties = ptr ? MLT_SERVICE_PROPERTIES( ( mlt_service )ptr ) : NULL;
 	
 	if ( level > log_level )
 		return;
+	if ( log_buffered && ( buffer = buffer_get() ) )
+		print_prefix = &buffer->print_prefix;
 #ifndef NDEBUG
-	if ( print_prefix && level >= MLT_LOG_TIMINGS )
+	if ( *print_prefix && level >= MLT_LOG_TIMINGS )
 	{
 		struct timeval tv;
 		time_t ltime;
@@ -51,11 +207,11 @@ void default_callback( void* ptr, int level, const char* fmt, va_list vl )
 		rtime = localtime( &ltime );
 		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S" , rtime );
 
-		fprintf( stderr, "| %s.%.3d | ", buf, (int)(tv.tv_usec / 1000) );
+		log_printf( buffer, "| %s.%.3d | ", buf, (int)(tv.tv_usec / 1000) );
 	}
 #endif
 
-	if ( print_prefix && properties )
+	if ( *print_prefix && properties )
 	{
 		char *mlt_type = mlt_properties_get( properties, "mlt_type" );
 		char *mlt_service = mlt_properties_get( properties, "mlt_service" );
@@ -64,18 +220,33 @@ void default_callback( void* ptr, int level, const char* fmt, va_list vl )
 		if ( !( resource && *resource && resource[0] == '<' && resource[ strlen(resource) - 1 ] == '>' ) )
 			mlt_type = mlt_properties_get( properties, "mlt_type" );
 		if ( mlt_service )
-			fprintf( stderr, "[%s %s] ", mlt_type, mlt_service );
+			log_printf( buffer, "[%s %s] ", mlt_type, mlt_service );
 		else
-			fprintf( stderr, "[%s %p] ", mlt_type, ptr );
+			log_printf( buffer, "[%s %p] ", mlt_type, ptr );
 		if ( resource )
-			fprintf( stderr, "%s\n    ", resource );
+			log_printf( buffer, "%s\n    ", resource );
 	}
-	print_prefix = strstr( fmt, "\n" ) != NULL;
-	vfprintf( stderr, fmt, vl );
+	*print_prefix = strstr( fmt, "\n" ) != NULL;
+	log_vprintf( buffer, fmt, vl );
+
+	// Write complete lines of warnings and worse at once, the others now and then
+	if ( buffer && *print_prefix &&
+		( level <= MLT_LOG_WARNING || time_us() - buffer->flushed >= LOG_BUFFER_DELAY ) )
+		buffer_flush( buffer );
 }
 
 static void ( *callback )( void*, int, const char*, va_list ) = default_callback;
 
+static void update_threshold( void )
+{
+	if ( !callback )
+		mlt_log_threshold = INT_MIN;
+	else if ( callback == default_callback )
+		mlt_log_threshold = log_level;
+	else
+		mlt_log_threshold = INT_MAX;
+}
+
 void mlt_log( void* service, int level, const char *fmt, ...)
 {
 	va_list vl;
@@ -98,24 +269,45 @@ int mlt_log_get_level( void )
 void mlt_log_set_level( int level )
 {
 	log_level = level;
+	update_threshold();
 }
 
 void mlt_log_set_callback( void (*new_callback)( void*, int, const char*, va_list ) )
 {
 	callback = new_callback;
+	update_threshold();
+}
+
+/** Set whether the default callback buffers messages per thread.
+ *
+ * Each thread then formats into its own buffer and writes whole lines to
+ * stderr with a single system call, so threads logging at a verbose level do
+ * not wait on each other. Warnings and more severe messages are still written
+ * immediately, the others at least every 100 milliseconds while logging and
+ * when the thread exits.
+ *
+ * \param buffered whether to buffer
+ */
+
+void mlt_log_set_buffered( int buffered )
+{
+	log_buffered = buffered;
+	if ( !buffered )
+	{
+		log_buffer *buffer;
+
+		pthread_once( &buffer_once, buffer_init );
+		buffer = pthread_getspecific( buffer_key );
+		if ( buffer )
+			buffer_flush( buffer );
+	}
 }
 
 int64_t mlt_log_timings_now( void )
 {
 	int64_t r = 0;
 #ifndef NDEBUG
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-	r = tv.tv_sec;
-
-	r *= 1000000LL;
-	r += tv.tv_usec;
+	r = time_us();
 #endif
 	return r;
 }
@@ -79,26 +79,40 @@ void mlt_log( void *service, int level, const char *fmt, ... ) __attribute__ ((_
 void mlt_log( void *service, int level, const char *fmt, ... );
 #endif
 
-#define mlt_log_panic(service, format, args...) mlt_log((service), MLT_LOG_PANIC, (format), ## args)
-#define mlt_log_fatal(service, format, args...) mlt_log((service), MLT_LOG_FATAL, (format), ## args)
-#define mlt_log_error(service, format, args...) mlt_log((service), MLT_LOG_ERROR, (format), ## args)
-#define mlt_log_warning(service, format, args...) mlt_log((service), MLT_LOG_WARNING, (format), ## args)
-#define mlt_log_info(service, format, args...) mlt_log((service), MLT_LOG_INFO, (format), ## args)
-#define mlt_log_verbose(service, format, args...) mlt_log((service), MLT_LOG_VERBOSE, (format), ## args)
-#define mlt_log_timings(service, format, args...) mlt_log((service), MLT_LOG_TIMINGS, (format), ## args)
-#define mlt_log_debug(service, format, args...) mlt_log((service), MLT_LOG_DEBUG, (format), ## args)
+extern int mlt_log_threshold;
+
+/** Determine whether a message of the given level would be logged.
+ *
+ * The logging macros use this to skip evaluating their arguments and calling
+ * mlt_log when nobody would receive the message.
+ */
+
+#define mlt_log_enabled(level) ( (level) <= mlt_log_threshold )
+
+#define mlt_log_level_(service, level, format, args...) \
+	( mlt_log_enabled( level ) ? mlt_log((service), (level), (format), ## args) : (void) 0 )
+
+#define mlt_log_panic(service, format, args...) mlt_log_level_((service), MLT_LOG_PANIC, (format), ## args)
+#define mlt_log_fatal(service, format, args...) mlt_log_level_((service), MLT_LOG_FATAL, (format), ## args)
+#define mlt_log_error(service, format, args...) mlt_log_level_((service), MLT_LOG_ERROR, (format), ## args)
+#define mlt_log_warning(service, format, args...) mlt_log_level_((service), MLT_LOG_WARNING, (format), ## args)
+#define mlt_log_info(service, format, args...) mlt_log_level_((service), MLT_LOG_INFO, (format), ## args)
+#define mlt_log_verbose(service, format, args...) mlt_log_level_((service), MLT_LOG_VERBOSE, (format), ## args)
+#define mlt_log_timings(service, format, args...) mlt_log_level_((service), MLT_LOG_TIMINGS, (format), ## args)
+#define mlt_log_debug(service, format, args...) mlt_log_level_((service), MLT_LOG_DEBUG, (format), ## args)
 
 void mlt_vlog( void *service, int level, const char *fmt, va_list );
 int mlt_log_get_level( void );
 void mlt_log_set_level( int );
 void mlt_log_set_callback( void (*)( void*, int, const char*, va_list ) );
+void mlt_log_set_buffered( int );
 
 #define mlt_log_timings_begin() \
 { \
-	int64_t _mlt_log_timings_begin = mlt_log_timings_now(), _mlt_log_timings_end;
+	int64_t _mlt_log_timings_begin = mlt_log_enabled( MLT_LOG_TIMINGS ) ? mlt_log_timings_now() : 0, _mlt_log_timings_end;
 
 #define mlt_log_timings_end(service, msg) \
-	_mlt_log_timings_end = mlt_log_timings_now(); \
+	_mlt_log_timings_end = mlt_log_enabled( MLT_LOG_TIMINGS ) ? mlt_log_timings_now() : 0; \
 	mlt_log_timings( service, "%s:%d: T(%s)=%" PRId64 " us\n", \
 		__FILE__, __LINE__, msg, _mlt_log_timings_end - _mlt_log_timings_begin ); \
 }
@@ -0,0 +1,319 @@
+/**
+ * \file mlt_memory.c
+ * \brief process-wide memory budget
+ * \see mlt_memory_client_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_memory.h"
+#include "mlt_properties.h"
+#include "mlt_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+/** the fraction of the budget to reclaim down to once it is exceeded */
+#define RECLAIM_TARGET(budget) ( (budget) / 10 * 9 )
+
+/** \brief Memory client class
+ *
+ * A memory client is a subsystem that holds memory on behalf of the process,
+ * like a cache, a pool or a queue. It reports how much it holds and may
+ * release some of it when asked. Clients are asked to release memory in order
+ * of priority, lowest first, so cheap to recreate data goes before the pools
+ * that feed everything else.
+ *
+ * A pooled client holds blocks of \p mlt_pool_s, which the pool client already
+ * counts. Its usage shows in the statistics but not again in the total.
+ */
+
+struct mlt_memory_client_s
+{
+	char *category;             /**< the name under which the usage is reported */
+	int priority;               /**< the order in which clients are asked to reclaim, lowest first */
+	int pooled;                 /**< whether the usage is already counted by the pool */
+	mlt_memory_usage usage;     /**< the function that reports the bytes held */
+	mlt_memory_reclaim reclaim; /**< the function that releases bytes, optional */
+	void *data;                 /**< the opaque argument of the functions */
+	struct mlt_memory_client_s *next;
+};
+
+/* The list mutex is only held to change or copy the list, never while calling
+ * a client, so a client may register while holding its own lock. The reclaim
+ * mutex is held while calling the clients and keeps them from going away. */
+static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t reclaim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t budget_once = PTHREAD_ONCE_INIT;
+static struct mlt_memory_client_s *clients = NULL;
+static int client_count = 0;
+static int64_t budget = 0;
+static volatile int pressure = 0;
+
+static void budget_init( )
+{
+	const char *env = getenv( "MLT_MEMORY_BUDGET" );
+	if ( env )
+		budget = strtoll( env, NULL, 10 );
+	if ( budget < 0 )
+		budget = 0;
+}
+
+/** Register a subsystem that holds memory.
+ *
+ * A reclaim function must not register or unregister clients.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \param category the name under which the usage is reported, clients may share one
+ * \param priority the order in which the clients are asked to reclaim, lowest first
+ * \param pooled whether the memory is allocated from \p mlt_pool_s
+ * \param usage a function that reports the bytes held
+ * \param reclaim a function that releases bytes or NULL
+ * \param data the argument of the functions
+ * \return a client or NULL on error
+ */
+
+mlt_memory_client mlt_memory_register( const char *category, int priority, int pooled, mlt_memory_usage usage, mlt_memory_reclaim reclaim, void *data )
+{
+	mlt_memory_client self = calloc( 1, sizeof( struct mlt_memory_client_s ) );
+
+	if ( self && usage && category )
+	{
+		struct mlt_memory_client_s **link;
+
+		self->category = strdup( category );
+		self->priority = priority;
+		self->pooled = pooled;
+		self->usage = usage;
+		self->reclaim = reclaim;
+		self->data = data;
+
+		pthread_mutex_lock( &list_mutex );
+		for ( link = &clients; *link && (*link)->priority <= priority; link = &(*link)->next );
+		self->next = *link;
+		*link = self;
+		client_count ++;
+		pthread_mutex_unlock( &list_mutex );
+		return self;
+	}
+	free( self );
+	return NULL;
+}
+
+/** Unregister a subsystem.
+ *
+ * This waits for a reclaim in progress, so it must not be called with a lock
+ * that a usage or reclaim function takes.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \param self a client
+ */
+
+void mlt_memory_unregister( mlt_memory_client self )
+{
+	struct mlt_memory_client_s **link;
+
+	if ( !self )
+		return;
+	pthread_mutex_lock( &reclaim_mutex );
+	pthread_mutex_lock( &list_mutex );
+	for ( link = &clients; *link && *link != self; link = &(*link)->next );
+	if ( *link )
+	{
+		*link = self->next;
+		client_count --;
+	}
+	pthread_mutex_unlock( &list_mutex );
+	pthread_mutex_unlock( &reclaim_mutex );
+	free( self->category );
+	free( self );
+}
+
+/** Set the number of bytes the registered subsystems may hold together.
+ *
+ * The budget defaults to the value of the environment variable
+ * \envvar MLT_MEMORY_BUDGET or 0, which means there is no limit.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \param bytes the budget
+ */
+
+void mlt_memory_set_budget( int64_t bytes )
+{
+	pthread_once( &budget_once, budget_init );
+	budget = bytes > 0 ? bytes : 0;
+	if ( !budget )
+		pressure = 0;
+	mlt_memory_check( );
+}
+
+/** Get the number of bytes the registered subsystems may hold together.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \return the budget, 0 for no limit
+ */
+
+int64_t mlt_memory_get_budget( )
+{
+	pthread_once( &budget_once, budget_init );
+	return budget;
+}
+
+/* Copy the list of clients, called with the reclaim mutex held. */
+static int clients_copy( mlt_memory_client **result )
+{
+	int count = 0;
+
+	pthread_mutex_lock( &list_mutex );
+	*result = client_count ? malloc( client_count * sizeof( mlt_memory_client ) ) : NULL;
+	if ( *result )
+	{
+		mlt_memory_client client;
+		for ( client = clients; client; client = client->next )
+			(*result)[ count ++ ] = client;
+	}
+	pthread_mutex_unlock( &list_mutex );
+	return count;
+}
+
+static int64_t clients_used( mlt_memory_client *list, int count )
+{
+	int64_t total = 0;
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+		if ( !list[ i ]->pooled )
+			total += list[ i ]->usage( list[ i ]->data );
+	return total;
+}
+
+/** Get the bytes held by the registered subsystems.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \return the total, not counting pooled memory twice
+ */
+
+int64_t mlt_memory_used( )
+{
+	mlt_memory_client *list;
+	int64_t total;
+	int count;
+
+	pthread_mutex_lock( &reclaim_mutex );
+	count = clients_copy( &list );
+	total = clients_used( list, count );
+	pthread_mutex_unlock( &reclaim_mutex );
+	free( list );
+	return total;
+}
+
+/** Enforce the budget.
+ *
+ * When the registered subsystems hold more than the budget, they are asked to
+ * release memory in order of priority until the total is comfortably below the
+ * budget again. Only one thread reclaims at a time, the others return at once.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \return true if the total is still over the budget
+ */
+
+int mlt_memory_check( )
+{
+	mlt_memory_client *list;
+	int64_t total;
+	int count, i;
+
+	pthread_once( &budget_once, budget_init );
+	if ( !budget )
+		return 0;
+	if ( pthread_mutex_trylock( &reclaim_mutex ) )
+		return pressure;
+
+	count = clients_copy( &list );
+	total = clients_used( list, count );
+	if ( total > budget )
+	{
+		int64_t target = RECLAIM_TARGET( budget );
+
+		mlt_log_debug( NULL, "%s: %"PRId64" bytes used of %"PRId64"\n", __FUNCTION__, total, budget );
+		for ( i = 0; i < count && total > target; i ++ )
+		{
+			if ( list[ i ]->reclaim && list[ i ]->usage( list[ i ]->data ) > 0 )
+			{
+				list[ i ]->reclaim( list[ i ]->data, total - target );
+				// Releasing pooled memory only returns it to the pool, so measure again
+				total = clients_used( list, count );
+			}
+		}
+	}
+	pressure = total > budget;
+	pthread_mutex_unlock( &reclaim_mutex );
+	free( list );
+
+	return pressure;
+}
+
+/** Determine if the budget was exceeded at the last check.
+ *
+ * This is cheap enough to call for every frame and is meant for the
+ * subsystems that produce ahead, like read-ahead queues, to hold back.
+ *
+ * \public \memberof mlt_memory_client_s
+ * \return true if the subsystems hold more than the budget
+ */
+
+int mlt_memory_pressure( )
+{
+	return pressure;
+}
+
+/** Get the usage of each category of memory.
+ *
+ * The properties contain the bytes held in each category, the "total" that
+ * counts against the budget, the "budget" and whether there is "pressure".
+ *
+ * \public \memberof mlt_memory_client_s
+ * \return a new properties list that you must close
+ */
+
+mlt_properties mlt_memory_stats( )
+{
+	mlt_properties result = mlt_properties_new( );
+	mlt_memory_client *list;
+	int64_t total = 0;
+	int count, i;
+
+	pthread_mutex_lock( &reclaim_mutex );
+	count = clients_copy( &list );
+	for ( i = 0; i < count; i ++ )
+	{
+		int64_t bytes = list[ i ]->usage( list[ i ]->data );
+		mlt_properties_set_int64( result, list[ i ]->category,
+			mlt_properties_get_int64( result, list[ i ]->category ) + bytes );
+		if ( !list[ i ]->pooled )
+			total += bytes;
+	}
+	pthread_mutex_unlock( &reclaim_mutex );
+	free( list );
+
+	mlt_properties_set_int64( result, "total", total );
+	mlt_properties_set_int64( result, "budget", mlt_memory_get_budget( ) );
+	mlt_properties_set_int( result, "pressure", pressure );
+	return result;
+}
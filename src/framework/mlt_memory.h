@@ -0,0 +1,47 @@
+/**
+ * \file mlt_memory.h
+ * \brief process-wide memory budget
+ * \see mlt_memory_client_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_MEMORY_H
+#define MLT_MEMORY_H
+
+#include "mlt_types.h"
+
+/**
+ * \envvar \em MLT_MEMORY_BUDGET the number of bytes the caches, pools and queues of the process may hold together, 0 or unset for no limit
+ */
+
+/** A function that reports the bytes held by a client of the memory budget. */
+typedef int64_t ( *mlt_memory_usage )( void *data );
+
+/** A function that releases at least the given number of bytes if it can and returns the bytes released. */
+typedef int64_t ( *mlt_memory_reclaim )( void *data, int64_t bytes );
+
+extern mlt_memory_client mlt_memory_register( const char *category, int priority, int pooled, mlt_memory_usage usage, mlt_memory_reclaim reclaim, void *data );
+extern void mlt_memory_unregister( mlt_memory_client client );
+extern void mlt_memory_set_budget( int64_t bytes );
+extern int64_t mlt_memory_get_budget( );
+extern int64_t mlt_memory_used( );
+extern int mlt_memory_check( );
+extern int mlt_memory_pressure( );
+extern mlt_properties mlt_memory_stats( );
+
+#endif
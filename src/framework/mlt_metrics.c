@@ -0,0 +1,541 @@
+/**
+ * \file mlt_metrics.c
+ * \brief counters, gauges and histograms for monitoring
+ * \see mlt_metric_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_metrics.h"
+#include "mlt_properties.h"
+#include "mlt_service.h"
+#include "mlt_memory.h"
+#include "mlt_cache.h"
+#include "mlt_pool.h"
+#include "mlt_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#endif
+
+/** the upper bounds in seconds of the buckets of a histogram, followed by +Inf */
+static const double bucket_bounds[] = { 0.001, 0.0025, 0.005, 0.01, 0.02, 0.04, 0.08, 0.16, 0.32, 0.64, 1.28 };
+
+#define BUCKETS ( sizeof( bucket_bounds ) / sizeof( bucket_bounds[0] ) )
+
+/** \brief Metric class
+ *
+ * A metric is a named value that a service updates on its hot path with
+ * atomic operations and that the monitoring reads. The name may carry
+ * Prometheus labels, like \em mlt_consumer_frames_total{consumer="avformat"}.
+ * Metrics live until mlt_factory_close(), so a service may keep a pointer.
+ */
+
+struct mlt_metric_s
+{
+	mlt_metric_type type;
+	char *name;                   /**< the name with its labels */
+	char *help;
+	int64_t value;                /**< the total of a counter, or the observations of a histogram */
+	volatile double gauge;        /**< the value of a gauge */
+	int64_t sum;                  /**< the microseconds observed by a histogram */
+	int64_t buckets[ BUCKETS ];   /**< the observations of a histogram at or below each bound */
+	struct mlt_metric_s *next;
+};
+
+int mlt_metrics_active = 0;
+
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mlt_metric_s *metrics = NULL;
+static struct mlt_metric_s **metrics_tail = &metrics;
+static pthread_t thread;
+static int running = 0;
+static char *dump_file = NULL;
+static int dump_interval = 10;
+static int listener = -1;
+
+/** A growing string */
+
+typedef struct
+{
+	char *data;
+	size_t used, size;
+}
+text;
+
+static void text_printf( text *self, const char *format, ... )
+{
+	va_list ap;
+	int n;
+
+	va_start( ap, format );
+	n = vsnprintf( self->data ? self->data + self->used : NULL, self->data ? self->size - self->used : 0, format, ap );
+	va_end( ap );
+	if ( n < 0 )
+		return;
+	if ( !self->data || self->used + n + 1 > self->size )
+	{
+		size_t size = ( self->size + n + 1 ) * 2;
+		char *data = realloc( self->data, size );
+		if ( !data )
+			return;
+		self->data = data;
+		self->size = size;
+		va_start( ap, format );
+		vsnprintf( self->data + self->used, self->size - self->used, format, ap );
+		va_end( ap );
+	}
+	self->used += n;
+}
+
+// The length of the name before its labels.
+static size_t base_length( const char *name )
+{
+	const char *labels = strchr( name, '{' );
+	return labels ? (size_t) ( labels - name ) : strlen( name );
+}
+
+// Write a sample of a histogram, merging the le label with the labels of the name.
+static void format_bucket( text *out, mlt_metric self, const char *suffix, const char *le, int64_t value )
+{
+	size_t base = base_length( self->name );
+	const char *labels = self->name + base;
+	size_t labels_length = strlen( labels );
+
+	if ( le )
+	{
+		if ( labels_length > 2 )
+			text_printf( out, "%.*s%s%.*s,le=\"%s\"} %"PRId64"\n", (int) base, self->name, suffix,
+				(int) labels_length - 1, labels, le, value );
+		else
+			text_printf( out, "%.*s%s{le=\"%s\"} %"PRId64"\n", (int) base, self->name, suffix, le, value );
+	}
+	else
+	{
+		text_printf( out, "%.*s%s%s %"PRId64"\n", (int) base, self->name, suffix, labels, value );
+	}
+}
+
+static void format_metric( text *out, mlt_metric self )
+{
+	size_t base = base_length( self->name );
+	mlt_metric other;
+	unsigned i;
+
+	// Describe each name once, before its first sample
+	for ( other = metrics; other != self; other = other->next )
+		if ( base_length( other->name ) == base && !strncmp( other->name, self->name, base ) )
+			break;
+	if ( other == self )
+	{
+		static const char *types[] = { "counter", "gauge", "histogram" };
+		if ( self->help )
+			text_printf( out, "# HELP %.*s %s\n", (int) base, self->name, self->help );
+		text_printf( out, "# TYPE %.*s %s\n", (int) base, self->name, types[ self->type ] );
+	}
+
+	switch ( self->type )
+	{
+	case mlt_metric_counter:
+		text_printf( out, "%s %"PRId64"\n", self->name, self->value );
+		break;
+	case mlt_metric_gauge:
+		text_printf( out, "%s %g\n", self->name, self->gauge );
+		break;
+	case mlt_metric_histogram:
+		for ( i = 0; i < BUCKETS; i ++ )
+		{
+			char le[32];
+			snprintf( le, sizeof( le ), "%g", bucket_bounds[ i ] );
+			format_bucket( out, self, "_bucket", le, self->buckets[ i ] );
+		}
+		format_bucket( out, self, "_bucket", "+Inf", self->value );
+		text_printf( out, "%.*s_sum%s %g\n", (int) base, self->name, self->name + base, self->sum / 1000000.0 );
+		format_bucket( out, self, "_count", NULL, self->value );
+		break;
+	}
+}
+
+// Add the usage of the memory, the pool and the shared frame cache.
+static void format_memory( text *out )
+{
+	mlt_properties stats = mlt_memory_stats( );
+	uint64_t allocated, used, hits, misses;
+	int64_t cache_hits, cache_misses, cache_bytes;
+	int i, count;
+
+	text_printf( out, "# HELP mlt_memory_bytes Memory held by each category of the memory budget.\n"
+		"# TYPE mlt_memory_bytes gauge\n" );
+	for ( i = 0; i < mlt_properties_count( stats ); i ++ )
+	{
+		const char *name = mlt_properties_get_name( stats, i );
+		if ( strcmp( name, "pressure" ) && strcmp( name, "budget" ) )
+			text_printf( out, "mlt_memory_bytes{category=\"%s\"} %"PRId64"\n", name, mlt_properties_get_int64( stats, name ) );
+	}
+	text_printf( out, "# HELP mlt_memory_budget_bytes The memory budget, 0 for no limit.\n"
+		"# TYPE mlt_memory_budget_bytes gauge\nmlt_memory_budget_bytes %"PRId64"\n", mlt_properties_get_int64( stats, "budget" ) );
+	text_printf( out, "# HELP mlt_memory_pressure Whether the memory budget is exceeded.\n"
+		"# TYPE mlt_memory_pressure gauge\nmlt_memory_pressure %d\n", mlt_properties_get_int( stats, "pressure" ) );
+	mlt_properties_close( stats );
+
+	mlt_pool_stats( &allocated, &used, &hits, &misses );
+	text_printf( out, "# HELP mlt_pool_bytes Bytes of the blocks of the memory pool.\n# TYPE mlt_pool_bytes gauge\n"
+		"mlt_pool_bytes{state=\"allocated\"} %"PRIu64"\nmlt_pool_bytes{state=\"used\"} %"PRIu64"\n", allocated, used );
+	text_printf( out, "# HELP mlt_pool_fetches_total Fetches from the memory pool.\n# TYPE mlt_pool_fetches_total counter\n"
+		"mlt_pool_fetches_total{result=\"hit\"} %"PRIu64"\nmlt_pool_fetches_total{result=\"miss\"} %"PRIu64"\n", hits, misses );
+
+	mlt_cache_shared_stats( &cache_hits, &cache_misses, &cache_bytes, &count );
+	text_printf( out, "# HELP mlt_cache_lookups_total Lookups in the shared frame cache.\n# TYPE mlt_cache_lookups_total counter\n"
+		"mlt_cache_lookups_total{result=\"hit\"} %"PRId64"\nmlt_cache_lookups_total{result=\"miss\"} %"PRId64"\n",
+		cache_hits, cache_misses );
+	text_printf( out, "# HELP mlt_cache_frames Frames in the shared frame cache.\n# TYPE mlt_cache_frames gauge\n"
+		"mlt_cache_frames %d\n", count );
+}
+
+/** Get the metrics in the Prometheus text exposition format.
+ *
+ * \public \memberof mlt_metric_s
+ * \return a string that you must free
+ */
+
+char *mlt_metrics_format( )
+{
+	text out = { NULL, 0, 0 };
+	mlt_metric self;
+
+	pthread_mutex_lock( &metrics_mutex );
+	for ( self = metrics; self; self = self->next )
+		format_metric( &out, self );
+	pthread_mutex_unlock( &metrics_mutex );
+	format_memory( &out );
+
+	return out.data ? out.data : strdup( "" );
+}
+
+/** Write the metrics to a file.
+ *
+ * The file is replaced at once, so a collector never reads half of it.
+ *
+ * \public \memberof mlt_metric_s
+ * \param filename the name of the file
+ * \return true on error
+ */
+
+int mlt_metrics_dump( const char *filename )
+{
+	char *data = mlt_metrics_format( );
+	size_t length = strlen( filename ) + 5;
+	char *temp = malloc( length );
+	int error = 1;
+
+	if ( data && temp )
+	{
+		FILE *file;
+		snprintf( temp, length, "%s.tmp", filename );
+		file = fopen( temp, "w" );
+		if ( file )
+		{
+			error = fputs( data, file ) < 0;
+			error |= fclose( file ) != 0;
+			error = error || rename( temp, filename );
+			if ( error )
+				remove( temp );
+		}
+	}
+	free( temp );
+	free( data );
+	return error;
+}
+
+#ifndef _WIN32
+
+// Answer one HTTP request with the metrics.
+static void serve( int fd )
+{
+	struct timeval timeout = { 1, 0 };
+	char request[ 4096 ];
+	char *body, header[ 256 ];
+	int length;
+
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+	if ( recv( fd, request, sizeof( request ), 0 ) > 0 )
+	{
+		body = mlt_metrics_format( );
+		length = snprintf( header, sizeof( header ), "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+			(unsigned) strlen( body ) );
+		if ( send( fd, header, length, 0 ) == length )
+			send( fd, body, strlen( body ), 0 );
+		free( body );
+	}
+	close( fd );
+}
+
+static int listen_on( int port )
+{
+	struct sockaddr_in address;
+	int one = 1;
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+	if ( fd < 0 )
+		return -1;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port = htons( port );
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	if ( bind( fd, (struct sockaddr*) &address, sizeof( address ) ) || listen( fd, 4 ) )
+	{
+		mlt_log_warning( NULL, "[mlt_metrics] cannot listen on port %d\n", port );
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+#endif
+
+static void *metrics_thread( void *arg )
+{
+	struct timeval now, next;
+
+	gettimeofday( &next, NULL );
+	next.tv_sec += dump_interval;
+	while ( running )
+	{
+#ifndef _WIN32
+		if ( listener >= 0 )
+		{
+			struct timeval timeout = { 0, 200000 };
+			fd_set fds;
+			FD_ZERO( &fds );
+			FD_SET( listener, &fds );
+			if ( select( listener + 1, &fds, NULL, NULL, &timeout ) > 0 )
+			{
+				int fd = accept( listener, NULL, NULL );
+				if ( fd >= 0 )
+					serve( fd );
+			}
+		}
+		else
+#endif
+		{
+			usleep( 200000 );
+		}
+		gettimeofday( &now, NULL );
+		if ( dump_file && now.tv_sec >= next.tv_sec )
+		{
+			mlt_metrics_dump( dump_file );
+			next.tv_sec = now.tv_sec + dump_interval;
+		}
+	}
+	return NULL;
+}
+
+/** Start collecting metrics if \envvar MLT_METRICS or \envvar MLT_METRICS_PORT is set.
+ *
+ * This is called by mlt_factory_init().
+ */
+
+void mlt_metrics_init( )
+{
+	const char *file = getenv( "MLT_METRICS" );
+	const char *port = getenv( "MLT_METRICS_PORT" );
+	const char *interval = getenv( "MLT_METRICS_INTERVAL" );
+
+	if ( running || ( !( file && strcmp( file, "" ) ) && !( port && atoi( port ) > 0 ) ) )
+		return;
+
+	dump_file = file && strcmp( file, "" ) ? strdup( file ) : NULL;
+	dump_interval = interval && atoi( interval ) > 0 ? atoi( interval ) : 10;
+#ifndef _WIN32
+	if ( port && atoi( port ) > 0 )
+		listener = listen_on( atoi( port ) );
+#endif
+	running = 1;
+	if ( pthread_create( &thread, NULL, metrics_thread, NULL ) )
+		running = 0;
+	mlt_metrics_enable( 1 );
+}
+
+/** Stop serving the metrics, write them one last time and release them.
+ *
+ * This is called by mlt_factory_close().
+ */
+
+void mlt_metrics_close( )
+{
+	mlt_metric self;
+
+	if ( running )
+	{
+		running = 0;
+		pthread_join( thread, NULL );
+	}
+	if ( dump_file )
+		mlt_metrics_dump( dump_file );
+#ifndef _WIN32
+	if ( listener >= 0 )
+		close( listener );
+#endif
+	listener = -1;
+	free( dump_file );
+	dump_file = NULL;
+
+	mlt_metrics_active = 0;
+	pthread_mutex_lock( &metrics_mutex );
+	while ( ( self = metrics ) )
+	{
+		metrics = self->next;
+		free( self->name );
+		free( self->help );
+		free( self );
+	}
+	metrics_tail = &metrics;
+	pthread_mutex_unlock( &metrics_mutex );
+}
+
+/** Turn the collection of metrics on or off.
+ *
+ * Services only create and update metrics while this is on. An application
+ * that reads mlt_metrics_format() itself calls this instead of setting the
+ * environment variables.
+ *
+ * \public \memberof mlt_metric_s
+ * \param enable whether to collect metrics
+ */
+
+void mlt_metrics_enable( int enable )
+{
+	mlt_metrics_active = enable;
+}
+
+/** Get a metric, creating it on first use.
+ *
+ * \public \memberof mlt_metric_s
+ * \param type the kind of metric
+ * \param name the name in the Prometheus format, optionally with labels
+ * \param help a description of the metric or NULL
+ * \return the metric or NULL if metrics are not enabled
+ */
+
+mlt_metric mlt_metrics_get( mlt_metric_type type, const char *name, const char *help )
+{
+	mlt_metric self = NULL;
+
+	if ( !mlt_metrics_active || !name )
+		return NULL;
+
+	pthread_mutex_lock( &metrics_mutex );
+	for ( self = metrics; self && strcmp( self->name, name ); self = self->next );
+	if ( !self && ( self = calloc( 1, sizeof( struct mlt_metric_s ) ) ) )
+	{
+		self->type = type;
+		self->name = strdup( name );
+		self->help = help ? strdup( help ) : NULL;
+		*metrics_tail = self;
+		metrics_tail = &self->next;
+	}
+	pthread_mutex_unlock( &metrics_mutex );
+	return self;
+}
+
+/** Get a metric of a service, labelled with the kind and the id of the service.
+ *
+ * For example, \em mlt_consumer_frames_total of an avformat consumer is named
+ * \em mlt_consumer_frames_total{consumer="avformat"}.
+ *
+ * \public \memberof mlt_metric_s
+ * \param type the kind of metric
+ * \param name the name in the Prometheus format without labels
+ * \param help a description of the metric or NULL
+ * \param service the service that updates the metric
+ * \return the metric or NULL if metrics are not enabled
+ */
+
+mlt_metric mlt_metrics_service( mlt_metric_type type, const char *name, const char *help, mlt_service service )
+{
+	static const char *kinds[] = { "service", "service", "producer", "tractor", "playlist", "multitrack", "filter", "transition", "consumer", "field" };
+	mlt_service_type kind;
+	const char *id;
+	char full[ 256 ];
+
+	if ( !mlt_metrics_active || !service )
+		return NULL;
+	kind = mlt_service_identify( service );
+	id = mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "mlt_service" );
+	snprintf( full, sizeof( full ), "%s{%s=\"%s\"}", name,
+		kind >= 0 && kind <= field_type ? kinds[ kind ] : "service", id ? id : "unknown" );
+	return mlt_metrics_get( type, full, help );
+}
+
+/** Add to a counter.
+ *
+ * \public \memberof mlt_metric_s
+ * \param self a counter or NULL
+ * \param value the amount to add
+ */
+
+void mlt_metrics_add( mlt_metric self, int64_t value )
+{
+	if ( self && self->type == mlt_metric_counter )
+		__sync_fetch_and_add( &self->value, value );
+}
+
+/** Set the value of a gauge.
+ *
+ * \public \memberof mlt_metric_s
+ * \param self a gauge or NULL
+ * \param value the value
+ */
+
+void mlt_metrics_set( mlt_metric self, double value )
+{
+	if ( self && self->type == mlt_metric_gauge )
+		self->gauge = value;
+}
+
+/** Add a duration to a histogram.
+ *
+ * \public \memberof mlt_metric_s
+ * \param self a histogram or NULL
+ * \param seconds the duration
+ */
+
+void mlt_metrics_observe( mlt_metric self, double seconds )
+{
+	if ( self && self->type == mlt_metric_histogram )
+	{
+		unsigned i;
+		for ( i = 0; i < BUCKETS; i ++ )
+			if ( seconds <= bucket_bounds[ i ] )
+				__sync_fetch_and_add( &self->buckets[ i ], 1 );
+		__sync_fetch_and_add( &self->sum, (int64_t) ( seconds * 1000000.0 ) );
+		__sync_fetch_and_add( &self->value, 1 );
+	}
+}
@@ -0,0 +1,59 @@
+/**
+ * \file mlt_metrics.h
+ * \brief counters, gauges and histograms for monitoring
+ * \see mlt_metric_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_METRICS_H
+#define MLT_METRICS_H
+
+#include "mlt_types.h"
+
+/**
+ * \envvar \em MLT_METRICS a file to which to write the metrics in the Prometheus text format, for the textfile collector
+ * \envvar \em MLT_METRICS_INTERVAL the seconds between writes of \em MLT_METRICS, defaults to 10
+ * \envvar \em MLT_METRICS_PORT a TCP port on which to serve the metrics over HTTP
+ */
+
+/** The kinds of metric */
+
+typedef enum
+{
+	mlt_metric_counter,   /**< a total that only goes up */
+	mlt_metric_gauge,     /**< a value that goes up and down */
+	mlt_metric_histogram  /**< a distribution of durations in seconds */
+}
+mlt_metric_type;
+
+extern int mlt_metrics_active;
+
+#define mlt_metrics_enabled() ( mlt_metrics_active )
+
+extern void mlt_metrics_init( );
+extern void mlt_metrics_close( );
+extern void mlt_metrics_enable( int enable );
+extern mlt_metric mlt_metrics_get( mlt_metric_type type, const char *name, const char *help );
+extern mlt_metric mlt_metrics_service( mlt_metric_type type, const char *name, const char *help, mlt_service service );
+extern void mlt_metrics_add( mlt_metric self, int64_t value );
+extern void mlt_metrics_set( mlt_metric self, double value );
+extern void mlt_metrics_observe( mlt_metric self, double seconds );
+extern char *mlt_metrics_format( );
+extern int mlt_metrics_dump( const char *filename );
+
+#endif
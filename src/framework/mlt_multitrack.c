@@ -608,8 +608,19 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int ind
 		// Make sure we're at the same point
 		mlt_producer_seek( producer, position );
 
-		// Get the frame from the producer
-		mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), frame, 0 );
+		if ( ( hide & 3 ) == 3 )
+		{
+			// Nothing on a track that is hidden and muted is used, so skip its producer
+			*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_image", 1 );
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_audio", 1 );
+			mlt_producer_prepare_next( producer );
+		}
+		else
+		{
+			// Get the frame from the producer
+			mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), frame, 0 );
+		}
 
 		// Indicate speed of this producer
 		mlt_properties properties = MLT_FRAME_PROPERTIES( *frame );
@@ -21,7 +21,25 @@
  */
 
 #include "mlt.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define INDEX_TYPES ( field_type + 1 )
+
+/** \brief The services found under a root, see mlt_parser_index() */
+
+typedef struct
+{
+	mlt_service root;
+	uint64_t hash;
+	mlt_service *services[ INDEX_TYPES ];
+	int count[ INDEX_TYPES ];
+	int size[ INDEX_TYPES ];
+	mlt_properties seen;   ///< the services already added, by address
+	mlt_properties ids;    ///< the first service with each "id"
+}
+parser_index;
 
 static int on_invalid( mlt_parser self, mlt_service object )
 {
@@ -242,3 +260,213 @@ void mlt_parser_close( mlt_parser self )
 }
 
 
+
+static void index_clear( parser_index *index )
+{
+	int i;
+	for ( i = 0; i < INDEX_TYPES; i ++ )
+		index->count[ i ] = 0;
+	mlt_properties_close( index->seen );
+	mlt_properties_close( index->ids );
+	index->seen = mlt_properties_new( );
+	index->ids = mlt_properties_new( );
+	index->root = NULL;
+}
+
+static void index_close( parser_index *index )
+{
+	int i;
+	for ( i = 0; i < INDEX_TYPES; i ++ )
+		free( index->services[ i ] );
+	mlt_properties_close( index->seen );
+	mlt_properties_close( index->ids );
+	free( index );
+}
+
+static int index_add( mlt_parser self, mlt_service service, mlt_service_type type )
+{
+	parser_index *index = mlt_properties_get_data( &self->parent, "_index", NULL );
+	char key[ 32 ];
+	const char *id;
+
+	snprintf( key, sizeof( key ), "%p", ( void* )service );
+	if ( mlt_properties_get_data( index->seen, key, NULL ) )
+		return 0;
+	mlt_properties_set_data( index->seen, key, service, 0, NULL, NULL );
+
+	if ( index->count[ type ] == index->size[ type ] )
+	{
+		int size = index->size[ type ] ? 2 * index->size[ type ] : 16;
+		mlt_service *services = realloc( index->services[ type ], size * sizeof( *services ) );
+		if ( !services )
+			return 0;
+		index->services[ type ] = services;
+		index->size[ type ] = size;
+	}
+	index->services[ type ][ index->count[ type ] ++ ] = service;
+
+	id = mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "id" );
+	if ( id && !mlt_properties_get_data( index->ids, id, NULL ) )
+		mlt_properties_set_data( index->ids, id, service, 0, NULL, NULL );
+	return 0;
+}
+
+static int index_producer( mlt_parser self, mlt_producer object )
+{
+	return index_add( self, MLT_PRODUCER_SERVICE( object ), producer_type );
+}
+
+// The cuts in playlists are not identified as producers, so add them here
+// after their parent.
+static int index_unknown( mlt_parser self, mlt_service object )
+{
+	const char *mlt_type = mlt_properties_get( MLT_SERVICE_PROPERTIES( object ), "mlt_type" );
+	mlt_producer producer = MLT_PRODUCER( object );
+	int i = 0;
+
+	if ( !mlt_type || strcmp( mlt_type, "mlt_producer" ) || mlt_producer_is_blank( producer ) )
+		return 0;
+	if ( mlt_producer_is_cut( producer ) )
+		mlt_parser_start( self, MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( producer ) ) );
+	index_add( self, object, producer_type );
+	while ( mlt_producer_filter( producer, i ) != NULL )
+		mlt_parser_start( self, MLT_FILTER_SERVICE( mlt_producer_filter( producer, i ++ ) ) );
+	return 0;
+}
+
+static int index_playlist( mlt_parser self, mlt_playlist object )
+{
+	return index_add( self, MLT_PLAYLIST_SERVICE( object ), playlist_type );
+}
+
+static int index_tractor( mlt_parser self, mlt_tractor object )
+{
+	return index_add( self, MLT_TRACTOR_SERVICE( object ), tractor_type );
+}
+
+static int index_multitrack( mlt_parser self, mlt_multitrack object )
+{
+	return index_add( self, MLT_MULTITRACK_SERVICE( object ), multitrack_type );
+}
+
+static int index_filter( mlt_parser self, mlt_filter object )
+{
+	return index_add( self, MLT_FILTER_SERVICE( object ), filter_type );
+}
+
+static int index_transition( mlt_parser self, mlt_transition object )
+{
+	return index_add( self, MLT_TRANSITION_SERVICE( object ), transition_type );
+}
+
+/** Index the services connected to a service.
+ *
+ * This lists the producers, playlists, tractors, multitracks, filters and
+ * transitions that mlt_parser_start() visits, each once, by type and by
+ * their "id" property. The clips of playlists are listed as producers after
+ * their parents, and blanks are left out. The index is kept by the parser and reused while
+ * mlt_service_hash() of \p object is the same, so asking again after
+ * nothing changed does not walk the graph. The index does not hold references
+ * to the services.
+ * \public \memberof mlt_parser_s
+ * \param self a parser
+ * \param object the service to start from
+ * \return the number of services indexed
+ */
+
+int mlt_parser_index( mlt_parser self, mlt_service object )
+{
+	parser_index *index;
+	uint64_t hash;
+	int count = 0;
+	int i;
+
+	if ( !self || !object )
+		return 0;
+
+	index = mlt_properties_get_data( &self->parent, "_index", NULL );
+	if ( !index )
+	{
+		index = calloc( 1, sizeof( *index ) );
+		if ( !index )
+			return 0;
+		mlt_properties_set_data( &self->parent, "_index", index, 0, ( mlt_destructor )index_close, NULL );
+	}
+
+	hash = mlt_service_hash( object );
+	if ( index->root != object || index->hash != hash )
+	{
+		mlt_parser walker = mlt_parser_new( );
+
+		index_clear( index );
+		if ( walker )
+		{
+			mlt_properties_set_data( &walker->parent, "_index", index, 0, NULL, NULL );
+			walker->on_unknown = index_unknown;
+			walker->on_start_producer = index_producer;
+			walker->on_start_playlist = index_playlist;
+			walker->on_start_tractor = index_tractor;
+			walker->on_start_multitrack = index_multitrack;
+			walker->on_start_filter = index_filter;
+			walker->on_start_transition = index_transition;
+			mlt_parser_start( walker, object );
+			mlt_parser_close( walker );
+			index->root = object;
+			index->hash = hash;
+		}
+	}
+
+	for ( i = 0; i < INDEX_TYPES; i ++ )
+		count += index->count[ i ];
+	return count;
+}
+
+/** Get the number of indexed services of a type.
+ *
+ * \public \memberof mlt_parser_s
+ * \param self a parser
+ * \param type the service type
+ * \return the number of services, 0 before mlt_parser_index()
+ */
+
+int mlt_parser_index_count( mlt_parser self, mlt_service_type type )
+{
+	parser_index *index = self ? mlt_properties_get_data( &self->parent, "_index", NULL ) : NULL;
+	if ( !index || type < 0 || type >= INDEX_TYPES )
+		return 0;
+	return index->count[ type ];
+}
+
+/** Get an indexed service of a type.
+ *
+ * The services are in the order that mlt_parser_start() first visits them.
+ * \public \memberof mlt_parser_s
+ * \param self a parser
+ * \param type the service type
+ * \param i the number of the service
+ * \return the service or NULL if \p i is out of range
+ */
+
+mlt_service mlt_parser_index_get( mlt_parser self, mlt_service_type type, int i )
+{
+	if ( i < 0 || i >= mlt_parser_index_count( self, type ) )
+		return NULL;
+	parser_index *index = mlt_properties_get_data( &self->parent, "_index", NULL );
+	return index->services[ type ][ i ];
+}
+
+/** Find an indexed service by its "id" property.
+ *
+ * \public \memberof mlt_parser_s
+ * \param self a parser
+ * \param id the identifier
+ * \return the first service found with \p id or NULL
+ */
+
+mlt_service mlt_parser_index_find( mlt_parser self, const char *id )
+{
+	parser_index *index = self ? mlt_properties_get_data( &self->parent, "_index", NULL ) : NULL;
+	if ( !index || !id || !index->ids )
+		return NULL;
+	return mlt_properties_get_data( index->ids, id, NULL );
+}
@@ -55,5 +55,9 @@ extern mlt_parser mlt_parser_new( );
 extern mlt_properties mlt_parser_properties( mlt_parser self );
 extern int mlt_parser_start( mlt_parser self, mlt_service object );
 extern void mlt_parser_close( mlt_parser self );
+extern int mlt_parser_index( mlt_parser self, mlt_service object );
+extern int mlt_parser_index_count( mlt_parser self, mlt_service_type type );
+extern mlt_service mlt_parser_index_get( mlt_parser self, mlt_service_type type, int i );
+extern mlt_service mlt_parser_index_find( mlt_parser self, const char *id );
 
 #endif
@@ -0,0 +1,533 @@
+/**
+ * \file mlt_peaks.c
+ * \brief multi-resolution audio peaks of a media file
+ * \see mlt_peaks_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Local header files
+#include "mlt_peaks.h"
+#include "mlt_producer.h"
+#include "mlt_frame.h"
+#include "mlt_factory.h"
+#include "mlt_sidecar.h"
+#include "mlt_log.h"
+#include "mlt_job.h"
+
+// System header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define PEAKS_MAGIC "MLTPEAK1"
+#define PEAKS_BLOCK (256)     // the samples of a peak at the finest level
+#define PEAKS_FACTOR (4)      // the peaks of a level that make one of the next
+#define PEAKS_LEVELS (6)
+#define PEAKS_MAX_CHANNELS (32)
+
+/** \brief the minimum, maximum and root mean square of a block of samples of a channel
+ */
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+	uint16_t rms;
+}
+peak;
+
+/** \brief the header of a peak file
+ *
+ * It is followed by the peaks of each level in turn, from the finest, with
+ * the peaks of all channels of a block together.
+ */
+
+typedef struct
+{
+	char magic[8];
+	uint32_t frequency;
+	uint32_t channels;
+	uint32_t block;       // the samples of a peak at the finest level
+	uint32_t levels;
+	uint64_t samples;     // the samples of each channel
+}
+peaks_header;
+
+/** \brief Peaks class
+ *
+ * The peaks of the audio of a media file at several resolutions, so that
+ * drawing its waveform costs in proportion to the pixels instead of the
+ * samples. They are kept in the sidecar store, which maps them into
+ * memory, and generated by a background job the first time.
+ */
+
+struct mlt_peaks_s
+{
+	pthread_mutex_t mutex;
+	mlt_job job;
+	int ready;
+	char *resource;
+	char *audio_index;
+	mlt_profile profile;
+	mlt_sidecar sidecar;  // the record of the peaks when they were stored
+	void *data;           // the peaks when they were generated
+	const peaks_header *header;
+	const peak *levels[ PEAKS_LEVELS ];
+	uint64_t counts[ PEAKS_LEVELS ];
+};
+
+/** Check the contents of a peak file and find its levels.
+ *
+ * \private \memberof mlt_peaks_s
+ * \return true if the contents are not valid
+ */
+
+static int set_data( mlt_peaks self, const void *data, size_t size )
+{
+	const peaks_header *header = data;
+	const peak *p;
+	uint64_t count;
+	uint32_t i;
+
+	if ( size < sizeof( peaks_header ) || memcmp( header->magic, PEAKS_MAGIC, sizeof( header->magic ) )
+		 || header->frequency == 0 || header->channels == 0 || header->channels > PEAKS_MAX_CHANNELS
+		 || header->block == 0 || header->levels == 0 || header->levels > PEAKS_LEVELS )
+		return 1;
+	p = (const peak*) ( header + 1 );
+	count = ( header->samples + header->block - 1 ) / header->block;
+	for ( i = 0; i < header->levels; i++ )
+	{
+		self->levels[i] = p;
+		self->counts[i] = count;
+		p += count * header->channels;
+		count = ( count + PEAKS_FACTOR - 1 ) / PEAKS_FACTOR;
+	}
+	if ( (size_t) ( (const char*) p - (const char*) data ) > size )
+		return 1;
+	self->header = header;
+	return 0;
+}
+
+/** Map the stored peaks into memory.
+ *
+ * \private \memberof mlt_peaks_s
+ * \return true if there are no valid stored peaks
+ */
+
+static int load_stored( mlt_peaks self, const char *resource, const char *audio_index )
+{
+	size_t size = 0;
+	const void *data;
+
+	self->sidecar = mlt_sidecar_open( resource, "peaks", audio_index );
+	data = mlt_sidecar_data( self->sidecar, &size );
+	if ( data && !set_data( self, data, size ) )
+		return 0;
+	mlt_sidecar_close( self->sidecar );
+	self->sidecar = NULL;
+	return 1;
+}
+
+/** Combine the peaks of a level into the next coarser one.
+ *
+ * \private \memberof mlt_peaks_s
+ */
+
+static void combine_level( const peak *in, uint64_t in_count, peak *out, int channels )
+{
+	uint64_t i;
+	int c, k;
+
+	for ( i = 0; i < in_count; i += PEAKS_FACTOR, out += channels )
+	{
+		for ( c = 0; c < channels; c++ )
+		{
+			const peak *p = in + i * channels + c;
+			int n = in_count - i < PEAKS_FACTOR ? in_count - i : PEAKS_FACTOR;
+			double sum = 0.0;
+
+			out[c] = *p;
+			for ( k = 0; k < n; k++, p += channels )
+			{
+				if ( p->min < out[c].min )
+					out[c].min = p->min;
+				if ( p->max > out[c].max )
+					out[c].max = p->max;
+				sum += (double) p->rms * p->rms;
+			}
+			out[c].rms = lrint( sqrt( sum / n ) );
+		}
+	}
+}
+
+/** Read all of the audio of the media and build its peaks.
+ *
+ * \private \memberof mlt_peaks_s
+ * \return the contents of a peak file or NULL on error
+ */
+
+static void *generate( mlt_peaks self, mlt_job job, size_t *size )
+{
+	mlt_producer producer = mlt_factory_producer( self->profile, NULL, self->resource );
+	mlt_position length = 0, position;
+	double fps = 0.0;
+	peaks_header header;
+	peak level0[ PEAKS_MAX_CHANNELS ];
+	double sums[ PEAKS_MAX_CHANNELS ];
+	peak *peaks = NULL;
+	uint64_t count = 0, allocated = 0;
+	int filled = 0;
+	int frequency = 0, channels = 0;
+	int error = !producer;
+	int cancelled = 0;
+	char *data = NULL;
+
+	if ( !error )
+	{
+		// Only the audio is needed
+		if ( self->audio_index )
+			mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), "audio_index", self->audio_index );
+		mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( producer ), "video_index", -1 );
+		length = mlt_producer_get_length( producer );
+		fps = mlt_producer_get_fps( producer );
+		error = length <= 0;
+	}
+	memset( &header, 0, sizeof( header ) );
+	for ( position = 0; !error && position < length; position++ )
+	{
+		mlt_frame frame = NULL;
+		mlt_audio_format format = mlt_audio_s16;
+		int16_t *pcm = NULL;
+		int samples, i, c;
+
+		if ( mlt_job_yield( job ) )
+		{
+			cancelled = 1;
+			break;
+		}
+		mlt_job_set_progress( job, (double) position / length );
+		error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+		if ( error )
+			break;
+		if ( !frequency )
+		{
+			// Keep the audio of the media as it is
+			frequency = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "audio_frequency" );
+			channels = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "audio_channels" );
+			if ( frequency <= 0 )
+				frequency = 48000;
+			if ( channels <= 0 || channels > PEAKS_MAX_CHANNELS )
+				channels = 2;
+			header.frequency = frequency;
+			header.channels = channels;
+		}
+		samples = mlt_sample_calculator( fps, frequency, position );
+		error = mlt_frame_get_audio( frame, (void**) &pcm, &format, &frequency, &channels, &samples );
+		if ( !error && ( !pcm || format != mlt_audio_s16 || frequency != header.frequency || channels != header.channels ) )
+			error = 1;
+		for ( i = 0; !error && i < samples; i++ )
+		{
+			if ( filled == 0 )
+			{
+				for ( c = 0; c < channels; c++ )
+				{
+					level0[c].min = level0[c].max = pcm[c];
+					sums[c] = 0.0;
+				}
+			}
+			for ( c = 0; c < channels; c++, pcm++ )
+			{
+				if ( *pcm < level0[c].min )
+					level0[c].min = *pcm;
+				if ( *pcm > level0[c].max )
+					level0[c].max = *pcm;
+				sums[c] += (double) *pcm * *pcm;
+			}
+			if ( ++filled == PEAKS_BLOCK || ( i == samples - 1 && position == length - 1 ) )
+			{
+				if ( count == allocated )
+				{
+					peak *grown;
+					allocated = allocated ? allocated * 2 : 4096;
+					grown = realloc( peaks, allocated * channels * sizeof( peak ) );
+					if ( !grown )
+					{
+						error = 1;
+						break;
+					}
+					peaks = grown;
+				}
+				for ( c = 0; c < channels; c++ )
+				{
+					long rms = lrint( sqrt( sums[c] / filled ) );
+					level0[c].rms = rms > 32767 ? 32767 : rms;
+				}
+				memcpy( peaks + count * channels, level0, channels * sizeof( peak ) );
+				count++;
+				filled = 0;
+			}
+		}
+		header.samples += error ? 0 : samples;
+		mlt_frame_close( frame );
+	}
+	mlt_producer_close( producer );
+
+	if ( !error && !cancelled && count > 0 )
+	{
+		uint64_t counts[ PEAKS_LEVELS ];
+		uint64_t total = 0;
+		peak *level;
+		int i;
+
+		memcpy( header.magic, PEAKS_MAGIC, sizeof( header.magic ) );
+		header.block = PEAKS_BLOCK;
+		header.levels = PEAKS_LEVELS;
+		counts[0] = count;
+		for ( i = 0; i < PEAKS_LEVELS; i++ )
+		{
+			if ( i > 0 )
+				counts[i] = ( counts[i - 1] + PEAKS_FACTOR - 1 ) / PEAKS_FACTOR;
+			total += counts[i];
+		}
+		*size = sizeof( header ) + total * header.channels * sizeof( peak );
+		data = malloc( *size );
+		if ( data )
+		{
+			memcpy( data, &header, sizeof( header ) );
+			level = (peak*) ( data + sizeof( header ) );
+			memcpy( level, peaks, count * header.channels * sizeof( peak ) );
+			for ( i = 1; i < PEAKS_LEVELS; i++ )
+			{
+				combine_level( level, counts[i - 1], level + counts[i - 1] * header.channels, header.channels );
+				level += counts[i - 1] * header.channels;
+			}
+		}
+	}
+	free( peaks );
+	return data;
+}
+
+static int generate_job( mlt_job job, void *cookie )
+{
+	mlt_peaks self = cookie;
+	size_t size = 0;
+	void *data = generate( self, job, &size );
+
+	if ( data )
+	{
+		mlt_sidecar_store( self->resource, "peaks", self->audio_index, data, size );
+		pthread_mutex_lock( &self->mutex );
+		self->ready = !set_data( self, data, size );
+		if ( self->ready )
+			self->data = data;
+		pthread_mutex_unlock( &self->mutex );
+		if ( !self->ready )
+			free( data );
+	}
+	else if ( !mlt_job_yield( job ) )
+	{
+		mlt_log_verbose( NULL, "[peaks] unable to read the audio of %s\n", self->resource );
+	}
+	return !self->ready;
+}
+
+/** Create the peaks of the media of a producer.
+ *
+ * This maps the stored peaks of the media when there are some and otherwise
+ * starts generating it in a background job with a producer of its own.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param producer a producer of a media file
+ * \return a new peaks object or NULL if the resource of the producer is not a file
+ */
+
+mlt_peaks mlt_peaks_init( mlt_producer producer )
+{
+	mlt_producer parent = mlt_producer_cut_parent( producer );
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( parent );
+	const char *resource = mlt_properties_get( properties, "resource" );
+	const char *audio_index = mlt_properties_get( properties, "audio_index" );
+	struct stat st;
+	mlt_peaks self;
+
+	if ( !resource || stat( resource, &st ) || !S_ISREG( st.st_mode ) )
+		return NULL;
+	self = calloc( 1, sizeof( struct mlt_peaks_s ) );
+	if ( !self )
+		return NULL;
+	pthread_mutex_init( &self->mutex, NULL );
+	self->ready = !load_stored( self, resource, audio_index );
+	if ( !self->ready )
+	{
+		self->resource = strdup( resource );
+		self->audio_index = audio_index ? strdup( audio_index ) : NULL;
+		self->profile = mlt_service_profile( MLT_PRODUCER_SERVICE( parent ) );
+		self->job = mlt_job_submit( mlt_job_normal, generate_job, self );
+	}
+	return self;
+}
+
+/** Get the peaks of the media of a producer shared by all of its users.
+ *
+ * The peaks are created by mlt_peaks_init() on first use and closed with the
+ * producer, so do not close them.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param producer a producer or a cut of it
+ * \return the peaks or NULL if the resource of the producer is not a file
+ */
+
+mlt_peaks mlt_peaks_of_producer( mlt_producer producer )
+{
+	mlt_producer parent = mlt_producer_cut_parent( producer );
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( parent );
+	mlt_peaks self;
+
+	mlt_service_lock( MLT_PRODUCER_SERVICE( parent ) );
+	self = mlt_properties_get_data( properties, "_peaks", NULL );
+	if ( !self && !mlt_properties_get_int( properties, "_peaks_failed" ) )
+	{
+		self = mlt_peaks_init( parent );
+		if ( self )
+			mlt_properties_set_data( properties, "_peaks", self, 0, (mlt_destructor) mlt_peaks_close, NULL );
+		else
+			mlt_properties_set_int( properties, "_peaks_failed", 1 );
+	}
+	mlt_service_unlock( MLT_PRODUCER_SERVICE( parent ) );
+	return self;
+}
+
+/** Determine if the peaks can be read.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self the peaks
+ * \return true once the peak file is loaded or generated
+ */
+
+int mlt_peaks_is_ready( mlt_peaks self )
+{
+	int ready = 0;
+	if ( self )
+	{
+		pthread_mutex_lock( &self->mutex );
+		ready = self->ready;
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return ready;
+}
+
+/** Get the number of channels of the peaks.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self the peaks
+ * \return the channels or 0 if the peaks are not ready
+ */
+
+int mlt_peaks_channels( mlt_peaks self )
+{
+	return mlt_peaks_is_ready( self ) ? self->header->channels : 0;
+}
+
+/** Get the peaks of a channel over an interval of time.
+ *
+ * This reads the coarsest level that has at least a few peaks in the
+ * interval, so the cost does not depend on its duration.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self the peaks
+ * \param channel the channel starting at 0
+ * \param start the start of the interval in seconds
+ * \param end the end of the interval in seconds
+ * \param[out] min the minimum sample from -1.0 to 1.0
+ * \param[out] max the maximum sample from -1.0 to 1.0
+ * \param[out] rms the root mean square of the samples from 0.0 to 1.0
+ * \return true if the peaks are not ready or the interval is outside the media
+ */
+
+int mlt_peaks_get( mlt_peaks self, int channel, double start, double end, float *min, float *max, float *rms )
+{
+	const peaks_header *header;
+	int64_t first, last, block, i;
+	int level = 0;
+	int lo = 32767, hi = -32768;
+	double sum = 0.0;
+	const peak *p;
+
+	if ( !mlt_peaks_is_ready( self ) || channel < 0 || channel >= self->header->channels )
+		return 1;
+	header = self->header;
+	first = llrint( start * header->frequency );
+	last = llrint( end * header->frequency );
+	if ( last <= first )
+		last = first + 1;
+	block = header->block;
+	while ( level + 1 < header->levels && block * PEAKS_FACTOR * PEAKS_FACTOR <= last - first )
+	{
+		level++;
+		block *= PEAKS_FACTOR;
+	}
+	first = first < 0 ? 0 : first / block;
+	last = ( last + block - 1 ) / block;
+	if ( last > self->counts[ level ] )
+		last = self->counts[ level ];
+	if ( first >= last )
+		return 1;
+
+	p = self->levels[ level ] + first * header->channels + channel;
+	for ( i = first; i < last; i++, p += header->channels )
+	{
+		if ( p->min < lo )
+			lo = p->min;
+		if ( p->max > hi )
+			hi = p->max;
+		sum += (double) p->rms * p->rms;
+	}
+	if ( min )
+		*min = lo / 32768.0f;
+	if ( max )
+		*max = hi / 32768.0f;
+	if ( rms )
+		*rms = sqrt( sum / ( last - first ) ) / 32768.0f;
+	return 0;
+}
+
+/** Close the peaks.
+ *
+ * This stops generating the peak file if it is not done.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self the peaks
+ */
+
+void mlt_peaks_close( mlt_peaks self )
+{
+	if ( !self )
+		return;
+	mlt_job_close( self->job );
+	mlt_sidecar_close( self->sidecar );
+	free( self->data );
+	pthread_mutex_destroy( &self->mutex );
+	free( self->resource );
+	free( self->audio_index );
+	free( self );
+}
@@ -0,0 +1,35 @@
+/**
+ * \file mlt_peaks.h
+ * \brief multi-resolution audio peaks of a media file
+ * \see mlt_peaks_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_PEAKS_H
+#define MLT_PEAKS_H
+
+#include "mlt_types.h"
+
+extern mlt_peaks mlt_peaks_init( mlt_producer producer );
+extern mlt_peaks mlt_peaks_of_producer( mlt_producer producer );
+extern int mlt_peaks_is_ready( mlt_peaks self );
+extern int mlt_peaks_channels( mlt_peaks self );
+extern int mlt_peaks_get( mlt_peaks self, int channel, double start, double end, float *min, float *max, float *rms );
+extern void mlt_peaks_close( mlt_peaks self );
+
+#endif
@@ -44,6 +44,7 @@ struct playlist_entry_s
 	mlt_position producer_length;
 	mlt_event event;
 	int preservation_hack;
+	mlt_position start;
 };
 
 /* Forward declarations
@@ -166,67 +167,142 @@ mlt_properties mlt_playlist_properties( mlt_playlist self )
 	return MLT_PRODUCER_PROPERTIES( &self->parent );
 }
 
-/** Refresh the playlist after a clip has been changed.
+/** Bring an entry up to date with the in and out points of its producer.
  *
  * \private \memberof mlt_playlist_s
  * \param self a playlist
- * \return false
+ * \param i the index of the playlist entry
+ * \return the duration of the entry
  */
 
-static int mlt_playlist_virtual_refresh( mlt_playlist self )
+static mlt_position mlt_playlist_virtual_update( mlt_playlist self, int i )
 {
-	// Obtain the properties
-	mlt_properties properties = MLT_PLAYLIST_PROPERTIES( self );
-	int i = 0;
-	mlt_position frame_count = 0;
+	playlist_entry *entry = self->list[ i ];
 
-	for ( i = 0; i < self->count; i ++ )
+	// Get the producer
+	mlt_producer producer = entry->producer;
+	if ( producer )
 	{
-		// Get the producer
-		mlt_producer producer = self->list[ i ]->producer;
-		if ( producer )
-		{
-			int current_length = mlt_producer_get_playtime( producer );
+		int current_length = mlt_producer_get_playtime( producer );
 
-			// Check if the length of the producer has changed
-			if ( self->list[ i ]->frame_in != mlt_producer_get_in( producer ) ||
-				self->list[ i ]->frame_out != mlt_producer_get_out( producer ) )
+		// Check if the length of the producer has changed
+		if ( entry->frame_in != mlt_producer_get_in( producer ) ||
+			entry->frame_out != mlt_producer_get_out( producer ) )
+		{
+			// This clip should be removed...
+			if ( current_length < 1 )
 			{
-				// This clip should be removed...
-				if ( current_length < 1 )
-				{
-					self->list[ i ]->frame_in = 0;
-					self->list[ i ]->frame_out = -1;
-					self->list[ i ]->frame_count = 0;
-				}
-				else
-				{
-					self->list[ i ]->frame_in = mlt_producer_get_in( producer );
-					self->list[ i ]->frame_out = mlt_producer_get_out( producer );
-					self->list[ i ]->frame_count = current_length;
-				}
-
-				// Update the producer_length
-				self->list[ i ]->producer_length = current_length;
+				entry->frame_in = 0;
+				entry->frame_out = -1;
+				entry->frame_count = 0;
 			}
+			else
+			{
+				entry->frame_in = mlt_producer_get_in( producer );
+				entry->frame_out = mlt_producer_get_out( producer );
+				entry->frame_count = current_length;
+			}
+
+			// Update the producer_length
+			entry->producer_length = current_length;
 		}
+	}
 
-		// Calculate the frame_count
-		self->list[ i ]->frame_count = ( self->list[ i ]->frame_out - self->list[ i ]->frame_in + 1 ) * self->list[ i ]->repeat;
+	// Calculate the frame_count
+	entry->frame_count = ( entry->frame_out - entry->frame_in + 1 ) * entry->repeat;
 
-		// Update the frame_count for self clip
-		frame_count += self->list[ i ]->frame_count;
-	}
+	return entry->frame_count;
+}
+
+/** Set the length of the playlist.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param frame_count the duration of all the entries
+ */
+
+static void mlt_playlist_virtual_length( mlt_playlist self, mlt_position frame_count )
+{
+	mlt_properties properties = MLT_PLAYLIST_PROPERTIES( self );
 
-	// Refresh all properties
 	mlt_events_block( properties, properties );
 	mlt_properties_set_position( properties, "length", frame_count );
 	mlt_events_unblock( properties, properties );
 	mlt_properties_set_position( properties, "out", frame_count - 1 );
+}
+
+/** Refresh the playlist after a clip has been changed.
+ *
+ * This also rebuilds the start positions of all the entries.
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \return false
+ */
+
+static int mlt_playlist_virtual_refresh( mlt_playlist self )
+{
+	int i = 0;
+	mlt_position frame_count = 0;
+
+	for ( i = 0; i < self->count; i ++ )
+	{
+		self->list[ i ]->start = frame_count;
+
+		// Update the frame_count for self clip
+		frame_count += mlt_playlist_virtual_update( self, i );
+	}
+	self->indexed = self->count;
+
+	// Refresh all properties
+	mlt_playlist_virtual_length( self, frame_count );
 
 	return 0;
 }
 
+/** Mark the start positions of the entries from a clip onwards as stale.
+ *
+ * Call this whenever entries are moved around in the list.
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param clip the index of the first playlist entry that changed
+ */
+
+static void mlt_playlist_invalidate( mlt_playlist self, int clip )
+{
+	if ( clip < self->indexed )
+		self->indexed = clip < 0 ? 0 : clip;
+}
+
+/** Get the position at which a clip starts.
+ *
+ * The start positions are a running total of the durations of the entries
+ * which is extended on demand from the last entry known to be correct.
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param clip a playlist entry index or the number of entries for the duration of the playlist
+ * \return the time at which the clip starts
+ */
+
+static mlt_position mlt_playlist_start( mlt_playlist self, int clip )
+{
+	if ( clip > self->count )
+		clip = self->count;
+	if ( self->indexed < clip )
+	{
+		int i = self->indexed;
+		mlt_position start = i > 0 ? self->list[ i - 1 ]->start + self->list[ i - 1 ]->frame_count : 0;
+		for ( ; i < clip; i ++ )
+		{
+			self->list[ i ]->start = start;
+			start += self->list[ i ]->frame_count;
+		}
+		self->indexed = clip;
+	}
+	if ( clip <= 0 )
+		return 0;
+	return self->list[ clip - 1 ]->start + self->list[ clip - 1 ]->frame_count;
+}
+
 /** Listener for producers on the playlist.
  *
  * Refreshes the playlist whenever an entry receives producer-changed.
@@ -351,13 +427,18 @@ static int mlt_playlist_virtual_append( mlt_playlist self, mlt_producer source,
 		mlt_properties_set( properties, "eof", "pause" );
 		mlt_producer_set_speed( producer, 0 );
 		self->count ++;
+
+		// Only the new entry needs to be brought up to date
+		mlt_playlist_virtual_update( self, self->count - 1 );
+		mlt_playlist_virtual_length( self, mlt_playlist_start( self, self->count ) );
 	}
 
-	return mlt_playlist_virtual_refresh( self );
+	return 0;
 }
 
 /** Locate a producer by index.
  *
+ * This is a binary search of the start positions of the entries.
  * \private \memberof mlt_playlist_s
  * \param self a playlist
  * \param[in, out] position the time at which to locate the producer, returns the time relative to the producer's starting point
@@ -371,25 +452,35 @@ static mlt_producer mlt_playlist_locate( mlt_playlist self, mlt_position *positi
 	// Default producer to NULL
 	mlt_producer producer = NULL;
 
-	// Loop for each producer until found
-	for ( *clip = 0; *clip < self->count; *clip += 1 )
-	{
-		// Increment the total
-		*total += self->list[ *clip ]->frame_count;
+	// Find the first entry that ends after the position
+	// Note that 0 length clips get skipped automatically
+	int low = 0;
+	int high = self->count;
+	mlt_position length = mlt_playlist_start( self, self->count );
 
-		// Check if the position indicates that we have found the clip
-		// Note that 0 length clips get skipped automatically
-		if ( *position < self->list[ *clip ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ *clip ]->producer;
-			break;
-		}
+	while ( low < high )
+	{
+		int middle = ( low + high ) / 2;
+		playlist_entry *entry = self->list[ middle ];
+		if ( *position < entry->start + entry->frame_count )
+			high = middle;
 		else
-		{
-			// Decrement position by length of self entry
-			*position -= self->list[ *clip ]->frame_count;
-		}
+			low = middle + 1;
+	}
+
+	*clip = low;
+	if ( low < self->count )
+	{
+		// Found it, make the position relative to the entry
+		playlist_entry *entry = self->list[ low ];
+		producer = entry->producer;
+		*total += entry->start + entry->frame_count;
+		*position -= entry->start;
+	}
+	else
+	{
+		*total += length;
+		*position -= length;
 	}
 
 	return producer;
@@ -523,23 +614,12 @@ static mlt_producer mlt_playlist_virtual_set_out( mlt_playlist self )
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
 
-	// Loop through the virtual playlist
+	// Locate the entry in the virtual playlist
 	int i = 0;
+	int total = 0;
 
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ i ]->producer;
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
+	if ( mlt_playlist_locate( self, &position, &i, &total ) )
+		producer = self->list[ i ]->producer;
 
 	// Seek in real producer to relative position
 	if ( i < self->count && self->list[ i ]->frame_out != position )
@@ -567,22 +647,11 @@ int mlt_playlist_current_clip( mlt_playlist self )
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
 
-	// Loop through the virtual playlist
+	// Locate the entry in the virtual playlist
 	int i = 0;
+	int total = 0;
 
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
+	mlt_playlist_locate( self, &position, &i, &total );
 
 	return i;
 }
@@ -615,9 +684,7 @@ mlt_producer mlt_playlist_current( mlt_playlist self )
 
 mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index )
 {
-	mlt_position position = 0;
 	int absolute_clip = index;
-	int i = 0;
 
 	// Determine the absolute clip
 	switch ( whence )
@@ -642,10 +709,7 @@ mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index
 		absolute_clip = self->count;
 
 	// Now determine the position
-	for ( i = 0; i < absolute_clip; i ++ )
-		position += self->list[ i ]->frame_count;
-
-	return position;
+	return mlt_playlist_start( self, absolute_clip );
 }
 
 /** Get all the info about the clip specified.
@@ -839,6 +903,7 @@ int mlt_playlist_remove( mlt_playlist self, int where )
 		for ( i = where + 1; i < self->count; i ++ )
 			self->list[ i - 1 ] = self->list[ i ];
 		self->count --;
+		mlt_playlist_invalidate( self, where );
 
 		if ( entry->preservation_hack == 0 )
 		{
@@ -937,6 +1002,7 @@ int mlt_playlist_move( mlt_playlist self, int src, int dest )
 				self->list[ i ] = self->list[ i + 1 ];
 		}
 		self->list[ dest ] = src_entry;
+		mlt_playlist_invalidate( self, src < dest ? src : dest );
 
 		mlt_playlist_get_clip_info( self, &current_info, current );
 		mlt_producer_seek( MLT_PLAYLIST_PRODUCER( self ), current_info.start + position );
@@ -2061,6 +2127,20 @@ int mlt_playlist_move_region( mlt_playlist self, mlt_position position, int leng
 	return 0;
 }
 
+/** Determine if a blank entry only yields test frames.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param producer the producer of a playlist entry
+ * \return true if it is a blank that has no filters
+ */
+
+static int mlt_playlist_plain_blank( mlt_producer producer )
+{
+	return mlt_producer_is_blank( producer )
+		&& mlt_service_filter( MLT_PRODUCER_SERVICE( producer ), 0 ) == NULL
+		&& mlt_service_filter( MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( producer ) ), 0 ) == NULL;
+}
+
 /** Get the current frame.
  *
  * The implementation of the get_frame virtual function.
@@ -2097,7 +2177,18 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 	}
 
 	// Get the frame
-	if ( !mlt_properties_get_int( MLT_SERVICE_PROPERTIES( real ), "meta.fx_cut" ) )
+	if ( !mlt_properties_get_int( MLT_SERVICE_PROPERTIES( real ), "meta.fx_cut" ) && mlt_playlist_plain_blank( ( mlt_producer )real ) )
+	{
+		// Nothing can draw on a blank without filters, so skip its producer
+		mlt_producer cut = ( mlt_producer )real;
+		*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( cut ) ) );
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_image", 1 );
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_audio", 1 );
+		mlt_properties_set_double( MLT_FRAME_PROPERTIES( *frame ), "_speed", mlt_producer_get_speed( cut ) );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( *frame ), "_producer", cut, 0, NULL, NULL );
+		mlt_producer_prepare_next( cut );
+	}
+	else if ( !mlt_properties_get_int( MLT_SERVICE_PROPERTIES( real ), "meta.fx_cut" ) )
 	{
 		mlt_service_get_frame( real, frame, index );
 	}
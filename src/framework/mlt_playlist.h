@@ -77,6 +77,7 @@ struct mlt_playlist_s
 	int size;
 	int count;
 	playlist_entry **list;
+	int indexed; /**< \private the number of entries whose start position is known */
 };
 
 #define MLT_PLAYLIST_PRODUCER( playlist )	( &( playlist )->parent )
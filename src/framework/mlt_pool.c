@@ -23,6 +23,8 @@
 #include "mlt_properties.h"
 #include "mlt_deque.h"
 #include "mlt_log.h"
+#include "mlt_slices.h"
+#include "mlt_memory.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -31,19 +33,27 @@
 // Not nice - memalign is defined here apparently?
 #ifdef linux
 #include <malloc.h>
+#include <sys/mman.h>
 #endif
 
+/** the alignment of every block, enough for a cache line and AVX-512 loads */
+#define POOL_ALIGN 64
+
 // Macros to re-assign system functions.
 #ifdef _WIN32
 #  define mlt_free _aligned_free
-#  define mlt_alloc(X) _aligned_malloc( (X), 16 )
-#  define mlt_realloc(X, Y) _aligned_realloc( (X), (Y), 16 )
+#  define mlt_alloc(X) _aligned_malloc( (X), POOL_ALIGN )
+#  define mlt_realloc(X, Y) _aligned_realloc( (X), (Y), POOL_ALIGN )
 #else
 #  define mlt_free free
 #  ifdef linux
-#    define mlt_alloc(X) memalign( 16, (X) )
+#    define mlt_alloc(X) memalign( POOL_ALIGN, (X) )
 #  else
-#    define mlt_alloc(X) malloc( (X) )
+static inline void *mlt_alloc( size_t size )
+{
+	void *ptr = NULL;
+	return posix_memalign( &ptr, POOL_ALIGN, size ) ? NULL : ptr;
+}
 #  endif
 #  define mlt_realloc realloc
 #endif
@@ -59,9 +69,18 @@ void mlt_pool_init() {}
 void *mlt_pool_alloc( int size ) { return mlt_alloc( size ); }
 void *mlt_pool_realloc( void *ptr, int size ) { return mlt_realloc( ptr, size ); }
 void mlt_pool_release( void *release ) { return mlt_free( release ); }
+void *mlt_pool_retain( void *ptr ) { return NULL; }
+int mlt_pool_is_shared( void *ptr ) { return 0; }
 void mlt_pool_purge() {}
 void mlt_pool_close() {}
 void mlt_pool_stat() {}
+void mlt_pool_stats( uint64_t *allocated, uint64_t *used, uint64_t *hits, uint64_t *misses )
+{
+	if ( allocated ) *allocated = 0;
+	if ( used ) *used = 0;
+	if ( hits ) *hits = 0;
+	if ( misses ) *misses = 0;
+}
 
 #else
 
@@ -69,42 +88,223 @@ void mlt_pool_stat() {}
 
 static mlt_properties pools = NULL;
 
+/** the number of size classes: 1 << 8 through 1 << 30 */
+
+#define POOL_CLASSES ( 31 - 8 )
+
+/** the maximum number of blocks a per-thread magazine holds */
+
+#define MAGAZINE_MAX 16
+
+/** the default byte budget of each per-thread magazine (override with MLT_POOL_MAGAZINE_BYTES) */
+
+#define MAGAZINE_BYTES ( 4 << 20 )
+
+/** the maximum number of memory nodes with stacks of their own */
+
+#define POOL_NODES 8
+
 /** \brief Pool (memory) class
  */
 
 typedef struct mlt_pool_s
 {
 	pthread_mutex_t lock; ///< lock to prevent race conditions
-	mlt_deque stack;      ///< a stack of addresses to memory blocks
+	mlt_deque stacks[ POOL_NODES ]; ///< a stack of addresses to memory blocks for each memory node
 	int size;             ///< the size of the memory block as a power of 2
 	int count;            ///< the number of blocks in the pool
+	int index;            ///< the size class of this pool
+	int magazine;         ///< the capacity of a per-thread magazine, 0 to bypass
+	uint64_t hits;        ///< fetches satisfied by a recycled block
+	uint64_t misses;      ///< fetches that required a new allocation
+	uint64_t transfers;   ///< batches moved between a magazine and the stack
 }
 *mlt_pool;
 
+/** the size of a huge page and the smallest block that uses them (see MLT_POOL_HUGE_PAGES) */
+
+#define HUGE_PAGE_SIZE ( 2 << 20 )
+
 /** \brief private to mlt_pool_s, for tracking items to release
  *
- * Aligned to 16 byte in case we toss buffers to external assembly
- * optimized libraries (sse/altivec).
+ * Aligned to POOL_ALIGN bytes so that the data following it starts on a
+ * cache line, in case we toss buffers to external assembly optimized
+ * libraries (sse/avx/neon).
  */
 
-typedef struct __attribute__ ((aligned (16))) mlt_release_s
+typedef struct __attribute__ ((aligned (POOL_ALIGN))) mlt_release_s
 {
 	mlt_pool pool;
-	int references;
+	int references; ///< the number of holders, see mlt_pool_retain()
+	int node;       ///< the memory node of the thread that allocated the block
 }
 *mlt_release;
 
+/** \brief private to mlt_pool_s, a per-thread stack of released blocks for one size class
+ */
+
+typedef struct
+{
+	int count;                    ///< the number of blocks held
+	void *items[ MAGAZINE_MAX ];  ///< the blocks held
+	uint64_t hits;                ///< fetches satisfied from this magazine
+	uint64_t misses;              ///< fetches that required a new allocation
+	uint64_t transfers;           ///< batches moved to or from the pool stack
+}
+pool_magazine;
+
+/** \brief private to mlt_pool_s, the per-thread cache of magazines
+ *
+ * Only the owning thread touches the magazines, so no lock is needed to
+ * fetch or return a block unless the magazine runs empty or full. Then
+ * half a magazine is moved to or from the pool stack under one lock.
+ */
+
+typedef struct pool_cache_s
+{
+	pool_magazine magazines[ POOL_CLASSES ];
+	struct pool_cache_s *next;
+	struct pool_cache_s *prev;
+}
+*pool_cache;
+
+/** the list of all thread caches, to report their counters and to empty them on close */
+
+static pool_cache caches = NULL;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static int magazine_bytes = MAGAZINE_BYTES;
+static int pool_nodes = 1;
+static int huge_pages = 0;
+static mlt_memory_client memory_client = NULL;
+
+static void pool_stats( int log, uint64_t *allocated, uint64_t *used, uint64_t *hits, uint64_t *misses );
+
+/** Get the memory node whose stack the calling thread uses.
+ *
+ * \private \memberof mlt_pool_s
+ * \return the node, always 0 unless MLT_NUMA is set
+ */
+
+static inline int pool_node( )
+{
+	return pool_nodes > 1 ? mlt_slices_numa_node( ) % POOL_NODES : 0;
+}
+
+static inline int block_node( void *ptr )
+{
+	return ( ( mlt_release )( ( char * )ptr - sizeof( struct mlt_release_s ) ) )->node;
+}
+
+/** Free a block held by the pool or a magazine.
+ *
+ * \private \memberof mlt_pool_s
+ * \param ptr an opaque pointer
+ */
+
+static inline void pool_free( void *ptr )
+{
+	mlt_free( ( char * )ptr - sizeof( struct mlt_release_s ) );
+}
+
+/** Move blocks from a magazine back onto the pool stack.
+ *
+ * \private \memberof mlt_pool_s
+ * \param self a pool
+ * \param magazine a magazine belonging to the pool's size class
+ * \param n the number of blocks to transfer
+ */
+
+static void magazine_flush( mlt_pool self, pool_magazine *magazine, int n )
+{
+	if ( n > magazine->count )
+		n = magazine->count;
+	if ( n > 0 )
+	{
+		pthread_mutex_lock( &self->lock );
+		while ( n-- )
+		{
+			void *ptr = magazine->items[ -- magazine->count ];
+			mlt_deque_push_back( self->stacks[ block_node( ptr ) ], ptr );
+		}
+		pthread_mutex_unlock( &self->lock );
+		magazine->transfers ++;
+	}
+}
+
+/** Destroy the cache of a terminating thread, returning its blocks to the pools.
+ *
+ * \private \memberof mlt_pool_s
+ * \param arg a pool cache
+ */
+
+static void cache_close( void *arg )
+{
+	pool_cache cache = arg;
+	int i;
+
+	pthread_mutex_lock( &caches_lock );
+	for ( i = 0; pools && i < POOL_CLASSES; i ++ )
+	{
+		mlt_pool self = mlt_properties_get_data_at( pools, i, NULL );
+		pool_magazine *magazine = &cache->magazines[ i ];
+		magazine_flush( self, magazine, magazine->count );
+		pthread_mutex_lock( &self->lock );
+		self->hits += magazine->hits;
+		self->misses += magazine->misses;
+		self->transfers += magazine->transfers;
+		pthread_mutex_unlock( &self->lock );
+	}
+	if ( cache->prev )
+		cache->prev->next = cache->next;
+	else
+		caches = cache->next;
+	if ( cache->next )
+		cache->next->prev = cache->prev;
+	pthread_mutex_unlock( &caches_lock );
+	free( cache );
+}
+
+static void cache_key_init( )
+{
+	pthread_key_create( &cache_key, cache_close );
+}
+
+/** Get the cache of the calling thread, creating it on first use.
+ *
+ * \private \memberof mlt_pool_s
+ * \return the thread's pool cache or NULL on error
+ */
+
+static pool_cache cache_get( )
+{
+	pool_cache cache = pthread_getspecific( cache_key );
+	if ( !cache && ( cache = calloc( 1, sizeof( struct pool_cache_s ) ) ) )
+	{
+		pthread_mutex_lock( &caches_lock );
+		cache->next = caches;
+		if ( caches )
+			caches->prev = cache;
+		caches = cache;
+		pthread_mutex_unlock( &caches_lock );
+		pthread_setspecific( cache_key, cache );
+	}
+	return cache;
+}
+
 /** Create a pool.
  *
  * \private \memberof mlt_pool_s
- * \param size the size of the memory blocks to hold as some power of two
+ * \param index the size class of the memory blocks to hold as some power of two
  * \return a new pool object
  */
 
-static mlt_pool pool_init( int size )
+static mlt_pool pool_init( int index )
 {
 	// Create the pool
 	mlt_pool self = calloc( 1, sizeof( struct mlt_pool_s ) );
+	int i;
 
 	// Initialise it
 	if ( self != NULL )
@@ -112,17 +312,89 @@ static mlt_pool pool_init( int size )
 		// Initialise the mutex
 		pthread_mutex_init( &self->lock, NULL );
 
-		// Create the stack
-		self->stack = mlt_deque_init( );
+		// Create the stacks, the pages of a block stay on the node that first touched them
+		for ( i = 0; i < POOL_NODES; i ++ )
+			self->stacks[ i ] = mlt_deque_init( );
 
 		// Assign the size
-		self->size = size;
+		self->index = index - 8;
+		self->size = 1 << index;
+
+		// Large blocks bypass the magazines so idle threads do not hoard them
+		self->magazine = magazine_bytes / self->size;
+		if ( self->magazine > MAGAZINE_MAX )
+			self->magazine = MAGAZINE_MAX;
 	}
 
 	// Return it
 	return self;
 }
 
+/** Allocate the memory of a block.
+ *
+ * Blocks of a huge page or more are aligned to huge pages and, if enabled,
+ * backed by them, so that a full frame pass touches a handful of TLB entries
+ * instead of hundreds. They can still be released with mlt_free.
+ *
+ * \private \memberof mlt_pool_s
+ * \param self a pool
+ * \return the memory or NULL
+ */
+
+static void *block_alloc( mlt_pool self )
+{
+#if defined( linux ) && defined( MADV_HUGEPAGE )
+	if ( huge_pages && self->size >= HUGE_PAGE_SIZE )
+	{
+		void *ptr = NULL;
+		if ( posix_memalign( &ptr, HUGE_PAGE_SIZE, self->size ) )
+			return NULL;
+		madvise( ptr, self->size, MADV_HUGEPAGE );
+		return ptr;
+	}
+#endif
+	return mlt_alloc( self->size );
+}
+
+/** Allocate a new block for a pool.
+ *
+ * \private \memberof mlt_pool_s
+ * \param self a pool
+ * \return an opaque pointer
+ */
+
+static void *pool_allocate( mlt_pool self )
+{
+	// We need to generate a release item
+	mlt_release release = block_alloc( self );
+
+	// If out of memory, log it, reclaim memory, and try again.
+	if ( !release && self->size > 0 )
+	{
+		mlt_log_fatal( NULL, "[mlt_pool] out of memory\n" );
+		mlt_pool_purge();
+		release = block_alloc( self );
+	}
+
+	// Initialise it
+	if ( release != NULL )
+	{
+		// Increment the number of items allocated to this pool
+		__sync_fetch_and_add( &self->count, 1 );
+
+		// Assign the pool
+		release->pool = self;
+
+		// Assign the reference
+		release->references = 1;
+		release->node = pool_node( );
+
+		// Determine the ptr
+		return ( char * )release + sizeof( struct mlt_release_s );
+	}
+	return NULL;
+}
+
 /** Get an item from the pool.
  *
  * \private \memberof mlt_pool_s
@@ -138,50 +410,63 @@ static void *pool_fetch( mlt_pool self )
 	// Sanity check
 	if ( self != NULL )
 	{
+		pool_cache cache = self->magazine > 0 ? cache_get( ) : NULL;
+
+		if ( cache )
+		{
+			pool_magazine *magazine = &cache->magazines[ self->index ];
+
+			// Refill an empty magazine with half its capacity from the stack
+			if ( magazine->count == 0 )
+			{
+				int n = ( self->magazine + 1 ) / 2;
+				mlt_deque stack = self->stacks[ pool_node( ) ];
+				pthread_mutex_lock( &self->lock );
+				while ( n-- && mlt_deque_count( stack ) != 0 )
+					magazine->items[ magazine->count ++ ] = mlt_deque_pop_back( stack );
+				pthread_mutex_unlock( &self->lock );
+				if ( magazine->count )
+					magazine->transfers ++;
+			}
+
+			if ( magazine->count != 0 )
+			{
+				ptr = magazine->items[ -- magazine->count ];
+				( ( mlt_release )( ( char * )ptr - sizeof( struct mlt_release_s ) ) )->references = 1;
+				magazine->hits ++;
+			}
+			else
+			{
+				ptr = pool_allocate( self );
+				magazine->misses ++;
+			}
+			return ptr;
+		}
+
+		mlt_deque stack = self->stacks[ pool_node( ) ];
+
 		// Lock the pool
 		pthread_mutex_lock( &self->lock );
 
 		// Check if the stack is empty
-		if ( mlt_deque_count( self->stack ) != 0 )
+		if ( mlt_deque_count( stack ) != 0 )
 		{
 			// Pop the top of the stack
-			ptr = mlt_deque_pop_back( self->stack );
+			ptr = mlt_deque_pop_back( stack );
 
 			// Assign the reference
-			( ( mlt_release )ptr )->references = 1;
+			( ( mlt_release )( ( char * )ptr - sizeof( struct mlt_release_s ) ) )->references = 1;
+			self->hits ++;
+			pthread_mutex_unlock( &self->lock );
 		}
 		else
 		{
-			// We need to generate a release item
-			mlt_release release = mlt_alloc( self->size );
-
-			// If out of memory, log it, reclaim memory, and try again.
-			if ( !release && self->size > 0 )
-			{
-				mlt_log_fatal( NULL, "[mlt_pool] out of memory\n" );
-				mlt_pool_purge();
-				release = mlt_alloc( self->size );
-			}
-
-			// Initialise it
-			if ( release != NULL )
-			{
-				// Increment the number of items allocated to this pool
-				self->count ++;
-
-				// Assign the pool
-				release->pool = self;
-
-				// Assign the reference
-				release->references = 1;
+			self->misses ++;
 
-				// Determine the ptr
-				ptr = ( char * )release + sizeof( struct mlt_release_s );
-			}
+			// Allocate outside of the lock
+			pthread_mutex_unlock( &self->lock );
+			ptr = pool_allocate( self );
 		}
-
-		// Unlock the pool
-		pthread_mutex_unlock( &self->lock );
 	}
 
 	// Return the generated release object
@@ -205,13 +490,31 @@ static void pool_return( void *ptr )
 		// Get the pool
 		mlt_pool self = that->pool;
 
+		// Keep a block that is still shared
+		if ( __atomic_sub_fetch( &that->references, 1, __ATOMIC_ACQ_REL ) > 0 )
+			return;
+
 		if ( self != NULL )
 		{
+			// A block from another node goes home rather than into this thread's magazine
+			pool_cache cache = self->magazine > 0 && that->node == pool_node( ) ? cache_get( ) : NULL;
+
+			if ( cache )
+			{
+				pool_magazine *magazine = &cache->magazines[ self->index ];
+
+				// Spill half of a full magazine to the stack
+				if ( magazine->count == self->magazine )
+					magazine_flush( self, magazine, ( self->magazine + 1 ) / 2 );
+				magazine->items[ magazine->count ++ ] = ptr;
+				return;
+			}
+
 			// Lock the pool
 			pthread_mutex_lock( &self->lock );
 
 			// Push the that back back on to the stack
-			mlt_deque_push_back( self->stack, ptr );
+			mlt_deque_push_back( self->stacks[ that->node ], ptr );
 
 			// Unlock the pool
 			pthread_mutex_unlock( &self->lock );
@@ -220,7 +523,7 @@ static void pool_return( void *ptr )
 		}
 
 		// Free the release itself
-		mlt_free( ( char * )ptr - sizeof( struct mlt_release_s ) );
+		pool_free( ptr );
 	}
 }
 
@@ -236,16 +539,20 @@ static void pool_close( mlt_pool self )
 	{
 		// We need to free up all items in the pool
 		void *release = NULL;
+		int i;
 
-		// Iterate through the stack until depleted
-		while ( ( release = mlt_deque_pop_back( self->stack ) ) != NULL )
+		for ( i = 0; i < POOL_NODES; i ++ )
 		{
-			// We'll free this item now
-			mlt_free( ( char * )release - sizeof( struct mlt_release_s ) );
-		}
+			// Iterate through the stack until depleted
+			while ( ( release = mlt_deque_pop_back( self->stacks[ i ] ) ) != NULL )
+			{
+				// We'll free this item now
+				pool_free( release );
+			}
 
-		// We can now close the stack
-		mlt_deque_close( self->stack );
+			// We can now close the stack
+			mlt_deque_close( self->stacks[ i ] );
+		}
 
 		// Destroy the mutex
 		pthread_mutex_destroy( &self->lock );
@@ -255,6 +562,24 @@ static void pool_close( mlt_pool self )
 	}
 }
 
+/** Report all the blocks allocated to the memory budget. */
+
+static int64_t pool_memory_usage( void *data )
+{
+	uint64_t allocated, used, hits, misses;
+	pool_stats( 0, &allocated, &used, &hits, &misses );
+	return allocated;
+}
+
+/** Free the unused blocks when the memory budget is exceeded. */
+
+static int64_t pool_memory_reclaim( void *data, int64_t bytes )
+{
+	int64_t before = pool_memory_usage( data );
+	mlt_pool_purge( );
+	return before - pool_memory_usage( data );
+}
+
 /** Initialise the global pool.
  *
  * \public \memberof mlt_pool_s
@@ -265,6 +590,18 @@ void mlt_pool_init( )
 	// Loop variable used to create the pools
 	int i = 0;
 
+	// Allow the per-thread magazines to be resized or disabled
+	const char *env = getenv( "MLT_POOL_MAGAZINE_BYTES" );
+	magazine_bytes = env ? atoi( env ) : MAGAZINE_BYTES;
+	pthread_once( &cache_key_once, cache_key_init );
+
+	// Back the blocks of a huge page or more with huge pages
+	env = getenv( "MLT_POOL_HUGE_PAGES" );
+	huge_pages = env ? atoi( env ) : 0;
+
+	// Keep blocks on the memory node that allocated them, see MLT_NUMA
+	pool_nodes = mlt_slices_numa_nodes( );
+
 	// Create the pools
 	pools = mlt_properties_new( );
 
@@ -275,7 +612,7 @@ void mlt_pool_init( )
 		char name[ 32 ];
 
 		// Construct a pool
-		mlt_pool pool = pool_init( 1 << i );
+		mlt_pool pool = pool_init( i );
 
 		// Generate a name
 		sprintf( name, "%d", i );
@@ -283,6 +620,9 @@ void mlt_pool_init( )
 		// Register with properties
 		mlt_properties_set_data( pools, name, pool, 0, ( mlt_destructor )pool_close, NULL );
 	}
+
+	// Give back the unused blocks last when the memory budget is exceeded
+	memory_client = mlt_memory_register( "pool", 30, 0, pool_memory_usage, pool_memory_reclaim, NULL );
 }
 
 /** Allocate size bytes from the pool.
@@ -329,14 +669,16 @@ void *mlt_pool_realloc( void *ptr, int size )
 		// Get the release pointer
 		mlt_release that = ( void * )(( char * )ptr - sizeof( struct mlt_release_s ));
 
-		// If the current pool this ptr belongs to is big enough
-		if ( size > that->pool->size - sizeof( struct mlt_release_s ) )
+		// If the current pool this ptr belongs to is big enough and the block is not shared
+		if ( size > that->pool->size - sizeof( struct mlt_release_s ) || mlt_pool_is_shared( ptr ) )
 		{
+			int old_size = that->pool->size - sizeof( struct mlt_release_s );
+
 			// Allocate
 			result = mlt_pool_alloc( size );
 
 			// Copy
-			memcpy( result, ptr, that->pool->size - sizeof( struct mlt_release_s ) );
+			memcpy( result, ptr, size < old_size ? size : old_size );
 
 			// Release
 			mlt_pool_release( ptr );
@@ -364,7 +706,10 @@ void *mlt_pool_realloc( void *ptr, int size )
 
 void mlt_pool_purge( )
 {
-	int i = 0;
+	int i = 0, j;
+
+	// Return the blocks held by the calling thread
+	pool_cache cache = pthread_getspecific( cache_key );
 
 	// For each pool
 	for ( i = 0; i < mlt_properties_count( pools ); i ++ )
@@ -375,14 +720,20 @@ void mlt_pool_purge( )
 		// Pointer to unused memory
 		void *release = NULL;
 
+		if ( cache )
+			magazine_flush( self, &cache->magazines[ i ], cache->magazines[ i ].count );
+
 		// Lock the pool
 		pthread_mutex_lock( &self->lock );
 
 		// We'll free all unused items now
-		while ( ( release = mlt_deque_pop_back( self->stack ) ) != NULL )
+		for ( j = 0; j < POOL_NODES; j ++ )
 		{
-			mlt_free( ( char * )release - sizeof( struct mlt_release_s ) );
-			self->count--;
+			while ( ( release = mlt_deque_pop_back( self->stacks[ j ] ) ) != NULL )
+			{
+				pool_free( release );
+				__sync_fetch_and_sub( &self->count, 1 );
+			}
 		}
 
 		// Unlock the pool
@@ -402,6 +753,43 @@ void mlt_pool_release( void *release )
 	pool_return( release );
 }
 
+/** Share an allocated block by adding a reference to it.
+ *
+ * Each reference is dropped with mlt_pool_release() and the block returns
+ * to the pool with the last one. A shared block must not be written; use
+ * mlt_pool_is_shared() to decide whether to copy it first.
+ * \public \memberof mlt_pool_s
+ * \param ptr an opaque pointer of a block in the pool
+ * \return \p ptr, or NULL if blocks cannot be shared because the pool is disabled
+ */
+
+void *mlt_pool_retain( void *ptr )
+{
+	if ( ptr != NULL )
+	{
+		mlt_release that = ( void * )(( char * )ptr - sizeof( struct mlt_release_s ));
+		__atomic_add_fetch( &that->references, 1, __ATOMIC_RELAXED );
+	}
+	return ptr;
+}
+
+/** Determine if an allocated block has more than one reference.
+ *
+ * \public \memberof mlt_pool_s
+ * \param ptr an opaque pointer of a block in the pool
+ * \return true if the block is shared
+ */
+
+int mlt_pool_is_shared( void *ptr )
+{
+	if ( ptr != NULL )
+	{
+		mlt_release that = ( void * )(( char * )ptr - sizeof( struct mlt_release_s ));
+		return __atomic_load_n( &that->references, __ATOMIC_ACQUIRE ) > 1;
+	}
+	return 0;
+}
+
 /** Close the pool.
  *
  * \public \memberof mlt_pool_s
@@ -409,35 +797,119 @@ void mlt_pool_release( void *release )
 
 void mlt_pool_close( )
 {
+	pool_cache cache;
+
 #ifdef _MLT_POOL_CHECKS_
 	mlt_pool_stat( );
 #endif
 
+	mlt_memory_unregister( memory_client );
+	memory_client = NULL;
+
+	// Empty the magazines of all threads - the pool must no longer be in use
+	pthread_mutex_lock( &caches_lock );
+	for ( cache = caches; cache; cache = cache->next )
+	{
+		int i;
+		for ( i = 0; i < POOL_CLASSES; i ++ )
+		{
+			pool_magazine *magazine = &cache->magazines[ i ];
+			while ( magazine->count )
+				pool_free( magazine->items[ -- magazine->count ] );
+			memset( magazine, 0, sizeof( *magazine ) );
+		}
+	}
+
 	// Close the properties
 	mlt_properties_close( pools );
+	pools = NULL;
+	pthread_mutex_unlock( &caches_lock );
 }
 
-void mlt_pool_stat( )
+/** Add up the usage and counters of the pools, optionally logging each size class. */
+
+static void pool_stats( int log, uint64_t *allocated, uint64_t *used, uint64_t *hits, uint64_t *misses )
 {
-	// Stats dump
-	uint64_t allocated = 0, used = 0, s;
+	uint64_t s;
 	int i = 0, c = mlt_properties_count( pools );
 
-	mlt_log( NULL, MLT_LOG_VERBOSE, "%s: count %d\n", __FUNCTION__, c);
+	*allocated = *used = *hits = *misses = 0;
+	if ( log )
+		mlt_log( NULL, MLT_LOG_VERBOSE, "%s: count %d\n", "mlt_pool_stat", c);
 
+	pthread_mutex_lock( &caches_lock );
 	for ( i = 0; i < c; i ++ )
 	{
 		mlt_pool pool = mlt_properties_get_data_at( pools, i, NULL );
-		if ( pool->count )
-			mlt_log_verbose( NULL, "%s: size %d allocated %d returned %d %c\n", __FUNCTION__,
-				pool->size, pool->count, mlt_deque_count( pool->stack ),
-				pool->count !=  mlt_deque_count( pool->stack ) ? '*' : ' ' );
-		s = pool->size; s *= pool->count; allocated += s;
-		s = pool->count - mlt_deque_count( pool->stack ); s *= pool->size; used += s;
+		uint64_t pool_hits, pool_misses, transfers;
+		int held = 0, returned, j;
+		pool_cache cache;
+
+		pthread_mutex_lock( &pool->lock );
+		pool_hits = pool->hits;
+		pool_misses = pool->misses;
+		transfers = pool->transfers;
+		for ( returned = 0, j = 0; j < POOL_NODES; j ++ )
+			returned += mlt_deque_count( pool->stacks[ j ] );
+		pthread_mutex_unlock( &pool->lock );
+
+		// The magazines belong to other threads, so these are approximate
+		for ( cache = caches; cache; cache = cache->next )
+		{
+			pool_hits += cache->magazines[ i ].hits;
+			pool_misses += cache->magazines[ i ].misses;
+			transfers += cache->magazines[ i ].transfers;
+			held += cache->magazines[ i ].count;
+		}
+		returned += held;
+
+		if ( log && pool->count )
+			mlt_log_verbose( NULL, "%s: size %d allocated %d returned %d (in magazines %d) hits %"PRIu64" misses %"PRIu64" transfers %"PRIu64" %c\n", "mlt_pool_stat",
+				pool->size, pool->count, returned, held, pool_hits, pool_misses, transfers,
+				pool->count != returned ? '*' : ' ' );
+		s = pool->size; s *= pool->count; *allocated += s;
+		s = pool->count - returned; s *= pool->size; *used += s;
+		*hits += pool_hits;
+		*misses += pool_misses;
 	}
+	pthread_mutex_unlock( &caches_lock );
+}
+
+/** Report the pool usage and counters for each size class to the log.
+ *
+ * Hits are fetches that recycled a block, misses are fetches that needed a
+ * new allocation, and transfers are batches moved between the per-thread
+ * magazines and the shared stack of a size class.
+ * \public \memberof mlt_pool_s
+ */
 
+void mlt_pool_stat( )
+{
+	uint64_t allocated, used, hits, misses;
+
+	pool_stats( 1, &allocated, &used, &hits, &misses );
 	mlt_log_verbose( NULL, "%s: allocated %"PRIu64" bytes, used %"PRIu64" bytes \n",
 		__FUNCTION__, allocated, used );
 }
 
+/** Get the totals of the pools.
+ *
+ * \public \memberof mlt_pool_s
+ * \param[out] allocated the bytes of all the blocks allocated, or NULL
+ * \param[out] used the bytes of the blocks not returned, or NULL
+ * \param[out] hits the fetches that recycled a block, or NULL
+ * \param[out] misses the fetches that needed a new allocation, or NULL
+ */
+
+void mlt_pool_stats( uint64_t *allocated, uint64_t *used, uint64_t *hits, uint64_t *misses )
+{
+	uint64_t a, u, h, m;
+
+	pool_stats( 0, &a, &u, &h, &m );
+	if ( allocated ) *allocated = a;
+	if ( used ) *used = u;
+	if ( hits ) *hits = h;
+	if ( misses ) *misses = m;
+}
+
 #endif // NO_MLT_POOL
@@ -23,12 +23,21 @@
 #ifndef MLT_POOL_H
 #define MLT_POOL_H
 
+#include <stdint.h>
+
+/**
+ * \envvar \em MLT_POOL_HUGE_PAGES set to 1 to back the blocks of 2 MiB and more with transparent huge pages on Linux
+ */
+
 extern void mlt_pool_init( );
 extern void *mlt_pool_alloc( int size );
 extern void *mlt_pool_realloc( void *ptr, int size );
 extern void mlt_pool_release( void *release );
+extern void *mlt_pool_retain( void *ptr );
+extern int mlt_pool_is_shared( void *ptr );
 extern void mlt_pool_purge( );
 extern void mlt_pool_close( );
 extern void mlt_pool_stat( );
+extern void mlt_pool_stats( uint64_t *allocated, uint64_t *used, uint64_t *hits, uint64_t *misses );
 
 #endif
@@ -709,18 +709,20 @@ static int producer_get_frame( mlt_service service, mlt_frame_ptr frame, int ind
 		result = 0;
 	}
 
-	// Pass on all meta properties from the producer/cut on to the frame
+	// Pass on all meta properties from the producer/cut on to the frame,
+	// which reads them through the producer unless it has too many parents
 	if ( *frame != NULL && self != NULL )
 	{
 		int i = 0;
 		mlt_properties p_props = MLT_PRODUCER_PROPERTIES( self );
 		mlt_properties f_props = MLT_FRAME_PROPERTIES( *frame );
+		int copy_meta = mlt_properties_add_parent( f_props, p_props, "meta." );
 		mlt_properties_lock( p_props );
 		int count = mlt_properties_count( p_props );
 		for ( i = 0; i < count; i ++ )
 		{
 			char *name = mlt_properties_get_name( p_props, i );
-			if ( !strncmp( name, "meta.", 5 ) )
+			if ( copy_meta && !strncmp( name, "meta.", 5 ) )
 				mlt_properties_set( f_props, name, mlt_properties_get_value( p_props, i ) );
 			else if ( !strncmp( name, "set.", 4 ) )
 				mlt_properties_set( f_props, name + 4, mlt_properties_get_value( p_props, i ) );
@@ -299,6 +299,37 @@ double mlt_profile_dar( mlt_profile profile )
 		return 0;
 }
 
+/** Get the ratio of a width to the width of a profile.
+ *
+ * A filter whose parameters are in pixels of the profile, like a blur
+ * radius, multiplies them by this to work on an image requested at another
+ * size, such as a preview that a consumer renders at a reduced scale.
+ *
+ * \public \memberof mlt_profile_s
+ * \param profile a profile
+ * \param width the width of the image being processed
+ * \return the scale factor, or 1 if it cannot be determined
+ */
+
+double mlt_profile_scale_width( mlt_profile profile, int width )
+{
+	return ( profile && width > 0 && profile->width > 0 ) ? ( double ) width / profile->width : 1.0;
+}
+
+/** Get the ratio of a height to the height of a profile.
+ *
+ * \public \memberof mlt_profile_s
+ * \param profile a profile
+ * \param height the height of the image being processed
+ * \return the scale factor, or 1 if it cannot be determined
+ * \see mlt_profile_scale_width
+ */
+
+double mlt_profile_scale_height( mlt_profile profile, int height )
+{
+	return ( profile && height > 0 && profile->height > 0 ) ? ( double ) height / profile->height : 1.0;
+}
+
 /** Free up the global profile resources.
  *
  * \public \memberof mlt_profile_s
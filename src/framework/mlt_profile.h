@@ -54,6 +54,8 @@ extern mlt_profile mlt_profile_load_string( const char *string );
 extern double mlt_profile_fps( mlt_profile profile );
 extern double mlt_profile_sar( mlt_profile profile );
 extern double mlt_profile_dar( mlt_profile profile );
+extern double mlt_profile_scale_width( mlt_profile profile, int width );
+extern double mlt_profile_scale_height( mlt_profile profile, int height );
 extern void mlt_profile_close( mlt_profile profile );
 extern mlt_profile mlt_profile_clone( mlt_profile profile );
 extern mlt_properties mlt_profile_list( );
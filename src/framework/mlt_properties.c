@@ -44,22 +44,54 @@
 #include <locale.h>
 #include <float.h>
 
+extern mlt_destructor mlt_property_get_destructor( mlt_property self );
+
+#define MAX_PARENTS (8)
+
 /** \brief private implementation of the property list */
 
 typedef struct
 {
-	int hash[ 199 ];
+	int *index;            ///< open addressing table of name positions + 1, 0 is empty
+	int index_size;        ///< the capacity of the index, always a power of two
+	unsigned int *hash;    ///< the full hash of each name
 	char **name;
 	mlt_property *value;
 	int count;
 	int size;
+	int reserved;          ///< the number of names and values kept for reuse, at least count
 	mlt_properties mirror;
 	int ref_count;
 	pthread_mutex_t mutex;
 	locale_t locale;
+	void *events;          ///< the events object, see mlt_events.c
+	mlt_properties parent[ MAX_PARENTS ]; ///< the properties that missing names are read from, see mlt_properties_add_parent()
+	char *parent_prefix[ MAX_PARENTS ];
+	int parent_count;
 }
 property_list;
 
+static inline mlt_property properties_lookup( property_list *list, const char *name, unsigned int hash );
+static mlt_property properties_find_hashed( mlt_properties self, const char *name, unsigned int hash );
+
+/** \brief Interned property name
+ *
+ * Atoms are never freed, so their name and precomputed hash can be kept by
+ * a service for the lifetime of the process.
+ */
+
+struct mlt_atom_s
+{
+	char *name;
+	unsigned int hash;
+	struct mlt_atom_s *next;
+};
+
+#define ATOM_BUCKETS 256
+
+static struct mlt_atom_s *atoms[ ATOM_BUCKETS ];
+static pthread_mutex_t atoms_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* Memory leak checks */
 
 //#define _MLT_PROPERTY_CHECKS_ 2
@@ -104,6 +136,95 @@ int mlt_properties_init( mlt_properties self, void *child )
 	return self != NULL && self->local == NULL;
 }
 
+/** Get the events object of a properties list.
+ *
+ * This is private to the framework; it lets the events find their object
+ * without a lookup each time one is fired.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \return the events object or NULL
+ */
+
+void *mlt_properties_get_events( mlt_properties self )
+{
+	if ( !self || !self->local ) return NULL;
+	property_list *list = self->local;
+	return __atomic_load_n( &list->events, __ATOMIC_ACQUIRE );
+}
+
+/** Set the events object of a properties list.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param events the events object or NULL
+ */
+
+void mlt_properties_set_events( mlt_properties self, void *events )
+{
+	if ( self && self->local )
+	{
+		property_list *list = self->local;
+		__atomic_store_n( &list->events, events, __ATOMIC_RELEASE );
+	}
+}
+
+/** Release the parents of a property list.
+ *
+ * \private \memberof mlt_properties_s
+ * \param list a property list
+ */
+
+static void parents_release( property_list *list )
+{
+	while ( list->parent_count )
+	{
+		list->parent_count --;
+		mlt_properties_close( list->parent[ list->parent_count ] );
+		free( list->parent_prefix[ list->parent_count ] );
+	}
+}
+
+/** Empty a properties list so that its object can be used again.
+ *
+ * This is private to the framework; it lets frames be recycled. The values
+ * are cleared, but the property objects, their names and the arrays are
+ * kept, and a name is reused when the same one is added at the same place
+ * again. The reference count is set to one.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \return true if the list has a close function and cannot be reused
+ */
+
+int mlt_properties_reset( mlt_properties self )
+{
+	property_list *list = self->local;
+	int i;
+
+	if ( self->close != NULL )
+		return 1;
+
+	for ( i = list->count - 1; i >= 0; i -- )
+		mlt_property_clear( list->value[ i ] );
+	list->count = 0;
+	if ( list->index )
+		memset( list->index, 0, list->index_size * sizeof( int ) );
+	list->mirror = NULL;
+	list->ref_count = 1;
+	parents_release( list );
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+	if ( list->locale )
+		freelocale( list->locale );
+#else
+	free( list->locale );
+#endif
+	list->locale = NULL;
+
+	return 0;
+}
+
 /** Create a properties object.
  *
  * This allocates the properties structure and calls mlt_properties_init() on it.
@@ -197,20 +318,60 @@ const char* mlt_properties_get_lcnumeric( mlt_properties self )
 	return result;
 }
 
-static int load_properties( mlt_properties self, const char *filename )
+/** \brief a properties file as read for the process
+ *
+ * Presets and profiles are loaded every time a consumer starts, so the lines
+ * of each file are kept until its modification time or size changes.
+ */
+
+typedef struct
+{
+	char **lines;
+	int count;
+	time_t mtime;
+	off_t size;
+	int refcount;
+}
+properties_file;
+
+static pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t file_refcount_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mlt_properties files = NULL;
+
+static void properties_file_release( properties_file *file )
+{
+	int refcount;
+
+	pthread_mutex_lock( &file_refcount_mutex );
+	refcount = -- file->refcount;
+	pthread_mutex_unlock( &file_refcount_mutex );
+	if ( refcount == 0 )
+	{
+		while ( file->count )
+			free( file->lines[ -- file->count ] );
+		free( file->lines );
+		free( file );
+	}
+}
+
+static properties_file *read_properties_file( const char *filename )
 {
 	// Open the file
-	FILE *file = mlt_fopen( filename, "r" );
+	FILE *stream = mlt_fopen( filename, "r" );
+	properties_file *file = NULL;
 
 	// Load contents of file
-	if ( file != NULL )
+	if ( stream != NULL && ( file = calloc( 1, sizeof( properties_file ) ) ) )
 	{
 		// Temp string
 		char temp[ 1024 ];
 		char last[ 1024 ] = "";
+		int size = 0;
+
+		file->refcount = 1;
 
 		// Read each string from the file
-		while( fgets( temp, 1024, file ) )
+		while( fgets( temp, 1024, stream ) )
 		{
 			// Chomp the new line character from the string
 			int x = strlen( temp ) - 1;
@@ -230,13 +391,105 @@ static int load_properties( mlt_properties self, const char *filename )
 				*( strchr( last, '=' ) ) = '\0';
 			}
 
-			// Parse and set the property
+			// Keep the line to parse
 			if ( strcmp( temp, "" ) && temp[ 0 ] != '#' )
-				mlt_properties_parse( self, temp );
+			{
+				if ( file->count == size )
+				{
+					char **lines = realloc( file->lines, ( size = size ? size * 2 : 16 ) * sizeof( char* ) );
+					if ( !lines )
+						break;
+					file->lines = lines;
+				}
+				if ( !( file->lines[ file->count ] = strdup( temp ) ) )
+					break;
+				file->count ++;
+			}
 		}
+	}
+
+	// Close the file
+	if ( stream != NULL )
+		fclose( stream );
+	return file;
+}
+
+/** Get the lines of a properties file, reading it only if it changed.
+ *
+ * \private \memberof mlt_properties_s
+ * \param filename the file name
+ * \return a file to release with properties_file_release or NULL with errno set
+ */
+
+static properties_file *get_properties_file( const char *filename )
+{
+	struct stat stat_buff;
+	properties_file *file = NULL;
+
+	// A name that stat does not take, such as UTF-8 on Windows, is not kept
+	if ( stat( filename, &stat_buff ) )
+		return read_properties_file( filename );
+
+	pthread_mutex_lock( &files_mutex );
+	if ( files )
+		file = mlt_properties_get_data( files, filename, NULL );
+	if ( file && file->mtime == stat_buff.st_mtime && file->size == stat_buff.st_size )
+	{
+		pthread_mutex_lock( &file_refcount_mutex );
+		file->refcount ++;
+		pthread_mutex_unlock( &file_refcount_mutex );
+	}
+	else
+	{
+		file = NULL;
+	}
+	pthread_mutex_unlock( &files_mutex );
 
-		// Close the file
-		fclose( file );
+	if ( !file && ( file = read_properties_file( filename ) ) )
+	{
+		// The list keeps one reference and the caller the other
+		file->mtime = stat_buff.st_mtime;
+		file->size = stat_buff.st_size;
+		file->refcount ++;
+		pthread_mutex_lock( &files_mutex );
+		if ( !files )
+			files = mlt_properties_new( );
+		if ( files )
+			mlt_properties_set_data( files, filename, file, 0, (mlt_destructor) properties_file_release, NULL );
+		else
+			file->refcount --;
+		pthread_mutex_unlock( &files_mutex );
+	}
+	return file;
+}
+
+/** Free the properties files kept for the process.
+ *
+ * This is private to the framework and called by mlt_factory_close().
+ * \private \memberof mlt_properties_s
+ */
+
+void mlt_properties_files_close( )
+{
+	pthread_mutex_lock( &files_mutex );
+	mlt_properties properties = files;
+	files = NULL;
+	pthread_mutex_unlock( &files_mutex );
+	mlt_properties_close( properties );
+}
+
+static int load_properties( mlt_properties self, const char *filename )
+{
+	properties_file *file = get_properties_file( filename );
+
+	if ( file != NULL )
+	{
+		int i;
+
+		// Parse and set the properties
+		for ( i = 0; i < file->count; i ++ )
+			mlt_properties_parse( self, file->lines[ i ] );
+		properties_file_release( file );
 	}
 	return file? 0 : errno;
 }
@@ -329,12 +582,96 @@ int mlt_properties_preset( mlt_properties self, const char *name )
  * \return an integer
  */
 
-static inline int generate_hash( const char *name )
+static inline unsigned int generate_hash( const char *name )
 {
 	unsigned int hash = 5381;
 	while ( *name )
 		hash = hash * 33 + (unsigned int) ( *name ++ );
-	return hash % 199;
+	return hash;
+}
+
+/** Add a property's position to the hash index.
+ *
+ * The index must have room for it.
+ * \private \memberof mlt_properties_s
+ * \param list a property list
+ * \param i the position of the property
+ */
+
+static inline void index_insert( property_list *list, int i )
+{
+	int mask = list->index_size - 1;
+	int slot = list->hash[ i ] & mask;
+	while ( list->index[ slot ] )
+		slot = ( slot + 1 ) & mask;
+	list->index[ slot ] = i + 1;
+}
+
+/** Rebuild the hash index, growing it as needed to keep the load below one half.
+ *
+ * \private \memberof mlt_properties_s
+ * \param list a property list
+ * \param count the number of properties the index must accommodate
+ */
+
+static void index_rebuild( property_list *list, int count )
+{
+	int i;
+	if ( list->index_size < count * 2 )
+	{
+		int size = list->index_size ? list->index_size : 16;
+		while ( size < count * 2 )
+			size *= 2;
+		free( list->index );
+		list->index = malloc( size * sizeof( int ) );
+		list->index_size = size;
+	}
+	memset( list->index, 0, list->index_size * sizeof( int ) );
+	for ( i = 0; i < list->count; i ++ )
+		index_insert( list, i );
+}
+
+/** Intern a property name.
+ *
+ * An atom lets a service look up the same property repeatedly without hashing
+ * the name on each call.
+ * \public \memberof mlt_properties_s
+ * \param name a property name
+ * \return the atom for the name; it is never freed
+ */
+
+mlt_atom mlt_atom_intern( const char *name )
+{
+	mlt_atom atom = NULL;
+	if ( name )
+	{
+		unsigned int hash = generate_hash( name );
+		pthread_mutex_lock( &atoms_mutex );
+		for ( atom = atoms[ hash % ATOM_BUCKETS ]; atom; atom = atom->next )
+			if ( atom->hash == hash && !strcmp( atom->name, name ) )
+				break;
+		if ( !atom && ( atom = malloc( sizeof( struct mlt_atom_s ) ) ) )
+		{
+			atom->name = strdup( name );
+			atom->hash = hash;
+			atom->next = atoms[ hash % ATOM_BUCKETS ];
+			atoms[ hash % ATOM_BUCKETS ] = atom;
+		}
+		pthread_mutex_unlock( &atoms_mutex );
+	}
+	return atom;
+}
+
+/** Get the name of an atom.
+ *
+ * \public \memberof mlt_properties_s
+ * \param atom an atom from mlt_atom_intern()
+ * \return the property name
+ */
+
+const char *mlt_atom_name( mlt_atom atom )
+{
+	return atom ? atom->name : NULL;
 }
 
 /** Copy a serializable property to a properties list that is mirroring this one.
@@ -432,6 +769,80 @@ void mlt_properties_mirror( mlt_properties self, mlt_properties that )
 	list->mirror = that;
 }
 
+/** Determine if a name of a parent is hidden by the list or by a newer parent.
+ *
+ * This is called with the parent locked, so it does not look further than
+ * the parents of the list.
+ * \private \memberof mlt_properties_s
+ * \param that a properties list
+ * \param index the index of the parent
+ * \param name the name to look up
+ * \param hash the hash of the name
+ * \return true if the name is found before the parent
+ */
+
+static int parents_hidden( mlt_properties that, int index, const char *name, unsigned int hash )
+{
+	property_list *list = that->local;
+	mlt_property value;
+	int i;
+
+	mlt_properties_lock( that );
+	value = properties_lookup( list, name, hash );
+	mlt_properties_unlock( that );
+	for ( i = index + 1; i < list->parent_count && !value; i ++ )
+	{
+		mlt_properties parent = list->parent[ i ];
+		if ( parent != list->parent[ index ]
+			 && !strncmp( name, list->parent_prefix[ i ], strlen( list->parent_prefix[ i ] ) ) )
+		{
+			mlt_properties_lock( parent );
+			value = properties_lookup( parent->local, name, hash );
+			mlt_properties_unlock( parent );
+		}
+	}
+
+	return value != NULL;
+}
+
+/** Copy the serializable values that a properties list reads through its parents.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self the properties to copy to
+ * \param that the properties whose parents to copy from
+ * \param prefix the property names to match, which is stripped as by mlt_properties_pass()
+ */
+
+static void parents_pass( mlt_properties self, mlt_properties that, const char *prefix )
+{
+	property_list *list = that->local;
+	int length = strlen( prefix );
+	int p, i;
+
+	for ( p = 0; p < list->parent_count; p ++ )
+	{
+		mlt_properties parent = list->parent[ p ];
+		property_list *parent_list = parent->local;
+		int parent_length = strlen( list->parent_prefix[ p ] );
+
+		mlt_properties_lock( parent );
+		for ( i = 0; i < parent_list->count; i ++ )
+		{
+			char *name = parent_list->name[ i ];
+			char *value;
+
+			// Only the values that are not hidden by that or by a newer parent
+			if ( strncmp( name, list->parent_prefix[ p ], parent_length ) || strncmp( name, prefix, length )
+				 || parents_hidden( that, p, name, parent_list->hash[ i ] ) )
+				continue;
+			value = mlt_property_get_string_l( parent_list->value[ i ], parent_list->locale );
+			if ( value != NULL )
+				mlt_properties_set( self, name + length, value );
+		}
+		mlt_properties_unlock( parent );
+	}
+}
+
 /** Copy all serializable properties to another properties list.
  *
  * \public \memberof mlt_properties_s
@@ -459,10 +870,63 @@ int mlt_properties_inherit( mlt_properties self, mlt_properties that )
 	}
 
 	mlt_properties_unlock( that );
+	parents_pass( self, that, "" );
 
 	return 0;
 }
 
+/** Read the properties of another list whose names match a prefix through this one.
+ *
+ * A name that is not found in \p self is looked up in \p parent if it
+ * matches the prefix, which lets a frame have the metadata of its
+ * producer without a copy of each value. Setting a name on \p self sets
+ * its own value, which hides that of the parent. The parents are not
+ * counted, listed or serialised with \p self, but mlt_properties_inherit()
+ * and mlt_properties_pass() copy their values. Parents added later are looked up first.
+ * The parent gets a reference that is released with \p self.
+ * Add the parents before sharing \p self with other threads.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param parent the properties to read through
+ * \param prefix the names to look up in \p parent
+ * \return true if the parent could not be added, and the caller should copy the values
+ */
+
+int mlt_properties_add_parent( mlt_properties self, mlt_properties parent, const char *prefix )
+{
+	if ( !self || !parent || !prefix || self == parent ) return 1;
+	property_list *list = self->local;
+	int error = 0;
+	int added = 0;
+	int i;
+
+	// A parent is only locked before its children, never while one is locked
+	mlt_properties_inc_ref( parent );
+	mlt_properties_lock( self );
+	for ( i = 0; i < list->parent_count; i ++ )
+		if ( list->parent[ i ] == parent && !strcmp( list->parent_prefix[ i ], prefix ) )
+			break;
+	if ( i == list->parent_count )
+	{
+		if ( list->parent_count < MAX_PARENTS )
+		{
+			list->parent[ list->parent_count ] = parent;
+			list->parent_prefix[ list->parent_count ] = strdup( prefix );
+			list->parent_count ++;
+			added = 1;
+		}
+		else
+		{
+			error = 1;
+		}
+	}
+	mlt_properties_unlock( self );
+	if ( !added )
+		mlt_properties_dec_ref( parent );
+
+	return error;
+}
+
 /** Pass all serializable properties that match a prefix to another properties object
  *
  * \warning The prefix is stripped from the name when it is set on the \p self properties list!
@@ -491,56 +955,119 @@ int mlt_properties_pass( mlt_properties self, mlt_properties that, const char *p
 				mlt_properties_set( self, name + length, value );
 		}
 	}
+	parents_pass( self, that, prefix );
 	return 0;
 }
 
-/** Locate a property by name.
+/** Locate a property by name and precomputed hash without locking.
  *
  * \private \memberof mlt_properties_s
- * \param self a properties list
+ * \param list the private list of a locked properties object
  * \param name the property to lookup by name
+ * \param hash the hash of the name
  * \return the property or NULL for failure
  */
 
-static inline mlt_property mlt_properties_find( mlt_properties self, const char *name )
+static inline mlt_property properties_lookup( property_list *list, const char *name, unsigned int hash )
 {
-	if ( !self || !name ) return NULL;
-	property_list *list = self->local;
 	mlt_property value = NULL;
-	int key = generate_hash( name );
 
-	mlt_properties_lock( self );
-
-	int i = list->hash[ key ] - 1;
-	if ( i >= 0 )
+	if ( list->index_size )
 	{
-		// Check if we're hashed
-		if ( list->count > 0 && list->name[ i ] &&
-		 	!strcmp( list->name[ i ], name ) )
-			value = list->value[ i ];
+		int mask = list->index_size - 1;
+		int slot = hash & mask;
+		int i;
 
-		// Locate the item
-		for ( i = list->count - 1; value == NULL && i >= 0; i -- )
-			if ( list->name[ i ] && !strcmp( list->name[ i ], name ) )
+		// Probe until an empty slot
+		while ( ( i = list->index[ slot ] ) )
+		{
+			i --;
+			if ( list->hash[ i ] == hash && list->name[ i ] && !strcmp( list->name[ i ], name ) )
+			{
 				value = list->value[ i ];
+				break;
+			}
+			slot = ( slot + 1 ) & mask;
+		}
 	}
+
+	return value;
+}
+
+/** Locate a property by name and hash in the parents of a properties list.
+ *
+ * The parents are only added while the list is being set up, so they are
+ * read without its lock, and the newest one that has the name wins.
+ * \private \memberof mlt_properties_s
+ * \param list the private list of a properties object
+ * \param name the property to lookup by name
+ * \param hash the hash of the name
+ * \return the property or NULL for failure
+ */
+
+static mlt_property parents_lookup( property_list *list, const char *name, unsigned int hash )
+{
+	mlt_property value = NULL;
+	int i;
+
+	for ( i = list->parent_count - 1; i >= 0 && !value; i -- )
+		if ( !strncmp( name, list->parent_prefix[ i ], strlen( list->parent_prefix[ i ] ) ) )
+			value = properties_find_hashed( list->parent[ i ], name, hash );
+
+	return value;
+}
+
+/** Locate a property by name and hash.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to lookup by name
+ * \param hash the hash of the name
+ * \return the property or NULL for failure
+ */
+
+static mlt_property properties_find_hashed( mlt_properties self, const char *name, unsigned int hash )
+{
+	if ( !self || !name ) return NULL;
+	property_list *list = self->local;
+	mlt_property value;
+
+	mlt_properties_lock( self );
+	value = properties_lookup( list, name, hash );
 	mlt_properties_unlock( self );
 
+	if ( !value && list->parent_count )
+		value = parents_lookup( list, name, hash );
+
 	return value;
 }
 
+/** Locate a property by name.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to lookup by name
+ * \return the property or NULL for failure
+ */
+
+static inline mlt_property mlt_properties_find( mlt_properties self, const char *name )
+{
+	if ( !self || !name ) return NULL;
+	return properties_find_hashed( self, name, generate_hash( name ) );
+}
+
 /** Add a new property.
  *
  * \private \memberof mlt_properties_s
  * \param self a properties list
  * \param name the name of the new property
+ * \param hash the hash of the name
  * \return the new property
  */
 
-static mlt_property mlt_properties_add( mlt_properties self, const char *name )
+static mlt_property properties_add_hashed( mlt_properties self, const char *name, unsigned int hash )
 {
 	property_list *list = self->local;
-	int key = generate_hash( name );
 	mlt_property result;
 
 	mlt_properties_lock( self );
@@ -551,15 +1078,37 @@ static mlt_property mlt_properties_add( mlt_properties self, const char *name )
 		list->size += 50;
 		list->name = realloc( list->name, list->size * sizeof( const char * ) );
 		list->value = realloc( list->value, list->size * sizeof( mlt_property ) );
+		list->hash = realloc( list->hash, list->size * sizeof( unsigned int ) );
 	}
 
-	// Assign name/value pair
-	list->name[ list->count ] = strdup( name );
-	list->value[ list->count ] = mlt_property_init( );
+	// Assign name/value pair, reusing those kept by mlt_properties_reset()
+	if ( list->count < list->reserved )
+	{
+		if ( strcmp( list->name[ list->count ], name ) )
+		{
+			free( list->name[ list->count ] );
+			list->name[ list->count ] = strdup( name );
+		}
+	}
+	else
+	{
+		list->name[ list->count ] = strdup( name );
+		list->value[ list->count ] = mlt_property_init( );
+		list->reserved ++;
+	}
+	list->hash[ list->count ] = hash;
 
 	// Assign to hash table
-	if ( list->hash[ key ] == 0 )
-		list->hash[ key ] = list->count + 1;
+	if ( list->index_size < ( list->count + 1 ) * 2 )
+	{
+		list->count ++;
+		index_rebuild( list, list->count );
+		list->count --;
+	}
+	else
+	{
+		index_insert( list, list->count );
+	}
 
 	// Return and increment count accordingly
 	result = list->value[ list->count ++ ];
@@ -569,27 +1118,43 @@ static mlt_property mlt_properties_add( mlt_properties self, const char *name )
 	return result;
 }
 
-/** Fetch a property by name and add one if not found.
+/** Fetch a property by name and precomputed hash and add one if not found.
  *
  * \private \memberof mlt_properties_s
  * \param self a properties list
  * \param name the property to lookup or add
+ * \param hash the hash of the name
  * \return the property
  */
 
-static mlt_property mlt_properties_fetch( mlt_properties self, const char *name )
+static mlt_property properties_fetch_hashed( mlt_properties self, const char *name, unsigned int hash )
 {
-	// Try to find an existing property first
-	mlt_property property = mlt_properties_find( self, name );
+	// Try to find an existing property first, but never one of a parent
+	mlt_properties_lock( self );
+	mlt_property property = properties_lookup( self->local, name, hash );
+	mlt_properties_unlock( self );
 
 	// If it wasn't found, create one
 	if ( property == NULL )
-		property = mlt_properties_add( self, name );
+		property = properties_add_hashed( self, name, hash );
 
 	// Return the property
 	return property;
 }
 
+/** Fetch a property by name and add one if not found.
+ *
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to lookup or add
+ * \return the property
+ */
+
+static mlt_property mlt_properties_fetch( mlt_properties self, const char *name )
+{
+	return properties_fetch_hashed( self, name, generate_hash( name ) );
+}
+
 /** Copy a property to another properties list.
  *
  * \public \memberof mlt_properties_s
@@ -653,28 +1218,18 @@ int mlt_properties_pass_list( mlt_properties self, mlt_properties that, const ch
 
 /** Set a property to a string.
  *
- * The property name "properties" is reserved to load the preset in \p value.
- * When the value begins with '@' then it is interpreted as a very simple math
- * expression containing only the +, -, *, and / operators.
- * The event "property-changed" is fired after the property has been set.
- *
- * This makes a copy of the string value you supply.
- * \public \memberof mlt_properties_s
+ * \private \memberof mlt_properties_s
  * \param self a properties list
- * \param name the property to set
+ * \param property the property of \p self to set
+ * \param name the name of the property
  * \param value the property's new value
  * \return true if error
  */
 
-int mlt_properties_set( mlt_properties self, const char *name, const char *value )
+static int properties_set( mlt_properties self, mlt_property property, const char *name, const char *value )
 {
 	int error = 1;
 
-	if ( !self || !name ) return error;
-
-	// Fetch the property to work with
-	mlt_property property = mlt_properties_fetch( self, name );
-
 	// Set it if not NULL
 	if ( property == NULL )
 	{
@@ -756,6 +1311,43 @@ int mlt_properties_set( mlt_properties self, const char *name, const char *value
 	return error;
 }
 
+/** Set a property to a string.
+ *
+ * The property name "properties" is reserved to load the preset in \p value.
+ * When the value begins with '@' then it is interpreted as a very simple math
+ * expression containing only the +, -, *, and / operators.
+ * The event "property-changed" is fired after the property has been set.
+ *
+ * This makes a copy of the string value you supply.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to set
+ * \param value the property's new value
+ * \return true if error
+ */
+
+int mlt_properties_set( mlt_properties self, const char *name, const char *value )
+{
+	if ( !self || !name ) return 1;
+	return properties_set( self, mlt_properties_fetch( self, name ), name, value );
+}
+
+/** Set a property to a string using an interned name.
+ *
+ * This behaves like mlt_properties_set() but does not hash the name.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param atom the property to set
+ * \param value the property's new value
+ * \return true if error
+ */
+
+int mlt_properties_set_by_atom( mlt_properties self, mlt_atom atom, const char *value )
+{
+	if ( !self || !atom ) return 1;
+	return properties_set( self, properties_fetch_hashed( self, atom->name, atom->hash ), atom->name, value );
+}
+
 /** Set or default a property to a string.
  *
  * This makes a copy of the string value you supply.
@@ -794,6 +1386,27 @@ char *mlt_properties_get( mlt_properties self, const char *name )
 	return result;
 }
 
+/** Get a string value using an interned name.
+ *
+ * This behaves like mlt_properties_get() but does not hash the name.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param atom the property to get
+ * \return the property's string value or NULL if it does not exist
+ */
+
+char *mlt_properties_get_by_atom( mlt_properties self, mlt_atom atom )
+{
+	char *result = NULL;
+	mlt_property value = atom ? properties_find_hashed( self, atom->name, atom->hash ) : NULL;
+	if ( value )
+	{
+		property_list *list = self->local;
+		result = mlt_property_get_string_l( value, list->locale );
+	}
+	return result;
+}
+
 /** Get a property name by index.
  *
  * Do not free the returned string.
@@ -1139,6 +1752,21 @@ void *mlt_properties_get_data( mlt_properties self, const char *name, int *lengt
 	return value == NULL ? NULL : mlt_property_get_data( value, length );
 }
 
+/** Get the destructor of a binary data value.
+ *
+ * This is private to the framework, see mlt_frame_share_data().
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to get
+ * \return the destructor or NULL
+ */
+
+mlt_destructor mlt_properties_get_destructor( mlt_properties self, const char *name )
+{
+	mlt_property value = mlt_properties_find( self, name );
+	return value == NULL ? NULL : mlt_property_get_destructor( value );
+}
+
 /** Store binary data as a property.
  *
  * \public \memberof mlt_properties_s
@@ -1180,7 +1808,9 @@ int mlt_properties_set_data( mlt_properties self, const char *name, void *value,
 
 int mlt_properties_rename( mlt_properties self, const char *source, const char *dest )
 {
-	mlt_property value = mlt_properties_find( self, dest );
+	mlt_properties_lock( self );
+	mlt_property value = properties_lookup( self->local, dest, generate_hash( dest ) );
+	mlt_properties_unlock( self );
 
 	if ( value == NULL )
 	{
@@ -1195,7 +1825,8 @@ int mlt_properties_rename( mlt_properties self, const char *source, const char *
 			{
 				free( list->name[ i ] );
 				list->name[ i ] = strdup( dest );
-				list->hash[ generate_hash( dest ) ] = i + 1;
+				list->hash[ i ] = generate_hash( dest );
+				index_rebuild( list, list->count );
 				break;
 			}
 		}
@@ -1413,7 +2044,7 @@ void mlt_properties_close( mlt_properties self )
 #endif
 
 			// Clean up names and values
-			for ( index = list->count - 1; index >= 0; index -- )
+			for ( index = list->reserved - 1; index >= 0; index -- )
 			{
 				mlt_property_close( list->value[ index ] );
 				free( list->name[ index ] );
@@ -1429,9 +2060,12 @@ void mlt_properties_close( mlt_properties self )
 #endif
 
 			// Clear up the list
+			parents_release( list );
 			pthread_mutex_destroy( &list->mutex );
 			free( list->name );
 			free( list->value );
+			free( list->hash );
+			free( list->index );
 			free( list );
 
 			// Free self now if self has no child
@@ -2220,28 +2854,22 @@ mlt_position mlt_properties_time_to_frames( mlt_properties self, const char *tim
 	return mlt_properties_get_position( self, name );
 }
 
-/** Convert a numeric property to a tuple of color components.
+/** Convert a property to a tuple of color components.
  *
- * If the property's string is red, green, blue, white, or black, then it
- * is converted to the corresponding opaque color tuple. Otherwise, the property
- * is fetched as an integer and then converted.
- * \public \memberof mlt_properties_s
- * \param self a properties list
- * \param name the property to get
- * \return a color structure
+ * \private \memberof mlt_properties_s
+ * \param value the property or NULL
+ * \param fps the frame rate for time values
+ * \param locale the numeric locale
+ * \return a color structure, opaque white if \p value is NULL
  */
 
-mlt_color mlt_properties_get_color( mlt_properties self, const char* name )
+static mlt_color property_get_color( mlt_property value, double fps, locale_t locale )
 {
-	mlt_profile profile = mlt_properties_get_data( self, "_profile", NULL );
-	double fps = mlt_profile_fps( profile );
-	property_list *list = self->local;
-	mlt_property value = mlt_properties_find( self, name );
 	mlt_color result = { 0xff, 0xff, 0xff, 0xff };
 	if ( value )
 	{
-		const char *color = mlt_property_get_string_l( value, list->locale );
-		unsigned int color_int = mlt_property_get_int( value, fps, list->locale );
+		const char *color = mlt_property_get_string_l( value, locale );
+		unsigned int color_int = mlt_property_get_int( value, fps, locale );
 
 		if ( !strcmp( color, "red" ) )
 		{
@@ -2278,6 +2906,26 @@ mlt_color mlt_properties_get_color( mlt_properties self, const char* name )
 	return result;
 }
 
+/** Convert a numeric property to a tuple of color components.
+ *
+ * If the property's string is red, green, blue, white, or black, then it
+ * is converted to the corresponding opaque color tuple. Otherwise, the property
+ * is fetched as an integer and then converted.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the property to get
+ * \return a color structure
+ */
+
+mlt_color mlt_properties_get_color( mlt_properties self, const char* name )
+{
+	mlt_profile profile = mlt_properties_get_data( self, "_profile", NULL );
+	double fps = mlt_profile_fps( profile );
+	property_list *list = self->local;
+	mlt_property value = mlt_properties_find( self, name );
+	return property_get_color( value, fps, list->locale );
+}
+
 /** Set a property to an integer value by color.
  *
  * \public \memberof mlt_properties_s
@@ -2606,6 +3254,127 @@ extern mlt_rect mlt_properties_anim_get_rect( mlt_properties self, const char *n
 	return value == NULL ? rect : mlt_property_anim_get_rect( value, fps, list->locale, position, length );
 }
 
+// Get a value of mlt_properties_get_many() from its property.
+static void value_get( mlt_value *v, mlt_property value, double fps, locale_t locale, int position, int length )
+{
+	v->found = value != NULL;
+	memset( &v->value, 0, sizeof( v->value ) );
+	switch ( v->type )
+	{
+	case mlt_value_string:
+		if ( value )
+			v->value.s = mlt_property_anim_get_string( value, fps, locale, position, length );
+		break;
+	case mlt_value_int:
+		if ( value )
+			v->value.i = mlt_property_anim_get_int( value, fps, locale, position, length );
+		break;
+	case mlt_value_int64:
+		if ( value )
+			v->value.i64 = mlt_property_get_int64( value );
+		break;
+	case mlt_value_double:
+		if ( value )
+			v->value.d = mlt_property_anim_get_double( value, fps, locale, position, length );
+		break;
+	case mlt_value_position:
+		if ( value )
+			v->value.position = mlt_property_get_position( value, fps, locale );
+		break;
+	case mlt_value_rect:
+		if ( value )
+		{
+			v->value.rect = mlt_property_anim_get_rect( value, fps, locale, position, length );
+		}
+		else
+		{
+			mlt_rect rect = { DBL_MIN, DBL_MIN, DBL_MIN, DBL_MIN, DBL_MIN };
+			v->value.rect = rect;
+		}
+		break;
+	case mlt_value_color:
+		v->value.color = property_get_color( value, fps, locale );
+		break;
+	case mlt_value_data:
+		if ( value )
+			v->value.data = mlt_property_get_data( value, NULL );
+		break;
+	}
+}
+
+/** Get several values with one lock.
+ *
+ * This looks up each name of \p values by its interned hash while the
+ * properties are locked once, and converts the value to the requested type,
+ * which is cheaper than a getter per property when a service reads many of
+ * them for every frame. The integer, real number, rectangle and string types
+ * are evaluated at \p position when they are animated. When a property
+ * does not exist, its \p found is cleared and its value is what the single
+ * getter returns for that type. The strings and data returned belong to the
+ * properties and are only valid until they change.
+ *
+ * Intern the names once, for example when the service is created:
+ *
+ *     mlt_value values[] = {
+ *         { mlt_atom_intern( "radius" ), mlt_value_double },
+ *         { mlt_atom_intern( "rect" ), mlt_value_rect },
+ *     };
+ *     mlt_properties_get_many( properties, values, 2, position, length );
+ *
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ * \param values the names and types to get, and the values on return
+ * \param count the number of elements in \p values
+ * \param position the frame number for animated values
+ * \param length the maximum number of frames when interpreting negative keyframe times,
+ *  <=0 if you don't care or need that
+ * \return the number of properties found
+ */
+
+int mlt_properties_get_many( mlt_properties self, mlt_value *values, int count, int position, int length )
+{
+	static mlt_atom profile_atom = NULL;
+	int found = 0;
+	int i;
+
+	if ( !self || !values ) return 0;
+	if ( !profile_atom )
+		profile_atom = mlt_atom_intern( "_profile" );
+
+	property_list *list = self->local;
+	locale_t locale = list->locale;
+
+	mlt_properties_lock( self );
+
+	mlt_property profile_value = properties_lookup( list, profile_atom->name, profile_atom->hash );
+	double fps = mlt_profile_fps( profile_value ? mlt_property_get_data( profile_value, NULL ) : NULL );
+
+	for ( i = 0; i < count; i ++ )
+	{
+		mlt_value *v = &values[ i ];
+		mlt_property value = v->name ? properties_lookup( list, v->name->name, v->name->hash ) : NULL;
+
+		value_get( v, value, fps, locale, position, length );
+		found += v->found;
+	}
+
+	mlt_properties_unlock( self );
+
+	// The parents are looked up without the lock, as in properties_find_hashed()
+	for ( i = 0; i < count && list->parent_count; i ++ )
+	{
+		mlt_value *v = &values[ i ];
+		mlt_property value = v->found || !v->name ? NULL : parents_lookup( list, v->name->name, v->name->hash );
+		if ( value )
+		{
+			value_get( v, value, fps, locale, position, length );
+			found ++;
+		}
+	}
+
+	return found;
+}
+
 #ifndef _WIN32
 
 // See win32/win32.c for win32 implementation.
@@ -54,13 +54,16 @@ extern int mlt_properties_dec_ref( mlt_properties self );
 extern int mlt_properties_ref_count( mlt_properties self );
 extern void mlt_properties_mirror( mlt_properties self, mlt_properties that );
 extern int mlt_properties_inherit( mlt_properties self, mlt_properties that );
+extern int mlt_properties_add_parent( mlt_properties self, mlt_properties parent, const char *prefix );
 extern int mlt_properties_pass( mlt_properties self, mlt_properties that, const char *prefix );
 extern void mlt_properties_pass_property( mlt_properties self, mlt_properties that, const char *name );
 extern int mlt_properties_pass_list( mlt_properties self, mlt_properties that, const char *list );
 extern int mlt_properties_set( mlt_properties self, const char *name, const char *value );
+extern int mlt_properties_set_by_atom( mlt_properties self, mlt_atom atom, const char *value );
 extern int mlt_properties_set_or_default( mlt_properties self, const char *name, const char *value, const char *def );
 extern int mlt_properties_parse( mlt_properties self, const char *namevalue );
 extern char *mlt_properties_get( mlt_properties self, const char *name );
+extern char *mlt_properties_get_by_atom( mlt_properties self, mlt_atom atom );
 extern char *mlt_properties_get_name( mlt_properties self, int index );
 extern char *mlt_properties_get_value_tf( mlt_properties self, int index, mlt_time_format );
 extern char *mlt_properties_get_value( mlt_properties self, int index );
@@ -108,7 +111,11 @@ extern int mlt_properties_set_rect( mlt_properties self, const char *name, mlt_r
 extern mlt_rect mlt_properties_get_rect( mlt_properties self, const char *name );
 extern int mlt_properties_anim_set_rect( mlt_properties self, const char *name, mlt_rect value, int position, int length, mlt_keyframe_type keyframe_type );
 extern mlt_rect mlt_properties_anim_get_rect( mlt_properties self, const char *name, int position, int length );
+extern int mlt_properties_get_many( mlt_properties self, mlt_value *values, int count, int position, int length );
 
 extern int mlt_properties_from_utf8( mlt_properties properties, const char *name_from, const char *name_to );
 extern int mlt_properties_to_utf8( mlt_properties properties, const char *name_from, const char *name_to );
+extern mlt_atom mlt_atom_intern( const char *name );
+extern const char *mlt_atom_name( mlt_atom atom );
+
 #endif
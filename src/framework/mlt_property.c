@@ -53,6 +53,26 @@ typedef enum
 }
 mlt_property_type;
 
+/** The string conversions that are cached. */
+
+enum
+{
+	cache_int = 0,   //!< mlt_property_atoi()
+	cache_double,    //!< mlt_property_atof()
+	cache_count
+};
+
+/** A parsed value of the string and the arguments it was parsed with. */
+
+typedef struct
+{
+	int valid;
+	double fps;
+	locale_t locale;
+	double value;
+}
+property_cache;
+
 /** \brief Property class
  *
  * A property is like a variant or dynamic type. They are used for many things
@@ -81,6 +101,11 @@ struct mlt_property_s
 
 	pthread_mutex_t mutex;
 	mlt_animation animation;
+
+	/// Parsed values of the string, guarded by a sequence count that is odd
+	/// while they change so readers need no lock
+	unsigned int cache_seq;
+	property_cache cache[ cache_count ];
 };
 
 /** Construct a property and initialize it
@@ -95,6 +120,81 @@ mlt_property mlt_property_init( )
 	return self;
 }
 
+/** Look up a parsed value of the string.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param which the conversion
+ * \param fps frames per second
+ * \param locale the locale
+ * \param[out] value the cached value
+ * \param[out] seq the sequence count to pass to cache_store() on a miss
+ * \return true if the value was cached
+ */
+
+static inline int cache_lookup( mlt_property self, int which, double fps, locale_t locale, double *value, unsigned int *seq )
+{
+	property_cache *cache = &self->cache[ which ];
+	int hit;
+
+	*seq = __atomic_load_n( &self->cache_seq, __ATOMIC_ACQUIRE );
+	hit = !( *seq & 1 ) && cache->valid && cache->fps == fps && cache->locale == locale;
+	*value = cache->value;
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	return hit && __atomic_load_n( &self->cache_seq, __ATOMIC_RELAXED ) == *seq;
+}
+
+// Begin or end a change of the cache; the caller holds the mutex.
+static inline void cache_bump( mlt_property self )
+{
+	__atomic_store_n( &self->cache_seq, self->cache_seq + 1, __ATOMIC_RELEASE );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+/** Store a parsed value of the string.
+ *
+ * Nothing is stored if the string changed since \p seq was read.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param which the conversion
+ * \param fps frames per second
+ * \param locale the locale
+ * \param value the parsed value
+ * \param seq the sequence count from cache_lookup()
+ */
+
+static void cache_store( mlt_property self, int which, double fps, locale_t locale, double value, unsigned int seq )
+{
+	pthread_mutex_lock( &self->mutex );
+	if ( self->cache_seq == seq && !( seq & 1 ) )
+	{
+		property_cache *cache = &self->cache[ which ];
+		cache_bump( self );
+		cache->valid = 1;
+		cache->fps = fps;
+		cache->locale = locale;
+		cache->value = value;
+		cache_bump( self );
+	}
+	pthread_mutex_unlock( &self->mutex );
+}
+
+/** Forget the parsed values of the string.
+ *
+ * The caller holds the mutex.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ */
+
+static void cache_clear( mlt_property self )
+{
+	int i;
+	cache_bump( self );
+	for ( i = 0; i < cache_count; i++ )
+		self->cache[ i ].valid = 0;
+	cache_bump( self );
+}
+
 /** Clear (0/null) a property.
  *
  * Frees up any associated resources in the process.
@@ -113,6 +213,7 @@ static void clear_property( mlt_property self )
 		free( self->prop_string );
 
 	mlt_animation_close( self->animation );
+	cache_clear( self );
 
 	// Wipe stuff
 	self->types = 0;
@@ -220,6 +321,7 @@ int mlt_property_set_string( mlt_property self, const char *value )
 	else
 	{
 		self->types = mlt_prop_string;
+		cache_clear( self );
 	}
 	pthread_mutex_unlock( &self->mutex );
 	return self->prop_string == NULL;
@@ -448,6 +550,19 @@ static int mlt_property_atoi( mlt_property self, double fps, locale_t locale )
 	}
 }
 
+// Convert the string to an integer through the cache.
+static int string_to_int( mlt_property self, double fps, locale_t locale )
+{
+	double value;
+	unsigned int seq;
+	if ( !cache_lookup( self, cache_int, fps, locale, &value, &seq ) )
+	{
+		value = mlt_property_atoi( self, fps, locale );
+		cache_store( self, cache_int, fps, locale, value, seq );
+	}
+	return ( int )value;
+}
+
 /** Get the property as an integer.
  *
  * \public \memberof mlt_property_s
@@ -470,7 +585,7 @@ int mlt_property_get_int( mlt_property self, double fps, locale_t locale )
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( int ) ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return mlt_property_atoi( self, fps, locale );
+		return string_to_int( self, fps, locale );
 	return 0;
 }
 
@@ -538,6 +653,19 @@ static double mlt_property_atof( mlt_property self, double fps, locale_t locale
 	}
 }
 
+// Convert the string to a floating point through the cache.
+static double string_to_double( mlt_property self, double fps, locale_t locale )
+{
+	double value;
+	unsigned int seq;
+	if ( !cache_lookup( self, cache_double, fps, locale, &value, &seq ) )
+	{
+		value = mlt_property_atof( self, fps, locale );
+		cache_store( self, cache_double, fps, locale, value, seq );
+	}
+	return value;
+}
+
 /** Get the property as a floating point.
  *
  * \public \memberof mlt_property_s
@@ -560,7 +688,7 @@ double mlt_property_get_double( mlt_property self, double fps, locale_t locale )
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return mlt_property_atof( self, fps, locale );
+		return string_to_double( self, fps, locale );
 	return 0;
 }
 
@@ -587,7 +715,7 @@ mlt_position mlt_property_get_position( mlt_property self, double fps, locale_t
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( mlt_position ) ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return ( mlt_position )mlt_property_atoi( self, fps, locale );
+		return ( mlt_position )string_to_int( self, fps, locale );
 	return 0;
 }
 
@@ -843,6 +971,20 @@ void *mlt_property_get_data( mlt_property self, int *length )
 	return self->data;
 }
 
+/** Get the destructor of the binary data.
+ *
+ * This is private to the framework; it lets a frame tell a buffer from
+ * mlt_pool apart so that it can share it.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \return the destructor or NULL
+ */
+
+mlt_destructor mlt_property_get_destructor( mlt_property self )
+{
+	return ( self->types & mlt_prop_data ) ? self->destructor : NULL;
+}
+
 /** Destroy a property and free all related resources.
  *
  * \public \memberof mlt_property_s
@@ -1383,6 +1525,7 @@ char* mlt_property_anim_get_string( mlt_property self, double fps, locale_t loca
 		if ( self->prop_string )
 			self->prop_string = strdup( self->prop_string );
 		self->types |= mlt_prop_string;
+		cache_clear( self );
 
 		result = self->prop_string;
 		mlt_property_close( item.property );
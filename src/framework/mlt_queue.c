@@ -0,0 +1,218 @@
+/**
+ * \file mlt_queue.c
+ * \brief bounded multiple producer, multiple consumer queue
+ * \see mlt_queue_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Local header files
+#include "mlt_queue.h"
+
+// System header files
+#include <stdlib.h>
+
+/** \brief Queue cell class
+ *
+ * The sequence of a cell tells whose turn it is: it equals the position of
+ * the next push into the cell when it is free and that position plus one
+ * when it holds an item.
+ */
+
+typedef struct
+{
+	unsigned long sequence;
+	void *item;
+}
+queue_cell;
+
+/** \brief Bounded Queue class
+ *
+ * A first in, first out queue of a fixed size that any number of threads
+ * can push to and pop from at once without a lock. It does not block; a
+ * push fails when the queue is full and a pop when it is empty, so callers
+ * that need to wait pair it with a condition of their own.
+ */
+
+struct mlt_queue_s
+{
+	queue_cell *cells;
+	unsigned long mask;
+	// Keep the ends on their own cache lines.
+	char pad0[64];
+	unsigned long tail;
+	char pad1[64];
+	unsigned long head;
+	char pad2[64];
+};
+
+/** Create a queue.
+ *
+ * \public \memberof mlt_queue_s
+ * \param size the least number of items it can hold, which is rounded up to a power of two
+ * \return a new queue or NULL on error
+ */
+
+mlt_queue mlt_queue_init( int size )
+{
+	mlt_queue self = calloc( 1, sizeof( struct mlt_queue_s ) );
+	unsigned long n = 2;
+	unsigned long i;
+
+	while ( size > 0 && n < (unsigned long) size )
+		n *= 2;
+	if ( self && ( self->cells = malloc( n * sizeof( queue_cell ) ) ) )
+	{
+		self->mask = n - 1;
+		for ( i = 0; i < n; i++ )
+			self->cells[ i ].sequence = i;
+	}
+	else
+	{
+		free( self );
+		self = NULL;
+	}
+	return self;
+}
+
+/** Get the number of items the queue can hold.
+ *
+ * \public \memberof mlt_queue_s
+ * \param self a queue
+ * \return the size
+ */
+
+int mlt_queue_size( mlt_queue self )
+{
+	return self ? self->mask + 1 : 0;
+}
+
+/** Get the number of items in the queue.
+ *
+ * This is only a snapshot while other threads use the queue.
+ *
+ * \public \memberof mlt_queue_s
+ * \param self a queue
+ * \return the number of items
+ */
+
+int mlt_queue_count( mlt_queue self )
+{
+	if ( self )
+	{
+		unsigned long head = __atomic_load_n( &self->head, __ATOMIC_ACQUIRE );
+		unsigned long tail = __atomic_load_n( &self->tail, __ATOMIC_ACQUIRE );
+		return tail > head ? tail - head : 0;
+	}
+	return 0;
+}
+
+/** Push an item to the end.
+ *
+ * \public \memberof mlt_queue_s
+ * \param self a queue
+ * \param item an opaque pointer
+ * \return true if the queue is full
+ */
+
+int mlt_queue_push( mlt_queue self, void *item )
+{
+	unsigned long position = __atomic_load_n( &self->tail, __ATOMIC_RELAXED );
+
+	while ( 1 )
+	{
+		queue_cell *cell = &self->cells[ position & self->mask ];
+		unsigned long sequence = __atomic_load_n( &cell->sequence, __ATOMIC_ACQUIRE );
+		long difference = (long) sequence - (long) position;
+
+		if ( difference == 0 )
+		{
+			// The cell is free; claim it by moving the tail.
+			if ( __atomic_compare_exchange_n( &self->tail, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				cell->item = item;
+				__atomic_store_n( &cell->sequence, position + 1, __ATOMIC_RELEASE );
+				return 0;
+			}
+		}
+		else if ( difference < 0 )
+		{
+			// The cell still holds the item pushed one lap ago.
+			return 1;
+		}
+		else
+		{
+			position = __atomic_load_n( &self->tail, __ATOMIC_RELAXED );
+		}
+	}
+}
+
+/** Remove an item from the start.
+ *
+ * \public \memberof mlt_queue_s
+ * \param self a queue
+ * \return an opaque pointer or NULL if the queue is empty
+ */
+
+void *mlt_queue_pop( mlt_queue self )
+{
+	unsigned long position = __atomic_load_n( &self->head, __ATOMIC_RELAXED );
+
+	while ( 1 )
+	{
+		queue_cell *cell = &self->cells[ position & self->mask ];
+		unsigned long sequence = __atomic_load_n( &cell->sequence, __ATOMIC_ACQUIRE );
+		long difference = (long) sequence - (long) ( position + 1 );
+
+		if ( difference == 0 )
+		{
+			// The cell is full; claim it by moving the head.
+			if ( __atomic_compare_exchange_n( &self->head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				void *item = cell->item;
+				__atomic_store_n( &cell->sequence, position + self->mask + 1, __ATOMIC_RELEASE );
+				return item;
+			}
+		}
+		else if ( difference < 0 )
+		{
+			// The push into the cell has not finished.
+			return NULL;
+		}
+		else
+		{
+			position = __atomic_load_n( &self->head, __ATOMIC_RELAXED );
+		}
+	}
+}
+
+/** Destroy the queue.
+ *
+ * The items still in it are not released.
+ *
+ * \public \memberof mlt_queue_s
+ * \param self a queue
+ */
+
+void mlt_queue_close( mlt_queue self )
+{
+	if ( self )
+	{
+		free( self->cells );
+		free( self );
+	}
+}
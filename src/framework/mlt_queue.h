@@ -0,0 +1,35 @@
+/**
+ * \file mlt_queue.h
+ * \brief bounded multiple producer, multiple consumer queue
+ * \see mlt_queue_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_QUEUE_H
+#define MLT_QUEUE_H
+
+#include "mlt_types.h"
+
+extern mlt_queue mlt_queue_init( int size );
+extern int mlt_queue_size( mlt_queue self );
+extern int mlt_queue_count( mlt_queue self );
+extern int mlt_queue_push( mlt_queue self, void *item );
+extern void *mlt_queue_pop( mlt_queue self );
+extern void mlt_queue_close( mlt_queue self );
+
+#endif
@@ -32,12 +32,22 @@
 #include <string.h>
 #include <limits.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
+#define INDEX_HEADER "MLT repository index 1"
+
 /** \brief Repository class
  *
  * The Repository is a collection of plugin modules and their services and service metadata.
  *
+ * When the environment variable MLT_REPOSITORY_INDEX names a file, the
+ * services of each module are read from that index instead, and a module is
+ * opened only when one of its services is first used. The index is written
+ * whenever it does not match the modules in the directory. It does not notice
+ * services that modules find at run time, such as newly installed frei0r or
+ * LADSPA plugins, so it should be removed when those change.
+ *
  * \extends mlt_properties_s
  * \properties \p language a cached list of user locales
  */
@@ -49,8 +59,232 @@ struct mlt_repository_s
 	mlt_properties filters;         /// a list of entry points for filters
 	mlt_properties producers;       /// a list of entry points for producers
 	mlt_properties transitions;     /// a list of entry points for transitions
+	char *directory;                /// the directory of the modules
+	char *index;                    /// the index file when modules are opened on demand
+	const char *loading;            /// the object file being registered
+	pthread_mutex_t mutex;          /// serialises opening modules on demand
 };
 
+static mlt_properties get_service_properties( mlt_repository self, mlt_service_type type, const char *service );
+
+/** Open a module and let it register its services.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param object_name the full path of a shared object
+ * \return true if it is a module
+ */
+
+static int load_module( mlt_repository self, const char *object_name )
+{
+	int flags = RTLD_NOW;
+
+	// Very temporary hack to allow the quicktime plugins to work
+	// TODO: extend repository to allow this to be used on a case by case basis
+	if ( strstr( object_name, "libmltkino" ) )
+		flags |= RTLD_GLOBAL;
+
+	// Open the shared object
+	void *object = dlopen( object_name, flags );
+	if ( object != NULL )
+	{
+		// Get the registration function
+		mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
+
+		// Call the registration function
+		if ( symbol_ptr != NULL )
+		{
+			self->loading = object_name;
+			symbol_ptr( self );
+			self->loading = NULL;
+
+			// Register the object file for closure
+			mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
+			return 1;
+		}
+		else
+		{
+			dlclose( object );
+		}
+	}
+	else if ( strstr( object_name, "libmlt" ) )
+	{
+		mlt_log_warning( NULL, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
+	}
+	return 0;
+}
+
+/** Get the regular files of the module directory with their size and modification time.
+ *
+ * \private \memberof mlt_repository_s
+ * \param directory the directory of the modules
+ * \return a properties list of "size mtime" keyed by the full path
+ */
+
+static mlt_properties list_modules( const char *directory )
+{
+	mlt_properties files = mlt_properties_new();
+	mlt_properties dir = mlt_properties_new();
+	int count = mlt_properties_dir_list( dir, directory, NULL, 0 );
+	int i;
+
+	for ( i = 0; i < count; i++ )
+	{
+		const char *object_name = mlt_properties_get_value( dir, i );
+		struct stat info;
+		if ( !stat( object_name, &info ) && S_ISREG( info.st_mode ) )
+		{
+			char stamp[ 64 ];
+			snprintf( stamp, sizeof( stamp ), "%lld %lld", ( long long )info.st_size, ( long long )info.st_mtime );
+			mlt_properties_set( files, object_name, stamp );
+		}
+	}
+	mlt_properties_close( dir );
+	return files;
+}
+
+/** Register the services of the modules from the index without opening them.
+ *
+ * The index has a line "M size mtime path" for each module, followed by a
+ * line "type name" for each of its services, and a line "N size mtime path"
+ * for each other file of the directory.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param files the current files of the module directory from list_modules()
+ * \return true if the index is missing or does not match the files
+ */
+
+static int read_index( mlt_repository self, mlt_properties files )
+{
+	FILE *file = fopen( self->index, "r" );
+	char line[ PATH_MAX + 64 ];
+	char module[ PATH_MAX + 64 ] = "";
+	int pass, count = 0;
+	int error = file == NULL;
+
+	if ( !error )
+		error = !fgets( line, sizeof( line ), file ) || strcmp( line, INDEX_HEADER "\n" );
+
+	// Check the files first, and register the services only if they all match
+	for ( pass = 0; !error && pass < 2; pass++ )
+	{
+		while ( !error && fgets( line, sizeof( line ), file ) )
+		{
+			char *end = strchr( line, '\n' );
+			if ( end )
+				*end = '\0';
+			if ( ( line[0] == 'M' || line[0] == 'N' ) && line[1] == ' ' )
+			{
+				char *path = strchr( line + 2, ' ' );
+				path = path ? strchr( path + 1, ' ' ) : NULL;
+				if ( path )
+					*path ++ = '\0';
+				if ( pass == 0 )
+					error = !path || !mlt_properties_get( files, path ) || strcmp( line + 2, mlt_properties_get( files, path ) );
+				count += pass == 0;
+				strcpy( module, line[0] == 'M' && path ? path : "" );
+			}
+			else if ( pass == 1 && module[0] && line[0] >= '0' && line[0] <= '9' && line[1] == ' '
+					  && !get_service_properties( self, line[0] - '0', line + 2 ) )
+			{
+				self->loading = module;
+				mlt_repository_register( self, line[0] - '0', line + 2, NULL );
+				self->loading = NULL;
+			}
+		}
+		if ( pass == 0 )
+		{
+			// The index must know every file of the directory
+			error = count != mlt_properties_count( files );
+			rewind( file );
+			error = error || !fgets( line, sizeof( line ), file );
+		}
+	}
+	if ( file )
+		fclose( file );
+	return error;
+}
+
+/** Write the services of all modules to the index.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository whose modules are all open
+ */
+
+static void write_index( mlt_repository self )
+{
+	mlt_properties files = list_modules( self->directory );
+	mlt_properties lists[ 4 ] = { self->consumers, self->filters, self->producers, self->transitions };
+	mlt_service_type types[ 4 ] = { consumer_type, filter_type, producer_type, transition_type };
+	char *temp = malloc( strlen( self->index ) + 16 );
+	FILE *file = NULL;
+	int error = 1;
+	int i, j, k;
+
+	// Write to a temporary file and rename it so readers never see a partial index
+	if ( temp )
+	{
+		sprintf( temp, "%s.%d", self->index, rand() % 100000 );
+		file = fopen( temp, "w" );
+	}
+	if ( file )
+	{
+		error = fprintf( file, "%s\n", INDEX_HEADER ) < 0;
+		for ( i = 0; !error && i < mlt_properties_count( files ); i++ )
+		{
+			const char *object_name = mlt_properties_get_name( files, i );
+			int is_module = mlt_properties_get_data( &self->parent, object_name, NULL ) != NULL;
+			error = fprintf( file, "%c %s %s\n", is_module ? 'M' : 'N', mlt_properties_get_value( files, i ), object_name ) < 0;
+			for ( j = 0; is_module && j < 4; j++ )
+			{
+				for ( k = 0; !error && k < mlt_properties_count( lists[ j ] ); k++ )
+				{
+					mlt_properties service = mlt_properties_get_data_at( lists[ j ], k, NULL );
+					const char *module = mlt_properties_get( service, "module" );
+					if ( module && !strcmp( module, object_name ) )
+						error = fprintf( file, "%d %s\n", types[ j ], mlt_properties_get_name( lists[ j ], k ) ) < 0;
+				}
+			}
+		}
+		error = fclose( file ) || error;
+		if ( !error )
+			error = rename( temp, self->index );
+		if ( error )
+			remove( temp );
+	}
+	if ( error )
+		mlt_log_warning( NULL, "%s: failed to write %s\n", __FUNCTION__, self->index );
+	free( temp );
+	mlt_properties_close( files );
+}
+
+/** Open all of the modules that are not open yet.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \return the number of modules
+ */
+
+static int load_modules( mlt_repository self )
+{
+	mlt_properties files = list_modules( self->directory );
+	int count = mlt_properties_count( files );
+	int i;
+	int plugin_count = 0;
+
+	for ( i = 0; i < count; i++ )
+	{
+		const char *object_name = mlt_properties_get_name( files, i );
+		if ( mlt_properties_get_data( &self->parent, object_name, NULL ) )
+			++plugin_count;
+		else
+			plugin_count += load_module( self, object_name );
+	}
+	mlt_properties_close( files );
+	return plugin_count;
+}
+
 /** Construct a new repository.
  *
  * \public \memberof mlt_repository_s
@@ -72,11 +306,8 @@ mlt_repository mlt_repository_init( const char *directory )
 	self->producers = mlt_properties_new();
 	self->transitions = mlt_properties_new();
 
-	// Get the directory list
-	mlt_properties dir = mlt_properties_new();
-	int count = mlt_properties_dir_list( dir, directory, NULL, 0 );
-	int i;
-	int plugin_count = 0;
+	self->directory = strdup( directory );
+	pthread_mutex_init( &self->mutex, NULL );
 
 #ifdef _WIN32
 	char *syspath = getenv("PATH");
@@ -96,48 +327,24 @@ mlt_repository mlt_repository_init( const char *directory )
 	free(newpath);
 #endif
 
-	// Iterate over files
-	for ( i = 0; i < count; i++ )
+	// Use the index of the services if there is one for these modules
+	if ( getenv( "MLT_REPOSITORY_INDEX" ) && strcmp( getenv( "MLT_REPOSITORY_INDEX" ), "" ) )
 	{
-		int flags = RTLD_NOW;
-		const char *object_name = mlt_properties_get_value( dir, i);
-
-		// Very temporary hack to allow the quicktime plugins to work
-		// TODO: extend repository to allow this to be used on a case by case basis
-		if ( strstr( object_name, "libmltkino" ) )
-			flags |= RTLD_GLOBAL;
-	
-		// Open the shared object
-		void *object = dlopen( object_name, flags );
-		if ( object != NULL )
-		{
-			// Get the registration function
-			mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
-
-			// Call the registration function
-			if ( symbol_ptr != NULL )
-			{
-				symbol_ptr( self );
-
-				// Register the object file for closure
-				mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
-				++plugin_count;
-			}
-			else
-			{
-				dlclose( object );
-			}
-		}
-		else if ( strstr( object_name, "libmlt" ) )
+		mlt_properties files = list_modules( directory );
+		self->index = strdup( getenv( "MLT_REPOSITORY_INDEX" ) );
+		if ( !read_index( self, files ) )
 		{
-			mlt_log_warning( NULL, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
+			mlt_properties_close( files );
+			return self;
 		}
+		mlt_properties_close( files );
 	}
 
-	if ( !plugin_count )
+	// Otherwise open every module
+	if ( !load_modules( self ) )
 		mlt_log_error( NULL, "%s: no plugins found in \"%s\"\n", __FUNCTION__, directory );
-
-	mlt_properties_close( dir );
+	else if ( self->index )
+		write_index( self );
 
 	return self;
 }
@@ -156,6 +363,60 @@ static mlt_properties new_service( void *symbol )
 	return properties;
 }
 
+/** Add a service to the list of its class.
+ *
+ * A service read from the index keeps its properties list when its module
+ * registers it, since another thread may already hold it, and it belongs to
+ * the module the index names even if another module registers the same name.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param list the services of a class
+ * \param service the name of a service
+ * \param symbol a pointer to a function to create the service, NULL when read from the index
+ */
+
+static void register_service( mlt_repository self, mlt_properties list, const char *service, void *symbol )
+{
+	mlt_properties properties = mlt_properties_get_data( list, service, NULL );
+
+	if ( properties && mlt_properties_get_int( properties, "indexed" ) )
+	{
+		const char *module = mlt_properties_get( properties, "module" );
+		if ( symbol && self->loading && module && !strcmp( module, self->loading ) )
+			mlt_properties_set_data( properties, "symbol", symbol, 0, NULL, NULL );
+		return;
+	}
+	properties = new_service( symbol );
+	mlt_properties_set( properties, "module", self->loading );
+	mlt_properties_set_int( properties, "indexed", symbol == NULL );
+	mlt_properties_set_data( list, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
+}
+
+/** Open the module of a service read from the index.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param type a service class
+ * \param service the name of a service
+ * \return the properties of the service or NULL if there is none
+ */
+
+static mlt_properties load_service( mlt_repository self, mlt_service_type type, const char *service )
+{
+	mlt_properties properties = get_service_properties( self, type, service );
+
+	if ( self->index && properties && !mlt_properties_get_data( properties, "symbol", NULL ) )
+	{
+		const char *module = mlt_properties_get( properties, "module" );
+		pthread_mutex_lock( &self->mutex );
+		if ( module && !mlt_properties_get_data( &self->parent, module, NULL ) )
+			load_module( self, module );
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return properties;
+}
+
 /** Register a service with the repository.
  *
  * Typically, this is invoked by a module within its mlt_register().
@@ -173,16 +434,16 @@ void mlt_repository_register( mlt_repository self, mlt_service_type service_type
 	switch ( service_type )
 	{
 		case consumer_type:
-			mlt_properties_set_data( self->consumers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			register_service( self, self->consumers, service, symbol );
 			break;
 		case filter_type:
-			mlt_properties_set_data( self->filters, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			register_service( self, self->filters, service, symbol );
 			break;
 		case producer_type:
-			mlt_properties_set_data( self->producers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			register_service( self, self->producers, service, symbol );
 			break;
 		case transition_type:
-			mlt_properties_set_data( self->transitions, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			register_service( self, self->transitions, service, symbol );
 			break;
 		default:
 			break;
@@ -235,7 +496,7 @@ static mlt_properties get_service_properties( mlt_repository self, mlt_service_t
 
 void *mlt_repository_create( mlt_repository self, mlt_profile profile, mlt_service_type type, const char *service, const void *input )
 {
-	mlt_properties properties = get_service_properties( self, type, service );
+	mlt_properties properties = load_service( self, type, service );
 	if ( properties != NULL )
 	{
 		mlt_register_callback symbol_ptr = mlt_properties_get_data( properties, "symbol", NULL );
@@ -259,6 +520,9 @@ void mlt_repository_close( mlt_repository self )
 	mlt_properties_close( self->producers );
 	mlt_properties_close( self->transitions );
 	mlt_properties_close( &self->parent );
+	pthread_mutex_destroy( &self->mutex );
+	free( self->directory );
+	free( self->index );
 	free( self );
 }
 
@@ -326,6 +590,11 @@ mlt_properties mlt_repository_transitions( mlt_repository self )
 void mlt_repository_register_metadata( mlt_repository self, mlt_service_type type, const char *service, mlt_metadata_callback callback, void *callback_data )
 {
 	mlt_properties service_properties = get_service_properties( self, type, service );
+	const char *module = service_properties ? mlt_properties_get( service_properties, "module" ) : NULL;
+
+	// Another module owns a service of the same name in the index
+	if ( module && self->loading && strcmp( module, self->loading ) && mlt_properties_get_int( service_properties, "indexed" ) )
+		return;
 	mlt_properties_set_data( service_properties, "metadata_cb", callback, 0, NULL, NULL );
 	mlt_properties_set_data( service_properties, "metadata_cb_data", callback_data, 0, NULL, NULL );
 }
@@ -344,7 +613,7 @@ void mlt_repository_register_metadata( mlt_repository self, mlt_service_type typ
 mlt_properties mlt_repository_metadata( mlt_repository self, mlt_service_type type, const char *service )
 {
 	mlt_properties metadata = NULL;
-	mlt_properties properties = get_service_properties( self, type, service );
+	mlt_properties properties = load_service( self, type, service );
 
 	// If this is a valid service
 	if ( properties )
@@ -0,0 +1,192 @@
+/**
+ * \file mlt_ring.c
+ * \brief single producer, single consumer ring of bytes
+ * \see mlt_ring_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Local header files
+#include "mlt_ring.h"
+
+// System header files
+#include <stdlib.h>
+#include <string.h>
+
+/** \brief Ring class
+ *
+ * A first in, first out buffer of bytes of a fixed size between one thread
+ * that writes and one that reads, such as the thread of a consumer and the
+ * callback of an audio device. Neither side takes a lock or waits for the
+ * other: a write takes what fits and a read what is there, so the side that
+ * can wait polls on its own. The ends count every byte that passed, and the
+ * size is a power of two so they index the buffer through a mask.
+ */
+
+struct mlt_ring_s
+{
+	unsigned char *data;
+	unsigned long mask;
+	// Keep the ends on their own cache lines.
+	char pad0[64];
+	unsigned long tail;
+	char pad1[64];
+	unsigned long head;
+	char pad2[64];
+};
+
+/** Create a ring.
+ *
+ * \public \memberof mlt_ring_s
+ * \param size the least number of bytes it can hold, which is rounded up to a power of two
+ * \return a new ring or NULL on error
+ */
+
+mlt_ring mlt_ring_init( int size )
+{
+	mlt_ring self = calloc( 1, sizeof( struct mlt_ring_s ) );
+	unsigned long n = 2;
+
+	while ( size > 0 && n < (unsigned long) size )
+		n *= 2;
+	if ( self && ( self->data = malloc( n ) ) )
+	{
+		self->mask = n - 1;
+	}
+	else
+	{
+		free( self );
+		self = NULL;
+	}
+	return self;
+}
+
+/** Get the number of bytes the ring can hold.
+ *
+ * \public \memberof mlt_ring_s
+ * \param self a ring
+ * \return the size
+ */
+
+int mlt_ring_size( mlt_ring self )
+{
+	return self ? self->mask + 1 : 0;
+}
+
+/** Get the number of bytes to read.
+ *
+ * This is the least there is for the reader and the most for the writer.
+ *
+ * \public \memberof mlt_ring_s
+ * \param self a ring
+ * \return the number of bytes in the ring
+ */
+
+int mlt_ring_count( mlt_ring self )
+{
+	if ( self )
+	{
+		unsigned long head = __atomic_load_n( &self->head, __ATOMIC_ACQUIRE );
+		unsigned long tail = __atomic_load_n( &self->tail, __ATOMIC_ACQUIRE );
+		return tail - head;
+	}
+	return 0;
+}
+
+/** Add bytes to the end.
+ *
+ * Only one thread may write to a ring.
+ *
+ * \public \memberof mlt_ring_s
+ * \param self a ring
+ * \param data the bytes or NULL to add zeros
+ * \param size the number of bytes
+ * \return the number of bytes that fit
+ */
+
+int mlt_ring_write( mlt_ring self, const void *data, int size )
+{
+	unsigned long tail, head, offset, first;
+
+	if ( !self || size <= 0 )
+		return 0;
+	tail = __atomic_load_n( &self->tail, __ATOMIC_RELAXED );
+	head = __atomic_load_n( &self->head, __ATOMIC_ACQUIRE );
+	if ( (unsigned long) size > self->mask + 1 - ( tail - head ) )
+		size = self->mask + 1 - ( tail - head );
+	offset = tail & self->mask;
+	first = MIN( (unsigned long) size, self->mask + 1 - offset );
+	if ( data )
+	{
+		memcpy( self->data + offset, data, first );
+		memcpy( self->data, (const unsigned char*) data + first, size - first );
+	}
+	else
+	{
+		memset( self->data + offset, 0, first );
+		memset( self->data, 0, size - first );
+	}
+	__atomic_store_n( &self->tail, tail + size, __ATOMIC_RELEASE );
+	return size;
+}
+
+/** Take bytes from the front.
+ *
+ * Only one thread may read from a ring.
+ *
+ * \public \memberof mlt_ring_s
+ * \param self a ring
+ * \param data where to copy the bytes or NULL to drop them
+ * \param size the most bytes to take
+ * \return the number of bytes taken
+ */
+
+int mlt_ring_read( mlt_ring self, void *data, int size )
+{
+	unsigned long tail, head, offset, first;
+
+	if ( !self || size <= 0 )
+		return 0;
+	head = __atomic_load_n( &self->head, __ATOMIC_RELAXED );
+	tail = __atomic_load_n( &self->tail, __ATOMIC_ACQUIRE );
+	if ( (unsigned long) size > tail - head )
+		size = tail - head;
+	offset = head & self->mask;
+	first = MIN( (unsigned long) size, self->mask + 1 - offset );
+	if ( data )
+	{
+		memcpy( data, self->data + offset, first );
+		memcpy( (unsigned char*) data + first, self->data, size - first );
+	}
+	__atomic_store_n( &self->head, head + size, __ATOMIC_RELEASE );
+	return size;
+}
+
+/** Destroy a ring.
+ *
+ * \public \memberof mlt_ring_s
+ * \param self a ring
+ */
+
+void mlt_ring_close( mlt_ring self )
+{
+	if ( self )
+	{
+		free( self->data );
+		free( self );
+	}
+}
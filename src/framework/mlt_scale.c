@@ -0,0 +1,573 @@
+/**
+ * \file mlt_scale.c
+ * \brief image scaling engine
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_scale.h"
+#include "mlt_pool.h"
+#include "mlt_slices.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* An image is scaled in two passes for each output row: the input rows that
+ * the row covers are filtered vertically into a row of 16-bit samples, and
+ * each channel of that row is then filtered horizontally into the output.
+ * The vertical pass works on whole rows without regard for how the channels
+ * are interleaved, so it is the same for every format and is vectorized.
+ *
+ * The weights of both passes are computed once per call in tables of
+ * 14-bit fixed point. 8-bit samples keep 6 more bits between the passes.
+ */
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE ( 1 << WEIGHT_BITS )
+#define EXTRA_BITS 6
+
+// The output rows below which a scale is not sliced
+#define MIN_SLICE_ROWS 16
+
+/** the filter weights of one direction */
+
+typedef struct
+{
+	int size;          ///< the number of outputs
+	int taps;          ///< the number of inputs to each output
+	int *offset;       ///< the first input of each output
+	int16_t *weights;  ///< taps weights for each output
+}
+scale_table;
+
+/** where the samples of a channel are in a row */
+
+typedef struct
+{
+	int offset;        ///< the first sample
+	int step;          ///< the samples from one to the next
+	const scale_table *table;
+}
+scale_channel;
+
+/** a plane of an image */
+
+typedef struct
+{
+	const uint8_t *src;
+	int src_stride;
+	uint8_t *dst;
+	int dst_stride;
+	int row_samples;   ///< the input samples in a row, of all channels
+	int depth;         ///< 8 or 16 bits per sample
+	int max;           ///< the largest value of a sample
+	int channel_count;
+	scale_channel channels[4];
+	const scale_table *vertical;
+}
+scale_layer;
+
+typedef struct
+{
+	scale_layer layers[3];
+	int layer_count;
+	int row_samples;   ///< the largest row_samples of the layers
+	int taps;          ///< the largest vertical taps of the layers
+}
+scale_desc;
+
+/** Get the filter of an interpolation name.
+ *
+ * The names of the rescale.interp frame property map to the nearest filter:
+ * nearest, or none, to mlt_scale_nearest; tiles and bilinear to
+ * mlt_scale_bilinear; and hyper, bicubic and the higher quality names of
+ * other scalers to mlt_scale_bicubic.
+ *
+ * \public \memberof mlt_frame_s
+ * \param interpolation the name of an interpolation, may be NULL
+ * \return a filter, mlt_scale_bilinear if the name is not known
+ */
+
+mlt_scale_filter mlt_scale_filter_id( const char *interpolation )
+{
+	if ( !interpolation )
+		return mlt_scale_bilinear;
+	if ( !strcmp( interpolation, "nearest" ) || !strcmp( interpolation, "neighbor" ) || !strcmp( interpolation, "none" ) )
+		return mlt_scale_nearest;
+	if ( !strcmp( interpolation, "hyper" ) || !strcmp( interpolation, "bicubic" ) || !strcmp( interpolation, "bicublin" )
+		|| !strcmp( interpolation, "gauss" ) || !strcmp( interpolation, "sinc" ) || !strcmp( interpolation, "lanczos" )
+		|| !strcmp( interpolation, "spline" ) )
+		return mlt_scale_bicubic;
+	return mlt_scale_bilinear;
+}
+
+static double filter_weight( mlt_scale_filter filter, double x )
+{
+	x = fabs( x );
+	if ( filter == mlt_scale_bicubic )
+	{
+		if ( x < 1.0 )
+			return ( 1.5 * x - 2.5 ) * x * x + 1.0;
+		if ( x < 2.0 )
+			return ( ( -0.5 * x + 2.5 ) * x - 4.0 ) * x + 2.0;
+		return 0.0;
+	}
+	return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static void table_close( scale_table *table )
+{
+	free( table->offset );
+	free( table->weights );
+	table->offset = NULL;
+	table->weights = NULL;
+}
+
+/** Compute the weights of the inputs of each output.
+ *
+ * Inputs past the edges are clamped to the first or last one, and the
+ * weights of each output add up to exactly WEIGHT_ONE.
+ */
+
+static int table_init( scale_table *table, int in, int out, mlt_scale_filter filter )
+{
+	double scale = (double) in / out;
+	double stretch = scale > 1.0 ? scale : 1.0;
+	double radius = ( filter == mlt_scale_bicubic ? 2.0 : 1.0 ) * stretch;
+	int window = filter == mlt_scale_nearest ? 1 : (int) floor( 2.0 * radius ) + 1;
+	int taps = window < in ? window : in;
+	double *weights = malloc( window * sizeof( double ) );
+	int i, k;
+
+	table->size = out;
+	table->taps = taps;
+	table->offset = malloc( out * sizeof( int ) );
+	table->weights = malloc( out * taps * sizeof( int16_t ) );
+	if ( !weights || !table->offset || !table->weights )
+	{
+		free( weights );
+		table_close( table );
+		return 1;
+	}
+
+	for ( i = 0; i < out; i ++ )
+	{
+		int16_t *w = table->weights + i * taps;
+		double center = ( i + 0.5 ) * scale - 0.5;
+		int start, first, total = 0, largest = 0;
+		double sum = 0.0;
+
+		if ( filter == mlt_scale_nearest )
+		{
+			start = (int) floor( ( i + 0.5 ) * scale );
+			table->offset[ i ] = start < 0 ? 0 : start >= in ? in - 1 : start;
+			w[ 0 ] = WEIGHT_ONE;
+			continue;
+		}
+
+		start = (int) floor( center - radius ) + 1;
+		first = start < 0 ? 0 : start > in - taps ? in - taps : start;
+		for ( k = 0; k < taps; k ++ )
+			weights[ k ] = 0.0;
+		for ( k = 0; k < window; k ++ )
+		{
+			int j = start + k;
+			double weight = filter_weight( filter, ( j - center ) / stretch );
+			j = j < 0 ? 0 : j >= in ? in - 1 : j;
+			weights[ j - first ] += weight;
+			sum += weight;
+		}
+		for ( k = 0; k < taps; k ++ )
+		{
+			w[ k ] = (int16_t) lrint( weights[ k ] / sum * WEIGHT_ONE );
+			total += w[ k ];
+			if ( w[ k ] > w[ largest ] )
+				largest = k;
+		}
+		w[ largest ] += WEIGHT_ONE - total;
+		table->offset[ i ] = first;
+	}
+	free( weights );
+	return 0;
+}
+
+static int vertical_8( const uint8_t *const *rows, const int16_t *weights, int taps, uint16_t *out, int i, int samples )
+{
+	for ( ; i < samples; i ++ )
+	{
+		int k, sum = 1 << ( WEIGHT_BITS - EXTRA_BITS - 1 );
+		for ( k = 0; k < taps; k ++ )
+			sum += rows[ k ][ i ] * weights[ k ];
+		sum >>= WEIGHT_BITS - EXTRA_BITS;
+		out[ i ] = sum < 0 ? 0 : sum > ( 255 << EXTRA_BITS ) ? ( 255 << EXTRA_BITS ) : sum;
+	}
+	return samples;
+}
+
+#if defined(__SSE2__)
+
+// The same as vertical_8 for 8 samples at a time.
+static int vertical_8_sse2( const uint8_t *const *rows, const int16_t *weights, int taps, uint16_t *out, int samples )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32( 1 << ( WEIGHT_BITS - EXTRA_BITS - 1 ) );
+	const __m128i top = _mm_set1_epi16( 255 << EXTRA_BITS );
+	int i, k;
+
+	for ( i = 0; i + 8 <= samples; i += 8 )
+	{
+		__m128i lo = round;
+		__m128i hi = round;
+		for ( k = 0; k + 1 < taps; k += 2 )
+		{
+			// Multiply and add two rows at a time
+			__m128i a = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( rows[ k ] + i ) ), zero );
+			__m128i b = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( rows[ k + 1 ] + i ) ), zero );
+			__m128i w = _mm_set1_epi32( (uint16_t) weights[ k ] | ( (uint32_t)(uint16_t) weights[ k + 1 ] << 16 ) );
+			lo = _mm_add_epi32( lo, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), w ) );
+			hi = _mm_add_epi32( hi, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), w ) );
+		}
+		if ( k < taps )
+		{
+			__m128i a = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( rows[ k ] + i ) ), zero );
+			__m128i w = _mm_set1_epi32( (uint16_t) weights[ k ] );
+			lo = _mm_add_epi32( lo, _mm_madd_epi16( _mm_unpacklo_epi16( a, zero ), w ) );
+			hi = _mm_add_epi32( hi, _mm_madd_epi16( _mm_unpackhi_epi16( a, zero ), w ) );
+		}
+		lo = _mm_srai_epi32( lo, WEIGHT_BITS - EXTRA_BITS );
+		hi = _mm_srai_epi32( hi, WEIGHT_BITS - EXTRA_BITS );
+		_mm_storeu_si128( (__m128i*)( out + i ),
+			_mm_min_epi16( _mm_max_epi16( _mm_packs_epi32( lo, hi ), zero ), top ) );
+	}
+	return i;
+}
+
+#endif
+
+static void vertical_16( const uint16_t *const *rows, const int16_t *weights, int taps, uint16_t *out, int samples, int max )
+{
+	int i, k;
+	for ( i = 0; i < samples; i ++ )
+	{
+		int sum = 1 << ( WEIGHT_BITS - 1 );
+		for ( k = 0; k < taps; k ++ )
+			sum += rows[ k ][ i ] * weights[ k ];
+		sum >>= WEIGHT_BITS;
+		out[ i ] = sum < 0 ? 0 : sum > max ? max : sum;
+	}
+}
+
+static void horizontal_8( const uint16_t *in, uint8_t *out, const scale_channel *channel )
+{
+	const scale_table *table = channel->table;
+	const int16_t *w = table->weights;
+	int step = channel->step;
+	int taps = table->taps;
+	int x, k;
+
+	in += channel->offset;
+	out += channel->offset;
+	for ( x = 0; x < table->size; x ++, w += taps, out += step )
+	{
+		const uint16_t *p = in + table->offset[ x ] * step;
+		int sum = 1 << ( WEIGHT_BITS + EXTRA_BITS - 1 );
+		for ( k = 0; k < taps; k ++, p += step )
+			sum += *p * w[ k ];
+		sum >>= WEIGHT_BITS + EXTRA_BITS;
+		*out = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+	}
+}
+
+static void horizontal_16( const uint16_t *in, uint16_t *out, const scale_channel *channel, int max )
+{
+	const scale_table *table = channel->table;
+	const int16_t *w = table->weights;
+	int step = channel->step;
+	int taps = table->taps;
+	int x, k;
+
+	in += channel->offset;
+	out += channel->offset;
+	for ( x = 0; x < table->size; x ++, w += taps, out += step )
+	{
+		const uint16_t *p = in + table->offset[ x ] * step;
+		int sum = 1 << ( WEIGHT_BITS - 1 );
+		for ( k = 0; k < taps; k ++, p += step )
+			sum += *p * w[ k ];
+		sum >>= WEIGHT_BITS;
+		*out = sum < 0 ? 0 : sum > max ? max : sum;
+	}
+}
+
+static void scale_rows( const scale_layer *layer, int start, int end, uint16_t *row, const void **rows )
+{
+	const scale_table *vertical = layer->vertical;
+	int y, k, c;
+
+	for ( y = start; y < end; y ++ )
+	{
+		const int16_t *weights = vertical->weights + y * vertical->taps;
+		uint8_t *dst = layer->dst + y * layer->dst_stride;
+
+		for ( k = 0; k < vertical->taps; k ++ )
+			rows[ k ] = layer->src + ( vertical->offset[ y ] + k ) * layer->src_stride;
+
+		if ( layer->depth == 8 )
+		{
+			int i = 0;
+#if defined(__SSE2__)
+			i = vertical_8_sse2( (const uint8_t *const *) rows, weights, vertical->taps, row, layer->row_samples );
+#endif
+			vertical_8( (const uint8_t *const *) rows, weights, vertical->taps, row, i, layer->row_samples );
+			for ( c = 0; c < layer->channel_count; c ++ )
+				horizontal_8( row, dst, &layer->channels[ c ] );
+		}
+		else
+		{
+			vertical_16( (const uint16_t *const *) rows, weights, vertical->taps, row, layer->row_samples, layer->max );
+			for ( c = 0; c < layer->channel_count; c ++ )
+				horizontal_16( row, (uint16_t*) dst, &layer->channels[ c ], layer->max );
+		}
+	}
+}
+
+static int scale_slice_proc( int id, int idx, int jobs, void *cookie )
+{
+	scale_desc *desc = cookie;
+	uint16_t *row = mlt_pool_alloc( desc->row_samples * sizeof( uint16_t ) );
+	const void **rows = malloc( desc->taps * sizeof( void* ) );
+	int i;
+
+	if ( row && rows )
+	{
+		for ( i = 0; i < desc->layer_count; i ++ )
+		{
+			const scale_layer *layer = &desc->layers[ i ];
+			int height = layer->vertical->size;
+			int start = height * idx / jobs;
+			int end = height * ( idx + 1 ) / jobs;
+			scale_rows( layer, start, end, row, rows );
+		}
+	}
+	mlt_pool_release( row );
+	free( rows );
+	return 0;
+}
+
+static void scale_run( scale_desc *desc, int height )
+{
+	int jobs = mlt_slices_count_normal();
+	int i;
+
+	desc->row_samples = 0;
+	desc->taps = 0;
+	for ( i = 0; i < desc->layer_count; i ++ )
+	{
+		if ( desc->layers[ i ].row_samples > desc->row_samples )
+			desc->row_samples = desc->layers[ i ].row_samples;
+		if ( desc->layers[ i ].vertical->taps > desc->taps )
+			desc->taps = desc->layers[ i ].vertical->taps;
+	}
+	if ( jobs > height / MIN_SLICE_ROWS )
+		jobs = height / MIN_SLICE_ROWS;
+	if ( jobs > 1 )
+		mlt_slices_run_normal( jobs, scale_slice_proc, desc );
+	else
+		scale_slice_proc( 0, 0, 1, desc );
+}
+
+static void set_layer( scale_layer *layer, const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride,
+	int row_samples, int depth, const scale_table *vertical )
+{
+	layer->src = src;
+	layer->src_stride = src_stride;
+	layer->dst = dst;
+	layer->dst_stride = dst_stride;
+	layer->row_samples = row_samples;
+	layer->depth = depth;
+	layer->max = depth == 8 ? 255 : 65535;
+	layer->channel_count = 0;
+	layer->vertical = vertical;
+}
+
+static void add_channel( scale_layer *layer, int offset, int step, const scale_table *table )
+{
+	scale_channel *channel = &layer->channels[ layer->channel_count ++ ];
+	channel->offset = offset;
+	channel->step = step;
+	channel->table = table;
+}
+
+/** Determine if mlt_image_scale() can scale an image format.
+ *
+ * \public \memberof mlt_frame_s
+ * \param format an image format
+ * \return true if the format is supported
+ */
+
+int mlt_image_scale_supported( mlt_image_format format )
+{
+	switch ( format )
+	{
+	case mlt_image_rgb24:
+	case mlt_image_rgb24a:
+	case mlt_image_opengl:
+	case mlt_image_yuv422:
+	case mlt_image_yuv420p:
+	case mlt_image_yuv422p16:
+	case mlt_image_yuv420p10:
+	case mlt_image_yuv444p16:
+	case mlt_image_rgba64:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/** Scale an image.
+ *
+ * The image is filtered with a separable filter whose weights are computed
+ * once for the call, and the rows of the output are shared by the threads of
+ * the normal slices pool. The planes and strides are those that
+ * mlt_image_format_planes() gives, so that a view or one field of an image,
+ * with mlt_image_field_planes(), can be scaled as well.
+ *
+ * \public \memberof mlt_frame_s
+ * \param format the format of both images
+ * \param src the planes of the input image
+ * \param src_strides the strides of the input planes
+ * \param iwidth the width of the input image
+ * \param iheight the height of the input image
+ * \param[out] dst the planes of the output image
+ * \param dst_strides the strides of the output planes
+ * \param owidth the width of the output image
+ * \param oheight the height of the output image
+ * \param filter the filter to use
+ * \return true if the format is not supported or there is not enough memory
+ */
+
+int mlt_image_scale( mlt_image_format format, uint8_t *src[4], int src_strides[4], int iwidth, int iheight,
+	uint8_t *dst[4], int dst_strides[4], int owidth, int oheight, mlt_scale_filter filter )
+{
+	scale_table h_full = { 0 }, h_half = { 0 }, v_full = { 0 }, v_half = { 0 };
+	int half_width = format == mlt_image_yuv422 || format == mlt_image_yuv420p || format == mlt_image_yuv422p16 ||
+		format == mlt_image_yuv420p10;
+	int half_height = format == mlt_image_yuv420p || format == mlt_image_yuv420p10;
+	scale_desc desc;
+	int error = 0;
+	int i;
+
+	if ( !mlt_image_scale_supported( format ) || iwidth < 2 || iheight < 2 || owidth < 2 || oheight < 2 )
+		return 1;
+
+	error = table_init( &h_full, iwidth, owidth, filter ) || table_init( &v_full, iheight, oheight, filter )
+		|| ( half_width && table_init( &h_half, iwidth / 2, owidth / 2, filter ) )
+		|| ( half_height && table_init( &v_half, iheight / 2, oheight / 2, filter ) );
+
+	if ( !error )
+	{
+		desc.layer_count = 1;
+		switch ( format )
+		{
+		case mlt_image_rgb24:
+		case mlt_image_rgb24a:
+		case mlt_image_opengl:
+		case mlt_image_rgba64:
+		{
+			int channels = format == mlt_image_rgb24 ? 3 : 4;
+			set_layer( &desc.layers[0], src[0], src_strides[0], dst[0], dst_strides[0], iwidth * channels,
+				format == mlt_image_rgba64 ? 16 : 8, &v_full );
+			for ( i = 0; i < channels; i ++ )
+				add_channel( &desc.layers[0], i, channels, &h_full );
+			break;
+		}
+		case mlt_image_yuv422:
+			set_layer( &desc.layers[0], src[0], src_strides[0], dst[0], dst_strides[0], iwidth * 2, 8, &v_full );
+			add_channel( &desc.layers[0], 0, 2, &h_full );
+			add_channel( &desc.layers[0], 1, 4, &h_half );
+			add_channel( &desc.layers[0], 3, 4, &h_half );
+			break;
+		default:
+		{
+			// The planar formats
+			int depth = format == mlt_image_yuv420p ? 8 : 16;
+			desc.layer_count = 3;
+			for ( i = 0; i < 3; i ++ )
+			{
+				scale_layer *layer = &desc.layers[ i ];
+				const scale_table *horizontal = i && half_width ? &h_half : &h_full;
+				set_layer( layer, src[ i ], src_strides[ i ], dst[ i ], dst_strides[ i ],
+					i && half_width ? iwidth / 2 : iwidth, depth, i && half_height ? &v_half : &v_full );
+				if ( format == mlt_image_yuv420p10 )
+					layer->max = ( 1 << 10 ) - 1;
+				add_channel( layer, 0, 1, horizontal );
+			}
+			break;
+		}
+		}
+		scale_run( &desc, oheight );
+
+		// An odd width of yuv422 has no chroma of its own for the last pixel
+		if ( format == mlt_image_yuv422 && owidth % 2 )
+			for ( i = 0; i < oheight; i ++ )
+				dst[0][ i * dst_strides[0] + owidth * 2 - 1 ] = dst[0][ i * dst_strides[0] + owidth * 2 - 3 ];
+	}
+
+	table_close( &h_full );
+	table_close( &h_half );
+	table_close( &v_full );
+	table_close( &v_half );
+	return error;
+}
+
+/** Scale an alpha channel or another plane of 8-bit samples.
+ *
+ * \public \memberof mlt_frame_s
+ * \param src the input plane
+ * \param src_stride the stride of the input plane
+ * \param iwidth the width of the input plane
+ * \param iheight the height of the input plane
+ * \param[out] dst the output plane
+ * \param dst_stride the stride of the output plane
+ * \param owidth the width of the output plane
+ * \param oheight the height of the output plane
+ * \param filter the filter to use
+ */
+
+void mlt_image_scale_alpha( uint8_t *src, int src_stride, int iwidth, int iheight,
+	uint8_t *dst, int dst_stride, int owidth, int oheight, mlt_scale_filter filter )
+{
+	scale_table horizontal = { 0 }, vertical = { 0 };
+	scale_desc desc;
+
+	if ( iwidth < 1 || iheight < 1 || owidth < 1 || oheight < 1 )
+		return;
+	if ( !table_init( &horizontal, iwidth, owidth, filter ) && !table_init( &vertical, iheight, oheight, filter ) )
+	{
+		desc.layer_count = 1;
+		set_layer( &desc.layers[0], src, src_stride, dst, dst_stride, iwidth, 8, &vertical );
+		add_channel( &desc.layers[0], 0, 1, &horizontal );
+		scale_run( &desc, oheight );
+	}
+	table_close( &horizontal );
+	table_close( &vertical );
+}
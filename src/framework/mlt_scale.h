@@ -0,0 +1,44 @@
+/**
+ * \file mlt_scale.h
+ * \brief image scaling engine
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_SCALE_H
+#define MLT_SCALE_H
+
+#include "mlt_types.h"
+
+/** The filters of mlt_image_scale() */
+
+typedef enum
+{
+	mlt_scale_nearest = 0, /**< the nearest sample */
+	mlt_scale_bilinear,    /**< a triangle filter, which averages all the samples it covers when shrinking */
+	mlt_scale_bicubic      /**< a Catmull-Rom filter */
+}
+mlt_scale_filter;
+
+extern mlt_scale_filter mlt_scale_filter_id( const char *interpolation );
+extern int mlt_image_scale_supported( mlt_image_format format );
+extern int mlt_image_scale( mlt_image_format format, uint8_t *src[4], int src_strides[4], int iwidth, int iheight,
+	uint8_t *dst[4], int dst_strides[4], int owidth, int oheight, mlt_scale_filter filter );
+extern void mlt_image_scale_alpha( uint8_t *src, int src_stride, int iwidth, int iheight,
+	uint8_t *dst, int dst_stride, int owidth, int oheight, mlt_scale_filter filter );
+
+#endif
@@ -27,6 +27,8 @@
 #include "mlt_factory.h"
 #include "mlt_log.h"
 #include "mlt_producer.h"
+#include "mlt_playlist.h"
+#include "mlt_deque.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -56,9 +58,29 @@ typedef struct
 	int filter_size;
 	mlt_filter *filters;
 	pthread_mutex_t mutex;
+	int generation;
+	int properties_generation;
+	uint64_t properties_hash;
+	uint64_t hash;
+	int hash_change;
+	int profile_change;
 }
 mlt_service_base;
 
+// The walk of a service tree stops at this depth
+#define HASH_MAX_DEPTH (64)
+
+/** The number of changes to all services, which versions the cached hashes.
+ */
+
+static int change_count = 1;
+static pthread_mutex_t hash_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** The number of walks that told services of a new profile, which marks the services visited.
+ */
+
+static int profile_change_count = 0;
+
 /* Private methods
  */
 
@@ -66,6 +88,8 @@ static void mlt_service_disconnect( mlt_service self );
 static void mlt_service_connect( mlt_service self, mlt_service that );
 static int service_get_frame( mlt_service self, mlt_frame_ptr frame, int index );
 static void mlt_service_property_changed( mlt_listener, mlt_properties owner, mlt_service self, void **args );
+static void mlt_service_own_property_changed( mlt_service owner, mlt_service self, char *name );
+static void mlt_service_own_service_changed( mlt_service owner, mlt_service self );
 
 /** Initialize a service.
  *
@@ -101,6 +125,9 @@ int mlt_service_init( mlt_service self, void *child )
 		mlt_events_init( &self->parent );
 		mlt_events_register( &self->parent, "service-changed", NULL );
 		mlt_events_register( &self->parent, "property-changed", ( mlt_transmitter )mlt_service_property_changed );
+		mlt_events_register( &self->parent, "profile-changed", NULL );
+		mlt_events_listen( &self->parent, self, "property-changed", ( mlt_listener )mlt_service_own_property_changed );
+		mlt_events_listen( &self->parent, self, "service-changed", ( mlt_listener )mlt_service_own_service_changed );
 		pthread_mutex_init( &( ( mlt_service_base * )self->local )->mutex, NULL );
 	}
 
@@ -124,6 +151,236 @@ static void mlt_service_property_changed( mlt_listener listener, mlt_properties
 		listener( owner, self, ( char * )args[ 0 ] );
 }
 
+/** Mark a service as changed.
+ *
+ * This is done for every change of a property that is not private (whose
+ * name starts with an underscore), of an attached filter, and when the
+ * "service-changed" event fires. Call it for changes that do not go through
+ * the properties, such as a media file rewritten in place.
+ *
+ * \public \memberof mlt_service_s
+ * \param self a service
+ */
+
+void mlt_service_changed( mlt_service self )
+{
+	if ( self != NULL && self->local != NULL )
+	{
+		__atomic_add_fetch( &( ( mlt_service_base * )self->local )->generation, 1, __ATOMIC_RELAXED );
+		__atomic_add_fetch( &change_count, 1, __ATOMIC_RELEASE );
+	}
+}
+
+/** Get the number of changes made to a service.
+ *
+ * This only counts the service itself and its attached filters. Use
+ * mlt_service_hash() to find out if anything upstream changed.
+ *
+ * \public \memberof mlt_service_s
+ * \param self a service
+ * \return a counter that increases with every change
+ */
+
+int mlt_service_generation( mlt_service self )
+{
+	if ( self == NULL || self->local == NULL )
+		return 0;
+	return __atomic_load_n( &( ( mlt_service_base * )self->local )->generation, __ATOMIC_RELAXED );
+}
+
+static void mlt_service_own_property_changed( mlt_service owner, mlt_service self, char *name )
+{
+	if ( name == NULL || name[ 0 ] != '_' )
+		mlt_service_changed( self );
+}
+
+static void mlt_service_own_service_changed( mlt_service owner, mlt_service self )
+{
+	mlt_service_changed( self );
+}
+
+static uint64_t hash_bytes( uint64_t hash, const void *data, size_t size )
+{
+	const unsigned char *p = data;
+	while ( size-- )
+		hash = ( hash ^ *p++ ) * 1099511628211ULL;
+	return hash;
+}
+
+static uint64_t hash_value( uint64_t hash, uint64_t value )
+{
+	return hash_bytes( hash, &value, sizeof( value ) );
+}
+
+// Hash the public string properties of a service.
+static uint64_t hash_properties( mlt_properties properties )
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( properties ); i++ )
+	{
+		const char *name = mlt_properties_get_name( properties, i );
+		const char *value = mlt_properties_get_value( properties, i );
+		if ( name && value && name[ 0 ] != '_' )
+		{
+			hash = hash_bytes( hash, name, strlen( name ) + 1 );
+			hash = hash_bytes( hash, value, strlen( value ) + 1 );
+		}
+	}
+	return hash;
+}
+
+static uint64_t service_hash( mlt_service self, int change, int depth )
+{
+	mlt_service_base *base = self->local;
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( self );
+	mlt_service_type type = mlt_service_identify( self );
+	int generation = mlt_service_generation( self );
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+
+	if ( base->hash_change == change || depth > HASH_MAX_DEPTH )
+		return base->hash;
+
+	// The properties are only hashed again after they change
+	if ( base->properties_generation != generation || !base->properties_hash )
+	{
+		base->properties_hash = hash_properties( properties );
+		base->properties_generation = generation;
+	}
+	hash = hash_value( hash, base->properties_hash );
+
+	for ( i = 0; i < base->filter_count; i++ )
+		hash = hash_value( hash, service_hash( MLT_FILTER_SERVICE( base->filters[ i ] ), change, depth + 1 ) );
+	for ( i = 0; i < base->count; i++ )
+		hash = hash_value( hash, base->in[ i ] ? service_hash( base->in[ i ], change, depth + 1 ) : 0 );
+
+	// producer_xml replaces the resource of the playlists it loads from a file
+	if ( mlt_properties_get( properties, "_original_type" ) )
+		type = mlt_properties_get_int( properties, "_original_type" );
+	if ( type == producer_type || type == playlist_type || type == tractor_type || type == multitrack_type )
+	{
+		mlt_producer producer = MLT_PRODUCER( self );
+		if ( mlt_producer_is_cut( producer ) )
+			hash = hash_value( hash, service_hash( MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( producer ) ), change, depth + 1 ) );
+		else if ( type == playlist_type )
+			for ( i = 0; i < mlt_playlist_count( MLT_PLAYLIST( self ) ); i++ )
+			{
+				mlt_producer clip = mlt_playlist_get_clip( MLT_PLAYLIST( self ), i );
+				hash = hash_value( hash, clip ? service_hash( MLT_PRODUCER_SERVICE( clip ), change, depth + 1 ) : 0 );
+			}
+	}
+
+	base->hash = hash;
+	base->hash_change = change;
+	return hash;
+}
+
+/** Get a hash of the configuration of a service and everything upstream of it.
+ *
+ * The hash covers the public properties, the attached filters, the connected
+ * producers, the entries of a playlist and the parent of a cut, so it is the
+ * same for the same graph across runs. Hashes are cached until something is
+ * changed, see mlt_service_changed(), which makes asking again without a
+ * change as cheap as reading a counter.
+ *
+ * \public \memberof mlt_service_s
+ * \param self a service
+ * \return the hash
+ */
+
+uint64_t mlt_service_hash( mlt_service self )
+{
+	uint64_t hash = 0;
+	if ( self != NULL && self->local != NULL )
+	{
+		pthread_mutex_lock( &hash_mutex );
+		hash = service_hash( self, __atomic_load_n( &change_count, __ATOMIC_ACQUIRE ), 0 );
+		pthread_mutex_unlock( &hash_mutex );
+	}
+	return hash;
+}
+
+// Collect a service and everything upstream of it that was not yet visited by this walk.
+static void profile_walk( mlt_service self, int change, int depth, mlt_deque services )
+{
+	mlt_service_base *base = self->local;
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( self );
+	mlt_service_type type = mlt_service_identify( self );
+	int i;
+
+	if ( base == NULL || base->profile_change == change || depth > HASH_MAX_DEPTH )
+		return;
+	base->profile_change = change;
+	mlt_properties_inc_ref( properties );
+	mlt_deque_push_back( services, self );
+
+	for ( i = 0; i < base->filter_count; i++ )
+		profile_walk( MLT_FILTER_SERVICE( base->filters[ i ] ), change, depth + 1, services );
+	for ( i = 0; i < base->count; i++ )
+		if ( base->in[ i ] )
+			profile_walk( base->in[ i ], change, depth + 1, services );
+
+	if ( mlt_properties_get( properties, "_original_type" ) )
+		type = mlt_properties_get_int( properties, "_original_type" );
+	if ( type == playlist_type )
+	{
+		for ( i = 0; i < mlt_playlist_count( MLT_PLAYLIST( self ) ); i++ )
+		{
+			mlt_producer clip = mlt_playlist_get_clip( MLT_PLAYLIST( self ), i );
+			if ( clip )
+				profile_walk( MLT_PRODUCER_SERVICE( clip ), change, depth + 1, services );
+		}
+	}
+	// The mlt_type of a cut does not identify it as a producer
+	else if ( type != filter_type && type != transition_type && type != consumer_type &&
+		mlt_producer_is_cut( MLT_PRODUCER( self ) ) )
+	{
+		mlt_producer parent = mlt_producer_cut_parent( MLT_PRODUCER( self ) );
+		if ( parent )
+			profile_walk( MLT_PRODUCER_SERVICE( parent ), change, depth + 1, services );
+	}
+}
+
+/** Tell a service and everything upstream of it that their profile changed.
+ *
+ * Change the fields of the profile that the services share in place, as
+ * the mlt_profile property of a consumer does, and then call this on the
+ * consumer. Each service in the graph, and the parent of each cut and the
+ * entries of each playlist, gets the "profile-changed" event once, the
+ * producers first. Services keep their decoders and caches and only redo
+ * what depends on the size or the frame rate. A consumer takes the new
+ * profile into its properties and purges the frames it rendered in the old one.
+ *
+ * Services that hold other services outside of the graph, such as a
+ * wrapping producer, pass the event on to them.
+ *
+ * \public \memberof mlt_service_s
+ * \param self a service
+ */
+
+void mlt_service_profile_changed( mlt_service self )
+{
+	mlt_deque services;
+	mlt_service service;
+
+	if ( self == NULL || self->local == NULL || ( services = mlt_deque_init( ) ) == NULL )
+		return;
+
+	// Listeners may walk the graph again, so they are called without the lock
+	pthread_mutex_lock( &hash_mutex );
+	profile_walk( self, ++profile_change_count, 0, services );
+	pthread_mutex_unlock( &hash_mutex );
+
+	while ( ( service = mlt_deque_pop_back( services ) ) )
+	{
+		mlt_events_fire( MLT_SERVICE_PROPERTIES( service ), "profile-changed", NULL );
+		mlt_service_close( service );
+	}
+	mlt_deque_close( services );
+}
+
 /** Acquire a mutual exclusion lock on this service.
  *
  * \public \memberof mlt_service_s
@@ -249,6 +506,7 @@ int mlt_service_connect_producer( mlt_service self, mlt_service producer, int in
 
 		// Close the current service
 		mlt_service_close( current );
+		mlt_service_changed( self );
 
 		// Inform caller that all went well
 		return 0;
@@ -326,6 +584,7 @@ int mlt_service_insert_producer( mlt_service self, mlt_service producer, int ind
 
 		// Connect the producer to its connected consumer.
 		mlt_service_connect( producer, self );
+		mlt_service_changed( self );
 
 		// Inform caller that all went well
 		return 0;
@@ -363,6 +622,7 @@ int mlt_service_disconnect_producer( mlt_service self, int index )
 			for ( ; index + 1 < base->count; index ++ )
 				base->in[ index ] = base->in[ index + 1 ];
 			base->count --;
+			mlt_service_changed( self );
 			return 0;
 		}
 	}
@@ -537,9 +797,15 @@ void mlt_service_apply_filters( mlt_service self, mlt_frame frame, int index )
 	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_properties service_properties = MLT_SERVICE_PROPERTIES( self );
 	mlt_service_base *base = self->local;
-	mlt_position position = mlt_frame_get_position( frame );
-	mlt_position self_in = mlt_properties_get_position( service_properties, "in" );
-	mlt_position self_out = mlt_properties_get_position( service_properties, "out" );
+	mlt_position position, self_in, self_out;
+
+	// Most services on the way to the consumer have no filters
+	if ( base->filter_count == 0 )
+		return;
+
+	position = mlt_frame_get_position( frame );
+	self_in = mlt_properties_get_position( service_properties, "in" );
+	self_out = mlt_properties_get_position( service_properties, "out" );
 
 	if ( index == 0 || mlt_properties_get_int( service_properties, "_filter_private" ) == 0 )
 	{
@@ -553,6 +819,9 @@ void mlt_service_apply_filters( mlt_service self, mlt_frame frame, int index )
 				int disable = mlt_properties_get_int( MLT_FILTER_PROPERTIES( base->filters[ i ] ), "disable" );
 				if ( !disable && ( ( in == 0 && out == 0 ) || ( position >= in && ( position <= out || out == 0 ) ) ) )
 				{
+					// Only the normalisers keep what is known about the image
+					if ( !mlt_properties_get_int( MLT_FILTER_PROPERTIES( base->filters[ i ] ), "_loader" ) )
+						mlt_frame_clear_image_hints( frame );
 					mlt_properties_set_position( frame_properties, "in", in == 0 ? self_in : in );
 					mlt_properties_set_position( frame_properties, "out", out == 0 ? self_out : out );
 					mlt_filter_process( base->filters[ i ], frame );
@@ -588,10 +857,16 @@ int mlt_service_get_frame( mlt_service self, mlt_frame_ptr frame, int index )
 		mlt_properties properties = MLT_SERVICE_PROPERTIES( self );
 		mlt_position in = mlt_properties_get_position( properties, "in" );
 		mlt_position out = mlt_properties_get_position( properties, "out" );
-		mlt_position position = mlt_service_identify( self ) == producer_type ? mlt_producer_position( MLT_PRODUCER( self ) ) : -1;
+		int is_producer = mlt_service_identify( self ) == producer_type;
+		mlt_position position = is_producer ? mlt_producer_position( MLT_PRODUCER( self ) ) : -1;
 
 		result = self->get_frame( self, frame, index );
 
+		// Time what the producer left for the image and audio
+		if ( result == 0 && *frame && is_producer )
+			mlt_frame_trace_push( *frame, self, mlt_deque_count( MLT_FRAME_IMAGE_STACK( *frame ) ),
+				mlt_deque_count( MLT_FRAME_AUDIO_STACK( *frame ) ) );
+
 		if ( result == 0 )
 		{
 			mlt_properties_inc_ref( properties );
@@ -605,7 +880,7 @@ int mlt_service_get_frame( mlt_service self, mlt_frame_ptr frame, int index )
 			mlt_service_apply_filters( self, *frame, 1 );
 			mlt_deque_push_back( MLT_FRAME_SERVICE_STACK( *frame ), self );
 			
-			if ( mlt_service_identify( self ) == producer_type &&
+			if ( is_producer &&
 			     mlt_properties_get_int( MLT_SERVICE_PROPERTIES( self ), "_need_previous_next" ) )
 			{
 				// Save the new position from self->get_frame
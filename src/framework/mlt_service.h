@@ -40,6 +40,7 @@
  *
  * \event \em service-changed a filter was attached or detached or a transition was connected or disconnected
  * \event \em property-changed
+ * \event \em profile-changed the fields of the profile were changed in place, see mlt_service_profile_changed()
  * \properties \em mlt_type identifies the subclass
  * \properties \em _mlt_service_hidden a flag that indicates whether to hide the mlt_service
  * \properties \em mlt_service is the name of the implementation of the service
@@ -98,6 +99,10 @@ extern int mlt_service_move_filter( mlt_service self, int from, int to );
 extern mlt_filter mlt_service_filter( mlt_service self, int index );
 extern mlt_profile mlt_service_profile( mlt_service self );
 extern void mlt_service_set_profile( mlt_service self, mlt_profile profile );
+extern void mlt_service_changed( mlt_service self );
+extern int mlt_service_generation( mlt_service self );
+extern uint64_t mlt_service_hash( mlt_service self );
+extern void mlt_service_profile_changed( mlt_service self );
 extern void mlt_service_close( mlt_service self );
 
 extern void mlt_service_cache_put( mlt_service self, const char *name, void* data, int size, mlt_destructor destructor );
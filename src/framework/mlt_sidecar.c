@@ -0,0 +1,523 @@
+/**
+ * \file mlt_sidecar.c
+ * \brief on-disk store of data derived from media files
+ * \see mlt_sidecar_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_sidecar.h"
+#include "mlt_cache.h"
+#include "mlt_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define SIDECAR_MAGIC "MLTSIDE1"
+#define SIDECAR_SUFFIX ".side"
+#define SIDECAR_TEMP ".tmp"
+#define SIDECAR_SAMPLE ( 64 * 1024 )        /**< bytes read at each end of a media file to identify it */
+#define SIDECAR_IDENTITIES ( 32 )           /**< media files whose identity is remembered */
+#define SIDECAR_DEFAULT_BUDGET ( INT64_C( 1 ) << 30 )
+#define SIDECAR_TEMP_AGE ( 3600 )           /**< seconds after which a temporary file is left over */
+
+/** The header of a record file, followed by the data. */
+
+typedef struct
+{
+	char magic[ 8 ];
+	uint64_t size;       /**< the bytes of data that follow */
+	uint64_t identity;   /**< the identity of the media file */
+	uint64_t params;     /**< the hash of the parameters */
+}
+record_header;
+
+/** \brief Sidecar class
+ *
+ * A record of data derived from a media file, such as its peaks or its seek
+ * index, kept in a store shared by all of the processes of the user so that
+ * the analysis runs once per file. A record is found by the identity of the
+ * media file, its kind and the parameters of the analysis, and is read
+ * through a read-only mapping of its file.
+ *
+ * The identity of a media file is a hash of its size, its modification time
+ * and its contents at both ends, so that it does not depend on the path.
+ * Records are written to a temporary file that is renamed in place, and are
+ * never changed afterwards, so readers in other processes never see a
+ * partial one. The least recently used records are removed when the store
+ * grows beyond its budget; a record that is still mapped stays readable.
+ */
+
+struct mlt_sidecar_s
+{
+	void *data;          /**< the contents of the record file */
+	size_t size;
+	int mapped;
+};
+
+typedef struct
+{
+	char *resource;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t identity;
+}
+identity_entry;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static identity_entry identities[ SIDECAR_IDENTITIES ];
+static int identities_next = 0;
+static int64_t budget = -1;
+static unsigned sequence = 0;
+
+static uint64_t hash_bytes( uint64_t hash, const void *data, size_t size )
+{
+	const unsigned char *p = data;
+	while ( size-- )
+		hash = ( hash ^ *p++ ) * 1099511628211ULL;
+	return hash;
+}
+
+/** Get the identity of a media file.
+ *
+ * \return true if it is not a regular file or cannot be read
+ */
+
+static int media_identity( const char *resource, uint64_t *identity )
+{
+	struct stat st;
+	uint64_t size, hash = 14695981039346656037ULL;
+	int64_t mtime;
+	unsigned char *sample;
+	FILE *file;
+	size_t n;
+	int i, error = 0;
+
+	if ( !resource || stat( resource, &st ) || !S_ISREG( st.st_mode ) )
+		return 1;
+	size = st.st_size;
+	mtime = st.st_mtime;
+
+	pthread_mutex_lock( &mutex );
+	for ( i = 0; i < SIDECAR_IDENTITIES; i++ )
+	{
+		identity_entry *entry = &identities[i];
+		if ( entry->resource && entry->size == size && entry->mtime == mtime && !strcmp( entry->resource, resource ) )
+		{
+			*identity = entry->identity;
+			pthread_mutex_unlock( &mutex );
+			return 0;
+		}
+	}
+	pthread_mutex_unlock( &mutex );
+
+	sample = malloc( SIDECAR_SAMPLE );
+	file = sample ? fopen( resource, "rb" ) : NULL;
+	if ( !file )
+	{
+		free( sample );
+		return 1;
+	}
+	hash = hash_bytes( hash, &size, sizeof( size ) );
+	hash = hash_bytes( hash, &mtime, sizeof( mtime ) );
+	n = fread( sample, 1, SIDECAR_SAMPLE, file );
+	hash = hash_bytes( hash, sample, n );
+	if ( size > SIDECAR_SAMPLE )
+	{
+		uint64_t tail = MAX( size - SIDECAR_SAMPLE, SIDECAR_SAMPLE );
+		error = fseeko( file, tail, SEEK_SET );
+		if ( !error )
+		{
+			n = fread( sample, 1, SIDECAR_SAMPLE, file );
+			hash = hash_bytes( hash, sample, n );
+		}
+	}
+	error |= ferror( file );
+	fclose( file );
+	free( sample );
+	if ( error )
+		return 1;
+	*identity = hash;
+
+	pthread_mutex_lock( &mutex );
+	free( identities[ identities_next ].resource );
+	identities[ identities_next ].resource = strdup( resource );
+	identities[ identities_next ].size = size;
+	identities[ identities_next ].mtime = mtime;
+	identities[ identities_next ].identity = hash;
+	identities_next = ( identities_next + 1 ) % SIDECAR_IDENTITIES;
+	pthread_mutex_unlock( &mutex );
+	return 0;
+}
+
+static uint64_t params_hash( const char *params )
+{
+	return hash_bytes( 14695981039346656037ULL, params ? params : "", params ? strlen( params ) : 0 );
+}
+
+/** Get the name of the file of a record, or NULL if there is none.
+ */
+
+static char *record_filename( uint64_t identity, const char *kind, uint64_t params, int create )
+{
+	const char *s;
+	char *dir, *filename = NULL;
+
+	// The kind is part of the file name
+	if ( !kind || !*kind || strlen( kind ) > 64 )
+		return NULL;
+	for ( s = kind; *s; s++ )
+		if ( !( ( *s >= 'a' && *s <= 'z' ) || ( *s >= 'A' && *s <= 'Z' ) || ( *s >= '0' && *s <= '9' ) || *s == '_' ) )
+			return NULL;
+
+	dir = mlt_cache_directory( "MLT_SIDECAR_DIR", "sidecar", create );
+	if ( dir )
+	{
+		filename = malloc( strlen( dir ) + strlen( kind ) + 48 );
+		if ( filename )
+			sprintf( filename, "%s/%016" PRIx64 "-%s-%016" PRIx64 SIDECAR_SUFFIX, dir, identity, kind, params );
+	}
+	free( dir );
+	return filename;
+}
+
+static void release_data( void *data, size_t size, int mapped )
+{
+#ifndef _WIN32
+	if ( mapped )
+		munmap( data, size );
+	else
+#endif
+		free( data );
+}
+
+/** Open a record.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \param resource the name of a media file
+ * \param kind the kind of data, made of letters, digits and underscores
+ * \param params the parameters the data was computed with, or NULL
+ * \return the record to be closed with mlt_sidecar_close(), or NULL if there is none
+ */
+
+mlt_sidecar mlt_sidecar_open( const char *resource, const char *kind, const char *params )
+{
+	uint64_t identity, hash = params_hash( params );
+	char *filename;
+	FILE *file;
+	struct stat st;
+	void *data = NULL;
+	int mapped = 0;
+	mlt_sidecar self = NULL;
+
+	if ( media_identity( resource, &identity ) )
+		return NULL;
+	filename = record_filename( identity, kind, hash, 0 );
+	file = filename ? fopen( filename, "rb" ) : NULL;
+	if ( file )
+	{
+		if ( !fstat( fileno( file ), &st ) && (uint64_t) st.st_size >= sizeof( record_header ) )
+		{
+#ifndef _WIN32
+			data = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fileno( file ), 0 );
+			if ( data == MAP_FAILED )
+				data = NULL;
+			mapped = data != NULL;
+#else
+			data = malloc( st.st_size );
+			if ( data && fread( data, st.st_size, 1, file ) != 1 )
+			{
+				free( data );
+				data = NULL;
+			}
+#endif
+		}
+		fclose( file );
+	}
+	if ( data )
+	{
+		const record_header *header = data;
+		if ( !memcmp( header->magic, SIDECAR_MAGIC, sizeof( header->magic ) ) && header->identity == identity
+			 && header->params == hash && header->size == (uint64_t) st.st_size - sizeof( record_header ) )
+			self = calloc( 1, sizeof( struct mlt_sidecar_s ) );
+		if ( self )
+		{
+			self->data = data;
+			self->size = st.st_size;
+			self->mapped = mapped;
+			// Mark the record as used for the trimming of the store
+			utime( filename, NULL );
+		}
+		else
+		{
+			release_data( data, st.st_size, mapped );
+		}
+	}
+	free( filename );
+	return self;
+}
+
+/** Get the data of a record.
+ *
+ * The data is read-only and stays valid until the record is closed.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \param self a record
+ * \param size where to store the size of the data, or NULL
+ * \return the data
+ */
+
+const void *mlt_sidecar_data( mlt_sidecar self, size_t *size )
+{
+	if ( size )
+		*size = self ? self->size - sizeof( record_header ) : 0;
+	return self ? (const char*) self->data + sizeof( record_header ) : NULL;
+}
+
+/** Close a record.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \param self a record
+ */
+
+void mlt_sidecar_close( mlt_sidecar self )
+{
+	if ( self )
+	{
+		release_data( self->data, self->size, self->mapped );
+		free( self );
+	}
+}
+
+/** Store a record, replacing any with the same key.
+ *
+ * The store is trimmed to its budget afterwards.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \param resource the name of a media file
+ * \param kind the kind of data, made of letters, digits and underscores
+ * \param params the parameters the data was computed with, or NULL
+ * \param data the data
+ * \param size the size of the data in bytes
+ * \return true on error
+ */
+
+int mlt_sidecar_store( const char *resource, const char *kind, const char *params, const void *data, size_t size )
+{
+	record_header header;
+	uint64_t identity;
+	char *filename, *temp;
+	FILE *file;
+	unsigned serial;
+	int error = 1;
+
+	if ( !data || mlt_sidecar_get_budget( ) <= 0 || media_identity( resource, &identity ) )
+		return 1;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, SIDECAR_MAGIC, sizeof( header.magic ) );
+	header.size = size;
+	header.identity = identity;
+	header.params = params_hash( params );
+	filename = record_filename( identity, kind, header.params, 1 );
+	temp = filename ? malloc( strlen( filename ) + 32 ) : NULL;
+	if ( temp )
+	{
+		// Write to a temporary file of this process and thread so readers never see a partial record
+		pthread_mutex_lock( &mutex );
+		serial = sequence++;
+		pthread_mutex_unlock( &mutex );
+		sprintf( temp, "%s.%d.%u" SIDECAR_TEMP, filename, (int) getpid( ), serial );
+		file = fopen( temp, "wb" );
+		if ( file )
+		{
+			error = fwrite( &header, sizeof( header ), 1, file ) != 1
+				|| ( size && fwrite( data, size, 1, file ) != 1 );
+			error = fclose( file ) || error;
+#ifdef _WIN32
+			if ( !error )
+				remove( filename );
+#endif
+			if ( !error )
+				error = rename( temp, filename );
+			if ( error )
+				remove( temp );
+		}
+		if ( error )
+			mlt_log_warning( NULL, "[sidecar] failed to store %s\n", filename );
+	}
+	free( temp );
+	free( filename );
+	if ( !error )
+		mlt_sidecar_trim( );
+	return error;
+}
+
+/** Set the size the store is trimmed to.
+ *
+ * The budget defaults to the value of the environment variable
+ * \envvar MLT_SIDECAR_BYTES or 1 GiB. It is shared by all of the processes
+ * that use the store, each trimming it to its own budget.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \param bytes the byte budget, 0 for not storing any records
+ */
+
+void mlt_sidecar_set_budget( int64_t bytes )
+{
+	pthread_mutex_lock( &mutex );
+	budget = MAX( bytes, 0 );
+	pthread_mutex_unlock( &mutex );
+}
+
+/** Get the size the store is trimmed to.
+ *
+ * \public \memberof mlt_sidecar_s
+ * \return the byte budget
+ */
+
+int64_t mlt_sidecar_get_budget( )
+{
+	int64_t result;
+
+	pthread_mutex_lock( &mutex );
+	if ( budget < 0 )
+	{
+		const char *env = getenv( "MLT_SIDECAR_BYTES" );
+		budget = env ? MAX( strtoll( env, NULL, 10 ), 0 ) : SIDECAR_DEFAULT_BUDGET;
+	}
+	result = budget;
+	pthread_mutex_unlock( &mutex );
+	return result;
+}
+
+typedef struct
+{
+	char *filename;
+	int64_t size;
+	time_t mtime;
+}
+trim_entry;
+
+static int compare_mtime( const void *a, const void *b )
+{
+	const trim_entry *x = a;
+	const trim_entry *y = b;
+	return x->mtime < y->mtime ? -1 : x->mtime > y->mtime;
+}
+
+static int has_suffix( const char *name, const char *suffix )
+{
+	size_t n = strlen( name ), m = strlen( suffix );
+	return n > m && !strcmp( name + n - m, suffix );
+}
+
+/** Remove the least recently used records until the store is within its budget.
+ *
+ * This also removes the temporary files left over by writers that died.
+ *
+ * \public \memberof mlt_sidecar_s
+ */
+
+void mlt_sidecar_trim( )
+{
+	int64_t limit = mlt_sidecar_get_budget( );
+	char *dir = mlt_cache_directory( "MLT_SIDECAR_DIR", "sidecar", 0 );
+	DIR *d = dir ? opendir( dir ) : NULL;
+	trim_entry *entries = NULL;
+	int count = 0, allocated = 0, i;
+	int64_t total = 0;
+	time_t now = time( NULL );
+	struct dirent *de;
+
+	if ( !d )
+	{
+		free( dir );
+		return;
+	}
+	while ( ( de = readdir( d ) ) )
+	{
+		int is_record = has_suffix( de->d_name, SIDECAR_SUFFIX );
+		int is_temp = has_suffix( de->d_name, SIDECAR_TEMP );
+		char *filename;
+		struct stat st;
+
+		if ( !is_record && !is_temp )
+			continue;
+		filename = malloc( strlen( dir ) + strlen( de->d_name ) + 2 );
+		if ( !filename )
+			break;
+		sprintf( filename, "%s/%s", dir, de->d_name );
+		if ( stat( filename, &st ) || !S_ISREG( st.st_mode ) )
+		{
+			free( filename );
+		}
+		else if ( is_temp )
+		{
+			if ( now - st.st_mtime > SIDECAR_TEMP_AGE )
+				remove( filename );
+			free( filename );
+		}
+		else
+		{
+			if ( count == allocated )
+			{
+				trim_entry *more = realloc( entries, ( allocated = allocated ? allocated * 2 : 64 ) * sizeof( *entries ) );
+				if ( !more )
+				{
+					free( filename );
+					break;
+				}
+				entries = more;
+			}
+			entries[ count ].filename = filename;
+			entries[ count ].size = st.st_size;
+			entries[ count ].mtime = st.st_mtime;
+			total += st.st_size;
+			count++;
+		}
+	}
+	closedir( d );
+
+	// Leave some room so that every store does not trim again
+	if ( total > limit )
+	{
+		int64_t target = limit - limit / 10;
+		qsort( entries, count, sizeof( *entries ), compare_mtime );
+		for ( i = 0; i < count && total > target; i++ )
+		{
+			if ( !remove( entries[i].filename ) )
+				mlt_log_debug( NULL, "[sidecar] removed %s\n", entries[i].filename );
+			total -= entries[i].size;
+		}
+	}
+	for ( i = 0; i < count; i++ )
+		free( entries[i].filename );
+	free( entries );
+	free( dir );
+}
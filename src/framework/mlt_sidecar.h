@@ -0,0 +1,42 @@
+/**
+ * \file mlt_sidecar.h
+ * \brief on-disk store of data derived from media files
+ * \see mlt_sidecar_s
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_SIDECAR_H
+#define MLT_SIDECAR_H
+
+#include "mlt_types.h"
+#include <stddef.h>
+
+/**
+ * \envvar \em MLT_SIDECAR_DIR the directory of the sidecar store, defaults to mlt/sidecar in $XDG_CACHE_HOME or $HOME/.cache
+ * \envvar \em MLT_SIDECAR_BYTES the size the store is trimmed to, defaults to 1 GiB
+ */
+
+extern mlt_sidecar mlt_sidecar_open( const char *resource, const char *kind, const char *params );
+extern const void *mlt_sidecar_data( mlt_sidecar self, size_t *size );
+extern void mlt_sidecar_close( mlt_sidecar self );
+extern int mlt_sidecar_store( const char *resource, const char *kind, const char *params, const void *data, size_t size );
+extern void mlt_sidecar_set_budget( int64_t bytes );
+extern int64_t mlt_sidecar_get_budget( );
+extern void mlt_sidecar_trim( );
+
+#endif
@@ -20,12 +20,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "mlt_slices.h"
 #include "mlt_properties.h"
 #include "mlt_log.h"
 #include "mlt_factory.h"
+#include "mlt_trace.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <sched.h>
@@ -33,7 +40,9 @@
 #include <windows.h>
 #endif
 #define MAX_SLICES 32
+#define MAX_NODES 8
 #define ENV_SLICES "MLT_SLICES_COUNT"
+#define ENV_NUMA "MLT_NUMA"
 
 typedef enum {
 	mlt_policy_normal,
@@ -43,8 +52,15 @@ typedef enum {
 }
 mlt_schedule_policy;
 
+typedef enum {
+	mlt_numa_off,
+	mlt_numa_node,
+	mlt_numa_cpu
+}
+mlt_numa_mode;
+
 static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
-static mlt_slices globals[mlt_policy_nb] = {NULL, NULL, NULL};
+static mlt_slices globals[mlt_policy_nb][MAX_NODES];
 
 
 struct mlt_slices_runtime_s
@@ -53,6 +69,7 @@ struct mlt_slices_runtime_s
 	mlt_slices_proc proc;
 	void* cookie;
 	struct mlt_slices_runtime_s* next;
+	mlt_slices ctx;
 };
 
 struct mlt_slices_s
@@ -61,17 +78,215 @@ struct mlt_slices_s
 	int count;
 	int readys;
 	int ref;
+	int policy;
 	pthread_mutex_t cond_mutex;
 	pthread_cond_t cond_var_job;
 	pthread_cond_t cond_var_ready;
 	pthread_t threads[MAX_SLICES];
 	struct mlt_slices_runtime_s *head, *tail;
 	const char* name;
+	int node;
 };
 
+#if defined(__linux__)
+
+/** the processors of each memory node, read once from sysfs */
+
+static struct
+{
+	mlt_numa_mode mode;
+	int nodes;
+	int cpu_count[MAX_NODES];
+	cpu_set_t cpus[MAX_NODES];
+	signed char node_of_cpu[CPU_SETSIZE];
+}
+numa;
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+/* parse a sysfs cpu list such as 0-7,16-23 */
+static int parse_cpulist( const char *path, cpu_set_t *set )
+{
+	FILE *file = fopen( path, "r" );
+	char list[ 1024 ];
+	char *token, *saveptr = NULL;
+	int count = 0;
+
+	CPU_ZERO( set );
+	if ( !file )
+		return 0;
+	if ( fgets( list, sizeof( list ), file ) )
+	{
+		for ( token = strtok_r( list, ",\n", &saveptr ); token; token = strtok_r( NULL, ",\n", &saveptr ) )
+		{
+			int first = 0, last = -1;
+			if ( sscanf( token, "%d-%d", &first, &last ) < 2 )
+				last = first;
+			for ( ; first <= last && first < CPU_SETSIZE; first++ )
+			{
+				CPU_SET( first, set );
+				count++;
+			}
+		}
+	}
+	fclose( file );
+	return count;
+}
+
+static void numa_init( )
+{
+	const char *env = getenv( ENV_NUMA );
+	cpu_set_t allowed;
+	int node;
+
+	memset( numa.node_of_cpu, 0, sizeof( numa.node_of_cpu ) );
+	numa.mode = !env || !strcmp( env, "" ) || !strcmp( env, "0" ) ? mlt_numa_off :
+		!strcmp( env, "cpu" ) ? mlt_numa_cpu : mlt_numa_node;
+	numa.nodes = 1;
+	if ( numa.mode == mlt_numa_off || sched_getaffinity( 0, sizeof( allowed ), &allowed ) )
+	{
+		numa.mode = mlt_numa_off;
+		return;
+	}
+
+	// Only use the processors this process may run on
+	for ( numa.nodes = 0, node = 0; node < 64 && numa.nodes < MAX_NODES; node++ )
+	{
+		char path[ 64 ];
+		cpu_set_t set;
+		int cpu;
+
+		snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d/cpulist", node );
+		if ( !parse_cpulist( path, &set ) )
+			continue;
+		CPU_AND( &set, &set, &allowed );
+		if ( !CPU_COUNT( &set ) )
+			continue;
+		numa.cpus[ numa.nodes ] = set;
+		numa.cpu_count[ numa.nodes ] = CPU_COUNT( &set );
+		for ( cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+			if ( CPU_ISSET( cpu, &set ) )
+				numa.node_of_cpu[ cpu ] = numa.nodes;
+		numa.nodes++;
+	}
+	if ( numa.nodes == 0 )
+	{
+		// No sysfs topology, so treat the allowed processors as one node
+		numa.cpus[ 0 ] = allowed;
+		numa.cpu_count[ 0 ] = CPU_COUNT( &allowed );
+		numa.nodes = 1;
+	}
+	mlt_log_verbose( NULL, "[mlt_slices] %s placement on %d memory nodes\n",
+		numa.mode == mlt_numa_cpu ? "processor" : "node", numa.nodes );
+}
+
+static int numa_enabled( )
+{
+	pthread_once( &numa_once, numa_init );
+	return numa.mode != mlt_numa_off;
+}
+
+/* bind the calling thread to a node, or to one processor of it */
+static int numa_bind( int node, int index )
+{
+	cpu_set_t set;
+
+	if ( !numa_enabled( ) || node < 0 )
+		return 1;
+	node %= numa.nodes;
+	set = numa.cpus[ node ];
+	if ( numa.mode == mlt_numa_cpu && index >= 0 )
+	{
+		int cpu, n = index % numa.cpu_count[ node ];
+		for ( cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+			if ( CPU_ISSET( cpu, &numa.cpus[ node ] ) && n-- == 0 )
+				break;
+		CPU_ZERO( &set );
+		CPU_SET( cpu, &set );
+	}
+	return pthread_setaffinity_np( pthread_self( ), sizeof( set ), &set );
+}
+
+static int numa_current( )
+{
+	int cpu;
+	if ( !numa_enabled( ) || ( cpu = sched_getcpu( ) ) < 0 || cpu >= CPU_SETSIZE )
+		return 0;
+	return numa.node_of_cpu[ cpu ];
+}
+
+static int numa_cpus( int node )
+{
+	return numa_enabled( ) ? numa.cpu_count[ node % numa.nodes ] : 0;
+}
+
+static int numa_nodes( )
+{
+	return numa_enabled( ) ? numa.nodes : 1;
+}
+
+#else
+
+static int numa_bind( int node, int index ) { return 1; }
+static int numa_current( ) { return 0; }
+static int numa_cpus( int node ) { return 0; }
+static int numa_nodes( ) { return 1; }
+
+#endif
+
+/* claim the next job of a runtime, called with cond_mutex held */
+static int mlt_slices_claim( mlt_slices ctx, struct mlt_slices_runtime_s* r )
+{
+	int idx = r->curr++;
+
+	/* unlink the runtime once all its jobs are claimed so the queue never
+	 * references a runtime whose caller already returned */
+	if ( r->curr == r->jobs )
+	{
+		struct mlt_slices_runtime_s *prev = NULL, *i = ctx->head;
+		while ( i && i != r )
+		{
+			prev = i;
+			i = i->next;
+		}
+		if ( i )
+		{
+			if ( prev )
+				prev->next = r->next;
+			else
+				ctx->head = r->next;
+			if ( ctx->tail == r )
+				ctx->tail = prev;
+		}
+	}
+
+	return idx;
+}
+
+/* run one claimed job, called with cond_mutex held */
+static void mlt_slices_execute( mlt_slices ctx, struct mlt_slices_runtime_s* r, int id, int idx )
+{
+	pthread_mutex_unlock( &ctx->cond_mutex );
+	mlt_log_debug( NULL, "%s:%d: running job: id=%d, idx=%d/%d, pool=[%s]\n", __FUNCTION__, __LINE__,
+		id, idx, r->jobs, ctx->name );
+	int64_t trace = mlt_trace_begin( );
+	r->proc( id, idx, r->jobs, r->cookie );
+	mlt_trace_end( "slices", ctx->name, trace );
+	pthread_mutex_lock( &ctx->cond_mutex );
+
+	/* increase done jobs counter */
+	r->done++;
+
+	/* notify we fininished last job */
+	if ( r->done == r->jobs )
+	{
+		mlt_log_debug( NULL, "%s:%d: pthread_cond_signal( &ctx->cond_var_ready )\n", __FUNCTION__, __LINE__ );
+		pthread_cond_broadcast( &ctx->cond_var_ready );
+	}
+}
+
 static void* mlt_slices_worker( void* p )
 {
-	int id, idx;
+	int id;
 	struct mlt_slices_runtime_s* r;
 	mlt_slices ctx = (mlt_slices)p;
 
@@ -82,6 +297,17 @@ static void* mlt_slices_worker( void* p )
 	id = ctx->readys;
 	ctx->readys++;
 
+	/* keep the workers of a node pool and their memory on the node */
+	if ( ctx->node >= 0 )
+		numa_bind( ctx->node, id );
+
+	if ( mlt_trace_enabled() )
+	{
+		char name[64];
+		snprintf( name, sizeof( name ), "slices %s %d", ctx->name, id );
+		mlt_trace_thread( name );
+	}
+
 	while ( 1 )
 	{
 		mlt_log_debug( NULL, "%s:%d: ctx=[%p][%s] waiting\n", __FUNCTION__, __LINE__ , ctx, ctx->name );
@@ -96,54 +322,91 @@ static void* mlt_slices_worker( void* p )
 		if ( !r )
 			continue;
 
-		/* check if no new job */
-		if ( r->curr == r->jobs )
-		{
-			ctx->head = ctx->head->next;
-			if ( !ctx->head )
-				ctx->tail = NULL;
-			mlt_log_debug( NULL, "%s:%d: new ctx->head=%p\n", __FUNCTION__, __LINE__, ctx->head );
-			continue;
-		};
+		/* new job id and run job */
+		mlt_slices_execute( ctx, r, id, mlt_slices_claim( ctx, r ) );
+	}
 
-		/* new job id */
-		idx = r->curr;
-		r->curr++;
+	pthread_mutex_unlock( &ctx->cond_mutex );
 
-		/* run job */
-		pthread_mutex_unlock( &ctx->cond_mutex );
-		mlt_log_debug( NULL, "%s:%d: running job: id=%d, idx=%d/%d, pool=[%s]\n", __FUNCTION__, __LINE__,
-			id, idx, r->jobs, ctx->name );
-		r->proc( id, idx, r->jobs, r->cookie );
-		pthread_mutex_lock( &ctx->cond_mutex );
+	return NULL;
+}
 
-		/* increase done jobs counter */
-		r->done++;
+/* find the worker id of the calling thread or -1 if it is not a worker of ctx */
+static int mlt_slices_worker_id( mlt_slices ctx )
+{
+	pthread_t self = pthread_self();
+	int i;
+	for ( i = 0; i < ctx->count; i++ )
+		if ( pthread_equal( ctx->threads[i], self ) )
+			return i;
+	return -1;
+}
 
-		/* notify we fininished last job */
-		if ( r->done == r->jobs )
-		{
-			mlt_log_debug( NULL, "%s:%d: pthread_cond_signal( &ctx->cond_var_ready )\n", __FUNCTION__, __LINE__ );
-			pthread_cond_broadcast( &ctx->cond_var_ready );
-		}
-	}
+/* queue a runtime, called with cond_mutex held */
+static void mlt_slices_attach( mlt_slices ctx, struct mlt_slices_runtime_s* r, int jobs, mlt_slices_proc proc, void* cookie )
+{
+	/* check jobs count */
+	if ( jobs < 0 )
+		jobs = (-jobs) * ctx->count;
+	if ( !jobs )
+		jobs = ctx->count;
 
-	pthread_mutex_unlock( &ctx->cond_mutex );
+	/* setup runtime args */
+	r->jobs = jobs;
+	r->done = 0;
+	r->curr = 0;
+	r->proc = proc;
+	r->cookie = cookie;
+	r->next = NULL;
+	r->ctx = ctx;
 
-	return NULL;
+	/* attach job */
+	if ( ctx->tail )
+	{
+		ctx->tail->next = r;
+		ctx->tail = r;
+	}
+	else
+	{
+		ctx->head = ctx->tail = r;
+	}
+
+	/* notify workers */
+	pthread_cond_broadcast( &ctx->cond_var_job );
 }
 
-/** Initialize a sliced threading context
+/* wait for a runtime to finish, called with cond_mutex held
  *
- * \public \memberof mlt_slices_s
- * \deprecated
- * \param threads number of threads to use for job list, 0 for #cpus
- * \param policy scheduling policy of processing threads, -1 for normal
- * \param priority priority value that can be used with the scheduling algorithm, -1 for maximum
- * \return the context pointer
+ * Rather than sleeping, the caller runs the unclaimed jobs of its own
+ * runtime. This avoids a deadlock when a job itself runs slices on the same
+ * context because the calling worker never blocks with work left to do. For
+ * the real-time policies, only nested callers help so that jobs keep the
+ * priority of the workers.
  */
+static void mlt_slices_wait_locked( mlt_slices ctx, struct mlt_slices_runtime_s* r )
+{
+	int id = mlt_slices_worker_id( ctx );
+	int help = id >= 0 || ctx->policy == SCHED_OTHER;
 
-mlt_slices mlt_slices_init( int threads, int policy, int priority )
+	if ( id < 0 )
+		id = ctx->count;
+
+	while( !ctx->f_exit && ( r->done < r->jobs ) )
+	{
+		if ( help && r->curr < r->jobs )
+		{
+			mlt_slices_execute( ctx, r, id, mlt_slices_claim( ctx, r ) );
+		}
+		else
+		{
+			pthread_cond_wait( &ctx->cond_var_ready, &ctx->cond_mutex );
+			mlt_log_debug( NULL, "%s:%d: ctx=[%p][%s] signalled\n", __FUNCTION__, __LINE__ , ctx, ctx->name );
+		}
+	}
+}
+
+/* create a context, with its workers on a memory node unless node is negative */
+static mlt_slices mlt_slices_new( int threads, int policy, int priority, int node )
 {
 	pthread_attr_t tattr;
 	struct sched_param param;
@@ -158,7 +421,7 @@ mlt_slices mlt_slices_init( int threads, int policy, int priority )
 		int cpus = info.dwNumberOfProcessors;
 	#endif
 #else
-	int cpus = sysconf( _SC_NPROCESSORS_ONLN );
+	int cpus = node >= 0 && numa_cpus( node ) ? numa_cpus( node ) : sysconf( _SC_NPROCESSORS_ONLN );
 #endif
 	int i, env_val = env ? atoi(env) : 0;
 
@@ -190,6 +453,8 @@ mlt_slices mlt_slices_init( int threads, int policy, int priority )
 		threads = MAX_SLICES;
 
 	ctx->count = threads;
+	ctx->node = node;
+	ctx->policy = policy < 0 ? SCHED_OTHER : policy;
 
 	/* init attributes */
 	pthread_mutex_init ( &ctx->cond_mutex, NULL );
@@ -217,6 +482,21 @@ mlt_slices mlt_slices_init( int threads, int policy, int priority )
 	return ctx;
 }
 
+/** Initialize a sliced threading context
+ *
+ * \public \memberof mlt_slices_s
+ * \deprecated
+ * \param threads number of threads to use for job list, 0 for #cpus
+ * \param policy scheduling policy of processing threads, -1 for normal
+ * \param priority priority value that can be used with the scheduling algorithm, -1 for maximum
+ * \return the context pointer
+ */
+
+mlt_slices mlt_slices_init( int threads, int policy, int priority )
+{
+	return mlt_slices_new( threads, policy, priority, -1 );
+}
+
 /** Destroy sliced threading context
  *
  * \public \memberof mlt_slices_s
@@ -263,6 +543,11 @@ void mlt_slices_close( mlt_slices ctx )
 }
 
 /** Run sliced execution
+ *
+ * The calling thread may run some of the jobs itself, in which case \p proc
+ * receives an id equal to the number of threads of the context unless the
+ * caller is itself a worker of \p ctx. It is safe to call this from within a
+ * job running on the same context.
  *
  * \public \memberof mlt_slices_s
  * \deprecated
@@ -278,47 +563,66 @@ void mlt_slices_run( mlt_slices ctx, int jobs, mlt_slices_proc proc, void* cooki
 	/* lock */
 	pthread_mutex_lock( &ctx->cond_mutex);
 
-	/* check jobs count */
-	if ( jobs < 0 )
-		jobs = (-jobs) * ctx->count;
-	if ( !jobs )
-		jobs = ctx->count;
+	mlt_slices_attach( ctx, r, jobs, proc, cookie );
 
-	/* setup runtime args */
-	r->jobs = jobs;
-	r->done = 0;
-	r->curr = 0;
-	r->proc = proc;
-	r->cookie = cookie;
-	r->next = NULL;
+	/* wait for end of task */
+	mlt_slices_wait_locked( ctx, r );
 
-	/* attach job */
-	if ( ctx->tail )
-	{
-		ctx->tail->next = r;
-		ctx->tail = r;
-	}
-	else
+	pthread_mutex_unlock( &ctx->cond_mutex);
+}
+
+/** Start sliced execution without waiting for it.
+ *
+ * Each call returns its own completion token, so a caller only ever waits
+ * for its own jobs even when many threads share the context.
+ *
+ * \public \memberof mlt_slices_s
+ * \param ctx context pointer
+ * \param jobs number of jobs to process
+ * \param proc number of jobs to process
+ * \param cookie an opaque pointer passed to every job
+ * \return a token that must be passed to mlt_slices_wait()
+ */
+
+mlt_slices_runtime mlt_slices_submit( mlt_slices ctx, int jobs, mlt_slices_proc proc, void* cookie )
+{
+	struct mlt_slices_runtime_s *r = (struct mlt_slices_runtime_s*)calloc( 1, sizeof( *r ) );
+
+	if ( r )
 	{
-		ctx->head = ctx->tail = r;
+		pthread_mutex_lock( &ctx->cond_mutex );
+		mlt_slices_attach( ctx, r, jobs, proc, cookie );
+		pthread_mutex_unlock( &ctx->cond_mutex );
 	}
 
-	/* notify workers */
-	pthread_cond_broadcast( &ctx->cond_var_job );
+	return r;
+}
 
-	/* wait for end of task */
-	while( !ctx->f_exit && ( r->done < r->jobs ) )
+/** Wait for the jobs of mlt_slices_submit() to finish.
+ *
+ * This releases the token.
+ *
+ * \public \memberof mlt_slices_s
+ * \param runtime the token returned by mlt_slices_submit()
+ */
+
+void mlt_slices_wait( mlt_slices_runtime runtime )
+{
+	if ( runtime )
 	{
-		pthread_cond_wait( &ctx->cond_var_ready, &ctx->cond_mutex );
-		mlt_log_debug( NULL, "%s:%d: ctx=[%p][%s] signalled\n", __FUNCTION__, __LINE__ , ctx, ctx->name );
+		mlt_slices ctx = runtime->ctx;
+		pthread_mutex_lock( &ctx->cond_mutex );
+		mlt_slices_wait_locked( ctx, runtime );
+		pthread_mutex_unlock( &ctx->cond_mutex );
+		free( runtime );
 	}
-
-	pthread_mutex_unlock( &ctx->cond_mutex);
 }
 
 /** Get a global shared sliced threading context.
  *
- * There are separate contexts for each scheduling policy.
+ * There are separate contexts for each scheduling policy. With \envvar
+ * MLT_NUMA set, each memory node also has its own, and a caller gets the one
+ * of the node it runs on so that the slices of a frame stay on one socket.
  *
  * \private \memberof mlt_slices_s
  * \param policy the thread scheduling policy needed
@@ -327,8 +631,12 @@ void mlt_slices_run( mlt_slices ctx, int jobs, mlt_slices_proc proc, void* cooki
 
 static mlt_slices mlt_slices_get_global( mlt_schedule_policy policy )
 {
+	int nodes = numa_nodes();
+	int node = nodes > 1 ? numa_current() : 0;
+	mlt_slices ctx;
+
 	pthread_mutex_lock( &g_lock );
-	if ( !globals[policy] )
+	if ( !globals[policy][node] )
 	{
 		int posix_policy;
 		switch (policy) {
@@ -341,12 +649,54 @@ static mlt_slices mlt_slices_get_global( mlt_schedule_policy policy )
 		default:
 			posix_policy = SCHED_OTHER;
 		}
-		globals[policy] = mlt_slices_init( 0, posix_policy, -1 );
-		mlt_factory_register_for_clean_up( globals[policy], (mlt_destructor) mlt_slices_close );
+		globals[policy][node] = mlt_slices_new( 0, posix_policy, -1, nodes > 1 ? node : -1 );
+		mlt_factory_register_for_clean_up( globals[policy][node], (mlt_destructor) mlt_slices_close );
 	}
+	ctx = globals[policy][node];
 	pthread_mutex_unlock( &g_lock );
 
-	return globals[policy];
+	return ctx;
+}
+
+/** Get the number of memory nodes threads are placed on.
+ *
+ * This is 1 unless \envvar MLT_NUMA is set on a machine with several nodes.
+ *
+ * \public \memberof mlt_slices_s
+ * \return the number of nodes
+ */
+
+int mlt_slices_numa_nodes()
+{
+	return numa_nodes();
+}
+
+/** Get the memory node of the processor running the calling thread.
+ *
+ * \public \memberof mlt_slices_s
+ * \return the node, 0 when threads are not placed on nodes
+ */
+
+int mlt_slices_numa_node()
+{
+	return numa_nodes() > 1 ? numa_current() : 0;
+}
+
+/** Bind the calling thread to the processors of a memory node.
+ *
+ * With \envvar MLT_NUMA=cpu, the thread is bound to a single processor of
+ * the node chosen by \p index instead. This does nothing unless \envvar
+ * MLT_NUMA is set.
+ *
+ * \public \memberof mlt_slices_s
+ * \param node a node, which wraps around the number of nodes
+ * \param index picks the processor for MLT_NUMA=cpu, or -1 for the whole node
+ * \return true if the thread is not bound
+ */
+
+int mlt_slices_bind_node( int node, int index )
+{
+	return numa_bind( node, index );
 }
 
 /** Get the number of slices for the normal scheduling policy.
@@ -411,3 +761,9 @@ void mlt_slices_run_fifo(int jobs, mlt_slices_proc proc, void *cookie)
 	return mlt_slices_run( mlt_slices_get_global( mlt_policy_fifo ),
 	   jobs, proc, cookie );
 }
+
+mlt_slices_runtime mlt_slices_submit_normal( int jobs, mlt_slices_proc proc, void *cookie )
+{
+	return mlt_slices_submit( mlt_slices_get_global( mlt_policy_normal ),
+	   jobs, proc, cookie );
+}
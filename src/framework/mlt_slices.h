@@ -28,10 +28,15 @@
 /**
  * \envvar \em MLT_SLICES_COUNT Set the number of slices to use, which
  * defaults to number of CPUs found.
+ * \envvar \em MLT_NUMA Set to 1 to keep the slices and the consumer workers
+ * on memory nodes, or to cpu to also bind each of them to one processor.
  */
 
 struct mlt_slices_s;
 
+/** an opaque completion token for jobs started with mlt_slices_submit() */
+typedef struct mlt_slices_runtime_s *mlt_slices_runtime;
+
 typedef int (*mlt_slices_proc)( int id, int idx, int jobs, void* cookie );
 
 extern mlt_slices mlt_slices_init( int threads, int policy, int priority );
@@ -40,6 +45,10 @@ extern void mlt_slices_close( mlt_slices ctx );
 
 extern void mlt_slices_run( mlt_slices ctx, int jobs, mlt_slices_proc proc, void* cookie );
 
+extern mlt_slices_runtime mlt_slices_submit( mlt_slices ctx, int jobs, mlt_slices_proc proc, void* cookie );
+
+extern void mlt_slices_wait( mlt_slices_runtime runtime );
+
 extern int mlt_slices_count_normal();
 
 extern int mlt_slices_count_rr();
@@ -52,4 +61,12 @@ extern void mlt_slices_run_rr( int jobs, mlt_slices_proc proc, void* cookie );
 
 extern void mlt_slices_run_fifo( int jobs, mlt_slices_proc proc, void* cookie );
 
+extern mlt_slices_runtime mlt_slices_submit_normal( int jobs, mlt_slices_proc proc, void* cookie );
+
+extern int mlt_slices_numa_nodes();
+
+extern int mlt_slices_numa_node();
+
+extern int mlt_slices_bind_node( int node, int index );
+
 #endif
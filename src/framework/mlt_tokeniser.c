@@ -37,38 +37,58 @@ mlt_tokeniser mlt_tokeniser_init( )
 	tokeniser->tokens = NULL;
 	tokeniser->count = 0;
 	tokeniser->size = 0;
+	tokeniser->spans = NULL;
+	tokeniser->capacity = 0;
 	return tokeniser;
 }
 
-/** Clear the tokeniser.
+/** Clear the tokeniser and make room for the input and its tokens.
+ *
+ * The buffer holds a copy of the input followed by a second copy that the
+ * tokens point into, and it is kept for the next parse.
 */
 
-static void mlt_tokeniser_clear( mlt_tokeniser tokeniser )
+static int mlt_tokeniser_clear( mlt_tokeniser tokeniser, int length )
 {
-	int index = 0;
-	for ( index = 0; index < tokeniser->count; index ++ )
-		free( tokeniser->tokens[ index ] );
 	tokeniser->count = 0;
-	free( tokeniser->input );
-	tokeniser->input = NULL;
+	if ( 2 * ( length + 1 ) > tokeniser->capacity )
+	{
+		char *input = realloc( tokeniser->input, 2 * ( length + 1 ) );
+		if ( input == NULL )
+			return -1;
+		tokeniser->input = input;
+		tokeniser->capacity = 2 * ( length + 1 );
+	}
+	return 0;
 }
 
-/** Append a string to the tokeniser.
+/** Append the token found at a span of the input.
 */
 
-static int mlt_tokeniser_append( mlt_tokeniser tokeniser, char *token )
+static int mlt_tokeniser_append( mlt_tokeniser tokeniser, int length, int offset, int end )
 {
 	int error = 0;
 
 	if ( tokeniser->count == tokeniser->size )
 	{
-		tokeniser->size += 20;
-		tokeniser->tokens = realloc( tokeniser->tokens, tokeniser->size * sizeof( char * ) );
+		char **tokens = realloc( tokeniser->tokens, ( tokeniser->size + 20 ) * sizeof( char * ) );
+		int *spans = realloc( tokeniser->spans, ( tokeniser->size + 20 ) * 2 * sizeof( int ) );
+		if ( tokens )
+			tokeniser->tokens = tokens;
+		if ( spans )
+			tokeniser->spans = spans;
+		if ( tokens && spans )
+			tokeniser->size += 20;
 	}
 
-	if ( tokeniser->tokens != NULL )
+	if ( tokeniser->count < tokeniser->size )
 	{
-		tokeniser->tokens[ tokeniser->count ++ ] = strdup( token );
+		char *buffer = tokeniser->input + length + 1;
+		buffer[ end ] = '\0';
+		tokeniser->tokens[ tokeniser->count ] = buffer + offset;
+		tokeniser->spans[ 2 * tokeniser->count ] = offset;
+		tokeniser->spans[ 2 * tokeniser->count + 1 ] = end - offset;
+		tokeniser->count ++;
 	}
 	else
 	{
@@ -79,6 +99,10 @@ static int mlt_tokeniser_append( mlt_tokeniser tokeniser, char *token )
 }
 
 /** Parse a string by splitting on the delimiter provided.
+ *
+ * A token that opens a quote extends over the delimiters until the one that
+ * closes it. The tokens are spans of one copy of the input, so parsing does
+ * no allocation once the tokeniser has grown to the size of its input.
 */
 
 int mlt_tokeniser_parse_new( mlt_tokeniser tokeniser, char *string, const char *delimiter )
@@ -88,54 +112,56 @@ int mlt_tokeniser_parse_new( mlt_tokeniser tokeniser, char *string, const char *
 	int length = strlen( string );
 	int delimiter_size = strlen( delimiter );
 	int index = 0;
-	char *token = strdup( string );
+	int token = -1;
 
-	mlt_tokeniser_clear( tokeniser );
-	tokeniser->input = strdup( string );
-	strcpy( token, "" );
+	if ( mlt_tokeniser_clear( tokeniser, length ) )
+		return 0;
+	memcpy( tokeniser->input, string, length + 1 );
+	memcpy( tokeniser->input + length + 1, string, length + 1 );
 
 	for ( index = 0; index < length; )
 	{
 		char *start = string + index;
 		char *end = strstr( start, delimiter );
 
+		if ( token < 0 )
+			token = index;
+
 		if ( end == NULL )
 		{
-			strcat( token, start );
-			mlt_tokeniser_append( tokeniser, token );
+			mlt_tokeniser_append( tokeniser, length, token, length );
 			index = length;
 			count ++;
 		}
 		else if ( start != end )
 		{
-			strncat( token, start, end - start );
 			index += end - start;
-			if ( strchr( token, '\"' ) == NULL || token[ strlen( token ) - 1 ] == '\"' )
+			if ( memchr( string + token, '\"', index - token ) == NULL || string[ index - 1 ] == '\"' )
 			{
-				mlt_tokeniser_append( tokeniser, token );
-				strcpy( token, "" );
+				mlt_tokeniser_append( tokeniser, length, token, index );
+				token = -1;
 				count ++;
 			}
 			else while ( strncmp( string + index, delimiter, delimiter_size ) == 0 )
 			{
-				strncat( token, delimiter, delimiter_size );
 				index += delimiter_size;
 			}
 		}
 		else
 		{
+			if ( token == index )
+				token = -1;
 			index += delimiter_size;
 		}
 	}
 
 	/* Special case - malformed string condition */
-	if ( !strcmp( token, "" ) )
+	if ( token < 0 )
 	{
 		count = 0 - ( count - 1 );
-		mlt_tokeniser_append( tokeniser, token );
+		mlt_tokeniser_append( tokeniser, length, length, length );
 	}
 
-	free( token );
 	return count;
 }
 
@@ -166,12 +192,30 @@ char *mlt_tokeniser_get_string( mlt_tokeniser tokeniser, int index )
 		return NULL;
 }
 
+/** Get where a token is in the original input.
+ *
+ * This lets a parser work on the input without copying the token.
+ * \return true if the index is out of range
+*/
+
+int mlt_tokeniser_get_span( mlt_tokeniser tokeniser, int index, int *offset, int *length )
+{
+	if ( index < 0 || index >= tokeniser->count )
+		return 1;
+	if ( offset )
+		*offset = tokeniser->spans[ 2 * index ];
+	if ( length )
+		*length = tokeniser->spans[ 2 * index + 1 ];
+	return 0;
+}
+
 /** Close the tokeniser.
 */
 
 void mlt_tokeniser_close( mlt_tokeniser tokeniser )
 {
-	mlt_tokeniser_clear( tokeniser );
+	free( tokeniser->input );
 	free( tokeniser->tokens );
+	free( tokeniser->spans );
 	free( tokeniser );
 }
@@ -33,6 +33,8 @@ typedef struct
 	char **tokens;
 	int count;
 	int size;
+	int *spans;     /**< the offset and length in the input of each token */
+	int capacity;   /**< the size of the buffer at input, which also holds the tokens */
 }
 *mlt_tokeniser, mlt_tokeniser_t;
 
@@ -44,6 +46,7 @@ extern int mlt_tokeniser_parse_new( mlt_tokeniser tokeniser, char *text, const c
 extern char *mlt_tokeniser_get_input( mlt_tokeniser tokeniser );
 extern int mlt_tokeniser_count( mlt_tokeniser tokeniser );
 extern char *mlt_tokeniser_get_string( mlt_tokeniser tokeniser, int index );
+extern int mlt_tokeniser_get_span( mlt_tokeniser tokeniser, int index, int *offset, int *length );
 extern void mlt_tokeniser_close( mlt_tokeniser tokeniser );
 
 #endif
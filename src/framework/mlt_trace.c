@@ -0,0 +1,259 @@
+/**
+ * \file mlt_trace.c
+ * \brief timeline of the rendering in the Chrome trace event format
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mlt_trace.h"
+#include "mlt_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/** the number of events a thread buffers before it writes them */
+#define TRACE_EVENTS 4096
+
+/** the longest name of an event or thread */
+#define TRACE_NAME 48
+
+typedef struct
+{
+	int64_t begin;
+	int64_t duration;
+	const char *category;
+	char name[ TRACE_NAME ];
+}
+trace_event;
+
+/** \brief private to mlt_trace, the events of one thread
+ *
+ * Only the owning thread appends to its buffer, so recording an event takes
+ * no lock. The buffer is written to the file when it is full, when the thread
+ * ends and when tracing stops.
+ */
+
+typedef struct trace_buffer_s
+{
+	int count;
+	int tid;
+	char name[ TRACE_NAME ];
+	int named;                    ///< whether the name is in the file
+	struct trace_buffer_s *next;
+	struct trace_buffer_s *prev;
+	trace_event events[ TRACE_EVENTS ];
+}
+*trace_buffer;
+
+int mlt_trace_active = 0;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+static trace_buffer buffers = NULL;
+static FILE *file = NULL;
+static int written = 0;
+static int threads = 0;
+static int64_t origin = 0;
+
+static int64_t time_us( void )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return ( int64_t ) tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Copy a name, keeping the JSON valid.
+static void copy_name( char *dst, const char *src )
+{
+	int i;
+	for ( i = 0; src && src[ i ] && i < TRACE_NAME - 1; i ++ )
+		dst[ i ] = ( src[ i ] == '"' || src[ i ] == '\\' || (unsigned char) src[ i ] < ' ' ) ? '_' : src[ i ];
+	dst[ i ] = '\0';
+}
+
+/* Write the events of a buffer, called with the trace mutex held. */
+static void buffer_flush( trace_buffer buffer )
+{
+	int pid = getpid( );
+	int i;
+
+	if ( file && buffer->name[ 0 ] && !buffer->named )
+	{
+		fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			written ++ ? ",\n" : "", pid, buffer->tid, buffer->name );
+		buffer->named = 1;
+	}
+	for ( i = 0; file && i < buffer->count; i ++ )
+	{
+		trace_event *event = &buffer->events[ i ];
+		fprintf( file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%"PRId64",\"dur\":%"PRId64",\"pid\":%d,\"tid\":%d}",
+			written ++ ? ",\n" : "", event->name, event->category, event->begin, event->duration, pid, buffer->tid );
+	}
+	buffer->count = 0;
+}
+
+static void buffer_close( void *arg )
+{
+	trace_buffer buffer = arg;
+
+	pthread_mutex_lock( &trace_mutex );
+	buffer_flush( buffer );
+	if ( buffer->prev )
+		buffer->prev->next = buffer->next;
+	else
+		buffers = buffer->next;
+	if ( buffer->next )
+		buffer->next->prev = buffer->prev;
+	pthread_mutex_unlock( &trace_mutex );
+	free( buffer );
+}
+
+static void buffer_key_init( )
+{
+	pthread_key_create( &buffer_key, buffer_close );
+}
+
+// Get the buffer of the calling thread, creating it on first use.
+static trace_buffer buffer_get( )
+{
+	trace_buffer buffer;
+
+	pthread_once( &buffer_once, buffer_key_init );
+	buffer = pthread_getspecific( buffer_key );
+	if ( !buffer && ( buffer = calloc( 1, sizeof( struct trace_buffer_s ) ) ) )
+	{
+		pthread_mutex_lock( &trace_mutex );
+		buffer->tid = ++ threads;
+		buffer->next = buffers;
+		if ( buffers )
+			buffers->prev = buffer;
+		buffers = buffer;
+		pthread_mutex_unlock( &trace_mutex );
+		pthread_setspecific( buffer_key, buffer );
+	}
+	return buffer;
+}
+
+/** Start tracing if the environment variable \envvar MLT_TRACE names a file.
+ *
+ * This is called by mlt_factory_init().
+ */
+
+void mlt_trace_init( )
+{
+	const char *name = getenv( "MLT_TRACE" );
+
+	pthread_mutex_lock( &trace_mutex );
+	if ( !file && name && strcmp( name, "" ) )
+	{
+		file = fopen( name, "w" );
+		if ( file )
+		{
+			fputs( "[\n", file );
+			written = 0;
+			origin = time_us( ) - 1;
+			mlt_trace_active = 1;
+		}
+		else
+		{
+			mlt_log_warning( NULL, "[mlt_trace] cannot write %s\n", name );
+		}
+	}
+	pthread_mutex_unlock( &trace_mutex );
+}
+
+/** Stop tracing and write the remaining events of every thread.
+ *
+ * This is called by mlt_factory_close().
+ */
+
+void mlt_trace_close( )
+{
+	trace_buffer buffer;
+
+	mlt_trace_active = 0;
+	pthread_mutex_lock( &trace_mutex );
+	for ( buffer = buffers; buffer; buffer = buffer->next )
+		buffer_flush( buffer );
+	if ( file )
+	{
+		fputs( "\n]\n", file );
+		fclose( file );
+		file = NULL;
+	}
+	pthread_mutex_unlock( &trace_mutex );
+}
+
+/** Get the time on the timeline.
+ *
+ * \return microseconds since tracing started, never 0
+ */
+
+int64_t mlt_trace_now( )
+{
+	return time_us( ) - origin;
+}
+
+/** Record a span of work of the calling thread.
+ *
+ * \param category a string constant that groups the events, such as "consumer"
+ * \param name the name of the span, such as the id of a service
+ * \param begin the start time from mlt_trace_begin()
+ * \param end the end time from mlt_trace_now()
+ */
+
+void mlt_trace_event( const char *category, const char *name, int64_t begin, int64_t end )
+{
+	trace_buffer buffer = mlt_trace_active ? buffer_get( ) : NULL;
+
+	if ( buffer )
+	{
+		trace_event *event = &buffer->events[ buffer->count ++ ];
+		event->begin = begin;
+		event->duration = end - begin;
+		event->category = category;
+		copy_name( event->name, name );
+		if ( buffer->count == TRACE_EVENTS )
+		{
+			pthread_mutex_lock( &trace_mutex );
+			buffer_flush( buffer );
+			pthread_mutex_unlock( &trace_mutex );
+		}
+	}
+}
+
+/** Name the calling thread on the timeline.
+ *
+ * \param name a name such as "read-ahead"
+ */
+
+void mlt_trace_thread( const char *name )
+{
+	trace_buffer buffer = mlt_trace_active ? buffer_get( ) : NULL;
+
+	if ( buffer )
+	{
+		copy_name( buffer->name, name );
+		buffer->named = 0;
+	}
+}
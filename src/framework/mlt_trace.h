@@ -0,0 +1,48 @@
+/**
+ * \file mlt_trace.h
+ * \brief timeline of the rendering in the Chrome trace event format
+ *
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_TRACE_H
+#define MLT_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * \envvar \em MLT_TRACE the file to which to write a timeline of the threads, for chrome://tracing or Perfetto
+ */
+
+extern int mlt_trace_active;
+
+#define mlt_trace_enabled() ( mlt_trace_active )
+
+/** Get the start time of a span, or 0 if tracing is off. */
+#define mlt_trace_begin() ( mlt_trace_enabled() ? mlt_trace_now() : 0 )
+
+/** Record a span that started at \p begin, which must come from mlt_trace_begin(). */
+#define mlt_trace_end(category, name, begin) \
+	( (begin) ? mlt_trace_event( (category), (name), (begin), mlt_trace_now() ) : (void) 0 )
+
+extern void mlt_trace_init( );
+extern void mlt_trace_close( );
+extern int64_t mlt_trace_now( );
+extern void mlt_trace_event( const char *category, const char *name, int64_t begin, int64_t end );
+extern void mlt_trace_thread( const char *name );
+
+#endif
@@ -351,6 +351,17 @@ mlt_producer mlt_tractor_get_track( mlt_tractor self, int index )
 	return mlt_multitrack_track( mlt_tractor_multitrack( self ), index );
 }
 
+// Let the frame of a track add to the stats of a traced tractor frame.
+static void share_trace( mlt_frame self, mlt_frame frame )
+{
+	mlt_properties stats = mlt_frame_trace_stats( self, 0 );
+	if ( stats && !mlt_frame_trace_stats( frame, 0 ) )
+	{
+		mlt_properties_inc_ref( stats );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "_trace", stats, 0, ( mlt_destructor )mlt_properties_close, NULL );
+	}
+}
+
 static int producer_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	uint8_t *data = NULL;
@@ -365,6 +376,9 @@ static int producer_get_image( mlt_frame self, uint8_t **buffer, mlt_image_forma
 	mlt_properties_set( frame_properties, "deinterlace_method", mlt_properties_get( properties, "deinterlace_method" ) );
 	mlt_properties_set_int( frame_properties, "consumer_tff", mlt_properties_get_int( properties, "consumer_tff" ) );
 	mlt_properties_set( frame_properties, "consumer_color_trc", mlt_properties_get( properties, "consumer_color_trc" ) );
+	mlt_properties_set_int( frame_properties, "consumer_degrade", mlt_properties_get_int( properties, "consumer_degrade" ) );
+	mlt_properties_set_int( frame_properties, "consumer_scrub", mlt_properties_get_int( properties, "consumer_scrub" ) );
+	share_trace( self, frame );
 	// WebVfx uses this to setup a consumer-stopping event handler.
 	mlt_properties_set_data( frame_properties, "consumer", mlt_properties_get_data( properties, "consumer", NULL ), 0, NULL, NULL );
 
@@ -417,6 +431,7 @@ static int producer_get_audio( mlt_frame self, void **buffer, mlt_audio_format *
 	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_properties_set( frame_properties, "consumer_channel_layout", mlt_properties_get( properties, "consumer_channel_layout" ) );
 	mlt_properties_set( frame_properties, "producer_consumer_fps", mlt_properties_get( properties, "producer_consumer_fps" ) );
+	share_trace( self, frame );
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 	mlt_frame_set_audio( self, *buffer, *format, mlt_audio_format_size( *format, *samples, *channels ), NULL );
 	mlt_properties_set_int( properties, "audio_frequency", *frequency );
@@ -475,6 +490,9 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 		// Determine whether this tractor feeds to the consumer or stops here
 		int global_feed = mlt_properties_get_int( properties, "global_feed" );
 
+		// Determine whether transitions may render the tracks concurrently
+		int parallel_tracks = mlt_properties_get_int( properties, "parallel_tracks" );
+
 		// If we don't have one, we're in trouble...
 		if ( multitrack != NULL )
 		{
@@ -521,6 +539,8 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 
 				// Get the temporary properties
 				temp_properties = MLT_FRAME_PROPERTIES( temp );
+				if ( parallel_tracks )
+					mlt_properties_set_int( temp_properties, "parallel_tracks", 1 );
 
 				// Pass all unique meta properties from the producer's frame to the new frame
 				mlt_properties_lock( temp_properties );
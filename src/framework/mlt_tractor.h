@@ -37,6 +37,7 @@
  * \properties \em global_feed a flag to indicate whether this tractor feeds to the consumer or stops here
  * \properties \em global_queue is something for the data_feed functionality in the core module
  * \properties \em data_queue is something for the data_feed functionality in the core module
+ * \properties \em parallel_tracks set to let transitions render their tracks concurrently on the slices pool
  */
 
 struct mlt_tractor_s
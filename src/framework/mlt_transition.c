@@ -318,9 +318,24 @@ double mlt_transition_get_progress_delta( mlt_transition self, mlt_frame frame )
 mlt_frame mlt_transition_process( mlt_transition self, mlt_frame a_frame, mlt_frame b_frame )
 {
 	if ( self->process == NULL )
+	{
 		return a_frame;
+	}
 	else
-		return self->process( self, a_frame, b_frame );
+	{
+		int image = mlt_deque_count( MLT_FRAME_IMAGE_STACK( a_frame ) );
+		int audio = mlt_deque_count( MLT_FRAME_AUDIO_STACK( a_frame ) );
+		mlt_frame frame;
+
+		// The image of the a frame is no longer just its own content
+		mlt_frame_clear_image_hints( a_frame );
+		frame = self->process( self, a_frame, b_frame );
+		if ( frame == a_frame )
+			mlt_frame_trace_push( frame, MLT_TRANSITION_SERVICE( self ),
+				mlt_deque_count( MLT_FRAME_IMAGE_STACK( frame ) ) - image,
+				mlt_deque_count( MLT_FRAME_AUDIO_STACK( frame ) ) - audio );
+		return frame;
+	}
 }
 
 static int get_image_a( mlt_frame a_frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
@@ -361,7 +376,13 @@ static int get_image_b( mlt_frame b_frame, uint8_t **image, mlt_image_format *fo
 		mlt_frame_set_aspect_ratio( b_frame, mlt_profile_sar( mlt_service_profile( MLT_TRANSITION_SERVICE(self) ) ) );
 
 	mlt_properties_pass_list( b_props, a_props,
-		"consumer_deinterlace, deinterlace_method, consumer_tff, consumer_color_trc, consumer_channel_layout" );
+		"consumer_deinterlace, deinterlace_method, consumer_tff, consumer_color_trc, consumer_channel_layout, consumer_degrade, consumer_scrub" );
+	mlt_properties stats = mlt_frame_trace_stats( a_frame, 0 );
+	if ( stats && !mlt_frame_trace_stats( b_frame, 0 ) )
+	{
+		mlt_properties_inc_ref( stats );
+		mlt_properties_set_data( b_props, "_trace", stats, 0, ( mlt_destructor )mlt_properties_close, NULL );
+	}
 
 	return mlt_frame_get_image( b_frame, image, format, width, height, writable );
 }
@@ -411,13 +432,8 @@ static int transition_get_frame( mlt_service service, mlt_frame_ptr frame, int i
 
 	mlt_properties properties = MLT_TRANSITION_PROPERTIES( self );
 
-	int accepts_blanks = mlt_properties_get_int( properties, "accepts_blanks" );
 	int a_track = mlt_properties_get_int( properties, "a_track" );
 	int b_track = mlt_properties_get_int( properties, "b_track" );
-	mlt_position in = mlt_properties_get_position( properties, "in" );
-	mlt_position out = mlt_properties_get_position( properties, "out" );
-	int always_active = mlt_properties_get_int( properties, "always_active" );
-	int type = mlt_properties_get_int( properties, "_transition_type" );
 	int reverse_order = 0;
 
 	// Ensure that we have the correct order
@@ -433,6 +449,11 @@ static int transition_get_frame( mlt_service service, mlt_frame_ptr frame, int i
 	// Only act on this operation once per multitrack iteration from the tractor
 	if ( !self->held )
 	{
+		int accepts_blanks = mlt_properties_get_int( properties, "accepts_blanks" );
+		mlt_position in = mlt_properties_get_position( properties, "in" );
+		mlt_position out = mlt_properties_get_position( properties, "out" );
+		int always_active = mlt_properties_get_int( properties, "always_active" );
+		int type = mlt_properties_get_int( properties, "_transition_type" );
 		int active = 0;
 		int i = 0;
 		int a_frame = a_track;
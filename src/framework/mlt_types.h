@@ -53,6 +53,10 @@ typedef enum
 	mlt_image_glsl,    /**< for opengl module internal use only */
 	mlt_image_glsl_texture, /**< an OpenGL texture name */
 	mlt_image_yuv422p16, /**< planar YUV 4:2:2, 32bpp, (1 Cr & Cb sample per 2x1 Y samples), little-endian */
+	mlt_image_hwsurface, /**< an opaque hardware decoder surface, see the hwsurface.type frame property */
+	mlt_image_yuv420p10, /**< planar YUV 4:2:0, 10 bits in 16-bit little-endian samples */
+	mlt_image_yuv444p16, /**< planar YUV 4:4:4, 16-bit little-endian samples */
+	mlt_image_rgba64,  /**< packed RGBA, 16-bit little-endian samples */
 	mlt_image_invalid
 }
 mlt_image_format;
@@ -184,6 +188,15 @@ typedef struct {
 }
 mlt_color;
 
+/** Per-channel lookup tables that point filters compose, see mlt_frame_push_lut() */
+
+typedef struct {
+	mlt_image_format format; /**< mlt_image_yuv422, or mlt_image_rgb24 which also takes rgb24a */
+	int alpha;               /**< set when table[3] is not the identity */
+	uint8_t table[4][256];   /**< Y, U, V and alpha, or R, G, B and alpha */
+}
+mlt_lut;
+
 typedef struct mlt_frame_s *mlt_frame, **mlt_frame_ptr; /**< pointer to Frame object */
 typedef struct mlt_property_s *mlt_property;            /**< pointer to Property object */
 typedef struct mlt_properties_s *mlt_properties;        /**< pointer to Properties object */
@@ -207,10 +220,52 @@ typedef struct mlt_cache_s *mlt_cache;                  /**< pointer to Cache ob
 typedef struct mlt_cache_item_s *mlt_cache_item;        /**< pointer to CacheItem object */
 typedef struct mlt_animation_s *mlt_animation;          /**< pointer to Property Animation object */
 typedef struct mlt_slices_s *mlt_slices;                /**< pointer to Sliced processing context object */
+typedef struct mlt_queue_s *mlt_queue;                  /**< pointer to Bounded Queue object */
+typedef struct mlt_ring_s *mlt_ring;                    /**< pointer to Ring object */
+typedef struct mlt_peaks_s *mlt_peaks;                  /**< pointer to Peaks object */
+typedef struct mlt_job_s *mlt_job;                      /**< pointer to Job object */
+typedef struct mlt_sidecar_s *mlt_sidecar;              /**< pointer to Sidecar record object */
+typedef struct mlt_memory_client_s *mlt_memory_client;  /**< pointer to Memory Client object */
+typedef struct mlt_metric_s *mlt_metric;                /**< pointer to Metric object */
+typedef struct mlt_atom_s *mlt_atom;                    /**< pointer to an interned property name */
 
 typedef void ( *mlt_destructor )( void * );             /**< pointer to destructor function */
 typedef char *( *mlt_serialiser )( void *, int length );/**< pointer to serialization function */
 
+/** The type that mlt_properties_get_many() converts a value to */
+
+typedef enum
+{
+	mlt_value_string = 0, /**< a string that the property owns */
+	mlt_value_int,        /**< an integer, animated */
+	mlt_value_int64,      /**< a 64-bit integer */
+	mlt_value_double,     /**< a real number, animated */
+	mlt_value_position,   /**< a frame position or time */
+	mlt_value_rect,       /**< a rectangle, animated */
+	mlt_value_color,      /**< a color */
+	mlt_value_data        /**< a pointer to binary data */
+}
+mlt_value_type;
+
+/** A request for one property in mlt_properties_get_many() */
+
+typedef struct {
+	mlt_atom name;        /**< the interned property name */
+	mlt_value_type type;  /**< the type to convert it to */
+	int found;            /**< set when the property exists */
+	union {
+		char *s;
+		int i;
+		int64_t i64;
+		double d;
+		mlt_position position;
+		mlt_rect rect;
+		mlt_color color;
+		void *data;
+	} value;              /**< the value, zero or a default when not found */
+}
+mlt_value;
+
 #define MLT_SERVICE(x)    ( ( mlt_service )( x ) )      /**< Cast to a Service pointer */
 #define MLT_PRODUCER(x)   ( ( mlt_producer )( x ) )     /**< Cast to a Producer pointer */
 #define MLT_MULTITRACK(x) ( ( mlt_multitrack )( x ) )   /**< Cast to a Multitrack pointer */
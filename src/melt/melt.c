@@ -28,6 +28,10 @@
 #include <limits.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 #include <framework/mlt.h>
 
@@ -36,6 +40,7 @@
 #endif
 
 #include "io.h"
+#include "worker.h"
 
 static mlt_producer melt = NULL;
 
@@ -486,6 +491,7 @@ static void show_usage( char *program_name )
 "  -attach-track filter[:arg] [name=value]* Attach a filter to a track\n"
 "  -attach-clip filter[:arg] [name=value]*  Attach a filter to a producer\n"
 "  -audio-track | -hide-video               Add an audio-only track\n"
+"  -bench                                   Render at full speed, report stats as JSON\n"
 "  -blank frames                            Add blank silence to a track\n"
 "  -consumer id[:arg] [name=value]*         Set the consumer (sink)\n"
 "  -debug                                   Set the logging level to debug\n"
@@ -522,6 +528,7 @@ static void show_usage( char *program_name )
 "  -timings                                 Set the logging level to timings\n"
 "  -version                                 Show the version and copyright\n"
 "  -video-track | -hide-audio               Add a video-only track\n"
+"  -worker [host:]port                      Render segments for a farm consumer\n"
 "For more help: <https://www.mltframework.org/>\n",
 	basename( program_name ) );
 }
@@ -718,6 +725,170 @@ static void on_fatal_error( mlt_properties owner, mlt_consumer consumer )
 	mlt_properties_set_int( MLT_CONSUMER_PROPERTIES(consumer), "melt_error", 1 );
 }
 
+/** The measurements of -bench
+ */
+
+typedef struct
+{
+	int64_t start;          ///< when the consumer was started
+	int64_t last;           ///< when the last frame was shown
+	int count;              ///< the number of frames shown
+	int size;               ///< the allocated entries of latency and interval
+	int64_t *latency;       ///< microseconds from rendering to showing each frame
+	int64_t *interval;      ///< microseconds between showing each frame and the previous
+	int latencies;          ///< the entries used in latency
+	mlt_properties services; ///< the total microseconds of each traced stage
+}
+melt_bench;
+
+static int64_t bench_now( )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return ( int64_t )tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void on_bench_frame_render( mlt_properties owner, melt_bench *bench, mlt_frame frame )
+{
+	if ( frame )
+		mlt_properties_set_int64( MLT_FRAME_PROPERTIES( frame ), "melt_bench", bench_now() );
+}
+
+static void on_bench_frame_show( mlt_properties owner, melt_bench *bench, mlt_frame frame )
+{
+	int64_t now = bench_now();
+	int64_t rendered = frame ? mlt_properties_get_int64( MLT_FRAME_PROPERTIES( frame ), "melt_bench" ) : 0;
+
+	if ( bench->count == bench->size )
+	{
+		int size = bench->size ? bench->size * 2 : 1024;
+		int64_t *latency = realloc( bench->latency, size * sizeof( int64_t ) );
+		int64_t *interval = latency ? realloc( bench->interval, size * sizeof( int64_t ) ) : NULL;
+		if ( latency )
+			bench->latency = latency;
+		if ( !interval )
+			return;
+		bench->interval = interval;
+		bench->size = size;
+	}
+	bench->interval[ bench->count ++ ] = now - ( bench->last ? bench->last : bench->start );
+	if ( rendered )
+		bench->latency[ bench->latencies ++ ] = now - rendered;
+	bench->last = now;
+}
+
+static void on_bench_frame_stats( mlt_properties owner, melt_bench *bench, mlt_frame frame, mlt_properties stats )
+{
+	int i, n = mlt_properties_count( stats );
+	for ( i = 0; i < n; i ++ )
+	{
+		const char *name = mlt_properties_get_name( stats, i );
+		mlt_properties_set_int64( bench->services, name,
+			mlt_properties_get_int64( bench->services, name ) + mlt_properties_get_int64( stats, name ) );
+	}
+}
+
+static int compare_int64( const void *a, const void *b )
+{
+	int64_t x = *( const int64_t* )a, y = *( const int64_t* )b;
+	return x < y ? -1 : x > y;
+}
+
+static void bench_print_percentiles( const char *name, int64_t *values, int count )
+{
+	static const int percentiles[] = { 50, 90, 99 };
+	int i;
+
+	fprintf( stdout, "  \"%s_ms\": {", name );
+	if ( count > 0 )
+	{
+		qsort( values, count, sizeof( int64_t ), compare_int64 );
+		fprintf( stdout, " \"min\": %.3f", values[ 0 ] / 1000.0 );
+		for ( i = 0; i < sizeof( percentiles ) / sizeof( percentiles[0] ); i ++ )
+			fprintf( stdout, ", \"p%d\": %.3f", percentiles[ i ],
+				values[ ( count - 1 ) * percentiles[ i ] / 100 ] / 1000.0 );
+		fprintf( stdout, ", \"max\": %.3f ", values[ count - 1 ] / 1000.0 );
+	}
+	fprintf( stdout, "},\n" );
+}
+
+static void bench_init( melt_bench *bench, mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+	memset( bench, 0, sizeof( *bench ) );
+	bench->services = mlt_properties_new( );
+
+	// Render everything as fast as possible, then stop
+	if ( !mlt_properties_get( properties, "real_time" ) )
+		mlt_properties_set_int( properties, "real_time", -1 );
+	mlt_properties_set_int( properties, "terminate_on_pause", 1 );
+	mlt_properties_set_int( properties, "trace", 1 );
+
+	mlt_events_listen( properties, bench, "consumer-frame-render", ( mlt_listener )on_bench_frame_render );
+	mlt_events_listen( properties, bench, "consumer-frame-show", ( mlt_listener )on_bench_frame_show );
+	mlt_events_listen( properties, bench, "consumer-frame-stats", ( mlt_listener )on_bench_frame_stats );
+}
+
+/** Write the results of -bench to stdout as JSON. */
+
+static void bench_report( melt_bench *bench, mlt_consumer consumer )
+{
+	double seconds = ( bench->last - bench->start ) / 1000000.0;
+	uint64_t allocated, used, hits, misses;
+	double user = 0.0, system = 0.0;
+	long peak_rss = 0;
+	int i, n;
+#ifndef _WIN32
+	struct rusage usage;
+#endif
+
+	// Stop listening before the results are read
+	mlt_events_disconnect( MLT_CONSUMER_PROPERTIES( consumer ), bench );
+
+#ifndef _WIN32
+	if ( !getrusage( RUSAGE_SELF, &usage ) )
+	{
+		user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+		system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+#if defined(__APPLE__)
+		peak_rss = usage.ru_maxrss / 1024;
+#else
+		peak_rss = usage.ru_maxrss;
+#endif
+	}
+#endif
+	mlt_pool_stats( &allocated, &used, &hits, &misses );
+
+	fprintf( stdout, "{\n" );
+	fprintf( stdout, "  \"consumer\": \"%s\",\n", mlt_properties_get( MLT_CONSUMER_PROPERTIES( consumer ), "mlt_service" ) );
+	fprintf( stdout, "  \"frames\": %d,\n", bench->count );
+	fprintf( stdout, "  \"seconds\": %.3f,\n", seconds );
+	fprintf( stdout, "  \"fps\": %.3f,\n", seconds > 0 ? bench->count / seconds : 0.0 );
+	bench_print_percentiles( "latency", bench->latency, bench->latencies );
+	bench_print_percentiles( "interval", bench->interval, bench->count );
+	fprintf( stdout, "  \"user_seconds\": %.3f,\n", user );
+	fprintf( stdout, "  \"system_seconds\": %.3f,\n", system );
+	fprintf( stdout, "  \"peak_rss_kb\": %ld,\n", peak_rss );
+	fprintf( stdout, "  \"pool\": { \"allocated\": %" PRIu64 ", \"used\": %" PRIu64 ", \"hits\": %" PRIu64 ", \"misses\": %" PRIu64 " },\n",
+		allocated, used, hits, misses );
+	fprintf( stdout, "  \"services\": {" );
+	n = mlt_properties_count( bench->services );
+	for ( i = 0; i < n; i ++ )
+	{
+		int64_t total = mlt_properties_get_int64( bench->services, mlt_properties_get_name( bench->services, i ) );
+		fprintf( stdout, "%s\n    \"%s\": { \"total_ms\": %.3f, \"frame_ms\": %.3f }", i ? "," : "",
+			mlt_properties_get_name( bench->services, i ), total / 1000.0,
+			bench->count ? total / 1000.0 / bench->count : 0.0 );
+	}
+	fprintf( stdout, "%s}\n}\n", n ? "\n  " : " " );
+	fflush( stdout );
+
+	mlt_properties_close( bench->services );
+	free( bench->latency );
+	free( bench->interval );
+}
+
 int main( int argc, char **argv )
 {
 	int i;
@@ -729,8 +900,10 @@ int main( int argc, char **argv )
 	int is_silent = 0;
 	int is_abort = 0;
 	int is_getc = 0;
+	int is_bench = 0;
 	int error = 0;
 	mlt_profile backup_profile;
+	melt_bench bench;
 
 	// Handle abnormal exit situations.
 	signal( SIGSEGV, abnormal_exit_handler );
@@ -857,6 +1030,17 @@ query_all:
 		{
 			is_getc = 1;
 		}
+		else if ( !strcmp( argv[ i ], "-bench" ) )
+		{
+			is_bench = 1;
+			is_silent = 1;
+		}
+		else if ( !strcmp( argv[ i ], "-worker" ) )
+		{
+			const char *address = argv[ ++ i ];
+			error = melt_worker( address && address[0] != '-' ? address : "5250" );
+			goto exit_factory;
+		}
 	}
 	if ( !is_silent && !isatty( STDIN_FILENO ) && !is_progress )
 		is_progress = 1;
@@ -915,9 +1099,9 @@ query_all:
 			}
 		}
 
-		// If we have no consumer, default to sdl
+		// If we have no consumer, default to sdl, or null when benchmarking
 		if ( store == NULL && consumer == NULL )
-			consumer = create_consumer( profile, NULL );
+			consumer = create_consumer( profile, is_bench ? "null" : NULL );
 	}
 	
 	// Set transport properties on consumer and produder
@@ -990,6 +1174,11 @@ query_all:
 
 			// Start the consumer
 			mlt_events_listen( properties, consumer, "consumer-fatal-error", ( mlt_listener )on_fatal_error );
+			if ( is_bench )
+			{
+				bench_init( &bench, consumer );
+				bench.start = bench_now();
+			}
 			if ( mlt_consumer_start( consumer ) == 0 )
 			{
 				// Try to exit gracefully upon these signals
@@ -1005,7 +1194,9 @@ query_all:
 				
 				// Stop the consumer
 				mlt_consumer_stop( consumer );
-			}	
+			}
+			if ( is_bench )
+				bench_report( &bench, consumer );
 		}
 		else if ( store != NULL && store != stdout && name != NULL )
 		{
@@ -0,0 +1,370 @@
+/*
+ * worker.c -- melt render farm worker
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* A worker renders segments of a project for a coordinator, which is
+ * consumer_avformat with segments and workers set (see farm.c there). Each
+ * connection carries one job:
+ *
+ *   coordinator: MLTFARM 1 <start> <end> <profile size> <properties size> <xml size>\n
+ *                <profile><consumer properties><xml>
+ *   worker:      PROGRESS <frames>\n ...
+ *                DONE <size>\n<file>  or  FAIL <reason>\n
+ *
+ * The profile and the consumer properties are name=value lines, and start and
+ * end are frames of the producer loaded from the XML.
+ */
+
+#include "worker.h"
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define FARM_MAGIC "MLTFARM 1"
+#define FARM_MAX_TEXT (256 * 1024 * 1024)
+
+static int write_all( int fd, const void *data, size_t size )
+{
+	const char *p = data;
+	while ( size > 0 )
+	{
+		ssize_t n = send( fd, p, size, MSG_NOSIGNAL );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int read_all( int fd, void *data, size_t size )
+{
+	char *p = data;
+	while ( size > 0 )
+	{
+		ssize_t n = recv( fd, p, size, 0 );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int read_line( int fd, char *line, size_t size )
+{
+	size_t i = 0;
+	while ( i + 1 < size )
+	{
+		if ( read_all( fd, &line[ i ], 1 ) )
+			return 1;
+		if ( line[ i ] == '\n' )
+			break;
+		i ++;
+	}
+	line[ i ] = '\0';
+	return 0;
+}
+
+static int send_line( int fd, const char *format, ... )
+{
+	char line[ 256 ];
+	va_list args;
+	va_start( args, format );
+	vsnprintf( line, sizeof( line ), format, args );
+	va_end( args );
+	return write_all( fd, line, strlen( line ) );
+}
+
+// Set the name=value lines of a text on a properties list.
+static void parse_lines( mlt_properties properties, char *text )
+{
+	char *line = text;
+	while ( line && *line )
+	{
+		char *next = strchr( line, '\n' );
+		if ( next )
+			*next ++ = '\0';
+		if ( *line && *line != '#' )
+			mlt_properties_parse( properties, line );
+		line = next;
+	}
+}
+
+static void on_fatal_error( mlt_properties owner, mlt_consumer consumer )
+{
+	mlt_properties_set_int( MLT_CONSUMER_PROPERTIES( consumer ), "_farm_error", 1 );
+}
+
+// Send a rendered file to the coordinator.
+static const char *send_file( int fd, const char *filename )
+{
+	FILE *file = fopen( filename, "rb" );
+	struct stat st;
+	char buffer[ 65536 ];
+	size_t n;
+
+	if ( !file || fstat( fileno( file ), &st ) )
+	{
+		if ( file )
+			fclose( file );
+		return "the rendered file is missing";
+	}
+	if ( send_line( fd, "DONE %" PRId64 "\n", (int64_t) st.st_size ) )
+	{
+		fclose( file );
+		return "the coordinator closed the connection";
+	}
+	while ( ( n = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+		if ( write_all( fd, buffer, n ) )
+			break;
+	fclose( file );
+	return NULL;
+}
+
+/** Render the frames start to end of a project and send the file.
+ *
+ * \return NULL on success or the reason of a failure
+ */
+
+static const char *render_job( int fd, int start, int end, const char *profile_text, char *properties_text, const char *xml )
+{
+	mlt_profile profile = mlt_profile_load_string( profile_text );
+	mlt_properties settings = mlt_properties_new( );
+	const char *tmpdir = getenv( "TMPDIR" );
+	char *temp = malloc( strlen( tmpdir ? tmpdir : "/tmp" ) + 32 );
+	mlt_producer producer = NULL;
+	mlt_consumer consumer = NULL;
+	const char *error = NULL;
+	int temp_fd = -1;
+	int i;
+
+	if ( !profile || !settings || !temp )
+	{
+		error = "out of memory";
+		goto exit;
+	}
+	// Consumers other than avformat may need an extension to write a file
+	sprintf( temp, "%s/mlt-farm-XXXXXX.part", tmpdir ? tmpdir : "/tmp" );
+	temp_fd = mkstemps( temp, 5 );
+	if ( temp_fd < 0 )
+	{
+		error = "cannot create a temporary file";
+		goto exit;
+	}
+	close( temp_fd );
+	parse_lines( settings, properties_text );
+
+	producer = mlt_factory_producer( profile, "xml-string", (char*) xml );
+	consumer = mlt_factory_consumer( profile, mlt_properties_get( settings, "mlt_service" ) ?
+		mlt_properties_get( settings, "mlt_service" ) : "avformat", temp );
+	if ( !producer )
+		error = "cannot load the project";
+	else if ( !consumer )
+		error = "cannot create the consumer";
+	else if ( start < 0 || end < start || end >= mlt_producer_get_playtime( producer ) )
+		error = "the range is outside the project";
+	if ( error )
+		goto exit;
+
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	for ( i = 0; i < mlt_properties_count( settings ); i++ )
+	{
+		const char *name = mlt_properties_get_name( settings, i );
+		if ( strcmp( name, "mlt_service" ) )
+			mlt_properties_set( properties, name, mlt_properties_get_value( settings, i ) );
+	}
+	mlt_properties_set_int( properties, "terminate_on_pause", 1 );
+	mlt_events_listen( properties, consumer, "consumer-fatal-error", (mlt_listener) on_fatal_error );
+
+	int in = mlt_producer_get_in( producer );
+	mlt_producer_set_in_and_out( producer, in + start, in + end );
+	mlt_producer_seek( producer, 0 );
+	mlt_producer_set_speed( producer, 1.0 );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( producer ) );
+
+	mlt_log_info( NULL, "[melt worker] rendering frames %d-%d\n", start, end );
+	if ( mlt_consumer_start( consumer ) )
+	{
+		error = "cannot start the consumer";
+		goto exit;
+	}
+	while ( !mlt_consumer_is_stopped( consumer ) )
+	{
+		struct timespec t = { 1, 0 };
+		nanosleep( &t, NULL );
+		if ( send_line( fd, "PROGRESS %d\n", (int) mlt_producer_position( producer ) ) )
+		{
+			error = "the coordinator closed the connection";
+			break;
+		}
+	}
+	mlt_consumer_stop( consumer );
+	if ( !error && mlt_properties_get_int( properties, "_farm_error" ) )
+		error = "the consumer failed";
+	if ( !error )
+	{
+		// Close the consumer first so that it finishes writing the file
+		mlt_consumer_close( consumer );
+		consumer = NULL;
+		error = send_file( fd, temp );
+	}
+
+exit:
+	mlt_consumer_close( consumer );
+	mlt_producer_close( producer );
+	mlt_properties_close( settings );
+	mlt_profile_close( profile );
+	if ( temp_fd >= 0 )
+		remove( temp );
+	free( temp );
+	return error;
+}
+
+static void *job_thread( void *arg )
+{
+	int fd = (intptr_t) arg;
+	char line[ 256 ];
+	long start = 0, end = 0;
+	unsigned long sizes[ 3 ] = { 0, 0, 0 };
+	char *texts[ 3 ] = { NULL, NULL, NULL };
+	const char *error = NULL;
+	int i;
+
+	if ( read_line( fd, line, sizeof( line ) ) ||
+		 sscanf( line, FARM_MAGIC " %ld %ld %lu %lu %lu", &start, &end, &sizes[0], &sizes[1], &sizes[2] ) != 5 )
+		error = "bad request";
+	for ( i = 0; !error && i < 3; i++ )
+	{
+		texts[ i ] = sizes[ i ] < FARM_MAX_TEXT ? malloc( sizes[ i ] + 1 ) : NULL;
+		if ( !texts[ i ] || read_all( fd, texts[ i ], sizes[ i ] ) )
+			error = "bad request";
+		else
+			texts[ i ][ sizes[ i ] ] = '\0';
+	}
+	if ( !error )
+		error = render_job( fd, start, end, texts[0], texts[1], texts[2] );
+	if ( error )
+	{
+		mlt_log_warning( NULL, "[melt worker] %s\n", error );
+		send_line( fd, "FAIL %s\n", error );
+	}
+
+	for ( i = 0; i < 3; i++ )
+		free( texts[ i ] );
+	close( fd );
+	return NULL;
+}
+
+/** Serve render jobs until the process is stopped.
+ *
+ * \param address a port, or host:port to listen on one address only
+ * \return non-zero if the worker could not listen
+ */
+
+int melt_worker( const char *address )
+{
+	const char *colon = strrchr( address, ':' );
+	char *host = colon ? strndup( address, colon - address ) : NULL;
+	const char *port = colon ? colon + 1 : address;
+	struct addrinfo hints, *result = NULL, *ai;
+	int fd = -1;
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ( getaddrinfo( host && *host ? host : NULL, port, &hints, &result ) == 0 )
+	{
+		for ( ai = result; ai && fd < 0; ai = ai->ai_next )
+		{
+			int on = 1;
+			fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+			if ( fd < 0 )
+				continue;
+			setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+			if ( bind( fd, ai->ai_addr, ai->ai_addrlen ) || listen( fd, 16 ) )
+			{
+				close( fd );
+				fd = -1;
+			}
+		}
+		freeaddrinfo( result );
+	}
+	free( host );
+	if ( fd < 0 )
+	{
+		fprintf( stderr, "melt: cannot listen on %s\n", address );
+		return 1;
+	}
+
+	signal( SIGPIPE, SIG_IGN );
+	fprintf( stderr, "melt: worker listening on %s\n", address );
+	for ( ;; )
+	{
+		pthread_t thread;
+		int client = accept( fd, NULL, NULL );
+		if ( client < 0 )
+		{
+			if ( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			break;
+		}
+		if ( pthread_create( &thread, NULL, job_thread, (void*) (intptr_t) client ) )
+			close( client );
+		else
+			pthread_detach( thread );
+	}
+	close( fd );
+	return 1;
+}
+
+#else
+
+int melt_worker( const char *address )
+{
+	fprintf( stderr, "melt: -worker is not supported on this platform\n" );
+	return 1;
+}
+
+#endif
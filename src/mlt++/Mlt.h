@@ -22,6 +22,7 @@
 #define MLTPP_H
 
 #include "MltAnimation.h"
+#include "MltBorrowed.h"
 #include "MltConsumer.h"
 #include "MltDeque.h"
 #include "MltEvent.h"
@@ -38,6 +39,7 @@
 #include "MltProfile.h"
 #include "MltProperties.h"
 #include "MltPushConsumer.h"
+#include "MltRenderer.h"
 #include "MltRepository.h"
 #include "MltService.h"
 #include "MltTokeniser.h"
@@ -0,0 +1,67 @@
+/**
+ * MltBorrowed.h - MLT Wrapper
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLTPP_BORROWED_H
+#define MLTPP_BORROWED_H
+
+#include "MltProperties.h"
+
+namespace Mlt
+{
+	/** A wrapper that neither adds nor drops a reference.
+	 *
+	 * Use it for an object that something else keeps alive for the whole
+	 * scope, such as the frame given to a listener or the producer of a
+	 * playlist entry, to avoid the reference counting of a full wrapper.
+	 * Copying the wrapped object makes an ordinary, counted reference; do not
+	 * move from it.
+	 *
+	 *     Mlt::Borrowed<Mlt::Frame> frame( mlt_frame_ptr );
+	 *     frame->get_int( "test_image" );
+	 */
+
+	template <class T>
+	class Borrowed
+	{
+		private:
+			T object;
+			Borrowed( const Borrowed & );
+			Borrowed& operator=( const Borrowed & );
+		public:
+			template <class H>
+			explicit Borrowed( H handle ) :
+				object( handle, Adopt( ) )
+			{
+			}
+			~Borrowed( )
+			{
+				object.release( );
+			}
+			T *operator->( )
+			{
+				return &object;
+			}
+			T &operator*( )
+			{
+				return object;
+			}
+	};
+}
+
+#endif
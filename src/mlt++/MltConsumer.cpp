@@ -22,6 +22,7 @@
 #include "MltConsumer.h"
 #include "MltEvent.h"
 #include "MltProfile.h"
+#include <utility>
 using namespace Mlt;
 
 Consumer::Consumer( ) :
@@ -88,11 +89,42 @@ Consumer::Consumer( mlt_consumer consumer ) :
 	inc_ref( );
 }
 
+Consumer::Consumer( Consumer &&consumer ) :
+	Mlt::Service( std::move( consumer ) ),
+	instance( consumer.instance )
+{
+	consumer.instance = NULL;
+}
+
+Consumer::Consumer( mlt_consumer consumer, Adopt ) :
+	instance( consumer )
+{
+}
+
 Consumer::~Consumer( )
 {
 	mlt_consumer_close( instance );
 }
 
+Consumer& Consumer::operator=( Consumer &&consumer )
+{
+	if ( this != &consumer )
+	{
+		Service::operator=( std::move( consumer ) );
+		mlt_consumer_close( instance );
+		instance = consumer.instance;
+		consumer.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_consumer Consumer::release( )
+{
+	mlt_consumer result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_consumer Consumer::get_consumer( )
 {
 	return instance;
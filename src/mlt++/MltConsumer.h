@@ -44,7 +44,11 @@ namespace Mlt
 			Consumer( Service &consumer );
 			Consumer( Consumer &consumer );
 			Consumer( mlt_consumer consumer );
+			Consumer( Consumer &&consumer );
+			Consumer( mlt_consumer consumer, Adopt );
 			virtual ~Consumer( );
+			Consumer& operator=( Consumer &&consumer );
+			mlt_consumer release( );
 			virtual mlt_consumer get_consumer( );
 			mlt_service get_service( );
 			virtual int connect( Service &service );
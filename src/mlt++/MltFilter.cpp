@@ -21,6 +21,7 @@
 #include <string.h>
 #include "MltFilter.h"
 #include "MltProfile.h"
+#include <utility>
 using namespace Mlt;
 
 Filter::Filter( Profile& profile, const char *id, const char *arg ) :
@@ -75,11 +76,42 @@ Filter::Filter( mlt_filter filter ) :
 	inc_ref( );
 }
 
+Filter::Filter( Filter &&filter ) :
+	Mlt::Service( std::move( filter ) ),
+	instance( filter.instance )
+{
+	filter.instance = NULL;
+}
+
+Filter::Filter( mlt_filter filter, Adopt ) :
+	instance( filter )
+{
+}
+
 Filter::~Filter( )
 {
 	mlt_filter_close( instance );
 }
 
+Filter& Filter::operator=( Filter &&filter )
+{
+	if ( this != &filter )
+	{
+		Service::operator=( std::move( filter ) );
+		mlt_filter_close( instance );
+		instance = filter.instance;
+		filter.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_filter Filter::release( )
+{
+	mlt_filter result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_filter Filter::get_filter( )
 {
 	return instance;
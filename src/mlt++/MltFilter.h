@@ -43,7 +43,11 @@ namespace Mlt
 			Filter( Service &filter );
 			Filter( Filter &filter );
 			Filter( mlt_filter filter );
+			Filter( Filter &&filter );
+			Filter( mlt_filter filter, Adopt );
 			virtual ~Filter( );
+			Filter& operator=( Filter &&filter );
+			mlt_filter release( );
 			virtual mlt_filter get_filter( );
 			mlt_service get_service( );
 			int connect( Service &service, int index = 0 );
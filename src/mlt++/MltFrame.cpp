@@ -20,6 +20,8 @@
 
 #include "MltFrame.h"
 #include "MltProducer.h"
+#include <string.h>
+#include <utility>
 using namespace Mlt;
 
 Frame::Frame() :
@@ -49,6 +51,19 @@ Frame::Frame( const Frame &frame ) :
 	inc_ref( );
 }
 
+Frame::Frame( Frame &&frame ) :
+	Mlt::Properties( std::move( frame ) ),
+	instance( frame.instance )
+{
+	frame.instance = NULL;
+}
+
+Frame::Frame( mlt_frame frame, Adopt ) :
+	Mlt::Properties( false ),
+	instance( frame )
+{
+}
+
 Frame::~Frame( )
 {
 	mlt_frame_close( instance );
@@ -65,6 +80,24 @@ Frame& Frame::operator=( const Frame &frame )
 	return *this;
 }
 
+Frame& Frame::operator=( Frame &&frame )
+{
+	if ( this != &frame )
+	{
+		mlt_frame_close( instance );
+		instance = frame.instance;
+		frame.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_frame Frame::release( )
+{
+	mlt_frame result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_frame Frame::get_frame( )
 {
 	return instance;
@@ -114,6 +147,12 @@ Producer *Frame::get_original_producer( )
 	return new Producer( mlt_frame_get_original_producer( get_frame( ) ) );
 }
 
+bool Frame::get_original_producer( Producer &producer )
+{
+	producer = Producer( mlt_frame_get_original_producer( get_frame( ) ) );
+	return producer.is_valid( );
+}
+
 mlt_properties Frame::get_unique_properties( Service &service )
 {
 	return mlt_frame_unique_properties( get_frame(), service.get_service() );
@@ -133,3 +172,235 @@ int Frame::set_alpha( uint8_t *alpha, int size, mlt_destructor destroy )
 {
 	return mlt_frame_set_alpha( get_frame(), alpha, size, destroy );
 }
+
+ImageView::ImageView( ) :
+	format_( mlt_image_none ),
+	width_( 0 ),
+	height_( 0 )
+{
+	memset( planes_, 0, sizeof( planes_ ) );
+	memset( strides_, 0, sizeof( strides_ ) );
+}
+
+ImageView::ImageView( Frame &frame, mlt_image_format format, int width, int height, int writable ) :
+	frame_( frame ),
+	format_( format ),
+	width_( width ),
+	height_( height )
+{
+	uint8_t *image = NULL;
+
+	memset( planes_, 0, sizeof( planes_ ) );
+	memset( strides_, 0, sizeof( strides_ ) );
+	if ( frame_.get_double( "consumer_aspect_ratio" ) == 0.0 )
+		frame_.set( "consumer_aspect_ratio", 1.0 );
+	if ( mlt_frame_get_image_view( frame_.get_frame( ), &image, &format_, &width_, &height_, writable ) || !image
+		 || mlt_frame_get_image_planes( frame_.get_frame( ), planes_, strides_ ) )
+		format_ = mlt_image_none;
+
+	// Textures and hardware surfaces are not in memory we can address.
+	switch ( format_ )
+	{
+	case mlt_image_opengl:
+	case mlt_image_glsl:
+	case mlt_image_glsl_texture:
+	case mlt_image_hwsurface:
+	case mlt_image_invalid:
+		format_ = mlt_image_none;
+		break;
+	default:
+		break;
+	}
+	if ( format_ == mlt_image_none )
+	{
+		memset( planes_, 0, sizeof( planes_ ) );
+		memset( strides_, 0, sizeof( strides_ ) );
+	}
+}
+
+bool ImageView::is_valid( )
+{
+	return format_ != mlt_image_none;
+}
+
+Frame &ImageView::frame( )
+{
+	return frame_;
+}
+
+mlt_image_format ImageView::format( )
+{
+	return format_;
+}
+
+int ImageView::width( )
+{
+	return width_;
+}
+
+int ImageView::height( )
+{
+	return height_;
+}
+
+int ImageView::count( )
+{
+	switch ( format_ )
+	{
+	case mlt_image_none:
+		return 0;
+	case mlt_image_yuv420p:
+	case mlt_image_yuv420p10:
+	case mlt_image_yuv422p16:
+	case mlt_image_yuv444p16:
+		return 3;
+	default:
+		return 1;
+	}
+}
+
+uint8_t *ImageView::plane( int index )
+{
+	return index >= 0 && index < count( ) ? planes_[ index ] : NULL;
+}
+
+int ImageView::stride( int index )
+{
+	return index >= 0 && index < count( ) ? strides_[ index ] : 0;
+}
+
+int ImageView::rows( int index )
+{
+	if ( index < 0 || index >= count( ) )
+		return 0;
+	if ( index > 0 && ( format_ == mlt_image_yuv420p || format_ == mlt_image_yuv420p10 ) )
+		return height_ / 2;
+	return height_;
+}
+
+int ImageView::columns( int index )
+{
+	if ( index < 0 || index >= count( ) )
+		return 0;
+	if ( index > 0 && format_ != mlt_image_yuv444p16 )
+		return width_ / 2;
+	return width_;
+}
+
+int ImageView::components( int index )
+{
+	if ( index < 0 || index >= count( ) )
+		return 0;
+	switch ( format_ )
+	{
+	case mlt_image_rgb24:
+		return 3;
+	case mlt_image_rgb24a:
+	case mlt_image_rgba64:
+		return 4;
+	case mlt_image_yuv422:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+int ImageView::sample_size( )
+{
+	switch ( format_ )
+	{
+	case mlt_image_none:
+		return 0;
+	case mlt_image_yuv420p10:
+	case mlt_image_yuv422p16:
+	case mlt_image_yuv444p16:
+	case mlt_image_rgba64:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+AudioView::AudioView( ) :
+	format_( mlt_audio_none ),
+	frequency_( 0 ),
+	channels_( 0 ),
+	samples_( 0 ),
+	data_( NULL )
+{
+}
+
+AudioView::AudioView( Frame &frame, mlt_audio_format format, int frequency, int channels, int samples ) :
+	frame_( frame ),
+	format_( format ),
+	frequency_( frequency ),
+	channels_( channels ),
+	samples_( samples ),
+	data_( NULL )
+{
+	if ( mlt_frame_get_audio( frame_.get_frame( ), &data_, &format_, &frequency_, &channels_, &samples_ ) || !data_ )
+	{
+		format_ = mlt_audio_none;
+		data_ = NULL;
+	}
+}
+
+bool AudioView::is_valid( )
+{
+	return data_ != NULL;
+}
+
+Frame &AudioView::frame( )
+{
+	return frame_;
+}
+
+mlt_audio_format AudioView::format( )
+{
+	return format_;
+}
+
+int AudioView::frequency( )
+{
+	return frequency_;
+}
+
+int AudioView::channels( )
+{
+	return channels_;
+}
+
+int AudioView::samples( )
+{
+	return samples_;
+}
+
+void *AudioView::data( )
+{
+	return data_;
+}
+
+int AudioView::size( )
+{
+	return data_ ? mlt_audio_format_size( format_, samples_, channels_ ) : 0;
+}
+
+int AudioView::sample_size( )
+{
+	switch ( format_ )
+	{
+	case mlt_audio_u8:
+		return 1;
+	case mlt_audio_s16:
+		return 2;
+	case mlt_audio_none:
+		return 0;
+	default:
+		return 4;
+	}
+}
+
+bool AudioView::is_planar( )
+{
+	return format_ == mlt_audio_s32 || format_ == mlt_audio_float;
+}
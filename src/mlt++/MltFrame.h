@@ -41,8 +41,12 @@ namespace Mlt
 			Frame( mlt_frame frame );
 			Frame( Frame &frame );
 			Frame( const Frame &frame );
+			Frame( Frame &&frame );
+			Frame( mlt_frame frame, Adopt );
 			virtual ~Frame( );
 			Frame& operator=( const Frame &frame );
+			Frame& operator=( Frame &&frame );
+			mlt_frame release( );
 			virtual mlt_frame get_frame( );
 			mlt_properties get_properties( );
 			uint8_t *get_image( mlt_image_format &format, int &w, int &h, int writable = 0 );
@@ -50,11 +54,75 @@ namespace Mlt
 			void *get_audio( mlt_audio_format &format, int &frequency, int &channels, int &samples );
 			unsigned char *get_waveform( int w, int h );
 			Producer *get_original_producer( );
+			bool get_original_producer( Producer &producer );
 			int get_position( );
 			mlt_properties get_unique_properties( Service &service );
 			int set_image( uint8_t *image, int size, mlt_destructor destroy );
 			int set_alpha( uint8_t *alpha, int size, mlt_destructor destroy );
 	};
+
+	/** The image of a frame, addressed in place.
+	 *
+	 * The view holds a reference to the frame, so the planes stay valid for
+	 * as long as the view. The image is not packed: a region made by a crop
+	 * keeps the strides of the whole image.
+	 */
+
+	class MLTPP_DECLSPEC ImageView
+	{
+		private:
+			Frame frame_;
+			mlt_image_format format_;
+			int width_;
+			int height_;
+			uint8_t *planes_[4];
+			int strides_[4];
+		public:
+			ImageView( );
+			ImageView( Frame &frame, mlt_image_format format, int width, int height, int writable = 0 );
+			bool is_valid( );
+			Frame &frame( );
+			mlt_image_format format( );
+			int width( );
+			int height( );
+			int count( );
+			uint8_t *plane( int index );
+			int stride( int index );
+			int rows( int index );
+			int columns( int index );
+			int components( int index );
+			int sample_size( );
+	};
+
+	/** The audio of a frame, addressed in place.
+	 *
+	 * The view holds a reference to the frame, so the samples stay valid for
+	 * as long as the view.
+	 */
+
+	class MLTPP_DECLSPEC AudioView
+	{
+		private:
+			Frame frame_;
+			mlt_audio_format format_;
+			int frequency_;
+			int channels_;
+			int samples_;
+			void *data_;
+		public:
+			AudioView( );
+			AudioView( Frame &frame, mlt_audio_format format, int frequency, int channels, int samples );
+			bool is_valid( );
+			Frame &frame( );
+			mlt_audio_format format( );
+			int frequency( );
+			int channels( );
+			int samples( );
+			void *data( );
+			int size( );
+			int sample_size( );
+			bool is_planar( );
+	};
 }
 
 #endif
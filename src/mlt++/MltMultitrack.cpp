@@ -20,6 +20,7 @@
 
 #include "MltMultitrack.h"
 #include "MltProducer.h"
+#include <utility>
 using namespace Mlt;
 
 Multitrack::Multitrack( mlt_multitrack multitrack ) :
@@ -90,6 +91,12 @@ Producer *Multitrack::track( int index )
 	return new Producer( mlt_multitrack_track( get_multitrack( ), index ) );
 }
 
+bool Multitrack::track( int index, Producer &producer )
+{
+	producer = Producer( mlt_multitrack_track( get_multitrack( ), index ) );
+	return producer.is_valid( );
+}
+
 void Multitrack::refresh( )
 {
 	return mlt_multitrack_refresh( get_multitrack( ) );
@@ -49,6 +49,7 @@ namespace Mlt
 			int clip( mlt_whence whence, int index );
 			int count( );
 			Producer *track( int index );
+			bool track( int index, Producer &producer );
 			void refresh( );
 	};
 }
@@ -185,6 +185,28 @@ int Parser::start( Service &service )
 	return mlt_parser_start( parser, service.get_service( ) );
 }
 
+int Parser::index( Service &service )
+{
+	return mlt_parser_index( parser, service.get_service( ) );
+}
+
+int Parser::index_count( mlt_service_type type )
+{
+	return mlt_parser_index_count( parser, type );
+}
+
+Service *Parser::index_get( mlt_service_type type, int i )
+{
+	mlt_service service = mlt_parser_index_get( parser, type, i );
+	return service != NULL ? new Service( service ) : NULL;
+}
+
+Service *Parser::index_find( const char *id )
+{
+	mlt_service service = mlt_parser_index_find( parser, id );
+	return service != NULL ? new Service( service ) : NULL;
+}
+
 int Parser::on_invalid( Service *object )
 {
 	object->debug( "Invalid" );
@@ -45,6 +45,10 @@ namespace Mlt
 			Parser( );
 			~Parser( );
 			int start( Service &service );
+			int index( Service &service );
+			int index_count( mlt_service_type type );
+			Service *index_get( mlt_service_type type, int i );
+			Service *index_find( const char *id );
 			virtual mlt_properties get_properties( );	
 			virtual int on_invalid( Service *object );
 			virtual int on_unknown( Service *object );
@@ -23,6 +23,7 @@
 #include "MltPlaylist.h"
 #include "MltTransition.h"
 #include "MltProfile.h"
+#include <utility>
 using namespace Mlt;
 
 ClipInfo::ClipInfo( ) :
@@ -115,11 +116,42 @@ Playlist::Playlist( mlt_playlist playlist ) :
 	inc_ref( );
 }
 
+Playlist::Playlist( Playlist &&playlist ) :
+	Mlt::Producer( std::move( playlist ) ),
+	instance( playlist.instance )
+{
+	playlist.instance = NULL;
+}
+
+Playlist::Playlist( mlt_playlist playlist, Adopt ) :
+	instance( playlist )
+{
+}
+
 Playlist::~Playlist( )
 {
 	mlt_playlist_close( instance );
 }
 
+Playlist& Playlist::operator=( Playlist &&playlist )
+{
+	if ( this != &playlist )
+	{
+		Producer::operator=( std::move( playlist ) );
+		mlt_playlist_close( instance );
+		instance = playlist.instance;
+		playlist.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_playlist Playlist::release( )
+{
+	mlt_playlist result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_playlist Playlist::get_playlist( )
 {
 	return instance;
@@ -170,6 +202,12 @@ Producer *Playlist::current( )
 	return new Producer( mlt_playlist_current( get_playlist( ) ) );
 }
 
+bool Playlist::current( Producer &producer )
+{
+	producer = Producer( mlt_playlist_current( get_playlist( ) ) );
+	return producer.is_valid( );
+}
+
 ClipInfo *Playlist::clip_info( int index, ClipInfo *info )
 {
 	mlt_playlist_clip_info clip_info;
@@ -257,12 +295,24 @@ Producer *Playlist::get_clip( int clip )
 	return producer != NULL ? new Producer( producer ) : NULL;
 }
 
+bool Playlist::get_clip( int clip, Producer &producer )
+{
+	producer = Producer( mlt_playlist_get_clip( get_playlist( ), clip ) );
+	return producer.is_valid( );
+}
+
 Producer *Playlist::get_clip_at( int position )
 {
 	mlt_producer producer = mlt_playlist_get_clip_at( get_playlist( ), position );
 	return producer != NULL ? new Producer( producer ) : NULL;
 }
 
+bool Playlist::get_clip_at( int position, Producer &producer )
+{
+	producer = Producer( mlt_playlist_get_clip_at( get_playlist( ), position ) );
+	return producer.is_valid( );
+}
+
 int Playlist::get_clip_index_at( int position )
 {
 	return mlt_playlist_get_clip_index_at( get_playlist( ), position );
@@ -65,7 +65,11 @@ namespace Mlt
 			Playlist( Service &playlist );
 			Playlist( Playlist &playlist );
 			Playlist( mlt_playlist playlist );
+			Playlist( Playlist &&playlist );
+			Playlist( mlt_playlist playlist, Adopt );
 			virtual ~Playlist( );
+			Playlist& operator=( Playlist &&playlist );
+			mlt_playlist release( );
 			virtual mlt_playlist get_playlist( );
 			mlt_producer get_producer( );
 			int count( );
@@ -76,6 +80,7 @@ namespace Mlt
 			int clip( mlt_whence whence, int index );
 			int current_clip( );
 			Producer *current( );
+			bool current( Producer &producer );
 			ClipInfo *clip_info( int index, ClipInfo *info = NULL );
 			static void delete_clip_info( ClipInfo *info );
 			int insert( Producer &producer, int where, int in = -1, int out = -1 );
@@ -92,7 +97,9 @@ namespace Mlt
 			int mix_add( int clip, Transition *transition );
 			int repeat( int clip, int count );
 			Producer *get_clip( int clip );
+			bool get_clip( int clip, Producer &producer );
 			Producer *get_clip_at( int position );
+			bool get_clip_at( int position, Producer &producer );
 			int get_clip_index_at( int position );
 			bool is_mix( int clip );
 			bool is_blank( int clip );
@@ -22,6 +22,7 @@
 #include "MltProfile.h"
 #include "MltEvent.h"
 #include "MltConsumer.h"
+#include <utility>
 using namespace Mlt;
 
 Producer::Producer( ) :
@@ -81,6 +82,21 @@ Producer::Producer( Producer *producer ) :
 		inc_ref( );
 }
 
+Producer::Producer( Producer &&producer ) :
+	Mlt::Service( std::move( producer ) ),
+	instance( producer.instance ),
+	parent_( producer.parent_ )
+{
+	producer.instance = NULL;
+	producer.parent_ = NULL;
+}
+
+Producer::Producer( mlt_producer producer, Adopt ) :
+	instance( producer ),
+	parent_( NULL )
+{
+}
+
 Producer::~Producer( )
 {
 	delete parent_;
@@ -88,6 +104,30 @@ Producer::~Producer( )
 	instance = NULL;
 }
 
+Producer& Producer::operator=( Producer &&producer )
+{
+	if ( this != &producer )
+	{
+		Service::operator=( std::move( producer ) );
+		delete parent_;
+		mlt_producer_close( instance );
+		instance = producer.instance;
+		parent_ = producer.parent_;
+		producer.instance = NULL;
+		producer.parent_ = NULL;
+	}
+	return *this;
+}
+
+mlt_producer Producer::release( )
+{
+	mlt_producer result = instance;
+	delete parent_;
+	instance = NULL;
+	parent_ = NULL;
+	return result;
+}
+
 mlt_producer Producer::get_producer( )
 {
 	return instance;
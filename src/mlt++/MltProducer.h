@@ -47,7 +47,11 @@ namespace Mlt
 			Producer( mlt_producer producer );
 			Producer( Producer &producer );
 			Producer( Producer *producer );
+			Producer( Producer &&producer );
+			Producer( mlt_producer producer, Adopt );
 			virtual ~Producer( );
+			Producer& operator=( Producer &&producer );
+			mlt_producer release( );
 			virtual mlt_producer get_producer( );
 			Producer &parent( );
 			mlt_producer get_parent( );
@@ -20,6 +20,7 @@
 #include "MltProperties.h"
 #include "MltEvent.h"
 #include "MltAnimation.h"
+#include <utility>
 using namespace Mlt;
 
 Properties::Properties( ) :
@@ -57,11 +58,40 @@ Properties::Properties( const char *file ) :
 	instance = mlt_properties_load( file );
 }
 
+Properties::Properties( Properties &&properties ) :
+	instance( properties.instance )
+{
+	properties.instance = NULL;
+}
+
+Properties::Properties( mlt_properties properties, Adopt ) :
+	instance( properties )
+{
+}
+
 Properties::~Properties( )
 {
 	mlt_properties_close( instance );
 }
 
+Properties& Properties::operator=( Properties &&properties )
+{
+	if ( this != &properties )
+	{
+		mlt_properties_close( instance );
+		instance = properties.instance;
+		properties.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_properties Properties::release( )
+{
+	mlt_properties result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_properties Properties::get_properties( )
 {
 	return instance;
@@ -408,6 +438,11 @@ mlt_rect Properties::anim_get_rect(const char *name, int position, int length)
 	return mlt_properties_anim_get_rect( get_properties(), name, position, length );
 }
 
+int Properties::get_many( mlt_value *values, int count, int position, int length )
+{
+	return mlt_properties_get_many( get_properties(), values, count, position, length );
+}
+
 mlt_animation Properties::get_animation( const char *name )
 {
 	return mlt_properties_get_animation( get_properties(), name );
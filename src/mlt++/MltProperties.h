@@ -30,6 +30,12 @@ namespace Mlt
 	class Event;
 	class Animation;
 
+	/** Tag for the constructors that take over a reference the caller holds
+	 * instead of adding one.
+	 */
+
+	struct Adopt { };
+
 	/** Abstract Properties class.
 	 */
 
@@ -44,7 +50,11 @@ namespace Mlt
 			Properties( mlt_properties properties );
 			Properties( void *properties );
 			Properties( const char *file );
+			Properties( Properties &&properties );
+			Properties( mlt_properties properties, Adopt );
 			virtual ~Properties( );
+			Properties& operator=( Properties &&properties );
+			mlt_properties release( );
 			virtual mlt_properties get_properties( );
 			int inc_ref( );
 			int dec_ref( );
@@ -121,6 +131,7 @@ namespace Mlt
 			int anim_set( const char *name, mlt_rect value, int position, int length = 0,
 				mlt_keyframe_type keyframe_type = mlt_keyframe_linear );
 			mlt_rect anim_get_rect( const char *name, int position, int length = 0 );
+			int get_many( mlt_value *values, int count, int position = 0, int length = 0 );
 			mlt_animation get_animation( const char *name );
 			Animation* get_anim( const char *name );
 	};
@@ -20,6 +20,7 @@
 
 #include "MltPushConsumer.h"
 #include "MltFilter.h"
+#include <algorithm>
 using namespace Mlt;
 
 namespace Mlt
@@ -90,36 +91,40 @@ int PushConsumer::connect( Service &/*service*/ )
 	return -1;
 }
 
-int PushConsumer::push( Frame *frame )
+// Process the frame at the render resolution when one is set
+static void render( PushConsumer &consumer, Frame *frame )
 {
-	frame->inc_ref( );
-
 	// Here we have the option to process the frame at a render resolution (this will 
 	// typically be PAL or NTSC) prior to scaling according to the consumers profile
 	// This is done to optimise quality, esp. with regard to compositing positions 
-	if ( get_int( "render_width" ) )
+	if ( consumer.get_int( "render_width" ) )
 	{
 		// Process the projects render resolution first
 		mlt_image_format format = mlt_image_yuv422;
-		int w = get_int( "render_width" );
-		int h = get_int( "render_height" );
-		frame->set( "consumer_aspect_ratio", get_double( "render_aspect_ratio" ) );
-		frame->set( "consumer_deinterlace", get_int( "deinterlace" ) );
-		frame->set( "deinterlace_method", get_int( "deinterlace_method" ) );
-		frame->set( "rescale.interp", get( "rescale" ) );
+		int w = consumer.get_int( "render_width" );
+		int h = consumer.get_int( "render_height" );
+		frame->set( "consumer_aspect_ratio", consumer.get_double( "render_aspect_ratio" ) );
+		frame->set( "consumer_deinterlace", consumer.get_int( "deinterlace" ) );
+		frame->set( "deinterlace_method", consumer.get_int( "deinterlace_method" ) );
+		frame->set( "rescale.interp", consumer.get( "rescale" ) );
 
 		// Render the frame
 		frame->get_image( format, w, h );
 
 		// Now set up the post image scaling
-		Filter *convert = ( Filter * )get_data( "filter_convert" );
+		Filter *convert = ( Filter * )consumer.get_data( "filter_convert" );
 		mlt_filter_process( convert->get_filter( ), frame->get_frame( ) );
-		Filter *rescale = ( Filter * )get_data( "filter_rescale" );
+		Filter *rescale = ( Filter * )consumer.get_data( "filter_rescale" );
 		mlt_filter_process( rescale->get_filter( ), frame->get_frame( ) );
-		Filter *resize = ( Filter * )get_data( "filter_resize" );
+		Filter *resize = ( Filter * )consumer.get_data( "filter_resize" );
 		mlt_filter_process( resize->get_filter( ), frame->get_frame( ) );
 	}
+}
 
+int PushConsumer::push( Frame *frame )
+{
+	frame->inc_ref( );
+	render( *this, frame );
 	return mlt_consumer_put_frame( ( mlt_consumer )get_service( ), frame->get_frame( ) );
 }
 
@@ -128,6 +133,49 @@ int PushConsumer::push( Frame &frame )
 	return push( &frame );
 }
 
+// Push a frame, waiting at most timeout milliseconds for room in the queue.
+// Returns 0 if the consumer took the frame.
+int PushConsumer::push( Frame &frame, int timeout )
+{
+	int error;
+
+	// Do not render a frame that a full queue would refuse at once
+	if ( timeout <= 0 && queued( ) >= depth( ) )
+		return 1;
+	render( *this, &frame );
+	frame.inc_ref( );
+	error = mlt_consumer_put_frame_timeout( get_consumer( ), frame.get_frame( ), timeout );
+	if ( error )
+		frame.dec_ref( );
+	return error;
+}
+
+int PushConsumer::try_push( Frame &frame )
+{
+	return push( frame, 0 );
+}
+
+// Set how many pushed frames may wait for the consumer
+void PushConsumer::set_depth( int depth )
+{
+	set( "put_depth", depth );
+}
+
+int PushConsumer::depth( )
+{
+	return std::max( 1, get_int( "put_depth" ) );
+}
+
+int PushConsumer::queued( )
+{
+	return mlt_consumer_put_count( get_consumer( ) );
+}
+
+double PushConsumer::latency( )
+{
+	return mlt_consumer_put_latency( get_consumer( ) );
+}
+
 int PushConsumer::drain( )
 {
 	return 0;
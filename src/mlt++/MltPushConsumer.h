@@ -43,6 +43,12 @@ namespace Mlt
 			virtual int connect( Service &service );
 			int push( Frame *frame );
 			int push( Frame &frame );
+			int push( Frame &frame, int timeout );
+			int try_push( Frame &frame );
+			void set_depth( int depth );
+			int depth( );
+			int queued( );
+			double latency( );
 			int drain( );
 			Frame *construct( int );
 	};
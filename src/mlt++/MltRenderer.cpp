@@ -0,0 +1,242 @@
+/**
+ * MltRenderer.cpp - MLT Wrapper
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "MltRenderer.h"
+#include "MltProducer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+using namespace Mlt;
+
+namespace Mlt
+{
+	typedef std::tuple<mlt_producer, int, int, int, int> RendererKey;
+
+	class RendererJob
+	{
+		public:
+			Producer producer;
+			RendererKey key;
+			int position;
+			mlt_image_format format;
+			int width;
+			int height;
+			std::promise<ImageView> promise;
+			std::shared_future<ImageView> future;
+
+			RendererJob( Producer &producer, int position, mlt_image_format format, int width, int height ) :
+				producer( producer ),
+				key( producer.get_producer( ), position, format, width, height ),
+				position( position ),
+				format( format ),
+				width( width ),
+				height( height ),
+				future( promise.get_future( ) )
+			{
+			}
+	};
+
+	typedef std::shared_ptr<RendererJob> RendererJobPtr;
+
+	class RendererJobs
+	{
+		public:
+			std::mutex mutex;
+			std::condition_variable cond;
+			std::deque<RendererJobPtr> queue;
+			std::map<RendererKey, RendererJobPtr> in_flight;
+			std::vector<std::thread> threads;
+			std::mutex seek_mutex;
+			bool stop;
+
+			RendererJobs( ) :
+				stop( false )
+			{
+			}
+
+			// Remove the queued jobs of a producer, or all with NULL, with the mutex held.
+			void take( mlt_producer producer, const RendererJob *keep, std::vector<RendererJobPtr> &taken )
+			{
+				for ( auto it = queue.begin( ); it != queue.end( ); )
+				{
+					if ( it->get( ) != keep && ( !producer || std::get<0>( ( *it )->key ) == producer ) )
+					{
+						in_flight.erase( ( *it )->key );
+						taken.push_back( *it );
+						it = queue.erase( it );
+					}
+					else
+					{
+						++ it;
+					}
+				}
+			}
+
+			static void cancelled( std::vector<RendererJobPtr> &taken )
+			{
+				for ( auto &job : taken )
+					job->promise.set_value( ImageView( ) );
+			}
+
+			ImageView render( RendererJob &job )
+			{
+				Frame frame;
+
+				// Seeking and getting the frame must not interleave, but the
+				// image is rendered in parallel with the other threads.
+				{
+					std::lock_guard<std::mutex> lock( seek_mutex );
+					job.producer.seek( job.position );
+					job.producer.get_frame( frame );
+				}
+				return ImageView( frame, job.format, job.width, job.height );
+			}
+
+			void run( )
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+
+				mlt_trace_thread( "renderer" );
+				while ( true )
+				{
+					while ( !stop && queue.empty( ) )
+						cond.wait( lock );
+					if ( stop )
+						break;
+					RendererJobPtr job = queue.front( );
+					queue.pop_front( );
+					lock.unlock( );
+					ImageView view = render( *job );
+					lock.lock( );
+					auto it = in_flight.find( job->key );
+					if ( it != in_flight.end( ) && it->second == job )
+						in_flight.erase( it );
+					lock.unlock( );
+					job->promise.set_value( view );
+					lock.lock( );
+				}
+			}
+	};
+}
+
+Renderer::Renderer( int threads ) :
+	jobs( new RendererJobs( ) )
+{
+	if ( threads <= 0 )
+		threads = std::max( 1, int( std::thread::hardware_concurrency( ) ) );
+	for ( int i = 0; i < threads; i ++ )
+		jobs->threads.push_back( std::thread( &RendererJobs::run, jobs ) );
+}
+
+Renderer::~Renderer( )
+{
+	cancel( );
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		jobs->stop = true;
+	}
+	jobs->cond.notify_all( );
+	for ( auto &thread : jobs->threads )
+		thread.join( );
+	delete jobs;
+}
+
+/** Render an image of a producer.
+ *
+ * If \p supersede is true, the queued requests for other positions of the
+ * producer are cancelled, which suits scrubbing and previews.
+ */
+
+std::shared_future<ImageView> Renderer::render_async( Producer &producer, int position,
+	mlt_image_format format, int width, int height, bool supersede )
+{
+	std::vector<RendererJobPtr> taken;
+	std::shared_future<ImageView> result;
+	RendererKey key( producer.get_producer( ), position, format, width, height );
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		auto it = jobs->in_flight.find( key );
+		RendererJobPtr job = it != jobs->in_flight.end( ) ? it->second : nullptr;
+
+		if ( supersede )
+			jobs->take( producer.get_producer( ), job.get( ), taken );
+		if ( !job )
+		{
+			job = std::make_shared<RendererJob>( producer, position, format, width, height );
+			jobs->in_flight[ key ] = job;
+			jobs->queue.push_back( job );
+			jobs->cond.notify_one( );
+		}
+		result = job->future;
+	}
+	RendererJobs::cancelled( taken );
+	return result;
+}
+
+/** Cancel the queued requests of a producer.
+ *
+ * \return the number of requests cancelled
+ */
+
+int Renderer::cancel( Producer &producer )
+{
+	std::vector<RendererJobPtr> taken;
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		if ( producer.get_producer( ) )
+			jobs->take( producer.get_producer( ), NULL, taken );
+	}
+	RendererJobs::cancelled( taken );
+	return taken.size( );
+}
+
+/** Cancel all of the queued requests.
+ *
+ * \return the number of requests cancelled
+ */
+
+int Renderer::cancel( )
+{
+	std::vector<RendererJobPtr> taken;
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		jobs->take( NULL, NULL, taken );
+	}
+	RendererJobs::cancelled( taken );
+	return taken.size( );
+}
+
+/** Get the number of requests that are queued or rendering. */
+
+int Renderer::pending( )
+{
+	std::lock_guard<std::mutex> lock( jobs->mutex );
+	return jobs->in_flight.size( );
+}
+
+int Renderer::threads( )
+{
+	return jobs->threads.size( );
+}
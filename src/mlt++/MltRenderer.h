@@ -0,0 +1,63 @@
+/**
+ * MltRenderer.h - MLT Wrapper
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLTPP_RENDERER_H
+#define MLTPP_RENDERER_H
+
+#include "MltConfig.h"
+
+#include <future>
+#include <framework/mlt.h>
+#include "MltFrame.h"
+
+namespace Mlt
+{
+	class Producer;
+	class RendererJobs;
+
+	/** Renders images of producers on a pool of threads.
+	 *
+	 * A request returns at once with a future of the image. Requests for the
+	 * same producer, position, format and size share one rendering while it
+	 * is queued or running. A request that is cancelled before it starts
+	 * gives an image view that is not valid.
+	 *
+	 * The renderer seeks the producer that it renders, so do not play it
+	 * while requests for it are pending.
+	 */
+
+	class MLTPP_DECLSPEC Renderer
+	{
+		private:
+			RendererJobs *jobs;
+			Renderer( const Renderer & );
+			Renderer& operator=( const Renderer & );
+		public:
+			Renderer( int threads = 0 );
+			~Renderer( );
+			std::shared_future<ImageView> render_async( Producer &producer, int position,
+				mlt_image_format format, int width, int height, bool supersede = false );
+			int cancel( Producer &producer );
+			int cancel( );
+			int pending( );
+			int threads( );
+	};
+}
+
+#endif
@@ -19,6 +19,7 @@
  */
 
 #include <string.h>
+#include <utility>
 #include "MltService.h"
 #include "MltFilter.h"
 #include "MltProfile.h"
@@ -44,11 +45,43 @@ Service::Service( mlt_service service ) :
 	inc_ref( );
 }
 
+Service::Service( Service &&service ) :
+	Properties( std::move( service ) ),
+	instance( service.instance )
+{
+	service.instance = NULL;
+}
+
+Service::Service( mlt_service service, Adopt ) :
+	Properties( false ),
+	instance( service )
+{
+}
+
 Service::~Service( )
 {
 	mlt_service_close( instance );
 }
 
+Service& Service::operator=( Service &&service )
+{
+	if ( this != &service )
+	{
+		Properties::operator=( std::move( service ) );
+		mlt_service_close( instance );
+		instance = service.instance;
+		service.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_service Service::release( )
+{
+	mlt_service result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_service Service::get_service( )
 {
 	return instance;
@@ -113,9 +146,15 @@ Frame *Service::get_frame( int index )
 {
 	mlt_frame frame = NULL;
 	mlt_service_get_frame( get_service( ), &frame, index );
-	Frame *result = new Frame( frame );
-	mlt_frame_close( frame );
-	return result;
+	return new Frame( frame, Adopt( ) );
+}
+
+int Service::get_frame( Frame &frame, int index )
+{
+	mlt_frame result = NULL;
+	int error = mlt_service_get_frame( get_service( ), &result, index );
+	frame = Frame( result, Adopt( ) );
+	return error;
 }
 
 mlt_service_type Service::type( )
@@ -43,7 +43,11 @@ namespace Mlt
 			Service( );
 			Service( Service &service );
 			Service( mlt_service service );
+			Service( Service &&service );
+			Service( mlt_service service, Adopt );
 			virtual ~Service( );
+			Service& operator=( Service &&service );
+			mlt_service release( );
 			virtual mlt_service get_service( );
 			void lock( );
 			void unlock( );
@@ -57,6 +61,7 @@ namespace Mlt
 			Profile *profile( );
 			mlt_profile get_profile( );
 			Frame *get_frame( int index = 0 );
+			int get_frame( Frame &frame, int index = 0 );
 			mlt_service_type type( );
 			int attach( Filter &filter );
 			int detach( Filter &filter );
@@ -24,6 +24,7 @@
 #include "MltFilter.h"
 #include "MltPlaylist.h"
 #include "MltProfile.h"
+#include <utility>
 using namespace Mlt;
 
 Tractor::Tractor( ) :
@@ -82,11 +83,42 @@ Tractor::Tractor( mlt_profile profile, char *id, char *resource ) :
 	}
 }
 
+Tractor::Tractor( Tractor &&tractor ) :
+	Mlt::Producer( std::move( tractor ) ),
+	instance( tractor.instance )
+{
+	tractor.instance = NULL;
+}
+
+Tractor::Tractor( mlt_tractor tractor, Adopt ) :
+	instance( tractor )
+{
+}
+
 Tractor::~Tractor( )
 {
 	mlt_tractor_close( instance );
 }
 
+Tractor& Tractor::operator=( Tractor &&tractor )
+{
+	if ( this != &tractor )
+	{
+		Producer::operator=( std::move( tractor ) );
+		mlt_tractor_close( instance );
+		instance = tractor.instance;
+		tractor.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_tractor Tractor::release( )
+{
+	mlt_tractor result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_tractor Tractor::get_tractor( )
 {
 	return instance;
@@ -133,6 +165,12 @@ Producer *Tractor::track( int index )
 	return producer != NULL ? new Producer( producer ) : NULL;
 }
 
+bool Tractor::track( int index, Producer &producer )
+{
+	producer = Producer( mlt_tractor_get_track( get_tractor( ), index ) );
+	return producer.is_valid( );
+}
+
 int Tractor::count( )
 {
 	return mlt_multitrack_count( mlt_tractor_multitrack( get_tractor( ) ) );
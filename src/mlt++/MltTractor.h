@@ -48,7 +48,11 @@ namespace Mlt
 			Tractor( Tractor &tractor );
 			Tractor( Profile& profile, char *id, char *arg = NULL );
 			Tractor( mlt_profile profile, char *id, char *arg = NULL );
+			Tractor( Tractor &&tractor );
+			Tractor( mlt_tractor tractor, Adopt );
 			virtual ~Tractor( );
+			Tractor& operator=( Tractor &&tractor );
+			mlt_tractor release( );
 			virtual mlt_tractor get_tractor( );
 			mlt_producer get_producer( );
 			Multitrack *multitrack( );
@@ -58,6 +62,7 @@ namespace Mlt
 			int insert_track( Producer &producer, int index );
 			int remove_track( int index );
 			Producer *track( int index );
+			bool track( int index, Producer &producer );
 			int count( );
 			void plant_transition( Transition &transition, int a_track = 0, int b_track = 1 );
 			void plant_transition( Transition *transition, int a_track = 0, int b_track = 1 );
@@ -22,6 +22,7 @@
 #include "MltTransition.h"
 #include "MltProfile.h"
 #include "MltProducer.h"
+#include <utility>
 using namespace Mlt;
 
 Transition::Transition( Profile& profile, const char *id, const char *arg ) :
@@ -76,11 +77,42 @@ Transition::Transition( mlt_transition transition ) :
 	inc_ref( );
 }
 
+Transition::Transition( Transition &&transition ) :
+	Mlt::Service( std::move( transition ) ),
+	instance( transition.instance )
+{
+	transition.instance = NULL;
+}
+
+Transition::Transition( mlt_transition transition, Adopt ) :
+	instance( transition )
+{
+}
+
 Transition::~Transition( )
 {
 	mlt_transition_close( instance );
 }
 
+Transition& Transition::operator=( Transition &&transition )
+{
+	if ( this != &transition )
+	{
+		Service::operator=( std::move( transition ) );
+		mlt_transition_close( instance );
+		instance = transition.instance;
+		transition.instance = NULL;
+	}
+	return *this;
+}
+
+mlt_transition Transition::release( )
+{
+	mlt_transition result = instance;
+	instance = NULL;
+	return result;
+}
+
 mlt_transition Transition::get_transition( )
 {
 	return instance;
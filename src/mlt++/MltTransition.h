@@ -41,7 +41,11 @@ namespace Mlt
 			Transition( Service &transition );
 			Transition( Transition &transition );
 			Transition( mlt_transition transition );
+			Transition( Transition &&transition );
+			Transition( mlt_transition transition, Adopt );
 			virtual ~Transition( );
+			Transition& operator=( Transition &&transition );
+			mlt_transition release( );
 			virtual mlt_transition get_transition( );
 			mlt_service get_service( );
 			void set_in_and_out( int in, int out );
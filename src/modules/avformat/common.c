@@ -22,6 +22,12 @@
 #include <libavutil/channel_layout.h>
 #include <libavutil/samplefmt.h>
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 int mlt_default_sws_flags = SWS_BICUBIC | SWS_FULL_CHR_H_INP | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND;
 
 int mlt_to_av_sample_format( mlt_audio_format format )
@@ -180,3 +186,60 @@ int mlt_set_luma_transfer( struct SwsContext *context, int src_colorspace,
 	return sws_setColorspaceDetails( context, src_coefficients, src_range, dst_coefficients, dst_range,
 		brightness, contrast, saturation );
 }
+
+#ifdef HWDEVICE
+
+// The hardware devices opened so far, shared by the producers and consumers.
+static struct hwdevice
+{
+	enum AVHWDeviceType type;
+	char *device;
+	AVBufferRef *ref;
+	struct hwdevice *next;
+} *hwdevices = NULL;
+static pthread_mutex_t hwdevices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Get a reference to a hardware device, opening it on first use.
+ *
+ * Decoders and encoders that use the same device exchange surfaces without
+ * copying them, which is only possible when they share the device context.
+ * \param device the name of the device or NULL for the default
+ * \return a new reference for the caller to release or NULL on error
+ */
+
+AVBufferRef *mlt_hwdevice_ref( enum AVHWDeviceType type, const char *device )
+{
+	struct hwdevice *entry;
+	AVBufferRef *ref = NULL;
+
+	pthread_mutex_lock( &hwdevices_mutex );
+	for ( entry = hwdevices; entry; entry = entry->next )
+		if ( entry->type == type && ( entry->device && device ? !strcmp( entry->device, device ) : entry->device == device ) )
+			break;
+	if ( !entry )
+	{
+		AVBufferRef *device_ref = NULL;
+		if ( av_hwdevice_ctx_create( &device_ref, type, device, NULL, 0 ) >= 0 )
+		{
+			entry = calloc( 1, sizeof( *entry ) );
+			if ( entry )
+			{
+				entry->type = type;
+				entry->device = device ? strdup( device ) : NULL;
+				entry->ref = device_ref;
+				entry->next = hwdevices;
+				hwdevices = entry;
+			}
+			else
+			{
+				av_buffer_unref( &device_ref );
+			}
+		}
+	}
+	if ( entry )
+		ref = av_buffer_ref( entry->ref );
+	pthread_mutex_unlock( &hwdevices_mutex );
+	return ref;
+}
+
+#endif
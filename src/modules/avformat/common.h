@@ -22,6 +22,11 @@
 
 #include <framework/mlt.h>
 #include <libswscale/swscale.h>
+#include <libavutil/version.h>
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 0, 0)
+#  define HWDEVICE
+#  include <libavutil/hwcontext.h>
+#endif
 
 int mlt_to_av_sample_format( mlt_audio_format format );
 int64_t mlt_to_av_channel_layout( mlt_channel_layout layout );
@@ -30,5 +35,8 @@ mlt_channel_layout mlt_get_channel_layout_or_default( const char* name, int chan
 int mlt_set_luma_transfer( struct SwsContext *context, int src_colorspace,
 	int dst_colorspace, int src_full_range, int dst_full_range );
 extern int mlt_default_sws_flags;
+#ifdef HWDEVICE
+AVBufferRef *mlt_hwdevice_ref( enum AVHWDeviceType type, const char *device );
+#endif
 
 #endif // COMMON_H
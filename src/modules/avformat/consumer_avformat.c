@@ -18,6 +18,7 @@
  */
 
 #include "common.h"
+#include "farm.h"
 
 // mlt Header files
 #include <framework/mlt_consumer.h>
@@ -25,6 +26,7 @@
 #include <framework/mlt_profile.h>
 #include <framework/mlt_log.h>
 #include <framework/mlt_events.h>
+#include <framework/mlt_metrics.h>
 
 // System header files
 #include <stdio.h>
@@ -61,11 +63,16 @@
 #endif
 
 #define MAX_AUDIO_STREAMS (8)
+#define MAX_RENDITIONS (8)
 #define AUDIO_ENCODE_BUFFER_SIZE (48000 * 2 * MAX_AUDIO_STREAMS)
 #define AUDIO_BUFFER_SIZE (1024 * 42)
 #define VIDEO_BUFFER_SIZE (8192 * 8192)
 #define IMAGE_ALIGN (4)
 
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+#define SEGMENTS
+#endif
+
 //
 // This structure should be extended and made globally available in mlt
 //
@@ -127,24 +134,76 @@ void sample_fifo_close( sample_fifo fifo )
 	free( fifo );
 }
 
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-static AVFilterGraph *vfilter_graph;
+#if defined(AVFILTER) && defined(HWDEVICE)
+#define HWENCODE
+
+// The pixel formats of the encoders that take hardware surfaces and their devices.
+static const struct
+{
+	enum AVPixelFormat pix_fmt;
+	enum AVHWDeviceType type;
+}
+hw_encode_formats[] =
+{
+	{ AV_PIX_FMT_VAAPI, AV_HWDEVICE_TYPE_VAAPI },
+	{ AV_PIX_FMT_CUDA, AV_HWDEVICE_TYPE_CUDA },
+	{ AV_PIX_FMT_QSV, AV_HWDEVICE_TYPE_QSV },
+	{ AV_PIX_FMT_VIDEOTOOLBOX, AV_HWDEVICE_TYPE_VIDEOTOOLBOX },
+};
+
+static enum AVHWDeviceType hw_encode_type( enum AVPixelFormat pix_fmt )
+{
+	int i;
+	for ( i = 0; i < sizeof( hw_encode_formats ) / sizeof( hw_encode_formats[0] ); i++ )
+		if ( hw_encode_formats[i].pix_fmt == pix_fmt )
+			return hw_encode_formats[i].type;
+	return AV_HWDEVICE_TYPE_NONE;
+}
+
+// Get the software pixel format that frames are uploaded from.
+static enum AVPixelFormat hw_upload_format( mlt_properties properties )
+{
+	const char *name = mlt_properties_get( properties, "hw_sw_format" );
+	enum AVPixelFormat pix_fmt = name ? av_get_pix_fmt( name ) : AV_PIX_FMT_NONE;
+	return pix_fmt == AV_PIX_FMT_NONE ? AV_PIX_FMT_NV12 : pix_fmt;
+}
+
+// Check whether a decoded surface can be encoded without copying it.
+static int hw_surface_matches( AVCodecContext *codec_context, const AVFrame *surface )
+{
+	AVHWFramesContext *surface_frames, *encoder_frames;
+
+	if ( !surface->hw_frames_ctx || !codec_context->hw_frames_ctx || surface->format != codec_context->pix_fmt )
+		return 0;
+	surface_frames = (AVHWFramesContext*) surface->hw_frames_ctx->data;
+	encoder_frames = (AVHWFramesContext*) codec_context->hw_frames_ctx->data;
+	return surface_frames->device_ref->data == encoder_frames->device_ref->data &&
+		surface_frames->sw_format == encoder_frames->sw_format &&
+		surface->width == codec_context->width && surface->height == codec_context->height;
+}
+
+static void vfilter_graph_close( void *graph )
+{
+	AVFilterGraph *vfilter_graph = graph;
+	avfilter_graph_free( &vfilter_graph );
+}
 
-static int setup_hwupload_filter(mlt_properties properties, AVStream* stream, AVCodecContext *codec_context)
+static int setup_hwupload_filter(mlt_properties properties, AVStream* stream, AVCodecContext *codec_context, enum AVPixelFormat sw_format)
 {
 	AVFilterContext *vfilter_in;
 	AVFilterContext *vfilter_out;
 	AVFilterContext *vfilter_hwupload;
+	AVFilterGraph *vfilter_graph;
 
 	vfilter_graph = avfilter_graph_alloc();
-	mlt_properties_set_data(properties, "vfilter_graph", &vfilter_graph, 0,
-		(mlt_destructor) avfilter_graph_free, NULL);
+	mlt_properties_set_data(properties, "vfilter_graph", vfilter_graph, 0,
+		vfilter_graph_close, NULL);
 
 	// From ffplay.c:configure_video_filters().
 	char buffersrc_args[256];
 	snprintf(buffersrc_args, sizeof(buffersrc_args),
 			 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
-			 codec_context->width, codec_context->height, AV_PIX_FMT_NV12,
+			 codec_context->width, codec_context->height, sw_format,
 			 stream->time_base.num, stream->time_base.den,
 		     codec_context->sample_aspect_ratio.num, codec_context->sample_aspect_ratio.den,
 			 codec_context->time_base.den, codec_context->time_base.num);
@@ -165,6 +224,11 @@ static int setup_hwupload_filter(mlt_properties properties, AVStream* stream, AV
 
 			if (result >= 0) {
 				vfilter_hwupload->hw_device_ctx = av_buffer_ref(codec_context->hw_device_ctx);
+#if LIBAVFILTER_VERSION_INT >= AV_VERSION_INT(7, 16, 100)
+				// QSV needs a fixed pool that also covers the frames the encoder holds.
+				if (AV_PIX_FMT_QSV == codec_context->pix_fmt)
+					vfilter_hwupload->extra_hw_frames = 32;
+#endif
 				result = avfilter_link(vfilter_in, 0, vfilter_hwupload, 0);
 				if (result >= 0) {
 					result = avfilter_link(vfilter_hwupload, 0, vfilter_out, 0);
@@ -183,23 +247,18 @@ static int setup_hwupload_filter(mlt_properties properties, AVStream* stream, AV
 	return result;
 }
 
-static AVBufferRef *hw_device_ctx;
-
-static int init_vaapi(mlt_properties properties, AVCodecContext *codec_context)
+static int init_hw_device(mlt_properties properties, AVCodecContext *codec_context, enum AVHWDeviceType type)
 {
-	int err = 0;
-	const char* vaapi_device = mlt_properties_get(properties, "vaapi_device");
-	
-	if ((err = av_hwdevice_ctx_create(&hw_device_ctx, AV_HWDEVICE_TYPE_VAAPI,
-									  vaapi_device, NULL, 0)) < 0) {
-		mlt_log_warning(NULL, "Failed to create VAAPI device.\n");
-		return err;
-	}
-	codec_context->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-	mlt_properties_set_data(properties, "hw_device_ctx", &hw_device_ctx, 0,
-							(mlt_destructor) av_buffer_unref, NULL);
-	
-	return err;
+	const char* device = mlt_properties_get(properties, "hw_device");
+
+	if (!device && AV_HWDEVICE_TYPE_VAAPI == type)
+		device = mlt_properties_get(properties, "vaapi_device");
+	codec_context->hw_device_ctx = mlt_hwdevice_ref(type, device);
+	if (!codec_context->hw_device_ctx) {
+		mlt_log_warning(NULL, "Failed to create %s device.\n", av_hwdevice_get_type_name(type));
+		return AVERROR(ENODEV);
+	}
+	return 0;
 }
 
 #endif
@@ -210,6 +269,10 @@ static int consumer_start( mlt_consumer consumer );
 static int consumer_stop( mlt_consumer consumer );
 static int consumer_is_stopped( mlt_consumer consumer );
 static void *consumer_thread( void *arg );
+#ifdef SEGMENTS
+static int segments_enabled( mlt_consumer consumer );
+static void *segments_thread( void *arg );
+#endif
 static void consumer_close( mlt_consumer consumer );
 
 /** Initialise the consumer.
@@ -234,7 +297,6 @@ mlt_consumer consumer_avformat_init( mlt_profile profile, char *arg )
 			mlt_properties_set( properties, "target", arg );
 
 		// sample and frame queue
-		mlt_properties_set_data( properties, "frame_queue", mlt_deque_init( ), 0, ( mlt_destructor )mlt_deque_close, NULL );
 
 		// Audio options not fully handled by AVOptions
 #define QSCALE_NONE (-99999)
@@ -469,7 +531,12 @@ static int consumer_start( mlt_consumer consumer )
 		// Assign the thread to properties
 		mlt_properties_set_data( properties, "thread", thread, sizeof( pthread_t ), free, NULL );
 
-		// Create the thread
+		// Create the thread, which renders in segments on consumers of its own if requested
+#ifdef SEGMENTS
+		if ( segments_enabled( consumer ) )
+			pthread_create( thread, NULL, segments_thread, consumer );
+		else
+#endif
 		pthread_create( thread, NULL, consumer_thread, consumer );
 
 		// Set the running state
@@ -550,6 +617,12 @@ static enum AVPixelFormat pick_pix_fmt( mlt_image_format img_fmt )
 		return AV_PIX_FMT_YUV420P;
 	case mlt_image_yuv422p16:
 		return AV_PIX_FMT_YUV422P16LE;
+	case mlt_image_yuv420p10:
+		return AV_PIX_FMT_YUV420P10LE;
+	case mlt_image_yuv444p16:
+		return AV_PIX_FMT_YUV444P16LE;
+	case mlt_image_rgba64:
+		return AV_PIX_FMT_RGBA64LE;
 	default:
 		return AV_PIX_FMT_YUYV422;
 	}
@@ -873,15 +946,17 @@ static AVStream *add_video_stream( mlt_consumer consumer, AVFormatContext *oc, A
 		c->pix_fmt = pix_fmt ? av_get_pix_fmt( pix_fmt ) : codec ?
 			( codec->pix_fmts ? codec->pix_fmts[0] : AV_PIX_FMT_YUV422P ): AV_PIX_FMT_YUV420P;
 
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-		if (AV_PIX_FMT_VAAPI == c->pix_fmt) {
-			int result = init_vaapi(properties, c);
+#ifdef HWENCODE
+		enum AVHWDeviceType hw_type = hw_encode_type(c->pix_fmt);
+		if (AV_HWDEVICE_TYPE_NONE != hw_type) {
+			int result = init_hw_device(properties, c, hw_type);
 			if (result >= 0) {
-				int result = setup_hwupload_filter(properties, st, c);
+				int result = setup_hwupload_filter(properties, st, c, hw_upload_format(properties));
 				if (result < 0)
 					mlt_log_error(MLT_CONSUMER_SERVICE(consumer), "Failed to setup hwfilter: %d\n", result);
 			} else {
-				mlt_log_error(MLT_CONSUMER_SERVICE(consumer), "Failed to initialize VA-API: %d\n", result);
+				mlt_log_error(MLT_CONSUMER_SERVICE(consumer), "Failed to initialize %s: %d\n",
+					av_hwdevice_get_type_name(hw_type), result);
 			}
 		}
 #endif
@@ -1154,6 +1229,103 @@ static void write_transmitter( mlt_listener listener, mlt_properties owner, mlt_
 	listener( owner, service, (uint8_t*) args[0], *p_size );
 }
 
+//
+// A bounded queue passing items between the stages of the encoder
+//
+
+typedef struct
+{
+	mlt_deque items;
+	int size;
+	int closed;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+}
+*encode_queue, encode_queue_s;
+
+static encode_queue encode_queue_init( int size )
+{
+	encode_queue self = calloc( 1, sizeof( encode_queue_s ) );
+	if ( self )
+	{
+		self->items = mlt_deque_init( );
+		self->size = size;
+		pthread_mutex_init( &self->mutex, NULL );
+		pthread_cond_init( &self->cond, NULL );
+	}
+	return self;
+}
+
+// Append an item, waiting while the queue is full.
+static void encode_queue_push( encode_queue self, void *item )
+{
+	pthread_mutex_lock( &self->mutex );
+	while ( mlt_deque_count( self->items ) >= self->size )
+		pthread_cond_wait( &self->cond, &self->mutex );
+	mlt_deque_push_back( self->items, item );
+	pthread_cond_broadcast( &self->cond );
+	pthread_mutex_unlock( &self->mutex );
+}
+
+// Remove the oldest item, waiting while the queue is empty; NULL once it is closed and empty.
+static void *encode_queue_pop( encode_queue self )
+{
+	void *item;
+	pthread_mutex_lock( &self->mutex );
+	while ( !mlt_deque_count( self->items ) && !self->closed )
+		pthread_cond_wait( &self->cond, &self->mutex );
+	item = mlt_deque_pop_front( self->items );
+	pthread_cond_broadcast( &self->cond );
+	pthread_mutex_unlock( &self->mutex );
+	return item;
+}
+
+// Wake the consumer of the queue once it has taken the last item.
+static void encode_queue_close( encode_queue self )
+{
+	pthread_mutex_lock( &self->mutex );
+	self->closed = 1;
+	pthread_cond_broadcast( &self->cond );
+	pthread_mutex_unlock( &self->mutex );
+}
+
+static void encode_queue_free( encode_queue self )
+{
+	if ( self )
+	{
+		mlt_deque_close( self->items );
+		pthread_mutex_destroy( &self->mutex );
+		pthread_cond_destroy( &self->cond );
+		free( self );
+	}
+}
+
+// A converted image waiting for the video encoder
+typedef struct
+{
+	AVFrame *picture; // NULL to repeat the previous picture
+	AVFrame *hw_frame;
+	AVFrame *renditions[ MAX_RENDITIONS ]; // the picture scaled for each rendition of the ladder
+	int progressive;
+	int top_field_first;
+}
+video_item;
+
+// An extra video stream of the ladder, encoded from a scaled down picture
+typedef struct
+{
+	AVStream *st;
+	int width;
+	int height;
+	char bitrate[32];
+	int source;                  ///< the rendition it is scaled from, or -1 for the main picture
+	struct SwsContext *scaler;
+	encode_queue free_pictures;
+	AVFrame *last_picture;
+	int error_count;
+}
+rendition;
+
 typedef struct encode_ctx_desc
 {
 	mlt_consumer consumer;
@@ -1178,6 +1350,8 @@ typedef struct encode_ctx_desc
 	int audio_codec_id;
 
 	int error_count;
+	int video_error_count;
+	int hwupload_error_count;
 	int frame_count;
 
 	double audio_pts;
@@ -1185,23 +1359,207 @@ typedef struct encode_ctx_desc
 
 	int terminate_on_pause;
 	int terminated;
+	int real_time_output;
 	mlt_properties properties;
 	mlt_properties frame_meta_properties;
+	mlt_properties audio_meta_properties;
 
 	AVFrame *audio_avframe;
+
+	// Video conversion and encoding
+	int width;
+	int height;
+	mlt_image_format img_fmt;
+	enum AVPixelFormat pix_fmt;
+	int dst_colorspace;
+	int dst_full_range;
+	uint8_t *video_outbuf;
+	int video_outbuf_size;
+	AVFrame *last_picture;
+	rendition renditions[ MAX_RENDITIONS ];
+	int rendition_count;
+
+	// The stages run on their own threads when the pipeline depth is not 0
+	int pipeline;
+	int started;
+	volatile int failed;
+	encode_queue frame_queue;
+	encode_queue picture_queue;
+	encode_queue free_pictures;
+	encode_queue packet_queue;
+	pthread_t convert_thread;
+	pthread_t video_thread;
+	pthread_t audio_thread;
+	pthread_t mux_thread;
+
+	// Guards the sample fifo, the channels and the frame meta properties
+	pthread_mutex_t audio_mutex;
+	pthread_cond_t audio_cond;
+	int audio_finished;
 } encode_ctx_t;
 
+/** Add the video streams of the ladder.
+ *
+ * The ladder is a list of width x height and optional bitrate separated by
+ * commas, like 1280x720:3M,640x360:800k. Each rendition is encoded with the
+ * codec and options of the main video stream, but for its size and bitrate,
+ * from the picture of the smallest larger rendition.
+ * \return the number of renditions
+ */
+
+static int add_renditions( mlt_consumer consumer, AVFormatContext *oc, AVCodec *codec, AVStream *video_st,
+	rendition *renditions )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	const char *ladder = mlt_properties_get( properties, "ladder" );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	int count = 0;
+	int i;
+
+	if ( mlt_properties_get_int( properties, "pass" ) )
+	{
+		mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "the ladder needs a single pass, ignoring it\n" );
+		return 0;
+	}
+#ifdef HWENCODE
+	if ( AV_HWDEVICE_TYPE_NONE != hw_encode_type( video_st->codec->pix_fmt ) )
+	{
+		mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "the ladder needs a software encoder, ignoring it\n" );
+		return 0;
+	}
+#endif
+	while ( ladder && *ladder && count < MAX_RENDITIONS )
+	{
+		rendition *r = &renditions[ count ];
+		const char *end = strchr( ladder, ',' );
+		int length = end ? end - ladder : strlen( ladder );
+		int w = 0, h = 0, n = 0;
+
+		memset( r, 0, sizeof( *r ) );
+		if ( sscanf( ladder, "%dx%d%n", &w, &h, &n ) < 2 || w <= 0 || h <= 0 || n > length )
+		{
+			mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "invalid rendition %.*s in the ladder\n", length, ladder );
+		}
+		else if ( ( r->st = add_video_stream( consumer, oc, codec ) ) )
+		{
+			AVCodecContext *c = r->st->codec;
+
+			// Keep the display aspect ratio at the even size
+			r->width = c->width = ( w + 1 ) & ~1;
+			r->height = c->height = ( h + 1 ) & ~1;
+			c->sample_aspect_ratio = av_mul_q( video_st->codec->sample_aspect_ratio,
+				(AVRational){ width * r->height, r->width * height } );
+			r->st->sample_aspect_ratio = c->sample_aspect_ratio;
+			if ( ladder[ n ] == ':' && length - n - 1 > 0 )
+			{
+				snprintf( r->bitrate, sizeof( r->bitrate ), "%.*s", length - n - 1, ladder + n + 1 );
+				if ( av_opt_set( c, "b", r->bitrate, 0 ) < 0 )
+					mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "invalid bitrate %s in the ladder\n", r->bitrate );
+			}
+
+			// Scale from the smallest rendition before it that is at least as large
+			r->source = -1;
+			for ( i = 0; i < count; i++ )
+				if ( renditions[i].width >= r->width && renditions[i].height >= r->height &&
+				     ( r->source < 0 || renditions[i].width <= renditions[ r->source ].width ) )
+					r->source = i;
+			count++;
+		}
+		ladder = end ? end + 1 : NULL;
+	}
+	return count;
+}
+
+/** Group the streams of the ladder into the variants of HLS or the
+ * adaptation sets of DASH, unless these are given, so that the players
+ * switch between the renditions and share the audio.
+ */
+
+static void map_renditions( encode_ctx_t *ctx )
+{
+	mlt_properties properties = ctx->properties;
+	AVFormatContext *oc = ctx->oc;
+	char map[ 24 * ( MAX_RENDITIONS + MAX_AUDIO_STREAMS + 1 ) ] = "";
+	const char *option = NULL;
+	int audio = 0;
+	int i;
+
+	while ( audio < MAX_AUDIO_STREAMS && ctx->audio_st[ audio ] )
+		audio++;
+	if ( !ctx->rendition_count || !oc->priv_data )
+		return;
+	if ( !strcmp( oc->oformat->name, "hls" ) && !mlt_properties_get( properties, "var_stream_map" ) )
+	{
+		for ( i = 0; i < audio; i++ )
+			sprintf( map + strlen( map ), "a:%d,agroup:audio ", i );
+		for ( i = 0; i <= ctx->rendition_count; i++ )
+			sprintf( map + strlen( map ), audio ? "v:%d,agroup:audio " : "v:%d ", i );
+		map[ strlen( map ) - 1 ] = '\0';
+		option = "var_stream_map";
+		if ( !mlt_properties_get( properties, "master_pl_name" ) )
+			av_opt_set( oc->priv_data, "master_pl_name", "master.m3u8", 0 );
+	}
+	else if ( !strcmp( oc->oformat->name, "dash" ) && !mlt_properties_get( properties, "adaptation_sets" ) )
+	{
+		strcpy( map, audio ? "id=0,streams=v id=1,streams=a" : "id=0,streams=v" );
+		option = "adaptation_sets";
+	}
+	if ( option && av_opt_set( oc->priv_data, option, map, 0 ) < 0 )
+		mlt_log_warning( MLT_CONSUMER_SERVICE( ctx->consumer ), "failed to set %s to %s\n", option, map );
+}
+
+/** Write a packet, or queue it for the mux thread.
+ *
+ * The packet is blank afterwards in either case.
+ * \return non-zero on error
+ */
+
+static int mux_packet( encode_ctx_t *ctx, AVPacket *pkt )
+{
+	AVPacket *copy;
+
+	if ( !ctx->packet_queue )
+		return av_interleaved_write_frame( ctx->oc, pkt );
+
+	// Take over the data of the packet, copying it if the encoder owns it.
+	copy = av_malloc( sizeof( AVPacket ) );
+	if ( !copy )
+		return AVERROR(ENOMEM);
+	*copy = *pkt;
+	av_init_packet( pkt );
+	pkt->data = NULL;
+	pkt->size = 0;
+	if ( av_dup_packet( copy ) < 0 )
+	{
+		av_free( copy );
+		return AVERROR(ENOMEM);
+	}
+	encode_queue_push( ctx->packet_queue, copy );
+	return 0;
+}
+
+// Check whether the fifo holds a whole frame for the audio encoder.
+static int audio_frame_ready( encode_ctx_t* ctx )
+{
+	return ctx->fifo && sample_fifo_used( ctx->fifo ) >=
+		ctx->audio_input_frame_size * ctx->channels * ctx->sample_bytes;
+}
+
 static int encode_audio(encode_ctx_t* ctx)
 {
 	char key[27];
 	int i, j = 0, samples = ctx->audio_input_frame_size;
 
-	int frame_length = ctx->audio_input_frame_size * ctx->channels * ctx->sample_bytes;
+	// Take the samples and the channel map from the consumer thread.
+	pthread_mutex_lock( &ctx->audio_mutex );
+	int channels = ctx->channels;
+	int frame_length = ctx->audio_input_frame_size * channels * ctx->sample_bytes;
 
 	// Get samples count to fetch from fifo
 	if ( sample_fifo_used( ctx->fifo ) < frame_length )
 	{
-		samples = sample_fifo_used( ctx->fifo ) / ( ctx->channels * ctx->sample_bytes );
+		samples = sample_fifo_used( ctx->fifo ) / ( channels * ctx->sample_bytes );
 	}
 	else if ( ctx->audio_input_frame_size == 1 )
 	{
@@ -1211,18 +1569,19 @@ static int encode_audio(encode_ctx_t* ctx)
 
 	// Get the audio samples
 	if ( samples > 0 )
+		sample_fifo_fetch( ctx->fifo, ctx->audio_buf_1, samples * ctx->sample_bytes * channels );
+	mlt_properties_pass( ctx->audio_meta_properties, ctx->frame_meta_properties, "" );
+	pthread_mutex_unlock( &ctx->audio_mutex );
+
+	if ( samples <= 0 )
 	{
-		sample_fifo_fetch( ctx->fifo, ctx->audio_buf_1, samples * ctx->sample_bytes * ctx->channels );
-	}
-	else if ( ctx->audio_codec_id == AV_CODEC_ID_VORBIS && ctx->terminated )
-	{
-		// This prevents an infinite loop when some versions of vorbis do not
-		// increment pts when encoding silence.
-		ctx->audio_pts = ctx->video_pts;
-		return 1;
-	}
-	else
-	{
+		if ( ctx->audio_codec_id == AV_CODEC_ID_VORBIS && ctx->terminated )
+		{
+			// This prevents an infinite loop when some versions of vorbis do not
+			// increment pts when encoding silence.
+			ctx->audio_pts = ctx->video_pts;
+			return 1;
+		}
 		memset( ctx->audio_buf_1, 0, AUDIO_ENCODE_BUFFER_SIZE );
 	}
 
@@ -1238,17 +1597,17 @@ static int encode_audio(encode_ctx_t* ctx)
 		pkt.size = ctx->audio_outbuf_size;
 
 		// Optimized for single track and no channel remap
-		if ( !ctx->audio_st[1] && !mlt_properties_count( ctx->frame_meta_properties ) )
+		if ( !ctx->audio_st[1] && !mlt_properties_count( ctx->audio_meta_properties ) )
 		{
 			void* p = ctx->audio_buf_1;
 			if ( codec->sample_fmt == AV_SAMPLE_FMT_FLTP )
-				p = interleaved_to_planar( samples, ctx->channels, p, sizeof( float ) );
+				p = interleaved_to_planar( samples, channels, p, sizeof( float ) );
 			else if ( codec->sample_fmt == AV_SAMPLE_FMT_S16P )
-				p = interleaved_to_planar( samples, ctx->channels, p, sizeof( int16_t ) );
+				p = interleaved_to_planar( samples, channels, p, sizeof( int16_t ) );
 			else if ( codec->sample_fmt == AV_SAMPLE_FMT_S32P )
-				p = interleaved_to_planar( samples, ctx->channels, p, sizeof( int32_t ) );
+				p = interleaved_to_planar( samples, channels, p, sizeof( int32_t ) );
 			else if ( codec->sample_fmt == AV_SAMPLE_FMT_U8P )
-				p = interleaved_to_planar( samples, ctx->channels, p, sizeof( uint8_t ) );
+				p = interleaved_to_planar( samples, channels, p, sizeof( uint8_t ) );
 			ctx->audio_avframe->nb_samples = FFMAX( samples, ctx->audio_input_frame_size );
 			ctx->audio_avframe->pts = ctx->sample_count[i];
 			ctx->sample_count[i] += ctx->audio_avframe->nb_samples;
@@ -1299,10 +1658,10 @@ static int encode_audio(encode_ctx_t* ctx)
 				for ( k = 0; k < (MAX_AUDIO_STREAMS * 2) && map_start != j; k++ )
 				{
 					sprintf( key, "%d.channels", k );
-					map_channels = mlt_properties_get_int( ctx->frame_meta_properties, key );
+					map_channels = mlt_properties_get_int( ctx->audio_meta_properties, key );
 					sprintf( key, "%d.start", k );
-					if ( mlt_properties_get( ctx->frame_meta_properties, key ) )
-						map_start = mlt_properties_get_int( ctx->frame_meta_properties, key );
+					if ( mlt_properties_get( ctx->audio_meta_properties, key ) )
+						map_start = mlt_properties_get_int( ctx->audio_meta_properties, key );
 					if ( map_start != j )
 						source_offset += map_channels;
 				}
@@ -1315,7 +1674,7 @@ static int encode_audio(encode_ctx_t* ctx)
 				}
 
 				// Copy samples if source offset valid
-				if ( source_offset < ctx->channels )
+				if ( source_offset < channels )
 				{
 					// Interleave the audio buffer with the # channels for this stream/mapping.
 					for ( k = 0; k < map_channels; k++, j++, source_offset++, dest_offset++ )
@@ -1327,7 +1686,7 @@ static int encode_audio(encode_ctx_t* ctx)
 						while ( --s ) {
 							memcpy( dest, src, ctx->sample_bytes );
 							dest += current_channels * ctx->sample_bytes;
-							src += ctx->channels * ctx->sample_bytes;
+							src += channels * ctx->sample_bytes;
 						}
 					}
 				}
@@ -1375,7 +1734,7 @@ receive_audio_packet:
 			if ( pkt.duration > 0 )
 				pkt.duration = av_rescale_q( pkt.duration, codec->time_base, stream->time_base );
 			pkt.stream_index = stream->index;
-			if ( av_interleaved_write_frame( ctx->oc, &pkt ) )
+			if ( mux_packet( ctx, &pkt ) )
 			{
 				mlt_log_fatal( MLT_CONSUMER_SERVICE( ctx->consumer ), "error writing audio frame\n" );
 				mlt_events_fire( ctx->properties, "consumer-fatal-error", NULL );
@@ -1405,96 +1764,1460 @@ receive_audio_packet:
 	return 0;
 }
 
-/** The main thread - the argument is simply the consumer.
-*/
+// Encode the whole frames in the fifo.
+static int encode_ready_audio( encode_ctx_t* ctx )
+{
+	int ready, error = 0;
 
-static void *consumer_thread( void *arg )
+	pthread_mutex_lock( &ctx->audio_mutex );
+	ready = audio_frame_ready( ctx );
+	pthread_mutex_unlock( &ctx->audio_mutex );
+	while ( ready && !error )
+	{
+		error = encode_audio( ctx ) < 0;
+		pthread_mutex_lock( &ctx->audio_mutex );
+		ready = audio_frame_ready( ctx );
+		pthread_mutex_unlock( &ctx->audio_mutex );
+	}
+	return error;
+}
+
+// Pad the audio to the end of the video on termination and flush the audio encoder.
+static int finish_audio( encode_ctx_t* ctx )
 {
-	int i;
+	if ( !ctx->fifo )
+		return 0;
+	if ( ctx->video_st && ctx->terminated )
+	{
+		while ( ctx->audio_pts < ctx->video_pts )
+		{
+			int r = encode_audio( ctx );
+			if ( r > 0 )
+				break;
+			else if ( r < 0 )
+				return 1;
+		}
+	}
+	if ( ctx->real_time_output <= 0 )
+	{
+		// Flush audio fifo
+		// TODO: flush all audio streams
+		for (;;)
+		{
+			pthread_mutex_lock( &ctx->audio_mutex );
+			int sz = sample_fifo_used( ctx->fifo );
+			pthread_mutex_unlock( &ctx->audio_mutex );
+			int ret = encode_audio( ctx );
 
-	// Encoding content
-	encode_ctx_t* enc_ctx = mlt_pool_alloc(sizeof(encode_ctx_t));
-	memset(enc_ctx, 0, sizeof(encode_ctx_t));
+			mlt_log_debug( MLT_CONSUMER_SERVICE( ctx->consumer ), "flushing audio: sz=%d, ret=%d\n", sz, ret );
 
-	// Map the argument to the object
-	mlt_consumer consumer = enc_ctx->consumer = arg;
+			if ( !sz || ret < 0 )
+				break;
+		}
+	}
+	return 0;
+}
 
-	// Get the properties
-	mlt_properties properties = enc_ctx->properties = MLT_CONSUMER_PROPERTIES( consumer );
+/** Convert the image of a frame to the pixel format of the encoder and close the frame.
+ *
+ * \return the item for encode_video() or NULL on error
+ */
 
-	// Get the terminate on pause property
-	enc_ctx->terminate_on_pause = mlt_properties_get_int( enc_ctx->properties, "terminate_on_pause" );
+static video_item *convert_video( encode_ctx_t* ctx, mlt_frame frame )
+{
+	mlt_properties properties = ctx->properties;
+	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+	AVCodecContext *c = ctx->video_st->codec;
+	int width = ctx->width;
+	int height = ctx->height;
+	video_item *item = calloc( 1, sizeof( video_item ) );
+
+	if ( !item || ctx->failed )
+	{
+		free( item );
+		mlt_frame_close( frame );
+		return NULL;
+	}
+	item->progressive = mlt_properties_get_int( frame_properties, "progressive" );
+	item->top_field_first = mlt_properties_get_int( frame_properties, "top_field_first" );
 
-	// Determine if feed is slow (for realtime stuff)
-	int real_time_output = mlt_properties_get_int( properties, "real_time" );
+	if ( mlt_properties_get_int( frame_properties, "rendered" ) )
+	{
+		AVFrame video_avframe;
+		AVFrame *converted_avframe;
+		mlt_image_format img_fmt = ctx->img_fmt;
+		enum AVPixelFormat src_pix_fmt;
+		int img_width = width;
+		int img_height = height;
+		uint8_t *image;
+		int i;
 
-	// Time structures
-	struct timeval ante;
+		mlt_frame_get_image( frame, &image, &img_fmt, &img_width, &img_height, 0 );
 
-	// Get the frame rate
-	double fps = mlt_properties_get_double( properties, "fps" );
+#ifdef HWENCODE
+		AVFrame *sw_frame = NULL;
+		if ( img_fmt == mlt_image_hwsurface )
+		{
+			AVFrame *surface = (AVFrame*) image;
 
-	// Get width and height
-	int width = mlt_properties_get_int( properties, "width" );
-	int height = mlt_properties_get_int( properties, "height" );
-	int img_width = width;
-	int img_height = height;
+			// Pass a surface of the encoder's device straight to it.
+			if ( hw_surface_matches( c, surface ) && ( item->hw_frame = av_frame_clone( surface ) ) )
+			{
+				mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+				mlt_frame_close( frame );
+				return item;
+			}
 
-	// Get default audio properties
-	enc_ctx->total_channels = enc_ctx->channels = mlt_properties_get_int( properties, "channels" );
-	enc_ctx->frequency = mlt_properties_get_int( properties, "frequency" );
-	void *pcm = NULL;
-	int samples = 0;
+			// Otherwise download it and upload it again below.
+			sw_frame = av_frame_alloc();
+			if ( !sw_frame || av_hwframe_transfer_data( sw_frame, surface, 0 ) < 0 )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( ctx->consumer ), "failed to download the %s surface\n",
+					mlt_properties_get( frame_properties, "hwsurface.type" ) );
+				av_frame_free( &sw_frame );
+				mlt_frame_close( frame );
+				return item;
+			}
+			memcpy( video_avframe.data, sw_frame->data, sizeof( video_avframe.data ) );
+			memcpy( video_avframe.linesize, sw_frame->linesize, sizeof( video_avframe.linesize ) );
+			src_pix_fmt = sw_frame->format;
+		}
+		else
+#endif
+		{
+			mlt_image_format_planes( img_fmt, width, height, image, video_avframe.data, video_avframe.linesize );
+			src_pix_fmt = pick_pix_fmt( img_fmt );
+		}
+		converted_avframe = item->picture = encode_queue_pop( ctx->free_pictures );
 
-	// AVFormat audio buffer and frame size
-	enc_ctx->audio_outbuf_size = AUDIO_BUFFER_SIZE;
+		int src_colorspace = mlt_properties_get_int( frame_properties, "colorspace" );
+		int src_full_range = mlt_properties_get_int( frame_properties, "full_luma" );
+		int transfer = ( src_colorspace && ctx->dst_colorspace != src_colorspace ) || ctx->dst_full_range != src_full_range;
+		if ( src_pix_fmt == ctx->pix_fmt && !transfer )
+		{
+			// The image is already in the pixel format of the encoder
+			av_image_copy( converted_avframe->data, converted_avframe->linesize,
+				(const uint8_t**) video_avframe.data, video_avframe.linesize, ctx->pix_fmt, width, height );
+		}
+		else
+		{
+			// Do the colour space conversion
+			int flags = mlt_default_sws_flags;
+			struct SwsContext *context = sws_getContext( width, height, src_pix_fmt,
+				width, height, ctx->pix_fmt, flags, NULL, NULL, NULL);
+			if ( transfer )
+				mlt_set_luma_transfer( context, src_colorspace, ctx->dst_colorspace, src_full_range, ctx->dst_full_range );
+			sws_scale( context, (const uint8_t* const*) video_avframe.data, video_avframe.linesize, 0, height,
+				converted_avframe->data, converted_avframe->linesize);
+			sws_freeContext( context );
+		}
+#ifdef HWENCODE
+		av_frame_free( &sw_frame );
+#endif
 
-	// AVFormat video buffer and frame count
-	int video_outbuf_size = VIDEO_BUFFER_SIZE;
-	uint8_t *video_outbuf = av_malloc( video_outbuf_size );
+		mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
 
-	// Used for the frame properties
-	mlt_frame frame = NULL;
-	mlt_properties frame_properties = NULL;
+		// Apply the alpha if applicable
+		if ( !mlt_properties_get( properties, "mlt_image_format" ) ||
+		     strcmp( mlt_properties_get( properties, "mlt_image_format" ), "rgb24a" ) )
+		if ( c->pix_fmt == AV_PIX_FMT_RGBA ||
+		     c->pix_fmt == AV_PIX_FMT_ARGB ||
+		     c->pix_fmt == AV_PIX_FMT_BGRA )
+		{
+			uint8_t *p;
+			uint8_t *alpha = mlt_frame_get_alpha( frame );
+			register int n;
 
-	// Get the queues
-	mlt_deque queue = mlt_properties_get_data( properties, "frame_queue", NULL );
-	enc_ctx->fifo = mlt_properties_get_data( properties, "sample_fifo", NULL );
+			// Without an alpha channel the image is opaque
+			for ( i = 0; !alpha && i < height; i ++ )
+			{
+				p = converted_avframe->data[ 0 ] + i * converted_avframe->linesize[ 0 ] + 3;
+				for ( n = 0; n < width; n ++, p += 4 )
+					*p = 255;
+			}
+			for ( i = 0; alpha && i < height; i ++ )
+			{
+				n = ( width + 7 ) / 8;
+				p = converted_avframe->data[ 0 ] + i * converted_avframe->linesize[ 0 ] + 3;
 
-	// For receiving images from an mlt_frame
-	uint8_t *image;
-	mlt_image_format img_fmt = mlt_image_yuv422;
+				switch( width % 8 )
+				{
+					case 0:	do { *p = *alpha++; p += 4;
+					case 7:		 *p = *alpha++; p += 4;
+					case 6:		 *p = *alpha++; p += 4;
+					case 5:		 *p = *alpha++; p += 4;
+					case 4:		 *p = *alpha++; p += 4;
+					case 3:		 *p = *alpha++; p += 4;
+					case 2:		 *p = *alpha++; p += 4;
+					case 1:		 *p = *alpha++; p += 4;
+							}
+							while( --n );
+				}
+			}
+		}
 
-	// Need two av pictures for converting
-	AVFrame *converted_avframe = NULL;
-	AVFrame *avframe = NULL;
+		// Scale the pictures of the ladder, each from the smallest larger one
+		for ( i = 0; i < ctx->rendition_count; i++ )
+		{
+			rendition *r = &ctx->renditions[i];
+			AVFrame *source = r->source < 0 ? converted_avframe : item->renditions[ r->source ];
+			AVFrame *scaled = item->renditions[i] = encode_queue_pop( r->free_pictures );
+
+			r->scaler = sws_getCachedContext( r->scaler, source->width, source->height, source->format,
+				r->width, r->height, scaled->format, mlt_default_sws_flags, NULL, NULL, NULL );
+			if ( r->scaler )
+				sws_scale( r->scaler, (const uint8_t* const*) source->data, source->linesize, 0, source->height,
+					scaled->data, scaled->linesize );
+		}
 
-	// For receiving audio samples back from the fifo
-	int count = 0;
+#ifdef HWENCODE
+		if (AV_HWDEVICE_TYPE_NONE != hw_encode_type(c->pix_fmt)) {
+			AVFilterContext *vfilter_in = mlt_properties_get_data(properties, "vfilter_in", NULL);
+			AVFilterContext *vfilter_out = mlt_properties_get_data(properties, "vfilter_out", NULL);
+			if (vfilter_in && vfilter_out) {
+				int ret;
+				item->hw_frame = av_frame_alloc();
+				ret = av_buffersrc_add_frame(vfilter_in, converted_avframe);
+				ret = av_buffersink_get_frame(vfilter_out, item->hw_frame);
+				if (ret < 0) {
+					mlt_log_warning(MLT_CONSUMER_SERVICE(ctx->consumer), "error with hwupload: %d\n", ret);
+					av_frame_free(&item->hw_frame);
+					if (++ctx->hwupload_error_count > 2)
+						ctx->failed = 1;
+				} else {
+					ctx->hwupload_error_count = 0;
+				}
+			}
+		}
+#endif
+	}
+	mlt_frame_close( frame );
+	return item;
+}
 
-	// Frames dispatched
-	long int frames = 0;
-	long int total_time = 0;
+/** Encode a picture into a video stream.
+ *
+ * \return non-zero on a fatal error
+ */
 
-	// Determine the format
-	AVOutputFormat *fmt = NULL;
-	const char *filename = mlt_properties_get( properties, "target" );
-	char *format = mlt_properties_get( properties, "f" );
-	char *vcodec = mlt_properties_get( properties, "vcodec" );
-	char *acodec = mlt_properties_get( properties, "acodec" );
-	AVCodec *audio_codec = NULL;
-	AVCodec *video_codec = NULL;
+static int encode_picture( encode_ctx_t* ctx, AVStream *st, AVFrame *avframe, video_item *item, int *error_count )
+{
+	mlt_properties properties = ctx->properties;
+	AVCodecContext *c = st->codec;
+	int ret = 0;
 
+	if ( ctx->failed || !avframe )
+	{
+		// Nothing to encode
+	}
+#ifdef AVFMT_RAWPICTURE
+	else if (ctx->oc->oformat->flags & AVFMT_RAWPICTURE)
+	{
+		// raw video case. The API will change slightly in the near future for that
+		AVPacket pkt;
+		av_init_packet(&pkt);
 
-	// Misc
-	char key[27];
-	enc_ctx->frame_meta_properties = mlt_properties_new();
-	int header_written = 0;
-	int dst_colorspace = mlt_properties_get_int( properties, "colorspace" );
-	const char* color_range = mlt_properties_get( properties, "color_range" );
-	int dst_full_range = color_range && (!strcmp("pc", color_range) || !strcmp("jpeg", color_range));
+		// Set frame interlace hints
+		if ( item->progressive )
+			c->field_order = AV_FIELD_PROGRESSIVE;
+		else
+			c->field_order = item->top_field_first ? AV_FIELD_TB : AV_FIELD_BT;
+		pkt.flags |= AV_PKT_FLAG_KEY;
+		pkt.stream_index = st->index;
+		pkt.data = (uint8_t*) avframe;
+		pkt.size = sizeof(AVPicture);
 
-	// Check for user selected format first
+		ret = av_write_frame(ctx->oc, &pkt);
+	}
+#endif
+	else
+	{
+		AVPacket pkt;
+		av_init_packet( &pkt );
+		if ( c->codec->id == AV_CODEC_ID_RAWVIDEO ) {
+			pkt.data = NULL;
+			pkt.size = 0;
+		} else {
+			pkt.data = ctx->video_outbuf;
+			pkt.size = ctx->video_outbuf_size;
+		}
+
+		// Set the quality
+		avframe->quality = c->global_quality;
+		avframe->pts = ctx->frame_count;
+
+		// Set frame interlace hints
+		avframe->interlaced_frame = !item->progressive;
+		avframe->top_field_first = item->top_field_first;
+		if ( item->progressive )
+			c->field_order = AV_FIELD_PROGRESSIVE;
+		else if ( c->codec_id == AV_CODEC_ID_MJPEG )
+			c->field_order = item->top_field_first ? AV_FIELD_TT : AV_FIELD_BB;
+		else
+			c->field_order = item->top_field_first ? AV_FIELD_TB : AV_FIELD_BT;
+
+		// Encode the image
+#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
+		ret = avcodec_send_frame( c, avframe );
+		if ( ret < 0 ) {
+			pkt.size = ret;
+		} else {
+receive_video_packet:
+			ret = avcodec_receive_packet( c, &pkt );
+			if ( ret == AVERROR(EAGAIN) || ret == AVERROR_EOF )
+				pkt.size = ret = 0;
+			else if ( ret < 0 )
+				pkt.size = ret;
+		}
+#else
+		int got_packet;
+		ret = avcodec_encode_video2( c, &pkt, avframe, &got_packet );
+		if ( ret < 0 )
+			pkt.size = ret;
+		else if ( !got_packet )
+			pkt.size = 0;
+#endif
+
+		// If zero size, it means the image was buffered
+		if ( pkt.size > 0 )
+		{
+			if ( pkt.pts != AV_NOPTS_VALUE )
+				pkt.pts = av_rescale_q( pkt.pts, c->time_base, st->time_base );
+			if ( pkt.dts != AV_NOPTS_VALUE )
+				pkt.dts = av_rescale_q( pkt.dts, c->time_base, st->time_base );
+			pkt.stream_index = st->index;
+
+			// write the compressed frame in the media file
+			ret = mux_packet( ctx, &pkt );
+			mlt_log_debug( MLT_CONSUMER_SERVICE( ctx->consumer ), " frame_size %d\n", c->frame_size );
+
+			// Dual pass logging
+			if ( mlt_properties_get_data( properties, "_logfile", NULL ) && c->stats_out )
+				fprintf( mlt_properties_get_data( properties, "_logfile", NULL ), "%s", c->stats_out );
+
+			*error_count = 0;
+
+#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
+			if ( !ret )
+				goto receive_video_packet;
+#endif
+		}
+		else if ( pkt.size < 0 )
+		{
+			mlt_log_warning( MLT_CONSUMER_SERVICE( ctx->consumer ), "error with video encode: %d (frame %d)\n", pkt.size, ctx->frame_count );
+			ret = 0;
+			if ( ++*error_count > 2 )
+				return 1;
+		}
+	}
+	if ( ret )
+	{
+		mlt_log_fatal( MLT_CONSUMER_SERVICE( ctx->consumer ), "error writing video frame: %d\n", ret );
+		mlt_events_fire( properties, "consumer-fatal-error", NULL );
+	}
+	return ret;
+}
+
+/** Encode a converted image, and its renditions of the ladder, and free the item.
+ *
+ * \return non-zero on a fatal error
+ */
+
+static int encode_video( encode_ctx_t* ctx, video_item *item )
+{
+	AVFrame *avframe;
+	int ret;
+	int i;
+
+	// Keep the latest picture to repeat it for frames that were not rendered.
+	if ( item->picture )
+	{
+		if ( ctx->last_picture )
+			encode_queue_push( ctx->free_pictures, ctx->last_picture );
+		ctx->last_picture = item->picture;
+	}
+	for ( i = 0; i < ctx->rendition_count; i++ )
+	{
+		rendition *r = &ctx->renditions[i];
+		if ( item->renditions[i] )
+		{
+			if ( r->last_picture )
+				encode_queue_push( r->free_pictures, r->last_picture );
+			r->last_picture = item->renditions[i];
+		}
+	}
+#ifdef HWENCODE
+	if ( AV_HWDEVICE_TYPE_NONE != hw_encode_type( ctx->video_st->codec->pix_fmt ) )
+		avframe = item->hw_frame;
+	else
+#endif
+	avframe = ctx->last_picture;
+
+	ret = encode_picture( ctx, ctx->video_st, avframe, item, &ctx->video_error_count );
+	for ( i = 0; !ret && i < ctx->rendition_count; i++ )
+		ret = encode_picture( ctx, ctx->renditions[i].st, ctx->renditions[i].last_picture, item,
+			&ctx->renditions[i].error_count );
+	ctx->frame_count++;
+	av_frame_free( &item->hw_frame );
+	free( item );
+	return ret;
+}
+
+// Drain the frames buffered by the encoder of a video stream.
+static int flush_stream( encode_ctx_t* ctx, AVStream *st )
+{
+	mlt_properties properties = ctx->properties;
+
+#ifdef AVFMT_RAWPICTURE
+	if ( ctx->oc->oformat->flags & AVFMT_RAWPICTURE )
+		return 0;
+#endif
+	for (;;)
+	{
+		AVCodecContext *c = st->codec;
+		AVPacket pkt;
+		av_init_packet( &pkt );
+		if ( c->codec->id == AV_CODEC_ID_RAWVIDEO ) {
+			pkt.data = NULL;
+			pkt.size = 0;
+		} else {
+			pkt.data = ctx->video_outbuf;
+			pkt.size = ctx->video_outbuf_size;
+		}
+
+		// Encode the image
+#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
+		int ret;
+		while ( (ret = avcodec_receive_packet( c, &pkt )) == AVERROR(EAGAIN) ) {
+			ret = avcodec_send_frame( c, NULL );
+			if ( ret < 0 ) {
+				mlt_log_warning( MLT_CONSUMER_SERVICE( ctx->consumer ), "error with video encode: %d\n", ret );
+				break;
+			}
+		}
+#else
+		int got_packet = 0;
+		int ret = avcodec_encode_video2( c, &pkt, NULL, &got_packet );
+		if ( ret < 0 )
+			pkt.size = ret;
+		else if ( !got_packet )
+			pkt.size = 0;
+#endif
+		mlt_log_debug( MLT_CONSUMER_SERVICE( ctx->consumer ), "flushing video size %d\n", pkt.size );
+		if ( pkt.size < 0 )
+			break;
+		// Dual pass logging
+		if ( mlt_properties_get_data( properties, "_logfile", NULL ) && c->stats_out )
+			fprintf( mlt_properties_get_data( properties, "_logfile", NULL ), "%s", c->stats_out );
+		if ( !pkt.size )
+			break;
+
+		if ( pkt.pts != AV_NOPTS_VALUE )
+			pkt.pts = av_rescale_q( pkt.pts, c->time_base, st->time_base );
+		if ( pkt.dts != AV_NOPTS_VALUE )
+			pkt.dts = av_rescale_q( pkt.dts, c->time_base, st->time_base );
+		pkt.stream_index = st->index;
+
+		// write the compressed frame in the media file
+		if ( mux_packet( ctx, &pkt ) != 0 )
+		{
+			mlt_log_fatal( MLT_CONSUMER_SERVICE( ctx->consumer ), "error writing flushed video frame\n" );
+			mlt_events_fire( properties, "consumer-fatal-error", NULL );
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Drain the frames buffered by the video encoders.
+static int flush_video( encode_ctx_t* ctx )
+{
+	int i;
+
+	if ( flush_stream( ctx, ctx->video_st ) )
+		return 1;
+	for ( i = 0; i < ctx->rendition_count; i++ )
+		if ( flush_stream( ctx, ctx->renditions[i].st ) )
+			return 1;
+	return 0;
+}
+
+// Convert the fetched frames.
+static void *convert_thread( void *arg )
+{
+	encode_ctx_t* ctx = arg;
+	mlt_frame frame;
+
+	while ( ( frame = encode_queue_pop( ctx->frame_queue ) ) )
+	{
+		video_item *item = convert_video( ctx, frame );
+		if ( item )
+			encode_queue_push( ctx->picture_queue, item );
+	}
+	encode_queue_close( ctx->picture_queue );
+	return NULL;
+}
+
+// Encode the converted images.
+static void *video_thread( void *arg )
+{
+	encode_ctx_t* ctx = arg;
+	video_item *item;
+
+	// Keep taking items after a failure so that the other stages do not block.
+	while ( ( item = encode_queue_pop( ctx->picture_queue ) ) )
+	{
+		if ( ctx->failed )
+		{
+			int i;
+			if ( item->picture )
+				encode_queue_push( ctx->free_pictures, item->picture );
+			for ( i = 0; i < ctx->rendition_count; i++ )
+				if ( item->renditions[i] )
+					encode_queue_push( ctx->renditions[i].free_pictures, item->renditions[i] );
+			av_frame_free( &item->hw_frame );
+			free( item );
+		}
+		else if ( encode_video( ctx, item ) )
+		{
+			ctx->failed = 1;
+		}
+	}
+	if ( !ctx->failed && ctx->real_time_output <= 0 && flush_video( ctx ) )
+		ctx->failed = 1;
+	return NULL;
+}
+
+// Encode the audio as it is appended to the fifo.
+static void *audio_thread( void *arg )
+{
+	encode_ctx_t* ctx = arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock( &ctx->audio_mutex );
+		while ( !audio_frame_ready( ctx ) && !ctx->audio_finished )
+			pthread_cond_wait( &ctx->audio_cond, &ctx->audio_mutex );
+		int ready = audio_frame_ready( ctx );
+		pthread_mutex_unlock( &ctx->audio_mutex );
+		if ( !ready || ctx->failed )
+			break;
+		if ( encode_audio( ctx ) < 0 )
+			ctx->failed = 1;
+	}
+	if ( !ctx->failed && finish_audio( ctx ) )
+		ctx->failed = 1;
+	return NULL;
+}
+
+// Write the encoded packets in the order the encoders produce them.
+static void *mux_thread( void *arg )
+{
+	encode_ctx_t* ctx = arg;
+	AVPacket *pkt;
+
+	while ( ( pkt = encode_queue_pop( ctx->packet_queue ) ) )
+	{
+		if ( !ctx->failed && av_interleaved_write_frame( ctx->oc, pkt ) )
+		{
+			mlt_log_fatal( MLT_CONSUMER_SERVICE( ctx->consumer ), "error writing packet to stream %d\n", pkt->stream_index );
+			mlt_events_fire( ctx->properties, "consumer-fatal-error", NULL );
+			ctx->failed = 1;
+		}
+		av_free_packet( pkt );
+		av_free( pkt );
+	}
+	return NULL;
+}
+
+// Start the threads of the stages once the header is written.
+static void start_pipeline( encode_ctx_t* ctx )
+{
+	if ( ctx->pipeline > 0 )
+	{
+		ctx->packet_queue = encode_queue_init( ctx->pipeline * 16 );
+		pthread_create( &ctx->mux_thread, NULL, mux_thread, ctx );
+		if ( ctx->video_st )
+		{
+			ctx->frame_queue = encode_queue_init( ctx->pipeline );
+			ctx->picture_queue = encode_queue_init( ctx->pipeline );
+			pthread_create( &ctx->convert_thread, NULL, convert_thread, ctx );
+			pthread_create( &ctx->video_thread, NULL, video_thread, ctx );
+		}
+		if ( ctx->audio_st[0] )
+			pthread_create( &ctx->audio_thread, NULL, audio_thread, ctx );
+	}
+	ctx->started = 1;
+}
+
+// Drain and stop the stages, finishing the streams unless there was an error.
+static void finish_pipeline( encode_ctx_t* ctx )
+{
+	if ( !ctx->started )
+		return;
+	if ( ctx->pipeline > 0 )
+	{
+		if ( ctx->video_st )
+		{
+			encode_queue_close( ctx->frame_queue );
+			pthread_join( ctx->convert_thread, NULL );
+			pthread_join( ctx->video_thread, NULL );
+		}
+		if ( ctx->audio_st[0] )
+		{
+			pthread_mutex_lock( &ctx->audio_mutex );
+			ctx->audio_finished = 1;
+			pthread_cond_signal( &ctx->audio_cond );
+			pthread_mutex_unlock( &ctx->audio_mutex );
+			pthread_join( ctx->audio_thread, NULL );
+		}
+		encode_queue_close( ctx->packet_queue );
+		pthread_join( ctx->mux_thread, NULL );
+	}
+	else if ( !ctx->failed )
+	{
+		if ( ctx->audio_st[0] && finish_audio( ctx ) )
+			ctx->failed = 1;
+		else if ( ctx->video_st && ctx->real_time_output <= 0 && flush_video( ctx ) )
+			ctx->failed = 1;
+	}
+	ctx->started = 0;
+}
+
+//
+// Segmented rendering: the range of the producer is split at multiples of
+// the GOP size and each part is rendered by a consumer of its own, then the
+// parts are joined without encoding them again.
+//
+
+#ifdef SEGMENTS
+
+// Check whether the consumer can render in segments.
+static int segments_enabled( mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	const char *target = mlt_properties_get( properties, "target" );
+
+	if ( mlt_properties_get_int( properties, "segments" ) < 2 && !mlt_properties_get_int( properties, "smart" ) )
+		return 0;
+	if ( !target || !strcmp( target, "-" ) || !strncmp( target, "pipe:", 5 ) ||
+	     mlt_properties_get_int( properties, "redirect" ) || mlt_properties_get_int( properties, "pass" ) )
+	{
+		mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "segments need a file target and one pass, rendering serially\n" );
+		return 0;
+	}
+	return mlt_service_producer( MLT_CONSUMER_SERVICE( consumer ) ) != NULL;
+}
+
+// Copy the settings of the consumer to the consumer of a segment.
+static void segment_properties( mlt_properties segment, mlt_properties properties )
+{
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( properties ); i++ )
+	{
+		const char *name = mlt_properties_get_name( properties, i );
+		char *value = mlt_properties_get_value( properties, i );
+
+		if ( value && name[0] != '_' && strncmp( name, "mlt_", 4 ) &&
+		     strcmp( name, "segments" ) && strcmp( name, "workers" ) && strcmp( name, "target" ) &&
+		     strcmp( name, "running" ) && strncmp( name, "farm", 4 ) )
+			mlt_properties_set( segment, name, value );
+	}
+}
+
+static void on_segment_error( mlt_properties owner, mlt_consumer segment )
+{
+	mlt_properties_set_int( MLT_CONSUMER_PROPERTIES( segment ), "_segment_error", 1 );
+}
+
+/** Join the segment files into the target.
+ *
+ * The streams of the first segment define the output, and the timestamps of
+ * each segment are offset by the time of its first frame. Packets that would
+ * not follow the previous segment, such as the priming of an audio encoder,
+ * are dropped.
+ * \return non-zero on error
+ */
+
+static int concat_segments( mlt_consumer consumer, AVOutputFormat *fmt, const char *target, char **parts, int *starts, int count )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	AVRational frame_duration = { mlt_properties_get_int( properties, "frame_rate_den" ),
+		mlt_properties_get_int( properties, "frame_rate_num" ) };
+	AVFormatContext *oc = NULL;
+	int64_t *last_dts = NULL;
+	int header_written = 0;
+	int error = avformat_alloc_output_context2( &oc, fmt, NULL, target ) < 0;
+	int i, j;
+
+	for ( i = 0; !error && i < count; i++ )
+	{
+		AVFormatContext *ic = NULL;
+		AVPacket pkt;
+
+		if ( avformat_open_input( &ic, parts[i], NULL, NULL ) < 0 || avformat_find_stream_info( ic, NULL ) < 0 )
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to open segment %s\n", parts[i] );
+			avformat_close_input( &ic );
+			error = 1;
+			break;
+		}
+		if ( i == 0 )
+		{
+			for ( j = 0; !error && j < ic->nb_streams; j++ )
+			{
+				AVStream *st = avformat_new_stream( oc, NULL );
+				error = !st || avcodec_parameters_copy( st->codecpar, ic->streams[j]->codecpar ) < 0;
+				if ( !error )
+				{
+					st->codecpar->codec_tag = 0;
+					st->time_base = ic->streams[j]->time_base;
+					av_dict_copy( &st->metadata, ic->streams[j]->metadata, 0 );
+				}
+			}
+			last_dts = av_malloc_array( FFMAX( ic->nb_streams, 1 ), sizeof( int64_t ) );
+			error = error || !last_dts;
+			for ( j = 0; !error && j < ic->nb_streams; j++ )
+				last_dts[j] = AV_NOPTS_VALUE;
+			av_dict_copy( &oc->metadata, ic->metadata, 0 );
+			apply_properties( oc, properties, AV_OPT_FLAG_ENCODING_PARAM );
+			if ( oc->oformat->priv_class && oc->priv_data )
+				apply_properties( oc->priv_data, properties, AV_OPT_FLAG_ENCODING_PARAM );
+			if ( !error && !( fmt->flags & AVFMT_NOFILE ) && avio_open( &oc->pb, target, AVIO_FLAG_WRITE ) < 0 )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "Could not open '%s'\n", target );
+				error = 1;
+			}
+			if ( !error )
+				error = avformat_write_header( oc, NULL ) < 0;
+			header_written = !error;
+		}
+		else if ( ic->nb_streams != oc->nb_streams )
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "segment %s has %d streams instead of %d\n",
+				parts[i], ic->nb_streams, oc->nb_streams );
+			error = 1;
+		}
+
+		av_init_packet( &pkt );
+		while ( !error && av_read_frame( ic, &pkt ) >= 0 )
+		{
+			AVStream *st = oc->streams[ pkt.stream_index ];
+			int64_t offset = av_rescale_q( starts[i], frame_duration, st->time_base );
+
+			av_packet_rescale_ts( &pkt, ic->streams[ pkt.stream_index ]->time_base, st->time_base );
+			if ( pkt.pts != AV_NOPTS_VALUE )
+				pkt.pts += offset;
+			if ( pkt.dts != AV_NOPTS_VALUE )
+				pkt.dts += offset;
+			if ( pkt.dts != AV_NOPTS_VALUE && last_dts[ pkt.stream_index ] != AV_NOPTS_VALUE &&
+			     pkt.dts <= last_dts[ pkt.stream_index ] )
+			{
+				av_packet_unref( &pkt );
+				continue;
+			}
+			if ( pkt.dts != AV_NOPTS_VALUE )
+				last_dts[ pkt.stream_index ] = pkt.dts;
+			pkt.pos = -1;
+			if ( av_interleaved_write_frame( oc, &pkt ) < 0 )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "error writing packet of segment %s\n", parts[i] );
+				error = 1;
+			}
+			av_packet_unref( &pkt );
+		}
+		avformat_close_input( &ic );
+	}
+	if ( oc )
+	{
+		if ( header_written )
+			av_write_trailer( oc );
+		if ( !( fmt->flags & AVFMT_NOFILE ) )
+			avio_closep( &oc->pb );
+		avformat_free_context( oc );
+	}
+	av_free( last_dts );
+	return error;
+}
+
+/** A part of a smart render, which is encoded or copied from a source.
+*/
+
+typedef struct
+{
+	int start;            ///< the first frame, relative to the in point of the producer
+	int end;              ///< the frame after the last one
+	char *resource;       ///< the file to copy the packets from, or NULL to encode the part
+	int video_index;      ///< the streams of the resource to copy
+	int audio_index;      ///< or -1 for none
+	int source_start;     ///< the frame of the resource at start, which is a keyframe
+} smart_part;
+
+// Get the codec the consumer encodes a type of stream with.
+static enum AVCodecID smart_codec( mlt_properties properties, AVOutputFormat *fmt, int is_audio )
+{
+	const char *name = mlt_properties_get( properties, is_audio ? "acodec" : "vcodec" );
+	AVCodec *codec;
+
+	if ( ( name && !strcmp( name, "none" ) ) || mlt_properties_get_int( properties, is_audio ? "an" : "vn" ) )
+		return AV_CODEC_ID_NONE;
+	if ( !name )
+		return is_audio ? fmt->audio_codec : fmt->video_codec;
+	codec = avcodec_find_encoder_by_name( name );
+	return codec ? codec->id : AV_CODEC_ID_NONE;
+}
+
+// Check whether a service has filters, not counting the normalizers of the loader.
+static int smart_has_filters( mlt_service service )
+{
+	mlt_filter filter;
+	int i;
+
+	for ( i = 0; ( filter = mlt_service_filter( service, i ) ); i++ )
+		if ( !mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "_loader" ) &&
+		     !mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "disable" ) )
+			return 1;
+	return 0;
+}
+
+/** Get the playlist that a producer plays unchanged.
+ *
+ * This is the producer itself or the only track of a tractor without
+ * transitions, and neither may have filters.
+ * \return the playlist or NULL if there is none
+ */
+
+static mlt_playlist smart_playlist( mlt_service service )
+{
+	if ( service && mlt_service_identify( service ) == tractor_type && !smart_has_filters( service ) )
+	{
+		mlt_tractor tractor = MLT_TRACTOR( service );
+		mlt_multitrack multitrack = mlt_tractor_multitrack( tractor );
+		mlt_producer track = multitrack && mlt_multitrack_count( multitrack ) == 1 ?
+			mlt_multitrack_track( multitrack, 0 ) : NULL;
+
+		service = NULL;
+		if ( track && mlt_service_producer( MLT_TRACTOR_SERVICE( tractor ) ) == MLT_MULTITRACK_SERVICE( multitrack ) &&
+		     !mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( track ), "hide" ) &&
+		     !smart_has_filters( MLT_PRODUCER_SERVICE( track ) ) )
+			service = MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( track ) );
+	}
+	if ( service && mlt_service_identify( service ) == playlist_type && !smart_has_filters( service ) )
+		return MLT_PLAYLIST( service );
+	return NULL;
+}
+
+// Choose a stream of a source, preferring the one its producer uses.
+static int smart_stream( AVFormatContext *ic, mlt_properties producer_properties, const char *name, enum AVMediaType type )
+{
+	int index = mlt_properties_get( producer_properties, name ) ?
+		mlt_properties_get_int( producer_properties, name ) : av_find_best_stream( ic, type, -1, -1, NULL, 0 );
+
+	if ( index < 0 || index >= ic->nb_streams || ic->streams[ index ]->codecpar->codec_type != type )
+		return -1;
+	return index;
+}
+
+/** Check whether the streams of a source are what the consumer would encode.
+ * \return non-zero if its packets cannot be copied
+ */
+
+static int smart_source( mlt_consumer consumer, AVOutputFormat *fmt, AVFormatContext *ic, mlt_properties producer_properties,
+	int *video_index, int *audio_index )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	AVRational frame_rate = { profile->frame_rate_num, profile->frame_rate_den };
+	enum AVCodecID video_codec = smart_codec( properties, fmt, 0 );
+	enum AVCodecID audio_codec = smart_codec( properties, fmt, 1 );
+	const char *pix_fmt = mlt_properties_get( properties, "pix_fmt" );
+	AVCodecParameters *par;
+
+	*video_index = smart_stream( ic, producer_properties, "video_index", AVMEDIA_TYPE_VIDEO );
+	*audio_index = -1;
+	if ( *video_index < 0 || video_codec == AV_CODEC_ID_NONE )
+		return 1;
+	par = ic->streams[ *video_index ]->codecpar;
+	if ( par->codec_id != video_codec || par->width != profile->width || par->height != profile->height ||
+	     av_cmp_q( ic->streams[ *video_index ]->avg_frame_rate, frame_rate ) ||
+	     ( pix_fmt && par->format != av_get_pix_fmt( pix_fmt ) ) ||
+	     ( mlt_properties_get_int( properties, "progressive" ) && par->field_order > AV_FIELD_PROGRESSIVE ) )
+		return 1;
+
+	// One audio stream with the same codec and layout, or none at all
+	if ( audio_codec != AV_CODEC_ID_NONE )
+	{
+		int i;
+		for ( i = 0; i < MAX_AUDIO_STREAMS; i++ )
+		{
+			char key[20];
+			sprintf( key, "channels.%d", i );
+			if ( mlt_properties_get_int( properties, key ) )
+				return 1;
+		}
+		*audio_index = smart_stream( ic, producer_properties, "audio_index", AVMEDIA_TYPE_AUDIO );
+		if ( *audio_index < 0 )
+			return 1;
+		par = ic->streams[ *audio_index ]->codecpar;
+		if ( par->codec_id != audio_codec || par->sample_rate != mlt_properties_get_int( properties, "frequency" ) ||
+		     par->channels != mlt_properties_get_int( properties, "channels" ) )
+			return 1;
+	}
+	return 0;
+}
+
+// Get the start time of a source in the time base of one of its streams.
+static int64_t smart_start_time( AVFormatContext *ic, AVStream *st )
+{
+	return ic->start_time != AV_NOPTS_VALUE ? av_rescale_q( ic->start_time, AV_TIME_BASE_Q, st->time_base ) : 0;
+}
+
+/** Find the frames of a clip whose packets can be copied.
+ *
+ * These go from the first keyframe at or after \p in up to the last one at
+ * or before \p out + 1, or the end of the stream. A source with open GOPs,
+ * whose pictures can refer to the GOP before their keyframe, is not copied.
+ * \return non-zero if nothing can be copied
+ */
+
+static int smart_scan( AVFormatContext *ic, int index, AVRational frame_duration, int in, int out, int *first, int *last )
+{
+	AVStream *st = ic->streams[ index ];
+	int64_t start = smart_start_time( ic, st );
+	int keyframe = -1;
+	int end = -1;
+	int latest = -1;
+	int open = 0;
+	int done = 0;
+	AVPacket pkt;
+
+	*first = *last = -1;
+	if ( av_seek_frame( ic, index, start + av_rescale_q( in, frame_duration, st->time_base ), AVSEEK_FLAG_BACKWARD ) < 0 )
+		return 1;
+	av_init_packet( &pkt );
+	while ( !done && !open && av_read_frame( ic, &pkt ) >= 0 )
+	{
+		if ( pkt.stream_index == index && pkt.pts != AV_NOPTS_VALUE )
+		{
+			int frame = av_rescale_q( pkt.pts - start, st->time_base, frame_duration );
+
+			if ( end >= 0 )
+			{
+				// The picture after the keyframe that ends the clip must not come before it
+				open = frame < end;
+				done = 1;
+			}
+			else if ( pkt.flags & AV_PKT_FLAG_KEY )
+			{
+				if ( *first < 0 && frame >= in )
+					*first = frame;
+				if ( *first >= 0 && frame <= out + 1 )
+					*last = frame;
+				if ( frame > out )
+					end = frame;
+				keyframe = frame;
+			}
+			else if ( *first >= 0 && keyframe > *first && frame < keyframe )
+			{
+				open = 1;
+			}
+			if ( end < 0 )
+				latest = FFMAX( latest, frame );
+		}
+		av_packet_unref( &pkt );
+	}
+
+	// The stream ended within the clip
+	if ( !done && *first >= 0 && end < 0 && latest <= out )
+		*last = latest + 1;
+
+	return open || *first < 0 || *last <= *first;
+}
+
+/** Find the part of a playlist entry that can be copied from its source.
+ * \return non-zero if nothing can be copied
+ */
+
+static int smart_clip( mlt_consumer consumer, AVOutputFormat *fmt, mlt_playlist_clip_info *info, smart_part *part )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	AVRational frame_duration = { mlt_properties_get_int( properties, "frame_rate_den" ),
+		mlt_properties_get_int( properties, "frame_rate_num" ) };
+	mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( info->producer );
+	const char *service = mlt_properties_get( producer_properties, "mlt_service" );
+	const char *resource = mlt_properties_get( producer_properties, "resource" );
+	AVFormatContext *ic = NULL;
+	int first, last;
+	int error;
+
+	if ( !service || !resource || ( strcmp( service, "avformat" ) && strcmp( service, "avformat-novalidate" ) ) ||
+	     info->repeat > 1 || smart_has_filters( MLT_PRODUCER_SERVICE( info->producer ) ) ||
+	     smart_has_filters( MLT_PRODUCER_SERVICE( info->cut ) ) )
+		return 1;
+	error = avformat_open_input( &ic, resource, NULL, NULL ) < 0 || avformat_find_stream_info( ic, NULL ) < 0;
+	error = error || smart_source( consumer, fmt, ic, producer_properties, &part->video_index, &part->audio_index );
+	error = error || smart_scan( ic, part->video_index, frame_duration, info->frame_in, info->frame_out, &first, &last );
+	avformat_close_input( &ic );
+	if ( !error )
+	{
+		part->start = info->start + first - info->frame_in;
+		part->end = info->start + last - info->frame_in;
+		part->source_start = first;
+		part->resource = strdup( resource );
+		error = !part->resource;
+	}
+	return error;
+}
+
+/** Split the range of a producer into the parts that are copied and those
+ * that are encoded.
+ * \return the number of parts
+ */
+
+static int smart_plan( mlt_consumer consumer, AVOutputFormat *fmt, mlt_producer producer, smart_part **plan )
+{
+	mlt_playlist playlist = smart_playlist( MLT_PRODUCER_SERVICE( producer ) );
+	int in = mlt_producer_get_in( producer );
+	int length = mlt_producer_get_playtime( producer );
+	int clips = playlist ? mlt_playlist_count( playlist ) : 0;
+	int count = 0;
+	int position = 0;
+	int i;
+
+	// Every copied clip may need an encoded part before it
+	*plan = calloc( 2 * clips + 1, sizeof( smart_part ) );
+	if ( !*plan )
+		return 0;
+	for ( i = 0; i < clips; i++ )
+	{
+		mlt_playlist_clip_info info;
+		smart_part part;
+
+		if ( mlt_playlist_get_clip_info( playlist, &info, i ) || smart_clip( consumer, fmt, &info, &part ) )
+			continue;
+		part.start -= in;
+		part.end -= in;
+		if ( part.start < position || part.end > length )
+		{
+			free( part.resource );
+			continue;
+		}
+		if ( part.start > position )
+		{
+			( *plan )[ count ].start = position;
+			( *plan )[ count++ ].end = part.start;
+		}
+		( *plan )[ count++ ] = part;
+		position = part.end;
+		mlt_log_verbose( MLT_CONSUMER_SERVICE( consumer ), "copying frames %d-%d of %s\n",
+			part.source_start, part.source_start + part.end - part.start - 1, part.resource );
+	}
+	if ( position < length )
+	{
+		( *plan )[ count ].start = position;
+		( *plan )[ count++ ].end = length;
+	}
+	return count;
+}
+
+/** Write the packets of a copied part into a file.
+ *
+ * The timestamps start at zero, as in a part that is encoded.
+ * \return non-zero on error
+ */
+
+static int copy_part( mlt_consumer consumer, AVOutputFormat *fmt, smart_part *part, const char *target )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	AVRational frame_duration = { mlt_properties_get_int( properties, "frame_rate_den" ),
+		mlt_properties_get_int( properties, "frame_rate_num" ) };
+	int index[2] = { part->video_index, part->audio_index };
+	int64_t begin[2] = { 0, 0 };
+	int64_t finish[2] = { 0, 0 };
+	int done[2] = { 0, part->audio_index < 0 };
+	int started = 0;
+	int header_written = 0;
+	AVFormatContext *ic = NULL;
+	AVFormatContext *oc = NULL;
+	AVPacket pkt;
+	int error = avformat_open_input( &ic, part->resource, NULL, NULL ) < 0 || avformat_find_stream_info( ic, NULL ) < 0;
+	int i;
+
+	error = error || avformat_alloc_output_context2( &oc, fmt, NULL, target ) < 0;
+	for ( i = 0; !error && i < 2 && index[i] >= 0; i++ )
+	{
+		AVStream *source = ic->streams[ index[i] ];
+		AVStream *st = avformat_new_stream( oc, NULL );
+		int64_t start = smart_start_time( ic, source );
+
+		error = !st || avcodec_parameters_copy( st->codecpar, source->codecpar ) < 0;
+		if ( !error )
+		{
+			st->codecpar->codec_tag = 0;
+			st->time_base = source->time_base;
+		}
+		begin[i] = start + av_rescale_q( part->source_start, frame_duration, source->time_base );
+		finish[i] = start + av_rescale_q( part->source_start + part->end - part->start, frame_duration, source->time_base );
+	}
+	if ( !error )
+	{
+		apply_properties( oc, properties, AV_OPT_FLAG_ENCODING_PARAM );
+		if ( oc->oformat->priv_class && oc->priv_data )
+			apply_properties( oc->priv_data, properties, AV_OPT_FLAG_ENCODING_PARAM );
+		if ( !( fmt->flags & AVFMT_NOFILE ) && avio_open( &oc->pb, target, AVIO_FLAG_WRITE ) < 0 )
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "Could not open '%s'\n", target );
+			error = 1;
+		}
+	}
+	error = error || avformat_write_header( oc, NULL ) < 0;
+	header_written = !error;
+	error = error || av_seek_frame( ic, index[0], begin[0], AVSEEK_FLAG_BACKWARD ) < 0;
+
+	av_init_packet( &pkt );
+	while ( !error && !( done[0] && done[1] ) && av_read_frame( ic, &pkt ) >= 0 )
+	{
+		int j = pkt.stream_index == index[0] ? 0 : pkt.stream_index == index[1] ? 1 : -1;
+		int write = 0;
+
+		if ( j >= 0 && !done[j] && pkt.pts != AV_NOPTS_VALUE )
+		{
+			if ( j == 0 )
+			{
+				// Start at the keyframe of the part and stop at the next one after it
+				if ( pkt.flags & AV_PKT_FLAG_KEY )
+				{
+					started = started || pkt.pts >= begin[0];
+					done[0] = pkt.pts >= finish[0];
+				}
+				write = started && !done[0] && pkt.pts >= begin[0];
+			}
+			else
+			{
+				done[1] = pkt.pts >= finish[1];
+				write = !done[1] && pkt.pts >= begin[1];
+			}
+		}
+		if ( write )
+		{
+			AVStream *st = oc->streams[j];
+			pkt.pts -= begin[j];
+			if ( pkt.dts != AV_NOPTS_VALUE )
+				pkt.dts -= begin[j];
+			av_packet_rescale_ts( &pkt, ic->streams[ index[j] ]->time_base, st->time_base );
+			pkt.stream_index = j;
+			pkt.pos = -1;
+			if ( av_interleaved_write_frame( oc, &pkt ) < 0 )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "error copying a packet of %s\n", part->resource );
+				error = 1;
+			}
+		}
+		av_packet_unref( &pkt );
+	}
+
+	if ( oc )
+	{
+		if ( header_written )
+			av_write_trailer( oc );
+		if ( !( fmt->flags & AVFMT_NOFILE ) )
+			avio_closep( &oc->pb );
+		avformat_free_context( oc );
+	}
+	avformat_close_input( &ic );
+	return error;
+}
+
+// Start a consumer that encodes a range of the producer into a part.
+static mlt_consumer segment_start( mlt_consumer consumer, AVOutputFormat *fmt, char *doc, const char *part, int start, int end )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	mlt_producer producer = mlt_factory_producer( profile, "xml-string", doc );
+	mlt_consumer segment = mlt_factory_consumer( profile, "avformat", NULL );
+	mlt_properties segment_props;
+	int in;
+
+	if ( !producer || !segment )
+	{
+		mlt_producer_close( producer );
+		mlt_consumer_close( segment );
+		return NULL;
+	}
+	segment_props = MLT_CONSUMER_PROPERTIES( segment );
+	segment_properties( segment_props, properties );
+	mlt_properties_set( segment_props, "target", part );
+	mlt_properties_set( segment_props, "f", fmt->name );
+	mlt_properties_set_int( segment_props, "terminate_on_pause", 1 );
+	mlt_properties_set_data( segment_props, "_segment_producer", producer, 0, (mlt_destructor) mlt_producer_close, NULL );
+	mlt_events_listen( segment_props, segment, "consumer-fatal-error", (mlt_listener) on_segment_error );
+
+	in = mlt_producer_get_in( producer );
+	mlt_producer_set_in_and_out( producer, in + start, in + end - 1 );
+	mlt_producer_seek( producer, 0 );
+	mlt_producer_set_speed( producer, 1.0 );
+	mlt_consumer_connect( segment, MLT_PRODUCER_SERVICE( producer ) );
+	mlt_consumer_start( segment );
+	return segment;
+}
+
+/** The thread of a segmented render - the argument is simply the consumer.
+ *
+ * With smart, the parts are the clips that can be copied and the ranges
+ * between them, and at most segments of them are encoded at a time.
+ */
+
+static void *segments_thread( void *arg )
+{
+	mlt_consumer consumer = arg;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	mlt_service service = mlt_service_producer( MLT_CONSUMER_SERVICE( consumer ) );
+	const char *target = mlt_properties_get( properties, "target" );
+	const char *workers = mlt_properties_get( properties, "workers" );
+	AVOutputFormat *fmt = av_guess_format( mlt_properties_get( properties, "f" ), target, NULL );
+	int count = mlt_properties_get_int( properties, "segments" );
+	int smart = mlt_properties_get_int( properties, "smart" );
+	int jobs = smart ? FFMAX( count, 2 ) : count;
+	int gop = FFMAX( mlt_properties_get_int( properties, "g" ), 1 );
+	mlt_consumer *segments = NULL;
+	char **parts = NULL;
+	int *starts = NULL;
+	smart_part *plan = NULL;
+	mlt_consumer xml = mlt_factory_consumer( profile, "xml", "string" );
+	char *doc = NULL;
+	int error = !fmt || !xml;
+	int i, n = 0;
+
+	if ( smart && workers )
+	{
+		mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "smart renders on local consumers, ignoring the workers\n" );
+		workers = NULL;
+	}
+
+	// Serialise the producer so that every segment gets an instance of its own.
+	if ( !error )
+	{
+		mlt_consumer_connect( xml, service );
+		mlt_consumer_start( xml );
+		doc = mlt_properties_get( MLT_CONSUMER_PROPERTIES( xml ), "string" );
+		error = !doc;
+	}
+
+	// Split the range at the copied clips, or at multiples of the GOP size, skipping empty segments.
+	if ( !error )
+	{
+		mlt_producer producer = mlt_factory_producer( profile, "xml-string", doc );
+		int length = producer ? mlt_producer_get_playtime( producer ) : 0;
+
+		error = length <= 0;
+		if ( !error && smart )
+			count = smart_plan( consumer, fmt, producer, &plan );
+		mlt_producer_close( producer );
+		segments = calloc( FFMAX( count, 1 ), sizeof( mlt_consumer ) );
+		parts = calloc( FFMAX( count, 1 ), sizeof( char* ) );
+		starts = calloc( count + 1, sizeof( int ) );
+		error = error || !segments || !parts || !starts || ( smart && !count );
+		for ( i = 0; !error && i < count; i++ )
+		{
+			int start = smart ? plan[i].start : (int64_t) length * i / count / gop * gop;
+			if ( n == 0 || start > starts[ n - 1 ] )
+			{
+				if ( smart )
+					plan[n] = plan[i];
+				starts[ n++ ] = start;
+			}
+		}
+		if ( !error )
+			starts[ n ] = length;
+		count = n;
+	}
+	if ( error )
+		count = 0;
+
+	for ( i = 0; !error && i < count; i++ )
+	{
+		parts[i] = malloc( strlen( target ) + 16 );
+		error = !parts[i];
+		if ( !error )
+			sprintf( parts[i], "%s.part%d", target, i );
+	}
+
+	// Render the segments on remote workers when there are some.
+	if ( !error && workers )
+	{
+		mlt_properties settings = mlt_properties_new( );
+
+		segment_properties( settings, properties );
+		mlt_properties_set( settings, "f", fmt->name );
+		mlt_properties_set( settings, "mlt_service", "avformat" );
+		error = farm_render( consumer, workers, doc, settings, starts, count, parts );
+		mlt_properties_close( settings );
+	}
+
+	// Otherwise start the consumers of the segments, copying the parts that can be,
+	// and wait for them to finish or for the consumer to be stopped.
+	n = 0;
+	while ( !error && !workers )
+	{
+		int running = 0;
+		struct timespec t = { 0, 100000000 };
+
+		for ( i = 0; i < n; i++ )
+		{
+			if ( segments[i] )
+			{
+				running += !mlt_consumer_is_stopped( segments[i] );
+				error = error || mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( segments[i] ), "_segment_error" );
+			}
+		}
+		for ( ; !error && n < count && running < jobs; n++ )
+		{
+			if ( plan && plan[n].resource )
+			{
+				error = copy_part( consumer, fmt, &plan[n], parts[n] );
+			}
+			else
+			{
+				segments[n] = segment_start( consumer, fmt, doc, parts[n], starts[n], starts[n + 1] );
+				error = !segments[n];
+				running++;
+			}
+		}
+		if ( ( !running && n == count ) || error )
+			break;
+		if ( !mlt_properties_get_int( properties, "running" ) )
+			error = 1;
+		else
+			nanosleep( &t, NULL );
+	}
+	for ( i = 0; i < count; i++ )
+	{
+		if ( segments[i] )
+		{
+			mlt_consumer_stop( segments[i] );
+			error = error || mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( segments[i] ), "_segment_error" );
+		}
+	}
+
+	// Join the segments.
+	if ( !error && concat_segments( consumer, fmt, target, parts, starts, count ) )
+		error = 1;
+	if ( error && mlt_properties_get_int( properties, "running" ) )
+		mlt_events_fire( properties, "consumer-fatal-error", NULL );
+
+	for ( i = 0; i < count; i++ )
+	{
+		mlt_consumer_close( segments[i] );
+		if ( parts[i] )
+			remove( parts[i] );
+		free( parts[i] );
+		if ( plan )
+			free( plan[i].resource );
+	}
+	mlt_consumer_close( xml );
+	free( segments );
+	free( parts );
+	free( starts );
+	free( plan );
+
+	mlt_consumer_stopped( consumer );
+	return NULL;
+}
+
+#endif
+
+/** The main thread - the argument is simply the consumer.
+*/
+
+static void *consumer_thread( void *arg )
+{
+	int i;
+
+	// Encoding content
+	encode_ctx_t* enc_ctx = mlt_pool_alloc(sizeof(encode_ctx_t));
+	memset(enc_ctx, 0, sizeof(encode_ctx_t));
+
+	// Map the argument to the object
+	mlt_consumer consumer = enc_ctx->consumer = arg;
+
+	// Get the properties
+	mlt_properties properties = enc_ctx->properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+	// Get the terminate on pause property
+	enc_ctx->terminate_on_pause = mlt_properties_get_int( enc_ctx->properties, "terminate_on_pause" );
+
+	// Determine if feed is slow (for realtime stuff)
+	int real_time_output = enc_ctx->real_time_output = mlt_properties_get_int( properties, "real_time" );
+
+	// Time structures
+	struct timeval ante;
+
+	// Get the frame rate
+	double fps = mlt_properties_get_double( properties, "fps" );
+
+	// Get width and height
+	int width = enc_ctx->width = mlt_properties_get_int( properties, "width" );
+	int height = enc_ctx->height = mlt_properties_get_int( properties, "height" );
+
+	// Get default audio properties
+	enc_ctx->total_channels = enc_ctx->channels = mlt_properties_get_int( properties, "channels" );
+	enc_ctx->frequency = mlt_properties_get_int( properties, "frequency" );
+	void *pcm = NULL;
+	int samples = 0;
+
+	// AVFormat audio buffer and frame size
+	enc_ctx->audio_outbuf_size = AUDIO_BUFFER_SIZE;
+
+	// AVFormat video buffer and frame count
+	enc_ctx->video_outbuf_size = VIDEO_BUFFER_SIZE;
+	enc_ctx->video_outbuf = av_malloc( enc_ctx->video_outbuf_size );
+
+	// Used for the frame properties
+	mlt_frame frame = NULL;
+	mlt_properties frame_properties = NULL;
+
+	// Get the sample fifo
+	enc_ctx->fifo = mlt_properties_get_data( properties, "sample_fifo", NULL );
+
+	// For receiving images from an mlt_frame
+	mlt_image_format img_fmt = mlt_image_yuv422;
+
+	// For receiving audio samples back from the fifo
+	int count = 0;
+
+	// Frames dispatched and pushed to the video stages
+	long int frames = 0;
+	long int pushed_frames = 0;
+	long int total_time = 0;
+
+	// The difference between the audio and video timestamps for monitoring
+	mlt_metric drift = mlt_metrics_service( mlt_metric_gauge, "mlt_consumer_av_drift_seconds",
+		"Audio timestamp less video timestamp of the output.", MLT_CONSUMER_SERVICE( consumer ) );
+
+	// Determine the format
+	AVOutputFormat *fmt = NULL;
+	const char *filename = mlt_properties_get( properties, "target" );
+	char *format = mlt_properties_get( properties, "f" );
+	char *vcodec = mlt_properties_get( properties, "vcodec" );
+	char *acodec = mlt_properties_get( properties, "acodec" );
+	AVCodec *audio_codec = NULL;
+	AVCodec *video_codec = NULL;
+
+
+	// Misc
+	char key[27];
+	enc_ctx->frame_meta_properties = mlt_properties_new();
+	enc_ctx->audio_meta_properties = mlt_properties_new();
+	pthread_mutex_init( &enc_ctx->audio_mutex, NULL );
+	pthread_cond_init( &enc_ctx->audio_cond, NULL );
+	int header_written = 0;
+	int dst_colorspace = mlt_properties_get_int( properties, "colorspace" );
+	const char* color_range = mlt_properties_get( properties, "color_range" );
+	int dst_full_range = color_range && (!strcmp("pc", color_range) || !strcmp("jpeg", color_range));
+
+	// Check for user selected format first
 	if ( format != NULL )
 		fmt = av_guess_format( format, NULL, NULL );
 
@@ -1616,8 +3339,26 @@ static void *consumer_thread( void *arg )
 			else
 			{
 				// Set the mlt_image_format from the selected pix_fmt.
+				// The high bit depth formats native to MLT are passed through without narrowing.
 				const char *pix_fmt_name = av_get_pix_fmt_name( enc_ctx->video_st->codec->pix_fmt );
-				if ( !strcmp( pix_fmt_name, "rgba" ) ||
+#ifdef HWENCODE
+				// Ask for decoded surfaces, which are encoded without copying when they match
+				// the device of the encoder; frames from elsewhere come back in system memory.
+				if ( AV_HWDEVICE_TYPE_NONE != hw_encode_type( enc_ctx->video_st->codec->pix_fmt ) ) {
+					mlt_properties_set( properties, "mlt_image_format", "hwsurface" );
+					img_fmt = mlt_image_hwsurface;
+				} else
+#endif
+				if ( !strcmp( pix_fmt_name, "yuv420p10le" ) ) {
+					mlt_properties_set( properties, "mlt_image_format", "yuv420p10" );
+					img_fmt = mlt_image_yuv420p10;
+				} else if ( !strcmp( pix_fmt_name, "yuv444p16le" ) ) {
+					mlt_properties_set( properties, "mlt_image_format", "yuv444p16" );
+					img_fmt = mlt_image_yuv444p16;
+				} else if ( !strcmp( pix_fmt_name, "rgba64le" ) ) {
+					mlt_properties_set( properties, "mlt_image_format", "rgba64" );
+					img_fmt = mlt_image_rgba64;
+				} else if ( !strcmp( pix_fmt_name, "rgba" ) ||
 					 !strcmp( pix_fmt_name, "argb" ) ||
 					 !strcmp( pix_fmt_name, "bgra" ) ) {
 					mlt_properties_set( properties, "mlt_image_format", "rgb24a" );
@@ -1630,6 +3371,8 @@ static void *consumer_thread( void *arg )
 			}
 		}
 	}
+	if ( enc_ctx->video_st && mlt_properties_get( properties, "ladder" ) )
+		enc_ctx->rendition_count = add_renditions( consumer, enc_ctx->oc, video_codec, enc_ctx->video_st, enc_ctx->renditions );
 	if ( enc_ctx->audio_codec_id != AV_CODEC_ID_NONE )
 	{
 		int is_multi = 0;
@@ -1692,6 +3435,17 @@ static void *consumer_thread( void *arg )
 
 		if ( enc_ctx->video_st && !open_video( properties, enc_ctx->oc, enc_ctx->video_st, vcodec? vcodec : NULL ) )
 			enc_ctx->video_st = NULL;
+		for ( i = 0; i < enc_ctx->rendition_count; i++ )
+		{
+			if ( !enc_ctx->video_st || !open_video( properties, enc_ctx->oc, enc_ctx->renditions[i].st, vcodec? vcodec : NULL ) )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "Could not open the video encoder of the rendition %dx%d\n",
+					enc_ctx->renditions[i].width, enc_ctx->renditions[i].height );
+				enc_ctx->rendition_count = i;
+				mlt_events_fire( properties, "consumer-fatal-error", NULL );
+				goto on_fatal_error;
+			}
+		}
 		for ( i = 0; i < MAX_AUDIO_STREAMS && enc_ctx->audio_st[i]; i++ )
 		{
 			enc_ctx->audio_input_frame_size = open_audio( properties, enc_ctx->oc, enc_ctx->audio_st[i], enc_ctx->audio_outbuf_size,
@@ -1709,6 +3463,7 @@ static void *consumer_thread( void *arg )
 				enc_ctx->audio_st[i] = NULL;
 			}
 		}
+		map_renditions( enc_ctx );
 
 		// Setup custom I/O if redirecting
 		if ( mlt_properties_get_int( properties, "redirect" ) )
@@ -1750,20 +3505,46 @@ static void *consumer_thread( void *arg )
 		goto on_fatal_error;
 	}
 
-	// Allocate picture
-	enum AVPixelFormat pix_fmt;
+	// Allocate the pictures for converting, enough for every stage to hold one
+	enc_ctx->pipeline = mlt_properties_get( properties, "pipeline" ) ? mlt_properties_get_int( properties, "pipeline" ) : 2;
+#ifdef AVFMT_RAWPICTURE
+	if ( enc_ctx->oc->oformat->flags & AVFMT_RAWPICTURE )
+		enc_ctx->pipeline = enc_ctx->rendition_count = 0;
+#endif
 	if ( enc_ctx->video_st ) {
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-		pix_fmt = enc_ctx->video_st->codec->pix_fmt == AV_PIX_FMT_VAAPI ?
-				   AV_PIX_FMT_NV12 : enc_ctx->video_st->codec->pix_fmt;
+		int n = enc_ctx->pipeline > 0 ? enc_ctx->pipeline + 3 : 2;
+		int j;
+#ifdef HWENCODE
+		enc_ctx->pix_fmt = AV_HWDEVICE_TYPE_NONE != hw_encode_type( enc_ctx->video_st->codec->pix_fmt ) ?
+				   hw_upload_format( properties ) : enc_ctx->video_st->codec->pix_fmt;
 #else
-		pix_fmt = enc_ctx->video_st->codec->pix_fmt;
+		enc_ctx->pix_fmt = enc_ctx->video_st->codec->pix_fmt;
 #endif
-		converted_avframe = alloc_picture( pix_fmt, width, height );
-		if ( !converted_avframe ) {
-			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to allocate video AVFrame\n" );
-			mlt_events_fire( properties, "consumer-fatal-error", NULL );
-			goto on_fatal_error;
+		enc_ctx->img_fmt = img_fmt;
+		enc_ctx->dst_colorspace = dst_colorspace;
+		enc_ctx->dst_full_range = dst_full_range;
+		enc_ctx->free_pictures = encode_queue_init( INT_MAX );
+		for ( i = 0; i < n; i++ ) {
+			AVFrame *picture = alloc_picture( enc_ctx->pix_fmt, width, height );
+			if ( !picture ) {
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to allocate video AVFrame\n" );
+				mlt_events_fire( properties, "consumer-fatal-error", NULL );
+				goto on_fatal_error;
+			}
+			encode_queue_push( enc_ctx->free_pictures, picture );
+		}
+		for ( j = 0; j < enc_ctx->rendition_count; j++ ) {
+			rendition *r = &enc_ctx->renditions[j];
+			r->free_pictures = encode_queue_init( INT_MAX );
+			for ( i = 0; i < n; i++ ) {
+				AVFrame *picture = alloc_picture( r->st->codec->pix_fmt, r->width, r->height );
+				if ( !picture ) {
+					mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to allocate video AVFrame\n" );
+					mlt_events_fire( properties, "consumer-fatal-error", NULL );
+					goto on_fatal_error;
+				}
+				encode_queue_push( r->free_pictures, picture );
+			}
 		}
 	}
 
@@ -1790,8 +3571,7 @@ static void *consumer_thread( void *arg )
 	gettimeofday( &ante, NULL );
 
 	// Loop while running
-	while( mlt_properties_get_int( properties, "running" ) &&
-	       ( !enc_ctx->terminated || ( enc_ctx->video_st && mlt_deque_count( queue ) ) ) )
+	while( mlt_properties_get_int( properties, "running" ) && !enc_ctx->terminated && !enc_ctx->failed )
 	{
 		if ( !frame )
 			frame = mlt_consumer_rt_frame( consumer );
@@ -1827,6 +3607,7 @@ static void *consumer_thread( void *arg )
 				}
 
 				header_written = 1;
+				start_pipeline( enc_ctx );
 			}
 
 			// Increment frames dispatched
@@ -1838,9 +3619,12 @@ static void *consumer_thread( void *arg )
 			// Get audio and append to the fifo
 			if ( !enc_ctx->terminated && enc_ctx->audio_st[0] )
 			{
+				int channels = enc_ctx->total_channels;
 				samples = mlt_sample_calculator( fps, enc_ctx->frequency, count ++ );
-				enc_ctx->channels = enc_ctx->total_channels;
-				mlt_frame_get_audio( frame, &pcm, &aud_fmt, &enc_ctx->frequency, &enc_ctx->channels, &samples );
+				mlt_frame_get_audio( frame, &pcm, &aud_fmt, &enc_ctx->frequency, &channels, &samples );
+
+				pthread_mutex_lock( &enc_ctx->audio_mutex );
+				enc_ctx->channels = channels;
 
 				// Save the audio channel remap properties for later
 				mlt_properties_pass( enc_ctx->frame_meta_properties, frame_properties, "meta.map.audio." );
@@ -1861,249 +3645,40 @@ static void *consumer_thread( void *arg )
 					sample_fifo_append( enc_ctx->fifo, pcm, samples * enc_ctx->channels * enc_ctx->sample_bytes );
 					total_time += ( samples * 1000000 ) / enc_ctx->frequency;
 				}
+				pthread_cond_signal( &enc_ctx->audio_cond );
+				pthread_mutex_unlock( &enc_ctx->audio_mutex );
+
 				if ( !enc_ctx->video_st )
 					mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+
+				// Write audio
+				if ( enc_ctx->pipeline <= 0 && encode_ready_audio( enc_ctx ) )
+					enc_ctx->failed = 1;
 			}
 
 			// Encode the image
-			if ( !enc_ctx->terminated && enc_ctx->video_st )
-				mlt_deque_push_back( queue, frame );
-			else
-				mlt_frame_close( frame );
-			frame = NULL;
-		}
-
-		// While we have stuff to process, process...
-		while ( 1 )
-		{
-			// Write interleaved audio and video frames
-			if ( !enc_ctx->video_st || ( enc_ctx->video_st && enc_ctx->audio_st[0] && enc_ctx->audio_pts < enc_ctx->video_pts ) )
+			if ( !enc_ctx->terminated && enc_ctx->video_st && !enc_ctx->failed )
 			{
-				// Write audio
-				int fifo_frames = sample_fifo_used( enc_ctx->fifo ) /
-					( enc_ctx->audio_input_frame_size * enc_ctx->channels * enc_ctx->sample_bytes );
-				if ( ( enc_ctx->video_st && enc_ctx->terminated ) || fifo_frames )
+				enc_ctx->video_pts = (double) ++pushed_frames * av_q2d( enc_ctx->video_st->codec->time_base );
+				if ( enc_ctx->pipeline > 0 )
 				{
-					int r = encode_audio(enc_ctx);
-
-					if ( r > 0 )
-						break;
-					else if ( r < 0 )
-						goto on_fatal_error;
+					encode_queue_push( enc_ctx->frame_queue, frame );
 				}
 				else
 				{
-					break;
+					video_item *item = convert_video( enc_ctx, frame );
+					if ( !item || encode_video( enc_ctx, item ) )
+						enc_ctx->failed = 1;
 				}
 			}
-			else if ( enc_ctx->video_st )
+			else
 			{
-				// Write video
-				if ( mlt_deque_count( queue ) )
-				{
-					int ret = 0;
-					AVCodecContext *c = enc_ctx->video_st->codec;
-
-					frame = mlt_deque_pop_front( queue );
-					frame_properties = MLT_FRAME_PROPERTIES( frame );
-
-					if ( mlt_properties_get_int( frame_properties, "rendered" ) )
-					{
-						AVFrame video_avframe;
-						mlt_frame_get_image( frame, &image, &img_fmt, &img_width, &img_height, 0 );
-
-						mlt_image_format_planes( img_fmt, width, height, image, video_avframe.data, video_avframe.linesize );
-
-						// Do the colour space conversion
-						int flags = mlt_default_sws_flags;
-						struct SwsContext *context = sws_getContext( width, height, pick_pix_fmt( img_fmt ),
-							width, height, pix_fmt, flags, NULL, NULL, NULL);
-						int src_colorspace = mlt_properties_get_int( frame_properties, "colorspace" );
-						int src_full_range = mlt_properties_get_int( frame_properties, "full_luma" );
-						if ( (src_colorspace && dst_colorspace != src_colorspace) || dst_full_range != src_full_range )
-							mlt_set_luma_transfer( context, src_colorspace, dst_colorspace, src_full_range, dst_full_range );
-						sws_scale( context, (const uint8_t* const*) video_avframe.data, video_avframe.linesize, 0, height,
-							converted_avframe->data, converted_avframe->linesize);
-						sws_freeContext( context );
-
-						mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
-
-						// Apply the alpha if applicable
-						if ( !mlt_properties_get( properties, "mlt_image_format" ) ||
-						     strcmp( mlt_properties_get( properties, "mlt_image_format" ), "rgb24a" ) )
-						if ( c->pix_fmt == AV_PIX_FMT_RGBA ||
-						     c->pix_fmt == AV_PIX_FMT_ARGB ||
-						     c->pix_fmt == AV_PIX_FMT_BGRA )
-						{
-							uint8_t *p;
-							uint8_t *alpha = mlt_frame_get_alpha_mask( frame );
-							register int n;
-
-							for ( i = 0; i < height; i ++ )
-							{
-								n = ( width + 7 ) / 8;
-								p = converted_avframe->data[ 0 ] + i * converted_avframe->linesize[ 0 ] + 3;
-
-								switch( width % 8 )
-								{
-									case 0:	do { *p = *alpha++; p += 4;
-									case 7:		 *p = *alpha++; p += 4;
-									case 6:		 *p = *alpha++; p += 4;
-									case 5:		 *p = *alpha++; p += 4;
-									case 4:		 *p = *alpha++; p += 4;
-									case 3:		 *p = *alpha++; p += 4;
-									case 2:		 *p = *alpha++; p += 4;
-									case 1:		 *p = *alpha++; p += 4;
-											}
-											while( --n );
-								}
-							}
-						}
-
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-						if (AV_PIX_FMT_VAAPI == c->pix_fmt) {
-							AVFilterContext *vfilter_in = mlt_properties_get_data(properties, "vfilter_in", NULL);
-							AVFilterContext *vfilter_out = mlt_properties_get_data(properties, "vfilter_out", NULL);
-							if (vfilter_in && vfilter_out) {
-								if (!avframe)
-									avframe = av_frame_alloc();									
-								ret = av_buffersrc_add_frame(vfilter_in, converted_avframe);
-								ret = av_buffersink_get_frame(vfilter_out, avframe);
-								if (ret < 0) {
-									mlt_log_warning(MLT_CONSUMER_SERVICE(consumer), "error with hwupload: %d (frame %d)\n", ret, enc_ctx->frame_count);
-									if (++enc_ctx->error_count > 2)
-										goto on_fatal_error;
-									ret = 0;
-								}
-							}
-						} else {
-							avframe = converted_avframe;
-						}
-#else
-						avframe = converted_avframe;
-#endif
-					}
-
-#ifdef AVFMT_RAWPICTURE
-					if (enc_ctx->oc->oformat->flags & AVFMT_RAWPICTURE)
-					{
-	 					// raw video case. The API will change slightly in the near future for that
-						AVPacket pkt;
-						av_init_packet(&pkt);
-
-						// Set frame interlace hints
-						if ( mlt_properties_get_int( frame_properties, "progressive" ) )
-							c->field_order = AV_FIELD_PROGRESSIVE;
-						else
-							c->field_order = (mlt_properties_get_int( frame_properties, "top_field_first" )) ? AV_FIELD_TB : AV_FIELD_BT;
-						pkt.flags |= AV_PKT_FLAG_KEY;
-						pkt.stream_index = enc_ctx->video_st->index;
-						pkt.data = (uint8_t*) avframe;
-						pkt.size = sizeof(AVPicture);
-
-						ret = av_write_frame(enc_ctx->oc, &pkt);
-					} 
-					else 
-#endif
-					{
-						AVPacket pkt;
-						av_init_packet( &pkt );
-						if ( c->codec->id == AV_CODEC_ID_RAWVIDEO ) {
-							pkt.data = NULL;
-							pkt.size = 0;
-						} else {
-							pkt.data = video_outbuf;
-							pkt.size = video_outbuf_size;
-						}
-
-						// Set the quality
-						avframe->quality = c->global_quality;
-						avframe->pts = enc_ctx->frame_count;
-
-						// Set frame interlace hints
-						avframe->interlaced_frame = !mlt_properties_get_int( frame_properties, "progressive" );
-						avframe->top_field_first = mlt_properties_get_int( frame_properties, "top_field_first" );
-						if ( mlt_properties_get_int( frame_properties, "progressive" ) )
-							c->field_order = AV_FIELD_PROGRESSIVE;
-						else if ( c->codec_id == AV_CODEC_ID_MJPEG )
-							c->field_order = (mlt_properties_get_int( frame_properties, "top_field_first" )) ? AV_FIELD_TT : AV_FIELD_BB;
-						else
-							c->field_order = (mlt_properties_get_int( frame_properties, "top_field_first" )) ? AV_FIELD_TB : AV_FIELD_BT;
-
-	 					// Encode the image
-#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
-						ret = avcodec_send_frame( c, avframe );
-						if ( ret < 0 ) {
-							pkt.size = ret;
-						} else {
-receive_video_packet:
-							ret = avcodec_receive_packet( c, &pkt );
-							if ( ret == AVERROR(EAGAIN) || ret == AVERROR_EOF )
-								pkt.size = ret = 0;
-							else if ( ret < 0 )
-								pkt.size = ret;
-						}
-#else
-						int got_packet;
-						ret = avcodec_encode_video2( c, &pkt, avframe, &got_packet );
-						if ( ret < 0 )
-							pkt.size = ret;
-						else if ( !got_packet )
-							pkt.size = 0;
-#endif
-
-	 					// If zero size, it means the image was buffered
-						if ( pkt.size > 0 )
-						{
-							if ( pkt.pts != AV_NOPTS_VALUE )
-								pkt.pts = av_rescale_q( pkt.pts, c->time_base, enc_ctx->video_st->time_base );
-							if ( pkt.dts != AV_NOPTS_VALUE )
-								pkt.dts = av_rescale_q( pkt.dts, c->time_base, enc_ctx->video_st->time_base );
-							pkt.stream_index = enc_ctx->video_st->index;
-
-							// write the compressed frame in the media file
-							ret = av_interleaved_write_frame(enc_ctx->oc, &pkt);
-							mlt_log_debug( MLT_CONSUMER_SERVICE( consumer ), " frame_size %d\n", c->frame_size );
-							
-							// Dual pass logging
-							if ( mlt_properties_get_data( properties, "_logfile", NULL ) && c->stats_out )
-								fprintf( mlt_properties_get_data( properties, "_logfile", NULL ), "%s", c->stats_out );
-
-							enc_ctx->error_count = 0;
-
-#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
-							if ( !ret )
-								goto receive_video_packet;
-#endif
-						}
-						else if ( pkt.size < 0 )
-						{
-							mlt_log_warning( MLT_CONSUMER_SERVICE(consumer), "error with video encode: %d (frame %d)\n", pkt.size, enc_ctx->frame_count );
-							if ( ++enc_ctx->error_count > 2 )
-								goto on_fatal_error;
-							ret = 0;
-						}
- 					}
-					enc_ctx->frame_count++;
-					enc_ctx->video_pts = (double) enc_ctx->frame_count * av_q2d( enc_ctx->video_st->codec->time_base );
-					if ( ret )
-					{
-						mlt_log_fatal( MLT_CONSUMER_SERVICE(consumer), "error writing video frame: %d\n", ret );
-						mlt_events_fire( properties, "consumer-fatal-error", NULL );
-						goto on_fatal_error;
-					}
-					mlt_frame_close( frame );
-					frame = NULL;
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-					if (AV_PIX_FMT_VAAPI == c->pix_fmt)
-						av_frame_unref( avframe );
-#endif
-				}
-				else
-				{
-					break;
-				}
+				mlt_frame_close( frame );
 			}
+			frame = NULL;
+
+			if ( enc_ctx->audio_st[0] && enc_ctx->video_st )
+				mlt_metrics_set( drift, enc_ctx->audio_pts - enc_ctx->video_pts );
 			if ( enc_ctx->audio_st[0] )
 				mlt_log_debug( MLT_CONSUMER_SERVICE( consumer ), "audio pts %f ", enc_ctx->audio_pts );
 			if ( enc_ctx->video_st )
@@ -2116,7 +3691,9 @@ receive_video_packet:
 			long passed = time_difference( &ante );
 			if ( enc_ctx->fifo != NULL )
 			{
+				pthread_mutex_lock( &enc_ctx->audio_mutex );
 				long pending = ( ( ( long )sample_fifo_used( enc_ctx->fifo ) / enc_ctx->sample_bytes * 1000 ) / enc_ctx->frequency ) * 1000;
+				pthread_mutex_unlock( &enc_ctx->audio_mutex );
 				passed -= pending;
 			}
 			if ( passed < total_time )
@@ -2128,82 +3705,8 @@ receive_video_packet:
 		}
 	}
 
-	// Flush the encoder buffers
-	if ( real_time_output <= 0 )
-	{
-		// Flush audio fifo
-		// TODO: flush all audio streams
-		if ( enc_ctx->fifo && enc_ctx->audio_st[0] ) for (;;)
-		{
-			int sz = sample_fifo_used( enc_ctx->fifo );
-			int ret = encode_audio( enc_ctx );
-
-			mlt_log_debug( MLT_CONSUMER_SERVICE( consumer ), "flushing audio: sz=%d, ret=%d\n", sz, ret );
-
-			if ( !sz || ret < 0 )
-				break;
-		}
-
-		// Flush video
-#ifdef AVFMT_RAWPICTURE
-        if ( enc_ctx->video_st && !( enc_ctx->oc->oformat->flags & AVFMT_RAWPICTURE ) ) for (;;)
-#else
-        if ( enc_ctx->video_st ) for (;;)
-#endif
-		{
-			AVCodecContext *c = enc_ctx->video_st->codec;
-			AVPacket pkt;
-			av_init_packet( &pkt );
-			if ( c->codec->id == AV_CODEC_ID_RAWVIDEO ) {
-				pkt.data = NULL;
-				pkt.size = 0;
-			} else {
-				pkt.data = video_outbuf;
-				pkt.size = video_outbuf_size;
-			}
-
-			// Encode the image
-#if LIBAVCODEC_VERSION_INT >= ((57<<16)+(37<<8)+0)
-			int ret;
-			while ( (ret = avcodec_receive_packet( c, &pkt )) == AVERROR(EAGAIN) ) {
-				ret = avcodec_send_frame( c, NULL );
-				if ( ret < 0 ) {
-					mlt_log_warning( MLT_CONSUMER_SERVICE(consumer), "error with video encode: %d\n", ret );
-					break;
-				}
-			}
-#else
-			int got_packet = 0;
-			int ret = avcodec_encode_video2( c, &pkt, NULL, &got_packet );
-			if ( ret < 0 )
-				pkt.size = ret;
-			else if ( !got_packet )
-				pkt.size = 0;
-#endif
-			mlt_log_debug( MLT_CONSUMER_SERVICE( consumer ), "flushing video size %d\n", pkt.size );
-			if ( pkt.size < 0 )
-				break;
-			// Dual pass logging
-			if ( mlt_properties_get_data( properties, "_logfile", NULL ) && c->stats_out )
-				fprintf( mlt_properties_get_data( properties, "_logfile", NULL ), "%s", c->stats_out );
-			if ( !pkt.size )
-				break;
-
-			if ( pkt.pts != AV_NOPTS_VALUE )
-				pkt.pts = av_rescale_q( pkt.pts, c->time_base, enc_ctx->video_st->time_base );
-			if ( pkt.dts != AV_NOPTS_VALUE )
-				pkt.dts = av_rescale_q( pkt.dts, c->time_base, enc_ctx->video_st->time_base );
-			pkt.stream_index = enc_ctx->video_st->index;
-
-			// write the compressed frame in the media file
-			if ( av_interleaved_write_frame( enc_ctx->oc, &pkt ) != 0 )
-			{
-				mlt_log_fatal( MLT_CONSUMER_SERVICE(consumer), "error writing flushed video frame\n" );
-				mlt_events_fire( properties, "consumer-fatal-error", NULL );
-				goto on_fatal_error;
-			}
-		}
-	}
+	// Finish the streams and flush the encoder buffers
+	finish_pipeline( enc_ctx );
 
 on_fatal_error:
 
@@ -2215,19 +3718,48 @@ on_fatal_error:
 		av_write_trailer( enc_ctx->oc );
 
 	// Clean up input and output frames
-	if ( converted_avframe )
-		av_free( converted_avframe->data[0] );
-	av_free( converted_avframe );
-#if defined(AVFILTER) && LIBAVUTIL_VERSION_MAJOR >= 56
-	if (enc_ctx->video_st && enc_ctx->video_st->codec && AV_PIX_FMT_VAAPI == enc_ctx->video_st->codec->pix_fmt)
-		av_frame_free(&avframe);
-#endif
-	av_free( video_outbuf );
+	if ( enc_ctx->free_pictures )
+	{
+		AVFrame *picture = enc_ctx->last_picture;
+		encode_queue_close( enc_ctx->free_pictures );
+		do
+		{
+			if ( picture )
+				av_free( picture->data[0] );
+			av_free( picture );
+		}
+		while ( ( picture = encode_queue_pop( enc_ctx->free_pictures ) ) );
+		encode_queue_free( enc_ctx->free_pictures );
+	}
+	for ( i = 0; i < enc_ctx->rendition_count; i++ )
+	{
+		rendition *r = &enc_ctx->renditions[i];
+		AVFrame *picture = r->last_picture;
+		if ( r->free_pictures )
+		{
+			encode_queue_close( r->free_pictures );
+			do
+			{
+				if ( picture )
+					av_free( picture->data[0] );
+				av_free( picture );
+			}
+			while ( ( picture = encode_queue_pop( r->free_pictures ) ) );
+			encode_queue_free( r->free_pictures );
+		}
+		sws_freeContext( r->scaler );
+	}
+	encode_queue_free( enc_ctx->frame_queue );
+	encode_queue_free( enc_ctx->picture_queue );
+	encode_queue_free( enc_ctx->packet_queue );
+	av_free( enc_ctx->video_outbuf );
 	av_free( enc_ctx->audio_avframe );
 
 	// close each codec
 	if ( enc_ctx->video_st )
 		close_video(enc_ctx->oc, enc_ctx->video_st);
+	for ( i = 0; i < enc_ctx->rendition_count; i++ )
+		close_video( enc_ctx->oc, enc_ctx->renditions[i].st );
 	for ( i = 0; i < MAX_AUDIO_STREAMS && enc_ctx->audio_st[i]; i++ )
 		close_audio( enc_ctx->oc, enc_ctx->audio_st[i] );
 
@@ -2248,6 +3780,9 @@ on_fatal_error:
 	// Just in case we terminated on pause
 	mlt_consumer_stopped( consumer );
 	mlt_properties_close( enc_ctx->frame_meta_properties );
+	mlt_properties_close( enc_ctx->audio_meta_properties );
+	pthread_mutex_destroy( &enc_ctx->audio_mutex );
+	pthread_cond_destroy( &enc_ctx->audio_cond );
 
 	if ( mlt_properties_get_int( properties, "pass" ) > 1 )
 	{
@@ -2289,9 +3824,6 @@ on_fatal_error:
 		}
 	}
 
-	while ( ( frame = mlt_deque_pop_back( queue ) ) )
-		mlt_frame_close( frame );
-
 	mlt_pool_release( enc_ctx );
 
 	return NULL;
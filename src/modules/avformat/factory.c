@@ -385,7 +385,7 @@ static mlt_properties avfilter_metadata( mlt_service_type type, const char *id,
 			snprintf( key, 20, "%d", mlt_properties_count( params ) );
 			mlt_properties_set_data( params, key, p, 0, (mlt_destructor) mlt_properties_close, NULL );
 			mlt_properties_set( p, "identifier", "av.threads" );
-			mlt_properties_set( p, "description", "Maximum number of threads" );
+			mlt_properties_set( p, "description", "Maximum number of threads, 0 for automatic, defaults to the number of slice threads" );
 			mlt_properties_set( p, "type", "integer" );
 			mlt_properties_set_int( p, "minimum", 0 );
 			mlt_properties_set_int( p, "default", 0 );
@@ -0,0 +1,482 @@
+/*
+ * farm.c -- render segments of consumer_avformat on remote melt workers
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "farm.h"
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* The protocol is that of melt -worker, see src/melt/worker.c. Every worker
+ * takes the next segment that is not rendered yet. A segment that fails is
+ * given to another worker, up to FARM_ATTEMPTS times, and a worker that fails
+ * twice in a row is not used any more.
+ */
+
+#define FARM_MAGIC "MLTFARM 1"
+#define FARM_ATTEMPTS (3)
+#define FARM_WORKER_FAILURES (2)
+
+enum { segment_pending, segment_running, segment_done };
+
+typedef struct farm_s *farm;
+typedef struct farm_worker_s *farm_worker;
+
+struct farm_s
+{
+	mlt_consumer consumer;
+	const char *xml;
+	char *profile_text;
+	char *settings_text;
+	int *starts;
+	int count;
+	char **parts;
+	int *state;
+	int *attempts;
+	int remaining;
+	int failed;
+	int active;
+	int timeout;
+	volatile int cancel;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+struct farm_worker_s
+{
+	farm farm;
+	char *address;
+	int index;
+	pthread_t thread;
+	int started;
+	int segments;
+	int frames;
+	int64_t elapsed;
+	int failures;
+};
+
+static int64_t farm_now( )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int write_all( int fd, const void *data, size_t size )
+{
+	const char *p = data;
+	while ( size > 0 )
+	{
+		ssize_t n = send( fd, p, size, MSG_NOSIGNAL );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+// Read from a worker, giving up when the render is cancelled or the worker is silent too long.
+static ssize_t read_some( farm self, int fd, void *data, size_t size )
+{
+	int idle = 0;
+	for ( ;; )
+	{
+		ssize_t n = recv( fd, data, size, 0 );
+		if ( n >= 0 )
+			return n;
+		if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+			return -1;
+		if ( self->cancel || ++ idle > self->timeout )
+			return -1;
+	}
+}
+
+static int read_line( farm self, int fd, char *line, size_t size )
+{
+	size_t i = 0;
+	while ( i + 1 < size )
+	{
+		if ( read_some( self, fd, &line[ i ], 1 ) != 1 )
+			return 1;
+		if ( line[ i ] == '\n' )
+			break;
+		i ++;
+	}
+	line[ i ] = '\0';
+	return 0;
+}
+
+static int farm_connect( const char *address )
+{
+	const char *colon = strrchr( address, ':' );
+	char *host = colon ? strndup( address, colon - address ) : strdup( address );
+	struct addrinfo hints, *result = NULL, *ai;
+	struct timeval timeout = { 1, 0 };
+	int fd = -1;
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ( host && getaddrinfo( host, colon ? colon + 1 : "5250", &hints, &result ) == 0 )
+	{
+		for ( ai = result; ai && fd < 0; ai = ai->ai_next )
+		{
+			fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+			if ( fd >= 0 && connect( fd, ai->ai_addr, ai->ai_addrlen ) )
+			{
+				close( fd );
+				fd = -1;
+			}
+		}
+		freeaddrinfo( result );
+	}
+	free( host );
+
+	// Wake up every second to check for cancellation
+	if ( fd >= 0 )
+		setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	return fd;
+}
+
+/** Render one segment on a worker into its part file.
+ *
+ * \return non-zero on error
+ */
+
+static int render_segment( farm_worker worker, int segment )
+{
+	farm self = worker->farm;
+	mlt_service service = MLT_CONSUMER_SERVICE( self->consumer );
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self->consumer );
+	int fd = farm_connect( worker->address );
+	FILE *file = NULL;
+	char line[ 256 ];
+	char name[ 64 ];
+	int error = fd < 0;
+
+	if ( error )
+	{
+		mlt_log_warning( service, "cannot connect to worker %s\n", worker->address );
+		return error;
+	}
+
+	snprintf( line, sizeof( line ), FARM_MAGIC " %d %d %lu %lu %lu\n", self->starts[ segment ], self->starts[ segment + 1 ] - 1,
+		(unsigned long) strlen( self->profile_text ), (unsigned long) strlen( self->settings_text ), (unsigned long) strlen( self->xml ) );
+	error = write_all( fd, line, strlen( line ) ) ||
+		write_all( fd, self->profile_text, strlen( self->profile_text ) ) ||
+		write_all( fd, self->settings_text, strlen( self->settings_text ) ) ||
+		write_all( fd, self->xml, strlen( self->xml ) );
+
+	while ( !error )
+	{
+		int64_t size = 0;
+		int frames = 0;
+
+		if ( read_line( self, fd, line, sizeof( line ) ) )
+		{
+			mlt_log_warning( service, "lost worker %s\n", worker->address );
+			error = 1;
+		}
+		else if ( sscanf( line, "PROGRESS %d", &frames ) == 1 )
+		{
+			snprintf( name, sizeof( name ), "farm.%d.position", worker->index );
+			mlt_properties_set_int( properties, name, frames );
+		}
+		else if ( sscanf( line, "DONE %" SCNd64, &size ) == 1 )
+		{
+			char buffer[ 65536 ];
+			file = fopen( self->parts[ segment ], "wb" );
+			error = !file;
+			while ( !error && size > 0 )
+			{
+				ssize_t n = read_some( self, fd, buffer, size < sizeof( buffer ) ? size : sizeof( buffer ) );
+				error = n <= 0 || fwrite( buffer, 1, n, file ) != n;
+				size -= n;
+			}
+			error = ( file && fclose( file ) ) || error;
+			if ( error )
+			{
+				mlt_log_warning( service, "failed to receive segment %d from worker %s\n", segment, worker->address );
+				remove( self->parts[ segment ] );
+			}
+			break;
+		}
+		else
+		{
+			mlt_log_warning( service, "worker %s failed segment %d: %s\n", worker->address, segment,
+				strncmp( line, "FAIL ", 5 ) ? line : line + 5 );
+			error = 1;
+		}
+	}
+	close( fd );
+	return error;
+}
+
+// Publish the throughput of a worker on the consumer.
+static void report_worker( farm_worker worker )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( worker->farm->consumer );
+	double fps = worker->elapsed > 0 ? worker->frames * 1000000.0 / worker->elapsed : 0.0;
+	char name[ 64 ];
+
+	snprintf( name, sizeof( name ), "farm.%d.segments", worker->index );
+	mlt_properties_set_int( properties, name, worker->segments );
+	snprintf( name, sizeof( name ), "farm.%d.frames", worker->index );
+	mlt_properties_set_int( properties, name, worker->frames );
+	snprintf( name, sizeof( name ), "farm.%d.fps", worker->index );
+	mlt_properties_set_double( properties, name, fps );
+	snprintf( name, sizeof( name ), "farm.%d.failures", worker->index );
+	mlt_properties_set_int( properties, name, worker->failures );
+}
+
+static void *worker_thread( void *arg )
+{
+	farm_worker worker = arg;
+	farm self = worker->farm;
+	int failures = 0;
+
+	pthread_mutex_lock( &self->mutex );
+	while ( self->remaining > 0 && !self->failed && !self->cancel && failures < FARM_WORKER_FAILURES )
+	{
+		int segment;
+		for ( segment = 0; segment < self->count && self->state[ segment ] != segment_pending; segment++ );
+		if ( segment == self->count )
+		{
+			// Wait for a segment of another worker to finish or to fail
+			pthread_cond_wait( &self->cond, &self->mutex );
+			continue;
+		}
+		self->state[ segment ] = segment_running;
+		pthread_mutex_unlock( &self->mutex );
+
+		int64_t start = farm_now( );
+		int error = render_segment( worker, segment );
+		int frames = self->starts[ segment + 1 ] - self->starts[ segment ];
+
+		pthread_mutex_lock( &self->mutex );
+		if ( error )
+		{
+			failures ++;
+			worker->failures ++;
+			self->state[ segment ] = segment_pending;
+			if ( ++ self->attempts[ segment ] >= FARM_ATTEMPTS )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( self->consumer ), "segment %d failed %d times\n", segment, FARM_ATTEMPTS );
+				self->failed = 1;
+			}
+		}
+		else
+		{
+			int64_t elapsed = farm_now( ) - start;
+			failures = 0;
+			worker->segments ++;
+			worker->frames += frames;
+			worker->elapsed += elapsed;
+			self->state[ segment ] = segment_done;
+			self->remaining --;
+			mlt_log_info( MLT_CONSUMER_SERVICE( self->consumer ), "worker %s rendered segment %d of %d frames at %.1f fps, %d left\n",
+				worker->address, segment, frames, elapsed > 0 ? frames * 1000000.0 / elapsed : 0.0, self->remaining );
+			mlt_properties_set_int( MLT_CONSUMER_PROPERTIES( self->consumer ), "farm.done", self->count - self->remaining );
+		}
+		report_worker( worker );
+		pthread_cond_broadcast( &self->cond );
+	}
+	if ( failures >= FARM_WORKER_FAILURES )
+		mlt_log_warning( MLT_CONSUMER_SERVICE( self->consumer ), "not using worker %s any more\n", worker->address );
+	self->active --;
+	pthread_cond_broadcast( &self->cond );
+	pthread_mutex_unlock( &self->mutex );
+	return NULL;
+}
+
+// Write the name=value lines of a properties list for a worker to parse.
+static char *properties_text( mlt_properties properties )
+{
+	size_t size = 1;
+	char *text;
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( properties ); i++ )
+	{
+		const char *value = mlt_properties_get_value( properties, i );
+		if ( value )
+			size += strlen( mlt_properties_get_name( properties, i ) ) + strlen( value ) + 2;
+	}
+	text = malloc( size );
+	if ( text )
+	{
+		*text = '\0';
+		for ( i = 0; i < mlt_properties_count( properties ); i++ )
+		{
+			const char *name = mlt_properties_get_name( properties, i );
+			const char *value = mlt_properties_get_value( properties, i );
+			if ( value && !strchr( value, '\n' ) )
+			{
+				strcat( text, name );
+				strcat( text, "=" );
+				strcat( text, value );
+				strcat( text, "\n" );
+			}
+		}
+	}
+	return text;
+}
+
+static char *profile_text( mlt_profile profile )
+{
+	char *text = malloc( 512 );
+	if ( text )
+		snprintf( text, 512, "width=%d\nheight=%d\nprogressive=%d\nsample_aspect_num=%d\nsample_aspect_den=%d\n"
+			"display_aspect_num=%d\ndisplay_aspect_den=%d\nframe_rate_num=%d\nframe_rate_den=%d\ncolorspace=%d\n",
+			profile->width, profile->height, profile->progressive, profile->sample_aspect_num, profile->sample_aspect_den,
+			profile->display_aspect_num, profile->display_aspect_den, profile->frame_rate_num, profile->frame_rate_den,
+			profile->colorspace );
+	return text;
+}
+
+/** Render segments of a project on remote melt workers.
+ *
+ * The workers are a list of host:port separated by commas or spaces, and a
+ * host may be listed more than once to give it several segments at a time.
+ * The throughput of the workers is published on the consumer as
+ * farm.N.segments, farm.N.frames, farm.N.fps and farm.N.failures.
+ * \param xml the project serialised by consumer_xml
+ * \param settings the properties of the consumer of every segment
+ * \param starts the first frame of every segment and the end of the last one
+ * \param parts the files to write the segments to
+ * \return non-zero on error
+ */
+
+int farm_render( mlt_consumer consumer, const char *workers, const char *xml, mlt_properties settings,
+	int *starts, int count, char **parts )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	struct farm_s self;
+	farm_worker list = NULL;
+	char *addresses = strdup( workers );
+	char *token, *saveptr = NULL;
+	int n = 0, i, error;
+
+	memset( &self, 0, sizeof( self ) );
+	self.consumer = consumer;
+	self.xml = xml;
+	self.starts = starts;
+	self.count = count;
+	self.parts = parts;
+	self.remaining = count;
+	self.timeout = mlt_properties_get( properties, "farm_timeout" ) ?
+		mlt_properties_get_int( properties, "farm_timeout" ) : 60;
+	self.profile_text = profile_text( mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) ) );
+	self.settings_text = properties_text( settings );
+	self.state = calloc( count, sizeof( int ) );
+	self.attempts = calloc( count, sizeof( int ) );
+	pthread_mutex_init( &self.mutex, NULL );
+	pthread_cond_init( &self.cond, NULL );
+
+	for ( token = addresses ? strtok_r( addresses, ", ", &saveptr ) : NULL; token; token = strtok_r( NULL, ", ", &saveptr ) )
+	{
+		farm_worker grown = realloc( list, ( n + 1 ) * sizeof( struct farm_worker_s ) );
+		if ( !grown )
+			break;
+		list = grown;
+		memset( &list[ n ], 0, sizeof( struct farm_worker_s ) );
+		list[ n ].farm = &self;
+		list[ n ].address = token;
+		list[ n ].index = n;
+		n ++;
+	}
+	error = !n || !self.profile_text || !self.settings_text || !self.state || !self.attempts;
+
+	mlt_properties_set_int( properties, "farm.workers", n );
+	pthread_mutex_lock( &self.mutex );
+	for ( i = 0; !error && i < n; i++ )
+	{
+		list[ i ].started = !pthread_create( &list[ i ].thread, NULL, worker_thread, &list[ i ] );
+		self.active += list[ i ].started;
+	}
+
+	// Wait for the segments, for every worker to give up, or for the consumer to stop
+	while ( !error && self.remaining > 0 && !self.failed && self.active > 0 )
+	{
+		struct timespec t;
+		struct timeval now;
+		gettimeofday( &now, NULL );
+		t.tv_sec = now.tv_sec + 1;
+		t.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait( &self.cond, &self.mutex, &t );
+		if ( !mlt_properties_get_int( properties, "running" ) )
+			self.cancel = 1;
+	}
+	error = error || self.remaining > 0;
+	self.cancel = 1;
+	pthread_cond_broadcast( &self.cond );
+	pthread_mutex_unlock( &self.mutex );
+
+	for ( i = 0; i < n; i++ )
+	{
+		if ( list[ i ].started )
+			pthread_join( list[ i ].thread, NULL );
+		mlt_log_info( MLT_CONSUMER_SERVICE( consumer ), "worker %s rendered %d segments, %d frames at %.1f fps, %d failures\n",
+			list[ i ].address, list[ i ].segments, list[ i ].frames,
+			list[ i ].elapsed > 0 ? list[ i ].frames * 1000000.0 / list[ i ].elapsed : 0.0, list[ i ].failures );
+	}
+	if ( error && self.remaining > 0 )
+		mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "%d of %d segments were not rendered\n", self.remaining, count );
+
+	pthread_mutex_destroy( &self.mutex );
+	pthread_cond_destroy( &self.cond );
+	free( self.profile_text );
+	free( self.settings_text );
+	free( self.state );
+	free( self.attempts );
+	free( list );
+	free( addresses );
+	return error;
+}
+
+#else
+
+int farm_render( mlt_consumer consumer, const char *workers, const char *xml, mlt_properties settings,
+	int *starts, int count, char **parts )
+{
+	mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "render farms are not supported on this platform\n" );
+	return 1;
+}
+
+#endif
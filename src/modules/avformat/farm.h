@@ -0,0 +1,28 @@
+/*
+ * farm.h -- render segments of consumer_avformat on remote melt workers
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef FARM_H
+#define FARM_H
+
+#include <framework/mlt_consumer.h>
+
+int farm_render( mlt_consumer consumer, const char *workers, const char *xml, mlt_properties settings,
+	int *starts, int count, char **parts );
+
+#endif // FARM_H
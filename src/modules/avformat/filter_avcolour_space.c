@@ -29,6 +29,10 @@
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 0, 0)
+#  define HWACCEL
+#  include <libavutil/hwcontext.h>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,6 +71,15 @@ static int convert_mlt_to_av_cs( mlt_image_format format )
 		case mlt_image_yuv422p16:
 			value = AV_PIX_FMT_YUV422P16LE;
 			break;
+		case mlt_image_yuv420p10:
+			value = AV_PIX_FMT_YUV420P10LE;
+			break;
+		case mlt_image_yuv444p16:
+			value = AV_PIX_FMT_YUV444P16LE;
+			break;
+		case mlt_image_rgba64:
+			value = AV_PIX_FMT_RGBA64LE;
+			break;
 		default:
 			mlt_log_error( NULL, "[filter avcolor_space] Invalid format %s\n",
 				mlt_image_format_name( format ) );
@@ -76,40 +89,113 @@ static int convert_mlt_to_av_cs( mlt_image_format format )
 	return value;
 }
 
+// Get the MLT format of the planar pixel formats whose plane layout MLT defines itself.
+static mlt_image_format mlt_planar_format( int av_fmt )
+{
+	switch ( av_fmt )
+	{
+		case AV_PIX_FMT_YUV422P16LE:
+			return mlt_image_yuv422p16;
+		case AV_PIX_FMT_YUV420P10LE:
+			return mlt_image_yuv420p10;
+		case AV_PIX_FMT_YUV444P16LE:
+			return mlt_image_yuv444p16;
+		default:
+			return mlt_image_none;
+	}
+}
+
+// Is the MLT format YUV?
+static int is_yuv( mlt_image_format format )
+{
+	return format == mlt_image_yuv422 || format == mlt_image_yuv420p || format == mlt_image_yuv422p16
+		|| format == mlt_image_yuv420p10 || format == mlt_image_yuv444p16;
+}
+
 // returns set_lumage_transfer result
-static int av_convert_image( uint8_t *out, uint8_t *in, int out_fmt, int in_fmt,
-	int width, int height, int src_colorspace, int dst_colorspace, int use_full_range )
+static int av_convert_planes( uint8_t *out, uint8_t *in_data[4], int in_stride[4], int out_fmt, int in_fmt,
+	int in_width, int in_height, int width, int height, int src_colorspace, int dst_colorspace, int use_full_range )
 {
-	uint8_t *in_data[4];
-	int in_stride[4];
 	uint8_t *out_data[4];
 	int out_stride[4];
 	int flags = mlt_default_sws_flags;
 	int error = -1;
 
-	if ( in_fmt == AV_PIX_FMT_YUV422P16LE )
-		mlt_image_format_planes(mlt_image_yuv422p16, width, height, in, in_data, in_stride);
-	else
-		av_image_fill_arrays(in_data, in_stride, in, in_fmt, width, height, IMAGE_ALIGN);
-	if ( out_fmt == AV_PIX_FMT_YUV422P16LE )
-		mlt_image_format_planes(mlt_image_yuv422p16, width, height, out, out_data, out_stride);
+	if ( mlt_planar_format( out_fmt ) != mlt_image_none )
+		mlt_image_format_planes( mlt_planar_format( out_fmt ), width, height, out, out_data, out_stride );
 	else
 		av_image_fill_arrays(out_data, out_stride, out, out_fmt, width, height, IMAGE_ALIGN);
-	struct SwsContext *context = sws_getContext( width, height, in_fmt,
+	struct SwsContext *context = sws_getContext( in_width, in_height, in_fmt,
 		width, height, out_fmt, flags, NULL, NULL, NULL);
 	if ( context )
 	{
 		// libswscale wants the RGB colorspace to be SWS_CS_DEFAULT, which is = SWS_CS_ITU601.
-		if ( out_fmt == AV_PIX_FMT_RGB24 || out_fmt == AV_PIX_FMT_RGBA )
+		if ( out_fmt == AV_PIX_FMT_RGB24 || out_fmt == AV_PIX_FMT_RGBA || out_fmt == AV_PIX_FMT_RGBA64LE )
 			dst_colorspace = 601;
 		error = mlt_set_luma_transfer( context, src_colorspace, dst_colorspace, use_full_range, use_full_range );
-		sws_scale(context, (const uint8_t* const*) in_data, in_stride, 0, height,
+		sws_scale(context, (const uint8_t* const*) in_data, in_stride, 0, in_height,
 			out_data, out_stride);
 		sws_freeContext( context );
 	}
 	return error;
 }
 
+static int av_convert_image( uint8_t *out, uint8_t *in, int out_fmt, int in_fmt,
+	int width, int height, int src_colorspace, int dst_colorspace, int use_full_range )
+{
+	uint8_t *in_data[4];
+	int in_stride[4];
+
+	if ( mlt_planar_format( in_fmt ) != mlt_image_none )
+		mlt_image_format_planes( mlt_planar_format( in_fmt ), width, height, in, in_data, in_stride );
+	else
+		av_image_fill_arrays(in_data, in_stride, in, in_fmt, width, height, IMAGE_ALIGN);
+	return av_convert_planes( out, in_data, in_stride, out_fmt, in_fmt, width, height, width, height,
+		src_colorspace, dst_colorspace, use_full_range );
+}
+
+#ifdef HWACCEL
+// Download a hardware surface from producer_avformat and convert it to the output format.
+static int convert_surface( mlt_frame frame, uint8_t **image, mlt_image_format *format, mlt_image_format output_format,
+	int colorspace, int profile_colorspace )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	AVFrame *sw_frame = av_frame_alloc();
+	int error = 1;
+
+	if ( output_format == mlt_image_glsl || output_format == mlt_image_glsl_texture )
+		output_format = mlt_image_yuv422;
+	if ( sw_frame && av_hwframe_transfer_data( sw_frame, (AVFrame*) *image, 0 ) >= 0 )
+	{
+		int out_fmt = convert_mlt_to_av_cs( output_format );
+		int size = FFMAX( av_image_get_buffer_size( out_fmt, width, height, IMAGE_ALIGN ),
+			mlt_image_format_size( output_format, width, height, NULL ) );
+		uint8_t *output = mlt_pool_alloc( size );
+
+		if ( !av_convert_planes( output, sw_frame->data, sw_frame->linesize, out_fmt, sw_frame->format,
+				sw_frame->width, sw_frame->height, width, height, colorspace, profile_colorspace, 0 ) )
+		{
+			if ( is_yuv( output_format ) )
+				mlt_properties_set_int( properties, "colorspace", profile_colorspace );
+		}
+		*image = output;
+		*format = output_format;
+		mlt_frame_set_image( frame, output, size, mlt_pool_release );
+		mlt_properties_set_int( properties, "format", output_format );
+		error = 0;
+	}
+	else
+	{
+		mlt_log_error( NULL, "[filter avcolor_space] failed to download %s surface\n",
+			mlt_properties_get( properties, "hwsurface.type" ) );
+	}
+	av_frame_free( &sw_frame );
+	return error;
+}
+#endif
+
 /** Do it :-).
 */
 
@@ -132,6 +218,16 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 			mlt_image_format_name( *format ), mlt_image_format_name( output_format ),
 			width, height, colorspace, profile_colorspace );
 
+		// Only a decoder can make a hardware surface.
+		if ( output_format == mlt_image_hwsurface )
+			return 1;
+		if ( *format == mlt_image_hwsurface )
+#ifdef HWACCEL
+			return convert_surface( frame, image, format, output_format, colorspace, profile_colorspace );
+#else
+			return 1;
+#endif
+
 		int in_fmt = convert_mlt_to_av_cs( *format );
 		int out_fmt = convert_mlt_to_av_cs( output_format );
 		int size = FFMAX( av_image_get_buffer_size(out_fmt, width, height, IMAGE_ALIGN),
@@ -172,9 +268,7 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 								colorspace, profile_colorspace, force_full_luma ) )
 		{
 			// The new colorspace is only valid if destination is YUV.
-			if ( output_format == mlt_image_yuv422 ||
-				output_format == mlt_image_yuv420p ||
-				output_format == mlt_image_yuv422p16 )
+			if ( is_yuv( output_format ) )
 				mlt_properties_set_int( properties, "colorspace", profile_colorspace );
 		}
 		*image = output;
@@ -20,6 +20,8 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_pool.h>
+#include <framework/mlt_slices.h>
 
 #include <string.h>
 #include <stdlib.h>
@@ -36,29 +38,6 @@ static uint8_t ff_cropTbl[256 + 2 * MAX_NEG_CROP] = {0,};
 #endif
 
 #ifdef USE_MMX
-#define DEINT_INPLACE_LINE_LUM \
-                    movd_m2r(lum_m4[0],mm0);\
-                    movd_m2r(lum_m3[0],mm1);\
-                    movd_m2r(lum_m2[0],mm2);\
-                    movd_m2r(lum_m1[0],mm3);\
-                    movd_m2r(lum[0],mm4);\
-                    punpcklbw_r2r(mm7,mm0);\
-                    movd_r2m(mm2,lum_m4[0]);\
-                    punpcklbw_r2r(mm7,mm1);\
-                    punpcklbw_r2r(mm7,mm2);\
-                    punpcklbw_r2r(mm7,mm3);\
-                    punpcklbw_r2r(mm7,mm4);\
-                    paddw_r2r(mm3,mm1);\
-                    psllw_i2r(1,mm2);\
-                    paddw_r2r(mm4,mm0);\
-                    psllw_i2r(2,mm1);\
-                    paddw_r2r(mm6,mm2);\
-                    paddw_r2r(mm2,mm1);\
-                    psubusw_r2r(mm0,mm1);\
-                    psrlw_i2r(3,mm1);\
-                    packuswb_r2r(mm7,mm1);\
-                    movd_r2m(mm1,lum_m2[0]);
-
 #define DEINT_LINE_LUM \
                     movd_m2r(lum_m4[0],mm0);\
                     movd_m2r(lum_m3[0],mm1);\
@@ -129,112 +108,59 @@ static inline void deinterlace_line(uint8_t *dst,
     }
 #endif
 }
-static inline void deinterlace_line_inplace(uint8_t *lum_m4, uint8_t *lum_m3, uint8_t *lum_m2, uint8_t *lum_m1, uint8_t *lum,
-                             int size)
-{
-#ifndef USE_MMX
-    uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
-    int sum;
-
-    for(;size > 0;size--) {
-        sum = -lum_m4[0];
-        sum += lum_m3[0] << 2;
-        sum += lum_m2[0] << 1;
-        lum_m4[0]=lum_m2[0];
-        sum += lum_m1[0] << 2;
-        sum += -lum[0];
-        lum_m2[0] = cm[(sum + 4) >> 3];
-        lum_m4++;
-        lum_m3++;
-        lum_m2++;
-        lum_m1++;
-        lum++;
-    }
-#else
-
-    {
-        mmx_t rounder;
-        rounder.uw[0]=4;
-        rounder.uw[1]=4;
-        rounder.uw[2]=4;
-        rounder.uw[3]=4;
-        pxor_r2r(mm7,mm7);
-        movq_m2r(rounder,mm6);
-    }
-    for (;size > 3; size-=4) {
-        DEINT_INPLACE_LINE_LUM
-        lum_m4+=4;
-        lum_m3+=4;
-        lum_m2+=4;
-        lum_m1+=4;
-        lum+=4;
-    }
-#endif
-}
-
 /* deinterlacing : 2 temporal taps, 3 spatial taps linear filter. The
    top field is copied as is, but the bottom field is deinterlaced
-   against the top field. */
+   against the top field. This does the pairs of lines from start to end,
+   which are even, so that the slices of an image can run at once. */
 static inline void deinterlace_bottom_field(uint8_t *dst, int dst_wrap,
-                                    const uint8_t *src1, int src_wrap,
-                                    int width, int height)
+                                    const uint8_t *src, int src_wrap,
+                                    int width, int height, int start, int end)
 {
-    const uint8_t *src_m2, *src_m1, *src_0, *src_p1, *src_p2;
     int y;
 
-    src_m2 = src1;
-    src_m1 = src1;
-    src_0=&src_m1[src_wrap];
-    src_p1=&src_0[src_wrap];
-    src_p2=&src_p1[src_wrap];
-    for(y=0;y<(height-2);y+=2) {
-        memcpy(dst,src_m1,width);
-        dst += dst_wrap;
-        deinterlace_line(dst,src_m2,src_m1,src_0,src_p1,src_p2,width);
-        src_m2 = src_0;
-        src_m1 = src_p1;
-        src_0 = src_p2;
-        src_p1 += 2*src_wrap;
-        src_p2 += 2*src_wrap;
-        dst += dst_wrap;
+    for(y=start;y<end;y+=2) {
+        const uint8_t *src_m1 = &src[y*src_wrap];
+        const uint8_t *src_m2 = y >= 2 ? &src_m1[-src_wrap] : src_m1;
+        const uint8_t *src_0 = &src_m1[src_wrap];
+        const uint8_t *src_p1 = y + 2 < height ? &src_0[src_wrap] : src_0;
+        const uint8_t *src_p2 = y + 3 < height ? &src_p1[src_wrap] : src_0;
+
+        memcpy(&dst[y*dst_wrap],src_m1,width);
+        deinterlace_line(&dst[(y+1)*dst_wrap],src_m2,src_m1,src_0,src_p1,src_p2,width);
     }
-    memcpy(dst,src_m1,width);
-    dst += dst_wrap;
-    /* do last line */
-    deinterlace_line(dst,src_m2,src_m1,src_0,src_0,src_0,width);
 }
 
-static inline void deinterlace_bottom_field_inplace(uint8_t *src1, int src_wrap,
-					     int width, int height)
+typedef struct
 {
-    uint8_t *src_m1, *src_0, *src_p1, *src_p2;
-    int y;
-    uint8_t *buf;
-    buf = (uint8_t*)av_malloc(width);
+    uint8_t *dst;
+    int dst_wrap;
+    const uint8_t *src;
+    int src_wrap;
+    int width;
+    int height;
+} deinterlace_slice_desc;
+
+static int deinterlace_slice_proc( int id, int index, int jobs, void *cookie )
+{
+    deinterlace_slice_desc *desc = cookie;
+    int pairs = desc->height / 2;
 
-    src_m1 = src1;
-    memcpy(buf,src_m1,width);
-    src_0=&src_m1[src_wrap];
-    src_p1=&src_0[src_wrap];
-    src_p2=&src_p1[src_wrap];
-    for(y=0;y<(height-2);y+=2) {
-        deinterlace_line_inplace(buf,src_m1,src_0,src_p1,src_p2,width);
-        src_m1 = src_p1;
-        src_0 = src_p2;
-        src_p1 += 2*src_wrap;
-        src_p2 += 2*src_wrap;
-    }
-    /* do last line */
-    deinterlace_line_inplace(buf,src_m1,src_0,src_0,src_0,width);
-    av_free(buf);
+    deinterlace_bottom_field(desc->dst, desc->dst_wrap, desc->src, desc->src_wrap, desc->width, desc->height,
+                             pairs * index / jobs * 2, pairs * (index + 1) / jobs * 2);
+#ifdef USE_MMX
+    emms();
+#endif
+    return 0;
 }
 
-
-/* deinterlace - if not supported return -1 */
+/* deinterlace - if not supported return -1. The source is only read, so
+   the destination must be another buffer, and the slices split it. */
 static int mlt_avpicture_deinterlace(uint8_t *dst_data[4], int dst_stride[4],
 	uint8_t *src_data[4], int src_stride[4], int pix_fmt, int width, int height)
 {
     int i;
+    int planes = pix_fmt == AV_PIX_FMT_YUYV422 ? 1 : 3;
+    int jobs = FFMAX(1, FFMIN(mlt_slices_count_normal(), height / 16));
 
     if (pix_fmt != AV_PIX_FMT_YUV420P &&
         pix_fmt != AV_PIX_FMT_YUV422P &&
@@ -242,52 +168,40 @@ static int mlt_avpicture_deinterlace(uint8_t *dst_data[4], int dst_stride[4],
         pix_fmt != AV_PIX_FMT_YUV444P &&
         pix_fmt != AV_PIX_FMT_YUV411P)
         return -1;
-    if ((width & 3) != 0 || (height & 3) != 0)
+    if ((width & 3) != 0 || (height & 3) != 0 || src_data[0] == dst_data[0])
         return -1;
 
-    if ( pix_fmt != AV_PIX_FMT_YUYV422 )
-	{
-      for(i=0;i<3;i++) {
-          if (i == 1) {
-              switch(pix_fmt) {
-              case AV_PIX_FMT_YUV420P:
-                  width >>= 1;
-                  height >>= 1;
-                  break;
-              case AV_PIX_FMT_YUV422P:
-                  width >>= 1;
-                  break;
-              case AV_PIX_FMT_YUV411P:
-                  width >>= 2;
-                  break;
-              default:
-                  break;
-              }
-          }
-          if (src_data[0] == dst_data[0]) {
-              deinterlace_bottom_field_inplace(dst_data[i], dst_stride[i],
-                                   width, height);
-          } else {
-              deinterlace_bottom_field(dst_data[i], dst_stride[i],
-                                          src_data[i], src_stride[i],
-                                          width, height);
-          }
-	  }
+    if (pix_fmt == AV_PIX_FMT_YUYV422)
+        width <<= 1;
+
+    for(i=0;i<planes;i++) {
+        deinterlace_slice_desc desc;
+
+        if (i == 1) {
+            switch(pix_fmt) {
+            case AV_PIX_FMT_YUV420P:
+                width >>= 1;
+                height >>= 1;
+                break;
+            case AV_PIX_FMT_YUV422P:
+                width >>= 1;
+                break;
+            case AV_PIX_FMT_YUV411P:
+                width >>= 2;
+                break;
+            default:
+                break;
+            }
+        }
+        desc.dst = dst_data[i];
+        desc.dst_wrap = dst_stride[i];
+        desc.src = src_data[i];
+        desc.src_wrap = src_stride[i];
+        desc.width = width;
+        desc.height = height;
+        mlt_slices_run_normal(jobs, deinterlace_slice_proc, &desc);
     }
-	else {
-      if (src_data[0] == dst_data[0]) {
-          deinterlace_bottom_field_inplace(dst_data[0], dst_stride[0],
-                               width<<1, height);
-      } else {
-          deinterlace_bottom_field(dst_data[0], dst_stride[0],
-                                      src_data[0], src_stride[0],
-                                      width<<1, height);
-      }
-	}
 
-#ifdef USE_MMX
-    emms();
-#endif
     return 0;
 }
 
@@ -299,29 +213,36 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	int error = 0;
 	int deinterlace = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_deinterlace" );
 
-	// Determine if we need a writable version or not
-	if ( deinterlace && !writable )
-		 writable = !mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "progressive" );
-
-	// Get the input image
+	// Get the input image, which the deinterlacer only reads
 	*format = mlt_image_yuv422;
-	error = mlt_frame_get_image( frame, image, format, width, height, 1 );
+	error = mlt_frame_get_image( frame, image, format, width, height, writable );
 
 	// Check that we want progressive and we aren't already progressive
 	if ( deinterlace && *format == mlt_image_yuv422 && *image != NULL && !mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "progressive" ) )
 	{
-		// Create a picture
-		uint8_t *image_data[4];
-		int strides[4];
+		// Create the pictures
+		int size = mlt_image_format_size( *format, *width, *height, NULL );
+		uint8_t *output = mlt_pool_alloc( size );
+		uint8_t *image_data[4], *output_data[4];
+		int strides[4], output_strides[4];
 
-		// Fill the picture
+		// Fill the pictures
 		av_image_fill_arrays(image_data, strides, *image, AV_PIX_FMT_YUYV422, *width, *height, 1);
+		av_image_fill_arrays(output_data, output_strides, output, AV_PIX_FMT_YUYV422, *width, *height, 1);
 		mlt_log_timings_begin();
-		mlt_avpicture_deinterlace( image_data, strides, image_data, strides, AV_PIX_FMT_YUYV422, *width, *height );
-		mlt_log_timings_end( NULL, "mlt_avpicture_deinterlace" );
+		if ( output && !mlt_avpicture_deinterlace( output_data, output_strides, image_data, strides, AV_PIX_FMT_YUYV422, *width, *height ) )
+		{
+			mlt_frame_set_image( frame, output, size, mlt_pool_release );
+			*image = output;
 
-		// Make sure that others know the frame is deinterlaced
-		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "progressive", 1 );
+			// Make sure that others know the frame is deinterlaced
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "progressive", 1 );
+		}
+		else
+		{
+			mlt_pool_release( output );
+		}
+		mlt_log_timings_end( NULL, "mlt_avpicture_deinterlace" );
 	}
 
 	return error;
@@ -47,22 +47,33 @@ typedef struct
 	AVFilterGraph* avfilter_graph;
 	AVFrame* avinframe;
 	AVFrame* avoutframe;
+	mlt_properties options;
 	int format;
+	// The image size or the audio frequency and channels of the graph
+	int width;
+	int height;
 	int reset;
+	int changed;
+	int animated;
 } private_data;
 
 static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 {
 	if( strncmp( PARAM_PREFIX, name, PARAM_PREFIX_LEN ) == 0 ) {
 		private_data* pdata = (private_data*)filter->child;
-		if( pdata->avfilter )
+		if( !strcmp( name + PARAM_PREFIX_LEN, "threads" ) )
+		{
+			pdata->reset = 1;
+		}
+		else if( pdata->avfilter )
 		{
 			const AVOption *opt = NULL;
 			while( ( opt = av_opt_next( &pdata->avfilter->priv_class, opt ) ) )
 			{
 				if( !strcmp( opt->name, name + PARAM_PREFIX_LEN ) )
 				{
-					pdata->reset = 1;
+					// Try to apply it to the running graph before rebuilding it
+					pdata->changed = 1;
 					break;
 				}
 			}
@@ -111,29 +122,161 @@ static mlt_image_format get_supported_image_format( mlt_image_format format )
 	}
 }
 
-static void set_avfilter_options( mlt_filter filter )
+static int is_numeric_option( const AVOption *opt )
+{
+	switch( opt->type )
+	{
+	case AV_OPT_TYPE_INT:
+	case AV_OPT_TYPE_INT64:
+	case AV_OPT_TYPE_DOUBLE:
+	case AV_OPT_TYPE_FLOAT:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/** Get the value of an option property at the position of a frame.
+ *
+ * Only numeric options are animated because the values of the others may
+ * contain '=' without being keyframes.
+ */
+
+static const char* get_option_value( mlt_filter filter, mlt_frame frame, const AVOption *opt, int index )
+{
+	private_data* pdata = (private_data*)filter->child;
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES(filter);
+	const char *name = mlt_properties_get_name( filter_properties, index );
+
+	if( frame && is_numeric_option( opt ) )
+	{
+		const char* value = mlt_properties_anim_get( filter_properties, name, mlt_filter_get_position( filter, frame ), mlt_filter_get_length2( filter, frame ) );
+		if( mlt_properties_get_animation( filter_properties, name ) )
+			pdata->animated = 1;
+		return value;
+	}
+	return mlt_properties_get_value( filter_properties, index );
+}
+
+static void set_avfilter_options( mlt_filter filter, mlt_frame frame )
 {
 	private_data* pdata = (private_data*)filter->child;
 	mlt_properties filter_properties = MLT_FILTER_PROPERTIES(filter);
 	int i;
 	int count = mlt_properties_count( filter_properties );
 
+	// Remember the applied values to send only the changes to the running graph
+	mlt_properties_close( pdata->options );
+	pdata->options = mlt_properties_new();
+	pdata->animated = 0;
+	pdata->changed = 0;
+
 	for( i = 0; i < count; i++ )
 	{
 		const char *param_name = mlt_properties_get_name( filter_properties, i );
 		if( param_name && strncmp( PARAM_PREFIX, param_name, PARAM_PREFIX_LEN ) == 0 )
 		{
 			const AVOption *opt = av_opt_find( pdata->avfilter_ctx->priv, param_name + PARAM_PREFIX_LEN, 0, 0, 0 );
-			const char* value = mlt_properties_get_value( filter_properties, i );
+			const char* value = opt ? get_option_value( filter, frame, opt, i ) : NULL;
 			if( opt && value )
 			{
 				av_opt_set( pdata->avfilter_ctx->priv, opt->name, value, 0 );
+				mlt_properties_set( pdata->options, opt->name, value );
+			}
+		}
+	}
+}
+
+/** Send the changed options to the running graph.
+ *
+ * \return true if an option cannot be changed without rebuilding the graph
+ */
+
+static int update_avfilter_options( mlt_filter filter, mlt_frame frame )
+{
+	private_data* pdata = (private_data*)filter->child;
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES(filter);
+	int i;
+	int count = mlt_properties_count( filter_properties );
+
+	pdata->changed = 0;
+	for( i = 0; i < count; i++ )
+	{
+		const char *param_name = mlt_properties_get_name( filter_properties, i );
+		if( param_name && strncmp( PARAM_PREFIX, param_name, PARAM_PREFIX_LEN ) == 0 )
+		{
+			const AVOption *opt = av_opt_find( pdata->avfilter_ctx->priv, param_name + PARAM_PREFIX_LEN, 0, 0, 0 );
+			const char* value = opt ? get_option_value( filter, frame, opt, i ) : NULL;
+			const char* applied = opt ? mlt_properties_get( pdata->options, opt->name ) : NULL;
+			if( value && ( !applied || strcmp( value, applied ) ) )
+			{
+				if( avfilter_process_command( pdata->avfilter_ctx, opt->name, value, NULL, 0, 0 ) < 0 )
+					return 1;
+				mlt_properties_set( pdata->options, opt->name, value );
 			}
 		}
 	}
+	return 0;
+}
+
+/** Determine whether the filter graph must be rebuilt for a frame.
+*/
+
+static int need_rebuild( mlt_filter filter, mlt_frame frame, int format, int width, int height )
+{
+	private_data* pdata = (private_data*)filter->child;
+
+	if( pdata->reset || pdata->format != format || pdata->width != width || pdata->height != height )
+		return 1;
+	if( pdata->changed || pdata->animated )
+		return !pdata->avfilter_graph || update_avfilter_options( filter, frame );
+	return 0;
+}
+
+/** Set the threads of the filter graph.
+ *
+ * It defaults to the number of threads that the normal slices use.
+ */
+
+static void set_graph_threads( mlt_filter filter, int sliced )
+{
+	private_data* pdata = (private_data*)filter->child;
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES(filter);
+
+	if ( sliced ) {
+		int threads = mlt_properties_get( filter_properties, "av.threads" )
+			? FFMAX( 0, mlt_properties_get_int( filter_properties, "av.threads" ) )
+			: mlt_slices_count_normal();
+		av_opt_set_int( pdata->avfilter_graph, "threads", threads, 0 );
+		pdata->avfilter_graph->thread_type = threads == 1 ? 0 : AVFILTER_THREAD_SLICE;
+	} else {
+		pdata->avfilter_graph->thread_type = 0;
+	}
+}
+
+static void release_avframe( void *frame )
+{
+	av_frame_free( (AVFrame**) &frame );
+}
+
+/** Give the output frame of the graph to a frame without copying it.
+ *
+ * \return true if the output cannot be used in place and must be copied
+ */
+
+static int attach_avframe( mlt_properties frame_properties, AVFrame *avframe )
+{
+	AVFrame *clone;
+
+	// A buffer that the graph still references may change under the frame
+	if( !av_frame_is_writable( avframe ) || !( clone = av_frame_alloc() ) )
+		return 1;
+	av_frame_move_ref( clone, avframe );
+	mlt_properties_set_data( frame_properties, "_avfilter_frame", clone, 0, release_avframe, NULL );
+	return 0;
 }
 
-static void init_audio_filtergraph( mlt_filter filter, mlt_audio_format format, int frequency, int channels )
+static void init_audio_filtergraph( mlt_filter filter, mlt_frame frame, mlt_audio_format format, int frequency, int channels )
 {
 	private_data* pdata = (private_data*)filter->child;
 	AVFilter *abuffersrc  = avfilter_get_by_name("abuffer");
@@ -146,6 +289,8 @@ static void init_audio_filtergraph( mlt_filter filter, mlt_audio_format format,
 	int ret;
 
 	pdata->format = format;
+	pdata->width = frequency;
+	pdata->height = channels;
 
 	// Set up formats
 	sample_fmts[0] = mlt_to_av_sample_format( format );
@@ -165,10 +310,7 @@ static void init_audio_filtergraph( mlt_filter filter, mlt_audio_format format,
 	}
 
 	// Set thread count if supported.
-	if ( pdata->avfilter->flags & AVFILTER_FLAG_SLICE_THREADS ) {
-		av_opt_set_int( pdata->avfilter_graph, "threads",
-			FFMAX( 0, mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "av.threads" ) ), 0 );
-	}
+	set_graph_threads( filter, pdata->avfilter->flags & AVFILTER_FLAG_SLICE_THREADS );
 
 	// Initialize the buffer source filter context
 	pdata->avbuffsrc_ctx = avfilter_graph_alloc_filter( pdata->avfilter_graph, abuffersrc, "in");
@@ -240,7 +382,7 @@ static void init_audio_filtergraph( mlt_filter filter, mlt_audio_format format,
 		mlt_log_error( filter, "Cannot create audio filter\n" );
 		goto fail;
 	}
-	set_avfilter_options( filter );
+	set_avfilter_options( filter, frame );
 	ret = avfilter_init_str(  pdata->avfilter_ctx, NULL );
 	if( ret < 0 ) {
 		mlt_log_error( filter, "Cannot init filter\n" );
@@ -273,7 +415,7 @@ fail:
 }
 
 
-static void init_image_filtergraph( mlt_filter filter, mlt_image_format format, int width, int height )
+static void init_image_filtergraph( mlt_filter filter, mlt_frame frame, mlt_image_format format, int width, int height )
 {
 	private_data* pdata = (private_data*)filter->child;
 	mlt_profile profile = mlt_service_profile(MLT_FILTER_SERVICE(filter));
@@ -289,6 +431,8 @@ static void init_image_filtergraph( mlt_filter filter, mlt_image_format format,
 	int ret;
 
 	pdata->format = format;
+	pdata->width = width;
+	pdata->height = height;
 
 	// Set up formats
 	pixel_fmts[0] = mlt_to_av_image_format( format );
@@ -303,11 +447,8 @@ static void init_image_filtergraph( mlt_filter filter, mlt_image_format format,
 		goto fail;
 	}
 
-	// Set thread count if supported.
-	if ( pdata->avfilter->flags & AVFILTER_FLAG_SLICE_THREADS ) {
-		av_opt_set_int( pdata->avfilter_graph, "threads",
-			FFMAX( 0, mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "av.threads" ) ), 0 );
-	}
+	// Set thread count if supported, including by the scale filter.
+	set_graph_threads( filter, ( pdata->avfilter->flags | scale->flags ) & AVFILTER_FLAG_SLICE_THREADS );
 
 	// Initialize the buffer source filter context
 	pdata->avbuffsrc_ctx = avfilter_graph_alloc_filter( pdata->avfilter_graph, buffersrc, "in");
@@ -374,7 +515,7 @@ static void init_image_filtergraph( mlt_filter filter, mlt_image_format format,
 		mlt_log_error( filter, "Cannot create video filter\n" );
 		goto fail;
 	}
-	set_avfilter_options( filter );
+	set_avfilter_options( filter, frame );
 
 	if ( !strcmp( "lut3d", pdata->avfilter->name ) ) {
 #if defined(__GLIBC__) || defined(__APPLE__) || (__FreeBSD__)
@@ -545,9 +686,9 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
-	if( pdata->reset || pdata->format != *format )
+	if( need_rebuild( filter, frame, *format, *frequency, *channels ) )
 	{
-		init_audio_filtergraph( filter, *format, *frequency, *channels );
+		init_audio_filtergraph( filter, frame, *format, *frequency, *channels );
 		pdata->reset = 0;
 	}
 
@@ -603,8 +744,17 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 			goto exit;
 		}
 
+		// Use the filter output in place when it is laid out like the original buffer
+		if( !av_sample_fmt_is_planar( pdata->avoutframe->format ) &&
+			pdata->avoutframe->extended_data == pdata->avoutframe->data &&
+			!attach_avframe( MLT_FRAME_PROPERTIES(frame), pdata->avoutframe ) )
+		{
+			AVFrame *avframe = mlt_properties_get_data( MLT_FRAME_PROPERTIES(frame), "_avfilter_frame", NULL );
+			*buffer = avframe->data[0];
+			mlt_frame_set_audio( frame, *buffer, *format, bufsize, NULL );
+		}
 		// Copy the filter output into the original buffer
-		if( av_sample_fmt_is_planar( pdata->avoutframe->format ) )
+		else if( av_sample_fmt_is_planar( pdata->avoutframe->format ) )
 		{
 			int stride = bufsize / *channels;
 			int i = 0;
@@ -645,9 +795,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
-	if( pdata->reset || pdata->format != *format )
+	if( need_rebuild( filter, frame, *format, *width, *height ) )
 	{
-		init_image_filtergraph( filter, *format, *width, *height );
+		init_image_filtergraph( filter, frame, *format, *width, *height );
 		pdata->reset = 0;
 	}
 
@@ -741,8 +891,17 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 			goto exit;
 		}
 
+		// Use the filter output in place when it is laid out like the original buffer
+		if( *format != mlt_image_yuv420p &&
+			pdata->avoutframe->linesize[0] == mlt_image_format_size( *format, *width, 0, NULL ) &&
+			!attach_avframe( frame_properties, pdata->avoutframe ) )
+		{
+			AVFrame *avframe = mlt_properties_get_data( frame_properties, "_avfilter_frame", NULL );
+			*image = avframe->data[0];
+			mlt_frame_set_image( frame, *image, mlt_image_format_size( *format, *width, *height, NULL ), NULL );
+		}
 		// Copy the filter output into the original buffer
-		if( *format == mlt_image_yuv420p )
+		else if( *format == mlt_image_yuv420p )
 		{
 			int i = 0;
 			int p = 0;
@@ -815,6 +974,7 @@ static void filter_close( mlt_filter filter )
 		avfilter_graph_free( &pdata->avfilter_graph );
 		av_frame_free( &pdata->avinframe );
 		av_frame_free( &pdata->avoutframe );
+		mlt_properties_close( pdata->options );
 		free( pdata );
 	}
 	filter->child = NULL;
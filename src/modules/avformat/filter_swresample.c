@@ -27,6 +27,8 @@
 #include <libavutil/opt.h>
 #include <libavutil/samplefmt.h>
 
+#include <string.h>
+
 typedef struct
 {
 	SwrContext* ctx;
@@ -40,8 +42,31 @@ typedef struct
 	int out_channels;
 	mlt_channel_layout in_layout;
 	mlt_channel_layout out_layout;
+	int quality;
 } private_data;
 
+enum
+{
+	quality_medium = 0,
+	quality_fast,
+	quality_best
+};
+
+/** Get the quality of resampling from the filter, or else the consumer.
+*/
+
+static int get_quality( mlt_filter filter, mlt_frame frame )
+{
+	const char *quality = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "quality" );
+	if ( !quality )
+		quality = mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "resample.quality" );
+	if ( quality && !strcmp( quality, "fast" ) )
+		return quality_fast;
+	if ( quality && !strcmp( quality, "best" ) )
+		return quality_best;
+	return quality_medium;
+}
+
 static int audio_plane_count( mlt_audio_format format, int channels )
 {
 	switch ( format )
@@ -124,6 +149,18 @@ static int configure_swr_context( mlt_filter filter )
 	av_opt_set_int( pdata->ctx, "isr", pdata->in_frequency,  0 );
 	av_opt_set_int( pdata->ctx, "ich", pdata->in_channels, 0 );
 
+	// Trade the length of the polyphase filter for speed or quality.
+	if( pdata->quality == quality_fast )
+	{
+		av_opt_set_int( pdata->ctx, "filter_size", 8, 0 );
+		av_opt_set_int( pdata->ctx, "phase_shift", 6, 0 );
+	}
+	else if( pdata->quality == quality_best )
+	{
+		av_opt_set_int( pdata->ctx, "filter_size", 64, 0 );
+		av_opt_set_int( pdata->ctx, "linear_interp", 1, 0 );
+	}
+
 	if( pdata->in_layout != mlt_channel_independent && pdata->out_layout != mlt_channel_independent )
 	{
 		// Use standard channel layout and matrix for known channel configurations.
@@ -227,10 +264,21 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		return error;
 	}
 
+	// Resample from planar float, which is what swresample resamples
+	// natively, so that a change of the upstream sample format does not
+	// reset the state of the resampler.
+	if( in_frequency != out_frequency && in_format != mlt_audio_float && frame->convert_audio &&
+		!frame->convert_audio( frame, buffer, &in_format, mlt_audio_float ) )
+	{
+		in_format = mlt_audio_float;
+	}
+	int quality = get_quality( filter, frame );
+
 	mlt_service_lock( MLT_FILTER_SERVICE(filter) );
 
 	// Detect configuration change
 	if( !pdata->ctx ||
+		pdata->quality != quality ||
 		pdata->in_format != in_format ||
 		pdata->out_format != out_format ||
 		pdata->in_frequency != in_frequency ||
@@ -249,6 +297,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		pdata->out_channels = out_channels;
 		pdata->in_layout = in_layout;
 		pdata->out_layout = out_layout;
+		pdata->quality = quality;
 		// Reconfigure the context
 		error = configure_swr_context( filter );
 	}
@@ -261,7 +310,11 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		if( in_frequency != out_frequency )
 		{
 			// Number of output samples will change if sampling frequency changes.
-			alloc_samples = in_samples * out_frequency / in_frequency;
+			// Include the samples buffered from the previous frame so that they
+			// are all received from swresample and the delay does not grow.
+			alloc_samples = swr_get_out_samples( pdata->ctx, in_samples );
+			if( alloc_samples <= 0 )
+				alloc_samples = in_samples * out_frequency / in_frequency;
 			// Round up to make sure all available samples are received from swresample.
 			alloc_samples += 1;
 		}
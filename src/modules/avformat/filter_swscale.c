@@ -20,19 +20,302 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_factory.h>
+#include <framework/mlt_log.h>
+#include <framework/mlt_slices.h>
 
 
 // ffmpeg Header files
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/frame.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define IMAGE_ALIGN (1)
 
+// Scale in parallel row bands through sws_receive_slice() when available
+#define SLICED_SCALE (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
+
+// The smallest output that is scaled in bands and the fewest rows in a band
+#define SLICED_MIN_PIXELS (1280 * 720)
+#define SLICED_MIN_ROWS (64)
+#define MAX_BANDS (32)
+
+// The most idle scalers kept for reuse
+#define CACHE_SIZE (8)
+
+/** A set of scaling contexts for one geometry, one per row band.
+*/
+
+typedef struct scaler_s *scaler;
+
+struct scaler_s
+{
+	int iwidth, iheight, owidth, oheight, format, flags;
+	int bands;
+	struct SwsContext *contexts[MAX_BANDS];
+	scaler next;
+};
+
+// The idle scalers, most recently used first, shared by the filter instances
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static scaler cache = NULL;
+static int cache_users = 0;
+
+static void scaler_close( scaler self )
+{
+	int i;
+	for ( i = 0; i < self->bands; i++ )
+		sws_freeContext( self->contexts[i] );
+	free( self );
+}
+
+/** Take an idle scaler for a geometry from the cache or create one.
+*/
+
+static scaler scaler_get( int iwidth, int iheight, int owidth, int oheight, int format, int flags, int bands )
+{
+	scaler self = NULL;
+	scaler *prev;
+	int i;
+
+	pthread_mutex_lock( &cache_mutex );
+	for ( prev = &cache; *prev; prev = &( *prev )->next )
+	{
+		scaler s = *prev;
+		if ( s->iwidth == iwidth && s->iheight == iheight && s->owidth == owidth && s->oheight == oheight &&
+			 s->format == format && s->flags == flags && s->bands == bands )
+		{
+			*prev = s->next;
+			self = s;
+			break;
+		}
+	}
+	pthread_mutex_unlock( &cache_mutex );
+
+	if ( !self )
+	{
+		self = calloc( 1, sizeof( struct scaler_s ) );
+		if ( !self )
+			return NULL;
+		self->iwidth = iwidth;
+		self->iheight = iheight;
+		self->owidth = owidth;
+		self->oheight = oheight;
+		self->format = format;
+		self->flags = flags;
+		for ( i = 0; i < bands; i++ )
+		{
+			self->contexts[i] = sws_getContext( iwidth, iheight, format, owidth, oheight, format, flags, NULL, NULL, NULL );
+			if ( !self->contexts[i] )
+			{
+				scaler_close( self );
+				return NULL;
+			}
+			self->bands = i + 1;
+		}
+	}
+	self->next = NULL;
+	return self;
+}
+
+/** Return a scaler to the cache, dropping the least recently used ones.
+*/
+
+static void scaler_put( scaler self )
+{
+	scaler s, drop = NULL;
+	int n = 1;
+
+	pthread_mutex_lock( &cache_mutex );
+	self->next = cache;
+	cache = self;
+	for ( s = cache; s; s = s->next, n++ )
+	{
+		if ( n == CACHE_SIZE )
+		{
+			drop = s->next;
+			s->next = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock( &cache_mutex );
+
+	while ( drop )
+	{
+		s = drop->next;
+		scaler_close( drop );
+		drop = s;
+	}
+}
+
+/** Release the cache when the last filter instance is closed.
+*/
+
+static void cache_release( void *unused )
+{
+	scaler drop = NULL;
+
+	pthread_mutex_lock( &cache_mutex );
+	if ( --cache_users == 0 )
+	{
+		drop = cache;
+		cache = NULL;
+	}
+	pthread_mutex_unlock( &cache_mutex );
+
+	while ( drop )
+	{
+		scaler s = drop->next;
+		scaler_close( drop );
+		drop = s;
+	}
+}
+
+#if SLICED_SCALE
+struct sliced_scale_t
+{
+	scaler scaler;
+	AVFrame *src, *dst;
+	int rows;
+};
+
+static void no_free( void *opaque, uint8_t *data )
+{
+}
+
+// Wrap an image that belongs to the frame in an AVFrame without copying it
+static AVFrame *wrap_image( uint8_t *data[4], int stride[4], int size, int format, int width, int height )
+{
+	AVFrame *frame = av_frame_alloc();
+	int i;
+
+	if ( frame )
+	{
+		frame->format = format;
+		frame->width = width;
+		frame->height = height;
+		for ( i = 0; i < 4; i++ )
+		{
+			frame->data[i] = data[i];
+			frame->linesize[i] = stride[i];
+		}
+		frame->buf[0] = av_buffer_create( data[0], size, no_free, NULL, 0 );
+		if ( !frame->buf[0] )
+			av_frame_free( &frame );
+	}
+	return frame;
+}
+
+static int sliced_scale_proc( int id, int index, int jobs, void *cookie )
+{
+	struct sliced_scale_t *ctx = cookie;
+	struct SwsContext *context = ctx->scaler->contexts[index];
+	int start = ctx->rows * index;
+	int height = FFMIN( ctx->rows, ctx->scaler->oheight - start );
+
+	if ( height > 0 && sws_frame_start( context, ctx->dst, ctx->src ) >= 0 )
+	{
+		if ( sws_send_slice( context, 0, ctx->scaler->iheight ) >= 0 )
+			sws_receive_slice( context, start, height );
+		sws_frame_end( context );
+	}
+	return 0;
+}
+
+/** Scale an image in row bands on the slice threads.
+*/
+
+static int sliced_scale( scaler self, uint8_t *in_data[4], int in_stride[4], int in_size, uint8_t *out_data[4], int out_stride[4], int out_size )
+{
+	unsigned align = sws_receive_slice_alignment( self->contexts[0] );
+	struct sliced_scale_t ctx =
+	{
+		.scaler = self,
+		.src = wrap_image( in_data, in_stride, in_size, self->format, self->iwidth, self->iheight ),
+		.dst = wrap_image( out_data, out_stride, out_size, self->format, self->owidth, self->oheight ),
+		.rows = ( self->oheight + self->bands - 1 ) / self->bands,
+	};
+	int error = !ctx.src || !ctx.dst;
+
+	ctx.rows = ( ctx.rows + align - 1 ) / align * align;
+	if ( !error )
+		mlt_slices_run_normal( self->bands, sliced_scale_proc, &ctx );
+	av_frame_free( &ctx.src );
+	av_frame_free( &ctx.dst );
+	return error;
+}
+#endif
+
+/** Determine the number of row bands for scaling an image.
+*/
+
+static int scale_bands( int owidth, int oheight )
+{
+	int bands = 1;
+#if SLICED_SCALE
+	if ( owidth * oheight >= SLICED_MIN_PIXELS && !getenv( "MLT_SWSCALE_SLICED_DISABLE" ) )
+	{
+		bands = FFMIN( mlt_slices_count_normal(), oheight / SLICED_MIN_ROWS );
+		bands = FFMAX( 1, FFMIN( bands, MAX_BANDS ) );
+	}
+#endif
+	return bands;
+}
+
+/** Scale an image with a cached scaler.
+*/
+
+static int scale_image( int iwidth, int iheight, int owidth, int oheight, int format, int flags,
+	uint8_t *in_data[4], int in_stride[4], int in_size, uint8_t *out_data[4], int out_stride[4], int out_size )
+{
+	int bands = scale_bands( owidth, oheight );
+	scaler self = scaler_get( iwidth, iheight, owidth, oheight, format, flags, bands );
+	int error = 0;
+
+	if ( !self && bands > 1 )
+		self = scaler_get( iwidth, iheight, owidth, oheight, format, flags, bands = 1 );
+	if ( !self )
+		return 1;
+#if SLICED_SCALE
+	if ( bands > 1 )
+		error = sliced_scale( self, in_data, in_stride, in_size, out_data, out_stride, out_size );
+	else
+#endif
+	sws_scale( self->contexts[0], (const uint8_t **) in_data, in_stride, 0, iheight, out_data, out_stride );
+	scaler_put( self );
+	return error;
+}
+
+/** Scale an interlaced image a field at a time, so that the lines of the fields do not mix.
+*/
+
+static int scale_fields( int iwidth, int iheight, int owidth, int oheight, int format, int flags,
+	uint8_t *in_data[4], int in_stride[4], int in_size, uint8_t *out_data[4], int out_stride[4], int out_size )
+{
+	int error = 0;
+	int field;
+
+	for ( field = 0; field < 2 && !error; field++ )
+	{
+		uint8_t *in_field[4], *out_field[4];
+		int in_field_stride[4], out_field_stride[4];
+
+		memcpy( in_field, in_data, sizeof( in_field ) );
+		memcpy( in_field_stride, in_stride, sizeof( in_field_stride ) );
+		memcpy( out_field, out_data, sizeof( out_field ) );
+		memcpy( out_field_stride, out_stride, sizeof( out_field_stride ) );
+		error = scale_image( iwidth, mlt_image_field_planes( field, iheight, in_field, in_field_stride ),
+			owidth, mlt_image_field_planes( field, oheight, out_field, out_field_stride ), format, flags,
+			in_field, in_field_stride, in_size, out_field, out_field_stride, out_size );
+	}
+	return error;
+}
+
 static inline int convert_mlt_to_av_cs( mlt_image_format format )
 {
 	int value = 0;
@@ -52,6 +335,15 @@ static inline int convert_mlt_to_av_cs( mlt_image_format format )
 		case mlt_image_yuv420p:
 			value = AV_PIX_FMT_YUV420P;
 			break;
+		case mlt_image_yuv420p10:
+			value = AV_PIX_FMT_YUV420P10LE;
+			break;
+		case mlt_image_yuv444p16:
+			value = AV_PIX_FMT_YUV444P16LE;
+			break;
+		case mlt_image_rgba64:
+			value = AV_PIX_FMT_RGBA64LE;
+			break;
 		default:
 			fprintf( stderr, "Invalid format...\n" );
 			break;
@@ -101,9 +393,12 @@ static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *for
 		case mlt_image_rgb24:
 		case mlt_image_rgb24a:
 		case mlt_image_opengl:
+		case mlt_image_rgba64:
+		case mlt_image_yuv420p10:
+		case mlt_image_yuv444p16:
 			break;
 		default:
-			// XXX: we only know how to rescale packed formats
+			// XXX: we only know how to rescale packed formats and the high bit depth planar ones
 			return 1;
 	}
 
@@ -117,51 +412,53 @@ static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *for
 	int out_stride[4];
 	uint8_t *outbuf = mlt_pool_alloc( out_size );
 
-	av_image_fill_arrays(in_data, in_stride, *image, avformat, iwidth, iheight, IMAGE_ALIGN);
-	av_image_fill_arrays(out_data, out_stride, outbuf, avformat, owidth, oheight, IMAGE_ALIGN);
+	// The input may be a view
+	mlt_frame_get_image_planes( frame, in_data, in_stride );
+	if ( *format == mlt_image_yuv420p10 || *format == mlt_image_yuv444p16 )
+		mlt_image_format_planes( *format, owidth, oheight, outbuf, out_data, out_stride );
+	else
+		av_image_fill_arrays(out_data, out_stride, outbuf, avformat, owidth, oheight, IMAGE_ALIGN);
 
-	// Create the context and output image
-	struct SwsContext *context = sws_getContext( iwidth, iheight, avformat, owidth, oheight, avformat, interp, NULL, NULL, NULL);
-	if ( context )
+	// Perform the scaling, a field at a time when the rescale filter asks for it.
+	// The chroma lines of 4:2:0 only split evenly between the fields in pairs.
+	int in_size = mlt_image_format_size( *format, iwidth, iheight, NULL );
+	int fields = mlt_properties_get_int( properties, "rescale.fields" ) &&
+		( *format != mlt_image_yuv420p10 || ( iheight % 4 == 0 && oheight % 4 == 0 ) );
+	if ( !( fields ? scale_fields : scale_image )( iwidth, iheight, owidth, oheight, avformat, interp, in_data, in_stride, in_size, out_data, out_stride, out_size ) )
 	{
-		// Perform the scaling
-		sws_scale( context, (const uint8_t **) in_data, in_stride, 0, iheight, out_data, out_stride);
-		sws_freeContext( context );
-	
 		// Now update the frame
 		mlt_frame_set_image( frame, outbuf, out_size, mlt_pool_release );
-	
+
 		// Return the output
 		*image = outbuf;
-	
+
 		// Scale the alpha channel only if exists and not correct size
 		int alpha_size = 0;
 		mlt_properties_get_data( properties, "alpha", &alpha_size );
 		if ( alpha_size > 0 && alpha_size != ( owidth * oheight ) )
 		{
-			// Create the context and output image
+			// Create the output image
 			uint8_t *alpha = mlt_frame_get_alpha( frame );
 			if ( alpha )
 			{
 				avformat = AV_PIX_FMT_GRAY8;
-				struct SwsContext *context = sws_getContext( iwidth, iheight, avformat, owidth, oheight, avformat, interp, NULL, NULL, NULL);
 				outbuf = mlt_pool_alloc( owidth * oheight );
 				av_image_fill_arrays(in_data, in_stride, alpha, avformat, iwidth, iheight, IMAGE_ALIGN);
 				av_image_fill_arrays(out_data, out_stride, outbuf, avformat, owidth, oheight, IMAGE_ALIGN);
-	
-				// Perform the scaling
-				sws_scale( context, (const uint8_t **) in_data, in_stride, 0, iheight, out_data, out_stride);
-				sws_freeContext( context );
-	
-				// Set it back on the frame
-				mlt_frame_set_alpha( frame, outbuf, owidth * oheight, mlt_pool_release );
+
+				// Perform the scaling and set it back on the frame
+				if ( !( fields ? scale_fields : scale_image )( iwidth, iheight, owidth, oheight, avformat, interp, in_data, in_stride, iwidth * iheight, out_data, out_stride, owidth * oheight ) )
+					mlt_frame_set_alpha( frame, outbuf, owidth * oheight, mlt_pool_release );
+				else
+					mlt_pool_release( outbuf );
 			}
 		}
-	
+
 		return 0;
 	}
 	else
 	{
+		mlt_pool_release( outbuf );
 		return 1;
 	}
 }
@@ -198,6 +495,14 @@ mlt_filter filter_swscale_init( mlt_profile profile, void *arg )
 
 		// Set the method
 		mlt_properties_set_data( properties, "method", filter_scale, 0, NULL, NULL );
+		mlt_properties_set_int( properties, "_views", 1 );
+		mlt_properties_set_int( properties, "_fields", 1 );
+
+		// Share the cache of scaling contexts until the last instance is closed
+		pthread_mutex_lock( &cache_mutex );
+		cache_users++;
+		pthread_mutex_unlock( &cache_mutex );
+		mlt_properties_set_data( properties, "_swscale_cache", &cache, 0, cache_release, NULL );
 	}
 
 	return filter;
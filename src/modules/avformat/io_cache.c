@@ -0,0 +1,520 @@
+/*
+ * io_cache.c -- read ahead file input shared by the producers of a file
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Instead of the many small reads of the file protocol of libavformat, the
+// file is read in large blocks into a cache that all the producers opening
+// the same file share. A thread reads the blocks after those read in order
+// before they are asked for, which keeps network shares and disk arrays
+// streaming when several clips play at once.
+
+#include "io_cache.h"
+
+#include <framework/mlt_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// The size of the buffer of the I/O context that the blocks are copied to
+#define IO_BUFFER_SIZE ( 64 * 1024 )
+#define IO_READAHEAD 4
+#define IO_QUEUE_SIZE 64
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(57, 80, 100)
+#define avio_context_free av_freep
+#endif
+
+typedef struct
+{
+	int64_t index;    ///< the block of the file, or -1 if empty
+	int length;       ///< the bytes read, less than the block size at the end of the file
+	int loading;      ///< set while the block is being read
+	int64_t used;     ///< when it was last used, for eviction
+	uint8_t *data;
+} io_block;
+
+typedef struct io_file_s *io_file;
+
+struct io_file_s
+{
+	io_file next;
+	char *key;
+	int fd;
+	int64_t size;
+	int block_size;
+	int block_count;
+	io_block *blocks;
+	int64_t tick;
+	int references;
+	int64_t bytes_read;     ///< read from the file for all its readers
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	// The blocks wanted by the readers before they ask for them
+	pthread_t thread;
+	int thread_started;
+	int stop;
+	int64_t queue[ IO_QUEUE_SIZE ];
+	int queue_head;
+	int queue_count;
+};
+
+typedef struct
+{
+	io_file file;
+	int64_t position;
+	int64_t last_block;
+	int readahead;
+	int64_t wait_time;      ///< microseconds spent waiting for the file
+} io_reader;
+
+static io_file files = NULL;
+static pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( int64_t ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Read as much of a block as the file has, or return -1.
+static int read_block( io_file file, uint8_t *data, int64_t index )
+{
+	int64_t offset = index * file->block_size;
+	int length = 0;
+
+	while ( length < file->block_size )
+	{
+		ssize_t n = pread( file->fd, data + length, file->block_size - length, offset + length );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n < 0 )
+			return -1;
+		if ( n == 0 )
+			break;
+		length += n;
+	}
+	return length;
+}
+
+/** Get a block of a file into the cache, reading it if no one else is.
+ *
+ * Called with the mutex held, which is released while reading.
+ * \param wait_time where to add the time spent waiting for the file, or NULL
+ * \return the block or NULL if it could not be read
+ */
+
+static io_block *get_block( io_file file, int64_t index, int64_t *wait_time )
+{
+	while ( 1 )
+	{
+		io_block *block = NULL;
+		io_block *victim = NULL;
+		int i;
+
+		for ( i = 0; i < file->block_count; i++ )
+		{
+			io_block *b = &file->blocks[i];
+			if ( b->index == index )
+				block = b;
+			else if ( !b->loading && ( !victim || b->used < victim->used ) )
+				victim = b;
+		}
+		if ( block && !block->loading )
+		{
+			block->used = ++file->tick;
+			return block;
+		}
+		if ( block || !victim )
+		{
+			// Another thread is reading it, or all the blocks are being read
+			int64_t start = now();
+			pthread_cond_wait( &file->cond, &file->mutex );
+			if ( wait_time )
+				*wait_time += now() - start;
+			continue;
+		}
+
+		victim->index = index;
+		victim->loading = 1;
+		pthread_mutex_unlock( &file->mutex );
+		int64_t start = now();
+		int length = read_block( file, victim->data, index );
+		int64_t elapsed = now() - start;
+		pthread_mutex_lock( &file->mutex );
+		if ( wait_time )
+			*wait_time += elapsed;
+		victim->loading = 0;
+		pthread_cond_broadcast( &file->cond );
+		if ( length < 0 )
+		{
+			victim->index = -1;
+			return NULL;
+		}
+		victim->length = length;
+		victim->used = ++file->tick;
+		file->bytes_read += length;
+		return victim;
+	}
+}
+
+static int is_cached( io_file file, int64_t index )
+{
+	int i;
+	for ( i = 0; i < file->block_count; i++ )
+		if ( file->blocks[i].index == index )
+			return 1;
+	return 0;
+}
+
+static void *readahead_thread( void *arg )
+{
+	io_file file = arg;
+
+	pthread_mutex_lock( &file->mutex );
+	while ( !file->stop )
+	{
+		if ( !file->queue_count )
+		{
+			pthread_cond_wait( &file->cond, &file->mutex );
+			continue;
+		}
+		int64_t index = file->queue[ file->queue_head ];
+		file->queue_head = ( file->queue_head + 1 ) % IO_QUEUE_SIZE;
+		file->queue_count--;
+		if ( !is_cached( file, index ) )
+			get_block( file, index, NULL );
+	}
+	pthread_mutex_unlock( &file->mutex );
+	return NULL;
+}
+
+// Ask for the blocks after one read in order, with the mutex held.
+static void request_readahead( io_file file, int64_t index, int count )
+{
+	int64_t last = ( file->size - 1 ) / file->block_size;
+	int64_t i;
+
+	if ( !file->thread_started )
+	{
+		file->thread_started = !pthread_create( &file->thread, NULL, readahead_thread, file );
+		if ( !file->thread_started )
+			return;
+	}
+	for ( i = index + 1; i <= index + count && i <= last; i++ )
+	{
+		int j, queued = 0;
+		for ( j = 0; j < file->queue_count && !queued; j++ )
+			queued = file->queue[ ( file->queue_head + j ) % IO_QUEUE_SIZE ] == i;
+		if ( queued || is_cached( file, i ) )
+			continue;
+		if ( file->queue_count == IO_QUEUE_SIZE )
+		{
+			// Drop the oldest request, which is the least likely to be still wanted
+			file->queue_head = ( file->queue_head + 1 ) % IO_QUEUE_SIZE;
+			file->queue_count--;
+		}
+		file->queue[ ( file->queue_head + file->queue_count++ ) % IO_QUEUE_SIZE ] = i;
+#ifdef POSIX_FADV_WILLNEED
+		posix_fadvise( file->fd, i * file->block_size, file->block_size, POSIX_FADV_WILLNEED );
+#endif
+	}
+	pthread_cond_broadcast( &file->cond );
+}
+
+static void file_release( io_file file )
+{
+	io_file *p;
+	int i;
+
+	pthread_mutex_lock( &files_mutex );
+	if ( --file->references > 0 )
+	{
+		pthread_mutex_unlock( &files_mutex );
+		return;
+	}
+	for ( p = &files; *p; p = &( *p )->next )
+	{
+		if ( *p == file )
+		{
+			*p = file->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock( &files_mutex );
+
+	if ( file->thread_started )
+	{
+		pthread_mutex_lock( &file->mutex );
+		file->stop = 1;
+		pthread_cond_broadcast( &file->cond );
+		pthread_mutex_unlock( &file->mutex );
+		pthread_join( file->thread, NULL );
+	}
+	for ( i = 0; i < file->block_count; i++ )
+		free( file->blocks[i].data );
+	free( file->blocks );
+	if ( file->fd >= 0 )
+		close( file->fd );
+	pthread_mutex_destroy( &file->mutex );
+	pthread_cond_destroy( &file->cond );
+	free( file->key );
+	free( file );
+}
+
+/** Get the shared cache of a file, opening it with the first reader.
+ *
+ * The cache is keyed by the device, inode, size and modification time, so a
+ * file rewritten in place is opened again.
+ */
+
+static io_file file_acquire( const char *filename, const struct stat *st, int block_size, int block_count )
+{
+	char key[ 128 ];
+	io_file file;
+	int i;
+
+	snprintf( key, sizeof( key ), "%llu:%llu:%lld:%lld", ( unsigned long long ) st->st_dev,
+		( unsigned long long ) st->st_ino, ( long long ) st->st_size, ( long long ) st->st_mtime );
+
+	pthread_mutex_lock( &files_mutex );
+	for ( file = files; file; file = file->next )
+	{
+		if ( !strcmp( file->key, key ) )
+		{
+			file->references++;
+			pthread_mutex_unlock( &files_mutex );
+			return file;
+		}
+	}
+
+	file = calloc( 1, sizeof( *file ) );
+	if ( file )
+	{
+		file->fd = open( filename, O_RDONLY );
+		file->key = strdup( key );
+		file->size = st->st_size;
+		file->block_size = block_size;
+		file->block_count = block_count;
+		file->blocks = calloc( block_count, sizeof( io_block ) );
+		for ( i = 0; file->blocks && i < block_count; i++ )
+		{
+			file->blocks[i].index = -1;
+			if ( !( file->blocks[i].data = malloc( block_size ) ) )
+				break;
+		}
+		if ( file->fd < 0 || !file->key || !file->blocks || i < block_count )
+		{
+			// file_release() cleans up after a file not in the list
+			pthread_mutex_unlock( &files_mutex );
+			file->block_count = file->blocks ? i : 0;
+			pthread_mutex_init( &file->mutex, NULL );
+			pthread_cond_init( &file->cond, NULL );
+			file->references = 1;
+			file_release( file );
+			return NULL;
+		}
+		pthread_mutex_init( &file->mutex, NULL );
+		pthread_cond_init( &file->cond, NULL );
+		file->references = 1;
+		file->next = files;
+		files = file;
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise( file->fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+		mlt_log_verbose( NULL, "[producer avformat] I/O cache of %d x %d KiB for %s\n",
+			block_count, block_size / 1024, filename );
+	}
+	pthread_mutex_unlock( &files_mutex );
+	return file;
+}
+
+static int io_read( void *opaque, uint8_t *buf, int buf_size )
+{
+	io_reader *reader = opaque;
+	io_file file = reader->file;
+	int result = 0;
+
+	if ( reader->position >= file->size )
+		return AVERROR_EOF;
+
+	pthread_mutex_lock( &file->mutex );
+	while ( result < buf_size && reader->position < file->size )
+	{
+		int64_t index = reader->position / file->block_size;
+		io_block *block = get_block( file, index, &reader->wait_time );
+		if ( !block )
+			break;
+
+		int offset = reader->position - index * file->block_size;
+		int length = FFMIN( block->length - offset, buf_size - result );
+		if ( length <= 0 )
+			break;
+		memcpy( buf + result, block->data + offset, length );
+		result += length;
+		reader->position += length;
+
+		// Read the following blocks while the file is read in order
+		if ( index != reader->last_block && ( index == reader->last_block + 1 || index == 0 ) )
+			request_readahead( file, index, reader->readahead );
+		reader->last_block = index;
+	}
+	pthread_mutex_unlock( &file->mutex );
+
+	return result > 0 ? result : AVERROR( EIO );
+}
+
+static int64_t io_seek( void *opaque, int64_t offset, int whence )
+{
+	io_reader *reader = opaque;
+
+	switch ( whence & ~AVSEEK_FORCE )
+	{
+	case AVSEEK_SIZE:
+		return reader->file->size;
+	case SEEK_SET:
+		break;
+	case SEEK_CUR:
+		offset += reader->position;
+		break;
+	case SEEK_END:
+		offset += reader->file->size;
+		break;
+	default:
+		return AVERROR( EINVAL );
+	}
+	if ( offset < 0 )
+		return AVERROR( EINVAL );
+	reader->position = offset;
+	return offset;
+}
+
+// Get the block size in KiB from the io_buffer property or $MLT_AVFORMAT_IO_BUFFER.
+static int block_size_kib( mlt_properties properties )
+{
+	if ( mlt_properties_get( properties, "io_buffer" ) )
+		return mlt_properties_get_int( properties, "io_buffer" );
+	return getenv( "MLT_AVFORMAT_IO_BUFFER" ) ? atoi( getenv( "MLT_AVFORMAT_IO_BUFFER" ) ) : 0;
+}
+
+/** Open an input like avformat_open_input(), reading a local file through the cache.
+ *
+ * The cache is used when the io_buffer property or $MLT_AVFORMAT_IO_BUFFER
+ * gives the size of its blocks in KiB. Other URLs and unreadable
+ * files are left to the protocols of libavformat.
+ */
+
+int io_cache_open_input( AVFormatContext **context, const char *filename, AVInputFormat *format,
+	AVDictionary **options, mlt_properties properties )
+{
+	int kib = block_size_kib( properties );
+	const char *path = filename;
+	struct stat st;
+
+	if ( path && !strncmp( path, "file:", 5 ) )
+		path += 5;
+	if ( kib <= 0 || !path || stat( path, &st ) || !S_ISREG( st.st_mode ) || st.st_size <= 0 )
+		return avformat_open_input( context, filename, format, options );
+
+	int readahead = mlt_properties_get( properties, "io_readahead" ) ?
+		mlt_properties_get_int( properties, "io_readahead" ) : IO_READAHEAD;
+	int block_count = mlt_properties_get_int( properties, "io_cache" );
+	readahead = FFMAX( readahead, 0 );
+	block_count = FFMAX( block_count, 2 * readahead + 2 );
+
+	io_file file = file_acquire( path, &st, kib * 1024, block_count );
+	io_reader *reader = file ? calloc( 1, sizeof( *reader ) ) : NULL;
+	uint8_t *buffer = reader ? av_malloc( IO_BUFFER_SIZE ) : NULL;
+	AVIOContext *pb = buffer ? avio_alloc_context( buffer, IO_BUFFER_SIZE, 0, reader, io_read, NULL, io_seek ) : NULL;
+
+	if ( !*context )
+		*context = avformat_alloc_context();
+	if ( !pb || !*context )
+	{
+		av_free( buffer );
+		free( reader );
+		if ( file )
+			file_release( file );
+		return avformat_open_input( context, filename, format, options );
+	}
+	reader->file = file;
+	reader->last_block = -1;
+	reader->readahead = readahead;
+	pb->seekable = AVIO_SEEKABLE_NORMAL;
+	( *context )->pb = pb;
+	( *context )->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	int error = avformat_open_input( context, filename, format, options );
+	if ( error < 0 )
+	{
+		// libavformat frees the context but leaves the custom I/O context to us
+		av_freep( &pb->buffer );
+		avio_context_free( &pb );
+		free( reader );
+		file_release( file );
+	}
+	return error;
+}
+
+/** Close an input like avformat_close_input(), with the cache if it has one.
+ */
+
+void io_cache_close_input( AVFormatContext **context )
+{
+	AVIOContext *pb = NULL;
+
+	if ( *context && ( ( *context )->flags & AVFMT_FLAG_CUSTOM_IO ) )
+		pb = ( *context )->pb;
+	avformat_close_input( context );
+	if ( pb )
+	{
+		io_reader *reader = pb->opaque;
+		mlt_log_debug( NULL, "[producer avformat] I/O waited %lld us\n", ( long long ) reader->wait_time );
+		av_freep( &pb->buffer );
+		avio_context_free( &pb );
+		file_release( reader->file );
+		free( reader );
+	}
+}
+
+/** Get the counters of an input opened through the cache.
+ *
+ * \param[out] bytes_read the bytes read from the file for all the producers sharing it
+ * \param[out] wait_time the microseconds this input waited for the file
+ * \return true if the input does not use the cache
+ */
+
+int io_cache_stats( AVFormatContext *context, int64_t *bytes_read, int64_t *wait_time )
+{
+	if ( !context || !( context->flags & AVFMT_FLAG_CUSTOM_IO ) || !context->pb )
+		return 1;
+	io_reader *reader = context->pb->opaque;
+	pthread_mutex_lock( &reader->file->mutex );
+	*bytes_read = reader->file->bytes_read;
+	*wait_time = reader->wait_time;
+	pthread_mutex_unlock( &reader->file->mutex );
+	return 0;
+}
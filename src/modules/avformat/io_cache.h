@@ -0,0 +1,31 @@
+/*
+ * io_cache.h -- read ahead file input shared by the producers of a file
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef IO_CACHE_H
+#define IO_CACHE_H
+
+#include <framework/mlt_properties.h>
+#include <libavformat/avformat.h>
+
+int io_cache_open_input( AVFormatContext **context, const char *filename, AVInputFormat *format,
+	AVDictionary **options, mlt_properties properties );
+void io_cache_close_input( AVFormatContext **context );
+int io_cache_stats( AVFormatContext *context, int64_t *bytes_read, int64_t *wait_time );
+
+#endif // IO_CACHE_H
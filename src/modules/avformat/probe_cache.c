@@ -0,0 +1,125 @@
+/*
+ * probe_cache.c -- cache of media probe results for producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "probe_cache.h"
+#include "common.h"
+
+#include <framework/mlt_log.h>
+#include <framework/mlt_sidecar.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROBE_CACHE_MAGIC "MLTPRB1"
+
+// Get the parameters of the record, the frame rate the results were computed with.
+static void probe_params( char *params, size_t size, double fps )
+{
+	snprintf( params, size, "%.17g", fps );
+}
+
+/** Load the probe results saved by probe_cache_save().
+ *
+ * \param fps the frame rate the results were computed with
+ * \return the properties or NULL if there are none for the current version of the file
+ */
+
+mlt_properties probe_cache_load( const char *resource, double fps )
+{
+	char params[ 32 ];
+	mlt_sidecar record;
+	const char *data, *end;
+	size_t size = 0;
+	mlt_properties self = NULL;
+
+	probe_params( params, sizeof( params ), fps );
+	record = mlt_sidecar_open( resource, "probe", params );
+	data = mlt_sidecar_data( record, &size );
+	end = data ? data + size : NULL;
+	if ( data && size > 8 && !memcmp( data, PROBE_CACHE_MAGIC, 8 ) && end[ -1 ] == '\0'
+		 && ( self = mlt_properties_new( ) ) )
+	{
+		// The names and values follow each other, each terminated by a null character
+		const char *name = data + 8;
+		int error = 0;
+		while ( !error && name < end )
+		{
+			const char *value = name + strlen( name ) + 1;
+			if ( value < end )
+				mlt_properties_set( self, name, value );
+			else
+				error = 1;
+			name = value + strlen( value ) + 1;
+		}
+		if ( error || !mlt_properties_count( self ) )
+		{
+			mlt_properties_close( self );
+			self = NULL;
+		}
+		if ( self )
+			mlt_log_verbose( NULL, "[producer avformat] loaded probe cache of %s\n", resource );
+	}
+	mlt_sidecar_close( record );
+	return self;
+}
+
+/** Save the probe results in the sidecar store.
+ *
+ * \param fps the frame rate the results were computed with
+ * \return true on error
+ */
+
+int probe_cache_save( mlt_properties probe, const char *resource, double fps )
+{
+	char params[ 32 ];
+	size_t size = 8;
+	char *data, *p;
+	int i, error = 1;
+
+	probe_params( params, sizeof( params ), fps );
+	for ( i = 0; i < mlt_properties_count( probe ); i++ )
+	{
+		char *value = mlt_properties_get_value( probe, i );
+		if ( value )
+			size += strlen( mlt_properties_get_name( probe, i ) ) + strlen( value ) + 2;
+	}
+	data = malloc( size );
+	if ( data )
+	{
+		memcpy( data, PROBE_CACHE_MAGIC, 8 );
+		for ( i = 0, p = data + 8; i < mlt_properties_count( probe ); i++ )
+		{
+			char *name = mlt_properties_get_name( probe, i );
+			char *value = mlt_properties_get_value( probe, i );
+			if ( value )
+			{
+				memcpy( p, name, strlen( name ) + 1 );
+				p += strlen( name ) + 1;
+				memcpy( p, value, strlen( value ) + 1 );
+				p += strlen( value ) + 1;
+			}
+		}
+		error = mlt_sidecar_store( resource, "probe", params, data, size );
+	}
+	if ( error )
+		mlt_log_warning( NULL, "[producer avformat] failed to save the probe cache of %s\n", resource );
+	free( data );
+	return error;
+}
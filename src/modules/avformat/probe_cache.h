@@ -0,0 +1,28 @@
+/*
+ * probe_cache.h -- cache of media probe results for producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef PROBE_CACHE_H
+#define PROBE_CACHE_H
+
+#include <framework/mlt_properties.h>
+
+mlt_properties probe_cache_load( const char *resource, double fps );
+int probe_cache_save( mlt_properties probe, const char *resource, double fps );
+
+#endif // PROBE_CACHE_H
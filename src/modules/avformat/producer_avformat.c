@@ -28,6 +28,11 @@
 #include <framework/mlt_factory.h>
 #include <framework/mlt_cache.h>
 #include <framework/mlt_slices.h>
+#include <framework/mlt_job.h>
+#include "seek_index.h"
+#include "probe_cache.h"
+#include "io_cache.h"
+#include "proxy.h"
 
 // ffmpeg Header files
 #include <libavformat/avformat.h>
@@ -39,11 +44,18 @@
 #include <libavutil/channel_layout.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/version.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
 
 #ifdef VDPAU
 #  include <libavcodec/vdpau.h>
 #endif
 
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 0, 0)
+#  define HWACCEL
+#  include <libavutil/hwcontext.h>
+#endif
+
 #ifdef AVFILTER
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
@@ -57,6 +69,8 @@
 #include <limits.h>
 #include <math.h>
 #include <wchar.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #define POSITION_INITIAL (-2)
 #define POSITION_INVALID (-1)
@@ -66,6 +80,10 @@
 #define MAX_AUDIO_FRAME_SIZE (192000) // 1 second of 48khz 32bit audio
 #define IMAGE_ALIGN (1)
 #define VFR_THRESHOLD (3) // The minimum number of video frames with differing durations to be considered VFR.
+#define DECODER_IDLE_TIME (2000000) // Microseconds without decoding after which a producer does not count against the thread budget.
+#define LIVE_LATENCY (300) // The default milliseconds buffered from a live network source.
+#define MAX_DECODERS (16)
+#define DECODER_RANGE (25) // The frames of a block given to one decoder of a pool without a keyframe index.
 
 struct producer_avformat_s
 {
@@ -93,6 +111,7 @@ struct producer_avformat_s
 	size_t audio_buffer_size[ MAX_AUDIO_STREAMS ];
 	uint8_t *decode_buffer[ MAX_AUDIO_STREAMS ];
 	int audio_used[ MAX_AUDIO_STREAMS ];
+	int audio_offset[ MAX_AUDIO_STREAMS ]; // the first unused sample in audio_buffer
 	int audio_streams;
 	int audio_max_stream;
 	int total_channels;
@@ -134,9 +153,93 @@ struct producer_avformat_s
 	AVFilterGraph *vfilter_graph;
 	AVFilterContext *vfilter_in;
 	AVFilterContext* vfilter_out;
+#endif
+#ifdef HWACCEL
+	struct
+	{
+		AVBufferRef *device_ctx;
+		enum AVPixelFormat pix_fmt;
+	} hwaccel;
 #endif
 	int autorotate;
 	int is_audio_synchronizing;
+	struct producer_avformat_s *budget_next;
+	int64_t budget_active_at;
+	int budget_threads;        // threads assigned from the decoder budget, 0 if set explicitly
+	int64_t decode_time;       // total microseconds spent decoding video
+	int64_t decode_count;
+	struct
+	{
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int started;
+		int stop;
+		mlt_position last;     // the last position requested from outside
+		int sequential;        // the number of consecutive requests in order
+		int reverse;           // the number of consecutive requests in reverse order
+		mlt_position next;     // the next position to decode ahead
+		mlt_position end;      // the last position to decode ahead
+		mlt_position low;      // the first position of the last block decoded for reverse play
+		mlt_position done;     // the last position of that block decoded so far
+		mlt_image_format format;
+		int width;
+		int height;
+		char interp[ 32 ];
+	} prefetch;
+	struct
+	{
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int started;
+		int stop;
+		mlt_position last;     // the last position requested from outside
+		int sequential;        // the number of consecutive requests in order
+		mlt_position next;     // the next position to decode ahead
+		mlt_position end;      // the last position to decode ahead
+		double fps;
+		int frequency;
+		int channels;
+	} audio_prefetch;
+	mlt_cache audio_cache;     // the audio decoded ahead, or NULL
+	seek_index seek_index;     // set once the keyframe index is loaded or built
+	mlt_job index_job;         // builds the seek index in the background, or NULL
+	mlt_job proxy_job;         // builds the proxy in the background, or NULL
+	char *proxy_file;          // set once the proxy is complete
+	mlt_producer proxy_producer;
+	mlt_properties probe;      // the results of probing the file kept in the probe cache, or NULL
+	struct
+	{
+		pthread_mutex_t mutex;
+		int count;             // the decoders in the pool, the first of which is this one
+		struct producer_avformat_s *decoders[ MAX_DECODERS ];
+		mlt_position block[ MAX_DECODERS ];  // the block of frames each one was given last
+		int busy[ MAX_DECODERS ];             // the frames each one is decoding
+	} pool;
+	int pool_member;           // whether this is an extra decoder of the pool of another one
+	struct
+	{
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int started;
+		volatile int stop;     // also interrupts a blocking read
+		int enabled;           // whether packets are demuxed ahead into a jitter buffer
+		int error;             // the read error that ended the thread, or 0
+		AVFormatContext *context;
+		mlt_deque packets;     // the packets demuxed ahead
+		int64_t head;          // the time of the newest packet in microseconds
+		int64_t tail;          // the time of the last packet taken in microseconds
+		double level;          // the smoothed time buffered in microseconds
+		int64_t latency;       // the time to keep buffered in microseconds
+		int64_t adjusted_at;   // when the clock was last adjusted
+		int64_t reported_at;   // when the properties were last updated
+		int primed;            // whether the buffer was filled initially
+		int dropped;           // the frames skipped to reduce the latency
+		int repeated;          // the frames repeated to build up the buffer
+		int overflow;          // the packets discarded because the buffer was full
+	} live;
 };
 typedef struct producer_avformat_s *producer_avformat;
 
@@ -153,6 +256,16 @@ static int video_codec_init( producer_avformat self, int index, mlt_properties p
 static void get_audio_streams_info( producer_avformat self );
 static mlt_audio_format pick_audio_format( int sample_fmt );
 static int pick_av_pixel_format( int *pix_fmt );
+static void prefetch_request( producer_avformat self, mlt_frame frame, mlt_image_format format, int width, int height );
+static void prefetch_close( producer_avformat self );
+static void audio_prefetch_close( producer_avformat self );
+static void seek_index_start( producer_avformat self );
+static void proxy_start( producer_avformat self );
+static void share_image( mlt_frame frame, mlt_frame original, uint8_t **buffer );
+static void share_register( mlt_producer producer );
+static mlt_position keyframe_position_before( producer_avformat self, mlt_position position );
+static int probe_cache_restore( producer_avformat self, mlt_profile profile );
+static void probe_cache_store( producer_avformat self, mlt_profile profile );
 
 #ifdef VDPAU
 #include "vdpau.c"
@@ -198,23 +311,28 @@ mlt_producer producer_avformat_init( mlt_profile profile, const char *service, c
 
 			if ( strcmp( service, "avformat-novalidate" ) )
 			{
-				// Open the file
-				if ( producer_open( self, profile, mlt_properties_get( properties, "resource" ), 1, 1 ) != 0 )
-				{
-					// Clean up
-					mlt_producer_close( producer );
-					producer = NULL;
-					producer_avformat_close( self );
-				}
-				else if ( self->seekable )
+				// Reuse what an earlier probe of the same file found
+				if ( !probe_cache_restore( self, profile ) )
 				{
-					// Close the file to release resources for large playlists - reopen later as needed
-					if ( self->audio_format )
-						avformat_close_input( &self->audio_format );
-					if ( self->video_format )
-						avformat_close_input( &self->video_format );
-					self->audio_format = NULL;
-					self->video_format = NULL;
+					// Open the file
+					if ( producer_open( self, profile, mlt_properties_get( properties, "resource" ), 1, 1 ) != 0 )
+					{
+						// Clean up
+						mlt_producer_close( producer );
+						producer = NULL;
+						producer_avformat_close( self );
+					}
+					else if ( self->seekable )
+					{
+						// Close the file to release resources for large playlists - reopen later as needed
+						if ( self->audio_format )
+							io_cache_close_input( &self->audio_format );
+						if ( self->video_format )
+							io_cache_close_input( &self->video_format );
+						self->audio_format = NULL;
+						self->video_format = NULL;
+						probe_cache_store( self, profile );
+					}
 				}
 			}
 			if ( producer )
@@ -226,6 +344,7 @@ mlt_producer producer_avformat_init( mlt_profile profile, const char *service, c
 				mlt_service_cache_set_size( MLT_PRODUCER_SERVICE(producer), "producer_avformat", 5 );
 #endif
 				mlt_service_cache_put( MLT_PRODUCER_SERVICE(producer), "producer_avformat", self, 0, (mlt_destructor) producer_avformat_close );
+				share_register( producer );
 
 				mlt_properties_set_int( properties, "mute_on_pause",  1 );
 			}
@@ -650,7 +769,7 @@ static int get_basic_info( producer_avformat self, mlt_profile profile, const ch
 		mlt_properties_set_int( properties, "seekable", self->seekable );
 		self->dummy_context = format;
 		self->video_format = NULL;
-		avformat_open_input( &self->video_format, filename, NULL, NULL );
+		io_cache_open_input( &self->video_format, filename, NULL, NULL, properties );
 		avformat_find_stream_info( self->video_format, NULL );
 		format = self->video_format;
 	}
@@ -731,23 +850,164 @@ static int insert_filter(AVFilterGraph *graph, AVFilterContext **last_filter, co
 }
 #endif
 
-/** Open the file.
+/** Initialize the locks on first use.
 */
 
-static int producer_open(producer_avformat self, mlt_profile profile, const char *URL, int take_lock, int test_open )
+static void init_mutexes( producer_avformat self )
 {
-	// Return an error code (0 == no error)
-	int error = 0;
-	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
-
 	if ( !self->is_mutex_init )
 	{
 		pthread_mutex_init( &self->audio_mutex, NULL );
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_mutex_init( &self->packets_mutex, NULL );
 		pthread_mutex_init( &self->open_mutex, NULL );
+		pthread_mutex_init( &self->prefetch.mutex, NULL );
+		pthread_cond_init( &self->prefetch.cond, NULL );
+		pthread_mutex_init( &self->audio_prefetch.mutex, NULL );
+		pthread_cond_init( &self->audio_prefetch.cond, NULL );
+		pthread_mutex_init( &self->live.mutex, NULL );
+		pthread_cond_init( &self->live.cond, NULL );
+		pthread_mutex_init( &self->pool.mutex, NULL );
 		self->is_mutex_init = 1;
 	}
+}
+
+/** Determine if a source is read through the jitter buffer.
+ *
+ * The live property forces it on or off, otherwise it is used for the
+ * network protocols that deliver a stream at the pace of the sender.
+ */
+
+static int live_requested( mlt_properties properties, const char *URL )
+{
+	static const char *protocols[] = { "udp:", "rtp:", "srt:", "rtmp:", "rtmps:", NULL };
+	int i;
+
+	if ( mlt_properties_get( properties, "live" ) )
+		return mlt_properties_get_int( properties, "live" );
+	for ( i = 0; URL && protocols[i]; i++ )
+		if ( !strncmp( URL, protocols[i], strlen( protocols[i] ) ) )
+			return 1;
+	return 0;
+}
+
+/** Let closing the producer interrupt a blocking read of a live source.
+*/
+
+static int live_interrupt( void *opaque )
+{
+	producer_avformat self = opaque;
+	return self->live.stop;
+}
+
+static void live_alloc_context( producer_avformat self )
+{
+	if ( self->live.enabled && !self->video_format )
+	{
+		self->video_format = avformat_alloc_context();
+		if ( self->video_format )
+		{
+			self->video_format->interrupt_callback.callback = live_interrupt;
+			self->video_format->interrupt_callback.opaque = self;
+		}
+	}
+}
+
+/** Determine if the probe cache may be used.
+ *
+ * It is disabled for all producers by MLT_AVFORMAT_PROBE_CACHE=0 and for one
+ * producer by its probe_cache property.
+ */
+
+static int use_probe_cache( producer_avformat self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	const char *env = getenv( "MLT_AVFORMAT_PROBE_CACHE" );
+	return ( !env || atoi( env ) )
+		&& ( !mlt_properties_get( properties, "probe_cache" ) || mlt_properties_get_int( properties, "probe_cache" ) );
+}
+
+static int is_probe_property( const char *name )
+{
+	return name[0] != '_' && strcmp( name, "resource" ) && strcmp( name, "mlt_type" )
+		&& strcmp( name, "mlt_service" ) && strcmp( name, "probe_cache" );
+}
+
+/** Set the properties found by an earlier probe of the file instead of opening it.
+ *
+ * Only seekable files are cached, which are closed after probing anyway and
+ * opened again on the first frame.
+ * \return true if the cache had the file
+ */
+
+static int probe_cache_restore( producer_avformat self, mlt_profile profile )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	mlt_properties probe;
+	int i;
+
+	if ( !use_probe_cache( self ) )
+		return 0;
+	probe = probe_cache_load( mlt_properties_get( properties, "resource" ), mlt_profile_fps( profile ) );
+	if ( !probe )
+		return 0;
+
+	mlt_events_block( properties, self->parent );
+	for ( i = 0; i < mlt_properties_count( probe ); i++ )
+	{
+		char *name = mlt_properties_get_name( probe, i );
+		if ( is_probe_property( name ) )
+			mlt_properties_set( properties, name, mlt_properties_get_value( probe, i ) );
+	}
+	mlt_events_unblock( properties, self->parent );
+
+	self->audio_index = mlt_properties_get_int( probe, "audio_index" );
+	self->video_index = mlt_properties_get_int( probe, "video_index" );
+	self->seekable = 1;
+	self->video_seekable = 1;
+	self->first_pts = AV_NOPTS_VALUE;
+	self->last_position = POSITION_INITIAL;
+	self->probe = probe;
+	init_mutexes( self );
+	return 1;
+}
+
+/** Save the properties found by probing the file in the probe cache.
+*/
+
+static void probe_cache_store( producer_avformat self, mlt_profile profile )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	mlt_properties probe;
+	int i;
+
+	if ( !use_probe_cache( self ) || !( probe = mlt_properties_new( ) ) )
+		return;
+	for ( i = 0; i < mlt_properties_count( properties ); i++ )
+	{
+		char *name = mlt_properties_get_name( properties, i );
+		char *value = mlt_properties_get_value( properties, i );
+		if ( value && is_probe_property( name ) )
+			mlt_properties_set( probe, name, value );
+	}
+	mlt_properties_set_int( probe, "audio_index", self->audio_index );
+	mlt_properties_set_int( probe, "video_index", self->video_index );
+	if ( probe_cache_save( probe, mlt_properties_get( properties, "resource" ), mlt_profile_fps( profile ) ) )
+		mlt_properties_close( probe );
+	else
+		self->probe = probe;
+}
+
+/** Open the file.
+*/
+
+static int producer_open(producer_avformat self, mlt_profile profile, const char *URL, int take_lock, int test_open )
+{
+	// Return an error code (0 == no error)
+	int error = 0;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+
+	init_mutexes( self );
 
 	// Lock the service
 	if ( take_lock )
@@ -762,11 +1022,21 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 	AVDictionary *params = NULL;
 	char *filename = parse_url( profile, URL, &format, &params );
 
+	// Live network sources are read ahead into a jitter buffer
+	self->live.enabled = live_requested( properties, URL );
+	self->live.latency = 1000 * ( mlt_properties_get( properties, "live_latency" ) ?
+		mlt_properties_get_int( properties, "live_latency" ) : LIVE_LATENCY );
+	self->live.latency = MAX( self->live.latency, 0 );
+
 	// Now attempt to open the file or device with filename
-	error = avformat_open_input( &self->video_format, filename, format, &params ) < 0;
+	live_alloc_context( self );
+	error = io_cache_open_input( &self->video_format, filename, format, &params, properties ) < 0;
 	if ( error )
+	{
 		// If the URL is a network stream URL, then we probably need to open with full URL
-		error = avformat_open_input( &self->video_format, URL, format, &params ) < 0;
+		live_alloc_context( self );
+		error = io_cache_open_input( &self->video_format, URL, format, &params, properties ) < 0;
+	}
 
 	// Set MLT properties onto video AVFormatContext
 	if ( !error && self->video_format )
@@ -791,6 +1061,10 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 			find_default_streams( self );
 			error = get_basic_info( self, profile, filename );
 
+			// A source that can seek does not need a jitter buffer
+			if ( self->seekable )
+				self->live.enabled = 0;
+
 			// Initialize position info
 			self->first_pts = AV_NOPTS_VALUE;
 			self->last_position = POSITION_INITIAL;
@@ -805,7 +1079,7 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 					if ( self->seekable )
 					{
 						// And open again for our audio context
-						avformat_open_input( &self->audio_format, filename, NULL, NULL );
+						io_cache_open_input( &self->audio_format, filename, NULL, NULL, properties );
 						apply_properties( self->audio_format, properties, AV_OPT_FLAG_DECODING_PARAM );
 						if ( self->audio_format->iformat && self->audio_format->iformat->priv_class && self->audio_format->priv_data )
 							apply_properties( self->audio_format->priv_data, properties, AV_OPT_FLAG_DECODING_PARAM );
@@ -860,6 +1134,12 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 					}
 				}
 #endif
+				if ( !test_open && !self->pool_member && self->video_index != -1 && self->seekable
+					 && mlt_properties_get_int( properties, "seek_index" ) )
+					seek_index_start( self );
+				if ( !test_open && !self->pool_member && self->video_index != -1 && self->seekable
+					 && mlt_properties_get_int( properties, "proxy" ) )
+					proxy_start( self );
 			}
 		}
 	}
@@ -873,7 +1153,7 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 	if ( self->dummy_context )
 	{
 		pthread_mutex_lock( &self->open_mutex );
-		avformat_close_input( &self->dummy_context );
+		io_cache_close_input( &self->dummy_context );
 		self->dummy_context = NULL;
 		pthread_mutex_unlock( &self->open_mutex );
 	}
@@ -889,10 +1169,274 @@ static int producer_open(producer_avformat self, mlt_profile profile, const char
 	return error;
 }
 
+/** Get the time of a packet in microseconds.
+*/
+
+static int64_t live_packet_time( AVFormatContext *context, AVPacket *pkt )
+{
+	int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+	if ( ts == AV_NOPTS_VALUE || pkt->stream_index < 0 || pkt->stream_index >= context->nb_streams )
+		return AV_NOPTS_VALUE;
+	return av_rescale_q( ts, context->streams[ pkt->stream_index ]->time_base, AV_TIME_BASE_Q );
+}
+
+/** Get the time buffered in microseconds.
+ *
+ * The caller must hold the live mutex.
+ */
+
+static int64_t live_buffered( producer_avformat self )
+{
+	if ( self->live.head == AV_NOPTS_VALUE || self->live.tail == AV_NOPTS_VALUE )
+		return 0;
+	return MAX( self->live.head - self->live.tail, 0 );
+}
+
+static void live_deadline( struct timespec *tm, int64_t usec )
+{
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	usec += now.tv_usec;
+	tm->tv_sec = now.tv_sec + usec / 1000000;
+	tm->tv_nsec = ( usec % 1000000 ) * 1000;
+}
+
+/** The thread that demuxes a live source into the jitter buffer as fast as it arrives.
+*/
+
+static void *live_thread( void *arg )
+{
+	producer_avformat self = arg;
+	AVFormatContext *context = self->live.context;
+	// The stream whose timestamps measure the buffer
+	int reference = self->video_index != -1 ? self->video_index : self->audio_index;
+	// Discard the oldest packets if the consumer stops taking them
+	int64_t limit = MAX( 4 * self->live.latency, 2000000 );
+
+	while ( !self->live.stop )
+	{
+		AVPacket pkt;
+		int ret;
+
+		av_init_packet( &pkt );
+		ret = av_read_frame( context, &pkt );
+		if ( ret == AVERROR( EAGAIN ) )
+		{
+			av_usleep( 10000 );
+			continue;
+		}
+
+		pthread_mutex_lock( &self->live.mutex );
+		if ( ret < 0 )
+		{
+			self->live.error = ret;
+			pthread_cond_broadcast( &self->live.cond );
+			pthread_mutex_unlock( &self->live.mutex );
+			break;
+		}
+		if ( !av_dup_packet( &pkt ) )
+		{
+			AVPacket *tmp = malloc( sizeof(AVPacket) );
+			*tmp = pkt;
+			mlt_deque_push_back( self->live.packets, tmp );
+			if ( pkt.stream_index == reference )
+			{
+				int64_t time = live_packet_time( context, &pkt );
+				if ( time != AV_NOPTS_VALUE )
+				{
+					self->live.head = time;
+					if ( self->live.tail == AV_NOPTS_VALUE )
+						self->live.tail = time;
+				}
+			}
+			if ( live_buffered( self ) > limit )
+			{
+				while ( mlt_deque_count( self->live.packets ) > 1 && live_buffered( self ) > self->live.latency )
+				{
+					tmp = mlt_deque_pop_front( self->live.packets );
+					if ( tmp->stream_index == reference )
+					{
+						int64_t time = live_packet_time( context, tmp );
+						if ( time != AV_NOPTS_VALUE )
+							self->live.tail = time;
+					}
+					av_free_packet( tmp );
+					free( tmp );
+					self->live.overflow++;
+				}
+				mlt_log_verbose( MLT_PRODUCER_SERVICE( self->parent ), "live buffer overflow, %d packets discarded\n",
+					self->live.overflow );
+			}
+		}
+		else
+		{
+			av_free_packet( &pkt );
+		}
+		pthread_cond_broadcast( &self->live.cond );
+		pthread_mutex_unlock( &self->live.mutex );
+	}
+	return NULL;
+}
+
+/** Stop the live thread and discard the jitter buffer.
+*/
+
+static void live_stop( producer_avformat self )
+{
+	if ( self->is_mutex_init && self->live.started )
+	{
+		pthread_mutex_lock( &self->live.mutex );
+		self->live.stop = 1;
+		pthread_cond_broadcast( &self->live.cond );
+		pthread_mutex_unlock( &self->live.mutex );
+		pthread_join( self->live.thread, NULL );
+		self->live.started = 0;
+		self->live.stop = 0;
+	}
+	if ( self->live.packets )
+	{
+		AVPacket *pkt;
+		while ( ( pkt = mlt_deque_pop_back( self->live.packets ) ) )
+		{
+			av_free_packet( pkt );
+			free( pkt );
+		}
+	}
+	self->live.context = NULL;
+	self->live.head = self->live.tail = AV_NOPTS_VALUE;
+	self->live.level = 0;
+	self->live.primed = 0;
+	self->live.error = 0;
+}
+
+/** Read the next packet of a source, from the jitter buffer of a live source.
+ *
+ * This returns AVERROR(EAGAIN) when nothing arrived within a frame, so that the
+ * caller can conceal the gap instead of stalling the consumer. For video, the
+ * buffer level is held near the latency by skipping or repeating a frame at
+ * most once per second, which absorbs the drift between the sender clock and
+ * the consumer clock. The caller must hold the packets mutex.
+ */
+
+static int read_frame( producer_avformat self, AVFormatContext *context, AVPacket *pkt, int video )
+{
+	if ( !self->live.enabled )
+		return av_read_frame( context, pkt );
+
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	double fps = mlt_properties_get_double( properties, "meta.media.frame_rate_num" ) /
+		mlt_properties_get_double( properties, "meta.media.frame_rate_den" );
+	if ( !( fps > 0 ) || isinf( fps ) )
+		fps = mlt_producer_get_fps( self->parent );
+	int64_t frame_time = 1000000 / fps;
+	struct timespec tm;
+	int ret = 0;
+
+	pthread_mutex_lock( &self->live.mutex );
+	if ( !self->live.started )
+	{
+		if ( !self->live.packets )
+			self->live.packets = mlt_deque_init();
+		self->live.context = context;
+		self->live.stop = 0;
+		self->live.error = 0;
+		self->live.head = self->live.tail = AV_NOPTS_VALUE;
+		self->live.started = !pthread_create( &self->live.thread, NULL, live_thread, self );
+		if ( !self->live.started )
+		{
+			// Fall back to reading directly
+			self->live.enabled = 0;
+			pthread_mutex_unlock( &self->live.mutex );
+			return av_read_frame( context, pkt );
+		}
+	}
+	if ( !self->live.primed )
+	{
+		// Fill the buffer up to the latency before the first packet, without waiting forever
+		live_deadline( &tm, 2 * self->live.latency + 1000000 );
+		while ( !self->live.error && live_buffered( self ) < self->live.latency
+			&& pthread_cond_timedwait( &self->live.cond, &self->live.mutex, &tm ) == 0 );
+		self->live.primed = 1;
+		self->live.level = live_buffered( self );
+	}
+	else if ( !mlt_deque_count( self->live.packets ) && !self->live.error )
+	{
+		// Wait at most a frame for the next packet
+		live_deadline( &tm, frame_time );
+		while ( !self->live.error && !mlt_deque_count( self->live.packets )
+			&& pthread_cond_timedwait( &self->live.cond, &self->live.mutex, &tm ) == 0 );
+	}
+
+	if ( mlt_deque_count( self->live.packets ) )
+	{
+		AVPacket *tmp = mlt_deque_pop_front( self->live.packets );
+		int reference = self->video_index != -1 ? self->video_index : self->audio_index;
+		*pkt = *tmp;
+		free( tmp );
+		if ( pkt->stream_index == reference )
+		{
+			int64_t time = live_packet_time( context, pkt );
+			if ( time != AV_NOPTS_VALUE )
+				self->live.tail = time;
+		}
+	}
+	else
+	{
+		ret = self->live.error ? self->live.error : AVERROR( EAGAIN );
+		av_init_packet( pkt );
+		pkt->data = NULL;
+		pkt->size = 0;
+	}
+	self->live.level += ( live_buffered( self ) - self->live.level ) / 16.0;
+
+	int64_t now = mlt_log_timings_now();
+	if ( video && self->video_index != -1 && self->first_pts != AV_NOPTS_VALUE )
+	{
+		// The duration of a frame in the video time base
+		int64_t duration = llrint( 1.0 / ( av_q2d( self->video_time_base ) * fps ) );
+
+		if ( ret == AVERROR( EAGAIN ) )
+		{
+			// Show the next packet one frame later rather than skipping to it
+			self->first_pts -= duration;
+			self->live.repeated++;
+		}
+		else if ( ret == 0 && now - self->live.adjusted_at >= 1000000 )
+		{
+			if ( self->live.level > 1.5 * self->live.latency )
+			{
+				// The sender is ahead of the consumer
+				self->first_pts += duration;
+				self->live.dropped++;
+				self->live.adjusted_at = now;
+			}
+			else if ( self->live.level < 0.5 * self->live.latency )
+			{
+				// The sender is behind the consumer
+				self->first_pts -= duration;
+				self->live.repeated++;
+				self->live.adjusted_at = now;
+			}
+		}
+	}
+	if ( now - self->live.reported_at >= 1000000 )
+	{
+		mlt_properties_set_int( properties, "live_buffer", self->live.level / 1000 );
+		mlt_properties_set_int( properties, "live_dropped", self->live.dropped );
+		mlt_properties_set_int( properties, "live_repeated", self->live.repeated );
+		mlt_properties_set_int( properties, "live_overflow", self->live.overflow );
+		self->live.reported_at = now;
+	}
+	pthread_mutex_unlock( &self->live.mutex );
+
+	return ret;
+}
+
 static void prepare_reopen( producer_avformat self )
 {
 	mlt_service_lock( MLT_PRODUCER_SERVICE( self->parent ) );
 	pthread_mutex_lock( &self->audio_mutex );
+	live_stop( self );
 	pthread_mutex_lock( &self->open_mutex );
 
 	int i;
@@ -911,9 +1455,9 @@ static void prepare_reopen( producer_avformat self )
 	self->video_codec = NULL;
 
 	if ( self->seekable && self->audio_format )
-		avformat_close_input( &self->audio_format );
+		io_cache_close_input( &self->audio_format );
 	if ( self->video_format )
-		avformat_close_input( &self->video_format );
+		io_cache_close_input( &self->video_format );
 	self->audio_format = NULL;
 	self->video_format = NULL;
 #ifdef AVFILTER
@@ -960,6 +1504,14 @@ static int64_t best_pts( producer_avformat self, int64_t pts, int64_t dts )
 
 static void find_first_pts( producer_avformat self, int video_index )
 {
+	// Reuse the timestamp found when the file was opened before
+	if ( self->probe && use_probe_cache( self ) && mlt_properties_get( self->probe, "_first_pts" )
+		 && mlt_properties_get_int( self->probe, "_first_pts_index" ) == video_index )
+	{
+		self->first_pts = mlt_properties_get_int64( self->probe, "_first_pts" );
+		return;
+	}
+
 	// find initial PTS
 	AVFormatContext *context = self->video_format? self->video_format : self->audio_format;
 	int ret = 0;
@@ -1009,57 +1561,353 @@ static void find_first_pts( producer_avformat self, int video_index )
 	if ( vfr_counter >= VFR_THRESHOLD )
 		mlt_properties_set_int( MLT_PRODUCER_PROPERTIES(self->parent), "meta.media.variable_frame_rate", 1 );
 	av_seek_frame( context, -1, 0, AVSEEK_FLAG_BACKWARD );
+
+	// Keep the timestamp for the next time the file is opened
+	if ( self->probe && use_probe_cache( self ) && self->first_pts != AV_NOPTS_VALUE )
+	{
+		pthread_mutex_lock( &self->open_mutex );
+		mlt_properties_set_int64( self->probe, "_first_pts", self->first_pts );
+		mlt_properties_set_int( self->probe, "_first_pts_index", video_index );
+		if ( vfr_counter >= VFR_THRESHOLD )
+			mlt_properties_set_int( self->probe, "meta.media.variable_frame_rate", 1 );
+		probe_cache_save( self->probe, mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" ),
+			mlt_profile_fps( mlt_service_profile( MLT_PRODUCER_SERVICE( self->parent ) ) ) );
+		pthread_mutex_unlock( &self->open_mutex );
+	}
 }
 
-static int seek_video( producer_avformat self, mlt_position position,
-	int64_t req_position, int preseek )
+/** The decoder threads shared by all producers in the process.
+ *
+ * Producers that do not set the threads property register their video decoder here
+ * and get an equal share of the budget among those that decoded recently.
+ */
+
+static struct
 {
-	mlt_producer producer = self->parent;
-        mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
-	int paused = 0;
-	int seek_threshold = mlt_properties_get_int( properties, "seek_threshold" );
-	if ( seek_threshold <= 0 ) seek_threshold = 12;
+	pthread_mutex_t mutex;
+	int total;
+	producer_avformat producers;
+} decoder_budget = { PTHREAD_MUTEX_INITIALIZER, 0, NULL };
 
-	pthread_mutex_lock( &self->packets_mutex );
+// Get the fair share of threads, called with the budget mutex held.
+static int decoder_budget_share( producer_avformat self, int64_t now )
+{
+	producer_avformat p;
+	int active = 1;
 
-	if ( self->video_seekable && ( position != self->video_expected || self->last_position < 0 ) )
+	if ( !decoder_budget.total )
 	{
+		const char *env = getenv( "MLT_AVFORMAT_THREAD_BUDGET" );
+		decoder_budget.total = env && atoi( env ) > 0 ? atoi( env ) : av_cpu_count();
+	}
+	for ( p = decoder_budget.producers; p; p = p->budget_next )
+		if ( p != self && now - p->budget_active_at < DECODER_IDLE_TIME )
+			active++;
+	return FFMAX( 1, decoder_budget.total / active );
+}
 
-		// Fetch the video format context
-		AVFormatContext *context = self->video_format;
+static int decoder_budget_register( producer_avformat self )
+{
+	int64_t now = mlt_log_timings_now();
+	producer_avformat p;
 
-		// Get the video stream
-		AVStream *stream = context->streams[ self->video_index ];
+	pthread_mutex_lock( &decoder_budget.mutex );
+	for ( p = decoder_budget.producers; p && p != self; p = p->budget_next );
+	if ( !p )
+	{
+		self->budget_next = decoder_budget.producers;
+		decoder_budget.producers = self;
+	}
+	self->budget_active_at = now;
+	self->budget_threads = decoder_budget_share( self, now );
+	pthread_mutex_unlock( &decoder_budget.mutex );
 
-		// Get codec context
-		AVCodecContext *codec_context = stream->codec;
+	return self->budget_threads;
+}
 
-		// We may want to use the source fps if available
-		double source_fps = mlt_properties_get_double( properties, "meta.media.frame_rate_num" ) /
-			mlt_properties_get_double( properties, "meta.media.frame_rate_den" );
-	
-		if ( self->first_pts == AV_NOPTS_VALUE && self->last_position == POSITION_INITIAL )
-			find_first_pts( self, self->video_index );
+static void decoder_budget_unregister( producer_avformat self )
+{
+	producer_avformat *p;
 
-		if ( self->video_frame && position + 1 == self->video_expected )
+	pthread_mutex_lock( &decoder_budget.mutex );
+	for ( p = &decoder_budget.producers; *p; p = &(*p)->budget_next )
+	{
+		if ( *p == self )
 		{
-			// We're paused - use last image
-			paused = 1;
+			*p = self->budget_next;
+			break;
 		}
-		else if ( position < self->video_expected || position - self->video_expected >= seek_threshold || self->last_position < 0 )
-		{
-			// Calculate the timestamp for the requested frame
-			int64_t timestamp = req_position / ( av_q2d( self->video_time_base ) * source_fps );
-			if ( req_position <= 0 )
-				timestamp = 0;
-			else if ( self->first_pts != AV_NOPTS_VALUE )
-				timestamp += self->first_pts;
-			else if ( context->start_time != AV_NOPTS_VALUE )
-				timestamp += context->start_time;
-			if ( preseek && av_q2d( self->video_time_base ) != 0 )
-				timestamp -= 2 / av_q2d( self->video_time_base );
-			if ( timestamp < 0 )
-				timestamp = 0;
+	}
+	self->budget_next = NULL;
+	self->budget_threads = 0;
+	pthread_mutex_unlock( &decoder_budget.mutex );
+}
+
+static void decoder_budget_touch( producer_avformat self )
+{
+	if ( self->budget_threads )
+	{
+		pthread_mutex_lock( &decoder_budget.mutex );
+		self->budget_active_at = mlt_log_timings_now();
+		pthread_mutex_unlock( &decoder_budget.mutex );
+	}
+}
+
+/** Reopen the video decoder with its current share of the budget.
+ *
+ * The decoder threads are fixed while the codec is open, so this is only done
+ * after a seek has flushed the decoder and the share has changed by at least half.
+ */
+
+static void decoder_budget_rebalance( producer_avformat self, AVCodecContext *codec_context )
+{
+	const AVCodec *codec = codec_context->codec;
+	int threads;
+
+	if ( !self->budget_threads || !codec )
+		return;
+#ifdef VDPAU
+	if ( self->vdpau )
+		return;
+#endif
+	pthread_mutex_lock( &decoder_budget.mutex );
+	threads = decoder_budget_share( self, mlt_log_timings_now() );
+	pthread_mutex_unlock( &decoder_budget.mutex );
+	if ( threads * 2 > self->budget_threads * 3 || threads * 3 < self->budget_threads * 2 )
+	{
+		mlt_log_verbose( MLT_PRODUCER_SERVICE( self->parent ), "decoder threads %d -> %d\n", self->budget_threads, threads );
+		pthread_mutex_lock( &self->open_mutex );
+		avcodec_close( codec_context );
+		codec_context->thread_count = threads;
+#ifdef HWACCEL
+		if ( self->hwaccel.device_ctx )
+			codec_context->hw_device_ctx = av_buffer_ref( self->hwaccel.device_ctx );
+#endif
+		if ( avcodec_open2( codec_context, codec, NULL ) >= 0 )
+		{
+			mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+			apply_properties( codec_context, properties, AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM );
+			if ( codec->priv_class && codec_context->priv_data )
+				apply_properties( codec_context->priv_data, properties, AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM );
+			self->budget_threads = threads;
+		}
+		else
+		{
+			mlt_log_error( MLT_PRODUCER_SERVICE( self->parent ), "failed to reopen the video decoder\n" );
+			self->video_index = -1;
+			self->video_codec = NULL;
+		}
+		pthread_mutex_unlock( &self->open_mutex );
+	}
+}
+
+// Get the stream timestamp of a frame in the source frame rate.
+static int64_t frame_timestamp( producer_avformat self, int64_t req_position, double source_fps )
+{
+	AVFormatContext *context = self->video_format;
+	int64_t timestamp = req_position / ( av_q2d( self->video_time_base ) * source_fps );
+	if ( req_position <= 0 )
+		timestamp = 0;
+	else if ( self->first_pts != AV_NOPTS_VALUE )
+		timestamp += self->first_pts;
+	else if ( context->start_time != AV_NOPTS_VALUE )
+		timestamp += context->start_time;
+	return timestamp;
+}
+
+static int seek_index_job( mlt_job job, void *cookie )
+{
+	producer_avformat self = cookie;
+	const char *resource = mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" );
+	seek_index index = seek_index_build( resource, self->video_index, job );
+
+	if ( index )
+	{
+		seek_index_save( index, resource );
+		pthread_mutex_lock( &self->packets_mutex );
+		self->seek_index = index;
+		pthread_mutex_unlock( &self->packets_mutex );
+	}
+	return !index;
+}
+
+/** Load the keyframe index or start building it in the background.
+*/
+
+static void seek_index_start( producer_avformat self )
+{
+	if ( !self->seek_index && !self->index_job )
+	{
+		const char *resource = mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" );
+		seek_index index = seek_index_load( resource, self->video_index );
+		if ( index )
+		{
+			pthread_mutex_lock( &self->packets_mutex );
+			self->seek_index = index;
+			pthread_mutex_unlock( &self->packets_mutex );
+		}
+		else
+		{
+			self->index_job = mlt_job_submit( mlt_job_normal, seek_index_job, self );
+		}
+	}
+}
+
+/** Get the width of the proxy, which the requested width must not exceed to use it.
+*/
+
+static int proxy_width( mlt_properties properties )
+{
+	int width = mlt_properties_get_int( properties, "proxy_width" );
+	return width > 0 ? width : 640;
+}
+
+static int proxy_job( mlt_job job, void *cookie )
+{
+	producer_avformat self = cookie;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self->parent ) );
+	const char *resource = mlt_properties_get( properties, "resource" );
+	int width = proxy_width( properties );
+	int media_width = mlt_properties_get_int( properties, "width" );
+	int media_height = mlt_properties_get_int( properties, "height" );
+	int height = ( media_height * width / media_width + 1 ) & ~1;
+	char *filename = proxy_filename( resource, profile, width, 1 );
+
+	if ( filename && access( filename, F_OK )
+		 && proxy_build( resource, filename, profile, width, height,
+			mlt_properties_get_int( properties, "meta.media.sample_aspect_num" ),
+			mlt_properties_get_int( properties, "meta.media.sample_aspect_den" ), job ) )
+	{
+		free( filename );
+		filename = NULL;
+	}
+	if ( filename )
+	{
+		pthread_mutex_lock( &self->packets_mutex );
+		self->proxy_file = filename;
+		pthread_mutex_unlock( &self->packets_mutex );
+	}
+	return !filename;
+}
+
+/** Find the proxy or start building it in the background.
+ *
+ * Media no larger than the proxy does not get one.
+ */
+
+static void proxy_start( producer_avformat self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	if ( !self->proxy_file && !self->proxy_job
+		 && mlt_properties_get_int( properties, "width" ) > proxy_width( properties )
+		 && mlt_properties_get_int( properties, "height" ) > 0 )
+		self->proxy_job = mlt_job_submit( mlt_job_low, proxy_job, self );
+}
+
+/** Get the image of a frame from the proxy when it is requested at no more than its width.
+ *
+ * \return true if the proxy could not provide the image
+ */
+
+static int proxy_get_image( producer_avformat self, mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+	char *filename;
+	int error = 1;
+
+	pthread_mutex_lock( &self->packets_mutex );
+	filename = self->proxy_file;
+	pthread_mutex_unlock( &self->packets_mutex );
+	if ( !filename || *width <= 0 || *width > proxy_width( properties ) || *format == mlt_image_hwsurface )
+		return error;
+
+	pthread_mutex_lock( &self->video_mutex );
+	if ( !self->proxy_producer )
+		self->proxy_producer = mlt_factory_producer( mlt_service_profile( MLT_PRODUCER_SERVICE( self->parent ) ), "avformat", filename );
+	if ( self->proxy_producer )
+	{
+		mlt_frame proxy_frame = NULL;
+		mlt_producer_seek( self->proxy_producer, mlt_frame_original_position( frame ) );
+		mlt_service_get_frame( MLT_PRODUCER_SERVICE( self->proxy_producer ), &proxy_frame, 0 );
+		if ( proxy_frame )
+		{
+			error = mlt_frame_get_image( proxy_frame, buffer, format, width, height, 0 );
+			if ( !error )
+			{
+				share_image( frame, proxy_frame, buffer );
+				mlt_properties_set_data( frame_properties, "avformat.proxy", proxy_frame, 0, (mlt_destructor) mlt_frame_close, NULL );
+				mlt_properties_set_int( frame_properties, "format", *format );
+				mlt_properties_set_int( frame_properties, "progressive", 1 );
+			}
+			else
+			{
+				mlt_frame_close( proxy_frame );
+			}
+		}
+	}
+	pthread_mutex_unlock( &self->video_mutex );
+
+	return error;
+}
+
+static int seek_video( producer_avformat self, mlt_position position,
+	int64_t req_position, int preseek )
+{
+	mlt_producer producer = self->parent;
+        mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	int paused = 0;
+	int seek_threshold = mlt_properties_get_int( properties, "seek_threshold" );
+	if ( seek_threshold <= 0 ) seek_threshold = 12;
+
+	pthread_mutex_lock( &self->packets_mutex );
+
+	if ( self->video_seekable && ( position != self->video_expected || self->last_position < 0 ) )
+	{
+
+		// Fetch the video format context
+		AVFormatContext *context = self->video_format;
+
+		// Get the video stream
+		AVStream *stream = context->streams[ self->video_index ];
+
+		// Get codec context
+		AVCodecContext *codec_context = stream->codec;
+
+		// We may want to use the source fps if available
+		double source_fps = mlt_properties_get_double( properties, "meta.media.frame_rate_num" ) /
+			mlt_properties_get_double( properties, "meta.media.frame_rate_den" );
+	
+		seek_index index = self->seek_index;
+		if ( index && self->first_pts == AV_NOPTS_VALUE )
+			self->first_pts = seek_index_first_keyframe( index );
+		if ( self->first_pts == AV_NOPTS_VALUE && self->last_position == POSITION_INITIAL )
+			find_first_pts( self, self->video_index );
+
+		if ( self->video_frame && position + 1 == self->video_expected )
+		{
+			// We're paused - use last image
+			paused = 1;
+		}
+		else if ( index && self->last_position >= 0 && position > self->video_expected
+			&& seek_index_keyframe_before( index, frame_timestamp( self, req_position, source_fps ) )
+			== seek_index_keyframe_before( index, frame_timestamp( self, ( int64_t )( self->video_expected
+				/ mlt_producer_get_fps( producer ) * source_fps + 0.5 ), source_fps ) ) )
+		{
+			// The requested frame is in the group of pictures being decoded - decode forward
+		}
+		else if ( index || position < self->video_expected || position - self->video_expected >= seek_threshold || self->last_position < 0 )
+		{
+			// Calculate the timestamp for the requested frame
+			int64_t timestamp = frame_timestamp( self, req_position, source_fps );
+			if ( index && seek_index_keyframe_before( index, timestamp ) != AV_NOPTS_VALUE )
+				// Seek exactly to the keyframe
+				timestamp = seek_index_keyframe_before( index, timestamp );
+			else if ( preseek && av_q2d( self->video_time_base ) != 0 )
+				timestamp -= 2 / av_q2d( self->video_time_base );
+			if ( timestamp < 0 )
+				timestamp = 0;
 			mlt_log_debug( MLT_PRODUCER_SERVICE(producer), "seeking timestamp %"PRId64" position " MLT_POSITION_FMT " expected "MLT_POSITION_FMT" last_pos %"PRId64"\n",
 				timestamp, position, self->video_expected, self->last_position );
 
@@ -1069,6 +1917,7 @@ static int seek_video( producer_avformat self, mlt_position position,
 
 			// flush any pictures still in decode buffer
 			avcodec_flush_buffers( codec_context );
+			decoder_budget_rebalance( self, codec_context );
 
 			// Remove the cached info relating to the previous position
 			self->current_position = POSITION_INVALID;
@@ -1334,7 +2183,7 @@ static int convert_image( producer_avformat self, AVFrame *frame, uint8_t *buffe
 			|| pix_fmt == AV_PIX_FMT_YUVA444P
 #endif
 			) &&
-		*format != mlt_image_rgb24a && *format != mlt_image_opengl &&
+		*format != mlt_image_rgb24a && *format != mlt_image_opengl && *format != mlt_image_rgba64 &&
 		frame->data[3] && frame->linesize[3] )
 	{
 		int i;
@@ -1349,7 +2198,41 @@ static int convert_image( producer_avformat self, AVFrame *frame, uint8_t *buffe
 
 	int src_pix_fmt = pix_fmt;
 	pick_av_pixel_format( &src_pix_fmt );
-	if ( *format == mlt_image_yuv420p )
+	if ( *format == mlt_image_yuv420p10 || *format == mlt_image_yuv444p16 || *format == mlt_image_rgba64 )
+	{
+		int out_pix_fmt = *format == mlt_image_yuv420p10 ? AV_PIX_FMT_YUV420P10LE :
+			*format == mlt_image_yuv444p16 ? AV_PIX_FMT_YUV444P16LE : AV_PIX_FMT_RGBA64LE;
+		int is_rgb = *format == mlt_image_rgba64;
+		uint8_t *out_data[4];
+		int out_stride[4];
+
+		mlt_image_format_planes( *format, width, height, buffer, out_data, out_stride );
+		if ( src_pix_fmt == out_pix_fmt && !self->full_luma
+			 && ( is_rgb || self->yuv_colorspace == profile->colorspace ) )
+		{
+			// The decoded image is already in the requested format
+			int i, planes = is_rgb ? 1 : 3;
+			for ( i = 0; i < planes; i++ )
+			{
+				int h = ( i && *format == mlt_image_yuv420p10 ) ? height >> 1 : height;
+				av_image_copy_plane( out_data[i], out_stride[i], frame->data[i], frame->linesize[i],
+					FFMIN( out_stride[i], frame->linesize[i] ), h );
+			}
+		}
+		else
+		{
+			struct SwsContext *context = sws_getContext( width, height, src_pix_fmt,
+				width, height, out_pix_fmt, flags, NULL, NULL, NULL);
+			// libswscale wants the RGB colorspace to be SWS_CS_DEFAULT, which is = SWS_CS_ITU601.
+			if ( !mlt_set_luma_transfer( context, self->yuv_colorspace, is_rgb ? 601 : profile->colorspace,
+					self->full_luma, 0 ) && !is_rgb )
+				result = profile->colorspace;
+			sws_scale( context, (const uint8_t* const*) frame->data, frame->linesize, 0, height,
+				out_data, out_stride);
+			sws_freeContext( context );
+		}
+	}
+	else if ( *format == mlt_image_yuv420p )
 	{
 		// This is a special case. Movit wants the full range, if available.
 		// Thankfully, there is not much other use of yuv420p except consumer
@@ -1472,6 +2355,15 @@ static int convert_image( producer_avformat self, AVFrame *frame, uint8_t *buffe
 	return result;
 }
 
+/** Determine if only the keyframes are decoded, for fast thumbnails.
+*/
+
+static int keyframe_seek_mode( mlt_properties properties )
+{
+	const char *mode = mlt_properties_get( properties, "seek_mode" );
+	return mode && !strcmp( mode, "keyframe" );
+}
+
 static void set_image_size( producer_avformat self, int *width, int *height )
 {
 	double dar = mlt_profile_dar( mlt_service_profile( MLT_PRODUCER_SERVICE(self->parent) ) );
@@ -1497,6 +2389,150 @@ static void set_image_size( producer_avformat self, int *width, int *height )
 /** Allocate the image buffer and set it on the frame.
 */
 
+#ifdef HWACCEL
+static enum AVPixelFormat hwaccel_get_format( AVCodecContext *codec_context, const enum AVPixelFormat *pix_fmts )
+{
+	producer_avformat self = codec_context->opaque;
+	const enum AVPixelFormat *p;
+
+	for ( p = pix_fmts; *p != AV_PIX_FMT_NONE; p++ )
+		if ( *p == self->hwaccel.pix_fmt )
+			return *p;
+	mlt_log_warning( MLT_PRODUCER_SERVICE( self->parent ), "hwaccel surface format unavailable, decoding in software\n" );
+	return avcodec_default_get_format( codec_context, pix_fmts );
+}
+
+static void hwaccel_init( producer_avformat self, AVCodecContext *codec_context, AVCodec *codec, mlt_properties properties )
+{
+	const char *name = mlt_properties_get( properties, "hwaccel" );
+	enum AVHWDeviceType type;
+	int i;
+
+	av_buffer_unref( &self->hwaccel.device_ctx );
+	self->hwaccel.pix_fmt = AV_PIX_FMT_NONE;
+	if ( !name || !codec )
+		return;
+#ifdef AVFILTER
+	// The autorotate filter graph is configured for system memory frames.
+	if ( self->vfilter_graph )
+	{
+		mlt_log_info( MLT_PRODUCER_SERVICE( self->parent ), "hwaccel is not used with autorotate\n" );
+		return;
+	}
+#endif
+	type = av_hwdevice_find_type_by_name( name );
+	if ( type == AV_HWDEVICE_TYPE_NONE )
+	{
+		mlt_log_warning( MLT_PRODUCER_SERVICE( self->parent ), "unknown hwaccel %s\n", name );
+		return;
+	}
+	for ( i = 0; ; i++ )
+	{
+		const AVCodecHWConfig *config = avcodec_get_hw_config( codec, i );
+		if ( !config )
+		{
+			mlt_log_info( MLT_PRODUCER_SERVICE( self->parent ), "%s does not support hwaccel %s\n", codec->name, name );
+			return;
+		}
+		if ( ( config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX ) && config->device_type == type )
+		{
+			self->hwaccel.pix_fmt = config->pix_fmt;
+			break;
+		}
+	}
+	self->hwaccel.device_ctx = mlt_hwdevice_ref( type, mlt_properties_get( properties, "hwaccel_device" ) );
+	if ( !self->hwaccel.device_ctx )
+	{
+		mlt_log_warning( MLT_PRODUCER_SERVICE( self->parent ), "failed to create %s device\n", name );
+		self->hwaccel.pix_fmt = AV_PIX_FMT_NONE;
+		return;
+	}
+	codec_context->hw_device_ctx = av_buffer_ref( self->hwaccel.device_ctx );
+	codec_context->opaque = self;
+	codec_context->get_format = hwaccel_get_format;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+	// Surfaces may be held by the queues of a hardware encoder.
+	codec_context->extra_hw_frames = 8;
+#endif
+}
+
+static int hwaccel_is_surface( producer_avformat self, AVFrame *frame )
+{
+	return self->hwaccel.device_ctx && frame && frame->format == self->hwaccel.pix_fmt && frame->hw_frames_ctx;
+}
+
+// Download the decoded surface into system memory in place.
+static int hwaccel_download( producer_avformat self )
+{
+	int error = 0;
+
+	if ( hwaccel_is_surface( self, self->video_frame ) )
+	{
+		AVFrame *sw_frame = av_frame_alloc();
+		error = !sw_frame || av_hwframe_transfer_data( sw_frame, self->video_frame, 0 ) < 0
+			|| av_frame_copy_props( sw_frame, self->video_frame ) < 0;
+		if ( !error )
+		{
+			av_frame_unref( self->video_frame );
+			av_frame_move_ref( self->video_frame, sw_frame );
+		}
+		else
+		{
+			mlt_log_error( MLT_PRODUCER_SERVICE( self->parent ), "failed to download the hwaccel surface\n" );
+		}
+		av_frame_free( &sw_frame );
+	}
+	return error;
+}
+
+// Decide whether to pass on the decoded surface or to download it for the requested format.
+static int hwaccel_keep_surface( producer_avformat self, mlt_image_format *format )
+{
+	if ( *format == mlt_image_hwsurface && hwaccel_is_surface( self, self->video_frame ) )
+		return 1;
+	if ( *format == mlt_image_hwsurface )
+		*format = mlt_image_yuv422;
+	hwaccel_download( self );
+	return 0;
+}
+
+static void hwaccel_surface_close( void *surface )
+{
+	AVFrame *frame = surface;
+	av_frame_free( &frame );
+}
+
+// Attach a new reference to the decoded surface as the image of the MLT frame.
+static int hwaccel_attach_surface( producer_avformat self, mlt_frame frame, uint8_t **buffer )
+{
+	AVFrame *surface = av_frame_clone( self->video_frame );
+	int size = mlt_image_format_size( mlt_image_hwsurface, 0, 0, NULL );
+	AVHWFramesContext *frames_ctx;
+
+	if ( !surface )
+		return 0;
+	frames_ctx = (AVHWFramesContext*) surface->hw_frames_ctx->data;
+	*buffer = (uint8_t*) surface;
+	mlt_frame_set_image( frame, *buffer, size, hwaccel_surface_close );
+	mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "hwsurface.type",
+		av_hwdevice_get_type_name( frames_ctx->device_ctx->type ) );
+	mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "hwsurface.sw_format",
+		av_get_pix_fmt_name( frames_ctx->sw_format ) );
+	return size;
+}
+#endif
+
+// Get the pixel format of the frame last returned by the decoder.
+static int decoded_pix_fmt( producer_avformat self, AVCodecContext *codec_context )
+{
+#ifdef HWACCEL
+	// A downloaded surface is in the software format of the device.
+	if ( self->hwaccel.device_ctx && self->video_frame->format != AV_PIX_FMT_NONE )
+		return self->video_frame->format;
+#endif
+	return codec_context->pix_fmt;
+}
+
 static int allocate_buffer( mlt_frame frame, AVCodecContext *codec_context, uint8_t **buffer, mlt_image_format format, int width, int height )
 {
 	int size = 0;
@@ -1514,10 +2550,57 @@ static int allocate_buffer( mlt_frame frame, AVCodecContext *codec_context, uint
 	return size;
 }
 
-/** Get an image from a frame.
+// Give the frame the image and alpha of a cached frame, sharing them if possible.
+static void share_image( mlt_frame frame, mlt_frame original, uint8_t **buffer )
+{
+	mlt_properties orig_props = MLT_FRAME_PROPERTIES( original );
+	int size = 0;
+
+	*buffer = mlt_frame_share_data( original, "alpha", &size );
+	if ( *buffer )
+		mlt_frame_set_alpha( frame, *buffer, size, mlt_pool_release );
+	else if ( ( *buffer = mlt_properties_get_data( orig_props, "alpha", &size ) ) )
+		mlt_frame_set_alpha( frame, *buffer, size, NULL );
+	*buffer = mlt_frame_share_data( original, "image", &size );
+	if ( *buffer )
+		mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
+	else
+	{
+		*buffer = mlt_properties_get_data( orig_props, "image", &size );
+		mlt_frame_set_image( frame, *buffer, size, NULL );
+	}
+}
+
+// Create the image cache on first use unless it is turned off.
+static void image_cache_init( producer_avformat self, mlt_properties properties )
+{
+	if ( ! self->image_cache )
+	{
+		// if cache size supplied by environment variable
+		int cache_supplied = getenv( "MLT_AVFORMAT_CACHE" ) != NULL;
+		int cache_size = cache_supplied? atoi( getenv( "MLT_AVFORMAT_CACHE" ) ) : 0;
+
+		// cache size supplied via property
+		if ( mlt_properties_get( properties, "cache" ) )
+		{
+			cache_supplied = 1;
+			cache_size = mlt_properties_get_int( properties, "cache" );
+		}
+		if ( mlt_properties_get_int( properties, "noimagecache" ) )
+			cache_size = 0;
+		// create cache if not disabled
+		if ( !cache_supplied || cache_size > 0 )
+			self->image_cache = mlt_cache_init();
+		// set cache size if supplied
+		if ( self->image_cache && cache_supplied )
+			mlt_cache_set_size( self->image_cache, cache_size );
+	}
+}
+
+/** Get an image from a frame with the decoder pushed on it.
 */
 
-static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+static int producer_decode_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	// Get the producer
 	producer_avformat self = mlt_frame_pop_service( frame );
@@ -1532,6 +2615,12 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	// Get the producer properties
 	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
 
+	// A preview smaller than the proxy does not need the original
+	if ( !proxy_get_image( self, frame, buffer, format, width, height ) )
+		return 0;
+
+	prefetch_request( self, frame, *format, *width, *height );
+
 	pthread_mutex_lock( &self->video_mutex );
 
 	uint8_t *alpha = NULL;
@@ -1559,40 +2648,33 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		position = 0;
 
 	// Get the image cache
-	if ( ! self->image_cache )
-	{
-		// if cache size supplied by environment variable
-		int cache_supplied = getenv( "MLT_AVFORMAT_CACHE" ) != NULL;
-		int cache_size = cache_supplied? atoi( getenv( "MLT_AVFORMAT_CACHE" ) ) : 0;
-
-		// cache size supplied via property
-		if ( mlt_properties_get( properties, "cache" ) )
-		{
-			cache_supplied = 1;
-			cache_size = mlt_properties_get_int( properties, "cache" );
-		}
-		if ( mlt_properties_get_int( properties, "noimagecache" ) )
-			cache_size = 0;
-		// create cache if not disabled
-		if ( !cache_supplied || cache_size > 0 )
-			self->image_cache = mlt_cache_init();
-		// set cache size if supplied
-		if ( self->image_cache && cache_supplied )
-			mlt_cache_set_size( self->image_cache, cache_size );
-	}
-	if ( self->image_cache )
+	image_cache_init( self, properties );
+	// Only hardware decoding can provide a surface
+#ifdef HWACCEL
+	if ( *format == mlt_image_hwsurface && !self->hwaccel.device_ctx )
+#else
+	if ( *format == mlt_image_hwsurface )
+#endif
+		*format = mlt_image_yuv422;
+
+	// The shared cache is keyed by what determines the decoded image, so other
+	// producers of the same media can reuse it.
+	char shared_key[ 1024 ] = "";
+	if ( !mlt_properties_get_int( properties, "noimagecache" ) && mlt_cache_shared_get_budget() > 0 )
+		snprintf( shared_key, sizeof( shared_key ), "avformat:%s#%d@%d/%f:%s:%d%s",
+			mlt_properties_get( properties, "resource" ), self->video_index, position,
+			mlt_producer_get_fps( producer ), mlt_image_format_name( *format ), self->autorotate,
+			keyframe_seek_mode( properties ) ? ":keyframe" : "" );
+	if ( self->image_cache || shared_key[0] )
 	{
-		mlt_frame original = mlt_cache_get_frame( self->image_cache, position );
+		mlt_frame original = self->image_cache ? mlt_cache_get_frame( self->image_cache, position ) : NULL;
+		if ( !original && shared_key[0] )
+			original = mlt_cache_shared_get_frame( shared_key );
 		if ( original )
 		{
 			mlt_properties orig_props = MLT_FRAME_PROPERTIES( original );
-			int size = 0;
 
-			*buffer = mlt_properties_get_data( orig_props, "alpha", &size );
-			if (*buffer)
-				mlt_frame_set_alpha( frame, *buffer, size, NULL );
-			*buffer = mlt_properties_get_data( orig_props, "image", &size );
-			mlt_frame_set_image( frame, *buffer, size, NULL );
+			share_image( frame, original, buffer );
 			mlt_properties_set_data( frame_properties, "avformat.image_cache", original, 0, (mlt_destructor) mlt_frame_close, NULL );
 			*format = mlt_properties_get_int( orig_props, "format" );
 			set_image_size( self, width, height );
@@ -1601,6 +2683,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		}
 	}
 	// Cache miss
+	int64_t decode_start = mlt_log_timings_now();
 
 	// We may want to use the source fps if available
 	double source_fps = mlt_properties_get_double( properties, "meta.media.frame_rate_num" ) /
@@ -1613,10 +2696,16 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	const AVCodecDescriptor *descriptor = codec_context->codec? avcodec_descriptor_get( codec_context->codec->id ) : NULL;
 	int must_decode = descriptor && !( descriptor->props & AV_CODEC_PROP_INTRA_ONLY );
 
+	// Only decode the keyframe at or before the frame when it is enough to show where it is.
+	// A consumer that is scrubbing asks for it too, but those images are not cached.
+	int scrubbing = mlt_properties_get_int( frame_properties, "consumer_scrub" ) && !keyframe_seek_mode( properties );
+	int keyframe_only = must_decode && self->video_seekable && ( keyframe_seek_mode( properties ) || scrubbing );
+	int cacheable = !( keyframe_only && scrubbing );
+
 	double delay = mlt_properties_get_double( properties, "video_delay" );
 
 	// Seek if necessary
-	int preseek = must_decode && codec_context->has_b_frames;
+	int preseek = must_decode && codec_context->has_b_frames && !keyframe_only;
 #if defined(FFUDIV)
 	const char *interp = mlt_properties_get( frame_properties, "rescale.interp" );
 	preseek = preseek && interp && strcmp( interp, "nearest" );
@@ -1656,6 +2745,14 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	{
 		// Duplicate it
 		set_image_size( self, width, height );
+#ifdef HWACCEL
+		if ( hwaccel_keep_surface( self, format ) )
+		{
+			if ( ( image_size = hwaccel_attach_surface( self, frame, buffer ) ) )
+				got_picture = 1;
+		}
+		else
+#endif
 		if ( ( image_size = allocate_buffer( frame, codec_context, buffer, *format, *width, *height ) ) )
 		{
 			int yuv_colorspace;
@@ -1674,7 +2771,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			}
 			else
 #endif
-			yuv_colorspace = convert_image( self, self->video_frame, *buffer, codec_context->pix_fmt,
+			yuv_colorspace = convert_image( self, self->video_frame, *buffer, decoded_pix_fmt( self, codec_context ),
 				format, *width, *height, &alpha );
 			mlt_properties_set_int( frame_properties, "colorspace", yuv_colorspace );
 			got_picture = 1;
@@ -1690,6 +2787,12 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		if ( !self->video_frame )
 			self->video_frame = av_frame_alloc();
 
+		if ( keyframe_only )
+		{
+			codec_context->skip_frame = AVDISCARD_NONKEY;
+			codec_context->skip_loop_filter = AVDISCARD_ALL;
+		}
+
 		while( ret >= 0 && !got_picture )
 		{
 			// Read a packet
@@ -1705,7 +2808,13 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			}
 			else
 			{
-				ret = av_read_frame( context, &self->pkt );
+				ret = read_frame( self, context, &self->pkt, 1 );
+				if ( ret == AVERROR( EAGAIN ) )
+				{
+					// Nothing arrived from the live source in time, conceal it with the last image
+					pthread_mutex_unlock( &self->packets_mutex );
+					break;
+				}
 				if ( ret >= 0 && !self->video_seekable && self->pkt.stream_index == self->audio_index )
 				{
 					if ( !av_dup_packet( &self->pkt ) )
@@ -1785,7 +2894,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 					}
 #endif
 					codec_context->reordered_opaque = int_position;
-					if ( int_position >= req_position )
+					if ( int_position >= req_position && !keyframe_only )
 						codec_context->skip_loop_filter = AVDISCARD_NONE;
 					ret = avcodec_decode_video2( codec_context, self->video_frame, &got_picture, &self->pkt );
 					mlt_log_debug( MLT_PRODUCER_SERVICE(producer), "decoded packet with size %d => %d\n", self->pkt.size, ret );
@@ -1825,9 +2934,10 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 						int_position = ( int64_t )( ( av_q2d( self->video_time_base ) * pts + delay ) * source_fps + 0.5 );
 					}
 
-					if ( int_position < req_position )
+					// The first picture after the seek is the keyframe to show
+					if ( int_position < req_position && !keyframe_only )
 						got_picture = 0;
-					else if ( int_position >= req_position )
+					else if ( int_position >= req_position && !keyframe_only )
 						codec_context->skip_loop_filter = AVDISCARD_NONE;
 				}
 				else if ( !self->pkt.data ) // draining decoder with null packets
@@ -1858,6 +2968,21 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				}
 #endif
 				set_image_size( self, width, height );
+#ifdef HWACCEL
+				if ( hwaccel_keep_surface( self, format ) )
+				{
+					if ( ( image_size = hwaccel_attach_surface( self, frame, buffer ) ) )
+					{
+						self->top_field_first |= self->video_frame->top_field_first;
+						self->current_position = int_position;
+					}
+					else
+					{
+						got_picture = 0;
+					}
+				}
+				else
+#endif
 				if ( ( image_size = allocate_buffer( frame, codec_context, buffer, *format, *width, *height ) ) )
 				{
 					int yuv_colorspace;
@@ -1902,7 +3027,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 					}
 					else
 #endif
-					yuv_colorspace = convert_image( self, self->video_frame, *buffer, codec_context->pix_fmt,
+					yuv_colorspace = convert_image( self, self->video_frame, *buffer, decoded_pix_fmt( self, codec_context ),
 						format, *width, *height, &alpha );
 					mlt_properties_set_int( frame_properties, "colorspace", yuv_colorspace );
 					self->top_field_first |= self->video_frame->top_field_first;
@@ -1919,13 +3044,49 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				 !( !self->video_seekable && self->pkt.stream_index == self->audio_index ) )
 				av_free_packet( &self->pkt );
 		}
+
+		if ( keyframe_only )
+		{
+			// The frames in between were skipped, so the next request must seek again
+			codec_context->skip_frame = AVDISCARD_DEFAULT;
+			codec_context->skip_loop_filter = AVDISCARD_NONE;
+			self->last_position = POSITION_INVALID;
+		}
+	}
+
+	// Report the decoding time to find the clips that hold up rendering
+	if ( got_picture )
+	{
+		int64_t decode_time = mlt_log_timings_now() - decode_start;
+		self->decode_time += decode_time;
+		self->decode_count++;
+		mlt_properties_set_int64( frame_properties, "avformat.decode_time", decode_time );
+		mlt_properties_set_int64( frame_properties, "avformat.decode_time_avg", self->decode_time / self->decode_count );
+		mlt_properties_set_int( frame_properties, "avformat.threads", codec_context->thread_count );
+		int64_t io_read, io_wait;
+		if ( !io_cache_stats( self->video_format, &io_read, &io_wait ) )
+		{
+			mlt_properties_set_int64( frame_properties, "avformat.io_read", io_read );
+			mlt_properties_set_int64( frame_properties, "avformat.io_wait", io_wait );
+		}
+		decoder_budget_touch( self );
 	}
 
 	// set alpha
 	if ( alpha )
 		mlt_frame_set_alpha( frame, alpha, (*width) * (*height), mlt_pool_release );
 
-	if ( image_size > 0 )
+	if ( image_size > 0 && *format == mlt_image_hwsurface )
+	{
+		// Surfaces are neither cached nor kept for error concealment
+		mlt_properties_set_int( frame_properties, "format", *format );
+	}
+	else if ( image_size > 0 && !cacheable )
+	{
+		// The keyframe of a scrub is not the image of this position
+		mlt_properties_set_int( frame_properties, "format", *format );
+	}
+	else if ( image_size > 0 )
 	{
 		mlt_properties_set_int( frame_properties, "format", *format );
 		// Cache the image for rapid repeated access.
@@ -1939,6 +3100,8 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				mlt_cache_put_frame( self->image_cache, frame );
 			}
 		}
+		if ( shared_key[0] )
+			mlt_cache_shared_put_frame( shared_key, frame );
 		// Clone frame for error concealment.
 		if ( self->current_position >= self->last_good_position ) {
 			self->last_good_position = self->current_position;
@@ -1952,13 +3115,8 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		// Use last known good frame if there was a decoding failure.
 		mlt_frame original = mlt_frame_clone( self->last_good_frame, 1 );
 		mlt_properties orig_props = MLT_FRAME_PROPERTIES( original );
-		int size = 0;
 
-		*buffer = mlt_properties_get_data( orig_props, "alpha", &size );
-		if (*buffer)
-			mlt_frame_set_alpha( frame, *buffer, size, NULL );
-		*buffer = mlt_properties_get_data( orig_props, "image", &size );
-		mlt_frame_set_image( frame, *buffer, size, NULL );
+		share_image( frame, original, buffer );
 		mlt_properties_set_data( frame_properties, "avformat.conceal_error", original, 0, (mlt_destructor) mlt_frame_close, NULL );
 		*format = mlt_properties_get_int( orig_props, "format" );
 		set_image_size( self, width, height );
@@ -1972,27 +3130,215 @@ exit_get_image:
 
 	pthread_mutex_unlock( &self->video_mutex );
 
-	// Set the progressive flag
-	if ( mlt_properties_get( properties, "force_progressive" ) )
-		mlt_properties_set_int( frame_properties, "progressive", !!mlt_properties_get_int( properties, "force_progressive" ) );
-	else if ( self->video_frame )
-		mlt_properties_set_int( frame_properties, "progressive", !self->video_frame->interlaced_frame );
+	// Set the progressive flag
+	if ( mlt_properties_get( properties, "force_progressive" ) )
+		mlt_properties_set_int( frame_properties, "progressive", !!mlt_properties_get_int( properties, "force_progressive" ) );
+	else if ( self->video_frame )
+		mlt_properties_set_int( frame_properties, "progressive", !self->video_frame->interlaced_frame );
+
+	// Set the field order property for this frame
+	if ( mlt_properties_get( properties, "force_tff" ) )
+		mlt_properties_set_int( frame_properties, "top_field_first", !!mlt_properties_get_int( properties, "force_tff" ) );
+	else
+		mlt_properties_set_int( frame_properties, "top_field_first", self->top_field_first );
+
+	// Set immutable properties of the selected track's (or overridden) source attributes.
+	mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
+	mlt_properties_set_int( properties, "meta.media.top_field_first", self->top_field_first );
+	mlt_properties_set_int( properties, "meta.media.progressive", mlt_properties_get_int( frame_properties, "progressive" ) );
+	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+
+	mlt_log_timings_end( NULL, __FUNCTION__ );
+
+	return !got_picture;
+}
+
+/** Get the block of frames that a position belongs to for the pool of decoders.
+ *
+ * A decoder that is given the frames of a block in order decodes them
+ * without seeking. A block is a group of pictures when the keyframe index
+ * has it, a single frame of a codec that only has keyframes, or else
+ * decoder_range frames.
+ */
+
+static mlt_position decoder_block( producer_avformat self, mlt_position position )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	int range = mlt_properties_get_int( properties, "decoder_range" );
+	mlt_position keyframe;
+
+	if ( range > 0 )
+		return position / range;
+	if ( self->video_codec )
+	{
+		const AVCodecDescriptor *descriptor = avcodec_descriptor_get( self->video_codec->codec_id );
+		if ( descriptor && ( descriptor->props & AV_CODEC_PROP_INTRA_ONLY ) )
+			return position;
+	}
+	keyframe = keyframe_position_before( self, position );
+	return keyframe >= 0 ? keyframe : position / DECODER_RANGE;
+}
+
+// Make an extra decoder of the pool, which opens the file on first use.
+static producer_avformat decoder_new( producer_avformat self )
+{
+	producer_avformat decoder = calloc( 1, sizeof( struct producer_avformat_s ) );
+	if ( decoder )
+	{
+		decoder->parent = self->parent;
+		decoder->pool_member = 1;
+		decoder->image_cache = self->image_cache;
+		init_mutexes( decoder );
+	}
+	return decoder;
+}
+
+/** Choose the decoder of the pool for a frame.
+ *
+ * The decoder that was last given the block of the frame gets it. Otherwise
+ * one that is not decoding gets it, or a new one while there are fewer than
+ * the decoders property, or else the least busy one.
+ * \return the index of the decoder in the pool
+ */
+
+static int decoder_acquire( producer_avformat self, mlt_position position )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	int count = FFMIN( mlt_properties_get_int( properties, "decoders" ), MAX_DECODERS );
+	mlt_position block = decoder_block( self, position );
+	int i, best = -1;
+
+	pthread_mutex_lock( &self->pool.mutex );
+	if ( !self->pool.count )
+	{
+		self->pool.decoders[0] = self;
+		self->pool.block[0] = POSITION_INVALID;
+		self->pool.count = 1;
+	}
+	for ( i = 0; i < self->pool.count && best < 0; i++ )
+		if ( self->pool.block[i] == block )
+			best = i;
+	for ( i = 0; i < self->pool.count && best < 0; i++ )
+		if ( !self->pool.busy[i] )
+			best = i;
+	if ( best < 0 && self->pool.count < count )
+	{
+		producer_avformat decoder = decoder_new( self );
+		if ( decoder )
+		{
+			best = self->pool.count++;
+			self->pool.decoders[best] = decoder;
+			self->pool.busy[best] = 0;
+		}
+	}
+	if ( best < 0 )
+	{
+		best = 0;
+		for ( i = 1; i < self->pool.count; i++ )
+			if ( self->pool.busy[i] < self->pool.busy[best] )
+				best = i;
+	}
+	self->pool.block[best] = block;
+	self->pool.busy[best]++;
+	pthread_mutex_unlock( &self->pool.mutex );
+
+	return best;
+}
+
+static void decoder_release( producer_avformat self, int index )
+{
+	pthread_mutex_lock( &self->pool.mutex );
+	self->pool.busy[index]--;
+	pthread_mutex_unlock( &self->pool.mutex );
+}
+
+/** Open the file and video decoder of an extra decoder of a pool.
+ *
+ * Only the first decoder of a pool keeps an audio context.
+ * \return true on error
+ */
+
+static int decoder_open( producer_avformat self )
+{
+	mlt_producer producer = self->parent;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	int error = 0;
+
+	pthread_mutex_lock( &self->video_mutex );
+	if ( !self->video_format )
+	{
+		error = producer_open( self, mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) ),
+			mlt_properties_get( properties, "resource" ), 0, 0 );
+		pthread_mutex_lock( &self->open_mutex );
+		if ( self->audio_format && self->audio_format != self->video_format )
+			io_cache_close_input( &self->audio_format );
+		self->audio_format = NULL;
+		pthread_mutex_unlock( &self->open_mutex );
+		if ( !error && self->video_format )
+		{
+			int index = mlt_properties_get_int( properties, "video_index" );
+			if ( index > -1 && index < (int) self->video_format->nb_streams )
+				self->video_index = index;
+			error = !video_codec_init( self, self->video_index, properties );
+		}
+	}
+	error = error || !self->video_format || !self->video_codec;
+	pthread_mutex_unlock( &self->video_mutex );
+
+	return error;
+}
+
+static void decoder_pool_close( producer_avformat self )
+{
+	int i;
+	for ( i = 1; i < self->pool.count; i++ )
+	{
+		// The image cache belongs to the first one
+		self->pool.decoders[i]->image_cache = NULL;
+		producer_avformat_close( self->pool.decoders[i] );
+	}
+	self->pool.count = 0;
+}
+
+/** Get an image from a frame.
+ *
+ * With the decoders property above 1, the frames of a seekable source are
+ * shared out among a pool of decoders by blocks, so that the threads of a
+ * consumer with real_time below -1 decode different blocks in parallel
+ * instead of taking turns on one decoder, which would seek between them.
+ */
 
-	// Set the field order property for this frame
-	if ( mlt_properties_get( properties, "force_tff" ) )
-		mlt_properties_set_int( frame_properties, "top_field_first", !!mlt_properties_get_int( properties, "force_tff" ) );
-	else
-		mlt_properties_set_int( frame_properties, "top_field_first", self->top_field_first );
+static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+{
+	producer_avformat self = mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	producer_avformat decoder = self;
+	int index = -1;
+	int error;
 
-	// Set immutable properties of the selected track's (or overridden) source attributes.
-	mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
-	mlt_properties_set_int( properties, "meta.media.top_field_first", self->top_field_first );
-	mlt_properties_set_int( properties, "meta.media.progressive", mlt_properties_get_int( frame_properties, "progressive" ) );
-	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+	// Frames decoded ahead belong to the decoder that asked for them
+	if ( !self->pool_member && self->seekable && mlt_properties_get_int( properties, "decoders" ) > 1
+		 && !mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "avformat.prefetch" ) )
+	{
+		if ( !proxy_get_image( self, frame, buffer, format, width, height ) )
+			return 0;
+		image_cache_init( self, properties );
+		index = decoder_acquire( self, mlt_frame_original_position( frame ) );
+		decoder = self->pool.decoders[ index ];
+		if ( decoder != self && decoder_open( decoder ) )
+		{
+			decoder_release( self, index );
+			decoder = self;
+			index = -1;
+		}
+	}
 
-	mlt_log_timings_end( NULL, __FUNCTION__ );
+	mlt_frame_push_service( frame, decoder );
+	error = producer_decode_image( frame, buffer, format, width, height, writable );
+	if ( index >= 0 )
+		decoder_release( self, index );
 
-	return !got_picture;
+	return error;
 }
 
 /** Process properties as AVOptions and apply to AV context obj
@@ -2062,9 +3408,28 @@ static int video_codec_init( producer_avformat self, int index, mlt_properties p
 		int thread_count = mlt_properties_get_int( properties, "threads" );
 		if ( thread_count == 0 && getenv( "MLT_AVFORMAT_THREADS" ) )
 			thread_count = atoi( getenv( "MLT_AVFORMAT_THREADS" ) );
+		if ( thread_count == 0 && !mlt_properties_get( properties, "threads" ) && !getenv( "MLT_AVFORMAT_THREADS" ) )
+			thread_count = decoder_budget_register( self );
 		if ( thread_count >= 0 )
 			codec_context->thread_count = thread_count;
 
+#ifdef HWACCEL
+		hwaccel_init( self, codec_context, codec, properties );
+#endif
+
+		// For thumbnails, decode at the lowest resolution that still covers the profile
+		if ( codec && keyframe_seek_mode( properties ) && !mlt_properties_get( properties, "lowres" )
+			 && !mlt_properties_get( properties, "hwaccel" ) )
+		{
+			mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self->parent ) );
+			int lowres = 0;
+			while ( lowres < codec->max_lowres
+					&& ( codec_context->width >> ( lowres + 1 ) ) >= profile->width
+					&& ( codec_context->height >> ( lowres + 1 ) ) >= profile->height )
+				lowres++;
+			codec_context->lowres = lowres;
+		}
+
 		// If we don't have a codec and we can't initialise it, we can't do much more...
 		pthread_mutex_lock( &self->open_mutex );
 		if ( codec && avcodec_open2( codec_context, codec, NULL ) >= 0 )
@@ -2216,6 +3581,203 @@ static int video_codec_init( producer_avformat self, int index, mlt_properties p
 /** Set up video handling.
 */
 
+/** Decode ahead of sequential requests into the image cache.
+*/
+
+static void *prefetch_thread( void *arg )
+{
+	producer_avformat self = arg;
+	mlt_service service = MLT_PRODUCER_SERVICE( self->parent );
+
+	pthread_mutex_lock( &self->prefetch.mutex );
+	while ( !self->prefetch.stop )
+	{
+		if ( self->prefetch.next > self->prefetch.end )
+		{
+			pthread_cond_wait( &self->prefetch.cond, &self->prefetch.mutex );
+			continue;
+		}
+		mlt_position position = self->prefetch.next++;
+		mlt_image_format format = self->prefetch.format;
+		int width = self->prefetch.width;
+		int height = self->prefetch.height;
+		mlt_frame frame = mlt_frame_init( service );
+		if ( frame )
+		{
+			mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+			mlt_properties_set_position( properties, "original_position", position );
+			mlt_properties_set_int( properties, "avformat.prefetch", 1 );
+			if ( self->prefetch.interp[0] )
+				mlt_properties_set( properties, "rescale.interp", self->prefetch.interp );
+		}
+		pthread_mutex_unlock( &self->prefetch.mutex );
+
+		// producer_get_image puts the result into the image cache.
+		if ( frame )
+		{
+			uint8_t *image = NULL;
+			mlt_frame_push_service( frame, self );
+			producer_get_image( frame, &image, &format, &width, &height, 0 );
+			mlt_frame_close( frame );
+		}
+
+		pthread_mutex_lock( &self->prefetch.mutex );
+		if ( position >= self->prefetch.low && position <= self->prefetch.end )
+			self->prefetch.done = position;
+		pthread_cond_broadcast( &self->prefetch.cond );
+	}
+	pthread_mutex_unlock( &self->prefetch.mutex );
+
+	return NULL;
+}
+
+/** Get the position of the last keyframe at or before a position.
+ *
+ * \return the position, or -1 if the keyframe index is not available
+ */
+
+static mlt_position keyframe_position_before( producer_avformat self, mlt_position position )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	double source_fps = mlt_properties_get_double( properties, "meta.media.frame_rate_num" ) /
+		mlt_properties_get_double( properties, "meta.media.frame_rate_den" );
+	double fps = mlt_producer_get_fps( self->parent );
+	mlt_position result = -1;
+
+	pthread_mutex_lock( &self->packets_mutex );
+	if ( self->seek_index && self->video_format && av_q2d( self->video_time_base ) != 0 && source_fps > 0 )
+	{
+		int64_t req_position = ( int64_t )( position / fps * source_fps + 0.5 );
+		int64_t timestamp = seek_index_keyframe_before( self->seek_index, frame_timestamp( self, req_position, source_fps ) );
+		int64_t start = self->first_pts != AV_NOPTS_VALUE ? self->first_pts
+			: self->video_format->start_time != AV_NOPTS_VALUE ? self->video_format->start_time : 0;
+		if ( timestamp != AV_NOPTS_VALUE )
+			// The first position that is not before the keyframe
+			result = FFMAX( 0, ( mlt_position ) ceil( ( timestamp - start ) * av_q2d( self->video_time_base ) * fps - 0.001 ) );
+	}
+	pthread_mutex_unlock( &self->packets_mutex );
+
+	return result <= position ? result : -1;
+}
+
+/** Detect sequential access and keep the read-ahead thread up to \p prefetch frames ahead.
+ *
+ * When frames are requested in reverse order, the read-ahead thread instead
+ * decodes blocks of up to \p prefetch frames before the request in forward
+ * order, one block ahead of the one being played. A block starts at a
+ * keyframe when the keyframe index has one within it, so that a group of
+ * pictures no longer than \p prefetch frames is decoded only once. A request
+ * for a frame of the block being decoded waits for it instead of seeking.
+ *
+ * Any other access cancels decoding ahead. The request then seeks as usual in
+ * seek_video() once the read-ahead thread has finished its current frame.
+ */
+
+static void prefetch_request( producer_avformat self, mlt_frame frame, mlt_image_format format, int width, int height )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+	int count = mlt_properties_get_int( properties, "prefetch" );
+	mlt_position position = mlt_frame_original_position( frame );
+
+	if ( count <= 0 || !self->image_cache || !self->is_mutex_init
+		 || mlt_properties_get_int( frame_properties, "avformat.prefetch" ) )
+		return;
+
+	pthread_mutex_lock( &self->prefetch.mutex );
+	if ( position == self->prefetch.last + 1 )
+	{
+		self->prefetch.sequential++;
+		self->prefetch.reverse = 0;
+	}
+	else if ( position == self->prefetch.last - 1 )
+	{
+		self->prefetch.sequential = 0;
+		self->prefetch.reverse++;
+	}
+	else
+	{
+		self->prefetch.sequential = 0;
+		self->prefetch.reverse = 0;
+		self->prefetch.next = position + 1;
+	}
+	self->prefetch.last = position;
+	if ( self->prefetch.reverse >= 2 )
+	{
+		// Make room in the cache for the block being played and the one before it.
+		if ( mlt_cache_get_size( self->image_cache ) < 2 * count + 2 )
+			mlt_cache_set_size( self->image_cache, 2 * count + 2 );
+		if ( self->prefetch.reverse == 2 )
+		{
+			// This request decodes its own frame; start the blocks before it.
+			self->prefetch.low = position;
+			self->prefetch.end = position;
+			self->prefetch.done = position;
+			self->prefetch.next = position + 1;
+		}
+		self->prefetch.format = format;
+		self->prefetch.width = width;
+		self->prefetch.height = height;
+		snprintf( self->prefetch.interp, sizeof( self->prefetch.interp ), "%s",
+			mlt_properties_get( frame_properties, "rescale.interp" ) ? mlt_properties_get( frame_properties, "rescale.interp" ) : "" );
+		if ( self->prefetch.next > self->prefetch.end && self->prefetch.low > 0
+			 && position - self->prefetch.low < count )
+		{
+			mlt_position end = self->prefetch.low - 1;
+			mlt_position start = FFMAX( 0, end - count + 1 );
+			mlt_position keyframe = keyframe_position_before( self, end );
+			if ( keyframe >= start )
+				start = keyframe;
+			self->prefetch.next = start;
+			self->prefetch.end = end;
+			self->prefetch.low = start;
+			self->prefetch.done = start - 1;
+			if ( !self->prefetch.started )
+				self->prefetch.started = !pthread_create( &self->prefetch.thread, NULL, prefetch_thread, self );
+			pthread_cond_broadcast( &self->prefetch.cond );
+		}
+		// Wait for the frame if it is in the block being decoded.
+		while ( self->prefetch.started && !self->prefetch.stop && position >= self->prefetch.low
+				&& position <= self->prefetch.end && position > self->prefetch.done )
+			pthread_cond_wait( &self->prefetch.cond, &self->prefetch.mutex );
+	}
+	else if ( self->prefetch.sequential >= 2 )
+	{
+		// Make room in the cache for the frames ahead and the one in use.
+		if ( mlt_cache_get_size( self->image_cache ) < count + 2 )
+			mlt_cache_set_size( self->image_cache, count + 2 );
+		if ( self->prefetch.next <= position )
+			self->prefetch.next = position + 1;
+		self->prefetch.end = FFMIN( position + count, mlt_producer_get_length( self->parent ) - 1 );
+		self->prefetch.format = format;
+		self->prefetch.width = width;
+		self->prefetch.height = height;
+		snprintf( self->prefetch.interp, sizeof( self->prefetch.interp ), "%s",
+			mlt_properties_get( frame_properties, "rescale.interp" ) ? mlt_properties_get( frame_properties, "rescale.interp" ) : "" );
+		if ( !self->prefetch.started )
+			self->prefetch.started = !pthread_create( &self->prefetch.thread, NULL, prefetch_thread, self );
+		pthread_cond_broadcast( &self->prefetch.cond );
+	}
+	else
+	{
+		self->prefetch.end = position;
+	}
+	pthread_mutex_unlock( &self->prefetch.mutex );
+}
+
+static void prefetch_close( producer_avformat self )
+{
+	if ( self->is_mutex_init && self->prefetch.started )
+	{
+		pthread_mutex_lock( &self->prefetch.mutex );
+		self->prefetch.stop = 1;
+		pthread_cond_broadcast( &self->prefetch.cond );
+		pthread_mutex_unlock( &self->prefetch.mutex );
+		pthread_join( self->prefetch.thread, NULL );
+		self->prefetch.started = 0;
+	}
+}
+
 static void producer_set_up_video( producer_avformat self, mlt_frame frame )
 {
 	// Get the producer
@@ -2369,13 +3931,28 @@ static int seek_audio( producer_avformat self, mlt_position position, double tim
 			// Clear the usage in the audio buffer
 			int i = MAX_AUDIO_STREAMS + 1;
 			while ( --i )
+			{
 				self->audio_used[i - 1] = 0;
+				self->audio_offset[i - 1] = 0;
+			}
 		}
 	}
 	pthread_mutex_unlock( &self->packets_mutex );
 	return paused;
 }
 
+/** Consume samples from the front of the audio buffer of a stream.
+ *
+ * This only advances the read offset; decode_audio() moves the unused samples
+ * to the front when it needs the space.
+ */
+
+static void consume_audio( producer_avformat self, int index, int samples )
+{
+	self->audio_used[ index ] -= samples;
+	self->audio_offset[ index ] = self->audio_used[ index ] ? self->audio_offset[ index ] + samples : 0;
+}
+
 static int sample_bytes( AVCodecContext *context )
 {
 	return av_get_bytes_per_sample( context->sample_fmt );
@@ -2411,6 +3988,7 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 
 	int channels = codec_context->channels;
 	int audio_used = self->audio_used[ index ];
+	int audio_offset = self->audio_offset[ index ];
 	int ret = 0;
 	int discarded = 1;
 
@@ -2442,13 +4020,23 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 			int convert_samples = self->audio_frame->nb_samples;
 			channels = codec_context->channels;
 
-			// Resize audio buffer to prevent overflow
-			if ( ( audio_used + convert_samples ) * channels * sizeof_sample > self->audio_buffer_size[ index ] )
+			// Move the unused samples to the front only when the new ones do not fit after them
+			if ( ( audio_offset + audio_used + convert_samples ) * channels * sizeof_sample > self->audio_buffer_size[ index ] )
 			{
-				self->audio_buffer_size[ index ] = ( audio_used + convert_samples * 2 ) * channels * sizeof_sample;
-				audio_buffer = self->audio_buffer[ index ] = mlt_pool_realloc( audio_buffer, self->audio_buffer_size[ index ] );
+				if ( audio_offset )
+				{
+					memmove( audio_buffer, &audio_buffer[ audio_offset * channels * sizeof_sample ],
+							 audio_used * channels * sizeof_sample );
+					audio_offset = 0;
+				}
+				// Resize audio buffer to prevent overflow
+				if ( ( audio_used + convert_samples ) * channels * sizeof_sample > self->audio_buffer_size[ index ] )
+				{
+					self->audio_buffer_size[ index ] = ( audio_used + convert_samples * 2 ) * channels * sizeof_sample;
+					audio_buffer = self->audio_buffer[ index ] = mlt_pool_realloc( audio_buffer, self->audio_buffer_size[ index ] );
+				}
 			}
-			uint8_t *dest = &audio_buffer[ audio_used * channels * sizeof_sample ];
+			uint8_t *dest = &audio_buffer[ ( audio_offset + audio_used ) * channels * sizeof_sample ];
 			switch ( codec_context->sample_fmt )
 			{
 			case AV_SAMPLE_FMT_U8P:
@@ -2474,8 +4062,7 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 			int n = FFMIN( audio_used, *ignore );
 			*ignore -= n;
 			audio_used -= n;
-			memmove( audio_buffer, &audio_buffer[ n * channels * sizeof_sample ],
-					 audio_used * channels * sizeof_sample );
+			audio_offset = audio_used ? audio_offset + n : 0;
 		}
 	}
 
@@ -2518,10 +4105,180 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 	}
 
 	self->audio_used[ index ] = audio_used;
+	self->audio_offset[ index ] = audio_offset;
 
 	return ret;
 }
 
+static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples );
+
+static void *audio_prefetch_thread( void *arg )
+{
+	producer_avformat self = arg;
+	mlt_service service = MLT_PRODUCER_SERVICE( self->parent );
+
+	pthread_mutex_lock( &self->audio_prefetch.mutex );
+	while ( !self->audio_prefetch.stop )
+	{
+		if ( self->audio_prefetch.next > self->audio_prefetch.end )
+		{
+			pthread_cond_wait( &self->audio_prefetch.cond, &self->audio_prefetch.mutex );
+			continue;
+		}
+		mlt_position position = self->audio_prefetch.next++;
+		int frequency = self->audio_prefetch.frequency;
+		int channels = self->audio_prefetch.channels;
+		mlt_frame frame = mlt_frame_init( service );
+		if ( frame )
+		{
+			mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+			mlt_properties_set_position( properties, "original_position", position );
+			mlt_properties_set_int( properties, "avformat.prefetch", 1 );
+			mlt_properties_set_double( properties, "producer_consumer_fps", self->audio_prefetch.fps );
+		}
+		pthread_mutex_unlock( &self->audio_prefetch.mutex );
+
+		// producer_get_audio puts the result into the audio cache.
+		if ( frame )
+		{
+			void *buffer = NULL;
+			mlt_audio_format format = mlt_audio_s16;
+			int samples = 0;
+
+			mlt_frame_push_audio( frame, self );
+			producer_get_audio( frame, &buffer, &format, &frequency, &channels, &samples );
+			mlt_frame_close( frame );
+		}
+
+		pthread_mutex_lock( &self->audio_prefetch.mutex );
+	}
+	pthread_mutex_unlock( &self->audio_prefetch.mutex );
+
+	return NULL;
+}
+
+/** Detect sequential access and keep the audio read-ahead thread up to
+ * \p audio_prefetch frames ahead.
+ *
+ * This is called with the audio mutex held, as in prefetch_request() any other
+ * access cancels decoding ahead.
+ */
+
+static void audio_prefetch_request( producer_avformat self, mlt_frame frame, mlt_position position, double fps, int frequency, int channels )
+{
+	int count = mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( self->parent ), "audio_prefetch" );
+
+	if ( count <= 0 || !self->is_mutex_init
+		 || mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "avformat.prefetch" ) )
+		return;
+
+	pthread_mutex_lock( &self->audio_prefetch.mutex );
+	if ( position == self->audio_prefetch.last + 1 && fps == self->audio_prefetch.fps )
+	{
+		self->audio_prefetch.sequential++;
+	}
+	else
+	{
+		self->audio_prefetch.sequential = 0;
+		self->audio_prefetch.next = position + 1;
+	}
+	self->audio_prefetch.last = position;
+	self->audio_prefetch.fps = fps;
+	if ( self->audio_prefetch.sequential >= 2 )
+	{
+		// Make room in the cache for the frames ahead and the one in use.
+		if ( !self->audio_cache )
+			self->audio_cache = mlt_cache_init();
+		if ( mlt_cache_get_size( self->audio_cache ) < count + 2 )
+			mlt_cache_set_size( self->audio_cache, count + 2 );
+		if ( self->audio_prefetch.next <= position )
+			self->audio_prefetch.next = position + 1;
+		self->audio_prefetch.end = FFMIN( position + count, mlt_producer_get_length( self->parent ) - 1 );
+		self->audio_prefetch.frequency = frequency;
+		self->audio_prefetch.channels = channels;
+		if ( !self->audio_prefetch.started )
+			self->audio_prefetch.started = !pthread_create( &self->audio_prefetch.thread, NULL, audio_prefetch_thread, self );
+		pthread_cond_signal( &self->audio_prefetch.cond );
+	}
+	else
+	{
+		self->audio_prefetch.end = position;
+	}
+	pthread_mutex_unlock( &self->audio_prefetch.mutex );
+}
+
+/** Put the audio decoded ahead into the audio cache.
+ *
+ * This is called with the audio mutex held so that a request for the same
+ * position waits for it instead of decoding it again.
+ */
+
+static void audio_prefetch_put( producer_avformat self, mlt_frame frame, int frequency, int channels, int samples )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+
+	if ( !self->audio_cache || !mlt_properties_get_int( properties, "avformat.prefetch" )
+		 || !mlt_properties_get_data( properties, "audio", NULL ) )
+		return;
+	mlt_properties_set_int( properties, "audio_frequency", frequency );
+	mlt_properties_set_int( properties, "audio_channels", channels );
+	mlt_properties_set_int( properties, "audio_samples", samples );
+	mlt_properties_set_int( properties, "avformat.audio_index", self->audio_index );
+	mlt_cache_put_frame( self->audio_cache, frame );
+}
+
+/** Get the audio of a position from the audio decoded ahead.
+ *
+ * \return true if the audio of the frame was set
+ */
+
+static int audio_prefetch_get( producer_avformat self, mlt_frame frame, mlt_position position, double fps,
+	void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	mlt_frame cached;
+	int result = 0;
+
+	if ( !self->audio_cache || mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "avformat.prefetch" ) )
+		return 0;
+	cached = mlt_cache_get_frame( self->audio_cache, position );
+	if ( cached )
+	{
+		mlt_properties properties = MLT_FRAME_PROPERTIES( cached );
+		int size = 0;
+		void *audio = mlt_properties_get_data( properties, "audio", &size );
+
+		if ( audio && size > 0
+			 && mlt_properties_get_double( properties, "producer_consumer_fps" ) == fps
+			 && mlt_properties_get_int( properties, "avformat.audio_index" ) == self->audio_index )
+		{
+			*format = mlt_properties_get_int( properties, "audio_format" );
+			*frequency = mlt_properties_get_int( properties, "audio_frequency" );
+			*channels = mlt_properties_get_int( properties, "audio_channels" );
+			*samples = mlt_properties_get_int( properties, "audio_samples" );
+			*buffer = mlt_pool_alloc( size );
+			memcpy( *buffer, audio, size );
+			mlt_frame_set_audio( frame, *buffer, *format, size, mlt_pool_release );
+			mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "channel_layout", mlt_properties_get( properties, "channel_layout" ) );
+			result = 1;
+		}
+		mlt_frame_close( cached );
+	}
+	return result;
+}
+
+static void audio_prefetch_close( producer_avformat self )
+{
+	if ( self->is_mutex_init && self->audio_prefetch.started )
+	{
+		pthread_mutex_lock( &self->audio_prefetch.mutex );
+		self->audio_prefetch.stop = 1;
+		pthread_cond_signal( &self->audio_prefetch.cond );
+		pthread_mutex_unlock( &self->audio_prefetch.mutex );
+		pthread_join( self->audio_prefetch.thread, NULL );
+		self->audio_prefetch.started = 0;
+	}
+}
+
 /** Get the audio from a frame.
 */
 static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
@@ -2542,6 +4299,15 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	if ( mlt_properties_get( MLT_FRAME_PROPERTIES(frame), "producer_consumer_fps" ) )
 		fps = mlt_properties_get_double( MLT_FRAME_PROPERTIES(frame), "producer_consumer_fps" );
 
+	// Use the audio decoded ahead without touching the decoder, which is
+	// already further ahead.
+	if ( audio_prefetch_get( self, frame, position, fps, buffer, format, frequency, channels, samples ) )
+	{
+		audio_prefetch_request( self, frame, position, fps, *frequency, *channels );
+		pthread_mutex_unlock( &self->audio_mutex );
+		return 0;
+	}
+
 	// Number of frames to ignore (for ffwd)
 	int ignore[ MAX_AUDIO_STREAMS ] = { 0 };
 
@@ -2588,6 +4354,7 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 			// Check for audio buffer and create if necessary
 			self->audio_buffer_size[ index ] = MAX_AUDIO_FRAME_SIZE * sizeof_sample;
 			self->audio_buffer[ index ] = mlt_pool_alloc( self->audio_buffer_size[ index ] );
+			self->audio_offset[ index ] = 0;
 
 			// Check for decoder buffer and create if necessary
 			self->decode_buffer[ index ] = av_malloc( self->audio_buffer_size[ index ] );
@@ -2639,7 +4406,8 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 			}
 			else
 			{
-				ret = av_read_frame( context, &pkt );
+				// When nothing arrived from a live source in time, the rest is silent
+				ret = read_frame( self, context, &pkt, 0 );
 				if ( ret >= 0 && !self->seekable && pkt.stream_index == self->video_index )
 				{
 					if ( !av_dup_packet( &pkt ) )
@@ -2649,7 +4417,7 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 						mlt_deque_push_back( self->vpackets, tmp );
 					}
 				}
-				else if ( ret < 0 )
+				else if ( ret < 0 && ret != AVERROR( EAGAIN ) )
 				{
 					mlt_producer producer = self->parent;
 					mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
@@ -2729,19 +4497,17 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 				if ( self->audio_codec[ index ] )
 				{
 					int current_channels = self->audio_codec[ index ]->channels;
-					uint8_t *src = self->audio_buffer[ index ] + i * current_channels * sizeof_sample;
-					memcpy( dest, src, current_channels * sizeof_sample );
+					uint8_t *src = self->audio_buffer[ index ] + ( self->audio_offset[ index ] + i ) * current_channels * sizeof_sample;
+					if ( i < self->audio_used[ index ] )
+						memcpy( dest, src, current_channels * sizeof_sample );
+					else
+						memset( dest, 0, current_channels * sizeof_sample );
 					dest += current_channels * sizeof_sample;
 				}
 			}
 			for ( index = 0; index < index_max; index++ )
 			if ( self->audio_codec[ index ] && self->audio_used[ index ] >= *samples )
-			{
-				int current_channels = self->audio_codec[ index ]->channels;
-				uint8_t *src = self->audio_buffer[ index ] + *samples * current_channels * sizeof_sample;
-				self->audio_used[index] -= *samples;
-				memmove( self->audio_buffer[ index ], src, self->audio_used[ index ] * current_channels * sizeof_sample );
-			}
+				consume_audio( self, index, *samples );
 		}
 		// Copy a single track to the output buffer
 		else
@@ -2751,16 +4517,14 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 			// Now handle the audio if we have enough
 			if ( self->audio_used[ index ] > 0 )
 			{
-				uint8_t *src = self->audio_buffer[ index ];
+				uint8_t *src = self->audio_buffer[ index ] + self->audio_offset[ index ] * *channels * sizeof_sample;
 				// copy samples from audio_buffer
 				size = self->audio_used[ index ] < *samples ? self->audio_used[ index ] : *samples;
 				memcpy( *buffer, src, size * *channels * sizeof_sample );
 				// supply the remaining requested samples as silence
 				if ( *samples > self->audio_used[ index ] )
 					memset( *buffer + size * *channels * sizeof_sample, 0, ( *samples - self->audio_used[ index ] ) * *channels * sizeof_sample );
-				// reposition the samples within audio_buffer
-				self->audio_used[ index ] -= size;
-				memmove( src, src + size * *channels * sizeof_sample, self->audio_used[ index ] * *channels * sizeof_sample );
+				consume_audio( self, index, size );
 			}
 			else
 			{
@@ -2780,6 +4544,8 @@ exit_get_audio:
 	if ( !paused )
 		self->audio_expected = position + 1;
 
+	audio_prefetch_put( self, frame, *frequency, *channels, *samples );
+	audio_prefetch_request( self, frame, position, fps, *frequency, *channels );
 	pthread_mutex_unlock( &self->audio_mutex );
 
 	return 0;
@@ -2920,24 +4686,231 @@ static void producer_set_up_audio( producer_avformat self, mlt_frame frame )
 	}
 }
 
+/** The producers that can share the demuxer and decoders of another one.
+ *
+ * Producers of the same file with the same properties, except those of the
+ * edit like in and out, and the same profile decode the same frames. When
+ * the share property asks for it, the later ones use the state of the first
+ * as if they were cuts of it. This keeps one set of contexts and file handles
+ * open for all the clips cut from a file, counts them once in the producer
+ * cache, and a clip that starts where another one ends continues decoding
+ * without a seek. It is only meant for cuts that do not play at the same
+ * time, which would seek the shared decoder back and forth.
+ */
+
+typedef struct shared_producer_s *shared_producer;
+struct shared_producer_s
+{
+	mlt_producer producer;
+	uint64_t key;         ///< a hash of the properties that matter to decoding
+	int generation;       ///< the generation of the service the key was made at
+	shared_producer next;
+
+	// The owner found by get_frame and what it depends on, only used by the producer itself
+	mlt_producer owner;
+	int resolved;
+	int producer_generation;
+	int owner_generation;
+	uint64_t profile_key;
+	uint64_t owner_profile_key;
+};
+
+static struct
+{
+	pthread_mutex_t mutex;
+	shared_producer producers;
+} shared_producers = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static int is_share_property( const char *name )
+{
+	return name[0] != '_' && strncmp( name, "meta.", 5 ) && strncmp( name, "set.", 4 ) && !strchr( name, ':' )
+		&& strcmp( name, "in" ) && strcmp( name, "out" ) && strcmp( name, "length" ) && strcmp( name, "eof" )
+		&& strcmp( name, "id" ) && strcmp( name, "title" ) && strcmp( name, "share" );
+}
+
+// Get a hash of the parts of the profile that positions and times depend on.
+static uint64_t share_profile_key( mlt_producer producer )
+{
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
+	uint64_t hash = 14695981039346656037ULL;
+
+	if ( profile )
+	{
+		hash = ( hash ^ (uint32_t) profile->frame_rate_num ) * 1099511628211ULL;
+		hash = ( hash ^ (uint32_t) profile->frame_rate_den ) * 1099511628211ULL;
+		hash = ( hash ^ (uint32_t) profile->width ) * 1099511628211ULL;
+		hash = ( hash ^ (uint32_t) profile->height ) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Get the key of a producer, called with the mutex held.
+static uint64_t share_key( shared_producer entry )
+{
+	mlt_service service = MLT_PRODUCER_SERVICE( entry->producer );
+	int generation = mlt_service_generation( service );
+
+	if ( entry->generation != generation )
+	{
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( entry->producer );
+		uint64_t hash = 14695981039346656037ULL;
+		int i;
+
+		mlt_properties_lock( properties );
+		for ( i = 0; i < mlt_properties_count( properties ); i++ )
+		{
+			const char *name = mlt_properties_get_name( properties, i );
+			const char *value = mlt_properties_get_value( properties, i );
+			const char *c;
+			if ( !name || !value || !is_share_property( name ) )
+				continue;
+			for ( c = name; *c; c++ )
+				hash = ( hash ^ ( unsigned char ) *c ) * 1099511628211ULL;
+			hash = ( hash ^ '=' ) * 1099511628211ULL;
+			for ( c = value; *c; c++ )
+				hash = ( hash ^ ( unsigned char ) *c ) * 1099511628211ULL;
+			hash = ( hash ^ '\n' ) * 1099511628211ULL;
+		}
+		mlt_properties_unlock( properties );
+		entry->key = hash;
+		entry->generation = generation;
+	}
+
+	// The profile can change without a change to the producer
+	return ( entry->key ^ share_profile_key( entry->producer ) ) * 1099511628211ULL;
+}
+
+static int share_enabled( mlt_producer producer )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	const char *env = getenv( "MLT_AVFORMAT_SHARE" );
+	if ( mlt_properties_get( properties, "share" ) )
+		return mlt_properties_get_int( properties, "share" );
+	return env && atoi( env );
+}
+
+static void share_register( mlt_producer producer )
+{
+	shared_producer entry = calloc( 1, sizeof( *entry ) );
+	shared_producer *p;
+
+	if ( !entry )
+		return;
+	entry->producer = producer;
+	entry->generation = -1;
+	pthread_mutex_lock( &shared_producers.mutex );
+	for ( p = &shared_producers.producers; *p; p = &(*p)->next );
+	*p = entry;
+	pthread_mutex_unlock( &shared_producers.mutex );
+	mlt_properties_set_data( MLT_PRODUCER_PROPERTIES( producer ), "_share_entry", entry, 0, NULL, NULL );
+}
+
+static void share_unregister( mlt_producer producer )
+{
+	shared_producer *p;
+
+	mlt_properties_set_data( MLT_PRODUCER_PROPERTIES( producer ), "_share_entry", NULL, 0, NULL, NULL );
+	pthread_mutex_lock( &shared_producers.mutex );
+	for ( p = &shared_producers.producers; *p; p = &(*p)->next )
+	{
+		if ( (*p)->producer == producer )
+		{
+			shared_producer entry = *p;
+			*p = entry->next;
+			free( entry );
+			break;
+		}
+	}
+	pthread_mutex_unlock( &shared_producers.mutex );
+}
+
+/** Find the producer whose state a producer uses.
+ *
+ * A producer that shares the state of an earlier one holds a reference to it.
+ * The owner is looked up again only after a change to the producer, the owner,
+ * or their profiles.
+ * \return the earliest producer with the same key, or the producer itself
+ */
+
+static mlt_producer share_owner( mlt_producer producer )
+{
+	mlt_service service = MLT_PRODUCER_SERVICE( producer );
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	shared_producer entry = mlt_properties_get_data( properties, "_share_entry", NULL );
+	mlt_producer owner = producer;
+	mlt_producer current;
+	shared_producer other;
+	uint64_t key;
+	int generation = mlt_service_generation( service );
+
+	if ( !entry )
+		return producer;
+	if ( entry->resolved && entry->producer_generation == generation
+		 && entry->owner_generation == mlt_service_generation( MLT_PRODUCER_SERVICE( entry->owner ) )
+		 && entry->profile_key == share_profile_key( producer )
+		 && entry->owner_profile_key == share_profile_key( entry->owner ) )
+		return entry->owner;
+
+	current = mlt_properties_get_data( properties, "_share_owner", NULL );
+	if ( share_enabled( producer ) )
+	{
+		pthread_mutex_lock( &shared_producers.mutex );
+		key = share_key( entry );
+		for ( other = shared_producers.producers; other != entry; other = other->next )
+		{
+			if ( share_key( other ) == key && share_enabled( other->producer )
+				 && mlt_properties_ref_count( MLT_PRODUCER_PROPERTIES( other->producer ) ) > 0 )
+			{
+				owner = other->producer;
+				break;
+			}
+		}
+		if ( owner != producer && owner != current )
+			mlt_properties_inc_ref( MLT_PRODUCER_PROPERTIES( owner ) );
+		pthread_mutex_unlock( &shared_producers.mutex );
+	}
+
+	if ( owner != producer && owner != current )
+	{
+		mlt_log_verbose( service, "sharing the decoder of %s\n", mlt_properties_get( properties, "resource" ) );
+		mlt_properties_set_data( properties, "_share_owner", owner, 0, (mlt_destructor) mlt_producer_close, NULL );
+
+		// The state this producer opened the file with is not needed
+		mlt_service_cache_purge( service );
+	}
+	else if ( owner == producer && current )
+	{
+		mlt_properties_set_data( properties, "_share_owner", NULL, 0, NULL, NULL );
+	}
+
+	entry->owner = owner;
+	entry->producer_generation = generation;
+	entry->owner_generation = mlt_service_generation( MLT_PRODUCER_SERVICE( owner ) );
+	entry->profile_key = share_profile_key( producer );
+	entry->owner_profile_key = share_profile_key( owner );
+	entry->resolved = 1;
+	return owner;
+}
+
 /** Our get frame implementation.
 */
 
 static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
 {
-	// Access the private data
+	// Access the private data, which may be that of another producer of the same file
 	mlt_service service = MLT_PRODUCER_SERVICE( producer );
-	mlt_cache_item cache_item = mlt_service_cache_get( service, "producer_avformat" );
+	mlt_producer owner = share_owner( producer );
+	mlt_cache_item cache_item = mlt_service_cache_get( MLT_PRODUCER_SERVICE( owner ), "producer_avformat" );
 	producer_avformat self = mlt_cache_item_data( cache_item, NULL );
 
 	// If cache miss
 	if ( !self )
 	{
 		self = calloc( 1, sizeof( struct producer_avformat_s ) );
-		producer->child = self;
-		self->parent = producer;
-		mlt_service_cache_put( service, "producer_avformat", self, 0, (mlt_destructor) producer_avformat_close );
-		cache_item = mlt_service_cache_get( service, "producer_avformat" );
+		owner->child = self;
+		self->parent = owner;
+		mlt_service_cache_put( MLT_PRODUCER_SERVICE( owner ), "producer_avformat", self, 0, (mlt_destructor) producer_avformat_close );
+		cache_item = mlt_service_cache_get( MLT_PRODUCER_SERVICE( owner ), "producer_avformat" );
 	}
 
 	// Create an empty frame
@@ -2976,6 +4949,27 @@ static void producer_avformat_close( producer_avformat self )
 {
 	mlt_log_debug( NULL, "producer_avformat_close\n" );
 
+	// Stop decoding ahead before tearing down the decoder
+	decoder_pool_close( self );
+	prefetch_close( self );
+	audio_prefetch_close( self );
+	live_stop( self );
+	if ( self->live.packets )
+		mlt_deque_close( self->live.packets );
+	self->live.packets = NULL;
+	mlt_job_close( self->index_job );
+	self->index_job = NULL;
+	mlt_job_close( self->proxy_job );
+	self->proxy_job = NULL;
+	mlt_producer_close( self->proxy_producer );
+	self->proxy_producer = NULL;
+	free( self->proxy_file );
+	self->proxy_file = NULL;
+	seek_index_close( self->seek_index );
+	self->seek_index = NULL;
+	mlt_properties_close( self->probe );
+	self->probe = NULL;
+
 	// Cleanup av contexts
 	av_free_packet( &self->pkt );
 	av_free( self->video_frame );
@@ -2994,13 +4988,14 @@ static void producer_avformat_close( producer_avformat self )
 	if ( self->video_codec )
 		avcodec_close( self->video_codec );
 	self->video_codec = NULL;
+	decoder_budget_unregister( self );
 	// Close the file
 	if ( self->dummy_context )
-		avformat_close_input( &self->dummy_context );
+		io_cache_close_input( &self->dummy_context );
 	if ( self->seekable && self->audio_format )
-		avformat_close_input( &self->audio_format );
+		io_cache_close_input( &self->audio_format );
 	if ( self->video_format )
-		avformat_close_input( &self->video_format );
+		io_cache_close_input( &self->video_format );
 	if ( self->is_mutex_init )
 		pthread_mutex_unlock( &self->open_mutex );
 #ifdef VDPAU
@@ -3009,9 +5004,13 @@ static void producer_avformat_close( producer_avformat self )
 #ifdef AVFILTER
 	avfilter_graph_free(&self->vfilter_graph);
 #endif
+#ifdef HWACCEL
+	av_buffer_unref( &self->hwaccel.device_ctx );
+#endif
 
 	// Cleanup caches.
 	mlt_cache_close( self->image_cache );
+	mlt_cache_close( self->audio_cache );
 	if ( self->last_good_frame )
 		mlt_frame_close( self->last_good_frame );
 
@@ -3022,6 +5021,13 @@ static void producer_avformat_close( producer_avformat self )
 		pthread_mutex_destroy( &self->video_mutex );
 		pthread_mutex_destroy( &self->packets_mutex );
 		pthread_mutex_destroy( &self->open_mutex );
+		pthread_mutex_destroy( &self->prefetch.mutex );
+		pthread_cond_destroy( &self->prefetch.cond );
+		pthread_mutex_destroy( &self->audio_prefetch.mutex );
+		pthread_cond_destroy( &self->audio_prefetch.cond );
+		pthread_mutex_destroy( &self->live.mutex );
+		pthread_cond_destroy( &self->live.cond );
+		pthread_mutex_destroy( &self->pool.mutex );
 	}
 
 	// Cleanup the packet queues
@@ -3052,7 +5058,8 @@ static void producer_avformat_close( producer_avformat self )
 
 static void producer_close( mlt_producer parent )
 {
-	// Remove this instance from the cache
+	// Remove this instance from the cache and the producers that share
+	share_unregister( parent );
 	mlt_service_cache_purge( MLT_PRODUCER_SERVICE(parent) );
 
 	// Close the parent
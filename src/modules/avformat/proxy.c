@@ -0,0 +1,119 @@
+/*
+ * proxy.c -- low resolution proxies of media for producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "proxy.h"
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Get the name of the proxy of a file.
+ *
+ * The proxy has the frame rate of the profile so that its frames line up
+ * with those of the original; the frame rate and the width are part of the name.
+ * The directory is $MLT_AVFORMAT_PROXY_DIR, or else mlt/proxy in
+ * $XDG_CACHE_HOME or $HOME/.cache.
+ * \return the file name for the caller to free or NULL if there is none
+ */
+
+char *proxy_filename( const char *resource, mlt_profile profile, int width, int create )
+{
+	char suffix[ 64 ];
+	snprintf( suffix, sizeof( suffix ), "-%d-%d-%d.mkv", profile->frame_rate_num, profile->frame_rate_den, width );
+	return mlt_cache_filename( resource, "MLT_AVFORMAT_PROXY_DIR", "proxy", suffix, create );
+}
+
+/** Transcode the video of a file to an intra-only proxy of a smaller size.
+ *
+ * The proxy is written through consumer_avformat to a temporary file that is
+ * only renamed to \p filename once it is complete.
+ * \param profile the profile of the producer of the original
+ * \param job the job that builds it, which stops transcoding once it is cancelled
+ * \return true on error or if cancelled
+ */
+
+int proxy_build( const char *resource, const char *filename, mlt_profile profile, int width, int height,
+	int sample_aspect_num, int sample_aspect_den, mlt_job job )
+{
+	mlt_profile proxy_profile = mlt_profile_clone( profile );
+	char *temp = malloc( strlen( filename ) + 16 );
+	char *service = malloc( strlen( resource ) + 16 );
+	mlt_producer producer = NULL;
+	mlt_consumer consumer = NULL;
+	int error = 1;
+	int cancelled = 0;
+
+	if ( !proxy_profile || !temp || !service )
+		goto exit;
+
+	proxy_profile->width = width;
+	proxy_profile->height = height;
+	proxy_profile->progressive = 1;
+	proxy_profile->sample_aspect_num = MAX( sample_aspect_num, 1 );
+	proxy_profile->sample_aspect_den = MAX( sample_aspect_den, 1 );
+	proxy_profile->display_aspect_num = width * proxy_profile->sample_aspect_num;
+	proxy_profile->display_aspect_den = height * proxy_profile->sample_aspect_den;
+
+	// The loader normalises the original to the proxy profile.
+	sprintf( service, "avformat:%s", resource );
+	producer = mlt_factory_producer( proxy_profile, NULL, service );
+	sprintf( temp, "%s.%d.mkv", filename, rand( ) % 100000 );
+	consumer = mlt_factory_consumer( proxy_profile, "avformat", temp );
+	if ( !producer || !consumer )
+		goto exit;
+
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_properties_set( properties, "f", "matroska" );
+	mlt_properties_set( properties, "vcodec", "mjpeg" );
+	mlt_properties_set( properties, "pix_fmt", "yuvj422p" );
+	mlt_properties_set_int( properties, "qscale", 5 );
+	mlt_properties_set_int( properties, "an", 1 );
+	mlt_properties_set_int( properties, "real_time", -1 );
+	mlt_properties_set_int( properties, "terminate_on_pause", 1 );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( producer ) );
+
+	mlt_log_verbose( NULL, "[producer avformat] building proxy %s\n", filename );
+	if ( !mlt_consumer_start( consumer ) )
+	{
+		while ( !mlt_consumer_is_stopped( consumer ) && !( cancelled = mlt_job_yield( job ) ) )
+			usleep( 100000 );
+		mlt_consumer_stop( consumer );
+		error = cancelled;
+	}
+	mlt_consumer_close( consumer );
+	consumer = NULL;
+
+	if ( !error )
+		error = rename( temp, filename );
+	if ( error )
+		remove( temp );
+	else
+		mlt_log_verbose( NULL, "[producer avformat] built proxy %s\n", filename );
+
+exit:
+	mlt_consumer_close( consumer );
+	mlt_producer_close( producer );
+	mlt_profile_close( proxy_profile );
+	free( service );
+	free( temp );
+	return error;
+}
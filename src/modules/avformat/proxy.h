@@ -0,0 +1,29 @@
+/*
+ * proxy.h -- low resolution proxies of media for producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <framework/mlt_profile.h>
+
+char *proxy_filename( const char *resource, mlt_profile profile, int width, int create );
+int proxy_build( const char *resource, const char *filename, mlt_profile profile, int width, int height,
+	int sample_aspect_num, int sample_aspect_den, mlt_job job );
+
+#endif // PROXY_H
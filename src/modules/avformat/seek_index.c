@@ -0,0 +1,228 @@
+/*
+ * seek_index.c -- keyframe index for fast seeking in producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "seek_index.h"
+#include "common.h"
+
+#include <framework/mlt_log.h>
+#include <framework/mlt_job.h>
+#include <framework/mlt_sidecar.h>
+
+#include <libavformat/avformat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEEK_INDEX_MAGIC "MLTSIDX1"
+
+struct index_entry
+{
+	int64_t pts;
+	int key;
+};
+
+static seek_index seek_index_alloc( int stream_index, int64_t count )
+{
+	seek_index self = calloc( 1, sizeof( *self ) );
+	if ( self )
+	{
+		self->stream_index = stream_index;
+		self->count = count;
+		self->pts = malloc( ( count ? count : 1 ) * sizeof( int64_t ) );
+		self->key = malloc( count ? count : 1 );
+		if ( !self->pts || !self->key )
+		{
+			seek_index_close( self );
+			self = NULL;
+		}
+	}
+	return self;
+}
+
+/** Load the index of a stream saved by seek_index_save().
+ *
+ * \return the index or NULL if there is none for the current version of the file
+ */
+
+seek_index seek_index_load( const char *resource, int stream_index )
+{
+	char params[ 16 ];
+	mlt_sidecar record;
+	const char *data;
+	size_t size = 0;
+	seek_index self = NULL;
+	int64_t count;
+
+	snprintf( params, sizeof( params ), "%d", stream_index );
+	record = mlt_sidecar_open( resource, "seek_index", params );
+	data = mlt_sidecar_data( record, &size );
+	if ( data && size >= 8 + sizeof( count ) && !memcmp( data, SEEK_INDEX_MAGIC, 8 ) )
+	{
+		memcpy( &count, data + 8, sizeof( count ) );
+		if ( count > 0 && count < INT32_MAX && size == 8 + sizeof( count ) + count * ( sizeof( int64_t ) + 1 )
+			 && ( self = seek_index_alloc( stream_index, count ) ) )
+		{
+			memcpy( self->pts, data + 8 + sizeof( count ), count * sizeof( int64_t ) );
+			memcpy( self->key, data + 8 + sizeof( count ) + count * sizeof( int64_t ), count );
+			mlt_log_verbose( NULL, "[producer avformat] loaded seek index of %s\n", resource );
+		}
+	}
+	mlt_sidecar_close( record );
+	return self;
+}
+
+static int compare_entries( const void *a, const void *b )
+{
+	const struct index_entry *x = a;
+	const struct index_entry *y = b;
+	return x->pts < y->pts ? -1 : x->pts > y->pts;
+}
+
+/** Build the index of a stream by reading all of its packets without decoding.
+ *
+ * \param job the job that builds it, which returns NULL once it is cancelled
+ */
+
+seek_index seek_index_build( const char *resource, int stream_index, mlt_job job )
+{
+	AVFormatContext *context = NULL;
+	struct index_entry *entries = NULL;
+	int64_t count = 0, size = 0, i;
+	int cancelled = 0;
+	seek_index self = NULL;
+	AVPacket pkt;
+
+	if ( avformat_open_input( &context, resource, NULL, NULL ) < 0 )
+		return NULL;
+	if ( avformat_find_stream_info( context, NULL ) >= 0 && stream_index < context->nb_streams )
+	{
+		av_init_packet( &pkt );
+		while ( !( cancelled = mlt_job_yield( job ) ) && av_read_frame( context, &pkt ) >= 0 )
+		{
+			int64_t pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+			if ( pkt.stream_index == stream_index && pts != AV_NOPTS_VALUE )
+			{
+				if ( count == size )
+				{
+					struct index_entry *more;
+					size = size ? size * 2 : 4096;
+					more = realloc( entries, size * sizeof( *entries ) );
+					if ( !more )
+					{
+						av_free_packet( &pkt );
+						break;
+					}
+					entries = more;
+				}
+				entries[ count ].pts = pts;
+				entries[ count ].key = !!( pkt.flags & AV_PKT_FLAG_KEY );
+				count++;
+			}
+			av_free_packet( &pkt );
+		}
+		if ( !cancelled && count > 0 && ( self = seek_index_alloc( stream_index, count ) ) )
+		{
+			qsort( entries, count, sizeof( *entries ), compare_entries );
+			for ( i = 0; i < count; i++ )
+			{
+				self->pts[ i ] = entries[ i ].pts;
+				self->key[ i ] = entries[ i ].key;
+			}
+		}
+	}
+	free( entries );
+	avformat_close_input( &context );
+	return self;
+}
+
+/** Save the index in the sidecar store.
+ *
+ * \return true on error
+ */
+
+int seek_index_save( seek_index self, const char *resource )
+{
+	char params[ 16 ];
+	size_t size = 8 + sizeof( self->count ) + self->count * ( sizeof( int64_t ) + 1 );
+	char *data = malloc( size );
+	int error = 1;
+
+	snprintf( params, sizeof( params ), "%d", self->stream_index );
+	if ( data )
+	{
+		memcpy( data, SEEK_INDEX_MAGIC, 8 );
+		memcpy( data + 8, &self->count, sizeof( self->count ) );
+		memcpy( data + 8 + sizeof( self->count ), self->pts, self->count * sizeof( int64_t ) );
+		memcpy( data + 8 + sizeof( self->count ) + self->count * sizeof( int64_t ), self->key, self->count );
+		error = mlt_sidecar_store( resource, "seek_index", params, data, size );
+	}
+	if ( error )
+		mlt_log_warning( NULL, "[producer avformat] failed to save the seek index of %s\n", resource );
+	free( data );
+	return error;
+}
+
+void seek_index_close( seek_index self )
+{
+	if ( self )
+	{
+		free( self->pts );
+		free( self->key );
+		free( self );
+	}
+}
+
+/** Get the presentation timestamp of the first keyframe.
+ *
+ * \return the timestamp or AV_NOPTS_VALUE
+ */
+
+int64_t seek_index_first_keyframe( seek_index self )
+{
+	int64_t i;
+	for ( i = 0; i < self->count; i++ )
+		if ( self->key[ i ] )
+			return self->pts[ i ];
+	return AV_NOPTS_VALUE;
+}
+
+/** Get the presentation timestamp of the last keyframe at or before a timestamp.
+ *
+ * \return the timestamp or AV_NOPTS_VALUE if there is no keyframe before \p pts
+ */
+
+int64_t seek_index_keyframe_before( seek_index self, int64_t pts )
+{
+	int64_t low = 0, high = self->count;
+
+	// Find the number of entries with timestamps <= pts.
+	while ( low < high )
+	{
+		int64_t middle = low + ( high - low ) / 2;
+		if ( self->pts[ middle ] <= pts )
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	while ( low-- > 0 )
+		if ( self->key[ low ] )
+			return self->pts[ low ];
+	return AV_NOPTS_VALUE;
+}
@@ -0,0 +1,44 @@
+/*
+ * seek_index.h -- keyframe index for fast seeking in producer_avformat
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <framework/mlt_types.h>
+#include <stdint.h>
+
+/** The presentation timestamps of all packets of a video stream in presentation order.
+ */
+
+typedef struct seek_index_s
+{
+	int stream_index;
+	int64_t count;
+	int64_t *pts;   /**< sorted presentation timestamps */
+	uint8_t *key;   /**< non-zero where pts belongs to a keyframe */
+} *seek_index;
+
+seek_index seek_index_load( const char *resource, int stream_index );
+seek_index seek_index_build( const char *resource, int stream_index, mlt_job job );
+int seek_index_save( seek_index self, const char *resource );
+void seek_index_close( seek_index self );
+int64_t seek_index_first_keyframe( seek_index self );
+int64_t seek_index_keyframe_before( seek_index self, int64_t pts );
+
+#endif // SEEK_INDEX_H
@@ -0,0 +1,459 @@
+/*
+ * audio_convert_simd.c -- vectorized audio sample format conversion kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "audio_convert_simd.h"
+
+#include <stdlib.h>
+
+/* The scalar conversions scale by powers of two, which is exact, and
+ * truncate toward zero when converting float to integer:
+ *
+ *   s16 -> s32   s << 16          s32 -> s16   s >> 16
+ *   s16 -> f32   s / 2^15         s32 -> f32   s / 2^31
+ *   f32 -> s16   32767 * clamp( f )
+ *   f32 -> s32   2^31 * clamp( f ), saturated to 2^31 - 1
+ *
+ * Converting s32 to float rounds to nearest like the scalar division does.
+ */
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define SSE4 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE4 int s16_to_s32_sse4( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i v = _mm_cvtepi16_epi32( _mm_loadl_epi64( (const __m128i*)( s + i ) ) );
+		_mm_storeu_si128( (__m128i*)( d + i ), _mm_slli_epi32( v, 16 ) );
+	}
+	return i;
+}
+
+static SSE4 int s16_to_f32_sse4( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	float *d = dst;
+	__m128 scale = _mm_set1_ps( 1.0f / 32768.0f );
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i v = _mm_cvtepi16_epi32( _mm_loadl_epi64( (const __m128i*)( s + i ) ) );
+		_mm_storeu_ps( d + i, _mm_mul_ps( _mm_cvtepi32_ps( v ), scale ) );
+	}
+	return i;
+}
+
+static SSE4 int s32_to_s16_sse4( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m128i lo = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)( s + i ) ), 16 );
+		__m128i hi = _mm_srai_epi32( _mm_loadu_si128( (const __m128i*)( s + i + 4 ) ), 16 );
+		_mm_storeu_si128( (__m128i*)( d + i ), _mm_packs_epi32( lo, hi ) );
+	}
+	return i;
+}
+
+static SSE4 int s32_to_f32_sse4( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	float *d = dst;
+	__m128 scale = _mm_set1_ps( 1.0f / 2147483648.0f );
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128 v = _mm_cvtepi32_ps( _mm_loadu_si128( (const __m128i*)( s + i ) ) );
+		_mm_storeu_ps( d + i, _mm_mul_ps( v, scale ) );
+	}
+	return i;
+}
+
+static SSE4 inline __m128 clamp_sse4( __m128 v )
+{
+	return _mm_min_ps( _mm_max_ps( v, _mm_set1_ps( -1.0f ) ), _mm_set1_ps( 1.0f ) );
+}
+
+static SSE4 int f32_to_s16_sse4( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int16_t *d = dst;
+	__m128 scale = _mm_set1_ps( 32767.0f );
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m128i lo = _mm_cvttps_epi32( _mm_mul_ps( clamp_sse4( _mm_loadu_ps( s + i ) ), scale ) );
+		__m128i hi = _mm_cvttps_epi32( _mm_mul_ps( clamp_sse4( _mm_loadu_ps( s + i + 4 ) ), scale ) );
+		_mm_storeu_si128( (__m128i*)( d + i ), _mm_packs_epi32( lo, hi ) );
+	}
+	return i;
+}
+
+static SSE4 int f32_to_s32_sse4( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int32_t *d = dst;
+	__m128 scale = _mm_set1_ps( 2147483648.0f );
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128 v = _mm_mul_ps( clamp_sse4( _mm_loadu_ps( s + i ) ), scale );
+		// The conversion gives INT32_MIN for 2^31, which flips to INT32_MAX.
+		__m128i over = _mm_castps_si128( _mm_cmpge_ps( v, scale ) );
+		_mm_storeu_si128( (__m128i*)( d + i ), _mm_xor_si128( _mm_cvttps_epi32( v ), over ) );
+	}
+	return i;
+}
+
+static SSE4 int deinterleave_sse4( const uint32_t *src, uint32_t *left, uint32_t *right, int samples )
+{
+	int i;
+	for ( i = 0; i + 4 <= samples; i += 4 )
+	{
+		__m128 a = _mm_loadu_ps( (const float*)( src + 2 * i ) );
+		__m128 b = _mm_loadu_ps( (const float*)( src + 2 * i + 4 ) );
+		_mm_storeu_ps( (float*)( left + i ), _mm_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+		_mm_storeu_ps( (float*)( right + i ), _mm_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+	}
+	return i;
+}
+
+static SSE4 int interleave_sse4( const uint32_t *left, const uint32_t *right, uint32_t *dst, int samples )
+{
+	int i;
+	for ( i = 0; i + 4 <= samples; i += 4 )
+	{
+		__m128 l = _mm_loadu_ps( (const float*)( left + i ) );
+		__m128 r = _mm_loadu_ps( (const float*)( right + i ) );
+		_mm_storeu_ps( (float*)( dst + 2 * i ), _mm_unpacklo_ps( l, r ) );
+		_mm_storeu_ps( (float*)( dst + 2 * i + 4 ), _mm_unpackhi_ps( l, r ) );
+	}
+	return i;
+}
+
+static AVX2 int s16_to_s32_avx2( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256i v = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( s + i ) ) );
+		_mm256_storeu_si256( (__m256i*)( d + i ), _mm256_slli_epi32( v, 16 ) );
+	}
+	return i;
+}
+
+static AVX2 int s16_to_f32_avx2( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	float *d = dst;
+	__m256 scale = _mm256_set1_ps( 1.0f / 32768.0f );
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256i v = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( s + i ) ) );
+		_mm256_storeu_ps( d + i, _mm256_mul_ps( _mm256_cvtepi32_ps( v ), scale ) );
+	}
+	return i;
+}
+
+static AVX2 int s32_to_s16_avx2( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	int i;
+	for ( i = 0; i + 16 <= count; i += 16 )
+	{
+		__m256i lo = _mm256_srai_epi32( _mm256_loadu_si256( (const __m256i*)( s + i ) ), 16 );
+		__m256i hi = _mm256_srai_epi32( _mm256_loadu_si256( (const __m256i*)( s + i + 8 ) ), 16 );
+		// The pack works within 128-bit lanes, so restore the order of the 64-bit quarters.
+		__m256i v = _mm256_permute4x64_epi64( _mm256_packs_epi32( lo, hi ), 0xd8 );
+		_mm256_storeu_si256( (__m256i*)( d + i ), v );
+	}
+	return i;
+}
+
+static AVX2 int s32_to_f32_avx2( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	float *d = dst;
+	__m256 scale = _mm256_set1_ps( 1.0f / 2147483648.0f );
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256 v = _mm256_cvtepi32_ps( _mm256_loadu_si256( (const __m256i*)( s + i ) ) );
+		_mm256_storeu_ps( d + i, _mm256_mul_ps( v, scale ) );
+	}
+	return i;
+}
+
+static AVX2 inline __m256 clamp_avx2( __m256 v )
+{
+	return _mm256_min_ps( _mm256_max_ps( v, _mm256_set1_ps( -1.0f ) ), _mm256_set1_ps( 1.0f ) );
+}
+
+static AVX2 int f32_to_s16_avx2( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int16_t *d = dst;
+	__m256 scale = _mm256_set1_ps( 32767.0f );
+	int i;
+	for ( i = 0; i + 16 <= count; i += 16 )
+	{
+		__m256i lo = _mm256_cvttps_epi32( _mm256_mul_ps( clamp_avx2( _mm256_loadu_ps( s + i ) ), scale ) );
+		__m256i hi = _mm256_cvttps_epi32( _mm256_mul_ps( clamp_avx2( _mm256_loadu_ps( s + i + 8 ) ), scale ) );
+		__m256i v = _mm256_permute4x64_epi64( _mm256_packs_epi32( lo, hi ), 0xd8 );
+		_mm256_storeu_si256( (__m256i*)( d + i ), v );
+	}
+	return i;
+}
+
+static AVX2 int f32_to_s32_avx2( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int32_t *d = dst;
+	__m256 scale = _mm256_set1_ps( 2147483648.0f );
+	int i;
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256 v = _mm256_mul_ps( clamp_avx2( _mm256_loadu_ps( s + i ) ), scale );
+		__m256i over = _mm256_castps_si256( _mm256_cmp_ps( v, scale, _CMP_GE_OQ ) );
+		_mm256_storeu_si256( (__m256i*)( d + i ), _mm256_xor_si256( _mm256_cvttps_epi32( v ), over ) );
+	}
+	return i;
+}
+
+static AVX2 int deinterleave_avx2( const uint32_t *src, uint32_t *left, uint32_t *right, int samples )
+{
+	int i;
+	for ( i = 0; i + 8 <= samples; i += 8 )
+	{
+		__m256 a = _mm256_loadu_ps( (const float*)( src + 2 * i ) );
+		__m256 b = _mm256_loadu_ps( (const float*)( src + 2 * i + 8 ) );
+		// The shuffles work within 128-bit lanes, so restore the order of the 64-bit quarters.
+		__m256d l = _mm256_castps_pd( _mm256_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+		__m256d r = _mm256_castps_pd( _mm256_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+		_mm256_storeu_pd( (double*)( left + i ), _mm256_permute4x64_pd( l, 0xd8 ) );
+		_mm256_storeu_pd( (double*)( right + i ), _mm256_permute4x64_pd( r, 0xd8 ) );
+	}
+	return i;
+}
+
+static AVX2 int interleave_avx2( const uint32_t *left, const uint32_t *right, uint32_t *dst, int samples )
+{
+	int i;
+	for ( i = 0; i + 8 <= samples; i += 8 )
+	{
+		__m256 l = _mm256_loadu_ps( (const float*)( left + i ) );
+		__m256 r = _mm256_loadu_ps( (const float*)( right + i ) );
+		__m256 lo = _mm256_unpacklo_ps( l, r );
+		__m256 hi = _mm256_unpackhi_ps( l, r );
+		_mm256_storeu_ps( (float*)( dst + 2 * i ), _mm256_permute2f128_ps( lo, hi, 0x20 ) );
+		_mm256_storeu_ps( (float*)( dst + 2 * i + 8 ), _mm256_permute2f128_ps( lo, hi, 0x31 ) );
+	}
+	return i;
+}
+
+static const struct audio_convert_kernels sse4_kernels =
+{
+	"sse4.1",
+	s16_to_s32_sse4,
+	s16_to_f32_sse4,
+	s32_to_s16_sse4,
+	s32_to_f32_sse4,
+	f32_to_s16_sse4,
+	f32_to_s32_sse4,
+	deinterleave_sse4,
+	interleave_sse4
+};
+
+static const struct audio_convert_kernels avx2_kernels =
+{
+	"avx2",
+	s16_to_s32_avx2,
+	s16_to_f32_avx2,
+	s32_to_s16_avx2,
+	s32_to_f32_avx2,
+	f32_to_s16_avx2,
+	f32_to_s32_avx2,
+	deinterleave_avx2,
+	interleave_avx2
+};
+
+static const struct audio_convert_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	if ( __builtin_cpu_supports( "sse4.1" ) )
+		return &sse4_kernels;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static int s16_to_s32_neon( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+		vst1q_s32( d + i, vshll_n_s16( vld1_s16( s + i ), 16 ) );
+	return i;
+}
+
+static int s16_to_f32_neon( const void *src, void *dst, int count )
+{
+	const int16_t *s = src;
+	float *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		float32x4_t v = vcvtq_f32_s32( vmovl_s16( vld1_s16( s + i ) ) );
+		vst1q_f32( d + i, vmulq_n_f32( v, 1.0f / 32768.0f ) );
+	}
+	return i;
+}
+
+static int s32_to_s16_neon( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+		vst1_s16( d + i, vshrn_n_s32( vld1q_s32( s + i ), 16 ) );
+	return i;
+}
+
+static int s32_to_f32_neon( const void *src, void *dst, int count )
+{
+	const int32_t *s = src;
+	float *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+		vst1q_f32( d + i, vmulq_n_f32( vcvtq_f32_s32( vld1q_s32( s + i ) ), 1.0f / 2147483648.0f ) );
+	return i;
+}
+
+static inline float32x4_t clamp_neon( float32x4_t v )
+{
+	return vminq_f32( vmaxq_f32( v, vdupq_n_f32( -1.0f ) ), vdupq_n_f32( 1.0f ) );
+}
+
+static int f32_to_s16_neon( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int16_t *d = dst;
+	int i;
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		int32x4_t v = vcvtq_s32_f32( vmulq_n_f32( clamp_neon( vld1q_f32( s + i ) ), 32767.0f ) );
+		vst1_s16( d + i, vmovn_s32( v ) );
+	}
+	return i;
+}
+
+static int f32_to_s32_neon( const void *src, void *dst, int count )
+{
+	const float *s = src;
+	int32_t *d = dst;
+	int i;
+	// The conversion saturates 2^31 to INT32_MAX.
+	for ( i = 0; i + 4 <= count; i += 4 )
+		vst1q_s32( d + i, vcvtq_s32_f32( vmulq_n_f32( clamp_neon( vld1q_f32( s + i ) ), 2147483648.0f ) ) );
+	return i;
+}
+
+static int deinterleave_neon( const uint32_t *src, uint32_t *left, uint32_t *right, int samples )
+{
+	int i;
+	for ( i = 0; i + 4 <= samples; i += 4 )
+	{
+		uint32x4x2_t v = vld2q_u32( src + 2 * i );
+		vst1q_u32( left + i, v.val[0] );
+		vst1q_u32( right + i, v.val[1] );
+	}
+	return i;
+}
+
+static int interleave_neon( const uint32_t *left, const uint32_t *right, uint32_t *dst, int samples )
+{
+	int i;
+	for ( i = 0; i + 4 <= samples; i += 4 )
+	{
+		uint32x4x2_t v;
+		v.val[0] = vld1q_u32( left + i );
+		v.val[1] = vld1q_u32( right + i );
+		vst2q_u32( dst + 2 * i, v );
+	}
+	return i;
+}
+
+static const struct audio_convert_kernels neon_kernels =
+{
+	"neon",
+	s16_to_s32_neon,
+	s16_to_f32_neon,
+	s32_to_s16_neon,
+	s32_to_f32_neon,
+	f32_to_s16_neon,
+	f32_to_s32_neon,
+	deinterleave_neon,
+	interleave_neon
+};
+
+static const struct audio_convert_kernels *detect_kernels( void )
+{
+	return &neon_kernels;
+}
+
+#else
+
+static const struct audio_convert_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct audio_convert_kernels *audio_convert_simd_kernels( void )
+{
+	static const struct audio_convert_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_AUDIOCONVERT_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
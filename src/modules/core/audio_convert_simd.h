@@ -0,0 +1,59 @@
+/*
+ * audio_convert_simd.h -- vectorized audio sample format conversion kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef AUDIO_CONVERT_SIMD_H
+#define AUDIO_CONVERT_SIMD_H
+
+#include <stdint.h>
+
+/** Convert the leading samples of a run and return how many were converted.
+ *
+ * The kernels produce exactly the same values as the scalar code in
+ * filter_audioconvert.c, which converts the remaining samples.
+ */
+
+typedef int ( *audio_convert_kernel )( const void *src, void *dst, int count );
+
+/** Split leading stereo samples of 32 bits into two planes and return how many were split.
+ */
+
+typedef int ( *audio_deinterleave_kernel )( const uint32_t *src, uint32_t *left, uint32_t *right, int samples );
+
+/** Join leading samples of two planes of 32 bits into stereo and return how many were joined.
+ */
+
+typedef int ( *audio_interleave_kernel )( const uint32_t *left, const uint32_t *right, uint32_t *dst, int samples );
+
+struct audio_convert_kernels
+{
+	const char *name;
+	audio_convert_kernel s16_to_s32;
+	audio_convert_kernel s16_to_f32;
+	audio_convert_kernel s32_to_s16;
+	audio_convert_kernel s32_to_f32;
+	audio_convert_kernel f32_to_s16;
+	audio_convert_kernel f32_to_s32;
+	audio_deinterleave_kernel deinterleave;
+	audio_interleave_kernel interleave;
+};
+
+/** Get the best kernels for the CPU or NULL. */
+const struct audio_convert_kernels *audio_convert_simd_kernels( void );
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * audio_mix_simd.c -- vectorized audio mixing kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "audio_mix_simd.h"
+
+#include <stdlib.h>
+
+/* Each lane tracks the sample of its value and its channel within the
+ * sample, so the weight ramp of the scalar code,
+ *
+ *   w = weight + step * sample
+ *
+ * is computed without a division: advancing by n values adds n / channels
+ * samples and n % channels channels, plus one sample where the channel
+ * wraps.
+ */
+
+#define MAX_LANES (8)
+
+static inline void lane_positions( int channels, int lanes, int sample[ MAX_LANES ], int channel[ MAX_LANES ] )
+{
+	int k;
+	for ( k = 0; k < lanes; k++ )
+	{
+		sample[ k ] = k / channels;
+		channel[ k ] = k % channels;
+	}
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE2 inline int audio_mix_sse2( float *a, const float *b, int channels, int count, float weight, float step, int sum )
+{
+	int sample[ MAX_LANES ], channel[ MAX_LANES ];
+	int i;
+
+	lane_positions( channels, 4, sample, channel );
+	__m128i s = _mm_loadu_si128( (const __m128i*) sample );
+	__m128i c = _mm_loadu_si128( (const __m128i*) channel );
+	__m128i q = _mm_set1_epi32( 4 / channels );
+	__m128i r = _mm_set1_epi32( 4 % channels );
+	__m128i n = _mm_set1_epi32( channels );
+	__m128i last = _mm_set1_epi32( channels - 1 );
+	__m128 w0 = _mm_set1_ps( weight );
+	__m128 dw = _mm_set1_ps( step );
+	__m128 one = _mm_set1_ps( 1.0f );
+
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128 w = _mm_add_ps( w0, _mm_mul_ps( dw, _mm_cvtepi32_ps( s ) ) );
+		__m128 va = _mm_loadu_ps( a + i );
+		__m128 vb = _mm_loadu_ps( b + i );
+		if ( sum )
+			va = _mm_add_ps( va, _mm_mul_ps( w, vb ) );
+		else
+			va = _mm_add_ps( _mm_mul_ps( w, vb ), _mm_mul_ps( _mm_sub_ps( one, w ), va ) );
+		_mm_storeu_ps( a + i, va );
+
+		// Advance the lanes by 4 values
+		c = _mm_add_epi32( c, r );
+		__m128i wrap = _mm_cmpgt_epi32( c, last );
+		c = _mm_sub_epi32( c, _mm_and_si128( wrap, n ) );
+		s = _mm_sub_epi32( _mm_add_epi32( s, q ), wrap );
+	}
+	return i;
+}
+
+static SSE2 int audio_mix_mix_sse2( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_sse2( a, b, channels, count, weight, step, 0 );
+}
+
+static SSE2 int audio_mix_sum_sse2( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_sse2( a, b, channels, count, weight, step, 1 );
+}
+
+static AVX2 inline int audio_mix_avx2( float *a, const float *b, int channels, int count, float weight, float step, int sum )
+{
+	int sample[ MAX_LANES ], channel[ MAX_LANES ];
+	int i;
+
+	lane_positions( channels, 8, sample, channel );
+	__m256i s = _mm256_loadu_si256( (const __m256i*) sample );
+	__m256i c = _mm256_loadu_si256( (const __m256i*) channel );
+	__m256i q = _mm256_set1_epi32( 8 / channels );
+	__m256i r = _mm256_set1_epi32( 8 % channels );
+	__m256i n = _mm256_set1_epi32( channels );
+	__m256i last = _mm256_set1_epi32( channels - 1 );
+	__m256 w0 = _mm256_set1_ps( weight );
+	__m256 dw = _mm256_set1_ps( step );
+	__m256 one = _mm256_set1_ps( 1.0f );
+
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256 w = _mm256_add_ps( w0, _mm256_mul_ps( dw, _mm256_cvtepi32_ps( s ) ) );
+		__m256 va = _mm256_loadu_ps( a + i );
+		__m256 vb = _mm256_loadu_ps( b + i );
+		if ( sum )
+			va = _mm256_add_ps( va, _mm256_mul_ps( w, vb ) );
+		else
+			va = _mm256_add_ps( _mm256_mul_ps( w, vb ), _mm256_mul_ps( _mm256_sub_ps( one, w ), va ) );
+		_mm256_storeu_ps( a + i, va );
+
+		// Advance the lanes by 8 values
+		c = _mm256_add_epi32( c, r );
+		__m256i wrap = _mm256_cmpgt_epi32( c, last );
+		c = _mm256_sub_epi32( c, _mm256_and_si256( wrap, n ) );
+		s = _mm256_sub_epi32( _mm256_add_epi32( s, q ), wrap );
+	}
+	return i;
+}
+
+static AVX2 int audio_mix_mix_avx2( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_avx2( a, b, channels, count, weight, step, 0 );
+}
+
+static AVX2 int audio_mix_sum_avx2( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_avx2( a, b, channels, count, weight, step, 1 );
+}
+
+static const struct audio_mix_kernels sse2_kernels =
+{
+	"sse2",
+	audio_mix_mix_sse2,
+	audio_mix_sum_sse2
+};
+
+static const struct audio_mix_kernels avx2_kernels =
+{
+	"avx2",
+	audio_mix_mix_avx2,
+	audio_mix_sum_avx2
+};
+
+static const struct audio_mix_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return &sse2_kernels;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static inline int audio_mix_neon( float *a, const float *b, int channels, int count, float weight, float step, int sum )
+{
+	int sample[ MAX_LANES ], channel[ MAX_LANES ];
+	int i;
+
+	lane_positions( channels, 4, sample, channel );
+	int32x4_t s = vld1q_s32( sample );
+	int32x4_t c = vld1q_s32( channel );
+	int32x4_t q = vdupq_n_s32( 4 / channels );
+	int32x4_t r = vdupq_n_s32( 4 % channels );
+	int32x4_t n = vdupq_n_s32( channels );
+	int32x4_t last = vdupq_n_s32( channels - 1 );
+	float32x4_t w0 = vdupq_n_f32( weight );
+	float32x4_t dw = vdupq_n_f32( step );
+	float32x4_t one = vdupq_n_f32( 1.0f );
+
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		float32x4_t w = vaddq_f32( w0, vmulq_f32( dw, vcvtq_f32_s32( s ) ) );
+		float32x4_t va = vld1q_f32( a + i );
+		float32x4_t vb = vld1q_f32( b + i );
+		if ( sum )
+			va = vaddq_f32( va, vmulq_f32( w, vb ) );
+		else
+			va = vaddq_f32( vmulq_f32( w, vb ), vmulq_f32( vsubq_f32( one, w ), va ) );
+		vst1q_f32( a + i, va );
+
+		// Advance the lanes by 4 values
+		c = vaddq_s32( c, r );
+		int32x4_t wrap = vreinterpretq_s32_u32( vcgtq_s32( c, last ) );
+		c = vsubq_s32( c, vandq_s32( wrap, n ) );
+		s = vsubq_s32( vaddq_s32( s, q ), wrap );
+	}
+	return i;
+}
+
+static int audio_mix_mix_neon( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_neon( a, b, channels, count, weight, step, 0 );
+}
+
+static int audio_mix_sum_neon( float *a, const float *b, int channels, int count, float weight, float step )
+{
+	return audio_mix_neon( a, b, channels, count, weight, step, 1 );
+}
+
+static const struct audio_mix_kernels neon_kernels =
+{
+	"neon",
+	audio_mix_mix_neon,
+	audio_mix_sum_neon
+};
+
+static const struct audio_mix_kernels *detect_kernels( void )
+{
+	return &neon_kernels;
+}
+
+#else
+
+static const struct audio_mix_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct audio_mix_kernels *audio_mix_simd_kernels( void )
+{
+	static const struct audio_mix_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_AUDIO_MIX_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
@@ -0,0 +1,44 @@
+/*
+ * audio_mix_simd.h -- vectorized audio mixing kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef AUDIO_MIX_SIMD_H
+#define AUDIO_MIX_SIMD_H
+
+/** Mix the leading samples of interleaved float audio into \p a and return how many were done.
+ *
+ * \p count is the number of values, which is the number of samples times
+ * \p channels, and the weight of \p b ramps from \p weight over the samples
+ * by \p step per sample. The mix kernel computes w * b + ( 1 - w ) * a
+ * and the sum kernel a + w * b, like the scalar code in transition_mix.c,
+ * which mixes the remaining values.
+ */
+
+typedef int ( *audio_mix_kernel )( float *a, const float *b, int channels, int count, float weight, float step );
+
+struct audio_mix_kernels
+{
+	const char *name;
+	audio_mix_kernel mix;
+	audio_mix_kernel sum;
+};
+
+/** Get the best kernels for the CPU or NULL. */
+const struct audio_mix_kernels *audio_mix_simd_kernels( void );
+
+#endif
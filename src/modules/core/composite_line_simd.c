@@ -0,0 +1,361 @@
+/*
+ * composite_line_simd.c -- vectorized composite line kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "composite_line_simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The kernels compute in 32-bit integers like calculate_mix(), smoothstep()
+ * and sample_mix() in transition_composite.c:
+ *
+ *   mix  = ( ( luma ? smoothstep( luma, luma + soft, step ) : weight ) * ( alpha + 1 ) ) >> 8
+ *   dest = ( src * mix + dest * ( 65536 - mix ) ) >> 16 = dest + ( ( src - dest ) * mix >> 16 )
+ *
+ * The division in smoothstep() is done in double precision, which gives
+ * the exact integer quotient because the quotient is less than 2^16 and
+ * the divisor at most 2^17. Its final product wraps at 32 bits as in C.
+ *
+ * Each kernel is an instance of the template of its instruction set for
+ * one operator and variant, whose tests of the inputs are resolved when
+ * the template is inlined.
+ */
+
+#define INLINE inline __attribute__((always_inline))
+
+#define COMPOSITE_KERNEL( isa, attr, op, variant ) \
+static attr int composite_line_##op##_##variant##_##isa( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, \
+	uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step ) \
+{ \
+	return composite_line_##isa( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step, composite_op_##op, variant ); \
+}
+
+#define COMPOSITE_KERNELS( isa, attr, op ) \
+	COMPOSITE_KERNEL( isa, attr, op, 0 ) COMPOSITE_KERNEL( isa, attr, op, 1 ) \
+	COMPOSITE_KERNEL( isa, attr, op, 2 ) COMPOSITE_KERNEL( isa, attr, op, 3 ) \
+	COMPOSITE_KERNEL( isa, attr, op, 4 ) COMPOSITE_KERNEL( isa, attr, op, 5 ) \
+	COMPOSITE_KERNEL( isa, attr, op, 6 ) COMPOSITE_KERNEL( isa, attr, op, 7 )
+
+#define COMPOSITE_VARIANTS( isa, op ) \
+	{ composite_line_##op##_0_##isa, composite_line_##op##_1_##isa, composite_line_##op##_2_##isa, \
+	  composite_line_##op##_3_##isa, composite_line_##op##_4_##isa, composite_line_##op##_5_##isa, \
+	  composite_line_##op##_6_##isa, composite_line_##op##_7_##isa }
+
+#define COMPOSITE_KERNEL_TABLE( isa, attr, name ) \
+	COMPOSITE_KERNELS( isa, attr, over ) \
+	COMPOSITE_KERNELS( isa, attr, or ) \
+	COMPOSITE_KERNELS( isa, attr, and ) \
+	COMPOSITE_KERNELS( isa, attr, xor ) \
+	static const struct composite_line_kernels isa##_kernels = \
+	{ \
+		name, \
+		{ COMPOSITE_VARIANTS( isa, over ), COMPOSITE_VARIANTS( isa, or ), \
+		  COMPOSITE_VARIANTS( isa, and ), COMPOSITE_VARIANTS( isa, xor ) } \
+	};
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define SSE4 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE4 inline __m128i load_alpha_sse4( const uint8_t *alpha )
+{
+	int32_t a;
+	memcpy( &a, alpha, 4 );
+	return _mm_cvtepu8_epi32( _mm_cvtsi32_si128( a ) );
+}
+
+static SSE4 inline __m128i smoothstep_sse4( const uint16_t *luma, int soft, uint32_t step )
+{
+	__m128i edge1 = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*) luma ) );
+	__m128i edge2 = _mm_add_epi32( edge1, _mm_set1_epi32( soft ) );
+	__m128i a = _mm_set1_epi32( step );
+	__m128i below = _mm_cmpgt_epi32( edge1, a );
+	__m128i above = _mm_xor_si128( _mm_cmpgt_epi32( edge2, a ), _mm_set1_epi32( -1 ) );
+	__m128i offset = _mm_sub_epi32( a, edge1 );
+	__m128d scale = _mm_set1_pd( 65536.0 );
+	__m128d divisor = _mm_set1_pd( soft );
+	__m128d lo = _mm_div_pd( _mm_mul_pd( _mm_cvtepi32_pd( offset ), scale ), divisor );
+	__m128d hi = _mm_div_pd( _mm_mul_pd( _mm_cvtepi32_pd( _mm_srli_si128( offset, 8 ) ), scale ), divisor );
+	__m128i t = _mm_unpacklo_epi64( _mm_cvttpd_epi32( lo ), _mm_cvttpd_epi32( hi ) );
+	__m128i r = _mm_srli_epi32( _mm_mullo_epi32( _mm_srli_epi32( _mm_mullo_epi32( t, t ), 16 ),
+		_mm_sub_epi32( _mm_set1_epi32( 3 << 16 ), _mm_slli_epi32( t, 1 ) ) ), 16 );
+	r = _mm_andnot_si128( below, r );
+	return _mm_blendv_epi8( r, _mm_set1_epi32( 0x10000 ), _mm_andnot_si128( below, above ) );
+}
+
+static SSE4 inline __m128i sample_mix_sse4( __m128i dest, __m128i src, __m128i mix )
+{
+	return _mm_add_epi32( dest, _mm_srai_epi32( _mm_mullo_epi32( _mm_sub_epi32( src, dest ), mix ), 16 ) );
+}
+
+static SSE4 INLINE int composite_line_sse4( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a,
+	int weight, uint16_t *luma, int soft, uint32_t step, const int op, const int variant )
+{
+	const __m128i alpha_bytes = _mm_setr_epi8( 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	int j;
+
+	for ( j = 0; j + 4 <= width; j += 4, dest += 8, src += 8 )
+	{
+		__m128i a = ( variant & COMPOSITE_LINE_ALPHA_B ) ? load_alpha_sse4( alpha_b ) : _mm_set1_epi32( 255 );
+		__m128i aa = ( variant & COMPOSITE_LINE_ALPHA_A ) ? load_alpha_sse4( alpha_a ) : _mm_set1_epi32( 255 );
+		__m128i base = ( variant & COMPOSITE_LINE_LUMA ) ? smoothstep_sse4( luma + j, soft, step ) : _mm_set1_epi32( weight );
+		__m128i mix, d, s, out;
+
+		if ( op == composite_op_or )
+			a = _mm_or_si128( a, aa );
+		else if ( op == composite_op_and )
+			a = _mm_and_si128( a, aa );
+		else if ( op == composite_op_xor )
+			a = _mm_xor_si128( a, aa );
+		mix = _mm_srai_epi32( _mm_mullo_epi32( base, _mm_add_epi32( a, _mm_set1_epi32( 1 ) ) ), 8 );
+
+		d = _mm_loadl_epi64( (const __m128i*) dest );
+		s = _mm_loadl_epi64( (const __m128i*) src );
+		out = _mm_packs_epi32(
+			sample_mix_sse4( _mm_cvtepu8_epi32( d ), _mm_cvtepu8_epi32( s ), _mm_shuffle_epi32( mix, 0x50 ) ),
+			sample_mix_sse4( _mm_cvtepu8_epi32( _mm_srli_si128( d, 4 ) ), _mm_cvtepu8_epi32( _mm_srli_si128( s, 4 ) ),
+				_mm_shuffle_epi32( mix, 0xfa ) ) );
+		_mm_storel_epi64( (__m128i*) dest, _mm_packus_epi16( out, out ) );
+
+		if ( variant & COMPOSITE_LINE_ALPHA_A )
+		{
+			__m128i value = _mm_srai_epi32( mix, 8 );
+			int32_t bytes;
+			if ( op == composite_op_over )
+				value = _mm_or_si128( value, aa );
+			bytes = _mm_cvtsi128_si32( _mm_shuffle_epi8( value, alpha_bytes ) );
+			memcpy( alpha_a, &bytes, 4 );
+			alpha_a += 4;
+		}
+		if ( variant & COMPOSITE_LINE_ALPHA_B )
+			alpha_b += 4;
+	}
+	return j;
+}
+
+static AVX2 inline __m256i load_alpha_avx2( const uint8_t *alpha )
+{
+	return _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*) alpha ) );
+}
+
+static AVX2 inline __m256i smoothstep_avx2( const uint16_t *luma, int soft, uint32_t step )
+{
+	__m256i edge1 = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*) luma ) );
+	__m256i edge2 = _mm256_add_epi32( edge1, _mm256_set1_epi32( soft ) );
+	__m256i a = _mm256_set1_epi32( step );
+	__m256i below = _mm256_cmpgt_epi32( edge1, a );
+	__m256i above = _mm256_xor_si256( _mm256_cmpgt_epi32( edge2, a ), _mm256_set1_epi32( -1 ) );
+	__m256i offset = _mm256_sub_epi32( a, edge1 );
+	__m256d scale = _mm256_set1_pd( 65536.0 );
+	__m256d divisor = _mm256_set1_pd( soft );
+	__m256d lo = _mm256_div_pd( _mm256_mul_pd( _mm256_cvtepi32_pd( _mm256_castsi256_si128( offset ) ), scale ), divisor );
+	__m256d hi = _mm256_div_pd( _mm256_mul_pd( _mm256_cvtepi32_pd( _mm256_extracti128_si256( offset, 1 ) ), scale ), divisor );
+	__m256i t = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm256_cvttpd_epi32( lo ) ), _mm256_cvttpd_epi32( hi ), 1 );
+	__m256i r = _mm256_srli_epi32( _mm256_mullo_epi32( _mm256_srli_epi32( _mm256_mullo_epi32( t, t ), 16 ),
+		_mm256_sub_epi32( _mm256_set1_epi32( 3 << 16 ), _mm256_slli_epi32( t, 1 ) ) ), 16 );
+	r = _mm256_andnot_si256( below, r );
+	return _mm256_blendv_epi8( r, _mm256_set1_epi32( 0x10000 ), _mm256_andnot_si256( below, above ) );
+}
+
+static AVX2 inline __m256i sample_mix_avx2( __m256i dest, __m256i src, __m256i mix )
+{
+	return _mm256_add_epi32( dest, _mm256_srai_epi32( _mm256_mullo_epi32( _mm256_sub_epi32( src, dest ), mix ), 16 ) );
+}
+
+static AVX2 INLINE int composite_line_avx2( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a,
+	int weight, uint16_t *luma, int soft, uint32_t step, const int op, const int variant )
+{
+	const __m256i alpha_bytes = _mm256_setr_epi8( 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	int j;
+
+	for ( j = 0; j + 8 <= width; j += 8, dest += 16, src += 16 )
+	{
+		__m256i a = ( variant & COMPOSITE_LINE_ALPHA_B ) ? load_alpha_avx2( alpha_b ) : _mm256_set1_epi32( 255 );
+		__m256i aa = ( variant & COMPOSITE_LINE_ALPHA_A ) ? load_alpha_avx2( alpha_a ) : _mm256_set1_epi32( 255 );
+		__m256i base = ( variant & COMPOSITE_LINE_LUMA ) ? smoothstep_avx2( luma + j, soft, step ) : _mm256_set1_epi32( weight );
+		__m256i mix, lo, hi;
+		__m128i d, s;
+
+		if ( op == composite_op_or )
+			a = _mm256_or_si256( a, aa );
+		else if ( op == composite_op_and )
+			a = _mm256_and_si256( a, aa );
+		else if ( op == composite_op_xor )
+			a = _mm256_xor_si256( a, aa );
+		mix = _mm256_srai_epi32( _mm256_mullo_epi32( base, _mm256_add_epi32( a, _mm256_set1_epi32( 1 ) ) ), 8 );
+
+		// Each pixel has 2 bytes that share its mix.
+		d = _mm_loadu_si128( (const __m128i*) dest );
+		s = _mm_loadu_si128( (const __m128i*) src );
+		lo = sample_mix_avx2( _mm256_cvtepu8_epi32( d ), _mm256_cvtepu8_epi32( s ),
+			_mm256_permutevar8x32_epi32( mix, _mm256_setr_epi32( 0, 0, 1, 1, 2, 2, 3, 3 ) ) );
+		hi = sample_mix_avx2( _mm256_cvtepu8_epi32( _mm_srli_si128( d, 8 ) ), _mm256_cvtepu8_epi32( _mm_srli_si128( s, 8 ) ),
+			_mm256_permutevar8x32_epi32( mix, _mm256_setr_epi32( 4, 4, 5, 5, 6, 6, 7, 7 ) ) );
+		_mm_storeu_si128( (__m128i*) dest, _mm_packus_epi16(
+			_mm_packs_epi32( _mm256_castsi256_si128( lo ), _mm256_extracti128_si256( lo, 1 ) ),
+			_mm_packs_epi32( _mm256_castsi256_si128( hi ), _mm256_extracti128_si256( hi, 1 ) ) ) );
+
+		if ( variant & COMPOSITE_LINE_ALPHA_A )
+		{
+			__m256i value = _mm256_srai_epi32( mix, 8 );
+			if ( op == composite_op_over )
+				value = _mm256_or_si256( value, aa );
+			value = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( value, alpha_bytes ), _mm256_setr_epi32( 0, 4, 1, 1, 1, 1, 1, 1 ) );
+			_mm_storel_epi64( (__m128i*) alpha_a, _mm256_castsi256_si128( value ) );
+			alpha_a += 8;
+		}
+		if ( variant & COMPOSITE_LINE_ALPHA_B )
+			alpha_b += 8;
+	}
+	return j;
+}
+
+COMPOSITE_KERNEL_TABLE( sse4, SSE4, "sse4.1" )
+COMPOSITE_KERNEL_TABLE( avx2, AVX2, "avx2" )
+
+static const struct composite_line_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	if ( __builtin_cpu_supports( "sse4.1" ) )
+		return &sse4_kernels;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static inline uint32x4_t load_alpha_neon( const uint8_t *alpha )
+{
+	uint32_t a;
+	memcpy( &a, alpha, 4 );
+	return vmovl_u16( vget_low_u16( vmovl_u8( vreinterpret_u8_u32( vdup_n_u32( a ) ) ) ) );
+}
+
+static inline float64x2_t ramp_neon( int32x2_t offset, float64x2_t divisor )
+{
+	return vdivq_f64( vmulq_n_f64( vcvtq_f64_s64( vmovl_s32( offset ) ), 65536.0 ), divisor );
+}
+
+static inline uint32x4_t smoothstep_neon( const uint16_t *luma, int soft, uint32_t step )
+{
+	int32x4_t edge1 = vreinterpretq_s32_u32( vmovl_u16( vld1_u16( luma ) ) );
+	int32x4_t edge2 = vaddq_s32( edge1, vdupq_n_s32( soft ) );
+	int32x4_t a = vdupq_n_s32( step );
+	uint32x4_t below = vcltq_s32( a, edge1 );
+	uint32x4_t above = vcgeq_s32( a, edge2 );
+	int32x4_t offset = vsubq_s32( a, edge1 );
+	float64x2_t divisor = vdupq_n_f64( soft );
+	uint32x4_t t = vreinterpretq_u32_s32( vcombine_s32(
+		vmovn_s64( vcvtq_s64_f64( ramp_neon( vget_low_s32( offset ), divisor ) ) ),
+		vmovn_s64( vcvtq_s64_f64( ramp_neon( vget_high_s32( offset ), divisor ) ) ) ) );
+	uint32x4_t r = vshrq_n_u32( vmulq_u32( vshrq_n_u32( vmulq_u32( t, t ), 16 ),
+		vsubq_u32( vdupq_n_u32( 3 << 16 ), vshlq_n_u32( t, 1 ) ) ), 16 );
+	r = vbslq_u32( below, vdupq_n_u32( 0 ), r );
+	return vbslq_u32( vbicq_u32( above, below ), vdupq_n_u32( 0x10000 ), r );
+}
+
+static inline int32x4_t sample_mix_neon( uint16x4_t dest, uint16x4_t src, int32x4_t mix )
+{
+	int32x4_t d = vreinterpretq_s32_u32( vmovl_u16( dest ) );
+	int32x4_t s = vreinterpretq_s32_u32( vmovl_u16( src ) );
+	return vaddq_s32( d, vshrq_n_s32( vmulq_s32( vsubq_s32( s, d ), mix ), 16 ) );
+}
+
+static INLINE int composite_line_neon( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a,
+	int weight, uint16_t *luma, int soft, uint32_t step, const int op, const int variant )
+{
+	int j;
+
+	for ( j = 0; j + 4 <= width; j += 4, dest += 8, src += 8 )
+	{
+		uint32x4_t a = ( variant & COMPOSITE_LINE_ALPHA_B ) ? load_alpha_neon( alpha_b ) : vdupq_n_u32( 255 );
+		uint32x4_t aa = ( variant & COMPOSITE_LINE_ALPHA_A ) ? load_alpha_neon( alpha_a ) : vdupq_n_u32( 255 );
+		uint32x4_t base = ( variant & COMPOSITE_LINE_LUMA ) ? smoothstep_neon( luma + j, soft, step ) : vdupq_n_u32( weight );
+		uint16x8_t d = vmovl_u8( vld1_u8( dest ) );
+		uint16x8_t s = vmovl_u8( vld1_u8( src ) );
+		int32x4_t mix;
+		int16x8_t out;
+
+		if ( op == composite_op_or )
+			a = vorrq_u32( a, aa );
+		else if ( op == composite_op_and )
+			a = vandq_u32( a, aa );
+		else if ( op == composite_op_xor )
+			a = veorq_u32( a, aa );
+		mix = vshrq_n_s32( vmulq_s32( vreinterpretq_s32_u32( base ),
+			vreinterpretq_s32_u32( vaddq_u32( a, vdupq_n_u32( 1 ) ) ) ), 8 );
+
+		// Each pixel has 2 bytes that share its mix.
+		out = vcombine_s16(
+			vmovn_s32( sample_mix_neon( vget_low_u16( d ), vget_low_u16( s ), vzip1q_s32( mix, mix ) ) ),
+			vmovn_s32( sample_mix_neon( vget_high_u16( d ), vget_high_u16( s ), vzip2q_s32( mix, mix ) ) ) );
+		vst1_u8( dest, vmovn_u16( vreinterpretq_u16_s16( out ) ) );
+
+		if ( variant & COMPOSITE_LINE_ALPHA_A )
+		{
+			uint32x4_t value = vreinterpretq_u32_s32( vshrq_n_s32( mix, 8 ) );
+			uint8_t bytes[ 8 ];
+			if ( op == composite_op_over )
+				value = vorrq_u32( value, aa );
+			vst1_u8( bytes, vmovn_u16( vcombine_u16( vmovn_u32( value ), vdup_n_u16( 0 ) ) ) );
+			memcpy( alpha_a, bytes, 4 );
+			alpha_a += 4;
+		}
+		if ( variant & COMPOSITE_LINE_ALPHA_B )
+			alpha_b += 4;
+	}
+	return j;
+}
+
+COMPOSITE_KERNEL_TABLE( neon, , "neon" )
+
+static const struct composite_line_kernels *detect_kernels( void )
+{
+	return &neon_kernels;
+}
+
+#else
+
+static const struct composite_line_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct composite_line_kernels *composite_line_simd_kernels( void )
+{
+	static const struct composite_line_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_COMPOSITE_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
@@ -0,0 +1,73 @@
+/*
+ * composite_line_simd.h -- vectorized composite line kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef COMPOSITE_LINE_SIMD_H
+#define COMPOSITE_LINE_SIMD_H
+
+#include <stdint.h>
+
+/** The alpha operators of the composite line functions. */
+
+enum composite_line_op
+{
+	composite_op_over = 0,
+	composite_op_or,
+	composite_op_and,
+	composite_op_xor,
+	composite_op_count
+};
+
+/** The variants of a line function, for the inputs it has.
+ *
+ * A variant is only called with the luma map and alpha channels of its
+ * flags, which are the same for all the lines of an image, so that its
+ * loops do not test for them.
+ */
+
+#define COMPOSITE_LINE_LUMA     (1)
+#define COMPOSITE_LINE_ALPHA_B  (2)
+#define COMPOSITE_LINE_ALPHA_A  (4)
+#define COMPOSITE_LINE_VARIANTS (8)
+
+static inline int composite_line_variant( const uint16_t *luma, const uint8_t *alpha_b, const uint8_t *alpha_a )
+{
+	return ( luma ? COMPOSITE_LINE_LUMA : 0 ) | ( alpha_b ? COMPOSITE_LINE_ALPHA_B : 0 ) |
+		( alpha_a ? COMPOSITE_LINE_ALPHA_A : 0 );
+}
+
+/** Composite the leading pixels of a line and return how many were done.
+ *
+ * The kernels match the scalar line functions of transition_composite.c
+ * exactly, including the luma map and softness ramp, and leave the rest
+ * of the line to them. \p luma is indexed from the start of the line.
+ */
+
+typedef int ( *composite_line_kernel )( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a,
+	int weight, uint16_t *luma, int soft, uint32_t step );
+
+struct composite_line_kernels
+{
+	const char *name;
+	composite_line_kernel line[ composite_op_count ][ COMPOSITE_LINE_VARIANTS ];
+};
+
+/** Get the best kernels for the CPU or NULL. */
+const struct composite_line_kernels *composite_line_simd_kernels( void );
+
+#endif
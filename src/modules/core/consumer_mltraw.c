@@ -0,0 +1,283 @@
+/*
+ * consumer_mltraw.c -- write raw frames to a file of fixed-size records
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for O_DIRECT
+#endif
+
+#include "frame_record.h"
+
+#include <framework/mlt_consumer.h>
+#include <framework/mlt_frame.h>
+#include <framework/mlt_log.h>
+#include <framework/mlt_profile.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct consumer_mltraw_s *consumer_mltraw;
+
+struct consumer_mltraw_s
+{
+	struct mlt_consumer_s parent;
+	pthread_t thread;
+	int running;
+	int joined;
+	int fd;
+	frame_file_header *header;
+	uint8_t *record;
+};
+
+static int consumer_start( mlt_consumer consumer );
+static int consumer_stop( mlt_consumer consumer );
+static int consumer_is_stopped( mlt_consumer consumer );
+static void *consumer_thread( void *arg );
+static void consumer_close( mlt_consumer consumer );
+
+/** Initialise the raw file consumer.
+*/
+
+mlt_consumer consumer_mltraw_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	consumer_mltraw self = calloc( 1, sizeof( struct consumer_mltraw_s ) );
+
+	if ( self != NULL && mlt_consumer_init( &self->parent, self, profile ) == 0 )
+	{
+		mlt_consumer consumer = &self->parent;
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+		self->fd = -1;
+		self->joined = 1;
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set( properties, "mlt_image_format", "yuv422" );
+		mlt_properties_set( properties, "mlt_audio_format", "s16" );
+		mlt_properties_set_int( properties, "terminate_on_pause", 1 );
+		mlt_properties_set_int( properties, "real_time", -1 );
+		mlt_properties_set_int( properties, "prefill", 1 );
+
+		consumer->close = consumer_close;
+		consumer->start = consumer_start;
+		consumer->stop = consumer_stop;
+		consumer->is_stopped = consumer_is_stopped;
+		return consumer;
+	}
+	free( self );
+	return NULL;
+}
+
+// Write a whole buffer at an offset, which O_DIRECT needs aligned.
+static int write_all( int fd, const uint8_t *data, size_t size, off_t offset )
+{
+	while ( size > 0 )
+	{
+		ssize_t n = pwrite( fd, data, size, offset );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 1;
+		data += n;
+		size -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+static int open_file( mlt_consumer consumer, const char *resource )
+{
+	int fd = -1;
+
+#ifdef O_DIRECT
+	// Bypass the page cache, if the file system allows it
+	if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( consumer ), "direct" ) )
+	{
+		fd = open( resource, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666 );
+		if ( fd < 0 )
+			mlt_log_verbose( MLT_CONSUMER_SERVICE( consumer ), "O_DIRECT is not available for %s\n", resource );
+	}
+#endif
+	if ( fd < 0 )
+		fd = open( resource, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+	return fd;
+}
+
+static int consumer_start( mlt_consumer consumer )
+{
+	consumer_mltraw self = consumer->child;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	const char *resource = mlt_properties_get( properties, "resource" );
+
+	if ( !self->running )
+	{
+		mlt_image_format format = mlt_image_format_id( mlt_properties_get( properties, "mlt_image_format" ) );
+		int width = mlt_properties_get_int( properties, "width" );
+		int height = mlt_properties_get_int( properties, "height" );
+		size_t record_size = mlt_properties_get_int64( properties, "record_size" );
+		void *header = NULL;
+		void *record = NULL;
+
+		consumer_stop( consumer );
+		if ( format == mlt_image_none )
+			format = mlt_image_yuv422;
+		if ( record_size <= 0 )
+			record_size = frame_record_size( consumer, mlt_image_format_size( format, width, height, NULL ) );
+		record_size = FRAME_FILE_ALIGN( record_size );
+
+		if ( !resource || posix_memalign( &header, 4096, FRAME_FILE_ALIGN( sizeof( frame_file_header ) ) )
+			|| posix_memalign( &record, 4096, record_size )
+			|| ( self->fd = open_file( consumer, resource ) ) < 0 )
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to open %s\n", resource ? resource : "" );
+			free( header );
+			free( record );
+			mlt_events_fire( properties, "consumer-fatal-error", NULL );
+			return 1;
+		}
+		memset( header, 0, FRAME_FILE_ALIGN( sizeof( frame_file_header ) ) );
+		memset( record, 0, record_size );
+		self->header = header;
+		self->record = record;
+
+		memcpy( self->header->magic, FRAME_FILE_MAGIC, sizeof( self->header->magic ) );
+		self->header->byte_order = FRAME_FILE_BYTE_ORDER;
+		self->header->version = FRAME_FILE_VERSION;
+		self->header->header_size = FRAME_FILE_ALIGN( sizeof( frame_file_header ) );
+		self->header->record_size = record_size;
+		self->header->width = width;
+		self->header->height = height;
+		self->header->frame_rate_num = profile->frame_rate_num;
+		self->header->frame_rate_den = profile->frame_rate_den;
+		self->header->sample_aspect_num = profile->sample_aspect_num;
+		self->header->sample_aspect_den = profile->sample_aspect_den;
+		self->header->progressive = mlt_properties_get_int( properties, "progressive" );
+		self->header->colorspace = profile->colorspace;
+		self->header->image_format = format;
+		self->header->audio_format = frame_record_audio_format( consumer );
+		self->header->frequency = mlt_properties_get_int( properties, "frequency" );
+		self->header->channels = mlt_properties_get_int( properties, "channels" );
+
+		self->running = 1;
+		self->joined = 0;
+		pthread_create( &self->thread, NULL, consumer_thread, consumer );
+	}
+	return 0;
+}
+
+static int consumer_stop( mlt_consumer consumer )
+{
+	consumer_mltraw self = consumer->child;
+
+	if ( !self->joined )
+	{
+		self->running = 0;
+		self->joined = 1;
+		pthread_join( self->thread, NULL );
+	}
+	if ( self->fd >= 0 )
+	{
+		// Record the number of frames written
+		if ( write_all( self->fd, (uint8_t*) self->header, self->header->header_size, 0 ) )
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write the header of %s\n",
+				mlt_properties_get( MLT_CONSUMER_PROPERTIES( consumer ), "resource" ) );
+		close( self->fd );
+		self->fd = -1;
+	}
+	free( self->header );
+	free( self->record );
+	self->header = NULL;
+	self->record = NULL;
+
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer consumer )
+{
+	consumer_mltraw self = consumer->child;
+	return !self->running;
+}
+
+static void *consumer_thread( void *arg )
+{
+	mlt_consumer consumer = arg;
+	consumer_mltraw self = consumer->child;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	int terminate_on_pause = mlt_properties_get_int( properties, "terminate_on_pause" );
+	int terminated = 0;
+	mlt_frame frame = NULL;
+
+	// Write the header first so that a file cut short still opens
+	if ( write_all( self->fd, (uint8_t*) self->header, self->header->header_size, 0 ) )
+		terminated = 1;
+
+	while ( !terminated && self->running )
+	{
+		frame = mlt_consumer_rt_frame( consumer );
+
+		if ( terminate_on_pause && frame != NULL )
+			terminated = mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame ), "_speed" ) == 0.0;
+
+		// The frame of the pause is not part of the output
+		if ( frame != NULL && !terminated )
+		{
+			frame_file_header *header = self->header;
+			off_t offset = header->header_size + header->count * header->record_size;
+
+			if ( frame_record_write( consumer, frame, self->record, header->record_size, header->count ) )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "frame does not fit in a record of %u bytes\n",
+					(unsigned) header->record_size );
+				mlt_events_fire( properties, "consumer-fatal-error", NULL );
+				terminated = 1;
+			}
+			else if ( write_all( self->fd, self->record, header->record_size, offset ) )
+			{
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write %s\n",
+					mlt_properties_get( properties, "resource" ) );
+				mlt_events_fire( properties, "consumer-fatal-error", NULL );
+				terminated = 1;
+			}
+			else
+			{
+				header->count ++;
+			}
+			mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+		}
+		mlt_frame_close( frame );
+	}
+
+	self->running = 0;
+	mlt_consumer_stopped( consumer );
+
+	return NULL;
+}
+
+static void consumer_close( mlt_consumer consumer )
+{
+	consumer_mltraw self = consumer->child;
+
+	mlt_consumer_stop( consumer );
+	consumer->close = NULL;
+	mlt_consumer_close( consumer );
+	free( self );
+}
@@ -30,9 +30,30 @@ static int is_stopped( mlt_consumer consumer );
 static void *consumer_thread( void *arg );
 static void consumer_close( mlt_consumer consumer );
 static void purge( mlt_consumer consumer );
+static void *output_thread( void *arg );
 
 static mlt_properties normalisers = NULL;
 
+/** The queue and thread that feed one nested consumer.
+*/
+
+typedef struct
+{
+	mlt_consumer consumer;
+	mlt_consumer nested;
+	mlt_deque queue;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int size;
+	int drop;
+	int deeply;
+	int closed;
+	int dropped;
+} multi_output;
+
+static void output_close( multi_output *output );
+
 /** Initialise the consumer.
 */
 
@@ -48,6 +69,8 @@ mlt_consumer consumer_multi_init( mlt_profile profile, mlt_service_type type, co
 		mlt_properties_set( properties, "resource", arg );
 		mlt_properties_set_int( properties, "real_time", -1 );
 		mlt_properties_set_int( properties, "terminate_on_pause", 1 );
+		mlt_properties_set_int( properties, "queue", 2 );
+		mlt_properties_set( properties, "policy", "block" );
 
 		// Init state
 		mlt_properties_set_int( properties, "joined", 1 );
@@ -157,6 +180,157 @@ static void attach_normalisers( mlt_profile profile, mlt_service service )
 	create_filter( profile, service, "audioconvert", &created );
 }
 
+/** A converted image shared by the outputs that ask for the same one.
+*/
+
+typedef struct
+{
+	pthread_mutex_t mutex;
+	int done;
+	uint8_t *image;
+	uint8_t *alpha;
+	int alpha_size;
+	mlt_image_format format;
+	int width;
+	int height;
+} multi_memo;
+
+static pthread_mutex_t memo_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void memo_close( multi_memo *memo )
+{
+	pthread_mutex_destroy( &memo->mutex );
+	mlt_pool_release( memo->image );
+	mlt_pool_release( memo->alpha );
+	free( memo );
+}
+
+// Only images in system memory can be shared.
+static int memo_format( mlt_image_format format )
+{
+	return format != mlt_image_none && format != mlt_image_glsl && format != mlt_image_glsl_texture
+		&& format != mlt_image_hwsurface;
+}
+
+static int memo_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
+	mlt_frame source = mlt_properties_get_data( frame_props, "_multi_source", NULL );
+	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+	multi_memo *memo = NULL;
+	char key[256];
+	int error = 0;
+
+	if ( !source || !memo_format( *format ) || !profile )
+		return mlt_frame_get_image( frame, image, format, width, height, writable );
+
+	// The conversion depends on the request and on what the consumer put on the frame
+	snprintf( key, sizeof(key), "_multi_memo.%d.%dx%d.%s.%d.%s.%d.%s.%d:%d.%d:%d.%d", *format, *width, *height,
+		mlt_properties_get( frame_props, "rescale.interp" ),
+		mlt_properties_get_int( frame_props, "consumer_deinterlace" ),
+		mlt_properties_get( frame_props, "deinterlace_method" ),
+		mlt_properties_get_int( frame_props, "consumer_tff" ),
+		mlt_properties_get( frame_props, "consumer_color_trc" ),
+		profile->sample_aspect_num, profile->sample_aspect_den,
+		profile->display_aspect_num, profile->display_aspect_den, profile->colorspace );
+
+	pthread_mutex_lock( &memo_mutex );
+	memo = mlt_properties_get_data( MLT_FRAME_PROPERTIES( source ), key, NULL );
+	if ( !memo && ( memo = calloc( 1, sizeof( *memo ) ) ) )
+	{
+		pthread_mutex_init( &memo->mutex, NULL );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( source ), key, memo, 0, (mlt_destructor) memo_close, NULL );
+	}
+	pthread_mutex_unlock( &memo_mutex );
+	if ( !memo )
+		return mlt_frame_get_image( frame, image, format, width, height, writable );
+
+	// The first output to ask converts while the others wait for it
+	pthread_mutex_lock( &memo->mutex );
+	if ( !memo->done )
+	{
+		error = mlt_frame_get_image( frame, image, format, width, height, writable );
+		memo->done = 1;
+		if ( !error && *image && memo_format( *format ) )
+		{
+			int size = mlt_image_format_size( *format, *width, *height, NULL );
+			uint8_t *alpha = mlt_properties_get_data( frame_props, "alpha", &memo->alpha_size );
+
+			// Share the converted image of this output unless it must be copied
+			if ( *image == mlt_properties_get_data( frame_props, "image", NULL ) )
+				memo->image = mlt_frame_share_data( frame, "image", NULL );
+			if ( !memo->image )
+			{
+				memo->image = mlt_pool_alloc( size );
+				memcpy( memo->image, *image, size );
+			}
+			if ( alpha && memo->alpha_size <= 0 )
+				memo->alpha_size = *width * *height;
+			if ( alpha && !( memo->alpha = mlt_frame_share_data( frame, "alpha", NULL ) ) )
+			{
+				memo->alpha = mlt_pool_alloc( memo->alpha_size );
+				memcpy( memo->alpha, alpha, memo->alpha_size );
+			}
+			memo->format = *format;
+			memo->width = *width;
+			memo->height = *height;
+		}
+		pthread_mutex_unlock( &memo->mutex );
+		return error;
+	}
+	pthread_mutex_unlock( &memo->mutex );
+
+	// A failed conversion is not shared
+	if ( !memo->image )
+		return mlt_frame_get_image( frame, image, format, width, height, writable );
+
+	// The source frame, and so the memo, lives as long as this frame
+	*format = memo->format;
+	*width = memo->width;
+	*height = memo->height;
+	if ( writable )
+	{
+		int size = mlt_image_format_size( *format, *width, *height, NULL );
+		*image = mlt_pool_alloc( size );
+		memcpy( *image, memo->image, size );
+		mlt_frame_set_image( frame, *image, size, mlt_pool_release );
+	}
+	else
+	{
+		*image = memo->image;
+		mlt_frame_set_image( frame, *image, 0, NULL );
+	}
+	if ( memo->alpha )
+		mlt_frame_set_alpha( frame, memo->alpha, memo->alpha_size, NULL );
+	mlt_properties_set_int( frame_props, "format", *format );
+	mlt_properties_set_int( frame_props, "width", *width );
+	mlt_properties_set_int( frame_props, "height", *height );
+
+	return error;
+}
+
+static mlt_frame memo_process( mlt_filter filter, mlt_frame frame )
+{
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, memo_get_image );
+	return frame;
+}
+
+// Let the outputs that ask for the same image share one conversion.
+static void attach_memo( mlt_service service )
+{
+	mlt_filter filter = mlt_filter_new();
+	if ( filter )
+	{
+		filter->process = memo_process;
+		mlt_service_set_profile( MLT_FILTER_SERVICE( filter ), mlt_service_profile( service ) );
+		mlt_properties_set_int( MLT_FILTER_PROPERTIES( filter ), "_loader", 1 );
+		mlt_service_attach( service, filter );
+		mlt_filter_close( filter );
+	}
+}
+
 static void on_frame_show( void *dummy, mlt_properties properties, mlt_frame frame )
 {
 	mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
@@ -308,8 +482,40 @@ static void foreach_consumer_start( mlt_consumer consumer )
 			mlt_properties_set_data( nested_props, "_multi_audio", NULL, 0, NULL, NULL );
 			mlt_properties_set_int( nested_props, "_multi_samples", 0 );
 			mlt_consumer_start( nested );
+
+			// Give each nested consumer its own queue and thread
+			const char *policy = mlt_properties_get( nested_props, "policy" );
+			multi_output *output = calloc( 1, sizeof( *output ) );
+			output->consumer = consumer;
+			output->nested = nested;
+			output->queue = mlt_deque_init();
+			output->size = mlt_properties_get_int( properties, "queue" );
+			output->size = output->size > 0 ? output->size : 1;
+			if ( !policy )
+				policy = mlt_properties_get( properties, "policy" );
+			output->drop = policy && !strcmp( policy, "drop" );
+			// Outputs after the first get a copy of the image they can change
+			output->deeply = index > 1 ? 1 : 0;
+			pthread_mutex_init( &output->mutex, NULL );
+			pthread_cond_init( &output->cond, NULL );
+			pthread_create( &output->thread, NULL, output_thread, output );
+			snprintf( key, sizeof(key), "%d.output", index - 1 );
+			mlt_properties_set_data( properties, key, output, 0, (mlt_destructor) output_close, NULL );
 		}
 	} while ( nested );
+
+	// A single output has nobody to share its conversions with
+	if ( index > 2 && !mlt_properties_get_int( properties, "_multi_memo" ) )
+	{
+		mlt_properties_set_int( properties, "_multi_memo", 1 );
+		index = 0;
+		do {
+			snprintf( key, sizeof(key), "%d.consumer", index++ );
+			nested = mlt_properties_get_data( properties, key, NULL );
+			if ( nested )
+				attach_memo( MLT_CONSUMER_SERVICE(nested) );
+		} while ( nested );
+	}
 }
 
 static void foreach_consumer_refresh( mlt_consumer consumer )
@@ -342,107 +548,213 @@ static void foreach_consumer_update( mlt_consumer consumer )
 	} while ( nested );
 }
 
-static void foreach_consumer_put( mlt_consumer consumer, mlt_frame frame )
+// Send a frame to a nested consumer, cloning it as many times as the nested frame rate requires.
+static void put_nested( mlt_consumer consumer, mlt_consumer nested, mlt_frame frame, int deeply )
 {
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
-	mlt_consumer nested = NULL;
+	mlt_properties nested_props = MLT_CONSUMER_PROPERTIES(nested);
+	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
+	double self_fps = mlt_properties_get_double( properties, "fps" );
+	double nested_fps = mlt_properties_get_double( nested_props, "fps" );
+	mlt_position nested_pos = mlt_properties_get_position( nested_props, "_multi_position" );
+	mlt_position self_pos = mlt_frame_get_position( frame );
+	double self_time = self_pos / self_fps;
+	double nested_time = nested_pos / nested_fps;
+
+	// get the audio for the current frame, which foreach_consumer_put fetched
+	uint8_t *buffer = mlt_properties_get_data( frame_props, "audio", NULL );
+	mlt_audio_format format = mlt_properties_get_int( frame_props, "audio_format" );
+	int channels = mlt_properties_get_int( frame_props, "audio_channels" );
+	int frequency = mlt_properties_get_int( frame_props, "audio_frequency" );
+	int current_samples = buffer ? mlt_properties_get_int( frame_props, "audio_samples" ) : 0;
+	int current_size = mlt_audio_format_size( format, current_samples, channels );
+
+	// get any leftover audio
+	int prev_size = 0;
+	uint8_t *prev_buffer = mlt_properties_get_data( nested_props, "_multi_audio", &prev_size );
+	uint8_t *new_buffer = NULL;
+	if ( prev_size > 0 )
+	{
+		new_buffer = mlt_pool_alloc( prev_size + current_size );
+		memcpy( new_buffer, prev_buffer, prev_size );
+		if ( current_size > 0 )
+			memcpy( new_buffer + prev_size, buffer, current_size );
+		buffer = new_buffer;
+	}
+	current_size += prev_size;
+	current_samples += mlt_properties_get_int( nested_props, "_multi_samples" );
+
+	while ( nested_time <= self_time )
+	{
+		// put ideal number of samples into cloned frame
+		mlt_frame clone_frame = mlt_frame_clone( frame, deeply );
+		mlt_properties clone_props = MLT_FRAME_PROPERTIES( clone_frame );
+		// Converted images are shared through the source frame
+		mlt_properties_inc_ref( frame_props );
+		mlt_properties_set_data( clone_props, "_multi_source", frame, 0, (mlt_destructor) mlt_frame_close, NULL );
+		int nested_samples = mlt_sample_calculator( nested_fps, frequency, nested_pos );
+		// -10 is an optimization to avoid tiny amounts of leftover samples
+		nested_samples = nested_samples > current_samples - 10 ? current_samples : nested_samples;
+		int nested_size = mlt_audio_format_size( format, nested_samples, channels );
+		if ( nested_size > 0 )
+		{
+			prev_buffer = mlt_pool_alloc( nested_size );
+			memcpy( prev_buffer, buffer, nested_size );
+		}
+		else
+		{
+			prev_buffer = NULL;
+			nested_size = 0;
+		}
+		mlt_frame_set_audio( clone_frame, prev_buffer, format, nested_size, mlt_pool_release );
+		mlt_properties_set_int( clone_props, "audio_samples", nested_samples );
+		mlt_properties_set_int( clone_props, "audio_frequency", frequency );
+		mlt_properties_set_int( clone_props, "audio_channels", channels );
+
+		// chomp the audio
+		current_samples -= nested_samples;
+		current_size -= nested_size;
+		buffer += nested_size;
+
+		// Fix some things
+		mlt_properties_set_int( clone_props, "meta.media.width",
+			mlt_properties_get_int( frame_props, "width" ) );
+		mlt_properties_set_int( clone_props, "meta.media.height",
+			mlt_properties_get_int( frame_props, "height" ) );
+
+		// send frame to nested consumer
+		mlt_consumer_put_frame( nested, clone_frame );
+		mlt_properties_set_position( nested_props, "_multi_position", ++nested_pos );
+		nested_time = nested_pos / nested_fps;
+	}
+
+	// save any remaining audio
+	if ( current_size > 0 )
+	{
+		prev_buffer = mlt_pool_alloc( current_size );
+		memcpy( prev_buffer, buffer, current_size );
+	}
+	else
+	{
+		prev_buffer = NULL;
+		current_size = 0;
+	}
+	mlt_pool_release( new_buffer );
+	mlt_properties_set_data( nested_props, "_multi_audio", prev_buffer, current_size, mlt_pool_release, NULL );
+	mlt_properties_set_int( nested_props, "_multi_samples", current_samples );
+}
+
+// Feed one nested consumer from its queue so a slow output does not hold up the others.
+static void *output_thread( void *arg )
+{
+	multi_output *output = arg;
+	mlt_frame frame;
+
+	while ( 1 )
+	{
+		pthread_mutex_lock( &output->mutex );
+		while ( !output->closed && !mlt_deque_count( output->queue ) )
+			pthread_cond_wait( &output->cond, &output->mutex );
+		frame = mlt_deque_pop_front( output->queue );
+		pthread_cond_broadcast( &output->cond );
+		pthread_mutex_unlock( &output->mutex );
+		if ( !frame )
+			break;
+
+		if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_multi_dummy" ) )
+			mlt_consumer_put_frame( output->nested, frame );
+		else
+		{
+			put_nested( output->consumer, output->nested, frame, output->deeply );
+			mlt_frame_close( frame );
+		}
+	}
+	return NULL;
+}
+
+// Queue a frame reference for an output; returns false if the policy dropped it.
+static int output_push( multi_output *output, mlt_frame frame, int force )
+{
+	int queued = 1;
+
+	pthread_mutex_lock( &output->mutex );
+	if ( output->drop && !force && mlt_deque_count( output->queue ) >= output->size )
+		queued = 0;
+	while ( queued && !output->closed && mlt_deque_count( output->queue ) >= output->size )
+		pthread_cond_wait( &output->cond, &output->mutex );
+	if ( queued )
+		mlt_deque_push_back( output->queue, frame );
+	pthread_cond_broadcast( &output->cond );
+	pthread_mutex_unlock( &output->mutex );
+	return queued;
+}
+
+// Close an output's queue, let its thread drain it and release the queue.
+static void output_close( multi_output *output )
+{
+	if ( output )
+	{
+		mlt_frame frame;
+
+		pthread_mutex_lock( &output->mutex );
+		output->closed = 1;
+		pthread_cond_broadcast( &output->cond );
+		pthread_mutex_unlock( &output->mutex );
+		pthread_join( output->thread, NULL );
+		while ( ( frame = mlt_deque_pop_front( output->queue ) ) )
+			mlt_frame_close( frame );
+		mlt_deque_close( output->queue );
+		pthread_cond_destroy( &output->cond );
+		pthread_mutex_destroy( &output->mutex );
+		free( output );
+	}
+}
+
+// Discard the frames waiting in an output's queue.
+static void output_purge( multi_output *output )
+{
+	if ( output )
+	{
+		mlt_frame frame;
+
+		pthread_mutex_lock( &output->mutex );
+		while ( ( frame = mlt_deque_pop_front( output->queue ) ) )
+			mlt_frame_close( frame );
+		pthread_cond_broadcast( &output->cond );
+		pthread_mutex_unlock( &output->mutex );
+	}
+}
+
+static void foreach_consumer_put( mlt_consumer consumer, mlt_frame frame, int terminated )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	multi_output *output = NULL;
 	char key[30];
 	int index = 0;
 
+	// get the audio for the current frame once for all of the outputs
+	uint8_t *buffer = NULL;
+	mlt_audio_format format = mlt_audio_s16;
+	int channels = mlt_properties_get_int( properties, "channels" );
+	int frequency = mlt_properties_get_int( properties, "frequency" );
+	int samples = mlt_sample_calculator( mlt_properties_get_double( properties, "fps" ), frequency, mlt_frame_get_position( frame ) );
+	mlt_frame_get_audio( frame, (void**) &buffer, &format, &frequency, &channels, &samples );
+
 	do {
-		snprintf( key, sizeof(key), "%d.consumer", index++ );
-		nested = mlt_properties_get_data( properties, key, NULL );
-		if ( nested )
+		snprintf( key, sizeof(key), "%d.output", index++ );
+		output = mlt_properties_get_data( properties, key, NULL );
+		if ( output )
 		{
-			mlt_properties nested_props = MLT_CONSUMER_PROPERTIES(nested);
-			double self_fps = mlt_properties_get_double( properties, "fps" );
-			double nested_fps = mlt_properties_get_double( nested_props, "fps" );
-			mlt_position nested_pos = mlt_properties_get_position( nested_props, "_multi_position" );
-			mlt_position self_pos = mlt_frame_get_position( frame );
-			double self_time = self_pos / self_fps;
-			double nested_time = nested_pos / nested_fps;
-
-			// get the audio for the current frame
-			uint8_t *buffer = NULL;
-			mlt_audio_format format = mlt_audio_s16;
-			int channels = mlt_properties_get_int( properties, "channels" );
-			int frequency = mlt_properties_get_int( properties, "frequency" );
-			int current_samples = mlt_sample_calculator( self_fps, frequency, self_pos );
-			mlt_frame_get_audio( frame, (void**) &buffer, &format, &frequency, &channels, &current_samples );
-			int current_size = mlt_audio_format_size( format, current_samples, channels );
-
-			// get any leftover audio
-			int prev_size = 0;
-			uint8_t *prev_buffer = mlt_properties_get_data( nested_props, "_multi_audio", &prev_size );
-			uint8_t *new_buffer = NULL;
-			if ( prev_size > 0 )
+			// Each output holds a reference on the frame until its thread is done with it
+			mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( frame ) );
+			if ( !output_push( output, frame, terminated ) )
 			{
-				new_buffer = mlt_pool_alloc( prev_size + current_size );
-				memcpy( new_buffer, prev_buffer, prev_size );
-				memcpy( new_buffer + prev_size, buffer, current_size );
-				buffer = new_buffer;
-			}
-			current_size += prev_size;
-			current_samples += mlt_properties_get_int( nested_props, "_multi_samples" );
-
-			while ( nested_time <= self_time )
-			{
-				// put ideal number of samples into cloned frame
-				int deeply = index > 1 ? 1 : 0;
-				mlt_frame clone_frame = mlt_frame_clone( frame, deeply );
-				mlt_properties clone_props = MLT_FRAME_PROPERTIES( clone_frame );
-				int nested_samples = mlt_sample_calculator( nested_fps, frequency, nested_pos );
-				// -10 is an optimization to avoid tiny amounts of leftover samples
-				nested_samples = nested_samples > current_samples - 10 ? current_samples : nested_samples;
-				int nested_size = mlt_audio_format_size( format, nested_samples, channels );
-				if ( nested_size > 0 )
-				{
-					prev_buffer = mlt_pool_alloc( nested_size );
-					memcpy( prev_buffer, buffer, nested_size );
-				}
-				else
-				{
-					prev_buffer = NULL;
-					nested_size = 0;
-				}
-				mlt_frame_set_audio( clone_frame, prev_buffer, format, nested_size, mlt_pool_release );
-				mlt_properties_set_int( clone_props, "audio_samples", nested_samples );
-				mlt_properties_set_int( clone_props, "audio_frequency", frequency );
-				mlt_properties_set_int( clone_props, "audio_channels", channels );
-
-				// chomp the audio
-				current_samples -= nested_samples;
-				current_size -= nested_size;
-				buffer += nested_size;
-
-				// Fix some things
-				mlt_properties_set_int( clone_props, "meta.media.width",
-					mlt_properties_get_int( MLT_FRAME_PROPERTIES(frame), "width" ) );
-				mlt_properties_set_int( clone_props, "meta.media.height",
-					mlt_properties_get_int( MLT_FRAME_PROPERTIES(frame), "height" ) );
-
-				// send frame to nested consumer
-				mlt_consumer_put_frame( nested, clone_frame );
-				mlt_properties_set_position( nested_props, "_multi_position", ++nested_pos );
-				nested_time = nested_pos / nested_fps;
-			}
-
-			// save any remaining audio
-			if ( current_size > 0 )
-			{
-				prev_buffer = mlt_pool_alloc( current_size );
-				memcpy( prev_buffer, buffer, current_size );
-			}
-			else
-			{
-				prev_buffer = NULL;
-				current_size = 0;
+				mlt_frame_close( frame );
+				mlt_log_verbose( MLT_CONSUMER_SERVICE(consumer), "output %d dropped frame %d\n",
+					index - 1, ++output->dropped );
 			}
-			mlt_pool_release( new_buffer );
-			mlt_properties_set_data( nested_props, "_multi_audio", prev_buffer, current_size, mlt_pool_release, NULL );
-			mlt_properties_set_int( nested_props, "_multi_samples", current_samples );
 		}
-	} while ( nested );
+	} while ( output );
 }
 
 static void foreach_consumer_stop( mlt_consumer consumer )
@@ -454,21 +766,34 @@ static void foreach_consumer_stop( mlt_consumer consumer )
 	struct timespec tm = { 0, 1000 * 1000 };
 
 	do {
-		snprintf( key, sizeof(key), "%d.consumer", index++ );
+		snprintf( key, sizeof(key), "%d.consumer", index );
 		nested = mlt_properties_get_data( properties, key, NULL );
+		snprintf( key, sizeof(key), "%d.output", index++ );
+		multi_output *output = mlt_properties_get_data( properties, key, NULL );
 		if ( nested )
 		{
 			// Let consumer with terminate_on_pause stop on their own
 			if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES(nested), "terminate_on_pause" ) )
 			{
 				// Send additional dummy frame to unlatch nested consumer's threads
-				mlt_consumer_put_frame( nested, mlt_frame_init( MLT_CONSUMER_SERVICE(consumer) ) );
+				mlt_frame dummy = mlt_frame_init( MLT_CONSUMER_SERVICE(consumer) );
+				if ( output )
+				{
+					mlt_properties_set_int( MLT_FRAME_PROPERTIES( dummy ), "_multi_dummy", 1 );
+					output_push( output, dummy, 1 );
+				}
+				else
+				{
+					mlt_consumer_put_frame( nested, dummy );
+				}
+				mlt_properties_set_data( properties, key, NULL, 0, NULL, NULL );
 				// wait for stop
 				while ( !mlt_consumer_is_stopped( nested ) )
 					nanosleep( &tm, NULL );
 			}
 			else
 			{
+				mlt_properties_set_data( properties, key, NULL, 0, NULL, NULL );
 				mlt_consumer_stop( nested );
 			}
 		}
@@ -554,8 +879,10 @@ static void purge( mlt_consumer consumer )
 		int index = 0;
 
 		do {
-			snprintf( key, sizeof(key), "%d.consumer", index++ );
+			snprintf( key, sizeof(key), "%d.consumer", index );
 			nested = mlt_properties_get_data( properties, key, NULL );
+			snprintf( key, sizeof(key), "%d.output", index++ );
+			output_purge( mlt_properties_get_data( properties, key, NULL ) );
 			mlt_consumer_purge( nested );
 		} while ( nested );
 	}
@@ -593,7 +920,7 @@ static void *consumer_thread( void *arg )
 			{
 				if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES(frame), "_speed" ) == 0 )
 					foreach_consumer_refresh( consumer );
-				foreach_consumer_put( consumer, frame );
+				foreach_consumer_put( consumer, frame, 0 );
 			}
 			else
 			{
@@ -608,7 +935,7 @@ static void *consumer_thread( void *arg )
 			if ( frame && terminated )
 			{
 				// Send this termination frame to nested consumers for their cancellation
-				foreach_consumer_put( consumer, frame );
+				foreach_consumer_put( consumer, frame, 1 );
 			}
 			if ( frame )
 				mlt_frame_close( frame );
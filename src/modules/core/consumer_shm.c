@@ -0,0 +1,182 @@
+/*
+ * consumer_shm.c -- pass frames to another process in shared memory
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "frame_record.h"
+#include "shm_ring.h"
+
+#include <framework/mlt_consumer.h>
+#include <framework/mlt_frame.h>
+#include <framework/mlt_log.h>
+#include <framework/mlt_profile.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static int consumer_start( mlt_consumer consumer );
+static int consumer_stop( mlt_consumer consumer );
+static int consumer_is_stopped( mlt_consumer consumer );
+static void *consumer_thread( void *arg );
+static void consumer_close( mlt_consumer consumer );
+
+/** Initialise the shared memory consumer.
+*/
+
+mlt_consumer consumer_shm_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_consumer consumer = mlt_consumer_new( profile );
+
+	if ( consumer != NULL )
+	{
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+		mlt_properties_set( properties, "resource", arg ? arg : "mlt" );
+		mlt_properties_set_int( properties, "slots", 8 );
+		mlt_properties_set( properties, "mlt_image_format", "yuv422" );
+		mlt_properties_set( properties, "mlt_audio_format", "s16" );
+
+		consumer->close = consumer_close;
+		consumer->start = consumer_start;
+		consumer->stop = consumer_stop;
+		consumer->is_stopped = consumer_is_stopped;
+	}
+
+	return consumer;
+}
+
+// The largest frame of the profile, so that the ring can be made before the first frame.
+static size_t default_slot_size( mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+
+	// Room for 16-bit 4:4:4
+	return frame_record_size( consumer, width * height * 6 );
+}
+
+static int consumer_start( mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+	if ( !mlt_properties_get_int( properties, "running" ) )
+	{
+		pthread_t *thread = calloc( 1, sizeof( pthread_t ) );
+		size_t slot_size = mlt_properties_get_int64( properties, "slot_size" );
+		shm_ring ring = shm_ring_create( mlt_properties_get( properties, "resource" ),
+			mlt_properties_get_int( properties, "slots" ), slot_size > 0 ? slot_size : default_slot_size( consumer ) );
+
+		if ( !ring || !thread )
+		{
+			shm_ring_close( ring );
+			free( thread );
+			mlt_events_fire( properties, "consumer-fatal-error", NULL );
+			return 1;
+		}
+		mlt_properties_set_data( properties, "_ring", ring, 0, (mlt_destructor) shm_ring_close, NULL );
+		mlt_properties_set_data( properties, "thread", thread, sizeof( pthread_t ), free, NULL );
+		mlt_properties_set_int( properties, "running", 1 );
+		mlt_properties_set_int( properties, "joined", 0 );
+		pthread_create( thread, NULL, consumer_thread, consumer );
+	}
+	return 0;
+}
+
+static int consumer_stop( mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+
+	if ( !mlt_properties_get_int( properties, "joined" ) )
+	{
+		pthread_t *thread = mlt_properties_get_data( properties, "thread", NULL );
+
+		mlt_properties_set_int( properties, "running", 0 );
+		mlt_properties_set_int( properties, "joined", 1 );
+		if ( thread )
+			pthread_join( *thread, NULL );
+
+		// Closing the ring ends the stream for the reader
+		mlt_properties_set_data( properties, "_ring", NULL, 0, NULL, NULL );
+	}
+
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer consumer )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	return !mlt_properties_get_int( properties, "running" );
+}
+
+static void *consumer_thread( void *arg )
+{
+	mlt_consumer consumer = arg;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	shm_ring ring = mlt_properties_get_data( properties, "_ring", NULL );
+	int terminate_on_pause = mlt_properties_get_int( properties, "terminate_on_pause" );
+	int terminated = 0;
+	int64_t count = 0;
+	mlt_frame frame = NULL;
+
+	while ( !terminated && mlt_properties_get_int( properties, "running" ) )
+	{
+		frame = mlt_consumer_rt_frame( consumer );
+
+		if ( terminate_on_pause && frame != NULL )
+			terminated = mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame ), "_speed" ) == 0.0;
+
+		if ( frame != NULL )
+		{
+			int index = 0;
+
+			// Wait for the reader to release a slot
+			while ( mlt_properties_get_int( properties, "running" ) && shm_ring_acquire_write( ring, 100, &index ) );
+			if ( mlt_properties_get_int( properties, "running" ) )
+			{
+				if ( frame_record_write( consumer, frame, shm_ring_slot( ring, index ), shm_ring_slot_size( ring ), count ++ ) )
+				{
+					mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "frame does not fit in a slot of %u bytes\n",
+						(unsigned) shm_ring_slot_size( ring ) );
+					mlt_events_fire( properties, "consumer-fatal-error", NULL );
+					terminated = 1;
+				}
+				else
+				{
+					shm_ring_commit( ring, index );
+				}
+			}
+			mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+			mlt_frame_close( frame );
+		}
+	}
+	shm_ring_set_eof( ring );
+
+	mlt_properties_set_int( properties, "running", 0 );
+	mlt_consumer_stopped( consumer );
+
+	return NULL;
+}
+
+static void consumer_close( mlt_consumer consumer )
+{
+	mlt_consumer_stop( consumer );
+	mlt_consumer_close( consumer );
+	free( consumer );
+}
@@ -21,11 +21,18 @@
 #include <string.h>
 #include <limits.h>
 
+#ifndef _WIN32
+extern mlt_consumer consumer_mltraw_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#endif
 extern mlt_consumer consumer_multi_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_consumer consumer_null_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#ifndef _WIN32
+extern mlt_consumer consumer_shm_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#endif
 extern mlt_filter filter_audiochannels_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audioconvert_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audiomap_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_filter filter_audiomatrix_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audiowave_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_brightness_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_channelcopy_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
@@ -54,7 +61,14 @@ extern mlt_producer producer_hold_init( mlt_profile profile, mlt_service_type ty
 extern mlt_producer producer_loader_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_producer producer_melt_file_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_producer producer_melt_init( mlt_profile profile, mlt_service_type type, const char *id, char **argv );
+#ifndef _WIN32
+extern mlt_producer producer_mltraw_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#endif
 extern mlt_producer producer_noise_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_producer producer_render_cache_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#ifndef _WIN32
+extern mlt_producer producer_shm_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+#endif
 extern mlt_producer producer_timewarp_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_producer producer_tone_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 #include "transition_composite.h"
@@ -72,11 +86,18 @@ static mlt_properties metadata( mlt_service_type type, const char *id, void *dat
 
 MLT_REPOSITORY
 {
+#ifndef _WIN32
+	MLT_REGISTER( consumer_type, "mltraw", consumer_mltraw_init );
+#endif
 	MLT_REGISTER( consumer_type, "multi", consumer_multi_init );
 	MLT_REGISTER( consumer_type, "null", consumer_null_init );
+#ifndef _WIN32
+	MLT_REGISTER( consumer_type, "shm", consumer_shm_init );
+#endif
 	MLT_REGISTER( filter_type, "audiochannels", filter_audiochannels_init );
 	MLT_REGISTER( filter_type, "audioconvert", filter_audioconvert_init );
 	MLT_REGISTER( filter_type, "audiomap", filter_audiomap_init );
+	MLT_REGISTER( filter_type, "audiomatrix", filter_audiomatrix_init );
 	MLT_REGISTER( filter_type, "audiowave", filter_audiowave_init );
 	MLT_REGISTER( filter_type, "brightness", filter_brightness_init );
 	MLT_REGISTER( filter_type, "channelcopy", filter_channelcopy_init );
@@ -109,7 +130,14 @@ MLT_REPOSITORY
 	MLT_REGISTER( producer_type, "loader", producer_loader_init );
 	MLT_REGISTER( producer_type, "melt", producer_melt_init );
 	MLT_REGISTER( producer_type, "melt_file", producer_melt_file_init );
+#ifndef _WIN32
+	MLT_REGISTER( producer_type, "mltraw", producer_mltraw_init );
+#endif
 	MLT_REGISTER( producer_type, "noise", producer_noise_init );
+	MLT_REGISTER( producer_type, "render_cache", producer_render_cache_init );
+#ifndef _WIN32
+	MLT_REGISTER( producer_type, "shm", producer_shm_init );
+#endif
 	MLT_REGISTER( producer_type, "timewarp", producer_timewarp_init );
 	MLT_REGISTER( producer_type, "tone", producer_tone_init );
 	MLT_REGISTER( transition_type, "composite", transition_composite_init );
@@ -118,8 +146,15 @@ MLT_REPOSITORY
 	MLT_REGISTER( transition_type, "matte", transition_matte_init );
 	MLT_REGISTER( transition_type, "region", transition_region_init );
 
+#ifndef _WIN32
+	MLT_REGISTER_METADATA( consumer_type, "mltraw", metadata, "consumer_mltraw.yml" );
+#endif
 	MLT_REGISTER_METADATA( consumer_type, "multi", metadata, "consumer_multi.yml" );
+#ifndef _WIN32
+	MLT_REGISTER_METADATA( consumer_type, "shm", metadata, "consumer_shm.yml" );
+#endif
 	MLT_REGISTER_METADATA( filter_type, "audiomap", metadata, "filter_audiomap.yml" );
+	MLT_REGISTER_METADATA( filter_type, "audiomatrix", metadata, "filter_audiomatrix.yml" );
 	MLT_REGISTER_METADATA( filter_type, "audiowave", metadata, "filter_audiowave.yml" );
 	MLT_REGISTER_METADATA( filter_type, "brightness", metadata, "filter_brightness.yml" );
 	MLT_REGISTER_METADATA( filter_type, "channelcopy", metadata, "filter_channelcopy.yml" );
@@ -149,7 +184,14 @@ MLT_REPOSITORY
 	MLT_REGISTER_METADATA( producer_type, "loader", metadata, "producer_loader.yml" );
 	MLT_REGISTER_METADATA( producer_type, "melt", metadata, "producer_melt.yml" );
 	MLT_REGISTER_METADATA( producer_type, "melt_file", metadata, "producer_melt_file.yml" );
+#ifndef _WIN32
+	MLT_REGISTER_METADATA( producer_type, "mltraw", metadata, "producer_mltraw.yml" );
+#endif
 	MLT_REGISTER_METADATA( producer_type, "noise", metadata, "producer_noise.yml" );
+	MLT_REGISTER_METADATA( producer_type, "render_cache", metadata, "producer_render_cache.yml" );
+#ifndef _WIN32
+	MLT_REGISTER_METADATA( producer_type, "shm", metadata, "producer_shm.yml" );
+#endif
 	MLT_REGISTER_METADATA( producer_type, "timewarp", metadata, "producer_timewarp.yml" );
 	MLT_REGISTER_METADATA( producer_type, "tone", metadata, "producer_tone.yml" );
 	MLT_REGISTER_METADATA( transition_type, "composite", metadata, "transition_composite.yml" );
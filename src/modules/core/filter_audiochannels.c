@@ -109,11 +109,14 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		mlt_audio_format new_format = *format;
 		switch( *format )
 		{
+		case mlt_audio_f32le:
+			// Downmix interleaved float where it is
+			new_format = mlt_audio_f32le;
+			break;
 		default:
 			// Unknown. Try to convert to float anyway.
 			mlt_log_error( NULL, "[audiochannels] Unknown format %d\n", *format );
 		case mlt_audio_float:
-		case mlt_audio_f32le:
 			new_format = mlt_audio_float;
 			break;
 		case mlt_audio_s32le:
@@ -150,6 +153,24 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 				in +=6;
 			}
 		}
+		else if ( *format == mlt_audio_f32le )
+		{
+			float* in = *buffer;
+			float* out = *buffer;
+			int i;
+			for ( i = 0; i < *samples; i++ )
+			{
+				float fl = in[0];
+				float fr = in[1];
+				float c = in[2];
+				// in[3] is LFE
+				float sl = in[4];
+				float sr = in[5];
+				*out++ = MIX(fl, c, sl); // Left
+				*out++ = MIX(fr, c, sr); // Right
+				in += 6;
+			}
+		}
 		else if ( *format == mlt_audio_s32 )
 		{
 			int32_t* flin = *buffer;
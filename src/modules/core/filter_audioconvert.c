@@ -20,9 +20,193 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "audio_convert_simd.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_SAMPLES (256)
+
+// The types of the samples, which the conversion of values is done between.
+enum sample_type
+{
+	sample_s16,
+	sample_s32,
+	sample_f32,
+	sample_u8
+};
+
+static const int sample_size[] = { 2, 4, 4, 1 };
+
+// Get the type and layout of a format, returns true if it is not known.
+static int sample_layout( mlt_audio_format format, enum sample_type *type, int *planar )
+{
+	*planar = format == mlt_audio_s32 || format == mlt_audio_float;
+	switch ( format )
+	{
+	case mlt_audio_s16:
+		*type = sample_s16;
+		return 0;
+	case mlt_audio_s32:
+	case mlt_audio_s32le:
+		*type = sample_s32;
+		return 0;
+	case mlt_audio_float:
+	case mlt_audio_f32le:
+		*type = sample_f32;
+		return 0;
+	case mlt_audio_u8:
+		*type = sample_u8;
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static inline int16_t f32_to_s16( float f )
+{
+	f = CLAMP( f, -1.0f, 1.0f );
+	return 32767 * f;
+}
+
+static inline int32_t f32_to_s32( float f )
+{
+	f = CLAMP( f, -1.0f, 1.0f );
+	int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
+	return CLAMP( pcm, -2147483648LL, 2147483647LL );
+}
+
+static inline uint8_t f32_to_u8( float f )
+{
+	f = CLAMP( f, -1.0f, 1.0f );
+	return ( 127 * f ) + 128;
+}
+
+// Convert the values of a run of samples of the same layout.
+static void convert_values( enum sample_type from, enum sample_type to, const void *src, void *dst, int count )
+{
+	const struct audio_convert_kernels *kernels = audio_convert_simd_kernels();
+	audio_convert_kernel kernel = NULL;
+	int i = 0;
+
+	if ( from == to )
+	{
+		memcpy( dst, src, count * sample_size[ from ] );
+		return;
+	}
+	if ( kernels )
+	{
+		if ( from == sample_s16 && to == sample_s32 )
+			kernel = kernels->s16_to_s32;
+		else if ( from == sample_s16 && to == sample_f32 )
+			kernel = kernels->s16_to_f32;
+		else if ( from == sample_s32 && to == sample_s16 )
+			kernel = kernels->s32_to_s16;
+		else if ( from == sample_s32 && to == sample_f32 )
+			kernel = kernels->s32_to_f32;
+		else if ( from == sample_f32 && to == sample_s16 )
+			kernel = kernels->f32_to_s16;
+		else if ( from == sample_f32 && to == sample_s32 )
+			kernel = kernels->f32_to_s32;
+		if ( kernel )
+			i = kernel( src, dst, count );
+	}
+
+	switch ( from )
+	{
+	case sample_s16:
+	{
+		const int16_t *q = src;
+		if ( to == sample_s32 )
+			for ( ; i < count; i++ )
+				( (int32_t*) dst )[ i ] = (int32_t) q[ i ] << 16;
+		else if ( to == sample_f32 )
+			for ( ; i < count; i++ )
+				( (float*) dst )[ i ] = (float)( q[ i ] ) / 32768.0;
+		else
+			for ( ; i < count; i++ )
+				( (uint8_t*) dst )[ i ] = ( q[ i ] >> 8 ) + 128;
+		break;
+	}
+	case sample_s32:
+	{
+		const int32_t *q = src;
+		if ( to == sample_s16 )
+			for ( ; i < count; i++ )
+				( (int16_t*) dst )[ i ] = q[ i ] >> 16;
+		else if ( to == sample_f32 )
+			for ( ; i < count; i++ )
+				( (float*) dst )[ i ] = (float)( q[ i ] ) / 2147483648.0;
+		else
+			for ( ; i < count; i++ )
+				( (uint8_t*) dst )[ i ] = ( q[ i ] >> 24 ) + 128;
+		break;
+	}
+	case sample_f32:
+	{
+		const float *q = src;
+		if ( to == sample_s16 )
+			for ( ; i < count; i++ )
+				( (int16_t*) dst )[ i ] = f32_to_s16( q[ i ] );
+		else if ( to == sample_s32 )
+			for ( ; i < count; i++ )
+				( (int32_t*) dst )[ i ] = f32_to_s32( q[ i ] );
+		else
+			for ( ; i < count; i++ )
+				( (uint8_t*) dst )[ i ] = f32_to_u8( q[ i ] );
+		break;
+	}
+	case sample_u8:
+	{
+		const uint8_t *q = src;
+		if ( to == sample_s16 )
+			for ( ; i < count; i++ )
+				( (int16_t*) dst )[ i ] = ( (int16_t) q[ i ] - 128 ) << 8;
+		else if ( to == sample_s32 )
+			for ( ; i < count; i++ )
+				( (int32_t*) dst )[ i ] = ( (int32_t) q[ i ] - 128 ) << 24;
+		else
+			for ( ; i < count; i++ )
+				( (float*) dst )[ i ] = ( (float) q[ i ] - 128 ) / 256.0f;
+		break;
+	}
+	}
+}
+
+// Split a run of interleaved 32-bit samples into the planes of length samples, starting at offset.
+static void deinterleave( const uint32_t *src, uint32_t *dst, int channels, int samples, int offset, int count )
+{
+	const struct audio_convert_kernels *kernels = audio_convert_simd_kernels();
+	int i = 0, c;
+
+	if ( channels == 2 && kernels )
+		i = kernels->deinterleave( src, dst + offset, dst + samples + offset, count );
+	for ( c = 0; c < channels; c++ )
+	{
+		uint32_t *p = dst + c * samples + offset;
+		int s;
+		for ( s = i; s < count; s++ )
+			p[ s ] = src[ s * channels + c ];
+	}
+}
+
+// Join a run of the planes of length samples, starting at offset, into interleaved 32-bit samples.
+static void interleave( const uint32_t *src, uint32_t *dst, int channels, int samples, int offset, int count )
+{
+	const struct audio_convert_kernels *kernels = audio_convert_simd_kernels();
+	int i = 0, c;
+
+	if ( channels == 2 && kernels )
+		i = kernels->interleave( src + offset, src + samples + offset, dst, count );
+	for ( c = 0; c < channels; c++ )
+	{
+		const uint32_t *q = src + c * samples + offset;
+		int s;
+		for ( s = i; s < count; s++ )
+			dst[ s * channels + c ] = q[ s ];
+	}
+}
 
 static int convert_audio( mlt_frame frame, void **audio, mlt_audio_format *format, mlt_audio_format requested_format )
 {
@@ -31,531 +215,65 @@ static int convert_audio( mlt_frame frame, void **audio, mlt_audio_format *forma
 	int channels = mlt_properties_get_int( properties, "audio_channels" );
 	int samples = mlt_properties_get_int( properties, "audio_samples" );
 	int size = mlt_audio_format_size( requested_format, samples, channels );
+	enum sample_type from, to;
+	int from_planar, to_planar;
 
-	if ( *format != requested_format )
+	if ( *format != requested_format
+		 && !sample_layout( *format, &from, &from_planar )
+		 && !sample_layout( requested_format, &to, &to_planar ) )
 	{
+		uint8_t *buffer = mlt_pool_alloc( size );
+		const uint8_t *src = *audio;
+
 		mlt_log_debug( NULL, "[filter audioconvert] %s -> %s %d channels %d samples\n",
 			mlt_audio_format_name( *format ), mlt_audio_format_name( requested_format ),
 			channels, samples );
-		switch ( *format )
+
+		if ( from_planar == to_planar || channels == 1 )
 		{
-		case mlt_audio_s16:
-			switch ( requested_format )
-			{
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int16_t *q = (int16_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (int32_t) *q << 16;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int16_t *q = (int16_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (float)( *q ) / 32768.0;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32le:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int16_t *q = (int16_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = (int32_t) *q++ << 16;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_f32le:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int16_t *q = (int16_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = (float)( *q++ ) / 32768.0;
-					*p++ = CLAMP( f, -1.0f, 1.0f );
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_u8:
-			{
-				uint8_t *buffer = mlt_pool_alloc( size );
-				uint8_t *p = buffer;
-				int16_t *q = (int16_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = ( *q++ >> 8 ) + 128;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_s32:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-						*p++ = *( q + c * samples + s ) >> 16;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = (float)( *q++ ) / 2147483648.0;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32le:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-						*p++ = *( q + c * samples + s );
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_f32le:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-					{
-						float f = (float)( *( q + c * samples + s ) ) / 2147483648.0;
-						*p++ = CLAMP( f, -1.0f, 1.0f );
-					}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_u8:
-			{
-				uint8_t *buffer = mlt_pool_alloc( size );
-				uint8_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-						*p++ = ( q[c * samples + s] >> 24 ) + 128;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_float:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				float *q = (float*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-					{
-						float f = *( q + c * samples + s );
-						f = CLAMP( f, -1.0f, 1.0f );
-						*p++ = 32767 * f;
-					}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = CLAMP( f, -1.0f, 1.0f );
-					int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
-					*p++ = CLAMP( pcm, -2147483648LL, 2147483647LL );
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32le:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				float *q = (float*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-					{
-						float f = *( q + c * samples + s );
-						f = CLAMP( f, -1.0f, 1.0f );
-						int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
-						*p++ = CLAMP( pcm, -2147483648LL, 2147483647LL );
-					}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_f32le:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				float *q = (float*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-						*p++ = *( q + c * samples + s );
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_u8:
-			{
-				uint8_t *buffer = mlt_pool_alloc( size );
-				uint8_t *p = buffer;
-				float *q = (float*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-					{
-						float f = *( q + c * samples + s );
-						f = CLAMP( f, -1.0f, 1.0f );
-						*p++ = ( 127 * f ) + 128;
-					}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_s32le:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = *q++ >> 16;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int32_t *q = (int32_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = *q;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int32_t *q = (int32_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (float)( *q ) / 2147483648.0;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_f32le:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = (float)( *q++ ) / 2147483648.0;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_u8:
-			{
-				uint8_t *buffer = mlt_pool_alloc( size );
-				uint8_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = ( *q++ >> 24 ) + 128;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_f32le:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = CLAMP( f, -1.0f , 1.0f );
-					*p++ = 32767 * f;
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					float *q = (float*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = *q;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					float *q = (float*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						float f = *q;
-						f = CLAMP( f, -1.0f , 1.0f );
-						int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
-						*p++ = CLAMP( pcm, -2147483648LL, 2147483647LL );
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32le:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = CLAMP( f, -1.0f , 1.0f );
-					int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
-					*p++ = CLAMP( pcm, -2147483648LL, 2147483647LL );
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_u8:
-			{
-				uint8_t *buffer = mlt_pool_alloc( size );
-				uint8_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = CLAMP( f, -1.0f , 1.0f );
-					*p++ = ( 127 * f ) + 128;
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_u8:
-			switch ( requested_format )
-			{
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					uint8_t *q = (uint8_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = ( (int32_t) *q - 128 ) << 24;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
+			convert_values( from, to, src, buffer, samples * channels );
+		}
+		else if ( from == to )
+		{
+			// Only the layout changes.
+			if ( to_planar )
+				deinterleave( (const uint32_t*) src, (uint32_t*) buffer, channels, samples, 0, samples );
+			else
+				interleave( (const uint32_t*) src, (uint32_t*) buffer, channels, samples, 0, samples );
+		}
+		else
+		{
+			// Change the layout in blocks small enough to stay in the cache.
+			// The planar side always has 32-bit samples, so convert them while interleaved.
+			uint32_t *temp = mlt_pool_alloc( BLOCK_SAMPLES * channels * sizeof( uint32_t ) );
+			int s;
+			for ( s = 0; s < samples; s += BLOCK_SAMPLES )
+			{
+				int count = MIN( BLOCK_SAMPLES, samples - s );
+				if ( to_planar )
 				{
-					uint8_t *q = (uint8_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = ( (float) *q - 128 ) / 256.0f;
-						q += channels;
-					}
+					convert_values( from, to, src + s * channels * sample_size[ from ], temp, count * channels );
+					deinterleave( temp, (uint32_t*) buffer, channels, samples, s, count );
 				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				uint8_t *q = (uint8_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = ( (int16_t) *q++ - 128 ) << 8;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32le:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				uint8_t *q = (uint8_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = ( (int32_t) *q++ - 128 ) << 24;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_f32le:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				uint8_t *q = (uint8_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
+				else
 				{
-					float f = ( (float) *q++ - 128 ) / 256.0f;
-					*p++ = CLAMP( f, -1.0f, 1.0f );
+					interleave( (const uint32_t*) src, temp, channels, samples, s, count );
+					convert_values( from, to, temp, buffer + s * channels * sample_size[ to ], count * channels );
 				}
-				*audio = buffer;
-				error = 0;
-				break;
 			}
-			default:
-				break;
-			}
-			break;
-		default:
-			break;
+			mlt_pool_release( temp );
 		}
+		*audio = buffer;
+		error = 0;
 	}
 	if ( !error )
 	{
 		mlt_frame_set_audio( frame, *audio, requested_format, size, mlt_pool_release );
 		*format = requested_format;
+
+		// Count the conversions to help find needless changes of format.
+		mlt_properties_set_int( properties, "audio_conversions",
+			mlt_properties_get_int( properties, "audio_conversions" ) + 1 );
 	}
 	return error;
 }
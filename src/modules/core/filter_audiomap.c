@@ -17,6 +17,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include "filter_audiomatrix.h"
+
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
@@ -24,67 +26,35 @@
 #include <string.h>
 #include <stdlib.h>
 
-#define MAX_CHANNELS 32
-
-static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
-{
-	char prop_name[32], *prop_val;
-	int i, j, l, m[MAX_CHANNELS];
+#define MAX_CHANNELS AUDIO_MATRIX_MAX
 
-	mlt_filter filter = mlt_frame_pop_audio(frame);
-
-	// Get the producer's audio
-	int error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
-	if ( error ) return error;
+/** Filter processing.
+*/
 
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
 	mlt_properties properties = MLT_FILTER_PROPERTIES(filter);
-
-	/* find samples length */
-	int len = mlt_audio_format_size( *format, 1, 1 );
-
-	/* pcm samples buffer */
-	uint8_t *pcm = *buffer;
+	struct audio_matrix matrix;
+	char prop_name[32], *prop_val;
+	int i, j;
 
 	/* build matrix */
+	audio_matrix_identity( &matrix );
 	for ( i = 0; i < MAX_CHANNELS; i++ )
 	{
-		m[i] = i;
-
 		snprintf( prop_name, sizeof(prop_name), "%d", i );
 		if ( ( prop_val = mlt_properties_get( properties, prop_name ) ) )
 		{
 			j = atoi( prop_val );
 			if( j >= 0 && j < MAX_CHANNELS )
-				m[i] = j;
+			{
+				matrix.gain[i][i] = 0.0;
+				matrix.gain[i][j] = 1.0;
+			}
 		}
 	}
 
-	/* process samples */
-	for ( i = 0; i < *samples; i++ )
-	{
-		uint8_t tmp[MAX_CHANNELS * 4];
-
-		for ( j = 0; j < MAX_CHANNELS && j < *channels; j++ )
-			for(l = 0; l < len; l++)
-				tmp[j * len + l] = pcm[m[j] * len + l];
-
-		for ( j = 0; j < MAX_CHANNELS && j < *channels; j++ )
-			for ( l = 0; l < len; l++ )
-				pcm[j * len + l] = tmp[j * len + l];
-
-		pcm += len * (*channels);
-	}
-
-	return 0;
-}
-
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	mlt_frame_push_audio( frame, filter );
-	mlt_frame_push_audio( frame, filter_get_audio );
+	audio_matrix_push( frame, &matrix );
 	return frame;
 }
 
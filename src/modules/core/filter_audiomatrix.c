@@ -0,0 +1,342 @@
+/*
+ * filter_audiomatrix.c -- route audio channels through a gain matrix
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "filter_audiomatrix.h"
+
+#include <framework/mlt_filter.h>
+#include <framework/mlt_frame.h>
+#include <framework/mlt_log.h>
+#include <framework/mlt_pool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The matrices pushed onto the audio stack of one frame, in the order they apply.
+*/
+
+typedef struct
+{
+	int count;
+	int size;
+	struct audio_matrix *stages;
+}
+audio_matrix_chain;
+
+static void chain_close( audio_matrix_chain *chain )
+{
+	free( chain->stages );
+	free( chain );
+}
+
+void audio_matrix_identity( struct audio_matrix *matrix )
+{
+	int i;
+	memset( matrix, 0, sizeof( *matrix ) );
+	matrix->channels = -1;
+	for ( i = 0; i < AUDIO_MATRIX_MAX; i++ )
+		matrix->gain[i][i] = 1.0;
+}
+
+/** Combine the stages of a chain into one matrix for the actual input channels and return the output channels.
+*/
+
+static int chain_combine( audio_matrix_chain *chain, int channels, float result[ AUDIO_MATRIX_MAX ][ AUDIO_MATRIX_MAX ] )
+{
+	float product[ AUDIO_MATRIX_MAX ][ AUDIO_MATRIX_MAX ];
+	int n = channels;
+	int s, i, j, k;
+
+	memset( result, 0, sizeof( product ) );
+	for ( i = 0; i < channels; i++ )
+		result[i][i] = 1.0;
+
+	for ( s = 0; s < chain->count; s++ )
+	{
+		const struct audio_matrix *stage = &chain->stages[s];
+		int out = stage->channels < 0 ? n : stage->channels > AUDIO_MATRIX_MAX ? AUDIO_MATRIX_MAX : stage->channels;
+
+		for ( i = 0; i < out; i++ )
+			for ( j = 0; j < channels; j++ )
+			{
+				float sum = 0.0;
+				for ( k = 0; k < n; k++ )
+					sum += stage->gain[i][k] * result[k][j];
+				product[i][j] = sum;
+			}
+		memcpy( result, product, sizeof( product[0] ) * out );
+		n = out;
+	}
+	return n;
+}
+
+/** Mix one output plane of planar audio.
+*/
+
+static void mix_plane( float *restrict dest, const float *src, int samples, int channels, const float *gain )
+{
+	int first = 1;
+	int i, j;
+
+	for ( j = 0; j < channels; j++ )
+	{
+		const float *restrict in = src + j * samples;
+		float g = gain[j];
+
+		if ( g == 0.0 )
+			continue;
+		if ( first && g == 1.0 )
+			memcpy( dest, in, samples * sizeof( float ) );
+		else if ( first )
+			for ( i = 0; i < samples; i++ )
+				dest[i] = g * in[i];
+		else if ( g == 1.0 )
+			for ( i = 0; i < samples; i++ )
+				dest[i] += in[i];
+		else
+			for ( i = 0; i < samples; i++ )
+				dest[i] += g * in[i];
+		first = 0;
+	}
+	if ( first )
+		memset( dest, 0, samples * sizeof( float ) );
+}
+
+/** Find the input channel of each output channel when the matrix only copies channels.
+ *
+ * \return true if each output channel is either one input channel or silent
+ */
+
+static int matrix_route( float matrix[ AUDIO_MATRIX_MAX ][ AUDIO_MATRIX_MAX ], int channels, int channels_out, int *route )
+{
+	int i, j;
+
+	for ( i = 0; i < channels_out; i++ )
+	{
+		route[i] = -1;
+		for ( j = 0; j < channels; j++ )
+		{
+			if ( matrix[i][j] == 0.0 )
+				continue;
+			if ( matrix[i][j] != 1.0 || route[i] >= 0 )
+				return 0;
+			route[i] = j;
+		}
+	}
+	return 1;
+}
+
+/** Copy the routed channels in any format, so that the samples are not altered.
+*/
+
+static void route_audio( uint8_t *dest, const uint8_t *src, mlt_audio_format format, int samples, int channels, int channels_out, const int *route )
+{
+	int bytes = mlt_audio_format_size( format, 1, 1 );
+	int silence = format == mlt_audio_u8 ? 0x80 : 0;
+	int i, s;
+
+	if ( format == mlt_audio_float || format == mlt_audio_s32 )
+	{
+		int plane = samples * bytes;
+		for ( i = 0; i < channels_out; i++, dest += plane )
+			if ( route[i] >= 0 )
+				memcpy( dest, src + route[i] * plane, plane );
+			else
+				memset( dest, silence, plane );
+		return;
+	}
+	for ( s = 0; s < samples; s++, src += channels * bytes )
+		for ( i = 0; i < channels_out; i++, dest += bytes )
+			if ( route[i] >= 0 )
+				memcpy( dest, src + route[i] * bytes, bytes );
+			else
+				memset( dest, silence, bytes );
+}
+
+static int audio_matrix_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	audio_matrix_chain *chain = mlt_frame_pop_audio( frame );
+	float matrix[ AUDIO_MATRIX_MAX ][ AUDIO_MATRIX_MAX ];
+	int route[ AUDIO_MATRIX_MAX ];
+	int channels_out, identity = 1;
+	int i, j;
+
+	// Get the audio as requested, it is only converted when it needs mixing
+	int error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	if ( error || !*buffer || *format == mlt_audio_none )
+		return error;
+	if ( *channels > AUDIO_MATRIX_MAX )
+	{
+		mlt_log_warning( NULL, "[filter audiomatrix] too many channels %d\n", *channels );
+		return 0;
+	}
+
+	channels_out = chain_combine( chain, *channels, matrix );
+	if ( channels_out < 1 )
+		return 0;
+
+	// Leave the audio alone if the routes cancel out
+	for ( i = 0; i < channels_out && identity; i++ )
+		for ( j = 0; j < *channels && identity; j++ )
+			identity = matrix[i][j] == ( i == j ? 1.0 : 0.0 );
+	if ( identity && channels_out == *channels )
+		return 0;
+
+	// Copying, swapping and remapping channels keeps the samples of the format as they are
+	if ( matrix_route( matrix, *channels, channels_out, route ) )
+	{
+		int size = mlt_audio_format_size( *format, *samples, channels_out );
+		uint8_t *dest = mlt_pool_alloc( size );
+		if ( !dest )
+			return 0;
+		route_audio( dest, *buffer, *format, *samples, *channels, channels_out, route );
+		mlt_frame_set_audio( frame, dest, *format, size, mlt_pool_release );
+		*buffer = dest;
+		*channels = channels_out;
+		return 0;
+	}
+
+	// Mix in 32-bit float, planar or interleaved like the audio it gets
+	if ( *format != mlt_audio_float && *format != mlt_audio_f32le )
+	{
+		mlt_audio_format mix_format = *format == mlt_audio_s32 ? mlt_audio_float : mlt_audio_f32le;
+		if ( frame->convert_audio )
+			frame->convert_audio( frame, buffer, format, mix_format );
+		if ( *format != mlt_audio_float && *format != mlt_audio_f32le )
+			return 0;
+	}
+
+	int size = mlt_audio_format_size( *format, *samples, channels_out );
+	float *src = *buffer;
+	float *dest = mlt_pool_alloc( size );
+	if ( !dest )
+		return 0;
+
+	if ( *format == mlt_audio_float )
+	{
+		for ( i = 0; i < channels_out; i++ )
+			mix_plane( dest + i * *samples, src, *samples, *channels, matrix[i] );
+	}
+	else
+	{
+		int s;
+		for ( s = 0; s < *samples; s++, src += *channels, dest += channels_out )
+			for ( i = 0; i < channels_out; i++ )
+			{
+				float sum = 0.0;
+				for ( j = 0; j < *channels; j++ )
+					sum += matrix[i][j] * src[j];
+				dest[i] = sum;
+			}
+		dest -= *samples * channels_out;
+	}
+
+	mlt_frame_set_audio( frame, dest, *format, size, mlt_pool_release );
+	*buffer = dest;
+	*channels = channels_out;
+
+	return 0;
+}
+
+void audio_matrix_push( mlt_frame frame, const struct audio_matrix *matrix )
+{
+	mlt_deque stack = MLT_FRAME_AUDIO_STACK( frame );
+	int count = mlt_deque_count( stack );
+	audio_matrix_chain *chain = NULL;
+
+	// Join the matrix that was pushed just before
+	if ( count >= 2 && mlt_deque_peek_back( stack ) == (void*) audio_matrix_get_audio )
+		chain = mlt_deque_peek( stack, count - 2 );
+
+	if ( !chain )
+	{
+		char label[64];
+		chain = calloc( 1, sizeof( *chain ) );
+		if ( !chain )
+			return;
+		snprintf( label, sizeof( label ), "_audiomatrix.%p", chain );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), label, chain, 0, (mlt_destructor) chain_close, NULL );
+		mlt_frame_push_audio( frame, chain );
+		mlt_frame_push_audio( frame, audio_matrix_get_audio );
+	}
+
+	if ( chain->count == chain->size )
+	{
+		int size = chain->size ? chain->size * 2 : 2;
+		struct audio_matrix *stages = realloc( chain->stages, size * sizeof( *stages ) );
+		if ( !stages )
+			return;
+		chain->stages = stages;
+		chain->size = size;
+	}
+	chain->stages[ chain->count++ ] = *matrix;
+}
+
+/** Filter processing.
+*/
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	struct audio_matrix matrix;
+	char name[8];
+	int i, j;
+
+	audio_matrix_identity( &matrix );
+	if ( mlt_properties_get( properties, "channels" ) )
+		matrix.channels = mlt_properties_get_int( properties, "channels" );
+
+	// Each output channel lists the gains of the input channels
+	for ( i = 0; i < AUDIO_MATRIX_MAX; i++ )
+	{
+		char *value, *end;
+
+		snprintf( name, sizeof( name ), "%d", i );
+		if ( !( value = mlt_properties_get( properties, name ) ) )
+			continue;
+		for ( j = 0; j < AUDIO_MATRIX_MAX; j++ )
+		{
+			double gain = strtod( value, &end );
+			if ( end == value )
+				gain = 0.0;
+			else
+				value = end;
+			matrix.gain[i][j] = gain;
+		}
+	}
+
+	audio_matrix_push( frame, &matrix );
+
+	return frame;
+}
+
+/** Constructor for the filter.
+*/
+
+mlt_filter filter_audiomatrix_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter = mlt_filter_new();
+	if ( filter )
+	{
+		filter->process = filter_process;
+		if ( arg )
+			mlt_properties_set_int( MLT_FILTER_PROPERTIES( filter ), "channels", atoi( arg ) );
+	}
+	return filter;
+}
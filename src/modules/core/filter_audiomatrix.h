@@ -0,0 +1,49 @@
+/*
+ * filter_audiomatrix.h -- route audio channels through a gain matrix
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef FILTER_AUDIOMATRIX_H
+#define FILTER_AUDIOMATRIX_H
+
+#include <framework/mlt_frame.h>
+
+#define AUDIO_MATRIX_MAX 32
+
+/** The gains of each output channel from each input channel.
+ *
+ * The rows of the output channels beyond the input channels are still
+ * used when \p channels asks for more outputs than there were inputs.
+ */
+
+struct audio_matrix
+{
+	int channels;  /**< the number of output channels or -1 to keep the input count */
+	float gain[ AUDIO_MATRIX_MAX ][ AUDIO_MATRIX_MAX ]; /**< [out][in] */
+};
+
+/** Set a matrix that passes each channel through unchanged. */
+void audio_matrix_identity( struct audio_matrix *matrix );
+
+/** Route the audio of a frame through a matrix.
+ *
+ * When the previous operation on the audio stack of the frame is also a
+ * matrix, the two are combined so that the audio is only processed once.
+ */
+void audio_matrix_push( mlt_frame frame, const struct audio_matrix *matrix );
+
+#endif
@@ -24,12 +24,11 @@
 #include <stdlib.h>
 #include <math.h>
 
-/** Do it :-).
+/** Get the brightness level of a frame.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static double get_level( mlt_filter filter, mlt_frame frame )
 {
-	mlt_filter filter =  (mlt_filter) mlt_frame_pop_service( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
@@ -56,6 +55,20 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		}
 	}
 
+	return level;
+}
+
+/** Do it :-).
+*/
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter =  (mlt_filter) mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	double level = get_level( filter, frame );
+
 	// Do not cause an image conversion unless there is real work to do.
 	if ( level != 1.0 )
 		*format = mlt_image_yuv422;
@@ -113,6 +126,33 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
+	// Without alpha this is a point operation that is composed with its neighbours.
+	if ( !mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "alpha" ) )
+	{
+		double level = get_level( filter, frame );
+		mlt_lut *lut;
+
+		// Do not cause an image conversion unless there is real work to do.
+		if ( level == 1.0 )
+			return frame;
+
+		lut = mlt_frame_push_lut( frame, mlt_image_yuv422 );
+		if ( lut )
+		{
+			int32_t m = level * ( 1 << 16 );
+			int32_t n = 128 * ( ( 1 << 16 ) - m );
+			int i;
+
+			for ( i = 0; i < 256; i++ )
+			{
+				lut->table[0][i] = CLAMP( (lut->table[0][i] * m) >> 16, 16, 235 );
+				lut->table[1][i] = CLAMP( (lut->table[1][i] * m + n) >> 16, 16, 240 );
+				lut->table[2][i] = CLAMP( (lut->table[2][i] * m + n) >> 16, 16, 240 );
+			}
+			return frame;
+		}
+	}
+
 	mlt_frame_push_service( frame, filter );
 	mlt_frame_push_get_image( frame, filter_get_image );
 
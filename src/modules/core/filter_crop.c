@@ -90,6 +90,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		{
 			mlt_image_format requested_format = mlt_image_rgb24;
 			frame->convert_image( frame, image, format, requested_format );
+			mlt_properties_set_int( properties, "format", *format );
 		}
 	
 		mlt_log_debug( NULL, "[filter crop] %s %dx%d -> %dx%d\n", mlt_image_format_name(*format),
@@ -98,17 +99,29 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		if ( top % 2 )
 			mlt_properties_set_int( properties, "top_field_first", !mlt_properties_get_int( properties, "top_field_first" ) );
 		
-		// Create the output image
-		int size = mlt_image_format_size( *format, owidth, oheight, &bpp );
-		uint8_t *output = mlt_pool_alloc( size );
-		if ( output )
+		// Prefer a view of the region, which leaves the copy to the next service that needs one
+		if ( mlt_properties_get_data( properties, "image", NULL ) == *image
+			 && !mlt_frame_set_image_view( frame, left, top, owidth, oheight ) )
 		{
-			// Call the generic resize
-			crop( *image, output, bpp, *width, *height, left, right, top, bottom );
+			uint8_t *planes[4];
+			int strides[4];
+			mlt_frame_get_image_planes( frame, planes, strides );
+			*image = planes[0];
+		}
+		else
+		{
+			// Create the output image
+			int size = mlt_image_format_size( *format, owidth, oheight, &bpp );
+			uint8_t *output = mlt_pool_alloc( size );
+			if ( output )
+			{
+				// Call the generic resize
+				crop( *image, output, bpp, *width, *height, left, right, top, bottom );
 
-			// Now update the frame
-			mlt_frame_set_image( frame, output, size, mlt_pool_release );
-			*image = output;
+				// Now update the frame
+				mlt_frame_set_image( frame, output, size, mlt_pool_release );
+				*image = output;
+			}
 		}
 
 		// We should resize the alpha too
@@ -124,6 +137,19 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				mlt_frame_set_alpha( frame, newalpha, owidth * oheight, mlt_pool_release );
 			}
 		}
+
+		// Keep the box of the visible pixels within the cropped image
+		mlt_rect box;
+		if ( mlt_frame_get_alpha_box( frame, *width, *height, &box ) )
+		{
+			double x1 = CLAMP( box.x + box.w - left, 0, owidth );
+			double y1 = CLAMP( box.y + box.h - top, 0, oheight );
+			box.x = CLAMP( box.x - left, 0, owidth );
+			box.y = CLAMP( box.y - top, 0, oheight );
+			box.w = x1 > box.x ? x1 - box.x : 0;
+			box.h = y1 > box.y ? y1 - box.y : 0;
+			mlt_frame_set_alpha_box( frame, box, owidth, oheight );
+		}
 		*width = owidth;
 		*height = oheight;
 	}
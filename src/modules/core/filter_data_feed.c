@@ -82,18 +82,24 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 	if ( data_queue != NULL && type != NULL && !strcmp( type, "attr_check" ) )
 	{
 		int i = 0;
-		int count = mlt_properties_count( frame_properties );
+
+		// Collect the attributes, including those the frame reads through its producers
+		mlt_properties attributes = mlt_properties_new( );
+		mlt_properties_pass( attributes, frame_properties, "meta.attr." );
+		int count = mlt_properties_count( attributes );
 
 		for ( i = 0; i < count; i ++ )
 		{
-			char *name = mlt_properties_get_name( frame_properties, i );
+			char name[ 132 ];
+			if ( snprintf( name, sizeof( name ), "meta.attr.%s", mlt_properties_get_name( attributes, i ) ) >= (int) sizeof( name ) )
+				continue;
 
 			// Only deal with meta.attr.name values here - these should have a value of 1 to be considered
 			// Additional properties of the form are meta.attr.name.property are passed down on the feed
-			if ( !strncmp( name, "meta.attr.", 10 ) && strchr( name + 10, '.' ) == NULL && mlt_properties_get_int( frame_properties, name ) == 1 )
+			if ( strchr( name + 10, '.' ) == NULL && mlt_properties_get_int( frame_properties, name ) == 1 )
 			{
 				// Temp var to hold name + '.' for pass method
-				char temp[ 132 ];
+				char temp[ sizeof( name ) + 1 ];
 
 				// Create a new data feed
 				mlt_properties feed = mlt_properties_new( );
@@ -108,7 +114,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 				mlt_properties_set_position( feed, "out", mlt_properties_get_position( frame_properties, "out" ) );
 
 				// Pass all meta properties 
-				sprintf( temp, "%s.", name );
+				snprintf( temp, sizeof( temp ), "%s.", name );
 				mlt_properties_pass( feed, frame_properties, temp );
 
 				// Push it on to the queue
@@ -118,6 +124,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 				mlt_properties_set_int( frame_properties, name, 0 );
 			}
 		}
+		mlt_properties_close( attributes );
 	}
 	else if ( data_queue != NULL )
 	{
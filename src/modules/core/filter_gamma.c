@@ -24,56 +24,33 @@
 #include <stdlib.h>
 #include <math.h>
 
-/** Do it :-).
+/** Filter processing.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	mlt_filter filter = (mlt_filter) mlt_frame_pop_service( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_yuv422 );
 
-	*format = mlt_image_yuv422;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
+	// Get the gamma value
+	double gamma = mlt_properties_anim_get_double( properties, "gamma", position, length );
 
-	if ( error == 0 )
+	if ( lut && gamma != 1.0 )
 	{
-		// Get the gamma value
-		double gamma = mlt_properties_anim_get_double( properties, "gamma", position, length );
-
-		if ( gamma != 1.0 )
-		{
-			uint8_t *p = *image;
-			uint8_t *q = *image + *width * *height * 2;
+		// Calculate the look up table
+		double exp = 1 / gamma;
+		uint8_t lookup[ 256 ];
+		int i;
 
-			// Calculate the look up table
-			double exp = 1 / gamma;
-			uint8_t lookup[ 256 ];
-			int i;
+		for( i = 0; i < 256; i ++ )
+			lookup[ i ] = ( uint8_t )( pow( ( double )i / 255.0, exp ) * 255 );
 
-			for( i = 0; i < 256; i ++ )
-				lookup[ i ] = ( uint8_t )( pow( ( double )i / 255.0, exp ) * 255 );
-
-			while ( p != q )
-			{
-				*p = lookup[ *p ];
-				p += 2;
-			}
-		}
+		for( i = 0; i < 256; i ++ )
+			lut->table[ 0 ][ i ] = lookup[ lut->table[ 0 ][ i ] ];
 	}
 
-	return 0;
-}
-
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
-
 	return frame;
 }
 
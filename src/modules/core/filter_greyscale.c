@@ -22,30 +22,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-
-/** Do it :-).
-*/
-
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
-{
-	*format = mlt_image_yuv422;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
-	if ( error == 0 )
-	{
-		uint8_t *p = *image;
-		uint8_t *q = *image + *width * *height * 2;
-		while ( p ++ != q )
-			*p ++ = 128;
-	}
-	return error;
-}
+#include <string.h>
 
 /** Filter processing.
 */
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	mlt_frame_push_get_image( frame, filter_get_image );
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_yuv422 );
+	if ( lut )
+	{
+		memset( lut->table[ 1 ], 128, 256 );
+		memset( lut->table[ 2 ], 128, 256 );
+	}
 	return frame;
 }
 
@@ -21,8 +21,15 @@
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
 #include <framework/mlt_pool.h>
+#include <framework/mlt_slices.h>
+
+#include "image_convert_simd.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+/** Images smaller than this many pixels are converted on the calling thread. */
+#define SLICE_MIN_PIXELS ( 256 * 256 )
 
 /** This macro converts a YUV value to the RGB color space. */
 #define RGB2YUV_601_UNSCALED(r, g, b, y, u, v)\
@@ -54,13 +61,51 @@
 #define YUV2RGB_601 YUV2RGB_601_UNSCALED
 #endif
 
-static int convert_yuv422_to_rgb24a( uint8_t *yuv, uint8_t *rgba, uint8_t *alpha, int width, int height )
+/** The work of one conversion shared among the slices.
+ *
+ * Each range function converts the units from start to end, where a unit
+ * is a row or a pair of pixels depending on how the scalar code walks the
+ * image. A SIMD kernel converts the leading pixels of each run when one is
+ * available and the scalar code converts the rest.
+ */
+
+struct convert_context
+{
+	void ( *range )( struct convert_context *context, int start, int end );
+	uint8_t *src;
+	uint8_t *dst;
+	uint8_t *alpha;
+	int width;
+	int height;
+	int units;
+};
+
+static const struct image_convert_kernels *kernels( void )
+{
+	static const struct image_convert_kernels none;
+	const struct image_convert_kernels *k = image_convert_simd_kernels();
+	return k ? k : &none;
+}
+
+static void yuv422_to_rgb24a_range( struct convert_context *context, int start, int end )
 {
-	int ret = 0;
 	int yy, uu, vv;
 	int r,g,b;
-	int total = width * height / 2 + 1;
+	uint8_t *yuv = context->src + start * 4;
+	uint8_t *rgba = context->dst + start * 8;
+	uint8_t *alpha = context->alpha + start * 2;
+	int total = end - start;
+	image_convert_kernel kernel = kernels()->yuv422_to_rgb24a;
 
+	if ( kernel )
+	{
+		int done = kernel( yuv, rgba, alpha, total * 2 ) / 2;
+		yuv += done * 4;
+		rgba += done * 8;
+		alpha += done * 2;
+		total -= done;
+	}
+	total++;
 	while ( --total )
 	{
 		yy = yuv[0];
@@ -80,16 +125,25 @@ static int convert_yuv422_to_rgb24a( uint8_t *yuv, uint8_t *rgba, uint8_t *alpha
 		yuv += 4;
 		rgba += 8;
 	}
-	return ret;
 }
 
-static int convert_yuv422_to_rgb24( uint8_t *yuv, uint8_t *rgb, uint8_t *alpha, int width, int height )
+static void yuv422_to_rgb24_range( struct convert_context *context, int start, int end )
 {
-	int ret = 0;
 	int yy, uu, vv;
 	int r,g,b;
-	int total = width * height / 2 + 1;
+	uint8_t *yuv = context->src + start * 4;
+	uint8_t *rgb = context->dst + start * 6;
+	int total = end - start;
+	image_convert_kernel kernel = kernels()->yuv422_to_rgb24;
 
+	if ( kernel )
+	{
+		int done = kernel( yuv, rgb, NULL, total * 2 ) / 2;
+		yuv += done * 4;
+		rgb += done * 6;
+		total -= done;
+	}
+	total++;
 	while ( --total )
 	{
 		yy = yuv[0];
@@ -107,66 +161,48 @@ static int convert_yuv422_to_rgb24( uint8_t *yuv, uint8_t *rgb, uint8_t *alpha,
 		yuv += 4;
 		rgb += 6;
 	}
-	return ret;
 }
 
-static int convert_rgb24a_to_yuv422( uint8_t *rgba, uint8_t *yuv, uint8_t *alpha, int width, int height )
+static void rgb24a_to_yuv422_range( struct convert_context *context, int start, int end )
 {
-	int ret = 0;
+	int width = context->width;
 	int stride = width * 4;
 	int y0, y1, u0, u1, v0, v1;
 	int r, g, b;
-	uint8_t *s, *d = yuv;
-	int i, j, n = width / 2 + 1;
+	uint8_t *s, *d;
+	uint8_t *alpha;
+	int i, j;
+	image_convert_kernel kernel = kernels()->rgb24a_to_yuv422;
 
-	if ( alpha )
-	for ( i = 0; i < height; i++ )
+	for ( i = start; i < end; i++ )
 	{
-		s = rgba + ( stride * i );
-		j = n;
-		while ( --j )
+		int done = 0;
+		s = context->src + ( stride * i );
+		d = context->dst + ( width * 2 * i );
+		alpha = context->alpha ? context->alpha + width * i : NULL;
+		if ( kernel )
 		{
-			r = *s++;
-			g = *s++;
-			b = *s++;
-			*alpha++ = *s++;
-			RGB2YUV_601( r, g, b, y0, u0 , v0 );
-			r = *s++;
-			g = *s++;
-			b = *s++;
-			*alpha++ = *s++;
-			RGB2YUV_601( r, g, b, y1, u1 , v1 );
-			*d++ = y0;
-			*d++ = (u0+u1) >> 1;
-			*d++ = y1;
-			*d++ = (v0+v1) >> 1;
+			done = kernel( s, d, alpha, width & ~1 );
+			s += done * 4;
+			d += done * 2;
+			if ( alpha )
+				alpha += done;
 		}
-		if ( width % 2 )
-		{
-			r = *s++;
-			g = *s++;
-			b = *s++;
-			*alpha++ = *s++;
-			RGB2YUV_601( r, g, b, y0, u0 , v0 );
-			*d++ = y0;
-			*d++ = u0;
-		}
-	}
-	else
-	for ( i = 0; i < height; i++ )
-	{
-		s = rgba + ( stride * i );
-		j = n;
+		j = ( width - done ) / 2 + 1;
 		while ( --j )
 		{
 			r = *s++;
 			g = *s++;
 			b = *s++;
+			if ( alpha )
+				*alpha++ = *s;
 			s++;
 			RGB2YUV_601( r, g, b, y0, u0 , v0 );
 			r = *s++;
 			g = *s++;
 			b = *s++;
+			if ( alpha )
+				*alpha++ = *s;
 			s++;
 			RGB2YUV_601( r, g, b, y1, u1 , v1 );
 			*d++ = y0;
@@ -179,29 +215,38 @@ static int convert_rgb24a_to_yuv422( uint8_t *rgba, uint8_t *yuv, uint8_t *alpha
 			r = *s++;
 			g = *s++;
 			b = *s++;
+			if ( alpha )
+				*alpha++ = *s;
 			s++;
 			RGB2YUV_601( r, g, b, y0, u0 , v0 );
 			*d++ = y0;
 			*d++ = u0;
 		}
 	}
-
-	return ret;
 }
 
-static int convert_rgb24_to_yuv422( uint8_t *rgb, uint8_t *yuv, uint8_t *alpha, int width, int height )
+static void rgb24_to_yuv422_range( struct convert_context *context, int start, int end )
 {
-	int ret = 0;
+	int width = context->width;
 	int stride = width * 3;
 	int y0, y1, u0, u1, v0, v1;
 	int r, g, b;
-	uint8_t *s, *d = yuv;
-	int i, j, n = width / 2 + 1;
+	uint8_t *s, *d;
+	int i, j;
+	image_convert_kernel kernel = kernels()->rgb24_to_yuv422;
 
-	for ( i = 0; i < height; i++ )
+	for ( i = start; i < end; i++ )
 	{
-		s = rgb + ( stride * i );
-		j = n;
+		int done = 0;
+		s = context->src + ( stride * i );
+		d = context->dst + ( width * 2 * i );
+		if ( kernel )
+		{
+			done = kernel( s, d, NULL, width & ~1 );
+			s += done * 3;
+			d += done * 2;
+		}
+		j = ( width - done ) / 2 + 1;
 		while ( --j )
 		{
 			r = *s++;
@@ -227,42 +272,66 @@ static int convert_rgb24_to_yuv422( uint8_t *rgb, uint8_t *yuv, uint8_t *alpha,
 			*d++ = u0;
 		}
 	}
-	return ret;
 }
 
-static int convert_yuv420p_to_yuv422( uint8_t *yuv420p, uint8_t *yuv, uint8_t *alpha, int width, int height )
+static void yuv420p_line_to_yuv422( const uint8_t *Y, const uint8_t *u, const uint8_t *v, uint8_t *d, int half )
 {
-	int ret = 0;
-	int i, j;
+	image_convert_planar_kernel kernel = kernels()->yuv420p_to_yuv422;
+	int j, done = 0;
+
+	if ( kernel )
+	{
+		done = kernel( Y, u, v, d, half * 2 ) / 2;
+		Y += done * 2;
+		u += done;
+		v += done;
+		d += done * 4;
+	}
+	j = half - done + 1;
+	while ( --j )
+	{
+		*d ++ = *Y ++;
+		*d ++ = *u ++;
+		*d ++ = *Y ++;
+		*d ++ = *v ++;
+	}
+}
+
+static void yuv420p_to_yuv422_range( struct convert_context *context, int start, int end )
+{
+	int i;
+	int width = context->width;
+	int height = context->height;
 	int half = width >> 1;
-	uint8_t *Y = yuv420p;
-	uint8_t *U = Y + width * height;
+	uint8_t *U = context->src + width * height;
 	uint8_t *V = U + width * height / 4;
-	uint8_t *d = yuv;
 
-	for ( i = 0; i < height; i++ )
+	for ( i = start; i < end; i++ )
 	{
+		uint8_t *Y = context->src + i * half * 2;
 		uint8_t *u = U + ( i / 2 ) * ( half );
 		uint8_t *v = V + ( i / 2 ) * ( half );
+		uint8_t *d = context->dst + i * half * 4;
 
-		j = half + 1;
-		while ( --j )
-		{
-			*d ++ = *Y ++;
-			*d ++ = *u ++;
-			*d ++ = *Y ++;
-			*d ++ = *v ++;
-		}
+		yuv420p_line_to_yuv422( Y, u, v, d, half );
 	}
-	return ret;
 }
 
-static int convert_rgb24_to_rgb24a( uint8_t *rgb, uint8_t *rgba, uint8_t *alpha, int width, int height )
+static void rgb24_to_rgb24a_range( struct convert_context *context, int start, int end )
 {
-	uint8_t *s = rgb;
-	uint8_t *d = rgba;
-	int total = width * height + 1;
+	uint8_t *s = context->src + start * 3;
+	uint8_t *d = context->dst + start * 4;
+	int total = end - start;
+	image_convert_kernel kernel = kernels()->rgb24_to_rgb24a;
 
+	if ( kernel )
+	{
+		int done = kernel( s, d, NULL, total );
+		s += done * 3;
+		d += done * 4;
+		total -= done;
+	}
+	total++;
 	while ( --total )
 	{
 		*d++ = s[0];
@@ -271,15 +340,25 @@ static int convert_rgb24_to_rgb24a( uint8_t *rgb, uint8_t *rgba, uint8_t *alpha,
 		*d++ = 0xff;
 		s += 3;
 	}
-	return 0;
 }
 
-static int convert_rgb24a_to_rgb24( uint8_t *rgba, uint8_t *rgb, uint8_t *alpha, int width, int height )
+static void rgb24a_to_rgb24_range( struct convert_context *context, int start, int end )
 {
-	uint8_t *s = rgba;
-	uint8_t *d = rgb;
-	int total = width * height + 1;
+	uint8_t *s = context->src + start * 4;
+	uint8_t *d = context->dst + start * 3;
+	uint8_t *alpha = context->alpha + start;
+	int total = end - start;
+	image_convert_kernel kernel = kernels()->rgb24a_to_rgb24;
 
+	if ( kernel )
+	{
+		int done = kernel( s, d, alpha, total );
+		s += done * 4;
+		d += done * 3;
+		alpha += done;
+		total -= done;
+	}
+	total++;
 	while ( --total )
 	{
 		*d++ = s[0];
@@ -288,21 +367,408 @@ static int convert_rgb24a_to_rgb24( uint8_t *rgba, uint8_t *rgb, uint8_t *alpha,
 		*alpha++ = s[3];
 		s += 4;
 	}
+}
+
+// Narrow 16-bit samples to 8 bits, see image_convert_depth_kernel.
+static void narrow_samples( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	image_convert_depth_kernel kernel = kernels()->narrow;
+	const uint16_t *s = (const uint16_t*) src;
+	int bias = full_range ? 0 : 1 << ( shift - 1 );
+	int i = kernel ? kernel( src, dst, shift, full_range, samples ) : 0;
+
+	for ( ; i < samples; i++ )
+	{
+		int value = ( s[i] + bias ) >> shift;
+		dst[i] = value > 255 ? 255 : value;
+	}
+}
+
+// Widen 8-bit samples to 16 bits, see image_convert_depth_kernel.
+static void widen_samples( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	image_convert_depth_kernel kernel = kernels()->widen;
+	uint16_t *d = (uint16_t*) dst;
+	int i = kernel ? kernel( src, dst, shift, full_range, samples ) : 0;
+
+	for ( ; i < samples; i++ )
+		d[i] = ( src[i] << shift ) | ( full_range ? src[i] >> ( 8 - shift ) : 0 );
+}
+
+static void yuv420p10_to_yuv420p_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *src[4], *dst[4];
+	int src_strides[4], dst_strides[4];
+	int i, p;
+
+	mlt_image_format_planes( mlt_image_yuv420p10, context->width, context->height, context->src, src, src_strides );
+	mlt_image_format_planes( mlt_image_yuv420p, context->width, context->height, context->dst, dst, dst_strides );
+	for ( i = start; i < end; i++ )
+	{
+		narrow_samples( src[0] + i * src_strides[0], dst[0] + i * dst_strides[0], 2, 0, context->width );
+		if ( !( i & 1 ) && i / 2 < context->height / 2 )
+			for ( p = 1; p < 3; p++ )
+				narrow_samples( src[p] + i / 2 * src_strides[p], dst[p] + i / 2 * dst_strides[p], 2, 0, context->width / 2 );
+	}
+}
+
+static void yuv420p_to_yuv420p10_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *src[4], *dst[4];
+	int src_strides[4], dst_strides[4];
+	int i, p;
+
+	mlt_image_format_planes( mlt_image_yuv420p, context->width, context->height, context->src, src, src_strides );
+	mlt_image_format_planes( mlt_image_yuv420p10, context->width, context->height, context->dst, dst, dst_strides );
+	for ( i = start; i < end; i++ )
+	{
+		widen_samples( src[0] + i * src_strides[0], dst[0] + i * dst_strides[0], 2, 0, context->width );
+		if ( !( i & 1 ) && i / 2 < context->height / 2 )
+			for ( p = 1; p < 3; p++ )
+				widen_samples( src[p] + i / 2 * src_strides[p], dst[p] + i / 2 * dst_strides[p], 2, 0, context->width / 2 );
+	}
+}
+
+static void yuv420p10_to_yuv422_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *src[4];
+	int strides[4];
+	int width = context->width;
+	int half = width >> 1;
+	int chroma_lines = context->height / 2;
+	uint8_t *line = mlt_pool_alloc( width * 2 );
+	int i;
+
+	if ( !line )
+		return;
+	mlt_image_format_planes( mlt_image_yuv420p10, width, context->height, context->src, src, strides );
+	for ( i = start; i < end; i++ )
+	{
+		int c = i / 2 < chroma_lines ? i / 2 : chroma_lines - 1;
+
+		// Narrow the line to yuv420p and interleave it.
+		narrow_samples( src[0] + i * strides[0], line, 2, 0, half * 2 );
+		if ( c >= 0 )
+		{
+			narrow_samples( src[1] + c * strides[1], line + half * 2, 2, 0, half );
+			narrow_samples( src[2] + c * strides[2], line + half * 3, 2, 0, half );
+		}
+		else
+		{
+			memset( line + half * 2, 128, half * 2 );
+		}
+		yuv420p_line_to_yuv422( line, line + half * 2, line + half * 3, context->dst + i * half * 4, half );
+	}
+	mlt_pool_release( line );
+}
+
+static void yuv422_to_yuv420p10_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *dst[4];
+	int strides[4];
+	int width = context->width;
+	int height = context->height;
+	int i, j;
+
+	mlt_image_format_planes( mlt_image_yuv420p10, width, height, context->dst, dst, strides );
+	for ( i = start; i < end; i++ )
+	{
+		const uint8_t *s = context->src + i * width * 2;
+		uint16_t *Y = (uint16_t*) ( dst[0] + i * strides[0] );
+
+		for ( j = 0; j < width; j++ )
+			Y[j] = s[j * 2] << 2;
+
+		// Average the chroma of each pair of lines.
+		if ( !( i & 1 ) && i / 2 < height / 2 )
+		{
+			const uint8_t *n = s + width * 2;
+			uint16_t *u = (uint16_t*) ( dst[1] + i / 2 * strides[1] );
+			uint16_t *v = (uint16_t*) ( dst[2] + i / 2 * strides[2] );
+			for ( j = 0; j < width / 2; j++ )
+			{
+				u[j] = ( s[j * 4 + 1] + n[j * 4 + 1] ) << 1;
+				v[j] = ( s[j * 4 + 3] + n[j * 4 + 3] ) << 1;
+			}
+		}
+	}
+}
+
+static void yuv444p16_to_yuv422_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *src[4];
+	int strides[4];
+	int width = context->width;
+	int i, j;
+
+	mlt_image_format_planes( mlt_image_yuv444p16, width, context->height, context->src, src, strides );
+	for ( i = start; i < end; i++ )
+	{
+		const uint16_t *Y = (const uint16_t*) ( src[0] + i * strides[0] );
+		const uint16_t *u = (const uint16_t*) ( src[1] + i * strides[1] );
+		const uint16_t *v = (const uint16_t*) ( src[2] + i * strides[2] );
+		uint8_t *d = context->dst + i * width * 2;
+
+		// Round the luma and average the chroma of each pair of pixels.
+		for ( j = 0; j < width; j++ )
+		{
+			int value = ( Y[j] + 128 ) >> 8;
+			int c = ( j & 1 ) ? v[j - 1] + v[j] : j + 1 < width ? u[j] + u[j + 1] : u[j] * 2;
+			d[j * 2] = value > 255 ? 255 : value;
+			value = ( c + 256 ) >> 9;
+			d[j * 2 + 1] = value > 255 ? 255 : value;
+		}
+	}
+}
+
+static void yuv422_to_yuv444p16_range( struct convert_context *context, int start, int end )
+{
+	uint8_t *dst[4];
+	int strides[4];
+	int width = context->width;
+	int i, j;
+
+	mlt_image_format_planes( mlt_image_yuv444p16, width, context->height, context->dst, dst, strides );
+	for ( i = start; i < end; i++ )
+	{
+		const uint8_t *s = context->src + i * width * 2;
+		uint16_t *Y = (uint16_t*) ( dst[0] + i * strides[0] );
+		uint16_t *u = (uint16_t*) ( dst[1] + i * strides[1] );
+		uint16_t *v = (uint16_t*) ( dst[2] + i * strides[2] );
+
+		for ( j = 0; j < width; j++ )
+		{
+			const uint8_t *pair = s + ( j & ~1 ) * 2;
+			Y[j] = s[j * 2] << 8;
+			u[j] = pair[1] << 8;
+			v[j] = pair[3] << 8;
+		}
+	}
+}
+
+static void rgba64_to_rgb24a_range( struct convert_context *context, int start, int end )
+{
+	narrow_samples( context->src + start * 8, context->dst + start * 4, 8, 1, ( end - start ) * 4 );
+}
+
+static void rgb24a_to_rgba64_range( struct convert_context *context, int start, int end )
+{
+	widen_samples( context->src + start * 4, context->dst + start * 8, 8, 1, ( end - start ) * 4 );
+}
+
+static void rgba64_to_rgb24_range( struct convert_context *context, int start, int end )
+{
+	const uint16_t *s = (const uint16_t*) context->src + start * 4;
+	uint8_t *d = context->dst + start * 3;
+	uint8_t *alpha = context->alpha + start;
+	int i;
+
+	for ( i = start; i < end; i++, s += 4 )
+	{
+		*d++ = s[0] >> 8;
+		*d++ = s[1] >> 8;
+		*d++ = s[2] >> 8;
+		*alpha++ = s[3] >> 8;
+	}
+}
+
+static void rgb24_to_rgba64_range( struct convert_context *context, int start, int end )
+{
+	const uint8_t *s = context->src + start * 3;
+	uint16_t *d = (uint16_t*) context->dst + start * 4;
+	int i;
+
+	for ( i = start; i < end; i++, s += 3 )
+	{
+		*d++ = s[0] * 257;
+		*d++ = s[1] * 257;
+		*d++ = s[2] * 257;
+		*d++ = 0xffff;
+	}
+}
+
+static void rgba64_to_yuv422_range( struct convert_context *context, int start, int end )
+{
+	int width = context->width;
+	uint8_t *line = mlt_pool_alloc( width * 4 );
+	int i;
+
+	if ( !line )
+		return;
+	for ( i = start; i < end; i++ )
+	{
+		// Narrow the line to rgb24a and convert that.
+		struct convert_context line_context = { NULL, line, context->dst + i * width * 2,
+			context->alpha ? context->alpha + i * width : NULL, width, 1, 1 };
+		narrow_samples( context->src + i * width * 8, line, 8, 1, width * 4 );
+		rgb24a_to_yuv422_range( &line_context, 0, 1 );
+	}
+	mlt_pool_release( line );
+}
+
+static void yuv422_to_rgba64_range( struct convert_context *context, int start, int end )
+{
+	int width = context->width;
+	uint8_t *line = mlt_pool_alloc( width * 4 );
+	int i;
+
+	if ( !line )
+		return;
+	for ( i = start; i < end; i++ )
+	{
+		// Convert the line to rgb24a and widen that.
+		struct convert_context line_context = { NULL, context->src + i * width * 2, line,
+			context->alpha + i * width, width, 1, width / 2 };
+		yuv422_to_rgb24a_range( &line_context, 0, width / 2 );
+		widen_samples( line, context->dst + i * width * 8, 8, 1, width / 2 * 8 );
+	}
+	mlt_pool_release( line );
+}
+
+static int convert_slice( int id, int index, int count, void *cookie )
+{
+	struct convert_context *context = cookie;
+	int size = ( context->units + count - 1 ) / count;
+	int start = index * size;
+	int end = start + size;
+
+	if ( end > context->units )
+		end = context->units;
+	if ( start < end )
+		context->range( context, start, end );
 	return 0;
 }
 
+static int convert( void ( *range )( struct convert_context*, int, int ), int units,
+	uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	struct convert_context context = { range, src, dst, alpha, width, height, units };
+
+	// Small images are not worth waking the slice threads.
+	if ( width * height >= SLICE_MIN_PIXELS && mlt_slices_count_normal() > 1 )
+		mlt_slices_run_normal( 0, convert_slice, &context );
+	else if ( units > 0 )
+		range( &context, 0, units );
+	return 0;
+}
+
+static int convert_yuv422_to_rgb24a( uint8_t *yuv, uint8_t *rgba, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv422_to_rgb24a_range, width * height / 2, yuv, rgba, alpha, width, height );
+}
+
+static int convert_yuv422_to_rgb24( uint8_t *yuv, uint8_t *rgb, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv422_to_rgb24_range, width * height / 2, yuv, rgb, alpha, width, height );
+}
+
+static int convert_rgb24a_to_yuv422( uint8_t *rgba, uint8_t *yuv, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24a_to_yuv422_range, height, rgba, yuv, alpha, width, height );
+}
+
+static int convert_rgb24_to_yuv422( uint8_t *rgb, uint8_t *yuv, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24_to_yuv422_range, height, rgb, yuv, alpha, width, height );
+}
+
+static int convert_yuv420p_to_yuv422( uint8_t *yuv420p, uint8_t *yuv, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv420p_to_yuv422_range, height, yuv420p, yuv, alpha, width, height );
+}
+
+static int convert_rgb24_to_rgb24a( uint8_t *rgb, uint8_t *rgba, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24_to_rgb24a_range, width * height, rgb, rgba, alpha, width, height );
+}
+
+static int convert_rgb24a_to_rgb24( uint8_t *rgba, uint8_t *rgb, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24a_to_rgb24_range, width * height, rgba, rgb, alpha, width, height );
+}
+
+static int convert_yuv420p10_to_yuv420p( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv420p10_to_yuv420p_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv420p_to_yuv420p10( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv420p_to_yuv420p10_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv420p10_to_yuv422( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv420p10_to_yuv422_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv422_to_yuv420p10( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv422_to_yuv420p10_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv444p16_to_yuv422( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv444p16_to_yuv422_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv422_to_yuv444p16( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv422_to_yuv444p16_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_rgba64_to_rgb24a( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( rgba64_to_rgb24a_range, width * height, src, dst, alpha, width, height );
+}
+
+static int convert_rgb24a_to_rgba64( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24a_to_rgba64_range, width * height, src, dst, alpha, width, height );
+}
+
+static int convert_rgba64_to_rgb24( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( rgba64_to_rgb24_range, width * height, src, dst, alpha, width, height );
+}
+
+static int convert_rgb24_to_rgba64( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( rgb24_to_rgba64_range, width * height, src, dst, alpha, width, height );
+}
+
+static int convert_rgba64_to_yuv422( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( rgba64_to_yuv422_range, height, src, dst, alpha, width, height );
+}
+
+static int convert_yuv422_to_rgba64( uint8_t *src, uint8_t *dst, uint8_t *alpha, int width, int height )
+{
+	return convert( yuv422_to_rgba64_range, height, src, dst, alpha, width, height );
+}
+
 typedef int ( *conversion_function )( uint8_t *yuv, uint8_t *rgba, uint8_t *alpha, int width, int height );
 
 static conversion_function conversion_matrix[ mlt_image_invalid - 1 ][ mlt_image_invalid - 1 ] = {
-	{ NULL, convert_rgb24_to_rgb24a, convert_rgb24_to_yuv422, NULL, convert_rgb24_to_rgb24a, NULL },
-	{ convert_rgb24a_to_rgb24, NULL, convert_rgb24a_to_yuv422, NULL, NULL, NULL },
-	{ convert_yuv422_to_rgb24, convert_yuv422_to_rgb24a, NULL, NULL, convert_yuv422_to_rgb24a, NULL },
-	{ NULL, NULL, convert_yuv420p_to_yuv422, NULL, NULL, NULL },
-	{ convert_rgb24a_to_rgb24, NULL, convert_rgb24a_to_yuv422, NULL, NULL, NULL },
-	{ NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, convert_rgb24_to_rgb24a, convert_rgb24_to_yuv422, NULL, convert_rgb24_to_rgb24a, NULL, NULL, NULL, NULL, NULL, NULL, convert_rgb24_to_rgba64 },
+	{ convert_rgb24a_to_rgb24, NULL, convert_rgb24a_to_yuv422, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, convert_rgb24a_to_rgba64 },
+	{ convert_yuv422_to_rgb24, convert_yuv422_to_rgb24a, NULL, NULL, convert_yuv422_to_rgb24a, NULL, NULL, NULL, NULL, convert_yuv422_to_yuv420p10, convert_yuv422_to_yuv444p16, convert_yuv422_to_rgba64 },
+	{ NULL, NULL, convert_yuv420p_to_yuv422, NULL, NULL, NULL, NULL, NULL, NULL, convert_yuv420p_to_yuv420p10, NULL, NULL },
+	{ convert_rgb24a_to_rgb24, NULL, convert_rgb24a_to_yuv422, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, convert_rgb24a_to_rgba64 },
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, convert_yuv420p10_to_yuv422, convert_yuv420p10_to_yuv420p, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, convert_yuv444p16_to_yuv422, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ convert_rgba64_to_rgb24, convert_rgba64_to_rgb24a, convert_rgba64_to_yuv422, NULL, convert_rgba64_to_rgb24a, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
 };
 
-static uint8_t bpp_table[4] = { 3, 4, 2, 0 };
+// Whether a format carries its alpha channel in the image.
+static int has_alpha( mlt_image_format format )
+{
+	return format == mlt_image_rgb24a || format == mlt_image_opengl || format == mlt_image_rgba64;
+}
 
 static int convert_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, mlt_image_format requested_format )
 {
@@ -320,16 +786,18 @@ static int convert_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *f
 			width, height );
 		if ( converter )
 		{
-			int size = width * height * bpp_table[ requested_format - 1 ];
+			int size = mlt_image_format_size( requested_format, width, height, NULL );
 			int alpha_size = width * height;
 			uint8_t *image = mlt_pool_alloc( size );
-			uint8_t *alpha = ( *format == mlt_image_rgb24a ||
-			                   *format == mlt_image_opengl )
-			                 ? mlt_pool_alloc( width * height ) : NULL;
-			if ( requested_format == mlt_image_rgb24a || requested_format == mlt_image_opengl )
+			uint8_t *alpha = NULL;
+
+			// Split the alpha channel out of the image or merge it in.
+			if ( has_alpha( *format ) && !has_alpha( requested_format ) )
+			{
+				alpha = mlt_pool_alloc( width * height );
+			}
+			else if ( !has_alpha( *format ) && has_alpha( requested_format ) )
 			{
-				if ( alpha )
-					mlt_pool_release( alpha );
 				alpha = mlt_frame_get_alpha_mask( frame );
 				mlt_properties_get_data( properties, "alpha", &alpha_size );
 			}
@@ -337,7 +805,7 @@ static int convert_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *f
 			if ( !( error = converter( *buffer, image, alpha, width, height ) ) )
 			{
 				mlt_frame_set_image( frame, image, size, mlt_pool_release );
-				if ( alpha && ( *format == mlt_image_rgb24a || *format == mlt_image_opengl ) )
+				if ( alpha && has_alpha( *format ) )
 					mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
 				*buffer = image;
 				*format = requested_format;
@@ -345,7 +813,7 @@ static int convert_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *f
 			else
 			{
 				mlt_pool_release( image );
-				if ( alpha )
+				if ( alpha && has_alpha( *format ) )
 					mlt_pool_release( alpha );
 			}
 		}
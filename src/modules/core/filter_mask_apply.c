@@ -22,9 +22,106 @@
 #include <framework/mlt_frame.h>
 #include <framework/mlt_transition.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_slices.h>
 
 #include <string.h>
 
+// The transition that the filter blends itself, for the default format
+#define FUSED_TRANSITION "frei0r.composition"
+
+// Do not blend bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (16)
+
+struct blend_slice_desc
+{
+	const uint8_t *top;
+	int top_width;
+	uint8_t *bottom;
+	int width;
+	int x, y, w, h;
+};
+
+/** Put the masked image over the snapshot with straight alpha, skipping
+ * the pixels that the mask leaves transparent.
+ */
+
+static int blend_slice_proc(int id, int index, int jobs, void *cookie)
+{
+	struct blend_slice_desc *desc = (struct blend_slice_desc *) cookie;
+	int y = desc->y + desc->h * index / jobs;
+	int yend = desc->y + desc->h * (index + 1) / jobs;
+	int x, i;
+
+	for (; y < yend; y++) {
+		const uint8_t *top = desc->top + (y * desc->top_width + desc->x) * 4;
+		uint8_t *bottom = desc->bottom + (y * desc->width + desc->x) * 4;
+		for (x = 0; x < desc->w; x++, top += 4, bottom += 4) {
+			int a = top[3];
+			if (a == 255) {
+				memcpy(bottom, top, 4);
+			} else if (a) {
+				int wt = a * 255;
+				int wb = bottom[3] * (255 - a);
+				int sum = wt + wb;
+				for (i = 0; i < 3; i++)
+					bottom[i] = (top[i] * wt + bottom[i] * wb + sum / 2) / sum;
+				bottom[3] = (sum + 127) / 255;
+			}
+		}
+	}
+	return 0;
+}
+
+static int fused_get_image(mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable)
+{
+	*format = mlt_image_rgb24a;
+	int error = mlt_frame_get_image(frame, image, format, width, height, 0);
+	if (!error) {
+		mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
+		mlt_frame clone = mlt_properties_get_data(properties, "mask frame", NULL);
+		mlt_image_format bottom_format = mlt_image_rgb24a;
+		int bottom_width = *width;
+		int bottom_height = *height;
+		uint8_t *bottom = NULL;
+
+		if (clone && *format == mlt_image_rgb24a
+			&& !mlt_frame_get_image(clone, &bottom, &bottom_format, &bottom_width, &bottom_height, 1)
+			&& bottom_format == mlt_image_rgb24a) {
+			struct blend_slice_desc desc;
+			mlt_rect box;
+
+			desc.top = *image;
+			desc.top_width = *width;
+			desc.bottom = bottom;
+			desc.width = bottom_width;
+			desc.x = desc.y = 0;
+			desc.w = MIN(*width, bottom_width);
+			desc.h = MIN(*height, bottom_height);
+
+			// Only blend within the box of the mask if it is known
+			if (mlt_frame_get_alpha_box(frame, *width, *height, &box)) {
+				desc.x = box.x;
+				desc.y = box.y;
+				desc.w = MAX(0, MIN(box.w, desc.w - box.x));
+				desc.h = MAX(0, MIN(box.h, desc.h - box.y));
+			}
+			int jobs = MIN(mlt_slices_count_normal(), desc.h / MIN_SLICE_HEIGHT);
+			if (jobs > 1)
+				mlt_slices_run_normal(jobs, blend_slice_proc, &desc);
+			else if (desc.w > 0 && desc.h > 0)
+				blend_slice_proc(0, 0, 1, &desc);
+
+			*image = bottom;
+			*width = bottom_width;
+			*height = bottom_height;
+			mlt_frame_set_image(frame, *image, mlt_image_format_size(*format, *width, *height, NULL), NULL);
+			mlt_properties_set_int(properties, "width", *width);
+			mlt_properties_set_int(properties, "height", *height);
+		}
+	}
+	return error;
+}
+
 static int dummy_get_image(mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable)
 {
 	mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
@@ -63,10 +160,19 @@ static mlt_frame process(mlt_filter filter, mlt_frame frame)
 	mlt_properties properties = MLT_FILTER_PROPERTIES(filter);
 	mlt_transition transition = mlt_properties_get_data(properties, "instance", NULL);
 	char *name = mlt_properties_get(MLT_FILTER_PROPERTIES(filter), "transition");
+	mlt_image_format format = mlt_image_format_id(mlt_properties_get(properties, "mlt_image_format"));
 
 	if (!name || !strcmp("", name))
 		return frame;
 
+	// Blend the default transition without the cost of making a frame for it.
+	if (!strcmp(FUSED_TRANSITION, name) && format == mlt_image_rgb24a) {
+		int hide = mlt_properties_get_int(MLT_FRAME_PROPERTIES(frame), "hide");
+		if (!mlt_frame_is_test_card(frame) && !(hide & 1))
+			mlt_frame_push_get_image(frame, fused_get_image);
+		return frame;
+	}
+
 	// Create the transition if needed.
 	if (!transition
 		|| !mlt_properties_get(MLT_FILTER_PROPERTIES(transition), "mlt_service") 
@@ -87,8 +193,7 @@ static mlt_frame process(mlt_filter filter, mlt_frame frame)
 
 		// Only if video transition on visible track.
 		if ((type & 1) && !mlt_frame_is_test_card(frame) && !(hide & 1)) {
-			mlt_frame_push_service_int(frame,
-				mlt_image_format_id(mlt_properties_get(properties, "mlt_image_format")));
+			mlt_frame_push_service_int(frame, format);
 			mlt_frame_push_service(frame, transition);
 			mlt_frame_push_get_image(frame, get_image);
 		}
@@ -37,8 +37,9 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	mlt_properties filter_props = MLT_FILTER_PROPERTIES( filter );
 	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
 
-	// We can only mix interleaved 32-bit float.
-	*format = mlt_audio_f32le;
+	// We can only mix 32-bit float, but keep it planar if that was requested.
+	if ( *format != mlt_audio_float )
+		*format = mlt_audio_f32le;
 	mlt_frame_get_audio( frame, (void**) buffer, format, frequency, channels, samples );
 
 	// Apply silence
@@ -62,6 +63,9 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	double weight_step = ( mix_end - mix_start ) / *samples;
 	int active_channel = mlt_properties_get_int( properties, "channel" );
 	int gang = mlt_properties_get_int( properties, "gang" ) ? 2 : 1;
+	// The distance between samples and between channels in the buffer
+	int sample_step = *format == mlt_audio_float ? 1 : *channels;
+	int channel_step = *format == mlt_audio_float ? *samples : 1;
 
 	// Setup or resize a scratch buffer
 	if ( !src || src_size < *samples * *channels * sizeof(*src) )
@@ -174,8 +178,8 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		{
 			v = 0;
 			for ( in = 0; in < *channels && in < 6; in++ )
-				v += factors[in][out] * src[ i * *channels + in ];
-			dest[ i * *channels + out ] = v;
+				v += factors[in][out] * src[ i * sample_step + in * channel_step ];
+			dest[ i * sample_step + out * channel_step ] = v;
 		}
 		weight += weight_step;
 	}
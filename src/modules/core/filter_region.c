@@ -83,6 +83,14 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 	return frame;
 }
 
+/** Pass a change of profile on to the transition of the filter.
+*/
+
+static void on_profile_changed( mlt_properties owner, mlt_filter filter )
+{
+	mlt_service_profile_changed( mlt_properties_get_data( MLT_FILTER_PROPERTIES( filter ), "_transition", NULL ) );
+}
+
 /** Constructor for the filter.
 */
 
@@ -105,6 +113,7 @@ mlt_filter filter_region_init( mlt_profile profile, mlt_service_type type, const
 
 		// Ensure that attached filters are handled privately
 		mlt_properties_set_int( properties, "_filter_private", 1 );
+		mlt_events_listen( properties, filter, "profile-changed", ( mlt_listener )on_profile_changed );
 	}
 
 	// Return the filter
@@ -21,6 +21,7 @@
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
 #include <framework/mlt_profile.h>
+#include <framework/mlt_scale.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -41,69 +42,44 @@ typedef int ( *image_scaler )( mlt_frame frame, uint8_t **image, mlt_image_forma
 
 static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *format, int iwidth, int iheight, int owidth, int oheight )
 {
-	// Create the output image
-	uint8_t *output = mlt_pool_alloc( owidth * ( oheight + 1 ) * 2 );
-
-	// Calculate strides
-	int istride = iwidth * 2;
-	int ostride = owidth * 2;
-	iwidth = iwidth - ( iwidth % 4 );
-
-	// Derived coordinates
-	int dy, dx;
-
-	// Calculate ranges
-	int out_x_range = owidth / 2;
-	int out_y_range = oheight / 2;
-	int in_x_range = iwidth / 2;
-	int in_y_range = iheight / 2;
-
-	// Output pointers
-	register uint8_t *out_line = output;
-	register uint8_t *out_ptr;
-
-	// Calculate a middle pointer
-	uint8_t *in_middle = *image + istride * in_y_range + in_x_range * 2;
-	uint8_t *in_line;
-
-	// Generate the affine transform scaling values
-	register int scale_width = ( iwidth << 16 ) / owidth;
-	register int scale_height = ( iheight << 16 ) / oheight;
-	register int base = 0;
-
-	int outer = out_x_range * scale_width;
-	int bottom = out_y_range * scale_height;
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	mlt_scale_filter filter = mlt_scale_filter_id( mlt_properties_get( properties, "rescale.interp" ) );
 
-	// Loop for the entirety of our output height.
-	for ( dy = - bottom; dy < bottom; dy += scale_height )
+	// Create the output image
+	int size = mlt_image_format_size( *format, owidth, oheight, NULL );
+	uint8_t *output = mlt_pool_alloc( size );
+	uint8_t *out[4];
+	int out_strides[4];
+
+	// Calculate strides, the input may be a view
+	uint8_t *in[4];
+	int in_strides[4];
+	mlt_frame_get_image_planes( frame, in, in_strides );
+	mlt_image_format_planes( *format, owidth, oheight, output, out, out_strides );
+
+	if ( mlt_properties_get_int( properties, "rescale.fields" ) )
 	{
-		// Start at the beginning of the line
-		out_ptr = out_line;
-
-		// Pointer to the middle of the input line
-		in_line = in_middle + ( dy >> 16 ) * istride;
-
-		// Loop for the entirety of our output row.
-		for ( dx = - outer; dx < outer; dx += scale_width )
+		// Scale the fields apart so that their lines do not mix
+		int field;
+		for ( field = 0; field < 2; field++ )
 		{
-			base = dx >> 15;
-			base &= 0xfffffffe;
-			*out_ptr ++ = *( in_line + base );
-			base &= 0xfffffffc;
-			*out_ptr ++ = *( in_line + base + 1 );
-			dx += scale_width;
-			base = dx >> 15;
-			base &= 0xfffffffe;
-			*out_ptr ++ = *( in_line + base );
-			base &= 0xfffffffc;
-			*out_ptr ++ = *( in_line + base + 3 );
+			uint8_t *in_field[4] = { in[0], in[1], in[2], in[3] };
+			int in_field_strides[4] = { in_strides[0], in_strides[1], in_strides[2], in_strides[3] };
+			uint8_t *out_field[4] = { out[0], out[1], out[2], out[3] };
+			int out_field_strides[4] = { out_strides[0], out_strides[1], out_strides[2], out_strides[3] };
+			int in_height = mlt_image_field_planes( field, iheight, in_field, in_field_strides );
+			int out_height = mlt_image_field_planes( field, oheight, out_field, out_field_strides );
+			mlt_image_scale( *format, in_field, in_field_strides, iwidth, in_height,
+				out_field, out_field_strides, owidth, out_height, filter );
 		}
-		// Move to next output line
-		out_line += ostride;
 	}
- 
+	else
+	{
+		mlt_image_scale( *format, in, in_strides, iwidth, iheight, out, out_strides, owidth, oheight, filter );
+	}
+
 	// Now update the frame
-	mlt_frame_set_image( frame, output, owidth * ( oheight + 1 ) * 2, mlt_pool_release );
+	mlt_frame_set_image( frame, output, size, mlt_pool_release );
 	*image = output;
 
 	return 0;
@@ -112,25 +88,24 @@ static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *for
 static void scale_alpha( mlt_frame frame, int iwidth, int iheight, int owidth, int oheight )
 {
 	// Scale the alpha
-	uint8_t *output = NULL;
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 	uint8_t *input = mlt_frame_get_alpha( frame );
 
 	if ( input != NULL )
 	{
-		uint8_t *out_line, *in_line;
-		register int i, j, x, y;
-		register int ox = ( iwidth << 16 ) / owidth;
-		register int oy = ( iheight << 16 ) / oheight;
-
-		output = mlt_pool_alloc( owidth * oheight );
-		out_line = output;
+		mlt_scale_filter filter = mlt_scale_filter_id( mlt_properties_get( properties, "rescale.interp" ) );
+		uint8_t *output = mlt_pool_alloc( owidth * oheight );
 
-   		// Loop for the entirety of our output height.
-		for ( i = 0, y = (oy >> 1); i < oheight; i++, y += oy )
+		// Scale the lines of each field from the same field
+		if ( mlt_properties_get_int( properties, "rescale.fields" ) )
 		{
-			in_line = &input[ (y >> 16) * iwidth ];
-			for ( j = 0, x = (ox >> 1); j < owidth; j++, x += ox )
-				*out_line ++ = in_line[ x >> 16 ];
+			mlt_image_scale_alpha( input, iwidth * 2, iwidth, iheight / 2, output, owidth * 2, owidth, oheight / 2, filter );
+			mlt_image_scale_alpha( input + iwidth, iwidth * 2, iwidth, iheight / 2,
+				output + owidth, owidth * 2, owidth, oheight / 2, filter );
+		}
+		else
+		{
+			mlt_image_scale_alpha( input, iwidth, iwidth, iheight, output, owidth, owidth, oheight, filter );
 		}
 
 		// Set it back on the frame
@@ -210,15 +185,18 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 		// Deinterlace if height is changing to prevent fields mixing on interpolation
 		// One exception: non-interpolated, integral scaling
-		if ( iheight != oheight && ( strcmp( interps, "nearest" ) || ( iheight % oheight != 0 ) ) )
+		// Scalers that set "_fields" scale the fields apart for an interlaced consumer instead
+		int by_fields = ( scaler_method == filter_scale || mlt_properties_get_int( filter_properties, "_fields" ) ) &&
+			!mlt_properties_get_int( properties, "consumer_deinterlace" ) && oheight % 2 == 0;
+		if ( iheight != oheight && ( strcmp( interps, "nearest" ) || ( iheight % oheight != 0 ) ) && ( !by_fields || iheight % 2 ) )
 			mlt_properties_set_int( properties, "consumer_deinterlace", 1 );
 
-		// Convert the image to yuv422 when using the local scaler
-		if ( scaler_method == filter_scale )
+		// Convert the image to yuv422 when the local scaler does not support its format
+		if ( scaler_method == filter_scale && !mlt_image_scale_supported( *format ) )
 			*format = mlt_image_yuv422;
 
 		// Get the image as requested
-		mlt_frame_get_image( frame, image, format, &iwidth, &iheight, writable );
+		mlt_frame_get_image_view( frame, image, format, &iwidth, &iheight, writable );
 
 		// Get rescale interpretation again, in case the producer wishes to override scaling
 		interps = mlt_properties_get( properties, "rescale.interp" );
@@ -229,9 +207,18 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				iwidth, iheight, owidth, oheight, mlt_image_format_name( *format ), interps );
 
 			// If valid colorspace
-			if ( *format == mlt_image_yuv422 || *format == mlt_image_rgb24 ||
+			if ( ( scaler_method == filter_scale && mlt_image_scale_supported( *format ) ) ||
+			     *format == mlt_image_yuv422 || *format == mlt_image_rgb24 ||
 			     *format == mlt_image_rgb24a || *format == mlt_image_opengl )
 			{
+				// Scalers that do not set "_views" need a packed image
+				if ( scaler_method != filter_scale && !mlt_properties_get_int( filter_properties, "_views" ) )
+					mlt_frame_pack_image( frame, image );
+
+				// Scalers that see rescale.fields scale the fields of an interlaced image apart
+				mlt_properties_set_int( properties, "rescale.fields", by_fields && iheight != oheight && iheight % 2 == 0 &&
+					!mlt_properties_get_int( properties, "progressive" ) );
+
 				// Call the virtual function
 				scaler_method( frame, image, format, iwidth, iheight, owidth, oheight );
 				*width = owidth;
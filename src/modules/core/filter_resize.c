@@ -62,10 +62,10 @@ static uint8_t *resize_alpha( uint8_t *input, int owidth, int oheight, int iwidt
 	return output;
 }
 
-static void resize_image( uint8_t *output, int owidth, int oheight, uint8_t *input, int iwidth, int iheight, int bpp, mlt_image_format format, uint8_t alpha_value )
+static void resize_image( uint8_t *output, int owidth, int oheight, uint8_t *input, int iwidth, int iheight, int istride, int bpp, mlt_image_format format, uint8_t alpha_value )
 {
 	// Calculate strides
-	int istride = iwidth * bpp;
+	int ilength = iwidth * bpp;
 	int ostride = owidth * bpp;
 	int offset_x = ( owidth - iwidth ) / 2 * bpp;
 	int offset_y = ( oheight - iheight ) / 2;
@@ -79,7 +79,7 @@ static void resize_image( uint8_t *output, int owidth, int oheight, uint8_t *inp
 	{
 		return;
 	}
-	else if ( iwidth == owidth && iheight == oheight )
+	else if ( iwidth == owidth && iheight == oheight && istride == ostride )
 	{
 		memcpy( output, input, iheight * istride );
 		return;
@@ -118,7 +118,7 @@ static void resize_image( uint8_t *output, int owidth, int oheight, uint8_t *inp
 	while ( iheight -- )
 	{
 		// We're in the input range for this row.
-		memcpy( out_line, in_line, istride );
+		memcpy( out_line, in_line, ilength );
 
 		// Move to next input line
 		in_line += istride;
@@ -129,7 +129,8 @@ static void resize_image( uint8_t *output, int owidth, int oheight, uint8_t *inp
 }
 
 /** A padding function for frames - this does not rescale, but simply
-	resizes.
+	resizes. The input may be a view, such as a crop, in which case it is
+	copied straight into the padded image.
 */
 
 static uint8_t *frame_resize_image( mlt_frame frame, int owidth, int oheight, mlt_image_format format )
@@ -138,7 +139,10 @@ static uint8_t *frame_resize_image( mlt_frame frame, int owidth, int oheight, ml
 	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 
 	// Get the input image, width and height
-	uint8_t *input = mlt_properties_get_data( properties, "image", NULL );
+	uint8_t *planes[4];
+	int strides[4];
+	mlt_frame_get_image_planes( frame, planes, strides );
+	uint8_t *input = planes[0];
 	uint8_t *alpha = mlt_frame_get_alpha( frame );
 	int alpha_size = 0;
 	mlt_properties_get_data( properties, "alpha", &alpha_size );
@@ -156,11 +160,31 @@ static uint8_t *frame_resize_image( mlt_frame frame, int owidth, int oheight, ml
 		uint8_t *output = mlt_pool_alloc( owidth * ( oheight + 1 ) * bpp );
 
 		// Call the generic resize
-		resize_image( output, owidth, oheight, input, iwidth, iheight, bpp, format, alpha_value );
+		resize_image( output, owidth, oheight, input, iwidth, iheight, strides[0], bpp, format, alpha_value );
 
 		// Now update the frame
 		mlt_frame_set_image( frame, output, owidth * ( oheight + 1 ) * bpp, mlt_pool_release );
 
+		// The padding is black with the resize alpha
+		mlt_properties_set( properties, "solid_colour", NULL );
+		if ( ( alpha || format == mlt_image_rgb24a ) && mlt_properties_get( properties, "constant_alpha" )
+			 && mlt_properties_get_int( properties, "constant_alpha" ) != alpha_value )
+			mlt_properties_set( properties, "constant_alpha", NULL );
+
+		// Move the box of the visible pixels with the image
+		mlt_rect box;
+		if ( alpha_value == 0 && mlt_frame_get_alpha_box( frame, iwidth, iheight, &box ) )
+		{
+			int offset_x = ( owidth - iwidth ) / 2;
+			box.x += bpp == 2 ? offset_x - offset_x % 2 : offset_x;
+			box.y += ( oheight - iheight ) / 2;
+			mlt_frame_set_alpha_box( frame, box, owidth, oheight );
+		}
+		else
+		{
+			mlt_properties_set( properties, "alpha_box", NULL );
+		}
+
 		// We should resize the alpha too
 		if ( format != mlt_image_rgb24a && alpha && alpha_size >= iwidth * iheight )
 		{
@@ -278,7 +302,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	// Now get the image
 	if ( *format == mlt_image_yuv422 )
 		owidth -= owidth % 2;
-	error = mlt_frame_get_image( frame, image, format, &owidth, &oheight, writable );
+	error = mlt_frame_get_image_view( frame, image, format, &owidth, &oheight, writable );
 
 	if ( error == 0 && *image && *format != mlt_image_yuv420p )
 	{
@@ -22,6 +22,7 @@
 #include <framework/mlt_frame.h>
 #include <framework/mlt_producer.h>
 #include <framework/mlt_transition.h>
+#include <framework/mlt_service.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -118,9 +119,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 
-	// Process all remaining filters first
+	// Process all remaining filters first, the composite writes to this image through a_frame
 	*format = mlt_image_yuv422;
-	error = mlt_frame_get_image( frame, image, format, width, height, 0 );
+	error = mlt_frame_get_image( frame, image, format, width, height, 1 );
 
 	// Only continue if we have both producer and composite
 	if ( !error && composite != NULL && producer != NULL )
@@ -195,7 +196,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				mlt_properties_set( b_props, "rescale.interp", rescale );
 				mlt_service_apply_filters( MLT_FILTER_SERVICE( filter ), b_frame, 0 );
 				error = mlt_frame_get_image( b_frame, image, format, width, height, 1 );
-				alpha = mlt_frame_get_alpha_mask( b_frame );
+				alpha = mlt_frame_get_alpha( b_frame );
 				mlt_frame_set_image( frame, *image, *width * *height * 2, NULL );
 				mlt_frame_set_alpha( frame, alpha, *width * *height, NULL );
 				mlt_properties_set_int( a_props, "width", *width );
@@ -240,6 +241,22 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 /** Constructor for the filter.
 */
 
+/** Pass a change of profile on to the producer and composite of the filter.
+*/
+
+static void on_profile_changed( mlt_properties owner, mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+	mlt_service_profile_changed( mlt_properties_get_data( properties, "producer", NULL ) );
+	mlt_service_profile_changed( mlt_properties_get_data( properties, "composite", NULL ) );
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+}
+
+/** Constructor for the filter.
+*/
+
 mlt_filter filter_watermark_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
 {
 	mlt_filter filter = mlt_filter_new( );
@@ -252,6 +269,7 @@ mlt_filter filter_watermark_init( mlt_profile profile, mlt_service_type type, co
 			mlt_properties_set( properties, "resource", arg );
 		// Ensure that attached filters are handled privately
 		mlt_properties_set_int( properties, "_filter_private", 1 );
+		mlt_events_listen( properties, filter, "profile-changed", ( mlt_listener )on_profile_changed );
 	}
 	return filter;
 }
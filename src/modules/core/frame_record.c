@@ -0,0 +1,232 @@
+/*
+ * frame_record.c -- raw frames in a single block of memory
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "frame_record.h"
+
+#include <framework/mlt_pool.h>
+#include <framework/mlt_profile.h>
+
+#include <string.h>
+
+/** Get the audio format that a consumer asks for with mlt_audio_format. */
+
+mlt_audio_format frame_record_audio_format( mlt_consumer consumer )
+{
+	const char *name = mlt_properties_get( MLT_CONSUMER_PROPERTIES( consumer ), "mlt_audio_format" );
+
+	if ( name )
+	{
+		if ( !strcmp( name, "s32" ) ) return mlt_audio_s32;
+		else if ( !strcmp( name, "s32le" ) ) return mlt_audio_s32le;
+		else if ( !strcmp( name, "float" ) ) return mlt_audio_float;
+		else if ( !strcmp( name, "f32le" ) ) return mlt_audio_f32le;
+		else if ( !strcmp( name, "u8" ) ) return mlt_audio_u8;
+	}
+	return mlt_audio_s16;
+}
+
+/** Get the size of a record that fits the frames of a consumer.
+ *
+ * \param consumer the consumer
+ * \param image_size the largest size of an image
+ * \return the size, which allows for an alpha plane, two frames of 32-bit
+ * audio and the properties
+ */
+
+size_t frame_record_size( mlt_consumer consumer, size_t image_size )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	int frequency = mlt_properties_get_int( properties, "frequency" );
+	int channels = mlt_properties_get_int( properties, "channels" );
+	double fps = profile ? mlt_profile_fps( profile ) : 25.0;
+	int samples = fps > 0 ? frequency / fps * 2 : frequency;
+
+	return FRAME_RECORD_ALIGN( sizeof( frame_record_header ) ) + FRAME_RECORD_ALIGN( image_size ) +
+		FRAME_RECORD_ALIGN( width * height ) + FRAME_RECORD_ALIGN( samples * channels * 4 ) +
+		FRAME_RECORD_PROPERTIES_SIZE;
+}
+
+// Write the string properties of a frame as pairs of names and values.
+static uint32_t write_properties( mlt_properties properties, uint8_t *buffer, uint32_t size )
+{
+	uint32_t used = 0;
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( properties ); i++ )
+	{
+		const char *name = mlt_properties_get_name( properties, i );
+		const char *value = mlt_properties_get_value( properties, i );
+		size_t length;
+
+		if ( !value || name[0] == '_' )
+			continue;
+		length = strlen( name ) + strlen( value ) + 2;
+		if ( used + length > size )
+			break;
+		strcpy( (char*) buffer + used, name );
+		strcpy( (char*) buffer + used + strlen( name ) + 1, value );
+		used += length;
+	}
+	return used;
+}
+
+/** Copy a frame into a record.
+ *
+ * The image and audio are in the formats and sizes that the consumer asks for.
+ *
+ * \return non-zero if the frame does not fit
+ */
+
+int frame_record_write( mlt_consumer consumer, mlt_frame frame, uint8_t *record, size_t record_size, int64_t count )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+	frame_record_header *header = (frame_record_header*) record;
+	mlt_image_format image_format = mlt_image_format_id( mlt_properties_get( properties, "mlt_image_format" ) );
+	mlt_audio_format audio_format = frame_record_audio_format( consumer );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	int frequency = mlt_properties_get_int( properties, "frequency" );
+	int channels = mlt_properties_get_int( properties, "channels" );
+	int samples = mlt_sample_calculator( mlt_properties_get_double( properties, "fps" ), frequency, count );
+	uint8_t *image = NULL;
+	uint8_t *alpha = NULL;
+	void *audio = NULL;
+	uint32_t offset = FRAME_RECORD_ALIGN( sizeof( frame_record_header ) );
+
+	memset( header, 0, sizeof( *header ) );
+	header->position = mlt_frame_get_position( frame );
+	header->speed = mlt_properties_get_double( frame_properties, "_speed" );
+
+	if ( image_format == mlt_image_none )
+		image_format = mlt_image_yuv422;
+	if ( !mlt_frame_get_image( frame, &image, &image_format, &width, &height, 0 ) && image )
+	{
+		uint32_t size = mlt_image_format_size( image_format, width, height, NULL );
+
+		if ( offset + FRAME_RECORD_ALIGN( size ) > record_size )
+			return 1;
+		header->image_format = image_format;
+		header->width = width;
+		header->height = height;
+		header->image_offset = offset;
+		header->image_size = size;
+		memcpy( record + offset, image, size );
+		offset += FRAME_RECORD_ALIGN( size );
+
+		alpha = mlt_frame_get_alpha( frame );
+		if ( alpha && image_format != mlt_image_rgb24a )
+		{
+			if ( offset + FRAME_RECORD_ALIGN( width * height ) > record_size )
+				return 1;
+			header->alpha_offset = offset;
+			header->alpha_size = width * height;
+			memcpy( record + offset, alpha, width * height );
+			offset += FRAME_RECORD_ALIGN( width * height );
+		}
+	}
+
+	if ( !mlt_frame_get_audio( frame, &audio, &audio_format, &frequency, &channels, &samples ) && audio )
+	{
+		uint32_t size = mlt_audio_format_size( audio_format, samples, channels );
+
+		if ( offset + FRAME_RECORD_ALIGN( size ) > record_size )
+			return 1;
+		header->audio_format = audio_format;
+		header->frequency = frequency;
+		header->channels = channels;
+		header->samples = samples;
+		header->audio_offset = offset;
+		header->audio_size = size;
+		memcpy( record + offset, audio, size );
+		offset += FRAME_RECORD_ALIGN( size );
+	}
+
+	header->properties_offset = offset;
+	header->properties_size = write_properties( frame_properties, record + offset, record_size - offset );
+
+	return 0;
+}
+
+static void *copy_data( const uint8_t *data, uint32_t size )
+{
+	void *copy = mlt_pool_alloc( size );
+	if ( copy )
+		memcpy( copy, data, size );
+	return copy;
+}
+
+/** Make a frame of a record.
+ *
+ * \param frame the frame
+ * \param record the record
+ * \param copy whether to copy the data, or else use it in place, in which
+ * case the caller must keep the record until the frame is closed
+ */
+
+void frame_record_read( mlt_frame frame, uint8_t *record, int copy )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	frame_record_header *header = (frame_record_header*) record;
+	uint32_t offset = 0;
+
+	// Restore the properties first so that the data below takes precedence
+	while ( offset < header->properties_size )
+	{
+		const char *name = (const char*) record + header->properties_offset + offset;
+		const char *value = name + strlen( name ) + 1;
+		mlt_properties_set( properties, name, value );
+		offset += strlen( name ) + strlen( value ) + 2;
+	}
+
+	if ( header->image_size )
+	{
+		uint8_t *image = record + header->image_offset;
+		mlt_properties_set_int( properties, "format", header->image_format );
+		mlt_properties_set_int( properties, "width", header->width );
+		mlt_properties_set_int( properties, "height", header->height );
+		if ( copy )
+			mlt_frame_set_image( frame, copy_data( image, header->image_size ), header->image_size, mlt_pool_release );
+		else
+			mlt_frame_set_image( frame, image, header->image_size, NULL );
+	}
+	if ( header->alpha_size )
+	{
+		uint8_t *alpha = record + header->alpha_offset;
+		if ( copy )
+			mlt_frame_set_alpha( frame, copy_data( alpha, header->alpha_size ), header->alpha_size, mlt_pool_release );
+		else
+			mlt_frame_set_alpha( frame, alpha, header->alpha_size, NULL );
+	}
+	if ( header->audio_size )
+	{
+		uint8_t *audio = record + header->audio_offset;
+		mlt_properties_set_int( properties, "audio_frequency", header->frequency );
+		mlt_properties_set_int( properties, "audio_channels", header->channels );
+		mlt_properties_set_int( properties, "audio_samples", header->samples );
+		if ( copy )
+			mlt_frame_set_audio( frame, copy_data( audio, header->audio_size ), header->audio_format, header->audio_size, mlt_pool_release );
+		else
+			mlt_frame_set_audio( frame, audio, header->audio_format, header->audio_size, NULL );
+	}
+	mlt_properties_set_position( properties, "original_position", header->position );
+}
@@ -0,0 +1,97 @@
+/*
+ * frame_record.h -- raw frames in a single block of memory
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _FRAME_RECORD_H_
+#define _FRAME_RECORD_H_
+
+#include <framework/mlt_consumer.h>
+#include <framework/mlt_frame.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_RECORD_ALIGN(x) ( ( (x) + 63 ) & ~63 )
+#define FRAME_RECORD_PROPERTIES_SIZE (64 * 1024)
+
+/** The description of a frame at the start of a record.
+ *
+ * The image, alpha, audio and properties follow at the given offsets from the
+ * start of the record. The properties are pairs of NUL terminated names and
+ * values.
+ */
+
+typedef struct
+{
+	int64_t position;
+	double speed;
+	int32_t image_format;
+	int32_t width;
+	int32_t height;
+	int32_t audio_format;
+	int32_t frequency;
+	int32_t channels;
+	int32_t samples;
+	uint32_t image_offset, image_size;
+	uint32_t alpha_offset, alpha_size;
+	uint32_t audio_offset, audio_size;
+	uint32_t properties_offset, properties_size;
+}
+frame_record_header;
+
+#define FRAME_FILE_MAGIC "MLTRAW\r\n"
+#define FRAME_FILE_BYTE_ORDER 0x01020304
+#define FRAME_FILE_VERSION 1
+#define FRAME_FILE_ALIGN(x) ( ( (x) + 4095 ) & ~(size_t) 4095 )
+
+/** The description of a file of records at the start of the file.
+ *
+ * The records follow at header_size, each record_size apart, so frame n is
+ * at header_size + n * record_size. Both are multiples of 4096, so that a
+ * record can be mapped alone and written with O_DIRECT.
+ */
+
+typedef struct
+{
+	char magic[ 8 ];
+	uint32_t byte_order;
+	uint32_t version;
+	uint64_t header_size;
+	uint64_t record_size;
+	int64_t count;
+	int32_t width;
+	int32_t height;
+	int32_t frame_rate_num;
+	int32_t frame_rate_den;
+	int32_t sample_aspect_num;
+	int32_t sample_aspect_den;
+	int32_t progressive;
+	int32_t colorspace;
+	int32_t image_format;
+	int32_t audio_format;
+	int32_t frequency;
+	int32_t channels;
+}
+frame_file_header;
+
+extern mlt_audio_format frame_record_audio_format( mlt_consumer consumer );
+extern size_t frame_record_size( mlt_consumer consumer, size_t image_size );
+extern int frame_record_write( mlt_consumer consumer, mlt_frame frame, uint8_t *record, size_t size, int64_t count );
+extern void frame_record_read( mlt_frame frame, uint8_t *record, int copy );
+
+#endif
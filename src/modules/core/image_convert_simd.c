@@ -0,0 +1,714 @@
+/*
+ * image_convert_simd.c -- vectorized pixel format conversion kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "image_convert_simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* All kernels compute in 32-bit integers with the coefficients of
+ * YUV2RGB_601_SCALED and RGB2YUV_601_SCALED in mlt_frame.h and saturate
+ * the same way, so they are bit-exact with the scalar code.
+ *
+ * Kernels that read 3 byte pixels with 16 byte loads stop early enough
+ * not to read past the end of the run.
+ */
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define SSE4 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE4 inline void yuv_to_rgb_sse4( __m128i y, __m128i u, __m128i v, __m128i *r, __m128i *g, __m128i *b )
+{
+	y = _mm_mullo_epi32( _mm_sub_epi32( y, _mm_set1_epi32( 16 ) ), _mm_set1_epi32( 1192 ) );
+	u = _mm_sub_epi32( u, _mm_set1_epi32( 128 ) );
+	v = _mm_sub_epi32( v, _mm_set1_epi32( 128 ) );
+	*r = _mm_srai_epi32( _mm_add_epi32( y, _mm_mullo_epi32( v, _mm_set1_epi32( 1634 ) ) ), 10 );
+	*g = _mm_srai_epi32( _mm_sub_epi32( _mm_sub_epi32( y, _mm_mullo_epi32( v, _mm_set1_epi32( 832 ) ) ),
+		_mm_mullo_epi32( u, _mm_set1_epi32( 401 ) ) ), 10 );
+	*b = _mm_srai_epi32( _mm_add_epi32( y, _mm_mullo_epi32( u, _mm_set1_epi32( 2066 ) ) ), 10 );
+}
+
+// Saturate 4 pixels to bytes r0-3 g0-3 b0-3 in the low 12 bytes.
+static SSE4 inline __m128i pack_rgb_sse4( __m128i r, __m128i g, __m128i b )
+{
+	return _mm_packus_epi16( _mm_packs_epi32( r, g ), _mm_packs_epi32( b, b ) );
+}
+
+static SSE4 inline void store_rgb24_sse4( uint8_t *dst, __m128i planar )
+{
+	const __m128i interleave = _mm_setr_epi8( 0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1 );
+	__m128i rgb = _mm_shuffle_epi8( planar, interleave );
+	int32_t last = _mm_extract_epi32( rgb, 2 );
+	_mm_storel_epi64( (__m128i*) dst, rgb );
+	memcpy( dst + 8, &last, 4 );
+}
+
+static SSE4 inline void store_rgb24a_sse4( uint8_t *dst, __m128i planar, const uint8_t *alpha )
+{
+	const __m128i interleave = _mm_setr_epi8( 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 );
+	int32_t a;
+	memcpy( &a, alpha, 4 );
+	_mm_storeu_si128( (__m128i*) dst, _mm_shuffle_epi8( _mm_insert_epi32( planar, a, 3 ), interleave ) );
+}
+
+static SSE4 inline void load_yuv422_sse4( const uint8_t *src, __m128i *y, __m128i *u, __m128i *v )
+{
+	__m128i yuv = _mm_loadl_epi64( (const __m128i*) src );
+	*y = _mm_shuffle_epi8( yuv, _mm_setr_epi8( 0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1 ) );
+	*u = _mm_shuffle_epi8( yuv, _mm_setr_epi8( 1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1 ) );
+	*v = _mm_shuffle_epi8( yuv, _mm_setr_epi8( 3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1 ) );
+}
+
+static SSE4 int yuv422_to_rgb24_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 4 <= pixels; i += 4, src += 8, dst += 12 )
+	{
+		__m128i y, u, v, r, g, b;
+		load_yuv422_sse4( src, &y, &u, &v );
+		yuv_to_rgb_sse4( y, u, v, &r, &g, &b );
+		store_rgb24_sse4( dst, pack_rgb_sse4( r, g, b ) );
+	}
+	return i;
+}
+
+static SSE4 int yuv422_to_rgb24a_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 4 <= pixels; i += 4, src += 8, dst += 16, alpha += 4 )
+	{
+		__m128i y, u, v, r, g, b;
+		load_yuv422_sse4( src, &y, &u, &v );
+		yuv_to_rgb_sse4( y, u, v, &r, &g, &b );
+		store_rgb24a_sse4( dst, pack_rgb_sse4( r, g, b ), alpha );
+	}
+	return i;
+}
+
+// Convert 4 pixels of r, g, b to 8 bytes of yuv422.
+static SSE4 inline __m128i rgb_to_yuv422_sse4( __m128i r, __m128i g, __m128i b )
+{
+	__m128i y = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32(
+		_mm_mullo_epi32( r, _mm_set1_epi32( 263 ) ), _mm_mullo_epi32( g, _mm_set1_epi32( 516 ) ) ),
+		_mm_mullo_epi32( b, _mm_set1_epi32( 100 ) ) ), 10 ), _mm_set1_epi32( 16 ) );
+	__m128i u = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32(
+		_mm_mullo_epi32( r, _mm_set1_epi32( -152 ) ), _mm_mullo_epi32( g, _mm_set1_epi32( -300 ) ) ),
+		_mm_mullo_epi32( b, _mm_set1_epi32( 450 ) ) ), 10 ), _mm_set1_epi32( 128 ) );
+	__m128i v = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32(
+		_mm_mullo_epi32( r, _mm_set1_epi32( 450 ) ), _mm_mullo_epi32( g, _mm_set1_epi32( -377 ) ) ),
+		_mm_mullo_epi32( b, _mm_set1_epi32( -73 ) ) ), 10 ), _mm_set1_epi32( 128 ) );
+	// Average the chroma of each pair
+	__m128i uv = _mm_unpacklo_epi32( _mm_srai_epi32( _mm_hadd_epi32( u, u ), 1 ),
+		_mm_srai_epi32( _mm_hadd_epi32( v, v ), 1 ) );
+	return _mm_packus_epi16( _mm_packs_epi32( _mm_unpacklo_epi32( y, uv ), _mm_unpackhi_epi32( y, uv ) ), _mm_setzero_si128() );
+}
+
+static SSE4 int rgb24_to_yuv422_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m128i rs = _mm_setr_epi8( 0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1 );
+	const __m128i gs = _mm_setr_epi8( 1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1 );
+	const __m128i bs = _mm_setr_epi8( 2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1 );
+	int i;
+	for ( i = 0; i + 6 <= pixels; i += 4, src += 12, dst += 8 )
+	{
+		__m128i rgb = _mm_loadu_si128( (const __m128i*) src );
+		_mm_storel_epi64( (__m128i*) dst, rgb_to_yuv422_sse4( _mm_shuffle_epi8( rgb, rs ),
+			_mm_shuffle_epi8( rgb, gs ), _mm_shuffle_epi8( rgb, bs ) ) );
+	}
+	return i;
+}
+
+static SSE4 int rgb24a_to_yuv422_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m128i rs = _mm_setr_epi8( 0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1 );
+	const __m128i gs = _mm_setr_epi8( 1, -1, -1, -1, 5, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1 );
+	const __m128i bs = _mm_setr_epi8( 2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1 );
+	const __m128i as = _mm_setr_epi8( 3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	int i;
+	for ( i = 0; i + 4 <= pixels; i += 4, src += 16, dst += 8 )
+	{
+		__m128i rgba = _mm_loadu_si128( (const __m128i*) src );
+		_mm_storel_epi64( (__m128i*) dst, rgb_to_yuv422_sse4( _mm_shuffle_epi8( rgba, rs ),
+			_mm_shuffle_epi8( rgba, gs ), _mm_shuffle_epi8( rgba, bs ) ) );
+		if ( alpha )
+		{
+			int32_t a = _mm_cvtsi128_si32( _mm_shuffle_epi8( rgba, as ) );
+			memcpy( alpha, &a, 4 );
+			alpha += 4;
+		}
+	}
+	return i;
+}
+
+static SSE4 int rgb24_to_rgb24a_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m128i expand = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m128i opaque = _mm_set1_epi32( 0xff000000 );
+	int i;
+	for ( i = 0; i + 6 <= pixels; i += 4, src += 12, dst += 16 )
+		_mm_storeu_si128( (__m128i*) dst, _mm_or_si128( _mm_shuffle_epi8(
+			_mm_loadu_si128( (const __m128i*) src ), expand ), opaque ) );
+	return i;
+}
+
+static SSE4 int rgb24a_to_rgb24_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m128i as = _mm_setr_epi8( 3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m128i planar = _mm_setr_epi8( 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, -1, -1, -1, -1 );
+	int i;
+	for ( i = 0; i + 4 <= pixels; i += 4, src += 16, dst += 12, alpha += 4 )
+	{
+		__m128i rgba = _mm_loadu_si128( (const __m128i*) src );
+		int32_t a = _mm_cvtsi128_si32( _mm_shuffle_epi8( rgba, as ) );
+		store_rgb24_sse4( dst, _mm_shuffle_epi8( rgba, planar ) );
+		memcpy( alpha, &a, 4 );
+	}
+	return i;
+}
+
+static SSE4 int yuv420p_to_yuv422_sse4( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, y += 16, u += 8, v += 8, dst += 32 )
+	{
+		__m128i luma = _mm_loadu_si128( (const __m128i*) y );
+		__m128i chroma = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) u ), _mm_loadl_epi64( (const __m128i*) v ) );
+		_mm_storeu_si128( (__m128i*) dst, _mm_unpacklo_epi8( luma, chroma ) );
+		_mm_storeu_si128( (__m128i*) ( dst + 16 ), _mm_unpackhi_epi8( luma, chroma ) );
+	}
+	return i;
+}
+
+static AVX2 inline void yuv_to_rgb_avx2( const uint8_t *src, __m128i *planar_lo, __m128i *planar_hi )
+{
+	__m128i yuv = _mm_loadu_si128( (const __m128i*) src );
+	__m256i y = _mm256_cvtepu8_epi32( _mm_shuffle_epi8( yuv, _mm_setr_epi8( 0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1 ) ) );
+	__m256i u = _mm256_cvtepu8_epi32( _mm_shuffle_epi8( yuv, _mm_setr_epi8( 1, 1, 5, 5, 9, 9, 13, 13, -1, -1, -1, -1, -1, -1, -1, -1 ) ) );
+	__m256i v = _mm256_cvtepu8_epi32( _mm_shuffle_epi8( yuv, _mm_setr_epi8( 3, 3, 7, 7, 11, 11, 15, 15, -1, -1, -1, -1, -1, -1, -1, -1 ) ) );
+	__m256i r, g, b;
+
+	y = _mm256_mullo_epi32( _mm256_sub_epi32( y, _mm256_set1_epi32( 16 ) ), _mm256_set1_epi32( 1192 ) );
+	u = _mm256_sub_epi32( u, _mm256_set1_epi32( 128 ) );
+	v = _mm256_sub_epi32( v, _mm256_set1_epi32( 128 ) );
+	r = _mm256_srai_epi32( _mm256_add_epi32( y, _mm256_mullo_epi32( v, _mm256_set1_epi32( 1634 ) ) ), 10 );
+	g = _mm256_srai_epi32( _mm256_sub_epi32( _mm256_sub_epi32( y, _mm256_mullo_epi32( v, _mm256_set1_epi32( 832 ) ) ),
+		_mm256_mullo_epi32( u, _mm256_set1_epi32( 401 ) ) ), 10 );
+	b = _mm256_srai_epi32( _mm256_add_epi32( y, _mm256_mullo_epi32( u, _mm256_set1_epi32( 2066 ) ) ), 10 );
+	// Each 128 bit lane holds 4 pixels.
+	__m256i rg = _mm256_packs_epi32( r, g );
+	__m256i planar = _mm256_packus_epi16( rg, _mm256_packs_epi32( b, b ) );
+	*planar_lo = _mm256_castsi256_si128( planar );
+	*planar_hi = _mm256_extracti128_si256( planar, 1 );
+}
+
+static AVX2 int yuv422_to_rgb24_avx2( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 8 <= pixels; i += 8, src += 16, dst += 24 )
+	{
+		__m128i lo, hi;
+		yuv_to_rgb_avx2( src, &lo, &hi );
+		store_rgb24_sse4( dst, lo );
+		store_rgb24_sse4( dst + 12, hi );
+	}
+	return i + yuv422_to_rgb24_sse4( src, dst, alpha, pixels - i );
+}
+
+static AVX2 int yuv422_to_rgb24a_avx2( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 8 <= pixels; i += 8, src += 16, dst += 32, alpha += 8 )
+	{
+		__m128i lo, hi;
+		yuv_to_rgb_avx2( src, &lo, &hi );
+		store_rgb24a_sse4( dst, lo, alpha );
+		store_rgb24a_sse4( dst + 16, hi, alpha + 4 );
+	}
+	return i + yuv422_to_rgb24a_sse4( src, dst, alpha, pixels - i );
+}
+
+// Convert 8 pixels, 4 per 128 bit lane, to 16 bytes of yuv422.
+static AVX2 inline void rgb_to_yuv422_avx2( uint8_t *dst, __m256i r, __m256i g, __m256i b )
+{
+	__m256i y = _mm256_add_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32(
+		_mm256_mullo_epi32( r, _mm256_set1_epi32( 263 ) ), _mm256_mullo_epi32( g, _mm256_set1_epi32( 516 ) ) ),
+		_mm256_mullo_epi32( b, _mm256_set1_epi32( 100 ) ) ), 10 ), _mm256_set1_epi32( 16 ) );
+	__m256i u = _mm256_add_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32(
+		_mm256_mullo_epi32( r, _mm256_set1_epi32( -152 ) ), _mm256_mullo_epi32( g, _mm256_set1_epi32( -300 ) ) ),
+		_mm256_mullo_epi32( b, _mm256_set1_epi32( 450 ) ) ), 10 ), _mm256_set1_epi32( 128 ) );
+	__m256i v = _mm256_add_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32(
+		_mm256_mullo_epi32( r, _mm256_set1_epi32( 450 ) ), _mm256_mullo_epi32( g, _mm256_set1_epi32( -377 ) ) ),
+		_mm256_mullo_epi32( b, _mm256_set1_epi32( -73 ) ) ), 10 ), _mm256_set1_epi32( 128 ) );
+	__m256i uv = _mm256_unpacklo_epi32( _mm256_srai_epi32( _mm256_hadd_epi32( u, u ), 1 ),
+		_mm256_srai_epi32( _mm256_hadd_epi32( v, v ), 1 ) );
+	__m256i yuv = _mm256_packus_epi16( _mm256_packs_epi32( _mm256_unpacklo_epi32( y, uv ),
+		_mm256_unpackhi_epi32( y, uv ) ), _mm256_setzero_si256() );
+	_mm_storeu_si128( (__m128i*) dst, _mm256_castsi256_si128( _mm256_permute4x64_epi64( yuv, 0x08 ) ) );
+}
+
+static AVX2 inline __m256i load_two_avx2( const uint8_t *lo, const uint8_t *hi )
+{
+	return _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*) lo ) ),
+		_mm_loadu_si128( (const __m128i*) hi ), 1 );
+}
+
+static AVX2 int rgb24_to_yuv422_avx2( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m256i rs = _mm256_setr_epi8( 0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+		0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1 );
+	const __m256i gs = _mm256_setr_epi8( 1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+		1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1 );
+	const __m256i bs = _mm256_setr_epi8( 2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+		2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1 );
+	int i;
+	for ( i = 0; i + 10 <= pixels; i += 8, src += 24, dst += 16 )
+	{
+		__m256i rgb = load_two_avx2( src, src + 12 );
+		rgb_to_yuv422_avx2( dst, _mm256_shuffle_epi8( rgb, rs ), _mm256_shuffle_epi8( rgb, gs ), _mm256_shuffle_epi8( rgb, bs ) );
+	}
+	return i + rgb24_to_yuv422_sse4( src, dst, alpha, pixels - i );
+}
+
+static AVX2 int rgb24a_to_yuv422_avx2( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m256i as = _mm256_setr_epi8( 3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m256i mask = _mm256_set1_epi32( 0xff );
+	int i;
+	for ( i = 0; i + 8 <= pixels; i += 8, src += 32, dst += 16 )
+	{
+		__m256i rgba = _mm256_loadu_si256( (const __m256i*) src );
+		rgb_to_yuv422_avx2( dst, _mm256_and_si256( rgba, mask ), _mm256_and_si256( _mm256_srli_epi32( rgba, 8 ), mask ),
+			_mm256_and_si256( _mm256_srli_epi32( rgba, 16 ), mask ) );
+		if ( alpha )
+		{
+			__m256i a = _mm256_shuffle_epi8( rgba, as );
+			int32_t a0 = _mm256_extract_epi32( a, 0 ), a1 = _mm256_extract_epi32( a, 4 );
+			memcpy( alpha, &a0, 4 );
+			memcpy( alpha + 4, &a1, 4 );
+			alpha += 8;
+		}
+	}
+	return i + rgb24a_to_yuv422_sse4( src, dst, alpha, pixels - i );
+}
+
+static SSE4 int narrow_sse4( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const __m128i bias = _mm_set1_epi16( full_range ? 0 : 1 << ( shift - 1 ) );
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	int i;
+	for ( i = 0; i + 16 <= samples; i += 16, src += 32, dst += 16 )
+	{
+		__m128i lo = _mm_srl_epi16( _mm_adds_epu16( _mm_loadu_si128( (const __m128i*) src ), bias ), count );
+		__m128i hi = _mm_srl_epi16( _mm_adds_epu16( _mm_loadu_si128( (const __m128i*) ( src + 16 ) ), bias ), count );
+		_mm_storeu_si128( (__m128i*) dst, _mm_packus_epi16( lo, hi ) );
+	}
+	return i;
+}
+
+static SSE4 int widen_sse4( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	const __m128i low = _mm_cvtsi32_si128( full_range ? 8 - shift : 16 );
+	int i;
+	for ( i = 0; i + 16 <= samples; i += 16, src += 16, dst += 32 )
+	{
+		__m128i s = _mm_loadu_si128( (const __m128i*) src );
+		__m128i lo = _mm_cvtepu8_epi16( s );
+		__m128i hi = _mm_cvtepu8_epi16( _mm_srli_si128( s, 8 ) );
+		_mm_storeu_si128( (__m128i*) dst, _mm_or_si128( _mm_sll_epi16( lo, count ), _mm_srl_epi16( lo, low ) ) );
+		_mm_storeu_si128( (__m128i*) ( dst + 16 ), _mm_or_si128( _mm_sll_epi16( hi, count ), _mm_srl_epi16( hi, low ) ) );
+	}
+	return i;
+}
+
+static AVX2 int narrow_avx2( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const __m256i bias = _mm256_set1_epi16( full_range ? 0 : 1 << ( shift - 1 ) );
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	int i;
+	for ( i = 0; i + 32 <= samples; i += 32, src += 64, dst += 32 )
+	{
+		__m256i lo = _mm256_srl_epi16( _mm256_adds_epu16( _mm256_loadu_si256( (const __m256i*) src ), bias ), count );
+		__m256i hi = _mm256_srl_epi16( _mm256_adds_epu16( _mm256_loadu_si256( (const __m256i*) ( src + 32 ) ), bias ), count );
+		_mm256_storeu_si256( (__m256i*) dst, _mm256_permute4x64_epi64( _mm256_packus_epi16( lo, hi ), 0xd8 ) );
+	}
+	return i + narrow_sse4( src, dst, shift, full_range, samples - i );
+}
+
+static AVX2 int widen_avx2( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	const __m128i low = _mm_cvtsi32_si128( full_range ? 8 - shift : 16 );
+	int i;
+	for ( i = 0; i + 32 <= samples; i += 32, src += 32, dst += 64 )
+	{
+		__m256i lo = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) src ) );
+		__m256i hi = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) ( src + 16 ) ) );
+		_mm256_storeu_si256( (__m256i*) dst, _mm256_or_si256( _mm256_sll_epi16( lo, count ), _mm256_srl_epi16( lo, low ) ) );
+		_mm256_storeu_si256( (__m256i*) ( dst + 32 ), _mm256_or_si256( _mm256_sll_epi16( hi, count ), _mm256_srl_epi16( hi, low ) ) );
+	}
+	return i + widen_sse4( src, dst, shift, full_range, samples - i );
+}
+
+static SSE4 int luma_to_alpha_sse4( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m128i mask = _mm_set1_epi16( 0xff );
+	const __m128i low = _mm_set1_epi16( 16 );
+	const __m128i high = _mm_set1_epi16( 235 );
+	const __m128i scale = _mm_set1_epi16( 299 );
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 32, dst += 16 )
+	{
+		__m128i lo = _mm_and_si128( _mm_loadu_si128( (const __m128i*) src ), mask );
+		__m128i hi = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( src + 16 ) ), mask );
+		lo = _mm_sub_epi16( _mm_min_epi16( _mm_max_epi16( lo, low ), high ), low );
+		hi = _mm_sub_epi16( _mm_min_epi16( _mm_max_epi16( hi, low ), high ), low );
+		lo = _mm_srli_epi16( _mm_mullo_epi16( lo, scale ), 8 );
+		hi = _mm_srli_epi16( _mm_mullo_epi16( hi, scale ), 8 );
+		_mm_storeu_si128( (__m128i*) dst, _mm_packus_epi16( lo, hi ) );
+	}
+	return i;
+}
+
+static AVX2 int luma_to_alpha_avx2( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const __m256i mask = _mm256_set1_epi16( 0xff );
+	const __m256i low = _mm256_set1_epi16( 16 );
+	const __m256i high = _mm256_set1_epi16( 235 );
+	const __m256i scale = _mm256_set1_epi16( 299 );
+	int i;
+	for ( i = 0; i + 32 <= pixels; i += 32, src += 64, dst += 32 )
+	{
+		__m256i lo = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) src ), mask );
+		__m256i hi = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) ( src + 32 ) ), mask );
+		lo = _mm256_sub_epi16( _mm256_min_epi16( _mm256_max_epi16( lo, low ), high ), low );
+		hi = _mm256_sub_epi16( _mm256_min_epi16( _mm256_max_epi16( hi, low ), high ), low );
+		lo = _mm256_srli_epi16( _mm256_mullo_epi16( lo, scale ), 8 );
+		hi = _mm256_srli_epi16( _mm256_mullo_epi16( hi, scale ), 8 );
+		// The pack works within each half, so put the halves back in order
+		_mm256_storeu_si256( (__m256i*) dst, _mm256_permute4x64_epi64( _mm256_packus_epi16( lo, hi ), 0xd8 ) );
+	}
+	return i + luma_to_alpha_sse4( src, dst, alpha, pixels - i );
+}
+
+static const struct image_convert_kernels sse4_kernels =
+{
+	"sse4.1",
+	yuv422_to_rgb24_sse4,
+	yuv422_to_rgb24a_sse4,
+	rgb24_to_yuv422_sse4,
+	rgb24a_to_yuv422_sse4,
+	rgb24_to_rgb24a_sse4,
+	rgb24a_to_rgb24_sse4,
+	yuv420p_to_yuv422_sse4,
+	narrow_sse4,
+	widen_sse4,
+	luma_to_alpha_sse4
+};
+
+static const struct image_convert_kernels avx2_kernels =
+{
+	"avx2",
+	yuv422_to_rgb24_avx2,
+	yuv422_to_rgb24a_avx2,
+	rgb24_to_yuv422_avx2,
+	rgb24a_to_yuv422_avx2,
+	rgb24_to_rgb24a_sse4,
+	rgb24a_to_rgb24_sse4,
+	yuv420p_to_yuv422_sse4,
+	narrow_avx2,
+	widen_avx2,
+	luma_to_alpha_avx2
+};
+
+static const struct image_convert_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	if ( __builtin_cpu_supports( "sse4.1" ) )
+		return &sse4_kernels;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static inline uint8x8_t neon_pack( int32x4_t lo, int32x4_t hi )
+{
+	return vqmovun_s16( vcombine_s16( vqmovn_s32( vshrq_n_s32( lo, 10 ) ), vqmovn_s32( vshrq_n_s32( hi, 10 ) ) ) );
+}
+
+// Convert 8 pixels with luma y and chroma u, v (less their offsets) to r, g, b.
+static inline void neon_yuv_to_rgb( int16x8_t y, int16x8_t u, int16x8_t v, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b )
+{
+	int32x4_t ylo = vmull_n_s16( vget_low_s16( y ), 1192 );
+	int32x4_t yhi = vmull_n_s16( vget_high_s16( y ), 1192 );
+	*r = neon_pack( vmlal_n_s16( ylo, vget_low_s16( v ), 1634 ), vmlal_n_s16( yhi, vget_high_s16( v ), 1634 ) );
+	*g = neon_pack( vmlsl_n_s16( vmlsl_n_s16( ylo, vget_low_s16( v ), 832 ), vget_low_s16( u ), 401 ),
+		vmlsl_n_s16( vmlsl_n_s16( yhi, vget_high_s16( v ), 832 ), vget_high_s16( u ), 401 ) );
+	*b = neon_pack( vmlal_n_s16( ylo, vget_low_s16( u ), 2066 ), vmlal_n_s16( yhi, vget_high_s16( u ), 2066 ) );
+}
+
+static inline int16x8_t neon_offset( uint8x8_t x, int offset )
+{
+	return vsubq_s16( vreinterpretq_s16_u16( vmovl_u8( x ) ), vdupq_n_s16( offset ) );
+}
+
+// Convert 16 pixels of yuv422 to planar r, g, b.
+static inline uint8x16x3_t neon_yuv422_to_rgb( const uint8_t *src )
+{
+	uint8x8x4_t yuv = vld4_u8( src );
+	int16x8_t u = neon_offset( yuv.val[1], 128 );
+	int16x8_t v = neon_offset( yuv.val[3], 128 );
+	uint8x8_t r0, g0, b0, r1, g1, b1;
+	uint8x8x2_t r, g, b;
+	uint8x16x3_t rgb;
+
+	neon_yuv_to_rgb( neon_offset( yuv.val[0], 16 ), u, v, &r0, &g0, &b0 );
+	neon_yuv_to_rgb( neon_offset( yuv.val[2], 16 ), u, v, &r1, &g1, &b1 );
+	r = vzip_u8( r0, r1 );
+	g = vzip_u8( g0, g1 );
+	b = vzip_u8( b0, b1 );
+	rgb.val[0] = vcombine_u8( r.val[0], r.val[1] );
+	rgb.val[1] = vcombine_u8( g.val[0], g.val[1] );
+	rgb.val[2] = vcombine_u8( b.val[0], b.val[1] );
+	return rgb;
+}
+
+static int yuv422_to_rgb24_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 32, dst += 48 )
+		vst3q_u8( dst, neon_yuv422_to_rgb( src ) );
+	return i;
+}
+
+static int yuv422_to_rgb24a_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 32, dst += 64, alpha += 16 )
+	{
+		uint8x16x3_t rgb = neon_yuv422_to_rgb( src );
+		uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vld1q_u8( alpha ) } };
+		vst4q_u8( dst, rgba );
+	}
+	return i;
+}
+
+static inline int32x4_t neon_dot( int16x4_t r, int16x4_t g, int16x4_t b, int kr, int kg, int kb )
+{
+	return vmlal_n_s16( vmlal_n_s16( vmull_n_s16( r, kr ), g, kg ), b, kb );
+}
+
+// Convert 8 pixels to luma and the chroma averaged over pairs.
+static inline void neon_rgb_to_yuv( uint8x8_t r8, uint8x8_t g8, uint8x8_t b8, uint8x8_t *y, uint8x8_t *u, uint8x8_t *v )
+{
+	int16x8_t r = vreinterpretq_s16_u16( vmovl_u8( r8 ) );
+	int16x8_t g = vreinterpretq_s16_u16( vmovl_u8( g8 ) );
+	int16x8_t b = vreinterpretq_s16_u16( vmovl_u8( b8 ) );
+	int32x4_t k16 = vdupq_n_s32( 16 ), k128 = vdupq_n_s32( 128 );
+	int32x4_t ylo = vaddq_s32( vshrq_n_s32( neon_dot( vget_low_s16( r ), vget_low_s16( g ), vget_low_s16( b ), 263, 516, 100 ), 10 ), k16 );
+	int32x4_t yhi = vaddq_s32( vshrq_n_s32( neon_dot( vget_high_s16( r ), vget_high_s16( g ), vget_high_s16( b ), 263, 516, 100 ), 10 ), k16 );
+	int32x4_t ulo = vaddq_s32( vshrq_n_s32( neon_dot( vget_low_s16( r ), vget_low_s16( g ), vget_low_s16( b ), -152, -300, 450 ), 10 ), k128 );
+	int32x4_t uhi = vaddq_s32( vshrq_n_s32( neon_dot( vget_high_s16( r ), vget_high_s16( g ), vget_high_s16( b ), -152, -300, 450 ), 10 ), k128 );
+	int32x4_t vlo = vaddq_s32( vshrq_n_s32( neon_dot( vget_low_s16( r ), vget_low_s16( g ), vget_low_s16( b ), 450, -377, -73 ), 10 ), k128 );
+	int32x4_t vhi = vaddq_s32( vshrq_n_s32( neon_dot( vget_high_s16( r ), vget_high_s16( g ), vget_high_s16( b ), 450, -377, -73 ), 10 ), k128 );
+	*y = vqmovun_s16( vcombine_s16( vqmovn_s32( ylo ), vqmovn_s32( yhi ) ) );
+	// Pairwise sums of adjacent pixels, halved
+	*u = vqmovun_s16( vcombine_s16( vqmovn_s32( vshrq_n_s32( vpaddq_s32( ulo, uhi ), 1 ) ), vdup_n_s16( 0 ) ) );
+	*v = vqmovun_s16( vcombine_s16( vqmovn_s32( vshrq_n_s32( vpaddq_s32( vlo, vhi ), 1 ) ), vdup_n_s16( 0 ) ) );
+}
+
+// Write 16 pixels of yuv422.
+static inline void neon_store_yuv422( uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b )
+{
+	uint8x8_t y0, u0, v0, y1, u1, v1;
+	uint8x8x4_t yuv;
+	uint8x8x2_t y;
+
+	neon_rgb_to_yuv( vget_low_u8( r ), vget_low_u8( g ), vget_low_u8( b ), &y0, &u0, &v0 );
+	neon_rgb_to_yuv( vget_high_u8( r ), vget_high_u8( g ), vget_high_u8( b ), &y1, &u1, &v1 );
+	y = vuzp_u8( y0, y1 );
+	yuv.val[0] = y.val[0];
+	yuv.val[1] = vext_u8( vext_u8( u0, u0, 4 ), u1, 4 );
+	yuv.val[2] = y.val[1];
+	yuv.val[3] = vext_u8( vext_u8( v0, v0, 4 ), v1, 4 );
+	vst4_u8( dst, yuv );
+}
+
+static int rgb24_to_yuv422_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 48, dst += 32 )
+	{
+		uint8x16x3_t rgb = vld3q_u8( src );
+		neon_store_yuv422( dst, rgb.val[0], rgb.val[1], rgb.val[2] );
+	}
+	return i;
+}
+
+static int rgb24a_to_yuv422_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 64, dst += 32 )
+	{
+		uint8x16x4_t rgba = vld4q_u8( src );
+		neon_store_yuv422( dst, rgba.val[0], rgba.val[1], rgba.val[2] );
+		if ( alpha )
+		{
+			vst1q_u8( alpha, rgba.val[3] );
+			alpha += 16;
+		}
+	}
+	return i;
+}
+
+static int rgb24_to_rgb24a_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 48, dst += 64 )
+	{
+		uint8x16x3_t rgb = vld3q_u8( src );
+		uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8( 0xff ) } };
+		vst4q_u8( dst, rgba );
+	}
+	return i;
+}
+
+static int rgb24a_to_rgb24_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 64, dst += 48, alpha += 16 )
+	{
+		uint8x16x4_t rgba = vld4q_u8( src );
+		uint8x16x3_t rgb = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+		vst3q_u8( dst, rgb );
+		vst1q_u8( alpha, rgba.val[3] );
+	}
+	return i;
+}
+
+static int yuv420p_to_yuv422_neon( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int pixels )
+{
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, y += 16, u += 8, v += 8, dst += 32 )
+	{
+		uint8x8x2_t luma = vuzp_u8( vld1_u8( y ), vld1_u8( y + 8 ) );
+		uint8x8x4_t yuv = { { luma.val[0], vld1_u8( u ), luma.val[1], vld1_u8( v ) } };
+		vst4_u8( dst, yuv );
+	}
+	return i;
+}
+
+static int narrow_neon( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const uint16x8_t bias = vdupq_n_u16( full_range ? 0 : 1 << ( shift - 1 ) );
+	const int16x8_t count = vdupq_n_s16( -shift );
+	int i;
+	for ( i = 0; i + 16 <= samples; i += 16, src += 32, dst += 16 )
+	{
+		uint16x8_t lo = vshlq_u16( vqaddq_u16( vld1q_u16( (const uint16_t*) src ), bias ), count );
+		uint16x8_t hi = vshlq_u16( vqaddq_u16( vld1q_u16( (const uint16_t*) ( src + 16 ) ), bias ), count );
+		vst1q_u8( dst, vcombine_u8( vqmovn_u16( lo ), vqmovn_u16( hi ) ) );
+	}
+	return i;
+}
+
+static int widen_neon( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples )
+{
+	const int16x8_t count = vdupq_n_s16( shift );
+	const int16x8_t low = vdupq_n_s16( full_range ? shift - 8 : -16 );
+	int i;
+	for ( i = 0; i + 16 <= samples; i += 16, src += 16, dst += 32 )
+	{
+		uint8x16_t s = vld1q_u8( src );
+		uint16x8_t lo = vmovl_u8( vget_low_u8( s ) );
+		uint16x8_t hi = vmovl_u8( vget_high_u8( s ) );
+		vst1q_u16( (uint16_t*) dst, vorrq_u16( vshlq_u16( lo, count ), vshlq_u16( lo, low ) ) );
+		vst1q_u16( (uint16_t*) ( dst + 16 ), vorrq_u16( vshlq_u16( hi, count ), vshlq_u16( hi, low ) ) );
+	}
+	return i;
+}
+
+static int luma_to_alpha_neon( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels )
+{
+	const uint8x16_t low = vdupq_n_u8( 16 );
+	const uint8x16_t high = vdupq_n_u8( 235 );
+	const uint8x8_t scale = vdup_n_u8( 43 );
+	int i;
+	for ( i = 0; i + 16 <= pixels; i += 16, src += 32, dst += 16 )
+	{
+		// ( y * 299 ) >> 8 is y + ( ( y * 43 ) >> 8 )
+		uint8x16_t y = vsubq_u8( vminq_u8( vmaxq_u8( vld2q_u8( src ).val[0], low ), high ), low );
+		uint8x8_t lo = vshrn_n_u16( vmull_u8( vget_low_u8( y ), scale ), 8 );
+		uint8x8_t hi = vshrn_n_u16( vmull_u8( vget_high_u8( y ), scale ), 8 );
+		vst1q_u8( dst, vaddq_u8( y, vcombine_u8( lo, hi ) ) );
+	}
+	return i;
+}
+
+static const struct image_convert_kernels neon_kernels =
+{
+	"neon",
+	yuv422_to_rgb24_neon,
+	yuv422_to_rgb24a_neon,
+	rgb24_to_yuv422_neon,
+	rgb24a_to_yuv422_neon,
+	rgb24_to_rgb24a_neon,
+	rgb24a_to_rgb24_neon,
+	yuv420p_to_yuv422_neon,
+	narrow_neon,
+	widen_neon,
+	luma_to_alpha_neon
+};
+
+static const struct image_convert_kernels *detect_kernels( void )
+{
+	return &neon_kernels;
+}
+
+#else
+
+static const struct image_convert_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct image_convert_kernels *image_convert_simd_kernels( void )
+{
+	static const struct image_convert_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_IMAGECONVERT_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
@@ -0,0 +1,87 @@
+/*
+ * image_convert_simd.h -- vectorized pixel format conversion kernels
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef IMAGE_CONVERT_SIMD_H
+#define IMAGE_CONVERT_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Convert the leading pixels of a run and return how many were converted.
+ *
+ * The kernels produce exactly the same output as the scalar code in
+ * filter_imageconvert.c, which converts the remaining pixels. \p alpha is
+ * read for yuv422 to rgb24a and written for rgb24a sources.
+ */
+
+typedef int ( *image_convert_kernel )( const uint8_t *src, uint8_t *dst, uint8_t *alpha, int pixels );
+
+/** Interleave a yuv420p line into yuv422 and return how many pixels were converted.
+ */
+
+typedef int ( *image_convert_planar_kernel )( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int pixels );
+
+/** Change the depth of samples and return how many were converted.
+ *
+ * The narrowing kernel turns 16-bit little-endian samples into 8-bit ones by
+ * dropping \p shift bits, and the widening kernel does the reverse. With
+ * \p full_range the low bits are replicated when widening and truncated when
+ * narrowing, which round trips RGB; otherwise they are zero when widening and
+ * rounded when narrowing, which keeps the levels of video YUV.
+ */
+
+typedef int ( *image_convert_depth_kernel )( const uint8_t *src, uint8_t *dst, int shift, int full_range, int samples );
+
+struct image_convert_kernels
+{
+	const char *name;
+	image_convert_kernel yuv422_to_rgb24;
+	image_convert_kernel yuv422_to_rgb24a;
+	image_convert_kernel rgb24_to_yuv422;
+	image_convert_kernel rgb24a_to_yuv422;
+	image_convert_kernel rgb24_to_rgb24a;
+	image_convert_kernel rgb24a_to_rgb24;
+	image_convert_planar_kernel yuv420p_to_yuv422;
+	image_convert_depth_kernel narrow;
+	image_convert_depth_kernel widen;
+	image_convert_kernel luma_to_alpha;
+};
+
+/** Get the best kernels for the CPU; any of them may be NULL. */
+const struct image_convert_kernels *image_convert_simd_kernels( void );
+
+/** Make an alpha channel from the Y of a yuv422 run, scaled from video to full range.
+ *
+ * Only the luma bytes are read. The alpha argument of the kernel is not used.
+ */
+
+static inline void image_luma_to_alpha( const uint8_t *src, uint8_t *dst, int pixels )
+{
+	const struct image_convert_kernels *k = image_convert_simd_kernels();
+	int i = k && k->luma_to_alpha ? k->luma_to_alpha( src, dst, NULL, pixels ) : 0;
+
+	for ( src += i * 2; i < pixels; i++, src += 2 )
+	{
+		unsigned int p = *src < 16 ? 16 : *src > 235 ? 235 : *src;
+		/* p = (p - 16) * 255 / 219; */
+		dst[i] = ( ( p - 16 ) * 299 ) >> 8;
+	}
+}
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ * luma_generator.c -- generator of the luma wipes
+ * Copyright (C) 2003-2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "luma_generator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void luma_generator_init( luma_generator *self )
+{
+	memset( self, 0, sizeof( luma_generator ) );
+	self->type = 0;
+	self->w = 720;
+	self->h = 576;
+	self->bands = 1;
+	self->rband = 0;
+	self->vmirror = 0;
+	self->hmirror = 0;
+	self->dmirror = 0;
+	self->invert = 0;
+	self->offset = 0;
+	self->flip = 0;
+	self->flop = 0;
+	self->quart = 0;
+	self->pflop = 0;
+	self->pflip = 0;
+}
+
+/** Set the options of one of the installed wipes, as create_lumas makes them.
+ *
+ * The size must be set first. Returns non-zero for an unknown number.
+ */
+
+int luma_generator_preset( luma_generator *self, int number )
+{
+	switch ( number )
+	{
+	case 1:
+		break;
+	case 2:
+		self->bands = self->h;
+		break;
+	case 3:
+		self->hmirror = 1;
+		break;
+	case 4:
+		self->bands = self->h;
+		self->vmirror = 1;
+		break;
+	case 5: case 6: case 7: case 8: case 15:
+		self->offset = 32768;
+		self->dmirror = 1;
+		self->flip = number == 6 || number == 8;
+		self->quart = number == 7 || number == 8;
+		self->hmirror = number == 15;
+		break;
+	case 9: case 10: case 11: case 12: case 13: case 14:
+		self->bands = 12;
+		self->rband = number >= 11;
+		self->rotate = number == 10 || number == 13 || number == 14;
+		self->flop = number == 10 || number == 13;
+		self->vmirror = number == 12 || number == 14;
+		break;
+	case 16: case 17:
+		self->type = 1;
+		if ( number == 17 )
+		{
+			self->bands = 2;
+			self->rband = 1;
+		}
+		break;
+	case 18: case 19: case 20: case 21:
+		self->type = 2;
+		self->quart = number >= 19;
+		self->flip = number == 20;
+		self->bands = number == 21 ? 2 : 1;
+		break;
+	case 22:
+		self->type = 3;
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+static inline int sqrti( int n )
+{
+    int p = 0;
+	int q = 1;
+	int r = n;
+	int h = 0;
+
+    while( q <= n ) 
+		q = 4 * q;
+
+    while( q != 1 )
+    {
+        q = q / 4;
+        h = p + q;
+        p = p / 2;
+        if ( r >= h )
+        {
+            p = p + q;
+            r = r - h;
+        } 
+    }
+
+    return p;
+}
+
+/** Get the size of the image that the rows are rendered in.
+ *
+ * A quarter wipe is rendered at twice the size and a rotated one on its side.
+ */
+
+void luma_generator_size( const luma_generator *self, int *width, int *height )
+{
+	*width = self->quart ? self->w * 2 : self->w;
+	*height = self->quart ? self->h * 2 : self->h;
+	if ( self->rotate )
+	{
+		int t = *width;
+		*width = *height;
+		*height = t;
+	}
+}
+
+/** Render the rows from start to end of the pattern of a wipe.
+ *
+ * Every row depends only on its number, so that the rows can be rendered in
+ * parallel before luma_generator_finish.
+ */
+
+void luma_generator_rows( const luma_generator *self, uint16_t *image, int start, int end )
+{
+	int w, h;
+	luma_generator_size( self, &w, &h );
+
+	int max = ( 1 << 16 ) - 1;
+	int lpb = h / self->bands;
+	int rpb = max / self->bands;
+	int half_w = w / 2;
+	int half_h = h / 2;
+	int row, k;
+
+	if ( !self->dmirror && ( self->hmirror || self->vmirror ) )
+		rpb *= 2;
+
+	for ( row = start; row < end; row ++ )
+	{
+		uint16_t *p = image + row * w;
+		uint16_t *row_end = p + w;
+		int i = lpb ? row / lpb : self->bands;
+		int j = lpb ? row % lpb : 0;
+		int lower = i * rpb;
+		int direction = 1;
+
+		if ( self->rband && i % 2 == 1 )
+		{
+			direction = -1;
+			lower += rpb;
+		}
+
+		// Rows past the last band are not part of the pattern
+		if ( self->type == 3 ? row >= half_h * 2 : i >= self->bands )
+		{
+			memset( p, 0, w * sizeof( uint16_t ) );
+			continue;
+		}
+
+		switch( self->type )
+		{
+			case 1:
+				{
+					int length = sqrti( half_w * half_w + lpb * lpb / 4 );
+					int value;
+					int x = 0;
+					int y = j - lpb / 2;
+					for ( k = 0; k < w; k ++ )
+					{
+						x = k - half_w;
+						value = sqrti( x * x + y * y );
+						*p ++ = lower + ( direction * (int64_t) rpb * ( ( (int64_t) max * value ) / length ) / max ) + ( j * self->offset * 2 / lpb ) + ( j * self->offset / lpb );
+					}
+				}
+				break;
+
+			case 2:
+				{
+					int value = ( ( j * w ) / lpb ) - half_w;
+					if ( value > 0 )
+						value = - value;
+					for ( k = - half_w; k < value; k ++ )
+						*p ++ = lower + ( direction * (int64_t) rpb * ( ( (int64_t) max * abs( k ) ) / half_w ) / max );
+					for ( k = value; k < abs( value ); k ++ )
+						*p ++ = lower + ( direction * (int64_t) rpb * ( ( (int64_t) max * abs( value ) ) / half_w ) / max ) + ( j * self->offset * 2 / lpb ) + ( j * self->offset / lpb );
+					for ( k = abs( value ); k < half_w; k ++ )
+						*p ++ = lower + ( direction * (int64_t) rpb * ( ( (int64_t) max * abs( k ) ) / half_w ) / max );
+				}
+				break;
+
+			case 3:
+				{
+					int length;
+					j = row - half_h;
+					if ( j < 0 )
+					{
+						for ( k = - half_w; k < half_w; k ++ )
+						{
+							length = sqrti( k * k + j * j );
+							*p ++ = ( max / 4 * k ) / ( length + 1 );
+						}
+					}
+					else
+					{
+						for ( k = half_w; k > - half_w; k -- )
+						{
+							length = sqrti( k * k + j * j );
+							*p ++ = ( max / 2 ) + ( max / 4 * k ) / ( length + 1 );
+						}
+					}
+				}
+				break;
+
+			default:
+				for ( k = 0; k < w; k ++ )
+					*p ++ = lower + ( direction * ( (int64_t) rpb * ( ( (int64_t) k * max ) / w ) / max ) ) + ( j * self->offset * 2 / lpb );
+				break;
+		}
+
+		// The patterns about the centre fill an even number of columns
+		while ( p < row_end )
+		{
+			*p = p > image + row * w ? p[ -1 ] : 0;
+			p ++;
+		}
+	}
+}
+
+/** Mirror, flip and rotate the rendered rows into the wipe.
+ *
+ * The pointers meet or cross in the middle, so that odd sizes work.
+ * The image is the size given by luma_generator_size. A rotated wipe is
+ * written to spare, which must hold self->w * self->h values; otherwise the
+ * wipe is the start of the image. Returns the image that holds the wipe.
+ */
+
+uint16_t *luma_generator_finish( const luma_generator *self, uint16_t *image, uint16_t *spare )
+{
+	int max = ( 1 << 16 ) - 1;
+	int w, h;
+	int i = 0;
+	int j = 0;
+	uint16_t *end;
+	uint16_t *p = image;
+	uint16_t *r = image;
+
+	luma_generator_size( self, &w, &h );
+	end = image + w * h;
+
+	if ( self->quart )
+	{
+		w /= 2;
+		h /= 2;
+		for ( i = 1; i < h; i ++ )
+		{
+			p = image + i * w;
+			r = image + i * 2 * w;
+			j = w;
+			while ( j -- > 0 )
+				*p ++ = *r ++;
+		}
+	}
+
+	if ( self->dmirror )
+	{
+		for ( i = 0; i < h; i ++ )
+		{
+			p = image + i * w;
+			r = end - i * w;
+			j = ( w * ( h - i ) ) / h;
+			while ( j -- )
+				*( -- r ) = *p ++;
+		}
+	}
+
+	if ( self->flip )
+	{
+		uint16_t t;
+		for ( i = 0; i < h; i ++ )
+		{
+			p = image + i * w;
+			r = p + w;
+			while( p < r )
+			{
+				t = *p;
+				*p ++ = *( -- r );
+				*r = t;
+			}
+		}
+	}
+
+	if ( self->flop )
+	{
+		uint16_t t;
+		r = end;
+		for ( i = 1; i < h / 2; i ++ )
+		{
+			p = image + i * w;
+			j = w;
+			while( j -- )
+			{
+				t = *( -- p );
+				*p = *( -- r );
+				*r = t;
+			}
+		}
+	}
+
+	if ( self->hmirror )
+	{
+		p = image;
+		while ( p < end )
+		{
+			r = p + w;
+			while ( p < r )
+				*( -- r ) = *p ++;
+			p += w / 2;
+		}
+	}
+
+	if ( self->vmirror )
+	{
+		p = image;
+		r = end;
+		while ( p < r )
+			*( -- r ) = *p ++;
+	}
+
+	if ( self->invert )
+	{
+		p = image;
+		r = image;
+		while ( p < end )
+			*p ++ = max - *r ++;
+	}
+
+	if ( self->pflip )
+	{
+		uint16_t t;
+		for ( i = 0; i < h; i ++ )
+		{
+			p = image + i * w;
+			r = p + w;
+			while( p < r )
+			{
+				t = *p;
+				*p ++ = *( -- r );
+				*r = t;
+			}
+		}
+	}
+
+	if ( self->pflop )
+	{
+		uint16_t t;
+		end = image + w * h;
+		r = end;
+		for ( i = 1; i < h / 2; i ++ )
+		{
+			p = image + i * w;
+			j = w;
+			while( j -- )
+			{
+				t = *( -- p );
+				*p = *( -- r );
+				*r = t;
+			}
+		}
+	}
+
+	if ( self->rotate )
+	{
+		for ( i = 0; i < h; i ++ )
+		{
+			p = image + i * w;
+			r = spare + h - i - 1;
+			for ( j = 0; j < w; j ++ )
+			{
+				*r = *( p ++ );
+				r += h;
+			}
+		}
+		image = spare;
+	}
+
+	return image;
+}
@@ -0,0 +1,63 @@
+/*
+ * luma_generator.h -- generator of the luma wipes
+ * Copyright (C) 2003-2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LUMA_GENERATOR_H
+#define LUMA_GENERATOR_H
+
+#include <stdint.h>
+
+/* The generator is shared by the luma program, which writes the installed
+ * PGM files at build time, and the core module, which renders the same wipes
+ * at the size of the output. It does not use the framework.
+ */
+
+typedef struct
+{
+	int type;
+	int w;
+	int h;
+	int bands;
+	int rband;
+	int vmirror;
+	int hmirror;
+	int dmirror;
+	int invert;
+	int offset;
+	int flip;
+	int flop;
+	int pflip;
+	int pflop;
+	int quart;
+	int rotate;
+}
+luma_generator;
+
+/** The number of the last of the installed wipes, luma01 to luma22. */
+#define LUMA_GENERATOR_PRESETS 22
+
+extern void luma_generator_init( luma_generator *self );
+extern int luma_generator_preset( luma_generator *self, int number );
+extern void luma_generator_size( const luma_generator *self, int *width, int *height );
+extern void luma_generator_rows( const luma_generator *self, uint16_t *image, int start, int end );
+extern uint16_t *luma_generator_finish( const luma_generator *self, uint16_t *image, uint16_t *spare );
+
+// In transition_luma.c, for the transitions of the core module
+extern uint16_t *luma_generate( const char *resource, int width, int height );
+
+#endif
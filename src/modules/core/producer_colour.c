@@ -53,6 +53,29 @@ mlt_producer producer_colour_init( mlt_profile profile, mlt_service_type type, c
 	return NULL;
 }
 
+// Remove a path before the colour in the resource and return the colour.
+static char *strip_path( mlt_properties producer_props )
+{
+	char *resource = mlt_properties_get( producer_props, "resource" );
+	if ( resource && strchr( resource, '/' ) )
+	{
+		resource = strdup( strrchr( resource, '/' ) + 1 );
+		mlt_properties_set( producer_props, "resource", resource );
+		free( resource );
+		resource = mlt_properties_get( producer_props, "resource" );
+	}
+	return resource;
+}
+
+// Get a reference to a cached buffer, or a copy when pool buffers cannot be shared.
+static uint8_t *share_buffer( uint8_t *data, int size )
+{
+	uint8_t *shared = NULL;
+	if ( data && size > 0 && !( shared = mlt_pool_retain( data ) ) && ( shared = mlt_pool_alloc( size ) ) )
+		memcpy( shared, data, size );
+	return shared;
+}
+
 static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	// Obtain properties of frame
@@ -78,13 +101,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	mlt_image_format current_format = mlt_properties_get_int( producer_props, "_format" );
 
 	// Parse the colour
-	if ( now && strchr( now, '/' ) )
-	{
-		now = strdup( strrchr( now, '/' ) + 1 );
-		mlt_properties_set( producer_props, "resource", now );
-		free( now );
-		now = mlt_properties_get( producer_props, "resource" );
-	}
+	now = strip_path( producer_props );
 	mlt_color color = mlt_properties_get_color( producer_props, "resource" );
 
 	if ( mlt_properties_get( producer_props, "mlt_image_format") )
@@ -120,8 +137,6 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		mlt_properties_set_int( producer_props, "_format", *format );
 		mlt_properties_set( producer_props, "_resource", now );
 
-		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
-
 		switch ( *format )
 		{
 		case mlt_image_yuv420p:
@@ -188,35 +203,38 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			mlt_log_error( MLT_PRODUCER_SERVICE( producer ),
 				"invalid image format %s\n", mlt_image_format_name( *format ) );
 		}
+
+		// Initialise the alpha
+		if ( color.a < 255 || *format == mlt_image_rgb24a )
+		{
+			int alpha_size = *width * *height;
+			uint8_t *alpha = mlt_pool_alloc( alpha_size );
+			if ( alpha )
+				memset( alpha, color.a, alpha_size );
+			mlt_properties_set_data( producer_props, "alpha", alpha, alpha ? alpha_size : 0, mlt_pool_release, NULL );
+		}
+		else
+		{
+			mlt_properties_set_data( producer_props, "alpha", NULL, 0, NULL, NULL );
+		}
 	}
-	else
+	else if ( *format == mlt_image_yuv420p || *format == mlt_image_yuv422 )
 	{
-		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+		mlt_properties_set_int( properties, "colorspace", 601 );
 	}
 
-	// Create the alpha channel
+	// Share our image and alpha with the frame, which copies them before they are written
 	int alpha_size = 0;
-	uint8_t *alpha = NULL;
-
-	// Initialise the alpha
-	if (color.a < 255 || *format == mlt_image_rgb24a) {
-		alpha_size = *width * *height;
-		alpha = mlt_pool_alloc( alpha_size );
-		if ( alpha )
-			memset( alpha, color.a, alpha_size );
-		else
-			alpha_size = 0;
-	}
+	uint8_t *alpha = mlt_properties_get_data( producer_props, "alpha", &alpha_size );
+	alpha = share_buffer( alpha, alpha_size );
+	if ( buffer && image && size > 0 )
+		*buffer = share_buffer( image, size );
 
-	// Clone our image
-	if (buffer && image && size > 0) {
-		*buffer = mlt_pool_alloc( size );
-		memcpy( *buffer, image, size );
-	}
+	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 
-	// Now update properties so we free the copy after
+	// Now update properties so we release our reference after
 	mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
-	mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
+	mlt_frame_set_alpha( frame, alpha, alpha ? alpha_size : 0, mlt_pool_release );
 	mlt_properties_set_double( properties, "aspect_ratio", mlt_properties_get_double( producer_props, "aspect_ratio" ) );
 	mlt_properties_set_int( properties, "meta.media.width", *width );
 	mlt_properties_set_int( properties, "meta.media.height", *height );
@@ -252,6 +270,18 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 		// colour is an alias for resource
 		if ( mlt_properties_get( producer_props, "colour" ) != NULL )
 			mlt_properties_set( producer_props, "resource", mlt_properties_get( producer_props, "colour" ) );
+		strip_path( producer_props );
+
+		// Every frame has the same image for the same colour and format
+		char content[ 256 ];
+		snprintf( content, sizeof( content ), "colour:%s:%s", mlt_properties_get( producer_props, "resource" ),
+			mlt_properties_get( producer_props, "mlt_image_format" ) ? mlt_properties_get( producer_props, "mlt_image_format" ) : "" );
+		mlt_frame_set_static_image( *frame, content );
+
+		// Every pixel has the same colour and alpha
+		mlt_color color = mlt_properties_get_color( producer_props, "resource" );
+		mlt_properties_set_color( properties, "solid_colour", color );
+		mlt_properties_set_int( properties, "constant_alpha", color.a );
 		
 		// Push the get_image method
 		mlt_frame_push_get_image( *frame, producer_get_image );
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
 
 struct context_s {
 	mlt_producer self;
@@ -34,10 +35,28 @@ struct context_s {
 	mlt_profile profile;
 	int64_t audio_counter;
 	mlt_position audio_position;
+	int reuse;                   ///< whether the last nested frame is shown again
+	mlt_frame last_frame;        ///< the last nested frame when reusing it
+	mlt_position last_position;  ///< the position of the last nested frame
+	pthread_mutex_t mutex;       ///< serializes the images of reused frames
 };
 typedef struct context_s *context; 
 
 
+// Share a buffer of the nested frame, or copy it if it is not from the pool.
+static void *share_buffer( mlt_frame nested_frame, const char *name, void *data, int size )
+{
+	void *buffer = mlt_frame_share_data( nested_frame, name, NULL );
+	if ( buffer != data )
+	{
+		if ( buffer )
+			mlt_pool_release( buffer );
+		buffer = mlt_pool_alloc( size );
+		memcpy( buffer, data, size );
+	}
+	return buffer;
+}
+
 static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	context cx = mlt_frame_pop_service( frame );
@@ -46,28 +65,33 @@ static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format
 	*width = cx->profile->width;
 	*height = cx->profile->height;
 
-	int result = mlt_frame_get_image( nested_frame, image, format, width, height, writable );
+	// A reused nested frame may be asked for its image by several frames at once
+	if ( cx->reuse )
+		pthread_mutex_lock( &cx->mutex );
 
-	// Allocate the image
-	int size = mlt_image_format_size( *format, *width, *height, NULL );
-	uint8_t *new_image = mlt_pool_alloc( size );
+	int result = mlt_frame_get_image( nested_frame, image, format, width, height, 0 );
 
-	// Update the frame
-	mlt_properties properties = mlt_frame_properties( frame );
-	mlt_frame_set_image( frame, new_image, size, mlt_pool_release );
-	memcpy( new_image, *image, size );
-	mlt_properties_set( properties, "progressive", mlt_properties_get( MLT_FRAME_PROPERTIES(nested_frame), "progressive" ) );
-	*image = new_image;
-	
-	// Copy the alpha channel
-	uint8_t *alpha = mlt_properties_get_data( MLT_FRAME_PROPERTIES( nested_frame ), "alpha", &size );
-	if ( alpha && size > 0 )
+	if ( !result && *image )
 	{
-		new_image = mlt_pool_alloc( size );
-		memcpy( new_image, alpha, size );
-		mlt_frame_set_alpha( frame, new_image, size, mlt_pool_release );
+		// Move the image over, which the frame copies when asked to write to it
+		int size = mlt_image_format_size( *format, *width, *height, NULL );
+		uint8_t *new_image = share_buffer( nested_frame, "image", *image, size );
+
+		// Update the frame
+		mlt_properties properties = mlt_frame_properties( frame );
+		mlt_frame_set_image( frame, new_image, size, mlt_pool_release );
+		mlt_properties_set( properties, "progressive", mlt_properties_get( MLT_FRAME_PROPERTIES(nested_frame), "progressive" ) );
+		*image = new_image;
+
+		// Move the alpha channel over
+		uint8_t *alpha = mlt_properties_get_data( MLT_FRAME_PROPERTIES( nested_frame ), "alpha", &size );
+		if ( alpha && size > 0 )
+			mlt_frame_set_alpha( frame, share_buffer( nested_frame, "alpha", alpha, size ), size, mlt_pool_release );
 	}
 
+	if ( cx->reuse )
+		pthread_mutex_unlock( &cx->mutex );
+
 	return result;
 }
 
@@ -87,12 +111,14 @@ static int get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format,
 		}
 		*samples = mlt_sample_calculator( fps, *frequency, cx->audio_counter++ );
 		result = mlt_frame_get_audio( nested_frame, buffer, format, frequency, channels, samples );
-		int size = mlt_audio_format_size( *format, *samples, *channels );
-		int16_t *new_buffer = mlt_pool_alloc( size );
+		if ( !result && *buffer )
+		{
+			int size = mlt_audio_format_size( *format, *samples, *channels );
+			void *new_buffer = share_buffer( nested_frame, "audio", *buffer, size );
 
-		mlt_frame_set_audio( frame, new_buffer, *format, size, mlt_pool_release );
-		memcpy( new_buffer, *buffer, size );
-		*buffer = new_buffer;
+			mlt_frame_set_audio( frame, new_buffer, *format, size, mlt_pool_release );
+			*buffer = new_buffer;
+		}
 		cx->audio_position = mlt_frame_get_position( nested_frame );
 	}
 	else
@@ -181,6 +207,13 @@ static int get_frame( mlt_producer self, mlt_frame_ptr frame, int index )
 		// Connect it all together
 		mlt_consumer_connect( cx->consumer, MLT_PRODUCER_SERVICE( cx->producer ) );
 		mlt_consumer_start( cx->consumer );
+
+		// At a lower frame rate than ours, a nested frame is shown again instead of rendered again.
+		// Only without real_time, whose read ahead does not follow our seeks.
+		cx->reuse = !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( cx->consumer ), "real_time" ) &&
+			mlt_profile_fps( cx->profile ) < mlt_producer_get_fps( self );
+		cx->last_position = -1;
+		pthread_mutex_init( &cx->mutex, NULL );
 	}
 
 	// Generate a frame
@@ -193,11 +226,28 @@ static int get_frame( mlt_producer self, mlt_frame_ptr frame, int index )
 		if ( mlt_producer_get_speed( self ) != 0 )
 			actual_position *= mlt_producer_get_speed( self );
 		mlt_position need_first = floor( actual_position );
-		mlt_producer_seek( cx->producer,
-			lrint( need_first * mlt_profile_fps( cx->profile ) / mlt_producer_get_fps( self ) ) );
+		mlt_position nested_position = lrint( need_first * mlt_profile_fps( cx->profile ) / mlt_producer_get_fps( self ) );
+		mlt_frame nested_frame = NULL;
 
-		// Get the nested frame
-		mlt_frame nested_frame = mlt_consumer_rt_frame( cx->consumer );
+		if ( cx->reuse && cx->last_frame && nested_position == cx->last_position )
+		{
+			// Show the last nested frame again
+			nested_frame = cx->last_frame;
+			mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( nested_frame ) );
+		}
+		else
+		{
+			// Get the nested frame
+			mlt_producer_seek( cx->producer, nested_position );
+			nested_frame = mlt_consumer_rt_frame( cx->consumer );
+			if ( cx->reuse && nested_frame )
+			{
+				mlt_frame_close( cx->last_frame );
+				cx->last_frame = nested_frame;
+				cx->last_position = nested_position;
+				mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( nested_frame ) );
+			}
+		}
 
 		// Stack the producer and our methods on the nested frame
 		mlt_frame_push_service( *frame, nested_frame );
@@ -229,6 +279,26 @@ static int get_frame( mlt_producer self, mlt_frame_ptr frame, int index )
 	return 0;
 }
 
+static void on_profile_changed( mlt_properties owner, mlt_producer self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES(self);
+	context cx = mlt_properties_get_data( properties, "context", NULL );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self ) );
+
+	// A nested profile that was asked for or taken from the resource stays
+	if ( !cx || !profile || cx->profile->is_explicit || mlt_properties_get_int( properties, "autoprofile" ) )
+		return;
+
+	// Follow our profile in place, which the nested services share
+	free( cx->profile->description );
+	memcpy( cx->profile, profile, sizeof( *profile ) );
+	cx->profile->description = profile->description ? strdup( profile->description ) : NULL;
+	cx->profile->is_explicit = 0;
+	cx->reuse = !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( cx->consumer ), "real_time" ) &&
+		mlt_profile_fps( cx->profile ) < mlt_producer_get_fps( self );
+	mlt_service_profile_changed( MLT_CONSUMER_SERVICE( cx->consumer ) );
+}
+
 static void producer_close( mlt_producer self )
 {
 	context cx = mlt_properties_get_data( MLT_PRODUCER_PROPERTIES( self ), "context", NULL );
@@ -236,6 +306,8 @@ static void producer_close( mlt_producer self )
 	// Shut down all the encapsulated services
 	if ( cx )
 	{
+		mlt_frame_close( cx->last_frame );
+		pthread_mutex_destroy( &cx->mutex );
 		mlt_consumer_stop( cx->consumer );
 		mlt_consumer_close( cx->consumer );
 		mlt_producer_close( cx->producer );
@@ -261,6 +333,7 @@ mlt_producer producer_consumer_init( mlt_profile profile, mlt_service_type type,
 		// Override some producer methods
 		self->close = ( mlt_destructor )producer_close;
 		self->get_frame = get_frame;
+		mlt_events_listen( MLT_PRODUCER_PROPERTIES( self ), self, "profile-changed", ( mlt_listener )on_profile_changed );
 		
 		// Get the properties of this producer
 		mlt_properties properties = MLT_PRODUCER_PROPERTIES( self );
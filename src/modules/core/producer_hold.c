@@ -76,6 +76,53 @@ mlt_producer producer_hold_init( mlt_profile profile, mlt_service_type type, con
 	return self;
 }
 
+// Share a buffer of one frame with another, or copy it if it cannot be shared.
+static void *share_data( mlt_frame frame, const char *name, int size )
+{
+	void *data = mlt_frame_share_data( frame, name, NULL );
+	if ( data == NULL )
+	{
+		data = mlt_pool_alloc( size );
+		memcpy( data, mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), name, NULL ), size );
+	}
+	return data;
+}
+
+/** Get the held image in a format, converting it only the first time.
+ *
+ * Each conversion is kept on a frame stored on the real frame, so every
+ * output frame only takes a reference to the converted image.
+ */
+
+static mlt_frame get_converted( mlt_frame real_frame, mlt_image_format format )
+{
+	mlt_properties real_properties = MLT_FRAME_PROPERTIES( real_frame );
+	char key[ 64 ];
+	snprintf( key, sizeof( key ), "_hold.%s", mlt_image_format_name( format ) );
+	mlt_frame converted = mlt_properties_get_data( real_properties, key, NULL );
+
+	if ( converted == NULL && ( converted = mlt_frame_init( NULL ) ) )
+	{
+		mlt_properties properties = MLT_FRAME_PROPERTIES( converted );
+		int width = mlt_properties_get_int( real_properties, "width" );
+		int height = mlt_properties_get_int( real_properties, "height" );
+		int size = 0;
+		uint8_t *image = NULL;
+
+		mlt_properties_pass( properties, real_properties, "" );
+		mlt_properties_get_data( real_properties, "image", &size );
+		if ( size <= 0 )
+			size = mlt_image_format_size( mlt_properties_get_int( real_properties, "format" ), width, height, NULL );
+		mlt_frame_set_image( converted, share_data( real_frame, "image", size ), size, mlt_pool_release );
+		if ( mlt_properties_get_data( real_properties, "alpha", NULL ) )
+			mlt_frame_set_alpha( converted, share_data( real_frame, "alpha", width * height ), width * height, mlt_pool_release );
+		converted->convert_image = real_frame->convert_image;
+		mlt_frame_get_image( converted, &image, &format, &width, &height, 0 );
+		mlt_properties_set_data( real_properties, key, converted, 0, ( mlt_destructor )mlt_frame_close, NULL );
+	}
+	return converted;
+}
+
 static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	// Get the properties of the frame
@@ -83,40 +130,65 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	// Obtain the real frame
 	mlt_frame real_frame = mlt_frame_pop_service( frame );
+	mlt_properties real_properties = MLT_FRAME_PROPERTIES( real_frame );
+	mlt_producer producer = mlt_frame_get_original_producer( frame );
+	mlt_image_format requested_format = *format;
+	mlt_frame source = real_frame;
+
+	// The frames of this producer share the real frame
+	if ( producer )
+		mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
 
 	// Get the image from the real frame
 	int size = 0;
-	*buffer = mlt_properties_get_data( MLT_FRAME_PROPERTIES( real_frame ), "image", &size );
-	*width = mlt_properties_get_int( MLT_FRAME_PROPERTIES( real_frame ), "width" );
-	*height = mlt_properties_get_int( MLT_FRAME_PROPERTIES( real_frame ), "height" );
+	*buffer = mlt_properties_get_data( real_properties, "image", &size );
+	*width = mlt_properties_get_int( real_properties, "width" );
+	*height = mlt_properties_get_int( real_properties, "height" );
 
 	// If this is the first time, get it from the producer
 	if ( *buffer == NULL )
 	{
-		mlt_properties_pass( MLT_FRAME_PROPERTIES( real_frame ), properties, "" );
+		mlt_properties_pass( real_properties, properties, "" );
 
 		// We'll deinterlace on the downstream deinterlacer
-		mlt_properties_set_int( MLT_FRAME_PROPERTIES( real_frame ), "consumer_deinterlace", 1 );
+		mlt_properties_set_int( real_properties, "consumer_deinterlace", 1 );
 
 		// We want distorted to ensure we don't hit the resize filter twice
-		mlt_properties_set_int( MLT_FRAME_PROPERTIES( real_frame ), "distort", 1 );
+		mlt_properties_set_int( real_properties, "distort", 1 );
 
 		// Get the image
 		mlt_frame_get_image( real_frame, buffer, format, width, height, writable );
 	
 		// Make sure we get the size
-		*buffer = mlt_properties_get_data( MLT_FRAME_PROPERTIES( real_frame ), "image", &size );
+		*buffer = mlt_properties_get_data( real_properties, "image", &size );
 	}
 
-	mlt_properties_pass( properties, MLT_FRAME_PROPERTIES( real_frame ), "" );
+	mlt_properties_pass( properties, real_properties, "" );
+
+	// Use the conversion of the held image to the requested format
+	if ( *buffer != NULL && real_frame->convert_image && requested_format != mlt_image_none && requested_format != mlt_image_glsl
+		 && requested_format != mlt_properties_get_int( real_properties, "format" ) )
+	{
+		mlt_frame converted = get_converted( real_frame, requested_format );
+		if ( converted && mlt_properties_get_int( MLT_FRAME_PROPERTIES( converted ), "format" ) == requested_format
+			 && mlt_properties_get_data( MLT_FRAME_PROPERTIES( converted ), "image", &size ) )
+			source = converted;
+	}
 
 	// Set the values obtained on the frame
 	if ( *buffer != NULL )
 	{
-		uint8_t *image = mlt_pool_alloc( size );
-		memcpy( image, *buffer, size );
-		*buffer = image;
+		mlt_properties source_properties = MLT_FRAME_PROPERTIES( source );
+
+		// Share the image of the held frame, which is copied if it is written
+		*buffer = share_data( source, "image", size );
+		*format = mlt_properties_get_int( source_properties, "format" );
+		*width = mlt_properties_get_int( source_properties, "width" );
+		*height = mlt_properties_get_int( source_properties, "height" );
 		mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
+		mlt_properties_set_int( properties, "format", *format );
+		if ( mlt_properties_get_data( source_properties, "alpha", NULL ) )
+			mlt_frame_set_alpha( frame, share_data( source, "alpha", *width * *height ), *width * *height, mlt_pool_release );
 	}
 	else
 	{
@@ -124,6 +196,9 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		mlt_frame_set_image( frame, *buffer, size, NULL );
 	}
 
+	if ( producer )
+		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+
 	// Make sure that no further scaling is done
 	mlt_properties_set( properties, "rescale.interps", "none" );
 	mlt_properties_set( properties, "scale", "off" );
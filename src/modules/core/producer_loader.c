@@ -178,6 +178,48 @@ static void create_filter( mlt_profile profile, mlt_producer producer, char *eff
 	free( id );
 }
 
+/** Check whether a normaliser could do anything for a producer.
+ *
+ * Only those known to have nothing to do for the media the producer tells
+ * about are left out, the rest depend on what the consumer asks for.
+ */
+
+static int normaliser_wanted( const char *name, mlt_properties properties )
+{
+	// Deinterlacing and correcting the field order do nothing to progressive images
+	if ( !strcmp( name, "deinterlace" ) || !strcmp( name, "fieldorder" ) )
+	{
+		if ( mlt_properties_get( properties, "force_progressive" ) )
+			return !mlt_properties_get_int( properties, "force_progressive" );
+		if ( mlt_properties_get( properties, "progressive" ) )
+			return !mlt_properties_get_int( properties, "progressive" );
+	}
+	return 1;
+}
+
+/** Find where the normaliser at an index of loader.ini goes in the filters of a producer.
+ *
+ * \return the position past the normalisers before it, or -1 if it is attached
+ */
+
+static int normaliser_position( mlt_producer producer, int index )
+{
+	mlt_service service = MLT_PRODUCER_SERVICE( producer );
+	int count = mlt_service_filter_count( service );
+	int position = 0;
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		int other = mlt_properties_get_int( MLT_FILTER_PROPERTIES( mlt_service_filter( service, i ) ), "_loader_normaliser" );
+		if ( other == index + 1 )
+			return -1;
+		else if ( other && other < index + 1 )
+			position = i + 1;
+	}
+	return position;
+}
+
 static void attach_normalisers( mlt_profile profile, mlt_producer producer )
 {
 	// Loop variable
@@ -186,6 +228,9 @@ static void attach_normalisers( mlt_profile profile, mlt_producer producer )
 	// Tokeniser
 	mlt_tokeniser tokeniser = mlt_tokeniser_init( );
 
+	mlt_service service = MLT_PRODUCER_SERVICE( producer );
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+
 	// We only need to load the normalising properties once
 	if ( normalisers == NULL )
 	{
@@ -195,21 +240,40 @@ static void attach_normalisers( mlt_profile profile, mlt_producer producer )
 		mlt_factory_register_for_clean_up( normalisers, ( mlt_destructor )mlt_properties_close );
 	}
 
-	// Apply normalisers
+	// Apply the normalisers that are wanted and not yet attached, in their order
 	for ( i = 0; i < mlt_properties_count( normalisers ); i ++ )
 	{
 		int j = 0;
 		int created = 0;
+		int position = normaliser_position( producer, i );
 		char *value = mlt_properties_get_value( normalisers, i );
+
+		if ( position < 0 || !normaliser_wanted( mlt_properties_get_name( normalisers, i ), properties ) )
+			continue;
 		mlt_tokeniser_parse_new( tokeniser, value, "," );
 		for ( j = 0; !created && j < mlt_tokeniser_count( tokeniser ); j ++ )
 			create_filter( profile, producer, mlt_tokeniser_get_string( tokeniser, j ), &created );
+		if ( created )
+		{
+			int last = mlt_service_filter_count( service ) - 1;
+			mlt_properties_set_int( MLT_FILTER_PROPERTIES( mlt_service_filter( service, last ) ), "_loader_normaliser", i + 1 );
+			mlt_service_move_filter( service, last, position );
+		}
 	}
 
 	// Close the tokeniser
 	mlt_tokeniser_close( tokeniser );
 }
 
+/** Reconsider the normalisers left out when a property they depend on changes.
+ */
+
+static void on_property_changed( mlt_producer owner, mlt_producer producer, char *name )
+{
+	if ( name && ( !strcmp( name, "force_progressive" ) || !strcmp( name, "progressive" ) ) )
+		attach_normalisers( mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) ), producer );
+}
+
 mlt_producer producer_loader_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
 {
 	// Create the producer 
@@ -228,7 +292,10 @@ mlt_producer producer_loader_init( mlt_profile profile, mlt_service_type type, c
 		mlt_properties_get( properties, "xml" ) == NULL &&
 		mlt_properties_get( properties, "_xml" ) == NULL &&
 		mlt_properties_get( properties, "loader_normalised" ) == NULL )
+	{
 		attach_normalisers( profile, producer );
+		mlt_events_listen( properties, producer, "property-changed", ( mlt_listener )on_property_changed );
+	}
 	
 	if ( producer )
 	{
@@ -0,0 +1,217 @@
+/*
+ * producer_mltraw.c -- read raw frames from a file of fixed-size records
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "frame_record.h"
+
+#include <framework/mlt.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct producer_mltraw_s *producer_mltraw;
+
+struct producer_mltraw_s
+{
+	struct mlt_producer_s parent;
+	int fd;
+	frame_file_header header;
+};
+
+// A record mapped for a frame until the frame is closed.
+typedef struct
+{
+	void *data;
+	size_t size;
+}
+record_map;
+
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
+static void producer_close( mlt_producer producer );
+
+static int read_header( int fd, frame_file_header *header )
+{
+	struct stat st;
+	int64_t count;
+
+	if ( pread( fd, header, sizeof( *header ), 0 ) != sizeof( *header ) || fstat( fd, &st ) )
+		return 1;
+	if ( memcmp( header->magic, FRAME_FILE_MAGIC, sizeof( header->magic ) )
+		|| header->byte_order != FRAME_FILE_BYTE_ORDER || header->version != FRAME_FILE_VERSION
+		|| header->record_size < sizeof( frame_record_header ) || header->record_size != FRAME_FILE_ALIGN( header->record_size )
+		|| header->header_size != FRAME_FILE_ALIGN( header->header_size ) || header->header_size > st.st_size )
+		return 1;
+
+	// A writer that did not finish leaves the count at zero
+	count = ( st.st_size - header->header_size ) / header->record_size;
+	if ( header->count <= 0 || header->count > count )
+		header->count = count;
+	return header->count <= 0;
+}
+
+/** Initialise the raw file producer.
+*/
+
+mlt_producer producer_mltraw_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	producer_mltraw self = calloc( 1, sizeof( struct producer_mltraw_s ) );
+	int fd = arg ? open( arg, O_RDONLY ) : -1;
+
+	if ( self && fd >= 0 && !read_header( fd, &self->header ) && mlt_producer_init( &self->parent, self ) == 0 )
+	{
+		mlt_producer producer = &self->parent;
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+		frame_file_header *header = &self->header;
+
+		self->fd = fd;
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set_position( properties, "length", header->count );
+		mlt_properties_set_position( properties, "out", header->count - 1 );
+		mlt_properties_set_int( properties, "seekable", 1 );
+		mlt_properties_set_int( properties, "meta.media.width", header->width );
+		mlt_properties_set_int( properties, "meta.media.height", header->height );
+		mlt_properties_set_int( properties, "meta.media.frame_rate_num", header->frame_rate_num );
+		mlt_properties_set_int( properties, "meta.media.frame_rate_den", header->frame_rate_den );
+		mlt_properties_set_int( properties, "meta.media.sample_aspect_num", header->sample_aspect_num );
+		mlt_properties_set_int( properties, "meta.media.sample_aspect_den", header->sample_aspect_den );
+		mlt_properties_set_int( properties, "meta.media.progressive", header->progressive );
+		mlt_properties_set_int( properties, "meta.media.colorspace", header->colorspace );
+		mlt_properties_set_int( properties, "audio_frequency", header->frequency );
+		mlt_properties_set_int( properties, "audio_channels", header->channels );
+
+		producer->get_frame = producer_get_frame;
+		producer->close = ( mlt_destructor )producer_close;
+		return producer;
+	}
+	if ( fd >= 0 )
+		close( fd );
+	free( self );
+	return NULL;
+}
+
+static void record_unmap( record_map *map )
+{
+	munmap( map->data, map->size );
+	free( map );
+}
+
+// Check that the parts of a record are inside it, so that a bad file cannot crash.
+static int check_record( const uint8_t *record, size_t size )
+{
+	const frame_record_header *header = (const frame_record_header*) record;
+
+	if ( (uint64_t) header->image_offset + header->image_size > size
+		|| (uint64_t) header->alpha_offset + header->alpha_size > size
+		|| (uint64_t) header->audio_offset + header->audio_size > size
+		|| (uint64_t) header->properties_offset + header->properties_size > size )
+		return 1;
+	if ( header->properties_size )
+	{
+		// The last value must end inside the properties
+		const uint8_t *end = record + header->properties_offset + header->properties_size;
+		int nuls = 0;
+		const uint8_t *p;
+		if ( end[ -1 ] )
+			return 1;
+		for ( p = record + header->properties_offset; p < end; p ++ )
+			nuls += !*p;
+		if ( nuls % 2 )
+			return 1;
+	}
+	return 0;
+}
+
+/** Make a frame of a record.
+ *
+ * The record is mapped privately for each frame, so the image and audio are
+ * the pages of the file, and a filter that changes them in place gets a copy
+ * of only the pages it writes.
+ */
+
+static void read_record( producer_mltraw self, mlt_frame frame, mlt_position position )
+{
+	size_t size = self->header.record_size;
+	off_t offset = self->header.header_size + (off_t) position * self->header.record_size;
+	void *data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, self->fd, offset );
+
+	if ( data != MAP_FAILED )
+	{
+		record_map *map = malloc( sizeof( record_map ) );
+
+		if ( !map || check_record( data, size ) )
+		{
+			munmap( data, size );
+			free( map );
+			return;
+		}
+		map->data = data;
+		map->size = size;
+		frame_record_read( frame, data, 0 );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "_mltraw_record", map, 0, (mlt_destructor) record_unmap, NULL );
+	}
+	else
+	{
+		// The page size is larger than the alignment of the records
+		uint8_t *record = malloc( size );
+
+		if ( record && pread( self->fd, record, size, offset ) == size && !check_record( record, size ) )
+			frame_record_read( frame, record, 1 );
+		free( record );
+	}
+}
+
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
+{
+	producer_mltraw self = producer->child;
+
+	*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+	if ( *frame )
+	{
+		mlt_position position = mlt_producer_frame( producer );
+
+		if ( position < 0 )
+			position = 0;
+		else if ( position >= self->header.count )
+			position = self->header.count - 1;
+		read_record( self, *frame, position );
+		if ( !mlt_properties_get_data( MLT_FRAME_PROPERTIES( *frame ), "image", NULL ) )
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_image", 1 );
+		if ( !mlt_properties_get_data( MLT_FRAME_PROPERTIES( *frame ), "audio", NULL ) )
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_audio", 1 );
+		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
+	}
+
+	mlt_producer_prepare_next( producer );
+
+	return 0;
+}
+
+static void producer_close( mlt_producer producer )
+{
+	producer_mltraw self = producer->child;
+
+	producer->close = NULL;
+	mlt_producer_close( producer );
+	close( self->fd );
+	free( self );
+}
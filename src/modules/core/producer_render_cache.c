@@ -0,0 +1,665 @@
+/*
+ * producer_render_cache.c -- render cache of a timeline in segments on disk
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <framework/mlt.h>
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The walk of a service tree stops at this depth
+#define MAX_DEPTH (64)
+
+/* The timeline is cut into segments of a fixed number of frames. Each segment
+ * is keyed by a hash of everything in the service tree that renders it: the
+ * properties of the producers, filters and transitions that overlap it, their
+ * in and out points and the files they read. A segment that is not on disk is
+ * rendered on a thread from an XML copy of the tree to an intra-coded file
+ * named by its hash, so an edit only misses the segments it touches.
+ */
+
+typedef struct render_cache_s *render_cache;
+
+struct render_cache_s
+{
+	mlt_producer producer;
+	char *directory;
+	uint64_t seed;
+	int disabled;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int thread_started;
+	int running;
+	volatile int cancel;
+	int busy;
+	char *job_xml;
+	uint64_t job_hash;
+	mlt_position job_start;
+	mlt_position job_end;
+	uint64_t failed_hash;
+
+	mlt_producer play;
+	uint64_t play_hash;
+
+	uint64_t tree_hash;
+	mlt_position last_start;
+	mlt_position last_end;
+	uint64_t last_hash;
+};
+
+// Forward references
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
+static void producer_close( mlt_producer producer );
+
+static uint64_t hash_bytes( uint64_t hash, const void *data, size_t size )
+{
+	const unsigned char *p = data;
+	while ( size-- )
+		hash = ( hash ^ *p++ ) * 1099511628211ULL;
+	return hash;
+}
+
+static uint64_t hash_int( uint64_t hash, int64_t value )
+{
+	return hash_bytes( hash, &value, sizeof( value ) );
+}
+
+static uint64_t hash_string( uint64_t hash, const char *value )
+{
+	return hash_bytes( hash, value, strlen( value ) + 1 );
+}
+
+/** Hash the properties that can change the rendering of a service.
+ *
+ * Private properties, metadata and the names the XML consumer sets while
+ * serialising are left out. Files are hashed by their size and modification
+ * time too, so a replaced file does not play the old rendering.
+ */
+
+static uint64_t hash_properties( uint64_t hash, mlt_properties properties )
+{
+	int i;
+	int count = mlt_properties_count( properties );
+
+	for ( i = 0; i < count; i++ )
+	{
+		const char *name = mlt_properties_get_name( properties, i );
+		const char *value = mlt_properties_get_value( properties, i );
+		struct stat st;
+
+		if ( !name || !value || name[0] == '_' || !strncmp( name, "meta.", 5 ) ||
+			 !strcmp( name, "mlt_type" ) || !strcmp( name, "title" ) || !strcmp( name, "root" ) )
+			continue;
+		hash = hash_string( hash_string( hash, name ), value );
+		if ( !strcmp( name, "resource" ) && !stat( value, &st ) && S_ISREG( st.st_mode ) )
+		{
+			hash = hash_int( hash, st.st_size );
+			hash = hash_int( hash, st.st_mtime );
+		}
+	}
+	return hash;
+}
+
+// Get the type of a service, also when producer_xml replaced the resource of a tractor with its file.
+static mlt_service_type service_type( mlt_service service )
+{
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
+	if ( mlt_properties_get( properties, "_original_type" ) )
+		return mlt_properties_get_int( properties, "_original_type" );
+	return mlt_service_identify( service );
+}
+
+// Check whether an in and out point, where an out of 0 is unbounded, overlap a range.
+static int overlaps( mlt_position in, mlt_position out, mlt_position start, mlt_position end )
+{
+	return in <= end && ( out <= 0 || out >= start );
+}
+
+/** Hash the part of a service tree that renders a range of its frames.
+ *
+ * \param in the first frame of \p service
+ * \param out the last frame of \p service
+ */
+
+static uint64_t hash_service( uint64_t hash, mlt_service service, mlt_position in, mlt_position out, int depth )
+{
+	mlt_service_type type = service_type( service );
+	mlt_filter filter;
+	int i;
+
+	if ( depth > MAX_DEPTH )
+		return hash;
+
+	hash = hash_int( hash, type );
+	hash = hash_int( hash, in );
+	hash = hash_int( hash, out );
+	hash = hash_properties( hash, MLT_SERVICE_PROPERTIES( service ) );
+
+	// Attached filters that do not cover the range do not change it
+	for ( i = 0; ( filter = mlt_service_filter( service, i ) ) != NULL; i++ )
+		if ( overlaps( mlt_filter_get_in( filter ), mlt_filter_get_out( filter ), in, out ) )
+			hash = hash_service( hash, MLT_FILTER_SERVICE( filter ), in, out, depth + 1 );
+
+	if ( type == producer_type || type == playlist_type || type == tractor_type || type == multitrack_type )
+	{
+		mlt_producer producer = MLT_PRODUCER( service );
+		if ( mlt_producer_is_cut( producer ) )
+			return hash_service( hash, MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( producer ) ), in, out, depth + 1 );
+	}
+
+	switch ( type )
+	{
+		case tractor_type:
+		{
+			mlt_multitrack multitrack = mlt_tractor_multitrack( MLT_TRACTOR( service ) );
+			mlt_service next = mlt_service_producer( service );
+
+			// Walk the transitions and filters planted in the field down to the multitrack
+			while ( next && service_type( next ) != multitrack_type )
+			{
+				mlt_service_type next_type = service_type( next );
+				if ( next_type == transition_type )
+				{
+					mlt_transition transition = MLT_TRANSITION( next );
+					if ( overlaps( mlt_transition_get_in( transition ), mlt_transition_get_out( transition ), in, out ) )
+						hash = hash_service( hash, next, in, out, depth + 1 );
+				}
+				else if ( next_type == filter_type )
+				{
+					filter = MLT_FILTER( next );
+					if ( overlaps( mlt_filter_get_in( filter ), mlt_filter_get_out( filter ), in, out ) )
+						hash = hash_service( hash, next, in, out, depth + 1 );
+				}
+				else
+				{
+					break;
+				}
+				next = mlt_service_producer( next );
+			}
+			if ( multitrack )
+				hash = hash_service( hash, MLT_MULTITRACK_SERVICE( multitrack ), in, out, depth + 1 );
+			break;
+		}
+		case multitrack_type:
+		{
+			mlt_multitrack multitrack = MLT_MULTITRACK( service );
+			for ( i = 0; i < mlt_multitrack_count( multitrack ); i++ )
+			{
+				mlt_producer track = mlt_multitrack_track( multitrack, i );
+				if ( track )
+					hash = hash_service( hash, MLT_PRODUCER_SERVICE( track ), in, out, depth + 1 );
+			}
+			break;
+		}
+		case playlist_type:
+		{
+			mlt_playlist playlist = MLT_PLAYLIST( service );
+			mlt_playlist_clip_info info;
+			for ( i = 0; i < mlt_playlist_count( playlist ); i++ )
+			{
+				if ( mlt_playlist_get_clip_info( playlist, &info, i ) || !info.cut )
+					continue;
+				if ( info.start > out )
+					break;
+				if ( info.start + info.frame_count <= in )
+					continue;
+
+				// Hash the frames of the entry that fall in the range
+				hash = hash_int( hash, info.start );
+				hash = hash_int( hash, info.repeat );
+				hash = hash_service( hash, MLT_PRODUCER_SERVICE( info.cut ),
+					info.frame_in + MAX( in - info.start, 0 ),
+					info.frame_in + MIN( out, info.start + info.frame_count - 1 ) - info.start, depth + 1 );
+			}
+			break;
+		}
+		default:
+			break;
+	}
+	return hash;
+}
+
+// Get the number of frames of a segment.
+static int segment_length( mlt_producer producer )
+{
+	return MAX( 1, mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( producer ), "segment" ) );
+}
+
+// Get the hash of the segment of the wrapped producer from start to end.
+static uint64_t segment_hash( render_cache self, mlt_position start, mlt_position end )
+{
+	mlt_position in = mlt_producer_get_in( self->producer );
+	uint64_t hash = hash_int( self->seed, end - start );
+	return hash_service( hash, MLT_PRODUCER_SERVICE( self->producer ), in + start, in + end, 0 );
+}
+
+// Get the name of the file of a segment for the caller to free.
+static char *segment_filename( render_cache self, uint64_t hash, const char *suffix )
+{
+	char *filename = malloc( strlen( self->directory ) + strlen( suffix ) + 20 );
+	if ( filename )
+		sprintf( filename, "%s/%016" PRIx64 "%s", self->directory, hash, suffix );
+	return filename;
+}
+
+static int segment_exists( render_cache self, uint64_t hash )
+{
+	char *filename = segment_filename( self, hash, ".mkv" );
+	struct stat st;
+	int exists = filename && !stat( filename, &st );
+	free( filename );
+	return exists;
+}
+
+/** Serialise the wrapped producer to XML for the caller to free.
+ *
+ * A timeline loaded from a file is written in full rather than as a reference
+ * to that file, so the copy has the edits made since it was loaded.
+ */
+
+static char *serialise( render_cache self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->producer );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self->producer ) );
+	mlt_consumer consumer = mlt_factory_consumer( profile, "xml", "string" );
+	char *resource = NULL;
+	char *xml = NULL;
+
+	if ( consumer )
+	{
+		if ( mlt_properties_get( properties, "_original_resource" ) && mlt_properties_get( properties, "xml" ) )
+		{
+			resource = strdup( mlt_properties_get( properties, "resource" ) );
+			mlt_properties_set( properties, "resource", mlt_properties_get( properties, "_original_resource" ) );
+			mlt_properties_set( properties, "xml", NULL );
+		}
+		mlt_properties_set_int( MLT_CONSUMER_PROPERTIES( consumer ), "no_meta", 1 );
+		mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( self->producer ) );
+		mlt_consumer_start( consumer );
+		xml = mlt_properties_get( MLT_CONSUMER_PROPERTIES( consumer ), "string" );
+		xml = xml ? strdup( xml ) : NULL;
+		mlt_consumer_close( consumer );
+		if ( resource )
+		{
+			mlt_properties_set( properties, "resource", resource );
+			mlt_properties_set( properties, "xml", "was here" );
+			free( resource );
+		}
+	}
+	return xml;
+}
+
+/** Render a segment of an XML copy of the wrapped producer to its file.
+ *
+ * The segment is written through consumer_avformat to a temporary file that
+ * is only renamed once it is complete.
+ * \return true on error or if cancelled
+ */
+
+static int render_segment( render_cache self, mlt_profile profile, const char *xml, uint64_t hash, mlt_position start, mlt_position end )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->producer );
+	char *filename = segment_filename( self, hash, ".mkv" );
+	char *temp = segment_filename( self, hash, ".part.mkv" );
+	mlt_producer copy = NULL;
+	mlt_producer cut = NULL;
+	mlt_consumer consumer = NULL;
+	int error = 1;
+
+	if ( !profile || !filename || !temp )
+		goto exit;
+
+	copy = mlt_factory_producer( profile, "xml-string", (char*) xml );
+	if ( copy )
+		cut = mlt_producer_cut( copy, mlt_producer_get_in( copy ) + start, mlt_producer_get_in( copy ) + end );
+	consumer = mlt_factory_consumer( profile, "avformat", temp );
+	if ( !consumer )
+		self->disabled = 1;
+	if ( !cut || !consumer )
+		goto exit;
+
+	mlt_properties consumer_properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_properties_set( consumer_properties, "f", "matroska" );
+	mlt_properties_set( consumer_properties, "vcodec", "mjpeg" );
+	mlt_properties_set( consumer_properties, "pix_fmt", "yuvj422p" );
+	mlt_properties_set_int( consumer_properties, "qscale", mlt_properties_get_int( properties, "qscale" ) );
+	mlt_properties_set( consumer_properties, "acodec", "pcm_s16le" );
+	mlt_properties_set_int( consumer_properties, "frequency", mlt_properties_get_int( properties, "frequency" ) );
+	mlt_properties_set_int( consumer_properties, "channels", mlt_properties_get_int( properties, "channels" ) );
+	mlt_properties_set_int( consumer_properties, "real_time", -1 );
+	mlt_properties_set_int( consumer_properties, "terminate_on_pause", 1 );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( cut ) );
+
+	mlt_log_verbose( MLT_PRODUCER_SERVICE( self->producer ), "rendering %d-%d to %s\n", start, end, filename );
+	if ( !mlt_consumer_start( consumer ) )
+	{
+		while ( !mlt_consumer_is_stopped( consumer ) && !self->cancel )
+			usleep( 20000 );
+		mlt_consumer_stop( consumer );
+		error = self->cancel != 0;
+	}
+	mlt_consumer_close( consumer );
+	consumer = NULL;
+
+	if ( !error )
+		error = rename( temp, filename );
+	if ( error )
+		remove( temp );
+
+exit:
+	mlt_consumer_close( consumer );
+	mlt_producer_close( cut );
+	mlt_producer_close( copy );
+	free( filename );
+	free( temp );
+	return error;
+}
+
+static void *render_thread( void *arg )
+{
+	render_cache self = arg;
+
+	pthread_mutex_lock( &self->mutex );
+	while ( self->running )
+	{
+		if ( !self->job_xml )
+		{
+			pthread_cond_wait( &self->cond, &self->mutex );
+			continue;
+		}
+		char *xml = self->job_xml;
+		uint64_t hash = self->job_hash;
+		mlt_position start = self->job_start;
+		mlt_position end = self->job_end;
+		// Taken with the job, so that a change of profile cannot come in between
+		mlt_profile profile = mlt_profile_clone( mlt_service_profile( MLT_PRODUCER_SERVICE( self->producer ) ) );
+		self->job_xml = NULL;
+		pthread_mutex_unlock( &self->mutex );
+
+		int error = render_segment( self, profile, xml, hash, start, end );
+		mlt_profile_close( profile );
+		free( xml );
+
+		pthread_mutex_lock( &self->mutex );
+		if ( error )
+			self->failed_hash = hash;
+		self->busy = 0;
+	}
+	pthread_mutex_unlock( &self->mutex );
+	return NULL;
+}
+
+/** Render the first missing segment from the current one onwards.
+ *
+ * Only one segment is rendered at a time, at most \em ahead segments after
+ * the one that is playing.
+ */
+
+static void schedule( render_cache self, mlt_position start, uint64_t hash )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->producer );
+	int length = segment_length( self->producer );
+	int ahead = mlt_properties_get_int( properties, "ahead" );
+	mlt_position playtime = mlt_producer_get_playtime( self->producer );
+	int i;
+
+	pthread_mutex_lock( &self->mutex );
+	int busy = self->busy;
+	uint64_t failed_hash = self->failed_hash;
+	pthread_mutex_unlock( &self->mutex );
+	if ( busy || self->disabled )
+		return;
+
+	for ( i = 0; i <= ahead && start < playtime; i++, start += length )
+	{
+		mlt_position end = MIN( start + length, playtime ) - 1;
+		if ( i > 0 )
+			hash = segment_hash( self, start, end );
+		if ( hash == failed_hash || ( hash == self->play_hash && self->play ) || segment_exists( self, hash ) )
+			continue;
+
+		char *xml = serialise( self );
+		if ( !xml )
+		{
+			self->disabled = 1;
+			return;
+		}
+		pthread_mutex_lock( &self->mutex );
+		if ( !self->thread_started )
+		{
+			self->running = 1;
+			self->thread_started = !pthread_create( &self->thread, NULL, render_thread, self );
+		}
+		if ( self->thread_started )
+		{
+			self->job_xml = xml;
+			self->job_hash = hash;
+			self->job_start = start;
+			self->job_end = end;
+			self->busy = 1;
+			pthread_cond_signal( &self->cond );
+		}
+		else
+		{
+			free( xml );
+			self->disabled = 1;
+		}
+		pthread_mutex_unlock( &self->mutex );
+		break;
+	}
+}
+
+// Open the file of a segment for playback if it has been rendered.
+static void open_segment( render_cache self, mlt_profile profile, uint64_t hash )
+{
+	char *filename;
+
+	if ( self->play && hash == self->play_hash )
+		return;
+	mlt_producer_close( self->play );
+	self->play = NULL;
+	self->play_hash = 0;
+	if ( segment_exists( self, hash ) && ( filename = segment_filename( self, hash, ".mkv" ) ) )
+	{
+		self->play = mlt_factory_producer( profile, "avformat", filename );
+		if ( self->play )
+			self->play_hash = hash;
+		free( filename );
+	}
+}
+
+// Renderings of another profile or format are stored under other keys.
+static uint64_t profile_seed( mlt_profile profile )
+{
+	uint64_t seed = 14695981039346656037ULL;
+
+	seed = hash_string( seed, "render_cache 1" );
+	seed = hash_int( seed, profile->width );
+	seed = hash_int( seed, profile->height );
+	seed = hash_int( seed, profile->frame_rate_num );
+	seed = hash_int( seed, profile->frame_rate_den );
+	seed = hash_int( seed, profile->sample_aspect_num );
+	seed = hash_int( seed, profile->sample_aspect_den );
+	seed = hash_int( seed, profile->progressive );
+	seed = hash_int( seed, profile->colorspace );
+	return seed;
+}
+
+// Switch to the segments of the new profile, keeping the wrapped producer.
+static void on_profile_changed( mlt_properties owner, mlt_producer producer )
+{
+	render_cache self = producer->child;
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
+
+	pthread_mutex_lock( &self->mutex );
+	self->seed = profile_seed( profile );
+	if ( self->job_xml )
+	{
+		// The job that is waiting was keyed by the old profile
+		free( self->job_xml );
+		self->job_xml = NULL;
+		self->busy = 0;
+	}
+	self->failed_hash = 0;
+	pthread_mutex_unlock( &self->mutex );
+
+	// The next frame opens the segment of the new profile
+	self->last_hash = 0;
+	mlt_service_profile_changed( MLT_PRODUCER_SERVICE( self->producer ) );
+}
+
+/** Constructor for the render cache producer.
+ *
+ * \param arg a producer specification for the loader, typically an XML file or xml-string:
+ */
+
+mlt_producer producer_render_cache_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_producer producer = mlt_producer_new( profile );
+	mlt_producer wrapped = arg ? mlt_factory_producer( profile, NULL, arg ) : NULL;
+	render_cache self = calloc( 1, sizeof( struct render_cache_s ) );
+
+	if ( producer && wrapped && self )
+	{
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+		mlt_position playtime = mlt_producer_get_playtime( wrapped );
+
+		self->producer = wrapped;
+		self->directory = mlt_cache_directory( "MLT_RENDER_CACHE_DIR", "render", 1 );
+		pthread_mutex_init( &self->mutex, NULL );
+		pthread_cond_init( &self->cond, NULL );
+
+		self->seed = profile_seed( profile );
+
+		mlt_properties_set_data( properties, "producer", wrapped, 0, ( mlt_destructor )mlt_producer_close, NULL );
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set_int( properties, "segment", MAX( 1, lrint( 2 * mlt_profile_fps( profile ) ) ) );
+		mlt_properties_set_int( properties, "ahead", 2 );
+		mlt_properties_set_int( properties, "qscale", 2 );
+		mlt_properties_set_int( properties, "frequency", 48000 );
+		mlt_properties_set_int( properties, "channels", 2 );
+		mlt_properties_set_position( properties, "length", playtime );
+		mlt_properties_set_position( properties, "out", playtime - 1 );
+
+		producer->child = self;
+		producer->get_frame = producer_get_frame;
+		producer->close = ( mlt_destructor )producer_close;
+		mlt_events_listen( properties, producer, "profile-changed", ( mlt_listener )on_profile_changed );
+		if ( !self->directory )
+			self->disabled = 1;
+	}
+	else
+	{
+		mlt_producer_close( producer );
+		mlt_producer_close( wrapped );
+		free( self );
+		producer = NULL;
+	}
+	return producer;
+}
+
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
+{
+	render_cache self = producer->child;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
+	mlt_position position = mlt_producer_frame( producer );
+	mlt_position playtime = mlt_producer_get_playtime( self->producer );
+	int length = segment_length( producer );
+	int error = 1;
+
+	// Follow edits that change the length of the wrapped producer
+	if ( mlt_properties_get_position( properties, "length" ) != playtime )
+	{
+		mlt_properties_set_position( properties, "length", playtime );
+		mlt_properties_set_position( properties, "out", playtime - 1 );
+	}
+
+	if ( !self->disabled && position >= 0 && position < playtime )
+	{
+		mlt_position start = position - position % length;
+		mlt_position end = MIN( start + length, playtime ) - 1;
+		uint64_t tree_hash = mlt_service_hash( MLT_PRODUCER_SERVICE( self->producer ) );
+		uint64_t hash = self->last_hash;
+
+		// Walk the tree again only when the segment or anything in the tree changed
+		if ( tree_hash != self->tree_hash || start != self->last_start || end != self->last_end || !hash )
+		{
+			hash = segment_hash( self, start, end );
+			self->tree_hash = tree_hash;
+			self->last_start = start;
+			self->last_end = end;
+			self->last_hash = hash;
+		}
+
+		open_segment( self, profile, hash );
+		if ( self->play )
+		{
+			mlt_producer_seek( self->play, position - start );
+			error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( self->play ), frame, index );
+		}
+		schedule( self, start, hash );
+	}
+
+	if ( error )
+	{
+		mlt_producer_seek( self->producer, position );
+		error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( self->producer ), frame, index );
+	}
+	if ( !error )
+	{
+		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "render_cache.hit", self->play != NULL );
+	}
+
+	mlt_producer_prepare_next( producer );
+
+	return error;
+}
+
+static void producer_close( mlt_producer producer )
+{
+	render_cache self = producer->child;
+
+	pthread_mutex_lock( &self->mutex );
+	self->running = 0;
+	self->cancel = 1;
+	pthread_cond_signal( &self->cond );
+	pthread_mutex_unlock( &self->mutex );
+	if ( self->thread_started )
+		pthread_join( self->thread, NULL );
+	free( self->job_xml );
+
+	mlt_producer_close( self->play );
+	pthread_mutex_destroy( &self->mutex );
+	pthread_cond_destroy( &self->cond );
+	free( self->directory );
+	free( self );
+
+	producer->close = NULL;
+	mlt_producer_close( producer );
+	free( producer );
+}
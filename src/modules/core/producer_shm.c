@@ -0,0 +1,183 @@
+/*
+ * producer_shm.c -- receive frames from another process in shared memory
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "frame_record.h"
+#include "shm_ring.h"
+
+#include <framework/mlt.h>
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct producer_shm_s *producer_shm;
+
+struct producer_shm_s
+{
+	struct mlt_producer_s parent;
+	shm_ring ring;
+	pthread_mutex_t mutex;
+	int ended;
+};
+
+// A slot held by a frame until the frame is closed.
+typedef struct
+{
+	shm_ring ring;
+	int index;
+}
+slot_ref;
+
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
+static void producer_close( mlt_producer producer );
+
+/** Initialise the shared memory producer.
+*/
+
+mlt_producer producer_shm_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	producer_shm self = calloc( 1, sizeof( struct producer_shm_s ) );
+
+	if ( self && mlt_producer_init( &self->parent, self ) == 0 )
+	{
+		mlt_producer producer = &self->parent;
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+
+		pthread_mutex_init( &self->mutex, NULL );
+		mlt_properties_set( properties, "resource", arg ? arg : "mlt" );
+		mlt_properties_set_int( properties, "timeout", 5 );
+		mlt_properties_set_int( properties, "length", INT_MAX );
+		mlt_properties_set_int( properties, "out", INT_MAX - 1 );
+		mlt_properties_set( properties, "eof", "loop" );
+		mlt_properties_set_int( properties, "seekable", 0 );
+
+		producer->get_frame = producer_get_frame;
+		producer->close = ( mlt_destructor )producer_close;
+		return producer;
+	}
+	free( self );
+	return NULL;
+}
+
+static void slot_release( slot_ref *ref )
+{
+	shm_ring_release( ref->ring, ref->index );
+	shm_ring_close( ref->ring );
+	free( ref );
+}
+
+/** Make a frame of a slot.
+ *
+ * The frame uses the data in place and releases the slot when it is closed,
+ * unless the reader holds so much of the ring that the writer could starve.
+ */
+
+static void read_frame( producer_shm self, mlt_frame frame, int index, int held )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int copy = held > shm_ring_slots( self->ring ) / 2;
+
+	frame_record_read( frame, shm_ring_slot( self->ring, index ), copy );
+
+	if ( copy )
+	{
+		shm_ring_release( self->ring, index );
+	}
+	else
+	{
+		slot_ref *ref = malloc( sizeof( slot_ref ) );
+		ref->ring = self->ring;
+		ref->index = index;
+		shm_ring_ref( self->ring );
+		mlt_properties_set_data( properties, "_shm_slot", ref, 0, (mlt_destructor) slot_release, NULL );
+	}
+}
+
+static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
+{
+	producer_shm self = producer->child;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	int timeout = mlt_properties_get_int( properties, "timeout" ) * 1000;
+	int waited = 0;
+	int slot = 0, held = 0;
+	int error = 1;
+
+	*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+	if ( *frame )
+	{
+		pthread_mutex_lock( &self->mutex );
+		while ( error && waited < timeout )
+		{
+			// Attach to the writer, or to a new one after the stream ended
+			if ( !self->ring )
+				self->ring = shm_ring_open( mlt_properties_get( properties, "resource" ) );
+			if ( self->ring )
+			{
+				error = shm_ring_acquire_read( self->ring, 100, &slot, &held );
+				if ( error < 0 )
+				{
+					if ( !self->ended )
+						mlt_log_info( MLT_PRODUCER_SERVICE( producer ), "the writer of %s stopped\n",
+							mlt_properties_get( properties, "resource" ) );
+					self->ended = 1;
+					shm_ring_close( self->ring );
+					self->ring = NULL;
+				}
+				else if ( !error )
+				{
+					self->ended = 0;
+				}
+			}
+			if ( error )
+			{
+				// Do not keep waiting on every frame once the stream has ended
+				if ( self->ended && !self->ring )
+					break;
+				if ( !self->ring )
+					usleep( 100000 );
+				waited += 100;
+			}
+		}
+		if ( !error )
+			read_frame( self, *frame, slot, held );
+		pthread_mutex_unlock( &self->mutex );
+
+		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
+		if ( error )
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_image", 1 );
+	}
+
+	mlt_producer_prepare_next( producer );
+
+	return 0;
+}
+
+static void producer_close( mlt_producer producer )
+{
+	producer_shm self = producer->child;
+
+	producer->close = NULL;
+	mlt_producer_close( producer );
+	shm_ring_close( self->ring );
+	pthread_mutex_destroy( &self->mutex );
+	free( self );
+}
@@ -0,0 +1,405 @@
+/*
+ * shm_ring.c -- a ring of frames in shared memory between processes
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* One process writes frames into the slots of the ring and another reads
+ * them. A slot is free, filled by the writer, or held by the reader until the
+ * frame made from it is closed, so the reader can use the data in place.
+ * The ring is guarded by a process shared robust mutex with two conditions,
+ * which are futexes on Linux, and either side notices when the other one has
+ * died: a writer frees the slots of a dead reader so that a new reader can
+ * attach, and a reader sees the end of the stream once the slots of a dead
+ * writer are read.
+ */
+
+#include "shm_ring.h"
+
+#include <framework/mlt_log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SHM_RING_MAGIC (0x4d4c5452)
+#define SHM_RING_VERSION (1)
+#define SHM_RING_ALIGN (4096)
+
+enum { slot_free, slot_filled, slot_held };
+
+typedef struct
+{
+	volatile uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint64_t slot_size;
+	uint64_t size;
+	pthread_mutex_t mutex;
+	pthread_cond_t readable;
+	pthread_cond_t writable;
+	uint64_t write_count;
+	uint64_t read_count;
+	int32_t writer_pid;
+	int32_t reader_pid;
+	int32_t eof;
+	int32_t state[ SHM_RING_MAX_SLOTS ];
+}
+shm_ring_header;
+
+struct shm_ring_s
+{
+	char *name;
+	shm_ring_header *header;
+	size_t size;
+	int writer;
+	int ref_count;
+	pthread_mutex_t ref_mutex;
+};
+
+static size_t header_size( )
+{
+	return ( sizeof( shm_ring_header ) + SHM_RING_ALIGN - 1 ) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+}
+
+static char *object_name( const char *name )
+{
+	char *result = malloc( strlen( name ) + 2 );
+	if ( result )
+		sprintf( result, "%s%s", name[0] == '/' ? "" : "/", name );
+	return result;
+}
+
+static int process_alive( int32_t pid )
+{
+	return pid == 0 || kill( pid, 0 ) == 0 || errno != ESRCH;
+}
+
+static void ring_lock( shm_ring_header *header )
+{
+	// Take over the state of a process that died holding the lock
+	if ( pthread_mutex_lock( &header->mutex ) == EOWNERDEAD )
+		pthread_mutex_consistent( &header->mutex );
+}
+
+static void ring_wait( shm_ring_header *header, pthread_cond_t *cond, int milliseconds )
+{
+	struct timeval now;
+	struct timespec until;
+
+	gettimeofday( &now, NULL );
+	until.tv_sec = now.tv_sec + milliseconds / 1000;
+	until.tv_nsec = ( now.tv_usec + ( milliseconds % 1000 ) * 1000 ) * 1000;
+	if ( until.tv_nsec >= 1000000000 )
+	{
+		until.tv_sec ++;
+		until.tv_nsec -= 1000000000;
+	}
+	if ( pthread_cond_timedwait( cond, &header->mutex, &until ) == EOWNERDEAD )
+		pthread_mutex_consistent( &header->mutex );
+}
+
+static shm_ring ring_new( const char *name, shm_ring_header *header, size_t size, int writer )
+{
+	shm_ring self = calloc( 1, sizeof( struct shm_ring_s ) );
+	if ( self )
+	{
+		self->name = object_name( name );
+		self->header = header;
+		self->size = size;
+		self->writer = writer;
+		self->ref_count = 1;
+		pthread_mutex_init( &self->ref_mutex, NULL );
+	}
+	return self;
+}
+
+/** Create a ring for writing, replacing a stale one of the same name.
+ *
+ * \param name the name of the shared memory object
+ * \param slots the number of frames in the ring
+ * \param slot_size the size of a frame with its header
+ * \return a ring or NULL on error
+ */
+
+shm_ring shm_ring_create( const char *name, int slots, size_t slot_size )
+{
+	char *object = object_name( name );
+	shm_ring_header *header = NULL;
+	shm_ring self = NULL;
+	size_t size;
+	int fd = -1;
+
+	if ( !object || slots < 2 || slots > SHM_RING_MAX_SLOTS )
+	{
+		free( object );
+		return NULL;
+	}
+	slot_size = ( slot_size + SHM_RING_ALIGN - 1 ) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+	size = header_size( ) + slots * slot_size;
+
+	shm_unlink( object );
+	fd = shm_open( object, O_CREAT | O_EXCL | O_RDWR, 0600 );
+	if ( fd >= 0 && ftruncate( fd, size ) == 0 )
+		header = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( fd >= 0 )
+		close( fd );
+	if ( header && header != MAP_FAILED )
+	{
+		pthread_mutexattr_t mutex_attr;
+		pthread_condattr_t cond_attr;
+
+		pthread_mutexattr_init( &mutex_attr );
+		pthread_mutexattr_setpshared( &mutex_attr, PTHREAD_PROCESS_SHARED );
+		pthread_mutexattr_setrobust( &mutex_attr, PTHREAD_MUTEX_ROBUST );
+		pthread_mutex_init( &header->mutex, &mutex_attr );
+		pthread_mutexattr_destroy( &mutex_attr );
+		pthread_condattr_init( &cond_attr );
+		pthread_condattr_setpshared( &cond_attr, PTHREAD_PROCESS_SHARED );
+		pthread_cond_init( &header->readable, &cond_attr );
+		pthread_cond_init( &header->writable, &cond_attr );
+		pthread_condattr_destroy( &cond_attr );
+		header->version = SHM_RING_VERSION;
+		header->slots = slots;
+		header->slot_size = slot_size;
+		header->size = size;
+		header->writer_pid = getpid( );
+
+		// A reader only uses the ring once it is complete
+		__sync_synchronize( );
+		header->magic = SHM_RING_MAGIC;
+		self = ring_new( name, header, size, 1 );
+	}
+	else
+	{
+		mlt_log_error( NULL, "[shm] cannot create %s: %s\n", object, strerror( errno ) );
+		shm_unlink( object );
+	}
+	free( object );
+	return self;
+}
+
+/** Open the ring of a writer for reading.
+ *
+ * \param name the name of the shared memory object
+ * \return a ring or NULL when there is no complete ring of this name yet
+ */
+
+shm_ring shm_ring_open( const char *name )
+{
+	char *object = object_name( name );
+	shm_ring_header *header = MAP_FAILED;
+	shm_ring self = NULL;
+	struct stat st;
+	int fd = object ? shm_open( object, O_RDWR, 0 ) : -1;
+
+	if ( fd >= 0 && fstat( fd, &st ) == 0 && st.st_size >= header_size( ) )
+		header = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( fd >= 0 )
+		close( fd );
+	free( object );
+	if ( header == MAP_FAILED )
+		return NULL;
+	if ( header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION || header->size != st.st_size )
+	{
+		munmap( header, st.st_size );
+		return NULL;
+	}
+	__sync_synchronize( );
+
+	// Take the place of a previous reader, freeing what it held
+	ring_lock( header );
+	if ( !process_alive( header->reader_pid ) || header->reader_pid == 0 )
+	{
+		int i;
+		for ( i = 0; i < header->slots; i++ )
+			if ( header->state[ i ] == slot_held )
+				header->state[ i ] = slot_free;
+	}
+	header->reader_pid = getpid( );
+	pthread_cond_broadcast( &header->writable );
+	pthread_mutex_unlock( &header->mutex );
+
+	self = ring_new( name, header, st.st_size, 0 );
+	if ( !self )
+		munmap( header, st.st_size );
+	return self;
+}
+
+void shm_ring_ref( shm_ring self )
+{
+	pthread_mutex_lock( &self->ref_mutex );
+	self->ref_count ++;
+	pthread_mutex_unlock( &self->ref_mutex );
+}
+
+/** Release a reference on a ring, unmapping it with the last one.
+ *
+ * The writer also removes the name of the ring.
+ */
+
+void shm_ring_close( shm_ring self )
+{
+	int ref_count;
+
+	if ( !self )
+		return;
+	pthread_mutex_lock( &self->ref_mutex );
+	ref_count = -- self->ref_count;
+	pthread_mutex_unlock( &self->ref_mutex );
+	if ( ref_count > 0 )
+		return;
+
+	ring_lock( self->header );
+	if ( self->writer )
+	{
+		self->header->eof = 1;
+		self->header->writer_pid = 0;
+	}
+	else if ( self->header->reader_pid == getpid( ) )
+	{
+		self->header->reader_pid = 0;
+	}
+	pthread_cond_broadcast( &self->header->readable );
+	pthread_cond_broadcast( &self->header->writable );
+	pthread_mutex_unlock( &self->header->mutex );
+
+	if ( self->writer && self->name )
+		shm_unlink( self->name );
+	munmap( self->header, self->size );
+	pthread_mutex_destroy( &self->ref_mutex );
+	free( self->name );
+	free( self );
+}
+
+int shm_ring_slots( shm_ring self )
+{
+	return self->header->slots;
+}
+
+size_t shm_ring_slot_size( shm_ring self )
+{
+	return self->header->slot_size;
+}
+
+uint8_t *shm_ring_slot( shm_ring self, int index )
+{
+	return (uint8_t*) self->header + header_size( ) + index * self->header->slot_size;
+}
+
+/** Wait for the next slot to write.
+ *
+ * \param timeout the number of milliseconds to wait
+ * \param[out] index the slot to fill and commit
+ * \return zero when there is a slot, non-zero on timeout
+ */
+
+int shm_ring_acquire_write( shm_ring self, int timeout, int *index )
+{
+	shm_ring_header *header = self->header;
+	int error = 1;
+
+	ring_lock( header );
+	*index = header->write_count % header->slots;
+	if ( header->state[ *index ] != slot_free && !process_alive( header->reader_pid ) )
+	{
+		// The reader died, so nobody will release the slots it held
+		int i;
+		for ( i = 0; i < header->slots; i++ )
+			if ( header->state[ i ] == slot_held )
+				header->state[ i ] = slot_free;
+		header->reader_pid = 0;
+	}
+	if ( header->state[ *index ] != slot_free && timeout > 0 )
+		ring_wait( header, &header->writable, timeout );
+	error = header->state[ *index ] != slot_free;
+	pthread_mutex_unlock( &header->mutex );
+	return error;
+}
+
+void shm_ring_commit( shm_ring self, int index )
+{
+	shm_ring_header *header = self->header;
+
+	ring_lock( header );
+	header->state[ index ] = slot_filled;
+	header->write_count ++;
+	pthread_cond_signal( &header->readable );
+	pthread_mutex_unlock( &header->mutex );
+}
+
+/** Wait for the next filled slot and hold it.
+ *
+ * \param timeout the number of milliseconds to wait
+ * \param[out] index the slot to read and release
+ * \param[out] held the number of slots the reader holds, including this one
+ * \return zero when there is a slot, 1 on timeout and -1 at the end of the stream
+ */
+
+int shm_ring_acquire_read( shm_ring self, int timeout, int *index, int *held )
+{
+	shm_ring_header *header = self->header;
+	int error = 0;
+	int i;
+
+	ring_lock( header );
+	*index = header->read_count % header->slots;
+	if ( header->state[ *index ] != slot_filled && !header->eof && timeout > 0 )
+		ring_wait( header, &header->readable, timeout );
+	if ( header->state[ *index ] == slot_filled )
+	{
+		header->state[ *index ] = slot_held;
+		header->read_count ++;
+		for ( *held = 0, i = 0; i < header->slots; i++ )
+			*held += header->state[ i ] == slot_held;
+	}
+	else
+	{
+		error = header->eof || !process_alive( header->writer_pid ) ? -1 : 1;
+	}
+	pthread_mutex_unlock( &header->mutex );
+	return error;
+}
+
+void shm_ring_release( shm_ring self, int index )
+{
+	shm_ring_header *header = self->header;
+
+	ring_lock( header );
+	if ( header->state[ index ] == slot_held )
+		header->state[ index ] = slot_free;
+	pthread_cond_signal( &header->writable );
+	pthread_mutex_unlock( &header->mutex );
+}
+
+/** Tell the reader that no more frames follow those in the ring.
+ */
+
+void shm_ring_set_eof( shm_ring self )
+{
+	ring_lock( self->header );
+	self->header->eof = 1;
+	pthread_cond_broadcast( &self->header->readable );
+	pthread_mutex_unlock( &self->header->mutex );
+}
@@ -0,0 +1,43 @@
+/*
+ * shm_ring.h -- a ring of frames in shared memory between processes
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SHM_RING_H_
+#define _SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_RING_MAX_SLOTS (64)
+
+typedef struct shm_ring_s *shm_ring;
+
+extern shm_ring shm_ring_create( const char *name, int slots, size_t slot_size );
+extern shm_ring shm_ring_open( const char *name );
+extern void shm_ring_ref( shm_ring self );
+extern void shm_ring_close( shm_ring self );
+extern int shm_ring_slots( shm_ring self );
+extern size_t shm_ring_slot_size( shm_ring self );
+extern uint8_t *shm_ring_slot( shm_ring self, int index );
+extern int shm_ring_acquire_write( shm_ring self, int timeout, int *index );
+extern void shm_ring_commit( shm_ring self, int index );
+extern int shm_ring_acquire_read( shm_ring self, int timeout, int *index, int *held );
+extern void shm_ring_release( shm_ring self, int index );
+extern void shm_ring_set_eof( shm_ring self );
+
+#endif
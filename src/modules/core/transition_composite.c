@@ -18,10 +18,13 @@
  */
 
 #include "transition_composite.h"
+#include "luma_generator.h"
+#include "composite_line_simd.h"
 #include <framework/mlt.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <ctype.h>
 #include <string.h>
 #include <math.h>
@@ -338,106 +341,157 @@ static void luma_read_yuv422( uint8_t *image, uint16_t **map, int width, int hei
 		*p++ = ( image[ i ] - 16 ) * 299; // 299 = 65535 / 219
 }
 
-static inline int calculate_mix( uint16_t *luma, int j, int softness, int weight, int alpha, uint32_t step )
-{
-	return ( ( luma ? smoothstep( luma[ j ], luma[ j ] + softness, step ) : weight ) * ( alpha + 1 ) ) >> 8;
-}
-
 static inline uint8_t sample_mix( uint8_t dest, uint8_t src, int mix )
 {
 	return ( src * mix + dest * ( ( 1 << 16 ) - mix ) ) >> 16;
 }
 
-/** Composite a source line over a destination line
-*/
 #if defined(USE_SSE) && defined(ARCH_X86_64)
 void composite_line_yuv_sse2_simple(uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight);
 #endif
 
-void composite_line_yuv( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
+/** Composite a source line over a destination line with an alpha operator.
+ *
+ * This is the template of the line functions, each an instance of it for
+ * an operator and a variant of composite_line_simd.h, whose tests of the
+ * inputs are resolved when it is inlined.
+ */
+
+static inline __attribute__((always_inline)) void composite_line_template( uint8_t *dest, uint8_t *src, int width,
+	uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step, const int op, const int variant )
 {
-	register int j = 0;
-	register int mix;
+	const struct composite_line_kernels *kernels = composite_line_simd_kernels();
+	int j = 0;
 
 #if defined(USE_SSE) && defined(ARCH_X86_64)
-	if ( !luma && width > 7 )
+	if ( op == composite_op_over && !( variant & COMPOSITE_LINE_LUMA ) && width > 7 )
 	{
-		composite_line_yuv_sse2_simple(dest, src, width, alpha_b, alpha_a, weight);
+		composite_line_yuv_sse2_simple( dest, src, width, alpha_b, alpha_a, weight );
 		j = width - width % 8;
-		dest += j * 2;
-		src += j * 2;
-		if ( alpha_a )
-			alpha_a += j;
-		if ( alpha_b )
-			alpha_b += j;
 	}
+	else
 #endif
+	if ( kernels )
+		j = kernels->line[ op ][ variant ]( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step );
+	dest += j * 2;
+	src += j * 2;
+	if ( variant & COMPOSITE_LINE_ALPHA_B )
+		alpha_b += j;
+	if ( variant & COMPOSITE_LINE_ALPHA_A )
+		alpha_a += j;
 
 	for ( ; j < width; j ++ )
 	{
-		mix = calculate_mix( luma, j, soft, weight, alpha_b? *alpha_b : 255, step );
+		int b = ( variant & COMPOSITE_LINE_ALPHA_B ) ? *alpha_b++ : 255;
+		int a = ( variant & COMPOSITE_LINE_ALPHA_A ) ? *alpha_a : 255;
+		int alpha = op == composite_op_or ? ( b | a ) : op == composite_op_and ? ( b & a ) :
+			op == composite_op_xor ? ( b ^ a ) : b;
+		int mix = ( ( ( variant & COMPOSITE_LINE_LUMA ) ? smoothstep( luma[ j ], luma[ j ] + soft, step ) : weight )
+			* ( alpha + 1 ) ) >> 8;
+
 		*dest = sample_mix( *dest, *src++, mix );
 		dest++;
 		*dest = sample_mix( *dest, *src++, mix );
 		dest++;
-		if ( alpha_a )
+		if ( variant & COMPOSITE_LINE_ALPHA_A )
 		{
-			*alpha_a = ( mix >> 8 ) | *alpha_a;
+			*alpha_a = op == composite_op_over ? ( mix >> 8 ) | a : mix >> 8;
 			alpha_a ++;
 		}
-		if ( alpha_b ) alpha_b ++;
 	}
 }
 
-static void composite_line_yuv_or( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
+#define COMPOSITE_LINE( op, variant ) \
+static void composite_line_##op##_##variant( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, \
+	int weight, uint16_t *luma, int soft, uint32_t step ) \
+{ \
+	composite_line_template( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step, composite_op_##op, variant ); \
+}
+
+#define COMPOSITE_LINES( op ) \
+	COMPOSITE_LINE( op, 0 ) COMPOSITE_LINE( op, 1 ) COMPOSITE_LINE( op, 2 ) COMPOSITE_LINE( op, 3 ) \
+	COMPOSITE_LINE( op, 4 ) COMPOSITE_LINE( op, 5 ) COMPOSITE_LINE( op, 6 ) COMPOSITE_LINE( op, 7 )
+
+#define COMPOSITE_VARIANTS( op ) \
+	{ composite_line_##op##_0, composite_line_##op##_1, composite_line_##op##_2, composite_line_##op##_3, \
+	  composite_line_##op##_4, composite_line_##op##_5, composite_line_##op##_6, composite_line_##op##_7 }
+
+COMPOSITE_LINES( over )
+COMPOSITE_LINES( or )
+COMPOSITE_LINES( and )
+COMPOSITE_LINES( xor )
+
+static const composite_line_fn composite_lines[ composite_op_count ][ COMPOSITE_LINE_VARIANTS ] =
 {
-	register int j;
-	register int mix;
+	COMPOSITE_VARIANTS( over ),
+	COMPOSITE_VARIANTS( or ),
+	COMPOSITE_VARIANTS( and ),
+	COMPOSITE_VARIANTS( xor )
+};
 
-	for ( j = 0; j < width; j ++ )
-	{
-		mix = calculate_mix( luma, j, soft, weight, (alpha_b? *alpha_b : 255) | (alpha_a? *alpha_a : 255), step );
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		if (alpha_a) *alpha_a ++ = mix >> 8;
-		if (alpha_b) alpha_b++;
-	}
+/** Composite a source line over a destination line
+*/
+
+void composite_line_yuv( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
+{
+	composite_lines[ composite_op_over ][ composite_line_variant( luma, alpha_b, alpha_a ) ]
+		( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step );
 }
 
-static void composite_line_yuv_and( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step  )
+/** Fill a destination line with a source line of a single opaque colour
+*/
+
+static void composite_line_yuv_fill( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
 {
-	register int j;
-	register int mix;
+	int size = width * 2;
+	int done = size < 4 ? size : 4;
 
-	for ( j = 0; j < width; j ++ )
+	// Copy the first pair of pixels and then double what is filled
+	memcpy( dest, src, done );
+	while ( done < size )
 	{
-		mix = calculate_mix( luma, j, soft, weight, (alpha_b? *alpha_b : 255) & (alpha_a? *alpha_a : 255), step );
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		if (alpha_a) *alpha_a ++ = mix >> 8;
-		if (alpha_b) alpha_b++;
+		int n = done < size - done ? done : size - done;
+		memcpy( dest + done, dest, n );
+		done += n;
 	}
+	if ( alpha_a )
+		memset( alpha_a, 0xff, width );
+}
+
+static void composite_line_yuv_or( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
+{
+	composite_lines[ composite_op_or ][ composite_line_variant( luma, alpha_b, alpha_a ) ]
+		( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step );
+}
+
+static void composite_line_yuv_and( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step  )
+{
+	composite_lines[ composite_op_and ][ composite_line_variant( luma, alpha_b, alpha_a ) ]
+		( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step );
 }
 
 static void composite_line_yuv_xor( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, int weight, uint16_t *luma, int soft, uint32_t step )
 {
-	register int j;
-	register int mix;
+	composite_lines[ composite_op_xor ][ composite_line_variant( luma, alpha_b, alpha_a ) ]
+		( dest, src, width, alpha_b, alpha_a, weight, luma, soft, step );
+}
 
-	for ( j = 0; j < width; j ++ )
-	{
-		mix = calculate_mix( luma, j, soft, weight, (alpha_b? *alpha_b : 255) ^ (alpha_a? *alpha_a : 255), step );
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		*dest = sample_mix( *dest, *src++, mix );
-		dest++;
-		if (alpha_a) *alpha_a ++ = mix >> 8;
-		if (alpha_b) alpha_b++;
-	}
+/** Get the instance of a line function for the luma map and alpha channels of an image.
+*/
+
+static composite_line_fn composite_line_select( composite_line_fn line_fn, uint16_t *luma, uint8_t *alpha_b, uint8_t *alpha_a )
+{
+	int variant = composite_line_variant( luma, alpha_b, alpha_a );
+
+	if ( line_fn == composite_line_yuv )
+		return composite_lines[ composite_op_over ][ variant ];
+	if ( line_fn == composite_line_yuv_or )
+		return composite_lines[ composite_op_or ][ variant ];
+	if ( line_fn == composite_line_yuv_and )
+		return composite_lines[ composite_op_and ][ variant ];
+	if ( line_fn == composite_line_yuv_xor )
+		return composite_lines[ composite_op_xor ][ variant ];
+	return line_fn;
 }
 
 struct sliced_composite_desc
@@ -488,7 +542,7 @@ static int sliced_composite_proc( int id, int idx, int jobs, void* cookie )
 /** Composite function.
 */
 
-static int composite_yuv( uint8_t *p_dest, int width_dest, int height_dest, uint8_t *p_src, int width_src, int height_src, uint8_t *alpha_b, uint8_t *alpha_a, struct geometry_s geometry, int field, uint16_t *p_luma, double softness, composite_line_fn line_fn, int sliced )
+static int composite_yuv( uint8_t *p_dest, int width_dest, int height_dest, uint8_t *p_src, int width_src, int height_src, uint8_t *alpha_b, uint8_t *alpha_a, struct geometry_s geometry, int field, uint16_t *p_luma, double softness, composite_line_fn line_fn, int sliced, const mlt_rect *alpha_box )
 {
 	int ret = 0;
 	int i;
@@ -608,7 +662,37 @@ static int composite_yuv( uint8_t *p_dest, int width_dest, int height_dest, uint
 			alpha_b += 1;
 	}
 
+	// Only composite the rows and columns of the source that are not transparent
+	if ( alpha_box )
+	{
+		int col = x_src + ( uneven_x != uneven_x_src );
+		int row = y_src + ( field == 1 );
+		int skip = alpha_box->y > row ? ( alpha_box->y - row + step - 1 ) / step : 0;
+		int left = alpha_box->x > col ? ( ( int )alpha_box->x - col ) & ~15 : 0;
+		int right = MIN( alpha_box->x + alpha_box->w - col, width_src );
+		int bottom = MIN( alpha_box->y + alpha_box->h - row, height_src );
+
+		// Keep each pixel in the same SIMD block as when compositing the whole line
+		right = left + ( ( right - left + 15 ) & ~15 );
+		if ( right > width_src - width_src % 16 )
+			right = width_src;
+
+		if ( right <= left || bottom <= skip * step )
+			return ret;
+		p_src += skip * stride_src + left * bpp;
+		p_dest += skip * stride_dest + left * bpp;
+		if ( alpha_b )
+			alpha_b += skip * alpha_b_stride + left;
+		if ( alpha_a )
+			alpha_a += skip * alpha_a_stride + left;
+		if ( p_luma )
+			p_luma += skip * alpha_b_stride + left;
+		width_src = right - left;
+		height_src = bottom - skip * step;
+	}
+
 	// now do the compositing only to cropped extents
+	line_fn = composite_line_select( line_fn, p_luma, alpha_b, alpha_a );
 	if ( !sliced )
 	{
 	for ( i = 0; i < height_src; i += step )
@@ -689,6 +773,7 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 	
 	// If the filename property changed, reload the map
 	char *resource = mlt_properties_get( properties, "luma" );
+	char *orig_resource = resource;
 	mlt_profile profile = mlt_service_profile( MLT_TRANSITION_SERVICE( self ) );
 	char temp[ 512 ];
 
@@ -718,17 +803,14 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 		int old_invert = mlt_properties_get_int( properties, "_luma_invert" );
 
 		if ( invert != old_invert || ( old_luma && old_luma[0] && strcmp( resource, old_luma ) ) )
-		{
-			mlt_properties_set_data( properties, "_luma.orig_bitmap", NULL, 0, NULL, NULL );
 			luma_bitmap = NULL;
-		}
 	}
 	else {
 		char *old_luma = mlt_properties_get( properties, "_luma" );
 		if ( old_luma && old_luma[0] )
 		{
-			mlt_properties_set_data( properties, "_luma.orig_bitmap", NULL, 0, NULL, NULL );
 			mlt_properties_set_data( properties, "_luma.bitmap", NULL, 0, NULL, NULL );
+			mlt_properties_set_data( properties, "_luma.item", NULL, 0, NULL, NULL );
 			luma_bitmap = NULL;
 			mlt_properties_set( properties, "_luma", NULL);
 		}
@@ -736,15 +818,31 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 
 	if ( resource && resource[0] && ( luma_bitmap == NULL || luma_width != width || luma_height != height ) )
 	{
-		uint16_t *orig_bitmap = mlt_properties_get_data( properties, "_luma.orig_bitmap", NULL );
-		luma_width = mlt_properties_get_int( properties, "_luma.orig_width" );
-		luma_height = mlt_properties_get_int( properties, "_luma.orig_height" );
+		// Transitions that use the same wipe at the same size share one scaled map.
+		char *key = calloc( 1, strlen( resource ) + 64 );
+		mlt_cache_item item;
 
-		// Load the original luma once
-		if ( orig_bitmap == NULL )
+		sprintf( key, "luma:scaled:%s:%dx%d:%d", resource, width, height, invert );
+		item = mlt_cache_shared_get_data( key );
+		if ( !item && ( luma_bitmap = luma_generate( orig_resource, width, height ) ) )
 		{
+			// An installed wipe is rendered at the size it is used
+			if ( invert )
+			{
+				int i;
+				for ( i = 0; i < width * height; i ++ )
+					luma_bitmap[ i ] ^= 0xffff;
+			}
+			item = mlt_cache_shared_put_data( key, luma_bitmap, width * height * 2, mlt_pool_release );
+		}
+		if ( !item )
+		{
+			uint16_t *orig_bitmap = NULL;
 			char *extension = strrchr( resource, '.' );
-			
+
+			luma_width = 0;
+			luma_height = 0;
+
 			// See if it is a PGM
 			int lumaLoaded = 0;
 			if ( extension != NULL && strcmp( extension, ".pgm" ) == 0 )
@@ -756,13 +854,8 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 					// Load from PGM
 					luma_read_pgm( f, &orig_bitmap, &luma_width, &luma_height );
 					fclose( f );
-					if ( luma_width > 0 && luma_height > 0 ) {
-						// Remember the original size for subsequent scaling
-						mlt_properties_set_data( properties, "_luma.orig_bitmap", orig_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
-						mlt_properties_set_int( properties, "_luma.orig_width", luma_width );
-						mlt_properties_set_int( properties, "_luma.orig_height", luma_height );
+					if ( luma_width > 0 && luma_height > 0 )
 						lumaLoaded = 1;
-					}
 				}
 			}
 			if ( !lumaLoaded )
@@ -802,11 +895,6 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 						if ( luma_image != NULL && luma_format == mlt_image_yuv422 )
 							luma_read_yuv422( luma_image, &orig_bitmap, luma_width, luma_height );
 	
-						// Remember the original size for subsequent scaling
-						mlt_properties_set_data( properties, "_luma.orig_bitmap", orig_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
-						mlt_properties_set_int( properties, "_luma.orig_width", luma_width );
-						mlt_properties_set_int( properties, "_luma.orig_height", luma_height );
-						
 						// Cleanup the luma frame
 						mlt_frame_close( luma_frame );
 					}
@@ -814,26 +902,33 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 					// Cleanup the luma producer
 					mlt_producer_close( producer );
 				}
-				else
-				{
-					luma_width = 0;
-					luma_height = 0;
-                }
 			}
+			if ( orig_bitmap && luma_width > 0 && luma_height > 0 )
+			{
+				// Scale luma map
+				luma_bitmap = mlt_pool_alloc( width * height * sizeof( uint16_t ) );
+				scale_luma( luma_bitmap, width, height, orig_bitmap, luma_width, luma_height, invert * ( ( 1 << 16 ) - 1 ) );
+				item = mlt_cache_shared_put_data( key, luma_bitmap, width * height * 2, mlt_pool_release );
+			}
+			mlt_pool_release( orig_bitmap );
 		}
-		if ( luma_width > 0 && luma_height > 0 )
-		{
-			// Scale luma map
-			luma_bitmap = mlt_pool_alloc( width * height * sizeof( uint16_t ) );
-			scale_luma( luma_bitmap, width, height, orig_bitmap, luma_width, luma_height, invert * ( ( 1 << 16 ) - 1 ) );
+		free( key );
 
+		if ( item )
+		{
 			// Remember the scaled luma size to prevent unnecessary scaling
+			luma_bitmap = mlt_cache_item_data( item, NULL );
 			mlt_properties_set_int( properties, "_luma.width", width );
 			mlt_properties_set_int( properties, "_luma.height", height );
-			mlt_properties_set_data( properties, "_luma.bitmap", luma_bitmap, width * height * 2, mlt_pool_release, NULL );
+			mlt_properties_set_data( properties, "_luma.bitmap", luma_bitmap, 0, NULL, NULL );
+			mlt_properties_set_data( properties, "_luma.item", item, 0, (mlt_destructor) mlt_cache_item_close, NULL );
 			mlt_properties_set( properties, "_luma", resource );
 			mlt_properties_set_int( properties, "_luma_invert", invert );
 		}
+		else
+		{
+			luma_bitmap = NULL;
+		}
 	}
 	return luma_bitmap;
 }
@@ -841,6 +936,81 @@ static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int w
 /** Get the properly sized image from b_frame.
 */
 
+/** Give the b frame the scaled image of static content kept from an earlier frame.
+*/
+
+static int get_static_image( mlt_transition self, mlt_frame b_frame, const char *key, uint8_t **image, int *width, int *height )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( self );
+	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
+	int found = 0;
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( self ) );
+	char *cached = mlt_properties_get( properties, "_static.key" );
+	if ( cached && !strcmp( cached, key ) )
+	{
+		int size = 0;
+		int alpha_size = 0;
+		uint8_t *data = mlt_properties_get_data( properties, "_static.image", &size );
+		uint8_t *alpha = mlt_properties_get_data( properties, "_static.alpha", &alpha_size );
+		if ( data && ( *image = mlt_pool_retain( data ) ) )
+		{
+			*width = mlt_properties_get_int( properties, "_static.width" );
+			*height = mlt_properties_get_int( properties, "_static.height" );
+			mlt_frame_set_image( b_frame, *image, size, mlt_pool_release );
+			mlt_frame_set_alpha( b_frame, alpha ? mlt_pool_retain( alpha ) : NULL, alpha_size, mlt_pool_release );
+			mlt_properties_set_int( b_props, "format", mlt_image_yuv422 );
+			mlt_properties_set_int( b_props, "width", *width );
+			mlt_properties_set_int( b_props, "height", *height );
+			mlt_properties_set( b_props, "solid_colour", mlt_properties_get( properties, "_static.solid_colour" ) );
+			mlt_properties_set( b_props, "constant_alpha", mlt_properties_get( properties, "_static.constant_alpha" ) );
+			mlt_properties_set( b_props, "alpha_box", mlt_properties_get( properties, "_static.alpha_box" ) );
+			mlt_properties_set_int( b_props, "alpha_box.width", *width );
+			mlt_properties_set_int( b_props, "alpha_box.height", *height );
+			found = 1;
+		}
+	}
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( self ) );
+	return found;
+}
+
+/** Keep the scaled image of static content for the following frames.
+*/
+
+static void put_static_image( mlt_transition self, mlt_frame b_frame, const char *key, int width, int height )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( self );
+	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
+	int size = 0;
+	int alpha_size = 0;
+	uint8_t *image = mlt_frame_share_data( b_frame, "image", &size );
+	uint8_t *alpha = mlt_frame_share_data( b_frame, "alpha", &alpha_size );
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( self ) );
+	if ( image )
+	{
+		mlt_properties_set( properties, "_static.key", key );
+		mlt_properties_set_int( properties, "_static.width", width );
+		mlt_properties_set_int( properties, "_static.height", height );
+		mlt_properties_set_data( properties, "_static.image", image, size, mlt_pool_release, NULL );
+		mlt_properties_set_data( properties, "_static.alpha", alpha, alpha_size, alpha ? mlt_pool_release : NULL, NULL );
+		// Scaling may have padded the image
+		mlt_properties_set( properties, "_static.solid_colour", mlt_properties_get( b_props, "solid_colour" ) );
+		mlt_properties_set( properties, "_static.constant_alpha", mlt_properties_get( b_props, "constant_alpha" ) );
+		mlt_rect box;
+		if ( mlt_frame_get_alpha_box( b_frame, width, height, &box ) )
+			mlt_properties_set_rect( properties, "_static.alpha_box", box );
+		else
+			mlt_properties_set( properties, "_static.alpha_box", NULL );
+	}
+	else
+	{
+		mlt_properties_set( properties, "_static.key", NULL );
+		mlt_pool_release( alpha );
+	}
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( self ) );
+}
+
 static int get_b_frame_image( mlt_transition self, mlt_frame b_frame, uint8_t **image, int *width, int *height, struct geometry_s *geometry )
 {
 	int error = 0;
@@ -964,7 +1134,23 @@ static int get_b_frame_image( mlt_transition self, mlt_frame b_frame, uint8_t **
 // fprintf(stderr, "%s: scaled %dx%d norm %dx%d resize %dx%d\n", __FILE__,
 // geometry->sw, geometry->sh, geometry->nw, geometry->nh, *width, *height);
 
-	error = mlt_frame_get_image( b_frame, image, &format, width, height, 1 );
+	// Reuse the scaled image of static content, such as a still watermark, until the size changes
+	char key[ 256 ] = "";
+	uint64_t hash = mlt_frame_get_static_image( b_frame );
+	if ( hash && !mlt_properties_get_int( properties, "invert" ) && !mlt_properties_get( properties, "alpha_b" ) )
+	{
+		const char *interp = mlt_properties_get( b_props, "rescale.interp" );
+		snprintf( key, sizeof( key ), "%" PRIu64 ":%dx%d:%d:%d:%d:%s", hash, *width, *height,
+			mlt_properties_get_int( b_props, "distort" ), mlt_properties_get_int( b_props, "resize_alpha" ),
+			mlt_properties_get_int( b_props, "consumer_deinterlace" ), interp ? interp : "" );
+	}
+
+	if ( !key[0] || !get_static_image( self, b_frame, key, image, width, height ) )
+	{
+		error = mlt_frame_get_image( b_frame, image, &format, width, height, 1 );
+		if ( !error && key[0] )
+			put_static_image( self, b_frame, key, *width, *height );
+	}
 
 	// composite_yuv uses geometry->sw to determine source stride, which
 	// should equal the image width if not using crop property.
@@ -1339,6 +1525,9 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 			alpha_b = alpha_b == NULL ? mlt_frame_get_alpha( b_frame ) : alpha_b;
 
 			composite_line_fn line_fn = composite_line_yuv;
+			int solid = 0;
+			mlt_rect alpha_box;
+			int has_alpha_box = 0;
 
 			// Replacement and override
 			if ( operator != NULL )
@@ -1358,6 +1547,20 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 			if ( mlt_properties_get( properties, "alpha_b" ) && alpha_b )
 				memset( alpha_b, mlt_properties_get_int( properties, "alpha_b" ), width_b * height_b );
 
+			// Skip the blending when the b frame is known or found to be transparent or opaque
+			if ( line_fn == composite_line_yuv && !luma_bitmap && !invert && !mlt_properties_get( properties, "alpha_b" ) )
+			{
+				int constant_alpha = mlt_frame_get_constant_alpha( b_frame, alpha_b, width_b * height_b );
+				if ( constant_alpha == 0 )
+					return 0;
+				if ( constant_alpha == 255 )
+				{
+					alpha_b = NULL;
+					solid = mlt_properties_get( b_props, "solid_colour" ) != NULL;
+				}
+				has_alpha_box = alpha_b && mlt_frame_get_alpha_box( b_frame, width_b, height_b, &alpha_box );
+			}
+
 			for ( field = 0; field < ( progressive ? 1 : 2 ); field++ )
 			{
 				// Assume lower field (0) first
@@ -1409,9 +1612,10 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 				// Composite the b_frame on the a_frame
 				mlt_log_timings_begin();
 				if ( invert )
-					composite_yuv( *image, width_b, height_b, image_b, *width, *height, alpha_a, alpha_b, result, field_id, luma_bitmap, luma_softness, line_fn, sliced );
+					composite_yuv( *image, width_b, height_b, image_b, *width, *height, alpha_a, alpha_b, result, field_id, luma_bitmap, luma_softness, line_fn, sliced, NULL );
 				else
-					composite_yuv( *image, *width, *height, image_b, width_b, height_b, alpha_b, alpha_a, result, field_id, luma_bitmap, luma_softness, line_fn, sliced );
+					composite_yuv( *image, *width, *height, image_b, width_b, height_b, alpha_b, alpha_a, result, field_id, luma_bitmap, luma_softness,
+						solid && result.item.mix >= 100 ? composite_line_yuv_fill : line_fn, sliced, has_alpha_box ? &alpha_box : NULL );
 				mlt_log_timings_end( NULL, "composite_yuv" );
 			}
 		}
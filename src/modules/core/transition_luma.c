@@ -28,13 +28,12 @@
 #include <string.h>
 #include <math.h>
 #include "transition_composite.h"
+#include "composite_line_simd.h"
+#include "luma_generator.h"
 
-static inline int is_opaque( uint8_t *alpha_channel, int width, int height )
+static inline int is_opaque( mlt_frame frame, uint8_t *alpha_channel, int width, int height )
 {
-	int n = width * height + 1;
-	while ( --n )
-		if ( *alpha_channel++ != 0xff ) return 0;
-	return 1;
+	return mlt_frame_get_constant_alpha( frame, alpha_channel, width * height ) == 255;
 }
 
 static inline float calculate_mix( float weight, float alpha )
@@ -47,16 +46,21 @@ static inline uint8_t sample_mix( uint8_t dest, uint8_t src, float mix )
 	return src * mix + dest * ( 1.f - mix );
 }
 
-static void composite_line_yuv_float( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, float weight )
+/** Dissolve a source line into a destination line, for the alpha channels
+ * given by the flags of the variant of composite_line_simd.h.
+ */
+
+static inline __attribute__((always_inline)) void composite_line_yuv_float( uint8_t *dest, uint8_t *src, int width,
+	uint8_t *alpha_b, uint8_t *alpha_a, float weight, const int variant )
 {
 	register int j = 0;
 	float mix_a, mix_b;
 
 	for ( ; j < width; j ++ )
 	{
-		mix_a = calculate_mix( 1.0f - weight, alpha_a? *alpha_a : 255 );
-		mix_b = calculate_mix( weight, alpha_b? *alpha_b : 255 );
-		if (alpha_a) {
+		mix_a = calculate_mix( 1.0f - weight, ( variant & COMPOSITE_LINE_ALPHA_A )? *alpha_a : 255 );
+		mix_b = calculate_mix( weight, ( variant & COMPOSITE_LINE_ALPHA_B )? *alpha_b : 255 );
+		if ( variant & COMPOSITE_LINE_ALPHA_A ) {
 			float mix2 = mix_b + mix_a - mix_b * mix_a;
 			*alpha_a = 255 * mix2;
 			if (mix2 != 0.f) mix_b /= mix2;
@@ -65,11 +69,29 @@ static void composite_line_yuv_float( uint8_t *dest, uint8_t *src, int width, ui
 		dest++;
 		*dest = sample_mix( *dest, *src++, mix_b );
 		dest++;
-		if ( alpha_a ) alpha_a ++;
-		if ( alpha_b ) alpha_b ++;
+		if ( variant & COMPOSITE_LINE_ALPHA_A ) alpha_a ++;
+		if ( variant & COMPOSITE_LINE_ALPHA_B ) alpha_b ++;
 	}
 }
 
+#define DISSOLVE_LINE( variant ) \
+static void dissolve_line_##variant( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, float weight ) \
+{ \
+	composite_line_yuv_float( dest, src, width, alpha_b, alpha_a, weight, variant ); \
+}
+
+DISSOLVE_LINE( 0 )
+DISSOLVE_LINE( 2 )
+DISSOLVE_LINE( 4 )
+DISSOLVE_LINE( 6 )
+
+typedef void ( *dissolve_line_fn )( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_b, uint8_t *alpha_a, float weight );
+
+static const dissolve_line_fn dissolve_lines[ COMPOSITE_LINE_VARIANTS ] =
+{
+	dissolve_line_0, NULL, dissolve_line_2, NULL, dissolve_line_4, NULL, dissolve_line_6, NULL
+};
+
 struct dissolve_slice_context {
 	uint8_t *dst_image;
 	uint8_t *src_image;
@@ -85,6 +107,7 @@ static int dissolve_slice( int id, int index, int count, void *context )
 	struct dissolve_slice_context ctx = *((struct dissolve_slice_context*) context);
 	int stride = ctx.width * 2;
 	int slice_height = (ctx.height + count - 1) / count;
+	dissolve_line_fn line = dissolve_lines[ composite_line_variant( NULL, ctx.src_alpha, ctx.dst_alpha ) ];
 	int i;
 
 	ctx.dst_image += index * slice_height * stride;
@@ -94,7 +117,7 @@ static int dissolve_slice( int id, int index, int count, void *context )
 	slice_height = MIN(slice_height, ctx.height - index * slice_height);
 
 	for (i = 0; i < slice_height; i++) {
-		composite_line_yuv_float( ctx.dst_image, ctx.src_image, ctx.width, ctx.src_alpha, ctx.dst_alpha, ctx.weight );
+		line( ctx.dst_image, ctx.src_image, ctx.width, ctx.src_alpha, ctx.dst_alpha, ctx.weight );
 		ctx.dst_image += stride;
 		ctx.src_image += stride;
 		if (ctx.dst_alpha) ctx.dst_alpha += ctx.width;
@@ -116,12 +139,17 @@ static inline int dissolve_yuv( mlt_frame frame, mlt_frame that, float weight, i
 
 	if ( mlt_properties_get( &frame->parent, "distort" ) )
 		mlt_properties_set( &that->parent, "distort", mlt_properties_get( &frame->parent, "distort" ) );
+	mlt_frame_prefetch_image( that, format, width_src, height_src, 0 );
 	mlt_frame_get_image( frame, &p_dest, &format, &width, &height, 1 );
-	alpha_dst = mlt_frame_get_alpha_mask( frame );
+	alpha_dst = mlt_frame_get_alpha( frame );
 	mlt_frame_get_image( that, &p_src, &format, &width_src, &height_src, 0 );
-	alpha_src = mlt_frame_get_alpha_mask( that );
-	int is_translucent = ( alpha_dst && !is_opaque(alpha_dst, width, height) )
-	                  || ( alpha_src && !is_opaque(alpha_src, width_src, height_src) );
+	alpha_src = mlt_frame_get_alpha( that );
+	int is_translucent = !is_opaque( frame, alpha_dst, width, height )
+	                  || !is_opaque( that, alpha_src, width_src, height_src );
+
+	// A missing alpha channel is opaque, so one is only made for the mix to write
+	if ( is_translucent )
+		alpha_dst = mlt_frame_get_alpha_mask( frame );
 
 	// Pick the lesser of two evils ;-)
 	width_src = width_src > width ? width : width_src;
@@ -140,16 +168,34 @@ static inline int dissolve_yuv( mlt_frame frame, mlt_frame that, float weight, i
 		};
 		mlt_slices_run_normal(threads, dissolve_slice, &context);
 	}
+	else if ( mix <= 0 )
+	{
+		// Nothing of the opaque b frame shows
+	}
+	else if ( mix >= ( 1 << 16 ) )
+	{
+		// Only the opaque b frame shows
+		for ( i = 0; i < height_src; i++ )
+			memcpy( p_dest + i * width * 2, p_src + i * width_src * 2, width_src * 2 );
+	}
 	else
 	{
+		// The line functions weight a missing source alpha differently from
+		// an opaque one, so give them an opaque line to keep the same result.
+		uint8_t *opaque = alpha_src ? NULL : mlt_pool_alloc( width_src );
+		if ( opaque )
+			memset( opaque, 255, width_src );
 		while ( --i )
 		{
-			composite_line_yuv( p_dest, p_src, width_src, alpha_src, alpha_dst, mix, NULL, 0, 0 );
+			composite_line_yuv( p_dest, p_src, width_src, alpha_src ? alpha_src : opaque, alpha_dst, mix, NULL, 0, 0 );
 			p_src += width_src << 1;
 			p_dest += width << 1;
-			alpha_src += width_src;
-			alpha_dst += width;
+			if ( alpha_src )
+				alpha_src += width_src;
+			if ( alpha_dst )
+				alpha_dst += width;
 		}
+		mlt_pool_release( opaque );
 	}
 
 	return ret;
@@ -184,6 +230,67 @@ static float smoothstep_float( float edge1, float edge2, float a )
 	return ( a * a )  * ( 3 - ( 2 * a ) );
 }
 
+/** Wipe a row of translucent images by the luma map.
+ *
+ * The flags of the variant of composite_line_simd.h tell which alpha
+ * channels there are, alpha_b for the source and alpha_a for the
+ * destination, and invert which of them receives the mix.
+ */
+
+static inline __attribute__((always_inline)) void luma_row_translucent( uint8_t *q, uint8_t *p, int width, uint16_t *l,
+	int32_t x_diff, float softness, float pos, uint8_t **alpha_dest, uint8_t **alpha_src, const int variant, const int invert )
+{
+	uint8_t *alpha_a = *alpha_dest;
+	uint8_t *alpha_b = *alpha_src;
+	int32_t x_offset = 0;
+	float mix_a, mix_b;
+
+	while( width -- )
+	{
+		float weight = l[ x_offset >> 16 ] / 65535.f;
+		float value = smoothstep_float( weight, softness + weight, pos );
+		mix_a = calculate_mix( 1.0f - value, ( variant & COMPOSITE_LINE_ALPHA_A )? *alpha_a : 255 );
+		mix_b = calculate_mix( value, ( variant & COMPOSITE_LINE_ALPHA_B )? *alpha_b : 255 );
+		if ( invert && ( variant & COMPOSITE_LINE_ALPHA_B ) ) {
+			float mix2 = mix_b + mix_a - mix_b * mix_a;
+			*alpha_b = 255 * mix2;
+			if (mix2 != 0.f) mix_b /= mix2;
+		} else if ( !invert && ( variant & COMPOSITE_LINE_ALPHA_A ) ) {
+			float mix2 = mix_b + mix_a - mix_b * mix_a;
+			*alpha_a = 255 * mix2;
+			if (mix2 != 0.f) mix_b /= mix2;
+		}
+		*q = sample_mix( *q, *p++, mix_b );
+		q++;
+		*q = sample_mix( *q, *p++, mix_b );
+		q++;
+		if ( variant & COMPOSITE_LINE_ALPHA_A ) alpha_a ++;
+		if ( variant & COMPOSITE_LINE_ALPHA_B ) alpha_b ++;
+		x_offset += x_diff;
+	}
+	*alpha_dest = alpha_a;
+	*alpha_src = alpha_b;
+}
+
+#define LUMA_ROW( variant, invert ) \
+static void luma_row_##variant##_##invert( uint8_t *q, uint8_t *p, int width, uint16_t *l, int32_t x_diff, \
+	float softness, float pos, uint8_t **alpha_dest, uint8_t **alpha_src ) \
+{ \
+	luma_row_translucent( q, p, width, l, x_diff, softness, pos, alpha_dest, alpha_src, variant, invert ); \
+}
+
+LUMA_ROW( 0, 0 ) LUMA_ROW( 2, 0 ) LUMA_ROW( 4, 0 ) LUMA_ROW( 6, 0 )
+LUMA_ROW( 0, 1 ) LUMA_ROW( 2, 1 ) LUMA_ROW( 4, 1 ) LUMA_ROW( 6, 1 )
+
+typedef void ( *luma_row_fn )( uint8_t *q, uint8_t *p, int width, uint16_t *l, int32_t x_diff,
+	float softness, float pos, uint8_t **alpha_dest, uint8_t **alpha_src );
+
+static const luma_row_fn luma_rows[ 2 ][ COMPOSITE_LINE_VARIANTS ] =
+{
+	{ luma_row_0_0, NULL, luma_row_2_0, NULL, luma_row_4_0, NULL, luma_row_6_0, NULL },
+	{ luma_row_0_1, NULL, luma_row_2_1, NULL, luma_row_4_1, NULL, luma_row_6_1, NULL }
+};
+
 /** powerful stuff
 
     \param field_order -1 = progressive, 0 = lower field first, 1 = top field first
@@ -203,16 +310,23 @@ static void luma_composite( mlt_frame a_frame, mlt_frame b_frame, int luma_width
 
 	if ( mlt_properties_get( &a_frame->parent, "distort" ) )
 		mlt_properties_set( &b_frame->parent, "distort", mlt_properties_get( &a_frame->parent, "distort" ) );
+	mlt_frame_prefetch_image( b_frame, format_src, width_src, height_src, 0 );
 	mlt_frame_get_image( a_frame, &p_dest, &format_dest, &width_dest, &height_dest, 1 );
-	alpha_dest = mlt_frame_get_alpha_mask( a_frame );
+	alpha_dest = mlt_frame_get_alpha( a_frame );
 	mlt_frame_get_image( b_frame, &p_src, &format_src, &width_src, &height_src, 0 );
-	alpha_src = mlt_frame_get_alpha_mask( b_frame );
+	alpha_src = mlt_frame_get_alpha( b_frame );
 
 	if ( *width == 0 || *height == 0 )
 		return;
 
-	int is_translucent = ( alpha_dest && !is_opaque(alpha_dest, width_dest, height_dest) )
-	                  || ( alpha_src  && !is_opaque(alpha_src,  width_src,  height_src ) );
+	int is_translucent = !is_opaque( a_frame, alpha_dest, width_dest, height_dest )
+	                  || !is_opaque( b_frame, alpha_src,  width_src,  height_src );
+
+	// A missing alpha channel is opaque, so one is only made for the mix to write
+	if ( is_translucent && invert )
+		alpha_src = mlt_frame_get_alpha_mask( b_frame );
+	else if ( is_translucent )
+		alpha_dest = mlt_frame_get_alpha_mask( a_frame );
 
 	// Pick the lesser of two evils ;-)
 	width_src = width_src > width_dest ? width_dest : width_src;
@@ -240,7 +354,7 @@ static void luma_composite( mlt_frame a_frame, mlt_frame b_frame, int luma_width
 	int field_stride_src = field_count * stride_src;
 	int field_stride_dest = field_count * stride_dest;
 	int field = 0;
-	float mix_a, mix_b;
+	luma_row_fn row = luma_rows[ invert != 0 ][ composite_line_variant( NULL, alpha_src, alpha_dest ) ];
 
 	// composite using luma map
 	while ( field < field_count )
@@ -260,29 +374,7 @@ static void luma_composite( mlt_frame a_frame, mlt_frame b_frame, int luma_width
 
 			if (is_translucent)
 			{
-				while( j -- )
-				{
-					float weight = l[ x_offset >> 16 ] / 65535.f;
-					float value = smoothstep_float( weight, softness + weight, field_pos[ field ] );
-					mix_a = calculate_mix( 1.0f - value, alpha_dest? *alpha_dest : 255 );
-					mix_b = calculate_mix( value, alpha_src? *alpha_src : 255 );
-					if (invert && alpha_src) {
-						float mix2 = mix_b + mix_a - mix_b * mix_a;
-						*alpha_src = 255 * mix2;
-						if (mix2 != 0.f) mix_b /= mix2;
-					} else if (!invert && alpha_dest) {
-						float mix2 = mix_b + mix_a - mix_b * mix_a;
-						*alpha_dest = 255 * mix2;
-						if (mix2 != 0.f) mix_b /= mix2;
-					}
-					*q = sample_mix( *q, *p++, mix_b );
-					q++;
-					*q = sample_mix( *q, *p++, mix_b );
-					q++;
-					if ( alpha_dest ) alpha_dest ++;
-					if ( alpha_src ) alpha_src ++;
-					x_offset += x_diff;
-				}
+				row( q, p, j, l, x_diff, softness, field_pos[ field ], &alpha_dest, &alpha_src );
 			}
 			else
 			{
@@ -437,6 +529,130 @@ static void luma_read_yuv422( uint8_t *image, uint16_t **map, int width, int hei
 		*p++ = ( image[ i ] - 16 ) * 299; // 299 = 65535 / 219
 }
 
+struct luma_generate_desc
+{
+	const luma_generator *generator;
+	uint16_t *image;
+	int height;
+};
+
+static int luma_generate_proc( int id, int idx, int jobs, void *cookie )
+{
+	struct luma_generate_desc *desc = cookie;
+	int slice_height = ( desc->height + jobs - 1 ) / jobs;
+	int start = MIN( idx * slice_height, desc->height );
+
+	luma_generator_rows( desc->generator, desc->image, start, MIN( start + slice_height, desc->height ) );
+	return 0;
+}
+
+/** Render one of the installed wipes at the size of the output.
+ *
+ * The resource is %lumaNN.pgm, which the lumas module installs at the sizes
+ * of a few profiles. Rendering it at the size it is used instead needs no
+ * file and no scaling. The rows are rendered on the slices pool.
+ * Returns a map from the memory pool or NULL if it is not one of the wipes.
+ */
+
+uint16_t *luma_generate( const char *resource, int width, int height )
+{
+	const char *name = resource ? strchr( resource, '%' ) : NULL;
+	luma_generator generator;
+	struct luma_generate_desc desc;
+	uint16_t *image, *spare = NULL, *result;
+	int w, h;
+
+	if ( !name || strlen( name ) != 11 || strncmp( name, "%luma", 5 ) || !isdigit( name[5] ) || !isdigit( name[6] )
+		|| ( strcmp( name + 7, ".pgm" ) && strcmp( name + 7, ".png" ) ) || width < 2 || height < 2 )
+		return NULL;
+
+	luma_generator_init( &generator );
+	generator.w = width;
+	generator.h = height;
+	if ( luma_generator_preset( &generator, atoi( name + 5 ) ) )
+		return NULL;
+
+	luma_generator_size( &generator, &w, &h );
+	image = mlt_pool_alloc( w * h * sizeof( uint16_t ) );
+	if ( generator.rotate )
+		spare = mlt_pool_alloc( width * height * sizeof( uint16_t ) );
+	if ( !image || ( generator.rotate && !spare ) )
+	{
+		mlt_pool_release( image );
+		mlt_pool_release( spare );
+		return NULL;
+	}
+
+	desc.generator = &generator;
+	desc.image = image;
+	desc.height = h;
+	mlt_slices_run_normal( 0, luma_generate_proc, &desc );
+
+	result = luma_generator_finish( &generator, image, spare );
+	mlt_pool_release( result == image ? spare : image );
+	return result;
+}
+
+/** A luma map in the shared data cache.
+*/
+
+struct luma_map
+{
+	uint16_t *bitmap;
+	int width;
+	int height;
+};
+
+static void luma_map_close( void *data )
+{
+	struct luma_map *map = data;
+	mlt_pool_release( map->bitmap );
+	free( map );
+}
+
+/** Use a luma map from the shared data cache.
+*/
+
+static void set_luma_map( mlt_properties properties, const char *resource, mlt_cache_item item )
+{
+	struct luma_map *map = mlt_cache_item_data( item, NULL );
+	mlt_properties_set_int( properties, "width", map->width );
+	mlt_properties_set_int( properties, "height", map->height );
+	mlt_properties_set( properties, "_resource", resource );
+	mlt_properties_set_data( properties, "bitmap", map->bitmap, 0, NULL, NULL );
+	mlt_properties_set_data( properties, "_luma.item", item, 0, (mlt_destructor) mlt_cache_item_close, NULL );
+}
+
+static uint16_t *get_luma_map( mlt_properties properties, int *width, int *height )
+{
+	*width = mlt_properties_get_int( properties, "width" );
+	*height = mlt_properties_get_int( properties, "height" );
+	return mlt_properties_get_data( properties, "bitmap", NULL );
+}
+
+/** Put a newly loaded luma map in the shared data cache and use it.
+*/
+
+static uint16_t *put_luma_map( mlt_properties properties, const char *key, const char *resource, uint16_t *bitmap, int *width, int *height )
+{
+	struct luma_map *map = calloc( 1, sizeof( *map ) );
+	mlt_cache_item item;
+
+	if ( !map )
+	{
+		mlt_pool_release( bitmap );
+		return NULL;
+	}
+	map->bitmap = bitmap;
+	map->width = *width;
+	map->height = *height;
+	item = mlt_cache_shared_put_data( key, map, *width * *height * 2, luma_map_close );
+	if ( !item )
+		return NULL;
+	set_luma_map( properties, resource, item );
+	return get_luma_map( properties, width, height );
+}
+
 /** Get the image.
 */
 
@@ -498,29 +714,46 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 			extension = strrchr( resource, '.' );
 		}
 
+		// Transitions that use the same wipe share one map.
+		char *key = calloc( 1, strlen( resource ) + 64 );
+		sprintf( key, "luma:source:%s:%dx%d", resource, luma_width, luma_height );
+		mlt_cache_item item = *resource ? mlt_cache_shared_get_data( key ) : NULL;
+		uint16_t *generated = NULL;
+
+		if ( item )
+		{
+			set_luma_map( properties, orig_resource, item );
+			luma_bitmap = get_luma_map( properties, &luma_width, &luma_height );
+		}
+		// Render an installed wipe at the size it is used
+		else if ( ( generated = luma_generate( orig_resource, luma_width, luma_height ) ) )
+		{
+			luma_bitmap = put_luma_map( properties, key, orig_resource, generated, &luma_width, &luma_height );
+		}
 		// See if it is a PGM
-		if ( extension != NULL && strcmp( extension, ".pgm" ) == 0 )
+		else if ( extension != NULL && strcmp( extension, ".pgm" ) == 0 )
 		{
 			// Open PGM
 			FILE *f = mlt_fopen( resource, "rb" );
 			if ( f != NULL )
 			{
+				uint16_t *bitmap = NULL;
+
 				// Load from PGM
-				luma_read_pgm( f, &luma_bitmap, &luma_width, &luma_height );
+				luma_read_pgm( f, &bitmap, &luma_width, &luma_height );
 				fclose( f );
 
 				// Set the transition properties
-				mlt_properties_set_int( properties, "width", luma_width );
-				mlt_properties_set_int( properties, "height", luma_height );
-				mlt_properties_set( properties, "_resource", orig_resource );
-				mlt_properties_set_data( properties, "bitmap", luma_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
+				if ( bitmap )
+					luma_bitmap = put_luma_map( properties, key, orig_resource, bitmap, &luma_width, &luma_height );
 			}
 		}
 		else if (!*resource) 
 		{
 		    luma_bitmap = NULL;
 		    mlt_properties_set( properties, "_resource", NULL );
-		    mlt_properties_set_data( properties, "bitmap", luma_bitmap, 0, mlt_pool_release, NULL );
+		    mlt_properties_set_data( properties, "bitmap", luma_bitmap, 0, NULL, NULL );
+		    mlt_properties_set_data( properties, "_luma.item", NULL, 0, NULL, NULL );
 		}
 		else
 		{
@@ -555,15 +788,14 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 					mlt_properties_set( MLT_FRAME_PROPERTIES( luma_frame ), "rescale.interp", "nearest" );
 					mlt_frame_get_image( luma_frame, &luma_image, &luma_format, &luma_width, &luma_height, 0 );
 
-					// Generate the luma map
+					// Generate the luma map and set the transition properties
 					if ( luma_image != NULL )
-						luma_read_yuv422( luma_image, &luma_bitmap, luma_width, luma_height );
-					
-					// Set the transition properties
-					mlt_properties_set_int( properties, "width", luma_width );
-					mlt_properties_set_int( properties, "height", luma_height );
-					mlt_properties_set( properties, "_resource", orig_resource);
-					mlt_properties_set_data( properties, "bitmap", luma_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
+					{
+						uint16_t *bitmap = NULL;
+						luma_read_yuv422( luma_image, &bitmap, luma_width, luma_height );
+						if ( bitmap )
+							luma_bitmap = put_luma_map( properties, key, orig_resource, bitmap, &luma_width, &luma_height );
+					}
 
 					// Cleanup the luma frame
 					mlt_frame_close( luma_frame );
@@ -573,6 +805,7 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 				mlt_producer_close( producer );
 			}
 		}
+		free( key );
 	}
 
 	// Arbitrary composite defaults
@@ -640,6 +873,22 @@ static mlt_frame transition_process( mlt_transition transition, mlt_frame a_fram
 	return a_frame;
 }
 
+/** Drop the luma map of the old size, to be looked up again for the new one.
+*/
+
+static void on_profile_changed( mlt_properties owner, mlt_transition transition )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( transition ) );
+	mlt_properties_set( properties, "_resource", NULL );
+	mlt_properties_set( properties, "width", NULL );
+	mlt_properties_set( properties, "height", NULL );
+	mlt_properties_set_data( properties, "bitmap", NULL, 0, NULL, NULL );
+	mlt_properties_set_data( properties, "_luma.item", NULL, 0, NULL, NULL );
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+}
+
 /** Constructor for the filter.
 */
 
@@ -659,6 +908,7 @@ mlt_transition transition_luma_init( mlt_profile profile, mlt_service_type type,
 		
 		// Inform apps and framework that this is a video only transition
 		mlt_properties_set_int( MLT_TRANSITION_PROPERTIES( transition ), "_transition_type", 1 );
+		mlt_events_listen( MLT_TRANSITION_PROPERTIES( transition ), transition, "profile-changed", ( mlt_listener )on_profile_changed );
 
 		return transition;
 	}
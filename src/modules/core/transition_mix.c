@@ -20,6 +20,7 @@
 #include <framework/mlt_transition.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "audio_mix_simd.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,51 +41,89 @@ typedef struct transition_mix_s
 	int dest_buffer_count;
 } *transition_mix;
 
-static void mix_audio( double weight_start, double weight_end, float *buffer_a,
+// Mix or sum the audio of b into a with a smooth ramp of the weight of b over start to end.
+static void ramp_audio( int sum, double weight_start, double weight_end, float *buffer_a,
 	float *buffer_b, int channels_a, int channels_b, int channels_out, int samples )
 {
+	float weight = weight_start;
+	float step = ( weight_end - weight_start ) / samples;
 	int i, j;
-	double a, b, v;
 
-	// Compute a smooth ramp over start to end
-	double mix = weight_start;
-	double mix_step = ( weight_end - weight_start ) / samples;
+	if ( channels_a == channels_out && channels_b == channels_out )
+	{
+		const struct audio_mix_kernels *kernels = audio_mix_simd_kernels();
+		int count = samples * channels_out;
+
+		i = 0;
+		if ( kernels )
+			i = ( sum ? kernels->sum : kernels->mix )( buffer_a, buffer_b, channels_out, count, weight, step );
+		for ( ; i < count; i++ )
+		{
+			float mix = weight + step * (float) ( i / channels_out );
+			if ( sum )
+				buffer_a[ i ] += mix * buffer_b[ i ];
+			else
+				buffer_a[ i ] = mix * buffer_b[ i ] + ( 1.0f - mix ) * buffer_a[ i ];
+		}
+		return;
+	}
 
 	for ( i = 0; i < samples; i++ )
 	{
+		float mix = weight + step * (float) i;
+		float *a = buffer_a + i * channels_a;
+		float *b = buffer_b + i * channels_b;
+
 		for ( j = 0; j < channels_out; j++ )
 		{
-			a = (double) buffer_a[ i * channels_a + j ];
-			b = (double) buffer_b[ i * channels_b + j ];
-			v = mix * b + (1.0 - mix) * a;
-			buffer_a[ i * channels_a + j ] = v;
+			if ( sum )
+				a[ j ] += mix * b[ j ];
+			else
+				a[ j ] = mix * b[ j ] + ( 1.0f - mix ) * a[ j ];
 		}
-		mix += mix_step;
 	}
 }
 
-static void sum_audio( double weight_start, double weight_end, float *buffer_a,
-	float *buffer_b, int channels_a, int channels_b, int channels_out, int samples )
+// Mix or sum planar audio of b into a plane by plane with the same ramp as ramp_audio().
+static void ramp_planar( int sum, double weight_start, double weight_end, float *buffer_a,
+	float *buffer_b, int samples_a, int samples_b, int channels, int samples )
 {
+	const struct audio_mix_kernels *kernels = audio_mix_simd_kernels();
+	float weight = weight_start;
+	float step = ( weight_end - weight_start ) / samples;
 	int i, j;
-	double a, b;
-
-	// Compute a smooth ramp over start to end
-	double mix = weight_start;
-	double mix_step = ( weight_end - weight_start ) / samples;
 
-	for ( i = 0; i < samples; i++ )
+	for ( j = 0; j < channels; j++ )
 	{
-		for ( j = 0; j < channels_out; j++ )
+		float *a = buffer_a + j * samples_a;
+		float *b = buffer_b + j * samples_b;
+
+		i = 0;
+		if ( kernels )
+			i = ( sum ? kernels->sum : kernels->mix )( a, b, 1, samples, weight, step );
+		for ( ; i < samples; i++ )
 		{
-			a = (double) buffer_a[ i * channels_a + j ];
-			b = (double) buffer_b[ i * channels_b + j ];
-			buffer_a[ i * channels_a + j ] = mix * b + a;
+			float mix = weight + step * (float) i;
+			if ( sum )
+				a[ i ] += mix * b[ i ];
+			else
+				a[ i ] = mix * b[ i ] + ( 1.0f - mix ) * a[ i ];
 		}
-		mix += mix_step;
 	}
 }
 
+static void mix_audio( double weight_start, double weight_end, float *buffer_a,
+	float *buffer_b, int channels_a, int channels_b, int channels_out, int samples )
+{
+	ramp_audio( 0, weight_start, weight_end, buffer_a, buffer_b, channels_a, channels_b, channels_out, samples );
+}
+
+static void sum_audio( double weight_start, double weight_end, float *buffer_a,
+	float *buffer_b, int channels_a, int channels_b, int channels_out, int samples )
+{
+	ramp_audio( 1, weight_start, weight_end, buffer_a, buffer_b, channels_a, channels_b, channels_out, samples );
+}
+
 // This filter uses an inline low pass filter to allow mixing without volume hacking.
 static void combine_audio( double weight, float *buffer_a, float *buffer_b,
 	int channels_a, int channels_b, int channels_out, int samples )
@@ -111,6 +150,47 @@ static void combine_audio( double weight, float *buffer_a, float *buffer_b,
 	}
 }
 
+// Get the ramp of the mix level of b.
+static void get_mix_levels( mlt_properties b_props, double level, double *mix_start, double *mix_end )
+{
+	*mix_start = *mix_end = level;
+	if ( mlt_properties_get( b_props, "audio.previous_mix" ) )
+		*mix_start = mlt_properties_get_double( b_props, "audio.previous_mix" );
+	if ( mlt_properties_get( b_props, "audio.mix" ) )
+		*mix_end = mlt_properties_get_double( b_props, "audio.mix" );
+	if ( mlt_properties_get_int( b_props, "audio.reverse" ) )
+	{
+		*mix_start = 1.0 - *mix_start;
+		*mix_end = 1.0 - *mix_end;
+	}
+}
+
+// Mix the audio of b into a in place using the algorithm of the transition.
+static void mix_buffers( mlt_transition transition, mlt_frame frame_a, mlt_frame frame_b, float *buffer_a,
+	float *buffer_b, int channels_a, int channels_b, int channels_out, int samples )
+{
+	mlt_properties b_props = MLT_FRAME_PROPERTIES( frame_b );
+	double mix_start, mix_end;
+
+	if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES(transition), "sum" ) )
+	{
+		get_mix_levels( b_props, 1.0, &mix_start, &mix_end );
+		sum_audio( mix_start, mix_end, buffer_a, buffer_b, channels_a, channels_b, channels_out, samples );
+	}
+	else if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES(transition), "combine" ) )
+	{
+		double weight = 1.0;
+		if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame_a ), "meta.mixdown" ) )
+			weight = 1.0 - mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame_a ), "meta.volume" );
+		combine_audio( weight, buffer_a, buffer_b, channels_a, channels_b, channels_out, samples );
+	}
+	else
+	{
+		get_mix_levels( b_props, 0.5, &mix_start, &mix_end );
+		mix_audio( mix_start, mix_end, buffer_a, buffer_b, channels_a, channels_b, channels_out, samples );
+	}
+}
+
 /** Get the audio.
 */
 
@@ -128,14 +208,19 @@ static int transition_get_audio( mlt_frame frame_a, void **buffer, mlt_audio_for
 	mlt_properties b_props = MLT_FRAME_PROPERTIES( frame_b );
 
 	transition_mix self = transition->child;
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
 	float *buffer_b, *buffer_a;
 	int frequency_b = *frequency, frequency_a = *frequency;
 	int channels_b = *channels, channels_a = *channels;
 	int samples_b = *samples, samples_a = *samples;
 
-	// We can only mix interleaved 32-bit float.
-	*format = mlt_audio_f32le;
-	mlt_frame_get_audio( frame_b, (void**) &buffer_b, format, &frequency_b, &channels_b, &samples_b );
+	// We can only mix 32-bit float. Planar is mixed in place, without
+	// interleaving it, when it was requested and nothing is buffered.
+	int planar = *format == mlt_audio_float && !self->src_buffer_count && !self->dest_buffer_count
+		&& !mlt_properties_get_int( properties, "combine" ) && frame_a->convert_audio && frame_b->convert_audio;
+	mlt_audio_format format_b = planar ? mlt_audio_float : mlt_audio_f32le;
+	*format = format_b;
+	mlt_frame_get_audio( frame_b, (void**) &buffer_b, &format_b, &frequency_b, &channels_b, &samples_b );
 	mlt_frame_get_audio( frame_a, (void**) &buffer_a, format, &frequency_a, &channels_a, &samples_a );
 
 	// Prevent dividing by zero.
@@ -161,6 +246,39 @@ static int transition_get_audio( mlt_frame frame_a, void **buffer, mlt_audio_for
 	if ( silent )
 		memset( buffer_b, 0, samples_b * channels_b * sizeof( float ) );
 
+	// Mix in place when nothing is buffered and the frames line up.
+	int in_place = !self->src_buffer_count && !self->dest_buffer_count && samples_a == samples_b
+		 && samples_a <= MAX_SAMPLES && channels_a <= MIN( channels_b, MAX_CHANNELS );
+	if ( planar && in_place && *format == mlt_audio_float && format_b == mlt_audio_float )
+	{
+		int sum = mlt_properties_get_int( properties, "sum" );
+		double mix_start, mix_end;
+		get_mix_levels( b_props, sum ? 1.0 : 0.5, &mix_start, &mix_end );
+		ramp_planar( sum, mix_start, mix_end, buffer_a, buffer_b, samples_a, samples_b, channels_a, samples_a );
+		*samples = samples_a;
+		*channels = channels_a;
+		*frequency = frequency_a;
+		*buffer = buffer_a;
+		return error;
+	}
+	if ( planar )
+	{
+		// Interleave to mix through the buffers
+		if ( *format != mlt_audio_f32le )
+			frame_a->convert_audio( frame_a, (void**) &buffer_a, format, mlt_audio_f32le );
+		if ( format_b != mlt_audio_f32le )
+			frame_b->convert_audio( frame_b, (void**) &buffer_b, &format_b, mlt_audio_f32le );
+	}
+	if ( in_place )
+	{
+		mix_buffers( transition, frame_a, frame_b, buffer_a, buffer_b, channels_a, channels_b, channels_a, samples_a );
+		*samples = samples_a;
+		*channels = channels_a;
+		*frequency = frequency_a;
+		*buffer = buffer_a;
+		return error;
+	}
+
 	// determine number of samples to process
 	*samples = MIN( self->src_buffer_count + samples_b, self->dest_buffer_count + samples_a );
 	*channels = MIN( MIN( channels_b, channels_a ), MAX_CHANNELS );
@@ -197,41 +315,7 @@ static int transition_get_audio( mlt_frame frame_a, void **buffer, mlt_audio_for
 	buffer_a = self->dest_buffer;
 
 	// Do the mixing.
-	if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES(transition), "sum" ) )
-	{
-		double mix_start = 1.0, mix_end = 1.0;
-		if ( mlt_properties_get( b_props, "audio.previous_mix" ) )
-			mix_start = mlt_properties_get_double( b_props, "audio.previous_mix" );
-		if ( mlt_properties_get( b_props, "audio.mix" ) )
-			mix_end = mlt_properties_get_double( b_props, "audio.mix" );
-		if ( mlt_properties_get_int( b_props, "audio.reverse" ) )
-		{
-			mix_start = 1.0 - mix_start;
-			mix_end = 1.0 - mix_end;
-		}
-		sum_audio( mix_start, mix_end, buffer_a, buffer_b, channels_a, channels_b, *channels, *samples );
-	}
-	else if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES(transition), "combine" ) )
-	{
-		double weight = 1.0;
-		if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame_a ), "meta.mixdown" ) )
-			weight = 1.0 - mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame_a ), "meta.volume" );
-		combine_audio( weight, buffer_a, buffer_b, channels_a, channels_b, *channels, *samples );
-	}
-	else
-	{
-		double mix_start = 0.5, mix_end = 0.5;
-		if ( mlt_properties_get( b_props, "audio.previous_mix" ) )
-			mix_start = mlt_properties_get_double( b_props, "audio.previous_mix" );
-		if ( mlt_properties_get( b_props, "audio.mix" ) )
-			mix_end = mlt_properties_get_double( b_props, "audio.mix" );
-		if ( mlt_properties_get_int( b_props, "audio.reverse" ) )
-		{
-			mix_start = 1.0 - mix_start;
-			mix_end = 1.0 - mix_end;
-		}
-		mix_audio( mix_start, mix_end, buffer_a, buffer_b, channels_a, channels_b, *channels, *samples );
-	}
+	mix_buffers( transition, frame_a, frame_b, buffer_a, buffer_b, channels_a, channels_b, *channels, *samples );
 
 	// Copy the audio into the frame.
 	bytes = SAMPLE_BYTES( *samples, *channels );
@@ -275,6 +359,105 @@ static int transition_get_audio( mlt_frame frame_a, void **buffer, mlt_audio_for
 	return error;
 }
 
+// The b frames that the transitions in mixer mode sum into an a frame in one pass.
+typedef struct
+{
+	mlt_frame *frames;
+	int count;
+	int size;
+} *mix_group;
+
+static void mix_group_close( mix_group group )
+{
+	free( group->frames );
+	free( group );
+}
+
+/** Get the audio of a frame and sum the audio of a group of tracks into it.
+*/
+
+static int mixer_get_audio( mlt_frame frame_a, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	mix_group group = mlt_frame_pop_audio( frame_a );
+	mlt_properties a_props = MLT_FRAME_PROPERTIES( frame_a );
+	float *buffer_a;
+	int i;
+
+	// We can only mix 32-bit float, but keep it planar if that was requested.
+	if ( *format != mlt_audio_float )
+		*format = mlt_audio_f32le;
+	mlt_frame_get_audio( frame_a, (void**) &buffer_a, format, frequency, channels, samples );
+	if ( !*channels )
+		return 1;
+	*buffer = buffer_a;
+
+	if ( mlt_properties_get_int( a_props, "silent_audio" ) )
+		memset( buffer_a, 0, *samples * *channels * sizeof( float ) );
+	mlt_properties_set_int( a_props, "silent_audio", 0 );
+
+	for ( i = 0; i < group->count; i++ )
+	{
+		mlt_frame frame_b = group->frames[ i ];
+		mlt_properties b_props = MLT_FRAME_PROPERTIES( frame_b );
+		mlt_audio_format format_b = *format;
+		int frequency_b = *frequency, channels_b = *channels, samples_b = *samples;
+		int silent;
+		float *buffer_b = NULL;
+		double mix_start, mix_end;
+
+		mlt_frame_get_audio( frame_b, (void**) &buffer_b, &format_b, &frequency_b, &channels_b, &samples_b );
+		silent = mlt_properties_get_int( b_props, "silent_audio" );
+		mlt_properties_set_int( b_props, "silent_audio", 0 );
+
+		// Adding silence changes nothing.
+		if ( silent || !channels_b || !buffer_b || buffer_b == buffer_a )
+			continue;
+		get_mix_levels( b_props, 1.0, &mix_start, &mix_end );
+		if ( *format == mlt_audio_float )
+		{
+			if ( format_b == mlt_audio_float )
+				ramp_planar( 1, mix_start, mix_end, buffer_a, buffer_b, *samples, samples_b,
+					MIN( *channels, channels_b ), MIN( *samples, samples_b ) );
+		}
+		else
+			sum_audio( mix_start, mix_end, buffer_a, buffer_b, *channels, channels_b,
+				MIN( *channels, channels_b ), MIN( *samples, samples_b ) );
+	}
+
+	return 0;
+}
+
+// Add the b frame to the group on top of the audio stack of the a frame or start a new group.
+static void mixer_push_frame( mlt_frame a_frame, mlt_frame b_frame )
+{
+	mlt_deque stack = MLT_FRAME_AUDIO_STACK( a_frame );
+	int depth = mlt_deque_count( stack );
+	mix_group group = NULL;
+
+	if ( depth >= 2 && mlt_deque_peek_back( stack ) == (void*) mixer_get_audio )
+		group = mlt_deque_peek( stack, depth - 2 );
+	if ( !group )
+	{
+		char key[ 32 ];
+		group = calloc( 1, sizeof( *group ) );
+		if ( !group )
+			return;
+		snprintf( key, sizeof( key ), "_mix.group.%d", depth );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( a_frame ), key, group, 0, (mlt_destructor) mix_group_close, NULL );
+		mlt_frame_push_audio( a_frame, group );
+		mlt_frame_push_audio( a_frame, mixer_get_audio );
+	}
+	if ( group->count == group->size )
+	{
+		int size = group->size ? group->size * 2 : 8;
+		mlt_frame *frames = realloc( group->frames, size * sizeof( mlt_frame ) );
+		if ( !frames )
+			return;
+		group->frames = frames;
+		group->size = size;
+	}
+	group->frames[ group->count++ ] = b_frame;
+}
 
 /** Mix transition processing.
 */
@@ -358,9 +541,16 @@ static mlt_frame transition_process( mlt_transition transition, mlt_frame a_fram
 	}
 
 	// Override the get_audio method
-	mlt_frame_push_audio( a_frame, transition );
-	mlt_frame_push_audio( a_frame, b_frame );
-	mlt_frame_push_audio( a_frame, transition_get_audio );
+	if ( mlt_properties_get_int( properties, "sum" ) && mlt_properties_get_int( properties, "mixer" ) )
+	{
+		mixer_push_frame( a_frame, b_frame );
+	}
+	else
+	{
+		mlt_frame_push_audio( a_frame, transition );
+		mlt_frame_push_audio( a_frame, b_frame );
+		mlt_frame_push_audio( a_frame, transition_get_audio );
+	}
 
 	// Ensure transition_get_audio is called if test_audio=1.
 	if ( mlt_properties_get_int( properties, "accepts_blanks" ) )
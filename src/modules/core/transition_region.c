@@ -19,9 +19,11 @@
 
 #include "transition_region.h"
 #include "transition_composite.h"
+#include "image_convert_simd.h"
 
 #include <framework/mlt.h>
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -91,6 +93,23 @@ static int create_instance( mlt_transition transition, char *name, char *value,
 	return error;
 }
 
+/** The alpha of a static shape kept from an earlier frame.
+*/
+
+typedef struct
+{
+	char key[ 64 ];
+	uint8_t *alpha;
+	int size;
+}
+shape_alpha;
+
+static void shape_alpha_close( shape_alpha *self )
+{
+	mlt_pool_release( self->alpha );
+	free( self );
+}
+
 static uint8_t *filter_get_alpha_mask( mlt_frame frame )
 {
 	uint8_t *alpha = NULL;
@@ -101,36 +120,64 @@ static uint8_t *filter_get_alpha_mask( mlt_frame frame )
 	// Get the shape frame
 	mlt_frame shape_frame = mlt_properties_get_data( properties, "shape_frame", NULL );
 
+	// Get the transition that keeps the alpha of a static shape
+	mlt_transition transition = mlt_properties_get_data( properties, "region_transition", NULL );
+
 	// Get the width and height of the image
 	int region_width = mlt_properties_get_int( properties, "width" );
 	int region_height = mlt_properties_get_int( properties, "height" );
+	int size = region_width * region_height;
 	uint8_t *image = NULL;
 	mlt_image_format format = mlt_image_yuv422;
-					
-	// Get the shape image to trigger alpha creation
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( shape_frame ), "distort", 1 );
-	mlt_frame_get_image( shape_frame, &image, &format, &region_width, &region_height, 0 );
+	uint8_t *alpha_duplicate = NULL;
+	char key[ 64 ] = "";
 
-	alpha = mlt_frame_get_alpha_mask( shape_frame );
+	// The alpha is made once for the frame
+	frame->get_alpha_mask = NULL;
 
-	int size = region_width * region_height;
-	uint8_t *alpha_duplicate = mlt_pool_alloc( size );
+	// Reuse the alpha of a shape with the same content and size
+	uint64_t hash = mlt_frame_get_static_image( shape_frame );
+	if ( hash && transition )
+	{
+		snprintf( key, sizeof( key ), "%" PRIu64 ":%dx%d", hash, region_width, region_height );
+		mlt_cache_item item = mlt_service_cache_get( MLT_TRANSITION_SERVICE( transition ), "region.shape_alpha" );
+		shape_alpha *cached = mlt_cache_item_data( item, NULL );
+		if ( cached && cached->size == size && !strcmp( cached->key, key ) )
+			alpha_duplicate = mlt_pool_retain( cached->alpha );
+		mlt_cache_item_close( item );
+	}
 
-	// Generate from the Y component of the image if no alpha available
-	if ( alpha == NULL )
+	if ( alpha_duplicate == NULL )
 	{
-		alpha = alpha_duplicate;
-		while ( size -- )
+		// Get the shape image to trigger alpha creation
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( shape_frame ), "distort", 1 );
+		mlt_frame_get_image( shape_frame, &image, &format, &region_width, &region_height, 0 );
+
+		alpha = mlt_frame_get_alpha_mask( shape_frame );
+
+		size = region_width * region_height;
+		alpha_duplicate = mlt_pool_alloc( size );
+
+		// Generate from the Y component of the image if no alpha available
+		if ( alpha == NULL )
+			image_luma_to_alpha( image, alpha_duplicate, size );
+		else
+			memcpy( alpha_duplicate, alpha, size );
+
+		if ( key[0] )
 		{
-			*alpha ++ = ( int )( ( ( *image ++ - 16 ) * 299 ) / 255 );
-			image ++;
+			shape_alpha *cached = calloc( 1, sizeof( *cached ) );
+			if ( cached )
+			{
+				strcpy( cached->key, key );
+				cached->alpha = mlt_pool_retain( alpha_duplicate );
+				cached->size = size;
+				mlt_service_cache_put( MLT_TRANSITION_SERVICE( transition ), "region.shape_alpha", cached, 0,
+					( mlt_destructor )shape_alpha_close );
+			}
 		}
 	}
-	else
-	{
-		memcpy( alpha_duplicate, alpha, size );
-	}
-	mlt_frame_set_alpha( frame, alpha_duplicate, region_width * region_height, mlt_pool_release );
+	mlt_frame_set_alpha( frame, alpha_duplicate, size, mlt_pool_release );
 
 	return alpha_duplicate;
 }
@@ -389,6 +436,7 @@ static int transition_get_image( mlt_frame frame, uint8_t **image, mlt_image_for
 				{
 					// Ensure that the shape frame will be closed
 					mlt_properties_set_data( b_props, "shape_frame", shape_frame, 0, ( mlt_destructor )mlt_frame_close, NULL );
+					mlt_properties_set_data( b_props, "region_transition", transition, 0, NULL, NULL );
 
 					// Specify the callback for evaluation
 					b_frame->get_alpha_mask = filter_get_alpha_mask;
@@ -423,6 +471,28 @@ static mlt_frame transition_process( mlt_transition transition, mlt_frame a_fram
 	return a_frame;
 }
 
+/** Pass a change of profile on to the services the transition made.
+*/
+
+static void on_profile_changed( mlt_properties owner, mlt_transition transition )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	mlt_filter filter;
+	char id[ 256 ];
+	int i = 0;
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( transition ) );
+	mlt_service_profile_changed( mlt_properties_get_data( properties, "composite", NULL ) );
+	mlt_service_profile_changed( mlt_properties_get_data( properties, "producer", NULL ) );
+	sprintf( id, "_filter_%d", i );
+	while ( ( filter = mlt_properties_get_data( properties, id, NULL ) ) )
+	{
+		mlt_service_profile_changed( MLT_FILTER_SERVICE( filter ) );
+		sprintf( id, "_filter_%d", ++ i );
+	}
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+}
+
 /** Constructor for the transition.
 */
 
@@ -448,6 +518,7 @@ mlt_transition transition_region_init( mlt_profile profile, mlt_service_type typ
 
 		// Inform apps and framework that this is a video only transition
 		mlt_properties_set_int( properties, "_transition_type", 1 );
+		mlt_events_listen( properties, transition, "profile-changed", ( mlt_listener )on_profile_changed );
 	}
 
 	// Return the transition
@@ -20,6 +20,9 @@
 #include "common.h"
 #include <stdlib.h>
 #include <unistd.h>
+#if defined(USE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifdef __APPLE__
 
@@ -91,45 +94,25 @@ void freeDLString( DLString aDLString )
 #endif
 
 
+// Swap the bytes of each 16-bit word, which converts between UYVY and YUYV.
+// The SSE2 path handles 32 bytes per iteration without alignment
+// requirements and leaves the remainder to swab().
 void swab2( const void *from, void *to, int n )
 {
-#if defined(USE_SSE)
-#define SWAB_STEP 16
-	__asm__ volatile
-	(
-		"loop_start:                            \n\t"
-
-		/* load */
-		"movdqa         0(%[from]), %%xmm0      \n\t"
-		"add            $0x10, %[from]          \n\t"
-
-		/* duplicate to temp registers */
-		"movdqa         %%xmm0, %%xmm1          \n\t"
-
-		/* shift right temp register */
-		"psrlw          $8, %%xmm1              \n\t"
-
-		/* shift left main register */
-		"psllw          $8, %%xmm0              \n\t"
-
-		/* compose them back */
-		"por           %%xmm0, %%xmm1           \n\t"
-
-		/* save */
-		"movdqa         %%xmm1, 0(%[to])        \n\t"
-		"add            $0x10, %[to]            \n\t"
-
-		"dec            %[cnt]                  \n\t"
-		"jnz            loop_start              \n\t"
-
-		:
-		: [from]"r"(from), [to]"r"(to), [cnt]"r"(n / SWAB_STEP)
-		//: "xmm0", "xmm1"
-	);
-
-	from = (unsigned char*) from + n - (n % SWAB_STEP);
-	to = (unsigned char*) to + n - (n % SWAB_STEP);
-	n = (n % SWAB_STEP);
+#if defined(USE_SSE2) && defined(__SSE2__)
+	const __m128i *s = (const __m128i*) from;
+	__m128i *d = (__m128i*) to;
+	for ( ; n >= 32; n -= 32, s += 2, d += 2 )
+	{
+		__m128i a = _mm_loadu_si128( s );
+		__m128i b = _mm_loadu_si128( s + 1 );
+		a = _mm_or_si128( _mm_slli_epi16( a, 8 ), _mm_srli_epi16( a, 8 ) );
+		b = _mm_or_si128( _mm_slli_epi16( b, 8 ), _mm_srli_epi16( b, 8 ) );
+		_mm_storeu_si128( d, a );
+		_mm_storeu_si128( d + 1, b );
+	}
+	from = s;
+	to = d;
 #endif
-	swab((char*) from, (char*) to, n);
-};
+	swab( (const char*) from, (char*) to, n );
+}
@@ -95,6 +95,17 @@ private:
 	pthread_t                   m_op_thread;
 	bool                        m_sliced_swab;
 	uint8_t*                    m_buffer;
+	int                         m_render_ahead;
+	bool                        m_rendering;
+	bool                        m_render_started;
+	pthread_t                   m_render_thread;
+	pthread_mutex_t             m_frames_lock;
+	pthread_cond_t              m_frames_cond;
+	int                         m_skipped;
+	int                         m_late;
+	int                         m_dropped;
+	mlt_metric                  m_metric_late;
+	mlt_metric                  m_metric_dropped;
 
 	IDeckLinkDisplayMode* getDisplayMode()
 	{
@@ -142,6 +153,12 @@ public:
 		m_aqueue = mlt_deque_init();
 		m_frames = mlt_deque_init();
 		m_buffer = NULL;
+		m_rendering = false;
+		m_render_started = false;
+		m_metric_late = NULL;
+		m_metric_dropped = NULL;
+		pthread_mutex_init( &m_frames_lock, NULL );
+		pthread_cond_init( &m_frames_cond, NULL );
 
 		// operation locks
 		m_op_id = OP_NONE;
@@ -173,6 +190,9 @@ public:
 		pthread_join(m_op_thread, NULL);
 		mlt_log_debug( getConsumer(), "%s: finished op thread\n", __FUNCTION__ );
 
+		stopRenderThread();
+		pthread_mutex_destroy( &m_frames_lock );
+		pthread_cond_destroy( &m_frames_cond );
 		pthread_mutex_destroy( &m_aqueue_lock );
 		pthread_mutex_destroy(&m_op_lock);
 		pthread_mutex_destroy(&m_op_arg_mutex);
@@ -270,6 +290,54 @@ protected:
 		return NULL;
 	}
 
+	// The render-ahead thread converts and schedules a frame whenever the
+	// card returns one, so the completion callback never waits on rendering.
+	static void* render_main( void* thisptr )
+	{
+		DeckLinkConsumer* d = static_cast<DeckLinkConsumer*>( thisptr );
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( d->getConsumer() );
+
+		d->reprio( 1 );
+		for (;;)
+		{
+			pthread_mutex_lock( &d->m_frames_lock );
+			while ( d->m_rendering && !mlt_deque_count( d->m_frames ) )
+				pthread_cond_wait( &d->m_frames_cond, &d->m_frames_lock );
+			bool rendering = d->m_rendering;
+			d->m_count += d->m_skipped;
+			d->m_skipped = 0;
+			pthread_mutex_unlock( &d->m_frames_lock );
+
+			if ( !rendering || !mlt_properties_get_int( properties, "running" ) )
+				break;
+			d->ScheduleNextFrame( false );
+		}
+		return NULL;
+	}
+
+	void startRenderThread()
+	{
+		m_rendering = true;
+		m_render_started = !pthread_create( &m_render_thread, NULL, render_main, this );
+	}
+
+	void stopRenderThread()
+	{
+		if ( !m_render_started )
+			return;
+		pthread_mutex_lock( &m_frames_lock );
+		m_rendering = false;
+		pthread_cond_broadcast( &m_frames_cond );
+		pthread_mutex_unlock( &m_frames_lock );
+
+		// The thread itself stops when a paused frame terminates the consumer.
+		if ( pthread_equal( m_render_thread, pthread_self() ) )
+			pthread_detach( m_render_thread );
+		else
+			pthread_join( m_render_thread, NULL );
+		m_render_started = false;
+	}
+
 	bool open( unsigned card = 0 )
 	{
 		unsigned i = 0;
@@ -370,6 +438,9 @@ protected:
 		else
 			m_deckLinkOutput->StartScheduledPlayback( 0, m_timescale, 1.0 );
 
+		if ( m_render_ahead > 0 )
+			startRenderThread();
+
 		mlt_log_debug( getConsumer(), "%s: exiting\n", __FUNCTION__ );
 
 		return 0;
@@ -380,9 +451,20 @@ protected:
 		mlt_properties properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
 
 		// Initialize members
+		stopRenderThread();
 		m_count = 0;
 		m_buffer = NULL;
+		m_skipped = 0;
+		m_late = 0;
+		m_dropped = 0;
+		mlt_properties_set_int( properties, "late", 0 );
+		mlt_properties_set_int( properties, "dropped", 0 );
+		m_metric_late = mlt_metrics_service( mlt_metric_counter, "mlt_decklink_frames_late_total",
+			"Frames the card displayed late.", MLT_CONSUMER_SERVICE( getConsumer() ) );
+		m_metric_dropped = mlt_metrics_service( mlt_metric_counter, "mlt_decklink_frames_dropped_total",
+			"Frames the card dropped.", MLT_CONSUMER_SERVICE( getConsumer() ) );
 		preroll = preroll < PREROLL_MINIMUM ? PREROLL_MINIMUM : preroll;
+		m_render_ahead = MAX( mlt_properties_get_int( properties, "render_ahead" ), 0 );
 		m_inChannels = mlt_properties_get_int( properties, "channels" );
 		if( m_inChannels <= 2 )
 		{
@@ -443,7 +525,7 @@ protected:
 		m_preroll = preroll;
 		m_reprio = 2;
 
-		for ( unsigned i = 0; i < ( m_preroll + 2 ) ; i++)
+		for ( unsigned i = 0; i < ( m_preroll + 2 + m_render_ahead ) ; i++)
 		{
 			IDeckLinkMutableVideoFrame* frame;
 
@@ -470,6 +552,8 @@ protected:
 
 		mlt_log_debug( getConsumer(), "%s: starting\n", __FUNCTION__ );
 
+		stopRenderThread();
+
 		// Stop the audio and video output streams immediately
 		if ( m_deckLinkOutput )
 		{
@@ -484,8 +568,10 @@ protected:
 		pthread_mutex_unlock( &m_aqueue_lock );
 
 		m_buffer = NULL;
+		pthread_mutex_lock( &m_frames_lock );
 		while ( IDeckLinkMutableVideoFrame* frame = (IDeckLinkMutableVideoFrame*) mlt_deque_pop_back( m_frames ) )
 			SAFE_RELEASE( frame );
+		pthread_mutex_unlock( &m_frames_lock );
 
 		// set running state is 0
 		mlt_properties_set_int( properties, "running", 0 );
@@ -518,8 +604,10 @@ protected:
 		mlt_properties consumer_properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
 		int stride = m_width * ( m_isKeyer? 4 : 2 );
 		int height = m_height;
+		pthread_mutex_lock( &m_frames_lock );
 		IDeckLinkMutableVideoFrame* decklinkFrame =
 			static_cast<IDeckLinkMutableVideoFrame*>( mlt_deque_pop_front( m_frames ) );
+		pthread_mutex_unlock( &m_frames_lock );
 		
 		mlt_log_debug( getConsumer(), "%s: entering\n", __FUNCTION__ );
 
@@ -792,8 +880,31 @@ protected:
 	virtual HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted( IDeckLinkVideoFrame* completedFrame, BMDOutputFrameCompletionResult completed )
 	{
 		mlt_log_debug( getConsumer(), "%s: ENTERING\n", __FUNCTION__ );
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
 
+		pthread_mutex_lock( &m_frames_lock );
 		mlt_deque_push_back( m_frames, completedFrame );
+		if ( bmdOutputFrameDropped == completed && m_render_started )
+			m_skipped++;
+		pthread_cond_broadcast( &m_frames_cond );
+		pthread_mutex_unlock( &m_frames_lock );
+
+		if ( bmdOutputFrameDisplayedLate == completed )
+		{
+			mlt_log_verbose( getConsumer(), "ScheduledFrameCompleted: bmdOutputFrameDisplayedLate == completed\n" );
+			mlt_properties_set_int( properties, "late", ++m_late );
+			mlt_metrics_add( m_metric_late, 1 );
+		}
+		if ( bmdOutputFrameDropped == completed )
+		{
+			mlt_log_verbose( getConsumer(), "ScheduledFrameCompleted: bmdOutputFrameDropped == completed\n" );
+			mlt_properties_set_int( properties, "dropped", ++m_dropped );
+			mlt_metrics_add( m_metric_dropped, 1 );
+		}
+
+		// The render-ahead thread schedules the next frame.
+		if ( m_render_started )
+			return S_OK;
 
 		//  change priority of video callback thread
 		reprio( 1 );
@@ -808,13 +919,8 @@ protected:
 		ScheduleNextFrame( false );
 
 		// step forward frames counter if underrun
-		if ( bmdOutputFrameDisplayedLate == completed )
-		{
-			mlt_log_verbose( getConsumer(), "ScheduledFrameCompleted: bmdOutputFrameDisplayedLate == completed\n" );
-		}
 		if ( bmdOutputFrameDropped == completed )
 		{
-			mlt_log_verbose( getConsumer(), "ScheduledFrameCompleted: bmdOutputFrameDropped == completed\n" );
 			m_count++;
 			ScheduleNextFrame( false );
 		}
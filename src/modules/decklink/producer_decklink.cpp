@@ -489,6 +489,17 @@ public:
 			return S_OK;
 		}
 
+		// Drop the frame before converting it if the queue is already full.
+		int queueMax = mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( getProducer() ), "buffer" );
+		pthread_mutex_lock( &m_mutex );
+		if ( mlt_deque_count( m_queue ) >= queueMax )
+		{
+			mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( getProducer() ), "dropped", ++m_dropped );
+			pthread_mutex_unlock( &m_mutex );
+			mlt_log_warning( getProducer(), "buffer overrun, frame dropped %d\n", m_dropped );
+			return S_OK;
+		}
+		pthread_mutex_unlock( &m_mutex );
 
 		// Copy video
 		if ( video )
@@ -642,7 +653,6 @@ public:
 		{
 			mlt_properties_set_int64( MLT_FRAME_PROPERTIES( frame ), "arrived",
 				arrived.tv_sec * 1000000LL + arrived.tv_usec );
-			int queueMax = mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( getProducer() ), "buffer" );
 			pthread_mutex_lock( &m_mutex );
 			if ( mlt_deque_count( m_queue ) < queueMax )
 			{
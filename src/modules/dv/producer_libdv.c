@@ -22,6 +22,7 @@
 #include <framework/mlt_deque.h>
 #include <framework/mlt_factory.h>
 #include <framework/mlt_profile.h>
+#include <framework/mlt_slices.h>
 
 #include <pthread.h>
 #include <stdlib.h>
@@ -31,6 +32,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #define FRAME_SIZE_525_60 	10 * 150 * 80
@@ -128,8 +130,67 @@ struct producer_libdv_s
 	int frame_size;
 	long frames_in_file;
 	mlt_producer alternative;
+	mlt_properties map;
+	uint64_t next_position;
 };
 
+/** The file mapped into memory, which the frames share until the last is closed.
+*/
+
+typedef struct
+{
+	uint8_t *data;
+	size_t size;
+}
+dv_file_map;
+
+static void dv_file_unmap( dv_file_map *map )
+{
+	munmap( map->data, map->size );
+	free( map );
+}
+
+/** Map a raw DV file, whose frames are all the same size, so that a frame
+ * is found at a computed offset without seeking or reading.
+ */
+
+static mlt_properties dv_file_map_open( int fd, uint64_t size )
+{
+	mlt_properties owner = NULL;
+	dv_file_map *map = size > 0 && size == ( size_t ) size ? malloc( sizeof( dv_file_map ) ) : NULL;
+
+	if ( map )
+	{
+		map->size = size;
+		map->data = mmap( NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		if ( map->data != MAP_FAILED && ( owner = mlt_properties_new( ) ) )
+		{
+			madvise( map->data, map->size, MADV_SEQUENTIAL );
+			mlt_properties_set_data( owner, "map", map, 0, ( mlt_destructor )dv_file_unmap, NULL );
+		}
+		else
+		{
+			if ( map->data != MAP_FAILED )
+				munmap( map->data, map->size );
+			free( map );
+		}
+	}
+	return owner;
+}
+
+/** An image decoded on the slices pool before the frame asks for it.
+*/
+
+typedef struct
+{
+	mlt_slices_runtime runtime;
+	uint8_t *dv_data;
+	char *quality;
+	uint8_t *image;
+	int size;
+}
+dv_decode_ahead;
+
 static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int index );
 static void producer_close( mlt_producer parent );
 
@@ -178,6 +239,9 @@ mlt_producer producer_libdv_init( mlt_profile profile, mlt_service_type type, co
 			// Collect info
 			if ( this->fd == -1 || !producer_collect_info( this, profile ) )
 				destroy = 1;
+			else
+				this->map = dv_file_map_open( this->fd, this->file_size );
+			mlt_properties_set_int( properties, "decode_ahead", 1 );
 		}
 
 		// If we couldn't open the file, then destroy it now
@@ -302,6 +366,65 @@ static int producer_collect_info( producer_libdv this, mlt_profile profile )
 	return valid;
 }
 
+static void set_quality( dv_decoder_t *decoder, const char *quality )
+{
+	if ( quality != NULL )
+	{
+		if ( strncmp( quality, "fast", 4 ) == 0 )
+			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_DC );
+		else if ( strncmp( quality, "best", 4 ) == 0 )
+			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_AC_2 );
+		else
+			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_AC_1 );
+	}
+}
+
+static int decode_ahead_proc( int id, int index, int jobs, void *cookie )
+{
+	dv_decode_ahead *ahead = cookie;
+	dv_decoder_t *decoder = dv_decoder_alloc( );
+	int pitches[3] = { 720 * 2, 0, 0 };
+	uint8_t *pixels[3] = { ahead->image, NULL, NULL };
+
+	set_quality( decoder, ahead->quality );
+	dv_parse_header( decoder, ahead->dv_data );
+	dv_decode_full_frame( decoder, ahead->dv_data, e_dv_color_yuv, pixels, pitches );
+	dv_decoder_return( decoder );
+	return 0;
+}
+
+static void decode_ahead_close( dv_decode_ahead *ahead )
+{
+	if ( ahead->runtime )
+		mlt_slices_wait( ahead->runtime );
+	mlt_pool_release( ahead->image );
+	free( ahead->quality );
+	free( ahead );
+}
+
+/** Start decoding the image of a frame so that frames decode in parallel
+ * even when the consumer asks for them one at a time.
+ */
+
+static void decode_ahead_start( mlt_frame frame, uint8_t *dv_data, const char *quality )
+{
+	dv_decode_ahead *ahead = calloc( 1, sizeof( dv_decode_ahead ) );
+
+	if ( ahead )
+	{
+		int height = dv_data[ 3 ] & 0x80 ? 576 : 480;
+		ahead->dv_data = dv_data;
+		ahead->quality = quality ? strdup( quality ) : NULL;
+		ahead->size = 720 * ( height + 1 ) * 2;
+		ahead->image = mlt_pool_alloc( ahead->size );
+		if ( ahead->image )
+			ahead->runtime = mlt_slices_submit_normal( 1, decode_ahead_proc, ahead );
+
+		// This is set after dv_data so that it is closed first, which waits for the decoder
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "_dv_ahead", ahead, 0, ( mlt_destructor )decode_ahead_close, NULL );
+	}
+}
+
 static int producer_get_image( mlt_frame this, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	int pitches[3] = { 0, 0, 0 };
@@ -318,16 +441,10 @@ static int producer_get_image( mlt_frame this, uint8_t **buffer, mlt_image_forma
 
 	// Get and set the quality request
 	char *quality = mlt_frame_pop_service( this );
+	set_quality( decoder, quality );
 
-	if ( quality != NULL )
-	{
-		if ( strncmp( quality, "fast", 4 ) == 0 )
-			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_DC );
-		else if ( strncmp( quality, "best", 4 ) == 0 )
-			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_AC_2 );
-		else
-			decoder->quality = ( DV_QUALITY_COLOR | DV_QUALITY_AC_1 );
-	}
+	// Get the image decoded ahead, if any
+	dv_decode_ahead *ahead = mlt_properties_get_data( properties, "_dv_ahead", NULL );
 
 	// Parse the header for meta info
 	dv_parse_header( decoder, dv_data );
@@ -337,7 +454,17 @@ static int producer_get_image( mlt_frame this, uint8_t **buffer, mlt_image_forma
 	*height = dv_data[ 3 ] & 0x80 ? 576 : 480;
 
 	// Extract an image of the format requested
-	if ( *format != mlt_image_rgb24 )
+	if ( *format != mlt_image_rgb24 && ahead && ahead->image && ahead->runtime )
+	{
+		// Wait for the decoder and take the image
+		mlt_slices_wait( ahead->runtime );
+		ahead->runtime = NULL;
+		mlt_frame_set_image( this, ahead->image, ahead->size, mlt_pool_release );
+		*buffer = ahead->image;
+		*format = mlt_image_yuv422;
+		ahead->image = NULL;
+	}
+	else if ( *format != mlt_image_rgb24 )
 	{
 		// Allocate an image
 		uint8_t *image = mlt_pool_alloc( *width * ( *height + 1 ) * 2 );
@@ -457,15 +584,31 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 	{
 		// Convert timecode to a file position (ensuring that we're on a frame boundary)
 		uint64_t offset = position * this->frame_size;
-
-		// Allocate space
-		data = mlt_pool_alloc( FRAME_SIZE_625_50 );
+		dv_file_map *map = this->map ? mlt_properties_get_data( this->map, "map", NULL ) : NULL;
 
 		// Create an empty frame
 		*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
 
+		if ( map )
+		{
+			// The frame refers to the mapped file, which it keeps open
+			if ( offset + FRAME_SIZE_525_60 <= map->size )
+			{
+				data = map->data + offset;
+				this->is_pal = data[3] & 0x80;
+				if ( this->is_pal && offset + FRAME_SIZE_625_50 > map->size )
+					data = NULL;
+			}
+			if ( data != NULL )
+			{
+				mlt_properties_inc_ref( this->map );
+				mlt_properties_set_data( MLT_FRAME_PROPERTIES( *frame ), "_dv_map", this->map, 0, ( mlt_destructor )mlt_properties_close, NULL );
+				mlt_properties_set_data( MLT_FRAME_PROPERTIES( *frame ), "dv_data", data, FRAME_SIZE_625_50, NULL, NULL );
+			}
+		}
 		// Seek and fetch
-		if ( this->fd != 0 && 
+		else if ( ( data = mlt_pool_alloc( FRAME_SIZE_625_50 ) ) &&
+			 this->fd != 0 &&
 		 	 lseek( this->fd, offset, SEEK_SET ) == offset &&
 		 	 read_frame( this->fd, data, &this->is_pal ) )
 		{
@@ -529,12 +672,19 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 
 			// Push the get_image method on to the stack
 			mlt_frame_push_get_image( *frame, producer_get_image );
+
+			// Decode on the slices pool while the frames are fetched in order
+			if ( this->alternative == NULL && position == this->next_position &&
+				 mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( producer ), "decode_ahead" ) )
+				decode_ahead_start( *frame, data, mlt_properties_get( MLT_PRODUCER_PROPERTIES( producer ), "quality" ) );
 		}
 	
 		// Return the decoder
 		dv_decoder_return( dv_decoder );
 	}
 
+	this->next_position = position + 1;
+
 	// Update timecode on the frame we're creating
 	if ( *frame != NULL )
 		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
@@ -550,7 +700,8 @@ static void producer_close( mlt_producer parent )
 	// Obtain this
 	producer_libdv this = parent->child;
 
-	// Close the file
+	// Close the file, which stays mapped for the frames that remain
+	mlt_properties_close( this->map );
 	if ( this->fd > 0 )
 		close( this->fd );
 
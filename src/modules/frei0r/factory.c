@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <math.h>
+#include <errno.h>
 
 
 #if defined(_WIN32)
@@ -396,6 +397,63 @@ static void * create_frei0r_item ( mlt_profile profile, mlt_service_type type, c
 }
 
 
+/** Get the type of a plugin without opening it when it is in the discovery cache.
+ *
+ * The cache is keyed by the plugin file, its size and modification time, so
+ * an updated plugin is opened again. The directory is $MLT_FREI0R_CACHE_DIR,
+ * or else mlt/frei0r in $XDG_CACHE_HOME or $HOME/.cache.
+ * \return the frei0r plugin type or -1 if it is not a plugin
+ */
+
+static int get_plugin_type( const char *name )
+{
+	char *cachename = mlt_cache_filename( name, "MLT_FREI0R_CACHE_DIR", "frei0r", ".txt", 0 );
+	mlt_properties cache = cachename ? mlt_properties_load( cachename ) : NULL;
+	int type = -1;
+
+	if ( cache && mlt_properties_get( cache, "plugin_type" ) )
+	{
+		type = mlt_properties_get_int( cache, "plugin_type" );
+	}
+	else
+	{
+		void* handle=dlopen(name,RTLD_LAZY);
+		if (handle){
+			void (*plginfo)(f0r_plugin_info_t*)=dlsym(handle,"f0r_get_plugin_info");
+
+			if (plginfo){
+				f0r_plugin_info_t info;
+				plginfo(&info);
+				type = info.plugin_type;
+			}
+			dlclose(handle);
+		}
+
+		// Only remember the plugins, a file that fails to open may get its dependencies later
+		free( cachename );
+		cachename = type >= 0 ? mlt_cache_filename( name, "MLT_FREI0R_CACHE_DIR", "frei0r", ".txt", 1 ) : NULL;
+		if ( cache && cachename )
+		{
+			// Write to a temporary file and rename it so readers never see a partial cache.
+			char *temp = malloc( strlen( cachename ) + 8 );
+			mlt_properties_set_int( cache, "plugin_type", type );
+			if ( temp )
+			{
+				sprintf( temp, "%s.%d", cachename, rand( ) % 100000 );
+				if ( mlt_properties_save( cache, temp ) || rename( temp, cachename ) )
+				{
+					mlt_log_warning( NULL, "[frei0r] failed to save discovery cache %s: %s\n", cachename, strerror( errno ) );
+					remove( temp );
+				}
+				free( temp );
+			}
+		}
+	}
+	mlt_properties_close( cache );
+	free( cachename );
+	return type;
+}
+
 MLT_REPOSITORY
 {
 	int i=0;
@@ -443,42 +501,24 @@ MLT_REPOSITORY
 			if ( firstname && mlt_properties_get( blacklist, firstname ) )
 				continue;
 
-			void* handle=dlopen(strcat(name, LIBSUF),RTLD_LAZY);
-			if (handle){
-				void (*plginfo)(f0r_plugin_info_t*)=dlsym(handle,"f0r_get_plugin_info");
-
-				if (plginfo){
-					f0r_plugin_info_t info;
-					plginfo(&info);
-					if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_SOURCE){
-						if (mlt_properties_get(mlt_repository_producers(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( producer_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( producer_type, pluginname, fill_param_info, name );
-					}
-					else if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_FILTER){
-						if (mlt_properties_get(mlt_repository_filters(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( filter_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( filter_type, pluginname, fill_param_info, name );
-					}
-					else if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_MIXER2 ){
-						if (mlt_properties_get(mlt_repository_transitions(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( transition_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( transition_type, pluginname, fill_param_info, name );
-					}
-				}
-				dlclose(handle);
+			int type = get_plugin_type( strcat( name, LIBSUF ) );
+			if (firstname && type==F0R_PLUGIN_TYPE_SOURCE){
+				if (mlt_properties_get(mlt_repository_producers(repository), pluginname))
+					continue;
+				MLT_REGISTER( producer_type, pluginname, create_frei0r_item );
+				MLT_REGISTER_METADATA( producer_type, pluginname, fill_param_info, name );
+			}
+			else if (firstname && type==F0R_PLUGIN_TYPE_FILTER){
+				if (mlt_properties_get(mlt_repository_filters(repository), pluginname))
+					continue;
+				MLT_REGISTER( filter_type, pluginname, create_frei0r_item );
+				MLT_REGISTER_METADATA( filter_type, pluginname, fill_param_info, name );
+			}
+			else if (firstname && type==F0R_PLUGIN_TYPE_MIXER2 ){
+				if (mlt_properties_get(mlt_repository_transitions(repository), pluginname))
+					continue;
+				MLT_REGISTER( transition_type, pluginname, create_frei0r_item );
+				MLT_REGISTER_METADATA( transition_type, pluginname, fill_param_info, name );
 			}
 		}
 		mlt_factory_register_for_clean_up(direntries, (mlt_destructor) mlt_properties_close);
@@ -21,55 +21,164 @@
 #include <string.h>
 #include <stdlib.h>
 
-static void rgba_bgra( uint8_t *src, uint8_t* dst, int width, int height )
+static void rgba_bgra( uint32_t *src, uint32_t* dst, int width, int height )
 {
+	uint8_t *s = (uint8_t*) src;
+	uint8_t *d = (uint8_t*) dst;
 	int n = width * height + 1;
 
 	while ( --n )
 	{
-		*dst++ = src[2];
-		*dst++ = src[1];
-		*dst++ = src[0];
-		*dst++ = src[3];
-		src += 4;
-	}	
+		*d++ = s[2];
+		*d++ = s[1];
+		*d++ = s[0];
+		*d++ = s[3];
+		s += 4;
+	}
 }
 
 struct update_context {
-	f0r_instance_t frei0r;
+	f0r_instance_t *instances;
 	int width;
 	int height;
+	int slice_height;
 	double time;
 	uint32_t* inputs[2];
+	uint32_t* swapped[2];
 	uint32_t* output;
+	uint32_t* result;
+	int bgra;
 	void (*f0r_update)  (f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe);
 	void (*f0r_update2) (f0r_instance_t instance, double time, const uint32_t* inframe1,
 						 const uint32_t* inframe2,const uint32_t* inframe3, uint32_t* outframe);
 };
 
+/** Update one horizontal slice of the image with its own plugin instance.
+ *
+ * The last slice also gets the rows left over by the division. For plugins
+ * that use BGRA, the channels of the slice are swapped on the way in and out
+ * while the rows are still in cache.
+ */
+
 static int f0r_update_slice( int id, int index, int count, void *context )
 {
 	struct update_context *ctx = context;
-	int slice_height = ctx->height / count;
-	int slice_bytes = ctx->width * slice_height;
-	uint32_t *input = ctx->inputs[0] + index * slice_bytes;
-	uint32_t *output = ctx->output + index * slice_bytes;
-	ctx->f0r_update(ctx->frei0r, ctx->time, input, output);
+	int offset = ctx->width * ctx->slice_height * index;
+	int height = index == count - 1 ? ctx->height - ctx->slice_height * index : ctx->slice_height;
+	uint32_t *inputs[2] = { NULL, NULL };
+	uint32_t *output = ctx->output + offset;
+	int i;
+
+	for ( i = 0; i < 2; i++ ) {
+		if ( ctx->inputs[i] ) {
+			inputs[i] = ctx->inputs[i] + offset;
+			if ( ctx->bgra ) {
+				rgba_bgra( inputs[i], ctx->swapped[i] + offset, ctx->width, height );
+				inputs[i] = ctx->swapped[i] + offset;
+			}
+		}
+	}
+	if ( ctx->f0r_update2 )
+		ctx->f0r_update2( ctx->instances[index], ctx->time, inputs[0], inputs[1], NULL, output );
+	else
+		ctx->f0r_update( ctx->instances[index], ctx->time, inputs[0], output );
+	if ( ctx->bgra )
+		rgba_bgra( output, ctx->result + offset, ctx->width, height );
 	return 0;
 }
 
-static int f0r_update2_slice( int id, int index, int count, void *context )
+/** Take an instance of the given size from the pool of the service.
+ *
+ * The caller must hold the service lock. Each frame or slice rendered at the
+ * same time uses an instance of its own, so that neither the parameters nor
+ * the state of one leak into another.
+ */
+
+static f0r_instance_t acquire_instance( mlt_properties prop, int width, int height )
 {
-	struct update_context *ctx = context;
-	int slice_height = ctx->height / count;
-	int slice_bytes = ctx->width * slice_height;
-	uint32_t *inputs[2] = {
-		ctx->inputs[0] + index * slice_bytes,
-		ctx->inputs[1] + index * slice_bytes
-	};
-	uint32_t *output = ctx->output + index * slice_bytes;
-	ctx->f0r_update2(ctx->frei0r, ctx->time, inputs[0], inputs[1], NULL, output);
-	return 0;
+	f0r_instance_t ( *f0r_construct ) ( unsigned int , unsigned int ) = mlt_properties_get_data( prop, "f0r_construct", NULL );
+	char name[64];
+	snprintf( name, sizeof(name), "pool-%dx%d", width, height );
+	mlt_deque pool = mlt_properties_get_data( prop, name, NULL );
+	if ( !pool ) {
+		pool = mlt_deque_init();
+		mlt_properties_set_data( prop, name, pool, 0, NULL, NULL );
+	}
+	f0r_instance_t inst = mlt_deque_pop_back( pool );
+	return inst ? inst : f0r_construct( width, height );
+}
+
+/** Return an instance to the pool of the service.
+ *
+ * The caller must hold the service lock.
+ */
+
+static void release_instance( mlt_properties prop, f0r_instance_t inst, int width, int height )
+{
+	char name[64];
+	snprintf( name, sizeof(name), "pool-%dx%d", width, height );
+	mlt_deque_push_back( mlt_properties_get_data( prop, name, NULL ), inst );
+}
+
+static void set_params( mlt_properties prop, f0r_instance_t inst, f0r_plugin_info_t *info, double position, int length )
+{
+	void (*f0r_get_param_info)(f0r_param_info_t* info, int param_index)=mlt_properties_get_data( prop ,  "f0r_get_param_info" ,NULL);
+	void (*f0r_set_param_value)(f0r_instance_t instance, f0r_param_t param, int param_index)=mlt_properties_get_data(  prop , "f0r_set_param_value" ,NULL);
+	int i;
+
+	for (i=0;i<info->num_params;i++){
+		f0r_param_info_t pinfo;
+		f0r_get_param_info(&pinfo,i);
+		char index[20];
+		snprintf( index, sizeof(index), "%d", i );
+		const char *name = index;
+		char *val = mlt_properties_get( prop , name );
+		if ( !val ) {
+			name = pinfo.name;
+			val = mlt_properties_get( prop , name );
+		}
+		if ( !val ) {
+			// Use the backwards-compatibility param name map.
+			mlt_properties map = mlt_properties_get_data( prop, "_param_name_map", NULL );
+			if ( map ) {
+				int j;
+				for ( j = 0; !val && j < mlt_properties_count(map); j++ ) {
+					if ( !strcmp(mlt_properties_get_value(map, j), index) ) {
+						name = mlt_properties_get_name(map, j);
+						val = mlt_properties_get( prop , name );
+					}
+				}
+			}
+		}
+		if ( val ) {
+			switch (pinfo.type) {
+				case F0R_PARAM_DOUBLE:
+				case F0R_PARAM_BOOL:
+				{
+					double t = mlt_properties_anim_get_double(prop, name, position, length);
+					f0r_set_param_value(inst,&t,i);
+					break;
+				}
+				case F0R_PARAM_COLOR:
+				{
+					f0r_param_color_t f_color;
+					mlt_color m_color = mlt_properties_get(prop, index) ?
+						mlt_properties_get_color(prop, index) : mlt_properties_get_color(prop, pinfo.name);
+					f_color.r = (float) m_color.r / 255.0f;
+					f_color.g = (float) m_color.g / 255.0f;
+					f_color.b = (float) m_color.b / 255.0f;
+					f0r_set_param_value(inst, &f_color, i);
+					break;
+				}
+				case F0R_PARAM_STRING:
+				{
+					val = mlt_properties_anim_get(prop, name, position, length);
+					f0r_set_param_value(inst, &val, i);
+					break;
+				}
+			}
+		}
+	}
 }
 
 int process_frei0r_item( mlt_service service, double position, double time, int length, mlt_frame frame, uint8_t **image, int *width, int *height )
@@ -83,8 +192,6 @@ int process_frei0r_item( mlt_service service, double position, double time, int
 	}
 	void (*f0r_update)(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)=mlt_properties_get_data(  prop , "f0r_update" ,NULL);
 	void (*f0r_get_plugin_info)(f0r_plugin_info_t*)=mlt_properties_get_data( prop, "f0r_get_plugin_info" ,NULL);
-	void (*f0r_get_param_info)(f0r_param_info_t* info, int param_index)=mlt_properties_get_data( prop ,  "f0r_get_param_info" ,NULL);
-	void (*f0r_set_param_value)(f0r_instance_t instance, f0r_param_t param, int param_index)=mlt_properties_get_data(  prop , "f0r_set_param_value" ,NULL);
 	void (*f0r_update2) (f0r_instance_t instance, double time,
 			 const uint32_t* inframe1,const uint32_t* inframe2,const uint32_t* inframe3,
 			 uint32_t* outframe) = mlt_properties_get_data(  prop , "f0r_update2" ,NULL);
@@ -92,21 +199,26 @@ int process_frei0r_item( mlt_service service, double position, double time, int
 	int not_thread_safe = mlt_properties_get_int( prop, "_not_thread_safe" );
 	int slice_count = mlt_properties_get(prop, "threads") ? mlt_properties_get_int(prop, "threads") : -1;
 
+	if ( type == transition_type && !f0r_update2 )
+		return -1;
+
+	// Slices run at the same time, which a plugin that is not thread safe cannot do
 	if (slice_count >= 0)
 		slice_count = CLAMP(slice_count, 0, mlt_slices_count_normal());
+	if ( slice_count <= 0 || not_thread_safe || *height / slice_count == 0 )
+		slice_count = 1;
 
-	//use as name the width and height
-	int slice_height = *height / (slice_count > 0? slice_count : 1);
-	char ctorname[1024] = "";
-	sprintf(ctorname, "ctor-%dx%d", *width, slice_height);
+	// Each slice gets an instance of its own, the last is taller by the remainder
+	int slice_height = *height / slice_count;
+	int last_height = *height - slice_height * ( slice_count - 1 );
+	f0r_instance_t *instances = calloc( slice_count, sizeof(f0r_instance_t) );
+	if ( !instances )
+		return -1;
 
 	mlt_service_lock( service );
 
-	f0r_instance_t inst = mlt_properties_get_data(prop, ctorname, NULL);
-	if (!inst) {
-		inst = f0r_construct(*width, slice_height);
-		mlt_properties_set_data(prop, ctorname, inst, 0, NULL, NULL);
-	}
+	for ( i = 0; i < slice_count; i++ )
+		instances[i] = acquire_instance( prop, *width, i == slice_count - 1 ? last_height : slice_height );
 
 	if ( !not_thread_safe )
 		mlt_service_unlock( service );
@@ -115,132 +227,54 @@ int process_frei0r_item( mlt_service service, double position, double time, int
 	memset(&info, 0, sizeof(info));
 	if (f0r_get_plugin_info) {
 		f0r_get_plugin_info(&info);
-		for (i=0;i<info.num_params;i++){
-			f0r_param_info_t pinfo;
-			f0r_get_param_info(&pinfo,i);
-			char index[20];
-			snprintf( index, sizeof(index), "%d", i );
-			const char *name = index;
-			char *val = mlt_properties_get( prop , name );
-			if ( !val ) {
-				name = pinfo.name;
-				val = mlt_properties_get( prop , name );
-			}
-			if ( !val ) {
-				// Use the backwards-compatibility param name map.
-				mlt_properties map = mlt_properties_get_data( prop, "_param_name_map", NULL );
-				if ( map ) {
-					int j;
-					for ( j = 0; !val && j < mlt_properties_count(map); j++ ) {
-						if ( !strcmp(mlt_properties_get_value(map, j), index) ) {
-							name = mlt_properties_get_name(map, j);
-							val = mlt_properties_get( prop , name );
-						}
-					}
-				}
-			}
-			if ( val ) {
-				switch (pinfo.type) {
-					case F0R_PARAM_DOUBLE:
-					case F0R_PARAM_BOOL:
-					{
-						double t = mlt_properties_anim_get_double(prop, name, position, length);
-						f0r_set_param_value(inst,&t,i);
-						break;
-					}
-					case F0R_PARAM_COLOR:
-					{
-						f0r_param_color_t f_color;
-						mlt_color m_color = mlt_properties_get(prop, index) ?
-							mlt_properties_get_color(prop, index) : mlt_properties_get_color(prop, pinfo.name);
-						f_color.r = (float) m_color.r / 255.0f;
-						f_color.g = (float) m_color.g / 255.0f;
-						f_color.b = (float) m_color.b / 255.0f;
-						f0r_set_param_value(inst, &f_color, i);
-						break;
-					}
-					case F0R_PARAM_STRING:
-					{
-						val = mlt_properties_anim_get(prop, name, position, length);
-						f0r_set_param_value(inst, &val, i);
-						break;
-					}
-				}
-			}
-		}
+		for ( i = 0; i < slice_count; i++ )
+			set_params( prop, instances[i], &info, position, length );
 	}
 
 	int video_area = *width * *height;
 	uint32_t *result = mlt_pool_alloc( video_area * sizeof(uint32_t) );
 	uint32_t *extra = NULL;
-	uint32_t *source[2] = { (uint32_t*) image[0], (uint32_t*) image[1] };
-	uint32_t *dest = result;
-
-	if (info.color_model == F0R_COLOR_MODEL_BGRA8888) {
-		rgba_bgra(image[0], (uint8_t*) result, *width, *height);
-		source[0] = result;
-		dest = (uint32_t*) image[0];
-		if (type == producer_type) {
-			extra = mlt_pool_alloc( video_area * sizeof(uint32_t) );
-			dest = extra;
-		}
-		else if (type == transition_type && f0r_update2) {
+	struct update_context ctx = {
+		.instances = instances,
+		.width = *width,
+		.height = *height,
+		.slice_height = slice_height,
+		.time = time,
+		.inputs = { NULL, NULL },
+		.swapped = { result, NULL },
+		.output = result,
+		.result = result,
+		.bgra = info.color_model == F0R_COLOR_MODEL_BGRA8888,
+		.f0r_update = f0r_update,
+		.f0r_update2 = type == transition_type ? f0r_update2 : NULL
+	};
+
+	if (type != producer_type)
+		ctx.inputs[0] = (uint32_t*) image[0];
+	if (type == transition_type)
+		ctx.inputs[1] = (uint32_t*) image[1];
+	if (ctx.bgra) {
+		// The swapped input replaces the image, which receives the output instead
+		ctx.output = (uint32_t*) image[0];
+		if (type == producer_type || type == transition_type)
 			extra = mlt_pool_alloc( video_area * sizeof(uint32_t) );
-			rgba_bgra(image[1], (uint8_t*) extra, *width, *height);
-			source[1] = extra;
-		}
-	}
-	if (type==producer_type) {
-		if (slice_count > 0) {
-			struct update_context ctx = {
-				.frei0r = inst,
-				.width = *width,
-				.height = *height,
-				.time = time,
-				.inputs = { NULL, NULL },
-				.output = dest,
-				.f0r_update = f0r_update
-			};
-			mlt_slices_run_normal(slice_count, f0r_update_slice, &ctx);
-		} else {
-			f0r_update ( inst, time, source[0], dest );
-		}
-	} else if (type==filter_type) {
-		if (slice_count > 0) {
-			struct update_context ctx = {
-				.frei0r = inst,
-				.width = *width,
-				.height = *height,
-				.time = time,
-				.inputs = { source[0], NULL },
-				.output = dest,
-				.f0r_update = f0r_update
-			};
-			mlt_slices_run_normal(slice_count, f0r_update_slice, &ctx);
-		} else {
-			f0r_update ( inst, time, source[0], dest );
-		}
-	} else if (type==transition_type && f0r_update2 ) {
-		if (slice_count > 0) {
-			struct update_context ctx = {
-				.frei0r = inst,
-				.width = *width,
-				.height = *height,
-				.time = time,
-				.inputs = { source[0], source[1] },
-				.output = dest,
-				.f0r_update2 = f0r_update2
-			};
-			mlt_slices_run_normal(slice_count, f0r_update2_slice, &ctx);
-		} else {
-			f0r_update2 ( inst, time, source[0], source[1], NULL, dest );
-		}
-	}
-	if ( not_thread_safe )
-		mlt_service_unlock( service );
-	if (info.color_model == F0R_COLOR_MODEL_BGRA8888) {
-		rgba_bgra((uint8_t*) dest, (uint8_t*) result, *width, *height);
+		if (type == producer_type)
+			ctx.output = extra;
+		ctx.swapped[1] = extra;
 	}
+
+	if (slice_count > 1)
+		mlt_slices_run_normal(slice_count, f0r_update_slice, &ctx);
+	else
+		f0r_update_slice(0, 0, 1, &ctx);
+
+	if ( !not_thread_safe )
+		mlt_service_lock( service );
+	for ( i = 0; i < slice_count; i++ )
+		release_instance( prop, instances[i], *width, i == slice_count - 1 ? last_height : slice_height );
+	mlt_service_unlock( service );
+	free( instances );
+
 	*image = (uint8_t*) result;
 	mlt_frame_set_image(frame, (uint8_t*) result, video_area * sizeof(uint32_t), mlt_pool_release);
 	if (extra)
@@ -255,17 +289,21 @@ void destruct (mlt_properties prop ) {
 	void (*f0r_deinit)(void)=mlt_properties_get_data ( prop , "f0r_deinit" , NULL);
 	int i=0;
 
-	if ( f0r_deinit != NULL )
-		f0r_deinit();
-
 	for ( i=0 ; i < mlt_properties_count ( prop ) ; i++ ){
-		if ( strstr ( mlt_properties_get_name ( prop , i ) , "ctor-" ) != NULL ){
-			void * inst=mlt_properties_get_data( prop , mlt_properties_get_name ( prop , i ) , NULL );
-			if ( inst != NULL ){
-				f0r_destruct( (f0r_instance_t) inst);
+		if ( strstr ( mlt_properties_get_name ( prop , i ) , "pool-" ) != NULL ){
+			mlt_deque pool = mlt_properties_get_data( prop , mlt_properties_get_name ( prop , i ) , NULL );
+			f0r_instance_t inst;
+			if ( pool ) {
+				while ( ( inst = mlt_deque_pop_back( pool ) ) )
+					f0r_destruct( inst );
+				mlt_deque_close( pool );
 			}
 		}
 	}
+
+	if ( f0r_deinit != NULL )
+		f0r_deinit();
+
 	void (*dlclose)(void*)=mlt_properties_get_data ( prop , "_dlclose" , NULL);
 	void *handle=mlt_properties_get_data ( prop , "_dlclose_handle" , NULL);
 
@@ -47,6 +47,7 @@ struct pango_cached_image_s
 	uint8_t *image, *alpha;
 	mlt_image_format format;
 	int width, height;
+	mlt_rect alpha_box;
 };
 
 static void pango_cached_image_destroy( void* p )
@@ -662,6 +663,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				size = cached->width * cached->height;
 				cached->alpha = mlt_pool_alloc( size );
 				memcpy( cached->alpha, buf, size );
+				cached->alpha_box = mlt_image_alpha_box( cached->alpha, cached->width, cached->height );
 			}
 		}
 
@@ -683,6 +685,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				buf = mlt_pool_alloc( size );
 				memcpy( buf, cached->alpha, size );
 				mlt_frame_set_alpha( frame, buf, size, mlt_pool_release );
+				mlt_frame_set_alpha_box( frame, cached->alpha_box, cached->width, cached->height );
 			}
 		}
 
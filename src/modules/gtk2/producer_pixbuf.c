@@ -22,6 +22,7 @@
 #include <framework/mlt_cache.h>
 #include <framework/mlt_log.h>
 #include <framework/mlt_tokeniser.h>
+#include <framework/mlt_slices.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
 #ifdef USE_EXIF
@@ -36,14 +37,31 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <ctype.h>
 
 // this protects concurrent access to gdk_pixbuf
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// the most images of a sequence that are decoded ahead
+#define PREFETCH_MAX (16)
+
 typedef struct producer_pixbuf_s *producer_pixbuf;
 
+typedef struct
+{
+	producer_pixbuf self;
+	int idx;
+	int disable_exif;
+	int width;
+	int height;
+	char *key;
+	mlt_slices_runtime runtime;
+	mlt_cache_item item;
+} pixbuf_prefetch;
+
 struct producer_pixbuf_s
 {
 	struct mlt_producer_s parent;
@@ -63,12 +81,17 @@ struct producer_pixbuf_s
 	mlt_cache_item pixbuf_cache;
 	GdkPixbuf *pixbuf;
 	mlt_image_format format;
+	int decode_width;
+	int decode_height;
+	pixbuf_prefetch prefetch[ PREFETCH_MAX ];
+	pthread_mutex_t prefetch_mutex;
 };
 
 static void load_filenames( producer_pixbuf self, mlt_properties producer_properties );
 static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame );
 static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int index );
 static void producer_close( mlt_producer parent );
+static void prefetch_reset( producer_pixbuf self );
 
 static void refresh_length( mlt_properties properties, producer_pixbuf self )
 {
@@ -119,6 +142,7 @@ mlt_producer producer_pixbuf_init( char *filename )
 		// Callback registration
 		producer->get_frame = producer_get_frame;
 		producer->close = ( mlt_destructor )producer_close;
+		pthread_mutex_init( &self->prefetch_mutex, NULL );
 
 		// Set the default properties
 		mlt_properties_set( properties, "resource", filename );
@@ -395,23 +419,27 @@ static void load_filenames( producer_pixbuf self, mlt_properties properties )
 	refresh_length( properties, self );
 }
 
-static GdkPixbuf* reorient_with_exif( producer_pixbuf self, int image_idx, GdkPixbuf *pixbuf )
+static int get_exif_orientation( const char *filename )
 {
+	int exif_orientation = 0;
 #ifdef USE_EXIF
-	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( &self->parent );
-	ExifData *d = exif_data_new_from_file( mlt_properties_get_value( self->filenames, image_idx ) );
+	ExifData *d = exif_data_new_from_file( filename );
 	ExifEntry *entry;
-	int exif_orientation = 0;
-
-	/* get orientation and rotate image accordingly if necessary */
-	if (d)
+	if ( d )
 	{
 		if ( ( entry = exif_content_get_entry ( d->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION ) ) )
 			exif_orientation = exif_get_short (entry->data, exif_data_get_byte_order (d));
-
-		/* Free the EXIF data */
-		exif_data_unref(d);
+		exif_data_unref( d );
 	}
+#endif
+	return exif_orientation;
+}
+
+static GdkPixbuf* reorient_with_exif( producer_pixbuf self, int image_idx, GdkPixbuf *pixbuf )
+{
+#ifdef USE_EXIF
+	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( &self->parent );
+	int exif_orientation = get_exif_orientation( mlt_properties_get_value( self->filenames, image_idx ) );
 
 	// Remember EXIF value, might be useful for someone
 	mlt_properties_set_int( producer_props, "_exif_orientation" , exif_orientation );
@@ -460,6 +488,306 @@ static GdkPixbuf* reorient_with_exif( producer_pixbuf self, int image_idx, GdkPi
 	return pixbuf;
 }
 
+/** Get the size of an image file and whether its loader may run without the global lock.
+ *
+ * gdk-pixbuf serializes the loaders that are not flagged thread-safe itself,
+ * so only the formats whose loaders are known to be flagged skip the lock.
+ */
+
+static int get_file_info( const char *filename, int *width, int *height )
+{
+	static const char *formats[] = { "png", "jpeg", "tiff", "bmp", "gif", "ico", "ani", "pnm",
+		"ras", "tga", "xbm", "xpm", "wbmp", "qtif", "icns", NULL };
+	int result = 0;
+	int i;
+
+	*width = *height = 0;
+	pthread_mutex_lock( &g_mutex );
+	GdkPixbufFormat *format = gdk_pixbuf_get_file_info( filename, width, height );
+	gchar *name = format ? gdk_pixbuf_format_get_name( format ) : NULL;
+	pthread_mutex_unlock( &g_mutex );
+	for ( i = 0; name && formats[i]; i++ )
+		if ( !strcmp( name, formats[i] ) )
+			result = 1;
+	g_free( name );
+	return result;
+}
+
+// Get the size of a picture as it is shown, after the exif rotation.
+static void get_media_size( producer_pixbuf self, int idx, int disable_exif, int *width, int *height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	int w, h;
+
+	get_file_info( filename, &w, &h );
+	if ( !disable_exif && get_exif_orientation( filename ) >= 5 )
+	{
+		int t = w;
+		w = h;
+		h = t;
+	}
+	if ( w > 0 && h > 0 )
+	{
+		*width = w;
+		*height = h;
+	}
+}
+
+/** Decode an image file from memory, scaled while it is decoded.
+ *
+ * The file is mapped rather than read through stdio, and when a size is
+ * given the loader scales it down while decoding, which the JPEG loader
+ * does with the DCT scaling of libjpeg.
+ */
+
+static GdkPixbuf *read_pixbuf( const char *filename, int width, int height, GError **error )
+{
+	GdkPixbuf *pixbuf = NULL;
+	struct stat buf;
+	void *data = MAP_FAILED;
+	int fd = open( filename, O_RDONLY );
+
+	if ( fd >= 0 && !fstat( fd, &buf ) && buf.st_size > 0 )
+		data = mmap( NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( fd >= 0 )
+		close( fd );
+
+	if ( data != MAP_FAILED )
+	{
+		GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+		if ( width > 0 && height > 0 )
+			gdk_pixbuf_loader_set_size( loader, width, height );
+		int written = gdk_pixbuf_loader_write( loader, data, buf.st_size, error );
+		if ( gdk_pixbuf_loader_close( loader, written ? error : NULL ) && written )
+		{
+			pixbuf = gdk_pixbuf_loader_get_pixbuf( loader );
+			if ( pixbuf )
+				g_object_ref( pixbuf );
+		}
+		g_object_unref( loader );
+		munmap( data, buf.st_size );
+	}
+	else if ( width > 0 && height > 0 )
+	{
+		pixbuf = gdk_pixbuf_new_from_file_at_scale( filename, width, height, FALSE, error );
+	}
+	else
+	{
+		pixbuf = gdk_pixbuf_new_from_file( filename, error );
+	}
+	return pixbuf;
+}
+
+/** Decode a picture at the smallest size that covers the given one.
+ *
+ * Without a size, or when the picture is not larger, it is decoded in full.
+ */
+
+static GdkPixbuf *load_pixbuf( producer_pixbuf self, int idx, int disable_exif, int width, int height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	int file_width, file_height;
+	int threadsafe = get_file_info( filename, &file_width, &file_height );
+	int decode_width = 0;
+	int decode_height = 0;
+	GError *error = NULL;
+	GdkPixbuf *pixbuf;
+
+	if ( width > 0 && height > 0 && file_width > 0 && file_height > 0 )
+	{
+		// The size is that of the picture as it is shown
+		if ( !disable_exif && get_exif_orientation( filename ) >= 5 )
+		{
+			int t = width;
+			width = height;
+			height = t;
+		}
+		double scale = MAX( (double) width / file_width, (double) height / file_height );
+		if ( scale < 1.0 )
+		{
+			decode_width = MAX( 1, ceil( file_width * scale ) );
+			decode_height = MAX( 1, ceil( file_height * scale ) );
+		}
+	}
+
+	if ( !threadsafe )
+		pthread_mutex_lock( &g_mutex );
+	pixbuf = read_pixbuf( filename, decode_width, decode_height, &error );
+	// Read the exif value for this file
+	if ( pixbuf && !disable_exif )
+		pixbuf = reorient_with_exif( self, idx, pixbuf );
+	if ( !threadsafe )
+		pthread_mutex_unlock( &g_mutex );
+	if ( error )
+		g_error_free( error );
+	return pixbuf;
+}
+
+// Get the key of a decoded image in the shared data cache, which changes with the file.
+static char *pixbuf_key( producer_pixbuf self, int idx, int disable_exif, int width, int height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	struct stat buf;
+	char *key;
+
+	if ( !filename || stat( filename, &buf ) )
+		return NULL;
+	key = malloc( strlen( filename ) + 80 );
+	if ( key )
+		sprintf( key, "pixbuf:%s:%lld:%lld:%d:%dx%d", filename, (long long) buf.st_mtime, (long long) buf.st_size,
+			disable_exif, width, height );
+	return key;
+}
+
+static mlt_cache_item cache_pixbuf( const char *key, GdkPixbuf *pixbuf )
+{
+	int size = gdk_pixbuf_get_rowstride( pixbuf ) * gdk_pixbuf_get_height( pixbuf );
+	return mlt_cache_shared_put_data( key, pixbuf, size, ( mlt_destructor )g_object_unref );
+}
+
+static int prefetch_proc( int id, int idx, int jobs, void *cookie )
+{
+	pixbuf_prefetch *prefetch = cookie;
+	GdkPixbuf *pixbuf = load_pixbuf( prefetch->self, prefetch->idx, prefetch->disable_exif, prefetch->width, prefetch->height );
+	if ( pixbuf )
+		prefetch->item = cache_pixbuf( prefetch->key, pixbuf );
+	return 0;
+}
+
+static void prefetch_release( pixbuf_prefetch *prefetch )
+{
+	if ( prefetch->runtime )
+		mlt_slices_wait( prefetch->runtime );
+	mlt_cache_item_close( prefetch->item );
+	free( prefetch->key );
+	memset( prefetch, 0, sizeof( *prefetch ) );
+	prefetch->idx = -1;
+}
+
+static void prefetch_reset( producer_pixbuf self )
+{
+	int i;
+	pthread_mutex_lock( &self->prefetch_mutex );
+	for ( i = 0; i < PREFETCH_MAX; i++ )
+		prefetch_release( &self->prefetch[i] );
+	pthread_mutex_unlock( &self->prefetch_mutex );
+}
+
+/** Get the decoded image of a sequence and start decoding the images after it.
+ *
+ * The images ahead are decoded on the normal slices pool into the shared
+ * data cache, which any producer of the same files also reads. The property
+ * \\em prefetch sets how many, it defaults to the number of slice threads.
+ *
+ * \return a new reference to the pixbuf or NULL
+ */
+
+static GdkPixbuf *get_pixbuf( producer_pixbuf self, int current_idx, int disable_exif )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( &self->parent );
+	GdkPixbuf *pixbuf = NULL;
+	mlt_cache_item item = NULL;
+	int width = self->decode_width;
+	int height = self->decode_height;
+	char *key = pixbuf_key( self, current_idx, disable_exif, width, height );
+	int loop = mlt_properties_get_int( properties, "loop" );
+	int count = 0;
+	int i, j;
+
+	if ( self->count > 1 )
+	{
+		if ( mlt_properties_get( properties, "prefetch" ) )
+			count = mlt_properties_get_int( properties, "prefetch" );
+		else
+			count = mlt_slices_count_normal();
+		count = CLAMP( count, 0, MIN( PREFETCH_MAX, self->count - 1 ) );
+	}
+
+	pthread_mutex_lock( &self->prefetch_mutex );
+	for ( i = 0; i < PREFETCH_MAX; i++ )
+	{
+		pixbuf_prefetch *prefetch = &self->prefetch[i];
+		if ( prefetch->key && prefetch->idx == current_idx && prefetch->disable_exif == disable_exif
+			 && key && !strcmp( prefetch->key, key ) )
+		{
+			mlt_slices_wait( prefetch->runtime );
+			prefetch->runtime = NULL;
+			item = prefetch->item;
+			prefetch->item = NULL;
+			prefetch_release( prefetch );
+		}
+	}
+	if ( !item && key )
+		item = mlt_cache_shared_get_data( key );
+	if ( item )
+	{
+		pixbuf = g_object_ref( mlt_cache_item_data( item, NULL ) );
+		mlt_cache_item_close( item );
+	}
+	else
+	{
+		pixbuf = load_pixbuf( self, current_idx, disable_exif, width, height );
+		if ( pixbuf && key )
+			mlt_cache_item_close( cache_pixbuf( key, g_object_ref( pixbuf ) ) );
+	}
+
+	// Release the images that are no longer ahead
+	for ( i = 0; i < PREFETCH_MAX; i++ )
+	{
+		pixbuf_prefetch *prefetch = &self->prefetch[i];
+		int ahead = 0;
+		for ( j = 1; prefetch->key && j <= count; j++ )
+		{
+			int idx = current_idx + j;
+			if ( idx >= self->count && !loop )
+				break;
+			if ( prefetch->idx == idx % self->count && prefetch->disable_exif == disable_exif
+				 && prefetch->width == width && prefetch->height == height )
+				ahead = 1;
+		}
+		if ( prefetch->key && !ahead )
+			prefetch_release( prefetch );
+	}
+
+	// Start decoding the images ahead that are not in the cache
+	for ( j = 1; j <= count; j++ )
+	{
+		int idx = current_idx + j;
+		int found = 0;
+		if ( idx >= self->count && !loop )
+			break;
+		idx %= self->count;
+		for ( i = 0; i < PREFETCH_MAX && !found; i++ )
+			found = self->prefetch[i].key && self->prefetch[i].idx == idx;
+		for ( i = 0; i < PREFETCH_MAX && !found; i++ )
+		{
+			pixbuf_prefetch *prefetch = &self->prefetch[i];
+			if ( !prefetch->key )
+			{
+				found = 1;
+				prefetch->key = pixbuf_key( self, idx, disable_exif, width, height );
+				if ( !prefetch->key )
+					break;
+				prefetch->self = self;
+				prefetch->idx = idx;
+				prefetch->disable_exif = disable_exif;
+				prefetch->width = width;
+				prefetch->height = height;
+				// Keep the images that are already decoded until they are used
+				prefetch->item = mlt_cache_shared_get_data( prefetch->key );
+				if ( !prefetch->item )
+					prefetch->runtime = mlt_slices_submit_normal( 1, prefetch_proc, prefetch );
+				if ( !prefetch->item && !prefetch->runtime )
+					prefetch_release( prefetch );
+			}
+		}
+	}
+	pthread_mutex_unlock( &self->prefetch_mutex );
+
+	free( key );
+	return pixbuf;
+}
+
 static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame )
 {
 	// Obtain properties of frame and producer
@@ -473,6 +801,7 @@ static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame )
 		self->pixbuf = NULL;
 		self->image = NULL;
 		mlt_properties_set_int( producer_props, "force_reload", 0 );
+		prefetch_reset( self );
 	}
 
 	// Get the original position of this frame
@@ -522,17 +851,10 @@ static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame )
 		self->pixbuf = NULL;
 	if ( !self->pixbuf || mlt_properties_get_int( producer_props, "_disable_exif" ) != disable_exif )
 	{
-		GError *error = NULL;
-
 		self->image = NULL;
-		pthread_mutex_lock( &g_mutex );
-		self->pixbuf = gdk_pixbuf_new_from_file( mlt_properties_get_value( self->filenames, current_idx ), &error );
+		self->pixbuf = get_pixbuf( self, current_idx, disable_exif );
 		if ( self->pixbuf )
 		{
-			// Read the exif value for this file
-			if ( !disable_exif )
-				self->pixbuf = reorient_with_exif( self, current_idx, self->pixbuf );
-
 			// Register this pixbuf for destruction and reuse
 			mlt_cache_item_close( self->pixbuf_cache );
 			mlt_service_cache_put( MLT_PRODUCER_SERVICE( producer ), "pixbuf.pixbuf", self->pixbuf, 0, ( mlt_destructor )g_object_unref );
@@ -543,6 +865,10 @@ static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame )
 			self->width = gdk_pixbuf_get_width( self->pixbuf );
 			self->height = gdk_pixbuf_get_height( self->pixbuf );
 
+			// A picture that was decoded smaller still has the size of its file
+			if ( self->decode_width > 0 )
+				get_media_size( self, current_idx, disable_exif, &self->width, &self->height );
+
 			mlt_events_block( producer_props, NULL );
 			mlt_properties_set_int( producer_props, "meta.media.width", self->width );
 			mlt_properties_set_int( producer_props, "meta.media.height", self->height );
@@ -550,7 +876,6 @@ static int refresh_pixbuf( producer_pixbuf self, mlt_frame frame )
 			mlt_events_unblock( producer_props, NULL );
 
 		}
-		pthread_mutex_unlock( &g_mutex );
 	}
 
 	// Set width/height of frame
@@ -565,6 +890,17 @@ static void refresh_image( producer_pixbuf self, mlt_frame frame, mlt_image_form
 	// Obtain properties of frame and producer
 	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_producer producer = &self->parent;
+	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( producer );
+
+	// Decode the pictures at the size they are shown, and again if one was decoded too small
+	if ( width != self->decode_width || height != self->decode_height )
+	{
+		self->decode_width = width;
+		self->decode_height = height;
+		if ( self->pixbuf && ( gdk_pixbuf_get_width( self->pixbuf ) < width || gdk_pixbuf_get_height( self->pixbuf ) < height )
+			 && gdk_pixbuf_get_width( self->pixbuf ) < mlt_properties_get_int( producer_props, "meta.media.width" ) )
+			self->pixbuf = NULL;
+	}
 
 	// Get index and pixbuf
 	int current_idx = refresh_pixbuf( self, frame );
@@ -775,12 +1111,23 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 		// Update timecode on the frame we're creating
 		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
 
+		// Count the reloads that may change the content of the same picture
+		if ( mlt_properties_get_int( producer_properties, "force_reload" ) )
+			mlt_properties_set_int( producer_properties, "_reloads", mlt_properties_get_int( producer_properties, "_reloads" ) + 1 );
+
 		// Refresh the pixbuf
 		self->pixbuf_cache = mlt_service_cache_get( MLT_PRODUCER_SERVICE( producer ), "pixbuf.pixbuf" );
 		self->pixbuf = mlt_cache_item_data( self->pixbuf_cache, NULL );
-		refresh_pixbuf( self, *frame );
+		int image_idx = refresh_pixbuf( self, *frame );
 		mlt_cache_item_close( self->pixbuf_cache );
 
+		// Every frame showing the same picture has the same image
+		char content[ 1024 ];
+		snprintf( content, sizeof( content ), "pixbuf:%s#%d:%d:%d", mlt_properties_get( producer_properties, "resource" ),
+			image_idx, mlt_properties_get_int( producer_properties, "_reloads" ),
+			mlt_properties_get_int( producer_properties, "disable_exif" ) );
+		mlt_frame_set_static_image( *frame, content );
+
 		// Set producer-specific frame properties
 		mlt_properties_set_int( properties, "progressive", mlt_properties_get_int( producer_properties, "progressive" ) );
 		
@@ -804,6 +1151,8 @@ static void producer_close( mlt_producer parent )
 {
 	producer_pixbuf self = parent->child;
 	parent->close = NULL;
+	prefetch_reset( self );
+	pthread_mutex_destroy( &self->prefetch_mutex );
 	mlt_service_cache_purge( MLT_PRODUCER_SERVICE(parent) );
 	mlt_producer_close( parent );
 	free( self->outs );
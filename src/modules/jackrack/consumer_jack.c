@@ -54,6 +54,9 @@ struct consumer_jack_s
 	int counter;
 	jack_ringbuffer_t **ringbuffers;
 	jack_port_t **ports;
+	int channels;
+	volatile int xruns;
+	volatile int underruns;
 };
 
 /** Forward references to static functions.
@@ -66,6 +69,7 @@ static void consumer_close( mlt_consumer parent );
 static void *consumer_thread( void * );
 static void consumer_refresh_cb( mlt_consumer sdl, mlt_consumer parent, char *name );
 static int jack_process( jack_nframes_t frames, void * data );
+static int jack_xrun( void * data );
 
 /** Constructor
 */
@@ -84,6 +88,7 @@ mlt_consumer consumer_jack_init( mlt_profile profile, mlt_service_type type, con
 		if (( self->jack = jack_client_open( name, JackNullOption, NULL ) ))
 		{
 			jack_set_process_callback( self->jack, jack_process, self );
+			jack_set_xrun_callback( self->jack, jack_xrun, self );
 
 			// Create the queue
 			self->queue = mlt_deque_init( );
@@ -199,7 +204,7 @@ static int consumer_stop( mlt_consumer parent )
 			jack_deactivate( self->jack );
 		if ( self->ringbuffers )
 		{
-			int n = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( parent ), "channels" );
+			int n = self->channels;
 			while ( n-- )
 			{
 				jack_ringbuffer_free( self->ringbuffers[n] );
@@ -208,6 +213,7 @@ static int consumer_stop( mlt_consumer parent )
 			mlt_pool_release( self->ringbuffers );
 		}
 		self->ringbuffers = NULL;
+		self->channels = 0;
 		if ( self->ports )
 			mlt_pool_release( self->ports );
 		self->ports = NULL;
@@ -222,12 +228,18 @@ static int consumer_is_stopped( mlt_consumer parent )
 	return !self->running;
 }
 
+/** The JACK process callback.
+ *
+ * This runs in the realtime thread, so it only touches the state prepared by
+ * initialise_jack_ports() and never allocates, locks or looks up properties.
+ */
+
 static int jack_process( jack_nframes_t frames, void * data )
 {
 	int error = 0;
 	consumer_jack self = (consumer_jack) data;
-	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
-	int channels = mlt_properties_get_int( properties, "channels" );
+	int channels = self->channels;
+	int underrun = 0;
 	int i;
 
 	if ( !self->ringbuffers )
@@ -241,12 +253,24 @@ static int jack_process( jack_nframes_t frames, void * data )
 
 		jack_ringbuffer_read( self->ringbuffers[i], dest, ring_size < jack_size ? ring_size : jack_size );
 		if ( ring_size < jack_size )
+		{
 			memset( dest + ring_size, 0, jack_size - ring_size );
+			underrun = 1;
+		}
 	}
+	if ( underrun && self->playing )
+		self->underruns++;
 
 	return error;
 }
 
+static int jack_xrun( void * data )
+{
+	consumer_jack self = (consumer_jack) data;
+	self->xruns++;
+	return 0;
+}
+
 static void initialise_jack_ports( consumer_jack self )
 {
 	int i;
@@ -275,6 +299,7 @@ static void initialise_jack_ports( consumer_jack self )
 		self->ports[i] = jack_port_register( self->jack, mlt_name, JACK_DEFAULT_AUDIO_TYPE,
 				JackPortIsOutput | JackPortIsTerminal, 0 );
 	}
+	self->channels = channels;
 
 	// Establish connections
 	for ( i = 0; i < channels; i++ )
@@ -299,6 +324,51 @@ static void initialise_jack_ports( consumer_jack self )
 		jack_free( ports );
 }
 
+/** Copy one channel of a frame into the free space of its ringbuffer.
+ *
+ * The volume is applied while copying, so the frame's audio is left alone
+ * and no intermediate buffer is needed.
+ */
+
+static void write_ringbuffer( jack_ringbuffer_t *ringbuffer, const float *src, int samples, float volume )
+{
+	jack_ringbuffer_data_t vector[2];
+	int i, j;
+
+	jack_ringbuffer_get_write_vector( ringbuffer, vector );
+	for ( i = 0; i < 2 && samples > 0; i++ )
+	{
+		float *dest = (float*) vector[i].buf;
+		int n = vector[i].len / sizeof(float);
+		if ( n > samples )
+			n = samples;
+		if ( volume == 1.0 )
+			memcpy( dest, src, n * sizeof(float) );
+		else
+			for ( j = 0; j < n; j++ )
+				dest[j] = src[j] * volume;
+		jack_ringbuffer_write_advance( ringbuffer, n * sizeof(float) );
+		src += n;
+		samples -= n;
+	}
+}
+
+/** Publish the counters of the realtime thread as consumer properties.
+*/
+
+static void update_statistics( consumer_jack self, int frequency )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
+	jack_latency_range_t range = { 0, 0 };
+	size_t buffered = jack_ringbuffer_read_space( self->ringbuffers[0] ) / sizeof(float);
+
+	jack_port_get_latency_range( self->ports[0], JackPlaybackLatency, &range );
+	mlt_properties_set_int( properties, "xruns", self->xruns );
+	mlt_properties_set_int( properties, "underruns", self->underruns );
+	mlt_properties_set_double( properties, "latency",
+		1000.0 * ( buffered + range.max + jack_get_buffer_size( self->jack ) ) / frequency );
+}
+
 static int consumer_play_audio( consumer_jack self, mlt_frame frame, int init_audio, int *duration )
 {
 	// Get the properties of this consumer
@@ -338,21 +408,17 @@ static int consumer_play_audio( consumer_jack self, mlt_frame frame, int init_au
 		if ( !scrub && speed == 0.0 )
 			volume = 0.0;
 
-		if ( volume != 1.0 )
-		{
-			float *p = buffer;
-			i = samples * channels + 1;
-			while (--i)
-				*p++ *= volume;
-		}
-
 		// Write into output ringbuffer
+		if ( channels > self->channels )
+			channels = self->channels;
 		for ( i = 0; i < channels; i++ )
 		{
 			size_t ring_size = jack_ringbuffer_write_space( self->ringbuffers[i] );
 			if ( ring_size >= mlt_size )
-				jack_ringbuffer_write( self->ringbuffers[i], (char*)( buffer + i * samples ), mlt_size );
+				write_ringbuffer( self->ringbuffers[i], buffer + i * samples, samples, volume );
 		}
+		if ( self->channels > 0 )
+			update_statistics( self, frequency );
 	}
 
 	return init_audio;
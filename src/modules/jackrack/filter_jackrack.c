@@ -35,6 +35,28 @@ extern pthread_mutex_t g_activate_mutex;
 
 #define BUFFER_LEN 204800 * 6
 
+/** The state of the JACK process callback.
+ *
+ * It is prepared before JACK is activated so that the realtime thread does
+ * not need to look up properties or allocate.
+ */
+
+typedef struct
+{
+	jack_client_t *jack_client;
+	int channels;
+	jack_ringbuffer_t **output_buffers;
+	jack_ringbuffer_t **input_buffers;
+	jack_port_t **output_ports;
+	jack_port_t **input_ports;
+	pthread_mutex_t *output_lock;
+	pthread_cond_t *output_ready;
+	volatile int frame_size;
+	volatile int sync;
+	int total_size;
+	jack_transport_state_t transport_state;
+} jack_process_state;
+
 static void jack_started_transmitter( mlt_listener listener, mlt_properties owner, mlt_service service, void **args )
 {
 	listener( owner, service, (mlt_position*) args[0] );
@@ -116,13 +138,14 @@ static void on_jack_seek( mlt_properties owner, mlt_filter filter, mlt_position
 	jack_transport_locate( jack_client, jack_frame );
 }
 
-static void initialise_jack_ports( mlt_properties properties )
+static void initialise_jack_ports( mlt_filter filter )
 {
 	int i;
 	char mlt_name[67], rack_name[30];
 	jack_port_t **port = NULL;
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	jack_client_t *jack_client = mlt_properties_get_data( properties, "jack_client", NULL );
-	jack_nframes_t jack_buffer_size = jack_get_buffer_size( jack_client );
+	jack_process_state *state = filter->child;
 	
 	// Propagate these for the Jack processing callback
 	int channels = mlt_properties_get_int( properties, "channels" );
@@ -149,8 +172,6 @@ static void initialise_jack_ports( mlt_properties properties )
 	jack_ringbuffer_t **input_buffers = mlt_pool_alloc( sizeof( jack_ringbuffer_t *) * channels );
 	jack_port_t **jack_output_ports = mlt_pool_alloc( sizeof(jack_port_t *) * channels );
 	jack_port_t **jack_input_ports = mlt_pool_alloc( sizeof(jack_port_t *) * channels );
-	float **jack_output_buffers = mlt_pool_alloc( sizeof(float *) * jack_buffer_size );
-	float **jack_input_buffers = mlt_pool_alloc( sizeof(float *) * jack_buffer_size );
 
 	// Set properties - released inside filter_close
 	mlt_properties_set_data( properties, "output_buffers", output_buffers,
@@ -161,10 +182,6 @@ static void initialise_jack_ports( mlt_properties properties )
 		sizeof( jack_port_t *) * channels, mlt_pool_release, NULL );
 	mlt_properties_set_data( properties, "jack_input_ports", jack_input_ports,
 		sizeof( jack_port_t *) * channels, mlt_pool_release, NULL );
-	mlt_properties_set_data( properties, "jack_output_buffers", jack_output_buffers,
-		sizeof( float *) * channels, mlt_pool_release, NULL );
-	mlt_properties_set_data( properties, "jack_input_buffers", jack_input_buffers,
-		sizeof( float *) * channels, mlt_pool_release, NULL );
 	
 	// Register Jack ports
 	for ( i = 0; i < channels; i++ )
@@ -190,6 +207,13 @@ static void initialise_jack_ports( mlt_properties properties )
 		}
 	}
 	
+	// Hand everything to the process callback
+	state->output_buffers = output_buffers;
+	state->input_buffers = input_buffers;
+	state->output_ports = jack_output_ports;
+	state->input_ports = jack_input_ports;
+	state->channels = channels;
+
 	// Start Jack processing
 	pthread_mutex_lock( &g_activate_mutex );
 	jack_activate( jack_client );
@@ -229,46 +253,40 @@ static void initialise_jack_ports( mlt_properties properties )
 static int jack_process (jack_nframes_t frames, void * data)
 {
 	mlt_filter filter = (mlt_filter) data;
- 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
-	int channels = mlt_properties_get_int( properties, "channels" );
-	int frame_size = mlt_properties_get_int( properties, "_samples" ) * sizeof(float);
-	int sync = mlt_properties_get_int( properties, "_sync" );
+	jack_process_state *state = filter->child;
+	int channels = state->channels;
+	int frame_size = state->frame_size * sizeof(float);
+	int sync = state->sync;
 	int err = 0;
 	int i;
-	static int total_size = 0;
-  
-	jack_ringbuffer_t **output_buffers = mlt_properties_get_data( properties, "output_buffers", NULL );
-	if ( output_buffers == NULL )
+
+	if ( channels == 0 )
 		return 0;
-	jack_ringbuffer_t **input_buffers = mlt_properties_get_data( properties, "input_buffers", NULL );
-	jack_port_t **jack_output_ports = mlt_properties_get_data( properties, "jack_output_ports", NULL );
-	jack_port_t **jack_input_ports = mlt_properties_get_data( properties, "jack_input_ports", NULL );
-	float **jack_output_buffers = mlt_properties_get_data( properties, "jack_output_buffers", NULL );
-	float **jack_input_buffers = mlt_properties_get_data( properties, "jack_input_buffers", NULL );
-	pthread_mutex_t *output_lock = mlt_properties_get_data( properties, "output_lock", NULL );
-	pthread_cond_t *output_ready = mlt_properties_get_data( properties, "output_ready", NULL );
-	
+	jack_ringbuffer_t **output_buffers = state->output_buffers;
+	jack_ringbuffer_t **input_buffers = state->input_buffers;
+
 	for ( i = 0; i < channels; i++ )
 	{
 		size_t jack_size = ( frames * sizeof(float) );
 		size_t ring_size;
-		
+		float *jack_output_buffer, *jack_input_buffer;
+
 		// Send audio through out port
-		jack_output_buffers[i] = jack_port_get_buffer( jack_output_ports[i], frames );
-		if ( ! jack_output_buffers[i] )
+		jack_output_buffer = jack_port_get_buffer( state->output_ports[i], frames );
+		if ( ! jack_output_buffer )
 		{
 			mlt_log_error( MLT_FILTER_SERVICE(filter), "no buffer for output port %d\n", i );
 			err = 1;
 			break;
 		}
 		ring_size = jack_ringbuffer_read_space( output_buffers[i] );
-		jack_ringbuffer_read( output_buffers[i], ( char * )jack_output_buffers[i], ring_size < jack_size ? ring_size : jack_size );
+		jack_ringbuffer_read( output_buffers[i], ( char * )jack_output_buffer, ring_size < jack_size ? ring_size : jack_size );
 		if ( ring_size < jack_size )
-			memset( &jack_output_buffers[i][ring_size], 0, jack_size - ring_size );
-		
+			memset( ( char * )jack_output_buffer + ring_size, 0, jack_size - ring_size );
+
 		// Return audio through in port
-		jack_input_buffers[i] = jack_port_get_buffer( jack_input_ports[i], frames );
-		if ( ! jack_input_buffers[i] )
+		jack_input_buffer = jack_port_get_buffer( state->input_ports[i], frames );
+		if ( ! jack_input_buffer )
 		{
 			mlt_log_error( MLT_FILTER_SERVICE(filter), "no buffer for input port %d\n", i );
 			err = 1;
@@ -277,37 +295,35 @@ static int jack_process (jack_nframes_t frames, void * data)
 		
 		// Do not start returning audio until we have sent first mlt frame
 		if ( sync && i == 0 && frame_size > 0 )
-			total_size += ring_size;
+			state->total_size += ring_size;
 		mlt_log_debug( MLT_FILTER_SERVICE(filter), "sync %d frame_size %d ring_size %zu jack_size %zu\n", sync, frame_size, ring_size, jack_size );
 		
-		if ( ! sync || ( frame_size > 0  && total_size >= frame_size ) )
+		if ( ! sync || ( frame_size > 0  && state->total_size >= frame_size ) )
 		{
 			ring_size = jack_ringbuffer_write_space( input_buffers[i] );
-			jack_ringbuffer_write( input_buffers[i], ( char * )jack_input_buffers[i], ring_size < jack_size ? ring_size : jack_size );
-			
+			jack_ringbuffer_write( input_buffers[i], ( char * )jack_input_buffer, ring_size < jack_size ? ring_size : jack_size );
+
 			if ( sync )
 			{
 				// Tell mlt that audio is available
-				pthread_mutex_lock( output_lock);
-				pthread_cond_signal( output_ready );
-				pthread_mutex_unlock( output_lock);
+				pthread_mutex_lock( state->output_lock );
+				pthread_cond_signal( state->output_ready );
+				pthread_mutex_unlock( state->output_lock );
 
 				// Clear sync phase
-				mlt_properties_set_int( properties, "_sync", 0 );
+				state->sync = 0;
 			}
 		}
 	}
 
 	// Often jackd does not send the stopped event through the JackSyncCallback
-	jack_client_t *jack_client = mlt_properties_get_data( properties, "jack_client", NULL );
 	jack_position_t jack_pos;
-	jack_transport_state_t state = jack_transport_query( jack_client, &jack_pos );
-	int transport_state = mlt_properties_get_int( properties, "_transport_state" );
-	if ( state != transport_state )
+	jack_transport_state_t transport_state = jack_transport_query( state->jack_client, &jack_pos );
+	if ( transport_state != state->transport_state )
 	{
-		mlt_properties_set_int( properties, "_transport_state", state );
-		if ( state == JackTransportStopped )
-			jack_sync( state, &jack_pos, filter );
+		state->transport_state = transport_state;
+		if ( transport_state == JackTransportStopped )
+			jack_sync( transport_state, &jack_pos, filter );
 	}
 
 	return err;
@@ -338,8 +354,9 @@ static int jackrack_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	*frequency = jack_frequency;
 
 	// Initialise Jack ports and connections if needed
-	if ( mlt_properties_get_int( filter_properties, "_samples" ) == 0 )
-		mlt_properties_set_int( filter_properties, "_samples", *samples );
+	jack_process_state *state = filter->child;
+	if ( state->frame_size == 0 )
+		state->frame_size = *samples;
 	
 	// Get the filter-specific properties
 	jack_ringbuffer_t **output_buffers = mlt_properties_get_data( filter_properties, "output_buffers", NULL );
@@ -390,7 +407,7 @@ static mlt_frame filter_process( mlt_filter this, mlt_frame frame )
 		mlt_frame_push_audio( frame, jackrack_get_audio );
 		
 		if ( !mlt_properties_get_data( properties, "jackrack", NULL ) )
-			initialise_jack_ports( properties );
+			initialise_jack_ports( this );
 	}
 
 	return frame;
@@ -403,6 +420,8 @@ static void filter_close( mlt_filter this )
 	jack_client_t *jack_client = mlt_properties_get_data( properties, "jack_client", NULL );
 	jack_deactivate( jack_client );
 	jack_client_close( jack_client );
+	free( this->child );
+	this->child = NULL;
 	this->parent.close = NULL;
 	mlt_service_close( &this->parent );
 }
@@ -442,6 +461,14 @@ mlt_filter filter_jackrack_init( mlt_profile profile, mlt_service_type type, con
 			mlt_properties properties = MLT_FILTER_PROPERTIES( this );
 			pthread_mutex_t *output_lock = mlt_pool_alloc( sizeof( pthread_mutex_t ) );
 			pthread_cond_t  *output_ready = mlt_pool_alloc( sizeof( pthread_cond_t ) );
+			jack_process_state *state = calloc( 1, sizeof( jack_process_state ) );
+
+			state->jack_client = jack_client;
+			state->output_lock = output_lock;
+			state->output_ready = output_ready;
+			state->sync = 1;
+			state->transport_state = JackTransportStopped;
+			this->child = state;
 			
 			jack_set_process_callback( jack_client, jack_process, this );
 			jack_set_sync_callback( jack_client, jack_sync, this );
@@ -458,7 +485,6 @@ mlt_filter filter_jackrack_init( mlt_profile profile, mlt_service_type type, con
 			mlt_properties_set_int( properties, "_sample_rate", jack_get_sample_rate( jack_client ) );
 			mlt_properties_set_data( properties, "output_lock", output_lock, 0, mlt_pool_release, NULL );
 			mlt_properties_set_data( properties, "output_ready", output_ready, 0, mlt_pool_release, NULL );
-			mlt_properties_set_int( properties, "_sync", 1 );
 			mlt_properties_set_int( properties, "channels", 2 );
 
 			mlt_events_register( properties, "jack-started", (mlt_transmitter) jack_started_transmitter );
@@ -86,10 +86,8 @@ int lff_read (lff_t * lff, void * data) {
 /** write an element from data to the fifo.
 returns 0 on success, non-zero if there was no space */
 int lff_write (lff_t * lff, void * data) {
-  static unsigned int ri;
-  
   /* got to read read_index only once for safety */
-  ri = lff->read_index;
+  unsigned int ri = lff->read_index;
 
   /* lots of logic for when we're allowed to write to the fifo which basically
      boils down to "don't write if we're one element behind the read index" */  
@@ -114,3 +112,60 @@ int lff_write (lff_t * lff, void * data) {
     return -1;
   }
 }
+
+/** read up to count elements from the fifo into data, copying each
+contiguous span at once.
+returns the number of elements read */
+unsigned int lff_read_many (lff_t * lff, void * data, unsigned int count) {
+  /* got to read write_index only once for safety */
+  unsigned int wi = lff->write_index;
+  unsigned int ri = lff->read_index;
+  unsigned int available = wi >= ri ? wi - ri : lff->size - ri + wi;
+  unsigned int first;
+
+  if (count > available)
+    count = available;
+  first = count < lff->size - ri ? count : lff->size - ri;
+
+  memcpy (data, ((char *)lff->data) + (ri * lff->object_size),
+          first * lff->object_size);
+  if (count > first)
+    memcpy (((char *)data) + (first * lff->object_size), lff->data,
+            (count - first) * lff->object_size);
+
+  ri += count;
+  if (ri >= lff->size)
+    ri -= lff->size;
+  lff->read_index = ri;
+
+  return count;
+}
+
+/** write up to count elements from data to the fifo, copying each
+contiguous span at once.
+returns the number of elements written */
+unsigned int lff_write_many (lff_t * lff, const void * data, unsigned int count) {
+  /* got to read read_index only once for safety */
+  unsigned int ri = lff->read_index;
+  unsigned int wi = lff->write_index;
+  /* keep one element free so that a full fifo differs from an empty one */
+  unsigned int space = ri > wi ? ri - wi - 1 : lff->size - wi + ri - 1;
+  unsigned int first;
+
+  if (count > space)
+    count = space;
+  first = count < lff->size - wi ? count : lff->size - wi;
+
+  memcpy (((char *)lff->data) + (wi * lff->object_size), data,
+          first * lff->object_size);
+  if (count > first)
+    memcpy (lff->data, ((const char *)data) + (first * lff->object_size),
+            (count - first) * lff->object_size);
+
+  wi += count;
+  if (wi >= lff->size)
+    wi -= lff->size;
+  lff->write_index = wi;
+
+  return count;
+}
@@ -48,5 +48,8 @@ void    lff_destroy (lff_t * lock_free_fifo);
 int lff_read (lff_t * lock_free_fifo, void * data);
 int lff_write (lff_t * lock_free_fifo, void * data);
 
+unsigned int lff_read_many  (lff_t * lock_free_fifo, void * data, unsigned int count);
+unsigned int lff_write_many (lff_t * lock_free_fifo, const void * data, unsigned int count);
+
 
 #endif /* __JLH_LOCK_FREE_FIFO_H__ */
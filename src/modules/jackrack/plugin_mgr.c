@@ -39,6 +39,7 @@
 #include "plugin_mgr.h"
 #include "plugin_desc.h"
 #include "framework/mlt_log.h"
+#include "framework/mlt_cache.h"
 #include "framework/mlt_factory.h"
 
 static gboolean
@@ -65,6 +66,180 @@ plugin_is_valid (const LADSPA_Descriptor * descriptor)
   return TRUE;
 }
 
+static void
+plugin_mgr_add_descriptor (plugin_mgr_t * plugin_mgr, const char * filename,
+                           unsigned long plugin_index, const LADSPA_Descriptor * descriptor)
+{
+  plugin_desc_t * desc, * other_desc = NULL;
+  GSList * list;
+
+  if (!plugin_is_valid (descriptor))
+    return;
+
+  /* check it doesn't already exist */
+  for (list = plugin_mgr->all_plugins; list; list = g_slist_next (list))
+    {
+      other_desc = (plugin_desc_t *) list->data;
+
+      if (other_desc->id == descriptor->UniqueID)
+        {
+          mlt_log_info( NULL, "Plugin %ld exists in both '%s' and '%s'; using version in '%s'\n",
+                  descriptor->UniqueID, other_desc->object_file, filename, other_desc->object_file);
+          return;
+        }
+    }
+
+  desc = plugin_desc_new_with_descriptor (filename, plugin_index, descriptor);
+  plugin_mgr->all_plugins = g_slist_append (plugin_mgr->all_plugins, desc);
+  plugin_mgr->plugin_count++;
+
+  /* print in the splash screen */
+  /* mlt_log_verbose( NULL, "Loaded plugin '%s'\n", desc->name); */
+}
+
+/* The discovery cache keeps the parts of the descriptors that the plugin
+ * descriptions use for each object file, keyed by the file, its size and
+ * modification time. The directory is $MLT_LADSPA_CACHE_DIR, or else
+ * mlt/ladspa in $XDG_CACHE_HOME or $HOME/.cache. The bounds are kept as the
+ * bits of the floats so they do not change through the locale or rounding. */
+
+static char *
+plugin_mgr_cache_filename (const char * filename, int create)
+{
+  return mlt_cache_filename (filename, "MLT_LADSPA_CACHE_DIR", "ladspa", ".txt", create);
+}
+
+static void
+plugin_mgr_cache_set_float (mlt_properties cache, const char * name, LADSPA_Data value)
+{
+  guint32 bits;
+  memcpy (&bits, &value, sizeof (bits));
+  mlt_properties_set_int64 (cache, name, bits);
+}
+
+static LADSPA_Data
+plugin_mgr_cache_get_float (mlt_properties cache, const char * name)
+{
+  guint32 bits = mlt_properties_get_int64 (cache, name);
+  LADSPA_Data value;
+  memcpy (&value, &bits, sizeof (value));
+  return value;
+}
+
+static void
+plugin_mgr_cache_add (mlt_properties cache, unsigned long plugin_index, const LADSPA_Descriptor * descriptor)
+{
+  char key[64];
+  unsigned long i;
+
+  snprintf (key, sizeof (key), "%lu.id", plugin_index);
+  mlt_properties_set_int64 (cache, key, descriptor->UniqueID);
+  snprintf (key, sizeof (key), "%lu.name", plugin_index);
+  mlt_properties_set (cache, key, descriptor->Name);
+  snprintf (key, sizeof (key), "%lu.maker", plugin_index);
+  mlt_properties_set (cache, key, descriptor->Maker);
+  snprintf (key, sizeof (key), "%lu.properties", plugin_index);
+  mlt_properties_set_int (cache, key, descriptor->Properties);
+  snprintf (key, sizeof (key), "%lu.port_count", plugin_index);
+  mlt_properties_set_int64 (cache, key, descriptor->PortCount);
+  for (i = 0; i < descriptor->PortCount; i++)
+    {
+      snprintf (key, sizeof (key), "%lu.%lu.descriptor", plugin_index, i);
+      mlt_properties_set_int (cache, key, descriptor->PortDescriptors[i]);
+      snprintf (key, sizeof (key), "%lu.%lu.hint", plugin_index, i);
+      mlt_properties_set_int (cache, key, descriptor->PortRangeHints[i].HintDescriptor);
+      snprintf (key, sizeof (key), "%lu.%lu.lower", plugin_index, i);
+      plugin_mgr_cache_set_float (cache, key, descriptor->PortRangeHints[i].LowerBound);
+      snprintf (key, sizeof (key), "%lu.%lu.upper", plugin_index, i);
+      plugin_mgr_cache_set_float (cache, key, descriptor->PortRangeHints[i].UpperBound);
+      snprintf (key, sizeof (key), "%lu.%lu.name", plugin_index, i);
+      mlt_properties_set (cache, key, descriptor->PortNames[i]);
+    }
+}
+
+static void
+plugin_mgr_cache_save (mlt_properties cache, const char * filename)
+{
+  char * cache_name = plugin_mgr_cache_filename (filename, 1);
+  char * temp = cache_name ? g_strdup_printf ("%s.%d", cache_name, rand () % 100000) : NULL;
+
+  /* write to a temporary file and rename it so readers never see a partial cache */
+  if (temp && (mlt_properties_save (cache, temp) || rename (temp, cache_name)))
+    {
+      mlt_log_warning( NULL, "%s: failed to save discovery cache '%s': %s\n",
+               __FUNCTION__, cache_name, strerror (errno));
+      remove (temp);
+    }
+  g_free (temp);
+  free (cache_name);
+}
+
+static gboolean
+plugin_mgr_get_cached_plugins (plugin_mgr_t * plugin_mgr, const char * filename)
+{
+  char * cache_name = plugin_mgr_cache_filename (filename, 0);
+  mlt_properties cache = cache_name ? mlt_properties_load (cache_name) : NULL;
+  unsigned long count, plugin_index, i;
+  char key[64];
+
+  free (cache_name);
+  if (!cache || !mlt_properties_get (cache, "count"))
+    {
+      mlt_properties_close (cache);
+      return FALSE;
+    }
+
+  count = mlt_properties_get_int64 (cache, "count");
+  for (plugin_index = 0; plugin_index < count; plugin_index++)
+    {
+      LADSPA_Descriptor descriptor;
+      LADSPA_PortDescriptor * port_descriptors;
+      LADSPA_PortRangeHint * port_range_hints;
+      const char ** port_names;
+
+      memset (&descriptor, 0, sizeof (descriptor));
+      snprintf (key, sizeof (key), "%lu.id", plugin_index);
+      descriptor.UniqueID = mlt_properties_get_int64 (cache, key);
+      snprintf (key, sizeof (key), "%lu.name", plugin_index);
+      descriptor.Name = mlt_properties_get (cache, key);
+      snprintf (key, sizeof (key), "%lu.maker", plugin_index);
+      descriptor.Maker = mlt_properties_get (cache, key);
+      snprintf (key, sizeof (key), "%lu.properties", plugin_index);
+      descriptor.Properties = mlt_properties_get_int (cache, key);
+      snprintf (key, sizeof (key), "%lu.port_count", plugin_index);
+      descriptor.PortCount = mlt_properties_get_int64 (cache, key);
+
+      port_descriptors = g_malloc (sizeof (LADSPA_PortDescriptor) * (descriptor.PortCount + 1));
+      port_range_hints = g_malloc (sizeof (LADSPA_PortRangeHint) * (descriptor.PortCount + 1));
+      port_names = g_malloc (sizeof (char *) * (descriptor.PortCount + 1));
+      for (i = 0; i < descriptor.PortCount; i++)
+        {
+          snprintf (key, sizeof (key), "%lu.%lu.descriptor", plugin_index, i);
+          port_descriptors[i] = mlt_properties_get_int (cache, key);
+          snprintf (key, sizeof (key), "%lu.%lu.hint", plugin_index, i);
+          port_range_hints[i].HintDescriptor = mlt_properties_get_int (cache, key);
+          snprintf (key, sizeof (key), "%lu.%lu.lower", plugin_index, i);
+          port_range_hints[i].LowerBound = plugin_mgr_cache_get_float (cache, key);
+          snprintf (key, sizeof (key), "%lu.%lu.upper", plugin_index, i);
+          port_range_hints[i].UpperBound = plugin_mgr_cache_get_float (cache, key);
+          snprintf (key, sizeof (key), "%lu.%lu.name", plugin_index, i);
+          port_names[i] = mlt_properties_get (cache, key);
+        }
+      descriptor.PortDescriptors = port_descriptors;
+      descriptor.PortRangeHints = port_range_hints;
+      descriptor.PortNames = port_names;
+
+      plugin_mgr_add_descriptor (plugin_mgr, filename, plugin_index, &descriptor);
+
+      g_free (port_descriptors);
+      g_free (port_range_hints);
+      g_free (port_names);
+    }
+
+  mlt_properties_close (cache);
+  return TRUE;
+}
+
 static void
 plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * filename)
 {
@@ -73,11 +248,13 @@ plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * file
   LADSPA_Descriptor_Function get_descriptor;
   const LADSPA_Descriptor * descriptor;
   unsigned long plugin_index;
-  plugin_desc_t * desc, * other_desc = NULL;
-  GSList * list;
-  gboolean exists;
+  mlt_properties cache;
   int err;
-  
+
+  /* the plugins are opened again only when they are instantiated */
+  if (plugin_mgr_get_cached_plugins (plugin_mgr, filename))
+    return;
+
   /* open the object file */
   dl_handle = dlopen (filename, RTLD_LAZY);
   if (!dl_handle)
@@ -109,46 +286,17 @@ plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * file
   }
 #endif
 
+  cache = mlt_properties_new ();
   plugin_index = 0;
   while ( (descriptor = get_descriptor (plugin_index)) )
     {
-      if (!plugin_is_valid (descriptor))
-        {
-          plugin_index++;
-          continue;
-        }
-
-      
-      /* check it doesn't already exist */
-      exists = FALSE;
-      for (list = plugin_mgr->all_plugins; list; list = g_slist_next (list))
-        {
-          other_desc = (plugin_desc_t *) list->data;
-          
-          if (other_desc->id == descriptor->UniqueID)
-            {
-              exists = TRUE;
-              break;
-            }
-        }
-      
-      if (exists)
-        {
-          mlt_log_info( NULL, "Plugin %ld exists in both '%s' and '%s'; using version in '%s'\n",
-                  descriptor->UniqueID, other_desc->object_file, filename, other_desc->object_file);
-          plugin_index++;
-          continue;
-        }
-
-      
-      desc = plugin_desc_new_with_descriptor (filename, plugin_index, descriptor);
-      plugin_mgr->all_plugins = g_slist_append (plugin_mgr->all_plugins, desc);
+      plugin_mgr_cache_add (cache, plugin_index, descriptor);
+      plugin_mgr_add_descriptor (plugin_mgr, filename, plugin_index, descriptor);
       plugin_index++;
-      plugin_mgr->plugin_count++;
-      
-      /* print in the splash screen */
-      /* mlt_log_verbose( NULL, "Loaded plugin '%s'\n", desc->name); */
     }
+  mlt_properties_set_int64 (cache, "count", plugin_index);
+  plugin_mgr_cache_save (cache, filename);
+  mlt_properties_close (cache);
   
   err = dlclose (dl_handle);
   if (err)
@@ -60,6 +60,17 @@ jack_shutdown_cb (void * data)
   procinfo->quit = TRUE;
 }
 
+/** read the pending values of a control fifo a span at a time, keeping the newest */
+static void
+read_latest_value (lff_t * fifo, LADSPA_Data * value)
+{
+  LADSPA_Data values[32];
+  unsigned int count;
+
+  while ((count = lff_read_many (fifo, values, sizeof (values) / sizeof (values[0]))) > 0)
+    *value = values[count - 1];
+}
+
 /** process messages for plugins' control ports */
 void process_control_port_messages (process_info_t * procinfo) {
   plugin_t * plugin;
@@ -75,15 +86,15 @@ void process_control_port_messages (process_info_t * procinfo) {
         for (control = 0; control < plugin->desc->control_port_count; control++)
           for (copy = 0; copy < plugin->copies; copy++)
             {
-              while (lff_read (plugin->holders[copy].ui_control_fifos + control,
-                               plugin->holders[copy].control_memory + control) == 0);
+              read_latest_value (plugin->holders[copy].ui_control_fifos + control,
+                                 plugin->holders[copy].control_memory + control);
             }
       
       if (plugin->wet_dry_enabled)
         for (channel = 0; channel < procinfo->channels; channel++)
           {
-            while (lff_read (plugin->wet_dry_fifos + channel,
-                             plugin->wet_dry_values + channel) == 0);
+            read_latest_value (plugin->wet_dry_fifos + channel,
+                               plugin->wet_dry_values + channel);
           }
     }
 }
@@ -0,0 +1,730 @@
+/*
+ * consumer_jpeg_preview.c -- a live JPEG preview served over HTTP
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <jpeglib.h>
+
+#define BOUNDARY "mltpreview"
+
+/** An encoded frame shared by the clients that send it */
+
+typedef struct jpeg_image_s
+{
+	int refs;
+	int64_t sequence;             /**< the order of the frame among the encoded ones */
+	unsigned char *data;
+	unsigned long size;
+} *jpeg_image;
+
+typedef struct consumer_jpeg_preview_s *consumer_jpeg_preview;
+
+typedef struct client_s
+{
+	consumer_jpeg_preview self;
+	pthread_t thread;
+	int fd;
+	int done;
+	int64_t bytes;                /**< the bytes sent since the last adaptation */
+	int64_t busy;                 /**< the microseconds spent sending since the last adaptation */
+	int64_t sending;              /**< when the current send started or was last accounted, or 0 */
+	struct client_s *next;
+} *client;
+
+struct consumer_jpeg_preview_s
+{
+	struct mlt_consumer_s parent;
+	pthread_t thread;
+	pthread_t server_thread;
+	pthread_t *workers;
+	int worker_count;
+	int running;
+	int joined;
+	int listener;
+	pthread_mutex_t mutex;
+	pthread_cond_t frame_cond;    /**< signals the workers of a pending frame */
+	pthread_cond_t image_cond;    /**< signals the clients of a newer image */
+	mlt_frame pending;            /**< the newest frame not yet taken by a worker */
+	int64_t pending_sequence;
+	int64_t sequence;
+	jpeg_image latest;            /**< the newest encoded frame */
+	client clients;
+	int quality;                  /**< the adapted quality */
+	double scale;                 /**< the adapted scale of the size of the profile */
+	int dropped;
+};
+
+static int consumer_start( mlt_consumer parent );
+static int consumer_stop( mlt_consumer parent );
+static int consumer_is_stopped( mlt_consumer parent );
+static void consumer_close( mlt_consumer parent );
+static void *consumer_thread( void *arg );
+
+mlt_consumer consumer_jpeg_preview_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	consumer_jpeg_preview self = calloc( 1, sizeof( struct consumer_jpeg_preview_s ) );
+	if ( self && mlt_consumer_init( &self->parent, self, profile ) == 0 )
+	{
+		mlt_consumer parent = &self->parent;
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( parent );
+
+		parent->close = consumer_close;
+		parent->start = consumer_start;
+		parent->stop = consumer_stop;
+		parent->is_stopped = consumer_is_stopped;
+		self->joined = 1;
+		self->listener = -1;
+		pthread_mutex_init( &self->mutex, NULL );
+		pthread_cond_init( &self->frame_cond, NULL );
+		pthread_cond_init( &self->image_cond, NULL );
+
+		// Render the images in the read ahead thread without the audio
+		mlt_properties_set_int( properties, "port", arg ? atoi( arg ) : 8090 );
+		mlt_properties_set_int( properties, "quality", 80 );
+		mlt_properties_set_int( properties, "min_quality", 30 );
+		mlt_properties_set_double( properties, "min_scale", 0.25 );
+		mlt_properties_set_int( properties, "threads", 2 );
+		mlt_properties_set_int( properties, "adaptive", 1 );
+		mlt_properties_set( properties, "mlt_image_format", "rgb24" );
+		mlt_properties_set_int( properties, "audio_off", 1 );
+		mlt_properties_set_int( properties, "real_time", 1 );
+		mlt_properties_set_int( properties, "terminate_on_pause", 0 );
+
+		return parent;
+	}
+	free( self );
+	return NULL;
+}
+
+static void image_release( jpeg_image image )
+{
+	if ( image && --image->refs == 0 )
+	{
+		free( image->data );
+		free( image );
+	}
+}
+
+static int64_t time_now( )
+{
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/** Average the pixels of an RGB image over the area of each scaled pixel. */
+
+static void scale_image( uint8_t *src, int width, int height, uint8_t *dst, int dst_width, int dst_height )
+{
+	int x, y, i, j, c;
+
+	for ( y = 0; y < dst_height; y++ )
+	{
+		int y0 = y * height / dst_height;
+		int y1 = MAX( ( y + 1 ) * height / dst_height, y0 + 1 );
+
+		for ( x = 0; x < dst_width; x++ )
+		{
+			int x0 = x * width / dst_width;
+			int x1 = MAX( ( x + 1 ) * width / dst_width, x0 + 1 );
+			int count = ( x1 - x0 ) * ( y1 - y0 );
+			int sum[3] = { 0, 0, 0 };
+
+			for ( j = y0; j < y1; j++ )
+			{
+				uint8_t *p = src + ( j * width + x0 ) * 3;
+				for ( i = x0; i < x1; i++ )
+					for ( c = 0; c < 3; c++ )
+						sum[c] += *p++;
+			}
+			for ( c = 0; c < 3; c++ )
+				*dst++ = sum[c] / count;
+		}
+	}
+}
+
+struct encoder_error
+{
+	struct jpeg_error_mgr pub;
+	jmp_buf jump;
+};
+
+static void encoder_error_exit( j_common_ptr info )
+{
+	longjmp( ( (struct encoder_error*) info->err )->jump, 1 );
+}
+
+static jpeg_image encode_image( uint8_t *rgb, int width, int height, int quality )
+{
+	struct jpeg_compress_struct info;
+	struct encoder_error error;
+	unsigned char *data = NULL;
+	unsigned long size = 0;
+	jpeg_image image;
+
+	// The default handler of a fatal error exits the process
+	info.err = jpeg_std_error( &error.pub );
+	error.pub.error_exit = encoder_error_exit;
+	if ( setjmp( error.jump ) )
+	{
+		jpeg_destroy_compress( &info );
+		free( data );
+		return NULL;
+	}
+
+	jpeg_create_compress( &info );
+	jpeg_mem_dest( &info, &data, &size );
+	info.image_width = width;
+	info.image_height = height;
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+	jpeg_set_defaults( &info );
+	jpeg_set_quality( &info, quality, TRUE );
+	info.dct_method = JDCT_IFAST;
+	jpeg_start_compress( &info, TRUE );
+	while ( info.next_scanline < info.image_height )
+	{
+		JSAMPROW row = rgb + info.next_scanline * width * 3;
+		jpeg_write_scanlines( &info, &row, 1 );
+	}
+	jpeg_finish_compress( &info );
+	jpeg_destroy_compress( &info );
+
+	if ( ( image = calloc( 1, sizeof( *image ) ) ) )
+	{
+		image->refs = 1;
+		image->data = data;
+		image->size = size;
+	}
+	else
+	{
+		free( data );
+	}
+	return image;
+}
+
+/** Encode the newest frame, and publish it unless a newer one got there first. */
+
+static void *worker_thread( void *arg )
+{
+	consumer_jpeg_preview self = arg;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
+
+	while ( 1 )
+	{
+		mlt_image_format format = mlt_image_rgb24;
+		mlt_frame frame;
+		int64_t sequence;
+		int quality, width = 0, height = 0;
+		double scale;
+		uint8_t *image = NULL;
+		jpeg_image encoded = NULL;
+
+		pthread_mutex_lock( &self->mutex );
+		while ( self->running && !self->pending )
+			pthread_cond_wait( &self->frame_cond, &self->mutex );
+		frame = self->pending;
+		sequence = self->pending_sequence;
+		self->pending = NULL;
+		quality = self->quality;
+		scale = self->scale;
+		pthread_mutex_unlock( &self->mutex );
+		if ( !frame )
+			break;
+
+		// The image was rendered by the consumer thread
+		if ( !mlt_frame_get_image( frame, &image, &format, &width, &height, 0 ) && image && format == mlt_image_rgb24 )
+		{
+			int scaled_width = MAX( 16, width * scale );
+			int scaled_height = MAX( 16, height * scale );
+
+			if ( scaled_width < width && scaled_height < height )
+			{
+				uint8_t *scaled = mlt_pool_alloc( scaled_width * scaled_height * 3 );
+				if ( scaled )
+				{
+					scale_image( image, width, height, scaled, scaled_width, scaled_height );
+					encoded = encode_image( scaled, scaled_width, scaled_height, quality );
+					mlt_pool_release( scaled );
+				}
+			}
+			else
+			{
+				encoded = encode_image( image, width, height, quality );
+			}
+		}
+		mlt_frame_close( frame );
+
+		if ( encoded )
+		{
+			encoded->sequence = sequence;
+			pthread_mutex_lock( &self->mutex );
+			if ( !self->latest || self->latest->sequence < sequence )
+			{
+				image_release( self->latest );
+				self->latest = encoded;
+				encoded = NULL;
+				pthread_cond_broadcast( &self->image_cond );
+			}
+			else
+			{
+				self->dropped++;
+			}
+			pthread_mutex_unlock( &self->mutex );
+			image_release( encoded );
+		}
+		else
+		{
+			mlt_log_warning( MLT_CONSUMER_SERVICE( &self->parent ), "failed to encode frame %" PRId64 "\n", sequence );
+		}
+	}
+	mlt_properties_set_int( properties, "dropped", self->dropped );
+	return NULL;
+}
+
+static int send_all( client c, const void *data, size_t size )
+{
+	const char *p = data;
+
+	while ( size > 0 )
+	{
+		ssize_t sent = send( c->fd, p, size, MSG_NOSIGNAL );
+		if ( sent <= 0 )
+			return 1;
+		pthread_mutex_lock( &c->self->mutex );
+		c->bytes += sent;
+		pthread_mutex_unlock( &c->self->mutex );
+		p += sent;
+		size -= sent;
+	}
+	return 0;
+}
+
+/** Send the newest image whenever it changes, skipping those that came while sending. */
+
+static void *client_thread( void *arg )
+{
+	client c = arg;
+	consumer_jpeg_preview self = c->self;
+	struct timeval timeout = { 5, 0 };
+	int buffer_size = 128 * 1024;
+	char buffer[ 4096 ];
+	int64_t sent = 0;
+	int error;
+
+	// A small send buffer keeps the latency low and the busy time honest
+	setsockopt( c->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	setsockopt( c->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+	setsockopt( c->fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof( buffer_size ) );
+	error = recv( c->fd, buffer, sizeof( buffer ), 0 ) <= 0;
+	if ( !error )
+		error = send_all( c, buffer, snprintf( buffer, sizeof( buffer ), "HTTP/1.0 200 OK\r\n"
+			"Cache-Control: no-cache\r\nConnection: close\r\n"
+			"Content-Type: multipart/x-mixed-replace; boundary=" BOUNDARY "\r\n\r\n" ) );
+
+	while ( !error )
+	{
+		jpeg_image image = NULL;
+		int length;
+
+		pthread_mutex_lock( &self->mutex );
+		while ( self->running && ( !self->latest || self->latest->sequence <= sent ) )
+			pthread_cond_wait( &self->image_cond, &self->mutex );
+		if ( self->running )
+		{
+			image = self->latest;
+			image->refs++;
+			c->sending = time_now( );
+		}
+		pthread_mutex_unlock( &self->mutex );
+		if ( !image )
+			break;
+
+		length = snprintf( buffer, sizeof( buffer ), "--" BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+			"Content-Length: %lu\r\n\r\n", image->size );
+		error = send_all( c, buffer, length ) || send_all( c, image->data, image->size )
+			|| send_all( c, "\r\n", 2 );
+		sent = image->sequence;
+
+		pthread_mutex_lock( &self->mutex );
+		c->busy += time_now( ) - c->sending;
+		c->sending = 0;
+		image_release( image );
+		pthread_mutex_unlock( &self->mutex );
+	}
+
+	close( c->fd );
+	c->done = 1;
+	return NULL;
+}
+
+static int listen_on( consumer_jpeg_preview self, int port )
+{
+	struct sockaddr_in address;
+	int one = 1;
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+	if ( fd < 0 )
+		return -1;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port = htons( port );
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	if ( bind( fd, (struct sockaddr*) &address, sizeof( address ) ) || listen( fd, 8 ) )
+	{
+		mlt_log_error( MLT_CONSUMER_SERVICE( &self->parent ), "cannot listen on port %d\n", port );
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/** Remove the clients that have disconnected. Called with the mutex locked. */
+
+static void reap_clients( consumer_jpeg_preview self, int all )
+{
+	client *p = &self->clients;
+
+	while ( *p )
+	{
+		client c = *p;
+		if ( all || c->done )
+		{
+			*p = c->next;
+			pthread_mutex_unlock( &self->mutex );
+			pthread_join( c->thread, NULL );
+			free( c );
+			pthread_mutex_lock( &self->mutex );
+		}
+		else
+		{
+			p = &c->next;
+		}
+	}
+}
+
+static void *server_thread( void *arg )
+{
+	consumer_jpeg_preview self = arg;
+
+	while ( self->running )
+	{
+		struct timeval timeout = { 0, 200000 };
+		fd_set fds;
+
+		FD_ZERO( &fds );
+		FD_SET( self->listener, &fds );
+		if ( select( self->listener + 1, &fds, NULL, NULL, &timeout ) > 0 )
+		{
+			int fd = accept( self->listener, NULL, NULL );
+			client c = fd >= 0 ? calloc( 1, sizeof( *c ) ) : NULL;
+
+			if ( c )
+			{
+				c->self = self;
+				c->fd = fd;
+				if ( pthread_create( &c->thread, NULL, client_thread, c ) == 0 )
+				{
+					pthread_mutex_lock( &self->mutex );
+					c->next = self->clients;
+					self->clients = c;
+					pthread_mutex_unlock( &self->mutex );
+				}
+				else
+				{
+					close( fd );
+					free( c );
+				}
+			}
+			else if ( fd >= 0 )
+			{
+				close( fd );
+			}
+		}
+		pthread_mutex_lock( &self->mutex );
+		reap_clients( self, 0 );
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return NULL;
+}
+
+/** Fit the quality and then the size to the client that is busiest sending.
+ *
+ * A client that spends most of the time in send() is limited by its
+ * bandwidth, so the frames get smaller until it has time to spare, and larger
+ * again when all the clients are mostly idle.
+ */
+
+static void adapt( consumer_jpeg_preview self, int64_t now, int64_t elapsed )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
+	int max_quality = CLAMP( mlt_properties_get_int( properties, "quality" ), 1, 100 );
+	int min_quality = CLAMP( mlt_properties_get_int( properties, "min_quality" ), 1, max_quality );
+	double min_scale = CLAMP( mlt_properties_get_double( properties, "min_scale" ), 0.05, 1.0 );
+	double busy = 0.0, bandwidth = 0.0;
+	client c;
+
+	pthread_mutex_lock( &self->mutex );
+	for ( c = self->clients; c; c = c->next )
+	{
+		// A slow client may still be sending an image from before
+		if ( c->sending )
+		{
+			c->busy += now - c->sending;
+			c->sending = now;
+		}
+		if ( (double) c->busy / elapsed > busy )
+		{
+			busy = (double) c->busy / elapsed;
+			bandwidth = c->bytes * 1000000.0 / elapsed;
+		}
+		c->bytes = c->busy = 0;
+	}
+
+	if ( !mlt_properties_get_int( properties, "adaptive" ) )
+	{
+		self->quality = max_quality;
+		self->scale = 1.0;
+	}
+	else if ( busy > 0.8 )
+	{
+		if ( self->quality > min_quality )
+			self->quality = MAX( self->quality - 10, min_quality );
+		else
+			self->scale = MAX( self->scale * 0.75, min_scale );
+	}
+	else if ( busy < 0.4 )
+	{
+		if ( self->scale < 1.0 )
+			self->scale = MIN( self->scale / 0.75, 1.0 );
+		else
+			self->quality = MIN( self->quality + 5, max_quality );
+	}
+	self->quality = CLAMP( self->quality, min_quality, max_quality );
+	self->scale = CLAMP( self->scale, min_scale, 1.0 );
+	pthread_mutex_unlock( &self->mutex );
+
+	mlt_properties_set_int( properties, "current_quality", self->quality );
+	mlt_properties_set_double( properties, "current_scale", self->scale );
+	// A client blocked for the whole second has no new reading
+	if ( bandwidth > 0.0 || busy == 0.0 )
+		mlt_properties_set_double( properties, "bandwidth", bandwidth );
+	mlt_properties_set_int( properties, "dropped", self->dropped );
+}
+
+static int consumer_start( mlt_consumer parent )
+{
+	consumer_jpeg_preview self = parent->child;
+
+	if ( !self->running )
+	{
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( parent );
+		int i;
+
+		consumer_stop( parent );
+
+		self->listener = listen_on( self, mlt_properties_get_int( properties, "port" ) );
+		if ( self->listener < 0 )
+			return 1;
+
+		self->worker_count = CLAMP( mlt_properties_get_int( properties, "threads" ), 1, 16 );
+		self->workers = calloc( self->worker_count, sizeof( pthread_t ) );
+		self->quality = CLAMP( mlt_properties_get_int( properties, "quality" ), 1, 100 );
+		self->scale = 1.0;
+		self->sequence = 0;
+		self->dropped = 0;
+		self->running = 1;
+		self->joined = 0;
+		for ( i = 0; i < self->worker_count; i++ )
+			pthread_create( &self->workers[i], NULL, worker_thread, self );
+		pthread_create( &self->server_thread, NULL, server_thread, self );
+		pthread_create( &self->thread, NULL, consumer_thread, self );
+	}
+	return 0;
+}
+
+static int consumer_stop( mlt_consumer parent )
+{
+	consumer_jpeg_preview self = parent->child;
+
+	if ( !self->joined )
+	{
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( parent );
+		int app_locked = mlt_properties_get_int( properties, "app_locked" );
+		void ( *lock )( void ) = mlt_properties_get_data( properties, "app_lock", NULL );
+		void ( *unlock )( void ) = mlt_properties_get_data( properties, "app_unlock", NULL );
+		client c;
+		int i;
+
+		if ( app_locked && unlock ) unlock( );
+
+		// Wake everything that waits and kick the clients out of send()
+		pthread_mutex_lock( &self->mutex );
+		self->running = 0;
+		for ( c = self->clients; c; c = c->next )
+			shutdown( c->fd, SHUT_RDWR );
+		pthread_cond_broadcast( &self->frame_cond );
+		pthread_cond_broadcast( &self->image_cond );
+		pthread_mutex_unlock( &self->mutex );
+
+		pthread_join( self->thread, NULL );
+		pthread_join( self->server_thread, NULL );
+		for ( i = 0; i < self->worker_count; i++ )
+			pthread_join( self->workers[i], NULL );
+		free( self->workers );
+		self->workers = NULL;
+		self->worker_count = 0;
+
+		pthread_mutex_lock( &self->mutex );
+		reap_clients( self, 1 );
+		if ( self->pending )
+			mlt_frame_close( self->pending );
+		self->pending = NULL;
+		image_release( self->latest );
+		self->latest = NULL;
+		pthread_mutex_unlock( &self->mutex );
+
+		close( self->listener );
+		self->listener = -1;
+		self->joined = 1;
+
+		if ( app_locked && lock ) lock( );
+	}
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer parent )
+{
+	consumer_jpeg_preview self = parent->child;
+	return !self->running;
+}
+
+/** Pace the frames at the frame rate and hand the newest to the workers. */
+
+static void *consumer_thread( void *arg )
+{
+	consumer_jpeg_preview self = arg;
+	mlt_consumer consumer = &self->parent;
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	int terminate_on_pause = mlt_properties_get_int( properties, "terminate_on_pause" );
+	int real_time = mlt_properties_get_int( properties, "real_time" );
+	int64_t frame_duration = 1000000 / mlt_profile_fps( mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) ) );
+	int64_t start = time_now( );
+	int64_t adapted = start;
+	int64_t count = 0;
+	int terminated = 0;
+
+	while ( !terminated && self->running )
+	{
+		mlt_frame frame = mlt_consumer_rt_frame( consumer );
+		double speed;
+		int64_t now;
+
+		if ( !frame )
+			continue;
+
+		speed = mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame ), "_speed" );
+		if ( terminate_on_pause )
+			terminated = speed == 0.0;
+
+		now = time_now( );
+		if ( real_time && speed == 1.0 )
+		{
+			int64_t due = start + count * frame_duration;
+
+			// Restart the clock when too far behind instead of rushing to catch up
+			if ( now > due + 1000000 )
+			{
+				start = now;
+				count = 0;
+			}
+			else if ( due > now )
+			{
+				usleep( due - now );
+			}
+			count++;
+		}
+		else
+		{
+			start = now;
+			count = 0;
+		}
+
+		if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "rendered" ) == 1 )
+		{
+			mlt_image_format format = mlt_image_rgb24;
+			uint8_t *image = NULL;
+			int width = 0, height = 0;
+
+			mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+			mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+
+			// A frame that no worker took yet is stale
+			pthread_mutex_lock( &self->mutex );
+			if ( self->pending )
+			{
+				mlt_frame_close( self->pending );
+				self->dropped++;
+			}
+			self->pending = frame;
+			self->pending_sequence = ++self->sequence;
+			pthread_cond_signal( &self->frame_cond );
+			pthread_mutex_unlock( &self->mutex );
+		}
+		else
+		{
+			mlt_frame_close( frame );
+			self->dropped++;
+		}
+
+		if ( now - adapted >= 1000000 )
+		{
+			adapt( self, now, now - adapted );
+			adapted = now;
+		}
+	}
+
+	self->running = 0;
+	mlt_consumer_stopped( consumer );
+	return NULL;
+}
+
+static void consumer_close( mlt_consumer parent )
+{
+	consumer_jpeg_preview self = parent->child;
+
+	mlt_consumer_stop( parent );
+	mlt_consumer_close( parent );
+	pthread_mutex_destroy( &self->mutex );
+	pthread_cond_destroy( &self->frame_cond );
+	pthread_cond_destroy( &self->image_cond );
+	free( self );
+}
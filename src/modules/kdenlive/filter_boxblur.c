@@ -20,70 +20,256 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_profile.h>
+#include <framework/mlt_slices.h>
+#include <framework/mlt_pool.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+// Do not blur bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (32)
 
-static void PreCompute(uint8_t *image, int32_t *rgba, int width, int height)
+/* The blur is separable: a running sum of the rows inside the vertical box
+ * is kept for every column, and a prefix sum of that row gives the sum of the
+ * horizontal box. Each row of the result is written in place as soon as the
+ * rows it depends on have been summed, so besides the image only a ring of the
+ * rows inside the box is needed. The sums, edges and rounding are the same as
+ * those of a summed area table of the whole image.
+ */
+
+struct blur_slice_desc
+{
+	uint8_t *image;
+	uint8_t **halos;
+	int width;
+	int height;
+	int boxw;
+	int boxh;
+	float mul;
+};
+
+static inline int band_start( int index, int jobs, int height )
+{
+	return height * index / jobs;
+}
+
+/** The rows that cross a band boundary are copied before blurring, since the
+ * band on the other side overwrites them.
+ */
+
+static inline int halo_start( struct blur_slice_desc *desc, int boundary )
+{
+	return MAX( boundary - desc->boxh, 0 );
+}
+
+static inline int halo_end( struct blur_slice_desc *desc, int boundary )
+{
+	return MIN( boundary + desc->boxh, desc->height );
+}
+
+static uint8_t *GetRow( struct blur_slice_desc *desc, int index, int jobs, int y )
+{
+	int stride = desc->width * 4;
+	int y0 = band_start( index, jobs, desc->height );
+	int y1 = band_start( index + 1, jobs, desc->height );
+
+	if ( y >= y0 && y < y1 )
+		return desc->image + y * stride;
+	index = y < y0 ? index : index + 1;
+	return desc->halos[index] + ( y - halo_start( desc, band_start( index, jobs, desc->height ) ) ) * stride;
+}
+
+typedef void (*column_function)( uint32_t *column, const uint8_t *row, int n, int subtract );
+typedef void (*output_function)( uint8_t *image, uint32_t *prefix, const uint32_t *column, int width, int boxw, float mul );
+
+static void ColumnSumC( uint32_t *column, const uint8_t *row, int n, int subtract )
 {
-	register int x, y, z;
-	int32_t pts[4];
-	
-	for (y = 0; y < height; y++)
+	int i;
+	if ( subtract )
+		for ( i = 0; i < n; i++ )
+			column[i] -= row[i];
+	else
+		for ( i = 0; i < n; i++ )
+			column[i] += row[i];
+}
+
+static void OutputRowC( uint8_t *image, uint32_t *prefix, const uint32_t *column, int width, int boxw, float mul )
+{
+	int x, i;
+
+	// The sums wrap around like the table would on very large images
+	for ( i = 0; i < 4; i++ )
+		prefix[i] = column[i];
+	for ( i = 4; i < width * 4; i++ )
+		prefix[i] = prefix[i - 4] + column[i];
+
+	for ( x = 0; x < width; x++ )
 	{
-		for (x = 0; x < width; x++)
+		uint32_t *right = prefix + 4 * MIN( x + boxw, width - 1 );
+		uint32_t *left = prefix + 4 * MAX( x - boxw, 0 );
+		*image++ = (int32_t) ( right[0] - left[0] ) * mul;
+		*image++ = (int32_t) ( right[1] - left[1] ) * mul;
+		*image++ = (int32_t) ( right[2] - left[2] ) * mul;
+		*image++ = (int32_t) ( right[3] - left[3] ) * mul;
+	}
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define BLUR_SSE2 __attribute__((target("sse2")))
+
+static BLUR_SSE2 void ColumnSumSSE2( uint32_t *column, const uint8_t *row, int n, int subtract )
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i, j;
+
+	for ( i = 0; i + 16 <= n; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*) ( row + i ) );
+		__m128i w[4];
+		w[0] = _mm_unpacklo_epi8( v, zero );
+		w[2] = _mm_unpackhi_epi8( v, zero );
+		w[1] = _mm_unpackhi_epi16( w[0], zero );
+		w[0] = _mm_unpacklo_epi16( w[0], zero );
+		w[3] = _mm_unpackhi_epi16( w[2], zero );
+		w[2] = _mm_unpacklo_epi16( w[2], zero );
+		for ( j = 0; j < 4; j++ )
 		{
-			pts[0] = image[0];
-			pts[1] = image[1];
-			pts[2] = image[2];
-			pts[3] = image[3];
-			for (z = 0; z < 4; z++)
-			{
-				if (x > 0) pts[z] += rgba[-4];
-				if (y > 0) pts[z] += rgba[width * -4];
-				if (x>0 && y>0) pts[z] -= rgba[(width + 1) * -4];
-				*rgba++ = pts[z];
-			}
-			image += 4;
+			__m128i *c = (__m128i*) ( column + i + j * 4 );
+			__m128i sum = _mm_loadu_si128( c );
+			sum = subtract ? _mm_sub_epi32( sum, w[j] ) : _mm_add_epi32( sum, w[j] );
+			_mm_storeu_si128( c, sum );
 		}
 	}
+	ColumnSumC( column + i, row + i, n - i, subtract );
 }
 
-static inline int32_t GetRGBA(int32_t *rgba, unsigned int w, unsigned int h, unsigned int x, int offsetx, unsigned int y, int offsety, unsigned int z)
+static BLUR_SSE2 void OutputRowSSE2( uint8_t *image, uint32_t *prefix, const uint32_t *column, int width, int boxw, float mul )
 {
-	int xtheo = x + offsetx;
-	int ytheo = y + offsety;
-	return rgba[4 * (CLAMP(xtheo, 0, w-1) + CLAMP(ytheo, 0, h-1) * w) + z];
+	const __m128 scale = _mm_set1_ps( mul );
+	__m128i sum = _mm_setzero_si128();
+	int x;
+
+	// One pixel is one vector of its four channels
+	for ( x = 0; x < width; x++ )
+	{
+		sum = _mm_add_epi32( sum, _mm_loadu_si128( (const __m128i*) ( column + x * 4 ) ) );
+		_mm_storeu_si128( (__m128i*) ( prefix + x * 4 ), sum );
+	}
+	for ( x = 0; x < width; x++ )
+	{
+		__m128i right = _mm_loadu_si128( (const __m128i*) ( prefix + 4 * MIN( x + boxw, width - 1 ) ) );
+		__m128i left = _mm_loadu_si128( (const __m128i*) ( prefix + 4 * MAX( x - boxw, 0 ) ) );
+		__m128i v = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( _mm_sub_epi32( right, left ) ), scale ) );
+		v = _mm_packs_epi32( v, v );
+		v = _mm_packus_epi16( v, v );
+		*(int32_t*) ( image + x * 4 ) = _mm_cvtsi128_si32( v );
+	}
 }
 
-static void DoBoxBlur(uint8_t *image, int32_t *rgba, unsigned int width, unsigned int height, unsigned int boxw, unsigned int boxh)
+static void BoxBlurSimdDetect( column_function *column_sum, output_function *output_row )
 {
-	register int x, y;
-	float mul = 1.f / ((boxw*2) * (boxh*2));
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+	{
+		*column_sum = ColumnSumSSE2;
+		*output_row = OutputRowSSE2;
+	}
+}
+
+#else
+
+static void BoxBlurSimdDetect( column_function *column_sum, output_function *output_row )
+{
+}
+
+#endif
+
+static int DoBoxBlurSlice( int id, int index, int jobs, void *cookie )
+{
+	struct blur_slice_desc *desc = (struct blur_slice_desc *) cookie;
+	int width = desc->width;
+	int height = desc->height;
+	int stride = width * 4;
+	int ring_size = MIN( 2 * desc->boxh + 1, height );
+	int y0 = band_start( index, jobs, height );
+	int y1 = band_start( index + 1, jobs, height );
+	uint8_t *ring = mlt_pool_alloc( ring_size * stride );
+	uint32_t *column = mlt_pool_alloc( 2 * stride * sizeof( uint32_t ) );
+	uint32_t *prefix = column + stride;
+	int top = CLAMP( y0 - desc->boxh, 0, height - 1 );
+	int bottom = top;
+	column_function column_sum = ColumnSumC;
+	output_function output_row = OutputRowC;
+	int y;
+
+	BoxBlurSimdDetect( &column_sum, &output_row );
 
-	for (y = 0; y < height; y++)
+	memset( column, 0, stride * sizeof( uint32_t ) );
+
+	for ( y = y0; y < y1; y++ )
+	{
+		// Slide the vertical box over the rows (top, bottom]
+		int new_top = CLAMP( y - desc->boxh, 0, height - 1 );
+		int new_bottom = CLAMP( y + desc->boxh, 0, height - 1 );
+
+		for ( ; top < new_top; top++ )
+			column_sum( column, ring + ( ( top + 1 ) % ring_size ) * stride, stride, 1 );
+		for ( ; bottom < new_bottom; bottom++ )
+		{
+			uint8_t *row = ring + ( ( bottom + 1 ) % ring_size ) * stride;
+			memcpy( row, GetRow( desc, index, jobs, bottom + 1 ), stride );
+			column_sum( column, row, stride, 0 );
+		}
+
+		output_row( desc->image + y * stride, prefix, column, width, desc->boxw, desc->mul );
+	}
+
+	mlt_pool_release( column );
+	mlt_pool_release( ring );
+	return 0;
+}
+
+static void DoBoxBlur( uint8_t *image, unsigned int width, unsigned int height, unsigned int boxw, unsigned int boxh )
+{
+	struct blur_slice_desc desc =
+	{
+		.image = image,
+		.width = width,
+		.height = height,
+		.boxw = boxw,
+		.boxh = boxh,
+		.mul = 1.f / ((boxw*2) * (boxh*2))
+	};
+	int stride = width * 4;
+	int jobs = MIN( mlt_slices_count_normal(), (int) height / MAX( MIN_SLICE_HEIGHT, (int) boxh ) );
+	int i;
+
+	if ( jobs > 1 )
 	{
-		for (x = 0; x < width; x++)
+		desc.halos = calloc( jobs, sizeof( *desc.halos ) );
+		for ( i = 1; i < jobs; i++ )
 		{
-			*image++ = (GetRGBA(rgba, width, height, x, +boxw, y, +boxh, 0)
-			          + GetRGBA(rgba, width, height, x, -boxw, y, -boxh, 0)
-			          - GetRGBA(rgba, width, height, x, -boxw, y, +boxh, 0)
-			          - GetRGBA(rgba, width, height, x, +boxw, y, -boxh, 0)) * mul;
-			*image++ = (GetRGBA(rgba, width, height, x, +boxw, y, +boxh, 1)
-			          + GetRGBA(rgba, width, height, x, -boxw, y, -boxh, 1)
-			          - GetRGBA(rgba, width, height, x, -boxw, y, +boxh, 1)
-			          - GetRGBA(rgba, width, height, x, +boxw, y, -boxh, 1)) * mul;
-			*image++ = (GetRGBA(rgba, width, height, x, +boxw, y, +boxh, 2)
-			          + GetRGBA(rgba, width, height, x, -boxw, y, -boxh, 2)
-			          - GetRGBA(rgba, width, height, x, -boxw, y, +boxh, 2)
-			          - GetRGBA(rgba, width, height, x, +boxw, y, -boxh, 2)) * mul;
-			*image++ = (GetRGBA(rgba, width, height, x, +boxw, y, +boxh, 3)
-			          + GetRGBA(rgba, width, height, x, -boxw, y, -boxh, 3)
-			          - GetRGBA(rgba, width, height, x, -boxw, y, +boxh, 3)
-			          - GetRGBA(rgba, width, height, x, +boxw, y, -boxh, 3)) * mul;
+			int boundary = band_start( i, jobs, height );
+			int start = halo_start( &desc, boundary );
+			int size = ( halo_end( &desc, boundary ) - start ) * stride;
+			desc.halos[i] = mlt_pool_alloc( size );
+			memcpy( desc.halos[i], image + start * stride, size );
 		}
+		mlt_slices_run_normal( jobs, DoBoxBlurSlice, &desc );
+		for ( i = 1; i < jobs; i++ )
+			mlt_pool_release( desc.halos[i] );
+		free( desc.halos );
+	}
+	else
+	{
+		desc.halos = NULL;
+		DoBoxBlurSlice( 0, 0, 1, &desc );
 	}
 }
 
@@ -114,8 +300,10 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		factor = mlt_properties_anim_get_double( properties, "blur", position, length );
 	}
 
-	boxw = (unsigned int)(factor * hori);
-	boxh = (unsigned int)(factor * vert);
+	// Keep the blur the same relative size when rendering below the profile size
+	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+	boxw = (unsigned int)(factor * hori * mlt_profile_scale_width( profile, *width ));
+	boxh = (unsigned int)(factor * vert * mlt_profile_scale_height( profile, *height ));
 
 	if ( boxw == 0 && boxh == 0 )
 	{
@@ -131,11 +319,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		// Only process if we have no error and a valid colour space
 		if ( error == 0 )
 		{
-			int size = mlt_image_format_size( *format, *width, *height, NULL );
-			int32_t *rgba = mlt_pool_alloc( 4 * size );
-			PreCompute( *image, rgba, *width, *height );
-			DoBoxBlur( *image, rgba, *width, *height, MAX(1, boxw), MAX(1, boxh) );
-			mlt_pool_release( rgba );
+			DoBoxBlur( *image, *width, *height, MAX(1, boxw), MAX(1, boxh) );
 		}
 	}
 	return error;
@@ -30,6 +30,144 @@
 // Forward references.
 static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
 
+/** A source frame kept with its image rendered for one request.
+*/
+
+typedef struct
+{
+	mlt_frame frame;
+	mlt_position position;
+	mlt_image_format format;
+	int width;
+	int height;
+} buffered_frame;
+
+/** The recent source frames, shared by the output frames that show them.
+*/
+
+typedef struct
+{
+	buffered_frame *frames;
+	int count;
+	int next;
+	mlt_position last;
+} frame_ring;
+
+static void ring_clear( frame_ring *ring )
+{
+	int i;
+	for ( i = 0; i < ring->count; i++ )
+		mlt_frame_close( ring->frames[i].frame );
+	free( ring->frames );
+	ring->frames = NULL;
+	ring->count = 0;
+	ring->next = 0;
+}
+
+static void ring_close( frame_ring *ring )
+{
+	ring_clear( ring );
+	free( ring );
+}
+
+/** Get the ring of the producer, sized by its "cache" property.
+*/
+
+static frame_ring *get_ring( mlt_properties properties )
+{
+	frame_ring *ring = mlt_properties_get_data( properties, "_ring", NULL );
+	int count = mlt_properties_get( properties, "cache" ) ? mlt_properties_get_int( properties, "cache" ) : 8;
+
+	if ( count < 1 )
+		count = 1;
+	if ( ring == NULL )
+	{
+		ring = calloc( 1, sizeof( *ring ) );
+		ring->last = -1;
+		mlt_properties_set_data( properties, "_ring", ring, 0, ( mlt_destructor )ring_close, NULL );
+	}
+	if ( ring->count != count )
+	{
+		ring_clear( ring );
+		ring->frames = calloc( count, sizeof( *ring->frames ) );
+		ring->count = count;
+	}
+	return ring;
+}
+
+static buffered_frame *ring_find( frame_ring *ring, mlt_position position, mlt_image_format format, int width, int height )
+{
+	int i;
+	for ( i = 0; i < ring->count; i++ )
+	{
+		buffered_frame *slot = &ring->frames[i];
+		if ( slot->frame && slot->position == position && slot->format == format
+			 && slot->width == width && slot->height == height )
+			return slot;
+	}
+	return NULL;
+}
+
+/** Render a source frame into the oldest slot of the ring.
+*/
+
+static buffered_frame *ring_fetch( mlt_producer producer, frame_ring *ring, mlt_frame frame, mlt_position position,
+	mlt_image_format format, int width, int height, int index, int *error )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	mlt_producer real_producer = mlt_properties_get_data( properties, "producer", NULL );
+	mlt_frame source = NULL;
+	uint8_t *image = NULL;
+	buffered_frame *slot = &ring->frames[ ring->next ];
+
+	// Seek the producer to the correct place
+	mlt_producer_seek( real_producer, position );
+
+	// Get the frame
+	mlt_service_get_frame( MLT_PRODUCER_SERVICE( real_producer ), &source, index );
+	if ( source == NULL )
+	{
+		*error = 1;
+		return NULL;
+	}
+	mlt_properties_set( MLT_FRAME_PROPERTIES( source ), "rescale.interp", mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "rescale.interp" ) );
+
+	// The output frames get the image copy-on-write, so it needs not be writable here
+	slot->format = format;
+	slot->width = width;
+	slot->height = height;
+	*error = mlt_frame_get_image( source, &image, &format, &width, &height, 0 );
+	if ( *error != 0 )
+	{
+		mlt_log_warning( MLT_PRODUCER_SERVICE( producer ), "first_image == NULL get image died\n" );
+		mlt_frame_close( source );
+		return NULL;
+	}
+
+	mlt_frame_close( slot->frame );
+	slot->frame = source;
+	slot->position = position;
+	ring->next = ( ring->next + 1 ) % ring->count;
+
+	// Keep the latest source frame for the properties of the next output frames
+	mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( source ) );
+	mlt_properties_set_data( properties, "first_frame", source, 0, ( mlt_destructor )mlt_frame_close, NULL );
+
+	return slot;
+}
+
+// Share a buffer of a source frame with an output frame, or copy it if it cannot be shared.
+static void *share_data( mlt_frame frame, const char *name, int size )
+{
+	void *data = mlt_frame_share_data( frame, name, NULL );
+	if ( data == NULL )
+	{
+		data = mlt_pool_alloc( size );
+		memcpy( data, mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), name, NULL ), size );
+	}
+	return data;
+}
+
 /** Image stack(able) method
 */
 
@@ -45,7 +183,6 @@ static int framebuffer_get_image( mlt_frame frame, uint8_t **image, mlt_image_fo
 
 	// Frame properties objects
 	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
-	mlt_frame first_frame = mlt_properties_get_data( properties, "first_frame", NULL );
 
 	// Get producer parameters
 	int strobe = mlt_properties_get_int( properties, "strobe" );
@@ -55,7 +192,6 @@ static int framebuffer_get_image( mlt_frame frame, uint8_t **image, mlt_image_fo
 	int in = mlt_properties_get_position( properties, "in" );
 
 	// Determine the position
-	mlt_position first_position = (first_frame != NULL) ? mlt_frame_get_position( first_frame ) : -1;
 	mlt_position need_first = freeze;
 
 	if ( !freeze || freeze_after || freeze_before )
@@ -88,116 +224,53 @@ static int framebuffer_get_image( mlt_frame frame, uint8_t **image, mlt_image_fo
 		// set format to the original's producer format
 		*format = (mlt_image_format) mlt_properties_get_int( properties, "_original_format" );
 	}
-	// Determine output buffer size
+	// Determine the output size
 	*width = mlt_properties_get_int( frame_properties, "width" );
 	*height = mlt_properties_get_int( frame_properties, "height" );
-	int size = mlt_image_format_size( *format, *width, *height, NULL );
-
-	// Get output buffer
-	int buffersize = 0;
-        int alphasize = *width * *height;
-	uint8_t *output = mlt_properties_get_data( properties, "output_buffer", &buffersize );
-        uint8_t *output_alpha = mlt_properties_get_data( properties, "output_alpha", NULL );
-	if( buffersize == 0 || buffersize != size )
-	{
-		// invalidate cached frame
-		first_position = -1;
-	}
-
-	if ( need_first != first_position )
-	{
-		// invalidate cached frame
-		first_position = -1;
-		
-		// Bust the cached frame
-		mlt_properties_set_data( properties, "first_frame", NULL, 0, NULL, NULL );
-		first_frame = NULL;
-	}
-
-	if ( output && first_position != -1 ) {
-		// Using the cached frame
-	  	uint8_t *image_copy = mlt_pool_alloc( size );
-		memcpy( image_copy, output, size );
-                uint8_t *alpha_copy = mlt_pool_alloc( alphasize );
-                memcpy( alpha_copy, output_alpha, alphasize );
 
-		// Set the output image
-		*image = image_copy;
-		mlt_frame_set_image( frame, image_copy, size, mlt_pool_release );
-                mlt_frame_set_alpha( frame, alpha_copy, alphasize, mlt_pool_release );
+	// Neighbouring output frames share the source frames kept in the ring
+	frame_ring *ring = get_ring( properties );
+	buffered_frame *slot = ring_find( ring, need_first, *format, *width, *height );
+	int error = 0;
 
-		*width = mlt_properties_get_int( properties, "_output_width" );
-		*height = mlt_properties_get_int( properties, "_output_height" );
-		*format = mlt_properties_get_int( properties, "_output_format" );
-
-		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
-		return 0;
-	}
-
-	// Get the cached frame
-	if ( first_frame == NULL )
+	if ( slot == NULL )
 	{
-		// Get the frame to cache from the real producer
-		mlt_producer real_producer = mlt_properties_get_data( properties, "producer", NULL );
-
-		// Seek the producer to the correct place
-		mlt_producer_seek( real_producer, need_first );
-
-		// Get the frame
-		mlt_service_get_frame( MLT_PRODUCER_SERVICE( real_producer ), &first_frame, index );
-
-		// Cache the frame
-		mlt_properties_set_data( properties, "first_frame", first_frame, 0, ( mlt_destructor )mlt_frame_close, NULL );
+		// When playing backwards, fetch the source frames before this one in
+		// forward order so that the real producer only seeks once per ring
+		mlt_position position = need_first;
+		mlt_position step = ring->last - need_first;
+		if ( ring->last >= 0 && step > 0 && step <= ring->count )
+			position = MAX( 0, need_first - ( ring->count - 1 ) * step );
+		for ( ; position <= need_first && !error; position += MAX( step, 1 ) )
+		{
+			if ( position == need_first || !ring_find( ring, position, *format, *width, *height ) )
+				slot = ring_fetch( producer, ring, frame, position, *format, *width, *height, index, &error );
+		}
 	}
-	mlt_properties first_frame_properties = MLT_FRAME_PROPERTIES( first_frame );
+	ring->last = need_first;
 
-
-	// Which frames are buffered?
-	uint8_t *first_image = mlt_properties_get_data( first_frame_properties, "image", NULL );
-        uint8_t *first_alpha = mlt_properties_get_data( first_frame_properties, "alpha", NULL );
-	if ( !first_image )
+	if ( slot == NULL )
 	{
-		mlt_properties_set( first_frame_properties, "rescale.interp", mlt_properties_get( frame_properties, "rescale.interp" ) );
-
-		int error = mlt_frame_get_image( first_frame, &first_image, format, width, height, writable );
-
-		if ( error != 0 ) {
-			mlt_log_warning( MLT_PRODUCER_SERVICE( producer ), "first_image == NULL get image died\n" );
-			mlt_properties_set_data( properties, "first_frame", NULL, 0, NULL, NULL );
-			mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
-			return error;
-		}
-		output = mlt_pool_alloc( size );
-		memcpy( output, first_image, size );
-		// Let someone else clean up
-		mlt_properties_set_data( properties, "output_buffer", output, size, mlt_pool_release, NULL ); 
-		mlt_properties_set_int( properties, "_output_width", *width );
-		mlt_properties_set_int( properties, "_output_height", *height );
-		mlt_properties_set_int( properties, "_output_format", *format );
+		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+		return error ? error : 1;
 	}
 
-	if ( !first_alpha )
-        {
-                alphasize = *width * *height;
-                first_alpha = mlt_frame_get_alpha_mask( first_frame );
-                output_alpha = mlt_pool_alloc( alphasize );
-                memcpy( output_alpha, first_alpha, alphasize );
-                mlt_properties_set_data( properties, "output_alpha", output_alpha, alphasize, mlt_pool_release, NULL ); 
-        }
+	// Set the output image
+	mlt_properties source_properties = MLT_FRAME_PROPERTIES( slot->frame );
+	int size = 0;
+	mlt_properties_get_data( source_properties, "image", &size );
+	*format = mlt_properties_get_int( source_properties, "format" );
+	*width = mlt_properties_get_int( source_properties, "width" );
+	*height = mlt_properties_get_int( source_properties, "height" );
+	if ( size <= 0 )
+		size = mlt_image_format_size( *format, *width, *height, NULL );
+	*image = share_data( slot->frame, "image", size );
+	mlt_frame_set_image( frame, *image, size, mlt_pool_release );
+	if ( mlt_properties_get_data( source_properties, "alpha", NULL ) )
+		mlt_frame_set_alpha( frame, share_data( slot->frame, "alpha", *width * *height ), *width * *height, mlt_pool_release );
 
 	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 
-	// Create a copy
-	uint8_t *image_copy = mlt_pool_alloc( size );
-	memcpy( image_copy, first_image, size );
-        uint8_t *alpha_copy = mlt_pool_alloc( alphasize );
-        memcpy( alpha_copy, first_alpha, alphasize );
-
-	// Set the output image
-	*image = image_copy;
-	mlt_frame_set_image( frame, image_copy, size, mlt_pool_release );
-	mlt_frame_set_alpha( frame, alpha_copy, alphasize, mlt_pool_release );
-
 	return 0;
 }
 
@@ -68,7 +68,7 @@ using std::endl;
 AVIFile::AVIFile() : RIFFFile(),
 		idx1( NULL ), file_list( -1 ), riff_list( -1 ),
 		hdrl_list( -1 ), avih_chunk( -1 ), movi_list( -1 ), junk_chunk( -1 ), idx1_chunk( -1 ),
-		index_type( -1 ), current_ix00( -1 ), odml_list( -1 ), dmlh_chunk( -1 ), isUpdateIdx1( true )
+		index_type( -1 ), current_ix00( -1 ), dv_index_scanned( 0 ), odml_list( -1 ), dmlh_chunk( -1 ), isUpdateIdx1( true )
 {
 	// cerr << "0x" << hex << (long)this << dec << " AVIFile::AVIFile() : RIFFFile(), ..." << endl;
 
@@ -128,6 +128,8 @@ AVIFile::AVIFile( const AVIFile& avi ) : RIFFFile( avi )
 
 	index_type = avi.index_type;
 	current_ix00 = avi.current_ix00;
+	dv_index = avi.dv_index;
+	dv_index_scanned = avi.dv_index_scanned;
 
 	for ( int i = 0; i < 62; ++i )
 		dmlh[ i ] = avi.dmlh[ i ];
@@ -174,6 +176,8 @@ AVIFile& AVIFile::operator=( const AVIFile& avi )
 
 		index_type = avi.index_type;
 		current_ix00 = avi.current_ix00;
+		dv_index = avi.dv_index;
+		dv_index_scanned = avi.dv_index_scanned;
 
 		for ( int i = 0; i < 62; ++i )
 			dmlh[ i ] = avi.dmlh[ i ];
@@ -324,8 +328,7 @@ int AVIFile::GetDVFrameInfo( off_t &offset, int &size, int frameNum )
 
 		if ( i != current_ix00 )
 		{
-			fail_if( lseek( fd, indx[ 0 ] ->aIndex[ i ].qwOffset + RIFF_HEADERSIZE, SEEK_SET ) == ( off_t ) - 1 );
-			fail_neg( read( fd, ix[ 0 ], indx[ 0 ] ->aIndex[ i ].dwSize - RIFF_HEADERSIZE ) );
+			fail_neg( pread( fd, ix[ 0 ], indx[ 0 ] ->aIndex[ i ].dwSize - RIFF_HEADERSIZE, indx[ 0 ] ->aIndex[ i ].qwOffset + RIFF_HEADERSIZE ) );
 			current_ix00 = i;
 		}
 
@@ -340,23 +343,15 @@ int AVIFile::GetDVFrameInfo( off_t &offset, int &size, int frameNum )
 		break;
 
 	case AVI_SMALL_INDEX:
-		int index = -1;
-		int frameNumIndex = 0;
-		for ( int i = 0; i < idx1->nEntriesInUse; ++i )
+		/* index the video chunks of idx1 once, rather than searching it for every frame */
+
+		for ( ; dv_index_scanned < idx1->nEntriesInUse; ++dv_index_scanned )
 		{
-			FOURCC chunkID1 = make_fourcc( "00dc" );
-			FOURCC chunkID2 = make_fourcc( "00db" );
-			if ( idx1->aIndex[ i ].dwChunkId == chunkID1 ||
-			        idx1->aIndex[ i ].dwChunkId == chunkID2 )
-			{
-				if ( frameNumIndex == frameNum )
-				{
-					index = i;
-					break;
-				}
-				++frameNumIndex;
-			}
+			FOURCC chunkID = idx1->aIndex[ dv_index_scanned ].dwChunkId;
+			if ( chunkID == make_fourcc( "00dc" ) || chunkID == make_fourcc( "00db" ) )
+				dv_index.push_back( dv_index_scanned );
 		}
+		int index = frameNum >= 0 && frameNum < ( int ) dv_index.size() ? dv_index[ frameNum ] : -1;
 		if ( index != -1 )
 		{
 			// compatibility check for broken dvgrab dv2 format
@@ -467,12 +462,13 @@ int AVIFile::GetDVFrame( uint8_t *data, int frameNum )
 	off_t	offset;
 	int	size;
 
-	if ( GetDVFrameInfo( offset, size, frameNum ) != 0 || size < 0 )
-		return -1;
+	// The index is shared, but the frame is read without moving the file position
 	pthread_mutex_lock( &file_mutex );
-	fail_if( lseek( fd, offset, SEEK_SET ) == ( off_t ) - 1 );
-	fail_neg( read( fd, data, size ) );
+	int error = GetDVFrameInfo( offset, size, frameNum ) != 0 || size < 0;
 	pthread_mutex_unlock( &file_mutex );
+	if ( error )
+		return -1;
+	fail_neg( pread( fd, data, size, offset ) );
 
 	return 0;
 }
@@ -804,6 +800,8 @@ void AVIFile::ParseRIFF()
 
 void AVIFile::ReadIndex()
 {
+	dv_index.clear();
+	dv_index_scanned = 0;
 	indx_chunk[ 0 ] = FindDirectoryEntry( make_fourcc( "indx" ) );
 	if ( indx_chunk[ 0 ] != -1 )
 	{
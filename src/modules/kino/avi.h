@@ -29,6 +29,7 @@
 #define _AVI_H 1
 
 #include <stdint.h>
+#include <vector>
 #include "riff.h"
 
 #define PACKED(x)	__attribute__((packed)) x
@@ -267,6 +268,10 @@ protected:
 	int index_type;
 	int current_ix00;
 
+	/// the idx1 entries of the video frames, in order
+	std::vector<int> dv_index;
+	int dv_index_scanned;
+
 	DWORD dmlh[ 62 ];
 	int odml_list;
 	int dmlh_chunk;
@@ -36,6 +36,7 @@ using std::setfill;
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include <time.h>
 #include <sys/time.h>
@@ -337,7 +338,7 @@ bool FileHandler::WriteFrame( const Frame& frame )
 }
 #endif
 
-RawHandler::RawHandler() : fd( -1 )
+RawHandler::RawHandler() : fd( -1 ), map( NULL ), mapSize( 0 )
 {
 	extension = ".dv";
 	numBlocks = 0;
@@ -378,6 +379,12 @@ int RawHandler::Write( const Frame& frame )
 
 int RawHandler::Close()
 {
+	if ( map != NULL )
+	{
+		munmap( map, mapSize );
+		map = NULL;
+		mapSize = 0;
+	}
 	if ( fd != -1 )
 	{
 		close( fd );
@@ -413,6 +420,17 @@ bool RawHandler::Open( const char *s )
 		return false;
 	numBlocks = ( ( data[ 3 ] & 0x80 ) == 0 ) ? 250 : 300;
 	filename = s;
+
+	// The frames are all the same size, so map the file and find them by their offset
+	mapSize = GetFileSize();
+	if ( mapSize > 0 && ( off_t )( size_t ) mapSize == mapSize )
+		map = ( uint8_t* ) mmap( NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0 );
+	if ( map == MAP_FAILED )
+		map = NULL;
+	if ( map != NULL )
+		madvise( map, mapSize, MADV_SEQUENTIAL );
+	else
+		mapSize = 0;
 	return true;
 
 }
@@ -424,8 +442,12 @@ int RawHandler::GetFrame( uint8_t *data, int frameNum )
 	if ( frameNum < 0 )
 		return -1;
 	off_t offset = ( ( off_t ) frameNum * ( off_t ) size );
-	fail_if( lseek( fd, offset, SEEK_SET ) == ( off_t ) - 1 );
-	if ( read( fd, data, size ) > 0 )
+	if ( map != NULL && offset + size <= mapSize )
+	{
+		memcpy( data, map + offset, size );
+		return 0;
+	}
+	if ( pread( fd, data, size, offset ) > 0 )
 		return 0;
 	else
 		return -1;
@@ -139,6 +139,8 @@ public:
 	int GetFrame( uint8_t *data, int frameNum );
 private:
 	int numBlocks;
+	uint8_t *map;
+	off_t mapSize;
 };
 
 
@@ -125,6 +125,18 @@
  **/
 
 #include "sdi_generator.h"
+#include <errno.h>
+#if defined(USE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The generated blanking of each timing reference of the HD line structure
+static struct hd_line_template {
+	const struct source_format *fmt;
+	const struct trs *xyz;
+	uint16_t *line;
+	size_t header;
+} hd_line_templates[4];
 
 /*!/brief initialization of the file handlers for the playout
  * @param *device_video: file or SDITX device or SDIVIDEOTX device
@@ -452,8 +464,10 @@ static int sdi_init(char *device_video, char *device_audio, uint8_t blanking, ml
 
 	}
 
-	// set buffer for the complete SDI frame
-	data = (uint8_t*) calloc(sdi_frame_size, sizeof(uint8_t));
+	// set a page aligned buffer for the complete SDI frame, which the driver copies fastest
+	if (posix_memalign((void**) &data, 4096, sdi_frame_size))
+		return EXIT_FAILURE;
+	memset(data, 0, sdi_frame_size);
 
 	return 1;
 }
@@ -926,6 +940,8 @@ static int sdi_playout(uint8_t *vBuffer, int16_t aBuffer[MAX_AUDIO_STREAMS][MAX_
 	while (bytes < sdi_frame_size) {
 
 		if ((written_bytes = write(fh_sdi_video, data + bytes, sdi_frame_size - bytes)) < 0) {
+			if (errno == EINTR)
+				continue;
 			fprintf(stderr, "\nunable to write SDI video.\n");
 			return -1;
 		}
@@ -1250,6 +1266,161 @@ static inline int create_SD_SDI_Line(uint16_t *buf, const struct line_info *info
  *
  * Returns a negative error code on failure and zero on success.
  **/
+/**
+ * build_HD_SDI_Template - generate a line of vertical blanking with its timing references
+ * @buf: pointer to a buffer of samples_per_line elements
+ * @info: pointer to a line information structure, the line number is not used
+ *
+ * Returns the number of elements before the active video.
+ **/
+static size_t build_HD_SDI_Template(uint16_t *buf, const struct line_info *info) {
+	uint16_t *p = buf;
+	size_t header;
+
+	// write line with TRS(EAV) ANC(audio) TRS(SAV) activeVideo(CbY1CrY2)
+	// Example SD PAL:
+	//                  *************************************************************************
+	// 625 lines:       | EAV |     ANC      | SAV |        [CbY1CrY2]                          |
+	//                  *************************************************************************
+	// 1728 SDI-words:  | 4   |     280	     | 4   |        720+360+360=1440                    |
+	//					*************************************************************************
+
+	// write line with TRS(EAV) ANC(audio) TRS(SAV) activeVideo(CbY1CrY2)
+	// Example HD 1080i:
+	//                  *************************************************************************
+	// 1125 lines:      | EAV | LN  | CRC |	ANC | SAV | [CbY1CrY2]                              |
+	//                  *************************************************************************
+	// 5280 SDI-words:  | 6   | 4   | 4   | 280	| 6   |	1920+720+720=3840                       |
+	//                  *************************************************************************
+
+	if (info->fmt == &FMT_576i50) {
+		/* EAV */
+		*p++ = 0x3ff;
+		*p++ = 0x000;
+		*p++ = 0x000;
+		*p++ = info->xyz->eav;
+	} else {
+		/* EAV */
+		*p++ = 1023;
+		*p++ = 1023;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = info->xyz->eav;
+		*p++ = info->xyz->eav;
+		/* LN, set for each line */
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		/* CRC, added by serializer */
+		*p++ = 512;
+		*p++ = 64;
+		*p++ = 512;
+		*p++ = 64;
+
+	}
+
+	/* Horizontal blanking */
+	while (p < (buf + info->fmt->samples_per_line - info->fmt->active_samples_per_line - 4)) {
+		*p++ = 512;
+		*p++ = 64;
+		*p++ = 512;
+		*p++ = 64;
+	}
+
+	if (info->fmt == &FMT_576i50) {
+		/* SAV */
+		*p++ = 0x3ff;
+		*p++ = 0x000;
+		*p++ = 0x000;
+		*p++ = info->xyz->sav;
+	} else {
+		/* SAV */
+		*p++ = 1023;
+		*p++ = 1023;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = info->xyz->sav;
+		*p++ = info->xyz->sav;
+	}
+	header = p - buf;
+
+	/* Vertical blanking */
+	while (p < (buf + info->fmt->samples_per_line)) {
+		*p++ = 512;
+		*p++ = 64;
+		*p++ = 512;
+		*p++ = 64;
+	}
+
+	return header;
+}
+
+/**
+ * get_HD_SDI_Template - get the blanking of a line, generating it on first use
+ * @info: pointer to a line information structure
+ *
+ * Returns NULL if the template could not be allocated.
+ **/
+static const struct hd_line_template *get_HD_SDI_Template(const struct line_info *info) {
+	int i;
+
+	for (i = 0; i < 4 && hd_line_templates[i].line; i++) {
+		if (hd_line_templates[i].xyz == info->xyz && hd_line_templates[i].fmt == info->fmt)
+			return &hd_line_templates[i];
+	}
+	if (i == 4) {
+		// the format changed, forget all of them
+		for (i = 0; i < 4; i++) {
+			free(hd_line_templates[i].line);
+			hd_line_templates[i].line = NULL;
+		}
+		i = 0;
+	}
+	// one more for the last group of 4 elements written past the active video
+	hd_line_templates[i].line = (uint16_t*) malloc((info->fmt->samples_per_line + 4) * sizeof(uint16_t));
+	if (!hd_line_templates[i].line)
+		return NULL;
+	hd_line_templates[i].fmt = info->fmt;
+	hd_line_templates[i].xyz = info->xyz;
+	hd_line_templates[i].header = build_HD_SDI_Template(hd_line_templates[i].line, info);
+	return &hd_line_templates[i];
+}
+
+/**
+ * convert_HD_SDI_Video - convert 8-bit YUYV to 10-bit CbY1CrY2 words
+ * @p: pointer to the output words
+ * @src: pointer to the 8-bit video of the same position
+ * @count: number of elements, a multiple of 4
+ **/
+static inline void convert_HD_SDI_Video(uint16_t *p, const uint8_t *src, size_t count) {
+	uint16_t *end = p + count;
+
+#if defined(USE_SSE2) && defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; p + 16 <= end; p += 16, src += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) src);
+		__m128i lo = _mm_slli_epi16(_mm_unpacklo_epi8(a, zero), 2);
+		__m128i hi = _mm_slli_epi16(_mm_unpackhi_epi8(a, zero), 2);
+		// swap the luma and chroma of each pair
+		lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i*) p, lo);
+		_mm_storeu_si128((__m128i*) (p + 8), hi);
+	}
+#endif
+	for (; p < end; p += 4, src += 4) {
+		p[0] = src[1] << 2; // Cb
+		p[1] = src[0] << 2; // Y1
+		p[2] = src[3] << 2; // Cr
+		p[3] = src[2] << 2; // Y2
+	}
+}
+
 static inline int create_HD_SDI_Line(uint16_t *buf, const struct line_info *info, uint16_t active_video_line, unsigned int active,
 		uint8_t *video_buffer) {
 	uint16_t *p = buf, ln;
@@ -1262,78 +1433,22 @@ static inline int create_HD_SDI_Line(uint16_t *buf, const struct line_info *info
 	int start_of_current_line = active_video_line * info->fmt->active_samples_per_line;
 
 	if (info->blanking) {
+		const struct hd_line_template *template = get_HD_SDI_Template(info);
 
-		// write line with TRS(EAV) ANC(audio) TRS(SAV) activeVideo(CbY1CrY2)
-		// Example SD PAL:
-		//                  *************************************************************************
-		// 625 lines:       | EAV |     ANC      | SAV |        [CbY1CrY2]                          |
-		//                  *************************************************************************
-		// 1728 SDI-words:  | 4   |     280	     | 4   |        720+360+360=1440                    |
-		//					*************************************************************************
-
-		// write line with TRS(EAV) ANC(audio) TRS(SAV) activeVideo(CbY1CrY2)
-		// Example HD 1080i:
-		//                  *************************************************************************
-		// 1125 lines:      | EAV | LN  | CRC |	ANC | SAV | [CbY1CrY2]                              |
-		//                  *************************************************************************
-		// 5280 SDI-words:  | 6   | 4   | 4   | 280	| 6   |	1920+720+720=3840                       |
-		//                  *************************************************************************
-
-		if (info->fmt == &FMT_576i50) {
-			/* EAV */
-			*p++ = 0x3ff;
-			*p++ = 0x000;
-			*p++ = 0x000;
-			*p++ = info->xyz->eav;
-		} else {
-			/* EAV */
-			*p++ = 1023;
-			*p++ = 1023;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = info->xyz->eav;
-			*p++ = info->xyz->eav;
+		if (!template)
+			return -1;
+
+		// copy the timing references and the blanking, only the line number changes
+		p = buf + (active == ACTIVE_VIDEO ? template->header : samples);
+		memcpy(buf, template->line, (p - buf) * sizeof(uint16_t));
+		if (info->fmt != &FMT_576i50) {
 			/* LN */
 			ln = ((info->ln & 0x07f) << 2) | (~info->ln & 0x040) << 3;
-			*p++ = ln;
-			*p++ = ln;
+			buf[8] = ln;
+			buf[9] = ln;
 			ln = ((info->ln & 0x780) >> 5) | 0x200;
-			*p++ = ln;
-			*p++ = ln;
-			/* CRC, added by serializer */
-			*p++ = 512;
-			*p++ = 64;
-			*p++ = 512;
-			*p++ = 64;
-
-		}
-
-		/* Horizontal blanking */
-		while (p < (buf + info->fmt->samples_per_line - info->fmt->active_samples_per_line - 4)) {
-			*p++ = 512;
-			*p++ = 64;
-			*p++ = 512;
-			*p++ = 64;
-		}
-
-		if (info->fmt == &FMT_576i50) {
-			/* SAV */
-			*p++ = 0x3ff;
-			*p++ = 0x000;
-			*p++ = 0x000;
-			*p++ = info->xyz->sav;
-		} else {
-			/* SAV */
-			*p++ = 1023;
-			*p++ = 1023;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = 0;
-			*p++ = info->xyz->sav;
-			*p++ = info->xyz->sav;
+			buf[10] = ln;
+			buf[11] = ln;
 		}
 	}
 
@@ -1348,41 +1463,8 @@ static inline int create_HD_SDI_Line(uint16_t *buf, const struct line_info *info
 		}
 		break;
 	case ACTIVE_VIDEO:
-
-	{
-
-		while (p < (buf + samples)) {
-
-			*p = video_buffer[start_of_current_line + (p - buf) + 1] << 2; // Cb
-			p++;
-			//check values, this needs a lot of resources
-			//			if (*(p - 1) < 0x040)
-			//				*(p - 1) = 0x040;
-			//			if (*(p - 1) > 0x3c0)
-			//				*(p - 1) = 0x3c0;
-			//
-			*p = video_buffer[start_of_current_line + (p - buf) - 1] << 2; // Y1
-			p++;
-			//			if (*(p - 1) < 0x040)
-			//				*(p - 1) = 0x040;
-			//			if (*(p - 1) > 0x3ac)
-			//				*(p - 1) = 0x3ac;
-			//
-			*p = video_buffer[start_of_current_line + (p - buf) + 1] << 2; // Cr
-			p++;
-			//			if (*(p - 1) < 0x040)
-			//				*(p - 1) = 0x040;
-			//			if (*(p - 1) > 0x3c0)
-			//				*(p - 1) = 0x3c0;
-			//
-			*p = video_buffer[start_of_current_line + (p - buf) - 1] << 2; // Y2
-			p++;
-			//			if (*(p - 1) < 0x040)
-			//				*(p - 1) = 0x040;
-			//			if (*(p - 1) > 0x3ac)
-			//				*(p - 1) = 0x3ac;
-		}
-	}
+		// Cb Y1 Cr Y2; the values are not clipped to the legal range
+		convert_HD_SDI_Video(p, video_buffer + start_of_current_line + (p - buf), (buf + samples - p + 3) / 4 * 4);
 		break;
 	}
 	return 0;
@@ -1804,6 +1886,13 @@ pack8(uint8_t *outbuf, uint16_t *inbuf, size_t count) {
 	uint16_t *inp = inbuf;
 	uint8_t *outp = outbuf;
 
+#if defined(USE_SSE2) && defined(__SSE2__)
+	for (; inp + 16 <= inbuf + count; inp += 16, outp += 16) {
+		__m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i*) inp), 2);
+		__m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i*) (inp + 8)), 2);
+		_mm_storeu_si128((__m128i*) outp, _mm_packus_epi16(a, b));
+	}
+#endif
 	while (inp < (inbuf + count)) {
 		*outp++ = *inp++ >> 2;
 	}
@@ -1823,15 +1912,16 @@ static inline uint8_t * pack10(uint8_t *outbuf, uint16_t *inbuf, size_t count) {
 	uint16_t *inp = inbuf;
 	uint8_t *outp = outbuf;
 
+	// 4 elements are 40 bits, least significant first
 	while (inp < (inbuf + count)) {
-		*outp++ = *inp & 0xff;
-		*outp = *inp++ >> 8;
-		*outp++ += (*inp << 2) & 0xfc;
-		*outp = *inp++ >> 6;
-		*outp++ += (*inp << 4) & 0xf0;
-		*outp = *inp++ >> 4;
-		*outp++ += (*inp << 6) & 0xc0;
-		*outp++ = *inp++ >> 2;
+		uint64_t v = inp[0] | (uint32_t) inp[1] << 10 | (uint32_t) inp[2] << 20 | (uint64_t) inp[3] << 30;
+		outp[0] = v;
+		outp[1] = v >> 8;
+		outp[2] = v >> 16;
+		outp[3] = v >> 24;
+		outp[4] = v >> 32;
+		inp += 4;
+		outp += 5;
 	}
 
 	return outp;
@@ -1849,14 +1939,16 @@ static inline uint8_t * pack_v210(uint8_t *outbuf, uint16_t *inbuf, size_t count
 	uint16_t *inp = inbuf;
 	uint8_t *outp = outbuf;
 
+	// 3 elements are a little endian 32-bit word
 	count = (count / 96) * 96 + ((count % 96) ? 96 : 0);
 	while (inp < (inbuf + count)) {
-		*outp++ = *inp & 0xff;
-		*outp = *inp++ >> 8;
-		*outp++ += (*inp << 2) & 0xfc;
-		*outp = *inp++ >> 6;
-		*outp++ += (*inp << 4) & 0xf0;
-		*outp++ = *inp++ >> 4;
+		uint32_t v = inp[0] | (uint32_t) inp[1] << 10 | (uint32_t) inp[2] << 20;
+		outp[0] = v;
+		outp[1] = v >> 8;
+		outp[2] = v >> 16;
+		outp[3] = v >> 24;
+		inp += 3;
+		outp += 4;
 	}
 	return outp;
 }
@@ -1866,6 +1958,10 @@ static int sdimaster_close() {
 
 	free(line_buffer);
 	free(data);
+	for (int i = 0; i < 4; i++) {
+		free(hd_line_templates[i].line);
+		hd_line_templates[i].line = NULL;
+	}
 
 	if (fh_sdi_audio)
 		close(fh_sdi_audio);
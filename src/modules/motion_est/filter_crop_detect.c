@@ -12,6 +12,7 @@
  *	-filter crop_detect frequency=25		// Detect the crop once a second
  *	-filter crop_detect frequency=0			// Never detect unless the producer changes
  *	-filter crop_detect thresh=100			// Changes the threshold (default = 25)
+ *	-filter crop_detect samples=20			// Detect the crop once from 20 frames spread across the producer
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -41,6 +42,253 @@
 
 #define ABS(a) ((a) >= 0 ? (a) : (-(a)))
 
+// The sides of the image in the order they are scanned.
+enum { SIDE_TOP, SIDE_BOTTOM, SIDE_LEFT, SIDE_RIGHT, SIDE_COUNT };
+
+struct crop_scan_desc
+{
+	uint8_t *image;
+	int width;
+	int height;
+	int thresh;
+	int sides[SIDE_COUNT];
+};
+
+/** Tell whether a row or column of luma differs enough from its own average to be picture.
+ * \param q the first luma sample
+ * \param count the number of samples
+ * \param stride the distance between samples
+ * \param scale the number of samples the threshold is scaled with
+ */
+
+static int has_content( uint8_t *q, int count, int stride, int thresh, int scale )
+{
+	int i, average_brightness = 0, deviation = 0;
+
+	for( i = 0; i < count; i++ )
+		average_brightness += q[i*stride];
+
+	average_brightness /= count;
+
+	for( i = 0; i < count; i++ )
+		deviation += abs(average_brightness - q[i*stride]);
+
+	return deviation*10 >= thresh * scale;
+}
+
+/** Find the first row or column of picture from one side of the image.
+ * The sides are independent, so they are used as slices.
+ */
+
+static int scan_side( int id, int index, int jobs, void *cookie )
+{
+	struct crop_scan_desc *desc = (struct crop_scan_desc *) cookie;
+	int width = desc->width;
+	int height = desc->height;
+	int xstride = 2;
+	int ystride = 2 * width;
+	int x, y, result = 0;
+
+	switch ( index )
+	{
+	case SIDE_TOP:
+		for( y = 0; y < height/2; y++ ) {
+			result = y;
+			if( has_content( desc->image + y*ystride, width, xstride, desc->thresh, width ) )
+				break;
+		}
+		break;
+	case SIDE_BOTTOM:
+		for( y = height - 1; y >= height/2; y-- ) {
+			result = y;
+			if( has_content( desc->image + y*ystride, width, xstride, desc->thresh, width ) )
+				break;
+		}
+		break;
+	case SIDE_LEFT:
+		for( x = 0; x < width/2; x++ ) {
+			result = x;
+			if( has_content( desc->image + x*xstride, height, ystride, desc->thresh, width ) )
+				break;
+		}
+		break;
+	case SIDE_RIGHT:
+		for( x = width - 1; x >= width/2; x-- ) {
+			result = x;
+			if( has_content( desc->image + x*xstride, height, ystride, desc->thresh, width ) )
+				break;
+		}
+		break;
+	}
+	desc->sides[index] = result;
+	return 0;
+}
+
+/** Detect the crop of a yuv422 image.
+ * The geometry of \p bounds is zero-indexed and inclusive of the end values.
+ */
+
+static void detect_crop( uint8_t *image, int width, int height, int thresh, int parallel, mlt_geometry_item bounds )
+{
+	struct crop_scan_desc desc = { image, width, height, thresh, { 0, height, 0, width } };
+	int i;
+
+	if ( parallel && mlt_slices_count_normal() > 1 )
+		mlt_slices_run_normal( SIDE_COUNT, scan_side, &desc );
+	else
+		for ( i = 0; i < SIDE_COUNT; i++ )
+			scan_side( 0, i, SIDE_COUNT, &desc );
+
+	bounds->x = desc.sides[SIDE_LEFT];
+	bounds->y = desc.sides[SIDE_TOP];
+	bounds->w = desc.sides[SIDE_RIGHT];
+	bounds->h = desc.sides[SIDE_BOTTOM];
+}
+
+/** The sampling of a producer to detect a crop that holds for all of it. */
+
+struct crop_sample_desc
+{
+	mlt_profile profile;
+	char *resource;
+	mlt_position skip;
+	mlt_position length;
+	int samples;
+	int thresh;
+	// The sides of each sample relative to its size, or negative if it could not be read
+	double *results;
+};
+
+static int sample_slice( int id, int index, int jobs, void *cookie )
+{
+	struct crop_sample_desc *desc = (struct crop_sample_desc *) cookie;
+
+	// Every job reads from its own normalized producer
+	mlt_producer producer = mlt_factory_producer( desc->profile, NULL, desc->resource );
+	int i;
+
+	for ( i = index; producer && i < desc->samples; i += jobs )
+	{
+		double *result = desc->results + i * SIDE_COUNT;
+		mlt_position span = MAX( desc->length - desc->skip, 1 );
+		mlt_frame frame = NULL;
+
+		result[0] = -1;
+		mlt_producer_seek( producer, desc->skip + span * ( 2 * i + 1 ) / ( 2 * desc->samples ) );
+		if ( mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 ) == 0 && frame )
+		{
+			mlt_image_format format = mlt_image_yuv422;
+			int width = desc->profile->width;
+			int height = desc->profile->height;
+			uint8_t *image = NULL;
+
+			if ( !mlt_frame_get_image( frame, &image, &format, &width, &height, 0 ) && image
+				&& format == mlt_image_yuv422 && width > 1 && height > 1 )
+			{
+				struct mlt_geometry_item_s bounds;
+				detect_crop( image, width, height, desc->thresh, 0, &bounds );
+				result[0] = bounds.x / width;
+				result[1] = bounds.y / height;
+				result[2] = ( bounds.w + 1 ) / width;
+				result[3] = ( bounds.h + 1 ) / height;
+			}
+			mlt_frame_close( frame );
+		}
+	}
+	mlt_producer_close( producer );
+	return 0;
+}
+
+static int compare_doubles( const void *a, const void *b )
+{
+	double d = *(const double*) a - *(const double*) b;
+	return ( d > 0 ) - ( d < 0 );
+}
+
+/** Detect the crop from frames spread across the producer of the filter.
+ * The median of each side over the samples that were read is used, so that dark
+ * scenes and titles do not move the result. It is stored in the parent producer,
+ * where it is found again by later frames or once the producer is serialized.
+ */
+
+static int sample_crop( mlt_filter filter, mlt_frame frame, int width, int height, mlt_geometry_item bounds )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+
+	// Prefer the producer the filter is attached to over the one the frame comes from
+	mlt_service service = mlt_properties_get_data( properties, "service", NULL );
+	mlt_producer producer = mlt_service_identify( service ) == producer_type ?
+		MLT_PRODUCER( service ) : mlt_frame_get_original_producer( frame );
+	if ( !producer )
+		return 1;
+	producer = mlt_producer_cut_parent( producer );
+	mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( producer );
+
+	if ( !mlt_properties_get( producer_properties, "crop_detect.w" ) )
+	{
+		struct crop_sample_desc desc;
+		const char *service = mlt_properties_get( producer_properties, "mlt_service" );
+		const char *resource = mlt_properties_get( producer_properties, "resource" );
+		desc.profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+		if ( !service || !resource || !desc.profile )
+			return 1;
+		desc.resource = malloc( strlen( service ) + strlen( resource ) + 2 );
+		sprintf( desc.resource, "%s:%s", service, resource );
+		desc.skip = mlt_properties_get_int( properties, "skip" );
+		desc.length = mlt_producer_get_length( producer );
+		desc.samples = mlt_properties_get_int( properties, "samples" );
+		desc.thresh = mlt_properties_get_int( properties, "thresh" );
+		if ( desc.skip >= desc.length )
+			desc.skip = 0;
+
+		desc.results = calloc( desc.samples * SIDE_COUNT, sizeof( double ) );
+		int jobs = MIN( mlt_slices_count_normal(), desc.samples );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, sample_slice, &desc );
+		else
+			sample_slice( 0, 0, 1, &desc );
+
+		// Gather each side of the samples that were read
+		double *sides = malloc( desc.samples * SIDE_COUNT * sizeof( double ) );
+		int count = 0, i, j;
+		for ( i = 0; i < desc.samples; i++ )
+		{
+			if ( desc.results[i * SIDE_COUNT] < 0 )
+				continue;
+			for ( j = 0; j < SIDE_COUNT; j++ )
+				sides[j * desc.samples + count] = desc.results[i * SIDE_COUNT + j];
+			count++;
+		}
+		if ( count )
+		{
+			for ( j = 0; j < SIDE_COUNT; j++ )
+				qsort( sides + j * desc.samples, count, sizeof( double ), compare_doubles );
+			int median = count / 2;
+			double x = sides[median];
+			double y = sides[desc.samples + median];
+			double right = sides[2 * desc.samples + median];
+			double bottom = sides[3 * desc.samples + median];
+			mlt_properties_set_double( producer_properties, "crop_detect.x", x );
+			mlt_properties_set_double( producer_properties, "crop_detect.y", y );
+			mlt_properties_set_double( producer_properties, "crop_detect.w", MAX( right - x, 0 ) );
+			mlt_properties_set_double( producer_properties, "crop_detect.h", MAX( bottom - y, 0 ) );
+		}
+		mlt_log_verbose( MLT_FILTER_SERVICE( filter ), "sampled %d of %d frames of %s\n", count, desc.samples, resource );
+		free( sides );
+		free( desc.results );
+		free( desc.resource );
+		if ( !count )
+			return 1;
+	}
+
+	// The result is relative to the size of the image
+	bounds->x = floor( mlt_properties_get_double( producer_properties, "crop_detect.x" ) * width + 0.5 );
+	bounds->y = floor( mlt_properties_get_double( producer_properties, "crop_detect.y" ) * height + 0.5 );
+	bounds->w = floor( mlt_properties_get_double( producer_properties, "crop_detect.w" ) * width + 0.5 );
+	bounds->h = floor( mlt_properties_get_double( producer_properties, "crop_detect.h" ) * height + 0.5 );
+	return 0;
+}
+
 // Image stack(able) method
 static int filter_get_image( mlt_frame this, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
@@ -50,6 +298,7 @@ static int filter_get_image( mlt_frame this, uint8_t **image, mlt_image_format *
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 
 	// Get the new image
+	*format = mlt_image_yuv422;
 	int error = mlt_frame_get_image( this, image, format, width, height, 1 );
 
 	if( error != 0 ) {
@@ -63,6 +312,9 @@ static int filter_get_image( mlt_frame this, uint8_t **image, mlt_image_format *
 	// Producers may start with blank footage, by default we will skip, oh, 5 frames unless overridden
 	int skip = mlt_properties_get_int( properties, "skip");
 
+	// Detect the crop once from frames spread across the producer instead of during playback
+	int samples = mlt_properties_get_int( properties, "samples" );
+
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
 	// The result
@@ -76,12 +328,20 @@ static int filter_get_image( mlt_frame this, uint8_t **image, mlt_image_format *
 		mlt_properties_set_data( properties, "bounds", bounds, sizeof( struct mlt_geometry_item_s ), free, NULL );
 	}
 
+	if( samples > 0 && sample_crop( filter, this, *width, *height, bounds ) == 0 )
+	{
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES(this), "bounds", bounds, sizeof( struct mlt_geometry_item_s ), NULL, NULL );
+		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+		return 0;
+	}
+
 	// For periodic detection (with offset of 'skip')
 	if( frequency == 0 || (int)(mlt_filter_get_position(filter, this)+skip) % frequency  != 0)
 	{
 		// Inject in stream 
 		mlt_properties_set_data( MLT_FRAME_PROPERTIES(this), "bounds", bounds, sizeof( struct mlt_geometry_item_s ), NULL, NULL );
 
+		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 		return 0;
 	}
 	
@@ -89,84 +349,7 @@ static int filter_get_image( mlt_frame this, uint8_t **image, mlt_image_format *
 	// There is no way to detect a crop for sure, so make up an arbitrary one
 	int thresh = mlt_properties_get_int( properties, "thresh" );
 
-	*format = mlt_image_yuv422;
-	int xstride = 2;
-	int ystride = 2 * *width;
-
-	int x, y, average_brightness, deviation; // Scratch variables
-	uint8_t *q;
-
-	// Top crop
-	for( y = 0; y < *height/2; y++ ) {
-		bounds->y = y;
-		average_brightness = 0;
-		deviation = 0;
-		q = *image + y*ystride;
-		for( x = 0; x < *width; x++ )
-			average_brightness += q[x*xstride];
-
-		average_brightness /= *width;
-
-		for( x = 0; x < *width; x++ )
-			deviation += abs(average_brightness - q[x*xstride]);
-
-		if( deviation*10 >= thresh * *width )
-			break;
-	}
-
-	// Bottom crop
-	for( y = *height - 1; y >= *height/2; y-- ) {
-		bounds->h = y;
-		average_brightness = 0;
-		deviation = 0;
-		q = *image + y*ystride;
-		for( x = 0; x < *width; x++ )
-			average_brightness += q[x*xstride];
-
-		average_brightness /= *width;
-
-		for( x = 0; x < *width; x++ )
-			deviation += abs(average_brightness - q[x*xstride]);
-
-		if( deviation*10 >= thresh * *width)
-			break;
-	}
-
-	// Left crop	
-	for( x = 0; x < *width/2; x++ ) {
-		bounds->x = x;
-		average_brightness = 0;
-		deviation = 0;
-		q = *image + x*xstride;
-		for( y = 0; y < *height; y++ )
-			average_brightness += q[y*ystride];
-
-		average_brightness /= *height;
-
-		for( y = 0; y < *height; y++ )
-			deviation += abs(average_brightness - q[y*ystride]);
-
-		if( deviation*10 >= thresh * *width )
-			break;
-	}
-
-	// Right crop
-	for( x = *width - 1; x >= *width/2; x-- ) {
-		bounds->w = x;
-		average_brightness = 0;
-		deviation = 0;
-		q = *image + x*xstride;
-		for( y = 0; y < *height; y++ )
-			average_brightness += q[y*ystride];
-
-		average_brightness /= *height;
-
-		for( y = 0; y < *height; y++ )
-			deviation += abs(average_brightness - q[y*ystride]);
-
-		if( deviation*10 >= thresh * *width )
-			break;
-	}
+	detect_crop( *image, *width, *height, thresh, 1, bounds );
 
 	/* Debug: Draw arrows to show crop */
 	if( mlt_properties_get_int( properties, "debug") == 1 )
@@ -33,7 +33,9 @@
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <sched.h>
 
+#include "sad_simd.h"
 #ifdef USE_SSE
 #include "sad_sse.h"
 #endif
@@ -107,6 +109,7 @@ struct motion_est_context_s
 	/* run-time configurable comparison functions */
 	int (*compare_reference)(uint8_t *, uint8_t *, int, int, int, int);
 	int (*compare_optimized)(uint8_t *, uint8_t *, int, int, int, int);
+	int compare_any_size;			// true if compare_optimized also takes clipped blocks
 
 };
 
@@ -207,7 +210,7 @@ inline static int block_compare( uint8_t *block1,
 	// Some gotchas
 	if( penalty == 0 )			// Clipped out of existence: Return worst score
 		return MAX_MSAD;
-	else if( penalty != 1<<SHIFT )		// Nonstandard macroblock dimensions: Disable SIMD optimizizations.
+	else if( penalty != 1<<SHIFT && !c->compare_any_size )	// Nonstandard macroblock dimensions: Disable SIMD optimizizations.
 		cmp = c->compare_reference;
 
 	// Calculate the memory locations of the macroblocks
@@ -491,134 +494,196 @@ static inline int median_predictor(int a, int b, int c) {
 }
 
 
-/** /brief Motion search
-*
-* For each macroblock in the current frame, estimate the block from the last frame that
-* matches best.
+/** /brief Motion search of one macroblock
 *
 * Vocab: Colocated - the pixel in the previous frame at the current position
 *
 * Based on enhanced predictive zonal search. [Tourapis 2002]
 */
-static void motion_search( uint8_t *from,			//<! Image data.
-		   	   uint8_t *to,				//<! Image data. Rigid grid.
-			   struct motion_est_context_s *c)	//<! The context
+static void motion_search_block( uint8_t *from,		//<! Image data.
+				 uint8_t *to,		//<! Image data. Rigid grid.
+				 const int i,		//<! Column of the macroblock
+				 const int j,		//<! Row of the macroblock
+				 struct motion_est_context_s *c)	//<! The context
 {
-
-#ifdef COUNT_COMPARES
-	compares = 0;
-#endif
-
 	motion_vector candidates[10];
 	motion_vector *here;		// This one gets used a lot (about 30 times per macroblock)
 	int n = 0;
 
-	int i, j, count=0;
+	here = CURRENT(i,j);
+	here->valid = 1;
+	here->color = 100;
+	here->msad = MAX_MSAD;
 
-	// For every macroblock, perform motion vector estimation
-	for( i = c->left_mb; i <= c->right_mb; i++ ){
-	 for( j = c->top_mb; j <= c->bottom_mb; j++ ){
+	/* Stack the predictors [i.e. checked in reverse order] */
 
-		here = CURRENT(i,j);
-		here->valid = 1;
-		here->color = 100;
-		here->msad = MAX_MSAD;
-		count++;
-		n = 0;
+	/* Adjacent to collocated */
+	if( c->former_vectors_valid )
+	{
+		// Top of colocated
+		if( j > c->prev_top_mb ){// && COL_TOP->valid ){
+			candidates[n  ].dx = FORMER(i,j-1)->dx;
+			candidates[n++].dy = FORMER(i,j-1)->dy;
+		}
 
+		// Left of colocated
+		if( i > c->prev_left_mb ){// && COL_LEFT->valid ){
+			candidates[n  ].dx = FORMER(i-1,j)->dx;
+			candidates[n++].dy = FORMER(i-1,j)->dy;
+		}
 
-		/* Stack the predictors [i.e. checked in reverse order] */
+		// Right of colocated
+		if( i < c->prev_right_mb ){// && COL_RIGHT->valid ){
+			candidates[n  ].dx = FORMER(i+1,j)->dx;
+			candidates[n++].dy = FORMER(i+1,j)->dy;
+		}
 
-		/* Adjacent to collocated */
-		if( c->former_vectors_valid )
-		{
-			// Top of colocated
-			if( j > c->prev_top_mb ){// && COL_TOP->valid ){
-				candidates[n  ].dx = FORMER(i,j-1)->dx;
-				candidates[n++].dy = FORMER(i,j-1)->dy;
-			}
+		// Bottom of colocated
+		if( j < c->prev_bottom_mb ){// && COL_BOTTOM->valid ){
+			candidates[n  ].dx = FORMER(i,j+1)->dx;
+			candidates[n++].dy = FORMER(i,j+1)->dy;
+		}
 
-			// Left of colocated
-			if( i > c->prev_left_mb ){// && COL_LEFT->valid ){
-				candidates[n  ].dx = FORMER(i-1,j)->dx;
-				candidates[n++].dy = FORMER(i-1,j)->dy;
-			}
+		// And finally, colocated
+		candidates[n  ].dx = FORMER(i,j)->dx;
+		candidates[n++].dy = FORMER(i,j)->dy;
+	}
 
-			// Right of colocated
-			if( i < c->prev_right_mb ){// && COL_RIGHT->valid ){
-				candidates[n  ].dx = FORMER(i+1,j)->dx;
-				candidates[n++].dy = FORMER(i+1,j)->dy;
-			}
+	// For macroblocks not in the top row
+	if ( j > c->top_mb) {
 
-			// Bottom of colocated
-			if( j < c->prev_bottom_mb ){// && COL_BOTTOM->valid ){
-				candidates[n  ].dx = FORMER(i,j+1)->dx;
-				candidates[n++].dy = FORMER(i,j+1)->dy;
-			}
+		// Top if ( TOP->valid ) {
+			candidates[n  ].dx = CURRENT(i,j-1)->dx;
+			candidates[n++].dy = CURRENT(i,j-1)->dy;
+		//}
 
-			// And finally, colocated
-			candidates[n  ].dx = FORMER(i,j)->dx;
-			candidates[n++].dy = FORMER(i,j)->dy;
+		// Top-Right, macroblocks not in the right row
+		if ( i < c->right_mb ){// && TOP_RIGHT->valid ) {
+			candidates[n  ].dx = CURRENT(i+1,j-1)->dx;
+			candidates[n++].dy = CURRENT(i+1,j-1)->dy;
 		}
+	}
 
-		// For macroblocks not in the top row
-		if ( j > c->top_mb) {
+	// Left, Macroblocks not in the left column
+	if ( i > c->left_mb ){// && LEFT->valid ) {
+		candidates[n  ].dx = CURRENT(i-1,j)->dx;
+		candidates[n++].dy = CURRENT(i-1,j)->dy;
+	}
 
-			// Top if ( TOP->valid ) {
-				candidates[n  ].dx = CURRENT(i,j-1)->dx;
-				candidates[n++].dy = CURRENT(i,j-1)->dy;
-			//}
+	/* Median predictor vector (median of left, top, and top right adjacent vectors) */
+	if ( i > c->left_mb && j > c->top_mb && i < c->right_mb
+		 )//&& LEFT->valid && TOP->valid && TOP_RIGHT->valid )
+	{
+		candidates[n  ].dx = median_predictor( CURRENT(i-1,j)->dx, CURRENT(i,j-1)->dx, CURRENT(i+1,j-1)->dx);
+		candidates[n++].dy = median_predictor( CURRENT(i-1,j)->dy, CURRENT(i,j-1)->dy, CURRENT(i+1,j-1)->dy);
+	}
 
-			// Top-Right, macroblocks not in the right row
-			if ( i < c->right_mb ){// && TOP_RIGHT->valid ) {
-				candidates[n  ].dx = CURRENT(i+1,j-1)->dx;
-				candidates[n++].dy = CURRENT(i+1,j-1)->dy;
-			}
-		}
+	// Zero vector
+	candidates[n  ].dx = 0;
+	candidates[n++].dy = 0;
 
-		// Left, Macroblocks not in the left column
-		if ( i > c->left_mb ){// && LEFT->valid ) {
-			candidates[n  ].dx = CURRENT(i-1,j)->dx;
-			candidates[n++].dy = CURRENT(i-1,j)->dy;
-		}
+	int x = i * c->mb_w;
+	int y = j * c->mb_h;
+	check_candidates ( to, from, x, y, candidates, n, 0, here, c );
 
-		/* Median predictor vector (median of left, top, and top right adjacent vectors) */
-		if ( i > c->left_mb && j > c->top_mb && i < c->right_mb
-			 )//&& LEFT->valid && TOP->valid && TOP_RIGHT->valid )
-		{
-			candidates[n  ].dx = median_predictor( CURRENT(i-1,j)->dx, CURRENT(i,j-1)->dx, CURRENT(i+1,j-1)->dx);
-			candidates[n++].dy = median_predictor( CURRENT(i-1,j)->dy, CURRENT(i,j-1)->dy, CURRENT(i+1,j-1)->dy);
-		}
 
-		// Zero vector
-		candidates[n  ].dx = 0;
-		candidates[n++].dy = 0;
+#ifndef FULLSEARCH
+	diamond_search( to, from, x, y, here, c);
+#else
+	full_search( to, from, x, y, here, c);
+#endif
 
-		int x = i * c->mb_w;
-		int y = j * c->mb_h;
-		check_candidates ( to, from, x, y, candidates, n, 0, here, c );
+	assert( x + c->mb_w + here->dx > 0 );	// All macroblocks must have area > 0
+	assert( y + c->mb_h + here->dy > 0 );
+	assert( x + here->dx < c->width );
+	assert( y + here->dy < c->height );
+}
 
+struct motion_search_slices_s
+{
+	uint8_t *from, *to;
+	struct motion_est_context_s *c;
+	int next_row;				// the next macroblock row to claim
+	int *done;				// the number of macroblocks finished in each row
+};
 
-#ifndef FULLSEARCH
-		diamond_search( to, from, x, y, here, c);
-#else
-		full_search( to, from, x, y, here, c);
+/** /brief Motion search of the rows claimed by one slice
+*
+* The rows are claimed in order and searched in wavefront order: a macroblock
+* waits for the top and top right macroblocks used by its predictors. Since a
+* row is only waited on once it was claimed, a slice never waits on a job
+* that has not started.
+*/
+static int motion_search_slice( int id, int index, int jobs, void *cookie )
+{
+	struct motion_search_slices_s *s = cookie;
+	struct motion_est_context_s *c = s->c;
+	int columns = c->right_mb - c->left_mb + 1;
+	int i, j;
+
+	while( ( j = __atomic_fetch_add( &s->next_row, 1, __ATOMIC_SEQ_CST ) ) <= c->bottom_mb )
+	{
+		int *above = j > c->top_mb ? &s->done[ j - c->top_mb - 1 ] : NULL;
+		int *done = &s->done[ j - c->top_mb ];
+
+		for( i = c->left_mb; i <= c->right_mb; i++ ){
+			int needed = MIN( i - c->left_mb + 2, columns );
+			while( above && __atomic_load_n( above, __ATOMIC_ACQUIRE ) < needed )
+				sched_yield();
+			motion_search_block( s->from, s->to, i, j, c );
+			__atomic_store_n( done, i - c->left_mb + 1, __ATOMIC_RELEASE );
+		}
+	}
+
+#ifdef USE_SSE
+	asm volatile ( "emms" );
+#endif
+	return 0;
+}
+
+/** /brief Motion search
+*
+* For each macroblock in the current frame, estimate the block from the last frame that
+* matches best. The rows are searched top to bottom so that the top right predictor is
+* known, in parallel when there are enough rows.
+*/
+static void motion_search( uint8_t *from,			//<! Image data.
+		   	   uint8_t *to,				//<! Image data. Rigid grid.
+			   struct motion_est_context_s *c)	//<! The context
+{
+
+#ifdef COUNT_COMPARES
+	compares = 0;
 #endif
 
-		assert( x + c->mb_w + here->dx > 0 );	// All macroblocks must have area > 0
-		assert( y + c->mb_h + here->dy > 0 );
-		assert( x + here->dx < c->width );
-		assert( y + here->dy < c->height );
+	int rows = c->bottom_mb - c->top_mb + 1;
+	int columns = c->right_mb - c->left_mb + 1;
+	int jobs = MIN( mlt_slices_count_normal(), rows / 2 );
+	int i, j;
 
-	 } /* End column loop */
-	} /* End row loop */
+	if( rows <= 0 || columns <= 0 )
+		return;
+
+	if( jobs > 1 ) {
+		struct motion_search_slices_s s = { from, to, c, c->top_mb, calloc( rows, sizeof(int) ) };
+		if( s.done ) {
+			mlt_slices_run_normal( jobs, motion_search_slice, &s );
+			free( s.done );
+			return;
+		}
+	}
+
+	// For every macroblock, perform motion vector estimation
+	for( j = c->top_mb; j <= c->bottom_mb; j++ )
+	 for( i = c->left_mb; i <= c->right_mb; i++ )
+		motion_search_block( from, to, i, j, c );
 
 #ifdef USE_SSE
 	asm volatile ( "emms" );
 #endif
 
 #ifdef COUNT_COMPARES
-	fprintf(stderr, "%d comparisons per block were made", compares/count);
+	fprintf(stderr, "%d comparisons per block were made", compares/(rows*columns));
 #endif
 	return;
 }
@@ -656,6 +721,14 @@ void collect_post_statistics( struct motion_est_context_s *c ) {
 
 static void init_optimizations( struct motion_est_context_s *c )
 {
+	// Prefer the kernels that take any block size
+	sad_function simd = c->xstride == 2 ? sad_simd_detect() : NULL;
+	c->compare_any_size = simd != NULL;
+	if( simd ) {
+		c->compare_optimized = simd;
+		return;
+	}
+
 	switch(c->mb_w){
 #ifdef USE_SSE
 		case 4:  if(c->mb_h == 4)	c->compare_optimized = sad_sse_422_luma_4x4;
@@ -848,8 +921,6 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		if( mlt_properties_get( properties, "toggle_when_paused" ) != NULL )
 			c->toggle_when_paused = mlt_properties_get_int( properties, "toggle_when_paused" );
 
-		init_optimizations( c );
-
 		// Calculate the dimensions in macroblock units
 		c->mv_buffer_width = (*width / c->mb_w);
 		c->mv_buffer_height = (*height / c->mb_h);
@@ -873,6 +944,8 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		c->xstride = 2;
 		c->ystride = c->xstride * *width;
 
+		init_optimizations( c );
+
 		// Allocate a cache for the previous frame's image
 		c->former_image = mlt_pool_alloc( *width * *height * 2 );
 		c->cache_image = mlt_pool_alloc( *width * *height * 2 );
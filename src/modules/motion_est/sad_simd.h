@@ -0,0 +1,138 @@
+/*
+ * Sum of Absolute Differences of the luma of packed YUV 4:2:2 blocks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* These kernels take blocks of any size with an xstride of 2 and give the same
+ * result as sad_reference(). The chroma bytes are masked out of both blocks so
+ * that psadbw only sums the luma differences.
+ */
+
+typedef int (*sad_function)( uint8_t *, uint8_t *, int, int, int, int );
+
+static inline int sad_422_luma_tail( uint8_t *block1, uint8_t *block2, int i, int w )
+{
+	int score = 0;
+	for ( ; i < w; i++ )
+		score += abs( block1[i * 2] - block2[i * 2] );
+	return score;
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define SAD_SSE2 __attribute__((target("sse2")))
+#define SAD_AVX2 __attribute__((target("avx2")))
+
+static SAD_SSE2 int sad_sse2_422_luma( uint8_t *block1, uint8_t *block2, const int xstride, const int ystride, const int w, const int h )
+{
+	const __m128i mask = _mm_set1_epi16( 0x00ff );
+	__m128i sum = _mm_setzero_si128();
+	int i, j, score = 0;
+
+	for ( j = 0; j < h; j++, block1 += ystride, block2 += ystride )
+	{
+		for ( i = 0; i + 8 <= w; i += 8 )
+		{
+			__m128i a = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( block1 + i * 2 ) ), mask );
+			__m128i b = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( block2 + i * 2 ) ), mask );
+			sum = _mm_add_epi64( sum, _mm_sad_epu8( a, b ) );
+		}
+		score += sad_422_luma_tail( block1, block2, i, w );
+	}
+	sum = _mm_add_epi64( sum, _mm_srli_si128( sum, 8 ) );
+	return score + _mm_cvtsi128_si32( sum );
+}
+
+static SAD_AVX2 int sad_avx2_422_luma( uint8_t *block1, uint8_t *block2, const int xstride, const int ystride, const int w, const int h )
+{
+	const __m256i mask = _mm256_set1_epi16( 0x00ff );
+	__m256i sum = _mm256_setzero_si256();
+	__m128i sum128 = _mm_setzero_si128();
+	int i, j, score = 0;
+
+	for ( j = 0; j < h; j++, block1 += ystride, block2 += ystride )
+	{
+		for ( i = 0; i + 16 <= w; i += 16 )
+		{
+			__m256i a = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) ( block1 + i * 2 ) ), mask );
+			__m256i b = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) ( block2 + i * 2 ) ), mask );
+			sum = _mm256_add_epi64( sum, _mm256_sad_epu8( a, b ) );
+		}
+		if ( i + 8 <= w )
+		{
+			__m128i a = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( block1 + i * 2 ) ), _mm256_castsi256_si128( mask ) );
+			__m128i b = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( block2 + i * 2 ) ), _mm256_castsi256_si128( mask ) );
+			sum128 = _mm_add_epi64( sum128, _mm_sad_epu8( a, b ) );
+			i += 8;
+		}
+		score += sad_422_luma_tail( block1, block2, i, w );
+	}
+	sum128 = _mm_add_epi64( sum128, _mm_add_epi64( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) ) );
+	sum128 = _mm_add_epi64( sum128, _mm_srli_si128( sum128, 8 ) );
+	return score + _mm_cvtsi128_si32( sum128 );
+}
+
+static sad_function sad_simd_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return sad_avx2_422_luma;
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return sad_sse2_422_luma;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static int sad_neon_422_luma( uint8_t *block1, uint8_t *block2, const int xstride, const int ystride, const int w, const int h )
+{
+	uint32x4_t sum = vdupq_n_u32( 0 );
+	int i, j, score = 0;
+
+	for ( j = 0; j < h; j++, block1 += ystride, block2 += ystride )
+	{
+		for ( i = 0; i + 16 <= w; i += 16 )
+		{
+			// The first of the deinterleaved vectors holds the luma
+			uint8x16x2_t a = vld2q_u8( block1 + i * 2 );
+			uint8x16x2_t b = vld2q_u8( block2 + i * 2 );
+			sum = vpadalq_u16( sum, vpaddlq_u8( vabdq_u8( a.val[0], b.val[0] ) ) );
+		}
+		score += sad_422_luma_tail( block1, block2, i, w );
+	}
+	return score + vaddvq_u32( sum );
+}
+
+static sad_function sad_simd_detect( void )
+{
+	return sad_neon_422_luma;
+}
+
+#else
+
+static sad_function sad_simd_detect( void )
+{
+	return NULL;
+}
+
+#endif
@@ -35,6 +35,9 @@
 
 #include "Processing.NDI.Lib.h"
 
+// The SDK holds an asynchronously sent frame until the next one is sent.
+#define NDI_VIDEO_BUFFERS (2)
+
 typedef struct
 {
 	struct mlt_consumer_s parent;
@@ -49,6 +52,9 @@ static void* consumer_ndi_feeder( void* p )
 {
 	int i;
 	mlt_frame last = NULL;
+	mlt_frame held = NULL;
+	uint8_t* buffers[NDI_VIDEO_BUFFERS] = { NULL };
+	int buffers_size = 0, buffer_index = 0;
 	mlt_consumer consumer = p;
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
 	consumer_ndi_t* self = ( consumer_ndi_t* )consumer->child;
@@ -114,6 +120,31 @@ static void* consumer_ndi_feeder( void* p )
 				int64_t timecode;
 				int stride = width * ( m_isKeyer? 4 : 2 );
 				int progressive = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "progressive" );
+				int test_image = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frm ), "test_image" );
+
+				// RGBA passes without a copy; the rest goes to a buffer the SDK is not reading.
+				if ( m_isKeyer && !test_image )
+				{
+					buffer = image;
+				}
+				else
+				{
+					if ( buffers_size < height * stride )
+					{
+						// Make the SDK release the buffers before replacing them.
+						NDIlib_send_send_video_async(ndi_send, NULL);
+						for ( i = 0; i < NDI_VIDEO_BUFFERS; i++ )
+						{
+							free( buffers[i] );
+							buffers[i] = NULL;
+						}
+						buffers_size = 0;
+					}
+					if ( !buffers[buffer_index] && ( buffers[buffer_index] = malloc( height * stride ) ) )
+						buffers_size = height * stride;
+					buffer = buffers[buffer_index];
+					buffer_index = ( buffer_index + 1 ) % NDI_VIDEO_BUFFERS;
+				}
 
 				timecode = 10000000LL * (uint64_t)self->count * (uint64_t)profile->frame_rate_den;
 				timecode = timecode / (uint64_t)profile->frame_rate_num;
@@ -125,7 +156,7 @@ static void* consumer_ndi_feeder( void* p )
 
 					// Use YCbCr video
 					m_isKeyer
-						? NDIlib_FourCC_type_BGRA
+						? NDIlib_FourCC_type_RGBA
 						: NDIlib_FourCC_type_UYVY,
 
 					// The frame-eate
@@ -143,7 +174,7 @@ static void* consumer_ndi_feeder( void* p )
 					timecode,
 
 					// The video memory used for this frame
-					buffer = (uint8_t*)malloc( height * stride ),
+					buffer,
 
 					// The line to line stride of this image
 					stride
@@ -163,25 +194,7 @@ static void* consumer_ndi_feeder( void* p )
 						mlt_slices_run_fifo( 0, swab_sliced, arg);
 					}
 				}
-				else if ( !mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "test_image" ) )
-				{
-					// Normal keyer output
-					int y = height + 1;
-					uint32_t* s = (uint32_t*) image;
-					uint32_t* d = (uint32_t*) buffer;
-
-					// Need to relocate alpha channel RGBA => ARGB
-					while ( --y )
-					{
-						int x = width + 1;
-						while ( --x )
-						{
-							*d++ = ( *s << 8 ) | ( *s >> 24 );
-							s++;
-						}
-					}
-				}
-				else
+				else if ( test_image )
 				{
 					// Keying blank frames - nullify alpha
 					memset( buffer, 0, stride * height );
@@ -220,11 +233,18 @@ static void* consumer_ndi_feeder( void* p )
 					NDIlib_util_send_send_audio_interleaved_16s(ndi_send, &audio_data);
 				}
 
-				// We now submit the frame.
-				NDIlib_send_send_video(ndi_send, &ndi_video_frame);
+				// We now submit the frame, which releases the previous one.
+				NDIlib_send_send_video_async(ndi_send, &ndi_video_frame);
 
-				// free buf
-				free( ndi_video_frame.p_data );
+				// Keep the image of a frame sent without a copy until the SDK releases it.
+				if ( held )
+					mlt_frame_close( held );
+				held = NULL;
+				if ( buffer == image )
+				{
+					held = frm;
+					mlt_properties_inc_ref( MLT_FRAME_PROPERTIES( held ) );
+				}
 
 				self->count++;
 			}
@@ -241,8 +261,15 @@ static void* consumer_ndi_feeder( void* p )
 		mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
 	}
 
+	// Wait for the SDK to release the last frame.
+	NDIlib_send_send_video_async(ndi_send, NULL);
 	NDIlib_send_destroy( ndi_send );
 
+	if ( held )
+		mlt_frame_close( held );
+	for ( i = 0; i < NDI_VIDEO_BUFFERS; i++ )
+		free( buffers[i] );
+
 	mlt_log_debug( MLT_CONSUMER_SERVICE(consumer), "%s: exiting\n", __FUNCTION__ );
 
 	if ( last )
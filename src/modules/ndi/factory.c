@@ -31,6 +31,9 @@
 #include <sys/time.h>
 #include <limits.h>
 #include <pthread.h>
+#if defined(USE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "factory.h"
 
@@ -38,46 +41,48 @@
 
 void swab2( const void *from, void *to, int n )
 {
-#if defined(USE_SSE)
-#define SWAB_STEP 16
-	__asm__ volatile
-	(
-		"loop_start:                            \n\t"
-
-		/* load */
-		"movdqa         0(%[from]), %%xmm0      \n\t"
-		"add            $0x10, %[from]          \n\t"
-
-		/* duplicate to temp registers */
-		"movdqa         %%xmm0, %%xmm1          \n\t"
-
-		/* shift right temp register */
-		"psrlw          $8, %%xmm1              \n\t"
-
-		/* shift left main register */
-		"psllw          $8, %%xmm0              \n\t"
-
-		/* compose them back */
-		"por           %%xmm0, %%xmm1           \n\t"
-
-		/* save */
-		"movdqa         %%xmm1, 0(%[to])        \n\t"
-		"add            $0x10, %[to]            \n\t"
-
-		"dec            %[cnt]                  \n\t"
-		"jnz            loop_start              \n\t"
-
-		:
-		: [from]"r"(from), [to]"r"(to), [cnt]"r"(n / SWAB_STEP)
-		//: "xmm0", "xmm1"
-	);
+#if defined(USE_SSE2) && defined(__SSE2__)
+	const __m128i *s = (const __m128i*) from;
+	__m128i *d = (__m128i*) to;
+	for ( ; n >= 32; n -= 32, s += 2, d += 2 )
+	{
+		__m128i a = _mm_loadu_si128( s );
+		__m128i b = _mm_loadu_si128( s + 1 );
+		a = _mm_or_si128( _mm_slli_epi16( a, 8 ), _mm_srli_epi16( a, 8 ) );
+		b = _mm_or_si128( _mm_slli_epi16( b, 8 ), _mm_srli_epi16( b, 8 ) );
+		_mm_storeu_si128( d, a );
+		_mm_storeu_si128( d + 1, b );
+	}
+	from = s;
+	to = d;
+#endif
+	swab( (const char*) from, (char*) to, n );
+}
 
-	from = (unsigned char*) from + n - (n % SWAB_STEP);
-	to = (unsigned char*) to + n - (n % SWAB_STEP);
-	n = (n % SWAB_STEP);
+void bgra_to_rgba( const void *from, void *to, int n )
+{
+	const uint8_t *s = (const uint8_t*) from;
+	uint8_t *d = (uint8_t*) to;
+#if defined(USE_SSE2) && defined(__SSE2__)
+	const __m128i ga = _mm_set1_epi32( 0xff00ff00 );
+	const __m128i rb = _mm_set1_epi32( 0x00ff00ff );
+	for ( ; n >= 4; n -= 4, s += 16, d += 16 )
+	{
+		__m128i a = _mm_loadu_si128( (const __m128i*) s );
+		__m128i b = _mm_and_si128( a, rb );
+		b = _mm_or_si128( _mm_slli_epi32( b, 16 ), _mm_srli_epi32( b, 16 ) );
+		_mm_storeu_si128( (__m128i*) d, _mm_or_si128( _mm_and_si128( a, ga ), b ) );
+	}
 #endif
-	swab((char*) from, (char*) to, n);
-};
+	for ( ; n > 0; n--, s += 4, d += 4 )
+	{
+		uint8_t b = s[0];
+		d[0] = s[2];
+		d[1] = s[1];
+		d[2] = b;
+		d[3] = s[3];
+	}
+}
 
 #define SWAB_SLICED_ALIGN_POW 5
 int swab_sliced( int id, int idx, int jobs, void* cookie )
@@ -32,4 +32,6 @@ int swab_sliced( int id, int idx, int jobs, void* cookie );
 
 void swab2( const void *from, void *to, int n );
 
+void bgra_to_rgba( const void *from, void *to, int n );
+
 #endif /* FACTORY_H */
@@ -51,8 +51,26 @@ typedef struct
 	pthread_cond_t cond;
 	NDIlib_recv_instance_t recv;
 	int v_queue_limit, a_queue_limit, v_prefill;
+	int64_t v_timecode;
+	int v_dropped;
 } producer_ndi_t;
 
+// A received video frame that knows its receiver, so that it can be attached
+// to an mlt frame and returned to the NDI library when that is closed
+typedef struct
+{
+	NDIlib_video_frame_t video;
+	NDIlib_recv_instance_t recv;
+} producer_ndi_video_t;
+
+static void producer_ndi_video_close( void* p )
+{
+	producer_ndi_video_t* video = p;
+
+	NDIlib_recv_free_video( video->recv, &video->video );
+	mlt_pool_release( video );
+}
+
 static void* producer_ndi_feeder( void* p )
 {
 	mlt_producer producer = p;
@@ -143,7 +161,10 @@ static void* producer_ndi_feeder( void* p )
 		NDIlib_audio_frame_interleaved_16s_t *audio_packet, *audio_packet_prev;
 
 		if ( !video )
-			video = mlt_pool_alloc( sizeof( NDIlib_video_frame_t ) );
+		{
+			video = mlt_pool_alloc( sizeof( producer_ndi_video_t ) );
+			( (producer_ndi_video_t*) video )->recv = self->recv;
+		}
 
 		t = NDIlib_recv_capture(self->recv, video, &audio, &meta, 10 );
 
@@ -283,16 +304,19 @@ static int get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *forma
 		uint8_t *dst = NULL;
 		size_t size;
 		int j, dst_stride = 0, stride;
+		int uyvy = NDIlib_FourCC_type_UYVY == video->FourCC || NDIlib_FourCC_type_UYVA == video->FourCC;
+		int rgba = NDIlib_FourCC_type_RGBA == video->FourCC || NDIlib_FourCC_type_RGBX == video->FourCC;
+		int bgra = NDIlib_FourCC_type_BGRA == video->FourCC || NDIlib_FourCC_type_BGRX == video->FourCC;
 
 		*width = video->xres;
 		*height = video->yres;
 
-		if ( NDIlib_FourCC_type_UYVY == video->FourCC  || NDIlib_FourCC_type_UYVA == video->FourCC )
+		if ( uyvy )
 		{
 			dst_stride = 2 * video->xres;
 			*format = mlt_image_yuv422;
 		}
-		else if ( NDIlib_FourCC_type_RGBA == video->FourCC || NDIlib_FourCC_type_RGBX == video->FourCC )
+		else if ( rgba || bgra )
 		{
 			dst_stride = 4 * video->xres;
 			*format = mlt_image_rgb24a;
@@ -301,21 +325,31 @@ static int get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *forma
 			*format = mlt_image_none;
 
 		size = mlt_image_format_size( *format, *width, *height, NULL );
-
-		dst = mlt_pool_alloc( size );
-
 		stride = ( dst_stride > video->line_stride_in_bytes ) ? video->line_stride_in_bytes : dst_stride;
 		mlt_log_debug( NULL, "%s: stride=%d\n", __FUNCTION__, stride );
 
-		if ( NDIlib_FourCC_type_UYVY == video->FourCC  || NDIlib_FourCC_type_UYVA == video->FourCC )
-			for( j = 0; j < video->yres; j++)
-				swab2( video->p_data + j * video->line_stride_in_bytes, dst + j * dst_stride, stride );
-		else if ( NDIlib_FourCC_type_RGBA == video->FourCC || NDIlib_FourCC_type_RGBX == video->FourCC )
-			for( j = 0; j < video->yres; j++)
-				memcpy( dst + j * dst_stride, video->p_data + j * video->line_stride_in_bytes, stride );
-
-		if ( dst )
+		if ( rgba && !writable && dst_stride == video->line_stride_in_bytes )
 		{
+			// Use the received frame as is, it is released with the mlt frame
+			mlt_frame_set_image( frame, video->p_data, size, NULL );
+			*buffer = video->p_data;
+		}
+		else if ( *format != mlt_image_none )
+		{
+			dst = mlt_pool_alloc( size );
+
+			if ( uyvy && dst_stride == video->line_stride_in_bytes )
+				swab2( video->p_data, dst, dst_stride * video->yres );
+			else if ( uyvy )
+				for( j = 0; j < video->yres; j++)
+					swab2( video->p_data + j * video->line_stride_in_bytes, dst + j * dst_stride, stride );
+			else if ( bgra )
+				for( j = 0; j < video->yres; j++)
+					bgra_to_rgba( video->p_data + j * video->line_stride_in_bytes, dst + j * dst_stride, stride / 4 );
+			else
+				for( j = 0; j < video->yres; j++)
+					memcpy( dst + j * dst_stride, video->p_data + j * video->line_stride_in_bytes, stride );
+
 			mlt_frame_set_image( frame, (uint8_t*) dst, size, (mlt_destructor)mlt_pool_release );
 			*buffer = dst;
 		}
@@ -325,22 +359,26 @@ static int get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *forma
 			uint8_t *src = video->p_data + (*height) * video->line_stride_in_bytes;
 
 			size = (*width) * (*height);
-			dst = mlt_pool_alloc( size );
-
 			dst_stride = *width;
-			stride = ( dst_stride > ( video->line_stride_in_bytes / 2) ) ? ( video->line_stride_in_bytes / 2 ) : dst_stride;
-			for( j = 0; j < video->yres; j++)
-				memcpy( dst + j * dst_stride, src + j * ( video->line_stride_in_bytes / 2 ), stride );
+			if ( !writable && dst_stride == video->line_stride_in_bytes / 2 )
+			{
+				mlt_frame_set_alpha( frame, src, size, NULL );
+			}
+			else
+			{
+				dst = mlt_pool_alloc( size );
+				stride = ( dst_stride > ( video->line_stride_in_bytes / 2) ) ? ( video->line_stride_in_bytes / 2 ) : dst_stride;
+				for( j = 0; j < video->yres; j++)
+					memcpy( dst + j * dst_stride, src + j * ( video->line_stride_in_bytes / 2 ), stride );
 
-			mlt_frame_set_alpha( frame, (uint8_t*) dst, size, (mlt_destructor)mlt_pool_release );
+				mlt_frame_set_alpha( frame, (uint8_t*) dst, size, (mlt_destructor)mlt_pool_release );
+			}
 		}
 
 		mlt_properties_set_int( fprops, "progressive",
 			( video->frame_format_type == NDIlib_frame_format_type_progressive ) );
 		mlt_properties_set_int( fprops, "top_field_first",
 			( video->frame_format_type == NDIlib_frame_format_type_interleaved ) );
-
-		NDIlib_recv_free_video( recv, video );
 	}
 
 	return 0;
@@ -362,6 +400,16 @@ static int get_frame( mlt_producer producer, mlt_frame_ptr pframe, int index )
 	// run thread
 	if ( !self->f_running )
 	{
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+
+		// size the jitter buffer
+		if ( mlt_properties_get( properties, "buffer" ) )
+			self->v_queue_limit = self->a_queue_limit =
+				MAX( mlt_properties_get_int( properties, "buffer" ), 2 );
+		if ( mlt_properties_get( properties, "prefill" ) )
+			self->v_prefill = mlt_properties_get_int( properties, "prefill" );
+		self->v_prefill = CLAMP( self->v_prefill, 1, self->v_queue_limit - 1 );
+
 		// set flags
 		self->f_exit = 0;
 
@@ -389,7 +437,24 @@ static int get_frame( mlt_producer producer, mlt_frame_ptr pframe, int index )
 
 	// pop frame to use
 	if ( mlt_deque_count( self->v_queue ) >= self->v_prefill )
+	{
+		NDIlib_video_frame_t* newest = mlt_deque_peek_back( self->v_queue );
+		int64_t span = ( self->v_queue_limit - 1 ) * NDI_TIMEBASE * newest->frame_rate_D / newest->frame_rate_N;
+
+		// deliver by timecode: skip frames repeated or left behind by the buffer latency
+		while ( mlt_deque_count( self->v_queue ) > 1 )
+		{
+			video = mlt_deque_peek_front( self->v_queue );
+			if ( !( video->timecode <= self->v_timecode && self->v_timecode - video->timecode < span ) &&
+				newest->timecode - video->timecode <= span )
+				break;
+			producer_ndi_video_close( mlt_deque_pop_front( self->v_queue ) );
+			self->v_dropped++;
+		}
 		video = (NDIlib_video_frame_t*)mlt_deque_pop_front( self->v_queue );
+		self->v_timecode = video->timecode;
+		mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( producer ), "dropped", self->v_dropped );
+	}
 
 	if ( video )
 	{
@@ -485,7 +550,7 @@ static int get_frame( mlt_producer producer, mlt_frame_ptr pframe, int index )
 
 		if ( video )
 		{
-			mlt_properties_set_data( p, "ndi_video", (void *)video, 0, mlt_pool_release, NULL );
+			mlt_properties_set_data( p, "ndi_video", (void *)video, 0, producer_ndi_video_close, NULL );
 			mlt_frame_push_get_image( frame, get_image );
 		}
 		else
@@ -540,9 +605,7 @@ static void producer_ndi_close( mlt_producer producer )
 		// dequeue video frames
 		while( mlt_deque_count( self->v_queue ) )
 		{
-			NDIlib_video_frame_t* video = (NDIlib_video_frame_t*)mlt_deque_pop_front( self->v_queue );
-			NDIlib_recv_free_video( self->recv, video );
-			mlt_pool_release( video );
+			producer_ndi_video_close( mlt_deque_pop_front( self->v_queue ) );
 		}
 
 		// close receiver
@@ -586,6 +649,7 @@ mlt_producer producer_ndi_init( mlt_profile profile, mlt_service_type type, cons
 		self->v_queue_limit = 6;
 		self->a_queue_limit = 6;
 		self->v_prefill = 2;
+		self->v_timecode = INT64_MIN;
 
 		// Set callbacks
 		parent->close = (mlt_destructor) producer_ndi_close;
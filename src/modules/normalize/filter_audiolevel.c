@@ -24,6 +24,8 @@
 #include <framework/mlt_log.h>
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 
 #define AMPTODBFS(n) (log10(n) * 20.0)
@@ -53,55 +55,206 @@ static inline double IEC_Scale(double dB)
 	return fScale;
 }
 
+// A sample of this size counts as over the maximum.
+#define OVERSAMPLE (16384)
+
+typedef void ( *level_sums_function )( const int16_t *pcm, int channels, int count, int32_t *sums, int *over );
+
+/** Add up the magnitudes of count interleaved samples for each channel, and
+ * mark the channels that have a sample at OVERSAMPLE.
+ */
+
+static void level_sums_c( const int16_t *pcm, int channels, int count, int32_t *sums, int *over )
+{
+	int i;
+	for ( i = 0; i < count; i++ )
+	{
+		int sample = abs( pcm[i] );
+		sums[i % channels] += sample;
+		over[i % channels] |= sample == OVERSAMPLE;
+	}
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+// 8 samples at a time when the channels divide 8, so each lane stays on one channel
+static __attribute__((target("sse2"))) void level_sums_sse2( const int16_t *pcm, int channels, int count, int32_t *sums, int *over )
+{
+	__m128i low = _mm_setzero_si128();
+	__m128i high = _mm_setzero_si128();
+	__m128i mask = _mm_setzero_si128();
+	const __m128i plus = _mm_set1_epi16( OVERSAMPLE );
+	const __m128i minus = _mm_set1_epi16( -OVERSAMPLE );
+	int32_t lanes[8];
+	int16_t masks[8];
+	int i, k;
+
+	if ( 8 % channels )
+	{
+		level_sums_c( pcm, channels, count, sums, over );
+		return;
+	}
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*) ( pcm + i ) );
+		__m128i a = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );
+		__m128i b = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+		__m128i sa = _mm_srai_epi32( a, 31 );
+		__m128i sb = _mm_srai_epi32( b, 31 );
+		low = _mm_add_epi32( low, _mm_sub_epi32( _mm_xor_si128( a, sa ), sa ) );
+		high = _mm_add_epi32( high, _mm_sub_epi32( _mm_xor_si128( b, sb ), sb ) );
+		mask = _mm_or_si128( mask, _mm_or_si128( _mm_cmpeq_epi16( x, plus ), _mm_cmpeq_epi16( x, minus ) ) );
+	}
+	_mm_storeu_si128( (__m128i*) lanes, low );
+	_mm_storeu_si128( (__m128i*) ( lanes + 4 ), high );
+	_mm_storeu_si128( (__m128i*) masks, mask );
+	for ( k = 0; k < 8; k++ )
+	{
+		sums[k % channels] += lanes[k];
+		over[k % channels] |= masks[k] != 0;
+	}
+	// i is a multiple of 8, so the rest starts on channel 0
+	level_sums_c( pcm + i, channels, count - i, sums, over );
+}
+
+static level_sums_function level_sums_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return level_sums_sse2;
+	return level_sums_c;
+}
+
+#else
+
+static level_sums_function level_sums_detect( void )
+{
+	return level_sums_c;
+}
+
+#endif
+
+static level_sums_function level_sums = NULL;
+
+/** Get the level of a channel the slow way when it has samples over the maximum.
+ */
+
+static double oversampled_level( const int16_t *pcm, int num_channels, int num_samples, int c )
+{
+	int num_oversample = 0;
+	double val = 0;
+	double level = 0.0;
+	int s;
+
+	for ( s = 0; s < num_samples; s++ )
+	{
+		double sample = fabs( pcm[c + s * num_channels] / 128.0 );
+		val += sample;
+		if ( sample == 128 )
+			num_oversample++;
+		else
+			num_oversample = 0;
+		// 10 samples @max => show max signal
+		if ( num_oversample > 10 )
+			return 1.0;
+		// if 3 samples over max => 1 peak over 0 db (0 dB = 40.0)
+		if ( num_oversample > 3 )
+			level = 41.0/42.0;
+	}
+	if ( level == 0.0 && num_samples > 0 )
+		level = val / num_samples * 40.0/42.0 / 127.0;
+	return level;
+}
+
+/** Decide whether to measure this frame.
+ *
+ * With an interval of N the levels are measured on every Nth frame, and the
+ * frames between get the last levels. With 0 they are only measured when
+ * request is set.
+ */
+
+static int want_measure( mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	int interval = mlt_properties_get( properties, "interval" ) ? mlt_properties_get_int( properties, "interval" ) : 1;
+	int measure = 1;
+
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+	if ( mlt_properties_get_int( properties, "request" ) )
+	{
+		mlt_properties_set_int( properties, "request", 0 );
+	}
+	else if ( interval != 1 )
+	{
+		int count = mlt_properties_get_int( properties, "_skipped" );
+		measure = interval > 1 && count + 1 >= interval;
+		// Measure the first frame in any case
+		measure = measure || mlt_properties_get( properties, "_audio_level.0" ) == NULL;
+		count = measure ? 0 : count + 1;
+		mlt_properties_set_int( properties, "_skipped", count );
+	}
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+	return measure;
+}
+
 static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
 	mlt_filter filter = mlt_frame_pop_audio( frame );
-	int iec_scale = mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "iec_scale" );
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	int iec_scale = mlt_properties_get_int( properties, "iec_scale" );
+	int measure = want_measure( filter );
 	*format = mlt_audio_s16;
 	int error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 	if ( error || !buffer ) return error;
 
 	int num_channels = *channels;
 	int num_samples = *samples > 200 ? 200 : *samples;
-	int num_oversample = 0;
-	int c, s;
+	int c;
 	char key[ 50 ];
 	int16_t *pcm = (int16_t*) *buffer;
+	int32_t *sums = NULL;
+	int *over = NULL;
+
+	if ( measure && num_channels > 0 )
+	{
+		sums = calloc( num_channels, sizeof( *sums ) );
+		over = calloc( num_channels, sizeof( *over ) );
+		if ( sums && over )
+			level_sums( pcm, num_channels, num_samples * num_channels, sums, over );
+		else
+			measure = 0;
+	}
 
 	for ( c = 0; c < *channels; c++ )
 	{
-		double val = 0;
 		double level = 0.0;
 
-		for ( s = 0; s < num_samples; s++ )
+		sprintf( key, "_audio_level.%d", c );
+		if ( !measure )
 		{
-			double sample = fabs( pcm[c + s * num_channels] / 128.0 );
-			val += sample;
-			if ( sample == 128 )
-				num_oversample++;
-			else
-				num_oversample = 0;
-			// 10 samples @max => show max signal
-			if ( num_oversample > 10 )
-			{
-				level = 1.0;
-				break;
-			}
-			// if 3 samples over max => 1 peak over 0 db (0 dB = 40.0)
-			if ( num_oversample > 3 )
-				level = 41.0/42.0;
+			// Pass on the last measured level
+			level = mlt_properties_get_double( properties, key );
+			sprintf( key, "meta.media.audio_level.%d", c );
+			mlt_properties_set_double( MLT_FRAME_PROPERTIES( frame ), key, level );
+			continue;
 		}
+
+		if ( over[c] )
+			level = oversampled_level( pcm, num_channels, num_samples, c );
 		// max amplitude = 40/42, 3to10  oversamples=41, more then 10 oversamples=42
-		if ( level == 0.0 && num_samples > 0 )
-			level = val / num_samples * 40.0/42.0 / 127.0;
+		else if ( num_samples > 0 )
+			level = sums[c] / 128.0 / num_samples * 40.0/42.0 / 127.0;
 		if ( iec_scale )
 			level = IEC_Scale( AMPTODBFS( level ) );
+		mlt_properties_set_double( properties, key, level );
 		sprintf( key, "meta.media.audio_level.%d", c );
 		mlt_properties_set_double( MLT_FRAME_PROPERTIES( frame ), key, level );
-		sprintf( key, "_audio_level.%d", c );
-		mlt_properties_set_double( MLT_FILTER_PROPERTIES( filter ), key, level );
 		mlt_log_debug( MLT_FILTER_SERVICE( filter ), "channel %d level %f\n", c, level );
 	}
+	free( sums );
+	free( over );
 
 	return error;
 }
@@ -126,6 +279,9 @@ mlt_filter filter_audiolevel_init( mlt_profile profile, mlt_service_type type, c
 	{
 		filter->process = filter_process;
 		mlt_properties_set_int( MLT_FILTER_PROPERTIES(filter), "iec_scale", 1 );
+		mlt_properties_set_int( MLT_FILTER_PROPERTIES(filter), "interval", 1 );
+		if ( !level_sums )
+			level_sums = level_sums_detect();
 	}
 	return filter;
 }
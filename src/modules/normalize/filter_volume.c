@@ -66,14 +66,12 @@ int strncaseeq(const char *s1, const char *s2, size_t n)
 */
 static inline double limiter( double x, double lmtr_lvl )
 {
-	double xp = x;
+	// Both sides are the same curve mirrored, since tanh() is odd.
+	double ax = fabs( x );
 
-	if (x < -lmtr_lvl)
-		xp = tanh((x + lmtr_lvl) / (1-lmtr_lvl)) * (1-lmtr_lvl) - lmtr_lvl;
-	else if (x > lmtr_lvl)
-		xp = tanh((x - lmtr_lvl) / (1-lmtr_lvl)) * (1-lmtr_lvl) + lmtr_lvl;
-
-	return xp;
+	if ( ax <= lmtr_lvl )
+		return x;
+	return copysign( tanh( ( ax - lmtr_lvl ) / ( 1 - lmtr_lvl ) ) * ( 1 - lmtr_lvl ) + lmtr_lvl, x );
 }
 
 
@@ -155,6 +153,61 @@ double signal_max_power( int16_t *buffer, int channels, int samples, int16_t *pe
 
 /* ------ End normalize functions --------------------------------------- */
 
+/** Apply a gain that ramps by step per sample to interleaved float audio.
+
+    The gain of each sample is computed from its index rather than
+    accumulated, so that the loops have no dependency between iterations
+    and the compiler can vectorise them.
+*/
+
+static void apply_gain_interleaved( float *p, int samples, int channels, float gain, float step )
+{
+	int i, j;
+
+	if ( step == 0.0f )
+	{
+		int n = samples * channels;
+		for ( i = 0; i < n; i++ )
+			p[i] *= gain;
+	}
+	else if ( channels == 2 )
+	{
+		for ( i = 0; i < samples; i++ )
+		{
+			float g = gain + step * i;
+			p[2 * i] *= g;
+			p[2 * i + 1] *= g;
+		}
+	}
+	else
+	{
+		for ( i = 0; i < samples; i++, p += channels )
+		{
+			float g = gain + step * i;
+			for ( j = 0; j < channels; j++ )
+				p[j] *= g;
+		}
+	}
+}
+
+/** Apply a gain that ramps by step per sample to planar float audio.
+*/
+
+static void apply_gain_planar( float *p, int samples, int channels, float gain, float step )
+{
+	int i, j;
+
+	for ( j = 0; j < channels; j++, p += samples )
+	{
+		if ( step == 0.0f )
+			for ( i = 0; i < samples; i++ )
+				p[i] *= gain;
+		else
+			for ( i = 0; i < samples; i++ )
+				p[i] *= gain + step * i;
+	}
+}
+
 /** Get the audio.
 */
 
@@ -192,8 +245,11 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	if ( mlt_properties_get( instance_props, "limiter" ) != NULL )
 		limiter_level = mlt_properties_get_double( instance_props, "limiter" );
 	
-	// Get the producer's audio
-	*format = normalise? mlt_audio_s16 : mlt_audio_f32le;
+	// Get the producer's audio, keeping planar float if it was requested
+	if ( normalise )
+		*format = mlt_audio_s16;
+	else if ( *format != mlt_audio_float )
+		*format = mlt_audio_f32le;
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
@@ -258,25 +314,24 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		int samplemax = (1 << (bytes_per_samp * 8 - 1)) - 1;
 
 		for ( i = 0; i < *samples; i++, gain += gain_step ) {
-			for ( j = 0; j < *channels; j++ ) {
-				sample = *p * gain;
-				*p = ROUND( sample );
-				if ( gain > 1.0 && normalise ) {
-					/* use limiter function instead of clipping */
+			if ( gain > 1.0 ) {
+				/* use limiter function instead of clipping */
+				for ( j = 0; j < *channels; j++, p++ ) {
+					sample = *p * gain;
 					*p = ROUND( samplemax * limiter( sample / (double) samplemax, limiter_level ) );
 				}
-				p++;
+			} else {
+				for ( j = 0; j < *channels; j++, p++ )
+					*p = ROUND( *p * gain );
 			}
 		}
 	}
-	else
+	else if ( gain != 1.0 || gain_step != 0.0 )
 	{
-		float *p = *buffer;
-		for ( i = 0; i < *samples; i++, gain += gain_step ) {
-			for ( j = 0; j < *channels; j++, p++ ) {
-				p[0] *= gain;
-			}
-		}
+		if ( *format == mlt_audio_float )
+			apply_gain_planar( *buffer, *samples, *channels, gain, gain_step );
+		else
+			apply_gain_interleaved( *buffer, *samples, *channels, gain, gain_step );
 	}
 	return 0;
 }
@@ -25,6 +25,8 @@
 #include <string.h>
 #include <time.h>
 
+#include "random.h"
+
 static void overlay_image(uint8_t *src, int src_width, int src_height , uint8_t *overlay, int overlay_width, int overlay_height, uint8_t * alpha , int xpos, int ypos, int upsidedown , int mirror )
 {
 	int x,y;
@@ -87,26 +89,27 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		return 0;
 
 	double position = mlt_filter_get_progress( filter, frame );
-	srand( position * 10000 );
+	oldfilm_random rng;
+	oldfilm_random_init( &rng, position );
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
-	int im = rand() % maxcount;
+	int im = oldfilm_random_next( &rng ) % maxcount;
 	int piccount = mlt_properties_count( direntries );
 	while ( im-- && piccount )
 	{
-		int picnum = rand() % piccount;
+		int picnum = oldfilm_random_next( &rng ) % piccount;
 		
-		int y1 = rand() % *height;
-		int x1 = rand() % *width;
+		int y1 = oldfilm_random_next( &rng ) % *height;
+		int x1 = oldfilm_random_next( &rng ) % *width;
 		char resource[1024] = "";
 		char savename[1024] = "", savename1[1024] = "", cachedy[100];
 		int dx = ( *width * maxdia / 100);
 		int luma_width, luma_height;
 		uint8_t *luma_image = NULL;
 		uint8_t *alpha = NULL;
-		int updown = rand() % 2;
-		int mirror = rand() % 2;
+		int updown = oldfilm_random_next( &rng ) % 2;
+		int mirror = oldfilm_random_next( &rng ) % 2;
 		
 		sprintf( resource, "%s", mlt_properties_get_value(direntries,picnum) );
 		sprintf( savename, "cache-%d-%d", picnum,dx );
@@ -180,15 +183,15 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 		int h = *height;
 		int w = *width;
-		int im = rand() % maxcount;
+		int im = oldfilm_random_next( &rng ) % maxcount;
 		
 		while ( im-- )
 		{
 			int type = im % 2;
-			int y1 = rand() % h;
-			int x1 = rand() % w;
-			int dx = rand() % maxdia;
-			int dy = rand() % maxdia;
+			int y1 = oldfilm_random_next( &rng ) % h;
+			int x1 = oldfilm_random_next( &rng ) % w;
+			int dx = oldfilm_random_next( &rng ) % maxdia;
+			int dy = oldfilm_random_next( &rng ) % maxdia;
 			int x=0, y=0;
 			double v = 0.0;
 			for ( x = -dx ; x < dx ; x++ )
@@ -198,7 +201,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 					if ( x1 + x < w && x1 + x > 0 && y1 + y < h && y1 + y > 0 ){
 						uint8_t *pix = *image + (y+y1) * w * 2 + (x + x1) * 2;
 
-						v=pow((double) x /(double)dx * 5.0, 2.0) + pow((double)y / (double)dy * 5.0, 2.0);
+						double vx = (double) x / (double) dx * 5.0;
+						double vy = (double) y / (double) dy * 5.0;
+						v = vx * vx + vy * vy;
 						if (v>10)
 							v=10;
 						v = 1.0 - ( v / 10.0 );
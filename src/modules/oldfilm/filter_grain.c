@@ -19,10 +19,149 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
+#include <framework/mlt_pool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "random.h"
+
+// Do not filter bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (16)
+
+struct grain_slice_desc
+{
+	uint8_t *image;
+	int width;
+	int height;
+	int noise;
+	uint32_t seed;
+	int lut[256];
+};
+
+typedef void (*noise_function)( uint32_t seed, uint32_t counter, int noise, int16_t *out, int count );
+
+/** Fill a row with values in [0, noise) at consecutive counters.
+ */
+
+static void noise_row_c( uint32_t seed, uint32_t counter, int noise, int16_t *out, int count )
+{
+	int i;
+	for ( i = 0; i < count; i++ )
+		out[i] = oldfilm_random_range( oldfilm_random_at( seed, counter + i ), noise );
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define GRAIN_SSE2 __attribute__((target("sse2")))
+
+static GRAIN_SSE2 inline __m128i mullo_epi32( __m128i a, __m128i b )
+{
+	__m128i even = _mm_mul_epu32( a, b );
+	__m128i odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+	return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+		_mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+}
+
+static GRAIN_SSE2 inline __m128i mulhi_epu32( __m128i a, __m128i b )
+{
+	__m128i even = _mm_mul_epu32( a, b );
+	__m128i odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+	return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 3, 1, 3, 1 ) ),
+		_mm_shuffle_epi32( odd, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+}
+
+static GRAIN_SSE2 inline __m128i hash_epi32( __m128i x )
+{
+	x = _mm_xor_si128( x, _mm_srli_epi32( x, 16 ) );
+	x = mullo_epi32( x, _mm_set1_epi32( 0x7feb352d ) );
+	x = _mm_xor_si128( x, _mm_srli_epi32( x, 15 ) );
+	x = mullo_epi32( x, _mm_set1_epi32( 0x846ca68b ) );
+	x = _mm_xor_si128( x, _mm_srli_epi32( x, 16 ) );
+	return x;
+}
+
+static GRAIN_SSE2 void noise_row_sse2( uint32_t seed, uint32_t counter, int noise, int16_t *out, int count )
+{
+	const __m128i seeds = _mm_set1_epi32( seed );
+	const __m128i range = _mm_set1_epi32( noise );
+	const __m128i step = _mm_set1_epi32( OLDFILM_RANDOM_STEP * 8 );
+	__m128i lo = _mm_setr_epi32( counter * OLDFILM_RANDOM_STEP, ( counter + 1 ) * OLDFILM_RANDOM_STEP,
+		( counter + 2 ) * OLDFILM_RANDOM_STEP, ( counter + 3 ) * OLDFILM_RANDOM_STEP );
+	__m128i hi = _mm_add_epi32( lo, _mm_set1_epi32( OLDFILM_RANDOM_STEP * 4 ) );
+	int i;
+
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m128i a = mulhi_epu32( hash_epi32( _mm_xor_si128( seeds, lo ) ), range );
+		__m128i b = mulhi_epu32( hash_epi32( _mm_xor_si128( seeds, hi ) ), range );
+		_mm_storeu_si128( (__m128i*) ( out + i ), _mm_packs_epi32( a, b ) );
+		lo = _mm_add_epi32( lo, step );
+		hi = _mm_add_epi32( hi, step );
+	}
+	noise_row_c( seed, counter + i, noise, out + i, count - i );
+}
+
+static noise_function noise_simd_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return noise_row_sse2;
+	return noise_row_c;
+}
+
+#else
+
+static noise_function noise_simd_detect( void )
+{
+	return noise_row_c;
+}
+
+#endif
+
+static int grain_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct grain_slice_desc *desc = (struct grain_slice_desc *) cookie;
+	static noise_function noise_row = NULL;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	int16_t *noise = NULL;
+	int x;
+
+	if ( !noise_row )
+		noise_row = noise_simd_detect();
+	if ( desc->noise > 0 )
+		noise = mlt_pool_alloc( w * sizeof( *noise ) );
+
+	for ( ; y < yend; y++ )
+	{
+		uint8_t *pixel = desc->image + y * w * 2;
+
+		if ( noise )
+		{
+			noise_row( desc->seed, y * w, desc->noise, noise, w );
+			for ( x = 0; x < w; x++, pixel += 2 )
+			{
+				if ( *pixel > 20 )
+				{
+					int pix = desc->lut[*pixel] + desc->noise - noise[x];
+					*pixel = CLAMP( pix, 0, 255 );
+				}
+			}
+		}
+		else
+		{
+			for ( x = 0; x < w; x++, pixel += 2 )
+				*pixel = CLAMP( desc->lut[*pixel], 0, 255 );
+		}
+	}
+	mlt_pool_release( noise );
+	return 0;
+}
 
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
@@ -36,31 +175,27 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 	if ( error == 0 && *image )
 	{
-		int h = *height;
-		int w = *width;
-
+		struct grain_slice_desc desc;
 		double position = mlt_filter_get_progress( filter, frame );
-		srand(position*10000);
-
-		int noise = mlt_properties_anim_get_int( properties, "noise", pos, len );
 		double contrast = mlt_properties_anim_get_double( properties, "contrast", pos, len ) / 100.0;
 		double brightness = 127.0 * (mlt_properties_anim_get_double( properties, "brightness", pos, len ) -100.0 ) / 100.0;
-		
-		int x = 0,y = 0,pix = 0;
-		for ( x = 0; x < w; x++ )
-		{
-			for( y = 0; y < h; y++ )
-			{
-				uint8_t* pixel = (*image + (y) * w * 2 + (x) * 2 );
-				if (*pixel > 20)
-				{
-					pix = MIN ( MAX ( ( (double)*pixel -127.0  ) * contrast + 127.0 + brightness , 0 ) , 255 ) ;
-					if ( noise > 0 ) pix -= ( rand() % noise - noise );
+		int i;
 
-					*pixel = MIN ( MAX ( pix , 0 ) , 255 );
-				}
-			}
-		}
+		desc.image = *image;
+		desc.width = *width;
+		desc.height = *height;
+		desc.noise = MIN( mlt_properties_anim_get_int( properties, "noise", pos, len ), 32767 );
+		desc.seed = oldfilm_random_seed( position );
+
+		// Dark pixels are left alone, the others get the contrast and brightness
+		for ( i = 0; i < 256; i++ )
+			desc.lut[i] = i > 20 ? MIN( MAX( ( (double) i - 127.0 ) * contrast + 127.0 + brightness, 0 ), 255 ) : i;
+
+		int jobs = MIN( mlt_slices_count_normal(), *height / MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, grain_slice_proc, &desc );
+		else
+			grain_slice_proc( 0, 0, 1, &desc );
 	}
 
 	return error;
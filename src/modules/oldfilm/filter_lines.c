@@ -19,11 +19,14 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_profile.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "random.h"
+
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	mlt_filter filter = (mlt_filter) mlt_frame_pop_service( frame );
@@ -39,6 +42,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int h = *height;
 		int w = *width;
 
+		mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
 		int line_width = mlt_properties_anim_get_int( properties, "line_width", pos, len );
 		int num = mlt_properties_anim_get_int( properties, "num", pos, len );
 		double maxdarker = (double) mlt_properties_anim_get_int( properties, "darker", pos, len );
@@ -49,25 +53,27 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		
 		if ( line_width < 1 )
 			return 0;
+		line_width = MAX( 1, line_width * mlt_profile_scale_width( profile, w ) + 0.5 );
 
 		double position = mlt_filter_get_progress( filter, frame );
-		srand(position*10000);
+		oldfilm_random rng;
+		oldfilm_random_init( &rng, position );
 		
 		mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
 		while ( num-- )
 		{
-			int type = (rand() % 3 ) + 1;
-			int x1 = (double)w * rand() / RAND_MAX;
-			int dx = rand() % line_width;
+			int type = ( oldfilm_random_next( &rng ) % 3 ) + 1;
+			int x1 = (double) w * oldfilm_random_next( &rng ) / OLDFILM_RANDOM_MAX;
+			int dx = oldfilm_random_next( &rng ) % line_width;
 			int x = 0, y = 0;
-			int ystart = rand() % h;
-			int yend = rand() % h;
+			int ystart = oldfilm_random_next( &rng ) % h;
+			int yend = oldfilm_random_next( &rng ) % h;
 
 			sprintf( buf, "line%d", num);
 			sprintf( typebuf, "typeline%d", num);
-			maxlighter += rand() % 30 -15;
-			maxdarker += rand() % 30 -15;
+			maxlighter += oldfilm_random_next( &rng ) % 30 -15;
+			maxdarker += oldfilm_random_next( &rng ) % 30 -15;
 
 			if ( mlt_properties_get_int(MLT_FILTER_PROPERTIES( filter ),buf ) ==0 )
 			{
@@ -84,7 +90,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 			type = mlt_properties_get_int(MLT_FILTER_PROPERTIES( filter ), typebuf );
 			if ( position != mlt_properties_get_double(MLT_FILTER_PROPERTIES( filter ), "last_oldfilm_line_pos"))
 			{
-				x1 += (rand() % 11 - 5);
+				x1 += ( oldfilm_random_next( &rng ) % 11 - 5 );
 			}
 
 			if ( yend < ystart)
@@ -92,27 +98,28 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				yend=h;
 			}
 
-			for ( x = -dx ; x < dx && dx != 0 ; x++ )
+			// Walk the rows in memory order and only the columns inside the image
+			int xstart = MAX( -dx, 1 - x1 );
+			int xend = MIN( dx, w - x1 );
+
+			for ( y = ystart; y < yend && dx != 0; y++ )
 			{
-				for( y = ystart; y < yend; y++ )
+				uint8_t* row = *image + y * w * 2;
+				for ( x = xstart; x < xend; x++ )
 				{
-					if ( x + x1 < w && x + x1 > 0)
+					uint8_t* pixel = row + ( x + x1 ) * 2;
+					double diff = 1.0 - (double) abs(x) / dx;
+					switch( type )
 					{
-						uint8_t* pixel = (*image + (y) * w * 2 + ( x + x1) * 2);
-						double diff = 1.0 - (double) abs(x) / dx;
-						switch( type )
-						{
-							case 1: //blackline
-								*pixel -= ((double) * pixel * diff * maxdarker / 100.0);
-								break;
-							case 2: //whiteline
-								*pixel += ((255.0-(double)*pixel) * diff * maxlighter /100.0);
-								break;
-							case 3: //greenline
-								*(pixel+1) -= ((*(pixel+1)) * diff * maxlighter / 100.0);
+						case 1: //blackline
+							*pixel -= ((double) * pixel * diff * maxdarker / 100.0);
+							break;
+						case 2: //whiteline
+							*pixel += ((255.0-(double)*pixel) * diff * maxlighter /100.0);
 							break;
-						}
-							
+						case 3: //greenline
+							*(pixel+1) -= ((*(pixel+1)) * diff * maxlighter / 100.0);
+						break;
 					}
 				}
 			}
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "random.h"
+
 static double sinarr[] = {
 0.0,0.0627587292804297,0.125270029508395,0.18728744713136,0.2485664757507,0.308865520098932,
 0.3679468485397,0.425577530335206,0.481530353985902,0.535584723021826,0.587527525713892,0.637153975276265,
@@ -63,7 +65,8 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int y = 0;
 
 		double position = mlt_filter_get_progress( filter, frame );
-		srand( position * 10000);
+		oldfilm_random rng;
+		oldfilm_random_init( &rng, position );
 
 		int delta = mlt_properties_anim_get_int( properties, "delta", pos, len );
 		int every = mlt_properties_anim_get_int( properties, "every", pos, len );
@@ -78,13 +81,13 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 		int diffpic = 0;
 		if ( delta )
-			diffpic = rand() % delta * 2 - delta;
+			diffpic = oldfilm_random_next( &rng ) % delta * 2 - delta;
 		int brightdelta = 0;
 		if (( bdu + bdd ) != 0 )
-			brightdelta = rand() % (bdu + bdd) - bdd;
-		if ( rand() % 100 > every )
+			brightdelta = oldfilm_random_next( &rng ) % (bdu + bdd) - bdd;
+		if ( oldfilm_random_next( &rng ) % 100 > every )
 			diffpic = 0;
-		if ( rand() % 100 > bevery)
+		if ( oldfilm_random_next( &rng ) % 100 > bevery)
 			brightdelta = 0;
 		int yend, ydiff;
 		int unevendevelop_delta = 0;
@@ -93,9 +96,15 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 			float uval = sinarr[ ( ((int)position) % uduration) * 100 / uduration ];
 			unevendevelop_delta = uval * ( uval > 0 ? udu : udd );
 		}
+		// The luma offset is the same for every pixel
+		uint8_t lut[256];
+		for ( x = 0; x < 256; x++ )
+			lut[x] = CLAMP( x + brightdelta + unevendevelop_delta, 0, 255 );
+
+		// Walk away from the rows that are shifted in so that they are read before being written
 		if ( diffpic <= 0 )
 		{
-			y = h;
+			y = h - 1;
 			yend = 0;
 			ydiff = -1;
 		}
@@ -108,33 +117,22 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 		while( y != yend )
 		{
-			for ( x = 0; x < w; x++ )
+			uint8_t* pic = *image + y * w * 2;
+			int newy = y + diffpic;
+			if ( newy > 0 && newy < h )
 			{
-				uint8_t* pic = ( *image + y * w * 2 + x * 2 );
-				int newy = y + diffpic;
-				if ( newy > 0 && newy < h )
+				const uint8_t* src = pic + diffpic * w * 2;
+				for ( x = 0; x < w; x++ )
 				{
-					uint8_t oldval= *( pic + diffpic * w * 2 );
-					if ( ((int) oldval + brightdelta + unevendevelop_delta ) > 255 )
-					{
-						*pic=255;
-					}
-					else if ( ( (int) oldval + brightdelta + unevendevelop_delta )	<0 )
-					{
-						*pic=0;
-					}
-					else
-					{
-						*pic = oldval + brightdelta + unevendevelop_delta;
-					}
-					*( pic + 1 ) =* ( pic + diffpic * w * 2 + 1 );
-
+					pic[x * 2] = lut[src[x * 2]];
+					pic[x * 2 + 1] = src[x * 2 + 1];
 				}
-				else
-				{
-					*pic = 0;
-				}
-		}
+			}
+			else
+			{
+				for ( x = 0; x < w; x++ )
+					pic[x * 2] = 0;
+			}
 			y += ydiff;
 		}
 	}
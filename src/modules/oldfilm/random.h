@@ -0,0 +1,87 @@
+/*
+ * random.h -- reproducible noise for the oldfilm filters
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef OLDFILM_RANDOM_H
+#define OLDFILM_RANDOM_H
+
+#include <stdint.h>
+
+/* Every value is a hash of a seed and a counter, so the noise of a frame only
+ * depends on its position and any part of it can be generated on its own.
+ * Unlike srand() and rand() this is reentrant and is not disturbed by other
+ * filters rendering at the same time.
+ */
+
+#define OLDFILM_RANDOM_MAX (0x7fffffff)
+#define OLDFILM_RANDOM_STEP (0x9e3779b9u)
+
+typedef struct
+{
+	uint32_t seed;
+	uint32_t counter;
+} oldfilm_random;
+
+static inline uint32_t oldfilm_hash( uint32_t x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/** Get the seed of a frame from the progress of the filter.
+ */
+
+static inline uint32_t oldfilm_random_seed( double position )
+{
+	return oldfilm_hash( (uint32_t) ( position * 10000 ) + 1 );
+}
+
+/** Get the 32 random bits at a counter, typically the index of a pixel.
+ */
+
+static inline uint32_t oldfilm_random_at( uint32_t seed, uint32_t counter )
+{
+	return oldfilm_hash( seed ^ ( counter * OLDFILM_RANDOM_STEP ) );
+}
+
+/** Scale 32 random bits to the range [0, n).
+ */
+
+static inline int oldfilm_random_range( uint32_t value, int n )
+{
+	return (int) ( ( (uint64_t) value * (uint32_t) n ) >> 32 );
+}
+
+static inline void oldfilm_random_init( oldfilm_random *self, double position )
+{
+	self->seed = oldfilm_random_seed( position );
+	self->counter = 0;
+}
+
+/** Get the next value of a sequence in the range [0, OLDFILM_RANDOM_MAX].
+ */
+
+static inline int oldfilm_random_next( oldfilm_random *self )
+{
+	return oldfilm_random_at( self->seed, self->counter++ ) >> 1;
+}
+
+#endif
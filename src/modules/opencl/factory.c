@@ -0,0 +1,53 @@
+/*
+ * factory.c -- the factory method interfaces
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <framework/mlt.h>
+
+extern mlt_filter filter_opencl_brightness_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_filter filter_opencl_chroma_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_filter filter_opencl_rescale_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_filter filter_opencl_resize_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_transition transition_opencl_composite_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_transition transition_opencl_luma_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+
+static mlt_properties metadata( mlt_service_type type, const char *id, void *data )
+{
+	char file[ PATH_MAX ];
+	snprintf( file, PATH_MAX, "%s/opencl/%s", mlt_environment( "MLT_DATA" ), (char*) data );
+	return mlt_properties_parse_yaml( file );
+}
+
+MLT_REPOSITORY
+{
+	MLT_REGISTER( filter_type, "opencl.brightness", filter_opencl_brightness_init );
+	MLT_REGISTER( filter_type, "opencl.chroma", filter_opencl_chroma_init );
+	MLT_REGISTER( filter_type, "opencl.rescale", filter_opencl_rescale_init );
+	MLT_REGISTER( filter_type, "opencl.resize", filter_opencl_resize_init );
+	MLT_REGISTER( transition_type, "opencl.composite", transition_opencl_composite_init );
+	MLT_REGISTER( transition_type, "opencl.luma", transition_opencl_luma_init );
+
+	MLT_REGISTER_METADATA( filter_type, "opencl.brightness", metadata, "filter_opencl_brightness.yml" );
+	MLT_REGISTER_METADATA( filter_type, "opencl.chroma", metadata, "filter_opencl_chroma.yml" );
+	MLT_REGISTER_METADATA( filter_type, "opencl.rescale", metadata, "filter_opencl_rescale.yml" );
+	MLT_REGISTER_METADATA( filter_type, "opencl.resize", metadata, "filter_opencl_resize.yml" );
+	MLT_REGISTER_METADATA( transition_type, "opencl.composite", metadata, "transition_opencl_composite.yml" );
+	MLT_REGISTER_METADATA( transition_type, "opencl.luma", metadata, "transition_opencl_luma.yml" );
+}
@@ -0,0 +1,130 @@
+/*
+ * filter_opencl_brightness.c -- brightness and opacity on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+#include <math.h>
+
+/** Get the brightness level of a frame as the brightness filter does. */
+
+static double get_level( mlt_filter filter, mlt_frame frame )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	double level;
+
+	if ( mlt_properties_get( properties, "level" ) != NULL )
+	{
+		level = mlt_properties_anim_get_double( properties, "level", position, length );
+	}
+	else
+	{
+		level = fabs( mlt_properties_get_double( properties, "start" ) );
+		if ( mlt_properties_get( properties, "end" ) != NULL )
+		{
+			double end = fabs( mlt_properties_get_double( properties, "end" ) );
+			level += ( end - level ) * mlt_filter_get_progress( filter, frame );
+		}
+	}
+	return level;
+}
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	double level = get_level( filter, frame );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( frame, requested );
+	opencl_surface surface = NULL;
+	int error = opencl_frame_get_image( frame, &surface, width, height );
+	int count;
+
+	if ( error )
+		return error;
+	count = surface->width * surface->height;
+
+	if ( level != 1.0 )
+	{
+		cl_int m = level * ( 1 << 16 );
+		cl_int n = 128 * ( ( 1 << 16 ) - m );
+		cl_kernel kernel = opencl_kernel( "brightness" );
+
+		if ( kernel )
+		{
+			opencl_arg( kernel, 0, surface->image );
+			opencl_arg( kernel, 1, m );
+			opencl_arg( kernel, 2, n );
+			opencl_arg( kernel, 3, count );
+		}
+		error = opencl_enqueue( kernel, count, 1 );
+	}
+
+	if ( !error && mlt_properties_get( properties, "alpha" ) )
+	{
+		double alpha = mlt_properties_anim_get_double( properties, "alpha", position, length );
+		alpha = alpha >= 0.0 ? alpha : level;
+		if ( alpha != 1.0 && !( error = opencl_surface_add_alpha( surface, 255 ) ) )
+		{
+			cl_int m = alpha * ( 1 << 16 );
+			cl_kernel kernel = opencl_kernel( "scale_alpha" );
+
+			if ( kernel )
+			{
+				opencl_arg( kernel, 0, surface->alpha );
+				opencl_arg( kernel, 1, m );
+				opencl_arg( kernel, 2, count );
+			}
+			error = opencl_enqueue( kernel, count, 1 );
+		}
+	}
+
+	return opencl_frame_put_image( frame, surface, image, format, requested, resident ) || error;
+}
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	// Do not cause an upload unless there is real work to do.
+	if ( get_level( filter, frame ) == 1.0 && !mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "alpha" ) )
+		return frame;
+
+	opencl_frame_prepare( frame );
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, filter_get_image );
+	return frame;
+}
+
+mlt_filter filter_opencl_brightness_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter;
+
+	if ( !opencl_available() )
+		return mlt_factory_filter( profile, "brightness", arg );
+
+	if ( ( filter = mlt_filter_new() ) )
+	{
+		filter->process = filter_process;
+		mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "start", arg == NULL ? "1" : arg );
+		mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "level", NULL );
+	}
+	return filter;
+}
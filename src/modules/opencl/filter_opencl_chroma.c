@@ -0,0 +1,97 @@
+/*
+ * filter_opencl_chroma.c -- chroma key on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+static int key_clamp( int value, int low, int high )
+{
+	return value < low ? low : value > high ? high : value;
+}
+
+/** Key the alpha of the frame by the chroma, with the key, variance and
+ * softness of the chroma filter of the vmfx module.
+ */
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( frame, requested );
+	opencl_surface surface = NULL;
+	int error = opencl_frame_get_image( frame, &surface, width, height );
+
+	if ( error )
+		return error;
+
+	if ( !( error = opencl_surface_add_alpha( surface, 255 ) ) )
+	{
+		int32_t key_val = mlt_properties_get_int( properties, "key" );
+		int r = ( key_val >> 24 ) & 0xff;
+		int g = ( key_val >> 16 ) & 0xff;
+		int b = ( key_val >>  8 ) & 0xff;
+		cl_int u, v;
+		cl_int variance = key_clamp( 200 * mlt_properties_get_double( properties, "variance" ), -1, 255 );
+		cl_int softness = key_clamp( 200 * mlt_properties_get_double( properties, "softness" ), 1, 255 );
+		cl_int ramp = ( 255 << 8 ) / softness;
+		cl_kernel kernel = opencl_kernel( "chroma_key" );
+
+		RGB2UV_601_SCALED( r, g, b, u, v );
+		if ( kernel )
+		{
+			opencl_arg( kernel, 0, surface->image );
+			opencl_arg( kernel, 1, surface->alpha );
+			opencl_arg( kernel, 2, u );
+			opencl_arg( kernel, 3, v );
+			opencl_arg( kernel, 4, variance );
+			opencl_arg( kernel, 5, softness );
+			opencl_arg( kernel, 6, ramp );
+			opencl_arg( kernel, 7, surface->width );
+			opencl_arg( kernel, 8, surface->height );
+		}
+		error = opencl_enqueue( kernel, surface->width, surface->height );
+	}
+
+	return opencl_frame_put_image( frame, surface, image, format, requested, resident ) || error;
+}
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	opencl_frame_prepare( frame );
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, filter_get_image );
+	return frame;
+}
+
+mlt_filter filter_opencl_chroma_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter;
+
+	if ( !opencl_available() )
+		return mlt_factory_filter( profile, "chroma", arg );
+
+	if ( ( filter = mlt_filter_new() ) )
+	{
+		mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "key", arg == NULL ? "0x0000ff00" : arg );
+		mlt_properties_set_double( MLT_FILTER_PROPERTIES( filter ), "variance", 0.15 );
+		mlt_properties_set_double( MLT_FILTER_PROPERTIES( filter ), "softness", 0 );
+		filter->process = filter_process;
+	}
+	return filter;
+}
@@ -0,0 +1,124 @@
+/*
+ * filter_opencl_rescale.c -- image scaling on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+#include <string.h>
+
+/** Scale the image to the requested size, bilinear unless the interpolation
+ * is nearest, with the negotiation of the rescale filter.
+ */
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( frame, requested );
+	char *interps = mlt_properties_get( properties, "rescale.interp" );
+	opencl_surface surface = NULL;
+	int iwidth, iheight, owidth, oheight;
+	int error;
+
+	if ( *width == 0 || *height == 0 )
+	{
+		mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+		*width = profile->width;
+		*height = profile->height;
+	}
+	if ( *width < 6 || *height < 6 )
+		return 1;
+	iwidth = owidth = *width;
+	iheight = oheight = *height;
+
+	if ( mlt_properties_get( filter_properties, "factor" ) )
+	{
+		double factor = mlt_properties_get_double( filter_properties, "factor" );
+		owidth *= factor;
+		oheight *= factor;
+	}
+	if ( interps == NULL )
+	{
+		interps = mlt_properties_get( filter_properties, "interpolation" );
+		mlt_properties_set( properties, "rescale.interp", interps );
+	}
+	if ( mlt_properties_get_int( properties, "meta.media.width" ) )
+	{
+		iwidth = mlt_properties_get_int( properties, "meta.media.width" );
+		iheight = mlt_properties_get_int( properties, "meta.media.height" );
+	}
+
+	// Let the producer know what we are actually requested to obtain
+	if ( interps && strcmp( interps, "none" ) )
+	{
+		mlt_properties_set_int( properties, "rescale_width", *width );
+		mlt_properties_set_int( properties, "rescale_height", *height );
+	}
+	else
+	{
+		mlt_properties_set_int( properties, "rescale_width", iwidth );
+		mlt_properties_set_int( properties, "rescale_height", iheight );
+	}
+
+	// The fields are scaled together, so deinterlace if the height changes
+	if ( iheight != oheight && ( !interps || strcmp( interps, "nearest" ) || iheight % oheight ) )
+		mlt_properties_set_int( properties, "consumer_deinterlace", 1 );
+
+	if ( ( error = opencl_frame_get_image( frame, &surface, &iwidth, &iheight ) ) )
+		return error;
+
+	// Get the interpolation again, in case the producer wishes to override scaling
+	interps = mlt_properties_get( properties, "rescale.interp" );
+	if ( ( !interps || strcmp( interps, "none" ) ) && ( iwidth != owidth || iheight != oheight ) )
+	{
+		opencl_surface scaled = opencl_surface_scale( surface, owidth, oheight, interps && !strcmp( interps, "nearest" ) );
+		if ( scaled )
+			surface = scaled;
+		else
+			error = 1;
+	}
+	*width = surface->width;
+	*height = surface->height;
+
+	return opencl_frame_put_image( frame, surface, image, format, requested, resident ) || error;
+}
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	opencl_frame_prepare( frame );
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, filter_get_image );
+	return frame;
+}
+
+mlt_filter filter_opencl_rescale_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter;
+
+	if ( !opencl_available() )
+		return mlt_factory_filter( profile, "rescale", arg );
+
+	if ( ( filter = mlt_filter_new() ) )
+	{
+		filter->process = filter_process;
+		mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "interpolation", arg == NULL ? "bilinear" : arg );
+	}
+	return filter;
+}
@@ -0,0 +1,165 @@
+/*
+ * filter_opencl_resize.c -- aspect ratio padding on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+#include <math.h>
+#include <string.h>
+
+// Centre a surface in a black one of the requested size.
+static opencl_surface pad_surface( mlt_frame frame, opencl_surface surface, int width, int height )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	opencl_surface padded = opencl_surface_new( width, height, surface->alpha != NULL );
+	cl_int left = ( width - surface->width ) / 2;
+	cl_int top = ( height - surface->height ) / 2;
+	cl_int alpha_value = mlt_properties_get_int( properties, "resize_alpha" );
+	cl_kernel kernel;
+
+	if ( !padded )
+		return NULL;
+	left -= left % 2;
+	if ( ( kernel = opencl_kernel( "resize" ) ) )
+	{
+		opencl_arg( kernel, 0, surface->image );
+		opencl_arg( kernel, 1, surface->alpha );
+		opencl_arg( kernel, 2, surface->width );
+		opencl_arg( kernel, 3, surface->height );
+		opencl_arg( kernel, 4, padded->image );
+		opencl_arg( kernel, 5, padded->alpha );
+		opencl_arg( kernel, 6, width );
+		opencl_arg( kernel, 7, height );
+		opencl_arg( kernel, 8, left );
+		opencl_arg( kernel, 9, top );
+		opencl_arg( kernel, 10, alpha_value );
+	}
+	if ( opencl_enqueue( kernel, width, height ) )
+	{
+		opencl_surface_close( padded );
+		return NULL;
+	}
+
+	// The padding is black with the resize alpha
+	mlt_properties_set( properties, "solid_colour", NULL );
+	mlt_properties_set( properties, "constant_alpha", NULL );
+	mlt_properties_set( properties, "alpha_box", NULL );
+	return padded;
+}
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+	double aspect_ratio = mlt_deque_pop_back_double( MLT_FRAME_IMAGE_STACK( frame ) );
+	double consumer_aspect = mlt_profile_sar( profile );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( frame, requested );
+	char *rescale = mlt_properties_get( properties, "rescale.interp" );
+	opencl_surface surface = NULL;
+	int owidth, oheight;
+	int error;
+
+	if ( *width == 0 || *height == 0 )
+	{
+		*width = profile->width;
+		*height = profile->height;
+	}
+	owidth = *width;
+	oheight = *height;
+	if ( aspect_ratio == 0.0 )
+		aspect_ratio = consumer_aspect;
+	mlt_properties_set_double( properties, "aspect_ratio", aspect_ratio );
+
+	if ( rescale && !strcmp( rescale, "none" ) )
+	{
+		if ( ( error = opencl_frame_get_image( frame, &surface, width, height ) ) )
+			return error;
+		return opencl_frame_put_image( frame, surface, image, format, requested, resident );
+	}
+
+	// Fit the display aspect of the source in the one of the consumer
+	if ( mlt_properties_get_int( properties, "distort" ) == 0 )
+	{
+		int normalised_width = profile->width;
+		int normalised_height = profile->height;
+		int real_width = mlt_properties_get_int( properties, "meta.media.width" );
+		int real_height = mlt_properties_get_int( properties, "meta.media.height" );
+		if ( real_width == 0 )
+			real_width = mlt_properties_get_int( properties, "width" );
+		if ( real_height == 0 )
+			real_height = mlt_properties_get_int( properties, "height" );
+		double input_ar = aspect_ratio * real_width / real_height;
+		double output_ar = consumer_aspect * owidth / oheight;
+		int scaled_width = rint( ( input_ar * normalised_width ) / output_ar );
+		int scaled_height = normalised_height;
+
+		if ( scaled_width > normalised_width )
+		{
+			scaled_width = normalised_width;
+			scaled_height = rint( ( output_ar * normalised_height ) / input_ar );
+		}
+		owidth = rint( scaled_width * owidth / normalised_width );
+		oheight = rint( scaled_height * oheight / normalised_height );
+		mlt_frame_set_aspect_ratio( frame, consumer_aspect );
+	}
+	mlt_properties_set_int( properties, "distort", 0 );
+	mlt_properties_set_int( properties, "resize_width", *width );
+	mlt_properties_set_int( properties, "resize_height", *height );
+
+	owidth -= owidth % 2;
+	if ( ( error = opencl_frame_get_image( frame, &surface, &owidth, &oheight ) ) )
+		return error;
+
+	if ( surface->width < *width || surface->height < *height )
+	{
+		opencl_surface padded = pad_surface( frame, surface, *width, *height );
+		if ( padded )
+			surface = padded;
+		else
+			error = 1;
+	}
+	*width = surface->width;
+	*height = surface->height;
+
+	return opencl_frame_put_image( frame, surface, image, format, requested, resident ) || error;
+}
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	// Store the aspect ratio reported by the source
+	mlt_deque_push_back_double( MLT_FRAME_IMAGE_STACK( frame ), mlt_frame_get_aspect_ratio( frame ) );
+
+	opencl_frame_prepare( frame );
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, filter_get_image );
+	return frame;
+}
+
+mlt_filter filter_opencl_resize_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter;
+
+	if ( !opencl_available() )
+		return mlt_factory_filter( profile, "resize", arg );
+
+	if ( ( filter = mlt_filter_new() ) )
+		filter->process = filter_process;
+	return filter;
+}
@@ -0,0 +1,557 @@
+/*
+ * opencl_backend.c -- OpenCL compute backend for image services
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+#include "opencl_kernels.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PLATFORMS (8)
+
+typedef int ( *convert_image_fn )( mlt_frame self, uint8_t **image, mlt_image_format *input, mlt_image_format output );
+
+// The device is set up once and kept for the life of the process.
+static struct
+{
+	cl_context context;
+	cl_command_queue queue;
+	cl_program program;
+	int available;
+} backend;
+
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+
+static cl_device_id find_device( void )
+{
+	cl_platform_id platforms[ MAX_PLATFORMS ];
+	cl_uint count = 0, i;
+	cl_device_id device = NULL;
+
+	if ( clGetPlatformIDs( MAX_PLATFORMS, platforms, &count ) != CL_SUCCESS )
+		return NULL;
+	if ( count > MAX_PLATFORMS )
+		count = MAX_PLATFORMS;
+	for ( i = 0; i < count && !device; i++ )
+		if ( clGetDeviceIDs( platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, NULL ) != CL_SUCCESS )
+			device = NULL;
+	for ( i = 0; i < count && !device; i++ )
+		if ( clGetDeviceIDs( platforms[i], CL_DEVICE_TYPE_ALL, 1, &device, NULL ) != CL_SUCCESS )
+			device = NULL;
+	return device;
+}
+
+static void log_build( cl_device_id device )
+{
+	size_t size = 0;
+	char *log;
+
+	clGetProgramBuildInfo( backend.program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size );
+	if ( size && ( log = calloc( 1, size + 1 ) ) )
+	{
+		clGetProgramBuildInfo( backend.program, device, CL_PROGRAM_BUILD_LOG, size, log, NULL );
+		mlt_log_error( NULL, "[opencl] failed to build the program:\n%s\n", log );
+		free( log );
+	}
+}
+
+static void backend_init( void )
+{
+	const char *env = getenv( "MLT_OPENCL" );
+	const char *source = opencl_kernels_source;
+	cl_device_id device;
+	cl_int error = CL_SUCCESS;
+	char name[256] = "";
+
+	if ( env && !strcmp( env, "0" ) )
+		return;
+	if ( !( device = find_device() ) )
+	{
+		mlt_log_verbose( NULL, "[opencl] no device found\n" );
+		return;
+	}
+	backend.context = clCreateContext( NULL, 1, &device, NULL, NULL, &error );
+	if ( error == CL_SUCCESS )
+		backend.queue = clCreateCommandQueue( backend.context, device, 0, &error );
+	if ( error == CL_SUCCESS )
+		backend.program = clCreateProgramWithSource( backend.context, 1, &source, NULL, &error );
+	if ( error == CL_SUCCESS )
+	{
+		error = clBuildProgram( backend.program, 1, &device, "", NULL, NULL );
+		if ( error == CL_BUILD_PROGRAM_FAILURE )
+			log_build( device );
+	}
+	if ( error != CL_SUCCESS )
+	{
+		mlt_log_warning( NULL, "[opencl] cannot use the device (error %d)\n", error );
+		if ( backend.program )
+			clReleaseProgram( backend.program );
+		if ( backend.queue )
+			clReleaseCommandQueue( backend.queue );
+		if ( backend.context )
+			clReleaseContext( backend.context );
+		memset( &backend, 0, sizeof( backend ) );
+		return;
+	}
+	clGetDeviceInfo( device, CL_DEVICE_NAME, sizeof( name ) - 1, name, NULL );
+	mlt_log_verbose( NULL, "[opencl] using %s\n", name );
+	backend.available = 1;
+}
+
+int opencl_available( void )
+{
+	pthread_once( &backend_once, backend_init );
+	return backend.available;
+}
+
+cl_mem opencl_buffer_new( size_t size, const void *data )
+{
+	cl_int error = CL_SUCCESS;
+	cl_mem buffer = clCreateBuffer( backend.context, data ? CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR : CL_MEM_READ_WRITE,
+		size, (void*) data, &error );
+
+	if ( error != CL_SUCCESS )
+	{
+		mlt_log_error( NULL, "[opencl] failed to allocate a buffer of %zu bytes (error %d)\n", size, error );
+		buffer = NULL;
+	}
+	return buffer;
+}
+
+void opencl_buffer_close( void *buffer )
+{
+	if ( buffer )
+		clReleaseMemObject( (cl_mem) buffer );
+}
+
+opencl_surface opencl_surface_new( int width, int height, int alpha )
+{
+	opencl_surface surface = calloc( 1, sizeof( *surface ) );
+	cl_int error = CL_SUCCESS;
+
+	if ( !surface )
+		return NULL;
+	surface->width = width;
+	surface->height = height;
+	surface->image = clCreateBuffer( backend.context, CL_MEM_READ_WRITE, (size_t) width * height * 2, NULL, &error );
+	if ( error == CL_SUCCESS && alpha )
+		surface->alpha = clCreateBuffer( backend.context, CL_MEM_READ_WRITE, (size_t) width * height, NULL, &error );
+	if ( error != CL_SUCCESS )
+	{
+		mlt_log_error( NULL, "[opencl] failed to allocate a %dx%d surface (error %d)\n", width, height, error );
+		opencl_surface_close( surface );
+		surface = NULL;
+	}
+	return surface;
+}
+
+/** Give an opaque surface an alpha plane of a constant value.
+ * \return true on error
+ */
+
+int opencl_surface_add_alpha( opencl_surface surface, uint8_t value )
+{
+	size_t size = (size_t) surface->width * surface->height;
+	cl_int error = CL_SUCCESS;
+
+	if ( surface->alpha )
+		return 0;
+	surface->alpha = clCreateBuffer( backend.context, CL_MEM_READ_WRITE, size, NULL, &error );
+	if ( error == CL_SUCCESS )
+		error = clEnqueueFillBuffer( backend.queue, surface->alpha, &value, 1, 0, size, 0, NULL, NULL );
+	return error != CL_SUCCESS;
+}
+
+// The device releases the buffers once the queued kernels are done with them.
+void opencl_surface_close( void *surface )
+{
+	opencl_surface self = surface;
+
+	if ( self )
+	{
+		if ( self->image )
+			clReleaseMemObject( self->image );
+		if ( self->alpha )
+			clReleaseMemObject( self->alpha );
+		free( self );
+	}
+}
+
+cl_kernel opencl_kernel( const char *name )
+{
+	cl_int error = CL_SUCCESS;
+	cl_kernel kernel = clCreateKernel( backend.program, name, &error );
+
+	if ( error != CL_SUCCESS )
+	{
+		mlt_log_error( NULL, "[opencl] failed to create the %s kernel (error %d)\n", name, error );
+		kernel = NULL;
+	}
+	return kernel;
+}
+
+/** Queue a kernel, which is released whether or not that worked.
+ * \return true on error
+ */
+
+int opencl_enqueue( cl_kernel kernel, int width, int height )
+{
+	size_t global[2] = { width, height };
+	cl_int error = CL_INVALID_KERNEL;
+
+	if ( kernel )
+	{
+		error = clEnqueueNDRangeKernel( backend.queue, kernel, height > 1 ? 2 : 1, NULL, global, NULL, 0, NULL, NULL );
+		if ( error != CL_SUCCESS )
+			mlt_log_error( NULL, "[opencl] failed to queue a kernel (error %d)\n", error );
+		clReleaseKernel( kernel );
+	}
+	return error != CL_SUCCESS;
+}
+
+opencl_surface opencl_surface_scale( opencl_surface surface, int width, int height, int nearest )
+{
+	opencl_surface scaled = opencl_surface_new( width, height, surface->alpha != NULL );
+	cl_kernel kernel;
+	int error;
+
+	if ( !scaled )
+		return NULL;
+	if ( ( kernel = opencl_kernel( "rescale" ) ) )
+	{
+		opencl_arg( kernel, 0, surface->image );
+		opencl_arg( kernel, 1, surface->width );
+		opencl_arg( kernel, 2, surface->height );
+		opencl_arg( kernel, 3, scaled->image );
+		opencl_arg( kernel, 4, width );
+		opencl_arg( kernel, 5, height );
+		opencl_arg( kernel, 6, nearest );
+	}
+	error = opencl_enqueue( kernel, width, height );
+	if ( !error && surface->alpha )
+	{
+		if ( ( kernel = opencl_kernel( "rescale_alpha" ) ) )
+		{
+			opencl_arg( kernel, 0, surface->alpha );
+			opencl_arg( kernel, 1, surface->width );
+			opencl_arg( kernel, 2, surface->height );
+			opencl_arg( kernel, 3, scaled->alpha );
+			opencl_arg( kernel, 4, width );
+			opencl_arg( kernel, 5, height );
+			opencl_arg( kernel, 6, nearest );
+		}
+		error = opencl_enqueue( kernel, width, height );
+	}
+	if ( error )
+	{
+		opencl_surface_close( scaled );
+		scaled = NULL;
+	}
+	return scaled;
+}
+
+static int is_surface( mlt_frame frame, mlt_image_format format )
+{
+	const char *type = mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "hwsurface.type" );
+	return format == mlt_image_hwsurface && type && !strcmp( type, OPENCL_SURFACE_TYPE );
+}
+
+static void set_surface( mlt_frame frame, opencl_surface surface )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+
+	mlt_frame_set_image( frame, (uint8_t*) surface, mlt_image_format_size( mlt_image_hwsurface, 0, 0, NULL ),
+		opencl_surface_close );
+	mlt_frame_set_alpha( frame, NULL, 0, NULL );
+	mlt_properties_set_int( properties, "format", mlt_image_hwsurface );
+	mlt_properties_set_int( properties, "width", surface->width );
+	mlt_properties_set_int( properties, "height", surface->height );
+	mlt_properties_set( properties, "hwsurface.type", OPENCL_SURFACE_TYPE );
+	mlt_properties_set( properties, "hwsurface.sw_format", "yuv422" );
+}
+
+// Convert with the converter the frame had before the first OpenCL service.
+static int convert_on_cpu( mlt_frame frame, uint8_t **image, mlt_image_format *format, mlt_image_format output_format )
+{
+	convert_image_fn convert = (convert_image_fn) mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ),
+		"_opencl.convert_image", NULL );
+	return convert ? convert( frame, image, format, output_format ) : 1;
+}
+
+// Download a surface as yuv422 and alpha, or convert it to RGB on the device first.
+static int download( mlt_frame frame, uint8_t **image, mlt_image_format *format, mlt_image_format output_format )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	opencl_surface surface = (opencl_surface) *image;
+	int width = surface->width;
+	int height = surface->height;
+	int bpp = 0;
+	int size;
+	uint8_t *output;
+	uint8_t *alpha = NULL;
+	int error = 0;
+
+	if ( output_format != mlt_image_rgb24 && output_format != mlt_image_rgb24a )
+		output_format = mlt_image_yuv422;
+	size = mlt_image_format_size( output_format, width, height, &bpp );
+	if ( !( output = mlt_pool_alloc( size ) ) )
+		return 1;
+
+	if ( output_format == mlt_image_yuv422 )
+	{
+		error = clEnqueueReadBuffer( backend.queue, surface->image, CL_TRUE, 0, (size_t) width * height * 2,
+			output, 0, NULL, NULL ) != CL_SUCCESS;
+	}
+	else
+	{
+		cl_int status = CL_SUCCESS;
+		cl_mem rgb = clCreateBuffer( backend.context, CL_MEM_WRITE_ONLY, (size_t) width * height * bpp, NULL, &status );
+
+		error = status != CL_SUCCESS;
+		if ( !error )
+		{
+			cl_kernel kernel = opencl_kernel( "yuv422_to_rgb" );
+			if ( kernel )
+			{
+				opencl_arg( kernel, 0, surface->image );
+				opencl_arg( kernel, 1, surface->alpha );
+				opencl_arg( kernel, 2, rgb );
+				opencl_arg( kernel, 3, bpp );
+				opencl_arg( kernel, 4, width );
+				opencl_arg( kernel, 5, height );
+			}
+			error = opencl_enqueue( kernel, width, height );
+		}
+		if ( !error )
+			error = clEnqueueReadBuffer( backend.queue, rgb, CL_TRUE, 0, (size_t) width * height * bpp,
+				output, 0, NULL, NULL ) != CL_SUCCESS;
+		if ( rgb )
+			clReleaseMemObject( rgb );
+	}
+	if ( !error && surface->alpha && output_format != mlt_image_rgb24a )
+	{
+		alpha = mlt_pool_alloc( width * height );
+		error = !alpha || clEnqueueReadBuffer( backend.queue, surface->alpha, CL_TRUE, 0, (size_t) width * height,
+			alpha, 0, NULL, NULL ) != CL_SUCCESS;
+	}
+	if ( error )
+	{
+		mlt_log_error( NULL, "[opencl] failed to download a %dx%d surface\n", width, height );
+		mlt_pool_release( output );
+		mlt_pool_release( alpha );
+		return 1;
+	}
+
+	// This releases the surface
+	mlt_frame_set_image( frame, output, size, mlt_pool_release );
+	if ( alpha )
+		mlt_frame_set_alpha( frame, alpha, width * height, mlt_pool_release );
+	mlt_properties_set_int( properties, "format", output_format );
+	*image = output;
+	*format = output_format;
+	return 0;
+}
+
+// Upload a yuv422 image and its alpha, or an RGB one to convert on the device.
+static int upload( mlt_frame frame, uint8_t **image, mlt_image_format *format )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int width = mlt_properties_get_int( properties, "width" );
+	int height = mlt_properties_get_int( properties, "height" );
+	uint8_t *alpha = *format == mlt_image_yuv422 ? mlt_frame_get_alpha( frame ) : NULL;
+	int alpha_size = 0;
+	opencl_surface surface;
+	int error = 0;
+
+	mlt_properties_get_data( properties, "alpha", &alpha_size );
+	if ( alpha_size > 0 && alpha_size < width * height )
+		alpha = NULL;
+	if ( !( surface = opencl_surface_new( width, height, alpha || *format == mlt_image_rgb24a ) ) )
+		return 1;
+
+	if ( *format == mlt_image_yuv422 )
+	{
+		error = clEnqueueWriteBuffer( backend.queue, surface->image, CL_TRUE, 0, (size_t) width * height * 2,
+			*image, 0, NULL, NULL ) != CL_SUCCESS;
+		if ( !error && alpha )
+			error = clEnqueueWriteBuffer( backend.queue, surface->alpha, CL_TRUE, 0, (size_t) width * height,
+				alpha, 0, NULL, NULL ) != CL_SUCCESS;
+	}
+	else
+	{
+		int channels = *format == mlt_image_rgb24a ? 4 : 3;
+		cl_int status = CL_SUCCESS;
+		cl_mem rgb = clCreateBuffer( backend.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			(size_t) width * height * channels, *image, &status );
+
+		error = status != CL_SUCCESS;
+		if ( !error )
+		{
+			cl_kernel kernel = opencl_kernel( "rgb_to_yuv422" );
+			if ( kernel )
+			{
+				opencl_arg( kernel, 0, rgb );
+				opencl_arg( kernel, 1, surface->image );
+				opencl_arg( kernel, 2, surface->alpha );
+				opencl_arg( kernel, 3, channels );
+				opencl_arg( kernel, 4, width );
+				opencl_arg( kernel, 5, height );
+			}
+			error = opencl_enqueue( kernel, ( width + 1 ) / 2, height );
+		}
+		if ( rgb )
+			clReleaseMemObject( rgb );
+	}
+	if ( error )
+	{
+		mlt_log_error( NULL, "[opencl] failed to upload a %dx%d %s image\n", width, height, mlt_image_format_name( *format ) );
+		opencl_surface_close( surface );
+		return 1;
+	}
+
+	set_surface( frame, surface );
+	*image = (uint8_t*) surface;
+	*format = mlt_image_hwsurface;
+	return 0;
+}
+
+/** The image converter of a frame that OpenCL services process.
+ *
+ * It downloads a surface for the services that want it in memory, and it
+ * uploads an image only for an OpenCL service, which a consumer asking for
+ * the surface of its own hardware encoder is not. Everything else is left to
+ * the converter the frame had.
+ */
+
+static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, mlt_image_format output_format )
+{
+	int error = 0;
+
+	if ( is_surface( frame, *format ) )
+	{
+		if ( output_format == mlt_image_hwsurface || output_format == mlt_image_none )
+			return 0;
+		error = download( frame, image, format, output_format );
+		if ( !error && *format != output_format )
+			error = convert_on_cpu( frame, image, format, output_format );
+		return error;
+	}
+	if ( output_format == mlt_image_hwsurface && opencl_available()
+		 && mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "_opencl.request" ) )
+	{
+		// Bring a software image or the surface of another device over
+		if ( *format != mlt_image_yuv422 && *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
+			error = convert_on_cpu( frame, image, format, mlt_image_yuv422 );
+		if ( !error && *format != mlt_image_yuv422 && *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
+			error = 1;
+		return error ? error : upload( frame, image, format );
+	}
+	return convert_on_cpu( frame, image, format, output_format );
+}
+
+/** Let a frame carry surfaces between the services, which each OpenCL
+ * service does for the frames it gets.
+ */
+
+void opencl_frame_prepare( mlt_frame frame )
+{
+	if ( frame->convert_image != convert_image )
+	{
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "_opencl.convert_image",
+			(void*) frame->convert_image, 0, NULL, NULL );
+		frame->convert_image = convert_image;
+	}
+}
+
+/** Tell whether the image that a get_image is asked for stays on the device.
+ *
+ * That is when an OpenCL service asks for it, and every OpenCL service calls
+ * this on the way in to take the request.
+ */
+
+int opencl_frame_resident( mlt_frame frame, mlt_image_format format )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int resident = format == mlt_image_hwsurface && mlt_properties_get_int( properties, "_opencl.request" );
+
+	mlt_properties_set_int( properties, "_opencl.request", 0 );
+	return resident;
+}
+
+/** Get the image of a frame as a surface, uploading it if the service
+ * before was not an OpenCL one.
+ * \return true on error
+ */
+
+int opencl_frame_get_image( mlt_frame frame, opencl_surface *surface, int *width, int *height )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	mlt_image_format format = mlt_image_hwsurface;
+	uint8_t *image = NULL;
+	int error;
+
+	mlt_properties_set_int( properties, "_opencl.request", 1 );
+	error = mlt_frame_get_image( frame, &image, &format, width, height, 0 );
+
+	// A service in between may have taken the request
+	if ( !error && !is_surface( frame, format ) )
+	{
+		mlt_properties_set_int( properties, "_opencl.request", 1 );
+		error = convert_image( frame, &image, &format, mlt_image_hwsurface );
+	}
+	mlt_properties_set_int( properties, "_opencl.request", 0 );
+	*surface = error ? NULL : (opencl_surface) image;
+	return error || !*surface;
+}
+
+/** Put the surface a service made on a frame, and download it unless the
+ * get_image was resident.
+ * \return true on error
+ */
+
+int opencl_frame_put_image( mlt_frame frame, opencl_surface surface, uint8_t **image, mlt_image_format *format,
+	mlt_image_format requested, int resident )
+{
+	if ( mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), "image", NULL ) != surface )
+		set_surface( frame, surface );
+	*image = (uint8_t*) surface;
+	*format = mlt_image_hwsurface;
+	return resident ? 0 : download( frame, image, format, requested );
+}
+
+/** Copy the public properties of an OpenCL service onto its CPU fallback. */
+
+void opencl_pass_properties( mlt_properties dest, mlt_properties src )
+{
+	int i, count = mlt_properties_count( src );
+
+	for ( i = 0; i < count; i++ )
+	{
+		const char *name = mlt_properties_get_name( src, i );
+		const char *value = mlt_properties_get_value( src, i );
+		const char *current;
+
+		if ( !name || !value || name[0] == '_' || !strncmp( name, "mlt_", 4 ) )
+			continue;
+		current = mlt_properties_get( dest, name );
+		if ( !current || strcmp( current, value ) )
+			mlt_properties_set( dest, name, value );
+	}
+}
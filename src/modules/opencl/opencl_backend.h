@@ -0,0 +1,87 @@
+/*
+ * opencl_backend.h -- OpenCL compute backend for image services
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef OPENCL_BACKEND_H
+#define OPENCL_BACKEND_H
+
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <framework/mlt.h>
+
+/** The value of the hwsurface.type frame property of an image on the device. */
+#define OPENCL_SURFACE_TYPE "opencl"
+
+/** An image resident on the device.
+ *
+ * It is the data of an mlt_image_hwsurface image, a packed yuv422 buffer
+ * and an optional alpha plane, so that a chain of OpenCL services passes
+ * it along without downloading it in between.
+ */
+
+typedef struct opencl_surface_s
+{
+	cl_mem image;   ///< width * height * 2 bytes of yuv422
+	cl_mem alpha;   ///< width * height bytes, or NULL when opaque
+	int width;
+	int height;
+}
+*opencl_surface;
+
+/** Set up the device the first time and tell whether it can be used.
+ *
+ * The first GPU device of the platforms is preferred over the others,
+ * and setting MLT_OPENCL=0 in the environment disables the backend.
+ */
+
+extern int opencl_available( void );
+
+/** Create a buffer on the device, copying size bytes of data into it if that is set. */
+extern cl_mem opencl_buffer_new( size_t size, const void *data );
+extern void opencl_buffer_close( void *buffer );
+
+extern opencl_surface opencl_surface_new( int width, int height, int alpha );
+extern int opencl_surface_add_alpha( opencl_surface surface, uint8_t value );
+extern void opencl_surface_close( void *surface );
+
+/** Create an instance of a kernel of the program, to set the arguments of. */
+extern cl_kernel opencl_kernel( const char *name );
+
+/** Set an argument of a kernel from an lvalue, including a NULL cl_mem. */
+#define opencl_arg( kernel, index, value ) clSetKernelArg( ( kernel ), ( index ), sizeof( value ), &( value ) )
+
+/** Queue a kernel over width by height work items and release it. */
+extern int opencl_enqueue( cl_kernel kernel, int width, int height );
+
+/** Scale the yuv422 buffer and the alpha of a surface into a new surface. */
+extern opencl_surface opencl_surface_scale( opencl_surface surface, int width, int height, int nearest );
+
+extern void opencl_frame_prepare( mlt_frame frame );
+extern int opencl_frame_resident( mlt_frame frame, mlt_image_format format );
+extern int opencl_frame_get_image( mlt_frame frame, opencl_surface *surface, int *width, int *height );
+extern int opencl_frame_put_image( mlt_frame frame, opencl_surface surface, uint8_t **image, mlt_image_format *format,
+	mlt_image_format requested, int resident );
+
+extern void opencl_pass_properties( mlt_properties dest, mlt_properties src );
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * opencl_kernels.h -- the OpenCL C program of the opencl services
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef OPENCL_KERNELS_H
+#define OPENCL_KERNELS_H
+
+// The program is compiled by the driver, so it is kept as a string.
+#define OPENCL_SOURCE( ... ) #__VA_ARGS__
+
+/* The images are packed yuv422 of width * height pixels and the alpha planes
+ * width * height bytes. The conversions use the 601 integer arithmetic of
+ * mlt_frame.h, and the work items of a kernel past the edges of its image
+ * return at once, so that the global size is free to be rounded up.
+ */
+
+static const char opencl_kernels_source[] = OPENCL_SOURCE(
+
+kernel void yuv422_to_rgb( global const uchar *yuv, global const uchar *alpha, global uchar *rgb,
+	int channels, int width, int height )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	int i = y * width + x;
+	global const uchar *p = yuv + ( y * width + ( x & ~1 ) ) * 2;
+	int l = 1192 * ( yuv[ i * 2 ] - 16 );
+	int u = p[1] - 128;
+	int v = p[3] - 128;
+	global uchar *q = rgb + i * channels;
+	q[0] = clamp( ( l + 1634 * v ) >> 10, 0, 255 );
+	q[1] = clamp( ( l - 832 * v - 401 * u ) >> 10, 0, 255 );
+	q[2] = clamp( ( l + 2066 * u ) >> 10, 0, 255 );
+	if ( channels == 4 )
+		q[3] = alpha ? alpha[i] : 255;
+}
+
+kernel void rgb_to_yuv422( global const uchar *rgb, global uchar *yuv, global uchar *alpha,
+	int channels, int width, int height )
+{
+	int x = get_global_id( 0 ) * 2;
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	int i = y * width + x;
+	int odd = x + 1 < width;
+	global const uchar *p = rgb + i * channels;
+	global const uchar *q = p + odd * channels;
+	int r = ( p[0] + q[0] ) >> 1;
+	int g = ( p[1] + q[1] ) >> 1;
+	int b = ( p[2] + q[2] ) >> 1;
+	yuv[ i * 2 ] = ( ( 263 * p[0] + 516 * p[1] + 100 * p[2] ) >> 10 ) + 16;
+	yuv[ i * 2 + 1 ] = ( ( -152 * r - 300 * g + 450 * b ) >> 10 ) + 128;
+	if ( alpha && channels == 4 )
+		alpha[i] = p[3];
+	if ( odd )
+	{
+		yuv[ i * 2 + 2 ] = ( ( 263 * q[0] + 516 * q[1] + 100 * q[2] ) >> 10 ) + 16;
+		yuv[ i * 2 + 3 ] = ( ( 450 * r - 377 * g - 73 * b ) >> 10 ) + 128;
+		if ( alpha && channels == 4 )
+			alpha[ i + 1 ] = q[3];
+	}
+}
+
+kernel void brightness( global uchar *yuv, int m, int n, int count )
+{
+	int i = get_global_id( 0 );
+	if ( i >= count )
+		return;
+	yuv[ i * 2 ] = clamp( ( yuv[ i * 2 ] * m ) >> 16, 16, 235 );
+	yuv[ i * 2 + 1 ] = clamp( ( yuv[ i * 2 + 1 ] * m + n ) >> 16, 16, 240 );
+}
+
+kernel void scale_alpha( global uchar *alpha, int m, int count )
+{
+	int i = get_global_id( 0 );
+	if ( i < count )
+		alpha[i] = ( alpha[i] * m ) >> 16;
+}
+
+int key_value( int u, int v, int key_u, int key_v, int variance, int softness, int ramp )
+{
+	int du = u > key_u ? u - key_u : key_u - u;
+	int dv = v > key_v ? v - key_v : key_v - v;
+	int d = clamp( max( du, dv ) - variance, 0, softness );
+	return ( d * ramp + 255 ) >> 8;
+}
+
+kernel void chroma_key( global const uchar *yuv, global uchar *alpha, int key_u, int key_v,
+	int variance, int softness, int ramp, int width, int height )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	global const uchar *p = yuv + ( y * width + ( x & ~1 ) ) * 2;
+	int key;
+	if ( !( x & 1 ) )
+		key = key_value( p[1], x + 1 < width ? p[3] : p[-1], key_u, key_v, variance, softness, ramp );
+	else if ( x + 2 < width )
+		key = key_value( ( p[1] + p[5] ) / 2, ( p[3] + p[7] ) / 2, key_u, key_v, variance, softness, ramp );
+	else
+		key = key_value( p[1], p[3], key_u, key_v, variance, softness, ramp );
+	int i = y * width + x;
+	alpha[i] = ( alpha[i] * key + 255 ) >> 8;
+}
+
+float bilinear( global const uchar *p, int stride, int step, int width, int height, float x, float y )
+{
+	x = clamp( x, 0.0f, (float) ( width - 1 ) );
+	y = clamp( y, 0.0f, (float) ( height - 1 ) );
+	int x0 = (int) x;
+	int y0 = (int) y;
+	int x1 = min( x0 + 1, width - 1 );
+	int y1 = min( y0 + 1, height - 1 );
+	float top = mix( (float) p[ y0 * stride + x0 * step ], (float) p[ y0 * stride + x1 * step ], x - x0 );
+	float bottom = mix( (float) p[ y1 * stride + x0 * step ], (float) p[ y1 * stride + x1 * step ], x - x0 );
+	return mix( top, bottom, y - y0 );
+}
+
+float source_position( int x, int from, int to, int nearest )
+{
+	float scale = (float) from / to;
+	return nearest ? floor( ( x + 0.5f ) * scale ) : ( x + 0.5f ) * scale - 0.5f;
+}
+
+kernel void rescale( global const uchar *src, int src_width, int src_height,
+	global uchar *dst, int width, int height, int nearest )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	int pairs = ( src_width + 1 ) / 2;
+	float sx = source_position( x, src_width, width, nearest );
+	float sy = source_position( y, src_height, height, nearest );
+	float cx = source_position( x >> 1, pairs, ( width + 1 ) / 2, nearest );
+	global uchar *q = dst + ( y * width + x ) * 2;
+
+	// An even pixel carries the U and an odd one the V of its pair
+	q[0] = convert_uchar_sat_rte( bilinear( src, src_width * 2, 2, src_width, src_height, sx, sy ) );
+	q[1] = convert_uchar_sat_rte( bilinear( src + ( x & 1 ? 3 : 1 ), src_width * 2, 4, pairs, src_height, cx, sy ) );
+}
+
+kernel void rescale_alpha( global const uchar *src, int src_width, int src_height,
+	global uchar *dst, int width, int height, int nearest )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	float sx = source_position( x, src_width, width, nearest );
+	float sy = source_position( y, src_height, height, nearest );
+	dst[ y * width + x ] = convert_uchar_sat_rte( bilinear( src, src_width, 1, src_width, src_height, sx, sy ) );
+}
+
+kernel void resize( global const uchar *src, global const uchar *src_alpha, int src_width, int src_height,
+	global uchar *dst, global uchar *alpha, int width, int height, int left, int top, int alpha_value )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	int sx = x - left;
+	int sy = y - top;
+	int i = y * width + x;
+	if ( sx >= 0 && sx < src_width && sy >= 0 && sy < src_height )
+	{
+		int j = sy * src_width + sx;
+		dst[ i * 2 ] = src[ j * 2 ];
+		dst[ i * 2 + 1 ] = src[ j * 2 + 1 ];
+		if ( alpha )
+			alpha[i] = src_alpha[j];
+	}
+	else
+	{
+		dst[ i * 2 ] = 16;
+		dst[ i * 2 + 1 ] = 128;
+		if ( alpha )
+			alpha[i] = alpha_value;
+	}
+}
+
+kernel void dissolve( global uchar *dst, global uchar *dst_alpha, global const uchar *src,
+	global const uchar *src_alpha, float weight, int count )
+{
+	int i = get_global_id( 0 );
+	if ( i >= count )
+		return;
+	dst[ i * 2 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 ], (float) src[ i * 2 ], weight ) );
+	dst[ i * 2 + 1 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 + 1 ], (float) src[ i * 2 + 1 ], weight ) );
+	if ( dst_alpha )
+		dst_alpha[i] = convert_uchar_sat_rte( mix( (float) dst_alpha[i], src_alpha ? (float) src_alpha[i] : 255.0f, weight ) );
+}
+
+float smoothstep_position( float edge1, float edge2, float a )
+{
+	if ( a < edge1 )
+		return 0.0f;
+	if ( a >= edge2 )
+		return 1.0f;
+	a = ( a - edge1 ) / ( edge2 - edge1 );
+	return a * a * ( 3.0f - 2.0f * a );
+}
+
+kernel void luma_wipe( global uchar *dst, global uchar *dst_alpha, global const uchar *src,
+	global const uchar *src_alpha, global const ushort *luma, int luma_width, int luma_height,
+	float top_position, float bottom_position, float softness, int invert, int width, int height )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= width || y >= height )
+		return;
+	int i = y * width + x;
+	float position = y & 1 ? bottom_position : top_position;
+	float weight = luma[ ( y * luma_height / height ) * luma_width + x * luma_width / width ] / 65536.0f;
+	float value = smoothstep_position( weight, weight + softness, position );
+	if ( invert )
+		value = 1.0f - value;
+	dst[ i * 2 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 ], (float) src[ i * 2 ], value ) );
+	dst[ i * 2 + 1 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 + 1 ], (float) src[ i * 2 + 1 ], value ) );
+	if ( dst_alpha )
+		dst_alpha[i] = convert_uchar_sat_rte( mix( (float) dst_alpha[i], src_alpha ? (float) src_alpha[i] : 255.0f, value ) );
+}
+
+kernel void composite_over( global uchar *dst, global uchar *dst_alpha, int width, int height,
+	global const uchar *src, global const uchar *src_alpha, int src_width, int src_height,
+	int left, int top, float opacity )
+{
+	int x = get_global_id( 0 );
+	int y = get_global_id( 1 );
+	if ( x >= src_width || y >= src_height || x + left < 0 || x + left >= width || y + top < 0 || y + top >= height )
+		return;
+	int i = ( y + top ) * width + x + left;
+	int j = y * src_width + x;
+	float a = opacity * ( src_alpha ? src_alpha[j] / 255.0f : 1.0f );
+	dst[ i * 2 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 ], (float) src[ j * 2 ], a ) );
+	dst[ i * 2 + 1 ] = convert_uchar_sat_rte( mix( (float) dst[ i * 2 + 1 ], (float) src[ j * 2 + 1 ], a ) );
+	if ( dst_alpha )
+		dst_alpha[i] = convert_uchar_sat_rte( 255.0f * a + dst_alpha[i] * ( 1.0f - a ) );
+}
+
+);
+
+#endif
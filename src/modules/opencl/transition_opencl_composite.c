@@ -0,0 +1,207 @@
+/*
+ * transition_opencl_composite.c -- a compositor on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int alignment_parse( char *align )
+{
+	int ret = 0;
+
+	if ( align == NULL );
+	else if ( isdigit( align[0] ) )
+		ret = atoi( align );
+	else if ( align[0] == 'c' || align[0] == 'm' )
+		ret = 1;
+	else if ( align[0] == 'r' || align[0] == 'b' )
+		ret = 2;
+
+	return ret;
+}
+
+/** Put the b frame over the a frame in the geometry.
+ *
+ * The b frame is scaled to fit in the rectangle of the geometry, keeping its
+ * display aspect unless distort is set, and aligned by halign and valign.
+ */
+
+static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_frame b_frame = mlt_frame_pop_frame( a_frame );
+	mlt_transition transition = mlt_frame_pop_service( a_frame );
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
+	mlt_profile profile = mlt_service_profile( MLT_TRANSITION_SERVICE( transition ) );
+	mlt_position position = mlt_transition_get_position( transition, a_frame );
+	mlt_position length = mlt_transition_get_length( transition );
+	double consumer_ar = mlt_profile_sar( profile );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( a_frame, requested );
+	opencl_surface a = NULL, b = NULL, scaled = NULL;
+	char *geometry;
+	mlt_rect rect;
+	int b_width, b_height;
+	cl_int left, top;
+	int error;
+
+	if ( *width == 0 || *height == 0 )
+	{
+		*width = profile->width;
+		*height = profile->height;
+	}
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( transition ) );
+	rect = mlt_properties_anim_get_rect( properties, "geometry", position, length );
+	geometry = mlt_properties_get( properties, "geometry" );
+	if ( geometry && strchr( geometry, '%' ) )
+	{
+		rect.x *= profile->width;
+		rect.y *= profile->height;
+		rect.w *= profile->width;
+		rect.h *= profile->height;
+	}
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+
+	// The mix of the geometry of the composite transition is a percentage
+	rect.o = rect.o == DBL_MIN ? 1.0 : rect.o > 1.0 ? MIN( rect.o / 100.0, 1.0 ) : rect.o;
+
+	// Scale the geometry of the profile to the size asked for
+	rect.x *= (double) *width / profile->width;
+	rect.w *= (double) *width / profile->width;
+	rect.y *= (double) *height / profile->height;
+	rect.h *= (double) *height / profile->height;
+	b_width = rint( rect.w );
+	b_height = rint( rect.h );
+
+	if ( !mlt_properties_get_int( properties, "distort" ) && !mlt_properties_get_int( b_props, "distort" ) )
+	{
+		double b_ar = mlt_frame_get_aspect_ratio( b_frame );
+		int real_width = mlt_properties_get_int( b_props, "meta.media.width" );
+		int real_height = mlt_properties_get_int( b_props, "meta.media.height" );
+
+		if ( real_width == 0 || real_height == 0 )
+		{
+			real_width = mlt_properties_get_int( b_props, "width" );
+			real_height = mlt_properties_get_int( b_props, "height" );
+		}
+		if ( b_ar == 0.0 )
+			b_ar = consumer_ar;
+		if ( real_width > 0 && real_height > 0 && rect.w > 0 && rect.h > 0 )
+		{
+			double b_dar = b_ar * real_width / real_height;
+			if ( b_dar > consumer_ar * rect.w / rect.h )
+				b_height = rint( rect.w * consumer_ar / b_dar );
+			else
+				b_width = rint( rect.h * b_dar / consumer_ar );
+		}
+	}
+	b_width -= b_width % 2;
+	left = rint( rect.x + ( rect.w - b_width ) * alignment_parse( mlt_properties_get( properties, "halign" ) ) / 2 );
+	top = rint( rect.y + ( rect.h - b_height ) * alignment_parse( mlt_properties_get( properties, "valign" ) ) / 2 );
+	left -= left % 2;
+
+	error = opencl_frame_get_image( a_frame, &a, width, height );
+	if ( error )
+		return error;
+
+	if ( b_width > 0 && b_height > 0 && rect.o > 0.0 )
+	{
+		int w = b_width;
+		int h = b_height;
+
+		// The image of b is already fitted to the geometry
+		mlt_properties_set_int( b_props, "distort", 1 );
+		error = opencl_frame_get_image( b_frame, &b, &w, &h );
+		if ( !error && ( b->width != b_width || b->height != b_height ) )
+			error = !( b = scaled = opencl_surface_scale( b, b_width, b_height, 0 ) );
+		if ( !error )
+		{
+			cl_float opacity = rect.o;
+			cl_kernel kernel = opencl_kernel( "composite_over" );
+
+			if ( kernel )
+			{
+				opencl_arg( kernel, 0, a->image );
+				opencl_arg( kernel, 1, a->alpha );
+				opencl_arg( kernel, 2, a->width );
+				opencl_arg( kernel, 3, a->height );
+				opencl_arg( kernel, 4, b->image );
+				opencl_arg( kernel, 5, b->alpha );
+				opencl_arg( kernel, 6, b->width );
+				opencl_arg( kernel, 7, b->height );
+				opencl_arg( kernel, 8, left );
+				opencl_arg( kernel, 9, top );
+				opencl_arg( kernel, 10, opacity );
+			}
+			error = opencl_enqueue( kernel, b->width, b->height );
+		}
+		opencl_surface_close( scaled );
+	}
+
+	return opencl_frame_put_image( a_frame, a, image, format, requested, resident ) || error;
+}
+
+static mlt_frame transition_process( mlt_transition transition, mlt_frame a_frame, mlt_frame b_frame )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	char *operator = mlt_properties_get( properties, "operator" );
+	mlt_transition cpu = mlt_properties_get_data( properties, "_cpu", NULL );
+
+	// Leave the wipes, the other operators, the cropping and the filling to the composite transition
+	if ( cpu && ( mlt_properties_get( properties, "luma" ) || mlt_properties_get( properties, "crop" )
+		 || mlt_properties_get_int( properties, "crop_to_fill" ) || mlt_properties_get_int( properties, "fill" )
+		 || ( operator && strcmp( operator, "over" ) ) ) )
+	{
+		opencl_pass_properties( MLT_TRANSITION_PROPERTIES( cpu ), properties );
+		return mlt_transition_process( cpu, a_frame, b_frame );
+	}
+
+	opencl_frame_prepare( a_frame );
+	opencl_frame_prepare( b_frame );
+	mlt_frame_push_service( a_frame, transition );
+	mlt_frame_push_frame( a_frame, b_frame );
+	mlt_frame_push_get_image( a_frame, transition_get_image );
+	return a_frame;
+}
+
+mlt_transition transition_opencl_composite_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_transition transition;
+
+	if ( !opencl_available() )
+		return mlt_factory_transition( profile, "composite", arg );
+
+	if ( ( transition = mlt_transition_new() ) )
+	{
+		mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+		mlt_transition cpu = mlt_factory_transition( profile, "composite", arg );
+
+		transition->process = transition_process;
+		mlt_properties_set( properties, "geometry", arg != NULL ? arg : "0/0:100%x100%" );
+		mlt_properties_set_int( properties, "_transition_type", 1 );
+		if ( cpu )
+			mlt_properties_set_data( properties, "_cpu", cpu, 0, (mlt_destructor) mlt_transition_close, NULL );
+	}
+	return transition;
+}
@@ -0,0 +1,234 @@
+/*
+ * transition_opencl_luma.c -- dissolve and luma wipe on the OpenCL device
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "opencl_backend.h"
+
+#include <math.h>
+#include <string.h>
+
+/** Load the luma map of the resource through a producer, as the luma
+ * transition does for a file that is not a PGM, and keep it on the device.
+ * Called with the service locked, and the caller releases the map.
+ */
+
+static cl_mem get_luma_map( mlt_transition transition, int *width, int *height )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	char *resource = mlt_properties_get( properties, "resource" );
+	char *current = mlt_properties_get( properties, "_resource" );
+	cl_mem map;
+
+	if ( !resource || !*resource )
+		return NULL;
+
+	if ( !current || strcmp( resource, current ) )
+	{
+		mlt_profile profile = mlt_service_profile( MLT_TRANSITION_SERVICE( transition ) );
+		mlt_producer producer = mlt_factory_producer( profile, mlt_properties_get( properties, "factory" ), resource );
+		mlt_frame luma_frame = NULL;
+
+		// Do not try again for every frame
+		mlt_properties_set( properties, "_resource", resource );
+		mlt_properties_set_data( properties, "_luma.map", NULL, 0, NULL, NULL );
+
+		if ( producer && mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &luma_frame, 0 ) == 0 )
+		{
+			uint8_t *luma_image = NULL;
+			mlt_image_format luma_format = mlt_image_yuv422;
+			int luma_width = 0;
+			int luma_height = 0;
+
+			mlt_properties_set( MLT_FRAME_PROPERTIES( luma_frame ), "rescale.interp", "nearest" );
+			if ( !mlt_frame_get_image( luma_frame, &luma_image, &luma_format, &luma_width, &luma_height, 0 )
+				 && luma_image && luma_format == mlt_image_yuv422 )
+			{
+				int i, count = luma_width * luma_height;
+				uint16_t *bitmap = mlt_pool_alloc( count * sizeof( uint16_t ) );
+
+				if ( bitmap )
+				{
+					for ( i = 0; i < count; i++ )
+						bitmap[i] = CLAMP( luma_image[ i * 2 ] - 16, 0, 219 ) * 299; // 299 = 65535 / 219
+					map = opencl_buffer_new( count * sizeof( uint16_t ), bitmap );
+					mlt_pool_release( bitmap );
+					mlt_properties_set_data( properties, "_luma.map", map, 0, opencl_buffer_close, NULL );
+					mlt_properties_set_int( properties, "_luma.width", luma_width );
+					mlt_properties_set_int( properties, "_luma.height", luma_height );
+				}
+			}
+			mlt_frame_close( luma_frame );
+		}
+		mlt_producer_close( producer );
+	}
+
+	if ( ( map = mlt_properties_get_data( properties, "_luma.map", NULL ) ) )
+	{
+		clRetainMemObject( map );
+		*width = mlt_properties_get_int( properties, "_luma.width" );
+		*height = mlt_properties_get_int( properties, "_luma.height" );
+	}
+	return map;
+}
+
+/** Mix the b frame into the a frame, by the luma map or evenly.
+ *
+ * Unlike the luma transition, the result is always on the surface of the
+ * a frame at its size, and invert swaps the share of the mix the frames get.
+ */
+
+static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_frame b_frame = mlt_frame_pop_frame( a_frame );
+	mlt_transition transition = mlt_frame_pop_service( a_frame );
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	mlt_properties a_props = MLT_FRAME_PROPERTIES( a_frame );
+	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
+	mlt_image_format requested = *format;
+	int resident = opencl_frame_resident( a_frame, requested );
+	opencl_surface a = NULL, b = NULL, scaled = NULL;
+	cl_int luma_width = 0, luma_height = 0;
+	cl_kernel kernel;
+	cl_mem map;
+	int error;
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( transition ) );
+	map = get_luma_map( transition, &luma_width, &luma_height );
+	float mix = mlt_transition_get_progress( transition, a_frame );
+	float frame_delta = mlt_transition_get_progress_delta( transition, a_frame );
+	float softness = mlt_properties_get_double( properties, "softness" );
+	int progressive =
+			mlt_properties_get_int( a_props, "consumer_deinterlace" ) ||
+			mlt_properties_get_int( properties, "progressive" ) ||
+			mlt_properties_get_int( b_props, "luma.progressive" );
+	int top_field_first = mlt_properties_get_int( b_props, "top_field_first" );
+	int reverse = mlt_properties_get_int( properties, "reverse" );
+	cl_int invert = mlt_properties_get_int( properties, "invert" );
+
+	if ( mix >= 1.0 )
+		mix -= floor( mix );
+	if ( mlt_properties_get( properties, "fixed" ) )
+		mix = mlt_properties_get_double( properties, "fixed" );
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+
+	error = opencl_frame_get_image( a_frame, &a, width, height );
+	if ( !error )
+	{
+		int b_width = *width;
+		int b_height = *height;
+		error = opencl_frame_get_image( b_frame, &b, &b_width, &b_height );
+	}
+	if ( !error && ( b->width != a->width || b->height != a->height ) )
+		error = !( b = scaled = opencl_surface_scale( b, a->width, a->height, 0 ) );
+	if ( !error && b->alpha )
+		error = opencl_surface_add_alpha( a, 255 );
+
+	if ( !error && map )
+	{
+		int field_order = progressive ? -1 : top_field_first;
+		cl_float top_position, bottom_position;
+
+		reverse = invert ? !reverse : reverse;
+		mix = reverse ? 1 - mix : mix;
+		frame_delta *= reverse ? -1.0 : 1.0;
+		top_position = ( mix + ( field_order == 0 ? 1 : 0 ) * frame_delta * 0.5f ) * ( 1.f + softness );
+		bottom_position = field_order < 0 ? top_position : ( mix + ( field_order == 0 ? 0 : 1 ) * frame_delta * 0.5f ) * ( 1.f + softness );
+		if ( ( kernel = opencl_kernel( "luma_wipe" ) ) )
+		{
+			opencl_arg( kernel, 0, a->image );
+			opencl_arg( kernel, 1, a->alpha );
+			opencl_arg( kernel, 2, b->image );
+			opencl_arg( kernel, 3, b->alpha );
+			opencl_arg( kernel, 4, map );
+			opencl_arg( kernel, 5, luma_width );
+			opencl_arg( kernel, 6, luma_height );
+			opencl_arg( kernel, 7, top_position );
+			opencl_arg( kernel, 8, bottom_position );
+			opencl_arg( kernel, 9, softness );
+			opencl_arg( kernel, 10, invert );
+			opencl_arg( kernel, 11, a->width );
+			opencl_arg( kernel, 12, a->height );
+		}
+		error = opencl_enqueue( kernel, a->width, a->height );
+	}
+	else if ( !error )
+	{
+		cl_float weight = ( reverse || invert ) ? 1 - mix : mix;
+		cl_int count = a->width * a->height;
+
+		if ( ( kernel = opencl_kernel( "dissolve" ) ) )
+		{
+			opencl_arg( kernel, 0, a->image );
+			opencl_arg( kernel, 1, a->alpha );
+			opencl_arg( kernel, 2, b->image );
+			opencl_arg( kernel, 3, b->alpha );
+			opencl_arg( kernel, 4, weight );
+			opencl_arg( kernel, 5, count );
+		}
+		error = opencl_enqueue( kernel, count, 1 );
+	}
+
+	opencl_buffer_close( map );
+	opencl_surface_close( scaled );
+	if ( !a )
+		return 1;
+	return opencl_frame_put_image( a_frame, a, image, format, requested, resident ) || error;
+}
+
+static mlt_frame transition_process( mlt_transition transition, mlt_frame a_frame, mlt_frame b_frame )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	char *resource = mlt_properties_get( properties, "resource" );
+	mlt_transition cpu = mlt_properties_get_data( properties, "_cpu", NULL );
+
+	// The luma transition generates the maps with a % in their names
+	if ( cpu && resource && strchr( resource, '%' ) )
+	{
+		opencl_pass_properties( MLT_TRANSITION_PROPERTIES( cpu ), properties );
+		return mlt_transition_process( cpu, a_frame, b_frame );
+	}
+
+	opencl_frame_prepare( a_frame );
+	opencl_frame_prepare( b_frame );
+	mlt_frame_push_service( a_frame, transition );
+	mlt_frame_push_frame( a_frame, b_frame );
+	mlt_frame_push_get_image( a_frame, transition_get_image );
+	return a_frame;
+}
+
+mlt_transition transition_opencl_luma_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_transition transition;
+
+	if ( !opencl_available() )
+		return mlt_factory_transition( profile, "luma", arg );
+
+	if ( ( transition = mlt_transition_new() ) )
+	{
+		mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+		mlt_transition cpu = mlt_factory_transition( profile, "luma", arg );
+
+		transition->process = transition_process;
+		mlt_properties_set( properties, "factory", mlt_environment( "MLT_PRODUCER" ) );
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set_int( properties, "_transition_type", 1 );
+		if ( cpu )
+			mlt_properties_set_data( properties, "_cpu", cpu, 0, (mlt_destructor) mlt_transition_close, NULL );
+	}
+	return transition;
+}
@@ -19,15 +19,30 @@
 
 #include <framework/mlt.h>
 #include <opencv2/tracking.hpp>
+#include <opencv2/imgproc.hpp>
 #include <opencv2/core/version.hpp>
 
+#include <stdio.h>
+
+// The most objects that can be tracked with rect, rect.1, rect.2, ...
+#define MAX_OBJECTS 16
 
 typedef struct
 {
 	cv::Ptr<cv::Tracker> tracker;
 	cv::Rect2d boundingBox;
-	char * algo;
+	cv::Rect window; // the part of the image given to the tracker
 	mlt_rect startRect;
+	bool ok;
+} tracked_object;
+
+typedef struct
+{
+	tracked_object *objects;
+	int count;
+	char * algo;
+	double scale;
+	double search;
 	bool initialized;
 	bool playback;
 	bool analyze;
@@ -36,6 +51,34 @@ typedef struct
 	mlt_position producer_length;
 } private_data;
 
+typedef struct
+{
+	private_data* data;
+	cv::Mat* frame;
+} update_desc;
+
+
+/** Get the name of a property of an object.
+ *
+ * The first object uses the plain name, the others append their index.
+ */
+
+static const char* object_property( char* buffer, size_t size, const char* name, int index )
+{
+	if ( index == 0 )
+		return name;
+	snprintf( buffer, size, "%s.%d", name, index );
+	return buffer;
+}
+
+static int object_count( mlt_properties properties )
+{
+	char name[20];
+	int count = 1;
+	while ( count < MAX_OBJECTS && mlt_properties_get( properties, object_property( name, sizeof(name), "rect", count ) ) )
+		count++;
+	return count;
+}
 
 static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 {
@@ -65,11 +108,17 @@ static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 	{
 		return;
 	}
-	if ( !strcmp( name, "rect" ) )
+	if ( !strncmp( name, "rect", 4 ) && ( name[4] == '\0' || name[4] == '.' ) )
 	{
-		// The initial rect was changed, we need to reset the tracker with this new rect
-		mlt_rect rect = mlt_properties_get_rect( filter_properties, "rect" );
-		if ( rect.x != pdata->startRect.x || rect.y != pdata->startRect.y || rect.w != pdata->startRect.w || rect.h != pdata->startRect.h )
+		// An initial rect was changed, we need to reset the trackers with the new rects
+		int index = name[4] ? atoi( name + 5 ) : 0;
+		mlt_rect rect = mlt_properties_get_rect( filter_properties, name );
+		if ( index >= pdata->count )
+		{
+			pdata->playback = false;
+			pdata->initialized = false;
+		}
+		else if ( rect.x != pdata->objects[index].startRect.x || rect.y != pdata->objects[index].startRect.y || rect.w != pdata->objects[index].startRect.w || rect.h != pdata->objects[index].startRect.h )
 		{
 			pdata->playback = false;
 			pdata->initialized = false;
@@ -84,6 +133,11 @@ static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 			pdata->initialized = false;
 		}
 	}
+	else if ( !strcmp( name, "scale" ) || !strcmp( name, "search" ) )
+	{
+		pdata->playback = false;
+		pdata->initialized = false;
+	}
 	else if ( !strcmp( name, "_reset" ) )
 	{
 		mlt_properties_set( filter_properties, "results", NULL );
@@ -93,86 +147,206 @@ static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 static void apply( mlt_filter filter, private_data* data, int width, int height, int position, int length )
 {
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
-	mlt_rect rect = mlt_properties_anim_get_rect( properties, "results", position, length );
-	data->boundingBox.x = rect.x;
-	data->boundingBox.y= rect.y;
-	data->boundingBox.width = rect.w;
-	data->boundingBox.height = rect.h;
+	char name[20];
+	for ( int i = 0; i < data->count; i++ )
+	{
+		mlt_rect rect = mlt_properties_anim_get_rect( properties, object_property( name, sizeof(name), "results", i ), position, length );
+		data->objects[i].boundingBox.x = rect.x;
+		data->objects[i].boundingBox.y= rect.y;
+		data->objects[i].boundingBox.width = rect.w;
+		data->objects[i].boundingBox.height = rect.h;
+	}
+}
+
+static cv::Ptr<cv::Tracker> create_tracker( const char* algo )
+{
+	cv::Ptr<cv::Tracker> tracker;
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 3)
+	if ( !algo || *algo == '\0' || !strcmp(algo, "KCF" ) )
+	{
+		tracker = cv::TrackerKCF::create();
+	}
+	else if ( !strcmp(algo, "MIL" ) )
+	{
+		tracker = cv::TrackerMIL::create();
+	}
+	else if ( !strcmp(algo, "TLD" ) )
+	{
+		tracker = cv::TrackerTLD::create();
+	}
+	else
+	{
+		tracker = cv::TrackerBoosting::create();
+	}
+#else
+	if ( algo == NULL || !strcmp(algo, "" ) )
+	{
+		tracker = cv::Tracker::create( "KCF" );
+	}
+	else
+	{
+		tracker = cv::Tracker::create( algo );
+	}
+#endif
+	return tracker;
+}
+
+/** Choose the part of the image to track an object in.
+ *
+ * Without a search margin this is the whole image. Otherwise it is centered
+ * on the object and extends beyond it by search times its size on each side.
+ */
+
+static void place_window( private_data* data, tracked_object* object, int width, int height )
+{
+	if ( data->search <= 0.0 )
+	{
+		object->window = cv::Rect( 0, 0, width, height );
+		return;
+	}
+	int w = MIN( width, (int) ( object->boundingBox.width * ( 1.0 + 2.0 * data->search ) ) );
+	int h = MIN( height, (int) ( object->boundingBox.height * ( 1.0 + 2.0 * data->search ) ) );
+	int x = object->boundingBox.x + object->boundingBox.width / 2 - w / 2;
+	int y = object->boundingBox.y + object->boundingBox.height / 2 - h / 2;
+	object->window = cv::Rect( CLAMP( x, 0, width - w ), CLAMP( y, 0, height - h ), w, h );
+}
+
+/** Get the image given to the tracker of an object.
+ *
+ * By default this is the full color image. When downscaling or searching
+ * near the object, it is the downscaled luma of the search window.
+ */
+
+static cv::Mat tracker_input( private_data* data, tracked_object* object, cv::Mat& frame )
+{
+	if ( data->scale >= 1.0 && data->search <= 0.0 )
+		return frame;
+
+	cv::Mat window = frame( object->window );
+	cv::Mat small, luma;
+	if ( data->scale < 1.0 )
+	{
+		cv::resize( window, small, cv::Size(), data->scale, data->scale, cv::INTER_AREA );
+		window = small;
+	}
+	cv::cvtColor( window, luma, cv::COLOR_RGB2GRAY );
+	return luma;
 }
 
+static cv::Rect2d to_tracker( private_data* data, tracked_object* object, const cv::Rect2d& box )
+{
+	double scale = MIN( data->scale, 1.0 );
+	return cv::Rect2d( ( box.x - object->window.x ) * scale, ( box.y - object->window.y ) * scale, box.width * scale, box.height * scale );
+}
+
+static cv::Rect2d from_tracker( private_data* data, tracked_object* object, const cv::Rect2d& box )
+{
+	double scale = MIN( data->scale, 1.0 );
+	return cv::Rect2d( box.x / scale + object->window.x, box.y / scale + object->window.y, box.width / scale, box.height / scale );
+}
+
+static bool init_object( private_data* data, tracked_object* object, cv::Mat& frame )
+{
+	place_window( data, object, frame.cols, frame.rows );
+	object->tracker = create_tracker( data->algo );
+	object->ok = object->tracker != NULL && object->tracker->init( tracker_input( data, object, frame ), to_tracker( data, object, object->boundingBox ) );
+	return object->ok;
+}
+
+static void update_object( private_data* data, tracked_object* object, cv::Mat& frame )
+{
+	if ( !object->ok )
+		return;
+
+	cv::Rect2d box = to_tracker( data, object, object->boundingBox );
+	if ( object->tracker->update( tracker_input( data, object, frame ), box ) )
+		object->boundingBox = from_tracker( data, object, box );
+
+	// Move the search window with the object when it gets near an edge,
+	// the tracker must be started again as its state is relative to the window
+	if ( data->search > 0.0 )
+	{
+		double margin_x = object->boundingBox.width * data->search / 2;
+		double margin_y = object->boundingBox.height * data->search / 2;
+		cv::Rect2d inner( object->window.x + margin_x, object->window.y + margin_y,
+			object->window.width - 2 * margin_x, object->window.height - 2 * margin_y );
+		if ( ( object->boundingBox & inner ) != object->boundingBox
+			&& ( object->window.x > 0 || object->window.y > 0 || object->window.width < frame.cols || object->window.height < frame.rows ) )
+			init_object( data, object, frame );
+	}
+}
+
+static int update_slice( int id, int idx, int jobs, void* cookie )
+{
+	update_desc* desc = (update_desc*) cookie;
+	for ( int i = idx; i < desc->data->count; i += jobs )
+		update_object( desc->data, &desc->data->objects[i], *desc->frame );
+	return 0;
+}
 
 static void analyze( mlt_filter filter, cv::Mat cvFrame, private_data* data, int width, int height, int position, int length )
 {
 	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
+	char name[20];
 
-	// Create tracker and initialize it
+	// Create trackers and initialize them
 	if (!data->initialized)
         {
-		// Build tracker
+		// Build trackers
 		data->algo = mlt_properties_get( filter_properties, "algo" );
-#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 3)
-		if ( !data->algo || *data->algo == '\0' || !strcmp(data->algo, "KCF" ) )
-		{
-			data->tracker = cv::TrackerKCF::create();
-		}
-		else if ( !strcmp(data->algo, "MIL" ) )
-		{
-			data->tracker = cv::TrackerMIL::create();
-		}
-		else if ( !strcmp(data->algo, "TLD" ) )
-		{
-			data->tracker = cv::TrackerTLD::create();
-		}
-		else
-		{
-			data->tracker = cv::TrackerBoosting::create();
-		}
-#else
-		if ( data->algo == NULL || !strcmp(data->algo, "" ) )
-		{
-			data->tracker = cv::Tracker::create( "KCF" );
-		}
-		else
+		data->scale = mlt_properties_get_double( filter_properties, "scale" );
+		data->search = mlt_properties_get_double( filter_properties, "search" );
+		if ( data->scale <= 0.0 )
+			data->scale = 1.0;
+		delete[] data->objects;
+		data->count = object_count( filter_properties );
+		data->objects = new tracked_object[data->count];
+		data->last_position = -1;
+
+		for ( int i = 0; i < data->count; i++ )
 		{
-			data->tracker = cv::Tracker::create( data->algo );
-		}
-#endif
+			tracked_object* object = &data->objects[i];
 
-		// Discard previous results
-		mlt_properties_set( filter_properties, "_results", "" );
-		if( data->tracker == NULL )
-                {
-			fprintf( stderr, "Tracker initialized FAILED\n" );
-		}
-		else
-                {
-			data->startRect = mlt_properties_get_rect( filter_properties, "rect" );
-			data->boundingBox.x = MAX( data->startRect.x, 1.0 );
-			data->boundingBox.y= MAX( data->startRect.y, 1.0 );
-			data->boundingBox.width = data->startRect.w;
-			data->boundingBox.height = data->startRect.h;
-			if ( data->boundingBox.width <1 ) {
-				data->boundingBox.width = 50;
+			// Discard previous results
+			mlt_properties_set( filter_properties, object_property( name, sizeof(name), "_results", i ), "" );
+
+			object->startRect = mlt_properties_get_rect( filter_properties, object_property( name, sizeof(name), "rect", i ) );
+			object->boundingBox.x = MAX( object->startRect.x, 1.0 );
+			object->boundingBox.y= MAX( object->startRect.y, 1.0 );
+			object->boundingBox.width = object->startRect.w;
+			object->boundingBox.height = object->startRect.h;
+			if ( object->boundingBox.width <1 ) {
+				object->boundingBox.width = 50;
 			}
-			if ( data->boundingBox.height <1 ) {
-				data->boundingBox.height = 50;
+			if ( object->boundingBox.height <1 ) {
+				object->boundingBox.height = 50;
 			}
-			if ( data->tracker->init( cvFrame, data->boundingBox ) ) {
+			if ( init_object( data, object, cvFrame ) ) {
 				data->initialized = true;
 				data->analyze = true;
-				data->last_position = -1;
+			}
+			else
+			{
+				fprintf( stderr, "Tracker initialized FAILED\n" );
 			}
 			// init anim property
-			mlt_properties_anim_get_int( filter_properties, "_results", 0, length );
-			mlt_animation anim = mlt_properties_get_animation( filter_properties, "_results" );
+			const char* results = object_property( name, sizeof(name), "_results", i );
+			mlt_properties_anim_get_int( filter_properties, results, 0, length );
+			mlt_animation anim = mlt_properties_get_animation( filter_properties, results );
 			if ( anim == NULL ) {
 				fprintf( stderr, "animation initialized FAILED\n" );
 			}
 		}
 	}
-	else
+	else if ( data->count > 1 )
         {
-		data->tracker->update( cvFrame, data->boundingBox );
+		// The trackers are independent of each other
+		update_desc desc = { data, &cvFrame };
+		mlt_slices_run_normal( MIN( data->count, mlt_slices_count_normal() ), update_slice, &desc );
+	}
+	else
+	{
+		update_object( data, &data->objects[0], cvFrame );
 	}
 
 	if( data->analyze && position != data->last_position + 1 )
@@ -184,30 +358,39 @@ static void analyze( mlt_filter filter, cv::Mat cvFrame, private_data* data, int
 	{
 		return;
 	}
-	// Store results in temp variable
-	mlt_rect rect;
-	rect.x = data->boundingBox.x;
-	rect.y = data->boundingBox.y;
-	rect.w = data->boundingBox.width;
-	rect.h = data->boundingBox.height;
-	rect.o = 0;
+	// Store results in temp variables
 	int steps = mlt_properties_get_int(filter_properties, "steps");
-	if ( steps > 1 && position > 0 && position < length - 1 )
+	for ( int i = 0; i < data->count; i++ )
 	{
-		if ( position % steps == 0 )
-			mlt_properties_anim_set_rect( filter_properties, "_results", rect, position, length, mlt_keyframe_smooth );
-	}
-	else
-	{
-		mlt_properties_anim_set_rect( filter_properties, "_results", rect, position, length, mlt_keyframe_smooth );
+		const char* results = object_property( name, sizeof(name), "_results", i );
+		mlt_rect rect;
+		rect.x = data->objects[i].boundingBox.x;
+		rect.y = data->objects[i].boundingBox.y;
+		rect.w = data->objects[i].boundingBox.width;
+		rect.h = data->objects[i].boundingBox.height;
+		rect.o = 0;
+		if ( steps > 1 && position > 0 && position < length - 1 )
+		{
+			if ( position % steps == 0 )
+				mlt_properties_anim_set_rect( filter_properties, results, rect, position, length, mlt_keyframe_smooth );
+		}
+		else
+		{
+			mlt_properties_anim_set_rect( filter_properties, results, rect, position, length, mlt_keyframe_smooth );
+		}
 	}
 	if ( position + 1 == length )
 	{
-		//Analysis finished, store results
-		mlt_animation anim = mlt_properties_get_animation( filter_properties, "_results");
-		mlt_properties_set( filter_properties, "results", strdup( mlt_animation_serialize( anim ) ) );
-		// Discard temporary data
-		mlt_properties_set( filter_properties, "_results", (char*) NULL );
+		//Analysis finished, store results, the first object last as that signals completion
+		for ( int i = data->count - 1; i >= 0; i-- )
+		{
+			mlt_animation anim = mlt_properties_get_animation( filter_properties, object_property( name, sizeof(name), "_results", i ) );
+			char *results = mlt_animation_serialize( anim );
+			mlt_properties_set( filter_properties, object_property( name, sizeof(name), "results", i ), results );
+			free( results );
+			// Discard temporary data
+			mlt_properties_set( filter_properties, object_property( name, sizeof(name), "_results", i ), (char*) NULL );
+		}
 		data->playback = true;
 	}
 	data->last_position = position;
@@ -225,8 +408,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 	int shape_width = mlt_properties_get_int( filter_properties, "shape_width" );
 	int blur = mlt_properties_get_int( filter_properties, "blur" );
+	private_data* data = (private_data*) filter->child;
 	cv::Mat cvFrame;
-	if ( shape_width == 0 && blur == 0 ) {
+	if ( shape_width == 0 && blur == 0 && data->playback ) {
 		error = mlt_frame_get_image( frame, image, format, width, height, 1 );
 	}
 	else
@@ -235,7 +419,6 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		error = mlt_frame_get_image( frame, image, format, width, height, 1 );
 		cvFrame = cv::Mat( *height, *width, CV_8UC3, *image );
 	}
-	private_data* data = (private_data*) filter->child;
 	if ( !data->initialized )
         {
 		if ( data->producer_length == 0 )
@@ -259,6 +442,11 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	if( data->playback )
 	{
 		// Clip already analysed, don't re-process
+		if ( !data->objects )
+		{
+			data->count = object_count( filter_properties );
+			data->objects = new tracked_object[data->count];
+		}
 		apply( filter, data, *width, *height, position - data->producer_in, data->producer_length );
 	}
 	else
@@ -266,51 +454,57 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		analyze( filter, cvFrame, data, *width, *height, position - data->producer_in, data->producer_length );
 	}
 
-	if ( blur > 0 )
+	for ( int i = 0; i < data->count && !cvFrame.empty(); i++ )
 	{
-		switch ( mlt_properties_get_int( filter_properties, "blur_type" ) )
+		cv::Rect2d boundingBox = data->objects[i].boundingBox;
+		if ( blur > 0 )
 		{
+			switch ( mlt_properties_get_int( filter_properties, "blur_type" ) )
+			{
+				case 1:
+					// Gaussian Blur
+					cv::GaussianBlur( cvFrame( boundingBox ), cvFrame( boundingBox ), cv::Size( 0, 0 ), blur );
+	                                break;
+				case 0:
+				default:
+					// Median Blur
+					{
+						int size = blur + 1;
+						if ( size % 2 == 0 )
+						{
+							// median blur param must be odd and, minimum 3
+							++size;
+						}
+						cv::medianBlur( cvFrame( boundingBox ), cvFrame( boundingBox ), size );
+					}
+					break;
+			}
+		}
+
+		// Paint overlay shape
+		if ( shape_width != 0 )
+	        {
+			// Get the OpenCV image
+			mlt_color shape_color = mlt_properties_get_color( filter_properties, "shape_color" );
+			switch ( mlt_properties_get_int( filter_properties, "shape" ) )
+	                {
+			case 2:
+				// Arrow
+				cv::arrowedLine( cvFrame, cv::Point( boundingBox.x + boundingBox.width/2, boundingBox.y - boundingBox.height/2 ), cv::Point( boundingBox.x + boundingBox.width/2, boundingBox.y ), cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), MAX( shape_width, 1 ), 4, 0, .2 );
+				break;
 			case 1:
-				// Gaussian Blur
-				cv::GaussianBlur( cvFrame( data->boundingBox ), cvFrame( data->boundingBox ), cv::Size( 0, 0 ), blur );
-                                break;
-			case 0:
-			default:
-				// Median Blur
-				++blur;
-				if ( blur % 2 == 0 )
+				// Ellipse
 				{
-					// median blur param must be odd and, minimum 3
-					++blur;
+					cv::RotatedRect bounding = cv::RotatedRect( cv::Point2f( boundingBox.x + boundingBox.width/2, boundingBox.y + boundingBox.height/2 ), cv::Size2f( boundingBox.width, boundingBox.height ), 0);
+					cv::ellipse( cvFrame, bounding, cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), shape_width, 1 );
 				}
-				cv::medianBlur( cvFrame( data->boundingBox ), cvFrame( data->boundingBox ), blur );
 				break;
-		}
-	}
-
-	// Paint overlay shape
-	if ( shape_width != 0 )
-        {
-		// Get the OpenCV image
-		mlt_color shape_color = mlt_properties_get_color( filter_properties, "shape_color" );
-		switch ( mlt_properties_get_int( filter_properties, "shape" ) )
-                {
-		case 2:
-			// Arrow
-			cv::arrowedLine( cvFrame, cv::Point( data->boundingBox.x + data->boundingBox.width/2, data->boundingBox.y - data->boundingBox.height/2 ), cv::Point( data->boundingBox.x + data->boundingBox.width/2, data->boundingBox.y ), cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), MAX( shape_width, 1 ), 4, 0, .2 );
-			break;
-		case 1:
-			// Ellipse
-			{
-				cv::RotatedRect bounding = cv::RotatedRect( cv::Point2f( data->boundingBox.x + data->boundingBox.width/2, data->boundingBox.y + data->boundingBox.height/2 ), cv::Size2f( data->boundingBox.width, data->boundingBox.height ), 0);
-				cv::ellipse( cvFrame, bounding, cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), shape_width, 1 );
+			case 0:
+			default:
+				// Rectangle
+				cv::rectangle( cvFrame, boundingBox, cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), shape_width, 1 );
+				break;
 			}
-			break;
-		case 0:
-		default:
-			// Rectangle
-			cv::rectangle( cvFrame, data->boundingBox, cv::Scalar( shape_color.r, shape_color.g, shape_color.b ), shape_width, 1 );
-			break;
 		}
 	}
 
@@ -331,7 +525,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 static void filter_close( mlt_filter filter )
 {
 	private_data* data = (private_data*) filter->child;
-	free ( data->tracker );
+	delete[] data->objects;
 	free ( data );
 	filter->child = NULL;
 	filter->close = NULL;
@@ -355,12 +549,12 @@ mlt_filter filter_tracker_init( mlt_profile profile, mlt_service_type type, cons
 		mlt_properties_set_int( properties, "shape_width", 1 );
 		mlt_properties_set_int( properties, "steps", 5 );
 		mlt_properties_set( properties, "algo", "KCF" );
+		mlt_properties_set_double( properties, "scale", 1.0 );
+		mlt_properties_set_double( properties, "search", 0.0 );
 		data->initialized = false;
 		data->playback = false;
-		data->boundingBox.x = 0;
-		data->boundingBox.y= 0;
-		data->boundingBox.width = 0;
-		data->boundingBox.height = 0;
+		data->objects = NULL;
+		data->count = 0;
 		data->analyze = false;
 		data->last_position = -1;
 		data->producer_in = 0;
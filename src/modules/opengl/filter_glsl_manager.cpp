@@ -49,6 +49,8 @@ extern "C" {
 
 using namespace movit;
 
+static void deleteChain( GlslChain* chain );
+
 void dec_ref_and_delete(GlslManager *p)
 {
 	if (p->dec_ref() == 0) {
@@ -56,19 +58,34 @@ void dec_ref_and_delete(GlslManager *p)
 	}
 }
 
+GlslContext::GlslContext()
+	: last_texture_key(0)
+	, last_bucket(NULL)
+	, texture_uses(0)
+	, texture_bytes(0)
+	, chain_uses(0)
+	, prev_sync(NULL)
+{
+	for (int i = 0; i < GLSL_READBACK_BANDS; ++i)
+		pbos[i] = 0;
+}
+
 GlslManager::GlslManager()
 	: Mlt::Filter( mlt_filter_new() )
 	, resource_pool(new ResourcePool())
-	, pbo(0)
+	, texture_hits(0)
+	, texture_allocations(0)
+	, texture_evictions(0)
 	, initEvent(0)
 	, closeEvent(0)
-	, prev_sync(NULL)
 {
 	mlt_filter filter = get_filter();
+	pthread_key_create(&context_key, NULL);
 	if ( filter ) {
 		// Set the mlt_filter child in case we choose to override virtual functions.
 		filter->child = this;
 		add_ref(mlt_global_properties());
+		set("texture_budget", GLSL_TEXTURE_BUDGET);
 
 		mlt_events_register( get_properties(), "init glsl", NULL );
 		mlt_events_register( get_properties(), "close glsl", NULL );
@@ -80,16 +97,15 @@ GlslManager::GlslManager()
 GlslManager::~GlslManager()
 {
 	mlt_log_debug(get_service(), "%s\n", __FUNCTION__);
-	cleanupContext();
 // XXX If there is still a frame holding a reference to a texture after this
 // destructor is called, then it will crash in release_texture().
-//	while (texture_list.peek_back())
-//		delete (glsl_texture) texture_list.pop_back();
+	while (!contexts.empty()) {
+		deleteContext(contexts.back());
+		contexts.pop_back();
+	}
+	pthread_key_delete(context_key);
 	delete initEvent;
 	delete closeEvent;
-	if (prev_sync != NULL) {
-		glDeleteSync( prev_sync );
-	}
 	while (syncs_to_delete.count() > 0) {
 		GLsync sync = (GLsync) syncs_to_delete.pop_front();
 		glDeleteSync( sync );
@@ -109,23 +125,61 @@ GlslManager* GlslManager::get_instance()
 	return (GlslManager*) mlt_properties_get_data(mlt_global_properties(), "glslManager", 0);
 }
 
+// The context of the calling thread, which is created on its first use.
+GlslContext* GlslManager::get_context()
+{
+	GlslContext* context = (GlslContext*) pthread_getspecific(context_key);
+	if (!context) {
+		context = new GlslContext;
+		pthread_setspecific(context_key, context);
+		lock();
+		contexts.push_back(context);
+		unlock();
+	}
+	return context;
+}
+
+// The bytes of a texture with the given internal format
+static int texture_size(int width, int height, GLint internal_format)
+{
+	switch (internal_format) {
+	case GL_RGBA16F:
+	case GL_RGBA16:
+		return width * height * 8;
+	case GL_RGBA32F:
+		return width * height * 16;
+	default:
+		return width * height * 4;
+	}
+}
+
 glsl_texture GlslManager::get_texture(int width, int height, GLint internal_format)
 {
+	GlslContext* context = get_context();
 #if USE_TEXTURE_POOL
-	lock();
-	for (int i = 0; i < texture_list.count(); ++i) {
-		glsl_texture tex = (glsl_texture) texture_list.peek(i);
-		if (!tex->used && (tex->width == width) && (tex->height == height) && (tex->internal_format == internal_format)) {
+	uint64_t key = ((uint64_t) width << 48) | ((uint64_t) height << 32) | (uint32_t) internal_format;
+	glsl_texture_bucket* bucket = context->last_bucket;
+	if (!bucket || context->last_texture_key != key) {
+		bucket = &context->textures[key];
+		context->last_texture_key = key;
+		context->last_bucket = bucket;
+	}
+	++context->texture_uses;
+	for (size_t i = 0; i < bucket->size(); ++i) {
+		glsl_texture tex = (*bucket)[i];
+		if (!tex->used) {
 			glBindTexture(GL_TEXTURE_2D, tex->texture);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			glBindTexture( GL_TEXTURE_2D, 0);
 			tex->used = 1;
-			unlock();
+			tex->last_use = context->texture_uses;
+			if (context->texture_uses % GLSL_TEXTURE_MAX_IDLE == 0)
+				evictTextures(context);
+			updateStats(1, 0, 0);
 			return tex;
 		}
 	}
-	unlock();
 #endif
 
 	GLuint tex = 0;
@@ -152,23 +206,110 @@ glsl_texture GlslManager::get_texture(int width, int height, GLint internal_form
 	gtex->width = width;
 	gtex->height = height;
 	gtex->internal_format = internal_format;
+	gtex->size = texture_size(width, height, internal_format);
 	gtex->used = 1;
+	gtex->last_use = context->texture_uses;
 #if USE_TEXTURE_POOL
-	lock();
-	texture_list.push_back(gtex);
-	unlock();
+	bucket->push_back(gtex);
+	context->texture_bytes += gtex->size;
+	evictTextures(context);
 #endif
+	updateStats(0, 1, 0);
 	return gtex;
 }
 
+void GlslManager::deleteTexture(GlslContext* context, glsl_texture texture)
+{
+	glDeleteTextures(1, &texture->texture);
+	context->texture_bytes -= texture->size;
+	delete texture;
+}
+
+// Delete the unused textures that have been idle for long, and then the
+// least recently used ones until the pool fits in the budget.
+void GlslManager::evictTextures(GlslContext* context)
+{
+	int64_t budget = get_int64("texture_budget") * 1024 * 1024;
+	int evictions = 0;
+
+	for (std::map<uint64_t, glsl_texture_bucket>::iterator it = context->textures.begin(); it != context->textures.end(); ) {
+		glsl_texture_bucket& bucket = it->second;
+		for (size_t i = 0; i < bucket.size(); ) {
+			glsl_texture tex = bucket[i];
+			if (!tex->used && context->texture_uses - tex->last_use > GLSL_TEXTURE_MAX_IDLE) {
+				deleteTexture(context, tex);
+				bucket.erase(bucket.begin() + i);
+				++evictions;
+			} else {
+				++i;
+			}
+		}
+		if (bucket.empty()) {
+			if (context->last_bucket == &bucket)
+				context->last_bucket = NULL;
+			context->textures.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	while (budget > 0 && context->texture_bytes > budget) {
+		glsl_texture_bucket* oldest_bucket = NULL;
+		size_t oldest = 0;
+		for (std::map<uint64_t, glsl_texture_bucket>::iterator it = context->textures.begin(); it != context->textures.end(); ++it) {
+			for (size_t i = 0; i < it->second.size(); ++i) {
+				glsl_texture tex = it->second[i];
+				if (!tex->used && (!oldest_bucket || tex->last_use < (*oldest_bucket)[oldest]->last_use)) {
+					oldest_bucket = &it->second;
+					oldest = i;
+				}
+			}
+		}
+		if (!oldest_bucket)
+			break;
+		deleteTexture(context, (*oldest_bucket)[oldest]);
+		oldest_bucket->erase(oldest_bucket->begin() + oldest);
+		++evictions;
+	}
+
+	if (evictions)
+		updateStats(0, 0, evictions);
+}
+
+// Accumulate the counters and publish them with the bytes resident in all
+// the contexts.
+void GlslManager::updateStats(int hits, int allocations, int evictions)
+{
+	lock();
+	texture_hits += hits;
+	texture_allocations += allocations;
+	texture_evictions += evictions;
+	int64_t texture_bytes = 0, pbo_bytes = 0;
+	for (size_t i = 0; i < contexts.size(); ++i) {
+		texture_bytes += contexts[i]->texture_bytes;
+		for (int j = 0; j < GLSL_READBACK_BANDS; ++j)
+			if (contexts[i]->pbos[j])
+				pbo_bytes += contexts[i]->pbos[j]->size;
+		for (size_t j = 0; j < contexts[i]->upload_pbos.size(); ++j)
+			pbo_bytes += contexts[i]->upload_pbos[j]->size;
+	}
+	unlock();
+	set("texture_hits", texture_hits);
+	set("texture_allocations", texture_allocations);
+	set("texture_evictions", texture_evictions);
+	set("texture_bytes", texture_bytes);
+	set("pbo_bytes", pbo_bytes);
+}
+
 void GlslManager::release_texture(glsl_texture texture)
 {
 #if USE_TEXTURE_POOL
 	texture->used = 0;
 #else
+	// Textures are shared among the contexts, so any of them may delete it.
 	GlslManager* g = GlslManager::get_instance();
 	g->lock();
-	g->texture_list.push_back(texture);
+	g->textures_to_delete.push_back(texture);
 	g->unlock();
 #endif
 }
@@ -184,51 +325,118 @@ void GlslManager::delete_sync(GLsync sync)
 	g->unlock();
 }
 
-glsl_pbo GlslManager::get_pbo(int size)
+glsl_pbo GlslManager::get_pbo(int index, int size)
 {
-	lock();
+	glsl_pbo &pbo = get_context()->pbos[index];
 	if (!pbo) {
 		GLuint pb = 0;
 		glGenBuffers(1, &pb);
 		if (!pb) {
-			unlock();
 			return NULL;
 		}
 
 		pbo = new glsl_pbo_s;
 		if (!pbo) {
 			glDeleteBuffers(1, &pb);
-			unlock();
 			return NULL;
 		}
 		pbo->pbo = pb;
 		pbo->size = 0;
+		pbo->used = 0;
 	}
-	if (size > pbo->size) {
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo->pbo);
-		glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, size, NULL, GL_STREAM_DRAW);
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	// Also shrink a buffer that has become much larger than the images.
+	if (size > pbo->size || size < pbo->size / 4) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo->pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
 		pbo->size = size;
+		updateStats(0, 0, 0);
 	}
-	unlock();
 	return pbo;
 }
 
-void GlslManager::cleanupContext()
+// A buffer of at least size bytes to map and fill with an input image,
+// from which the texture upload does not have to wait for client memory.
+glsl_pbo GlslManager::get_upload_pbo(int size)
 {
-	lock();
-	while (texture_list.peek_back()) {
-		glsl_texture texture = (glsl_texture) texture_list.peek_back();
-		glDeleteTextures(1, &texture->texture);
-		delete texture;
-		texture_list.pop_back();
+	GlslContext* context = get_context();
+	for (size_t i = 0; i < context->upload_pbos.size(); ++i) {
+		glsl_pbo pbo = context->upload_pbos[i];
+		if (!pbo->used && pbo->size >= size && pbo->size / 4 < size) {
+			pbo->used = 1;
+			return pbo;
+		}
+	}
+
+	// Reallocate an unused buffer of another size before adding one.
+	glsl_pbo pbo = NULL;
+	for (size_t i = 0; i < context->upload_pbos.size() && !pbo; ++i)
+		if (!context->upload_pbos[i]->used)
+			pbo = context->upload_pbos[i];
+	if (!pbo) {
+		GLuint pb = 0;
+		glGenBuffers(1, &pb);
+		if (!pb) {
+			return NULL;
+		}
+		pbo = new glsl_pbo_s;
+		pbo->pbo = pb;
+		context->upload_pbos.push_back(pbo);
 	}
-	if (pbo) {
-		glDeleteBuffers(1, &pbo->pbo);
-		delete pbo;
-		pbo = 0;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo->pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	pbo->size = size;
+	pbo->used = 1;
+	updateStats(0, 0, 0);
+	return pbo;
+}
+
+void GlslManager::release_pbo(glsl_pbo pbo)
+{
+	pbo->used = 0;
+}
+
+void GlslManager::deleteContext(GlslContext* context)
+{
+	for (std::map<uint64_t, glsl_texture_bucket>::iterator it = context->textures.begin(); it != context->textures.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); ++i)
+			deleteTexture(context, it->second[i]);
+	for (std::map<std::string, GlslChain*>::iterator it = context->chains.begin(); it != context->chains.end(); ++it)
+		deleteChain(it->second);
+	for (int i = 0; i < GLSL_READBACK_BANDS; ++i) {
+		if (context->pbos[i]) {
+			glDeleteBuffers(1, &context->pbos[i]->pbo);
+			delete context->pbos[i];
+		}
+	}
+	for (size_t i = 0; i < context->upload_pbos.size(); ++i) {
+		glDeleteBuffers(1, &context->upload_pbos[i]->pbo);
+		delete context->upload_pbos[i];
+	}
+	if (context->prev_sync != NULL) {
+		glDeleteSync( context->prev_sync );
+	}
+	delete context;
+}
+
+// Delete the objects of the calling thread while its OpenGL context is current.
+void GlslManager::cleanupContext()
+{
+	GlslContext* context = (GlslContext*) pthread_getspecific(context_key);
+	if (context) {
+		pthread_setspecific(context_key, NULL);
+		lock();
+		for (size_t i = 0; i < contexts.size(); ++i) {
+			if (contexts[i] == context) {
+				contexts.erase(contexts.begin() + i);
+				break;
+			}
+		}
+		unlock();
+		deleteContext(context);
+		updateStats(0, 0, 0);
 	}
-	unlock();
 }
 
 void GlslManager::onInit( mlt_properties owner, GlslManager* filter )
@@ -241,8 +449,12 @@ void GlslManager::onInit( mlt_properties owner, GlslManager* filter )
 #else
 	std::string path = std::string(getenv("MLT_MOVIT_PATH") ? getenv("MLT_MOVIT_PATH") : SHADERDIR);
 #endif
+	// Every rendering thread initializes its context, but only the first
+	// one initializes Movit.
+	filter->lock();
 	bool success = init_movit( path, mlt_log_get_level() == MLT_LOG_DEBUG? MOVIT_DEBUG_ON : MOVIT_DEBUG_OFF );
 	filter->set( "glsl_supported", success );
+	filter->unlock();
 }
 
 void GlslManager::onClose( mlt_properties owner, GlslManager *filter )
@@ -282,10 +494,8 @@ static void deleteChain( GlslChain* chain )
 {
 	// The Input* is owned by the EffectChain, but the MltInput* is not.
 	// Thus, we have to delete it here.
-	for (std::map<mlt_producer, MltInput*>::iterator input_it = chain->inputs.begin();
-	     input_it != chain->inputs.end();
-	     ++input_it) {
-		delete input_it->second;
+	for (size_t i = 0; i < chain->input_order.size(); ++i) {
+		delete chain->input_order[i];
 	}
 	delete chain->effect_chain;
 	delete chain;
@@ -307,14 +517,35 @@ int GlslManager::set_frame_specific_data( mlt_service service, mlt_frame frame,
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES(frame), buf, value, length, destroy, serialise );
 }
 
-void GlslManager::set_chain( mlt_service service, GlslChain* chain )
+// The chains are shared by all the services with the same structure that
+// are rendered by the calling thread, which has its own OpenGL context.
+void GlslManager::set_chain( const std::string& fingerprint, GlslChain* chain )
 {
-	mlt_properties_set_data( MLT_SERVICE_PROPERTIES(service), "_movit chain", chain, 0, (mlt_destructor) deleteChain, NULL );
+	GlslContext* context = GlslManager::get_instance()->get_context();
+	chain->last_use = ++context->chain_uses;
+	context->chains[fingerprint] = chain;
+
+	// Drop the chain that was used the longest time ago
+	if (context->chains.size() > GLSL_MAX_CHAINS) {
+		std::map<std::string, GlslChain*>::iterator oldest = context->chains.begin();
+		for (std::map<std::string, GlslChain*>::iterator it = context->chains.begin(); it != context->chains.end(); ++it)
+			if (it->second->last_use < oldest->second->last_use)
+				oldest = it;
+		deleteChain(oldest->second);
+		context->chains.erase(oldest);
+	}
 }
 
-GlslChain* GlslManager::get_chain( mlt_service service )
+GlslChain* GlslManager::get_chain( const std::string& fingerprint )
 {
-	return (GlslChain*) mlt_properties_get_data( MLT_SERVICE_PROPERTIES(service), "_movit chain", NULL );
+	GlslContext* context = GlslManager::get_instance()->get_context();
+	GlslChain* chain = NULL;
+	std::map<std::string, GlslChain*>::iterator it = context->chains.find(fingerprint);
+	if (it != context->chains.end()) {
+		chain = it->second;
+		chain->last_use = ++context->chain_uses;
+	}
+	return chain;
 }
 	
 Effect* GlslManager::get_effect( mlt_service service, mlt_frame frame )
@@ -350,6 +581,19 @@ uint8_t* GlslManager::set_input_pixel_pointer( mlt_producer producer, mlt_frame
 	return image;
 }
 
+glsl_pbo GlslManager::get_input_pbo( mlt_producer producer, mlt_frame frame )
+{
+	return (glsl_pbo) get_frame_specific_data( MLT_PRODUCER_SERVICE(producer), frame, "_movit input pbo", NULL );
+}
+
+// The frame releases the buffer when it is replaced or closed unrendered.
+glsl_pbo GlslManager::set_input_pbo( mlt_producer producer, mlt_frame frame, glsl_pbo pbo )
+{
+	set_frame_specific_data( MLT_PRODUCER_SERVICE(producer), frame, "_movit input pbo", pbo, 0,
+		pbo ? (mlt_destructor) GlslManager::release_pbo : NULL, NULL );
+	return pbo;
+}
+
 mlt_service GlslManager::get_effect_input( mlt_service service, mlt_frame frame )
 {
 	return (mlt_service) get_frame_specific_data( service, frame, "_movit effect input", NULL );
@@ -407,24 +651,25 @@ int GlslManager::render_frame_texture(EffectChain *chain, mlt_frame frame, int w
 		glDeleteSync( sync );
 	}
 #if !USE_TEXTURE_POOL
-	while (texture_list.count() > 0) {
-		glsl_texture texture = (glsl_texture) texture_list.pop_back();
+	while (textures_to_delete.count() > 0) {
+		glsl_texture texture = (glsl_texture) textures_to_delete.pop_back();
 		glDeleteTextures(1, &texture->texture);
 		delete texture;
 	}
 #endif
 	unlock();
 
-	// Make sure we never have more than one frame pending at any time.
-	// This ensures we do not swamp the GPU with so much work
+	// Make sure we never have more than one frame pending at any time
+	// in each thread. This ensures we do not swamp the GPU with so much work
 	// that we cannot actually display the frames we generate.
-	if (prev_sync != NULL) {
+	GlslContext* context = get_context();
+	if (context->prev_sync != NULL) {
 		glFlush();
-		glClientWaitSync( prev_sync, 0, GL_TIMEOUT_IGNORED );
-		glDeleteSync( prev_sync );
+		glClientWaitSync( context->prev_sync, 0, GL_TIMEOUT_IGNORED );
+		glDeleteSync( context->prev_sync );
 	}
 	chain->render_to_fbo( fbo, width, height );
-	prev_sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	context->prev_sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
 	GLsync sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
 
 	check_error();
@@ -443,6 +688,17 @@ int GlslManager::render_frame_texture(EffectChain *chain, mlt_frame frame, int w
 	return 0;
 }
 
+// Copy pixels from BGRA to RGBA.
+static void copy_bgra_to_rgba(const uint8_t *src, uint8_t *dst, int pixels)
+{
+	for (int i = 0; i < pixels; ++i, src += 4, dst += 4) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = src[3];
+	}
+}
+
 int GlslManager::render_frame_rgba(EffectChain *chain, mlt_frame frame, int width, int height, uint8_t **image)
 {
 	glsl_texture texture = get_texture( width, height, GL_RGBA8 );
@@ -450,13 +706,20 @@ int GlslManager::render_frame_rgba(EffectChain *chain, mlt_frame frame, int widt
 		return 1;
 	}
 
-	// Use a PBO to hold the data we read back with glReadPixels().
+	// Use PBOs to hold the data we read back with glReadPixels().
 	// (Intel/DRI goes into a slow path if we don't read to PBO.)
+	// The image is read in bands, each into its own PBO with a fence, so
+	// that converting one band overlaps the transfer of the next ones.
 	int img_size = width * height * 4;
-	glsl_pbo pbo = get_pbo( img_size );
-	if (!pbo) {
-		release_texture(texture);
-		return 1;
+	int bands = height >= GLSL_READBACK_BANDS * 16 ? GLSL_READBACK_BANDS : 1;
+	int band_height = ( height + bands - 1 ) / bands;
+	glsl_pbo pbo[GLSL_READBACK_BANDS];
+	for (int i = 0; i < bands; ++i) {
+		pbo[i] = get_pbo( i, band_height * width * 4 );
+		if (!pbo[i]) {
+			release_texture(texture);
+			return 1;
+		}
 	}
 
 	// Set the FBO
@@ -472,35 +735,42 @@ int GlslManager::render_frame_rgba(EffectChain *chain, mlt_frame frame, int widt
 
 	chain->render_to_fbo( fbo, width, height );
 
-	// Read FBO into PBO
+	// Read FBO into PBOs
+	GLsync fences[GLSL_READBACK_BANDS];
 	glBindFramebuffer( GL_FRAMEBUFFER, fbo );
 	check_error();
-	glBindBuffer( GL_PIXEL_PACK_BUFFER_ARB, pbo->pbo );
-	check_error();
-	glBufferData( GL_PIXEL_PACK_BUFFER_ARB, img_size, NULL, GL_STREAM_READ );
-	check_error();
-	glReadPixels( 0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0) );
-	check_error();
+	for (int i = 0; i < bands; ++i) {
+		int y = i * band_height;
+		int rows = height - y < band_height ? height - y : band_height;
+		glBindBuffer( GL_PIXEL_PACK_BUFFER_ARB, pbo[i]->pbo );
+		check_error();
+		glReadPixels( 0, y, width, rows, GL_BGRA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0) );
+		check_error();
+		fences[i] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		check_error();
+	}
+	glFlush();
 
-	// Copy from PBO
-	uint8_t* buf = (uint8_t*) glMapBuffer( GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY );
-	check_error();
 	*image = (uint8_t*) mlt_pool_alloc( img_size );
 	mlt_frame_set_image( frame, *image, img_size, mlt_pool_release );
-	memcpy( *image, buf, img_size );
 
-	// Convert BGRA to RGBA
-	register uint8_t *p = *image;
-	register int n = width * height + 1;
-	while ( --n ) {
-		uint8_t b = p[0];
-		*p = p[2]; p += 2;
-		*p = b; p += 2;
+	// Copy from PBOs while converting BGRA to RGBA
+	for (int i = 0; i < bands; ++i) {
+		int y = i * band_height;
+		int rows = height - y < band_height ? height - y : band_height;
+		glClientWaitSync( fences[i], 0, GL_TIMEOUT_IGNORED );
+		glDeleteSync( fences[i] );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER_ARB, pbo[i]->pbo );
+		check_error();
+		uint8_t* buf = (uint8_t*) glMapBufferRange( GL_PIXEL_PACK_BUFFER_ARB, 0, rows * width * 4, GL_MAP_READ_BIT );
+		check_error();
+		if (buf)
+			copy_bgra_to_rgba( buf, *image + y * width * 4, rows * width );
+		glUnmapBuffer( GL_PIXEL_PACK_BUFFER_ARB );
+		check_error();
 	}
 
 	// Release PBO and FBO
-	glUnmapBuffer( GL_PIXEL_PACK_BUFFER_ARB );
-	check_error();
 	glBindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
 	check_error();
 	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
@@ -29,8 +29,26 @@
 #include <mlt++/MltDeque.h>
 #include <map>
 #include <string>
+#include <vector>
+#include <pthread.h>
 
 #define MAXLISTCOUNT 1024
+
+// The number of Movit chains that are kept for reuse
+#define GLSL_MAX_CHAINS 32
+
+// The number of horizontal bands, each with its own PBO, in which
+// render_frame_rgba() reads an image back
+#define GLSL_READBACK_BANDS 4
+
+// The default of the texture_budget property, in MiB of textures that each
+// thread's pool may keep (the textures in use are never deleted)
+#define GLSL_TEXTURE_BUDGET 512
+
+// The number of textures requested after which an unused one is deleted,
+// so that the textures of a previous resolution do not stay resident
+#define GLSL_TEXTURE_MAX_IDLE 250
+
 typedef struct glsl_list_s *glsl_list;
 struct glsl_list_s
 {
@@ -50,13 +68,17 @@ struct glsl_texture_s
 	int width;
 	int height;
 	GLint internal_format;
+	int size;
+	unsigned long last_use;
 };
 typedef struct glsl_texture_s *glsl_texture;
+typedef std::vector<glsl_texture> glsl_texture_bucket;
 
 struct glsl_pbo_s
 {
 	int size;
 	GLuint pbo;
+	int used;
 };
 typedef struct glsl_pbo_s *glsl_pbo;
 
@@ -81,12 +103,46 @@ struct GlslChain
 	// All services owned by the effect chain and their associated Movit effect.
 	std::map<mlt_service, movit::Effect*> effects;
 
-	// For each effect in the Movit graph, a unique identifier for the service
-	// and whether it's disabled or not, using post-order traversal.
-	// We need to generate the chain if and only if this has changed.
+	// The effects and inputs in the order they were added to the chain, so
+	// that another graph of services with the same structure can reuse it.
+	std::vector<movit::Effect*> effect_order;
+	std::vector<MltInput*> input_order;
+
+	// For each effect in the Movit graph, its type and whether it's disabled
+	// or not, and the format of each input, using post-order traversal.
+	// Parameter values are not part of it, since they are set per frame.
 	std::string fingerprint;
+
+	// When the chain was last used, to drop the oldest ones first
+	unsigned long last_use;
 };
 
+// The objects of one thread's OpenGL context. Each rendering thread has its
+// own context, sharing textures and buffers with the others, but chains hold
+// per-frame parameters and framebuffers that must not be shared.
+struct GlslContext
+{
+	GlslContext();
+
+	// The textures by size and format, remembering the last bucket used
+	// since a chain usually asks for the same size frame after frame
+	std::map<uint64_t, glsl_texture_bucket> textures;
+	uint64_t last_texture_key;
+	glsl_texture_bucket* last_bucket;
+	unsigned long texture_uses;
+	int64_t texture_bytes;
+	glsl_pbo pbos[GLSL_READBACK_BANDS];
+	// The pixel unpack buffers through which input images are uploaded
+	std::vector<glsl_pbo> upload_pbos;
+	std::map<std::string, GlslChain*> chains;
+	unsigned long chain_uses;
+	GLsync prev_sync;
+};
+
+// The manager exposes the statistics of the texture and PBO pools as the
+// read-only properties texture_hits, texture_allocations, texture_evictions,
+// texture_bytes and pbo_bytes. Setting texture_budget (MiB) limits the
+// textures kept by each thread's pool.
 class GlslManager : public Mlt::Filter
 {
 public:
@@ -98,13 +154,16 @@ public:
 	glsl_texture get_texture(int width, int height, GLint internal_format);
 	static void release_texture(glsl_texture);
 	static void delete_sync(GLsync sync);
-	glsl_pbo get_pbo(int size);
+	glsl_pbo get_pbo(int index, int size);
+	glsl_pbo get_upload_pbo(int size);
+	static void release_pbo(glsl_pbo);
+	GlslContext* get_context();
 	void cleanupContext();
 
 	movit::ResourcePool* get_resource_pool() { return resource_pool; }
 
-	static void set_chain(mlt_service, GlslChain*);
-	static GlslChain* get_chain(mlt_service);
+	static void set_chain(const std::string& fingerprint, GlslChain*);
+	static GlslChain* get_chain(const std::string& fingerprint);
 
 	static movit::Effect* get_effect(mlt_service, mlt_frame);
 	static movit::Effect* set_effect(mlt_service, mlt_frame, movit::Effect*);
@@ -112,6 +171,8 @@ public:
 	static MltInput* set_input(mlt_producer, mlt_frame, MltInput*);
 	static uint8_t* get_input_pixel_pointer(mlt_producer, mlt_frame);
 	static uint8_t* set_input_pixel_pointer(mlt_producer, mlt_frame, uint8_t*);
+	static glsl_pbo get_input_pbo(mlt_producer, mlt_frame);
+	static glsl_pbo set_input_pbo(mlt_producer, mlt_frame, glsl_pbo);
 
 	static mlt_service get_effect_input(mlt_service, mlt_frame);
 	static void set_effect_input(mlt_service, mlt_frame, mlt_service);
@@ -133,13 +194,20 @@ private:
 	static void onClose( mlt_properties owner, GlslManager* filter );
 	static void onServiceChanged( mlt_properties owner, mlt_service service );
 	static void onPropertyChanged( mlt_properties owner, mlt_service service, const char* property );
+	void deleteContext(GlslContext*);
+	void deleteTexture(GlslContext*, glsl_texture);
+	void evictTextures(GlslContext*);
+	void updateStats(int hits, int allocations, int evictions);
 	movit::ResourcePool* resource_pool;
-	Mlt::Deque texture_list;
 	Mlt::Deque syncs_to_delete;
-	glsl_pbo  pbo;
+	Mlt::Deque textures_to_delete;
+	std::vector<GlslContext*> contexts;
+	pthread_key_t context_key;
+	int64_t texture_hits;
+	int64_t texture_allocations;
+	int64_t texture_evictions;
 	Mlt::Event* initEvent;
 	Mlt::Event* closeEvent;
-	GLsync prev_sync;
 };
 
 #endif // GLSL_MANAGER_H
@@ -65,11 +65,6 @@ static int convert_on_cpu( mlt_frame frame, uint8_t **image, mlt_image_format *f
 	return error;
 }
 
-static void delete_chain( EffectChain* chain )
-{
-	delete chain;
-}
-
 // Copied from libavcodec, but we can not add that as a dependency to this module
 // simply for this.
 
@@ -196,7 +191,11 @@ static void get_format_from_properties( mlt_properties properties, ImageFormat*
 static void build_fingerprint( mlt_service service, mlt_frame frame, std::string *fingerprint )
 {
 	if ( service == (mlt_service) -1 ) {
+		mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
+		MltInput* input = GlslManager::get_input( producer, frame );
 		fingerprint->append( "input" );
+		if ( input )
+			input->append_fingerprint( fingerprint );
 		return;
 	}
 
@@ -223,8 +222,10 @@ static void build_fingerprint( mlt_service service, mlt_frame frame, std::string
 		fingerprint->push_back( ')' );
 	}
 
+	// The type of the effect rather than the service, so that services with
+	// the same effects share a chain
 	fingerprint->push_back( '(' );
-	fingerprint->append( mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "_unique_id" ) );
+	fingerprint->append( effect->effect_type_id() );
 
 	const char* effect_fingerprint = mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "_movit fingerprint" );
 	if ( effect_fingerprint ) {
@@ -248,6 +249,7 @@ static Effect* build_movit_chain( mlt_service service, mlt_frame frame, GlslChai
 		GlslManager::set_input( producer, frame, NULL );
 		chain->effect_chain->add_input( input->get_input() );
 		chain->inputs.insert(std::make_pair( producer, input ) );
+		chain->input_order.push_back( input );
 		return input->get_input();
 	}
 
@@ -274,9 +276,37 @@ static Effect* build_movit_chain( mlt_service service, mlt_frame frame, GlslChai
 	}
 		
 	chain->effects.insert(std::make_pair( service, effect ) );
+	chain->effect_order.push_back( effect );
 	return effect;
 }
 
+// Point the maps of a chain at the services of another graph with the same
+// structure, visiting them in the same order as build_movit_chain().
+static void map_movit_chain( mlt_service service, mlt_frame frame, GlslChain *chain, size_t *effect_index, size_t *input_index )
+{
+	if ( service == (mlt_service) -1 ) {
+		mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
+		if ( !chain->inputs.count( producer ) )
+			chain->inputs[ producer ] = chain->input_order[ *input_index ];
+		++*input_index;
+		return;
+	}
+
+	mlt_service input_a = GlslManager::get_effect_input( service, frame );
+	mlt_service input_b, input_c;
+	mlt_frame frame_b, frame_c;
+	GlslManager::get_effect_secondary_input( service, frame, &input_b, &frame_b );
+	GlslManager::get_effect_third_input( service, frame, &input_c, &frame_c );
+	map_movit_chain( input_a, frame, chain, effect_index, input_index );
+	if ( input_b ) {
+		map_movit_chain( input_b, frame_b, chain, effect_index, input_index );
+	}
+	if ( input_c && input_b ) {
+		map_movit_chain( input_c, frame_c, chain, effect_index, input_index );
+	}
+	chain->effects[ service ] = chain->effect_order[ (*effect_index)++ ];
+}
+
 static void dispose_movit_effects( mlt_service service, mlt_frame frame )
 {
 	if ( service == (mlt_service) -1 ) {
@@ -304,17 +334,20 @@ static void dispose_movit_effects( mlt_service service, mlt_frame frame )
 	}
 }
 
-static void finalize_movit_chain( mlt_service leaf_service, mlt_frame frame )
+static GlslChain* finalize_movit_chain( mlt_service leaf_service, mlt_frame frame )
 {
-	GlslChain* chain = GlslManager::get_chain( leaf_service );
+	mlt_profile profile = mlt_service_profile( leaf_service );
+	GammaCurve output_gamma = getGammaCurve( MLT_FRAME_PROPERTIES(frame) );
+	char prefix[64];
+	snprintf( prefix, sizeof(prefix), "%d:%d:%d", profile->display_aspect_num, profile->display_aspect_den, output_gamma );
 
-	std::string new_fingerprint;
+	std::string new_fingerprint( prefix );
 	build_fingerprint( leaf_service, frame, &new_fingerprint );
+	GlslChain* chain = GlslManager::get_chain( new_fingerprint );
 
 	// Build the chain if needed.
-	if ( !chain || new_fingerprint != chain->fingerprint ) {
-		mlt_log_debug( leaf_service, "=== CREATING NEW CHAIN (old chain=%p, leaf=%p, fingerprint=%s) ===\n", chain, leaf_service, new_fingerprint.c_str() );
-		mlt_profile profile = mlt_service_profile( leaf_service );
+	if ( !chain ) {
+		mlt_log_debug( leaf_service, "=== CREATING NEW CHAIN (leaf=%p, fingerprint=%s) ===\n", leaf_service, new_fingerprint.c_str() );
 		chain = new GlslChain;
 		chain->effect_chain = new EffectChain(
 			profile->display_aspect_num,
@@ -322,6 +355,7 @@ static void finalize_movit_chain( mlt_service leaf_service, mlt_frame frame )
 			GlslManager::get_instance()->get_resource_pool()
 		);
 		chain->fingerprint = new_fingerprint;
+		chain->last_use = 0;
 
 		build_movit_chain( leaf_service, frame, chain );
 		set_movit_parameters( chain, leaf_service, frame );
@@ -329,16 +363,24 @@ static void finalize_movit_chain( mlt_service leaf_service, mlt_frame frame )
 
 		ImageFormat output_format;
 		output_format.color_space = COLORSPACE_sRGB;
-		output_format.gamma_curve = getGammaCurve( MLT_FRAME_PROPERTIES(frame) );
+		output_format.gamma_curve = output_gamma;
 		chain->effect_chain->add_output(output_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
 		chain->effect_chain->set_dither_bits(8);
 		chain->effect_chain->finalize();
 
-		GlslManager::set_chain( leaf_service, chain );
+		GlslManager::set_chain( new_fingerprint, chain );
 	} else {
+		// The chain may have been built for other services with the same
+		// structure, so look up the effects of these ones.
+		size_t effect_index = 0, input_index = 0;
+		chain->effects.clear();
+		chain->inputs.clear();
+		map_movit_chain( leaf_service, frame, chain, &effect_index, &input_index );
+
 		// Delete all the created Effect instances to avoid memory leaks.
 		dispose_movit_effects( leaf_service, frame );
 	}
+	return chain;
 }
 
 static void set_movit_parameters( GlslChain *chain, mlt_service service, mlt_frame frame )
@@ -346,7 +388,10 @@ static void set_movit_parameters( GlslChain *chain, mlt_service service, mlt_fra
 	if ( service == (mlt_service) -1 ) {
 		mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
 		MltInput* input = chain->inputs[ producer ];
-		if (input)
+		glsl_pbo pbo = GlslManager::get_input_pbo( producer, frame );
+		if (input && pbo)
+			input->set_pixel_data( NULL, pbo->pbo );
+		else if (input)
 			input->set_pixel_data( GlslManager::get_input_pixel_pointer( producer, frame ) );
 		return;
 	}
@@ -427,6 +472,7 @@ static void dispose_pixel_pointers( GlslChain *chain, mlt_service service, mlt_f
 		if (input)
 			input->invalidate_pixel_data();
 		mlt_pool_release( GlslManager::get_input_pixel_pointer( producer, frame ) );
+		GlslManager::set_input_pbo( producer, frame, NULL );
 		return;
 	}
 
@@ -492,20 +538,72 @@ static MltInput* create_input( mlt_properties properties, mlt_image_format forma
 	return input;
 }
 
+// The size of an input image, which is planar if the image is yuv422.
+static int input_size( mlt_image_format format, int width, int height )
+{
+	// We use height-1 because mlt_image_format_size() uses height + 1.
+	// XXX Remove -1 when mlt_image_format_size() is changed.
+	return mlt_image_format_size( format, width, height - 1, NULL );
+}
+
+static void copy_input( mlt_image_format format, uint8_t *image, uint8_t *dst, int width, int height )
+{
+	if ( format == mlt_image_yuv422 ) {
+		yuv422_to_yuv422p( image, dst, width, height );
+	} else {
+		memcpy( dst, image, input_size( format, width, height ) );
+	}
+}
+
 // Make a copy of the given image (allocated using mlt_pool_alloc) suitable
 // to pass as pixel pointer to an MltInput (created using create_input
 // with the same parameters), and return that pointer.
 static uint8_t* make_input_copy( mlt_image_format format, uint8_t *image, int width, int height )
 {
-	// We use height-1 because mlt_image_format_size() uses height + 1.
-	// XXX Remove -1 when mlt_image_format_size() is changed.
-	int img_size = mlt_image_format_size( format, width, height - 1, NULL );
+	uint8_t* img_copy = (uint8_t*) mlt_pool_alloc( input_size( format, width, height ) );
+	copy_input( format, image, img_copy, width, height );
+	return img_copy;
+}
+
+// Write the same copy straight into a mapped pixel unpack buffer, so that
+// Movit uploads the texture from it without waiting on client memory.
+// Return NULL if there is no buffer, to fall back to make_input_copy().
+static glsl_pbo make_input_pbo( mlt_image_format format, uint8_t *image, int width, int height )
+{
+	int img_size = input_size( format, width, height );
+	glsl_pbo pbo = GlslManager::get_instance()->get_upload_pbo( img_size );
+	if ( !pbo )
+		return NULL;
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, pbo->pbo );
+	uint8_t* dst = (uint8_t*) glMapBufferRange( GL_PIXEL_UNPACK_BUFFER_ARB, 0, img_size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+	if ( dst ) {
+		copy_input( format, image, dst, width, height );
+		// The contents are lost if the buffer was corrupted while mapped.
+		if ( !glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER_ARB ) )
+			dst = NULL;
+	}
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
+	if ( !dst ) {
+		GlslManager::release_pbo( pbo );
+		return NULL;
+	}
+	return pbo;
+}
+
+// Read an input image back from its buffer when it is converted on the CPU.
+static uint8_t* read_input_pbo( glsl_pbo pbo, mlt_image_format format, int width, int height )
+{
+	int img_size = input_size( format, width, height );
 	uint8_t* img_copy = (uint8_t*) mlt_pool_alloc( img_size );
-	if ( format == mlt_image_yuv422 ) {
-		yuv422_to_yuv422p( image, img_copy, width, height );
-	} else {
-		memcpy( img_copy, image, img_size );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, pbo->pbo );
+	uint8_t* buf = (uint8_t*) glMapBufferRange( GL_PIXEL_UNPACK_BUFFER_ARB, 0, img_size, GL_MAP_READ_BIT );
+	if ( buf ) {
+		memcpy( img_copy, buf, img_size );
+		glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER_ARB );
 	}
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
 	return img_copy;
 }
 
@@ -542,8 +640,13 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 		mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
 		MltInput *input = create_input( properties, *format, profile->width, profile->height, width, height );
 		GlslManager::set_input( producer, frame, input );
-		uint8_t *img_copy = make_input_copy( *format, *image, width, height );
-		GlslManager::set_input_pixel_pointer( producer, frame, img_copy );
+		glsl_pbo pbo = make_input_pbo( *format, *image, width, height );
+		if ( pbo ) {
+			GlslManager::set_input_pbo( producer, frame, pbo );
+		} else {
+			uint8_t *img_copy = make_input_copy( *format, *image, width, height );
+			GlslManager::set_input_pixel_pointer( producer, frame, img_copy );
+		}
 
 		*image = (uint8_t *) -1;
 		mlt_frame_set_image( frame, *image, 0, NULL );
@@ -559,19 +662,25 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 			// just do the conversion and we're done.
 			mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
 			MltInput *input = GlslManager::get_input( producer, frame );
-			*image = GlslManager::get_input_pixel_pointer( producer, frame );
+			glsl_pbo pbo = GlslManager::get_input_pbo( producer, frame );
+			if ( pbo ) {
+				*image = read_input_pbo( pbo, input->get_format(), width, height );
+				mlt_frame_set_image( frame, *image, input_size( input->get_format(), width, height ), mlt_pool_release );
+				GlslManager::set_input_pbo( producer, frame, NULL );
+			} else {
+				*image = GlslManager::get_input_pixel_pointer( producer, frame );
+			}
 			*format = input->get_format();
 			delete input;
 			GlslManager::get_instance()->unlock_service( frame );
 			return convert_on_cpu( frame, image, format, output_format );
 		}
 
-		// Construct the chain unless we already have a good one.
-		finalize_movit_chain( leaf_service, frame );
+		// Construct the chain unless we already have one with the same structure.
+		GlslChain *chain = finalize_movit_chain( leaf_service, frame );
 
 		// Set per-frame parameters now that we know which Effect instances to set them on.
 		// (finalize_movit_chain may already have done this, though, but twice doesn't hurt.)
-		GlslChain *chain = GlslManager::get_chain( leaf_service );
 		set_movit_parameters( chain, leaf_service, frame );
 
 		error = movit_render( chain->effect_chain, frame, format, output_format, width, height, image );
@@ -592,32 +701,37 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 			mlt_frame_set_image( frame, *image, 0, NULL );
 		} else {
 			// Use a separate chain to convert image in RAM to OpenGL texture.
-			// Use cached chain if available and compatible.
-			Mlt::Producer producer( mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) ) );
-			EffectChain *chain = (EffectChain*) producer.get_data( "movit.convert.chain" );
-			MltInput *input = (MltInput*) producer.get_data( "movit.convert.input" );
-			int w = producer.get_int( "movit.convert.width" );
-			int h = producer.get_int( "movit.convert.height" );
-			mlt_image_format f = (mlt_image_format) producer.get_int( "movit.convert.format" );
-			if ( !chain || !input || width != w || height != h || *format != f ) {
-				chain = new EffectChain( width, height, GlslManager::get_instance()->get_resource_pool() );
-				input = create_input( properties, *format, width, height, width, height );
-				chain->add_input( input->get_input() );
-				chain->add_effect( new Mlt::VerticalFlip() );
+			// Use the cached chain of this thread if there is a compatible one.
+			GammaCurve output_gamma = getGammaCurve( properties );
+			char fingerprint[64];
+			snprintf( fingerprint, sizeof(fingerprint), "convert:%d:%d:%d:%d", width, height, *format, output_gamma );
+			GlslChain *glsl_chain = GlslManager::get_chain( fingerprint );
+			if ( !glsl_chain ) {
+				glsl_chain = new GlslChain;
+				glsl_chain->effect_chain = new EffectChain( width, height, GlslManager::get_instance()->get_resource_pool() );
+				glsl_chain->fingerprint = fingerprint;
+				glsl_chain->last_use = 0;
+				MltInput *input = create_input( properties, *format, width, height, width, height );
+				glsl_chain->input_order.push_back( input );
+				glsl_chain->effect_chain->add_input( input->get_input() );
+				glsl_chain->effect_chain->add_effect( new Mlt::VerticalFlip() );
 				ImageFormat movit_output_format;
 				movit_output_format.color_space = COLORSPACE_sRGB;
-				movit_output_format.gamma_curve = getGammaCurve( properties );
-				chain->add_output(movit_output_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
-				chain->set_dither_bits(8);
-				chain->finalize();
-				producer.set( "movit.convert.chain", chain, 0, (mlt_destructor) delete_chain );
-				producer.set( "movit.convert.input", input, 0, NULL );
-				producer.set( "movit.convert.width", width );
-				producer.set( "movit.convert.height", height );
-				producer.set( "movit.convert.format", *format );
+				movit_output_format.gamma_curve = output_gamma;
+				glsl_chain->effect_chain->add_output(movit_output_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+				glsl_chain->effect_chain->set_dither_bits(8);
+				glsl_chain->effect_chain->finalize();
+				GlslManager::set_chain( fingerprint, glsl_chain );
 			}
+			EffectChain *chain = glsl_chain->effect_chain;
+			MltInput *input = glsl_chain->input_order[0];
 
-			if ( *format == mlt_image_yuv422 ) {
+			glsl_pbo pbo = make_input_pbo( *format, *image, width, height );
+			if ( pbo ) {
+				input->set_pixel_data( NULL, pbo->pbo );
+				error = movit_render( chain, frame, format, output_format, width, height, image );
+				GlslManager::release_pbo( pbo );
+			} else if ( *format == mlt_image_yuv422 ) {
 				// We need to convert to planar, which make_input_copy() will do for us.
 				uint8_t *planar = make_input_copy( *format, *image, width, height );
 				input->set_pixel_data( planar );
@@ -19,10 +19,14 @@
 
 #include "mlt_movit_input.h"
 
+#include <stdio.h>
+
 using namespace movit;
 
 MltInput::MltInput( mlt_image_format format )
 	: m_format(format)
+	, m_width(0)
+	, m_height(0)
 	, input(0)
 	, isRGB(true)
 {
@@ -52,20 +56,22 @@ void MltInput::useYCbCrInput(const ImageFormat& image_format, const YCbCrFormat&
 		input = new YCbCrInput(image_format, ycbcr_format, width, height);
 		isRGB = false;
 		m_ycbcr_format = ycbcr_format;
+		m_image_format = image_format;
 	}
 }
 
-void MltInput::set_pixel_data(const unsigned char* data)
+void MltInput::set_pixel_data(const unsigned char* data, GLuint pbo)
 {
 	assert(input);
 	if (isRGB) {
 		FlatInput* flat = (FlatInput*) input;
-		flat->set_pixel_data(data);
+		flat->set_pixel_data(data, pbo);
 	} else {
+		// The planes are uploaded separately, nothing is converted to RGBA.
 		YCbCrInput* ycbcr = (YCbCrInput*) input;
-		ycbcr->set_pixel_data(0, data);
-		ycbcr->set_pixel_data(1, &data[m_width * m_height]);
-		ycbcr->set_pixel_data(2, &data[m_width * m_height + (m_width / m_ycbcr_format.chroma_subsampling_x * m_height / m_ycbcr_format.chroma_subsampling_y)]);
+		ycbcr->set_pixel_data(0, data, pbo);
+		ycbcr->set_pixel_data(1, data + m_width * m_height, pbo);
+		ycbcr->set_pixel_data(2, data + m_width * m_height + (m_width / m_ycbcr_format.chroma_subsampling_x * m_height / m_ycbcr_format.chroma_subsampling_y), pbo);
 	}
 }
 
@@ -80,3 +86,18 @@ void MltInput::invalidate_pixel_data()
 		ycbcr->invalidate_pixel_data();
 	}
 }
+
+void MltInput::append_fingerprint(std::string *fingerprint) const
+{
+	char buf[128];
+	if (isRGB)
+		snprintf(buf, sizeof(buf), "[%d %ux%u]", m_format, m_width, m_height);
+	else
+		snprintf(buf, sizeof(buf), "[%d %ux%u %d %d %d %d %d %d %g %g %g %g]", m_format, m_width, m_height,
+			m_image_format.color_space, m_image_format.gamma_curve,
+			m_ycbcr_format.luma_coefficients, m_ycbcr_format.full_range,
+			m_ycbcr_format.chroma_subsampling_x, m_ycbcr_format.chroma_subsampling_y,
+			m_ycbcr_format.cb_x_position, m_ycbcr_format.cb_y_position,
+			m_ycbcr_format.cr_x_position, m_ycbcr_format.cr_y_position);
+	fingerprint->append(buf);
+}
@@ -26,6 +26,8 @@
 #include <movit/ycbcr_input.h>
 #include <movit/effect_chain.h>
 
+#include <string>
+
 class MltInput
 {
 public:
@@ -34,7 +36,8 @@ public:
 
 	void useFlatInput(movit::MovitPixelFormat pix_fmt, unsigned width, unsigned height);
 	void useYCbCrInput(const movit::ImageFormat& image_format, const movit::YCbCrFormat& ycbcr_format, unsigned width, unsigned height);
-	void set_pixel_data(const unsigned char* data);
+	// With a pixel unpack buffer, data is the offset of the image in it.
+	void set_pixel_data(const unsigned char* data, GLuint pbo = 0);
 	void invalidate_pixel_data();
 	movit::Input *get_input() { return input; }
 
@@ -42,6 +45,9 @@ public:
 	// in case we change our mind later and want to convert on the CPU instead.
 	mlt_image_format get_format() const { return m_format; }
 
+	// Append everything that is fixed when the input is created.
+	void append_fingerprint(std::string *fingerprint) const;
+
 private:
 	mlt_image_format m_format;
 	unsigned m_width, m_height;
@@ -49,6 +55,7 @@ private:
 	movit::Input *input;
 	bool isRGB;
 	movit::YCbCrFormat m_ycbcr_format;
+	movit::ImageFormat m_image_format;
 };
 
 #endif // MLT_MOVIT_INPUT_H
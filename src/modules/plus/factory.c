@@ -29,6 +29,7 @@ extern mlt_filter filter_dynamic_loudness_init( mlt_profile profile, mlt_service
 extern mlt_filter filter_lift_gamma_gain_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_loudness_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_loudness_meter_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_filter filter_lut3d_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_lumakey_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_invert_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_rgblut_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
@@ -39,6 +40,7 @@ extern mlt_filter filter_timer_init( mlt_profile profile, mlt_service_type type,
 extern mlt_producer producer_blipflash_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_producer producer_count_init( const char *arg );
 extern mlt_transition transition_affine_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_transition transition_vqm_measure_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 
 #ifdef USE_FFTW
 extern mlt_filter filter_dance_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
@@ -64,6 +66,7 @@ MLT_REPOSITORY
 	MLT_REGISTER( filter_type, "loudness", filter_loudness_init );
 	MLT_REGISTER( filter_type, "loudness_meter", filter_loudness_meter_init );
 	MLT_REGISTER( filter_type, "lumakey", filter_lumakey_init );
+	MLT_REGISTER( filter_type, "lut3d", filter_lut3d_init );
 	MLT_REGISTER( filter_type, "rgblut", filter_rgblut_init );
 	MLT_REGISTER( filter_type, "sepia", filter_sepia_init );
 	MLT_REGISTER( filter_type, "spot_remover", filter_spot_remover_init );
@@ -72,6 +75,7 @@ MLT_REPOSITORY
 	MLT_REGISTER( producer_type, "blipflash", producer_blipflash_init );
 	MLT_REGISTER( producer_type, "count", producer_count_init );
 	MLT_REGISTER( transition_type, "affine", transition_affine_init );
+	MLT_REGISTER( transition_type, "vqm_measure", transition_vqm_measure_init );
 #ifdef USE_FFTW
 	MLT_REGISTER( filter_type, "dance", filter_dance_init );
 	MLT_REGISTER( filter_type, "fft", filter_fft_init );
@@ -87,6 +91,7 @@ MLT_REPOSITORY
 	MLT_REGISTER_METADATA( filter_type, "loudness", metadata, "filter_loudness.yml" );
 	MLT_REGISTER_METADATA( filter_type, "loudness_meter", metadata, "filter_loudness_meter.yml" );
 	MLT_REGISTER_METADATA( filter_type, "lumakey", metadata, "filter_lumakey.yml" );
+	MLT_REGISTER_METADATA( filter_type, "lut3d", metadata, "filter_lut3d.yml" );
 	MLT_REGISTER_METADATA( filter_type, "rgblut", metadata, "filter_rgblut.yml" );
 	MLT_REGISTER_METADATA( filter_type, "sepia", metadata, "filter_sepia.yml" );
 	MLT_REGISTER_METADATA( filter_type, "spot_remover", metadata, "filter_spot_remover.yml" );
@@ -95,6 +100,7 @@ MLT_REPOSITORY
 	MLT_REGISTER_METADATA( producer_type, "blipflash", metadata, "producer_blipflash.yml" );
 	MLT_REGISTER_METADATA( producer_type, "count", metadata, "producer_count.yml" );
 	MLT_REGISTER_METADATA( transition_type, "affine", metadata, "transition_affine.yml" );
+	MLT_REGISTER_METADATA( transition_type, "vqm_measure", metadata, "transition_vqm_measure.yml" );
 #ifdef USE_FFTW
 	MLT_REGISTER_METADATA( filter_type, "dance", metadata, "filter_dance.yml" );
 	MLT_REGISTER_METADATA( filter_type, "fft", metadata, "filter_fft.yml" );
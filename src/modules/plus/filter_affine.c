@@ -102,7 +102,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		mlt_frame_get_image( a_frame, image, format, width, height, writable );
 		mlt_properties_set_data( frame_properties, "affine_frame", a_frame, 0, (mlt_destructor)mlt_frame_close, NULL );
 		mlt_frame_set_image( frame, *image, *width * *height * 4, NULL );
-		mlt_frame_set_alpha( frame, mlt_frame_get_alpha_mask( a_frame ), *width * *height, NULL );
+		mlt_frame_set_alpha( frame, mlt_frame_get_alpha( a_frame ), *width * *height, NULL );
 	}
 	else
 	{
@@ -19,47 +19,177 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
+#include <framework/mlt_pool.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
-static inline int get_Y( uint8_t *pixels, int width, int height, int x, int y )
+// Do not filter bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (16)
+
+// The luma outside of the image
+#define BORDER_Y (235)
+
+// The largest gradient magnitude of 8 bit luma
+#define MAX_MAGNITUDE (1443)
+
+struct charcoal_slice_desc
 {
-	if ( x < 0 || x >= width || y < 0 || y >= height )
+	uint8_t *image;
+	uint8_t *output;
+	uint8_t *plane;     // the luma padded by the scatter on every side
+	int width;
+	int height;
+	int stride;
+	int x_scatter;
+	int y_scatter;
+	uint8_t luma[ MAX_MAGNITUDE + 1 ];
+	uint8_t chroma[ 256 ];
+};
+
+typedef void (*magnitude_function)( const uint8_t *top, const uint8_t *middle, const uint8_t *bottom, int scatter, int count, uint16_t *out );
+
+/** Compute the gradient magnitude of a row from the rows above and below it.
+ *
+ * The square root of an integer below 2^24 is exact enough in float that
+ * truncating it gives the integer square root.
+ */
+
+static void magnitude_row_c( const uint8_t *top, const uint8_t *middle, const uint8_t *bottom, int scatter, int count, uint16_t *out )
+{
+	int x;
+	for ( x = 0; x < count; x++ )
 	{
-		return 235;
+		int sum1 = ( bottom[ x - scatter ] - top[ x - scatter ] ) + ( ( bottom[ x ] - top[ x ] ) << 1 ) + ( bottom[ x + scatter ] - bottom[ x - scatter ] );
+		int sum2 = ( top[ x + scatter ] - top[ x - scatter ] ) + ( ( middle[ x + scatter ] - middle[ x - scatter ] ) << 1 ) + ( bottom[ x + scatter ] - bottom[ x - scatter ] );
+		out[ x ] = sqrtf( sum1 * sum1 + sum2 * sum2 );
 	}
-	else
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define CHARCOAL_SSE2 __attribute__((target("sse2")))
+
+static CHARCOAL_SSE2 inline __m128i load_epi16( const uint8_t *p )
+{
+	return _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) p ), _mm_setzero_si128() );
+}
+
+static CHARCOAL_SSE2 inline __m128i magnitude_epi32( __m128i sums )
+{
+	__m128i square = _mm_madd_epi16( sums, sums );
+	return _mm_cvttps_epi32( _mm_sqrt_ps( _mm_cvtepi32_ps( square ) ) );
+}
+
+static CHARCOAL_SSE2 void magnitude_row_sse2( const uint8_t *top, const uint8_t *middle, const uint8_t *bottom, int scatter, int count, uint16_t *out )
+{
+	int x;
+
+	for ( x = 0; x + 8 <= count; x += 8 )
 	{
-		uint8_t *pixel = pixels + y * ( width << 1 ) + ( x << 1 );
-		return *pixel;
+		__m128i tl = load_epi16( top + x - scatter );
+		__m128i tc = load_epi16( top + x );
+		__m128i tr = load_epi16( top + x + scatter );
+		__m128i ml = load_epi16( middle + x - scatter );
+		__m128i mr = load_epi16( middle + x + scatter );
+		__m128i bl = load_epi16( bottom + x - scatter );
+		__m128i bc = load_epi16( bottom + x );
+		__m128i br = load_epi16( bottom + x + scatter );
+		__m128i sum1 = _mm_add_epi16( _mm_add_epi16( _mm_sub_epi16( bl, tl ), _mm_slli_epi16( _mm_sub_epi16( bc, tc ), 1 ) ), _mm_sub_epi16( br, bl ) );
+		__m128i sum2 = _mm_add_epi16( _mm_add_epi16( _mm_sub_epi16( tr, tl ), _mm_slli_epi16( _mm_sub_epi16( mr, ml ), 1 ) ), _mm_sub_epi16( br, bl ) );
+
+		// Pair the sums to square and add them in 32 bits
+		__m128i lo = magnitude_epi32( _mm_unpacklo_epi16( sum1, sum2 ) );
+		__m128i hi = magnitude_epi32( _mm_unpackhi_epi16( sum1, sum2 ) );
+		_mm_storeu_si128( (__m128i*) ( out + x ), _mm_packs_epi32( lo, hi ) );
 	}
+	magnitude_row_c( top + x, middle + x, bottom + x, scatter, count - x, out + x );
+}
+
+static magnitude_function magnitude_simd_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return magnitude_row_sse2;
+	return magnitude_row_c;
 }
 
-static inline int sqrti( int n )
+#else
+
+static magnitude_function magnitude_simd_detect( void )
 {
-	int p = 0;
-	int q = 1;
-	int r = n;
-	int h = 0;
+	return magnitude_row_c;
+}
 
-	while( q <= n )
-		q = q << 2;
+#endif
+
+/** Copy the luma of a band of rows into the padded plane.
+*/
 
-	while( q != 1 )
+static int pad_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct charcoal_slice_desc *desc = (struct charcoal_slice_desc *) cookie;
+	int x_pad = abs( desc->x_scatter );
+	int y_pad = abs( desc->y_scatter );
+	int rows = desc->height + 2 * y_pad;
+	int y = rows * index / jobs;
+	int yend = rows * ( index + 1 ) / jobs;
+	int x;
+
+	for ( ; y < yend; y++ )
 	{
-		q = q >> 2;
-		h = p + q;
-		p = p >> 1;
-		if ( r >= h )
+		uint8_t *row = desc->plane + y * desc->stride;
+
+		if ( y < y_pad || y >= y_pad + desc->height )
 		{
-			p = p + q;
-			r = r - h;
+			memset( row, BORDER_Y, desc->stride );
+		}
+		else
+		{
+			uint8_t *pixel = desc->image + ( y - y_pad ) * desc->width * 2;
+			memset( row, BORDER_Y, x_pad );
+			for ( x = 0; x < desc->width; x++, pixel += 2 )
+				row[ x_pad + x ] = *pixel;
+			memset( row + x_pad + desc->width, BORDER_Y, x_pad );
 		}
 	}
+	return 0;
+}
+
+static int charcoal_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct charcoal_slice_desc *desc = (struct charcoal_slice_desc *) cookie;
+	static magnitude_function magnitude_row = NULL;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	uint16_t *magnitude = mlt_pool_alloc( w * sizeof( *magnitude ) );
+	uint8_t *origin = desc->plane + abs( desc->y_scatter ) * desc->stride + abs( desc->x_scatter );
+	int x;
+
+	if ( !magnitude_row )
+		magnitude_row = magnitude_simd_detect();
 
-	return p;
+	for ( ; y < yend; y++ )
+	{
+		const uint8_t *middle = origin + y * desc->stride;
+		const uint8_t *chroma = desc->image + y * w * 2 + 1;
+		uint8_t *p = desc->output + y * w * 2;
+
+		magnitude_row( middle - desc->y_scatter * desc->stride, middle, middle + desc->y_scatter * desc->stride, desc->x_scatter, w, magnitude );
+		for ( x = 0; x < w; x++, chroma += 2 )
+		{
+			*p ++ = desc->luma[ magnitude[ x ] ];
+			*p ++ = desc->chroma[ *chroma ];
+		}
+	}
+	mlt_pool_release( magnitude );
+	return 0;
 }
 
 /** Do it :-).
@@ -80,64 +210,56 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	// Only process if we have no error and a valid colour space
 	if ( error == 0 )
 	{
+		struct charcoal_slice_desc desc;
+
 		// Get the charcoal scatter value
 		int x_scatter = mlt_properties_anim_get_double( properties, "x_scatter", position, length );
 		int y_scatter = mlt_properties_anim_get_double( properties, "y_scatter", position, length );
 		float scale = mlt_properties_anim_get_double( properties, "scale" ,position, length);
 		float mix = mlt_properties_anim_get_double( properties, "mix", position, length);
 		int invert = mlt_properties_anim_get_int( properties, "invert", position, length);
+		int i;
 
-		// We'll process pixel by pixel
-		int x = 0;
-		int y = 0;
+		// Every neighbour is outside of the image past its size
+		desc.x_scatter = CLAMP( x_scatter, -*width, *width );
+		desc.y_scatter = CLAMP( y_scatter, -*height, *height );
+		desc.image = *image;
+		desc.width = *width;
+		desc.height = *height;
+		desc.stride = *width + 2 * abs( desc.x_scatter );
 
 		// We need to create a new frame as this effect modifies the input
-		uint8_t *temp = mlt_pool_alloc( *width * *height * 2 );
-		uint8_t *p = temp;
-		uint8_t *q = *image;
-
-		// Calculations are carried out on a 3x3 matrix
-		int matrix[ 3 ][ 3 ];
+		desc.output = mlt_pool_alloc( *width * *height * 2 );
+		desc.plane = mlt_pool_alloc( desc.stride * ( *height + 2 * abs( desc.y_scatter ) ) );
 
-		// Used to carry out the matrix calculations
-		int sum1;
-		int sum2;
-		float sum;
-		int val;
+		// Map the gradient magnitude and the chroma once for the frame
+		for ( i = 0; i <= MAX_MAGNITUDE; i++ )
+		{
+			float sum = scale * i;
+			desc.luma[ i ] = !invert ? ( sum >= 16 && sum <= 235 ? 251 - sum : sum < 16 ? 235 : 16 ) :
+									   ( sum >= 16 && sum <= 235 ? sum : sum < 16 ? 16 : 235 );
+		}
+		for ( i = 0; i < 256; i++ )
+		{
+			int val = 128 + mix * ( i - 128 );
+			desc.chroma[ i ] = val < 16 ? 16 : val > 240 ? 240 : val;
+		}
 
-		// Loop for each row
-		for ( y = 0; y < *height; y ++ )
+		int jobs = MIN( mlt_slices_count_normal(), *height / MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+		{
+			mlt_slices_run_normal( jobs, pad_slice_proc, &desc );
+			mlt_slices_run_normal( jobs, charcoal_slice_proc, &desc );
+		}
+		else
 		{
-			// Loop for each pixel
-			for ( x = 0; x < *width; x ++ )
-			{
-				// Populate the matrix
-				matrix[ 0 ][ 0 ] = get_Y( *image, *width, *height, x - x_scatter, y - y_scatter );
-				matrix[ 0 ][ 1 ] = get_Y( *image, *width, *height, x            , y - y_scatter );
-				matrix[ 0 ][ 2 ] = get_Y( *image, *width, *height, x + x_scatter, y - y_scatter );
-				matrix[ 1 ][ 0 ] = get_Y( *image, *width, *height, x - x_scatter, y             );
-				matrix[ 1 ][ 2 ] = get_Y( *image, *width, *height, x + x_scatter, y             );
-				matrix[ 2 ][ 0 ] = get_Y( *image, *width, *height, x - x_scatter, y + y_scatter );
-				matrix[ 2 ][ 1 ] = get_Y( *image, *width, *height, x            , y + y_scatter );
-				matrix[ 2 ][ 2 ] = get_Y( *image, *width, *height, x + x_scatter, y + y_scatter );
-
-				// Do calculations
-				sum1 = (matrix[2][0] - matrix[0][0]) + ( (matrix[2][1] - matrix[0][1]) << 1 ) + (matrix[2][2] - matrix[2][0]);
-				sum2 = (matrix[0][2] - matrix[0][0]) + ( (matrix[1][2] - matrix[1][0]) << 1 ) + (matrix[2][2] - matrix[2][0]);
-				sum = scale * sqrti( sum1 * sum1 + sum2 * sum2 );
-
-				// Assign value
-				*p ++ = !invert ? ( sum >= 16 && sum <= 235 ? 251 - sum : sum < 16 ? 235 : 16 ) :
-								  ( sum >= 16 && sum <= 235 ? sum : sum < 16 ? 16 : 235 );
-				q ++;
-				val = 128 + mix * ( *q ++ - 128 );
-				val = val < 16 ? 16 : val > 240 ? 240 : val;
-				*p ++ = val;
-			}
+			pad_slice_proc( 0, 0, 1, &desc );
+			charcoal_slice_proc( 0, 0, 1, &desc );
 		}
+		mlt_pool_release( desc.plane );
 
 		// Return the created image
-		*image = temp;
+		*image = desc.output;
 
 		// Store new and destroy old
 		mlt_frame_set_image( frame, *image, *width * *height * 2, mlt_pool_release );
@@ -33,12 +33,21 @@ typedef struct
 	int reset;
 	unsigned int time_elapsed_ms;
 	mlt_position prev_o_pos;
+	/* The lookahead delays the audio in this ring, so that the gain for a
+	 * block has been measured on the audio up to lookahead after it.
+	 */
+	float* ring;
+	int ring_size;      ///< the capacity of the ring in samples of all channels
+	int ring_start;     ///< the first sample in the ring
+	int ring_count;     ///< the number of samples in the ring
+	int channels;
+	int frequency;
 } private_data;
 
 static void property_changed( mlt_service owner, mlt_filter filter, char *name )
 {
 	private_data* pdata = (private_data*)filter->child;
-	if ( !strcmp( name, "window" ) )
+	if ( !strcmp( name, "window" ) || !strcmp( name, "lookahead" ) )
 	{
 		pdata->reset = 1;
 	}
@@ -62,11 +71,33 @@ static void check_for_reset( mlt_filter filter, int channels, int frequency )
 		pdata->reset = 0;
 		pdata->time_elapsed_ms = 0;
 		pdata->prev_o_pos = -1;
+		pdata->ring_start = 0;
+		pdata->ring_count = -1;
 		mlt_properties_set_double( properties, "out_gain", 0.0 );
 		mlt_properties_set_double( properties, "in_loudness", -100.0 );
 		mlt_properties_set_int( properties, "reset_count", mlt_properties_get_int( properties, "reset_count") + 1 );
 	}
 
+	if( pdata->ring_count < 0 || channels != pdata->channels || frequency != pdata->frequency )
+	{
+		// Start the lookahead with silence
+		pdata->ring_start = 0;
+		pdata->ring_count = lrint( mlt_properties_get_double( properties, "lookahead" ) * frequency ) * channels;
+		if( pdata->ring_count < 0 )
+			pdata->ring_count = 0;
+		if( pdata->ring_count > pdata->ring_size )
+		{
+			free( pdata->ring );
+			pdata->ring = malloc( pdata->ring_count * sizeof( float ) );
+			pdata->ring_size = pdata->ring ? pdata->ring_count : 0;
+			pdata->ring_count = pdata->ring_size;
+		}
+		if( pdata->ring_count )
+			memset( pdata->ring, 0, pdata->ring_count * sizeof( float ) );
+		pdata->channels = channels;
+		pdata->frequency = frequency;
+	}
+
 	if( !pdata->r128 )
 	{
 		pdata->r128 = ebur128_init( channels, frequency, EBUR128_MODE_I );
@@ -132,6 +163,86 @@ static void analyze_audio( mlt_filter filter, void* buffer, int samples, int fre
 	mlt_properties_set_double( properties, "out_gain", pdata->end_gain );
 }
 
+/** Put the samples of a frame at the end of the ring and take as many from
+ * the start of the ring in their place, making the ring larger as needed.
+ */
+
+static void delay_audio( private_data* pdata, float* buffer, int count )
+{
+	int n, i;
+
+	if( pdata->ring_count + count > pdata->ring_size )
+	{
+		int size = pdata->ring_count + count;
+		float* ring = malloc( size * sizeof( float ) );
+		if( !ring )
+			return;
+		// Straighten the ring out as it is copied
+		n = pdata->ring_size - pdata->ring_start;
+		if( n > pdata->ring_count )
+			n = pdata->ring_count;
+		memcpy( ring, pdata->ring + pdata->ring_start, n * sizeof( float ) );
+		memcpy( ring + n, pdata->ring, ( pdata->ring_count - n ) * sizeof( float ) );
+		free( pdata->ring );
+		pdata->ring = ring;
+		pdata->ring_size = size;
+		pdata->ring_start = 0;
+	}
+
+	// Append the new samples after the ones in the ring
+	for( i = 0; i < count; i += n )
+	{
+		int end = ( pdata->ring_start + pdata->ring_count + i ) % pdata->ring_size;
+		n = MIN( count - i, pdata->ring_size - end );
+		memcpy( pdata->ring + end, buffer + i, n * sizeof( float ) );
+	}
+
+	// And take as many from the start, which leaves the new ones at the end
+	for( i = 0; i < count; i += n )
+	{
+		n = MIN( count - i, pdata->ring_size - pdata->ring_start );
+		memcpy( buffer + i, pdata->ring + pdata->ring_start, n * sizeof( float ) );
+		pdata->ring_start = ( pdata->ring_start + n ) % pdata->ring_size;
+	}
+}
+
+/** Apply a gain that goes linearly from start to end over the samples.
+ *
+ * The gain of each sample is computed from its index, so the loops carry no
+ * dependency and the compiler vectorises them.
+ */
+
+static void apply_gain( float* p, int samples, int channels, float start, float end )
+{
+	float step = samples > 0 ? ( end - start ) / samples : 0.0f;
+	int i, j;
+
+	if( step == 0.0f )
+	{
+		int n = samples * channels;
+		for( i = 0; i < n; i++ )
+			p[i] *= start;
+	}
+	else if( channels == 2 )
+	{
+		for( i = 0; i < samples; i++ )
+		{
+			float g = start + step * ( i + 1 );
+			p[2 * i] *= g;
+			p[2 * i + 1] *= g;
+		}
+	}
+	else
+	{
+		for( i = 0; i < samples; i++, p += channels )
+		{
+			float g = start + step * ( i + 1 );
+			for( j = 0; j < channels; j++ )
+				p[j] *= g;
+		}
+	}
+}
+
 static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
 	mlt_filter filter = mlt_frame_pop_audio( frame );
@@ -158,24 +269,17 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	{
 		// Only analyze the audio is the producer is not paused.
 		analyze_audio( filter, *buffer, *samples, *frequency );
+
+		// Analyze ahead of the audio that the gain is applied to
+		if( pdata->ring_count > 0 )
+			delay_audio( pdata, *buffer, *samples * *channels );
 	}
 
+	// The gain changes by a fraction of a dB per frame, so a linear ramp of
+	// the coefficient is as good as an exponential one.
 	double start_coeff = pdata->start_gain > -90.0 ? pow(10.0, pdata->start_gain / 20.0) : 0.0;
 	double end_coeff = pdata->end_gain > -90.0 ? pow(10.0, pdata->end_gain / 20.0) : 0.0;
-	double coeff_factor = pow( (end_coeff / start_coeff), 1.0 / (double)*samples );
-	double coeff = start_coeff;
-	float* p = *buffer;
-	int s = 0;
-	int c = 0;
-	for( s = 0; s < *samples; s++ )
-	{
-		coeff = coeff * coeff_factor;
-		for ( c = 0; c < *channels; c++ )
-		{
-			*p = *p * coeff;
-			p++;
-		}
-	}
+	apply_gain( *buffer, *samples, *channels, start_coeff, end_coeff );
 
 	pdata->prev_o_pos = o_pos;
 
@@ -207,6 +311,7 @@ static void filter_close( mlt_filter filter )
 		{
 			ebur128_destroy( &pdata->r128 );
 		}
+		free( pdata->ring );
 		free( pdata );
 	}
 	filter->child = NULL;
@@ -231,6 +336,7 @@ mlt_filter filter_dynamic_loudness_init( mlt_profile profile, mlt_service_type t
 		mlt_properties_set( properties, "max_gain", "15.0" );
 		mlt_properties_set( properties, "min_gain", "-15.0" );
 		mlt_properties_set( properties, "max_rate", "3.0" );
+		mlt_properties_set( properties, "lookahead", "0.0" );
 		mlt_properties_set( properties, "in_loudness", "-100.0" );
 		mlt_properties_set( properties, "out_gain", "0.0" );
 		mlt_properties_set( properties, "reset_count", "0" );
@@ -20,7 +20,9 @@
 #include <framework/mlt.h>
 #include <stdlib.h> // calloc(), free()
 #include <string.h> // memset(), memmove()
+#include <stdio.h>  // snprintf()
 #include <math.h>   // sqrt()
+#include <pthread.h>
 #include <fftw3.h>
 
 // Private Constants
@@ -29,21 +31,125 @@ static const int MIN_WINDOW_SIZE = 500;
 static const double PI = 3.14159265358979323846;
 
 // Private Types
+typedef struct shared_plan_s
+{
+	struct shared_plan_s* next;
+	unsigned int window_size;
+	int refs;
+	fftw_plan plan;
+	double* hann;
+} shared_plan;
+
 typedef struct
 {
 	int initialized;
 	unsigned int window_size;
 	double* fft_in;
 	fftw_complex* fft_out;
-	fftw_plan fft_plan;
+	shared_plan* fft_plan;
 	int bin_count;
 	int sample_buff_count;
 	float* sample_buff;
-	float* hann;
 	float* out_bins;
 	mlt_position expected_pos;
 } private_data;
 
+// The analysis of a frame, kept on the frame for other FFT filters of the same window
+typedef struct
+{
+	unsigned int window_size;
+	float* sample_buff;
+	float* bins;
+} shared_result;
+
+// The plans are shared by all filters because FFTW planning is slow and not thread-safe.
+static pthread_mutex_t plans_mutex = PTHREAD_MUTEX_INITIALIZER;
+static shared_plan* plans = NULL;
+static int wisdom_loaded = 0;
+
+/** Get a plan for a window size from the process-wide cache, creating it if needed.
+
+    When the environment variable MLT_FFTW_WISDOM names a file, the wisdom
+    in it is imported, new plans are measured instead of estimated, and the
+    wisdom is saved back so that the next process plans instantly.
+*/
+
+static shared_plan* get_plan( unsigned int window_size )
+{
+	const char* wisdom = getenv( "MLT_FFTW_WISDOM" );
+	shared_plan* plan;
+
+	pthread_mutex_lock( &plans_mutex );
+	for ( plan = plans; plan && plan->window_size != window_size; plan = plan->next );
+	if ( !plan && ( plan = calloc( 1, sizeof( *plan ) ) ) )
+	{
+		// Plan with scratch arrays because measuring overwrites them
+		double* in = fftw_alloc_real( window_size );
+		fftw_complex* out = fftw_alloc_complex( window_size / 2 + 1 );
+		unsigned int flags = FFTW_ESTIMATE;
+		unsigned int i;
+
+		if ( wisdom && wisdom[0] )
+		{
+			if ( !wisdom_loaded )
+				wisdom_loaded = fftw_import_wisdom_from_filename( wisdom ) ? 1 : -1;
+			flags = FFTW_MEASURE;
+		}
+		plan->window_size = window_size;
+		plan->hann = fftw_alloc_real( window_size );
+		if ( in && out && plan->hann )
+			plan->plan = fftw_plan_dft_r2c_1d( window_size, in, out, flags );
+		if ( plan->plan && flags == FFTW_MEASURE )
+			fftw_export_wisdom_to_filename( wisdom );
+		fftw_free( in );
+		fftw_free( out );
+		if ( plan->plan )
+		{
+			// Initialize the hanning window function
+			for ( i = 0; i < window_size; i++ )
+				plan->hann[i] = 0.5 * ( 1 - cos( 2 * PI * i / window_size ) );
+			plan->next = plans;
+			plans = plan;
+		}
+		else
+		{
+			fftw_free( plan->hann );
+			free( plan );
+			plan = NULL;
+		}
+	}
+	if ( plan )
+		plan->refs++;
+	pthread_mutex_unlock( &plans_mutex );
+	return plan;
+}
+
+static void release_plan( shared_plan* plan )
+{
+	shared_plan** p;
+
+	if ( !plan )
+		return;
+	pthread_mutex_lock( &plans_mutex );
+	if ( --plan->refs == 0 )
+	{
+		for ( p = &plans; *p != plan; p = &(*p)->next );
+		*p = plan->next;
+		fftw_destroy_plan( plan->plan );
+		fftw_free( plan->hann );
+		free( plan );
+	}
+	pthread_mutex_unlock( &plans_mutex );
+}
+
+static void destroy_shared_result( void* ptr )
+{
+	shared_result* result = (shared_result*)ptr;
+	mlt_pool_release( result->sample_buff );
+	mlt_pool_release( result->bins );
+	free( result );
+}
+
 static int initFft( mlt_filter filter )
 {
 	int error = 0;
@@ -66,15 +172,7 @@ static int initFft( mlt_filter filter )
 			// Initialize fftw variables
 			private->fft_in = fftw_alloc_real( private->window_size );
 			private->fft_out = fftw_alloc_complex( private->bin_count );
-			private->fft_plan = fftw_plan_dft_r2c_1d( private->window_size, private->fft_in, private->fft_out, FFTW_ESTIMATE );
-
-			// Initialize the hanning window function
-			private->hann = mlt_pool_alloc( private->window_size * sizeof(*private->hann));
-			int i = 0;
-			for ( i = 0; i < private->window_size; i++ )
-			{
-				private->hann[i] = 0.5 * (1 - cos( 2 * PI * i / private->window_size ) );
-			}
+			private->fft_plan = get_plan( private->window_size );
 
 			mlt_properties_set_int( filter_properties, "bin_count", private->bin_count );
 			mlt_properties_set_data( filter_properties, "bins", private->out_bins, 0, 0, 0 );
@@ -146,34 +244,33 @@ static int filter_get_audio( mlt_frame frame, void** buffer, mlt_audio_format* f
 		// Zero out the space for the new samples
 		memset( private->sample_buff + old_samples, 0, sizeof(*private->sample_buff) * new_samples );
 
-		// Copy the new samples into the sample buffer
+		// Copy the new samples into the sample buffer as the average of all
+		// channels. The loops only depend on the sample index, so they are
+		// vectorized.
+		float* restrict dst = private->sample_buff + old_samples;
 		if( *format == mlt_audio_s16 )
 		{
-			int16_t* aud = (int16_t*)*buffer;
-			// For each sample, add all channels
+			const int16_t* restrict aud = (int16_t*)*buffer;
+			// Scale to +/-1
+			const float scale = 1.0 / ( MAX_S16_AMPLITUDE * *channels );
 			for( c = 0; c < *channels; c++ )
 			{
 				for( s = 0; s < new_samples; s++ )
 				{
-					double sample = aud[s * *channels + c];
-					// Scale to +/-1
-					sample /= MAX_S16_AMPLITUDE;
-					sample /= (double)*channels;
-					private->sample_buff[old_samples + s] += sample;
+					dst[s] += aud[s * *channels + c] * scale;
 				}
 			}
 		}
 		else if( *format == mlt_audio_float )
 		{
-			float* aud = (float*)*buffer;
-			// For each sample, add all channels
+			const float* restrict aud = (float*)*buffer;
+			const float scale = 1.0 / *channels;
 			for( c = 0; c < *channels; c++ )
 			{
+				const float* restrict src = aud + c * *samples;
 				for( s = 0; s < new_samples; s++ )
 				{
-					double sample = aud[c * *samples + s];
-					sample /= (double)*channels;
-					private->sample_buff[old_samples + s] += sample;
+					dst[s] += src[s] * scale;
 				}
 			}
 		}
@@ -187,24 +284,50 @@ static int filter_get_audio( mlt_frame frame, void** buffer, mlt_audio_format* f
 			private->sample_buff_count = private->window_size;
 		}
 
-		// Copy samples to fft input while applying window function
-		for (s = 0; s < private->window_size; s++)
+		// Another FFT filter may have analyzed the same window of this frame
+		char name[32];
+		snprintf( name, sizeof(name), "_fft.%u", private->window_size );
+		shared_result* shared = (shared_result*)mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), name, NULL );
+		if( shared && !memcmp( shared->sample_buff, private->sample_buff, sizeof(*private->sample_buff) * private->window_size ) )
 		{
-			private->fft_in[s] = private->sample_buff[s] * private->hann[s];
+			memcpy( private->out_bins, shared->bins, sizeof(*private->out_bins) * private->bin_count );
 		}
+		else
+		{
+			const float* restrict in = private->sample_buff;
+			const double* restrict hann = private->fft_plan->hann;
+			double* restrict fft_in = private->fft_in;
+			float* restrict bins = private->out_bins;
+			const float scale = 4.0 / (float)private->window_size;
+
+			// Copy samples to fft input while applying window function
+			for( s = 0; s < private->window_size; s++ )
+			{
+				fft_in[s] = in[s] * hann[s];
+			}
 
-		// Perform the FFT
-		fftw_execute( private->fft_plan );
+			// Perform the FFT on the arrays of this filter with the shared plan
+			fftw_execute_dft_r2c( private->fft_plan->plan, private->fft_in, private->fft_out );
 
-		// Convert to magnitudes
-		int bin = 0;
-		for( bin = 0; bin < private->bin_count; bin++ )
-		{
-			// Convert FFT output to magnitudes
-			private->out_bins[bin] = sqrt( private->fft_out[bin][0] * private->fft_out[bin][0]
-												+ private->fft_out[bin][1] * private->fft_out[bin][1] );
-			// Scale to 0.0 - 1.0
-			private->out_bins[bin] = (4.0 * private->out_bins[bin]) / (float)private->window_size;
+			// Convert FFT output to magnitudes and scale to 0.0 - 1.0
+			int bin = 0;
+			for( bin = 0; bin < private->bin_count; bin++ )
+			{
+				bins[bin] = scale * sqrt( private->fft_out[bin][0] * private->fft_out[bin][0]
+										 + private->fft_out[bin][1] * private->fft_out[bin][1] );
+			}
+
+			// Share the result with the other FFT filters of this frame
+			shared = (shared_result*)calloc( 1, sizeof(shared_result) );
+			if( shared )
+			{
+				shared->window_size = private->window_size;
+				shared->sample_buff = mlt_pool_alloc( sizeof(*private->sample_buff) * private->window_size );
+				shared->bins = mlt_pool_alloc( sizeof(*private->out_bins) * private->bin_count );
+				memcpy( shared->sample_buff, private->sample_buff, sizeof(*private->sample_buff) * private->window_size );
+				memcpy( shared->bins, private->out_bins, sizeof(*private->out_bins) * private->bin_count );
+				mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), name, shared, sizeof(shared_result), destroy_shared_result, NULL );
+			}
 		}
 
 		private->expected_pos++;
@@ -236,9 +359,8 @@ static void filter_close( mlt_filter filter )
 	{
 		fftw_free( private->fft_in );
 		fftw_free( private->fft_out );
-		fftw_destroy_plan( private->fft_plan );
+		release_plan( private->fft_plan );
 		mlt_pool_release( private->sample_buff );
-		mlt_pool_release( private->hann );
 		mlt_pool_release( private->out_bins );
 		free( private );
 	}
@@ -30,50 +30,31 @@ static inline int clamp( int v, int l, int u )
 	return v < l ? l : ( v > u ? u : v );
 }
 
-/** Do it :-).
+/** Filter processing.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	// Get the image
-	mlt_filter filter = mlt_frame_pop_service( frame );
-
 	int mask = mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "alpha" );
-	*format = mlt_image_yuv422;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_yuv422 );
 
-	// Only process if we have no error and a valid colour space
-	if ( error == 0 )
+	if ( lut )
 	{
-		uint8_t *p = *image;
-		uint8_t *q = *image + *width * *height * 2;
-		uint8_t *r = *image;
+		int i;
 
-		while ( p != q )
+		for ( i = 0; i < 256; i ++ )
 		{
-			*p ++ = clamp( 251 - *r ++, 16, 235 );
-			*p ++ = clamp( 256 - *r ++, 16, 240 );
+			lut->table[ 0 ][ i ] = clamp( 251 - lut->table[ 0 ][ i ], 16, 235 );
+			lut->table[ 1 ][ i ] = clamp( 256 - lut->table[ 1 ][ i ], 16, 240 );
+			lut->table[ 2 ][ i ] = clamp( 256 - lut->table[ 2 ][ i ], 16, 240 );
 		}
 
 		if ( mask )
 		{
-			uint8_t *alpha = mlt_frame_get_alpha_mask( frame );
-			int size = *width * *height;
-			memset( alpha, mask, size );
+			memset( lut->table[ 3 ], mask, 256 );
+			lut->alpha = 1;
 		}
 	}
-
-	return error;
-}
-
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	// Push the frame filter
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
@@ -30,23 +30,32 @@ typedef struct
 	double rlift, glift, blift;
 	double rgamma, ggamma, bgamma;
 	double rgain, ggain, bgain;
+	mlt_value values[9];
 } private_data;
 
+static const char *value_names[9] =
+{
+	"lift_r", "lift_g", "lift_b",
+	"gamma_r", "gamma_g", "gamma_b",
+	"gain_r", "gain_g", "gain_b"
+};
+
 static void refresh_lut( mlt_filter filter, mlt_frame frame )
 {
 	private_data* self = (private_data*)filter->child;
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
-	double rlift = mlt_properties_anim_get_double( properties, "lift_r", position, length );
-	double glift = mlt_properties_anim_get_double( properties, "lift_g", position, length );
-	double blift = mlt_properties_anim_get_double( properties, "lift_b", position, length );
-	double rgamma = mlt_properties_anim_get_double( properties, "gamma_r", position, length );
-	double ggamma = mlt_properties_anim_get_double( properties, "gamma_g", position, length );
-	double bgamma = mlt_properties_anim_get_double( properties, "gamma_b", position, length );
-	double rgain = mlt_properties_anim_get_double( properties, "gain_r", position, length );
-	double ggain = mlt_properties_anim_get_double( properties, "gain_g", position, length );
-	double bgain = mlt_properties_anim_get_double( properties, "gain_b", position, length );
+	mlt_properties_get_many( properties, self->values, 9, position, length );
+	double rlift = self->values[0].value.d;
+	double glift = self->values[1].value.d;
+	double blift = self->values[2].value.d;
+	double rgamma = self->values[3].value.d;
+	double ggamma = self->values[4].value.d;
+	double bgamma = self->values[5].value.d;
+	double rgain = self->values[6].value.d;
+	double ggain = self->values[7].value.d;
+	double bgain = self->values[8].value.d;
 
 	// Only regenerate the LUT if something changed.
 	if( self->rlift != rlift || self->glift != glift || self->blift != blift ||
@@ -107,90 +116,26 @@ static void refresh_lut( mlt_filter filter, mlt_frame frame )
 	}
 }
 
-static void apply_lut( mlt_filter filter, uint8_t* image, mlt_image_format format, int width, int height )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
 	private_data* self = (private_data*)filter->child;
-	uint8_t* rlut = malloc( sizeof(self->rlut) );
-	uint8_t* glut = malloc( sizeof(self->glut) );
-	uint8_t* blut = malloc( sizeof(self->blut) );
-	int total = width * height + 1;
-	uint8_t* sample = image;
-
-	// Copy the LUT so that we can be frame-thread safe.
-	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
-	memcpy( rlut, self->rlut, sizeof(self->rlut) );
-	memcpy( glut, self->glut, sizeof(self->glut) );
-	memcpy( blut, self->blut, sizeof(self->blut) );
-	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
-
-	switch( format )
-	{
-	case mlt_image_rgb24:
-		while( --total )
-		{
-			*sample = rlut[ *sample ];
-			sample++;
-			*sample = glut[ *sample ];
-			sample++;
-			*sample = blut[ *sample ];
-			sample++;
-		}
-		break;
-	case mlt_image_rgb24a:
-		while( --total )
-		{
-			*sample = rlut[ *sample ];
-			sample++;
-			*sample = glut[ *sample ];
-			sample++;
-			*sample = blut[ *sample ];
-			sample++;
-			sample++; // Skip alpha
-		}
-		break;
-	default:
-		mlt_log_error( MLT_FILTER_SERVICE( filter ), "Invalid image format: %s\n", mlt_image_format_name( format ) );
-		break;
-	}
-	free( rlut );
-	free( glut );
-	free( blut );
-}
-
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
-{
-	mlt_filter filter = (mlt_filter) mlt_frame_pop_service( frame );
-	int error = 0;
-
-
-	// Regenerate the LUT if necessary
-	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
-	refresh_lut( filter, frame );
-	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_rgb24 );
 
-	// Make sure the format is acceptable
-	if( *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
+	if ( lut )
 	{
-		*format = mlt_image_rgb24;
-	}
-
-	// Get the image
-	writable = 1;
-	error = mlt_frame_get_image( frame, image, format, width, height, writable );
+		int i = 0;
 
-	// Apply the LUT
-	if( !error )
-	{
-		apply_lut( filter, *image, *format, *width, *height );
+		// Regenerate the LUT if necessary and compose it into that of the frame.
+		mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+		refresh_lut( filter, frame );
+		for( i = 0; i < 256; i++ )
+		{
+			lut->table[0][i] = self->rlut[ lut->table[0][i] ];
+			lut->table[1][i] = self->glut[ lut->table[1][i] ];
+			lut->table[2][i] = self->blut[ lut->table[2][i] ];
+		}
+		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 	}
-
-	return error;
-}
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
@@ -222,6 +167,11 @@ mlt_filter filter_lift_gamma_gain_init( mlt_profile profile, mlt_service_type ty
 			self->glut[i] = i;
 			self->blut[i] = i;
 		}
+		for( i = 0; i < 9; i++ )
+		{
+			self->values[i].name = mlt_atom_intern( value_names[i] );
+			self->values[i].type = mlt_value_double;
+		}
 		self->rlift = self->glift = self->blift = 0.0;
 		self->rgamma = self->ggamma = self->bgamma = 1.0;
 		self->rgain = self->ggain = self->bgain = 1.0;
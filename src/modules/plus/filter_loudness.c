@@ -19,12 +19,14 @@
  */
 
 #include <framework/mlt.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <ebur128.h>
 
 #define MAX_RESULT_SIZE 512
+#define EBUR128_MODES ( EBUR128_MODE_I | EBUR128_MODE_LRA | EBUR128_MODE_SAMPLE_PEAK )
 
 typedef struct
 {
@@ -43,6 +45,7 @@ typedef struct
 	analyze_data* analyze;
 	apply_data* apply;
 	mlt_position last_position;
+	int cache_checked;
 } private_data;
 
 static void destroy_analyze_data( mlt_filter filter )
@@ -57,7 +60,7 @@ static void init_analyze_data( mlt_filter filter, int channels, int samplerate )
 {
 	private_data* private = (private_data*)filter->child;
 	private->analyze = (analyze_data*)calloc( 1, sizeof(analyze_data) );
-	private->analyze->state = ebur128_init( (unsigned int)channels, (unsigned long)samplerate, EBUR128_MODE_I | EBUR128_MODE_LRA | EBUR128_MODE_SAMPLE_PEAK );
+	private->analyze->state = ebur128_init( (unsigned int)channels, (unsigned long)samplerate, EBUR128_MODES );
 	private->last_position = 0;
 }
 
@@ -90,6 +93,247 @@ static void init_apply_data( mlt_filter filter )
 	}
 }
 
+/** Get the producer to which the filter is attached and the range it filters.
+*/
+
+static mlt_producer get_source( mlt_filter filter, mlt_position *in, mlt_position *length )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_service service = mlt_properties_get_data( properties, "service", NULL );
+	mlt_producer producer;
+
+	if ( !service || mlt_service_identify( service ) != producer_type )
+		return NULL;
+	producer = MLT_PRODUCER( service );
+	if ( mlt_filter_get_out( filter ) > 0 )
+	{
+		*in = mlt_filter_get_in( filter );
+		*length = mlt_filter_get_out( filter ) - *in + 1;
+	}
+	else
+	{
+		*in = mlt_producer_get_in( producer );
+		*length = mlt_producer_get_playtime( producer );
+	}
+	return producer;
+}
+
+/** Get the name of the cache file of the results for the audio of the filter's producer.
+*/
+
+static char *cache_filename( mlt_filter filter, int frequency, int channels, int create )
+{
+	mlt_position in = 0, length = 0;
+	mlt_producer producer = get_source( filter, &in, &length );
+	char suffix[100];
+
+	if ( !producer || length <= 0 || !mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "cache" ) )
+		return NULL;
+	producer = mlt_producer_cut_parent( producer );
+	snprintf( suffix, sizeof( suffix ), "-%d-%d-%d-%d-%d.txt", in, length,
+		mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( producer ), "audio_index" ), frequency, channels );
+	return mlt_cache_filename( mlt_properties_get( MLT_PRODUCER_PROPERTIES( producer ), "resource" ),
+		"MLT_LOUDNESS_CACHE", "loudness", suffix, create );
+}
+
+/** Load the results from the cache into the results property.
+*/
+
+static int load_results( mlt_filter filter, int frequency, int channels )
+{
+	char *filename = cache_filename( filter, frequency, channels, 0 );
+	FILE *file = filename ? fopen( filename, "r" ) : NULL;
+	char result[MAX_RESULT_SIZE];
+	int error = 1;
+
+	if ( file )
+	{
+		if ( fgets( result, sizeof( result ), file ) )
+		{
+			result[ strcspn( result, "\n" ) ] = '\0';
+			mlt_log_info( MLT_FILTER_SERVICE( filter ), "Cached results: %s\n", result );
+			mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "results", result );
+			error = 0;
+		}
+		fclose( file );
+	}
+	free( filename );
+	return error;
+}
+
+/** Store the results of an analysis and save them in the cache.
+*/
+
+static void store_results( mlt_filter filter, ebur128_state **states, int count, int frequency, int channels )
+{
+	double loudness = 0.0;
+	double range = 0.0;
+	double tmpPeak = 0.0;
+	double peak = 0.0;
+	int i, j;
+	char result[MAX_RESULT_SIZE];
+
+	ebur128_loudness_global_multiple( states, count, &loudness );
+	ebur128_loudness_range_multiple( states, count, &range );
+	for ( j = 0; j < count; j++ )
+	{
+		for ( i = 0; i < channels; i++ )
+		{
+			ebur128_sample_peak( states[j], i, &tmpPeak );
+			if( tmpPeak > peak )
+			{
+				peak = tmpPeak;
+			}
+		}
+	}
+
+	snprintf( result, MAX_RESULT_SIZE, "L: %lf\tR: %lf\tP %lf", loudness, range, peak );
+	result[ MAX_RESULT_SIZE - 1 ] = '\0';
+	mlt_log_info( MLT_FILTER_SERVICE( filter ), "Stored results: %s\n", result );
+	mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "results", result );
+
+	char *filename = cache_filename( filter, frequency, channels, 1 );
+	if ( filename )
+	{
+		// Write a temporary file and rename it so that a reader never sees a partial result
+		char *temp = malloc( strlen( filename ) + 5 );
+		FILE *file;
+		sprintf( temp, "%s.tmp", filename );
+		file = fopen( temp, "w" );
+		if ( file )
+		{
+			int error = fprintf( file, "%s\n", result ) < 0;
+			error |= fclose( file );
+			if ( error || rename( temp, filename ) )
+				remove( temp );
+		}
+		free( temp );
+		free( filename );
+	}
+}
+
+typedef struct
+{
+	mlt_producer source;
+	mlt_position in;
+	mlt_position length;
+	int frequency;
+	int channels;
+	ebur128_state **states;
+	int error;
+} scan_data;
+
+/** Analyze one chunk of the audio with a producer of its own.
+*/
+
+static int scan_chunk( int id, int idx, int jobs, void *cookie )
+{
+	scan_data *scan = cookie;
+	mlt_producer parent = mlt_producer_cut_parent( scan->source );
+	mlt_properties parent_props = MLT_PRODUCER_PROPERTIES( parent );
+	mlt_position start = scan->in + scan->length * idx / jobs;
+	mlt_position end = scan->in + scan->length * ( idx + 1 ) / jobs;
+	double fps = mlt_producer_get_fps( scan->source );
+	mlt_producer producer = mlt_factory_producer( mlt_service_profile( MLT_PRODUCER_SERVICE( parent ) ), NULL,
+		mlt_properties_get( parent_props, "resource" ) );
+	ebur128_state *state = ebur128_init( (unsigned int) scan->channels, (unsigned long) scan->frequency, EBUR128_MODES );
+	mlt_position pos;
+	int error = !producer || !state;
+
+	if ( !error )
+	{
+		// Only the audio is needed
+		if ( mlt_properties_get( parent_props, "audio_index" ) )
+			mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), "audio_index", mlt_properties_get( parent_props, "audio_index" ) );
+		mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( producer ), "video_index", -1 );
+		mlt_producer_seek( producer, start );
+	}
+	for ( pos = start; !error && pos < end && !scan->error; pos++ )
+	{
+		mlt_frame frame = NULL;
+		void *buffer = NULL;
+		mlt_audio_format format = mlt_audio_f32le;
+		int frequency = scan->frequency;
+		int channels = scan->channels;
+		int samples = mlt_sample_calculator( fps, frequency, pos );
+
+		error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+		if ( !error )
+			error = mlt_frame_get_audio( frame, &buffer, &format, &frequency, &channels, &samples );
+		// The analysis is only valid in the requested format
+		if ( !error && ( !buffer || format != mlt_audio_f32le || frequency != scan->frequency || channels != scan->channels ) )
+			error = 1;
+		if ( !error )
+			ebur128_add_frames_float( state, buffer, samples );
+		mlt_frame_close( frame );
+	}
+	if ( error )
+	{
+		scan->error = 1;
+		if ( state )
+			ebur128_destroy( &state );
+	}
+	scan->states[idx] = state;
+	mlt_producer_close( producer );
+	return 0;
+}
+
+/** Analyze all of the audio of the filter's producer in parallel chunks.
+
+    Each chunk is read by a producer of its own, without decoding the video,
+    and has its own gating state. The states are merged for the results.
+*/
+
+static int scan_audio( mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	scan_data scan;
+	int jobs = mlt_properties_get_int( properties, "threads" );
+	int i;
+
+	memset( &scan, 0, sizeof( scan ) );
+	scan.source = get_source( filter, &scan.in, &scan.length );
+	scan.frequency = mlt_properties_get_int( properties, "frequency" );
+	scan.channels = mlt_properties_get_int( properties, "channels" );
+	if ( !scan.source || scan.length <= 0 || scan.frequency <= 0 || scan.channels <= 0 )
+	{
+		mlt_log_error( MLT_FILTER_SERVICE( filter ), "Analysis Failed: no producer to scan\n" );
+		return 1;
+	}
+	if ( !load_results( filter, scan.frequency, scan.channels ) )
+		return 0;
+
+	if ( jobs <= 0 )
+		jobs = mlt_slices_count_normal();
+	// A chunk shorter than a few seconds would lose too much of the gating at its edges
+	if ( jobs > scan.length / 250 )
+		jobs = scan.length / 250;
+	if ( jobs < 1 )
+		jobs = 1;
+	scan.states = calloc( jobs, sizeof( ebur128_state* ) );
+	mlt_slices_run_normal( jobs, scan_chunk, &scan );
+
+	if ( !scan.error )
+		store_results( filter, scan.states, jobs, scan.frequency, scan.channels );
+	else
+		mlt_log_error( MLT_FILTER_SERVICE( filter ), "Analysis Failed: unable to read the audio\n" );
+	for ( i = 0; i < jobs; i++ )
+		if ( scan.states[i] )
+			ebur128_destroy( &scan.states[i] );
+	free( scan.states );
+	return scan.error;
+}
+
+static void property_changed( mlt_service owner, mlt_filter filter, char *name )
+{
+	if ( !strcmp( name, "analyze" ) && mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "analyze" ) )
+	{
+		char* results = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "results" );
+		if ( !results || !strcmp( results, "" ) )
+			scan_audio( filter );
+	}
+}
+
 static void analyze( mlt_filter filter, mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
 	private_data* private = (private_data*)filter->child;
@@ -114,29 +358,7 @@ static void analyze( mlt_filter filter, mlt_frame frame, void **buffer, mlt_audi
 
 		if ( pos + 1 == mlt_filter_get_length2( filter, frame ) )
 		{
-			mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
-			double loudness = 0.0;
-			double range = 0.0;
-			double tmpPeak = 0.0;
-			double peak = 0.0;
-			int i = 0;
-			char result[MAX_RESULT_SIZE];
-			ebur128_loudness_global( private->analyze->state, &loudness );
-			ebur128_loudness_range( private->analyze->state, &range );
-
-			for ( i = 0; i < *channels; i++ )
-			{
-				ebur128_sample_peak( private->analyze->state, i, &tmpPeak );
-				if( tmpPeak > peak )
-				{
-					peak = tmpPeak;
-				}
-			}
-
-			snprintf( result, MAX_RESULT_SIZE, "L: %lf\tR: %lf\tP %lf", loudness, range, peak );
-			result[ MAX_RESULT_SIZE - 1 ] = '\0';
-			mlt_log_info( MLT_FILTER_SERVICE( filter ), "Stored results: %s\n", result );
-			mlt_properties_set( properties, "results", result );
+			store_results( filter, &private->analyze->state, 1, *frequency, *channels );
 			destroy_analyze_data( filter );
 		}
 
@@ -177,6 +399,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 {
 	mlt_filter filter = mlt_frame_pop_audio( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	private_data* private = (private_data*)filter->child;
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
@@ -185,6 +408,13 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 
 	char* results = mlt_properties_get( properties, "results" );
+	if( ( !results || !strcmp( results, "" ) ) && !private->cache_checked )
+	{
+		private->cache_checked = 1;
+		// Use the results of an earlier analysis of the same audio
+		load_results( filter, *frequency, *channels );
+		results = mlt_properties_get( properties, "results" );
+	}
 	if( results && strcmp( results, "" ) )
 	{
 		apply( filter, frame, buffer, format, frequency, channels, samples );
@@ -242,12 +472,16 @@ mlt_filter filter_loudness_init( mlt_profile profile, mlt_service_type type, con
 	{
 		mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 		mlt_properties_set( properties, "program", "-23.0" );
+		mlt_properties_set_int( properties, "cache", 1 );
+		mlt_properties_set_int( properties, "frequency", 48000 );
+		mlt_properties_set_int( properties, "channels", 2 );
 
 		data->analyze = NULL;
 
 		filter->close = filter_close;
 		filter->process = filter_process;
 		filter->child = data;
+		mlt_events_listen( properties, filter, "property-changed", (mlt_listener)property_changed );
 	}
 	else
 	{
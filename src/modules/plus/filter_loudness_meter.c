@@ -29,6 +29,9 @@ typedef struct
 	ebur128_state* r128;
 	int reset;
 	mlt_position prev_pos;
+	int skipped;        ///< the frames analyzed since the values were last updated
+	double prev_peak;   ///< the peak of those frames
+	double prev_true_peak;
 } private_data;
 
 static void property_changed( mlt_service owner, mlt_filter filter, char *name )
@@ -61,11 +64,14 @@ static void check_for_reset( mlt_filter filter, int channels, int frequency )
 		pdata->reset = 0;
 		pdata->prev_pos = -1;
 		mlt_events_block( properties, filter );
-		mlt_properties_set( properties, "frames_processed", "0" );
-		mlt_properties_set( properties, "program", "-100.0" );
-		mlt_properties_set( properties, "shortterm", "-100.0" );
-		mlt_properties_set( properties, "momentary", "-100.0" );
-		mlt_properties_set( properties, "range", "-1.0" );
+		pdata->skipped = 0;
+		pdata->prev_peak = 0.0;
+		pdata->prev_true_peak = 0.0;
+		mlt_properties_set_position( properties, "frames_processed", 0 );
+		mlt_properties_set_double( properties, "program", -100.0 );
+		mlt_properties_set_double( properties, "shortterm", -100.0 );
+		mlt_properties_set_double( properties, "momentary", -100.0 );
+		mlt_properties_set_double( properties, "range", -1.0 );
 		mlt_properties_set_int( properties, "reset_count", mlt_properties_get_int( properties, "reset_count") + 1 );
 		mlt_properties_set_int( properties, "reset", 0 );
 		mlt_events_unblock( properties, filter );
@@ -109,6 +115,44 @@ static void check_for_reset( mlt_filter filter, int channels, int frequency )
 	}
 }
 
+/** Decide whether to update the measured values after this frame.
+ *
+ * Every frame is analyzed, but getting the loudness from the histograms is
+ * only done on every Nth frame with an interval of N, or when request is
+ * set with an interval of 0.
+ */
+
+static int want_update( mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	private_data* pdata = (private_data*)filter->child;
+	int interval = mlt_properties_get_int( properties, "interval" );
+
+	if ( mlt_properties_get_int( properties, "request" ) )
+	{
+		mlt_events_block( properties, filter );
+		mlt_properties_set_int( properties, "request", 0 );
+		mlt_events_unblock( properties, filter );
+		return 1;
+	}
+	return interval == 1 || ( interval > 1 && pdata->skipped >= interval );
+}
+
+// Keep the largest of the peaks of the last frame of each channel.
+static double max_prev_peak( ebur128_state* r128, int (*get_peak)( ebur128_state*, unsigned int, double* ), double max_peak )
+{
+	unsigned int c;
+	for( c = 0; c < r128->channels; c++ )
+	{
+		double peak;
+		if( get_peak( r128, c, &peak ) == EBUR128_SUCCESS && peak != HUGE_VAL && peak > max_peak )
+		{
+			max_peak = peak;
+		}
+	}
+	return max_peak;
+}
+
 static void analyze_audio( mlt_filter filter, void* buffer, int samples )
 {
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
@@ -117,6 +161,24 @@ static void analyze_audio( mlt_filter filter, void* buffer, int samples )
 	double loudness = 0.0;
 
 	ebur128_add_frames_float( pdata->r128, buffer, samples );
+	mlt_properties_set_position( properties, "frames_processed", mlt_properties_get_position( properties, "frames_processed" ) + 1 );
+	pdata->skipped++;
+
+	// The peaks of the frames between updates are kept here
+	if( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "calc_peak" ) )
+	{
+		pdata->prev_peak = max_prev_peak( pdata->r128, ebur128_prev_sample_peak, pdata->prev_peak );
+	}
+	if( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "calc_true_peak" ) )
+	{
+		pdata->prev_true_peak = max_prev_peak( pdata->r128, ebur128_prev_true_peak, pdata->prev_true_peak );
+	}
+
+	if( !want_update( filter ) )
+	{
+		return;
+	}
+	pdata->skipped = 0;
 
 	if( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "calc_program" ) )
 	{
@@ -157,51 +219,19 @@ static void analyze_audio( mlt_filter filter, void* buffer, int samples )
 
 	if( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "calc_peak" ) )
 	{
-		double prev_peak = 0.0;
-		double max_peak = 0.0;
-		int c = 0;
-		for( c = 0; c < pdata->r128->channels; c++ )
-		{
-			double peak;
-			result = ebur128_sample_peak( pdata->r128, c, &peak );
-			if( result == EBUR128_SUCCESS && peak != HUGE_VAL && peak > max_peak )
-			{
-				max_peak = peak;
-			}
-			result = ebur128_prev_sample_peak( pdata->r128, c, &peak );
-			if( result == EBUR128_SUCCESS && peak != HUGE_VAL && peak > prev_peak )
-			{
-				prev_peak = peak;
-			}
-		}
+		double max_peak = max_prev_peak( pdata->r128, ebur128_sample_peak, 0.0 );
 		mlt_properties_set_double( properties, "max_peak", 20 * log10(max_peak) );
-		mlt_properties_set_double( properties, "peak", 20 * log10(prev_peak) );
+		mlt_properties_set_double( properties, "peak", 20 * log10(pdata->prev_peak) );
+		pdata->prev_peak = 0.0;
 	}
 
 	if( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "calc_true_peak" ) )
 	{
-		double prev_peak = 0.0;
-		double max_peak = 0.0;
-		int c = 0;
-		for( c = 0; c < pdata->r128->channels; c++ )
-		{
-			double peak;
-			result = ebur128_true_peak( pdata->r128, c, &peak );
-			if( result == EBUR128_SUCCESS && peak != HUGE_VAL && peak > max_peak )
-			{
-				max_peak = peak;
-			}
-			result = ebur128_prev_true_peak( pdata->r128, c, &peak );
-			if( result == EBUR128_SUCCESS && peak != HUGE_VAL && peak > prev_peak )
-			{
-				prev_peak = peak;
-			}
-		}
+		double max_peak = max_prev_peak( pdata->r128, ebur128_true_peak, 0.0 );
 		mlt_properties_set_double( properties, "max_true_peak", 20 * log10(max_peak) );
-		mlt_properties_set_double( properties, "true_peak", 20 * log10(prev_peak) );
+		mlt_properties_set_double( properties, "true_peak", 20 * log10(pdata->prev_true_peak) );
+		pdata->prev_true_peak = 0.0;
 	}
-
-	mlt_properties_set_position( properties, "frames_processed", mlt_properties_get_position( properties, "frames_processed" ) + 1 );
 }
 
 static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
@@ -279,17 +309,19 @@ mlt_filter filter_loudness_meter_init( mlt_profile profile, mlt_service_type typ
 		mlt_properties_set_int( properties, "calc_range", 1 );
 		mlt_properties_set_int( properties, "calc_peak", 1 );
 		mlt_properties_set_int( properties, "calc_true_peak", 1 );
-		mlt_properties_set( properties, "program", "-100.0" );
-		mlt_properties_set( properties, "shortterm", "-100.0" );
-		mlt_properties_set( properties, "momentary", "-100.0" );
-		mlt_properties_set( properties, "range", "-1.0" );
-		mlt_properties_set( properties, "peak", "-100.0" );
-		mlt_properties_set( properties, "max_peak", "-100.0" );
-		mlt_properties_set( properties, "true_peak", "-100.0" );
-		mlt_properties_set( properties, "max_true_peak", "-100.0" );
-		mlt_properties_set( properties, "reset", "1" );
-		mlt_properties_set( properties, "reset_count", "0" );
-		mlt_properties_set( properties, "frames_processed", "0" );
+		mlt_properties_set_int( properties, "interval", 1 );
+		mlt_properties_set_int( properties, "request", 0 );
+		mlt_properties_set_double( properties, "program", -100.0 );
+		mlt_properties_set_double( properties, "shortterm", -100.0 );
+		mlt_properties_set_double( properties, "momentary", -100.0 );
+		mlt_properties_set_double( properties, "range", -1.0 );
+		mlt_properties_set_double( properties, "peak", -100.0 );
+		mlt_properties_set_double( properties, "max_peak", -100.0 );
+		mlt_properties_set_double( properties, "true_peak", -100.0 );
+		mlt_properties_set_double( properties, "max_true_peak", -100.0 );
+		mlt_properties_set_int( properties, "reset", 1 );
+		mlt_properties_set_int( properties, "reset_count", 0 );
+		mlt_properties_set_position( properties, "frames_processed", 0 );
 
 		pdata->r128 = 0;
 		pdata->reset = 1;
@@ -20,6 +20,7 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -59,7 +60,52 @@ static void fill_opa_lut(int lgg_lut[], int prelevel, int postlevel, int slope_s
 		lgg_lut[ i ] = postlevel;
 }
 
+// Do not key bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (16)
+
+struct lumakey_slice_desc
+{
+	uint8_t *image;
+	uint8_t *alpha;       ///< the alpha plane of a yuv422 image, NULL for rgb24a
+	int width;
+	int height;
+	uint8_t opa_lut[256];
+};
+
+static int lumakey_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct lumakey_slice_desc *desc = (struct lumakey_slice_desc *) cookie;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	int x;
+
+	for ( ; y < yend; y++ )
+	{
+		if ( desc->alpha )
+		{
+			// The table is indexed by Y
+			const uint8_t *sample = desc->image + y * w * 2;
+			uint8_t *alpha = desc->alpha + y * w;
+			for ( x = 0; x < w; x++, sample += 2 )
+				alpha[x] = desc->opa_lut[*sample];
+		}
+		else
+		{
+			// Visual luma from RGB, 0.3 R + 0.59 G + 0.11 B
+			uint8_t *sample = desc->image + y * w * 4;
+			for ( x = 0; x < w; x++, sample += 4 )
+				sample[3] = desc->opa_lut[( 30 * sample[0] + 59 * sample[1] + 11 * sample[2] ) / 100];
+		}
+	}
+	return 0;
+}
+
 /** Do image filtering.
+ *
+ * A yuv422 request is keyed from Y into the alpha plane of the frame, which
+ * saves a compositor from taking the alpha out of an rgb24a image. Anything
+ * else is keyed into the alpha of an rgb24a image.
 */
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
@@ -69,11 +115,12 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
 
-	*format =  mlt_image_rgb24a;
+	int yuv = *format == mlt_image_yuv422;
+	*format = yuv ? mlt_image_yuv422 : mlt_image_rgb24a;
 	int error = mlt_frame_get_image( frame, image, format, width, height, 0 );
 
 	// Only process if we have no error and a valid colour space
-	if ( error == 0 )
+	if ( error == 0 && *format == ( yuv ? mlt_image_yuv422 : mlt_image_rgb24a ) )
 	{
 		// Get values and force accepted ranges
 		int threshold = mlt_properties_anim_get_int( properties, "threshold", position, length );
@@ -93,22 +140,23 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int opa_lut[256];
 		fill_opa_lut( opa_lut, prelevel, postlevel, slope_start, slope_end );
 
-		// Values for calculating visual luma from RGB
-		double R = 0.3;
-		double G = 0.59;
-		double B = 0.11;
+		struct lumakey_slice_desc desc;
+		int i;
 
-		// Filter
-		int i = *width * *height + 1;
-		uint8_t *sample = *image;
-		uint8_t r, g, b;
-		while ( --i )
-		{
-			r = *sample ++;
-			g = *sample ++;
-			b = *sample ++;
-			*sample ++ = opa_lut[(int) (R * r + g * G + b * B) ];
-		}
+		desc.image = *image;
+		desc.alpha = yuv ? mlt_frame_get_alpha_mask( frame ) : NULL;
+		desc.width = *width;
+		desc.height = *height;
+
+		// Map the video range of Y to the full range of the luma of RGB
+		for ( i = 0; i < 256; i++ )
+			desc.opa_lut[i] = opa_lut[yuv ? clamp( ( i - 16 ) * 255 / 219, 0, 255 ) : i];
+
+		int jobs = MIN( mlt_slices_count_normal(), *height / MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, lumakey_slice_proc, &desc );
+		else
+			lumakey_slice_proc( 0, 0, 1, &desc );
 	}
 
 	return error;
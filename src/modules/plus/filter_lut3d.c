@@ -0,0 +1,836 @@
+/*
+ * filter_lut3d.c -- apply a colour grade through a 3D lookup table
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <framework/mlt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#define MIN_SIZE (2)
+#define MAX_SIZE (65)
+#define DEFAULT_SIZE (33)
+#define MIN_SLICE_HEIGHT (16)
+
+// The interpolation is only fast when it is inlined into the loops over the rows.
+#if defined(__GNUC__)
+#define LUT3D_INLINE static inline __attribute__((always_inline))
+#else
+#define LUT3D_INLINE static inline
+#endif
+
+/* The grade is compiled into a cube of nodes that each hold 4 floats, the
+ * output r, g, b (or y, u, v) in the 8-bit range and a pad that lets a node be
+ * loaded as one vector. The first channel changes fastest in the cube.
+ */
+
+typedef struct
+{
+	double lift[3];
+	double gamma[3];
+	double gain[3];
+	double saturation;
+	double matrix[9];
+	int size;
+	int yuv;
+} grade;
+
+typedef struct
+{
+	// The table of the resource, in the order and domain of a .cube file.
+	char *resource;
+	float *file;
+	int file_size;
+	float domain_min[3];
+	float domain_max[3];
+} private_data;
+
+typedef struct
+{
+	const float *nodes;
+	int size;
+	int tetrahedral;
+	uint8_t *image;
+	mlt_image_format format;
+	int width;
+	int height;
+	int stride[3];
+	int offset[3][256];
+	float fraction[256];
+} slice_desc;
+
+/** Read a LUT in the Adobe/Resolve .cube format.
+*/
+
+static int load_cube( private_data *self, FILE *file )
+{
+	char line[1024];
+	int size = 0, count = 0;
+
+	self->domain_min[0] = self->domain_min[1] = self->domain_min[2] = 0.0f;
+	self->domain_max[0] = self->domain_max[1] = self->domain_max[2] = 1.0f;
+	while ( fgets( line, sizeof( line ), file ) )
+	{
+		char *p = line;
+		float r, g, b;
+
+		while ( *p == ' ' || *p == '\t' )
+			p++;
+		if ( *p == '#' || *p == '\n' || *p == '\r' || *p == '\0' )
+			continue;
+		if ( !strncmp( p, "LUT_3D_SIZE", 11 ) )
+		{
+			size = atoi( p + 11 );
+			if ( size < MIN_SIZE || size > MAX_SIZE || self->file )
+				return 1;
+			self->file = malloc( size * size * size * 3 * sizeof( float ) );
+			self->file_size = size;
+		}
+		else if ( !strncmp( p, "DOMAIN_MIN", 10 ) )
+		{
+			sscanf( p + 10, "%f %f %f", &self->domain_min[0], &self->domain_min[1], &self->domain_min[2] );
+		}
+		else if ( !strncmp( p, "DOMAIN_MAX", 10 ) )
+		{
+			sscanf( p + 10, "%f %f %f", &self->domain_max[0], &self->domain_max[1], &self->domain_max[2] );
+		}
+		else if ( sscanf( p, "%f %f %f", &r, &g, &b ) == 3 )
+		{
+			if ( !self->file || count >= size * size * size )
+				return 1;
+			self->file[ count * 3 + 0 ] = r;
+			self->file[ count * 3 + 1 ] = g;
+			self->file[ count * 3 + 2 ] = b;
+			count++;
+		}
+		else if ( strncmp( p, "TITLE", 5 ) )
+		{
+			// LUT_1D_SIZE and anything else that is not understood
+			return 1;
+		}
+	}
+	return !self->file || count != size * size * size;
+}
+
+/** Read a LUT in the Autodesk .3dl format.
+*/
+
+static int load_3dl( private_data *self, FILE *file )
+{
+	char line[1024];
+	int size = 0, count = 0, max = 0, i;
+	int *values = NULL;
+
+	while ( fgets( line, sizeof( line ), file ) )
+	{
+		char *p = line;
+		int r, g, b;
+
+		while ( *p == ' ' || *p == '\t' )
+			p++;
+		if ( *p == '#' || *p == '\n' || *p == '\r' || *p == '\0' || !strncmp( p, "Mesh", 4 ) )
+			continue;
+		if ( !size )
+		{
+			// The first line is the grid of the input, its length is the size.
+			char *end;
+			while ( strtol( p, &end, 10 ), end != p )
+			{
+				size++;
+				p = end;
+			}
+			if ( size < MIN_SIZE || size > MAX_SIZE )
+			{
+				free( values );
+				return 1;
+			}
+			values = malloc( size * size * size * 3 * sizeof( int ) );
+		}
+		else if ( sscanf( p, "%d %d %d", &r, &g, &b ) == 3 )
+		{
+			if ( count >= size * size * size )
+				break;
+			values[ count * 3 + 0 ] = r;
+			values[ count * 3 + 1 ] = g;
+			values[ count * 3 + 2 ] = b;
+			max = MAX( max, MAX( r, MAX( g, b ) ) );
+			count++;
+		}
+	}
+	if ( !size || count != size * size * size )
+	{
+		free( values );
+		return 1;
+	}
+
+	// The output depth is not declared; it is the smallest that holds the values.
+	int depth = 1;
+	while ( depth < 16 && ( 1 << depth ) - 1 < max )
+		depth++;
+	float scale = 1.0f / ( ( 1 << depth ) - 1 );
+
+	// Blue changes fastest in a .3dl file, so transpose it into .cube order.
+	self->file = malloc( size * size * size * 3 * sizeof( float ) );
+	self->file_size = size;
+	for ( i = 0; i < count; i++ )
+	{
+		int r = i / ( size * size ), g = ( i / size ) % size, b = i % size;
+		int j = ( b * size + g ) * size + r;
+		self->file[ j * 3 + 0 ] = values[ i * 3 + 0 ] * scale;
+		self->file[ j * 3 + 1 ] = values[ i * 3 + 1 ] * scale;
+		self->file[ j * 3 + 2 ] = values[ i * 3 + 2 ] * scale;
+	}
+	for ( i = 0; i < 3; i++ )
+	{
+		self->domain_min[i] = 0.0f;
+		self->domain_max[i] = 1.0f;
+	}
+	free( values );
+	return 0;
+}
+
+/** Load the resource when it changes.
+*/
+
+static void refresh_file( mlt_filter filter, private_data *self )
+{
+	const char *resource = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "resource" );
+
+	if ( ( !resource && !self->resource ) || ( resource && self->resource && !strcmp( resource, self->resource ) ) )
+		return;
+
+	free( self->resource );
+	free( self->file );
+	self->resource = resource ? strdup( resource ) : NULL;
+	self->file = NULL;
+	self->file_size = 0;
+
+	if ( resource && *resource )
+	{
+		FILE *file = mlt_fopen( resource, "r" );
+		const char *extension = strrchr( resource, '.' );
+		int error = 1;
+
+		if ( file )
+		{
+			if ( extension && !strcasecmp( extension, ".3dl" ) )
+				error = load_3dl( self, file );
+			else
+				error = load_cube( self, file );
+			fclose( file );
+		}
+		if ( error )
+		{
+			mlt_log_error( MLT_FILTER_SERVICE( filter ), "Unable to load 3D LUT %s\n", resource );
+			free( self->file );
+			self->file = NULL;
+			self->file_size = 0;
+		}
+	}
+}
+
+/** Look up a colour in the table of the resource with trilinear interpolation.
+*/
+
+static void sample_file( private_data *self, double rgb[3] )
+{
+	int size = self->file_size;
+	int i0[3], i1[3];
+	double f[3];
+	double out[3];
+	int c;
+
+	for ( c = 0; c < 3; c++ )
+	{
+		double range = self->domain_max[c] - self->domain_min[c];
+		double x = range > 0.0 ? ( rgb[c] - self->domain_min[c] ) / range * ( size - 1 ) : 0.0;
+		x = CLAMP( x, 0.0, size - 1 );
+		i0[c] = MIN( (int) x, size - 2 );
+		i1[c] = i0[c] + 1;
+		f[c] = x - i0[c];
+	}
+	for ( c = 0; c < 3; c++ )
+	{
+#define NODE( r, g, b ) self->file[ ( ( ( b ) * size + ( g ) ) * size + ( r ) ) * 3 + c ]
+		double c00 = NODE( i0[0], i0[1], i0[2] ) + f[0] * ( NODE( i1[0], i0[1], i0[2] ) - NODE( i0[0], i0[1], i0[2] ) );
+		double c10 = NODE( i0[0], i1[1], i0[2] ) + f[0] * ( NODE( i1[0], i1[1], i0[2] ) - NODE( i0[0], i1[1], i0[2] ) );
+		double c01 = NODE( i0[0], i0[1], i1[2] ) + f[0] * ( NODE( i1[0], i0[1], i1[2] ) - NODE( i0[0], i0[1], i1[2] ) );
+		double c11 = NODE( i0[0], i1[1], i1[2] ) + f[0] * ( NODE( i1[0], i1[1], i1[2] ) - NODE( i0[0], i1[1], i1[2] ) );
+#undef NODE
+		double c0 = c00 + f[1] * ( c10 - c00 );
+		double c1 = c01 + f[1] * ( c11 - c01 );
+		out[c] = c0 + f[2] * ( c1 - c0 );
+	}
+	rgb[0] = out[0];
+	rgb[1] = out[1];
+	rgb[2] = out[2];
+}
+
+/** Apply the resource, matrix, lift/gamma/gain and saturation to a colour in [0, 1].
+*/
+
+static void grade_colour( private_data *self, const grade *g, double rgb[3] )
+{
+	double in[3];
+	int c;
+
+	if ( self->file )
+		sample_file( self, rgb );
+
+	in[0] = rgb[0];
+	in[1] = rgb[1];
+	in[2] = rgb[2];
+	for ( c = 0; c < 3; c++ )
+		rgb[c] = g->matrix[c * 3] * in[0] + g->matrix[c * 3 + 1] * in[1] + g->matrix[c * 3 + 2] * in[2];
+
+	// The same curve as filter lift_gamma_gain
+	for ( c = 0; c < 3; c++ )
+	{
+		double x = pow( CLAMP( rgb[c], 0.0, 1.0 ), 1.0 / 2.2 );
+		x += g->lift[c] * ( 1.0 - x );
+		x = MAX( x, 0.0 );
+		x = pow( x, 2.2 / g->gamma[c] );
+		x *= pow( g->gain[c], 1.0 / g->gamma[c] );
+		rgb[c] = x;
+	}
+
+	if ( g->saturation != 1.0 )
+	{
+		double luma = 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+		for ( c = 0; c < 3; c++ )
+			rgb[c] = luma + g->saturation * ( rgb[c] - luma );
+	}
+
+	for ( c = 0; c < 3; c++ )
+		rgb[c] = CLAMP( rgb[c], 0.0, 1.0 );
+}
+
+/** Compile the grade into a cube of nodes.
+ *
+ * A cube for yuv422 is indexed by Y'CbCr and includes the conversions to
+ * and from RGB, so that the image does not need to be converted.
+ */
+
+static float *compile_nodes( private_data *self, const grade *g )
+{
+	int size = g->size;
+	int nodes = size * size * size;
+	float *result = mlt_pool_alloc( nodes * 4 * sizeof( float ) );
+	int i;
+
+	for ( i = 0; result && i < nodes; i++ )
+	{
+		double a = 255.0 * ( i % size ) / ( size - 1 );
+		double b = 255.0 * ( ( i / size ) % size ) / ( size - 1 );
+		double c = 255.0 * ( i / ( size * size ) ) / ( size - 1 );
+		double rgb[3];
+		float *out = result + i * 4;
+
+		if ( g->yuv )
+		{
+			// ITU-R BT.601 in the video range, as YUV2RGB_601_SCALED
+			double y = 1.164 * ( a - 16.0 );
+			rgb[0] = CLAMP( ( y + 1.596 * ( c - 128.0 ) ) / 255.0, 0.0, 1.0 );
+			rgb[1] = CLAMP( ( y - 0.813 * ( c - 128.0 ) - 0.391 * ( b - 128.0 ) ) / 255.0, 0.0, 1.0 );
+			rgb[2] = CLAMP( ( y + 2.018 * ( b - 128.0 ) ) / 255.0, 0.0, 1.0 );
+			grade_colour( self, g, rgb );
+			out[0] = 16.0 + 65.481 * rgb[0] + 128.553 * rgb[1] + 24.966 * rgb[2];
+			out[1] = 128.0 - 37.797 * rgb[0] - 74.203 * rgb[1] + 112.0 * rgb[2];
+			out[2] = 128.0 + 112.0 * rgb[0] - 93.786 * rgb[1] - 18.214 * rgb[2];
+		}
+		else
+		{
+			rgb[0] = a / 255.0;
+			rgb[1] = b / 255.0;
+			rgb[2] = c / 255.0;
+			grade_colour( self, g, rgb );
+			out[0] = 255.0 * rgb[0];
+			out[1] = 255.0 * rgb[1];
+			out[2] = 255.0 * rgb[2];
+		}
+		out[3] = 0.0f;
+	}
+	return result;
+}
+
+/** Get the grade of a frame from the properties.
+*/
+
+static void get_grade( mlt_filter filter, mlt_frame frame, private_data *self, int yuv, grade *g )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	static const char *channels[3] = { "r", "g", "b" };
+	const char *matrix = mlt_properties_get( properties, "matrix" );
+	char name[16];
+	int i;
+
+	memset( g, 0, sizeof( *g ) );
+	for ( i = 0; i < 3; i++ )
+	{
+		snprintf( name, sizeof( name ), "lift_%s", channels[i] );
+		g->lift[i] = mlt_properties_anim_get_double( properties, name, position, length );
+		snprintf( name, sizeof( name ), "gamma_%s", channels[i] );
+		g->gamma[i] = mlt_properties_anim_get_double( properties, name, position, length );
+		snprintf( name, sizeof( name ), "gain_%s", channels[i] );
+		g->gain[i] = mlt_properties_anim_get_double( properties, name, position, length );
+		if ( g->gamma[i] <= 0.0 )
+			g->gamma[i] = 1.0;
+	}
+	g->saturation = mlt_properties_anim_get_double( properties, "saturation", position, length );
+
+	// The matrix is 9 numbers in rows, which default to the identity.
+	if ( !matrix || sscanf( matrix, "%lf %lf %lf %lf %lf %lf %lf %lf %lf",
+			&g->matrix[0], &g->matrix[1], &g->matrix[2], &g->matrix[3], &g->matrix[4],
+			&g->matrix[5], &g->matrix[6], &g->matrix[7], &g->matrix[8] ) != 9 )
+	{
+		memset( g->matrix, 0, sizeof( g->matrix ) );
+		g->matrix[0] = g->matrix[4] = g->matrix[8] = 1.0;
+	}
+
+	g->size = self->file_size ? self->file_size : mlt_properties_get_int( properties, "size" );
+	g->size = CLAMP( g->size, MIN_SIZE, MAX_SIZE );
+	g->yuv = yuv;
+}
+
+static int is_identity( private_data *self, const grade *g )
+{
+	int i;
+
+	if ( self->file || g->saturation != 1.0 )
+		return 0;
+	for ( i = 0; i < 3; i++ )
+		if ( g->lift[i] != 0.0 || g->gamma[i] != 1.0 || g->gain[i] != 1.0 )
+			return 0;
+	for ( i = 0; i < 9; i++ )
+		if ( g->matrix[i] != ( i % 4 ? 0.0 : 1.0 ) )
+			return 0;
+	return 1;
+}
+
+/** Get the nodes of a grade, compiling them if it changed.
+ *
+ * The nodes are shared with the cache of the filter, or copied when the
+ * memory pool is disabled; release them with mlt_pool_release().
+ */
+
+static float *get_nodes( mlt_filter filter, private_data *self, const grade *g )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	const char *name = g->yuv ? "_yuv_nodes" : "_rgb_nodes";
+	char key_name[16];
+	int size = g->size * g->size * g->size * 4 * sizeof( float );
+	grade *key;
+	float *nodes;
+
+	snprintf( key_name, sizeof( key_name ), "%s_key", name );
+	key = mlt_properties_get_data( properties, key_name, NULL );
+	nodes = mlt_properties_get_data( properties, name, NULL );
+
+	if ( !nodes || !key || memcmp( key, g, sizeof( *g ) ) )
+	{
+		nodes = compile_nodes( self, g );
+		if ( !nodes )
+			return NULL;
+		mlt_properties_set_data( properties, name, nodes, size, mlt_pool_release, NULL );
+		key = malloc( sizeof( *key ) );
+		memcpy( key, g, sizeof( *key ) );
+		mlt_properties_set_data( properties, key_name, key, sizeof( *key ), free, NULL );
+	}
+
+	if ( mlt_pool_retain( nodes ) )
+		return nodes;
+
+	float *copy = mlt_pool_alloc( size );
+	if ( copy )
+		memcpy( copy, nodes, size );
+	return copy;
+}
+
+/** Find the 4 nodes of the tetrahedron of a cell that holds a colour and their weights.
+ *
+ * The tetrahedral interpolation keeps the grey axis exact and only reads 4
+ * nodes; the trilinear weighs all 8 corners of the cell.
+ */
+
+LUT3D_INLINE const float *tetrahedron( const slice_desc *desc, int a, int b, int c, const float *n[3], float w[4] )
+{
+	int ga = desc->stride[0], gb = desc->stride[1], gc = desc->stride[2];
+	const float *base = desc->nodes + desc->offset[0][a] + desc->offset[1][b] + desc->offset[2][c];
+	float fa = desc->fraction[a], fb = desc->fraction[b], fc = desc->fraction[c];
+
+	n[2] = base + ga + gb + gc;
+	if ( fa > fb )
+	{
+		if ( fb > fc )
+			n[0] = base + ga, n[1] = base + ga + gb, w[1] = fa - fb, w[2] = fb - fc, w[3] = fc;
+		else if ( fa > fc )
+			n[0] = base + ga, n[1] = base + ga + gc, w[1] = fa - fc, w[2] = fc - fb, w[3] = fb;
+		else
+			n[0] = base + gc, n[1] = base + ga + gc, w[1] = fc - fa, w[2] = fa - fb, w[3] = fb;
+	}
+	else
+	{
+		if ( fc > fb )
+			n[0] = base + gc, n[1] = base + gb + gc, w[1] = fc - fb, w[2] = fb - fa, w[3] = fa;
+		else if ( fc > fa )
+			n[0] = base + gb, n[1] = base + gb + gc, w[1] = fb - fc, w[2] = fc - fa, w[3] = fa;
+		else
+			n[0] = base + gb, n[1] = base + ga + gb, w[1] = fb - fa, w[2] = fa - fc, w[3] = fc;
+	}
+	w[0] = 1.0f - w[1] - w[2] - w[3];
+	return base;
+}
+
+LUT3D_INLINE void interpolate_c( const slice_desc *desc, int a, int b, int c, float out[3] )
+{
+	int i;
+
+	if ( desc->tetrahedral )
+	{
+		const float *n[3], *base;
+		float w[4];
+
+		base = tetrahedron( desc, a, b, c, n, w );
+		for ( i = 0; i < 3; i++ )
+			out[i] = w[0] * base[i] + w[1] * n[0][i] + w[2] * n[1][i] + w[3] * n[2][i];
+	}
+	else
+	{
+		int ga = desc->stride[0], gb = desc->stride[1], gc = desc->stride[2];
+		const float *base = desc->nodes + desc->offset[0][a] + desc->offset[1][b] + desc->offset[2][c];
+		float fa = desc->fraction[a], fb = desc->fraction[b], fc = desc->fraction[c];
+
+		for ( i = 0; i < 3; i++ )
+		{
+			float c00 = base[i] + fa * ( base[ga + i] - base[i] );
+			float c10 = base[gb + i] + fa * ( base[ga + gb + i] - base[gb + i] );
+			float c01 = base[gc + i] + fa * ( base[ga + gc + i] - base[gc + i] );
+			float c11 = base[gb + gc + i] + fa * ( base[ga + gb + gc + i] - base[gb + gc + i] );
+			float c0 = c00 + fb * ( c10 - c00 );
+			float c1 = c01 + fb * ( c11 - c01 );
+			out[i] = c0 + fc * ( c1 - c0 );
+		}
+	}
+}
+
+LUT3D_INLINE uint8_t to_byte( float value )
+{
+	int result = (int) ( value + 0.5f );
+	return CLAMP( result, 0, 255 );
+}
+
+/** Grade the rows [y, end) of an image.
+ *
+ * Both pixels of a yuv422 pair are graded with their chroma, which is then
+ * averaged; the last pixel of an odd row takes V from the pair before it.
+ */
+
+typedef void ( *grade_rows_function )( const slice_desc *desc, int y, int end );
+
+static void grade_rows_c( const slice_desc *desc, int y, int end )
+{
+	float out[3], out2[3];
+	int x;
+
+	for ( ; y < end; y++ )
+	{
+		if ( desc->format == mlt_image_yuv422 )
+		{
+			uint8_t *p = desc->image + y * desc->width * 2;
+			for ( x = 0; x + 1 < desc->width; x += 2, p += 4 )
+			{
+				interpolate_c( desc, p[0], p[1], p[3], out );
+				interpolate_c( desc, p[2], p[1], p[3], out2 );
+				p[0] = to_byte( out[0] );
+				p[1] = to_byte( 0.5f * ( out[1] + out2[1] ) );
+				p[2] = to_byte( out2[0] );
+				p[3] = to_byte( 0.5f * ( out[2] + out2[2] ) );
+			}
+			if ( x < desc->width )
+			{
+				interpolate_c( desc, p[0], p[1], x ? p[-1] : 128, out );
+				p[0] = to_byte( out[0] );
+				p[1] = to_byte( out[1] );
+			}
+		}
+		else
+		{
+			int step = desc->format == mlt_image_rgb24a ? 4 : 3;
+			uint8_t *p = desc->image + y * desc->width * step;
+			for ( x = 0; x < desc->width; x++, p += step )
+			{
+				interpolate_c( desc, p[0], p[1], p[2], out );
+				p[0] = to_byte( out[0] );
+				p[1] = to_byte( out[1] );
+				p[2] = to_byte( out[2] );
+			}
+		}
+	}
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define LUT3D_SSE2 __attribute__((target("sse2")))
+
+/* A node is a vector of 4 floats, so a pixel is interpolated with a few
+ * vector multiplies and adds, and rounded and packed to bytes at once.
+ */
+
+LUT3D_INLINE LUT3D_SSE2 __m128 interpolate_sse2( const slice_desc *desc, int a, int b, int c )
+{
+	__m128 result;
+
+	if ( desc->tetrahedral )
+	{
+		const float *n[3], *base;
+		float w[4];
+
+		base = tetrahedron( desc, a, b, c, n, w );
+		result = _mm_mul_ps( _mm_set1_ps( w[0] ), _mm_loadu_ps( base ) );
+		result = _mm_add_ps( result, _mm_mul_ps( _mm_set1_ps( w[1] ), _mm_loadu_ps( n[0] ) ) );
+		result = _mm_add_ps( result, _mm_mul_ps( _mm_set1_ps( w[2] ), _mm_loadu_ps( n[1] ) ) );
+		result = _mm_add_ps( result, _mm_mul_ps( _mm_set1_ps( w[3] ), _mm_loadu_ps( n[2] ) ) );
+	}
+	else
+	{
+		int ga = desc->stride[0], gb = desc->stride[1], gc = desc->stride[2];
+		const float *base = desc->nodes + desc->offset[0][a] + desc->offset[1][b] + desc->offset[2][c];
+		__m128 va = _mm_set1_ps( desc->fraction[a] );
+		__m128 vb = _mm_set1_ps( desc->fraction[b] );
+		__m128 vc = _mm_set1_ps( desc->fraction[c] );
+		__m128 n000 = _mm_loadu_ps( base );
+		__m128 n100 = _mm_loadu_ps( base + ga );
+		__m128 n010 = _mm_loadu_ps( base + gb );
+		__m128 n110 = _mm_loadu_ps( base + ga + gb );
+		__m128 n001 = _mm_loadu_ps( base + gc );
+		__m128 n101 = _mm_loadu_ps( base + ga + gc );
+		__m128 n011 = _mm_loadu_ps( base + gb + gc );
+		__m128 n111 = _mm_loadu_ps( base + ga + gb + gc );
+		__m128 c00 = _mm_add_ps( n000, _mm_mul_ps( va, _mm_sub_ps( n100, n000 ) ) );
+		__m128 c10 = _mm_add_ps( n010, _mm_mul_ps( va, _mm_sub_ps( n110, n010 ) ) );
+		__m128 c01 = _mm_add_ps( n001, _mm_mul_ps( va, _mm_sub_ps( n101, n001 ) ) );
+		__m128 c11 = _mm_add_ps( n011, _mm_mul_ps( va, _mm_sub_ps( n111, n011 ) ) );
+		__m128 c0 = _mm_add_ps( c00, _mm_mul_ps( vb, _mm_sub_ps( c10, c00 ) ) );
+		__m128 c1 = _mm_add_ps( c01, _mm_mul_ps( vb, _mm_sub_ps( c11, c01 ) ) );
+		result = _mm_add_ps( c0, _mm_mul_ps( vc, _mm_sub_ps( c1, c0 ) ) );
+	}
+	return result;
+}
+
+// Round the channels of a vector as to_byte() and pack them into an integer.
+LUT3D_INLINE LUT3D_SSE2 uint32_t pack_sse2( __m128 value )
+{
+	__m128i result = _mm_cvttps_epi32( _mm_add_ps( value, _mm_set1_ps( 0.5f ) ) );
+	result = _mm_packs_epi32( result, result );
+	return _mm_cvtsi128_si32( _mm_packus_epi16( result, result ) );
+}
+
+static LUT3D_SSE2 void grade_rows_sse2( const slice_desc *desc, int y, int end )
+{
+	const __m128 half = _mm_set1_ps( 0.5f );
+	uint32_t out;
+	int x;
+
+	for ( ; y < end; y++ )
+	{
+		if ( desc->format == mlt_image_yuv422 )
+		{
+			uint8_t *p = desc->image + y * desc->width * 2;
+			for ( x = 0; x + 1 < desc->width; x += 2, p += 4 )
+			{
+				__m128 v1 = interpolate_sse2( desc, p[0], p[1], p[3] );
+				__m128 v2 = interpolate_sse2( desc, p[2], p[1], p[3] );
+				out = pack_sse2( _mm_mul_ps( half, _mm_add_ps( v1, v2 ) ) );
+				p[0] = pack_sse2( v1 );
+				p[1] = out >> 8;
+				p[2] = pack_sse2( v2 );
+				p[3] = out >> 16;
+			}
+			if ( x < desc->width )
+			{
+				out = pack_sse2( interpolate_sse2( desc, p[0], p[1], x ? p[-1] : 128 ) );
+				p[0] = out;
+				p[1] = out >> 8;
+			}
+		}
+		else
+		{
+			int step = desc->format == mlt_image_rgb24a ? 4 : 3;
+			uint8_t *p = desc->image + y * desc->width * step;
+			for ( x = 0; x < desc->width; x++, p += step )
+			{
+				out = pack_sse2( interpolate_sse2( desc, p[0], p[1], p[2] ) );
+				p[0] = out;
+				p[1] = out >> 8;
+				p[2] = out >> 16;
+			}
+		}
+	}
+}
+
+static grade_rows_function grade_rows_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return grade_rows_sse2;
+	return grade_rows_c;
+}
+
+#else
+
+static grade_rows_function grade_rows_detect( void )
+{
+	return grade_rows_c;
+}
+
+#endif
+
+static int slice_proc( int id, int index, int jobs, void *cookie )
+{
+	const slice_desc *desc = cookie;
+	grade_rows_function grade_rows = grade_rows_detect();
+
+	grade_rows( desc, desc->height * index / jobs, desc->height * ( index + 1 ) / jobs );
+	return 0;
+}
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter = mlt_frame_pop_service( frame );
+	private_data *self = filter->child;
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	float *nodes = NULL;
+	grade g;
+	int error;
+
+	// Grade the image in the format it comes in when the table can take it.
+	if ( *format != mlt_image_yuv422 && *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
+		*format = mlt_image_rgb24a;
+
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+	refresh_file( filter, self );
+	get_grade( filter, frame, self, *format == mlt_image_yuv422, &g );
+	if ( !is_identity( self, &g ) )
+		nodes = get_nodes( filter, self, &g );
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+
+	error = mlt_frame_get_image( frame, image, format, width, height, nodes != NULL );
+
+	if ( !error && nodes && *image && ( *format == mlt_image_yuv422 ) == g.yuv &&
+		( *format == mlt_image_yuv422 || *format == mlt_image_rgb24 || *format == mlt_image_rgb24a ) )
+	{
+		slice_desc *desc = malloc( sizeof( *desc ) );
+		int jobs = MIN( mlt_slices_count_normal(), *height / MIN_SLICE_HEIGHT );
+		int i;
+
+		desc->nodes = nodes;
+		desc->size = g.size;
+		desc->tetrahedral = strcmp( mlt_properties_get( properties, "interpolation" ) ? mlt_properties_get( properties, "interpolation" ) : "", "trilinear" );
+		desc->image = *image;
+		desc->format = *format;
+		desc->width = *width;
+		desc->height = *height;
+		desc->stride[0] = 4;
+		desc->stride[1] = 4 * g.size;
+		desc->stride[2] = 4 * g.size * g.size;
+
+		// The cell and position in it of every 8-bit value
+		for ( i = 0; i < 256; i++ )
+		{
+			float x = (float) i * ( g.size - 1 ) / 255.0f;
+			int index = MIN( (int) x, g.size - 2 );
+			desc->offset[0][i] = index * desc->stride[0];
+			desc->offset[1][i] = index * desc->stride[1];
+			desc->offset[2][i] = index * desc->stride[2];
+			desc->fraction[i] = x - index;
+		}
+
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, slice_proc, desc );
+		else
+			slice_proc( 0, 0, 1, desc );
+		free( desc );
+	}
+	mlt_pool_release( nodes );
+
+	return error;
+}
+
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	mlt_frame_push_service( frame, filter );
+	mlt_frame_push_get_image( frame, filter_get_image );
+	return frame;
+}
+
+static void filter_close( mlt_filter filter )
+{
+	private_data *self = filter->child;
+
+	free( self->resource );
+	free( self->file );
+	free( self );
+	filter->child = NULL;
+	filter->close = NULL;
+	filter->parent.close = NULL;
+	mlt_service_close( &filter->parent );
+}
+
+mlt_filter filter_lut3d_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_filter filter = mlt_filter_new();
+	private_data *self = calloc( 1, sizeof( private_data ) );
+
+	if ( filter && self )
+	{
+		mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set( properties, "interpolation", "tetrahedral" );
+		mlt_properties_set_int( properties, "size", DEFAULT_SIZE );
+		mlt_properties_set_double( properties, "lift_r", 0.0 );
+		mlt_properties_set_double( properties, "lift_g", 0.0 );
+		mlt_properties_set_double( properties, "lift_b", 0.0 );
+		mlt_properties_set_double( properties, "gamma_r", 1.0 );
+		mlt_properties_set_double( properties, "gamma_g", 1.0 );
+		mlt_properties_set_double( properties, "gamma_b", 1.0 );
+		mlt_properties_set_double( properties, "gain_r", 1.0 );
+		mlt_properties_set_double( properties, "gain_g", 1.0 );
+		mlt_properties_set_double( properties, "gain_b", 1.0 );
+		mlt_properties_set_double( properties, "saturation", 1.0 );
+
+		filter->close = filter_close;
+		filter->process = filter_process;
+		filter->child = self;
+	}
+	else
+	{
+		mlt_log_error( MLT_FILTER_SERVICE(filter), "Filter lut3d init failed\n" );
+		mlt_filter_close( filter );
+		filter = NULL;
+		free( self );
+	}
+
+	return filter;
+}
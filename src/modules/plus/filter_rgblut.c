@@ -58,20 +58,15 @@ static void fill_channel_lut(int lut[], char* channel_table_str)
 	mlt_tokeniser_close( tokeniser );
 }
 
-/** Do it :-).
+/** Filter processing.
 */
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
-{
-	// Get the image
-	mlt_filter filter = mlt_frame_pop_service( frame );
 
-	*format = mlt_image_rgb24;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 0 );
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
+{
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_rgb24 );
 
-	// Only process if we have no error and a valid colour space
-	if ( error == 0 )
+	if ( lut )
 	{
-
 		// Create lut tables from properties for each RGB channel
 		char* r_str = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "R_table" );
 		int r_lut[256];
@@ -85,29 +80,15 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int b_lut[256];
 		fill_channel_lut( b_lut, b_str );
 
-		// Apply look-up tables into image
-		int i = *width * *height + 1;
-		uint8_t *p = *image;
-		uint8_t *r = *image;
-		while ( --i )
+		// Compose the look-up tables into those of the frame
+		int i;
+		for ( i = 0; i < 256; i++ )
 		{
-			*p ++ = r_lut[ *r ++ ];
-			*p ++ = g_lut[ *r ++ ];
-			*p ++ = b_lut[ *r ++ ];
+			lut->table[0][i] = r_lut[ lut->table[0][i] ];
+			lut->table[1][i] = g_lut[ lut->table[1][i] ];
+			lut->table[2][i] = b_lut[ lut->table[2][i] ];
 		}
 	}
-
-	return error;
-}
-
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	// Push the frame filter
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
@@ -23,66 +23,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
-/** Do it :-).
+/** Filter processing.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	// Get the filter
-	mlt_filter filter = mlt_frame_pop_service( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
+	mlt_lut *lut = mlt_frame_push_lut( frame, mlt_image_yuv422 );
 
-	// Get the image
-	*format = mlt_image_yuv422;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
-
-	// Only process if we have no error and a valid colour space
-	if ( error == 0 && *image )
+	if ( lut )
 	{
-		// We modify the whole image
-		uint8_t *p = *image;
-		int h = *height;
-		int uneven = *width % 2;
-		int w = ( *width - uneven ) / 2;
-		int t;
-
 		// Get u and v values
 		int u = mlt_properties_anim_get_int( properties, "u", position, length );
 		int v = mlt_properties_anim_get_int( properties, "v", position, length );
 
-		// Loop through image
-		while( h -- )
-		{
-			t = w;
-			while( t -- )
-			{
-				p ++;
-				*p ++ = u;
-				p ++;
-				*p ++ = v;
-			}
-			if ( uneven )
-			{
-				p ++;
-				*p ++ = u;
-			}
-		}
+		memset( lut->table[ 1 ], u, 256 );
+		memset( lut->table[ 2 ], v, 256 );
 	}
-
-	return error;
-}
-
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	// Push the frame filter
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
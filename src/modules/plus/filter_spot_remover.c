@@ -79,43 +79,135 @@ mlt_rect constrain_rect( mlt_rect rect, int max_x, int max_y )
 	return rect;
 }
 
+/** The fixed point unit of the interpolation weights. */
+#define WEIGHT_ONE ( 1 << 14 )
+
+/** Interpolate a line of values within the rect.
+  *
+  * \param out the values to write
+  * \param xpairs the weights of the left and right values for each value
+  * \param tbpairs the top and bottom values for each value
+  * \param lr the left value in the low and the right value in the high 16 bits
+  * \param ypair the top weight in the low and the bottom weight in the high 16 bits
+  * \param count the number of values
+  */
+typedef void ( *spot_row_function )( uint8_t *out, const int16_t *xpairs, const int16_t *tbpairs, int32_t lr, int32_t ypair, int count );
+
+static void spot_row_c( uint8_t *out, const int16_t *xpairs, const int16_t *tbpairs, int32_t lr, int32_t ypair, int count )
+{
+	int l = lr & 0xffff, r = lr >> 16;
+	int yw = ypair & 0xffff, ywc = ypair >> 16;
+	int x;
+	for ( x = 0; x < count; x++ )
+	{
+		int sum = l * xpairs[ 2 * x ] + r * xpairs[ 2 * x + 1 ] + tbpairs[ 2 * x ] * yw + tbpairs[ 2 * x + 1 ] * ywc;
+		out[ x ] = sum >> 15;
+	}
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define SPOT_SSE2 __attribute__((target("sse2")))
+
+static SPOT_SSE2 inline __m128i spot_sum_epi32( const int16_t *xpairs, const int16_t *tbpairs, __m128i lr, __m128i ypair )
+{
+	__m128i x = _mm_madd_epi16( _mm_loadu_si128( (const __m128i*) xpairs ), lr );
+	__m128i y = _mm_madd_epi16( _mm_loadu_si128( (const __m128i*) tbpairs ), ypair );
+	return _mm_srli_epi32( _mm_add_epi32( x, y ), 15 );
+}
+
+static SPOT_SSE2 void spot_row_sse2( uint8_t *out, const int16_t *xpairs, const int16_t *tbpairs, int32_t lr, int32_t ypair, int count )
+{
+	__m128i lr4 = _mm_set1_epi32( lr );
+	__m128i ypair4 = _mm_set1_epi32( ypair );
+	int x;
+
+	for ( x = 0; x + 8 <= count; x += 8 )
+	{
+		__m128i lo = spot_sum_epi32( xpairs + 2 * x, tbpairs + 2 * x, lr4, ypair4 );
+		__m128i hi = spot_sum_epi32( xpairs + 2 * x + 8, tbpairs + 2 * x + 8, lr4, ypair4 );
+		__m128i values = _mm_packs_epi32( lo, hi );
+		_mm_storel_epi64( (__m128i*) ( out + x ), _mm_packus_epi16( values, values ) );
+	}
+	spot_row_c( out + x, xpairs + 2 * x, tbpairs + 2 * x, lr, ypair, count - x );
+}
+
+static spot_row_function spot_simd_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return spot_row_sse2;
+	return spot_row_c;
+}
+
+#else
+
+static spot_row_function spot_simd_detect( void )
+{
+	return spot_row_c;
+}
+
+#endif
+
 /** Perform spot removal on a channel.
   *
   * Values within the rectangle are replaced with interpolated values.
   * Each value is an interpolation of the first values outside of the rect on
   * the top, bottom, left and right of the value being interpolated.
+  * Only the rect and the values around it are read.
   *
   * \param chan a pointer to the first value in the channel
-  * \param rowCount the number of values in each line (row)
+  * \param stride the number of bytes between lines (rows)
   * \param step the space between values in each line
   * \param rect the area to be removed
   */
-static void remove_spot_channel( uint8_t *chan, int rowCount, int step, mlt_rect rect )
+static void remove_spot_channel( uint8_t *chan, int stride, int step, mlt_rect rect )
 {
-	int yStop = rect.y + rect.h;
-	int xStop = rect.x + rect.w;
-	int rowSize = rowCount * step;
-	int y;
-	for ( y = rect.y; y < yStop; y++ )
-	{
-		uint8_t* xValueL = chan + ( y * rowSize ) + ( ( (int)rect.x - 1 ) * step );
-		uint8_t* xValueR = xValueL + ( (int)rect.w * step );
-		uint8_t* p = chan + ( y * rowSize ) + ( (int)rect.x * step );
-		double yRatio = 1.0 - ( ( y - rect.y ) / rect.h );
-		int x;
-		for ( x = rect.x; x < xStop; x++ )
+	static spot_row_function spot_row = NULL;
+	int rx = rect.x, ry = rect.y, rw = rect.w, rh = rect.h;
+	int16_t *xpairs = mlt_pool_alloc( rw * 4 * sizeof( *xpairs ) + rw );
+	int16_t *tbpairs = xpairs + rw * 2;
+	uint8_t *line = (uint8_t*) ( tbpairs + rw * 2 );
+	const uint8_t *top = chan + ( ry - 1 ) * stride + rx * step;
+	const uint8_t *bottom = top + rh * stride;
+	int x, y;
+
+	if ( !xpairs )
+		return;
+	if ( !spot_row )
+		spot_row = spot_simd_detect();
+
+	// The column weights and the top and bottom values are the same for every line.
+	// The right and bottom values are the last ones within the rect, as they always were.
+	for ( x = 0; x < rw; x++ )
+	{
+		int xw = WEIGHT_ONE - x * WEIGHT_ONE / rw;
+		xpairs[ 2 * x ] = xw;
+		xpairs[ 2 * x + 1 ] = WEIGHT_ONE - xw;
+		tbpairs[ 2 * x ] = top[ x * step ];
+		tbpairs[ 2 * x + 1 ] = bottom[ x * step ];
+	}
+
+	for ( y = 0; y < rh; y++ )
+	{
+		uint8_t *p = chan + ( ry + y ) * stride + rx * step;
+		int32_t yw = WEIGHT_ONE - y * WEIGHT_ONE / rh;
+		int32_t lr = p[ -step ] | ( p[ ( rw - 1 ) * step ] << 16 );
+
+		if ( step == 1 )
+		{
+			spot_row( p, xpairs, tbpairs, lr, yw | ( ( WEIGHT_ONE - yw ) << 16 ), rw );
+		}
+		else
 		{
-			uint8_t* yValueT = chan  + ( ( (int)rect.y - 1 ) * rowSize ) + ( x * step );
-			uint8_t* yValueB = yValueT + (int)rect.h * rowSize;
-			double xRatio = 1.0 - ( ( x - rect.x ) / rect.w );
-			unsigned int xValueInterp = ( *xValueL * xRatio ) + ( *xValueR * ( 1.0 - xRatio ) );
-			unsigned int yValueInterp = ( *yValueT * yRatio ) + ( *yValueB * ( 1.0 - yRatio ) );
-			unsigned int value = ( xValueInterp + yValueInterp ) / 2;
-			if ( value > 255 ) value = 255;
-			*p = value;
-			p += step;
+			spot_row( line, xpairs, tbpairs, lr, yw | ( ( WEIGHT_ONE - yw ) << 16 ), rw );
+			for ( x = 0; x < rw; x++ )
+				p[ x * step ] = line[ x ];
 		}
 	}
+	mlt_pool_release( xpairs );
 }
 
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
@@ -129,23 +221,6 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		mlt_log_warning( MLT_FILTER_SERVICE(filter), "rect property not set\n" );
 		return mlt_frame_get_image( frame, image, format, width, height, writable );
 	}
-	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
-	mlt_position position = mlt_filter_get_position( filter, frame );
-	mlt_position length = mlt_filter_get_length2( filter, frame );
-	mlt_rect rect = mlt_properties_anim_get_rect( filter_properties, "rect", position, length );
-	if ( strchr( rect_str, '%' ) )
-	{
-		rect.x *= profile->width;
-		rect.w *= profile->width;
-		rect.y *= profile->height;
-		rect.h *= profile->height;
-	}
-	rect = constrain_rect( rect, profile->width, profile->height );
-	if ( rect.w < 1 || rect.h < 1 )
-	{
-		mlt_log_info( MLT_FILTER_SERVICE(filter), "rect invalid\n" );
-		return mlt_frame_get_image( frame, image, format, width, height, writable );
-	}
 
 	switch( *format )
 	{
@@ -159,50 +234,80 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 			*format = mlt_image_rgb24a;
 			break;
 	}
-	error = mlt_frame_get_image( frame, image, format, width, height, 1 );
+
+	// A view of the image is fine since only the rect is touched.
+	error = mlt_frame_get_image_view( frame, image, format, width, height, 1 );
 	if (error) return error;
 
+	// The rect is in profile coordinates but the image may be scaled.
+	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	mlt_rect rect = mlt_properties_anim_get_rect( filter_properties, "rect", position, length );
+	if ( strchr( rect_str, '%' ) )
+	{
+		rect.x *= *width;
+		rect.w *= *width;
+		rect.y *= *height;
+		rect.h *= *height;
+	}
+	else
+	{
+		rect = scale_rect( rect, (double) profile->width / *width, (double) profile->height / *height );
+	}
+	rect = constrain_rect( rect, *width, *height );
+	if ( rect.w < 1 || rect.h < 1 )
+	{
+		mlt_log_info( MLT_FILTER_SERVICE(filter), "rect invalid\n" );
+		return error;
+	}
+
+	uint8_t *planes[4];
+	int strides[4];
 	int i;
+	mlt_frame_get_image_planes( frame, planes, strides );
 	switch( *format )
 	{
 		case mlt_image_rgb24a:
 			for ( i = 0; i < 4; i++ )
 			{
-				remove_spot_channel( *image + i, *width, 4, rect );
+				remove_spot_channel( planes[0] + i, strides[0], 4, rect );
 			}
 			break;
 		case mlt_image_rgb24:
 			for ( i = 0; i < 3; i++ )
 			{
-				remove_spot_channel( *image + i, *width, 3, rect );
+				remove_spot_channel( planes[0] + i, strides[0], 3, rect );
 			}
 			break;
 		case mlt_image_yuv422:
 			// Y
-			remove_spot_channel( *image, *width, 2, rect );
+			remove_spot_channel( planes[0], strides[0], 2, rect );
 			// U
-			remove_spot_channel( *image + 1, *width / 2, 4,
+			remove_spot_channel( planes[0] + 1, strides[0], 4,
 								 constrain_rect( scale_rect( rect, 2, 1 ), *width / 2, *height ) );
 			// V
-			remove_spot_channel( *image + 3, *width / 2, 4,
+			remove_spot_channel( planes[0] + 3, strides[0], 4,
 								 constrain_rect( scale_rect( rect, 2, 1 ), *width / 2, *height ) );
 			break;
 		case mlt_image_yuv420p:
 			// Y
-			remove_spot_channel( *image, *width, 1, rect );
+			remove_spot_channel( planes[0], strides[0], 1, rect );
 			// U
-			remove_spot_channel( *image + (*width * *height), *width / 2, 1,
+			remove_spot_channel( planes[1], strides[1], 1,
 								 constrain_rect( scale_rect( rect, 2, 2 ), *width / 2, *height / 2 ) );
 			// V
-			remove_spot_channel( *image + (*width * *height * 5 / 4), *width / 2, 1,
+			remove_spot_channel( planes[2], strides[2], 1,
 								 constrain_rect( scale_rect( rect, 2, 2 ), *width / 2, *height / 2 ) );
 			break;
 		default:
 			return 1;
 	}
 
+	int alpha_size = 0;
 	uint8_t *alpha = mlt_frame_get_alpha( frame );
-	if ( alpha && *format != mlt_image_rgb24a )
+	mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), "alpha", &alpha_size );
+	if ( alpha && alpha_size >= *width * *height && *format != mlt_image_rgb24a )
 	{
 		remove_spot_channel( alpha, *width, 1, rect );
 	}
@@ -0,0 +1,211 @@
+/*
+ * interp_simd.c -- vectorized interpolation kernels for transition_affine
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "interp_simd.h"
+
+#include <stdlib.h>
+
+/* The kernels work on 8 pixels at a time. They gather the source pixels,
+ * split them into channels, and then follow the float arithmetic of
+ * interp.h operation for operation, including the truncation of the
+ * results to bytes. Only AVX2 has the gathers that make this pay off.
+ */
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 inline __m256 channel_avx2( __m256i pixels, int c )
+{
+	return _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( pixels, 8 * c ), _mm256_set1_epi32( 0xff ) ) );
+}
+
+static AVX2 inline __m256i to_byte_avx2( __m256 v, int c )
+{
+	return _mm256_slli_epi32( _mm256_and_si256( _mm256_cvttps_epi32( v ), _mm256_set1_epi32( 0xff ) ), 8 * c );
+}
+
+static AVX2 inline __m256i gather_avx2( const uint8_t *src, __m256i index )
+{
+	return _mm256_i32gather_epi32( (const int*) src, index, 4 );
+}
+
+// Blend the sampled colour channels p[0..3] onto the destination pixels.
+static AVX2 inline __m256i blend_avx2( __m256i v, const __m256 p[ 4 ], float o, int is_atop )
+{
+	__m256 one = _mm256_set1_ps( 1.0f );
+	__m256 max = _mm256_set1_ps( 255.0f );
+	__m256 alpha_sl = _mm256_mul_ps( _mm256_div_ps( p[ 3 ], max ), _mm256_set1_ps( o ) );
+	__m256 alpha_v = _mm256_div_ps( channel_avx2( v, 3 ), max );
+	__m256 alpha = _mm256_sub_ps( _mm256_add_ps( alpha_sl, alpha_v ), _mm256_mul_ps( alpha_sl, alpha_v ) );
+	__m256i result = to_byte_avx2( is_atop ? p[ 3 ] : _mm256_mul_ps( max, alpha ), 3 );
+	int c;
+
+	alpha = _mm256_div_ps( alpha_sl, alpha );
+	for ( c = 0; c < 3; c++ )
+	{
+		__m256 mixed = _mm256_add_ps( _mm256_mul_ps( channel_avx2( v, c ), _mm256_sub_ps( one, alpha ) ),
+			_mm256_mul_ps( p[ c ], alpha ) );
+		result = _mm256_or_si256( result, to_byte_avx2( mixed, c ) );
+	}
+	return result;
+}
+
+static AVX2 int bilinear_avx2( const uint8_t *src, int w, int h, const float *x, const float *y, int count,
+	float o, uint8_t *dst, int is_atop )
+{
+	__m256i width = _mm256_set1_epi32( w );
+	__m256i one = _mm256_set1_epi32( 1 );
+	int i, c;
+
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256 vx = _mm256_loadu_ps( x + i );
+		__m256 vy = _mm256_loadu_ps( y + i );
+		__m256i m = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_floor_ps( vx ) ), _mm256_set1_epi32( w - 2 ) );
+		__m256i n = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_floor_ps( vy ) ), _mm256_set1_epi32( h - 2 ) );
+		__m256 fx = _mm256_sub_ps( vx, _mm256_cvtepi32_ps( m ) );
+		__m256 fy = _mm256_sub_ps( vy, _mm256_cvtepi32_ps( n ) );
+		__m256i k = _mm256_add_epi32( _mm256_mullo_epi32( n, width ), m );
+		__m256i l = _mm256_add_epi32( k, width );
+		__m256i p00 = gather_avx2( src, k );
+		__m256i p01 = gather_avx2( src, _mm256_add_epi32( k, one ) );
+		__m256i p10 = gather_avx2( src, l );
+		__m256i p11 = gather_avx2( src, _mm256_add_epi32( l, one ) );
+		__m256 p[ 4 ];
+
+		for ( c = 0; c < 4; c++ )
+		{
+			__m256 s00 = channel_avx2( p00, c );
+			__m256 s10 = channel_avx2( p10, c );
+			__m256 a = _mm256_add_ps( s00, _mm256_mul_ps( _mm256_sub_ps( channel_avx2( p01, c ), s00 ), fx ) );
+			__m256 b = _mm256_add_ps( s10, _mm256_mul_ps( _mm256_sub_ps( channel_avx2( p11, c ), s10 ), fx ) );
+			p[ c ] = _mm256_add_ps( a, _mm256_mul_ps( _mm256_sub_ps( b, a ), fy ) );
+		}
+
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( dst + 4 * i ) );
+		_mm256_storeu_si256( (__m256i*)( dst + 4 * i ), blend_avx2( v, p, o, is_atop ) );
+	}
+	return i;
+}
+
+// Aitken-Neville interpolation of 4 samples at v, where the first sample is at first.
+static AVX2 inline __m256 neville_avx2( __m256 p[ 4 ], __m256 v, __m256 first )
+{
+	int i, j;
+	for ( j = 1; j < 4; j++ )
+		for ( i = 3; i >= j; i-- )
+		{
+			__m256 t = _mm256_sub_ps( _mm256_sub_ps( v, _mm256_set1_ps( i ) ), first );
+			__m256 k = _mm256_div_ps( t, _mm256_set1_ps( j ) );
+			p[ i ] = _mm256_add_ps( p[ i ], _mm256_mul_ps( k, _mm256_sub_ps( p[ i ], p[ i - 1 ] ) ) );
+		}
+	return p[ 3 ];
+}
+
+// Get the first of the 4 samples around a coordinate like interpBC_b32().
+static AVX2 inline __m256i first_sample_avx2( __m256 v, int size )
+{
+	__m256i m = _mm256_sub_epi32( _mm256_cvttps_epi32( _mm256_ceil_ps( v ) ), _mm256_set1_epi32( 2 ) );
+	m = _mm256_max_epi32( m, _mm256_setzero_si256() );
+	return _mm256_blendv_epi8( m, _mm256_set1_epi32( size - 4 ), _mm256_cmpgt_epi32( m, _mm256_set1_epi32( size - 5 ) ) );
+}
+
+static AVX2 int bicubic_avx2( const uint8_t *src, int w, int h, const float *x, const float *y, int count,
+	float o, uint8_t *dst, int is_atop )
+{
+	__m256i width = _mm256_set1_epi32( w );
+	int i, r, c, b;
+
+	for ( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256 vx = _mm256_loadu_ps( x + i );
+		__m256 vy = _mm256_loadu_ps( y + i );
+		__m256i m = first_sample_avx2( vx, w );
+		__m256i n = first_sample_avx2( vy, h );
+		__m256 fm = _mm256_cvtepi32_ps( m );
+		__m256 fn = _mm256_cvtepi32_ps( n );
+		__m256i pixels[ 4 ][ 4 ];
+		__m256 p[ 4 ];
+
+		for ( r = 0; r < 4; r++ )
+		{
+			__m256i l = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_add_epi32( n, _mm256_set1_epi32( r ) ), width ), m );
+			for ( c = 0; c < 4; c++ )
+				pixels[ r ][ c ] = gather_avx2( src, _mm256_add_epi32( l, _mm256_set1_epi32( c ) ) );
+		}
+		for ( b = 0; b < 4; b++ )
+		{
+			__m256 column[ 4 ];
+			for ( c = 0; c < 4; c++ )
+			{
+				__m256 s[ 4 ];
+				for ( r = 0; r < 4; r++ )
+					s[ r ] = channel_avx2( pixels[ r ][ c ], b );
+				column[ c ] = neville_avx2( s, vy, fn );
+			}
+			p[ b ] = neville_avx2( column, vx, fm );
+			p[ b ] = _mm256_min_ps( _mm256_max_ps( p[ b ], _mm256_setzero_ps() ), _mm256_set1_ps( 255.0f ) );
+		}
+
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( dst + 4 * i ) );
+		_mm256_storeu_si256( (__m256i*)( dst + 4 * i ), blend_avx2( v, p, o, is_atop ) );
+	}
+	return i;
+}
+
+static const struct interp_kernels avx2_kernels =
+{
+	"avx2",
+	bilinear_avx2,
+	bicubic_avx2
+};
+
+static const struct interp_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	return NULL;
+}
+
+#else
+
+static const struct interp_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct interp_kernels *interp_simd_kernels( void )
+{
+	static const struct interp_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_AFFINE_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
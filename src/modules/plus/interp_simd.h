@@ -0,0 +1,47 @@
+/*
+ * interp_simd.h -- vectorized interpolation kernels for transition_affine
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef INTERP_SIMD_H
+#define INTERP_SIMD_H
+
+#include <stdint.h>
+
+/** Interpolate and blend the leading pixels of a run and return how many were done.
+ *
+ * Pixel i of \p dst gets the source image sampled at \p x[i], \p y[i],
+ * which must all be within the limits of the interpolator. The kernels
+ * do the same arithmetic as interpBL_b32() and interpBC_b32() in interp.h,
+ * which blend the remaining pixels, but in a different order, so a few
+ * channels may differ from them by one.
+ */
+
+typedef int ( *interp_run_kernel )( const uint8_t *src, int w, int h, const float *x, const float *y, int count,
+	float o, uint8_t *dst, int is_atop );
+
+struct interp_kernels
+{
+	const char *name;
+	interp_run_kernel bilinear;
+	interp_run_kernel bicubic;
+};
+
+/** Get the best kernels for the CPU; any of them may be NULL. */
+const struct interp_kernels *interp_simd_kernels( void );
+
+#endif
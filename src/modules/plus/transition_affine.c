@@ -28,6 +28,7 @@
 #include <float.h>
 
 #include "interp.h"
+#include "interp_simd.h"
 
 static double alignment_parse( char* align )
 {
@@ -384,10 +385,13 @@ static inline void get_affine( affine_t *affine, mlt_transition transition, doub
 	}
 }
 
+#define TILE_SIZE (64)
+
 struct sliced_desc
 {
 	uint8_t *a_image, *b_image;
 	interpp interp;
+	interp_run_kernel run;
 	affine_t affine;
 	int a_width, a_height, b_width, b_height;
 	double lower_x, lower_y;
@@ -397,25 +401,87 @@ struct sliced_desc
 	double minima, xmax, ymax;
 };
 
+// Interpolate a run of pixels whose source coordinates are all in range.
+static void interpolate_run( struct sliced_desc *ctx, const float *x, const float *y, int count, uint8_t *dest )
+{
+	int i = 0;
+
+	if ( ctx->run )
+		i = ctx->run( ctx->b_image, ctx->b_width, ctx->b_height, x, y, count, ctx->mix, dest, ctx->b_alpha );
+	for ( ; i < count; i++ )
+		ctx->interp( ctx->b_image, ctx->b_width, ctx->b_height, x[i], y[i], ctx->mix, dest + 4 * i, ctx->b_alpha );
+}
+
+// Determine if a tile maps entirely outside of the source image.
+static int tile_is_outside( struct sliced_desc *ctx, int x, int y, int width, int height )
+{
+	double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+	int corner;
+
+	// The transform is affine, so the tile maps inside the hull of its corners.
+	for ( corner = 0; corner < 4; corner++ )
+	{
+		double cx = ctx->lower_x + x + ( corner & 1 ? width - 1 : 0 );
+		double cy = ctx->lower_y + y + ( corner & 2 ? height - 1 : 0 );
+		double dx = MapX( ctx->affine.matrix, cx, cy ) / ctx->dz + ctx->x_offset;
+		double dy = MapY( ctx->affine.matrix, cx, cy ) / ctx->dz + ctx->y_offset;
+		min_x = MIN( min_x, dx );
+		max_x = MAX( max_x, dx );
+		min_y = MIN( min_y, dy );
+		max_y = MAX( max_y, dy );
+	}
+	// Leave a margin for rounding.
+	return max_x < ctx->minima - 1 || min_x > ctx->xmax + 1 || max_y < ctx->minima - 1 || min_y > ctx->ymax + 1;
+}
+
 static int sliced_proc( int id, int index, int jobs, void* cookie )
 {
 	(void) id; // unused
-	struct sliced_desc ctx = *((struct sliced_desc*) cookie);
-	int height_slice = (ctx.a_height + jobs / 2) / jobs;
-	int starty = height_slice * index;
-	double x, y;
-	double dx, dy;
-	int i, j;
-
-	ctx.a_image += (index * height_slice) * (ctx.a_width * 4);
-	for (i = 0, y = ctx.lower_y; i < ctx.a_height; i++, y++) {
-		if (i >= starty && i < (starty + height_slice)) {
-			for (j = 0, x = ctx.lower_x; j < ctx.a_width; j++, x++) {
-				dx = MapX( ctx.affine.matrix, x, y ) / ctx.dz + ctx.x_offset;
-				dy = MapY( ctx.affine.matrix, x, y ) / ctx.dz + ctx.y_offset;
-				if (dx >= ctx.minima && dx <= ctx.xmax && dy >= ctx.minima && dy <= ctx.ymax)
-					ctx.interp(ctx.b_image, ctx.b_width, ctx.b_height, dx, dy, ctx.mix, ctx.a_image, ctx.b_alpha);
-				ctx.a_image += 4;
+	struct sliced_desc *ctx = (struct sliced_desc*) cookie;
+	int start = ctx->a_height * index / jobs;
+	int end = ctx->a_height * ( index + 1 ) / jobs;
+	// The source coordinates advance by a constant step per destination pixel.
+	double step_x = ctx->affine.matrix[0][0] / ctx->dz;
+	double step_y = ctx->affine.matrix[1][0] / ctx->dz;
+	float xs[ TILE_SIZE ], ys[ TILE_SIZE ];
+	int tile_x, tile_y, i, j;
+
+	for ( tile_y = start; tile_y < end; tile_y += TILE_SIZE )
+	{
+		int tile_h = MIN( TILE_SIZE, end - tile_y );
+		for ( tile_x = 0; tile_x < ctx->a_width; tile_x += TILE_SIZE )
+		{
+			int tile_w = MIN( TILE_SIZE, ctx->a_width - tile_x );
+			if ( tile_is_outside( ctx, tile_x, tile_y, tile_w, tile_h ) )
+				continue;
+			for ( i = tile_y; i < tile_y + tile_h; i++ )
+			{
+				double x = ctx->lower_x + tile_x;
+				double y = ctx->lower_y + i;
+				double row_x = MapX( ctx->affine.matrix, x, y ) / ctx->dz + ctx->x_offset;
+				double row_y = MapY( ctx->affine.matrix, x, y ) / ctx->dz + ctx->y_offset;
+				uint8_t *dest = ctx->a_image + ( i * ctx->a_width + tile_x ) * 4;
+				int first = 0, count = 0;
+
+				for ( j = 0; j < tile_w; j++ )
+				{
+					double dx = row_x + j * step_x;
+					double dy = row_y + j * step_y;
+					if ( dx >= ctx->minima && dx <= ctx->xmax && dy >= ctx->minima && dy <= ctx->ymax )
+					{
+						if ( !count )
+							first = j;
+						xs[ count ] = dx;
+						ys[ count++ ] = dy;
+					}
+					else if ( count )
+					{
+						interpolate_run( ctx, xs, ys, count, dest + first * 4 );
+						count = 0;
+					}
+				}
+				if ( count )
+					interpolate_run( ctx, xs, ys, count, dest + first * 4 );
 			}
 		}
 	}
@@ -668,6 +734,7 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 		else if ( strcmp( interps, "bilinear" ) == 0 )
 		{
 			desc.interp = interpBL_b32;
+			desc.run = interp_simd_kernels() ? interp_simd_kernels()->bilinear : NULL;
 			// uses floorf.
 		}
 		else if ( strcmp( interps, "bicubic" ) == 0 ||  strcmp( interps, "hyper" ) == 0 || strcmp( interps, "sinc" ) == 0 || strcmp( interps, "lanczos" ) == 0 || strcmp( interps, "spline" ) == 0 )
@@ -675,6 +742,7 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 			// TODO: lanczos 8x8
 			// TODO: spline 4x4 or 6x6
 			desc.interp = interpBC_b32;
+			desc.run = interp_simd_kernels() ? interp_simd_kernels()->bicubic : NULL;
 			// uses ceilf. Values should be > -1 and <= max.
 			desc.minima -= 1;
 		}
@@ -0,0 +1,225 @@
+/*
+ * transition_vqm_measure.c -- headless video quality measurement
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "vqm_metrics.h"
+
+#include <framework/mlt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct
+{
+	FILE *report;
+	int frames;
+	mlt_position last_position;
+	double psnr[3];     ///< the sums of the PSNR of the frames
+	double ssim[3];
+	double sse[3];      ///< the sums of the squared differences of the frames
+	double samples[3];
+} private_data;
+
+typedef struct
+{
+	mlt_frame frame;
+	uint8_t *image;
+	mlt_image_format format;
+	int width;
+	int height;
+	int error;
+} decode_job;
+
+static void *decode_image( void *arg )
+{
+	decode_job *job = (decode_job*) arg;
+	job->error = mlt_frame_get_image( job->frame, &job->image, &job->format, &job->width, &job->height, 0 );
+	return NULL;
+}
+
+// Open the report on the first frame, called with the service locked.
+static FILE *get_report( mlt_transition transition )
+{
+	private_data *pdata = (private_data*) transition->child;
+	const char *name = mlt_properties_get( MLT_TRANSITION_PROPERTIES( transition ), "report" );
+
+	if ( !pdata->report )
+	{
+		if ( name && strcmp( name, "" ) && strcmp( name, "-" ) )
+			pdata->report = fopen( name, "w" );
+		if ( !pdata->report )
+		{
+			if ( name && strcmp( name, "" ) && strcmp( name, "-" ) )
+				mlt_log_error( MLT_TRANSITION_SERVICE( transition ), "failed to open report %s\n", name );
+			pdata->report = stdout;
+		}
+		fprintf( pdata->report, "frame psnr[Y] psnr[Cb] psnr[Cr] ssim[Y] ssim[Cb] ssim[Cr]\n" );
+	}
+	return pdata->report;
+}
+
+static void add_frame( mlt_transition transition, mlt_position position, vqm_metrics *metrics )
+{
+	mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+	private_data *pdata = (private_data*) transition->child;
+	int p;
+
+	mlt_service_lock( MLT_TRANSITION_SERVICE( transition ) );
+
+	// Do not count a frame repeated while paused
+	if ( pdata->frames && position == pdata->last_position )
+	{
+		mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+		return;
+	}
+	pdata->last_position = position;
+	fprintf( get_report( transition ), "%05d %05.2f %05.2f %05.2f %5.3f %5.3f %5.3f\n",
+			position, metrics->psnr[0], metrics->psnr[1], metrics->psnr[2],
+			metrics->ssim[0], metrics->ssim[1], metrics->ssim[2] );
+	pdata->frames++;
+	for ( p = 0; p < 3; p++ )
+	{
+		pdata->psnr[p] += metrics->psnr[p];
+		pdata->ssim[p] += metrics->ssim[p];
+		pdata->sse[p] += metrics->sse[p];
+		pdata->samples[p] += metrics->samples[p];
+	}
+	mlt_properties_set_int( properties, "frames", pdata->frames );
+	mlt_properties_set_double( properties, "psnr.y", pdata->psnr[0] / pdata->frames );
+	mlt_properties_set_double( properties, "psnr.cb", pdata->psnr[1] / pdata->frames );
+	mlt_properties_set_double( properties, "psnr.cr", pdata->psnr[2] / pdata->frames );
+	mlt_properties_set_double( properties, "ssim.y", pdata->ssim[0] / pdata->frames );
+	mlt_properties_set_double( properties, "ssim.cb", pdata->ssim[1] / pdata->frames );
+	mlt_properties_set_double( properties, "ssim.cr", pdata->ssim[2] / pdata->frames );
+	mlt_service_unlock( MLT_TRANSITION_SERVICE( transition ) );
+}
+
+static int get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_frame b_frame = mlt_frame_pop_frame( a_frame );
+	mlt_properties properties = MLT_FRAME_PROPERTIES( a_frame );
+	mlt_transition transition = MLT_TRANSITION( mlt_frame_pop_service( a_frame ) );
+	mlt_properties transition_properties = MLT_TRANSITION_PROPERTIES( transition );
+	int window_size = mlt_properties_get_int( transition_properties, "window_size" );
+	decode_job job = { b_frame, NULL, mlt_image_yuv422, *width, *height, 0 };
+	pthread_t thread;
+	int threaded = mlt_properties_get_int( transition_properties, "parallel" );
+	vqm_metrics metrics;
+	int error;
+
+	// Decode the compared frame alongside the reference
+	if ( threaded && pthread_create( &thread, NULL, decode_image, &job ) )
+		threaded = 0;
+	*format = mlt_image_yuv422;
+	error = mlt_frame_get_image( a_frame, image, format, width, height, writable );
+	if ( threaded )
+		pthread_join( thread, NULL );
+	else
+		decode_image( &job );
+
+	if ( error || job.error || *format != mlt_image_yuv422 || job.format != mlt_image_yuv422
+		 || job.width != *width || job.height != *height )
+	{
+		mlt_log_warning( MLT_TRANSITION_SERVICE( transition ), "cannot compare frame %d\n", mlt_frame_get_position( a_frame ) );
+		return error;
+	}
+
+	if ( !vqm_metrics_yuv422( *image, job.image, *width, *height, window_size, &metrics ) )
+	{
+		mlt_properties_set_double( properties, "meta.vqm.psnr.y", metrics.psnr[0] );
+		mlt_properties_set_double( properties, "meta.vqm.psnr.cb", metrics.psnr[1] );
+		mlt_properties_set_double( properties, "meta.vqm.psnr.cr", metrics.psnr[2] );
+		mlt_properties_set_double( properties, "meta.vqm.ssim.y", metrics.ssim[0] );
+		mlt_properties_set_double( properties, "meta.vqm.ssim.cb", metrics.ssim[1] );
+		mlt_properties_set_double( properties, "meta.vqm.ssim.cr", metrics.ssim[2] );
+		add_frame( transition, mlt_frame_get_position( a_frame ), &metrics );
+	}
+
+	return 0;
+}
+
+static mlt_frame process( mlt_transition transition, mlt_frame a_frame, mlt_frame b_frame )
+{
+	mlt_frame_push_service( a_frame, transition );
+	mlt_frame_push_frame( a_frame, b_frame );
+	mlt_frame_push_get_image( a_frame, get_image );
+
+	return a_frame;
+}
+
+/** Write the averages over all the frames to the report.
+ *
+ * The first six are the means of the measurements of the frames, and the
+ * last three are the PSNR of the squared differences of all the frames.
+ */
+
+static void transition_close( mlt_transition transition )
+{
+	private_data *pdata = (private_data*) transition->child;
+
+	if ( pdata )
+	{
+		if ( pdata->report && pdata->frames )
+		{
+			fprintf( pdata->report, "average %05.2f %05.2f %05.2f %5.3f %5.3f %5.3f %05.2f %05.2f %05.2f\n",
+				pdata->psnr[0] / pdata->frames, pdata->psnr[1] / pdata->frames, pdata->psnr[2] / pdata->frames,
+				pdata->ssim[0] / pdata->frames, pdata->ssim[1] / pdata->frames, pdata->ssim[2] / pdata->frames,
+				vqm_metrics_psnr( pdata->sse[0], pdata->samples[0] ),
+				vqm_metrics_psnr( pdata->sse[1], pdata->samples[1] ),
+				vqm_metrics_psnr( pdata->sse[2], pdata->samples[2] ) );
+		}
+		if ( pdata->report && pdata->report != stdout )
+			fclose( pdata->report );
+		else if ( pdata->report )
+			fflush( pdata->report );
+		free( pdata );
+	}
+	transition->child = NULL;
+	transition->close = NULL;
+	mlt_transition_close( transition );
+}
+
+mlt_transition transition_vqm_measure_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_transition transition = mlt_transition_new();
+	private_data *pdata = (private_data*) calloc( 1, sizeof( private_data ) );
+
+	if ( transition && pdata )
+	{
+		mlt_properties properties = MLT_TRANSITION_PROPERTIES( transition );
+
+		transition->process = process;
+		transition->close = transition_close;
+		transition->child = pdata;
+		mlt_properties_set_int( properties, "_transition_type", 1 ); // video only
+		mlt_properties_set_int( properties, "window_size", 8 );
+		mlt_properties_set_int( properties, "parallel", 1 );
+		if ( arg )
+			mlt_properties_set( properties, "report", arg );
+	}
+	else
+	{
+		if ( transition )
+			mlt_transition_close( transition );
+		free( pdata );
+		transition = NULL;
+	}
+
+	return transition;
+}
@@ -0,0 +1,351 @@
+/*
+ * vqm_metrics.c -- sliced and vectorized PSNR and SSIM of yuv422 images
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "vqm_metrics.h"
+
+#include <framework/mlt_slices.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Each row of both images is split into its planes, and the sums that the
+ * SSIM of a window needs are kept per column over the rows of a band of
+ * windows. All the sums are integers, so the results do not depend on the
+ * order they are added up in.
+ */
+
+typedef struct
+{
+	int32_t *a, *b, *aa, *bb, *ab;
+} column_sums;
+
+typedef void ( *deinterleave_function )( const uint8_t *yuv, int width, uint8_t *y, uint8_t *u, uint8_t *v );
+typedef uint64_t ( *accumulate_function )( const uint8_t *a, const uint8_t *b, int n, column_sums *sums );
+
+static void deinterleave_c( const uint8_t *yuv, int width, uint8_t *y, uint8_t *u, uint8_t *v )
+{
+	int i;
+	for ( i = 0; i + 1 < width; i += 2, yuv += 4 )
+	{
+		y[i] = yuv[0];
+		u[i / 2] = yuv[1];
+		y[i + 1] = yuv[2];
+		v[i / 2] = yuv[3];
+	}
+}
+
+// Add a row to the column sums, if any, and return its sum of squared differences.
+static uint64_t accumulate_c( const uint8_t *a, const uint8_t *b, int n, column_sums *sums )
+{
+	uint64_t sse = 0;
+	int i;
+	for ( i = 0; i < n; i++ )
+	{
+		int diff = a[i] - b[i];
+		sse += diff * diff;
+	}
+	if ( sums )
+	{
+		for ( i = 0; i < n; i++ )
+		{
+			sums->a[i] += a[i];
+			sums->b[i] += b[i];
+			sums->aa[i] += a[i] * a[i];
+			sums->bb[i] += b[i] * b[i];
+			sums->ab[i] += a[i] * b[i];
+		}
+	}
+	return sse;
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define VQM_SSE2 __attribute__((target("sse2")))
+
+static VQM_SSE2 void deinterleave_sse2( const uint8_t *yuv, int width, uint8_t *y, uint8_t *u, uint8_t *v )
+{
+	const __m128i low = _mm_set1_epi16( 0xff );
+	int i;
+
+	for ( i = 0; i + 16 <= width; i += 16, yuv += 32 )
+	{
+		__m128i x0 = _mm_loadu_si128( (const __m128i*) yuv );
+		__m128i x1 = _mm_loadu_si128( (const __m128i*) ( yuv + 16 ) );
+		__m128i c = _mm_packus_epi16( _mm_srli_epi16( x0, 8 ), _mm_srli_epi16( x1, 8 ) );
+		_mm_storeu_si128( (__m128i*) ( y + i ), _mm_packus_epi16( _mm_and_si128( x0, low ), _mm_and_si128( x1, low ) ) );
+		_mm_storel_epi64( (__m128i*) ( u + i / 2 ), _mm_packus_epi16( _mm_and_si128( c, low ), c ) );
+		_mm_storel_epi64( (__m128i*) ( v + i / 2 ), _mm_packus_epi16( _mm_srli_epi16( c, 8 ), c ) );
+	}
+	deinterleave_c( yuv, width - i, y + i, u + i / 2, v + i / 2 );
+}
+
+static VQM_SSE2 inline void add_sums_sse2( int32_t *sums, __m128i lo, __m128i hi )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i *p = (__m128i*) sums;
+	_mm_storeu_si128( p, _mm_add_epi32( _mm_loadu_si128( p ), _mm_unpacklo_epi16( lo, zero ) ) );
+	_mm_storeu_si128( p + 1, _mm_add_epi32( _mm_loadu_si128( p + 1 ), _mm_unpackhi_epi16( lo, zero ) ) );
+	_mm_storeu_si128( p + 2, _mm_add_epi32( _mm_loadu_si128( p + 2 ), _mm_unpacklo_epi16( hi, zero ) ) );
+	_mm_storeu_si128( p + 3, _mm_add_epi32( _mm_loadu_si128( p + 3 ), _mm_unpackhi_epi16( hi, zero ) ) );
+}
+
+// 16 samples at a time; the squares fit in 16 unsigned bits.
+static VQM_SSE2 uint64_t accumulate_sse2( const uint8_t *a, const uint8_t *b, int n, column_sums *sums )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sse = _mm_setzero_si128();
+	uint32_t lanes[4];
+	int i;
+
+	for ( i = 0; i + 16 <= n; i += 16 )
+	{
+		__m128i va = _mm_loadu_si128( (const __m128i*) ( a + i ) );
+		__m128i vb = _mm_loadu_si128( (const __m128i*) ( b + i ) );
+		__m128i al = _mm_unpacklo_epi8( va, zero );
+		__m128i ah = _mm_unpackhi_epi8( va, zero );
+		__m128i bl = _mm_unpacklo_epi8( vb, zero );
+		__m128i bh = _mm_unpackhi_epi8( vb, zero );
+		__m128i dl = _mm_sub_epi16( al, bl );
+		__m128i dh = _mm_sub_epi16( ah, bh );
+		sse = _mm_add_epi32( sse, _mm_add_epi32( _mm_madd_epi16( dl, dl ), _mm_madd_epi16( dh, dh ) ) );
+		if ( sums )
+		{
+			add_sums_sse2( sums->a + i, al, ah );
+			add_sums_sse2( sums->b + i, bl, bh );
+			add_sums_sse2( sums->aa + i, _mm_mullo_epi16( al, al ), _mm_mullo_epi16( ah, ah ) );
+			add_sums_sse2( sums->bb + i, _mm_mullo_epi16( bl, bl ), _mm_mullo_epi16( bh, bh ) );
+			add_sums_sse2( sums->ab + i, _mm_mullo_epi16( al, bl ), _mm_mullo_epi16( ah, bh ) );
+		}
+	}
+	_mm_storeu_si128( (__m128i*) lanes, sse );
+	if ( sums && i < n )
+	{
+		column_sums rest = { sums->a + i, sums->b + i, sums->aa + i, sums->bb + i, sums->ab + i };
+		return (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3] + accumulate_c( a + i, b + i, n - i, &rest );
+	}
+	return (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3] + accumulate_c( a + i, b + i, n - i, NULL );
+}
+
+#endif
+
+static deinterleave_function deinterleave = NULL;
+static accumulate_function accumulate = NULL;
+
+static void detect_kernels( void )
+{
+	deinterleave = deinterleave_c;
+	accumulate = accumulate_c;
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+	{
+		deinterleave = deinterleave_sse2;
+		accumulate = accumulate_sse2;
+	}
+#endif
+}
+
+typedef struct
+{
+	const uint8_t *a;
+	const uint8_t *b;
+	int width;
+	int height;
+	int stride;           ///< the bytes of a row of the images
+	int window_size;
+	int bands;            ///< the rows of whole windows
+	int windows_x[3];
+	double *ssim[3];      ///< the SSIM of each window of each plane
+	uint64_t *sse;        ///< the sums of squared differences of each plane of each job
+	int error;
+} slice_desc;
+
+// The SSIM of a window from its sums, as in the vqm transition.
+static double window_ssim( double ref_acc, double ref_acc_2, double cmp_acc, double cmp_acc_2, double ref_cmp_acc, int window_size )
+{
+	double n_samples = window_size * window_size,
+			ref_avg = ref_acc / n_samples,
+			ref_var = ref_acc_2 / n_samples - ref_avg * ref_avg,
+			cmp_avg = cmp_acc / n_samples,
+			cmp_var = cmp_acc_2 / n_samples - cmp_avg * cmp_avg,
+			ref_cmp_cov = ref_cmp_acc / n_samples - ref_avg * cmp_avg,
+			c1 = 6.5025, // (0.01*255.0)^2
+			c2 = 58.5225, // (0.03*255)^2
+			ssim_num = (2.0 * ref_avg * cmp_avg + c1) * (2.0 * ref_cmp_cov + c2),
+			ssim_den = (ref_avg * ref_avg + cmp_avg * cmp_avg + c1) * (ref_var + cmp_var + c2);
+	return ssim_num / ssim_den;
+}
+
+static int slice_proc( int id, int idx, int jobs, void *cookie )
+{
+	slice_desc *desc = (slice_desc*) cookie;
+	int width = desc->width;
+	int ws = desc->window_size;
+	int widths[3] = { width, width / 2, width / 2 };
+	int offsets[3] = { 0, width, width + width / 2 };
+	int first, last, band, row, p, x, i;
+	uint64_t *sse = desc->sse + idx * 3;
+	uint8_t *planes = malloc( 4 * width );
+	int32_t *columns = calloc( 5 * 2 * width, sizeof( int32_t ) );
+
+	if ( !planes || !columns )
+	{
+		free( planes );
+		free( columns );
+		desc->error = 1;
+		return 0;
+	}
+
+	// The planes of a row of each image side by side, Y then Cb then Cr
+	uint8_t *pa = planes;
+	uint8_t *pb = planes + 2 * width;
+	column_sums sums[3];
+	for ( p = 0; p < 3; p++ )
+	{
+		int32_t *c = columns + offsets[p];
+		column_sums s = { c, c + 2 * width, c + 4 * width, c + 6 * width, c + 8 * width };
+		sums[p] = s;
+	}
+
+	// Whole bands of windows, and the rows below them in the last job
+	first = desc->bands * idx / jobs;
+	last = desc->bands * ( idx + 1 ) / jobs;
+	for ( band = first; band < last; band++ )
+	{
+		memset( columns, 0, 5 * 2 * width * sizeof( int32_t ) );
+		for ( row = band * ws; row < ( band + 1 ) * ws; row++ )
+		{
+			deinterleave( desc->a + row * desc->stride, width, pa, pa + width, pa + width + width / 2 );
+			deinterleave( desc->b + row * desc->stride, width, pb, pb + width, pb + width + width / 2 );
+			for ( p = 0; p < 3; p++ )
+				sse[p] += accumulate( pa + offsets[p], pb + offsets[p], widths[p], &sums[p] );
+		}
+		for ( p = 0; p < 3; p++ )
+		{
+			for ( x = 0; x < desc->windows_x[p]; x++ )
+			{
+				int64_t a = 0, b = 0, aa = 0, bb = 0, ab = 0;
+				for ( i = x * ws; i < ( x + 1 ) * ws; i++ )
+				{
+					a += sums[p].a[i];
+					b += sums[p].b[i];
+					aa += sums[p].aa[i];
+					bb += sums[p].bb[i];
+					ab += sums[p].ab[i];
+				}
+				desc->ssim[p][band * desc->windows_x[p] + x] = window_ssim( a, aa, b, bb, ab, ws );
+			}
+		}
+	}
+	if ( desc->bands )
+	{
+		first = idx == jobs - 1 ? desc->bands * ws : desc->height;
+		last = desc->height;
+	}
+	else
+	{
+		first = desc->height * idx / jobs;
+		last = desc->height * ( idx + 1 ) / jobs;
+	}
+	for ( row = first; row < last; row++ )
+	{
+		deinterleave( desc->a + row * desc->stride, width, pa, pa + width, pa + width + width / 2 );
+		deinterleave( desc->b + row * desc->stride, width, pb, pb + width, pb + width + width / 2 );
+		for ( p = 0; p < 3; p++ )
+			sse[p] += accumulate( pa + offsets[p], pb + offsets[p], widths[p], NULL );
+	}
+
+	free( planes );
+	free( columns );
+	return 0;
+}
+
+double vqm_metrics_psnr( double sse, double samples )
+{
+	return 10.0 * log10( 255.0 * 255.0 / ( sse == 0 ? 1e-10 : sse / samples ) );
+}
+
+int vqm_metrics_yuv422( const uint8_t *reference, const uint8_t *image, int width, int height, int window_size,
+	vqm_metrics *metrics )
+{
+	slice_desc desc;
+	int jobs, p, i;
+
+	if ( !reference || !image || width < 2 || height < 1 || !metrics )
+		return 1;
+	if ( !accumulate )
+		detect_kernels();
+
+	memset( &desc, 0, sizeof( desc ) );
+	desc.a = reference;
+	desc.b = image;
+	desc.width = width & ~1;
+	desc.height = height;
+	desc.stride = width * 2;
+	desc.window_size = window_size;
+	desc.bands = window_size > 0 ? height / window_size : 0;
+	desc.windows_x[0] = window_size > 0 ? desc.width / window_size : 0;
+	desc.windows_x[1] = desc.windows_x[2] = window_size > 0 ? desc.width / 2 / window_size : 0;
+	if ( !desc.windows_x[0] )
+		desc.bands = 0;
+
+	jobs = mlt_slices_count_normal();
+	if ( desc.bands && jobs > desc.bands )
+		jobs = desc.bands;
+	if ( jobs > height )
+		jobs = height;
+	if ( jobs < 1 )
+		jobs = 1;
+
+	desc.sse = calloc( jobs * 3, sizeof( uint64_t ) );
+	for ( p = 0; p < 3; p++ )
+		desc.ssim[p] = desc.bands && desc.windows_x[p] ? malloc( desc.bands * desc.windows_x[p] * sizeof( double ) ) : NULL;
+	desc.error = !desc.sse || ( desc.bands && !desc.ssim[0] ) || ( desc.bands && desc.windows_x[1] && ( !desc.ssim[1] || !desc.ssim[2] ) );
+
+	if ( !desc.error )
+		mlt_slices_run_normal( jobs, slice_proc, &desc );
+
+	if ( !desc.error )
+	{
+		metrics->samples[0] = (int64_t) desc.width * height;
+		metrics->samples[1] = metrics->samples[2] = (int64_t) desc.width * height / 2;
+		for ( p = 0; p < 3; p++ )
+		{
+			// Add up the windows in the order the vqm transition does
+			double avg = 0.0;
+			int windows = desc.ssim[p] ? desc.bands * desc.windows_x[p] : 0;
+
+			metrics->sse[p] = 0;
+			for ( i = 0; i < jobs; i++ )
+				metrics->sse[p] += desc.sse[i * 3 + p];
+			metrics->psnr[p] = vqm_metrics_psnr( metrics->sse[p], metrics->samples[p] );
+			for ( i = 0; i < windows; i++ )
+				avg += desc.ssim[p][i];
+			metrics->ssim[p] = windows ? avg / desc.windows_x[p] / desc.bands : 0.0;
+		}
+	}
+
+	free( desc.sse );
+	for ( p = 0; p < 3; p++ )
+		free( desc.ssim[p] );
+	return desc.error;
+}
@@ -0,0 +1,51 @@
+/*
+ * vqm_metrics.h -- sliced and vectorized PSNR and SSIM of yuv422 images
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef VQM_METRICS_H
+#define VQM_METRICS_H
+
+#include <stdint.h>
+
+/** The measurements of the Y, Cb and Cr planes of an image against a reference.
+ *
+ * The PSNR of a plane is over all of its samples, and its SSIM is the mean
+ * over the whole windows of window_size by window_size samples that fit in
+ * the plane, as the vqm transition of the qt module measures them.
+ */
+
+typedef struct
+{
+	double psnr[3];
+	double ssim[3];
+	uint64_t sse[3];     ///< the sum of the squared differences
+	int64_t samples[3];  ///< the number of samples the sse is over
+} vqm_metrics;
+
+/** Measure a yuv422 image against a reference of the same size, slicing
+ * the rows across the normal slices pool.
+ * \return true on error
+ */
+
+int vqm_metrics_yuv422( const uint8_t *reference, const uint8_t *image, int width, int height, int window_size,
+	vqm_metrics *metrics );
+
+/** Get the PSNR of a sum of squared differences over a number of samples. */
+double vqm_metrics_psnr( double sse, double samples );
+
+#endif
@@ -20,6 +20,11 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
+// For sendmmsg
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32
 #include <winsock2.h>
 #else
@@ -46,6 +51,10 @@
 #include <netdb.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#ifdef MSG_WAITFORONE
+#define CBRTS_SENDMMSG 1
+#endif
 #endif
 #endif
 #include <sys/time.h>
@@ -65,6 +74,9 @@
 #define REMUX_BUFFER_MAX (50)
 #define UDP_BUFFER_MINIMUM (100)
 #define UDP_BUFFER_DEFAULT (1000)
+#define UDP_BATCH_MAX (64)
+#define UDP_BATCH_WINDOW_NS (1500000)
+#define UDP_GSO_BYTES (65000)
 #define RTP_VERSION   (2)
 #define RTP_PAYLOAD   (33)
 #define RTP_HZ        (90000)
@@ -100,6 +112,9 @@ struct consumer_cbrts_s
 	int is_si_pat;
 	int is_si_pmt;
 	int dropped;
+	mlt_metric metric_packets;
+	mlt_metric metric_dropped;
+	mlt_metric metric_rate;
 	uint8_t continuity_count[MAX_PID];
 	uint64_t output_counter;
 #ifdef CBRTS_BSD_SOCKETS
@@ -108,15 +123,25 @@ struct consumer_cbrts_s
 	uint32_t nsec_per_packet;
 	uint32_t femto_per_packet;
 	uint64_t femto_counter;
+	int udp_batch;
+	int udp_gso;
 #endif
 	int ( *write_tsp )( consumer_cbrts, const void *buf, size_t count );
 	uint8_t udp_packet[UDP_MTU];
 	size_t udp_bytes;
 	size_t udp_packet_size;
-	mlt_deque udp_packets;
+	uint8_t *udp_ring;
+	unsigned udp_ring_size;
+	unsigned udp_head;
+	unsigned udp_tail;
+	int udp_reader_waiting;
+	int udp_writer_waiting;
+	unsigned udp_depth_max;
+	int udp_underruns;
+	int udp_overruns;
 	pthread_t output_thread;
-	pthread_mutex_t udp_deque_mutex;
-	pthread_cond_t udp_deque_cond;
+	pthread_mutex_t udp_ring_mutex;
+	pthread_cond_t udp_ring_cond;
 	uint64_t muxrate;
 	int udp_buffer_max;
 	uint16_t rtp_sequence;
@@ -163,7 +188,6 @@ mlt_consumer consumer_cbrts_init( mlt_profile profile, mlt_service_type type, co
 		parent->is_stopped = consumer_is_stopped;
 		self->joined = 1;
 		self->tsp_packets = mlt_deque_init();
-		self->udp_packets = mlt_deque_init();
 
 		// Create the null packet
 		memset( null_packet, 0xFF, TSP_BYTES );
@@ -172,9 +196,9 @@ mlt_consumer consumer_cbrts_init( mlt_profile profile, mlt_service_type type, co
 		null_packet[2] = 0xff;
 		null_packet[3] = 0x10;
 
-		// Create the deque mutex and condition
-		pthread_mutex_init( &self->udp_deque_mutex, NULL );
-		pthread_cond_init( &self->udp_deque_cond, NULL );
+		// Create the ring mutex and condition
+		pthread_mutex_init( &self->udp_ring_mutex, NULL );
+		pthread_cond_init( &self->udp_ring_cond, NULL );
 
 		// Set consumer property defaults
 		mlt_properties_set_int( properties, "real_time", -1 );
@@ -454,11 +478,10 @@ static int sendn( consumer_cbrts self, const void *buf, size_t count )
 	return result;
 }
 
-static int write_udp( consumer_cbrts self, const void *buf, size_t count )
-{
-	int result = 0;
-
 #ifdef CBRTS_BSD_SOCKETS
+// Advance the send schedule by one UDP packet at the muxrate.
+static void advance_timer( consumer_cbrts self )
+{
 	if ( !self->timer.tv_sec )
 		clock_gettime( CLOCK_MONOTONIC, &self->timer );
 	self->femto_counter += self->femto_per_packet;
@@ -467,6 +490,15 @@ static int write_udp( consumer_cbrts self, const void *buf, size_t count )
 	self->timer.tv_nsec += self->nsec_per_packet;
 	self->timer.tv_sec  += self->timer.tv_nsec / 1000000000;
 	self->timer.tv_nsec  = self->timer.tv_nsec % 1000000000;
+}
+#endif
+
+static int write_udp( consumer_cbrts self, const void *buf, size_t count )
+{
+	int result = 0;
+
+#ifdef CBRTS_BSD_SOCKETS
+	advance_timer( self );
 	clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &self->timer, NULL );
 	result = sendn( self, buf, count );
 #endif
@@ -474,6 +506,103 @@ static int write_udp( consumer_cbrts self, const void *buf, size_t count )
 	return result;
 }
 
+#ifdef CBRTS_SENDMMSG
+// Send UDP packets of equal size as one segmentation offload.
+static int send_gso( consumer_cbrts self, uint8_t **packets, int n, size_t size )
+{
+	int result = 0;
+#ifdef UDP_SEGMENT
+	struct iovec iov[UDP_BATCH_MAX];
+	struct msghdr msg = {0};
+	int i;
+
+	for ( i = 0; i < n; i++ )
+	{
+		iov[i].iov_base = packets[i];
+		iov[i].iov_len = size;
+	}
+	msg.msg_name = self->addr->ai_addr;
+	msg.msg_namelen = self->addr->ai_addrlen;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = n;
+	result = sendmsg( self->fd, &msg, 0 );
+	if ( result >= 0 )
+		return n;
+
+	// Not every route or device supports it, so fall back to sendmmsg.
+	int disable = 0;
+	mlt_log_warning( MLT_CONSUMER_SERVICE(&self->parent), "Disabling UDP GSO: %s\n", strerror( errno ) );
+	setsockopt( self->fd, SOL_UDP, UDP_SEGMENT, &disable, sizeof(disable) );
+	self->udp_gso = 0;
+	result = 0;
+#endif
+	return result;
+}
+
+// Send UDP packets with as few system calls as possible.
+static int sendmmsgn( consumer_cbrts self, uint8_t **packets, int n, size_t size )
+{
+	struct mmsghdr msgs[UDP_BATCH_MAX];
+	struct iovec iov[UDP_BATCH_MAX];
+	int sent = 0;
+	int i;
+
+	if ( self->udp_gso )
+		sent = send_gso( self, packets, n, size );
+
+	memset( msgs, 0, sizeof(msgs) );
+	for ( i = 0; i < n; i++ )
+	{
+		iov[i].iov_base = packets[i];
+		iov[i].iov_len = size;
+		msgs[i].msg_hdr.msg_name = self->addr->ai_addr;
+		msgs[i].msg_hdr.msg_namelen = self->addr->ai_addrlen;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	while ( sent < n )
+	{
+		int result = sendmmsg( self->fd, &msgs[sent], n - sent, 0 );
+		if ( result < 0 )
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE(&self->parent), "Failed to send: %s\n", strerror( errno ) );
+			exit( EXIT_FAILURE );
+		}
+		sent += result;
+	}
+	return sent;
+}
+#endif
+
+/** Send a batch of UDP packets paced at the muxrate.
+ *
+ * The batch leaves at the time of its first packet, and the schedule still
+ * advances one packet at a time, so the long term rate and thus the PCR
+ * timing is kept while the packets within a batch are sent in a burst.
+ */
+
+static int write_udp_batch( consumer_cbrts self, uint8_t **packets, int n, size_t size )
+{
+	int result = 0;
+
+#ifdef CBRTS_SENDMMSG
+	if ( n > 1 )
+	{
+		int i;
+		advance_timer( self );
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &self->timer, NULL );
+		result = sendmmsgn( self, packets, n, size );
+		for ( i = 1; i < n; i++ )
+			advance_timer( self );
+		return result;
+	}
+#endif
+	while ( n-- && result >= 0 )
+		result = write_udp( self, *packets++, size );
+
+	return result;
+}
+
 // socket IO code
 static int create_socket( consumer_cbrts self )
 {
@@ -610,31 +739,139 @@ static int create_socket( consumer_cbrts self )
 	return result;
 }
 
+#ifdef CBRTS_BSD_SOCKETS
+// Choose how many UDP packets to send per system call.
+static void setup_batch( consumer_cbrts self, mlt_properties properties )
+{
+	self->udp_batch = 1;
+	self->udp_gso = 0;
+#ifdef CBRTS_SENDMMSG
+	// By default batch the packets due within a fraction of the PCR period.
+	if ( mlt_properties_get( properties, "udp.batch" ) )
+		self->udp_batch = mlt_properties_get_int( properties, "udp.batch" );
+	else if ( self->nsec_per_packet )
+		self->udp_batch = UDP_BATCH_WINDOW_NS / self->nsec_per_packet;
+	self->udp_batch = CLAMP( self->udp_batch, 1, UDP_BATCH_MAX );
+
+#ifdef UDP_SEGMENT
+	if ( self->udp_batch > 1 && mlt_properties_get_int( properties, "udp.gso" ) )
+	{
+		size_t size = self->rtp_ssrc ? RTP_BYTES + self->udp_packet_size : self->udp_packet_size;
+		int segment = size;
+		if ( setsockopt( self->fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment) ) == 0 )
+		{
+			self->udp_gso = 1;
+			self->udp_batch = MIN( self->udp_batch, UDP_GSO_BYTES / size );
+		}
+		else
+		{
+			mlt_log_warning( MLT_CONSUMER_SERVICE(&self->parent),
+				"UDP GSO is not available: %s\n", strerror( errno ) );
+		}
+	}
+#endif
+#endif
+	mlt_log_verbose( MLT_CONSUMER_SERVICE(&self->parent), "sending %d UDP packets per batch%s\n",
+		self->udp_batch, self->udp_gso ? " with GSO" : "" );
+}
+#endif
+
+/** The UDP packets pass from the remuxer to the output thread through a ring.
+ *
+ * The ring has one writer and one reader that own its head and tail, so
+ * neither takes a lock unless the ring is full or empty. Then it sleeps on
+ * the condition after raising a flag that the other side checks after moving
+ * its own end.
+ */
+
+static inline unsigned ring_count( consumer_cbrts self )
+{
+	return __atomic_load_n( &self->udp_head, __ATOMIC_SEQ_CST ) - __atomic_load_n( &self->udp_tail, __ATOMIC_SEQ_CST );
+}
+
+static inline uint8_t *ring_slot( consumer_cbrts self, unsigned index )
+{
+	return self->udp_ring + ( index % self->udp_ring_size ) * UDP_MTU;
+}
+
+// Wait until the ring has room for the writer or packets for the reader.
+static void ring_wait( consumer_cbrts self, int writer )
+{
+	int *waiting = writer ? &self->udp_writer_waiting : &self->udp_reader_waiting;
+
+	pthread_mutex_lock( &self->udp_ring_mutex );
+	__atomic_store_n( waiting, 1, __ATOMIC_SEQ_CST );
+	while ( self->thread_running && ( writer ? ring_count( self ) >= self->udp_ring_size : ring_count( self ) < 1 ) )
+		pthread_cond_wait( &self->udp_ring_cond, &self->udp_ring_mutex );
+	__atomic_store_n( waiting, 0, __ATOMIC_SEQ_CST );
+	pthread_mutex_unlock( &self->udp_ring_mutex );
+}
+
+// Wake the other side if it is waiting on the ring.
+static void ring_notify( consumer_cbrts self, int *waiting )
+{
+	if ( __atomic_load_n( waiting, __ATOMIC_SEQ_CST ) )
+	{
+		pthread_mutex_lock( &self->udp_ring_mutex );
+		pthread_cond_broadcast( &self->udp_ring_cond );
+		pthread_mutex_unlock( &self->udp_ring_mutex );
+	}
+}
+
+// Publish the health of the ring as consumer properties.
+static void ring_report( consumer_cbrts self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
+	mlt_properties_set_int( properties, "udp.depth", ring_count( self ) );
+	mlt_properties_set_int( properties, "udp.depth_max", __atomic_load_n( &self->udp_depth_max, __ATOMIC_RELAXED ) );
+	mlt_properties_set_int( properties, "udp.underruns", self->udp_underruns );
+	mlt_properties_set_int( properties, "udp.overruns", __atomic_load_n( &self->udp_overruns, __ATOMIC_RELAXED ) );
+}
+
 static void *output_thread( void *arg )
 {
 	consumer_cbrts self = arg;
 	int result = 0;
+	uint8_t *packets[UDP_BATCH_MAX];
+	int batch = 1;
+	int reported = 0;
 
+#ifdef CBRTS_BSD_SOCKETS
+	batch = self->udp_batch;
+#endif
 	while ( self->thread_running )
 	{
-		pthread_mutex_lock( &self->udp_deque_mutex );
-		while ( self->thread_running && mlt_deque_count( self->udp_packets ) < 1 )
-			pthread_cond_wait( &self->udp_deque_cond, &self->udp_deque_mutex );
-		pthread_mutex_unlock( &self->udp_deque_mutex );
+		if ( ring_count( self ) < 1 )
+		{
+			if ( self->udp_tail )
+				self->udp_underruns++;
+			ring_wait( self, 0 );
+		}
 
-		// Dequeue the UDP packets and write them.
-		int i = mlt_deque_count( self->udp_packets );
+		// Write the UDP packets in batches straight from the ring.
+		int i = ring_count( self );
 		mlt_log_debug( MLT_CONSUMER_SERVICE(&self->parent), "%s: count %d\n", __FUNCTION__, i );
-		while ( self->thread_running && i-- && result >= 0 )
+		while ( self->thread_running && i > 0 && result >= 0 )
 		{
-			pthread_mutex_lock( &self->udp_deque_mutex );
-			uint8_t *packet = mlt_deque_pop_front( self->udp_packets );
-			pthread_cond_broadcast( &self->udp_deque_cond );
-			pthread_mutex_unlock( &self->udp_deque_mutex );
+			int n = 0;
+			while ( n < batch && n < i )
+			{
+				packets[n] = ring_slot( self, self->udp_tail + n );
+				n++;
+			}
+			i -= n;
 
 			size_t size = self->rtp_ssrc ? RTP_BYTES + self->udp_packet_size : self->udp_packet_size;
-			result = write_udp( self, packet, size );
-			free( packet );
+			result = write_udp_batch( self, packets, n, size );
+			__atomic_store_n( &self->udp_tail, self->udp_tail + n, __ATOMIC_SEQ_CST );
+			ring_notify( self, &self->udp_writer_waiting );
+
+			reported += n;
+			if ( reported >= UDP_BUFFER_MINIMUM )
+			{
+				ring_report( self );
+				reported = 0;
+			}
 		}
 	}
 	return NULL;
@@ -651,8 +888,20 @@ static int enqueue_udp( consumer_cbrts self, const void *buf, size_t count )
 	{
 		size_t offset = self->rtp_ssrc ? RTP_BYTES : 0;
 
-		// Duplicate the packet.
-		uint8_t *packet = malloc( self->udp_packet_size + offset );
+		// Wait for room in the ring.
+		if ( ring_count( self ) >= self->udp_ring_size )
+		{
+			ring_wait( self, 1 );
+			if ( ring_count( self ) >= self->udp_ring_size )
+			{
+				// The output thread has stopped.
+				__atomic_add_fetch( &self->udp_overruns, 1, __ATOMIC_RELAXED );
+				return 0;
+			}
+		}
+
+		// Copy the packet into the ring.
+		uint8_t *packet = ring_slot( self, self->udp_head );
 		memcpy( packet + offset, self->udp_packet, self->udp_packet_size );
 
 		// Add the RTP header.
@@ -677,15 +926,12 @@ static int enqueue_udp( consumer_cbrts self, const void *buf, size_t count )
 			self->rtp_sequence++;
 		}
 
-		// Wait for room in the fifo.
-		pthread_mutex_lock( &self->udp_deque_mutex );
-		while ( self->thread_running && mlt_deque_count( self->udp_packets ) >= self->udp_buffer_max )
-			pthread_cond_wait( &self->udp_deque_cond, &self->udp_deque_mutex );
-
-		// Add the packet to the fifo.
-		mlt_deque_push_back( self->udp_packets, packet );
-		pthread_cond_broadcast( &self->udp_deque_cond );
-		pthread_mutex_unlock( &self->udp_deque_mutex );
+		// Hand the packet to the output thread.
+		__atomic_store_n( &self->udp_head, self->udp_head + 1, __ATOMIC_SEQ_CST );
+		unsigned depth = ring_count( self );
+		if ( depth > self->udp_depth_max )
+			__atomic_store_n( &self->udp_depth_max, depth, __ATOMIC_RELAXED );
+		ring_notify( self, &self->udp_reader_waiting );
 	}
 
 	return 0;
@@ -746,6 +992,7 @@ static int output_cbr( consumer_cbrts self, uint64_t input_rate, uint64_t output
 
 			// Compute new input_rate based on dropped count
 			input_rate = measure_bitrate( self, *pcr, ++dropped );
+			mlt_metrics_add( self->metric_dropped, 1 );
 
 			continue;
 		}
@@ -829,6 +1076,9 @@ static int output_cbr( consumer_cbrts self, uint64_t input_rate, uint64_t output
 		}
 	}
 
+	mlt_metrics_add( self->metric_packets, output_packets );
+	mlt_metrics_set( self->metric_rate, input_rate );
+
 	// Reset counters leaving a residual output count
 	if ( input_counter < self->output_counter )
 		self->output_counter -= input_counter;
@@ -937,19 +1187,16 @@ static void stop_output_thread( consumer_cbrts self )
 	self->thread_running = 0;
 
 	// Broadcast to the condition in case it's waiting.
-	pthread_mutex_lock( &self->udp_deque_mutex );
-	pthread_cond_broadcast( &self->udp_deque_cond );
-	pthread_mutex_unlock( &self->udp_deque_mutex );
+	pthread_mutex_lock( &self->udp_ring_mutex );
+	pthread_cond_broadcast( &self->udp_ring_cond );
+	pthread_mutex_unlock( &self->udp_ring_mutex );
 
 	// Join the thread.
 	pthread_join( self->output_thread, NULL );
 
 	// Release the buffered packets.
-	pthread_mutex_lock( &self->udp_deque_mutex );
-	int n = mlt_deque_count( self->udp_packets );
-	while ( n-- )
-		free( mlt_deque_pop_back( self->udp_packets ) );
-	pthread_mutex_unlock( &self->udp_deque_mutex );
+	ring_report( self );
+	self->udp_tail = self->udp_head;
 }
 
 static inline int filter_packet( consumer_cbrts self, uint8_t *packet )
@@ -995,6 +1242,9 @@ static void on_data_received( mlt_properties properties, mlt_consumer consumer,
 	{
 		consumer_cbrts self = (consumer_cbrts) consumer->child;
 
+		if ( !self->thread_running )
+			start_output_thread( self );
+
 		// Sanity check
 		if ( self->leftover_size == 0 && buf[0] != 0x47 )
 		{
@@ -1034,9 +1284,6 @@ static void on_data_received( mlt_properties properties, mlt_consumer consumer,
 
 		self->leftover_size = remaining;
 		memcpy( self->leftover_data, buf, self->leftover_size );
-
-		if ( !self->thread_running )
-			start_output_thread( self );
 		mlt_log_debug( MLT_CONSUMER_SERVICE(consumer), "%s: %p 0x%x (%d)\n", __FUNCTION__, buf, *buf, size % TSP_BYTES );
 
 		// Do direct output
@@ -1068,6 +1315,12 @@ static int consumer_start( mlt_consumer parent )
 		mlt_properties_set_int( avformat, "redirect", 1 );
 		mlt_properties_set( avformat, "f", "mpegts" );
 		self->dropped = 0;
+		self->metric_packets = mlt_metrics_service( mlt_metric_counter, "mlt_cbrts_packets_total",
+			"Transport stream packets sent including null packets.", MLT_CONSUMER_SERVICE( parent ) );
+		self->metric_dropped = mlt_metrics_service( mlt_metric_counter, "mlt_cbrts_packets_dropped_total",
+			"Packets dropped because the muxrate is too low.", MLT_CONSUMER_SERVICE( parent ) );
+		self->metric_rate = mlt_metrics_service( mlt_metric_gauge, "mlt_cbrts_input_bits_per_second",
+			"The measured bitrate of the encoded stream.", MLT_CONSUMER_SERVICE( parent ) );
 		self->fd = STDOUT_FILENO;
 		self->write_tsp = writen;
 		self->muxrate = mlt_properties_get_int64( MLT_CONSUMER_PROPERTIES(&self->parent), "muxrate" );
@@ -1092,12 +1345,23 @@ static int consumer_start( mlt_consumer parent )
 #ifdef CBRTS_BSD_SOCKETS
 				self->nsec_per_packet  = 1000000000UL * self->udp_packet_size * 8 / self->muxrate;
 				self->femto_per_packet = 1000000000000000ULL * self->udp_packet_size * 8 / self->muxrate - self->nsec_per_packet * 1000000;
+				setup_batch( self, properties );
 #endif
 				self->udp_buffer_max = mlt_properties_get_int( properties, "udp.buffer" );
 				if ( self->udp_buffer_max < UDP_BUFFER_MINIMUM )
 					self->udp_buffer_max = UDP_BUFFER_DEFAULT;
+				if ( self->udp_ring_size != self->udp_buffer_max )
+				{
+					free( self->udp_ring );
+					self->udp_ring = malloc( self->udp_buffer_max * UDP_MTU );
+					self->udp_ring_size = self->udp_ring ? self->udp_buffer_max : 0;
+				}
+				self->udp_head = self->udp_tail = 0;
+				self->udp_depth_max = 0;
+				self->udp_underruns = self->udp_overruns = 0;
 
-				self->write_tsp = enqueue_udp;
+				if ( self->udp_ring )
+					self->write_tsp = enqueue_udp;
 			}
 		}
 
@@ -1231,7 +1495,7 @@ static void consumer_close( mlt_consumer parent )
 
 	// Now clean up the rest
 	mlt_deque_close( self->tsp_packets );
-	mlt_deque_close( self->udp_packets );
+	free( self->udp_ring );
 	mlt_consumer_close( parent );
 
 	// Finally clean up this
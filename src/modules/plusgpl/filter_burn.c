@@ -28,6 +28,7 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +41,9 @@
 #define Decay 15
 #define MAGIC_THRESHOLD "50"
 
+// Do not filter bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (16)
+
 static RGB32 palette[256];
 
 static void makePalette(void)
@@ -69,6 +73,95 @@ static void makePalette(void)
 	}
 }
 
+struct burn_slice_desc
+{
+	RGB32 *src;
+	RGB32 *background;
+	unsigned char *diff;
+	unsigned char *buffer;
+	int width;
+	int height;
+	int y_threshold;
+	int burn_foreground;
+};
+
+/** Find the bright, or with a background the moving, pixels of a band of rows.
+*/
+
+static int diff_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct burn_slice_desc *desc = (struct burn_slice_desc *) cookie;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	int offset = y * desc->width;
+	int area = ( yend - y ) * desc->width;
+
+	// The background holds a short for every pixel
+	if ( desc->burn_foreground == 1 )
+		image_bgsubtract_y( desc->diff + offset, (RGB32*) ( (short*) desc->background + offset ), desc->src + offset, area, desc->y_threshold );
+	else
+		image_y_over( desc->diff + offset, desc->src + offset, area, desc->y_threshold );
+	return 0;
+}
+
+/** Light the fire where the pixels change from the row above.
+*/
+
+static int light_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct burn_slice_desc *desc = (struct burn_slice_desc *) cookie;
+	int w = desc->width;
+	int y = ( desc->height - 1 ) * index / jobs;
+	int yend = ( desc->height - 1 ) * ( index + 1 ) / jobs;
+	int x;
+
+	for ( ; y < yend; y++ )
+	{
+		const unsigned char *diff = desc->diff + y * w;
+		unsigned char *buffer = desc->buffer + y * w;
+
+		if ( y == 0 )
+		{
+			for ( x = 1; x < w - 1; x++ )
+				buffer[x] |= diff[x];
+		}
+		else
+		{
+			for ( x = 1; x < w - 1; x++ )
+				buffer[x] |= diff[x - w] ^ diff[x];
+		}
+	}
+	return 0;
+}
+
+/** Add the fire to the image in a band of rows.
+*/
+
+static int blend_slice_proc( int id, int index, int jobs, void *cookie )
+{
+	struct burn_slice_desc *desc = (struct burn_slice_desc *) cookie;
+	RGB32 *src = desc->src;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	int x, i;
+	RGB32 a, b, c;
+
+	for ( ; y < yend; y++ ) {
+		i = y * w + 1;
+		for ( x = 1; x < w - 1; x++ ) {
+			/* FIXME: endianness? */
+			a = (src[i] & 0xfefeff) + palette[desc->buffer[i]];
+			b = a & 0x1010100;
+			// Add alpha if necessary or use src alpha.
+			c = palette[desc->buffer[i]] ? 0xff000000 : src[i] & 0xff000000;
+			src[i] = a | (b - (b >> 8)) | c;
+			i++;
+		}
+	}
+	return 0;
+}
+
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	RGB32 *background;
@@ -94,6 +187,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int animated_threshold = mlt_properties_anim_get_int( properties, "threshold", pos, len );
 		int y_threshold = image_set_threshold_y( animated_threshold );
 
+		struct burn_slice_desc desc;
+		int jobs;
+
 		// We'll process pixel by pixel
 		int x = 0;
 		int y = 0;
@@ -103,11 +199,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		int video_height = *height;
 		int video_area = video_width * video_height;
 		// We need to create a new frame as this effect modifies the input
-		RGB32 *dest = (RGB32*)*image;
 		RGB32 *src = (RGB32*)*image;
 
-		unsigned char v, w;
-		RGB32 a, b, c;
+		unsigned char v;
 
 		mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
@@ -144,21 +238,28 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 			}
 		}
 
-		if (burn_foreground == 1) {
-			image_bgsubtract_y(diff, background, src, video_area, y_threshold);
-		} else {
-			/* default */
-			image_y_over(diff, src, video_area, y_threshold);
+		desc.src = src;
+		desc.background = burn_foreground == 1 ? background : NULL;
+		desc.diff = diff;
+		desc.buffer = buffer;
+		desc.width = video_width;
+		desc.height = video_height;
+		desc.y_threshold = y_threshold;
+		desc.burn_foreground = burn_foreground;
+
+		jobs = MIN( mlt_slices_count_normal(), video_height / MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+		{
+			mlt_slices_run_normal( jobs, diff_slice_proc, &desc );
+			mlt_slices_run_normal( jobs, light_slice_proc, &desc );
 		}
-	
-		for(x=1; x<video_width-1; x++) {
-			v = 0;
-			for(y=0; y<video_height-1; y++) {
-				w = diff[y*video_width+x];
-				buffer[y*video_width+x] |= v ^ w;
-				v = w;
-			}
+		else
+		{
+			diff_slice_proc( 0, 0, 1, &desc );
+			light_slice_proc( 0, 0, 1, &desc );
 		}
+
+		// The fire spreads up with the shared random numbers, so in one thread
 		for(x=1; x<video_width-1; x++) {
 			i = video_width + x;
 			for(y=1; y<video_height; y++) {
@@ -170,20 +271,11 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				i += video_width;
 			}
 		}
-	
-		i = 1;
-		for(y=0; y<video_height; y++) {
-			for(x=1; x<video_width-1; x++) {
-				/* FIXME: endianness? */
-				a = (src[i] & 0xfefeff) + palette[buffer[i]];
-				b = a & 0x1010100;
-				// Add alpha if necessary or use src alpha.
-				c = palette[buffer[i]] ? 0xff000000 : src[i] & 0xff000000;
-				dest[i] = a | (b - (b >> 8)) | c;
-				i++;
-			}
-			i += 2;
-		}
+
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, blend_slice_proc, &desc );
+		else
+			blend_slice_proc( 0, 0, 1, &desc );
 
 		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 	}
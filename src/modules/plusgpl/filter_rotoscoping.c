@@ -19,6 +19,7 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
 
 #include "cJSON.h"
 
@@ -29,6 +30,9 @@
 
 #define SQR( x ) ( x ) * ( x )
 
+// Do not blur bands of rows or columns narrower than this in their own thread.
+#define MIN_SLICE_SIZE (32)
+
 /** x, y tuple with double precision */
 typedef struct PointF
 {
@@ -84,10 +88,11 @@ static inline void lerpHalf( const PointF *a, const PointF *b, PointF *result )
     result->y = ( a->y + b->y ) * .5;
 }
 
-/** Helper for using qsort with an array of integers. */
-int ncompare( const void *a, const void *b )
+/** Helper for using qsort with an array of doubles. */
+static int dcompare( const void *a, const void *b )
 {
-    return *(const int*)a - *(const int*)b;
+    double d = *(const double*)a - *(const double*)b;
+    return ( d > 0 ) - ( d < 0 );
 }
 
 /** Turns a json array with two children into a point (x, y tuple). */
@@ -131,8 +136,21 @@ static int json2BCurves( cJSON *array, BPointF **points )
     return i;
 }
 
+/** Largest blur window for which \see divide is exact with a table of reciprocals. */
+#define MAX_RECIPROCAL_WINDOW 4095
+
+/** Divides a \param total of at most 255 * \param amount by \param amount.
+ * Multiplying by a reciprocal rounded up gives the same result as the division
+ * as long as total * amount stays below 2^32. */
+static inline int divide( int total, int amount, const uint64_t *reciprocals )
+{
+    if ( reciprocals )
+        return ( total * reciprocals[amount] ) >> 32;
+    return total / amount;
+}
+
 /** Blurs \param src horizontally. \See function blur. */
-static void blurHorizontal( uint8_t *src, uint8_t *dst, int width, int height, int radius)
+static void blurHorizontal( uint8_t *src, uint8_t *dst, int width, int height, int radius, const uint64_t *reciprocals )
 {
     int x, y, kx, yOff, total, amount, amountInit;
     amountInit = radius * 2 + 1;
@@ -144,7 +162,7 @@ static void blurHorizontal( uint8_t *src, uint8_t *dst, int width, int height, i
         int size = MIN(radius + 1, width);
         for ( kx = 0; kx < size; ++kx )
             total += src[yOff + kx];
-        dst[yOff] = total / ( radius + 1 );
+        dst[yOff] = divide( total, radius + 1, reciprocals );
         // Subsequent pixels just update window total
         for ( x = 1; x < width; ++x )
         {
@@ -159,37 +177,120 @@ static void blurHorizontal( uint8_t *src, uint8_t *dst, int width, int height, i
                 total += src[yOff + x + radius];
             else
                 amount -= radius - width + x;
-            dst[yOff + x] = total / amount;
+            dst[yOff + x] = divide( total, amount, reciprocals );
         }
     }
 }
 
-/** Blurs \param src vertically. \See function blur. */
-static void blurVertical( uint8_t *src, uint8_t *dst, int width, int height, int radius)
+typedef void (*blur_row_function)( int *total, const uint8_t *out, const uint8_t *in, uint8_t *dst, int width, int amount, const uint64_t *reciprocals );
+
+/** Moves the running totals of the columns from one row to the next and writes the averages.
+ * \param out the row leaving the window or NULL
+ * \param in the row entering the window or NULL */
+static void blurVerticalRow( int *total, const uint8_t *out, const uint8_t *in, uint8_t *dst, int width, int amount, const uint64_t *reciprocals )
 {
-    int x, y, ky, total, amount, amountInit;
-    amountInit = radius * 2 + 1;
-    for (x = 0; x < width; ++x)
+    int x;
+    if ( out )
+        for ( x = 0; x < width; ++x )
+            total[x] -= out[x];
+    if ( in )
+        for ( x = 0; x < width; ++x )
+            total[x] += in[x];
+    for ( x = 0; x < width; ++x )
+        dst[x] = divide( total[x], amount, reciprocals );
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define ROTO_SSE2 __attribute__((target("sse2")))
+
+/** \see blurVerticalRow for a window of at most MAX_RECIPROCAL_WINDOW.
+ * The quotient is computed in single precision from the reciprocal with a margin
+ * that keeps it exact for every total of at most 255 * amount. */
+static ROTO_SSE2 void blurVerticalRowSSE2( int *total, const uint8_t *out, const uint8_t *in, uint8_t *dst, int width, int amount, const uint64_t *reciprocals )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 inverse = _mm_set1_ps( 1.0f / amount );
+    const __m128 margin = _mm_set1_ps( 1e-4f );
+    int x, j;
+
+    for ( x = 0; x + 16 <= width; x += 16 )
     {
-        total = 0;
-        int size = MIN(radius + 1, height);
-        for ( ky = 0; ky < size; ++ky )
-            total += src[x + ky * width];
-        dst[x] = total / ( radius + 1 );
-        for ( y = 1; y < height; ++y )
+        __m128i o = out ? _mm_loadu_si128( (const __m128i*) ( out + x ) ) : zero;
+        __m128i i = in ? _mm_loadu_si128( (const __m128i*) ( in + x ) ) : zero;
+        __m128i lo = _mm_sub_epi16( _mm_unpacklo_epi8( i, zero ), _mm_unpacklo_epi8( o, zero ) );
+        __m128i hi = _mm_sub_epi16( _mm_unpackhi_epi8( i, zero ), _mm_unpackhi_epi8( o, zero ) );
+        __m128i delta[4], q[4];
+
+        // Sign extend the differences to 32 bits
+        delta[0] = _mm_srai_epi32( _mm_unpacklo_epi16( lo, lo ), 16 );
+        delta[1] = _mm_srai_epi32( _mm_unpackhi_epi16( lo, lo ), 16 );
+        delta[2] = _mm_srai_epi32( _mm_unpacklo_epi16( hi, hi ), 16 );
+        delta[3] = _mm_srai_epi32( _mm_unpackhi_epi16( hi, hi ), 16 );
+        for ( j = 0; j < 4; j++ )
         {
-            amount = amountInit;
-            if ( y - radius - 1 >= 0 )
-                total -= src[( y - radius - 1 ) * width + x];
-            else
-                amount -= radius - y;
-            if ( y + radius < height )
-                total += src[( y + radius ) * width + x];
-            else
-                amount -= radius - height + y;
-            dst[y * width + x] = total / amount;
+            __m128i *t = (__m128i*) ( total + x + j * 4 );
+            __m128i sum = _mm_add_epi32( _mm_loadu_si128( t ), delta[j] );
+            _mm_storeu_si128( t, sum );
+            q[j] = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( sum ), inverse ), margin ) );
         }
+        _mm_storeu_si128( (__m128i*) ( dst + x ),
+            _mm_packus_epi16( _mm_packs_epi32( q[0], q[1] ), _mm_packs_epi32( q[2], q[3] ) ) );
     }
+    blurVerticalRow( total + x, out ? out + x : NULL, in ? in + x : NULL, dst + x, width - x, amount, reciprocals );
+}
+
+static blur_row_function blurRowDetect( const uint64_t *reciprocals )
+{
+    __builtin_cpu_init();
+    if ( reciprocals && __builtin_cpu_supports( "sse2" ) )
+        return blurVerticalRowSSE2;
+    return blurVerticalRow;
+}
+
+#else
+
+static blur_row_function blurRowDetect( const uint64_t *reciprocals )
+{
+    return blurVerticalRow;
+}
+
+#endif
+
+/** Blurs \param src vertically. \See function blur.
+ * The rows are walked in memory order with a running total for each column.
+ * \param stride the distance between rows, which exceeds \param width for a band of columns */
+static void blurVertical( uint8_t *src, uint8_t *dst, int width, int stride, int height, int radius, const uint64_t *reciprocals )
+{
+    int x, y, ky, amount, amountInit;
+    int *total = mlt_pool_alloc( width * sizeof( int ) );
+    blur_row_function blurRow = blurRowDetect( reciprocals );
+    amountInit = radius * 2 + 1;
+    memset( total, 0, width * sizeof( int ) );
+    int size = MIN(radius + 1, height);
+    for ( ky = 0; ky < size; ++ky )
+        for ( x = 0; x < width; ++x )
+            total[x] += src[x + ky * stride];
+    for ( x = 0; x < width; ++x )
+        dst[x] = divide( total[x], radius + 1, reciprocals );
+    for ( y = 1; y < height; ++y )
+    {
+        uint8_t *out = NULL;
+        uint8_t *in = NULL;
+        amount = amountInit;
+        if ( y - radius - 1 >= 0 )
+            out = src + ( y - radius - 1 ) * stride;
+        else
+            amount -= radius - y;
+        if ( y + radius < height )
+            in = src + ( y + radius ) * stride;
+        else
+            amount -= radius - height + y;
+        blurRow( total, out, in, dst + y * stride, width, amount, reciprocals );
+    }
+    mlt_pool_release( total );
 }
 
 /**
@@ -200,69 +301,208 @@ static void blurVertical( uint8_t *src, uint8_t *dst, int width, int height, int
  * \param radius blur radius
  * \param passes blur passes
  */
+struct blur_slice_desc
+{
+    uint8_t *map;
+    uint8_t *tmp;
+    int width;
+    int height;
+    int radius;
+    const uint64_t *reciprocals;
+};
+
+/** Blurs a band of rows of the map into the temporary image. */
+static int blurHorizontalSlice( int id, int index, int jobs, void *cookie )
+{
+    struct blur_slice_desc *desc = (struct blur_slice_desc *) cookie;
+    int y0 = desc->height * index / jobs;
+    int y1 = desc->height * ( index + 1 ) / jobs;
+    blurHorizontal( desc->map + y0 * desc->width, desc->tmp + y0 * desc->width, desc->width, y1 - y0, desc->radius, desc->reciprocals );
+    return 0;
+}
+
+/** Blurs a band of columns of the temporary image back into the map.
+ * The bands start at multiples of 16 columns to keep the vector loads in step. */
+static int blurVerticalSlice( int id, int index, int jobs, void *cookie )
+{
+    struct blur_slice_desc *desc = (struct blur_slice_desc *) cookie;
+    int x0 = ( desc->width * index / jobs ) & ~15;
+    int x1 = index + 1 == jobs ? desc->width : ( desc->width * ( index + 1 ) / jobs ) & ~15;
+    if ( x1 > x0 )
+        blurVertical( desc->tmp + x0, desc->map + x0, x1 - x0, desc->width, desc->height, desc->radius, desc->reciprocals );
+    return 0;
+}
+
 static void blur( uint8_t *map, int width, int height, int radius, int passes )
 {
-    uint8_t *src = mlt_pool_alloc( width * height );
     uint8_t *tmp = mlt_pool_alloc( width * height );
+    uint64_t *reciprocals = NULL;
 
     int i;
+    if ( radius * 2 + 1 <= MAX_RECIPROCAL_WINDOW )
+    {
+        reciprocals = mlt_pool_alloc( ( radius * 2 + 2 ) * sizeof( uint64_t ) );
+        reciprocals[0] = 0;
+        for ( i = 1; i <= radius * 2 + 1; ++i )
+            reciprocals[i] = 0xffffffffu / i + 1ull;
+    }
+
+    struct blur_slice_desc desc = { map, tmp, width, height, radius, reciprocals };
+    int jobs = MIN( mlt_slices_count_normal(), MIN( width, height ) / MIN_SLICE_SIZE );
     for ( i = 0; i < passes; ++i )
     {
-        memcpy( src, map, width * height );
-        blurHorizontal( src, tmp, width, height, radius );
-        blurVertical( tmp, map, width, height, radius );
+        if ( jobs > 1 )
+        {
+            mlt_slices_run_normal( jobs, blurHorizontalSlice, &desc );
+            mlt_slices_run_normal( jobs, blurVerticalSlice, &desc );
+        }
+        else
+        {
+            blurHorizontalSlice( 0, 0, 1, &desc );
+            blurVerticalSlice( 0, 0, 1, &desc );
+        }
     }
 
-    mlt_pool_release(src);
+    mlt_pool_release(reciprocals);
     mlt_pool_release(tmp);
 }
 
+/** Number of sub scanlines sampled for each row of the mask. */
+#define SUBSAMPLES 4
+
+/** Coverage of a pixel by one sub scanline. */
+#define COVERAGE 256
+
+/** Edge of the polygon, oriented downwards for the scanline rasterizer. */
+typedef struct Edge
+{
+    double x;
+    double y;
+    double ymax;
+    double dxdy;
+} Edge;
+
+static int edgeCompare( const void *a, const void *b )
+{
+    double d = ( (const Edge*)a )->y - ( (const Edge*)b )->y;
+    return ( d > 0 ) - ( d < 0 );
+}
+
+/** Adds \param value to the pixels [\param start, \param end) in the difference array \param cover. */
+static inline void addCover( int *cover, int start, int end, int value )
+{
+    cover[start] += value;
+    cover[end] -= value;
+}
+
+/** Adds the coverage of the span [\param x0, \param x1) of a sub scanline to \param cover. */
+static void addSpan( int *cover, int width, double x0, double x1 )
+{
+    x0 = MAX( x0, 0 );
+    x1 = MIN( x1, width );
+    if ( x0 >= x1 )
+        return;
+
+    int i0 = x0;
+    int i1 = x1;
+    if ( i0 == i1 )
+    {
+        addCover( cover, i0, i0 + 1, ( x1 - x0 ) * COVERAGE + 0.5 );
+        return;
+    }
+    addCover( cover, i0, i0 + 1, ( i0 + 1 - x0 ) * COVERAGE + 0.5 );
+    addCover( cover, i0 + 1, i1, COVERAGE );
+    if ( i1 < width )
+        addCover( cover, i1, i1 + 1, ( x1 - i1 ) * COVERAGE + 0.5 );
+}
+
 /**
  * Determines which points are located in the polygon and sets their value in \param map to \param value
+ * The edges are sorted once and only those crossing a sub scanline are visited. Each pixel gets
+ * the part of it covered by the polygon, which anti-aliases the outline.
  * \param vertices points defining the polygon
  * \param count number of vertices
  * \param with x range
  * \param height y range
  * \param value value identifying points in the polygon
  * \param map array of integers of the dimension width * height.
- *            The map entries belonging to the points in the polygon will be set to \param set * 255 the others to !set * 255.
+ *            The map entries get the covered part of 255, or the uncovered part if \param invert is set.
  */
 static void fillMap( PointF *vertices, int count, int width, int height, int invert, uint8_t *map )
 {
-    int nodes, nodeX[1024], pixelY, i, j, value;
-
-    value = !invert * 255;
-    memset( map, invert * 255, width * height );
+    Edge *edges = mlt_pool_alloc( count * sizeof( Edge ) );
+    Edge **active = mlt_pool_alloc( count * sizeof( Edge* ) );
+    double *nodeX = mlt_pool_alloc( count * sizeof( double ) );
+    int *cover = mlt_pool_alloc( ( width + 2 ) * sizeof( int ) );
+    int edgeCount = 0, activeCount = 0, next = 0;
+    int pixelY, sub, nodes, i, j;
+    const int full = SUBSAMPLES * COVERAGE;
+
+    for ( i = 0, j = count - 1; i < count; j = i++ )
+    {
+        PointF *a = &vertices[j], *b = &vertices[i];
+        if ( a->y == b->y )
+            continue;
+        if ( a->y > b->y )
+        {
+            PointF *t = a;
+            a = b;
+            b = t;
+        }
+        edges[edgeCount].x = a->x;
+        edges[edgeCount].y = a->y;
+        edges[edgeCount].ymax = b->y;
+        edges[edgeCount].dxdy = ( b->x - a->x ) / ( b->y - a->y );
+        edgeCount++;
+    }
+    qsort( edges, edgeCount, sizeof( Edge ), edgeCompare );
 
     // Loop through the rows of the image
     for ( pixelY = 0; pixelY < height; pixelY++ )
     {
-        /*
-         * Build a list of nodes.
-         * nodes are located at the borders of the polygon
-         * and therefore indicate a move from in to out or vice versa
-         */
-        nodes = 0;
-        for ( i = 0, j = count - 1; i < count; j = i++ )
-            if ( (vertices[i].y > (double)pixelY) != (vertices[j].y > (double)pixelY) )
-                nodeX[nodes++] = (int)(vertices[i].x + (pixelY - vertices[i].y) / (vertices[j].y - vertices[i].y) * (vertices[j].x - vertices[i].x) );
+        uint8_t *row = map + width * pixelY;
+        memset( cover, 0, ( width + 2 ) * sizeof( int ) );
 
-        qsort( nodeX, nodes, sizeof( int ), ncompare );
-
-        // Set map values for points between the node pairs to 1
-        for ( i = 0; i < nodes; i += 2 )
+        for ( sub = 0; sub < SUBSAMPLES; sub++ )
         {
-            if ( nodeX[i] >= width )
-                break;
+            double y = pixelY + ( sub + 0.5 ) / SUBSAMPLES;
 
-            if ( nodeX[i+1] > 0 )
-            {
-                nodeX[i] = MAX( 0, nodeX[i] );
-                nodeX[i+1] = MIN( nodeX[i+1], width );
-                memset( map + width * pixelY + nodeX[i], value, nodeX[i+1] - nodeX[i] );
-            }
+            // Update the edges crossing this sub scanline
+            while ( next < edgeCount && edges[next].y <= y )
+                active[activeCount++] = &edges[next++];
+            for ( i = 0, j = 0; i < activeCount; i++ )
+                if ( active[i]->ymax > y )
+                    active[j++] = active[i];
+            activeCount = j;
+
+            /*
+             * Build a list of nodes.
+             * nodes are located at the borders of the polygon
+             * and therefore indicate a move from in to out or vice versa
+             */
+            nodes = 0;
+            for ( i = 0; i < activeCount; i++ )
+                nodeX[nodes++] = active[i]->x + ( y - active[i]->y ) * active[i]->dxdy;
+
+            qsort( nodeX, nodes, sizeof( double ), dcompare );
+
+            for ( i = 0; i + 1 < nodes; i += 2 )
+                addSpan( cover, width, nodeX[i], nodeX[i+1] );
+        }
+
+        int value = 0;
+        for ( i = 0; i < width; i++ )
+        {
+            value += cover[i];
+            int alpha = ( CLAMP( value, 0, full ) * 255 + full / 2 ) / full;
+            row[i] = invert ? 255 - alpha : alpha;
         }
     }
+
+    mlt_pool_release( cover );
+    mlt_pool_release( nodeX );
+    mlt_pool_release( active );
+    mlt_pool_release( edges );
 }
 
 /** Determines the point in the middle of the Bézier curve (t = 0.5) defined by \param p1 and \param p2
@@ -315,11 +555,108 @@ static void curvePoints( BPointF p1, BPointF p2, PointF **points, int *count, in
     (*points)[*(count)++] = p2.p;
 }
 
+/** Everything besides the Bézier points the mask depends on. */
+typedef struct MaskKey
+{
+    int width;
+    int height;
+    int invert;
+    int feather;
+    int passes;
+} MaskKey;
+
+/** Returns a reference to the mask cached for \param bpoints and \param key, or NULL.
+ * Masks only change with the spline, so the one of the last frame is kept in the filter
+ * and reused while playing over identical keyframes or pausing. */
+static uint8_t *getCachedMask( mlt_filter filter, BPointF *bpoints, int length, MaskKey *key )
+{
+    mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+    uint8_t *map = NULL;
+    int size = 0;
+
+    mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+    BPointF *points = mlt_properties_get_data( properties, "_mask_points", &size );
+    MaskKey *cachedKey = mlt_properties_get_data( properties, "_mask_key", NULL );
+    uint8_t *cached = mlt_properties_get_data( properties, "_mask", NULL );
+    if ( cached && cachedKey && size == length && !memcmp( cachedKey, key, sizeof( MaskKey ) )
+         && ( !length || !memcmp( points, bpoints, length ) ) )
+    {
+        // Share the cached mask, or copy it when pool buffers cannot be shared
+        size = key->width * key->height;
+        if ( !( map = mlt_pool_retain( cached ) ) && ( map = mlt_pool_alloc( size ) ) )
+            memcpy( map, cached, size );
+    }
+    mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+
+    return map;
+}
+
+static void setCachedMask( mlt_filter filter, BPointF *bpoints, int length, MaskKey *key, uint8_t *map )
+{
+    mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+    BPointF *points = mlt_pool_alloc( length );
+    MaskKey *cachedKey = mlt_pool_alloc( sizeof( MaskKey ) );
+    uint8_t *cached = mlt_pool_retain( map );
+
+    if ( !cached && ( cached = mlt_pool_alloc( key->width * key->height ) ) )
+        memcpy( cached, map, key->width * key->height );
+    if ( length )
+        memcpy( points, bpoints, length );
+    *cachedKey = *key;
+
+    mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+    mlt_properties_set_data( properties, "_mask", cached, key->width * key->height, (mlt_destructor)mlt_pool_release, NULL );
+    mlt_properties_set_data( properties, "_mask_points", points, length, (mlt_destructor)mlt_pool_release, NULL );
+    mlt_properties_set_data( properties, "_mask_key", cachedKey, sizeof( MaskKey ), (mlt_destructor)mlt_pool_release, NULL );
+    mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+}
+
+/** Maps a Bézier point from the range 0-1 to the image dimensions. */
+static BPointF scalePoint( BPointF point, int width, int height )
+{
+    point.h1.x *= width;
+    point.p.x  *= width;
+    point.h2.x *= width;
+    point.h1.y *= height;
+    point.p.y  *= height;
+    point.h2.y *= height;
+    return point;
+}
+
+/** Rasterizes and feathers the mask of the spline, or returns NULL if it has no points. */
+static uint8_t *renderMask( BPointF *bpoints, int bcount, MaskKey *key )
+{
+    struct PointF *points;
+    uint8_t *map = NULL;
+    int count = 0, size = 1, i, j;
+
+    points = mlt_pool_alloc( size * sizeof( struct PointF ) );
+    for ( i = 0; i < bcount; i++ )
+    {
+        j = (i + 1) % bcount;
+        curvePoints( scalePoint( bpoints[i], key->width, key->height ),
+                     scalePoint( bpoints[j], key->width, key->height ), &points, &count, &size );
+    }
+
+    if ( count )
+    {
+        map = mlt_pool_alloc( key->width * key->height );
+        fillMap( points, count, key->width, key->height, key->invert, map );
+
+        if ( key->feather )
+            blur( map, key->width, key->height, key->feather, key->passes );
+    }
+
+    mlt_pool_release( points );
+    return map;
+}
+
 /** Do it :-).
 */
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
     mlt_properties unique = mlt_frame_pop_service( frame );
+    mlt_filter filter = mlt_frame_pop_service( frame );
 
     int mode = mlt_properties_get_int( unique, "mode" );
 
@@ -332,41 +669,27 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
     if ( !error )
     {
         BPointF *bpoints;
-        struct PointF *points;
-        int bcount, length, count, size, i, j;
+        int length, size, i;
         bpoints = mlt_properties_get_data( unique, "points", &length );
-        bcount = length / sizeof( BPointF );
 
-        for ( i = 0; i < bcount; i++ )
+        MaskKey key;
+        memset( &key, 0, sizeof( key ) );
+        key.width = *width;
+        key.height = *height;
+        key.invert = mlt_properties_get_int( unique, "invert" );
+        if ( mode != MODE_RGB )
         {
-            // map to image dimensions
-            bpoints[i].h1.x *= *width;
-            bpoints[i].p.x  *= *width;
-            bpoints[i].h2.x *= *width;
-            bpoints[i].h1.y *= *height;
-            bpoints[i].p.y  *= *height;
-            bpoints[i].h2.y *= *height;
+            key.feather = mlt_properties_get_int( unique, "feather" );
+            key.passes = key.feather ? mlt_properties_get_int( unique, "feather_passes" ) : 0;
         }
 
-        count = 0;
-        size = 1;
-        points = mlt_pool_alloc( size * sizeof( struct PointF ) );
-        for ( i = 0; i < bcount; i++ )
-        {
-            j = (i + 1) % bcount;
-            curvePoints( bpoints[i], bpoints[j], &points, &count, &size );
-        }
+        uint8_t *map = getCachedMask( filter, bpoints, length, &key );
+        if ( !map && ( map = renderMask( bpoints, length / sizeof( BPointF ), &key ) ) )
+            setCachedMask( filter, bpoints, length, &key, map );
 
-        if ( count )
+        if ( map )
         {
             length = *width * *height;
-            uint8_t *map = mlt_pool_alloc( length );
-            int invert = mlt_properties_get_int( unique, "invert" );
-            fillMap( points, count, *width, *height, invert, map );
-
-            int feather = mlt_properties_get_int( unique, "feather" );
-            if ( feather && mode != MODE_RGB )
-                blur( map, *width, *height, feather, mlt_properties_get_int( unique, "feather_passes" ) );
 
             int bpp;
             size = mlt_image_format_size( *format, *width, *height - 1, &bpp ); // mlt_image_format_size increments height!
@@ -494,8 +817,6 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
             mlt_pool_release( map );
         }
-
-        mlt_pool_release( points );
     }
 
     return error;
@@ -599,6 +920,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
     mlt_properties_set_int( unique, "invert", mlt_properties_get_int( properties, "invert" ) );
     mlt_properties_set_int( unique, "feather", mlt_properties_get_int( properties, "feather" ) );
     mlt_properties_set_int( unique, "feather_passes", mlt_properties_get_int( properties, "feather_passes" ) );
+    mlt_frame_push_service( frame, filter );
     mlt_frame_push_service( frame, unique );
     mlt_frame_push_get_image( frame, filter_get_image );
 
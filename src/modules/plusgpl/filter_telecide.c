@@ -24,6 +24,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#include <emmintrin.h>
+#define METRICS_SSE2 __attribute__((target("sse2")))
+#endif
+
 #define MAX_CYCLE 6
 #define BLKSIZE 24
 #define BLKSIZE_TIMES2 (2 * BLKSIZE)
@@ -38,6 +43,7 @@
 #define POST_FULL_NOMATCH 4
 #define POST_FULL_NOMATCH_MAP 5
 #define CACHE_SIZE 100000
+#define IMAGE_CACHE_SIZE (MAX_CYCLE + 4)
 #define P 0
 #define C 1
 #define N 2
@@ -54,6 +60,13 @@ struct CACHE_ENTRY
 	unsigned int chosen;
 };
 
+struct IMAGE_CACHE_ENTRY
+{
+	mlt_position position;
+	uint8_t *image;
+	size_t size;
+};
+
 struct PREDICTION
 {
 	unsigned int metric;
@@ -99,6 +112,10 @@ struct context_s {
 	// Metrics cache.
 	struct CACHE_ENTRY *cache;
 
+	// Recent images, indexed by position modulo IMAGE_CACHE_SIZE.
+	struct IMAGE_CACHE_ENTRY images[IMAGE_CACHE_SIZE];
+	int use_sse2;
+
 	// Pattern guidance data.
 	int cycle;
 	struct PREDICTION pred[MAX_CYCLE+1];
@@ -184,6 +201,35 @@ static void CacheInsert(context cx, int frame, unsigned int p, unsigned int pblo
 	cx->cache[f].chosen = 0xff;
 }
 
+/** Copy an image into the image cache.
+ *
+ * The cache only holds the images of the current cycle, so the buffer of an
+ * older position is reused rather than allocating one for every frame.
+ */
+
+static void ImageCacheInsert( context cx, mlt_position position, uint8_t *image, size_t size )
+{
+	struct IMAGE_CACHE_ENTRY *entry = &cx->images[position % IMAGE_CACHE_SIZE];
+	if ( position < 0 )
+		return;
+	if ( entry->size != size )
+	{
+		char key[20];
+		sprintf( key, "%d", (int) ( position % IMAGE_CACHE_SIZE ) );
+		entry->image = mlt_pool_alloc( size );
+		entry->size = size;
+		mlt_properties_set_data( cx->image_cache, key, entry->image, size, (mlt_destructor)mlt_pool_release, NULL );
+	}
+	memcpy( entry->image, image, size );
+	entry->position = position;
+}
+
+static uint8_t *ImageCacheQuery( context cx, mlt_position position )
+{
+	struct IMAGE_CACHE_ENTRY *entry = &cx->images[position % IMAGE_CACHE_SIZE];
+	return position >= 0 && entry->image && entry->position == position ? entry->image : NULL;
+}
+
 static int CacheQuery(context cx, int frame, unsigned int *p, unsigned int *pblock,
 					unsigned int *c, unsigned int *cblock)
 {
@@ -389,128 +435,185 @@ static struct PREDICTION *PredictSoftYUY2(context cx, int frame )
 	return cx->pred;
 }
 
-static
-void CalculateMetrics(context cx, int frame, unsigned char *fcrp, unsigned char *fcrpU, unsigned char *fcrpV,
-					unsigned char *fprp, unsigned char *fprpU, unsigned char *fprpV)
+#define T 4
+
+/** Compute the comb metrics of one row.
+ *
+ * The bottom field lines bot0 and bot2 are tested against the top field lines
+ * top0, top2 and top4 around them. This returns the sum of the comb differences
+ * above the noise threshold and counts the vertically combed samples in the
+ * sums of the blocks of the row.
+ */
+
+static unsigned int MetricsRowC( context cx, int x, const unsigned char *bot0, const unsigned char *bot2,
+	const unsigned char *top0, const unsigned char *top2, const unsigned char *top4, unsigned int *sums )
 {
-	int x, y, p, c, tmp1, tmp2, skip;
-	int vc;
-    unsigned char *currbot0, *currbot2, *prevbot0, *prevbot2;
-	unsigned char *prevtop0, *prevtop2, *prevtop4, *currtop0, *currtop2, *currtop4;
-	unsigned char *a0, *a2, *b0, *b2, *b4;
-	unsigned int diff, index;
-#	define T 4
+	unsigned int sum = 0, diff;
+	int tmp1, tmp2, vc;
+	int skip = 1 + ( !cx->chroma );
 
-	/* Clear the block sums. */
- 	for (y = 0; y < cx->yblocks; y++)
+	// Subsample the frames for speed.
+	while ( x < cx->w )
 	{
- 		for (x = 0; x < cx->xblocks; x++)
-		{
-#ifdef WINDOWED_MATCH
-			matchp[y*xblocks+x] = 0;
-			matchc[y*xblocks+x] = 0;
-#endif
-			cx->sump[y * cx->xblocks + x] = 0;
-			cx->sumc[y * cx->xblocks + x] = 0;
-		}
-	}
+		tmp1 = ((long)bot0[x] + (long)bot2[x]);
+		diff = labs((((long)top0[x] + (long)top2[x] + (long)top4[x])) - (tmp1 >> 1) - tmp1);
+		if (diff > cx->nt)
+			sum += diff;
 
-	/* Find the best field match. Subsample the frames for speed. */
-	currbot0  = fcrp + cx->pitch;
-	currbot2  = fcrp + 3 * cx->pitch;
-	currtop0 = fcrp;
-	currtop2 = fcrp + 2 * cx->pitch;
-	currtop4 = fcrp + 4 * cx->pitch;
-	prevbot0  = fprp + cx->pitch;
-	prevbot2  = fprp + 3 * cx->pitch;
-	prevtop0 = fprp;
-	prevtop2 = fprp + 2 * cx->pitch;
-	prevtop4 = fprp + 4 * cx->pitch;
-	if ( cx->tff )
-	{
-		a0 = prevbot0;
-		a2 = prevbot2;
-		b0 = currtop0;
-		b2 = currtop2;
-		b4 = currtop4;
+		tmp1 = bot0[x] + T;
+		tmp2 = bot0[x] - T;
+		vc = (tmp1 < top0[x] && tmp1 < top2[x]) ||
+			 (tmp2 > top0[x] && tmp2 > top2[x]);
+		if (vc)
+			sums[x / BLKSIZE_TIMES2]++;
+
+		x += skip;
+		if (!(x&3)) x += 4;
 	}
-	else
+	return sum;
+}
+
+#ifdef METRICS_SSE2
+
+/** Compute the comb metrics of one row with SSE2.
+ *
+ * This samples the same bytes as MetricsRowC: the first four of every eight,
+ * or only the luma of those without chroma. A block spans three vectors.
+ */
+
+static METRICS_SSE2 unsigned int MetricsRowSSE2( context cx, const unsigned char *bot0, const unsigned char *bot2,
+	const unsigned char *top0, const unsigned char *top2, const unsigned char *top4, unsigned int *sums )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16( 1 );
+	const __m128i t = _mm_set1_epi16( T );
+	const __m128i nt = _mm_set1_epi16( cx->nt < 0 ? INT16_MAX : MIN( cx->nt, INT16_MAX ) );
+	const __m128i lanes = cx->chroma ? _mm_setr_epi16( -1, -1, -1, -1, 0, 0, 0, 0 ) : _mm_setr_epi16( -1, 0, -1, 0, 0, 0, 0, 0 );
+	__m128i total = _mm_setzero_si128();
+	int x, half;
+
+	for ( x = 0; x + 16 <= cx->w; x += 16 )
 	{
-		a0 = currbot0;
-		a2 = currbot2;
-		b0 = prevtop0;
-		b2 = prevtop2;
-		b4 = prevtop4;
+		__m128i vb0 = _mm_loadu_si128( (const __m128i*) ( bot0 + x ) );
+		__m128i vb2 = _mm_loadu_si128( (const __m128i*) ( bot2 + x ) );
+		__m128i vt0 = _mm_loadu_si128( (const __m128i*) ( top0 + x ) );
+		__m128i vt2 = _mm_loadu_si128( (const __m128i*) ( top2 + x ) );
+		__m128i vt4 = _mm_loadu_si128( (const __m128i*) ( top4 + x ) );
+		__m128i combed[2];
+
+		for ( half = 0; half < 2; half++ )
+		{
+			__m128i b0 = half ? _mm_unpackhi_epi8( vb0, zero ) : _mm_unpacklo_epi8( vb0, zero );
+			__m128i b2 = half ? _mm_unpackhi_epi8( vb2, zero ) : _mm_unpacklo_epi8( vb2, zero );
+			__m128i t0 = half ? _mm_unpackhi_epi8( vt0, zero ) : _mm_unpacklo_epi8( vt0, zero );
+			__m128i t2 = half ? _mm_unpackhi_epi8( vt2, zero ) : _mm_unpacklo_epi8( vt2, zero );
+			__m128i t4 = half ? _mm_unpackhi_epi8( vt4, zero ) : _mm_unpacklo_epi8( vt4, zero );
+
+			// Field match metric
+			__m128i tmp1 = _mm_add_epi16( b0, b2 );
+			__m128i diff = _mm_sub_epi16( _mm_add_epi16( _mm_add_epi16( t0, t2 ), t4 ),
+				_mm_add_epi16( _mm_srli_epi16( tmp1, 1 ), tmp1 ) );
+			diff = _mm_max_epi16( diff, _mm_sub_epi16( zero, diff ) );
+			diff = _mm_and_si128( diff, _mm_and_si128( _mm_cmpgt_epi16( diff, nt ), lanes ) );
+			total = _mm_add_epi32( total, _mm_madd_epi16( diff, ones ) );
+
+			// Vertical combing
+			__m128i up = _mm_add_epi16( b0, t );
+			__m128i down = _mm_sub_epi16( b0, t );
+			__m128i vc = _mm_or_si128( _mm_and_si128( _mm_cmplt_epi16( up, t0 ), _mm_cmplt_epi16( up, t2 ) ),
+				_mm_and_si128( _mm_cmpgt_epi16( down, t0 ), _mm_cmpgt_epi16( down, t2 ) ) );
+			combed[half] = _mm_and_si128( vc, lanes );
+		}
+		sums[x / BLKSIZE_TIMES2] += __builtin_popcount( _mm_movemask_epi8( _mm_packs_epi16( combed[0], combed[1] ) ) );
 	}
-	p = c = 0;
+	total = _mm_add_epi32( total, _mm_srli_si128( total, 8 ) );
+	total = _mm_add_epi32( total, _mm_srli_si128( total, 4 ) );
+	return (unsigned int) _mm_cvtsi128_si32( total ) + MetricsRowC( cx, x, bot0, bot2, top0, top2, top4, sums );
+}
 
-	// Calculate the field match and film/video metrics.
-	skip = 1 + ( !cx->chroma );
-	for (y = 0, index = 0; y < cx->h - 4; y+=4)
+#endif
+
+struct METRICS_DESC
+{
+	context cx;
+	unsigned char *fcrp, *fprp;
+	unsigned int p, c;
+};
+
+/** Compute the metrics of a band of rows of blocks.
+ *
+ * The bands do not share any block sums, so they can be computed in parallel.
+ */
+
+static int MetricsSlice( int id, int index, int jobs, void *cookie )
+{
+	struct METRICS_DESC *desc = (struct METRICS_DESC *) cookie;
+	context cx = desc->cx;
+	int yblock_start = index * cx->yblocks / jobs;
+	int yblock_end = ( index + 1 ) * cx->yblocks / jobs;
+	unsigned int p = 0, c = 0;
+	int y;
+
+	for ( y = yblock_start * BLKSIZE; y < yblock_end * BLKSIZE && y < cx->h - 4; y += 4 )
 	{
 		/* Exclusion band. Good for ignoring subtitles. */
 		if (cx->y0 == cx->y1 || y < cx->y0 || y > cx->y1)
 		{
-			for (x = 0; x < cx->w;)
+			unsigned char *curr = desc->fcrp + y * cx->pitch;
+			unsigned char *prev = desc->fprp + y * cx->pitch;
+			unsigned char *a, *b;
+			unsigned int *sumc = cx->sumc + (y / BLKSIZE) * cx->xblocks;
+			unsigned int *sump = cx->sump + (y / BLKSIZE) * cx->xblocks;
+
+			if ( cx->tff )
 			{
-				index = (y/BLKSIZE) * cx->xblocks + x/BLKSIZE_TIMES2;
+				a = prev + cx->pitch;
+				b = curr;
+			}
+			else
+			{
+				a = curr + cx->pitch;
+				b = prev;
+			}
 
+#ifdef METRICS_SSE2
+			if ( cx->use_sse2 )
+			{
 				// Test combination with current frame.
-				tmp1 = ((long)currbot0[x] + (long)currbot2[x]);
-				diff = labs((((long)currtop0[x] + (long)currtop2[x] + (long)currtop4[x])) - (tmp1 >> 1) - tmp1);
-				if (diff > cx->nt)
-				{
-					c += diff;
-#ifdef WINDOWED_MATCH
-					matchc[index] += diff;
-#endif
-				}
-
-				tmp1 = currbot0[x] + T;
-				tmp2 = currbot0[x] - T;
-				vc = (tmp1 < currtop0[x] && tmp1 < currtop2[x]) ||
-					 (tmp2 > currtop0[x] && tmp2 > currtop2[x]);
-				if (vc)
-				{
-					cx->sumc[index]++;
-				}
-
+				c += MetricsRowSSE2( cx, curr + cx->pitch, curr + 3 * cx->pitch, curr, curr + 2 * cx->pitch, curr + 4 * cx->pitch, sumc );
 				// Test combination with previous frame.
-				tmp1 = ((long)a0[x] + (long)a2[x]);
-				diff = labs((((long)b0[x] + (long)b2[x] + (long)b4[x])) - (tmp1 >> 1) - tmp1);
-				if (diff > cx->nt)
-				{
-					p += diff;
-#ifdef WINDOWED_MATCH
-					matchp[index] += diff;
-#endif
-				}
-
-				tmp1 = a0[x] + T;
-				tmp2 = a0[x] - T;
-				vc = (tmp1 < b0[x] && tmp1 < b2[x]) ||
-					 (tmp2 > b0[x] && tmp2 > b2[x]);
-				if (vc)
-				{
-					cx->sump[index]++;
-				}
-
-				x += skip;
-				if (!(x&3)) x += 4;
+				p += MetricsRowSSE2( cx, a, a + 2 * cx->pitch, b, b + 2 * cx->pitch, b + 4 * cx->pitch, sump );
+				continue;
 			}
+#endif
+			// Test combination with current frame.
+			c += MetricsRowC( cx, 0, curr + cx->pitch, curr + 3 * cx->pitch, curr, curr + 2 * cx->pitch, curr + 4 * cx->pitch, sumc );
+			// Test combination with previous frame.
+			p += MetricsRowC( cx, 0, a, a + 2 * cx->pitch, b, b + 2 * cx->pitch, b + 4 * cx->pitch, sump );
 		}
-		currbot0 += cx->pitchtimes4;
-		currbot2 += cx->pitchtimes4;
-		currtop0 += cx->pitchtimes4;
-		currtop2 += cx->pitchtimes4;
-		currtop4 += cx->pitchtimes4;
-		a0		 += cx->pitchtimes4;
-		a2		 += cx->pitchtimes4;
-		b0		 += cx->pitchtimes4;
-		b2		 += cx->pitchtimes4;
-		b4		 += cx->pitchtimes4;
 	}
+	__atomic_fetch_add( &desc->p, p, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &desc->c, c, __ATOMIC_RELAXED );
+	return 0;
+}
+
+static
+void CalculateMetrics(context cx, int frame, unsigned char *fcrp, unsigned char *fcrpU, unsigned char *fcrpV,
+					unsigned char *fprp, unsigned char *fprpU, unsigned char *fprpV)
+{
+	struct METRICS_DESC desc = { cx, fcrp, fprp, 0, 0 };
+	int x, y, jobs;
+
+	/* Clear the block sums. */
+	memset( cx->sump, 0, cx->xblocks * cx->yblocks * sizeof(unsigned int) );
+	memset( cx->sumc, 0, cx->xblocks * cx->yblocks * sizeof(unsigned int) );
 
+	// Calculate the field match and film/video metrics in bands of block rows.
+	jobs = MIN( mlt_slices_count_normal(), cx->yblocks );
+	if ( jobs > 1 )
+		mlt_slices_run_normal( jobs, MetricsSlice, &desc );
+	else
+		MetricsSlice( 0, 0, 1, &desc );
 
 	if ( cx->post )
 	{
@@ -537,11 +640,7 @@ void CalculateMetrics(context cx, int frame, unsigned char *fcrp, unsigned char
 			}
 		}
 	}
-#ifdef WINDOWED_MATCH
-	CacheInsert(frame, highest_matchp, highest_sump, highest_matchc, highest_sumc);
-#else
-	CacheInsert( cx, frame, p, cx->highest_sump, c, cx->highest_sumc);
-#endif
+	CacheInsert( cx, frame, desc.p, cx->highest_sump, desc.c, cx->highest_sumc);
 }
 
 /** Process the image.
@@ -614,31 +713,24 @@ static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format
 		// Put the current image into the image cache, keyed on position
 		size_t image_size = (*width * *height) << 1;
 		mlt_position pos = mlt_filter_get_position( filter, frame );
-		uint8_t *image_copy = mlt_pool_alloc( image_size );
-		memcpy( image_copy, *image, image_size );
-		char key[20];
-		sprintf( key, MLT_POSITION_FMT, pos );
-		mlt_properties_set_data( cx->image_cache, key, image_copy, image_size, (mlt_destructor)mlt_pool_release, NULL );
-		
+		ImageCacheInsert( cx, pos, *image, image_size );
+
 		// Only if we have enough frame images cached
 		if ( pos > 1 && pos > cx->cycle + 1 )
 		{
 			pos -= cx->cycle + 1;
 			// Get the current frame image
-			sprintf( key, MLT_POSITION_FMT, pos );
-			cx->fcrp = mlt_properties_get_data( cx->image_cache, key, NULL );
+			cx->fcrp = ImageCacheQuery( cx, pos );
 			if (!cx->fcrp) return error;
 			 
 			// Get the previous frame image
 			cx->pframe = pos == 0 ? 0 : pos - 1;
-			sprintf( key, "%d", cx->pframe );
-			cx->fprp = mlt_properties_get_data( cx->image_cache, key, NULL );
+			cx->fprp = ImageCacheQuery( cx, cx->pframe );
 			if (!cx->fprp) return error;
 			
 			// Get the next frame image
 			cx->nframe = pos > cx->out ? cx->out : pos + 1;
-			sprintf( key, "%d", cx->nframe );
-			cx->fnrp = mlt_properties_get_data( cx->image_cache, key, NULL );
+			cx->fnrp = ImageCacheQuery( cx, cx->nframe );
 			if (!cx->fnrp) return error;
 			
 			cx->pitch = *width << 1;
@@ -665,11 +757,10 @@ static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format
 				{
 					if ( ! CacheQuery( cx, cx->y, &cx->p, &cx->pblock, &cx->c, &cx->cblock ) )
 					{
-						sprintf( key, "%d", cx->y );
-						cx->crp = (unsigned char *) mlt_properties_get_data( cx->image_cache, key, NULL );
-						sprintf( key, "%d", cx->y ? cx->y - 1 : 1 );
-						cx->prp = (unsigned char *) mlt_properties_get_data( cx->image_cache, key, NULL );
-						CalculateMetrics( cx, cx->y, cx->crp, NULL, NULL, cx->prp, NULL, NULL );
+						cx->crp = ImageCacheQuery( cx, cx->y );
+						cx->prp = ImageCacheQuery( cx, cx->y ? cx->y - 1 : 1 );
+						if ( cx->crp && cx->prp )
+							CalculateMetrics( cx, cx->y, cx->crp, NULL, NULL, cx->prp, NULL, NULL );
 					}
 				}
 			}
@@ -857,9 +948,8 @@ static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format
 			}
 			else if ( cx->chosen == C )
 			{
-				// The best match was with the current frame.
-				BitBlt( cx->dstp, 2 * cx->dpitch, cx->fcrp, 2 * cx->pitch, cx->w, cx->hplus1over2 );
-				BitBlt( cx->dstp + cx->dpitch, 2 * cx->dpitch, cx->fcrp + cx->pitch, 2 * cx->pitch,	cx->w, cx->hover2 );
+				// The best match was with the current frame, both fields are contiguous.
+				memcpy( cx->dstp, cx->fcrp, cx->pitch * cx->h );
 			}
 			else if ( ! cx->tff )
 			{
@@ -978,9 +1068,8 @@ static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format
 			if (cx->hints) WriteHints(cx->film, cx->inpattern, frame_properties);
 
 final:			
-			// Flush frame at tail of period from the cache
-			sprintf( key, MLT_POSITION_FMT, pos - 1 );
-			mlt_properties_set_data( cx->image_cache, key, NULL, 0, NULL, NULL );
+			// The buffers of the image cache are reused for later positions
+			cx->fprp = cx->fcrp = cx->fnrp = NULL;
 		}
 		else
 		{
@@ -1039,6 +1128,12 @@ mlt_filter filter_telecide_init( mlt_profile profile, mlt_service_type type, con
 		// Allocate the image cache and set up for garbage collection
 		cx->image_cache = mlt_properties_new();
 		mlt_properties_set_data( properties, "image_cache", cx->image_cache, 0, (mlt_destructor)mlt_properties_close, NULL );
+		for (i = 0; i < IMAGE_CACHE_SIZE; i++)
+			cx->images[i].position = -1;
+#ifdef METRICS_SSE2
+		__builtin_cpu_init();
+		cx->use_sse2 = __builtin_cpu_supports( "sse2" );
+#endif
 		
 		// Initialize the parameter defaults
 		mlt_properties_set_int( properties, "guide", 0 );
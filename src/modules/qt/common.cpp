@@ -20,6 +20,8 @@
 #include <QApplication>
 #include <QLocale>
 #include <QImage>
+#include <QPainter>
+#include <QTransform>
 
 #if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
 #include <X11/Xlib.h>
@@ -101,6 +103,65 @@ void convert_mlt_to_qimage_rgba( uint8_t* mImg, QImage* qImg, int width, int hei
 #endif
 }
 
+// Do not paint bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (64)
+
+struct paint_slice_desc
+{
+	uint8_t *dest;
+	int width;
+	int height;
+	const QImage *source;
+	const QTransform *transform;
+	int composition;
+	bool smooth;
+	double opacity;
+	bool clear;
+};
+
+static int paint_slice( int id, int index, int jobs, void *cookie )
+{
+	struct paint_slice_desc *desc = (struct paint_slice_desc *) cookie;
+	int y = desc->height * index / jobs;
+	int height = desc->height * ( index + 1 ) / jobs - y;
+	uint8_t *dest = desc->dest + y * desc->width * 4;
+	QImage band;
+
+	// Each band is its own image and sees the transform shifted up by its offset.
+	convert_mlt_to_qimage_rgba( dest, &band, desc->width, height );
+	if ( desc->clear )
+		band.fill( 0 );
+	QPainter painter( &band );
+	painter.setCompositionMode( ( QPainter::CompositionMode ) desc->composition );
+	painter.setRenderHints( QPainter::Antialiasing | QPainter::SmoothPixmapTransform, desc->smooth );
+	painter.setTransform( *desc->transform * QTransform::fromTranslate( 0, -y ) );
+	painter.setOpacity( desc->opacity );
+	painter.drawImage( 0, 0, *desc->source );
+	painter.end();
+	convert_qimage_to_mlt_rgba( &band, dest, desc->width, height );
+	return 0;
+}
+
+/** Paint an image over an rgba buffer in place.
+ *
+ * Large buffers are split in horizontal bands that are painted in parallel.
+ * \param threads the number of bands, or 0 for the slice count
+ * \param clear make the buffer transparent before painting
+ */
+
+void paint_image_sliced( uint8_t *dest, int width, int height, const QImage &source, const QTransform &transform,
+	int composition, bool smooth, double opacity, bool clear, int threads )
+{
+	struct paint_slice_desc desc = { dest, width, height, &source, &transform, composition, smooth, opacity, clear };
+	int jobs = threads > 0 ? MIN( threads, mlt_slices_count_normal() ) : mlt_slices_count_normal();
+
+	jobs = MIN( jobs, height / MIN_SLICE_HEIGHT );
+	if ( jobs > 1 )
+		mlt_slices_run_normal( jobs, paint_slice, &desc );
+	else
+		paint_slice( 0, 0, 1, &desc );
+}
+
 int create_image( mlt_frame frame, uint8_t **image, mlt_image_format *image_format, int *width, int *height, int writable )
 {
 	int error = 0;
@@ -22,10 +22,13 @@
 #include <framework/mlt.h>
 
 class QImage;
+class QTransform;
 
 bool createQApplicationIfNeeded(mlt_service service);
 void convert_qimage_to_mlt_rgba( QImage* qImg, uint8_t* mImg, int width, int height );
 void convert_mlt_to_qimage_rgba( uint8_t* mImg, QImage* qImg, int width, int height );
+void paint_image_sliced( uint8_t *dest, int width, int height, const QImage &source, const QTransform &transform,
+	int composition, bool smooth, double opacity, bool clear, int threads );
 int create_image( mlt_frame frame, uint8_t **image, mlt_image_format *image_format, int *width, int *height, int writable );
 
 #endif // COMMON_H
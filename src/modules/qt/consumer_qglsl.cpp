@@ -86,15 +86,18 @@ protected:
 
 typedef void* ( *thread_function_t )( void* );
 
+// Each rendering thread has its own context, sharing textures and buffers
+// with the others so that frames rendered by one can be used by another.
 class RenderThread : public QThread
 {
 public:
-	RenderThread(thread_function_t function, void *data)
+	RenderThread(thread_function_t function, void *data, QOpenGLContext *shareContext)
 		: QThread(0)
 		, m_function(function)
 		, m_data(data)
 	{
 		m_context = new QOpenGLContext;
+		m_context->setShareContext(shareContext);
 		m_context->create();
 		m_context->moveToThread(this);
 		m_surface = new QOffscreenSurface();
@@ -128,7 +131,8 @@ static void onThreadCreate(mlt_properties owner, mlt_consumer self,
 {
 	Q_UNUSED(owner)
 	Q_UNUSED(priority)
-	(*thread) = new RenderThread(function, data);
+	QOpenGLContext *shareContext = (QOpenGLContext*) mlt_properties_get_data(MLT_CONSUMER_PROPERTIES(self), "glslShareContext", NULL);
+	(*thread) = new RenderThread(function, data, shareContext);
 	(*thread)->start();
 }
 
@@ -144,6 +148,11 @@ static void onThreadJoin(mlt_properties owner, mlt_consumer self, RenderThread*
 	}
 }
 
+static void deleteShareContext(QOpenGLContext *context)
+{
+	delete context;
+}
+
 #endif // Qt 5
 
 static void onThreadStarted(mlt_properties owner, mlt_consumer consumer)
@@ -208,6 +217,19 @@ mlt_consumer consumer_qglsl_init( mlt_profile profile, mlt_service_type type, co
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 			mlt_properties_set_data(properties, "GLWidget", new GLWidget, 0, NULL, NULL);
 #else
+			// The application may already have a context for all of its own to share.
+#if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+			QOpenGLContext *shareContext = QOpenGLContext::globalShareContext();
+#else
+			QOpenGLContext *shareContext = 0;
+#endif
+			if (shareContext) {
+				mlt_properties_set_data(properties, "glslShareContext", shareContext, 0, NULL, NULL);
+			} else {
+				shareContext = new QOpenGLContext;
+				shareContext->create();
+				mlt_properties_set_data(properties, "glslShareContext", shareContext, 0, (mlt_destructor) deleteShareContext, NULL);
+			}
 			mlt_events_listen(properties, consumer, "consumer-thread-create", (mlt_listener) onThreadCreate);
 			mlt_events_listen(properties, consumer, "consumer-thread-join", (mlt_listener) onThreadJoin);
 #endif
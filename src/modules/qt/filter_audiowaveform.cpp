@@ -256,6 +256,126 @@ static void paint_waveform( QPainter& p, QRectF& rect, int16_t* audio, int sampl
 	}
 }
 
+static void paint_peaks( QPainter& p, QRectF& rect, mlt_peaks peaks, int channel, int channels, double start, double end, int fill )
+{
+	int width = rect.width();
+	qreal half_height = rect.height() / 2.0;
+	qreal center_y = rect.y() + half_height;
+
+	// For each x position on the waveform, draw a vertical line from the
+	// min value to the max value of the peaks of that interval.
+	for ( int x = 0; x < width; x++ )
+	{
+		double x_start = start + ( end - start ) * x / width;
+		double x_end = start + ( end - start ) * ( x + 1 ) / width;
+		qreal max = 0.0;
+		qreal min = 0.0;
+		int count = 0;
+
+		// A negative channel combines all channels
+		for ( int c = channel < 0 ? 0 : channel; c < ( channel < 0 ? channels : channel + 1 ); c++ )
+		{
+			float c_min, c_max;
+			if ( !mlt_peaks_get( peaks, c, x_start, x_end, &c_min, &c_max, NULL ) )
+			{
+				min += c_min;
+				max += c_max;
+				count++;
+			}
+		}
+		if ( !count )
+			continue;
+		min /= count;
+		max /= count;
+
+		if ( fill ) {
+			// Draw the line all the way to 0 to "fill" it in.
+			if ( max > 0 && min > 0 ) {
+				min = 0;
+			} else if ( min < 0 && max < 0 ) {
+				max = 0;
+			}
+		}
+
+		QPoint high( x + rect.x(), max * half_height + center_y );
+		QPoint low( x + rect.x(), min * half_height + center_y );
+		if ( high.y() == low.y() ) {
+			p.drawPoint( high );
+		} else {
+			p.drawLine( low, high );
+		}
+	}
+}
+
+/** Get the peaks of the media of the frame when the filter uses them and they are ready.
+*/
+
+static mlt_peaks get_peaks( mlt_filter filter, mlt_frame frame )
+{
+	mlt_producer producer = mlt_frame_get_original_producer( frame );
+	mlt_peaks peaks = NULL;
+
+	if ( producer && mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "peaks" ) )
+	{
+		peaks = mlt_peaks_of_producer( producer );
+		if ( !mlt_peaks_is_ready( peaks ) )
+			peaks = NULL;
+	}
+	return peaks;
+}
+
+static void draw_peaks( mlt_filter filter, mlt_frame frame, QImage* qimg, mlt_peaks peaks )
+{
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
+	int show_channel = mlt_properties_get_int( filter_properties, "show_channel" );
+	int fill = mlt_properties_get_int( filter_properties, "fill" );
+	int channels = mlt_peaks_channels( peaks );
+	mlt_rect rect = mlt_properties_anim_get_rect( filter_properties, "rect", position, length );
+	if ( strchr( mlt_properties_get( filter_properties, "rect" ), '%' ) ) {
+		rect.x *= qimg->width();
+		rect.w *= qimg->width();
+		rect.y *= qimg->height();
+		rect.h *= qimg->height();
+	}
+
+	// The window ends with this frame, as with the buffered samples
+	double fps = mlt_producer_get_fps( producer );
+	double end = ( mlt_frame_original_position( frame ) + 1 ) / fps;
+	double start = end - qMax( mlt_properties_get_int( filter_properties, "window" ) / 1000.0, 1.0 / fps );
+
+	QRectF r( rect.x, rect.y, rect.w, rect.h );
+
+	QPainter p( qimg );
+
+	setup_graph_painter( p, r, filter_properties );
+
+	if ( show_channel == 0 ) // Show all channels
+	{
+		QRectF c_rect = r;
+		qreal c_height = r.height() / channels;
+		for ( int c = 0; c < channels; c++ )
+		{
+			// Divide the rectangle into smaller rectangles for each channel.
+			c_rect.setY( r.y() + c_height * c );
+			c_rect.setHeight( c_height );
+			setup_graph_pen( p, c_rect, filter_properties );
+			paint_peaks( p, c_rect, peaks, c, channels, start, end, fill );
+		}
+	} else { // Show one specific channel or all channels combined
+		if ( show_channel > channels ) {
+			// Sanity
+			show_channel = 1;
+		}
+		setup_graph_pen( p, r, filter_properties );
+		paint_peaks( p, r, peaks, show_channel - 1, channels, start, end, fill );
+	}
+
+	p.end();
+}
+
 static void draw_waveforms( mlt_filter filter, mlt_frame frame, QImage* qimg, int16_t* audio, int channels, int samples )
 {
 	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
@@ -328,8 +448,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	mlt_filter filter = (mlt_filter)mlt_frame_pop_service( frame );
 	private_data* pdata = (private_data*)filter->child;
 	save_buffer* audio = (save_buffer*)mlt_properties_get_data( frame_properties, pdata->buffer_prop_name, NULL );
+	mlt_peaks peaks = get_peaks( filter, frame );
 
-	if( audio )
+	if( audio || peaks )
 	{
 		// Get the current image
 		*image_format = mlt_image_rgb24a;
@@ -339,7 +460,10 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		if( !error ) {
 			QImage qimg( *width, *height, QImage::Format_ARGB32 );
 			convert_mlt_to_qimage_rgba( *image, &qimg, *width, *height );
-			draw_waveforms( filter, frame, &qimg, audio->buffer, audio->channels, audio->samples );
+			if ( peaks )
+				draw_peaks( filter, frame, &qimg, peaks );
+			else
+				draw_waveforms( filter, frame, &qimg, audio->buffer, audio->channels, audio->samples );
 			convert_qimage_to_mlt_rgba( &qimg, *image, *width, *height );
 		}
 	}
@@ -425,6 +549,7 @@ mlt_filter filter_audiowaveform_init( mlt_profile profile, mlt_service_type type
 		mlt_properties_set( filter_properties, "fill", "0" );
 		mlt_properties_set( filter_properties, "gorient", "v" );
 		mlt_properties_set_int( filter_properties, "window", 0 );
+		mlt_properties_set_int( filter_properties, "peaks", 0 );
 
 		pdata->reset_window = 1;
 		// Create a unique ID for storing data on the frame
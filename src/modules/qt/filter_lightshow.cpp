@@ -23,9 +23,12 @@
 #include <math.h>   // sin()
 #include <QPainter>
 #include <QImage>
+#include <QTransform>
 
 // Private Constants
 static const double PI = 3.14159265358979323846;
+// The light is a smooth gradient, so it is drawn at a fraction of its size.
+static const int LIGHT_SCALE = 4;
 
 // Private Types
 typedef struct
@@ -176,17 +179,30 @@ static void setup_pen( QPainter& p, QRect& rect, mlt_properties filter_propertie
 	p.setPen( QColor(0,0,0,0) ); // Clear pen
 }
 
-static void draw_light( mlt_properties filter_properties, QImage* qimg, mlt_rect* rect, double mag )
+static void draw_light( mlt_properties filter_properties, uint8_t* image, int width, int height, mlt_rect* rect, double mag )
 {
-	QPainter p( qimg );
-	QRect r( rect->x, rect->y, rect->w, rect->h );
+	// Only the lines covered by the light are painted.
+	int top = MAX( 0, (int)floor( rect->y ) );
+	int bottom = MIN( height, (int)ceil( rect->y + rect->h ) );
+	if ( rect->w <= 0 || bottom <= top )
+		return;
+
+	QImage light( MAX( 1, (int)ceil( rect->w / LIGHT_SCALE ) ), MAX( 1, (int)ceil( rect->h / LIGHT_SCALE ) ),
+		QImage::Format_ARGB32_Premultiplied );
+	light.fill( Qt::transparent );
+	QPainter p( &light );
+	QRect r( 0, 0, light.width(), light.height() );
 	p.setRenderHint( QPainter::Antialiasing );
-	// Output transparency = input transparency
-	p.setCompositionMode(QPainter::CompositionMode_SourceAtop);
 	setup_pen( p, r, filter_properties );
-	p.setOpacity( mag );
 	p.drawRect( r );
 	p.end();
+
+	// Output transparency = input transparency
+	QTransform transform;
+	transform.translate( rect->x, rect->y - top );
+	transform.scale( rect->w / light.width(), rect->h / light.height() );
+	paint_image_sliced( image + top * width * 4, width, bottom - top, light, transform,
+		QPainter::CompositionMode_SourceAtop, true, mag, false, 0 );
 }
 
 /** Get the image.
@@ -203,6 +219,11 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	if( mlt_properties_get( frame_properties, pdata->mag_prop_name ) )
 	{
 		double mag = mlt_properties_get_double( frame_properties, pdata->mag_prop_name );
+
+		// Nothing is drawn while the light is off.
+		if ( mag <= 0.0 )
+			return mlt_frame_get_image( frame, image, format, width, height, writable );
+
 		mlt_position position = mlt_filter_get_position( filter, frame );
 		mlt_position length = mlt_filter_get_length2( filter, frame );
 		mlt_rect rect = mlt_properties_anim_get_rect( filter_properties, "rect", position, length );
@@ -220,10 +241,7 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 		// Draw the light
 		if( !error ) {
-			QImage qimg( *width, *height, QImage::Format_ARGB32 );
-			convert_mlt_to_qimage_rgba( *image, &qimg, *width, *height );
-			draw_light( filter_properties, &qimg, &rect, mag );
-			convert_qimage_to_mlt_rgba( &qimg, *image, *width, *height );
+			draw_light( filter_properties, *image, *width, *height, &rect, mag );
 		}
 	} else {
 		if ( pdata->preprocess_warned++ == 2 )
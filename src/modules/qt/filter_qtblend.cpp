@@ -21,7 +21,6 @@
 #include <framework/mlt.h>
 #include <stdlib.h> // calloc(), free()
 #include <math.h>   // sin()
-#include <QPainter>
 #include <QTransform>
 #include <QImage>
 
@@ -143,20 +142,9 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 	uint8_t *dest_image = NULL;
 	dest_image = (uint8_t *) mlt_pool_alloc( image_size );
 	
-	QImage destImage;
-	convert_mlt_to_qimage_rgba( dest_image, &destImage, *width, *height );
-	destImage.fill(0);
-	
-	QPainter painter( &destImage );
-	painter.setCompositionMode( ( QPainter::CompositionMode ) mlt_properties_get_int( properties, "compositing" ) );
-	painter.setRenderHints( QPainter::Antialiasing | QPainter::SmoothPixmapTransform );
-	painter.setTransform(transform);
-	painter.setOpacity(opacity);
-	// Composite top frame
-	painter.drawImage(0, 0, sourceImage);
-	// finish Qt drawing
-	painter.end();
-	convert_qimage_to_mlt_rgba( &destImage, dest_image, *width, *height );
+	paint_image_sliced( dest_image, *width, *height, sourceImage, transform,
+		mlt_properties_get_int( properties, "compositing" ), true, opacity, true,
+		mlt_properties_get_int( properties, "threads" ) );
 	*image = dest_image;
 	mlt_frame_set_image( frame, *image, *width * *height * 4, mlt_pool_release );
 	return error;
@@ -33,6 +33,8 @@
 #include <QTextDocument>
 #include <QStyleOptionGraphicsItem>
 #include <QString>
+#include <QVector>
+#include <QCryptographicHash>
 #include <math.h>
 
 #include <QDomElement>
@@ -79,67 +81,145 @@ private:
 
 };
 
-void blur( QImage& image, int radius )
+// The blur is a recursive filter that runs down the columns, along the rows,
+// up the columns and back along the rows. Every step moves the accumulator of
+// a channel a fraction of the way towards the next pixel, in 12.4 fixed point.
+
+static inline void blur_step( int *acc, unsigned char *p, int alpha )
 {
-    int tab[] = { 14, 10, 8, 6, 5, 5, 4, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2 };
-    int alpha = (radius < 1)  ? 16 : (radius > 17) ? 1 : tab[radius-1];
+    for (int i = 0; i < 4; i++)
+        p[i] = (acc[i] += ((p[i] << 4) - acc[i]) * alpha / 16) >> 4;
+}
 
-    int r1 = 0;
-    int r2 = image.height() - 1;
-    int c1 = 0;
-    int c2 = image.width() - 1;
+static inline void blur_load( int *acc, const unsigned char *p )
+{
+    for (int i = 0; i < 4; i++)
+        acc[i] = p[i] << 4;
+}
 
-    int bpl = image.bytesPerLine();
-    int rgba[4];
-    unsigned char* p;
+static void blur_columns( unsigned char *line, int bpl, int width, int height, int alpha, int *acc )
+{
+    for (int col = 0; col < width; col++)
+        blur_load( acc + col * 4, line + col * 4 );
+    for (int row = 1; row < height; row++) {
+        line += bpl;
+        for (int col = 0; col < width; col++)
+            blur_step( acc + col * 4, line + col * 4, alpha );
+    }
+}
 
-    int i1 = 0;
-    int i2 = 3;
+static void blur_row( unsigned char *p, int step, int width, int alpha )
+{
+    int acc[4];
+    blur_load( acc, p );
+    for (int col = 1; col < width; col++) {
+        p += step;
+        blur_step( acc, p, alpha );
+    }
+}
 
-    for (int col = c1; col <= c2; col++) {
-        p = image.scanLine(r1) + col * 4;
-        for (int i = i1; i <= i2; i++)
-            rgba[i] = p[i] << 4;
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
 
-        p += bpl;
-        for (int j = r1; j < r2; j++, p += bpl)
-            for (int i = i1; i <= i2; i++)
-                p[i] = (rgba[i] += ((p[i] << 4) - rgba[i]) * alpha / 16) >> 4;
-    }
+#include <emmintrin.h>
 
-    for (int row = r1; row <= r2; row++) {
-        p = image.scanLine(row) + c1 * 4;
-        for (int i = i1; i <= i2; i++)
-            rgba[i] = p[i] << 4;
+#define BLUR_SSE2 __attribute__((target("sse2")))
 
-        p += 4;
-        for (int j = c1; j < c2; j++, p += 4)
-            for (int i = i1; i <= i2; i++)
-                p[i] = (rgba[i] += ((p[i] << 4) - rgba[i]) * alpha / 16) >> 4;
-    }
+// The four channels of a pixel are the four lanes of a vector. The products
+// fit 16 bits times 16 bits, so pmaddwd gives them without SSE4.1 and the
+// division rounds towards zero like the C code.
 
-    for (int col = c1; col <= c2; col++) {
-        p = image.scanLine(r2) + col * 4;
-        for (int i = i1; i <= i2; i++)
-            rgba[i] = p[i] << 4;
+static BLUR_SSE2 inline __m128i blur_load_sse2( const unsigned char *p )
+{
+    __m128i v = _mm_cvtsi32_si128( *(const int*) p );
+    v = _mm_unpacklo_epi8( v, _mm_setzero_si128() );
+    return _mm_unpacklo_epi16( v, _mm_setzero_si128() );
+}
 
-        p -= bpl;
-        for (int j = r1; j < r2; j++, p -= bpl)
-            for (int i = i1; i <= i2; i++)
-                p[i] = (rgba[i] += ((p[i] << 4) - rgba[i]) * alpha / 16) >> 4;
-    }
+static BLUR_SSE2 inline __m128i blur_step_sse2( __m128i acc, unsigned char *p, __m128i alpha )
+{
+    __m128i d = _mm_sub_epi32( _mm_slli_epi32( blur_load_sse2( p ), 4 ), acc );
+    __m128i m = _mm_madd_epi16( d, alpha );
+    m = _mm_add_epi32( m, _mm_and_si128( _mm_srai_epi32( m, 31 ), _mm_set1_epi32( 15 ) ) );
+    acc = _mm_add_epi32( acc, _mm_srai_epi32( m, 4 ) );
+    __m128i v = _mm_packs_epi32( _mm_srli_epi32( acc, 4 ), _mm_setzero_si128() );
+    *(int*) p = _mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+    return acc;
+}
 
-    for (int row = r1; row <= r2; row++) {
-        p = image.scanLine(row) + c2 * 4;
-        for (int i = i1; i <= i2; i++)
-            rgba[i] = p[i] << 4;
+static BLUR_SSE2 void blur_columns_sse2( unsigned char *line, int bpl, int width, int height, int a, int *acc )
+{
+    const __m128i alpha = _mm_set1_epi32( a );
+    for (int col = 0; col < width; col++)
+        _mm_storeu_si128( (__m128i*) ( acc + col * 4 ), _mm_slli_epi32( blur_load_sse2( line + col * 4 ), 4 ) );
+    for (int row = 1; row < height; row++) {
+        line += bpl;
+        for (int col = 0; col < width; col++) {
+            __m128i v = _mm_loadu_si128( (const __m128i*) ( acc + col * 4 ) );
+            _mm_storeu_si128( (__m128i*) ( acc + col * 4 ), blur_step_sse2( v, line + col * 4, alpha ) );
+        }
+    }
+}
 
-        p -= 4;
-        for (int j = c1; j < c2; j++, p -= 4)
-            for (int i = i1; i <= i2; i++)
-                p[i] = (rgba[i] += ((p[i] << 4) - rgba[i]) * alpha / 16) >> 4;
+static BLUR_SSE2 void blur_row_sse2( unsigned char *p, int step, int width, int a )
+{
+    const __m128i alpha = _mm_set1_epi32( a );
+    __m128i acc = _mm_slli_epi32( blur_load_sse2( p ), 4 );
+    for (int col = 1; col < width; col++) {
+        p += step;
+        acc = blur_step_sse2( acc, p, alpha );
     }
+}
+
+static bool blur_has_sse2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "sse2" );
+}
+
+#else
 
+static bool blur_has_sse2()
+{
+    return false;
+}
+
+#define blur_columns_sse2 blur_columns
+#define blur_row_sse2 blur_row
+
+#endif
+
+void blur( QImage& image, int radius )
+{
+    static const bool sse2 = blur_has_sse2();
+    int tab[] = { 14, 10, 8, 6, 5, 5, 4, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2 };
+    int alpha = (radius < 1)  ? 16 : (radius > 17) ? 1 : tab[radius-1];
+    int width = image.width();
+    int height = image.height();
+    int bpl = image.bytesPerLine();
+
+    if ( width < 1 || height < 1 )
+        return;
+
+    // The columns are filtered a row at a time to walk the memory in order
+    QVector<int> acc( width * 4 );
+    unsigned char* top = image.scanLine( 0 );
+    unsigned char* bottom = image.scanLine( height - 1 );
+
+    if ( sse2 ) {
+        blur_columns_sse2( top, bpl, width, height, alpha, acc.data() );
+        for (int row = 0; row < height; row++)
+            blur_row_sse2( image.scanLine( row ), 4, width, alpha );
+        blur_columns_sse2( bottom, -bpl, width, height, alpha, acc.data() );
+        for (int row = 0; row < height; row++)
+            blur_row_sse2( image.scanLine( row ) + ( width - 1 ) * 4, -4, width, alpha );
+    } else {
+        blur_columns( top, bpl, width, height, alpha, acc.data() );
+        for (int row = 0; row < height; row++)
+            blur_row( image.scanLine( row ), 4, width, alpha );
+        blur_columns( bottom, -bpl, width, height, alpha, acc.data() );
+        for (int row = 0; row < height; row++)
+            blur_row( image.scanLine( row ) + ( width - 1 ) * 4, -4, width, alpha );
+    }
 }
 
 class PlainTextItem: public QGraphicsItem
@@ -267,6 +347,51 @@ static void qscene_delete( void *data )
 	scene = NULL;
 }
 
+static void qimage_delete( void *data )
+{
+	delete static_cast<QImage*>( data );
+}
+
+#if QT_VERSION >= 0x050200
+// QImage::Format_RGBA8888 was added in Qt5.2
+static const QImage::Format title_format = QImage::Format_RGBA8888;
+#else
+static const QImage::Format title_format = QImage::Format_ARGB32;
+#endif
+
+static void render_scene( QGraphicsScene *scene, QImage &img, const QRectF &source, const QRectF &rect )
+{
+	QPainter p;
+	p.begin( &img );
+	p.setRenderHints( QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing );
+	scene->render( &p, source, rect, Qt::IgnoreAspectRatio );
+	p.end();
+}
+
+/** Render only some of the top level items of a scene.
+ */
+
+static void render_items( QGraphicsScene *scene, QImage &img, const QRectF &source, const QRectF &rect, const QList<QGraphicsItem *> &shown )
+{
+	QList<QGraphicsItem *> hidden;
+	foreach( QGraphicsItem *item, scene->items() )
+	{
+		if ( !item->parentItem() && item->isVisible() && !shown.contains( item ) )
+		{
+			item->setVisible( false );
+			hidden.append( item );
+		}
+	}
+	render_scene( scene, img, source, rect );
+	foreach( QGraphicsItem *item, hidden )
+		item->setVisible( true );
+}
+
+static QString rect_key( const QRectF &r )
+{
+	return QString( "%1,%2,%3,%4" ).arg( r.x(), 0, 'g', 10 ).arg( r.y(), 0, 'g', 10 ).arg( r.width(), 0, 'g', 10 ).arg( r.height(), 0, 'g', 10 );
+}
+
 
 void loadFromXml( producer_ktitle self, QGraphicsScene *scene, const char *templateXml, const char *templateText )
 {
@@ -663,19 +788,31 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 			scene = new QGraphicsScene();
 			scene->setItemIndexMethod( QGraphicsScene::NoIndex );
                         scene->setSceneRect(0, 0, mlt_properties_get_int( properties, "width" ), mlt_properties_get_int( properties, "height" ));
+			const char *xml;
+			const char *templatetext = mlt_properties_get( producer_props, "templatetext" );
 			if ( mlt_properties_get( producer_props, "resource" ) && mlt_properties_get( producer_props, "resource" )[0] != '\0' )
 			{
 				// The title has a resource property, so we read all properties from the resource.
 				// Do not serialize the xmldata
-				loadFromXml( self, scene, mlt_properties_get( producer_props, "_xmldata" ), mlt_properties_get( producer_props, "templatetext" ) );
+				xml = mlt_properties_get( producer_props, "_xmldata" );
 			}
 			else
 			{
 				// The title has no resource, all data should be serialized
-				loadFromXml( self, scene, mlt_properties_get( producer_props, "xmldata" ), mlt_properties_get( producer_props, "templatetext" ) );
-			  
+				xml = mlt_properties_get( producer_props, "xmldata" );
 			}
+			loadFromXml( self, scene, xml, templatetext );
 			mlt_properties_set_data( producer_props, "qscene", scene, 0, ( mlt_destructor )qscene_delete, NULL );
+			mlt_properties_set_data( producer_props, "_static_layer", NULL, 0, NULL, NULL );
+
+			// Renderings of the title are shared by all the titles with the same content
+			QCryptographicHash hash( QCryptographicHash::Sha1 );
+			if ( xml )
+				hash.addData( xml, strlen( xml ) );
+			hash.addData( "", 1 );
+			if ( templatetext )
+				hash.addData( templatetext, strlen( templatetext ) );
+			mlt_properties_set( producer_props, "_title_key", hash.result().toHex().constData() );
 		}
 
                 QRectF start = stringToRect( QString( mlt_properties_get( producer_props, "_startrect" ) ) );
@@ -686,8 +823,12 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 		    start = QRectF( 0, 0, mlt_properties_get_int( producer_props, "meta.media.width" ), mlt_properties_get_int( producer_props, "meta.media.height" ) );
 		}
 
+		// The state of the animation, frames in the same state look the same
+		QString state;
+
 		// Effects
 		QList <QGraphicsItem *> items = scene->items();
+		QList <QGraphicsItem *> animated_items;
 		QGraphicsTextItem *titem = NULL;
 		for (int i = 0; i < items.count(); i++) {
 		    titem = static_cast <QGraphicsTextItem*> ( items.at( i ) );
@@ -698,6 +839,13 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 				    // the keystroke delay and a start offset, both in frames
 				    QStringList values = params.at( 2 ).split( ";" );
 				    int interval = qMax( 0, ( ( int ) position - values.at( 1 ).toInt()) / values.at( 0 ).toInt() );
+				    interval = qMin( interval, params.at( 1 ).length() );
+				    animated_items.append( titem );
+				    state += QString( ":%1" ).arg( interval );
+				    // Only lay out the text again when a key was typed
+				    if ( titem->data( 2 ).isValid() && titem->data( 2 ).toInt() == interval )
+					    continue;
+				    titem->setData( 2, interval );
 				    QTextCursor cursor = titem->textCursor();
 				    cursor.movePosition(QTextCursor::EndOfBlock);
 				    // get the font format
@@ -717,60 +865,109 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 		    }
 		}
 
+		// Find the viewport of the frame, and of its second field when it is interlaced
+		mlt_position anim_out = mlt_properties_get_position( producer_props, "_animation_out" );
+		QRectF r1 = start;
+		QRectF r2;
+		if ( !end.isNull() )
+		{
+			if ( position > anim_out ) {
+				r1 = end;
+			}
+			else {
+				double percentage = 0;
+				if ( position && anim_out )
+					percentage = position / anim_out;
+				QPointF topleft = start.topLeft() + ( end.topLeft() - start.topLeft() ) * percentage;
+				QPointF bottomRight = start.bottomRight() + ( end.bottomRight() - start.bottomRight() ) * percentage;
+				r1 = QRectF( topleft, bottomRight );
+				if ( profile && !profile->progressive ) {
+					double percentage_next_filed	= ( position + 0.5 ) / anim_out;
+					QPointF topleft_next_field = start.topLeft() + ( end.topLeft() - start.topLeft() ) * percentage_next_filed;
+					QPointF bottomRight_next_field = start.bottomRight() + ( end.bottomRight() - start.bottomRight() ) * percentage_next_filed;
+					r2 = QRectF( topleft_next_field, bottomRight_next_field );
+				}
+			}
+		}
+		int next_field_line = (  mlt_properties_get_int( producer_props, "top_field_first" ) ? 1 : 0 );
+		state = rect_key( scene->sceneRect() ) + ":" + rect_key( r1 ) + ( r2.isNull() ? QString() : QString( ":%1:%2" ).arg( rect_key( r2 ) ).arg( next_field_line ) ) + state;
+		QByteArray key = QString( "kdenlivetitle:%1:%2x%3:%4" ).arg( mlt_properties_get( producer_props, "_title_key" ) )
+			.arg( width ).arg( height ).arg( state ).toUtf8();
+
 		//must be extracted from kdenlive title
 		self->rgba_image = (uint8_t *) mlt_pool_alloc( image_size );
+		mlt_cache_item item = mlt_cache_shared_get_data( key.constData() );
+		int cached_size = 0;
+		uint8_t *cached = item ? (uint8_t *) mlt_cache_item_data( item, &cached_size ) : NULL;
+
+		if ( cached && cached_size == image_size )
+		{
+			memcpy( self->rgba_image, cached, image_size );
+			mlt_cache_item_close( item );
+		}
+		else
+		{
+			if ( item )
+				mlt_cache_item_close( item );
 #if QT_VERSION >= 0x050200
-		// QImage::Format_RGBA8888 was added in Qt5.2
-		// Initialize the QImage with the MLT image because the data formats match.
-		QImage img( self->rgba_image, width, height, QImage::Format_RGBA8888 );
+			// Initialize the QImage with the MLT image because the data formats match.
+			QImage img( self->rgba_image, width, height, title_format );
 #else
-		QImage img( width, height, QImage::Format_ARGB32 );
+			QImage img( width, height, title_format );
 #endif
-		img.fill( 0 );
-		QPainter p1;
-		p1.begin( &img );
-		p1.setRenderHints( QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing );
-		//| QPainter::SmoothPixmapTransform );
-                mlt_position anim_out = mlt_properties_get_position( producer_props, "_animation_out" );
-
-		if (end.isNull())
-		{
-			scene->render( &p1, source, start, Qt::IgnoreAspectRatio );
-		}
-		else if ( position > anim_out ) {
-                        scene->render( &p1, source, end, Qt::IgnoreAspectRatio );
-                }
-		else {
-                        double percentage = 0;
-			if ( position && anim_out )
-				percentage = position / anim_out;
-			QPointF topleft = start.topLeft() + ( end.topLeft() - start.topLeft() ) * percentage;
-			QPointF bottomRight = start.bottomRight() + ( end.bottomRight() - start.bottomRight() ) * percentage;
-			const QRectF r1( topleft, bottomRight );
-			scene->render( &p1, source, r1, Qt::IgnoreAspectRatio );
-			if ( profile && !profile->progressive ){
-				int line=0;
-				double percentage_next_filed	= ( position + 0.5 ) / anim_out;
-				QPointF topleft_next_field = start.topLeft() + ( end.topLeft() - start.topLeft() ) * percentage_next_filed;
-				QPointF bottomRight_next_field = start.bottomRight() + ( end.bottomRight() - start.bottomRight() ) * percentage_next_filed;
-				const QRectF r2( topleft_next_field, bottomRight_next_field );
-				QImage img1( width, height, QImage::Format_ARGB32 );
-				img1.fill( 0 );
-				QPainter p2;
-				p2.begin(&img1);
-				p2.setRenderHints( QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing );
-				scene->render(&p2,source,r2,  Qt::IgnoreAspectRatio );
-				p2.end();
-				int next_field_line = (  mlt_properties_get_int( producer_props, "top_field_first" ) ? 1 : 0 );
-				for (line = next_field_line ;line<height;line+=2){
-						memcpy(img.scanLine(line),img1.scanLine(line),img.bytesPerLine());
+			if ( end.isNull() && !animated_items.isEmpty() )
+			{
+				// The items below the animated ones are rendered once into a layer
+				// and only the animated items and those above them for each frame.
+				qreal z = animated_items.first()->zValue();
+				foreach( QGraphicsItem *animated, animated_items )
+					z = qMin( z, animated->zValue() );
+				QList<QGraphicsItem *> below;
+				QList<QGraphicsItem *> above;
+				foreach( QGraphicsItem *gitem, items )
+				{
+					if ( !gitem->parentItem() )
+					{
+						if ( gitem->zValue() < z && !animated_items.contains( gitem ) )
+							below.append( gitem );
+						else
+							above.append( gitem );
+					}
 				}
+				QImage *layer = static_cast<QImage*>( mlt_properties_get_data( producer_props, "_static_layer", NULL ) );
+				if ( !layer || layer->width() != width || layer->height() != height )
+				{
+					layer = new QImage( width, height, title_format );
+					layer->fill( 0 );
+					render_items( scene, *layer, source, r1, below );
+					mlt_properties_set_data( producer_props, "_static_layer", layer, 0, qimage_delete, NULL );
+				}
+				for ( int line = 0; line < height; line++ )
+					memcpy( img.scanLine( line ), layer->constScanLine( line ), width * 4 );
+				render_items( scene, img, source, r1, above );
 			}
+			else
+			{
+				img.fill( 0 );
+				render_scene( scene, img, source, r1 );
+				if ( !r2.isNull() ) {
+					QImage img1( width, height, title_format );
+					img1.fill( 0 );
+					render_scene( scene, img1, source, r2 );
+					for (int line = next_field_line ;line<height;line+=2){
+							memcpy(img.scanLine(line),img1.scanLine(line),img.bytesPerLine());
+					}
+				}
+			}
+
+			convert_qimage_to_mlt_rgba(&img, self->rgba_image, width, height);
+			cached = (uint8_t *) mlt_pool_alloc( image_size );
+			memcpy( cached, self->rgba_image, image_size );
+			item = mlt_cache_shared_put_data( key.constData(), cached, image_size, mlt_pool_release );
+			if ( item )
+				mlt_cache_item_close( item );
 		}
-		p1.end();
 		self->format = mlt_image_rgb24a;
-
-		convert_qimage_to_mlt_rgba(&img, self->rgba_image, width, height);
 		self->current_image = (uint8_t *) mlt_pool_alloc( image_size );
 		memcpy( self->current_image, self->rgba_image, image_size );
 		mlt_properties_set_data( producer_props, "_cached_buffer", self->rgba_image, image_size, mlt_pool_release, NULL );
@@ -784,6 +981,7 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 			self->current_alpha = (uint8_t*) mlt_pool_alloc( width * height );
 			memcpy( self->current_alpha, alpha, width * height );
 			mlt_properties_set_data( producer_props, "_cached_alpha", self->current_alpha, width * height, mlt_pool_release, NULL );
+			self->alpha_box = mlt_image_alpha_box( self->current_alpha, width, height );
 		}
 	}
 
@@ -820,6 +1018,7 @@ void drawKdenliveTitle( producer_ktitle self, mlt_frame frame, mlt_image_format
 			self->current_alpha = (uint8_t*) mlt_pool_alloc( width * height );
 			memcpy( self->current_alpha, buffer, width * height );
 			mlt_properties_set_data( producer_props, "_cached_alpha", self->current_alpha, width * height, mlt_pool_release, NULL );
+			self->alpha_box = mlt_image_alpha_box( self->current_alpha, width, height );
 		}
         }
 
@@ -35,6 +35,7 @@ struct producer_ktitle_s
 	uint8_t *rgba_image;
 	uint8_t *current_image;
 	uint8_t *current_alpha;
+	mlt_rect alpha_box;
 	mlt_image_format format;
 	int current_width;
 	int current_height;
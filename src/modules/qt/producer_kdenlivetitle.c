@@ -113,6 +113,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			image_copy = mlt_pool_alloc( self->current_width * self->current_height );
 			memcpy( image_copy, self->current_alpha, self->current_width * self->current_height );
 			mlt_frame_set_alpha( frame, image_copy, self->current_width * self->current_height, mlt_pool_release );
+			mlt_frame_set_alpha_box( frame, self->alpha_box, self->current_width, self->current_height );
 		}
 	}
 	else
@@ -76,6 +76,7 @@ mlt_producer producer_qimage_init( mlt_profile profile, mlt_service_type type, c
 		// Callback registration
 		producer->get_frame = producer_get_frame;
 		producer->close = ( mlt_destructor )producer_close;
+		pthread_mutex_init( &self->prefetch_mutex, NULL );
 
 		// Set the default properties
 		mlt_properties_set( properties, "resource", filename );
@@ -217,6 +218,15 @@ static void load_filenames( producer_qimage self, mlt_properties properties )
 	refresh_length( properties, self );
 }
 
+// Get a reference to a cached buffer, or a copy when pool buffers cannot be shared.
+static uint8_t *share_buffer( uint8_t *data, int size )
+{
+	uint8_t *shared = mlt_pool_retain( data );
+	if ( !shared && ( shared = mlt_pool_alloc( size ) ) )
+		memcpy( shared, data, size );
+	return shared;
+}
+
 static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
 {
 	int error = 0;
@@ -232,6 +242,45 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	if ( mlt_properties_get_int( properties, "rescale_height" ) > 0 )
 		*height = mlt_properties_get_int( properties, "rescale_height" );
 
+	// Look in the cache shared across producers before touching our own state
+	char shared_key[ 1024 ] = "";
+	if ( self->count > 0 && mlt_cache_shared_get_budget() > 0 )
+	{
+		mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( producer );
+		int ttl = mlt_properties_get_int( producer_props, "ttl" );
+		mlt_position position = mlt_frame_original_position( frame ) + mlt_producer_get_in( producer );
+		int image_idx = ( int )floor( ( double )position / ( ttl > 0 ? ttl : 1 ) ) % self->count;
+		snprintf( shared_key, sizeof( shared_key ), "qimage:%s#%d:%s:%dx%d",
+			mlt_properties_get( producer_props, "resource" ), image_idx,
+			mlt_image_format_name( *format ), *width, *height );
+		mlt_frame original = mlt_cache_shared_get_frame( shared_key );
+		if ( original )
+		{
+			mlt_properties orig_props = MLT_FRAME_PROPERTIES( original );
+			int size = 0;
+			uint8_t *alpha = mlt_frame_share_data( original, "alpha", &size );
+			if ( alpha )
+				mlt_frame_set_alpha( frame, alpha, size, mlt_pool_release );
+			else if ( ( alpha = mlt_properties_get_data( orig_props, "alpha", &size ) ) )
+				mlt_frame_set_alpha( frame, alpha, size, NULL );
+			*buffer = mlt_frame_share_data( original, "image", &size );
+			if ( *buffer )
+				mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
+			else
+			{
+				*buffer = mlt_properties_get_data( orig_props, "image", &size );
+				mlt_frame_set_image( frame, *buffer, size, NULL );
+			}
+			mlt_properties_set_data( properties, "qimage.shared_cache", original, 0, (mlt_destructor) mlt_frame_close, NULL );
+			*format = mlt_properties_get_int( orig_props, "format" );
+			*width = mlt_properties_get_int( orig_props, "width" );
+			*height = mlt_properties_get_int( orig_props, "height" );
+			mlt_properties_set_int( properties, "width", *width );
+			mlt_properties_set_int( properties, "height", *height );
+			return 0;
+		}
+	}
+
 	mlt_service_lock( MLT_PRODUCER_SERVICE( &self->parent ) );
 
 	// Refresh the image
@@ -250,12 +299,12 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	// NB: Cloning is necessary with this producer (due to processing of images ahead of use)
 	// The fault is not in the design of mlt, but in the implementation of the qimage producer...
+	// The frame shares the cached image where possible and copies it before it is written.
 	if ( self->current_image )
 	{
 		// Clone the image and the alpha
 		int image_size = mlt_image_format_size( self->format, self->current_width, self->current_height, NULL );
-		uint8_t *image_copy = mlt_pool_alloc( image_size );
-		memcpy( image_copy, self->current_image, image_size );
+		uint8_t *image_copy = share_buffer( self->current_image, image_size );
 		// Now update properties so we free the copy after
 		mlt_frame_set_image( frame, image_copy, image_size, mlt_pool_release );
 		// We're going to pass the copy on
@@ -267,10 +316,14 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		{
             if ( !self->alpha_size )
                 self->alpha_size = self->current_width * self->current_height;
-			uint8_t * alpha_copy = mlt_pool_alloc( self->alpha_size );
-			memcpy( alpha_copy, self->current_alpha, self->alpha_size );
+			uint8_t * alpha_copy = share_buffer( self->current_alpha, self->alpha_size );
 			mlt_frame_set_alpha( frame, alpha_copy, self->alpha_size, mlt_pool_release );
 		}
+		if ( shared_key[0] )
+		{
+			mlt_properties_set_int( properties, "format", *format );
+			mlt_cache_shared_put_frame( shared_key, frame );
+		}
 	}
 	else
 	{
@@ -311,12 +364,22 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 		// Update timecode on the frame we're creating
 		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
 
+		// Count the reloads that may change the content of the same picture
+		if ( mlt_properties_get_int( producer_properties, "force_reload" ) )
+			mlt_properties_set_int( producer_properties, "_reloads", mlt_properties_get_int( producer_properties, "_reloads" ) + 1 );
+
 		// Refresh the image
 		self->qimage_cache = mlt_service_cache_get( MLT_PRODUCER_SERVICE( producer ), "qimage.qimage" );
 		self->qimage = mlt_cache_item_data( self->qimage_cache, NULL );
-		refresh_qimage( self, *frame );
+		int image_idx = refresh_qimage( self, *frame );
 		mlt_cache_item_close( self->qimage_cache );
 
+		// Every frame showing the same picture has the same image
+		char content[ 1024 ];
+		snprintf( content, sizeof( content ), "qimage:%s#%d:%d", mlt_properties_get( producer_properties, "resource" ),
+			image_idx, mlt_properties_get_int( producer_properties, "_reloads" ) );
+		mlt_frame_set_static_image( *frame, content );
+
 		// Set producer-specific frame properties
 		mlt_properties_set_int( properties, "progressive", mlt_properties_get_int( producer_properties, "progressive" ) );
 		double force_ratio = mlt_properties_get_double( producer_properties, "force_aspect_ratio" );
@@ -339,6 +402,8 @@ static void producer_close( mlt_producer parent )
 {
 	producer_qimage self = parent->child;
 	parent->close = NULL;
+	reset_prefetch( self );
+	pthread_mutex_destroy( &self->prefetch_mutex );
 	mlt_service_cache_purge( MLT_PRODUCER_SERVICE(parent) );
 	mlt_producer_close( parent );
 	mlt_properties_close( self->filenames );
@@ -30,6 +30,110 @@
 #include <QString>
 #include <QTextCodec>
 #include <QTextDecoder>
+#include <QTextLayout>
+#include <QGlyphRun>
+#include <QRawFont>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <cmath>
+
+#define MAX_CACHED_GLYPHS (2048)
+
+/** A glyph at its position in the layout of the text.
+*/
+
+struct PlacedGlyph
+{
+	QRawFont font;
+	quint32 index;
+	QPointF position; // of the origin on the baseline
+};
+
+typedef QVector<PlacedGlyph> GlyphLayout;
+
+/** A glyph rendered with the colours and the outline of the text.
+*/
+
+struct GlyphImage
+{
+	QImage image;
+	QPoint offset; // of the image from the pixel of the origin
+};
+
+/** The outlines and renderings of the glyphs of a producer.
+ *
+ * Text that changes on every frame, like a timecode, mostly uses the same
+ * glyphs, so each one is only turned into a path once, and rendered once for
+ * each set of colours, scale and quarter pixel phase. An image is then built
+ * from copies of these renderings instead of filling the path of the whole
+ * text. Both caches are cleared when they grow too large.
+ */
+
+class GlyphCache
+{
+public:
+	QPainterPath path( const QRawFont& font, quint32 index )
+	{
+		QMutexLocker locker( &m_mutex );
+		QString key = fontKey( font ) + QString::number( index );
+		QHash<QString, QPainterPath>::const_iterator i = m_paths.constFind( key );
+		if ( i != m_paths.constEnd() )
+			return i.value();
+		if ( m_paths.size() >= MAX_CACHED_GLYPHS )
+			m_paths.clear();
+		QPainterPath result = font.pathForGlyph( index );
+		m_paths.insert( key, result );
+		return result;
+	}
+
+	GlyphImage image( const PlacedGlyph& glyph, const QString& style, const QPen& pen, const QBrush& brush,
+		qreal sx, qreal sy, int phase_x, int phase_y )
+	{
+		QPainterPath outline = path( glyph.font, glyph.index );
+		QMutexLocker locker( &m_mutex );
+		QString key = QString( "%1%2/%3/%4/%5" ).arg( fontKey( glyph.font ), style ).arg( glyph.index ).arg( phase_x ).arg( phase_y );
+		QHash<QString, GlyphImage>::const_iterator i = m_images.constFind( key );
+		if ( i != m_images.constEnd() )
+			return i.value();
+		if ( m_images.size() >= MAX_CACHED_GLYPHS )
+			m_images.clear();
+
+		// Leave room for the outline and the antialiasing around the glyph.
+		QRectF bounds = QTransform::fromScale( sx, sy ).mapRect( outline.controlPointRect() );
+		int margin = (int) std::ceil( pen.widthF() * qMax( sx, sy ) / 2.0 ) + 2;
+		QPoint offset( (int) std::floor( bounds.left() ) - margin, (int) std::floor( bounds.top() ) - margin );
+		QSize size( (int) std::ceil( bounds.right() ) + margin + 1 - offset.x(), (int) std::ceil( bounds.bottom() ) + margin + 1 - offset.y() );
+
+		GlyphImage result;
+		result.offset = offset;
+		result.image = QImage( size, QImage::Format_ARGB32_Premultiplied );
+		result.image.fill( Qt::transparent );
+		if ( !outline.isEmpty() )
+		{
+			QPainter painter( &result.image );
+			painter.setRenderHints( QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing );
+			painter.translate( phase_x / 4.0 - offset.x(), phase_y / 4.0 - offset.y() );
+			painter.scale( sx, sy );
+			painter.setPen( pen );
+			painter.setBrush( brush );
+			painter.drawPath( outline );
+		}
+		m_images.insert( key, result );
+		return result;
+	}
+
+private:
+	static QString fontKey( const QRawFont& font )
+	{
+		return QString( "%1/%2/%3/%4/" ).arg( font.familyName(), font.styleName() ).arg( font.pixelSize() ).arg( font.weight() );
+	}
+
+	QMutex m_mutex;
+	QHash<QString, QPainterPath> m_paths;
+	QHash<QString, GlyphImage> m_images;
+};
 
 static void close_qimg( void* qimg )
 {
@@ -41,6 +145,25 @@ static void close_qpath( void* qpath )
 	delete static_cast<QPainterPath*>( qpath );
 }
 
+static void close_glyph_layout( void* layout )
+{
+	delete static_cast<GlyphLayout*>( layout );
+}
+
+static void close_glyph_cache( void* cache )
+{
+	delete static_cast<GlyphCache*>( cache );
+}
+
+// Get a reference to a cached buffer, or a copy when pool buffers cannot be shared.
+static uint8_t* share_buffer( uint8_t* data, int size )
+{
+	uint8_t* shared = static_cast<uint8_t*>( mlt_pool_retain( data ) );
+	if ( !shared && ( shared = static_cast<uint8_t*>( mlt_pool_alloc( size ) ) ) )
+		memcpy( shared, data, size );
+	return shared;
+}
+
 static void copy_qimage_to_mlt_image( QImage* qImg, uint8_t* mImg )
 {
 	int height = qImg->height();
@@ -125,9 +248,45 @@ static bool check_qpath( mlt_properties producer_properties )
 	return result;
 }
 
+/** Find the glyphs of a line of text with its baseline at \p origin.
+*/
+
+static void layout_line( const QString& line, const QFont& font, const QPointF& origin, GlyphLayout* glyphs )
+{
+	QTextLayout layout( line, font );
+	layout.setCacheEnabled( true );
+	layout.beginLayout();
+	QTextLine text_line = layout.createLine();
+	if ( text_line.isValid() )
+		text_line.setNumColumns( line.length() );
+	layout.endLayout();
+	if ( !text_line.isValid() )
+		return;
+
+	// The positions of a run are relative to the top of the line.
+	QPointF top = origin - QPointF( 0, text_line.ascent() );
+	QList<QGlyphRun> runs = layout.glyphRuns();
+	for ( int i = 0; i < runs.size(); ++i )
+	{
+		QVector<quint32> indexes = runs[i].glyphIndexes();
+		QVector<QPointF> positions = runs[i].positions();
+		QRawFont raw_font = runs[i].rawFont();
+		for ( int j = 0; j < indexes.size() && j < positions.size(); ++j )
+		{
+			PlacedGlyph glyph;
+			glyph.font = raw_font;
+			glyph.index = indexes[j];
+			glyph.position = top + positions[j];
+			glyphs->append( glyph );
+		}
+	}
+}
+
 static void generate_qpath( mlt_properties producer_properties )
 {
 	QPainterPath* qPath = static_cast<QPainterPath*>( mlt_properties_get_data( producer_properties, "_qpath", NULL ) );
+	GlyphLayout* glyphs = static_cast<GlyphLayout*>( mlt_properties_get_data( producer_properties, "_glyphs", NULL ) );
+	GlyphCache* glyph_cache = static_cast<GlyphCache*>( mlt_properties_get_data( producer_properties, "_glyph_cache", NULL ) );
 	int outline = mlt_properties_get_int( producer_properties, "outline" );
 	char* align = mlt_properties_get( producer_properties, "align" );
 	char* style = mlt_properties_get( producer_properties, "style" );
@@ -138,9 +297,10 @@ static void generate_qpath( mlt_properties producer_properties )
 	int width = 0;
 	int height = 0;
 
-	// Make the path empty
+	// Make the path and the layout empty
 	*qPath = QPainterPath();
 	qPath->setFillRule(Qt::WindingFill);
+	glyphs->clear();
 
 	// Get the strings to display
 	QTextCodec *codec = QTextCodec::codecForName( encoding );
@@ -212,10 +372,17 @@ static void generate_qpath( mlt_properties producer_properties )
 				x += width - line_width;
 				break;
 		}
-		qPath->addText( x, y, font, line );
+		layout_line( line, font, QPointF( x, y ), glyphs );
 		y += fm.lineSpacing();
 	}
 
+	// The path of the text is put together from those of its glyphs.
+	for( int i = 0; i < glyphs->size(); ++i )
+	{
+		const PlacedGlyph& glyph = glyphs->at(i);
+		qPath->addPath( glyph_cache->path( glyph.font, glyph.index ).translated( glyph.position ) );
+	}
+
 	// Account for outline and pad
 	width += offset * 2;
 	height += offset * 2;
@@ -271,6 +438,8 @@ static void generate_qimage( mlt_properties frame_properties )
 	QSize native_size( mlt_properties_get_int( frame_properties, "meta.media.width" ),
 					   mlt_properties_get_int( frame_properties, "meta.media.height" ) );
 	QPainterPath* qPath = static_cast<QPainterPath*>( mlt_properties_get_data( frame_properties, "_qpath", NULL ) );
+	GlyphLayout* glyphs = static_cast<GlyphLayout*>( mlt_properties_get_data( frame_properties, "_glyphs", NULL ) );
+	GlyphCache* glyph_cache = static_cast<GlyphCache*>( mlt_properties_get_data( producer_properties, "_glyph_cache", NULL ) );
 	mlt_color bg_color = mlt_properties_get_color( frame_properties, "_bgcolour" );
 	mlt_color fg_color = mlt_properties_get_color( frame_properties, "_fgcolour" );
 	mlt_color ol_color = mlt_properties_get_color( frame_properties, "_olcolour" );
@@ -293,8 +462,6 @@ static void generate_qimage( mlt_properties frame_properties )
 
 	// Draw the text
 	QPainter painter( qImg );
-	// Scale the painter rather than the image for better looking results.
-	painter.scale( sx, sy );
 	painter.setRenderHints( QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing );
 
 	QPen pen;
@@ -307,10 +474,33 @@ static void generate_qimage( mlt_properties frame_properties )
 	{
 		pen.setColor( QColor( bg_color.r, bg_color.g, bg_color.b, bg_color.a ) );
 	}
-	painter.setPen( pen );
 	QBrush brush( QColor( fg_color.r, fg_color.g, fg_color.b, fg_color.a ) );
-	painter.setBrush( brush );
-	painter.drawPath( *qPath );
+
+	if( glyphs && glyph_cache && !glyphs->isEmpty() )
+	{
+		// Copy the cached rendering of each glyph to its pixel.
+		QString style = QString( "%1/%2/%3/%4/%5/" ).arg( pen.color().rgba() ).arg( brush.color().rgba() )
+			.arg( outline ).arg( sx ).arg( sy );
+		for( int i = 0; i < glyphs->size(); ++i )
+		{
+			const PlacedGlyph& glyph = glyphs->at(i);
+			qreal x = glyph.position.x() * sx;
+			qreal y = glyph.position.y() * sy;
+			int ix = (int) std::floor( x );
+			int iy = (int) std::floor( y );
+			GlyphImage glyph_image = glyph_cache->image( glyph, style, pen, brush, sx, sy,
+				qMin( 3, (int) ( ( x - ix ) * 4 ) ), qMin( 3, (int) ( ( y - iy ) * 4 ) ) );
+			painter.drawImage( QPoint( ix, iy ) + glyph_image.offset, glyph_image.image );
+		}
+	}
+	else
+	{
+		// Scale the painter rather than the image for better looking results.
+		painter.scale( sx, sy );
+		painter.setPen( pen );
+		painter.setBrush( brush );
+		painter.drawPath( *qPath );
+	}
 }
 
 static int producer_get_image( mlt_frame frame, uint8_t** buffer, mlt_image_format* format, int* width, int* height, int writable )
@@ -326,7 +516,8 @@ static int producer_get_image( mlt_frame frame, uint8_t** buffer, mlt_image_form
 	mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
 
 	// Regenerate the qimage if necessary
-	if( check_qimage( frame_properties ) == true )
+	bool regenerated = check_qimage( frame_properties );
+	if( regenerated )
 	{
 		generate_qimage( frame_properties );
 	}
@@ -334,18 +525,34 @@ static int producer_get_image( mlt_frame frame, uint8_t** buffer, mlt_image_form
 	*format = mlt_image_rgb24a;
 	*width = qImg->width();
 	*height = qImg->height();
-
-	// Allocate and fill the image buffer
 	img_size = mlt_image_format_size( *format, *width, *height, NULL );
-	*buffer = static_cast<uint8_t*>( mlt_pool_alloc( img_size ) );
-	copy_qimage_to_mlt_image( qImg, *buffer );
+	alpha_size = *width * *height;
 
-	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+	// Convert the image and its alpha once for each new image
+	uint8_t* image = static_cast<uint8_t*>( mlt_properties_get_data( producer_properties, "_image", NULL ) );
+	uint8_t* image_alpha = static_cast<uint8_t*>( mlt_properties_get_data( producer_properties, "_alpha", NULL ) );
+	if( regenerated || !image || !image_alpha )
+	{
+		image = static_cast<uint8_t*>( mlt_pool_alloc( img_size ) );
+		copy_qimage_to_mlt_image( qImg, image );
+		image_alpha = static_cast<uint8_t*>( mlt_pool_alloc( alpha_size ) );
+		copy_image_to_alpha( image, image_alpha, *width, *height );
+		mlt_properties_set_data( producer_properties, "_image", image, img_size, mlt_pool_release, NULL );
+		mlt_properties_set_data( producer_properties, "_alpha", image_alpha, alpha_size, mlt_pool_release, NULL );
+		mlt_properties_set_rect( producer_properties, "_alpha_box", mlt_image_alpha_box( image_alpha, *width, *height ) );
+	}
+	mlt_frame_set_alpha_box( frame, mlt_properties_get_rect( producer_properties, "_alpha_box" ), *width, *height );
 
-	// Allocate and fill the alpha buffer
-	alpha_size = *width * *height;
-	alpha = static_cast<uint8_t*>( mlt_pool_alloc( alpha_size ) );
-	copy_image_to_alpha( *buffer, alpha, *width, *height );
+	// The frame shares the image where possible and copies it before it is written.
+	*buffer = share_buffer( image, img_size );
+	alpha = share_buffer( image_alpha, alpha_size );
+
+	// Mark the content so that a transition can reuse what it made of it.
+	char content[ MAX_SIG + 32 ];
+	snprintf( content, sizeof( content ), "qtext %dx%d %s", *width, *height, mlt_properties_get( producer_properties, "_img_sig" ) );
+	mlt_frame_set_static_image( frame, content );
+
+	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 
 	// Update the frame
 	mlt_frame_set_image( frame, *buffer, img_size, mlt_pool_release );
@@ -376,6 +583,8 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 		QPainterPath* prodPath = static_cast<QPainterPath*>( mlt_properties_get_data( producer_properties, "_qpath", NULL ) );
 		QPainterPath* framePath = new QPainterPath( *prodPath );
 		mlt_properties_set_data( frame_properties, "_qpath", static_cast<void*>( framePath ), 0, close_qpath, NULL );
+		GlyphLayout* prodGlyphs = static_cast<GlyphLayout*>( mlt_properties_get_data( producer_properties, "_glyphs", NULL ) );
+		mlt_properties_set_data( frame_properties, "_glyphs", static_cast<void*>( new GlyphLayout( *prodGlyphs ) ), 0, close_glyph_layout, NULL );
 
 		// Pass properties to the frame that will be needed to render the path
 		mlt_properties_set( frame_properties, "_path_sig", mlt_properties_get( producer_properties, "_path_sig" ) );
@@ -504,6 +713,8 @@ mlt_producer producer_qtext_init( mlt_profile profile, mlt_service_type type, co
 		// Create QT objects to be reused.
 		mlt_properties_set_data( producer_properties, "_qimg", static_cast<void*>( new QImage() ), 0, close_qimg, NULL );
 		mlt_properties_set_data( producer_properties, "_qpath", static_cast<void*>( new QPainterPath() ), 0, close_qpath, NULL );
+		mlt_properties_set_data( producer_properties, "_glyphs", static_cast<void*>( new GlyphLayout() ), 0, close_glyph_layout, NULL );
+		mlt_properties_set_data( producer_properties, "_glyph_cache", static_cast<void*>( new GlyphCache() ), 0, close_glyph_cache, NULL );
 
 		// Callback registration
 		producer->get_frame = producer_get_frame;
@@ -32,6 +32,8 @@
 #include <QtEndian>
 #include <QTemporaryFile>
 #include <QImageReader>
+#include <QFile>
+#include <QBuffer>
 
 #ifdef USE_EXIF
 #include <libexif/exif-data.h>
@@ -80,21 +82,26 @@ int init_qimage(const char *filename)
 	return 1;
 }
 
-static QImage* reorient_with_exif( producer_qimage self, int image_idx, QImage *qimage )
+static int get_exif_orientation( const char *filename )
 {
+	int exif_orientation = 0;
 #ifdef USE_EXIF
-	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( &self->parent );
-	ExifData *d = exif_data_new_from_file( mlt_properties_get_value( self->filenames, image_idx ) );
+	ExifData *d = exif_data_new_from_file( filename );
 	ExifEntry *entry;
-	int exif_orientation = 0;
-	/* get orientation and rotate image accordingly if necessary */
-	if (d) {
+	if ( d ) {
 		if ( ( entry = exif_content_get_entry ( d->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION ) ) )
 			exif_orientation = exif_get_short (entry->data, exif_data_get_byte_order (d));
-
-		/* Free the EXIF data */
-		exif_data_unref(d);
+		exif_data_unref( d );
 	}
+#endif
+	return exif_orientation;
+}
+
+static QImage* reorient_with_exif( producer_qimage self, int image_idx, QImage *qimage )
+{
+#ifdef USE_EXIF
+	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( &self->parent );
+	int exif_orientation = get_exif_orientation( mlt_properties_get_value( self->filenames, image_idx ) );
 
 	// Remember EXIF value, might be useful for someone
 	mlt_properties_set_int( producer_props, "_exif_orientation" , exif_orientation );
@@ -138,6 +145,241 @@ static QImage* reorient_with_exif( producer_qimage self, int image_idx, QImage *
 	return qimage;
 }
 
+// Get the size of a picture as it is shown, after the exif rotation.
+static void get_media_size( producer_qimage self, int idx, int disable_exif, int *width, int *height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	QImageReader reader;
+	reader.setDecideFormatFromContent( true );
+	reader.setFileName( QString::fromUtf8( filename ) );
+	QSize size = reader.size();
+	if ( !disable_exif && get_exif_orientation( filename ) >= 5 )
+		size.transpose();
+	if ( size.width() > 0 && size.height() > 0 )
+	{
+		*width = size.width();
+		*height = size.height();
+	}
+}
+
+/** Decode a picture at the smallest size that covers the given one.
+ *
+ * The file is mapped rather than read, and the reader scales it down while
+ * decoding, which the JPEG plugin does with the DCT scaling of libjpeg.
+ * Without a size, or when the picture is not larger, it is decoded in full.
+ */
+
+static QImage *load_qimage( producer_qimage self, int idx, int disable_exif, int width, int height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	QFile file( QString::fromUtf8( filename ) );
+	uchar *data = NULL;
+	QByteArray bytes;
+	QBuffer buffer;
+	QImageReader reader;
+
+	if ( file.open( QIODevice::ReadOnly ) && file.size() > 0 )
+		data = file.map( 0, file.size() );
+	reader.setDecideFormatFromContent( true );
+	if ( data )
+	{
+		bytes = QByteArray::fromRawData( (const char*) data, file.size() );
+		buffer.setBuffer( &bytes );
+		buffer.open( QIODevice::ReadOnly );
+		reader.setDevice( &buffer );
+	}
+	else
+	{
+		reader.setFileName( QString::fromUtf8( filename ) );
+	}
+
+	QSize size = reader.size();
+	if ( width > 0 && height > 0 && size.width() > 0 && size.height() > 0 )
+	{
+		// The size is that of the picture as it is shown
+		QSize shown( width, height );
+		if ( !disable_exif && get_exif_orientation( filename ) >= 5 )
+			shown.transpose();
+		double scale = qMax( (double) shown.width() / size.width(), (double) shown.height() / size.height() );
+		if ( scale < 1.0 )
+			reader.setScaledSize( QSize( qMax( 1, (int) ceil( size.width() * scale ) ),
+			                             qMax( 1, (int) ceil( size.height() * scale ) ) ) );
+	}
+	QImage *qimage = new QImage( reader.read() );
+	reader.setDevice( NULL );
+	buffer.close();
+	if ( data )
+		file.unmap( data );
+
+	if ( qimage->isNull() )
+	{
+		delete qimage;
+		return NULL;
+	}
+	// Read the exif value for this file
+	if ( !disable_exif )
+		qimage = reorient_with_exif( self, idx, qimage );
+	return qimage;
+}
+
+static void decoded_delete( void *data )
+{
+	delete static_cast<QImage*>( data );
+}
+
+// Get the key of a decoded image in the shared data cache, which changes with the file.
+static char *qimage_key( producer_qimage self, int idx, int disable_exif, int width, int height )
+{
+	const char *filename = mlt_properties_get_value( self->filenames, idx );
+	struct stat buf;
+	char *key;
+
+	if ( !filename || stat( filename, &buf ) )
+		return NULL;
+	key = (char*) malloc( strlen( filename ) + 80 );
+	if ( key )
+		sprintf( key, "qimage.decoded:%s:%lld:%lld:%d:%dx%d", filename, (long long) buf.st_mtime, (long long) buf.st_size,
+			disable_exif, width, height );
+	return key;
+}
+
+static mlt_cache_item cache_qimage( const char *key, QImage *qimage )
+{
+	return mlt_cache_shared_put_data( key, qimage, qimage->byteCount(), decoded_delete );
+}
+
+static int prefetch_proc( int id, int idx, int jobs, void *cookie )
+{
+	qimage_prefetch *prefetch = (qimage_prefetch*) cookie;
+	QImage *qimage = load_qimage( prefetch->self, prefetch->idx, prefetch->disable_exif, prefetch->width, prefetch->height );
+	if ( qimage )
+		prefetch->item = cache_qimage( prefetch->key, qimage );
+	return 0;
+}
+
+static void release_prefetch( qimage_prefetch *prefetch )
+{
+	if ( prefetch->runtime )
+		mlt_slices_wait( prefetch->runtime );
+	mlt_cache_item_close( prefetch->item );
+	free( prefetch->key );
+	memset( prefetch, 0, sizeof( *prefetch ) );
+	prefetch->idx = -1;
+}
+
+void reset_prefetch( producer_qimage self )
+{
+	pthread_mutex_lock( &self->prefetch_mutex );
+	for ( int i = 0; i < QIMAGE_PREFETCH_MAX; i++ )
+		release_prefetch( &self->prefetch[i] );
+	pthread_mutex_unlock( &self->prefetch_mutex );
+}
+
+/** Get the decoded image of a sequence and start decoding the images after it.
+ *
+ * The images ahead are decoded on the normal slices pool into the shared
+ * data cache, which any producer of the same files also reads. The property
+ * \em prefetch sets how many, it defaults to the number of slice threads.
+ *
+ * \return a new image that shares the decoded data or NULL
+ */
+
+static QImage *get_qimage( producer_qimage self, int image_idx, int disable_exif )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( &self->parent );
+	QImage *qimage = NULL;
+	mlt_cache_item item = NULL;
+	int width = self->decode_width;
+	int height = self->decode_height;
+	char *key = qimage_key( self, image_idx, disable_exif, width, height );
+	int count = 0;
+
+	if ( self->count > 1 )
+	{
+		if ( mlt_properties_get( properties, "prefetch" ) )
+			count = mlt_properties_get_int( properties, "prefetch" );
+		else
+			count = mlt_slices_count_normal();
+		count = qBound( 0, count, qMin( QIMAGE_PREFETCH_MAX, self->count - 1 ) );
+	}
+
+	pthread_mutex_lock( &self->prefetch_mutex );
+	for ( int i = 0; i < QIMAGE_PREFETCH_MAX; i++ )
+	{
+		qimage_prefetch *prefetch = &self->prefetch[i];
+		if ( prefetch->key && prefetch->idx == image_idx && prefetch->disable_exif == disable_exif
+			 && key && !strcmp( prefetch->key, key ) )
+		{
+			mlt_slices_wait( prefetch->runtime );
+			prefetch->runtime = NULL;
+			item = prefetch->item;
+			prefetch->item = NULL;
+			release_prefetch( prefetch );
+		}
+	}
+	if ( !item && key )
+		item = mlt_cache_shared_get_data( key );
+	if ( item )
+	{
+		qimage = new QImage( *static_cast<QImage*>( mlt_cache_item_data( item, NULL ) ) );
+		mlt_cache_item_close( item );
+	}
+	else
+	{
+		qimage = load_qimage( self, image_idx, disable_exif, width, height );
+		if ( qimage && key )
+			mlt_cache_item_close( cache_qimage( key, new QImage( *qimage ) ) );
+	}
+
+	// Release the images that are no longer ahead
+	for ( int i = 0; i < QIMAGE_PREFETCH_MAX; i++ )
+	{
+		qimage_prefetch *prefetch = &self->prefetch[i];
+		bool ahead = false;
+		for ( int j = 1; prefetch->key && j <= count; j++ )
+			if ( prefetch->idx == ( image_idx + j ) % self->count && prefetch->disable_exif == disable_exif
+				 && prefetch->width == width && prefetch->height == height )
+				ahead = true;
+		if ( prefetch->key && !ahead )
+			release_prefetch( prefetch );
+	}
+
+	// Start decoding the images ahead that are not in the cache
+	for ( int j = 1; j <= count; j++ )
+	{
+		int idx = ( image_idx + j ) % self->count;
+		bool found = false;
+		for ( int i = 0; i < QIMAGE_PREFETCH_MAX && !found; i++ )
+			found = self->prefetch[i].key && self->prefetch[i].idx == idx;
+		for ( int i = 0; i < QIMAGE_PREFETCH_MAX && !found; i++ )
+		{
+			qimage_prefetch *prefetch = &self->prefetch[i];
+			if ( !prefetch->key )
+			{
+				found = true;
+				prefetch->key = qimage_key( self, idx, disable_exif, width, height );
+				if ( !prefetch->key )
+					break;
+				prefetch->self = self;
+				prefetch->idx = idx;
+				prefetch->disable_exif = disable_exif;
+				prefetch->width = width;
+				prefetch->height = height;
+				// Keep the images that are already decoded until they are used
+				prefetch->item = mlt_cache_shared_get_data( prefetch->key );
+				if ( !prefetch->item )
+					prefetch->runtime = mlt_slices_submit_normal( 1, prefetch_proc, prefetch );
+				if ( !prefetch->item && !prefetch->runtime )
+					release_prefetch( prefetch );
+			}
+		}
+	}
+	pthread_mutex_unlock( &self->prefetch_mutex );
+
+	free( key );
+	return qimage;
+}
+
 int refresh_qimage( producer_qimage self, mlt_frame frame )
 {
 	// Obtain properties of frame and producer
@@ -151,6 +393,7 @@ int refresh_qimage( producer_qimage self, mlt_frame frame )
 		self->qimage = NULL;
 		self->current_image = NULL;
 		mlt_properties_set_int( producer_props, "force_reload", 0 );
+		reset_prefetch( self );
 	}
 
 	// Get the time to live for each frame
@@ -173,18 +416,11 @@ int refresh_qimage( producer_qimage self, mlt_frame frame )
 	if ( !self->qimage || mlt_properties_get_int( producer_props, "_disable_exif" ) != disable_exif )
 	{
 		self->current_image = NULL;
-		QImageReader reader;
-		reader.setDecideFormatFromContent( true );
-		reader.setFileName( QString::fromUtf8( mlt_properties_get_value( self->filenames, image_idx ) ) );
-		QImage *qimage = new  QImage( reader.read() );
+		QImage *qimage = get_qimage( self, image_idx, disable_exif );
 		self->qimage = qimage;
 
-		if ( !qimage->isNull( ) )
+		if ( qimage )
 		{
-			// Read the exif value for this file
-			if ( !disable_exif )
-				qimage = reorient_with_exif( self, image_idx, qimage );
-
 			// Register qimage for destruction and reuse
 			mlt_cache_item_close( self->qimage_cache );
 			mlt_service_cache_put( MLT_PRODUCER_SERVICE( producer ), "qimage.qimage", qimage, 0, ( mlt_destructor )qimage_delete );
@@ -195,17 +431,16 @@ int refresh_qimage( producer_qimage self, mlt_frame frame )
 			self->current_width = qimage->width( );
 			self->current_height = qimage->height( );
 
+			// A picture that was decoded smaller still has the size of its file
+			if ( self->decode_width > 0 )
+				get_media_size( self, image_idx, disable_exif, &self->current_width, &self->current_height );
+
 			mlt_events_block( producer_props, NULL );
 			mlt_properties_set_int( producer_props, "meta.media.width", self->current_width );
 			mlt_properties_set_int( producer_props, "meta.media.height", self->current_height );
 			mlt_properties_set_int( producer_props, "_disable_exif", disable_exif );
 			mlt_events_unblock( producer_props, NULL );
 		}
-		else
-		{
-			delete qimage;
-			self->qimage = NULL;
-		}
 	}
 
 	// Set width/height of frame
@@ -220,6 +455,18 @@ void refresh_image( producer_qimage self, mlt_frame frame, mlt_image_format form
 	// Obtain properties of frame and producer
 	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_producer producer = &self->parent;
+	mlt_properties producer_props = MLT_PRODUCER_PROPERTIES( producer );
+
+	// Decode the pictures at the size they are shown, and again if one was decoded too small
+	if ( width != self->decode_width || height != self->decode_height )
+	{
+		QImage *qimage = static_cast<QImage*>( self->qimage );
+		self->decode_width = width;
+		self->decode_height = height;
+		if ( qimage && ( qimage->width() < width || qimage->height() < height )
+			 && qimage->width() < mlt_properties_get_int( producer_props, "meta.media.width" ) )
+			self->qimage = NULL;
+	}
 
 	// Get index and qimage
 	int image_idx = refresh_qimage( self, frame );
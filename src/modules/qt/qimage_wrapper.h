@@ -30,6 +30,23 @@
 extern "C" {
 #endif
 
+// the most images of a sequence that are decoded ahead
+#define QIMAGE_PREFETCH_MAX (16)
+
+typedef struct producer_qimage_s *producer_qimage;
+
+typedef struct
+{
+	producer_qimage self;
+	int idx;
+	int disable_exif;
+	int width;
+	int height;
+	char *key;
+	mlt_slices_runtime runtime;
+	mlt_cache_item item;
+} qimage_prefetch;
+
 struct producer_qimage_s
 {
 	struct mlt_producer_s parent;
@@ -47,15 +64,18 @@ struct producer_qimage_s
 	mlt_cache_item qimage_cache;
 	void *qimage;
 	mlt_image_format format;
+	int decode_width;
+	int decode_height;
+	qimage_prefetch prefetch[ QIMAGE_PREFETCH_MAX ];
+	pthread_mutex_t prefetch_mutex;
 };
 
-typedef struct producer_qimage_s *producer_qimage;
-
 extern int refresh_qimage( producer_qimage self, mlt_frame frame );
 extern void refresh_image( producer_qimage, mlt_frame, mlt_image_format, int width, int height );
 extern void make_tempfile( producer_qimage, const char *xml );
 extern int init_qimage(const char *filename);
 extern int load_sequence_sprintf( producer_qimage self, mlt_properties properties, const char *filename );
+extern void reset_prefetch( producer_qimage self );
 
 
 #ifdef __cplusplus
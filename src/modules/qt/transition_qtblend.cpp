@@ -21,7 +21,6 @@
 #include <framework/mlt.h>
 #include <stdio.h>
 #include <QImage>
-#include <QPainter>
 #include <QTransform>
 
 static int get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
@@ -165,7 +164,7 @@ static int get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *form
 	*format = mlt_image_rgb24a;
 	error = mlt_frame_get_image( b_frame, &b_image, format, &b_width, &b_height, writable );
 
-	// Get bottom frame
+	// Get bottom frame, which is painted in place
 	uint8_t *a_image = NULL;
 	error = mlt_frame_get_image( a_frame, &a_image, format, width, height, 1 );
 	if (error)
@@ -173,12 +172,7 @@ static int get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *form
 		free( interps );
 		return error;
 	}
-	// Prepare output image
-	int image_size = mlt_image_format_size( *format, *width, *height, NULL );
-	*image = (uint8_t *) mlt_pool_alloc( image_size );
-
-	// Copy bottom frame in output
-	memcpy( *image, a_image, image_size );
+	*image = a_image;
 
 	bool hqPainting = false;
 	if ( interps )
@@ -189,29 +183,28 @@ static int get_image( mlt_frame a_frame, uint8_t **image, mlt_image_format *form
 		}
 	}
 
-	// convert bottom mlt image to qimage
-	QImage bottomImg;
-	convert_mlt_to_qimage_rgba( *image, &bottomImg, *width, *height );
-
 	// convert top mlt image to qimage
 	QImage topImg;
 	convert_mlt_to_qimage_rgba( b_image, &topImg, b_width, b_height );
 
-
-	// setup Qt drawing
-	QPainter painter( &bottomImg );
-	painter.setCompositionMode( ( QPainter::CompositionMode ) mlt_properties_get_int( transition_properties, "compositing" ) );
-	painter.setRenderHints( QPainter::Antialiasing | QPainter::SmoothPixmapTransform, hqPainting );
-	painter.setTransform(transform);
-	painter.setOpacity(opacity);
+	// Only paint the part of the top image that is not transparent
+	mlt_rect box;
+	if ( mlt_properties_get_int( transition_properties, "compositing" ) == 0
+		 && mlt_frame_get_alpha_box( b_frame, b_width, b_height, &box ) )
+	{
+		if ( box.w <= 0 || box.h <= 0 )
+		{
+			free( interps );
+			return error;
+		}
+		topImg = topImg.copy( box.x, box.y, box.w, box.h );
+		transform = QTransform::fromTranslate( box.x, box.y ) * transform;
+	}
 
 	// Composite top frame
-	painter.drawImage(0, 0, topImg);
-
-	// finish Qt drawing
-	painter.end();
-	convert_qimage_to_mlt_rgba( &bottomImg, *image, *width, *height );
-	mlt_frame_set_image( a_frame, *image, image_size, mlt_pool_release);
+	paint_image_sliced( *image, *width, *height, topImg, transform,
+		mlt_properties_get_int( transition_properties, "compositing" ), hqPainting, opacity, false,
+		mlt_properties_get_int( transition_properties, "threads" ) );
 	free( interps );
 	return error;
 }
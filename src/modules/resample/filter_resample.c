@@ -26,11 +26,20 @@
 #include <samplerate.h>
 #include <string.h>
 
-// BUFFER_LEN is based on a maximum of 96KHz, 5 fps, 8 channels
-// TODO: dynamically allocate larger buffer size
-#define BUFFER_LEN ((96000/5) * 8 * sizeof(float))
 #define RESAMPLE_TYPE SRC_SINC_FASTEST
 
+/** Get the libsamplerate converter for a quality of fast, medium or best.
+*/
+
+static int get_converter( const char *quality )
+{
+	if ( quality && !strcmp( quality, "fast" ) )
+		return SRC_LINEAR;
+	if ( quality && !strcmp( quality, "best" ) )
+		return SRC_SINC_MEDIUM_QUALITY;
+	return RESAMPLE_TYPE;
+}
+
 /** Get the audio.
 */
 
@@ -63,37 +72,54 @@ static int resample_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		if ( *format != mlt_audio_f32le )
 			frame->convert_audio( frame, buffer, format, mlt_audio_f32le );
 
+		// The quality of the filter overrides the one asked for by the consumer
+		const char *quality = mlt_properties_get( filter_properties, "quality" );
+		if ( !quality )
+			quality = mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "resample.quality" );
+		int converter = get_converter( quality );
+
+		// Allow for the output of the samples buffered from the previous frame
+		int output_frames = ( int64_t )*samples * output_rate / *frequency + 256;
+		int output_size = mlt_audio_format_size( mlt_audio_f32le, output_frames, *channels );
+		float *output_buffer = mlt_pool_alloc( output_size );
+
 		mlt_service_lock( MLT_FILTER_SERVICE(filter) );
 
 		SRC_DATA data;
 		data.data_in = *buffer;
-		data.data_out = mlt_properties_get_data( filter_properties, "output_buffer", NULL );
+		data.data_out = output_buffer;
 		data.src_ratio = ( float ) output_rate / ( float ) *frequency;
 		data.input_frames = *samples;
-		data.output_frames = BUFFER_LEN / sizeof(float) / *channels;
+		data.output_frames = output_frames;
 		data.end_of_input = 0;
 
+		// A change of rate keeps the state, which src_process() moves to smoothly
 		SRC_STATE *state = mlt_properties_get_data( filter_properties, "state", NULL );
-		if ( !state || mlt_properties_get_int( filter_properties, "channels" ) != *channels )
+		if ( !state || mlt_properties_get_int( filter_properties, "channels" ) != *channels
+			 || mlt_properties_get_int( filter_properties, "_converter" ) != converter )
 		{
-			// Recreate the resampler if the number of channels changed
-			state = src_new( RESAMPLE_TYPE, *channels, &error );
+			// Recreate the resampler if the number of channels or the quality changed
+			state = src_new( converter, *channels, &error );
 			mlt_properties_set_data( filter_properties, "state", state, 0, (mlt_destructor) src_delete, NULL );
 			mlt_properties_set_int( filter_properties, "channels", *channels );
+			mlt_properties_set_int( filter_properties, "_converter", converter );
 		}
 
 		// Resample the audio
-		error = src_process( state, &data );
-		if ( !error )
+		if ( state )
+			error = src_process( state, &data );
+		if ( state && !error )
 		{
 			// Update output variables
+			mlt_frame_set_audio( frame, output_buffer, mlt_audio_f32le, output_size, mlt_pool_release );
 			*samples = data.output_frames_gen;
 			*frequency = output_rate;
-			*buffer = data.data_out;
+			*buffer = output_buffer;
 		}
 		else
 		{
 			mlt_log_error( MLT_FILTER_SERVICE( filter ), "%s %d,%d,%d\n", src_strerror( error ), *frequency, *samples, output_rate );
+			mlt_pool_release( output_buffer );
 		}
 		mlt_service_unlock( MLT_FILTER_SERVICE(filter) );
 	}
@@ -127,13 +153,12 @@ mlt_filter filter_resample_init( mlt_profile profile, mlt_service_type type, con
 		SRC_STATE *state = src_new( RESAMPLE_TYPE, 2 /* channels */, &error );
 		if ( error == 0 )
 		{
-			void *output_buffer = mlt_pool_alloc( BUFFER_LEN );
 			this->process = filter_process;
 			if ( arg != NULL )
 				mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "frequency", atoi( arg ) );
 			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "channels", 2 );
+			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "_converter", RESAMPLE_TYPE );
 			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "state", state, 0, (mlt_destructor)src_delete, NULL );
-			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "output_buffer", output_buffer, BUFFER_LEN, mlt_pool_release, NULL );
 		}
 		else
 		{
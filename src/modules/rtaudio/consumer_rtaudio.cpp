@@ -22,6 +22,7 @@
 #include <string.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <time.h>
 #ifdef USE_INTERNAL_RTAUDIO
 #include "RtAudio.h"
 #else
@@ -63,10 +64,12 @@ public:
 	int                   joined;
 	int                   running;
 	int                   out_channels;
-	uint8_t               audio_buffer[4096 * 10];
-	int                   audio_avail;
-	pthread_mutex_t       audio_mutex;
-	pthread_cond_t        audio_cond;
+	mlt_ring              audio_ring;
+	int                   audio_target;
+	int                   audio_period;
+	float                 audio_volume;
+	int                   audio_underruns;
+	int64_t               audio_bytes;
 	pthread_mutex_t       video_mutex;
 	pthread_cond_t        video_cond;
 	int                   playing;
@@ -84,7 +87,12 @@ public:
 		, queue(NULL)
 		, joined(0)
 		, running(0)
-		, audio_avail(0)
+		, audio_ring(NULL)
+		, audio_target(0)
+		, audio_period(0)
+		, audio_volume(1.0)
+		, audio_underruns(0)
+		, audio_bytes(0)
 		, playing(0)
 		, refresh_count(0)
 		, is_purge(false)
@@ -98,8 +106,6 @@ public:
 		mlt_deque_close( queue );
 
 		// Destroy mutexes
-		pthread_mutex_destroy( &audio_mutex );
-		pthread_cond_destroy( &audio_cond );
 		pthread_mutex_destroy( &video_mutex );
 		pthread_cond_destroy( &video_cond );
 		pthread_mutex_destroy( &refresh_mutex );
@@ -109,6 +115,8 @@ public:
 			rt->closeStream();
 		delete rt;
 		rt = NULL;
+
+		mlt_ring_close( audio_ring );
 	}
 
 	bool create_rtaudio( RtAudio::Api api, int channels, int frequency )
@@ -116,6 +124,7 @@ public:
 		mlt_properties properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
 		const char *resource = mlt_properties_get( properties, "resource" );
 		unsigned int bufferFrames = mlt_properties_get_int( properties, "audio_buffer" );
+		int audio_latency = mlt_properties_get_int( properties, "audio_latency" );
 
 		mlt_log_info( getConsumer(), "Attempt to open RtAudio: %s\t%d\t%d\n", rtaudio_api_str( api ), channels, frequency );
 		rt = new RtAudio( api );
@@ -187,6 +196,14 @@ public:
 			}
 			rt->openStream( &parameters, NULL, RTAUDIO_SINT16,
 				frequency, &bufferFrames, &rtaudio_callback, this, &options );
+
+			// Keep the target of samples the device has ahead of it, at least two of its buffers
+			audio_target = MAX( ( int64_t )audio_latency * frequency / 1000, 2 * ( int64_t )bufferFrames );
+			audio_period = MAX( ( int64_t )bufferFrames * 1000000 / frequency / 4, 1000 );
+			mlt_ring_close( audio_ring );
+			audio_ring = mlt_ring_init( audio_target * channels * sizeof( int16_t ) );
+			audio_underruns = 0;
+			audio_bytes = 0;
 			rt->startStream();
 		}
 #ifdef RTERROR_H
@@ -272,8 +289,6 @@ public:
 		mlt_properties_set_double( properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &audio_mutex, NULL );
-		pthread_cond_init( &audio_cond, NULL);
 		pthread_mutex_init( &video_mutex, NULL );
 		pthread_cond_init( &video_cond, NULL);
 
@@ -287,6 +302,9 @@ public:
 		// Default audio buffer
 		mlt_properties_set_int( properties, "audio_buffer", 1024 );
 
+		// Default audio queued ahead of the device in milliseconds
+		mlt_properties_set_int( properties, "audio_latency", 200 );
+
 		// Set the resource to the device name arg
 		mlt_properties_set( properties, "resource", arg );
 
@@ -335,11 +353,6 @@ public:
 			pthread_cond_broadcast( &video_cond );
 			pthread_mutex_unlock( &video_mutex );
 
-			// Unlatch the audio callback
-			pthread_mutex_lock( &audio_mutex );
-			pthread_cond_broadcast( &audio_cond );
-			pthread_mutex_unlock( &audio_mutex );
-
 			if ( rt && rt->isStreamOpen() )
 			try {
 				// Stop the stream
@@ -505,45 +518,32 @@ public:
 
 		while( mlt_deque_count( queue ) )
 			mlt_frame_close( (mlt_frame) mlt_deque_pop_back( queue ) );
-
-		audio_avail = 0;
 	}
 
+	/** Give the device the audio in the ring without waiting for the consumer thread.
+	 *
+	 * What the ring does not have when the consumer is playing is an underrun,
+	 * and the device plays silence instead.
+	 */
+
 	int callback( int16_t *outbuf, int16_t *inbuf,
 		unsigned int samples, double streamTime, RtAudioStreamStatus status )
 	{
-		mlt_properties properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
-		double volume = mlt_properties_get_double( properties, "volume" );
 		int len = mlt_audio_format_size( mlt_audio_s16, samples, out_channels );
+		float volume;
 
-		pthread_mutex_lock( &audio_mutex );
-
-		// Block until audio received
-		while ( running && len > audio_avail )
-			pthread_cond_wait( &audio_cond, &audio_mutex );
-
-		if ( audio_avail >= len )
-		{
-			// Place in the audio buffer
-			memcpy( outbuf, audio_buffer, len );
-
-			// Remove len from the audio available
-			audio_avail -= len;
+		// The consumer thread keeps the volume to not wait on the properties
+		__atomic_load( &audio_volume, &volume, __ATOMIC_RELAXED );
 
-			// Remove the samples
-			memmove( audio_buffer, audio_buffer + len, audio_avail );
-		}
-		else
+		int bytes = mlt_ring_read( audio_ring, outbuf, len );
+		if ( bytes < len )
 		{
-			// Just to be safe, wipe the stream first
-			memset( outbuf, 0, len );
-
-			// Copy what we have
-			memcpy( outbuf, audio_buffer, audio_avail );
-
-			// No audio left
-			audio_avail = 0;
+			// Play silence for what we do not have
+			memset( (uint8_t*) outbuf + bytes, 0, len - bytes );
+			if ( running && audio_bytes )
+				__atomic_add_fetch( &audio_underruns, 1, __ATOMIC_RELAXED );
 		}
+		audio_bytes += bytes;
 
 		if ( volume != 1.0 )
 		{
@@ -556,9 +556,6 @@ public:
 		// We're definitely playing now
 		playing = 1;
 
-		pthread_cond_broadcast( &audio_cond );
-		pthread_mutex_unlock( &audio_mutex );
-
 		return 0;
 	}
 
@@ -579,6 +576,9 @@ public:
 		mlt_frame_get_audio( frame, (void**) &pcm, &afmt, &frequency, &channels, &samples );
 		*duration = ( ( samples * 1000 ) / frequency );
 
+		float volume = mlt_properties_get_double( properties, "volume" );
+		__atomic_store( &audio_volume, &volume, __ATOMIC_RELAXED );
+
 		if ( mlt_properties_get_int( properties, "audio_off" ) )
 		{
 			playing = 1;
@@ -603,59 +603,59 @@ public:
 		if ( init_audio == 0 )
 		{
 			mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-			int samples_copied = 0;
 			int dst_stride = out_channels * sizeof( *pcm );
+			int silent = !scrub && mlt_properties_get_double( properties, "_speed" ) != 1;
 
-			pthread_mutex_lock( &audio_mutex );
-
-			while ( running && samples_copied < samples )
+			while ( running && samples > 0 )
 			{
-				int sample_space = ( sizeof( audio_buffer ) - audio_avail ) / dst_stride;
+				int samples_to_copy = audio_target - mlt_ring_count( audio_ring ) / dst_stride;
 
-				while ( running && sample_space == 0 )
+				// Wait for the device to take some of the queue
+				if ( samples_to_copy <= 0 )
 				{
-					pthread_cond_wait( &audio_cond, &audio_mutex );
-					sample_space = ( sizeof( audio_buffer ) - audio_avail ) / dst_stride;
+					struct timespec tm = { 0, audio_period * 1000 };
+
+					nanosleep( &tm, NULL );
+					continue;
 				}
-				if ( running )
-				{
-					int samples_to_copy = samples - samples_copied;
-					if ( samples_to_copy > sample_space )
-					{
-						samples_to_copy = sample_space;
-					}
-					int dst_bytes = samples_to_copy * dst_stride;
+				if ( samples_to_copy > samples )
+					samples_to_copy = samples;
 
-					if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-					{
-						if ( channels == out_channels )
-						{
-							memcpy( &audio_buffer[ audio_avail ], pcm, dst_bytes );
-							pcm += samples_to_copy * channels;
-						}
-						else
-						{
-							int16_t *dest = (int16_t*) &audio_buffer[ audio_avail ];
-							int i = samples_to_copy + 1;
-							while ( --i )
-							{
-								memcpy( dest, pcm, dst_stride );
-								pcm += channels;
-								dest += out_channels;
-							}
-						}
-					}
-					else
+				if ( silent )
+				{
+					mlt_ring_write( audio_ring, NULL, samples_to_copy * dst_stride );
+				}
+				else if ( channels == out_channels )
+				{
+					mlt_ring_write( audio_ring, pcm, samples_to_copy * dst_stride );
+				}
+				else
+				{
+					// Drop the channels the device does not have through a small buffer
+					int16_t chunk[ 2048 ];
+					int i = 0;
+					while ( i < samples_to_copy )
 					{
-						memset( &audio_buffer[ audio_avail ], 0, dst_bytes );
-						pcm += samples_to_copy * channels;
+						int n = MIN( samples_to_copy - i, (int) sizeof( chunk ) / dst_stride );
+						int16_t *dest = chunk;
+						for ( int j = 0; j < n; j++, dest += out_channels )
+							memcpy( dest, pcm + ( i + j ) * channels, dst_stride );
+						mlt_ring_write( audio_ring, chunk, n * dst_stride );
+						i += n;
 					}
-					audio_avail += dst_bytes;
-					samples_copied += samples_to_copy;
 				}
-				pthread_cond_broadcast( &audio_cond );
+				pcm += samples_to_copy * channels;
+				samples -= samples_to_copy;
+			}
+
+			int underruns = __atomic_load_n( &audio_underruns, __ATOMIC_RELAXED );
+			mlt_properties consumer_properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
+			if ( underruns != mlt_properties_get_int( consumer_properties, "audio_underruns" ) )
+			{
+				mlt_events_block( consumer_properties, consumer_properties );
+				mlt_properties_set_int( consumer_properties, "audio_underruns", underruns );
+				mlt_events_unblock( consumer_properties, consumer_properties );
 			}
-			pthread_mutex_unlock( &audio_mutex );
 		}
 
 		return init_audio;
@@ -24,12 +24,14 @@
 #include <framework/mlt_factory.h>
 #include <framework/mlt_filter.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_ring.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <SDL.h>
 #include <sys/time.h>
+#include <time.h>
 
 extern pthread_mutex_t mlt_sdl_mutex;
 
@@ -46,10 +48,12 @@ struct consumer_sdl_s
 	pthread_t thread;
 	int joined;
 	int running;
-	uint8_t audio_buffer[ 4096 * 10 ];
-	int audio_avail;
-	pthread_mutex_t audio_mutex;
-	pthread_cond_t audio_cond;
+	mlt_ring audio_ring;
+	int audio_target;
+	int audio_period;
+	float audio_volume;
+	int audio_underruns;
+	int64_t audio_bytes;
 	pthread_mutex_t video_mutex;
 	pthread_cond_t video_cond;
 	int playing;
@@ -100,8 +104,6 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 		mlt_properties_set_double( self->properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &self->audio_mutex, NULL );
-		pthread_cond_init( &self->audio_cond, NULL);
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_cond_init( &self->video_cond, NULL);
 
@@ -115,6 +117,9 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 
 		// Default audio buffer
 		mlt_properties_set_int( self->properties, "audio_buffer", 2048 );
+
+		// Default audio queued ahead of the device in milliseconds
+		mlt_properties_set_int( self->properties, "audio_latency", 200 );
 #if defined(_WIN32) && SDL_MAJOR_VERSION == 2
 		mlt_properties_set( self->properties, "audio_driver", "DirectSound" );
 #endif
@@ -219,10 +224,6 @@ int consumer_stop( mlt_consumer parent )
 		pthread_cond_broadcast( &self->video_cond );
 		pthread_mutex_unlock( &self->video_mutex );
 
-		// Unlatch the audio callback
-		pthread_mutex_lock( &self->audio_mutex );
-		pthread_cond_broadcast( &self->audio_cond );
-		pthread_mutex_unlock( &self->audio_mutex );
 
 		SDL_QuitSubSystem( SDL_INIT_AUDIO );
 	}
@@ -255,47 +256,46 @@ void consumer_purge( mlt_consumer parent )
 	}
 }
 
+/** Give the device the audio in the ring without waiting for the consumer thread.
+ *
+ * What the ring does not have when the consumer is playing is an underrun,
+ * and the device plays silence instead.
+ */
+
 static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
 {
 	consumer_sdl self = udata;
+	float volume;
+	int bytes = 0;
 
-	// Get the volume
-	double volume = mlt_properties_get_double( self->properties, "volume" );
+	// The consumer thread keeps the volume to not wait on the properties
+	__atomic_load( &self->audio_volume, &volume, __ATOMIC_RELAXED );
 
 	// Wipe the stream first
 	memset( stream, 0, len );
 
-	pthread_mutex_lock( &self->audio_mutex );
-
-	if ( self->audio_avail >= len )
+	if ( volume == 1.0 )
 	{
-		// Place in the audio buffer
-		if ( volume != 1.0 )
-			SDL_MixAudio( stream, self->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-		else
-			memcpy( stream, self->audio_buffer, len );
-
-		// Remove len from the audio available
-		self->audio_avail -= len;
-
-		// Remove the samples
-		memmove( self->audio_buffer, self->audio_buffer + len, self->audio_avail );
+		bytes = mlt_ring_read( self->audio_ring, stream, len );
 	}
 	else
 	{
-		// Mix the audio
-		SDL_MixAudio( stream, self->audio_buffer, self->audio_avail,
-			( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-
-		// No audio left
-		self->audio_avail = 0;
+		// Mix the audio at the volume through a small buffer
+		uint8_t chunk[ 4096 ];
+		int n;
+		while ( bytes < len && ( n = mlt_ring_read( self->audio_ring, chunk, MIN( len - bytes, (int) sizeof( chunk ) ) ) ) > 0 )
+		{
+			SDL_MixAudio( stream + bytes, chunk, n, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
+			bytes += n;
+		}
 	}
 
+	if ( bytes < len && self->running && self->audio_bytes )
+		__atomic_add_fetch( &self->audio_underruns, 1, __ATOMIC_RELAXED );
+	self->audio_bytes += bytes;
+
 	// We're definitely playing now
 	self->playing = 1;
-
-	pthread_cond_broadcast( &self->audio_cond );
-	pthread_mutex_unlock( &self->audio_mutex );
 }
 
 static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_audio, int *duration )
@@ -317,6 +317,9 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	*duration = ( ( samples * 1000 ) / frequency );
 	pcm += mlt_properties_get_int( properties, "audio_offset" );
 
+	float volume = mlt_properties_get_double( properties, "volume" );
+	__atomic_store( &self->audio_volume, &volume, __ATOMIC_RELAXED );
+
 	if ( mlt_properties_get_int( properties, "audio_off" ) )
 	{
 		self->playing = 1;
@@ -330,6 +333,10 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		SDL_AudioSpec got;
 
 		int audio_buffer = mlt_properties_get_int( properties, "audio_buffer" );
+		int audio_latency = mlt_properties_get_int( properties, "audio_latency" );
+
+		// Only one device reads the ring
+		SDL_CloseAudio( );
 
 		// specify audio format
 		memset( &request, 0, sizeof( SDL_AudioSpec ) );
@@ -347,6 +354,14 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		}
 		else if ( got.size != 0 )
 		{
+
+			// Keep the target of samples the device has ahead of it, at least two of its buffers
+			self->audio_target = MAX( ( int64_t )audio_latency * got.freq / 1000, 2 * got.samples );
+			self->audio_period = MAX( ( int64_t )got.samples * 1000000 / got.freq / 4, 1000 );
+			mlt_ring_close( self->audio_ring );
+			self->audio_ring = mlt_ring_init( self->audio_target * got.channels * sizeof( int16_t ) );
+			self->audio_underruns = 0;
+			self->audio_bytes = 0;
 			SDL_PauseAudio( 0 );
 			init_audio = 0;
 		}
@@ -355,58 +370,60 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	if ( init_audio == 0 )
 	{
 		mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-		int samples_copied = 0;
 		int dst_stride = dest_channels * sizeof( *pcm );
+		int silent = !scrub && mlt_properties_get_double( properties, "_speed" ) != 1;
+		int underruns;
 
-		pthread_mutex_lock( &self->audio_mutex );
-
-		while ( self->running && samples_copied < samples )
+		while ( self->running && samples > 0 )
 		{
-			int sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
-			while ( self->running && sample_space == 0 )
+			int samples_to_copy = self->audio_target - mlt_ring_count( self->audio_ring ) / dst_stride;
+
+			// Wait for the device to take some of the queue
+			if ( samples_to_copy <= 0 )
+			{
+				struct timespec tm = { 0, self->audio_period * 1000 };
+
+				nanosleep( &tm, NULL );
+				continue;
+			}
+			if ( samples_to_copy > samples )
+				samples_to_copy = samples;
+
+			if ( silent )
 			{
-				pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
-				sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
+				mlt_ring_write( self->audio_ring, NULL, samples_to_copy * dst_stride );
 			}
-			if ( self->running )
+			else if ( channels == dest_channels )
 			{
-				int samples_to_copy = samples - samples_copied;
-				if ( samples_to_copy > sample_space )
-				{
-					samples_to_copy = sample_space;
-				}
-				int dst_bytes = samples_to_copy * dst_stride;
-
-				if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-				{
-					if ( channels == dest_channels )
-					{
-						memcpy( &self->audio_buffer[ self->audio_avail ], pcm, dst_bytes );
-						pcm += samples_to_copy * channels;
-					}
-					else
-					{
-						int16_t *dest = (int16_t*) &self->audio_buffer[ self->audio_avail ];
-						int i = samples_to_copy + 1;
-						while ( --i )
-						{
-							memcpy( dest, pcm, dst_stride );
-							pcm += channels;
-							dest += dest_channels;
-						}
-					}
-				}
-				else
+				mlt_ring_write( self->audio_ring, pcm, samples_to_copy * dst_stride );
+			}
+			else
+			{
+				// Drop the channels the device does not have through a small buffer
+				int16_t chunk[ 2048 ];
+				int i = 0;
+				while ( i < samples_to_copy )
 				{
-					memset( &self->audio_buffer[ self->audio_avail ], 0, dst_bytes );
-					pcm += samples_to_copy * channels;
+					int n = MIN( samples_to_copy - i, (int) sizeof( chunk ) / dst_stride );
+					int16_t *dest = chunk;
+					int j;
+					for ( j = 0; j < n; j++, dest += dest_channels )
+						memcpy( dest, pcm + ( i + j ) * channels, dst_stride );
+					mlt_ring_write( self->audio_ring, chunk, n * dst_stride );
+					i += n;
 				}
-				self->audio_avail += dst_bytes;
-				samples_copied += samples_to_copy;
 			}
-			pthread_cond_broadcast( &self->audio_cond );
+			pcm += samples_to_copy * channels;
+			samples -= samples_to_copy;
+		}
+
+		underruns = __atomic_load_n( &self->audio_underruns, __ATOMIC_RELAXED );
+		if ( underruns != mlt_properties_get_int( self->properties, "audio_underruns" ) )
+		{
+			mlt_events_block( self->properties, self->properties );
+			mlt_properties_set_int( self->properties, "audio_underruns", underruns );
+			mlt_events_unblock( self->properties, self->properties );
 		}
-		pthread_mutex_unlock( &self->audio_mutex );
 	}
 	else
 	{
@@ -666,8 +683,6 @@ static void *consumer_thread( void *arg )
 		frame = NULL;
 	}
 
-	self->audio_avail = 0;
-
 	return NULL;
 }
 
@@ -688,9 +703,9 @@ static void consumer_close( mlt_consumer parent )
 	// Close the queue
 	mlt_deque_close( self->queue );
 
+	mlt_ring_close( self->audio_ring );
+
 	// Destroy mutexes
-	pthread_mutex_destroy( &self->audio_mutex );
-	pthread_cond_destroy( &self->audio_cond );
 	pthread_mutex_destroy( &self->video_mutex );
 	pthread_cond_destroy( &self->video_cond );
 	pthread_mutex_destroy( &self->refresh_mutex );
@@ -25,6 +25,7 @@
 #include <framework/mlt_factory.h>
 #include <framework/mlt_filter.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_ring.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,10 +50,13 @@ struct consumer_sdl_s
 	pthread_t thread;
 	int joined;
 	int running;
-	uint8_t audio_buffer[ 4096 * 10 ];
-	int audio_avail;
+	mlt_ring audio_ring;
+	int audio_target;
+	int audio_period;
+	int audio_volume;
+	int audio_underruns;
+	SDL_AudioDeviceID audio_device;
 	pthread_mutex_t audio_mutex;
-	pthread_cond_t audio_cond;
 	pthread_mutex_t video_mutex;
 	pthread_cond_t video_cond;
 	int window_width;
@@ -69,6 +73,11 @@ struct consumer_sdl_s
 	SDL_Rect sdl_rect;
 	uint8_t *buffer;
 	int is_purge;
+	int64_t audio_bytes;
+	int64_t audio_time;
+	int audio_rate;
+	int device_latency;
+	int refresh_period;
 #ifdef _WIN32
 	int no_quit_subsystem;
 #endif
@@ -116,7 +125,6 @@ mlt_consumer consumer_sdl2_init( mlt_profile profile, mlt_service_type type, con
 
 		// This is the initialisation of the consumer
 		pthread_mutex_init( &self->audio_mutex, NULL );
-		pthread_cond_init( &self->audio_cond, NULL);
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_cond_init( &self->video_cond, NULL);
 		
@@ -131,6 +139,9 @@ mlt_consumer consumer_sdl2_init( mlt_profile profile, mlt_service_type type, con
 		// Default audio buffer
 		mlt_properties_set_int( self->properties, "audio_buffer", 2048 );
 
+		// Default audio queued ahead of the device in milliseconds
+		mlt_properties_set_int( self->properties, "audio_latency", 200 );
+
 		// Default scrub audio
 		mlt_properties_set_int( self->properties, "scrub_audio", 1 );
 
@@ -253,13 +264,6 @@ int consumer_stop( mlt_consumer parent )
 		self->joined = 1;
 		self->running = 0;
 
-		if ( !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( parent ), "audio_off" ) )
-		{
-			pthread_mutex_lock( &self->audio_mutex );
-			pthread_cond_broadcast( &self->audio_cond );
-			pthread_mutex_unlock( &self->audio_mutex );
-		}
-
 #ifndef _WIN32
 		if ( self->thread )
 #endif
@@ -281,6 +285,7 @@ int consumer_stop( mlt_consumer parent )
 #endif
 		if ( !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( parent ), "audio_off" ) )
 			SDL_QuitSubSystem( SDL_INIT_AUDIO );
+		self->audio_device = 0;
 		if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( parent ), "sdl_started" ) == 0 )
 			SDL_Quit( );
 		pthread_mutex_unlock( &mlt_sdl_mutex );
@@ -309,50 +314,73 @@ void consumer_purge( mlt_consumer parent )
 	}
 }
 
-static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
+static int64_t time_now( )
 {
-	consumer_sdl self = udata;
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	return ( int64_t )now.tv_sec * 1000000 + now.tv_usec;
+}
 
-	// Get the volume
-	double volume = mlt_properties_get_double( self->properties, "volume" );
+/** Get the playout time in microseconds of the audio being heard, or -1 without audio.
+*/
 
-	// Wipe the stream first
-	memset( stream, 0, len );
+static int64_t audio_clock( consumer_sdl self )
+{
+	int64_t clock = -1;
+	int64_t audio_time = __atomic_load_n( &self->audio_time, __ATOMIC_ACQUIRE );
 
 	pthread_mutex_lock( &self->audio_mutex );
+	if ( self->audio_rate && audio_time )
+	{
+		int64_t played = __atomic_load_n( &self->audio_bytes, __ATOMIC_RELAXED ) * 1000000 / self->audio_rate;
+
+		// The last buffer given to the device is still to be heard
+		clock = played - self->device_latency + ( time_now( ) - audio_time );
+		clock = CLAMP( clock, 0, played );
+	}
+	pthread_mutex_unlock( &self->audio_mutex );
 
-	// Block until audio received
-	while ( self->running && len > self->audio_avail )
-		pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
+	return clock;
+}
 
-	if ( self->audio_avail >= len )
-	{
-		// Place in the audio buffer
-		if ( volume != 1.0 )
-			SDL_MixAudio( stream, self->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-		else
-			memcpy( stream, self->audio_buffer, len );
+/** Give the device the audio in the ring without waiting for the consumer thread.
+ *
+ * What the ring does not have when the consumer is playing is an underrun,
+ * and the device plays silence instead.
+ */
 
-		// Remove len from the audio available
-		self->audio_avail -= len;
+static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
+{
+	consumer_sdl self = udata;
+	int volume = __atomic_load_n( &self->audio_volume, __ATOMIC_RELAXED );
+	int bytes = 0;
 
-		// Remove the samples
-		memmove( self->audio_buffer, self->audio_buffer + len, self->audio_avail );
+	// Wipe the stream first
+	memset( stream, 0, len );
+
+	if ( volume == SDL_MIX_MAXVOLUME )
+	{
+		bytes = mlt_ring_read( self->audio_ring, stream, len );
 	}
 	else
 	{
-		// Mix the audio 
-		SDL_MixAudio( stream, self->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-
-		// No audio left
-		self->audio_avail = 0;
+		// Mix the audio at the volume through a small buffer
+		uint8_t chunk[ 4096 ];
+		int n;
+		while ( bytes < len && ( n = mlt_ring_read( self->audio_ring, chunk, MIN( len - bytes, (int) sizeof( chunk ) ) ) ) > 0 )
+		{
+			SDL_MixAudio( stream + bytes, chunk, n, volume );
+			bytes += n;
+		}
 	}
 
+	if ( bytes < len && self->running && self->audio_bytes )
+		__atomic_add_fetch( &self->audio_underruns, 1, __ATOMIC_RELAXED );
+	__atomic_store_n( &self->audio_bytes, self->audio_bytes + bytes, __ATOMIC_RELAXED );
+	__atomic_store_n( &self->audio_time, time_now( ), __ATOMIC_RELEASE );
+
 	// We're definitely playing now
 	self->playing = 1;
-
-	pthread_cond_broadcast( &self->audio_cond );
-	pthread_mutex_unlock( &self->audio_mutex );
 }
 
 static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_audio, int *duration )
@@ -370,11 +398,17 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	int samples = mlt_sample_calculator( mlt_properties_get_double( self->properties, "fps" ), frequency, counter++ );
 	int16_t *pcm;
 	mlt_frame_get_audio( frame, (void**) &pcm, &afmt, &frequency, &channels, &samples );
-	*duration = ( ( samples * 1000 ) / frequency );
+	*duration = ( ( int64_t )samples * 1000000 ) / frequency;
 	pcm += mlt_properties_get_int( properties, "audio_offset" );
 
+	// The callback does not look up the volume to not wait on the properties
+	__atomic_store_n( &self->audio_volume, ( int )( ( float )SDL_MIX_MAXVOLUME * mlt_properties_get_double( properties, "volume" ) ), __ATOMIC_RELAXED );
+
 	if ( mlt_properties_get_int( properties, "audio_off" ) )
 	{
+		pthread_mutex_lock( &self->audio_mutex );
+		self->audio_rate = 0;
+		pthread_mutex_unlock( &self->audio_mutex );
 		self->playing = 1;
 		init_audio = 1;
 		return init_audio;
@@ -386,6 +420,12 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		SDL_AudioSpec got;
 		SDL_AudioDeviceID dev;
 		int audio_buffer = mlt_properties_get_int( properties, "audio_buffer" );
+		int audio_latency = mlt_properties_get_int( properties, "audio_latency" );
+
+		// Only one device reads the ring
+		if ( self->audio_device )
+			SDL_CloseAudioDevice( self->audio_device );
+		self->audio_device = 0;
 
 		// specify audio format
 		memset( &request, 0, sizeof( SDL_AudioSpec ) );
@@ -401,15 +441,30 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		if( dev == 0 )
 		{
 			mlt_log_error( MLT_CONSUMER_SERVICE( self ), "SDL failed to open audio\n" );
+			self->audio_rate = 0;
 			init_audio = 2;
 		}
 		else
 		{
+			// Keep the target of samples the device has ahead of it, at least two of its buffers
+			self->audio_target = MAX( ( int64_t )audio_latency * got.freq / 1000, 2 * got.samples );
+			self->audio_period = MAX( ( int64_t )got.samples * 1000000 / got.freq / 4, 1000 );
+			mlt_ring_close( self->audio_ring );
+			self->audio_ring = mlt_ring_init( self->audio_target * got.channels * sizeof( int16_t ) );
+			self->audio_underruns = 0;
+			self->audio_device = dev;
+
 			if( got.channels != request.channels )
 			{
 				mlt_log_info( MLT_CONSUMER_SERVICE( self ), "Unable to output %d channels. Change to %d\n", request.channels, got.channels );
 			}
 			mlt_log_info( MLT_CONSUMER_SERVICE( self ), "Audio Opened: driver=%s channels=%d frequency=%d\n", SDL_GetCurrentAudioDriver(), got.channels, got.freq );
+
+			// Restart the audio clock, which paces the video
+			self->audio_bytes = 0;
+			self->audio_time = 0;
+			self->audio_rate = got.freq * got.channels * sizeof( int16_t );
+			self->device_latency = ( int64_t )got.samples * 1000000 / got.freq;
 			SDL_PauseAudioDevice( dev, 0 );
 			init_audio = 0;
 			self->out_channels = got.channels;
@@ -419,74 +474,71 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	if ( init_audio == 0 )
 	{
 		mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-		int samples_copied = 0;
 		int dst_stride = self->out_channels * sizeof( *pcm );
+		int silent = !scrub && mlt_properties_get_double( properties, "_speed" ) != 1;
+		int64_t waited = 0;
+		int underruns;
 
-		pthread_mutex_lock( &self->audio_mutex );
-
-		while ( self->running && samples_copied < samples )
+		while ( self->running && samples > 0 )
 		{
-			int sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
-			while ( self->running && sample_space == 0 )
-			{
-				struct timeval now;
-				struct timespec tm;
+			int samples_to_copy = self->audio_target - mlt_ring_count( self->audio_ring ) / dst_stride;
 
-				gettimeofday( &now, NULL );
-				tm.tv_sec = now.tv_sec + 1;
-				tm.tv_nsec = now.tv_usec * 1000;
-				pthread_cond_timedwait( &self->audio_cond, &self->audio_mutex, &tm );
-				sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
+			// Wait for the device to take some of the queue
+			if ( samples_to_copy <= 0 )
+			{
+				struct timespec tm = { 0, self->audio_period * 1000 };
 
-				if ( sample_space == 0 )
+				if ( waited >= 1000000 )
 				{
 					mlt_log_warning( MLT_CONSUMER_SERVICE(&self->parent), "audio timed out\n" );
-					pthread_mutex_unlock( &self->audio_mutex );
 #ifdef _WIN32
 					self->no_quit_subsystem = 1;
 #endif
 					return 1;
 				}
+				nanosleep( &tm, NULL );
+				waited += self->audio_period;
+				continue;
 			}
-			if ( self->running )
-			{
-				int samples_to_copy = samples - samples_copied;
-				if ( samples_to_copy > sample_space )
-				{
-					samples_to_copy = sample_space;
-				}
-				int dst_bytes = samples_to_copy * dst_stride;
+			waited = 0;
+			if ( samples_to_copy > samples )
+				samples_to_copy = samples;
 
-				if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-				{
-					if ( channels == self->out_channels )
-					{
-						memcpy( &self->audio_buffer[ self->audio_avail ], pcm, dst_bytes );
-						pcm += samples_to_copy * channels;
-					}
-					else
-					{
-						int16_t *dest = (int16_t*) &self->audio_buffer[ self->audio_avail ];
-						int i = samples_to_copy + 1;
-						while ( --i )
-						{
-							memcpy( dest, pcm, dst_stride );
-							pcm += channels;
-							dest += self->out_channels;
-						}
-					}
-				}
-				else
+			if ( silent )
+			{
+				mlt_ring_write( self->audio_ring, NULL, samples_to_copy * dst_stride );
+			}
+			else if ( channels == self->out_channels )
+			{
+				mlt_ring_write( self->audio_ring, pcm, samples_to_copy * dst_stride );
+			}
+			else
+			{
+				// Drop the channels the device does not have through a small buffer
+				int16_t chunk[ 2048 ];
+				int i = 0;
+				while ( i < samples_to_copy )
 				{
-					memset( &self->audio_buffer[ self->audio_avail ], 0, dst_bytes );
-					pcm += samples_to_copy * channels;
+					int n = MIN( samples_to_copy - i, (int) sizeof( chunk ) / dst_stride );
+					int16_t *dest = chunk;
+					int j;
+					for ( j = 0; j < n; j++, dest += self->out_channels )
+						memcpy( dest, pcm + ( i + j ) * channels, dst_stride );
+					mlt_ring_write( self->audio_ring, chunk, n * dst_stride );
+					i += n;
 				}
-				self->audio_avail += dst_bytes;
-				samples_copied += samples_to_copy;
 			}
-			pthread_cond_broadcast( &self->audio_cond );
+			pcm += samples_to_copy * channels;
+			samples -= samples_to_copy;
+		}
+
+		underruns = __atomic_load_n( &self->audio_underruns, __ATOMIC_RELAXED );
+		if ( underruns != mlt_properties_get_int( self->properties, "audio_underruns" ) )
+		{
+			mlt_events_block( self->properties, self->properties );
+			mlt_properties_set_int( self->properties, "audio_underruns", underruns );
+			mlt_events_unblock( self->properties, self->properties );
 		}
-		pthread_mutex_unlock( &self->audio_mutex );
 	}
 	else
 	{
@@ -554,7 +606,17 @@ static int setup_sdl_video( consumer_sdl self )
 	pthread_mutex_lock( &mlt_sdl_mutex );
 	self->sdl_window = SDL_CreateWindow("MLT", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
 		self->window_width, self->window_height, sdl_flags);
-	self->sdl_renderer = SDL_CreateRenderer(self->sdl_window, -1, SDL_RENDERER_ACCELERATED);
+	int vsync = mlt_properties_get_int( self->properties, "vsync" );
+	self->sdl_renderer = SDL_CreateRenderer(self->sdl_window, -1, SDL_RENDERER_ACCELERATED |
+		( vsync ? SDL_RENDERER_PRESENTVSYNC : 0 ) );
+	self->refresh_period = 0;
+	if ( vsync )
+	{
+		// Present a frame half a refresh early to show it at the nearest one
+		SDL_DisplayMode mode;
+		if ( !SDL_GetWindowDisplayMode( self->sdl_window, &mode ) && mode.refresh_rate > 0 )
+			self->refresh_period = 1000000 / mode.refresh_rate;
+	}
 	if ( self->sdl_renderer )
 	{
 		// Get texture width and height from the profile.
@@ -577,6 +639,42 @@ static int setup_sdl_video( consumer_sdl self )
 	return error;
 }
 
+/** Copy the planes of an image into the memory of a locked streaming texture.
+*/
+
+static int copy_to_texture( SDL_Texture *texture, unsigned char *planes[4], int strides[4], int height )
+{
+	void *pixels = NULL;
+	int pitch = 0;
+	int texture_height = 0;
+	int i;
+
+	if ( SDL_QueryTexture( texture, NULL, NULL, NULL, &texture_height ) ||
+		SDL_LockTexture( texture, NULL, &pixels, &pitch ) )
+		return 1;
+
+	for ( i = 0; i < 3 && ( i == 0 || strides[i] ); i++ )
+	{
+		// The chroma planes of a planar texture follow the luma at half the pitch and height
+		int dst_pitch = i ? pitch / 2 : pitch;
+		int dst_height = i ? texture_height / 2 : texture_height;
+		int rows = MIN( i ? height / 2 : height, dst_height );
+		int bytes = MIN( strides[i], dst_pitch );
+		uint8_t *dst = pixels;
+		int y;
+
+		if ( i )
+			dst += pitch * texture_height + ( i - 1 ) * dst_pitch * dst_height;
+		if ( bytes == strides[i] && bytes == dst_pitch )
+			memcpy( dst, planes[i], bytes * rows );
+		else for ( y = 0; y < rows; y++ )
+			memcpy( dst + y * dst_pitch, planes[i] + y * strides[i], bytes );
+	}
+	SDL_UnlockTexture( texture );
+
+	return 0;
+}
+
 static int consumer_play_video( consumer_sdl self, mlt_frame frame )
 {
 	// Get the properties of this consumer
@@ -670,7 +768,9 @@ static int consumer_play_video( consumer_sdl self, mlt_frame frame )
 			// We use height-1 because mlt_image_format_size() uses height + 1.
 			// XXX Remove -1 when mlt_image_format_size() is changed.
 			mlt_image_format_planes( vfmt, width, height - 1, image, planes, strides );
-			if ( strides[1] ) {
+			if ( !copy_to_texture( self->sdl_texture, planes, strides, height ) ) {
+				// the image was written in place
+			} else if ( strides[1] ) {
 				SDL_UpdateYUVTexture( self->sdl_texture, NULL,
 					planes[0], strides[0],
 					planes[1], strides[1],
@@ -707,6 +807,7 @@ static void *video_thread( void *arg )
 	struct timeval now;
 	int64_t start = 0;
 	int64_t elapsed = 0;
+	int64_t clock = -1;
 	struct timespec tm;
 	mlt_frame next = NULL;
 	mlt_properties properties = NULL;
@@ -742,20 +843,29 @@ static void *video_thread( void *arg )
 		// Get the current time
 		gettimeofday( &now, NULL );
 
-		// Get the elapsed time
-		elapsed = ( ( int64_t )now.tv_sec * 1000000 + now.tv_usec ) - start;
+		// Get the elapsed time, from the audio heard when there is audio
+		clock = audio_clock( self );
+		elapsed = clock >= 0 ? clock : ( ( int64_t )now.tv_sec * 1000000 + now.tv_usec ) - start;
 
 		// See if we have to delay the display of the current frame
 		if ( mlt_properties_get_int( properties, "rendered" ) == 1 && self->running )
 		{
 			// Obtain the scheduled playout time
-			int64_t scheduled = mlt_properties_get_int( properties, "playtime" );
+			int64_t scheduled = mlt_properties_get_int64( properties, "playtime" );
 
 			// Determine the difference between the elapsed time and the scheduled playout time
 			int64_t difference = scheduled - elapsed;
 
+			if ( clock >= 0 && real_time && speed == 1.0 && difference > self->refresh_period / 2 + 1000 )
+			{
+				// Wait for the audio of this frame
+				int64_t delay = difference - self->refresh_period / 2;
+				tm.tv_sec = delay / 1000000;
+				tm.tv_nsec = ( delay % 1000000 ) * 1000;
+				nanosleep( &tm, NULL );
+			}
 			// Smooth playback a bit
-			if ( real_time && ( difference > 20000 && speed == 1.0 ) )
+			else if ( clock < 0 && real_time && ( difference > 20000 && speed == 1.0 ) )
 			{
 				tm.tv_sec = difference / 1000000;
 				tm.tv_nsec = ( difference % 1000000 ) * 500;
@@ -764,10 +874,16 @@ static void *video_thread( void *arg )
 
 			// Show current frame if not too old
 			if ( !real_time || ( difference > -10000 || speed != 1.0 || mlt_deque_count( self->queue ) < 2 ) )
+			{
 				consumer_play_video( self, next );
 
+				// Report how far the video is behind the audio as presented
+				if ( clock >= 0 && ( clock = audio_clock( self ) ) >= 0 )
+					mlt_properties_set_double( self->properties, "av_offset", ( clock - scheduled ) / 1000.0 );
+			}
+
 			// If the queue is empty, recalculate start to allow build up again
-			if ( real_time && ( mlt_deque_count( self->queue ) == 0 && speed == 1.0 ) )
+			if ( clock < 0 && real_time && ( mlt_deque_count( self->queue ) == 0 && speed == 1.0 ) )
 			{
 				gettimeofday( &now, NULL );
 				start = ( ( int64_t )now.tv_sec * 1000000 + now.tv_usec ) - scheduled + 20000;
@@ -842,7 +958,7 @@ static void *consumer_thread( void *arg )
 			}
 
 			// Set playtime for this frame
-			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "playtime", playtime );
+			mlt_properties_set_int64( MLT_FRAME_PROPERTIES( frame ), "playtime", playtime );
 
 			while ( self->running && mlt_deque_count( self->queue ) > 15 )
 				nanosleep( &tm, NULL );
@@ -863,7 +979,7 @@ static void *consumer_thread( void *arg )
 			pthread_mutex_unlock( &self->video_mutex );
 
 			// Calculate the next playtime
-			playtime += ( duration * 1000 );
+			playtime += duration;
 		}
 		else if ( terminated )
 		{
@@ -898,8 +1014,6 @@ static void *consumer_thread( void *arg )
 	while( mlt_deque_count( self->queue ) )
 		mlt_frame_close( mlt_deque_pop_back( self->queue ) );
 
-	self->audio_avail = 0;
-
 	return NULL;
 }
 
@@ -919,7 +1033,7 @@ static void consumer_close( mlt_consumer parent )
 
 	// Destroy mutexes
 	pthread_mutex_destroy( &self->audio_mutex );
-	pthread_cond_destroy( &self->audio_cond );
+	mlt_ring_close( self->audio_ring );
 		
 	// Finally clean up this
 	free( self );
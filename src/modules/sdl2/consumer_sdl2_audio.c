@@ -25,12 +25,14 @@
 #include <framework/mlt_factory.h>
 #include <framework/mlt_filter.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_ring.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <SDL.h>
 #include <sys/time.h>
+#include <time.h>
 
 extern pthread_mutex_t mlt_sdl_mutex;
 
@@ -47,10 +49,13 @@ struct consumer_sdl_s
 	pthread_t thread;
 	int joined;
 	int running;
-	uint8_t audio_buffer[ 4096 * 10 ];
-	int audio_avail;
-	pthread_mutex_t audio_mutex;
-	pthread_cond_t audio_cond;
+	mlt_ring audio_ring;
+	int audio_target;
+	int audio_period;
+	float audio_volume;
+	int audio_underruns;
+	int64_t audio_bytes;
+	SDL_AudioDeviceID audio_device;
 	pthread_mutex_t video_mutex;
 	pthread_cond_t video_cond;
 	int out_channels;
@@ -105,8 +110,6 @@ mlt_consumer consumer_sdl2_audio_init( mlt_profile profile, mlt_service_type typ
 		mlt_properties_set_double( self->properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &self->audio_mutex, NULL );
-		pthread_cond_init( &self->audio_cond, NULL);
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_cond_init( &self->video_cond, NULL);
 
@@ -121,6 +124,9 @@ mlt_consumer consumer_sdl2_audio_init( mlt_profile profile, mlt_service_type typ
 		// Default audio buffer
 		mlt_properties_set_int( self->properties, "audio_buffer", 2048 );
 
+		// Default audio queued ahead of the device in milliseconds
+		mlt_properties_set_int( self->properties, "audio_latency", 200 );
+
 		// Ensure we don't join on a non-running object
 		self->joined = 1;
 
@@ -220,14 +226,11 @@ int consumer_stop( mlt_consumer parent )
 		pthread_cond_broadcast( &self->video_cond );
 		pthread_mutex_unlock( &self->video_mutex );
 
-		// Unlatch the audio callback
-		pthread_mutex_lock( &self->audio_mutex );
-		pthread_cond_broadcast( &self->audio_cond );
-		pthread_mutex_unlock( &self->audio_mutex );
 #ifdef _WIN32
 		if ( !self->no_quit_subsystem )
 #endif
 		SDL_QuitSubSystem( SDL_INIT_AUDIO );
+		self->audio_device = 0;
 	}
 
 	return 0;
@@ -258,44 +261,45 @@ void consumer_purge( mlt_consumer parent )
 	}
 }
 
+/** Give the device the audio in the ring without waiting for the consumer thread.
+ *
+ * What the ring does not have when the consumer is playing is an underrun,
+ * and the device plays silence instead.
+ */
+
 static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
 {
 	consumer_sdl self = udata;
+	float volume;
+	int bytes = 0;
 
-	// Get the volume
-	double volume = mlt_properties_get_double( self->properties, "volume" );
+	// The consumer thread keeps the volume to not wait on the properties
+	__atomic_load( &self->audio_volume, &volume, __ATOMIC_RELAXED );
 
 	// Wipe the stream first
 	memset( stream, 0, len );
 
-	pthread_mutex_lock( &self->audio_mutex );
-	int bytes = MIN(len, self->audio_avail);
-
-	// Place in the audio buffer
-	if ( volume != 1.0 ) {
+	if ( volume == 1.0 )
+	{
+		bytes = mlt_ring_read( self->audio_ring, stream, len );
+	}
+	else
+	{
 		// Adjust the volume while copying.
-		int16_t *src = (int16_t*) self->audio_buffer;
 		int16_t *dst = (int16_t*) stream;
-		int i = bytes / sizeof(*dst) + 1;
+		int i = ( bytes = mlt_ring_read( self->audio_ring, stream, len ) ) / sizeof(*dst) + 1;
 		while (--i) {
-			*dst++ = CLAMP(volume * src[0], -32768, 32767);
-			src++;
+			*dst = CLAMP(volume * dst[0], -32768, 32767);
+			dst++;
 		}
-	} else {
-		memcpy( stream, self->audio_buffer, bytes );
 	}
 
-	// Remove len from the audio available
-	self->audio_avail -= bytes;
-
-	// Remove the samples
-	memmove( self->audio_buffer, self->audio_buffer + bytes, self->audio_avail );
+	if ( bytes < len && self->running && self->audio_bytes )
+		__atomic_add_fetch( &self->audio_underruns, 1, __ATOMIC_RELAXED );
+	self->audio_bytes += bytes;
 
 	// We're definitely playing now
 	self->playing = 1;
-
-	pthread_cond_broadcast( &self->audio_cond );
-	pthread_mutex_unlock( &self->audio_mutex );
 }
 
 static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_audio, int *duration )
@@ -316,6 +320,9 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	*duration = ( ( samples * 1000 ) / frequency );
 	pcm += mlt_properties_get_int( properties, "audio_offset" );
 
+	float volume = mlt_properties_get_double( properties, "volume" );
+	__atomic_store( &self->audio_volume, &volume, __ATOMIC_RELAXED );
+
 	if ( mlt_properties_get_int( properties, "audio_off" ) )
 	{
 		self->playing = 1;
@@ -329,6 +336,12 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		SDL_AudioSpec got;
 		SDL_AudioDeviceID dev;
 		int audio_buffer = mlt_properties_get_int( properties, "audio_buffer" );
+		int audio_latency = mlt_properties_get_int( properties, "audio_latency" );
+
+		// Only one device reads the ring
+		if ( self->audio_device )
+			SDL_CloseAudioDevice( self->audio_device );
+		self->audio_device = 0;
 
 		// specify audio format
 		memset( &request, 0, sizeof( SDL_AudioSpec ) );
@@ -353,6 +366,15 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 				mlt_log_info( MLT_CONSUMER_SERVICE( self ), "Unable to output %d channels. Change to %d\n", request.channels, got.channels );
 			}
 				mlt_log_info( MLT_CONSUMER_SERVICE( self ), "Audio Opened: driver=%s channels=%d frequency=%d\n", SDL_GetCurrentAudioDriver(), got.channels, got.freq );
+
+			// Keep the target of samples the device has ahead of it, at least two of its buffers
+			self->audio_target = MAX( ( int64_t )audio_latency * got.freq / 1000, 2 * got.samples );
+			self->audio_period = MAX( ( int64_t )got.samples * 1000000 / got.freq / 4, 1000 );
+			mlt_ring_close( self->audio_ring );
+			self->audio_ring = mlt_ring_init( self->audio_target * got.channels * sizeof( int16_t ) );
+			self->audio_underruns = 0;
+			self->audio_bytes = 0;
+			self->audio_device = dev;
 			SDL_PauseAudioDevice( dev, 0 );
 			init_audio = 0;
 			self->out_channels = got.channels;
@@ -362,74 +384,71 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	if ( init_audio == 0 )
 	{
 		mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-		int samples_copied = 0;
 		int dst_stride = self->out_channels * sizeof( *pcm );
+		int silent = !scrub && mlt_properties_get_double( properties, "_speed" ) != 1;
+		int64_t waited = 0;
+		int underruns;
 
-		pthread_mutex_lock( &self->audio_mutex );
-
-		while ( self->running && samples_copied < samples )
+		while ( self->running && samples > 0 )
 		{
-			int sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
-			while ( self->running && sample_space == 0 )
-			{
-				struct timeval now;
-				struct timespec tm;
+			int samples_to_copy = self->audio_target - mlt_ring_count( self->audio_ring ) / dst_stride;
 
-				gettimeofday( &now, NULL );
-				tm.tv_sec = now.tv_sec + 1;
-				tm.tv_nsec = now.tv_usec * 1000;
-				pthread_cond_timedwait( &self->audio_cond, &self->audio_mutex, &tm );
-				sample_space = ( sizeof( self->audio_buffer ) - self->audio_avail ) / dst_stride;
+			// Wait for the device to take some of the queue
+			if ( samples_to_copy <= 0 )
+			{
+				struct timespec tm = { 0, self->audio_period * 1000 };
 
-				if ( sample_space == 0 )
+				if ( waited >= 1000000 )
 				{
 					mlt_log_warning( MLT_CONSUMER_SERVICE(&self->parent), "audio timed out\n" );
-					pthread_mutex_unlock( &self->audio_mutex );
 #ifdef _WIN32
 					self->no_quit_subsystem = 1;
 #endif
 					return 1;
 				}
+				nanosleep( &tm, NULL );
+				waited += self->audio_period;
+				continue;
 			}
-			if ( self->running )
-			{
-				int samples_to_copy = samples - samples_copied;
-				if ( samples_to_copy > sample_space )
-				{
-					samples_to_copy = sample_space;
-				}
-				int dst_bytes = samples_to_copy * dst_stride;
+			waited = 0;
+			if ( samples_to_copy > samples )
+				samples_to_copy = samples;
 
-				if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-				{
-					if ( channels == self->out_channels )
-					{
-						memcpy( &self->audio_buffer[ self->audio_avail ], pcm, dst_bytes );
-						pcm += samples_to_copy * channels;
-					}
-					else
-					{
-						int16_t *dest = (int16_t*) &self->audio_buffer[ self->audio_avail ];
-						int i = samples_to_copy + 1;
-						while ( --i )
-						{
-							memcpy( dest, pcm, dst_stride );
-							pcm += channels;
-							dest += self->out_channels;
-						}
-					}
-				}
-				else
+			if ( silent )
+			{
+				mlt_ring_write( self->audio_ring, NULL, samples_to_copy * dst_stride );
+			}
+			else if ( channels == self->out_channels )
+			{
+				mlt_ring_write( self->audio_ring, pcm, samples_to_copy * dst_stride );
+			}
+			else
+			{
+				// Drop the channels the device does not have through a small buffer
+				int16_t chunk[ 2048 ];
+				int i = 0;
+				while ( i < samples_to_copy )
 				{
-					memset( &self->audio_buffer[ self->audio_avail ], 0, dst_bytes );
-					pcm += samples_to_copy * channels;
+					int n = MIN( samples_to_copy - i, (int) sizeof( chunk ) / dst_stride );
+					int16_t *dest = chunk;
+					int j;
+					for ( j = 0; j < n; j++, dest += self->out_channels )
+						memcpy( dest, pcm + ( i + j ) * channels, dst_stride );
+					mlt_ring_write( self->audio_ring, chunk, n * dst_stride );
+					i += n;
 				}
-				self->audio_avail += dst_bytes;
-				samples_copied += samples_to_copy;
 			}
-			pthread_cond_broadcast( &self->audio_cond );
+			pcm += samples_to_copy * channels;
+			samples -= samples_to_copy;
+		}
+
+		underruns = __atomic_load_n( &self->audio_underruns, __ATOMIC_RELAXED );
+		if ( underruns != mlt_properties_get_int( self->properties, "audio_underruns" ) )
+		{
+			mlt_events_block( self->properties, self->properties );
+			mlt_properties_set_int( self->properties, "audio_underruns", underruns );
+			mlt_events_unblock( self->properties, self->properties );
 		}
-		pthread_mutex_unlock( &self->audio_mutex );
 	}
 	else
 	{
@@ -689,8 +708,6 @@ static void *consumer_thread( void *arg )
 		frame = NULL;
 	}
 
-	self->audio_avail = 0;
-
 	return NULL;
 }
 
@@ -711,9 +728,9 @@ static void consumer_close( mlt_consumer parent )
 	// Close the queue
 	mlt_deque_close( self->queue );
 
+	mlt_ring_close( self->audio_ring );
+
 	// Destroy mutexes
-	pthread_mutex_destroy( &self->audio_mutex );
-	pthread_cond_destroy( &self->audio_cond );
 	pthread_mutex_destroy( &self->video_mutex );
 	pthread_cond_destroy( &self->video_cond );
 	pthread_mutex_destroy( &self->refresh_mutex );
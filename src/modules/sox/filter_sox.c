@@ -53,7 +53,6 @@
 #	include <st.h>
 #endif
 
-#define BUFFER_LEN 8192
 #define AMPLITUDE_NORM 0.2511886431509580 /* -12dBFS */
 #define AMPLITUDE_MIN 0.00001
 #define DBFSTOAMP(x) pow(10,(x)/20.0)
@@ -89,31 +88,43 @@ static void delete_effect( eff_t effp )
 }
 #endif
 
-/** Create an effect state instance for a channels
+/** Release an effect state instance.
 */
-static int create_effect( mlt_filter this, char *value, int count, int channel, int frequency )
+static void close_effect( eff_t effp )
+{
+#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
+	delete_effect( effp );
+#else
+	mlt_pool_release( effp );
+#endif
+}
+
+/** Create an effect state instance for a channel
+*/
+static eff_t create_effect( const char *value, int frequency )
 {
 	mlt_tokeniser tokeniser = mlt_tokeniser_init();
-	char id[ 256 ];
 	int error = 1;
 
 	// Tokenise the effect specification
-	mlt_tokeniser_parse_new( tokeniser, value, " " );
+	mlt_tokeniser_parse_new( tokeniser, (char*) value, " " );
 	if ( tokeniser->count < 1 )
 	{
 		mlt_tokeniser_close( tokeniser );
-		return error;
+		return NULL;
 	}
 
 	// Locate the effect
-	mlt_destructor effect_destructor = mlt_pool_release;
 #ifdef SOX14
 	//fprintf(stderr, "%s: effect %s count %d\n", __FUNCTION__, tokeniser->tokens[0], tokeniser->count );
 #if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
 	sox_effect_handler_t const *eff_handle = sox_find_effect( tokeniser->tokens[0] );
-	if (eff_handle == NULL ) return error;
+	if ( eff_handle == NULL )
+	{
+		mlt_tokeniser_close( tokeniser );
+		return NULL;
+	}
 	eff_t eff = sox_create_effect( eff_handle );
-	effect_destructor = ( mlt_destructor ) delete_effect;
 	sox_encodinginfo_t *enc = calloc( 1, sizeof( sox_encodinginfo_t ) );
 	enc->encoding = SOX_ENCODING_SIGN2;
 	enc->bits_per_sample = 16;
@@ -165,23 +176,160 @@ static int create_effect( mlt_filter this, char *value, int count, int channel,
 #else
 			if ( ( * eff->h->start )( eff ) == ST_SUCCESS )
 #endif
-			{
-				// Construct id
-				sprintf( id, "_effect_%d_%d", count, channel );
-
-				// Save the effect state
-				mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), id, eff, 0, effect_destructor, NULL );
 				error = 0;
-			}
 		}
 	}
 	// Some error occurred so delete the temp effect state
 	if ( error == 1 )
-		effect_destructor( eff );
+	{
+		close_effect( eff );
+		eff = NULL;
+	}
 	
 	mlt_tokeniser_close( tokeniser );
 	
-	return error;
+	return eff;
+}
+
+/** The state of the effects, kept from frame to frame so the effects keep
+ * their history and are only created again when their specification changes.
+ */
+typedef struct
+{
+	int frequency;
+	int channels;
+	int count;            // number of effect specifications
+	char **specs;         // the specification of every effect
+	eff_t *effects;       // an instance of every effect for every channel or NULL
+	st_sample_t *buffer;  // two channels of work space
+	int size;             // the number of samples in a channel of work space
+} sox_chain;
+
+static void close_effects( sox_chain *chain, int from )
+{
+	int i;
+	for ( i = from * chain->channels; i < chain->count * chain->channels; i++ )
+		if ( chain->effects[ i ] )
+			close_effect( chain->effects[ i ] );
+	for ( i = from; i < chain->count; i++ )
+		free( chain->specs[ i ] );
+	chain->count = from;
+}
+
+static void close_chain( sox_chain *chain )
+{
+	close_effects( chain, 0 );
+	free( chain->specs );
+	free( chain->effects );
+	mlt_pool_release( chain->buffer );
+	free( chain );
+}
+
+/** Bring the effects in line with the effect properties of the filter.
+ *
+ * Only the effects whose specification changed are created again, unless
+ * the frequency or the channels of the audio changed.
+ */
+static void update_chain( mlt_filter filter, sox_chain *chain, int frequency, int channels )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	int n = mlt_properties_count( properties );
+	int count = 0;
+	int i, j;
+
+	if ( chain->frequency != frequency || chain->channels != channels )
+	{
+		close_effects( chain, 0 );
+		chain->frequency = frequency;
+		chain->channels = channels;
+	}
+
+	for ( i = 0; i < n; i ++ )
+	{
+		// Get the name of this property
+		char *name = mlt_properties_get_name( properties, i );
+
+		// If the name matches effect
+		if ( !strncmp( name, "effect", 6 ) )
+		{
+			// Get the effect specification
+			char *value = mlt_properties_get_value( properties, i );
+
+			if ( !value )
+				value = "";
+			if ( count == chain->count )
+			{
+				chain->specs = realloc( chain->specs, ( count + 1 ) * sizeof( *chain->specs ) );
+				chain->effects = realloc( chain->effects, ( count + 1 ) * channels * sizeof( *chain->effects ) );
+				chain->specs[ count ] = NULL;
+				memset( &chain->effects[ count * channels ], 0, channels * sizeof( *chain->effects ) );
+				chain->count ++;
+			}
+			if ( !chain->specs[ count ] || strcmp( chain->specs[ count ], value ) )
+			{
+				// Even though some effects are multi-channel aware, it is not reliable
+				// We must maintain a separate effect state for each channel
+				for ( j = 0; j < channels; j++ )
+				{
+					eff_t *e = &chain->effects[ count * channels + j ];
+					if ( *e )
+						close_effect( *e );
+					*e = create_effect( value, frequency );
+				}
+				free( chain->specs[ count ] );
+				chain->specs[ count ] = strdup( value );
+			}
+			count ++;
+		}
+	}
+
+	// Drop the effects that are no longer specified
+	if ( count < chain->count )
+		close_effects( chain, count );
+}
+
+/** Run a channel through an effect.
+ *
+ * The effect is given the whole channel at once and called again for
+ * whatever it does not take in one go.
+ */
+static void flow_effect( mlt_filter filter, eff_t e, st_sample_t *input, st_sample_t *output, st_size_t samples )
+{
+	st_size_t used = 0;
+	st_size_t made = 0;
+
+	while ( used < samples && made < samples )
+	{
+		st_size_t isamp = samples - used;
+		st_size_t osamp = samples - made;
+
+#ifdef SOX14
+		if ( ( * e->handler.flow )( e, input + used, output + made, &isamp, &osamp ) != ST_SUCCESS )
+#else
+		if ( ( * e->h->flow )( e, input + used, output + made, &isamp, &osamp ) != ST_SUCCESS )
+#endif
+		{
+			mlt_log_warning( MLT_FILTER_SERVICE(filter), "effect processing failed\n" );
+			break;
+		}
+		if ( isamp == 0 && osamp == 0 )
+			break;
+		used += isamp;
+		made += osamp;
+	}
+
+	// An effect with a delay does not have all of its output yet
+	if ( made < samples )
+		memset( output + made, 0, ( samples - made ) * sizeof( st_sample_t ) );
+}
+
+/** Convert a float sample to the sample format of sox.
+*/
+static inline st_sample_t float_to_sample( float f )
+{
+	f = CLAMP( f, -1.0f, 1.0f );
+	int64_t pcm = ( f > 0.0f ? 2147483647LL : 2147483648LL ) * f;
+	return CLAMP( pcm, -2147483648LL, 2147483647LL );
 }
 
 /** Get the audio.
@@ -201,75 +349,51 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
 	// Get the properties
-	st_sample_t *input_buffer;// = mlt_properties_get_data( filter_properties, "input_buffer", NULL );
-	st_sample_t *output_buffer = mlt_properties_get_data( filter_properties, "output_buffer", NULL );
+	sox_chain *chain = mlt_properties_get_data( filter_properties, "_chain", NULL );
 	int i; // channel
-	int count = mlt_properties_get_int( filter_properties, "_effect_count" );
 	int analysis = mlt_properties_get( filter_properties, "effect" ) && !strcmp( mlt_properties_get( filter_properties, "effect" ), "analysis" );
 
-	// Get the producer's audio
-	*format = mlt_audio_s32;
+	// Get the producer's audio, in float when that is asked for to convert
+	// it to and from the samples of sox a channel at a time here
+	*format = *format == mlt_audio_float ? mlt_audio_float : mlt_audio_s32;
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	int is_float = *format == mlt_audio_float;
+
+	if ( !*buffer || *samples <= 0 || ( *format != mlt_audio_s32 && !is_float ) )
+	{
+		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+		return 0;
+	}
+
+	update_chain( filter, chain, *frequency, *channels );
+
+	// Make room for two channels of work space
+	if ( chain->size < *samples )
+	{
+		mlt_pool_release( chain->buffer );
+		chain->buffer = mlt_pool_alloc( 2 * *samples * sizeof( st_sample_t ) );
+		chain->size = *samples;
+	}
 
-	// Even though some effects are multi-channel aware, it is not reliable
-	// We must maintain a separate effect state for each channel
 	for ( i = 0; i < *channels; i++ )
 	{
-		char id[ 256 ];
-		sprintf( id, "_effect_0_%d", i );
-		
-		// Get an existing effect state
-		eff_t e = mlt_properties_get_data( filter_properties, id, NULL );
-		
-		// Validate the existing effect state
-#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
-		if ( e != NULL && ( e->in_signal.rate != *frequency || 
-							e->out_signal.rate != *frequency ) )
-#else
-		if ( e != NULL && ( e->ininfo.rate != *frequency || 
-							e->outinfo.rate != *frequency ) )
-#endif
-			e = NULL;
-		
-		// (Re)Create the effect state
-		if ( e == NULL )
-		{
-			int j = 0;
-			
-			// Reset the count
-			count = 0;
-	
-			// Loop over all properties
-			for ( j = 0; j < mlt_properties_count( filter_properties ); j ++ )
-			{
-				// Get the name of this property
-				char *name = mlt_properties_get_name( filter_properties, j );
-	
-				// If the name does not contain a . and matches effect
-				if ( !strncmp( name, "effect", 6 ) )
-				{
-					// Get the effect specification
-					char *value = mlt_properties_get_value( filter_properties, j );
-	
-					// Create an instance
-					if ( create_effect( filter, value, count, i, *frequency ) == 0 )
-						count ++;
-				}
-			}
-			
-			// Save the number of filters
-			mlt_properties_set_int( filter_properties, "_effect_count", count );
-			
-		}
-		if ( *samples > 0 && ( count > 0 || analysis ) )
+		if ( chain->count > 0 || analysis )
 		{
-			input_buffer = (st_sample_t*) *buffer + i * *samples;
+			st_sample_t *channel = (st_sample_t*) *buffer + i * *samples;
+			st_sample_t *input_buffer = is_float ? chain->buffer : channel;
+			st_sample_t *output_buffer = chain->buffer + chain->size;
 			st_sample_t *p = input_buffer;
-			st_size_t isamp = *samples;
-			st_size_t osamp = *samples;
 			int j = *samples + 1;
 			char *normalise = mlt_properties_get( filter_properties, "normalise" );
 			double normalised_gain = 1.0;
+
+			if ( is_float )
+			{
+				float *f = (float*) channel;
+				int n;
+				for ( n = 0; n < *samples; n++ )
+					input_buffer[ n ] = float_to_sample( f[ n ] );
+			}
 			
 			if ( analysis )
 			{
@@ -385,15 +509,15 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 			}
 			
 			// For each effect
-			for ( j = 0; j < count; j++ )
+			for ( j = 0; j < chain->count; j++ )
 			{
-				sprintf( id, "_effect_%d_%d", j, i );
-				e = mlt_properties_get_data( filter_properties, id, NULL );
+				eff_t e = chain->effects[ j * *channels + i ];
 				
-				// We better have this guy
+				// Skip the effects that failed to start
 				if ( e != NULL )
 				{
 					float saved_gain = 1.0;
+					st_sample_t *swap = input_buffer;
 					
 					// XXX: hack to apply the normalised gain level to the vol effect
 #ifdef SOX14
@@ -407,15 +531,10 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 						*f = saved_gain * normalised_gain;
 					}
 					
-					// Apply the effect
-#ifdef SOX14
-					if ( ( * e->handler.flow )( e, input_buffer, output_buffer, &isamp, &osamp ) != ST_SUCCESS )
-#else
-					if ( ( * e->h->flow )( e, input_buffer, output_buffer, &isamp, &osamp ) != ST_SUCCESS )
-#endif
-					{
-						mlt_log_warning( MLT_FILTER_SERVICE(filter), "effect processing failed\n" );
-					}
+					// Apply the effect, and the next one to its output
+					flow_effect( filter, e, input_buffer, output_buffer, *samples );
+					input_buffer = output_buffer;
+					output_buffer = swap;
 					
 					// XXX: hack to restore the original vol gain to prevent accumulation
 #ifdef SOX14
@@ -431,7 +550,17 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 			}
 
 			// Write back
-			memcpy( input_buffer, output_buffer, *samples * sizeof(st_sample_t) );
+			if ( is_float )
+			{
+				float *f = (float*) channel;
+				int n;
+				for ( n = 0; n < *samples; n++ )
+					f[ n ] = (float)( input_buffer[ n ] ) / 2147483648.0;
+			}
+			else if ( input_buffer != channel )
+			{
+				memcpy( channel, input_buffer, *samples * sizeof(st_sample_t) );
+			}
 		}
 	}
 
@@ -476,8 +605,7 @@ mlt_filter filter_sox_init( mlt_profile profile, mlt_service_type type, const ch
 	mlt_filter this = mlt_filter_new( );
 	if ( this != NULL )
 	{
-		void *input_buffer = mlt_pool_alloc( BUFFER_LEN );
-		void *output_buffer = mlt_pool_alloc( BUFFER_LEN );
+		sox_chain *chain = calloc( 1, sizeof( sox_chain ) );
 		mlt_properties properties = MLT_FILTER_PROPERTIES( this );
 		
 		this->process = filter_process;
@@ -496,8 +624,7 @@ mlt_filter filter_sox_init( mlt_profile profile, mlt_service_type type, const ch
 		}
 		else if ( arg )
 			mlt_properties_set( properties, "effect", arg );
-		mlt_properties_set_data( properties, "input_buffer", input_buffer, BUFFER_LEN, mlt_pool_release, NULL );
-		mlt_properties_set_data( properties, "output_buffer", output_buffer, BUFFER_LEN, mlt_pool_release, NULL );
+		mlt_properties_set_data( properties, "_chain", chain, 0, (mlt_destructor) close_chain, NULL );
 		mlt_properties_set_int( properties, "window", 75 );
 		mlt_properties_set( properties, "version", sox_version() );
 	}
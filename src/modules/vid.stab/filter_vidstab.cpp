@@ -29,8 +29,12 @@ extern "C"
 
 #include <sstream>
 #include <string.h>
+#include <stdio.h>
 #include <assert.h>
 
+// The shortest chunk of a parallel analysis, which also decodes the frame before it
+#define MIN_CHUNK_LENGTH (100)
+
 typedef struct
 {
 	VSMotionDetect md;
@@ -196,6 +200,20 @@ void destory_analyze_data( vs_analyze* analyze_data )
 	}
 }
 
+static void get_motion_config( VSMotionDetectConfig* conf, mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	const char* filterName = mlt_properties_get( properties, "mlt_service" );
+
+	*conf = vsMotionDetectGetDefaultConfig( filterName );
+	conf->shakiness = mlt_properties_get_int( properties, "shakiness" );
+	conf->accuracy = mlt_properties_get_int( properties, "accuracy" );
+	conf->stepSize = mlt_properties_get_int( properties, "stepsize" );
+	conf->contrastThreshold = mlt_properties_get_double( properties, "mincontrast" );
+	conf->show = mlt_properties_get_int( properties, "show" );
+	conf->virtualTripod = mlt_properties_get_int( properties, "tripod" );
+}
+
 static void init_analyze_data( mlt_filter filter, mlt_frame frame, VSPixelFormat vs_format, int width, int height )
 {
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
@@ -204,14 +222,8 @@ static void init_analyze_data( mlt_filter filter, mlt_frame frame, VSPixelFormat
 	memset( analyze_data, 0, sizeof(vs_analyze) );
 
 	// Initialize a VSMotionDetectConfig
-	const char* filterName = mlt_properties_get( properties, "mlt_service" );
-	VSMotionDetectConfig conf = vsMotionDetectGetDefaultConfig( filterName );
-	conf.shakiness = mlt_properties_get_int( properties, "shakiness" );
-	conf.accuracy = mlt_properties_get_int( properties, "accuracy" );
-	conf.stepSize = mlt_properties_get_int( properties, "stepsize" );
-	conf.contrastThreshold = mlt_properties_get_double( properties, "mincontrast" );
-	conf.show = mlt_properties_get_int( properties, "show" );
-	conf.virtualTripod = mlt_properties_get_int( properties, "tripod" );
+	VSMotionDetectConfig conf;
+	get_motion_config( &conf, filter );
 
 	// Initialize a VSFrameInfo
 	VSFrameInfo fi;
@@ -328,6 +340,257 @@ static void analyze_image( mlt_filter filter, mlt_frame frame, uint8_t* vs_image
 	}
 }
 
+/** Get the producer to which the filter is attached and the range to analyze.
+*/
+
+static mlt_producer get_source( mlt_filter filter, mlt_position* in, mlt_position* length )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_service service = (mlt_service)mlt_properties_get_data( properties, "service", NULL );
+	mlt_producer producer;
+
+	if ( !service || mlt_service_identify( service ) != producer_type )
+		return NULL;
+	producer = MLT_PRODUCER( service );
+	if ( mlt_filter_get_out( filter ) > 0 )
+	{
+		*in = mlt_filter_get_in( filter );
+		*length = mlt_filter_get_out( filter ) - *in + 1;
+	}
+	else
+	{
+		*in = mlt_producer_get_in( producer );
+		*length = mlt_producer_get_playtime( producer );
+	}
+	return producer;
+}
+
+typedef struct
+{
+	mlt_filter filter;
+	mlt_producer source;
+	mlt_position in;
+	mlt_position length;
+	VSMotionDetectConfig conf;
+	int error;
+} vs_scan;
+
+/** Get the name of the file holding the motions of one chunk until they are merged.
+*/
+
+static char* chunk_filename( mlt_filter filter, int idx )
+{
+	const char* filename = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "filename" );
+	size_t size = strlen( filename ) + 32;
+	char* result = (char*)malloc( size );
+	snprintf( result, size, "%s.%d.tmp", filename, idx );
+	return result;
+}
+
+/** Analyze one chunk of the video with a producer of its own.
+
+    A chunk after the first also detects the frame before it, since the
+    motion of a frame is measured from the previous one, and only writes the
+    motions of its own frames, numbered as in a sequential analysis.
+*/
+
+static int scan_chunk( int id, int idx, int jobs, void* cookie )
+{
+	vs_scan* scan = (vs_scan*)cookie;
+	mlt_producer parent = mlt_producer_cut_parent( scan->source );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( parent ) );
+	mlt_position start = scan->in + scan->length * idx / jobs;
+	mlt_position end = scan->in + scan->length * ( idx + 1 ) / jobs;
+	mlt_position first = start > scan->in ? start - 1 : start;
+	mlt_producer producer = mlt_factory_producer( profile, NULL,
+		mlt_properties_get( MLT_PRODUCER_PROPERTIES( parent ), "resource" ) );
+	char* filename = chunk_filename( scan->filter, idx );
+	FILE* results = producer ? mlt_fopen( filename, "w" ) : NULL;
+	VSMotionDetect md;
+	int initialized = 0;
+	int error = !producer || !results;
+	mlt_position pos;
+
+	if ( !error )
+		mlt_producer_seek( producer, first );
+	for ( pos = first; !error && pos < end && !scan->error; pos++ )
+	{
+		mlt_frame frame = NULL;
+		uint8_t* image = NULL;
+		uint8_t* vs_image = NULL;
+		mlt_image_format format = mlt_image_yuv422;
+		VSPixelFormat vs_format = PF_NONE;
+		int width = profile->width;
+		int height = profile->height;
+
+		error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+		if ( !error )
+		{
+			// VS only works on progressive frames
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_deinterlace", 1 );
+			error = mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+		}
+		if ( !error )
+		{
+			vs_format = mltimage_to_vsimage( validate_format( format ), width, height, image, &vs_image );
+			error = !vs_image;
+		}
+		if ( !error && !initialized )
+		{
+			VSFrameInfo fi;
+			vsFrameInfoInit( &fi, width, height, vs_format );
+			initialized = vsMotionDetectInit( &md, &scan->conf, &fi ) == VS_OK;
+			error = !initialized;
+		}
+		if ( !error )
+		{
+			LocalMotions localmotions;
+			VSFrame vsFrame;
+			vsFrameFillFromBuffer( &vsFrame, vs_image, &md.fi );
+			if ( vsMotionDetection( &md, &localmotions, &vsFrame ) == VS_OK )
+			{
+				if ( pos >= start )
+				{
+					int frameNum = md.frameNum;
+					md.frameNum = pos - scan->in + 1;
+					vsWriteToFile( &md, results, &localmotions );
+					md.frameNum = frameNum;
+				}
+				vs_vector_del( &localmotions );
+			}
+			else
+			{
+				error = 1;
+			}
+		}
+		if ( vs_image )
+			free_vsimage( vs_image, vs_format );
+		mlt_frame_close( frame );
+	}
+	if ( initialized )
+		vsMotionDetectionCleanup( &md );
+	if ( results && fclose( results ) )
+		error = 1;
+	if ( error )
+		scan->error = 1;
+	mlt_producer_close( producer );
+	free( filename );
+	return 0;
+}
+
+/** Append the motions of a chunk to the results and remove its file.
+*/
+
+static int merge_chunk( mlt_filter filter, int idx, FILE* results )
+{
+	char* filename = chunk_filename( filter, idx );
+	FILE* f = mlt_fopen( filename, "r" );
+	char buffer[ 65536 ];
+	size_t n;
+	int error = !f;
+
+	while ( f && ( n = fread( buffer, 1, sizeof(buffer), f ) ) > 0 )
+		if ( fwrite( buffer, 1, n, results ) != n )
+			error = 1;
+	if ( f )
+	{
+		error |= ferror( f );
+		fclose( f );
+	}
+	remove( filename );
+	free( filename );
+	return error;
+}
+
+/** Analyze all of the video of the filter's producer in parallel chunks.
+
+    Each chunk is read by a producer of its own, and the motions of the chunks
+    are written in order to one results file, as a sequential analysis would.
+*/
+
+static int scan_video( mlt_filter filter )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	char* filename = mlt_properties_get( properties, "filename" );
+	int jobs = mlt_properties_get_int( properties, "threads" );
+	vs_scan scan;
+	int i;
+
+	memset( &scan, 0, sizeof(scan) );
+	scan.filter = filter;
+	scan.source = get_source( filter, &scan.in, &scan.length );
+	if ( !scan.source || scan.length <= 0 || !filename )
+	{
+		mlt_log_error( MLT_FILTER_SERVICE(filter), "Analysis failed: no producer to scan\n" );
+		return 1;
+	}
+	get_motion_config( &scan.conf, filter );
+
+	if ( jobs <= 0 )
+		jobs = mlt_slices_count_normal();
+	if ( jobs > scan.length / MIN_CHUNK_LENGTH )
+		jobs = scan.length / MIN_CHUNK_LENGTH;
+	// The virtual tripod measures every frame from one reference frame
+	if ( jobs < 1 || scan.conf.virtualTripod )
+		jobs = 1;
+	mlt_log_info( MLT_FILTER_SERVICE(filter), "Analyzing %d frames in %d chunks\n", scan.length, jobs );
+	mlt_slices_run_normal( jobs, scan_chunk, &scan );
+
+	FILE* results = NULL;
+	if ( !scan.error )
+	{
+		mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE(filter) );
+		VSMotionDetect md;
+		VSFrameInfo fi;
+
+		// Write the same header as a sequential analysis
+		results = mlt_fopen( filename, "w" );
+		vsFrameInfoInit( &fi, profile->width, profile->height, PF_YUV420P );
+		scan.error = !results || vsMotionDetectInit( &md, &scan.conf, &fi ) != VS_OK;
+		if ( !scan.error )
+		{
+			scan.error = vsPrepareFile( &md, results ) != VS_OK;
+			vsMotionDetectionCleanup( &md );
+		}
+	}
+	for ( i = 0; i < jobs; i++ )
+	{
+		if ( !scan.error )
+		{
+			scan.error = merge_chunk( filter, i, results );
+		}
+		else
+		{
+			char* chunk = chunk_filename( filter, i );
+			remove( chunk );
+			free( chunk );
+		}
+	}
+	if ( results && fclose( results ) )
+		scan.error = 1;
+
+	if ( !scan.error )
+	{
+		mlt_log_info( MLT_FILTER_SERVICE(filter), "Analysis complete\n" );
+		mlt_properties_set( properties, "results", filename );
+	}
+	else
+	{
+		mlt_log_error( MLT_FILTER_SERVICE(filter), "Analysis failed: unable to analyze the video\n" );
+	}
+	return scan.error;
+}
+
+static void property_changed( mlt_service owner, mlt_filter filter, char* name )
+{
+	if ( !strcmp( name, "analyze" ) && mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "analyze" ) )
+	{
+		char* results = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "results" );
+		if ( !results || !strcmp( results, "" ) )
+			scan_video( filter );
+	}
+}
+
 static int get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	mlt_filter filter = (mlt_filter)mlt_frame_pop_service( frame );
@@ -440,6 +703,10 @@ mlt_filter filter_vidstab_init( mlt_profile profile, mlt_service_type type, cons
 
 		mlt_properties_set( properties, "vid.stab.version", LIBVIDSTAB_VERSION );
 
+		// properties for a parallel analysis
+		mlt_properties_set_int( properties, "threads", 0 );
+		mlt_events_listen( properties, filter, "property-changed", (mlt_listener)property_changed );
+
 		init_vslog();
 	}
 	else
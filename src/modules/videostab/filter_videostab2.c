@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <sys/stat.h>
 #include <string.h>
@@ -32,13 +33,127 @@
 #include "stabilize.h"
 #include "transform_image.h"
 
+/* The analysis results file starts with this header and is followed by one
+ * record of four floats (x, y, alpha, zoom) per frame, so the record of a
+ * position is at sizeof(results_header) + position * sizeof(results_record).
+ * The values are relative to an image of the width in the header.
+ */
+#define RESULTS_MAGIC 0x32545356 /* "VST2" */
+#define RESULTS_VERSION 1
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t width;
+	uint32_t height;
+} results_header;
+
+typedef struct {
+	float x, y, alpha, zoom;
+} results_record;
+
 typedef struct {
 	StabData* stab;
 	TransformData* trans;
 	int initialized;
 	void* parent;
+	Transform* results;     // analysis results indexed by position
+	uint8_t* analyzed;      // whether results[position] came from its previous frame
+	mlt_position results_len;
+	mlt_position analyzed_count;
+	mlt_position last_pos;  // position of the last analyzed frame
+	int results_width;
+	int results_height;
+	int results_loaded;     // whether the results file has been tried
 } videostab2_data;
 
+static void free_results( videostab2_data* self )
+{
+	free( self->results );
+	free( self->analyzed );
+	self->results = NULL;
+	self->analyzed = NULL;
+	self->results_len = 0;
+	self->analyzed_count = 0;
+	self->last_pos = -1;
+}
+
+static int write_results( videostab2_data* self, const char *filename )
+{
+	FILE *file = fopen( filename, "wb" );
+	int error = !file;
+
+	if ( file )
+	{
+		results_header header = { RESULTS_MAGIC, RESULTS_VERSION, self->results_len, self->results_width, self->results_height };
+		mlt_position i;
+
+		error = fwrite( &header, sizeof(header), 1, file ) != 1;
+		for ( i = 0; !error && i < self->results_len; i++ )
+		{
+			Transform* t = &self->results[i];
+			results_record record = { t->x, t->y, t->alpha, t->zoom };
+			error = fwrite( &record, sizeof(record), 1, file ) != 1;
+		}
+		error = fclose( file ) || error;
+	}
+	if ( error )
+		mlt_log_error( MLT_FILTER_SERVICE( (mlt_filter) self->parent ), "failed to write %s\n", filename );
+	return error;
+}
+
+static int read_results( videostab2_data* self, const char *filename )
+{
+	FILE *file = fopen( filename, "rb" );
+	results_header header;
+	int error = !file;
+
+	if ( file )
+	{
+		error = fread( &header, sizeof(header), 1, file ) != 1
+			|| header.magic != RESULTS_MAGIC || header.version != RESULTS_VERSION
+			|| header.count == 0 || header.width == 0;
+		if ( !error )
+		{
+			mlt_position i;
+
+			free_results( self );
+			self->results = calloc( header.count, sizeof(Transform) );
+			error = !self->results;
+			for ( i = 0; !error && i < header.count; i++ )
+			{
+				results_record record;
+				if ( fread( &record, sizeof(record), 1, file ) != 1 )
+				{
+					error = 1;
+				}
+				else
+				{
+					self->results[i].x = record.x;
+					self->results[i].y = record.y;
+					self->results[i].alpha = record.alpha;
+					self->results[i].zoom = record.zoom;
+				}
+			}
+			if ( error )
+			{
+				free_results( self );
+			}
+			else
+			{
+				self->results_len = self->analyzed_count = header.count;
+				self->results_width = header.width;
+				self->results_height = header.height;
+			}
+		}
+		fclose( file );
+	}
+	if ( error )
+		mlt_log_verbose( MLT_FILTER_SERVICE( (mlt_filter) self->parent ), "no analysis results in %s\n", filename );
+	return error;
+}
+
 static void serialize_vectors( videostab2_data* self, mlt_position length )
 {
 	mlt_geometry g = mlt_geometry_init();
@@ -51,20 +166,17 @@ static void serialize_vectors( videostab2_data* self, mlt_position length )
 		item.key = item.f[0] = item.f[1] = item.f[2] = item.f[3] = 1;
 		item.f[4] = 0;
 
-		tlist* transform_data =self->stab->transs;
 		for ( i = 0; i < length; i++ )
 		{
 			// Set the geometry item
 			item.frame = i;
-			if (transform_data){
-				if ( transform_data->data){
-					Transform* t=transform_data->data;
-					item.x=t->x;
-					item.y=t->y;
-					item.w=t->alpha;
-					item.h=t->zoom;
-					transform_data=transform_data->next;
-				}
+			if ( i < self->results_len )
+			{
+				Transform* t = &self->results[i];
+				item.x=t->x;
+				item.y=t->y;
+				item.w=t->alpha;
+				item.h=t->zoom;
 			}
 			// Add the geometry item
 			mlt_geometry_insert( g, &item );
@@ -111,41 +223,117 @@ Transform* deserialize_vectors( char *vectors, mlt_position length ,float scale_
 	return tx;
 }
 
+/** Record the motion of one frame during analysis.
+ *
+ * The results are kept by position so that seeking during the analysis
+ * does not misplace them. The motion of a frame that does not follow the
+ * previously analyzed one is unknown and is left to be analyzed again when
+ * playback passes it in order.
+ */
+
+static void analyze_frame( mlt_filter filter, videostab2_data* data, uint8_t *image, mlt_image_format format, mlt_position pos, mlt_position length )
+{
+	if ( data->results_len != length )
+	{
+		free_results( data );
+		data->results = calloc( length, sizeof(Transform) );
+		data->analyzed = calloc( length, 1 );
+		if ( !data->results || !data->analyzed )
+		{
+			free_results( data );
+			return;
+		}
+		data->results_len = length;
+	}
+	if ( pos < 0 || pos >= length )
+		return;
+	int continuous = pos > 0 && pos == data->last_pos + 1 && data->stab->hasSeenOneFrame;
+	if ( !continuous )
+		data->stab->hasSeenOneFrame = 0;
+	stabilize_filter_video( data->stab, image, format );
+	if ( data->stab->transs )
+	{
+		if ( data->stab->transs->data && !data->analyzed[pos] && ( continuous || pos == 0 ) )
+		{
+			data->results[pos] = *(Transform*) data->stab->transs->data;
+			data->analyzed[pos] = 1;
+			data->analyzed_count++;
+		}
+		tlist_fini( data->stab->transs );
+		data->stab->transs = NULL;
+	}
+	data->last_pos = pos;
+
+	if ( data->analyzed_count == length )
+	{
+		char *filename = mlt_properties_get( MLT_FILTER_PROPERTIES(filter), "filename" );
+		data->results_width = data->stab->width;
+		data->results_height = data->stab->height;
+		if ( filename && filename[0] )
+			write_results( data, filename );
+		data->results_loaded = 1;
+		serialize_vectors( data, length );
+	}
+}
+
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	mlt_filter filter = mlt_frame_pop_service( frame );
+	videostab2_data* data = filter->child;
 	char *vectors = mlt_properties_get( MLT_FILTER_PROPERTIES(filter), "vectors" );
+	char *filename = mlt_properties_get( MLT_FILTER_PROPERTIES(filter), "filename" );
+
+	// Load the analysis results file once, unless the vectors are given
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+
+	// Handle signal from app to re-init data
+	if ( data && mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter) , "refresh" ) )
+	{
+		mlt_properties_set( MLT_FILTER_PROPERTIES(filter) , "refresh", NULL );
+		data->initialized = 0;
+	}
+	if ( data && !vectors && !data->results_loaded && filename && filename[0] )
+	{
+		data->results_loaded = 1;
+		read_results( data, filename );
+	}
+	// An instance that analyzes does not stabilize, even once its analysis is complete
+	int have_results = data && data->initialized != 1
+		&& ( vectors || ( data->results && data->analyzed_count == data->results_len ) );
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+
 	*format = mlt_image_yuv422;
-	if (vectors)
+	if (have_results)
 		*format= mlt_image_rgb24;
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES(frame), "consumer_deinterlace", 1 );
 	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
 
 	if ( !error && *image )
 	{
-		videostab2_data* data = filter->child;
 		if ( data==NULL ) { // big error, abort
 			return 1;
 		}
 		mlt_position length = mlt_filter_get_length2( filter, frame );
+		mlt_position pos = mlt_filter_get_position( filter, frame );
 		int h = *height;
 		int w = *width;
 
 		// Service locks are for concurrency control
 		mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
-		// Handle signal from app to re-init data
-		if ( mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter) , "refresh" ) )
-		{
-			mlt_properties_set( MLT_FILTER_PROPERTIES(filter) , "refresh", NULL );
-			data->initialized = 0;
-		}
-
-		if ( !vectors) {
+		if ( !have_results ) {
 			if ( !data->initialized )
 			{
 				// Initialize our context
 				data->initialized = 1;
+				if ( data->stab->prev )
+				{
+					// Analyze again after a refresh
+					stabilize_stop(data->stab);
+					if (data->stab->transs) tlist_fini(data->stab->transs);
+					data->stab->transs = NULL;
+					free_results(data);
+				}
 				data->stab->width=w;
 				data->stab->height=h;
 				if (*format==mlt_image_yuv420p) data->stab->framesize=w*h* 3/2;//( mlt_image_format_size ( *format, w,h , 0) ; // 3/2 =1 too small
@@ -158,36 +346,58 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				data->stab->contrast_threshold = mlt_properties_get_double( MLT_FILTER_PROPERTIES(filter) , "mincontrast" );
 				stabilize_configure(data->stab);
 			}
-				// Analyse
-				mlt_position pos = mlt_filter_get_position( filter, frame );
-				stabilize_filter_video ( data->stab , *image, *format );
-
-				// On last frame
-				if ( pos == length - 1 )
-				{
-					serialize_vectors( data , length );
-				}
+			// Analyse until every position has its result
+			if ( data->initialized == 1 && w == data->stab->width && h == data->stab->height
+				 && ( data->results_len != length || data->analyzed_count < length ) )
+				analyze_frame( filter, data, *image, *format, pos, length );
 		}
 		else
 		{
-			if ( data->initialized!=1  )
+			if ( data->initialized != 2 )
 			{
+				// Load analysis results from property or file
 				char *interps = mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "rescale.interp" );
+				int interp = 2; // default to bilinear
+				Transform* tx = NULL;
+				int tx_len = length;
 
-				if ( data->initialized != 2 )
-				{
-					// Load analysis results from property
-					data->initialized = 2;
+				if ( interps && ( strcmp( interps, "nearest" ) == 0 || strcmp( interps, "neighbor" ) == 0 ) )
+					interp = 0;
+				else if ( interps && ( strcmp( interps, "tiles" ) == 0 || strcmp( interps, "fast_bilinear" ) == 0 ) )
+					interp = 1;
 
-					int interp = 2; // default to bilinear
+				if ( vectors )
+				{
 					float scale_zoom=1.0;
-					if ( *width != mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "meta.media.width" ) )
-						scale_zoom = (float) *width / (float) mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "meta.media.width" );
-					if ( strcmp( interps, "nearest" ) == 0 || strcmp( interps, "neighbor" ) == 0 )
-						interp = 0;
-					else if ( strcmp( interps, "tiles" ) == 0 || strcmp( interps, "fast_bilinear" ) == 0 )
-						interp = 1;
+					int media_width = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "meta.media.width" );
+					if ( media_width > 0 && *width != media_width )
+						scale_zoom = (float) *width / (float) media_width;
+					tx = deserialize_vectors( vectors, length, scale_zoom );
+				}
+				else if ( data->results )
+				{
+					// The results are relative to the size they were analyzed at
+					float scale_zoom = (float) *width / (float) data->results_width;
+					int i;
+					tx_len = data->results_len;
+					tx = malloc( sizeof(Transform) * tx_len );
+					for ( i = 0; tx && i < tx_len; i++ )
+					{
+						tx[i] = data->results[i];
+						tx[i].x *= scale_zoom;
+						tx[i].y *= scale_zoom;
+						tx[i].zoom *= scale_zoom;
+						tx[i].extra = 0;
+					}
+				}
 
+				if ( tx )
+				{
+					data->initialized = 2;
+					free(data->trans->src);
+					free(data->trans->trans);
+					data->trans->src = NULL;
+					data->trans->trans = NULL;
 					data->trans->interpoltype = interp;
 					data->trans->smoothing = mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "smoothing" );
 					data->trans->maxshift = mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "maxshift" );
@@ -199,18 +409,17 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 					data->trans->optzoom = mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "optzoom" );
 					data->trans->sharpen = mlt_properties_get_double( MLT_FILTER_PROPERTIES(filter), "sharpen" );
 
-					transform_configure(data->trans,w,h,*format ,*image, deserialize_vectors(  vectors, length , scale_zoom ),length);
-
-				}
-				if ( data->initialized == 2 )
-				{
-					// Stabilize
-					float pos = mlt_filter_get_position( filter, frame );
-					data->trans->current_trans=pos;
-					transform_filter_video(data->trans, *image, *format );
-
+					// The transforms are smoothed once here for every position
+					if ( transform_configure(data->trans,w,h,*format ,*image, tx, tx_len) )
+						data->initialized = 0;
 				}
-		}
+			}
+			if ( data->initialized == 2 && pos >= 0 && w == data->trans->width_src && h == data->trans->height_src )
+			{
+				// Stabilize the frame at any position
+				data->trans->current_trans=pos;
+				transform_filter_video(data->trans, *image, *format );
+			}
 		}
 		mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 	}
@@ -228,11 +437,17 @@ static void filter_close( mlt_filter parent )
 {
 	videostab2_data* data = parent->child;
 	if (data){
-		if (data->stab) stabilize_stop(data->stab);
+		if (data->stab){
+			stabilize_stop(data->stab);
+			if (data->stab->transs) tlist_fini(data->stab->transs);
+			free(data->stab);
+		}
 		if (data->trans){
 			free(data->trans->src);
+			free(data->trans->trans);
 			free (data->trans);
 		}
+		free_results( data );
 		free( data );
 	}
 	parent->close = NULL;
@@ -268,6 +483,7 @@ mlt_filter filter_videostab2_init( mlt_profile profile, mlt_service_type type, c
 			return NULL;
 		}
 
+		data->last_pos = -1;
 		parent->child = data;
 		parent->close = filter_close;
 		parent->process = filter_process;
@@ -0,0 +1,162 @@
+/*
+ * chroma_key.h -- the chroma distance keyer of the chroma filters
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CHROMA_KEY_H
+#define CHROMA_KEY_H
+
+#include <framework/mlt_frame.h>
+#include <framework/mlt_properties.h>
+
+#include <stdint.h>
+
+// Do not key bands shorter than this in their own thread.
+#define CHROMA_KEY_MIN_SLICE_HEIGHT (16)
+
+/** The distance of a pixel from the key is the larger of the distances of
+ * its U and V from those of the key. A pixel within the variance is keyed
+ * to 0, one further than the variance and the softness is left at 255, and
+ * those between get a linear ramp. A softness of 0 gives a hard key.
+ */
+
+typedef struct
+{
+	int u;
+	int v;
+	int variance;  ///< -1 to 255
+	int softness;  ///< 1 to 255
+	int ramp;      ///< 255 / softness in 8-bit fixed point
+}
+chroma_key;
+
+typedef void ( *chroma_key_function )( const chroma_key *key, const uint8_t *yuv, int width, uint8_t *out );
+
+static inline int chroma_key_clamp( int value, int low, int high )
+{
+	return value < low ? low : value > high ? high : value;
+}
+
+/** Set up a key from the key, variance and softness properties of a filter.
+ */
+
+static inline void chroma_key_init( chroma_key *key, mlt_properties properties )
+{
+	int32_t key_val = mlt_properties_get_int( properties, "key" );
+	int r = ( key_val >> 24 ) & 0xff;
+	int g = ( key_val >> 16 ) & 0xff;
+	int b = ( key_val >>  8 ) & 0xff;
+	int u, v;
+
+	RGB2UV_601_SCALED( r, g, b, u, v );
+	key->u = u;
+	key->v = v;
+	key->variance = chroma_key_clamp( 200 * mlt_properties_get_double( properties, "variance" ), -1, 255 );
+	key->softness = chroma_key_clamp( 200 * mlt_properties_get_double( properties, "softness" ), 1, 255 );
+	key->ramp = ( 255 << 8 ) / key->softness;
+}
+
+static inline uint8_t chroma_key_value( const chroma_key *key, int u, int v )
+{
+	int du = u > key->u ? u - key->u : key->u - u;
+	int dv = v > key->v ? v - key->v : key->v - v;
+	int d = chroma_key_clamp( ( du > dv ? du : dv ) - key->variance, 0, key->softness );
+	return ( d * key->ramp + 255 ) >> 8;
+}
+
+/** Key the pixels of a yuv422 row from x on.
+ *
+ * An odd pixel has the average chroma of its pair and the next one, except
+ * at the end of the row.
+ */
+
+static void chroma_key_row_c( const chroma_key *key, const uint8_t *yuv, int width, uint8_t *out, int x )
+{
+	for ( ; x < width; x ++ )
+	{
+		const uint8_t *p = yuv + ( x & ~1 ) * 2;
+		if ( !( x & 1 ) )
+			out[x] = chroma_key_value( key, p[1], x + 1 < width ? p[3] : p[-1] );
+		else if ( x + 2 < width )
+			out[x] = chroma_key_value( key, ( p[1] + p[5] ) / 2, ( p[3] + p[7] ) / 2 );
+		else
+			out[x] = chroma_key_value( key, p[1], p[3] );
+	}
+}
+
+static void chroma_key_row( const chroma_key *key, const uint8_t *yuv, int width, uint8_t *out )
+{
+	chroma_key_row_c( key, yuv, width, out, 0 );
+}
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <emmintrin.h>
+
+#define CHROMA_KEY_SSE2 __attribute__((target("sse2")))
+
+// The larger of the distances of each pair of U and V
+static CHROMA_KEY_SSE2 inline __m128i chroma_key_distance_sse2( __m128i chroma, __m128i uv )
+{
+	__m128i d = _mm_max_epi16( _mm_sub_epi16( chroma, uv ), _mm_sub_epi16( uv, chroma ) );
+	return _mm_max_epi16( d, _mm_srli_epi32( d, 16 ) );
+}
+
+static CHROMA_KEY_SSE2 void chroma_key_row_sse2( const chroma_key *key, const uint8_t *yuv, int width, uint8_t *out )
+{
+	const __m128i uv = _mm_set1_epi32( key->u | ( key->v << 16 ) );
+	const __m128i variance = _mm_set1_epi16( key->variance );
+	const __m128i softness = _mm_set1_epi16( key->softness );
+	const __m128i ramp = _mm_set1_epi16( key->ramp );
+	const __m128i round = _mm_set1_epi16( 255 );
+	const __m128i low = _mm_set1_epi32( 0xffff );
+	const __m128i zero = _mm_setzero_si128();
+	int x;
+
+	// 8 pixels at a time, with the chroma of the pair after them
+	for ( x = 0; x + 10 <= width; x += 8 )
+	{
+		__m128i chroma = _mm_srli_epi16( _mm_loadu_si128( (const __m128i*) ( yuv + x * 2 ) ), 8 );
+		__m128i next = _mm_srli_epi16( _mm_loadu_si128( (const __m128i*) ( yuv + x * 2 + 4 ) ), 8 );
+		__m128i even = chroma_key_distance_sse2( chroma, uv );
+		__m128i odd = chroma_key_distance_sse2( _mm_srli_epi16( _mm_add_epi16( chroma, next ), 1 ), uv );
+		__m128i d = _mm_or_si128( _mm_and_si128( even, low ), _mm_slli_epi32( odd, 16 ) );
+		d = _mm_min_epi16( _mm_max_epi16( _mm_sub_epi16( d, variance ), zero ), softness );
+		d = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( d, ramp ), round ), 8 );
+		_mm_storel_epi64( (__m128i*) ( out + x ), _mm_packus_epi16( d, zero ) );
+	}
+	chroma_key_row_c( key, yuv, width, out, x );
+}
+
+static chroma_key_function chroma_key_detect( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return chroma_key_row_sse2;
+	return chroma_key_row;
+}
+
+#else
+
+static chroma_key_function chroma_key_detect( void )
+{
+	return chroma_key_row;
+}
+
+#endif
+
+#endif
@@ -18,23 +18,49 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include "chroma_key.h"
+
 #include <framework/mlt_filter.h>
 #include <stdlib.h>
 #include <framework/mlt_factory.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_producer.h>
+#include <framework/mlt_pool.h>
+#include <framework/mlt_slices.h>
 
-static inline int in_range( uint8_t v, uint8_t c, int var )
+struct chroma_slice_desc
 {
-	return ( ( int )v >= c - var ) && ( ( int )v <= c + var );
-}
+	chroma_key key;
+	uint8_t *image;
+	uint8_t *alpha;
+	int width;
+	int height;
+};
 
-static inline uint8_t alpha_value( uint8_t a, uint8_t *p, uint8_t u, uint8_t v, int var, int odd )
+static int chroma_slice_proc( int id, int index, int jobs, void *cookie )
 {
-	if ( odd == 0 )
-		return ( in_range( *( p + 1 ), u, var ) && in_range( *( p + 3 ), v, var ) ) ? 0 : a;
-	else
-		return ( in_range( ( *( p + 1 ) + *( p + 5 ) ) / 2, u, var ) && in_range( ( *( p + 3 ) + *( p + 7 ) ) / 2, v, var ) ) ? 0 : a;
+	struct chroma_slice_desc *desc = (struct chroma_slice_desc *) cookie;
+	static chroma_key_function key_row = NULL;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	uint8_t *key = mlt_pool_alloc( w );
+	int x;
+
+	if ( !key_row )
+		key_row = chroma_key_detect();
+
+	for ( ; y < yend; y++ )
+	{
+		uint8_t *alpha = desc->alpha + y * w;
+
+		// Keep the alpha outside of the key and ramp it down to 0 inside
+		key_row( &desc->key, desc->image + y * w * 2, w, key );
+		for ( x = 0; x < w; x++ )
+			alpha[x] = ( alpha[x] * key[x] + 255 ) >> 8;
+	}
+	mlt_pool_release( key );
+	return 0;
 }
 
 /** Get the images and map the chroma to the alpha of the frame.
@@ -43,29 +69,23 @@ static inline uint8_t alpha_value( uint8_t a, uint8_t *p, uint8_t u, uint8_t v,
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	mlt_filter this = mlt_frame_pop_service( frame );
-	int variance = 200 * mlt_properties_get_double( MLT_FILTER_PROPERTIES( this ), "variance" );
-	int32_t key_val = mlt_properties_get_int( MLT_FILTER_PROPERTIES( this ), "key" );
-	uint8_t r = ( key_val >> 24 ) & 0xff;
-	uint8_t g = ( key_val >> 16 ) & 0xff;
-	uint8_t b = ( key_val >>  8 ) & 0xff;
-	uint8_t u, v;
-
-	RGB2UV_601_SCALED( r, g, b, u, v );
 
 	*format = mlt_image_yuv422;
 	if ( mlt_frame_get_image( frame, image, format, width, height, writable ) == 0 )
 	{
-		uint8_t *alpha = mlt_frame_get_alpha_mask( frame );
-		uint8_t *p = *image;
-		int size = *width * *height / 2;
-		while ( size -- )
-		{
-			*alpha = alpha_value( *alpha, p, u, v, variance, 0 );
-			alpha ++;
-			*alpha = alpha_value( *alpha, p, u, v, variance, 1 );
-			alpha ++;
-			p += 4;
-		}
+		struct chroma_slice_desc desc;
+
+		chroma_key_init( &desc.key, MLT_FILTER_PROPERTIES( this ) );
+		desc.image = *image;
+		desc.alpha = mlt_frame_get_alpha_mask( frame );
+		desc.width = *width;
+		desc.height = *height;
+
+		int jobs = MIN( mlt_slices_count_normal(), *height / CHROMA_KEY_MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, chroma_slice_proc, &desc );
+		else
+			chroma_slice_proc( 0, 0, 1, &desc );
 	}
 
 	return 0;
@@ -91,6 +111,7 @@ mlt_filter filter_chroma_init( mlt_profile profile, mlt_service_type type, const
 	{
 		mlt_properties_set( MLT_FILTER_PROPERTIES( this ), "key", arg == NULL ? "0x0000ff00" : arg );
 		mlt_properties_set_double( MLT_FILTER_PROPERTIES( this ), "variance", 0.15 );
+		mlt_properties_set_double( MLT_FILTER_PROPERTIES( this ), "softness", 0 );
 		this->process = filter_process;
 	}
 	return this;
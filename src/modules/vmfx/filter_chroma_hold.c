@@ -18,23 +18,56 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include "chroma_key.h"
+
 #include <framework/mlt_filter.h>
 #include <stdlib.h>
 #include <framework/mlt_factory.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_producer.h>
+#include <framework/mlt_pool.h>
+#include <framework/mlt_slices.h>
 
-static inline int in_range( uint8_t v, uint8_t c, int var )
+struct chroma_hold_slice_desc
 {
-	return ( ( int )v >= c - var ) && ( ( int )v <= c + var );
-}
+	chroma_key key;
+	uint8_t *image;
+	int width;
+	int height;
+};
 
-static inline uint8_t alpha_value( uint8_t a, uint8_t *p, uint8_t u, uint8_t v, int var, int odd )
+static int chroma_hold_slice_proc( int id, int index, int jobs, void *cookie )
 {
-	if ( odd == 0 )
-		return ( in_range( *( p + 1 ), u, var ) && in_range( *( p + 3 ), v, var ) ) ? 0 : a;
-	else
-		return ( in_range( ( *( p + 1 ) + *( p + 5 ) ) / 2, u, var ) && in_range( ( *( p + 3 ) + *( p + 7 ) ) / 2, v, var ) ) ? 0 : a;
+	struct chroma_hold_slice_desc *desc = (struct chroma_hold_slice_desc *) cookie;
+	static chroma_key_function key_row = NULL;
+	int w = desc->width;
+	int y = desc->height * index / jobs;
+	int yend = desc->height * ( index + 1 ) / jobs;
+	uint8_t *key = mlt_pool_alloc( w );
+	int x;
+
+	if ( !key_row )
+		key_row = chroma_key_detect();
+
+	for ( ; y < yend; y++ )
+	{
+		uint8_t *p = desc->image + y * w * 2;
+
+		// Keep the colour inside the key and ramp it down to grey outside,
+		// a pair of pixels at a time for their shared chroma
+		key_row( &desc->key, p, w, key );
+		for ( x = 0; x + 1 < w; x += 2, p += 4 )
+		{
+			int k = key[x];
+			if ( k )
+			{
+				p[1] = ( p[1] * ( 255 - k ) + 128 * k + 127 ) / 255;
+				p[3] = ( p[3] * ( 255 - k ) + 128 * k + 127 ) / 255;
+			}
+		}
+	}
+	mlt_pool_release( key );
+	return 0;
 }
 
 /** Get the images and map the chroma to the alpha of the frame.
@@ -43,31 +76,22 @@ static inline uint8_t alpha_value( uint8_t a, uint8_t *p, uint8_t u, uint8_t v,
 static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
 {
 	mlt_filter this = mlt_frame_pop_service( frame );
-	int variance = 200 * mlt_properties_get_double( MLT_FILTER_PROPERTIES( this ), "variance" );
-	int32_t key_val = mlt_properties_get_int( MLT_FILTER_PROPERTIES( this ), "key" );
-	uint8_t r = ( key_val >> 24 ) & 0xff;
-	uint8_t g = ( key_val >> 16 ) & 0xff;
-	uint8_t b = ( key_val >>  8 ) & 0xff;
-	uint8_t u, v;
-
-	RGB2UV_601_SCALED( r, g, b, u, v );
 
 	*format = mlt_image_yuv422;
 	if ( mlt_frame_get_image( frame, image, format, width, height, writable ) == 0 )
 	{
-		uint8_t alpha = 0;
-		uint8_t *p = *image;
-		int size = *width * *height / 2;
-		while ( size -- )
-		{
-			alpha = alpha_value( 255, p, u, v, variance, 0 );
-			if ( alpha ) 
-				*( p + 1 )= 128;
-			alpha = alpha_value( 255, p, u, v, variance, 1 );
-			if ( alpha ) 
-				*( p + 3 ) = 128;
-			p += 4;
-		}
+		struct chroma_hold_slice_desc desc;
+
+		chroma_key_init( &desc.key, MLT_FILTER_PROPERTIES( this ) );
+		desc.image = *image;
+		desc.width = *width;
+		desc.height = *height;
+
+		int jobs = MIN( mlt_slices_count_normal(), *height / CHROMA_KEY_MIN_SLICE_HEIGHT );
+		if ( jobs > 1 )
+			mlt_slices_run_normal( jobs, chroma_hold_slice_proc, &desc );
+		else
+			chroma_hold_slice_proc( 0, 0, 1, &desc );
 	}
 
 	return 0;
@@ -93,6 +117,7 @@ mlt_filter filter_chroma_hold_init( mlt_profile profile, mlt_service_type type,
 	{
 		mlt_properties_set( MLT_FILTER_PROPERTIES( this ), "key", arg == NULL ? "0xc0000000" : arg );
 		mlt_properties_set_double( MLT_FILTER_PROPERTIES( this ), "variance", 0.15 );
+		mlt_properties_set_double( MLT_FILTER_PROPERTIES( this ), "softness", 0 );
 		this->process = filter_process;
 	}
 	return this;
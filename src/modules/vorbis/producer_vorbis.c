@@ -21,6 +21,9 @@
 #include <framework/mlt_producer.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_profile.h>
+#include <framework/mlt_log.h>
+#include <framework/mlt_job.h>
+#include <framework/mlt_sidecar.h>
 
 // vorbis Header files
 #include <vorbis/codec.h>
@@ -28,9 +31,14 @@
 
 // System header files
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 
+#define INDEX_MAGIC "MLTVIDX1"
+#define INDEX_SPACING ( 64 * 1024 )   // bytes of the stream between the pages of the seek index
+#define READ_SAMPLES ( 4096 )         // samples of each channel decoded at a time
+
 // Forward references.
 static int producer_open( mlt_producer this, mlt_profile profile, char *file );
 static int producer_get_frame( mlt_producer this, mlt_frame_ptr frame, int index );
@@ -64,6 +72,280 @@ static sw_metadata *vorbis_metadata_from_str (char * str)
  	return meta;
 }
 
+/** The pages of a stream and the samples before them, for seeking with ov_raw_seek().
+*/
+
+typedef struct
+{
+	char *resource;
+	long serial;
+	int64_t count;
+	int64_t *offsets;     // the byte offsets of pages in the file
+	int64_t *samples;     // the samples of the stream before the pages
+	int ready;            // set once the entries are complete
+	mlt_job job;
+}
+vorbis_index;
+
+/** The samples decoded ahead of the next frame, planar with capacity samples per channel.
+*/
+
+typedef struct
+{
+	float *data;
+	int capacity;
+	int channels;
+	int used;
+	int skip;             // samples to discard after seeking to a page
+}
+vorbis_audio;
+
+static int index_is_ready( vorbis_index *index )
+{
+	return index && __atomic_load_n( &index->ready, __ATOMIC_ACQUIRE );
+}
+
+static void index_set( vorbis_index *index, int64_t *offsets, int64_t *samples, int64_t count )
+{
+	index->offsets = offsets;
+	index->samples = samples;
+	index->count = count;
+	__atomic_store_n( &index->ready, 1, __ATOMIC_RELEASE );
+}
+
+/** Load a seek index stored by index_job().
+*/
+
+static int index_load( vorbis_index *index )
+{
+	mlt_sidecar record = mlt_sidecar_open( index->resource, "vorbis_index", NULL );
+	size_t size = 0;
+	const char *data = mlt_sidecar_data( record, &size );
+	size_t head = 8 + 2 * sizeof( int64_t );
+	int64_t serial, count;
+	int error = 1;
+
+	if ( data && size >= head && !memcmp( data, INDEX_MAGIC, 8 ) )
+	{
+		memcpy( &serial, data + 8, sizeof( serial ) );
+		memcpy( &count, data + 8 + sizeof( serial ), sizeof( count ) );
+		if ( serial == index->serial && count > 0 && size == head + 2 * count * sizeof( int64_t ) )
+		{
+			int64_t *offsets = malloc( count * sizeof( int64_t ) );
+			int64_t *samples = malloc( count * sizeof( int64_t ) );
+			if ( offsets && samples )
+			{
+				memcpy( offsets, data + head, count * sizeof( int64_t ) );
+				memcpy( samples, data + head + count * sizeof( int64_t ), count * sizeof( int64_t ) );
+				index_set( index, offsets, samples, count );
+				error = 0;
+			}
+			else
+			{
+				free( offsets );
+				free( samples );
+			}
+		}
+	}
+	mlt_sidecar_close( record );
+	return error;
+}
+
+static void index_store( vorbis_index *index )
+{
+	size_t head = 8 + 2 * sizeof( int64_t );
+	size_t size = head + 2 * index->count * sizeof( int64_t );
+	char *data = malloc( size );
+
+	if ( data )
+	{
+		int64_t serial = index->serial;
+		memcpy( data, INDEX_MAGIC, 8 );
+		memcpy( data + 8, &serial, sizeof( serial ) );
+		memcpy( data + 8 + sizeof( serial ), &index->count, sizeof( index->count ) );
+		memcpy( data + head, index->offsets, index->count * sizeof( int64_t ) );
+		memcpy( data + head + index->count * sizeof( int64_t ), index->samples, index->count * sizeof( int64_t ) );
+		mlt_sidecar_store( index->resource, "vorbis_index", NULL, data, size );
+		free( data );
+	}
+}
+
+/** Build the seek index by reading the pages of the file without decoding them.
+*/
+
+static int index_job( mlt_job job, void *cookie )
+{
+	vorbis_index *index = cookie;
+	FILE *input = mlt_fopen( index->resource, "rb" );
+	ogg_sync_state sync;
+	ogg_page page;
+	int64_t *offsets = NULL, *samples = NULL;
+	int64_t count = 0, allocated = 0;
+	int64_t offset = 0, last = 0, granule = -1;
+	int error = input == NULL;
+
+	ogg_sync_init( &sync );
+	while ( !error && !( error = mlt_job_yield( job ) ) )
+	{
+		char *buffer;
+		size_t bytes;
+		long n;
+
+		// Take the pages in the buffer, counting the bytes skipped or taken
+		while ( !error && ( n = ogg_sync_pageseek( &sync, &page ) ) != 0 )
+		{
+			if ( n > 0 && ogg_page_serialno( &page ) == index->serial )
+			{
+				// Only the pages after some audio, as the headers do not seek
+				if ( granule > 0 && ( !count || offset - last >= INDEX_SPACING ) )
+				{
+					if ( count == allocated )
+					{
+						int64_t *more_offsets, *more_samples;
+						allocated = allocated ? allocated * 2 : 1024;
+						more_offsets = realloc( offsets, allocated * sizeof( int64_t ) );
+						if ( more_offsets )
+							offsets = more_offsets;
+						more_samples = realloc( samples, allocated * sizeof( int64_t ) );
+						if ( more_samples )
+							samples = more_samples;
+						error = !more_offsets || !more_samples;
+					}
+					if ( !error )
+					{
+						offsets[ count ] = offset;
+						samples[ count ] = granule;
+						count++;
+						last = offset;
+					}
+				}
+				if ( ogg_page_granulepos( &page ) >= 0 )
+					granule = ogg_page_granulepos( &page );
+			}
+			offset += n > 0 ? n : -n;
+		}
+		buffer = ogg_sync_buffer( &sync, INDEX_SPACING );
+		bytes = buffer ? fread( buffer, 1, INDEX_SPACING, input ) : 0;
+		if ( bytes == 0 )
+			break;
+		ogg_sync_wrote( &sync, bytes );
+	}
+	ogg_sync_clear( &sync );
+	if ( input )
+		fclose( input );
+
+	if ( !error && count > 0 )
+	{
+		index_set( index, offsets, samples, count );
+		index_store( index );
+		mlt_log_verbose( NULL, "[producer vorbis] indexed %s\n", index->resource );
+		return 0;
+	}
+	free( offsets );
+	free( samples );
+	return 1;
+}
+
+static void index_close( void *arg )
+{
+	vorbis_index *index = arg;
+	if ( index )
+	{
+		mlt_job_close( index->job );
+		free( index->offsets );
+		free( index->samples );
+		free( index->resource );
+		free( index );
+	}
+}
+
+/** Make room for samples in the buffer of decoded audio.
+*/
+
+static int audio_reserve( vorbis_audio *audio, int channels, int samples )
+{
+	if ( audio->channels != channels )
+	{
+		audio->channels = channels;
+		audio->used = 0;
+		audio->capacity = 0;
+	}
+	if ( samples > audio->capacity )
+	{
+		int capacity = MAX( samples, audio->capacity * 2 );
+		float *data = malloc( channels * capacity * sizeof( float ) );
+		int c;
+		if ( !data )
+			return 1;
+		for ( c = 0; c < channels && audio->used; c++ )
+			memcpy( data + c * capacity, audio->data + c * audio->capacity, audio->used * sizeof( float ) );
+		free( audio->data );
+		audio->data = data;
+		audio->capacity = capacity;
+	}
+	return 0;
+}
+
+/** Remove the samples of a frame from the front of the buffer.
+*/
+
+static void audio_drop( vorbis_audio *audio, int samples )
+{
+	int c;
+	samples = MIN( samples, audio->used );
+	audio->used -= samples;
+	for ( c = 0; c < audio->channels && audio->used; c++ )
+		memmove( audio->data + c * audio->capacity, audio->data + c * audio->capacity + samples, audio->used * sizeof( float ) );
+}
+
+static void audio_close( void *arg )
+{
+	vorbis_audio *audio = arg;
+	if ( audio )
+	{
+		free( audio->data );
+		free( audio );
+	}
+}
+
+/** Seek to a sample of the stream.
+ *
+ * With the index, this goes to the last page before the sample and returns
+ * the samples to discard from there, which is much cheaper than the
+ * bisection of the file by ov_pcm_seek().
+ *
+ * \return the samples to discard before the sample
+*/
+
+static int producer_seek( OggVorbis_File *ov, vorbis_index *index, int64_t sample )
+{
+	if ( index_is_ready( index ) )
+	{
+		int64_t low = 0, high = index->count;
+
+		// Find the last page with fewer samples before it
+		while ( low < high )
+		{
+			int64_t middle = ( low + high ) / 2;
+			if ( index->samples[ middle ] < sample )
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		for ( low--; low >= 0 && low >= high - 3; low-- )
+		{
+			ogg_int64_t start;
+			if ( ov_raw_seek( ov, index->offsets[ low ] ) )
+				break;
+			start = ov_pcm_tell( ov );
+			if ( start >= 0 && start <= sample && sample - start < INT32_MAX )
+				return sample - start;
+		}
+	}
+	ov_pcm_seek( ov, sample );
+	return 0;
+}
+
 /** Constructor for libvorbis.
 */
 
@@ -177,6 +459,27 @@ static int producer_open( mlt_producer this, mlt_profile profile, char *file )
 				mlt_properties_set_int( properties, "audio_frequency", (int) vi->rate );
 				mlt_properties_set_int( properties, "audio_channels", vi->channels );
 
+				// Seek through an index of the pages of a single stream
+				if ( ov_streams( ov ) == 1 )
+				{
+					vorbis_index *index = calloc( 1, sizeof( vorbis_index ) );
+					if ( index )
+					{
+						index->resource = strdup( file );
+						index->serial = ov_serialnumber( ov, -1 );
+						if ( !index->resource )
+						{
+							free( index );
+							index = NULL;
+						}
+						else if ( index_load( index ) )
+						{
+							index->job = mlt_job_submit( mlt_job_normal, index_job, index );
+						}
+					}
+					mlt_properties_set_data( properties, "_vorbis_index", index, 0, index_close, NULL );
+				}
+
 				// Set some media metadata
 				mlt_properties_set_int( properties, "meta.media.nb_streams", 1 );
 				mlt_properties_set_int( properties, "audio_index", 0 );
@@ -198,14 +501,6 @@ static int producer_open( mlt_producer this, mlt_profile profile, char *file )
 	return error;
 }
 
-/** Convert a frame position to a time code.
-*/
-
-static double producer_time_of_frame( mlt_producer this, mlt_position position )
-{
-	return ( double )position / mlt_producer_get_fps( this );
-}
-
 /** Get the audio from a frame.
 */
 
@@ -225,6 +520,9 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	// Get the ogg vorbis file
 	OggVorbis_File *ov = mlt_properties_get_data( properties, "ogg_vorbis_file", NULL );
 
+	// Get the seek index, which is NULL if the file has none
+	vorbis_index *index = mlt_properties_get_data( properties, "_vorbis_index", NULL );
+
 	// Obtain the expected frame number
 	mlt_position expected = mlt_properties_get_position( properties, "audio_expected" );
 
@@ -234,11 +532,8 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	// Get the vorbis info
 	vorbis_info *vi = ov_info( ov, -1 );
 
-	// Obtain the audio buffer
-	int16_t *audio_buffer = mlt_properties_get_data( properties, "audio_buffer", NULL );
-
-	// Get amount of audio used
-	int audio_used =  mlt_properties_get_int( properties, "audio_used" );
+	// Obtain the buffer of decoded audio
+	vorbis_audio *audio = mlt_properties_get_data( properties, "_vorbis_audio", NULL );
 
 	// Number of frames to ignore (for ffwd)
 	int ignore = 0;
@@ -247,34 +542,31 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	int paused = 0;
 
 	// Check for audio buffer and create if necessary
-	if ( audio_buffer == NULL )
+	if ( audio == NULL )
 	{
-		// Allocate the audio buffer
-		audio_buffer = mlt_pool_alloc( 131072 * sizeof( int16_t ) );
-
-		// And store it on properties for reuse
-		mlt_properties_set_data( properties, "audio_buffer", audio_buffer, 0, mlt_pool_release, NULL );
+		audio = calloc( 1, sizeof( vorbis_audio ) );
+		mlt_properties_set_data( properties, "_vorbis_audio", audio, 0, audio_close, NULL );
 	}
 
 	// Seek if necessary
-	if ( position != expected )
+	if ( audio && position != expected )
 	{
 		if ( position + 1 == expected )
 		{
 			// We're paused - silence required
 			paused = 1;
 		}
-		else if ( position > expected && ( position - expected ) < 250 )
+		else if ( !index_is_ready( index ) && position > expected && ( position - expected ) < 250 )
 		{
-			// Fast forward - seeking is inefficient for small distances - just ignore following frames
+			// Fast forward - seeking without the index is inefficient for small distances - just ignore following frames
 			ignore = position - expected;
 		}
 		else
 		{
-			// Seek to the required position
-			ov_time_seek( ov, producer_time_of_frame( this, position ) );
+			// Seek to the first sample of the required position
+			audio->skip = producer_seek( ov, index, mlt_sample_calculator_to_now( fps, vi->rate, position ) );
 			expected = position;
-			audio_used = 0;
+			audio->used = 0;
 		}
 	}
 
@@ -283,7 +575,7 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	*channels = vi->channels;
 
 	// Get the audio if required
-	if ( !paused )
+	if ( !paused && audio )
 	{
 		// Bitstream section
 		int current_section;
@@ -291,48 +583,66 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		// Get the number of samples for the current frame
 		*samples = mlt_sample_calculator( fps, *frequency, expected ++ );
 
-		while( *samples > audio_used  )
+		while( *samples > audio->used )
 		{
-			// Read the samples
-			int bytes = ov_read( ov, ( char * )( &audio_buffer[ audio_used * 2 ] ), 4096, 0, 2, 1, &current_section );
+			// Read the samples as planar floats
+			float **pcm = NULL;
+			long count = ov_read_float( ov, &pcm, READ_SAMPLES, &current_section );
+			int skipped, have, c;
 
 			// Break if error or eof
-			if ( bytes <= 0 )
+			if ( count <= 0 )
+				break;
+
+			// Discard the samples before the position sought
+			skipped = MIN( count, audio->skip );
+			audio->skip -= skipped;
+			count -= skipped;
+			if ( audio_reserve( audio, *channels, audio->used + count ) )
 				break;
 
+			// A chained section may have fewer channels
+			have = MIN( ov_info( ov, current_section )->channels, *channels );
+			for ( c = 0; c < *channels; c++ )
+			{
+				float *p = audio->data + c * audio->capacity + audio->used;
+				if ( c < have )
+					memcpy( p, pcm[ c ] + skipped, count * sizeof( float ) );
+				else
+					memset( p, 0, count * sizeof( float ) );
+			}
+
 			// Increment number of samples used
-			audio_used += bytes / ( sizeof( int16_t ) * *channels );
+			audio->used += count;
 
 			// Handle ignore
-			while ( ignore && audio_used >= *samples )
+			while ( ignore && audio->used >= *samples )
 			{
 				ignore --;
-				audio_used -= *samples;
-				memmove( audio_buffer, &audio_buffer[ *samples * *channels ], audio_used * sizeof( int16_t ) * *channels );
+				audio_drop( audio, *samples );
 				*samples = mlt_sample_calculator( fps, *frequency, expected ++ );
 			}
 		}
 
 		// Now handle the audio if we have enough
-		if ( audio_used >= *samples )
+		if ( audio->used >= *samples )
 		{
-			int size = *samples * *channels * sizeof( int16_t );
-
-			*format = mlt_audio_s16;
-			*buffer = mlt_pool_alloc( size );
-			memcpy( *buffer, audio_buffer, size );
-			audio_used -= *samples;
-			memmove( audio_buffer, &audio_buffer[ *samples * *channels ], audio_used * *channels * sizeof( int16_t ) );
+			int size = *samples * *channels * sizeof( float );
+			float *out = mlt_pool_alloc( size );
+			int c;
+
+			for ( c = 0; c < *channels; c++ )
+				memcpy( out + c * *samples, audio->data + c * audio->capacity, *samples * sizeof( float ) );
+			audio_drop( audio, *samples );
+			*format = mlt_audio_float;
+			*buffer = out;
 			mlt_frame_set_audio( frame, *buffer, *format, size, mlt_pool_release );
 		}
 		else
 		{
 			mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
-			audio_used = 0;
+			audio->used = 0;
 		}
-		
-		// Store the number of audio samples still available
-		mlt_properties_set_int( properties, "audio_used", audio_used );
 	}
 	else
 	{
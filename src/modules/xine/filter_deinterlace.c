@@ -25,6 +25,7 @@
 #include "yadif.h"
 
 #include <framework/mlt_frame.h>
+#include <framework/mlt_slices.h>
 
 #include <string.h>
 #include <stdlib.h>
@@ -32,70 +33,31 @@
 #define YADIF_MODE_TEMPORAL_SPATIAL (0)
 #define YADIF_MODE_TEMPORAL (2)
 
-static yadif_filter *init_yadif( int width, int height )
-{
-	yadif_filter *yadif = mlt_pool_alloc( sizeof( *yadif ) );
-
-	yadif->cpu = 0; // Pure C
-#ifdef USE_SSE
-	yadif->cpu |= AVS_CPU_INTEGER_SSE;
-#endif
-#ifdef USE_SSE2
-	yadif->cpu |= AVS_CPU_SSE2;
-#endif
-	// Create intermediate planar planes
-	yadif->yheight = height;
-	yadif->ywidth  = width;
-	yadif->uvwidth = yadif->ywidth / 2;
-	yadif->ypitch  = ( yadif->ywidth +  15 ) / 16 * 16;
-	yadif->uvpitch = ( yadif->uvwidth + 15 ) / 16 * 16;
-	yadif->ysrc  = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->ypitch );
-	yadif->usrc  = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch);
-	yadif->vsrc  = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->yprev = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->ypitch );
-	yadif->uprev = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->vprev = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->ynext = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->ypitch );
-	yadif->unext = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->vnext = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->ydest = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->ypitch );
-	yadif->udest = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-	yadif->vdest = (unsigned char *) mlt_pool_alloc( yadif->yheight * yadif->uvpitch );
-
-	return yadif;
-}
+// Do not filter bands shorter than this in their own thread.
+#define MIN_SLICE_HEIGHT (32)
 
-static void close_yadif(yadif_filter *yadif)
+struct yadif_slice_desc
+{
+	int mode;
+	uint8_t *dest;
+	const uint8_t *previous;
+	const uint8_t *current;
+	const uint8_t *next;
+	int width;
+	int height;
+	int order;
+};
+
+static int yadif_slice_proc( int id, int index, int jobs, void *cookie )
 {
-	mlt_pool_release( yadif->ysrc );
-	mlt_pool_release( yadif->usrc );
-	mlt_pool_release( yadif->vsrc );
-	mlt_pool_release( yadif->yprev );
-	mlt_pool_release( yadif->uprev );
-	mlt_pool_release( yadif->vprev );
-	mlt_pool_release( yadif->ynext );
-	mlt_pool_release( yadif->unext );
-	mlt_pool_release( yadif->vnext );
-	mlt_pool_release( yadif->ydest );
-	mlt_pool_release( yadif->udest );
-	mlt_pool_release( yadif->vdest );
-	mlt_pool_release( yadif );
-
-#if defined(__GNUC__) && !defined(PIC)
-	// Set SSSE3 bit to cpu
-	asm (\
-	"mov $1, %%eax \n\t"\
-	"push %%ebx \n\t"\
-	"cpuid \n\t"\
-	"pop %%ebx \n\t"\
-	"mov %%ecx, %%edx \n\t"\
-	"shr $9, %%edx \n\t"\
-	"and $1, %%edx \n\t"\
-	"shl $9, %%edx \n\t"\
-	"and $511, %%ebx \n\t"\
-	"or %%edx, %%ebx \n\t"\
-	: "=b"(yadif->cpu) : "p"(yadif->cpu) : "%eax", "%ecx", "%edx");
-#endif
+	struct yadif_slice_desc *desc = (struct yadif_slice_desc *) cookie;
+	const int pitch = desc->width << 1;
+	const int parity = 0;
+
+	filter_yuv422( desc->mode, desc->dest, pitch, desc->previous, desc->current, desc->next, pitch,
+		desc->width, desc->height, desc->height * index / jobs, desc->height * ( index + 1 ) / jobs,
+		parity, desc->order );
+	return 0;
 }
 
 static int deinterlace_yadif( mlt_frame frame, mlt_filter filter, uint8_t **image, mlt_image_format *format, int *width, int *height, int mode )
@@ -134,7 +96,7 @@ static int deinterlace_yadif( mlt_frame frame, mlt_filter filter, uint8_t **imag
 
 		// Get the current frame's image
 		*format = mlt_image_yuv422;
-		error = mlt_frame_get_image( frame, image, format, width, height, 1 );
+		error = mlt_frame_get_image( frame, image, format, width, height, 0 );
 
 		if ( !error && *image && *format == mlt_image_yuv422 )
 		{
@@ -143,35 +105,27 @@ static int deinterlace_yadif( mlt_frame frame, mlt_filter filter, uint8_t **imag
 
 			if ( !error && next_image && *format == mlt_image_yuv422 )
 			{
-				yadif_filter *yadif = init_yadif( *width, *height );
-				if ( yadif )
+				// Deinterlace the packed image directly in bands of lines
+				int image_size = mlt_image_format_size( *format, *width, *height, NULL );
+				struct yadif_slice_desc desc =
 				{
-					const int order = mlt_properties_get_int( properties, "top_field_first" );
-					const int pitch = *width << 1;
-					const int parity = 0;
-
-					// Convert packed to planar
-					YUY2ToPlanes( *image, pitch, *width, *height, yadif->ysrc,
-						yadif->ypitch, yadif->usrc, yadif->vsrc, yadif->uvpitch, yadif->cpu );
-					YUY2ToPlanes( previous_image, pitch, *width, *height, yadif->yprev,
-						yadif->ypitch, yadif->uprev, yadif->vprev, yadif->uvpitch, yadif->cpu );
-					YUY2ToPlanes( next_image, pitch, *width, *height, yadif->ynext,
-						yadif->ypitch, yadif->unext, yadif->vnext, yadif->uvpitch, yadif->cpu );
-
-					// Deinterlace each plane
-					filter_plane( mode, yadif->ydest, yadif->ypitch, yadif->yprev, yadif->ysrc,
-						yadif->ynext, yadif->ypitch, *width, *height, parity, order, yadif->cpu);
-					filter_plane( mode, yadif->udest, yadif->uvpitch,yadif->uprev, yadif->usrc,
-						yadif->unext, yadif->uvpitch, *width >> 1, *height, parity, order, yadif->cpu);
-					filter_plane( mode, yadif->vdest, yadif->uvpitch, yadif->vprev, yadif->vsrc,
-						yadif->vnext, yadif->uvpitch, *width >> 1, *height, parity, order, yadif->cpu);
-
-					// Convert planar to packed
-					YUY2FromPlanes( *image, pitch, *width, *height, yadif->ydest,
-						yadif->ypitch, yadif->udest, yadif->vdest, yadif->uvpitch, yadif->cpu);
-
-					close_yadif( yadif );
-				}
+					.mode = mode,
+					.dest = mlt_pool_alloc( image_size ),
+					.previous = previous_image,
+					.current = *image,
+					.next = next_image,
+					.width = *width,
+					.height = *height,
+					.order = mlt_properties_get_int( properties, "top_field_first" ),
+				};
+				int jobs = MIN( mlt_slices_count_normal(), *height / MIN_SLICE_HEIGHT );
+
+				if ( jobs > 1 )
+					mlt_slices_run_normal( jobs, yadif_slice_proc, &desc );
+				else
+					yadif_slice_proc( 0, 0, 1, &desc );
+				mlt_frame_set_image( frame, desc.dest, image_size, mlt_pool_release );
+				*image = desc.dest;
 			}
 		}
 	}
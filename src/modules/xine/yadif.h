@@ -27,37 +27,6 @@
 
 #include <stdint.h>
 
-#define AVS_CPU_INTEGER_SSE 0x1
-#define AVS_CPU_SSE2 0x2
-#define AVS_CPU_SSSE3 0x4
-
-typedef struct yadif_filter  {
-	int cpu; // optimization
-	int yheight;
-	int ypitch;
-	int uvpitch;
-	int ywidth;
-	int uvwidth;
-	unsigned char *ysrc;
-	unsigned char *usrc;
-	unsigned char *vsrc;
-	unsigned char *yprev;
-	unsigned char *uprev;
-	unsigned char *vprev;
-	unsigned char *ynext;
-	unsigned char *unext;
-	unsigned char *vnext;
-	unsigned char *ydest;
-	unsigned char *udest;
-	unsigned char *vdest;
-} yadif_filter;
-
-void filter_plane(int mode, uint8_t *dst, int dst_stride, const uint8_t *prev0, const uint8_t *cur0, const uint8_t *next0, int refs, int w, int h, int parity, int tff, int cpu);
-void YUY2ToPlanes(const unsigned char *pSrcYUY2, int nSrcPitchYUY2, int nWidth, int nHeight,
-							   unsigned char * pSrcY, int srcPitchY,
-							   unsigned char * pSrcU,  unsigned char * pSrcV, int srcPitchUV, int cpu);
-void YUY2FromPlanes(unsigned char *pSrcYUY2, int nSrcPitchYUY2, int nWidth, int nHeight,
-							  const unsigned char * pSrcY, int srcPitchY,
-							  const unsigned char * pSrcU, const unsigned char * pSrcV, int srcPitchUV, int cpu);
+void filter_yuv422(int mode, uint8_t *dst, int dst_stride, const uint8_t *prev0, const uint8_t *cur0, const uint8_t *next0, int refs, int w, int h, int y0, int y1, int parity, int tff);
 
 #endif
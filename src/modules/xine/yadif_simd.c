@@ -0,0 +1,164 @@
+/*
+ * yadif_simd.c -- vectorized YADIF line filters
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "yadif_simd.h"
+
+#include <stdlib.h>
+
+#define ABSDIFF( a, b ) MAX( SUB( a, b ), SUB( b, a ) )
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+
+#include <immintrin.h>
+
+// ================= SSE2 =================
+#define ATTR __attribute__((target("sse2")))
+#define V __m128i
+#define N 8
+#define LOAD( p ) _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) (p) ), _mm_setzero_si128() )
+#define STORE( p, v ) _mm_storel_epi64( (__m128i*) (p), _mm_packus_epi16( v, v ) )
+#define SET1( a ) _mm_set1_epi16( a )
+#define LUMA_MASK _mm_set1_epi32( 0xffff )
+#define ADD( a, b ) _mm_add_epi16( a, b )
+#define SUB( a, b ) _mm_sub_epi16( a, b )
+#define SRA1( a ) _mm_srai_epi16( a, 1 )
+#define MAX( a, b ) _mm_max_epi16( a, b )
+#define MIN( a, b ) _mm_min_epi16( a, b )
+#define LT( a, b ) _mm_cmplt_epi16( a, b )
+#define AND( a, b ) _mm_and_si128( a, b )
+#define SEL( m, a, b ) _mm_or_si128( _mm_and_si128( m, a ), _mm_andnot_si128( m, b ) )
+#define KERNEL_NAME yadif_yuv422_sse2
+#include "yadif_simd_template.h"
+#undef ATTR
+#undef V
+#undef N
+#undef LOAD
+#undef STORE
+#undef SET1
+#undef LUMA_MASK
+#undef ADD
+#undef SUB
+#undef SRA1
+#undef MAX
+#undef MIN
+#undef LT
+#undef AND
+#undef SEL
+#undef KERNEL_NAME
+
+// ================= AVX2 =================
+#define ATTR __attribute__((target("avx2")))
+#define V __m256i
+#define N 16
+#define LOAD( p ) _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) (p) ) )
+#define STORE( p, v ) _mm_storeu_si128( (__m128i*) (p), \
+	_mm_packus_epi16( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) ) )
+#define SET1( a ) _mm256_set1_epi16( a )
+#define LUMA_MASK _mm256_set1_epi32( 0xffff )
+#define ADD( a, b ) _mm256_add_epi16( a, b )
+#define SUB( a, b ) _mm256_sub_epi16( a, b )
+#define SRA1( a ) _mm256_srai_epi16( a, 1 )
+#define MAX( a, b ) _mm256_max_epi16( a, b )
+#define MIN( a, b ) _mm256_min_epi16( a, b )
+#define LT( a, b ) _mm256_cmpgt_epi16( b, a )
+#define AND( a, b ) _mm256_and_si256( a, b )
+#define SEL( m, a, b ) _mm256_blendv_epi8( b, a, m )
+#define KERNEL_NAME yadif_yuv422_avx2
+#include "yadif_simd_template.h"
+
+static const struct yadif_kernels sse2_kernels =
+{
+	"sse2",
+	yadif_yuv422_sse2
+};
+
+static const struct yadif_kernels avx2_kernels =
+{
+	"avx2",
+	yadif_yuv422_avx2
+};
+
+static const struct yadif_kernels *detect_kernels( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return &avx2_kernels;
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return &sse2_kernels;
+	return NULL;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#undef ABSDIFF
+#define ABSDIFF( a, b ) vabdq_s16( a, b )
+
+#define ATTR
+#define V int16x8_t
+#define N 8
+#define LOAD( p ) vreinterpretq_s16_u16( vmovl_u8( vld1_u8( p ) ) )
+#define STORE( p, v ) vst1_u8( p, vqmovun_s16( v ) )
+#define SET1( a ) vdupq_n_s16( a )
+#define LUMA_MASK vreinterpretq_s16_u32( vdupq_n_u32( 0xffff ) )
+#define ADD( a, b ) vaddq_s16( a, b )
+#define SUB( a, b ) vsubq_s16( a, b )
+#define SRA1( a ) vshrq_n_s16( a, 1 )
+#define MAX( a, b ) vmaxq_s16( a, b )
+#define MIN( a, b ) vminq_s16( a, b )
+#define LT( a, b ) vreinterpretq_s16_u16( vcltq_s16( a, b ) )
+#define AND( a, b ) vandq_s16( a, b )
+#define SEL( m, a, b ) vbslq_s16( vreinterpretq_u16_s16( m ), a, b )
+#define KERNEL_NAME yadif_yuv422_neon
+#include "yadif_simd_template.h"
+
+static const struct yadif_kernels neon_kernels =
+{
+	"neon",
+	yadif_yuv422_neon
+};
+
+static const struct yadif_kernels *detect_kernels( void )
+{
+	return &neon_kernels;
+}
+
+#else
+
+static const struct yadif_kernels *detect_kernels( void )
+{
+	return NULL;
+}
+
+#endif
+
+const struct yadif_kernels *yadif_simd_kernels( void )
+{
+	static const struct yadif_kernels *kernels = NULL;
+	static int detected = 0;
+
+	if ( !detected )
+	{
+		const char *env = getenv( "MLT_YADIF_SIMD" );
+		kernels = ( env && !atoi( env ) ) ? NULL : detect_kernels();
+		detected = 1;
+	}
+	return kernels;
+}
@@ -0,0 +1,45 @@
+/*
+ * yadif_simd.h -- vectorized YADIF line filters
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef YADIF_SIMD_H
+#define YADIF_SIMD_H
+
+#include <stdint.h>
+
+/** Filter the leading bytes of a packed yuv422 line and return how many were done.
+ *
+ * The neighbours of a luma byte are 2 bytes apart and those of a chroma byte
+ * 4 bytes apart, so \p dst and the sources must start on a luma byte with at
+ * least 12 readable bytes on either side of the \p w bytes. The kernels match
+ * the scalar line filter of yadif.c exactly, which does the remaining bytes.
+ */
+
+typedef int ( *yadif_line_kernel )( int mode, uint8_t *dst, const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+	int w, int refs, int parity );
+
+struct yadif_kernels
+{
+	const char *name;
+	yadif_line_kernel yuv422;
+};
+
+/** Get the best kernels for the CPU or NULL. */
+const struct yadif_kernels *yadif_simd_kernels( void );
+
+#endif
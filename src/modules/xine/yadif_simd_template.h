@@ -0,0 +1,98 @@
+/*
+ * yadif_simd_template.h -- YADIF line filter for one instruction set
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* The includer defines the vector type V holding N signed 16-bit lanes,
+ * the attribute ATTR and the operations below, then names the kernel with
+ * KERNEL_NAME. The taps are widened bytes, and lanes at even bytes hold
+ * luma, so each tap blends a load at 2 bytes per step with one at 4.
+ */
+
+static ATTR int KERNEL_NAME( int mode, uint8_t *dst, const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+	int w, int refs, int parity )
+{
+	const uint8_t *prev2 = parity ? prev : cur;
+	const uint8_t *next2 = parity ? cur : next;
+	const V luma = LUMA_MASK;
+	const V one = SET1( 1 );
+	int x;
+
+#define TAP( p, k ) SEL( luma, LOAD( (p) + 2 * (k) ), LOAD( (p) + 4 * (k) ) )
+#define SCORE( j ) ADD( ADD( ABSDIFF( TAP( up, -1 + (j) ), TAP( down, -1 - (j) ) ), \
+	ABSDIFF( TAP( up, (j) ), TAP( down, -(j) ) ) ), ABSDIFF( TAP( up, 1 + (j) ), TAP( down, 1 - (j) ) ) )
+#define PRED( j ) SRA1( ADD( TAP( up, (j) ), TAP( down, -(j) ) ) )
+
+	for ( x = 0; x + N <= w; x += N )
+	{
+		const uint8_t *up = cur + x - refs;
+		const uint8_t *down = cur + x + refs;
+		V c = LOAD( up );
+		V e = LOAD( down );
+		V p2 = LOAD( prev2 + x );
+		V n2 = LOAD( next2 + x );
+		V d = SRA1( ADD( p2, n2 ) );
+		V diff = SRA1( ABSDIFF( p2, n2 ) );
+		V diff1 = SRA1( ADD( ABSDIFF( LOAD( prev + x - refs ), c ), ABSDIFF( LOAD( prev + x + refs ), e ) ) );
+		V diff2 = SRA1( ADD( ABSDIFF( LOAD( next + x - refs ), c ), ABSDIFF( LOAD( next + x + refs ), e ) ) );
+		V pred = SRA1( ADD( c, e ) );
+		V best = SUB( SCORE( 0 ), one );
+		V score, better;
+
+		diff = MAX( diff, MAX( diff1, diff2 ) );
+
+		// The second step in a direction only counts if the first one was better.
+		score = SCORE( -1 );
+		better = LT( score, best );
+		best = MIN( score, best );
+		pred = SEL( better, PRED( -1 ), pred );
+		score = SCORE( -2 );
+		better = AND( better, LT( score, best ) );
+		best = SEL( better, score, best );
+		pred = SEL( better, PRED( -2 ), pred );
+
+		score = SCORE( 1 );
+		better = LT( score, best );
+		best = MIN( score, best );
+		pred = SEL( better, PRED( 1 ), pred );
+		score = SCORE( 2 );
+		better = AND( better, LT( score, best ) );
+		pred = SEL( better, PRED( 2 ), pred );
+
+		if ( mode < 2 )
+		{
+			V b = SRA1( ADD( LOAD( prev2 + x - 2 * refs ), LOAD( next2 + x - 2 * refs ) ) );
+			V f = SRA1( ADD( LOAD( prev2 + x + 2 * refs ), LOAD( next2 + x + 2 * refs ) ) );
+			V de = SUB( d, e );
+			V dc = SUB( d, c );
+			V bc = SUB( b, c );
+			V fe = SUB( f, e );
+			V max = MAX( MAX( de, dc ), MIN( bc, fe ) );
+			V min = MIN( MIN( de, dc ), MAX( bc, fe ) );
+			diff = MAX( MAX( diff, min ), SUB( SET1( 0 ), max ) );
+		}
+
+		pred = MIN( MAX( pred, SUB( d, diff ) ), ADD( d, diff ) );
+		STORE( dst + x, pred );
+	}
+
+#undef TAP
+#undef SCORE
+#undef PRED
+
+	return x;
+}
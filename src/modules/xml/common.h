@@ -19,9 +19,10 @@
 #ifndef MLT_XML_COMMON_H
 #define MLT_XML_COMMON_H
 
-#include <framework/mlt_properties.h>
+#include <framework/mlt_properties.h>
 
 size_t mlt_xml_prefix_size( mlt_properties properties, const char *name, const char *value );
+int mlt_xml_update( mlt_service live, mlt_service update );
 
 #endif // MLT_XML_COMMON_H
 
@@ -18,6 +18,7 @@
  */
 
 #include "common.h"
+#include "mltbin.h"
 
 #include <framework/mlt.h>
 #include <stdio.h>
@@ -38,6 +39,7 @@
 struct serialise_context_s
 {
 	mlt_properties id_map;
+	mlt_properties service_map;
 	int producer_count;
 	int multitrack_count;
 	int playlist_count;
@@ -82,16 +84,15 @@ xml_type;
 static char *xml_get_id( serialise_context context, mlt_service service, xml_type type )
 {
 	char *id = NULL;
-	int i = 0;
+	char key[ 32 ];
 	mlt_properties map = context->id_map;
 
-	// Search the map for the service
-	for ( i = 0; i < mlt_properties_count( map ); i ++ )
-		if ( mlt_properties_get_data_at( map, i, NULL ) == service )
-			break;
+	// Look up the service by its address rather than searching the map
+	snprintf( key, sizeof( key ), "%p", ( void* )service );
+	id = mlt_properties_get( context->service_map, key );
 
 	// If the service is not in the map, and the type indicates a new id is needed...
-	if ( i >= mlt_properties_count( map ) && type != xml_existing )
+	if ( id == NULL && type != xml_existing )
 	{
 		// Attempt to reuse existing id
 		id = mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "id" );
@@ -132,24 +133,40 @@ static char *xml_get_id( serialise_context context, mlt_service service, xml_typ
 
 			// Set the data at the generated name
 			mlt_properties_set_data( map, temp, service, 0, NULL, NULL );
-
-			// Get the pointer to the name (i is the end of the list)
-			id = mlt_properties_get_name( map, i );
+			mlt_properties_set( context->service_map, key, temp );
 		}
 		else
 		{
 			// Store the existing id in the map
 			mlt_properties_set_data( map, id, service, 0, NULL, NULL );
+			mlt_properties_set( context->service_map, key, id );
 		}
+		id = mlt_properties_get( context->service_map, key );
 	}
-	else if ( type == xml_existing )
+	else if ( type != xml_existing )
 	{
-		id = mlt_properties_get_name( map, i );
+		// Already serialised
+		id = NULL;
 	}
 
 	return id;
 }
 
+/** Format a frame position as a time without going through a property.
+*/
+
+static const char *xml_get_time( serialise_context context, mlt_properties properties, mlt_position position, char *buffer, size_t size )
+{
+	if ( context->time_format == mlt_time_frames )
+	{
+		snprintf( buffer, size, "%d", position );
+		return buffer;
+	}
+	mlt_properties_set_data( properties, "_profile", context->profile, 0, NULL, NULL );
+	mlt_properties_set_position( properties, TIME_PROPERTY, position );
+	return mlt_properties_get_time( properties, TIME_PROPERTY, context->time_format );
+}
+
 /** This is what will be called by the factory - anything can be passed in
 	via the argument, but keep it simple.
 */
@@ -452,10 +469,9 @@ static void serialise_playlist( serialise_context context, mlt_service service,
 				char *service_s = mlt_properties_get( producer_props, "mlt_service" );
 				if ( service_s != NULL && strcmp( service_s, "blank" ) == 0 )
 				{
+					char temp[ 20 ];
 					xmlNode *entry = xmlNewChild( child, NULL, _x("blank"), NULL );
-					mlt_properties_set_data( producer_props, "_profile", context->profile, 0, NULL, NULL );
-					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_count );
-					xmlNewProp( entry, _x("length"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
+					xmlNewProp( entry, _x("length"), _x( xml_get_time( context, producer_props, info.frame_count, temp, sizeof( temp ) ) ) );
 				}
 				else
 				{
@@ -463,10 +479,8 @@ static void serialise_playlist( serialise_context context, mlt_service service,
 					xmlNode *entry = xmlNewChild( child, NULL, _x("entry"), NULL );
 					id = xml_get_id( context, MLT_SERVICE( producer ), xml_existing );
 					xmlNewProp( entry, _x("producer"), _x(id) );
-					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_in );
-					xmlNewProp( entry, _x("in"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
-					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_out );
-					xmlNewProp( entry, _x("out"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
+					xmlNewProp( entry, _x("in"), _x( xml_get_time( context, producer_props, info.frame_in, temp, sizeof( temp ) ) ) );
+					xmlNewProp( entry, _x("out"), _x( xml_get_time( context, producer_props, info.frame_out, temp, sizeof( temp ) ) ) );
 					if ( info.repeat > 1 )
 					{
 						sprintf( temp, "%d", info.repeat );
@@ -795,6 +809,7 @@ xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
 
 	// Construct the context maps
 	context->id_map = mlt_properties_new();
+	context->service_map = mlt_properties_new();
 	context->hide_map = mlt_properties_new();
 
 	// Ensure producer is a framework producer
@@ -813,6 +828,7 @@ xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
 
 	// Cleanup resource
 	mlt_properties_close( context->id_map );
+	mlt_properties_close( context->service_map );
 	mlt_properties_close( context->hide_map );
 	free( context->root );
 	free( context );
@@ -854,7 +870,29 @@ static void output_xml( mlt_consumer consumer )
 	doc = xml_make_doc( consumer, service );
 
 	// Handle the output
-	if ( resource == NULL || !strcmp( resource, "" ) )
+	if ( mlt_properties_get( properties, "mlt_service" )
+		&& !strcmp( mlt_properties_get( properties, "mlt_service" ), "mltbin" ) )
+	{
+		if ( resource == NULL || !strcmp( resource, "" ) )
+		{
+			mltbin_save( doc, stdout );
+		}
+		else if ( strchr( resource, '.' ) == NULL )
+		{
+			size_t size = 0;
+			void *data = mltbin_encode( doc, &size );
+			mlt_properties_set_data( properties, resource, data, size, free, NULL );
+		}
+		else
+		{
+			FILE *file = fopen( resource, "wb" );
+			if ( file == NULL || mltbin_save( doc, file ) )
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write %s\n", resource );
+			if ( file )
+				fclose( file );
+		}
+	}
+	else if ( resource == NULL || !strcmp( resource, "" ) )
 	{
 		xmlDocFormatDump( stdout, doc, 1 );
 	}
@@ -0,0 +1,495 @@
+/*
+ * mltbin.c -- a binary encoding of mlt xml documents
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mltbin.h"
+
+#include <framework/mlt_log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Only the shorter strings, such as names and ids, are shared
+#define MLTBIN_SHARED_SIZE 256
+
+typedef struct
+{
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+}
+mltbin_buffer;
+
+typedef struct
+{
+	uint32_t *table;           /**< open addressed indices of the shared strings, plus one */
+	uint32_t table_size;
+	uint32_t shared;
+	mltbin_buffer offsets;
+	mltbin_buffer strings;
+	mltbin_buffer records;
+	uint32_t count;
+	int error;
+}
+mltbin_encoder;
+
+struct mltbin_s
+{
+	uint8_t *data;
+	size_t size;
+	int mapped;
+	const uint32_t *offsets;
+	const char *strings;
+	uint32_t string_count;
+	const uint32_t *records;
+	uint32_t record_count;
+};
+
+static void buffer_append( mltbin_encoder *encoder, mltbin_buffer *buffer, const void *data, size_t size )
+{
+	if ( buffer->size + size > buffer->capacity )
+	{
+		size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+		while ( capacity < buffer->size + size )
+			capacity *= 2;
+		uint8_t *grown = realloc( buffer->data, capacity );
+		if ( !grown )
+		{
+			encoder->error = 1;
+			return;
+		}
+		buffer->data = grown;
+		buffer->capacity = capacity;
+	}
+	memcpy( buffer->data + buffer->size, data, size );
+	buffer->size += size;
+}
+
+static void encode_word( mltbin_encoder *encoder, uint32_t word )
+{
+	buffer_append( encoder, &encoder->records, &word, sizeof( word ) );
+}
+
+static inline uint32_t string_hash( const char *s )
+{
+	uint32_t hash = 5381;
+	while ( *s )
+		hash = hash * 33 + (uint8_t) *s ++;
+	return hash;
+}
+
+static uint32_t *encode_lookup( mltbin_encoder *encoder, const char *s, uint32_t hash )
+{
+	uint32_t mask = encoder->table_size - 1;
+	uint32_t i = hash & mask;
+	const uint32_t *offsets = (const uint32_t*) encoder->offsets.data;
+
+	while ( encoder->table[ i ] && strcmp( (const char*) encoder->strings.data + offsets[ encoder->table[ i ] - 1 ], s ) )
+		i = ( i + 1 ) & mask;
+	return &encoder->table[ i ];
+}
+
+static void encode_grow( mltbin_encoder *encoder )
+{
+	uint32_t *old = encoder->table;
+	uint32_t old_size = encoder->table_size;
+	uint32_t i;
+
+	encoder->table_size = old_size ? old_size * 2 : 1024;
+	encoder->table = calloc( encoder->table_size, sizeof( uint32_t ) );
+	if ( !encoder->table )
+	{
+		encoder->error = 1;
+		encoder->table = old;
+		encoder->table_size = old_size;
+		return;
+	}
+	for ( i = 0; i < old_size; i ++ )
+	{
+		if ( old[ i ] )
+		{
+			const uint32_t *offsets = (const uint32_t*) encoder->offsets.data;
+			const char *s = (const char*) encoder->strings.data + offsets[ old[ i ] - 1 ];
+			*encode_lookup( encoder, s, string_hash( s ) ) = old[ i ];
+		}
+	}
+	free( old );
+}
+
+static void encode_string( mltbin_encoder *encoder, const char *s )
+{
+	size_t length = strlen( s );
+	int shared = length < MLTBIN_SHARED_SIZE;
+	uint32_t hash = 0;
+	uint32_t *slot = NULL;
+
+	if ( shared )
+	{
+		if ( encoder->shared * 2 >= encoder->table_size )
+			encode_grow( encoder );
+		if ( encoder->error )
+			return;
+		hash = string_hash( s );
+		slot = encode_lookup( encoder, s, hash );
+	}
+	if ( !slot || !*slot )
+	{
+		uint32_t offset = encoder->strings.size;
+		if ( encoder->strings.size + length + 1 > UINT32_MAX )
+		{
+			encoder->error = 1;
+			return;
+		}
+		buffer_append( encoder, &encoder->offsets, &offset, sizeof( offset ) );
+		buffer_append( encoder, &encoder->strings, s, length + 1 );
+		if ( encoder->error )
+			return;
+		encoder->count ++;
+		if ( slot )
+		{
+			*slot = encoder->count;
+			encoder->shared ++;
+		}
+		encode_word( encoder, encoder->count - 1 );
+	}
+	else
+	{
+		encode_word( encoder, *slot - 1 );
+	}
+}
+
+static void encode_nodes( mltbin_encoder *encoder, xmlNodePtr node )
+{
+	for ( ; node != NULL && !encoder->error; node = node->next )
+	{
+		if ( node->type == XML_ELEMENT_NODE )
+		{
+			xmlAttrPtr attr;
+			uint32_t count = 0;
+
+			for ( attr = node->properties; attr != NULL; attr = attr->next )
+				count ++;
+			encode_word( encoder, MLTBIN_START );
+			encode_string( encoder, (const char*) node->name );
+			encode_word( encoder, count );
+			for ( attr = node->properties; attr != NULL; attr = attr->next )
+			{
+				encode_string( encoder, (const char*) attr->name );
+				if ( attr->children && !attr->children->next && attr->children->type == XML_TEXT_NODE )
+				{
+					encode_string( encoder, (const char*) attr->children->content );
+				}
+				else
+				{
+					xmlChar *value = xmlNodeListGetString( node->doc, attr->children, 1 );
+					encode_string( encoder, value ? (const char*) value : "" );
+					xmlFree( value );
+				}
+			}
+			encode_nodes( encoder, node->children );
+			encode_word( encoder, MLTBIN_END );
+			encode_string( encoder, (const char*) node->name );
+		}
+		else if ( ( node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE ) && node->content )
+		{
+			encode_word( encoder, MLTBIN_TEXT );
+			encode_string( encoder, (const char*) node->content );
+		}
+	}
+}
+
+/** Encode a document.
+ *
+ * \param doc the document
+ * \param size the size of the encoding is returned here
+ * \return the encoding, which the caller must free, or NULL on error
+ */
+
+void *mltbin_encode( xmlDocPtr doc, size_t *size )
+{
+	mltbin_encoder encoder;
+	uint8_t *result = NULL;
+
+	memset( &encoder, 0, sizeof( encoder ) );
+	encode_nodes( &encoder, xmlDocGetRootElement( doc ) );
+
+	if ( !encoder.error )
+	{
+		mltbin_header header;
+		size_t padding = ( 4 - ( sizeof( header ) + encoder.offsets.size + encoder.strings.size ) % 4 ) % 4;
+
+		memset( &header, 0, sizeof( header ) );
+		memcpy( header.magic, MLTBIN_MAGIC, sizeof( header.magic ) );
+		header.byte_order = MLTBIN_BYTE_ORDER;
+		header.version = MLTBIN_VERSION;
+		header.string_count = encoder.count;
+		header.record_count = encoder.records.size / sizeof( uint32_t );
+		header.offsets_offset = sizeof( header );
+		header.strings_offset = header.offsets_offset + encoder.offsets.size;
+		header.strings_size = encoder.strings.size;
+		header.records_offset = header.strings_offset + encoder.strings.size + padding;
+		*size = header.records_offset + encoder.records.size;
+
+		result = malloc( *size );
+		if ( result )
+		{
+			memcpy( result, &header, sizeof( header ) );
+			if ( encoder.offsets.size )
+				memcpy( result + header.offsets_offset, encoder.offsets.data, encoder.offsets.size );
+			if ( encoder.strings.size )
+				memcpy( result + header.strings_offset, encoder.strings.data, encoder.strings.size );
+			memset( result + header.strings_offset + encoder.strings.size, 0, padding );
+			if ( encoder.records.size )
+				memcpy( result + header.records_offset, encoder.records.data, encoder.records.size );
+		}
+	}
+
+	free( encoder.table );
+	free( encoder.offsets.data );
+	free( encoder.strings.data );
+	free( encoder.records.data );
+	return result;
+}
+
+/** Encode a document to a file.
+ *
+ * \return true on error
+ */
+
+int mltbin_save( xmlDocPtr doc, FILE *file )
+{
+	size_t size = 0;
+	void *data = mltbin_encode( doc, &size );
+	int error = data == NULL || fwrite( data, 1, size, file ) != size;
+	free( data );
+	return error;
+}
+
+static int mltbin_validate( mltbin self )
+{
+	const mltbin_header *header = (const mltbin_header*) self->data;
+	uint32_t i;
+
+	if ( self->size < sizeof( *header )
+		|| memcmp( header->magic, MLTBIN_MAGIC, sizeof( header->magic ) )
+		|| header->byte_order != MLTBIN_BYTE_ORDER
+		|| header->version != MLTBIN_VERSION
+		|| header->offsets_offset % 4 || header->records_offset % 4
+		|| header->offsets_offset > self->size
+		|| ( self->size - header->offsets_offset ) / 4 < header->string_count
+		|| header->strings_offset > self->size
+		|| header->strings_size > self->size - header->strings_offset
+		|| ( header->strings_size && self->data[ header->strings_offset + header->strings_size - 1 ] )
+		|| header->records_offset > self->size
+		|| ( self->size - header->records_offset ) / 4 < header->record_count )
+		return 1;
+
+	self->offsets = (const uint32_t*) ( self->data + header->offsets_offset );
+	self->strings = (const char*) ( self->data + header->strings_offset );
+	self->string_count = header->string_count;
+	self->records = (const uint32_t*) ( self->data + header->records_offset );
+	self->record_count = header->record_count;
+
+	// Make sure that every string is terminated within the table
+	for ( i = 0; i < self->string_count; i ++ )
+		if ( self->offsets[ i ] >= header->strings_size )
+			return 1;
+	return 0;
+}
+
+/** Open an encoded file.
+ *
+ * The file is mapped into memory, so the strings need not be read or copied
+ * before they are used.
+ *
+ * \return the file or NULL if it is not a valid encoding
+ */
+
+mltbin mltbin_open( const char *filename )
+{
+	mltbin self = calloc( 1, sizeof( struct mltbin_s ) );
+	struct stat st;
+	int fd = open( filename, O_RDONLY );
+
+	if ( !self || fd < 0 || fstat( fd, &st ) || st.st_size <= 0 )
+	{
+		if ( fd >= 0 )
+			close( fd );
+		free( self );
+		return NULL;
+	}
+	self->size = st.st_size;
+#ifndef _WIN32
+	self->data = mmap( NULL, self->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( self->data == MAP_FAILED )
+		self->data = NULL;
+	else
+		self->mapped = 1;
+#endif
+	if ( !self->data )
+	{
+		size_t done = 0;
+		ssize_t n = 1;
+		self->data = malloc( self->size );
+		while ( self->data && done < self->size && n > 0 )
+		{
+			n = read( fd, self->data + done, self->size - done );
+			if ( n > 0 )
+				done += n;
+		}
+		if ( done < self->size )
+		{
+			free( self->data );
+			self->data = NULL;
+		}
+	}
+	close( fd );
+
+	if ( !self->data || mltbin_validate( self ) )
+	{
+		mlt_log_error( NULL, "[mltbin] %s is not a valid file\n", filename );
+		mltbin_close( self );
+		return NULL;
+	}
+	return self;
+}
+
+static inline const xmlChar *mltbin_string( mltbin self, uint32_t index, int *error )
+{
+	if ( index < self->string_count )
+		return (const xmlChar*) ( self->strings + self->offsets[ index ] );
+	*error = 1;
+	return (const xmlChar*) "";
+}
+
+/** Replay the document to SAX callbacks.
+ *
+ * Only the startElement, endElement and characters callbacks of \p sax are
+ * used, and any of them may be NULL.
+ *
+ * \param self the file
+ * \param ctx the first argument to the callbacks
+ * \param sax the callbacks
+ * \return true if the file is malformed
+ */
+
+int mltbin_parse( mltbin self, void *ctx, xmlSAXHandler *sax )
+{
+	const uint32_t *record = self->records;
+	const uint32_t *end = record + self->record_count;
+	const xmlChar **atts = NULL;
+	uint32_t capacity = 0;
+	int depth = 0;
+	int error = 0;
+
+	while ( record < end && !error )
+	{
+		switch ( *record ++ )
+		{
+		case MLTBIN_START:
+		{
+			const xmlChar *name;
+			uint32_t count, i;
+
+			if ( end - record < 2 )
+			{
+				error = 1;
+				break;
+			}
+			name = mltbin_string( self, record[ 0 ], &error );
+			count = record[ 1 ];
+			record += 2;
+			if ( count > ( end - record ) / 2 )
+			{
+				error = 1;
+				break;
+			}
+			if ( count * 2 + 1 > capacity )
+			{
+				const xmlChar **grown = realloc( atts, ( count * 2 + 1 ) * sizeof( *atts ) );
+				if ( !grown )
+				{
+					error = 1;
+					break;
+				}
+				atts = grown;
+				capacity = count * 2 + 1;
+			}
+			for ( i = 0; i < count * 2; i ++ )
+				atts[ i ] = mltbin_string( self, record[ i ], &error );
+			atts[ count * 2 ] = NULL;
+			record += count * 2;
+			depth ++;
+			if ( sax->startElement && !error )
+				sax->startElement( ctx, name, atts );
+			break;
+		}
+		case MLTBIN_TEXT:
+			if ( record < end )
+			{
+				const xmlChar *text = mltbin_string( self, *record ++, &error );
+				if ( sax->characters && !error )
+					sax->characters( ctx, text, strlen( (const char*) text ) );
+			}
+			else
+			{
+				error = 1;
+			}
+			break;
+		case MLTBIN_END:
+			if ( record < end && depth > 0 )
+			{
+				const xmlChar *name = mltbin_string( self, *record ++, &error );
+				depth --;
+				if ( sax->endElement && !error )
+					sax->endElement( ctx, name );
+			}
+			else
+			{
+				error = 1;
+			}
+			break;
+		default:
+			error = 1;
+			break;
+		}
+	}
+	free( atts );
+	return error || depth != 0;
+}
+
+/** Close an encoded file. */
+
+void mltbin_close( mltbin self )
+{
+	if ( self )
+	{
+#ifndef _WIN32
+		if ( self->mapped )
+			munmap( self->data, self->size );
+		else
+#endif
+			free( self->data );
+		free( self );
+	}
+}
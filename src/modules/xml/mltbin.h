@@ -0,0 +1,69 @@
+/*
+ * mltbin.h -- a binary encoding of mlt xml documents
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MLT_XML_MLTBIN_H
+#define MLT_XML_MLTBIN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+/* A file is a header, a table of string offsets, the NUL terminated strings
+ * and the records. Every string, whether an element name, an attribute or
+ * text, is stored once and referenced by its index. The records are 32-bit
+ * words: MLTBIN_START name count [ name value ] * count, MLTBIN_TEXT text or
+ * MLTBIN_END name. Numbers are in the byte order of the machine that wrote
+ * the file, which the reader checks.
+ */
+
+#define MLTBIN_MAGIC "MLTBIN\r\n"
+#define MLTBIN_BYTE_ORDER 0x01020304
+#define MLTBIN_VERSION 1
+
+enum
+{
+	MLTBIN_START = 1,
+	MLTBIN_TEXT,
+	MLTBIN_END
+};
+
+typedef struct
+{
+	char magic[ 8 ];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t string_count;
+	uint32_t record_count;     /**< the number of words of records */
+	uint64_t offsets_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t records_offset;
+}
+mltbin_header;
+
+typedef struct mltbin_s *mltbin;
+
+extern void *mltbin_encode( xmlDocPtr doc, size_t *size );
+extern int mltbin_save( xmlDocPtr doc, FILE *file );
+extern mltbin mltbin_open( const char *filename );
+extern int mltbin_parse( mltbin self, void *ctx, xmlSAXHandler *sax );
+extern void mltbin_close( mltbin self );
+
+#endif // MLT_XML_MLTBIN_H
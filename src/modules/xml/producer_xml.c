@@ -21,6 +21,7 @@
 //       when the returned producer is closed).
 
 #include "common.h"
+#include "mltbin.h"
 
 #include <framework/mlt.h>
 #include <framework/mlt_log.h>
@@ -28,6 +29,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h> // for xmlCreateFileParserCtxt
@@ -87,6 +89,10 @@ struct deserialise_context_s
 	int consumer_count;
 	int seekable;
 	mlt_consumer qglsl;
+	int lazy;
+	int threads;
+	mlt_deque lazy_producers;
+	int update;
 };
 typedef struct deserialise_context_s *deserialise_context;
 
@@ -180,6 +186,17 @@ static xmlNodePtr context_pop_node( deserialise_context context )
 }
 
 
+// Keep what the element of an update sets, to compare with the live service
+static void record_update( deserialise_context context, mlt_service service, mlt_properties properties )
+{
+	if ( context->update )
+	{
+		mlt_properties copy = mlt_properties_new();
+		mlt_properties_inherit( copy, properties );
+		mlt_properties_set_data( MLT_SERVICE_PROPERTIES( service ), "_xml_update", copy, 0, ( mlt_destructor )mlt_properties_close, NULL );
+	}
+}
+
 // Set the destructor on a new service
 static void track_service( mlt_properties properties, void *service, mlt_destructor destructor )
 {
@@ -513,6 +530,274 @@ static void on_end_playlist( deserialise_context context, const xmlChar *name )
 	}
 }
 
+/** Create a producer from the service and resource of an XML producer element.
+*/
+
+static mlt_producer create_producer( mlt_profile profile, char *service_name, char *resource )
+{
+	mlt_producer producer = NULL;
+
+	if ( service_name != NULL )
+	{
+		service_name = trim( service_name );
+		if ( resource )
+		{
+			char *temp = calloc( 1, strlen( service_name ) + strlen( resource ) + 2 );
+			strcat( temp, service_name );
+			strcat( temp, ":" );
+			strcat( temp, resource );
+			producer = mlt_factory_producer( profile, NULL, temp );
+			free( temp );
+		}
+		else
+		{
+			producer = mlt_factory_producer( profile, NULL, service_name );
+		}
+	}
+
+	// Just in case the plugin requested doesn't exist...
+	if ( !producer && resource )
+		producer = mlt_factory_producer( profile, NULL, resource );
+	if ( !producer )
+		mlt_log_error( NULL, "[producer_xml] failed to load producer \"%s\"\n", resource );
+	if ( !producer )
+		producer = mlt_factory_producer( profile, NULL, "+INVALID.txt" );
+	if ( !producer )
+		producer = mlt_factory_producer( profile, NULL, "colour:red" );
+
+	return producer;
+}
+
+/** Load the media of a placeholder producer if it is not loaded yet.
+ *
+ * The caller must hold the service lock of the placeholder.
+ */
+
+static mlt_producer lazy_producer_load( mlt_producer self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self );
+	mlt_producer producer = mlt_properties_get_data( properties, "_lazy_producer", NULL );
+
+	if ( producer == NULL )
+	{
+		mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self ) );
+		mlt_properties producer_properties;
+		int i;
+
+		producer = create_producer( profile, mlt_properties_get( properties, "_lazy_service" ),
+			mlt_properties_get( properties, "_lazy_resource" ) );
+		if ( producer == NULL )
+			return NULL;
+		producer_properties = MLT_PRODUCER_PROPERTIES( producer );
+		mlt_properties_set_lcnumeric( producer_properties, mlt_properties_get_lcnumeric( properties ) );
+
+		// Apply what the XML and the application have set on the placeholder
+		mlt_properties_lock( properties );
+		for ( i = 0; i < mlt_properties_count( properties ); i ++ )
+		{
+			char *name = mlt_properties_get_name( properties, i );
+			char *value = mlt_properties_get_value( properties, i );
+			if ( value && name[0] != '_' && strcmp( name, "mlt_type" ) && strcmp( name, "mlt_service" ) )
+				mlt_properties_set( producer_properties, name, value );
+		}
+		mlt_properties_unlock( properties );
+
+		// Make what the media reports available on the placeholder
+		mlt_properties_lock( producer_properties );
+		for ( i = 0; i < mlt_properties_count( producer_properties ); i ++ )
+		{
+			char *name = mlt_properties_get_name( producer_properties, i );
+			char *value = mlt_properties_get_value( producer_properties, i );
+			if ( value && name[0] != '_' && !mlt_properties_get( properties, name ) )
+				mlt_properties_set( properties, name, value );
+		}
+		mlt_properties_unlock( producer_properties );
+
+		mlt_properties_set_data( properties, "_lazy_producer", producer, 0, ( mlt_destructor )mlt_producer_close, NULL );
+	}
+
+	return producer;
+}
+
+/** Pass a property set on a placeholder on to its loaded producer.
+*/
+
+static void on_lazy_property_changed( mlt_properties owner, mlt_producer self, char *name )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self );
+	mlt_producer producer = mlt_properties_get_data( properties, "_lazy_producer", NULL );
+
+	if ( producer && name[0] != '_' && strcmp( name, "mlt_type" ) && strcmp( name, "mlt_service" ) )
+	{
+		char *value = mlt_properties_get( properties, name );
+		char *current = mlt_properties_get( MLT_PRODUCER_PROPERTIES( producer ), name );
+		if ( value && ( !current || strcmp( value, current ) ) )
+			mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), name, value );
+	}
+}
+
+static int lazy_producer_get_frame( mlt_producer self, mlt_frame_ptr frame, int index )
+{
+	mlt_producer producer;
+
+	// The clones made by mlt_producer_optimise() are real producers
+	if ( self->get_frame != lazy_producer_get_frame )
+		return self->get_frame( self, frame, index );
+
+	producer = lazy_producer_load( self );
+	if ( producer == NULL )
+	{
+		*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( self ) );
+		mlt_frame_set_position( *frame, mlt_producer_position( self ) );
+	}
+	else
+	{
+		mlt_producer_seek( producer, mlt_producer_position( self ) );
+		mlt_producer_set_speed( producer, mlt_producer_get_speed( self ) );
+		mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), frame, index );
+
+		// Transitions and cuts expect the frame to come from the placeholder
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( *frame ), "_producer", MLT_PRODUCER_SERVICE( self ), 0, NULL, NULL );
+	}
+	mlt_producer_prepare_next( self );
+
+	return 0;
+}
+
+/** Create a placeholder for a producer whose media is loaded on first use.
+*/
+
+static mlt_producer lazy_producer_new( mlt_profile profile, char *service_name, char *resource )
+{
+	mlt_producer self = mlt_producer_new( profile );
+
+	if ( self )
+	{
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( self );
+		self->get_frame = lazy_producer_get_frame;
+		mlt_properties_set( properties, "mlt_service", service_name );
+		mlt_properties_set( properties, "_lazy_service", service_name );
+		mlt_properties_set( properties, "_lazy_resource", resource );
+		if ( resource )
+			mlt_properties_set( properties, "resource", resource );
+		mlt_events_listen( properties, self, "property-changed", ( mlt_listener )on_lazy_property_changed );
+	}
+
+	return self;
+}
+
+/** Determine if a producer element may be loaded on first use.
+ *
+ * It needs a length because playlists and tracks need that before any media
+ * is opened, and OpenGL services must be created while loading.
+ */
+
+static int use_lazy_producer( deserialise_context context, mlt_properties properties )
+{
+	char *service_name = mlt_properties_get( properties, "mlt_service" );
+	return ( context->lazy || context->update || context->threads > 1 ) && service_name && mlt_properties_get( properties, "length" )
+		&& strncmp( service_name, "glsl.", 5 ) && strncmp( service_name, "movit.", 6 );
+}
+
+/** Load placeholders on a pool of threads, in the order they appear.
+*/
+
+typedef struct
+{
+	pthread_t *threads;
+	int count;
+	pthread_mutex_t mutex;
+	mlt_deque queue;
+	int cancel;
+} *lazy_loader;
+
+static void *lazy_loader_thread( void *arg )
+{
+	lazy_loader self = arg;
+	mlt_producer producer;
+
+	while ( 1 )
+	{
+		pthread_mutex_lock( &self->mutex );
+		producer = mlt_deque_pop_front( self->queue );
+		pthread_mutex_unlock( &self->mutex );
+		if ( producer == NULL )
+			break;
+		if ( !self->cancel )
+		{
+			mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
+			lazy_producer_load( producer );
+			mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+		}
+		mlt_producer_close( producer );
+	}
+
+	return NULL;
+}
+
+static void lazy_loader_close( lazy_loader self )
+{
+	int i;
+
+	self->cancel = 1;
+	for ( i = 0; i < self->count; i ++ )
+		pthread_join( self->threads[ i ], NULL );
+	pthread_mutex_destroy( &self->mutex );
+	mlt_deque_close( self->queue );
+	free( self->threads );
+	free( self );
+}
+
+/** Start loading the placeholders of the document on up to \p threads threads.
+ *
+ * Placeholders that nothing but the parser refers to are skipped.
+ */
+
+static lazy_loader lazy_loader_start( deserialise_context context, int threads )
+{
+	lazy_loader self = calloc( 1, sizeof( *self ) );
+	mlt_producer producer;
+
+	if ( self == NULL )
+		return NULL;
+	self->threads = calloc( threads, sizeof( pthread_t ) );
+	self->queue = mlt_deque_init( );
+	pthread_mutex_init( &self->mutex, NULL );
+
+	while ( ( producer = mlt_deque_pop_front( context->lazy_producers ) ) )
+	{
+		if ( mlt_properties_ref_count( MLT_PRODUCER_PROPERTIES( producer ) ) > 1 )
+		{
+			mlt_properties_inc_ref( MLT_PRODUCER_PROPERTIES( producer ) );
+			mlt_deque_push_back( self->queue, producer );
+		}
+	}
+
+	if ( threads > mlt_deque_count( self->queue ) )
+		threads = mlt_deque_count( self->queue );
+	while ( self->threads && self->count < threads
+		&& !pthread_create( &self->threads[ self->count ], NULL, lazy_loader_thread, self ) )
+		self->count ++;
+
+	// Load in this thread whatever could not be handed to the pool
+	if ( self->count == 0 )
+		lazy_loader_thread( self );
+
+	return self;
+}
+
+/** Join the loader threads after they have emptied the queue.
+*/
+
+static void lazy_loader_wait( lazy_loader self )
+{
+	int i;
+
+	for ( i = 0; i < self->count; i ++ )
+		pthread_join( self->threads[ i ], NULL );
+	self->count = 0;
+}
+
 static void on_start_producer( deserialise_context context, const xmlChar *name, const xmlChar **atts)
 {
 	// use a dummy service to hold properties to allow arbitrary nesting
@@ -548,33 +833,14 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 		}
 
 		// Instantiate the producer
-		if ( mlt_properties_get( properties, "mlt_service" ) != NULL )
+		if ( use_lazy_producer( context, properties ) )
 		{
-			char *service_name = trim( mlt_properties_get( properties, "mlt_service" ) );
-			if ( resource )
-			{
-				char *temp = calloc( 1, strlen( service_name ) + strlen( resource ) + 2 );
-				strcat( temp, service_name );
-				strcat( temp, ":" );
-				strcat( temp, resource );
-				producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, temp ) );
-				free( temp );
-			}
-			else
-			{
-				producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, service_name ) );
-			}
+			producer = MLT_SERVICE( lazy_producer_new( context->profile, trim( mlt_properties_get( properties, "mlt_service" ) ), resource ) );
+			if ( producer )
+				mlt_deque_push_back( context->lazy_producers, producer );
 		}
-
-		// Just in case the plugin requested doesn't exist...
-		if ( !producer && resource )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, resource ) );
-		if ( !producer )
-			mlt_log_error( NULL, "[producer_xml] failed to load producer \"%s\"\n", resource );
-		if ( !producer )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, "+INVALID.txt" ) );
 		if ( !producer )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, "colour:red" ) );
+			producer = MLT_SERVICE( create_producer( context->profile, mlt_properties_get( properties, "mlt_service" ), resource ) );
 		if ( !producer )
 		{
 			mlt_service_close( service );
@@ -622,6 +888,7 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 
 		// Inherit the properties
 		mlt_properties_inherit( MLT_SERVICE_PROPERTIES( producer ), properties );
+		record_update( context, producer, properties );
 
 		// Attach all filters from service onto producer
 		attach_filters( producer, service );
@@ -939,6 +1206,7 @@ static void on_end_filter( deserialise_context context, const xmlChar *name )
 		qualify_property( context, properties, "filename" );
 		qualify_property( context, properties, "av.file" );
 		mlt_properties_inherit( filter_props, properties );
+		record_update( context, filter, properties );
 
 		// Attach all filters from service onto filter
 		attach_filters( filter, service );
@@ -1032,6 +1300,7 @@ static void on_end_transition( deserialise_context context, const xmlChar *name
 		qualify_property( context, properties, "composite.luma" );
 		qualify_property( context, properties, "producer.resource" );
 		mlt_properties_inherit( effect_props, properties );
+		record_update( context, effect, properties );
 
 		// Attach all filters from service onto effect
 		attach_filters( effect, service );
@@ -1652,6 +1921,7 @@ static deserialise_context context_new( mlt_profile profile )
 		context->stack_node = mlt_deque_init();
 		context->stack_branch = mlt_deque_init();
 		mlt_deque_push_back_int( context->stack_branch, 0 );
+		context->lazy_producers = mlt_deque_init();
 	}
 	return context;
 }
@@ -1665,21 +1935,74 @@ static void context_close( deserialise_context context )
 	mlt_deque_close( context->stack_types );
 	mlt_deque_close( context->stack_node );
 	mlt_deque_close( context->stack_branch );
+	mlt_deque_close( context->lazy_producers );
 	xmlFreeDoc( context->entity_doc );
 	free( context->lc_numeric );
 	free( context );
 }
 
-mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *data )
+/** Run one pass of the SAX callbacks over the document.
+ *
+ * \return true if the document is well formed
+ */
+
+static int parse_document( deserialise_context context, xmlSAXHandler *sax, mltbin bin, const char *filename, char *data )
+{
+	xmlSAXHandler *sax_orig;
+	struct _xmlParserCtxt *xmlcontext;
+	int well_formed = 0;
+
+	// Replay a binary project, which needs only the private context
+	if ( bin )
+	{
+		xmlcontext = calloc( 1, sizeof( struct _xmlParserCtxt ) );
+		if ( xmlcontext == NULL )
+			return 0;
+		xmlcontext->_private = ( void* )context;
+		well_formed = !mltbin_parse( bin, xmlcontext, sax );
+		free( xmlcontext );
+		return well_formed;
+	}
+
+	if ( filename )
+		xmlcontext = xmlCreateFileParserCtxt( filename );
+	else
+		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
+
+	// Invalid context
+	if ( xmlcontext == NULL )
+		return 0;
+
+	sax_orig = xmlcontext->sax;
+	xmlcontext->sax = sax;
+	xmlcontext->_private = ( void* )context;
+	xmlParseDocument( xmlcontext );
+	well_formed = xmlcontext->wellFormed;
+
+	// Cleanup after parsing
+	xmlcontext->sax = sax_orig;
+	xmlcontext->_private = NULL;
+	if ( xmlcontext->myDoc )
+		xmlFreeDoc( xmlcontext->myDoc );
+	xmlFreeParserCtxt( xmlcontext );
+
+	return well_formed;
+}
+
+/** Load a document, or an update of one that is only compared with the live
+ * services and opens none of the media of the producers that have a length.
+ */
+
+static mlt_producer load_document( mlt_profile profile, const char *id, char *data, int update )
 {
-	xmlSAXHandler *sax, *sax_orig;
+	xmlSAXHandler *sax;
 	deserialise_context context;
 	mlt_properties properties = NULL;
 	int i = 0;
-	struct _xmlParserCtxt *xmlcontext;
 	int well_formed = 0;
 	char *filename = NULL;
 	int is_filename = strcmp( id, "xml-string" );
+	mltbin bin = NULL;
 
 	// Strip file:// prefix
 	if ( data && strlen( data ) >= 7 && strncmp( data, "file://", 7 ) == 0 )
@@ -1691,6 +2014,7 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	context = context_new( profile );
 	if ( context == NULL )
 		return NULL;
+	context->update = update;
 
 	// Decode URL and parse parameters
 	mlt_properties_set( context->producer_map, "root", "" );
@@ -1738,6 +2062,16 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 		}
 	}
 
+	// Opt in to loading the media of producers on first use
+	const char *lazy = mlt_properties_get( context->params, "lazy" );
+	if ( lazy == NULL )
+		lazy = getenv( "MLT_XML_LAZY" );
+	context->lazy = lazy ? atoi( lazy ) : 0;
+	const char *threads = mlt_properties_get( context->params, "threads" );
+	if ( threads == NULL )
+		threads = getenv( "MLT_XML_THREADS" );
+	context->threads = threads ? atoi( threads ) : 0;
+
 	// We need to track the number of registered filters
 	mlt_properties_set_int( context->destructors, "registered", 0 );
 
@@ -1754,36 +2088,26 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	xmlSubstituteEntitiesDefault( 1 );
 	// This is used to facilitate entity substitution in the SAX parser
 	context->entity_doc = xmlNewDoc( _x("1.0") );
-	if ( is_filename )
-		xmlcontext = xmlCreateFileParserCtxt( filename );
-	else
-		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
 
-	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
+	// A binary project is mapped once and replayed in both passes
+	if ( !strcmp( id, "mltbin" ) )
 	{
-		context_close( context );
-		free( sax );
-		return NULL;
+		bin = mltbin_open( filename );
+		if ( bin == NULL )
+		{
+			context_close( context );
+			free( sax );
+			return NULL;
+		}
 	}
 
 	// Parse
-	sax_orig = xmlcontext->sax;
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;	
-	xmlParseDocument( xmlcontext );
-	well_formed = xmlcontext->wellFormed;
-	
-	// Cleanup after parsing
-	xmlcontext->sax = sax_orig;
-	xmlcontext->_private = NULL;
-	if ( xmlcontext->myDoc )
-		xmlFreeDoc( xmlcontext->myDoc );
-	xmlFreeParserCtxt( xmlcontext );
+	well_formed = parse_document( context, sax, bin, is_filename ? filename : NULL, data );
 
 	// Bad xml - clean up and return NULL
 	if ( !well_formed )
 	{
+		mltbin_close( bin );
 		context_close( context );
 		free( sax );
 		return NULL;
@@ -1791,18 +2115,6 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 
 	// Setup the second pass
 	context->pass ++;
-	if ( is_filename )
-		xmlcontext = xmlCreateFileParserCtxt( filename );
-	else
-		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
-
-	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
-	{
-		context_close( context );
-		free( sax );
-		return NULL;
-	}
 
 	// Reset the stack.
 	mlt_deque_close( context->stack_service );
@@ -1829,22 +2141,14 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	sax->getEntity = on_get_entity;
 
 	// Parse
-	sax_orig = xmlcontext->sax;
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;
-	xmlParseDocument( xmlcontext );
-	well_formed = xmlcontext->wellFormed;
+	well_formed = parse_document( context, sax, bin, is_filename ? filename : NULL, data );
 
 	// Cleanup after parsing
 	xmlFreeDoc( context->entity_doc );
 	context->entity_doc = NULL;
 	free( sax );
+	mltbin_close( bin );
 	xmlMemoryDump( ); // for debugging
-	xmlcontext->sax = sax_orig;
-	xmlcontext->_private = NULL;
-	if ( xmlcontext->myDoc )
-		xmlFreeDoc( xmlcontext->myDoc );
-	xmlFreeParserCtxt( xmlcontext );
 
 	// Get the last producer on the stack
 	enum service_type type;
@@ -1891,7 +2195,8 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 		mlt_properties_set( properties, "title", title );
 
 		// Optimise for overlapping producers
-		mlt_producer_optimise( MLT_PRODUCER( service ) );
+		if ( !update )
+			mlt_producer_optimise( MLT_PRODUCER( service ) );
 
 		// Handle deep copies
 		if ( getenv( "MLT_XML_DEEP" ) == NULL )
@@ -1927,6 +2232,25 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 		mlt_properties_set_int( properties, "seekable", context->seekable );
 
 		retain_services( context, service );
+
+		// Open the media of the placeholders concurrently
+		if ( !update && context->threads > 1 && !context->lazy )
+		{
+			lazy_loader loader = lazy_loader_start( context, context->threads );
+			if ( loader )
+			{
+				lazy_loader_wait( loader );
+				lazy_loader_close( loader );
+			}
+		}
+		// Or start loading the deferred media in the background
+		else if ( !update && context->lazy > 1 )
+		{
+			lazy_loader loader = lazy_loader_start( context, context->threads > 1 ? context->threads : 1 );
+			if ( loader )
+				mlt_properties_set_data( MLT_SERVICE_PROPERTIES( service ), "_xml_loader", loader, 0,
+					( mlt_destructor )lazy_loader_close, NULL );
+		}
 	}
 	else
 	{
@@ -1941,3 +2265,32 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 
 	return MLT_PRODUCER( service );
 }
+
+/** Apply the updated document, or the file name of one, set on xml_update.
+*/
+
+static void on_xml_update( mlt_properties owner, mlt_service self, char *name )
+{
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( self );
+	char *data = mlt_properties_get( properties, "xml_update" );
+	mlt_producer update;
+
+	if ( strcmp( name, "xml_update" ) || data == NULL )
+		return;
+
+	data = trim( strdup( data ) );
+	mlt_properties_set( properties, "xml_update", NULL );
+	update = load_document( mlt_service_profile( self ), data[0] == '<' ? "xml-string" : "xml", data, 1 );
+	mlt_properties_set_int( properties, "xml_update_error", mlt_xml_update( self, MLT_PRODUCER_SERVICE( update ) ) );
+	mlt_producer_close( update );
+	free( data );
+}
+
+mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *data )
+{
+	mlt_producer producer = load_document( profile, id, data, 0 );
+
+	if ( producer )
+		mlt_events_listen( MLT_PRODUCER_PROPERTIES( producer ), producer, "property-changed", ( mlt_listener )on_xml_update );
+	return producer;
+}
@@ -0,0 +1,528 @@
+/*
+ * xml_update.c -- apply an updated service network to a live one
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "common.h"
+
+#include <framework/mlt.h>
+#include <framework/mlt_log.h>
+#include <stdio.h>
+#include <string.h>
+
+struct update_context_s
+{
+	mlt_properties live;
+	mlt_properties update;
+	int properties;
+	int changes;
+};
+typedef struct update_context_s *update_context;
+
+/** Get the type of a service.
+ *
+ * The XML producer keeps aside the type of the root of a file, and cuts and
+ * placeholders are producers that do not identify as such.
+ */
+
+static mlt_service_type service_type( mlt_service service )
+{
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
+	int type = mlt_properties_get_int( properties, "_original_type" );
+	char *mlt_type = mlt_properties_get( properties, "mlt_type" );
+
+	if ( type )
+		return type;
+	type = mlt_service_identify( service );
+	if ( type == unknown_type && mlt_type && !strcmp( mlt_type, "mlt_producer" ) )
+		type = producer_type;
+	return type;
+}
+
+/** Map the services that have an id in a service network.
+*/
+
+static void map_services( mlt_properties map, mlt_service service )
+{
+	char *id;
+	int i;
+
+	if ( service == NULL )
+		return;
+
+	id = mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "id" );
+	if ( id )
+	{
+		if ( mlt_properties_get_data( map, id, NULL ) )
+			return;
+		mlt_properties_set_data( map, id, service, 0, NULL, NULL );
+	}
+
+	for ( i = 0; i < mlt_service_filter_count( service ); i ++ )
+		map_services( map, MLT_FILTER_SERVICE( mlt_service_filter( service, i ) ) );
+
+	switch ( service_type( service ) )
+	{
+		case playlist_type:
+		{
+			mlt_playlist playlist = MLT_PLAYLIST( service );
+			for ( i = 0; i < mlt_playlist_count( playlist ); i ++ )
+			{
+				mlt_playlist_clip_info info;
+				if ( mlt_playlist_is_blank( playlist, i ) || mlt_playlist_get_clip_info( playlist, &info, i ) )
+					continue;
+				map_services( map, MLT_PRODUCER_SERVICE( info.cut ) );
+			}
+			break;
+		}
+		case tractor_type:
+		{
+			mlt_multitrack multitrack = mlt_tractor_multitrack( MLT_TRACTOR( service ) );
+			mlt_service planted = mlt_service_producer( service );
+
+			map_services( map, MLT_MULTITRACK_SERVICE( multitrack ) );
+			for ( i = 0; i < mlt_multitrack_count( multitrack ); i ++ )
+				map_services( map, MLT_PRODUCER_SERVICE( mlt_multitrack_track( multitrack, i ) ) );
+			for ( ; planted && planted != MLT_MULTITRACK_SERVICE( multitrack ); planted = mlt_service_producer( planted ) )
+				map_services( map, planted );
+			break;
+		}
+		case producer_type:
+			if ( mlt_producer_is_cut( MLT_PRODUCER( service ) ) )
+				map_services( map, MLT_PRODUCER_SERVICE( mlt_producer_cut_parent( MLT_PRODUCER( service ) ) ) );
+			break;
+		default:
+			break;
+	}
+}
+
+static int string_equal( const char *a, const char *b )
+{
+	return a == b || ( a && b && !strcmp( a, b ) );
+}
+
+/** Find the live service that a service of the update stands for.
+ *
+ * It is the live service with the same id when it is the same kind of
+ * service on the same resource, otherwise it is the service of the update,
+ * which then takes the place of the live one.
+ */
+
+static mlt_service resolve( update_context self, mlt_service service )
+{
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
+	char *id = mlt_properties_get( properties, "id" );
+	mlt_service live = id ? mlt_properties_get_data( self->live, id, NULL ) : NULL;
+
+	if ( live && service_type( live ) == service_type( service )
+		 && string_equal( mlt_properties_get( MLT_SERVICE_PROPERTIES( live ), "mlt_service" ), mlt_properties_get( properties, "mlt_service" ) )
+		 && ( service_type( service ) != producer_type
+			  || string_equal( mlt_properties_get( MLT_SERVICE_PROPERTIES( live ), "resource" ), mlt_properties_get( properties, "resource" ) ) ) )
+		return live;
+	return service;
+}
+
+static mlt_producer resolve_producer( update_context self, mlt_producer producer )
+{
+	return MLT_PRODUCER( resolve( self, MLT_PRODUCER_SERVICE( producer ) ) );
+}
+
+/** Set the properties that differ on a live service.
+ *
+ * The producers, filters and transitions of the update carry the properties
+ * of their XML elements, which are the only ones compared, so that what a
+ * producer reports about its media is kept. Otherwise the public properties
+ * are compared, but for the in, out and length that follow from the contents
+ * of a container or cut.
+ */
+
+static void update_properties( update_context self, mlt_service live, mlt_service service )
+{
+	mlt_properties source = mlt_properties_get_data( MLT_SERVICE_PROPERTIES( service ), "_xml_update", NULL );
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( live );
+	int structural = source == NULL;
+	int i;
+
+	if ( live == service )
+		return;
+	if ( source == NULL )
+		source = MLT_SERVICE_PROPERTIES( service );
+
+	for ( i = 0; i < mlt_properties_count( source ); i ++ )
+	{
+		char *name = mlt_properties_get_name( source, i );
+		char *value = mlt_properties_get_value( source, i );
+
+		if ( value == NULL || name[0] == '_' || !strcmp( name, "mlt_type" ) || !strcmp( name, "mlt_service" )
+			 || !strcmp( name, "resource" ) || !strcmp( name, "id" ) )
+			continue;
+		if ( structural && ( !strcmp( name, "in" ) || !strcmp( name, "out" ) || !strcmp( name, "length" ) ) )
+			continue;
+		if ( !string_equal( mlt_properties_get( properties, name ), value ) )
+		{
+			mlt_properties_set( properties, name, value );
+			self->properties ++;
+		}
+	}
+}
+
+static int is_loader( mlt_filter filter )
+{
+	return mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "_loader" );
+}
+
+static int filter_index( mlt_service service, mlt_filter filter )
+{
+	int i;
+	for ( i = 0; i < mlt_service_filter_count( service ); i ++ )
+		if ( mlt_service_filter( service, i ) == filter )
+			return i;
+	return -1;
+}
+
+/** Make the filters of a live service those of the update, in its order.
+ *
+ * The normalising filters that the loader attached stay in front.
+ */
+
+static void update_filters( update_context self, mlt_service live, mlt_service service )
+{
+	int count = mlt_service_filter_count( service );
+	int loaders = 0;
+	int i, j;
+
+	if ( live == service )
+		return;
+
+	// Detach the filters that are gone
+	for ( i = mlt_service_filter_count( live ) - 1; i >= 0; i -- )
+	{
+		mlt_filter filter = mlt_service_filter( live, i );
+		int found = is_loader( filter );
+
+		for ( j = 0; !found && j < count; j ++ )
+			found = MLT_FILTER( resolve( self, MLT_FILTER_SERVICE( mlt_service_filter( service, j ) ) ) ) == filter;
+		if ( !found )
+		{
+			mlt_service_detach( live, filter );
+			self->changes ++;
+		}
+	}
+	for ( i = 0; i < mlt_service_filter_count( live ); i ++ )
+		loaders += is_loader( mlt_service_filter( live, i ) );
+
+	// Attach the new ones and put them all in order
+	for ( i = 0, j = loaders; i < count; i ++ )
+	{
+		mlt_filter filter = mlt_service_filter( service, i );
+		mlt_filter target = MLT_FILTER( resolve( self, MLT_FILTER_SERVICE( filter ) ) );
+		int index;
+
+		if ( is_loader( filter ) )
+			continue;
+		if ( target == filter )
+		{
+			mlt_service_attach( live, filter );
+			mlt_service_detach( service, filter );
+			i --;
+			count --;
+			self->changes ++;
+		}
+		else if ( filter_index( live, target ) < 0 )
+		{
+			// A filter that moved from another service
+			mlt_service_attach( live, target );
+			self->changes ++;
+		}
+		index = filter_index( live, target );
+		if ( index >= 0 && index != j )
+		{
+			mlt_service_move_filter( live, index, j );
+			self->changes ++;
+		}
+		j ++;
+	}
+}
+
+/** Bring a cut that is kept up to date with the one of the update.
+*/
+
+static void update_cut( update_context self, mlt_producer live, mlt_producer cut )
+{
+	update_properties( self, MLT_PRODUCER_SERVICE( live ), MLT_PRODUCER_SERVICE( cut ) );
+	update_filters( self, MLT_PRODUCER_SERVICE( live ), MLT_PRODUCER_SERVICE( cut ) );
+}
+
+static int entry_equal( update_context self, mlt_playlist live, int i, mlt_playlist playlist, int j )
+{
+	mlt_playlist_clip_info a, b;
+
+	if ( mlt_playlist_get_clip_info( live, &a, i ) || mlt_playlist_get_clip_info( playlist, &b, j ) )
+		return 0;
+	if ( mlt_playlist_is_blank( live, i ) || mlt_playlist_is_blank( playlist, j ) )
+		return mlt_playlist_is_blank( live, i ) && mlt_playlist_is_blank( playlist, j ) && a.frame_count == b.frame_count;
+	return a.producer == resolve_producer( self, b.producer ) && a.frame_in == b.frame_in
+		&& a.frame_out == b.frame_out && a.repeat == b.repeat;
+}
+
+/** Replace the entries of a live playlist that differ from the update.
+ *
+ * The entries in common at both ends are kept with their cuts, and the ones
+ * in between are removed and inserted again from the update.
+ */
+
+static void update_playlist( update_context self, mlt_playlist live, mlt_playlist playlist )
+{
+	int live_count = mlt_playlist_count( live );
+	int count = mlt_playlist_count( playlist );
+	int head = 0, tail = 0;
+	int i;
+
+	while ( head < live_count && head < count && entry_equal( self, live, head, playlist, head ) )
+		head ++;
+	while ( tail < live_count - head && tail < count - head
+			&& entry_equal( self, live, live_count - tail - 1, playlist, count - tail - 1 ) )
+		tail ++;
+
+	if ( head + tail < live_count || head + tail < count )
+	{
+		for ( i = live_count - tail - 1; i >= head; i -- )
+			mlt_playlist_remove( live, i );
+		for ( i = head; i < count - tail; i ++ )
+		{
+			mlt_playlist_clip_info info;
+
+			mlt_playlist_get_clip_info( playlist, &info, i );
+			if ( mlt_playlist_is_blank( playlist, i ) )
+			{
+				mlt_playlist_insert_blank( live, i, info.frame_count - 1 );
+			}
+			else
+			{
+				mlt_playlist_insert( live, resolve_producer( self, info.producer ), i, info.frame_in, info.frame_out );
+				if ( info.repeat > 1 )
+					mlt_playlist_repeat_clip( live, i, info.repeat );
+				update_cut( self, mlt_playlist_get_clip( live, i ), info.cut );
+			}
+		}
+		self->changes += live_count - head - tail + count - head - tail;
+	}
+
+	// The cuts kept by position may still have other properties and filters
+	for ( i = 0; i < head; i ++ )
+		if ( !mlt_playlist_is_blank( live, i ) )
+			update_cut( self, mlt_playlist_get_clip( live, i ), mlt_playlist_get_clip( playlist, i ) );
+	for ( i = 1; i <= tail; i ++ )
+		if ( !mlt_playlist_is_blank( live, mlt_playlist_count( live ) - i ) )
+			update_cut( self, mlt_playlist_get_clip( live, mlt_playlist_count( live ) - i ),
+				mlt_playlist_get_clip( playlist, count - i ) );
+}
+
+static int track_equal( update_context self, mlt_producer live, mlt_producer track )
+{
+	if ( mlt_producer_cut_parent( live ) != resolve_producer( self, mlt_producer_cut_parent( track ) ) )
+		return 0;
+	if ( mlt_producer_is_cut( live ) != mlt_producer_is_cut( track ) )
+		return 0;
+	return !mlt_producer_is_cut( live ) || ( mlt_producer_get_in( live ) == mlt_producer_get_in( track )
+		&& mlt_producer_get_out( live ) == mlt_producer_get_out( track ) );
+}
+
+/** Plant the filters and transitions of a tractor in the order of the update.
+ *
+ * The ones above the first that differs are taken out of the field and
+ * planted again, with the new ones in their places.
+ */
+
+static void update_field( update_context self, mlt_tractor live, mlt_tractor tractor )
+{
+	mlt_field field = mlt_tractor_field( live );
+	mlt_service bottom = MLT_MULTITRACK_SERVICE( mlt_tractor_multitrack( live ) );
+	mlt_service update_bottom = MLT_MULTITRACK_SERVICE( mlt_tractor_multitrack( tractor ) );
+	mlt_deque planted = mlt_deque_init();
+	mlt_deque wanted = mlt_deque_init();
+	mlt_service service;
+	int i, first;
+
+	for ( service = mlt_service_producer( MLT_TRACTOR_SERVICE( live ) ); service && service != bottom; service = mlt_service_producer( service ) )
+		mlt_deque_push_front( planted, service );
+	for ( service = mlt_service_producer( MLT_TRACTOR_SERVICE( tractor ) ); service && service != update_bottom; service = mlt_service_producer( service ) )
+		mlt_deque_push_front( wanted, resolve( self, service ) );
+
+	for ( first = 0; first < mlt_deque_count( planted ) && first < mlt_deque_count( wanted ); first ++ )
+		if ( mlt_deque_peek( planted, first ) != mlt_deque_peek( wanted, first ) )
+			break;
+
+	if ( field && ( first < mlt_deque_count( planted ) || first < mlt_deque_count( wanted ) ) )
+	{
+		// Hold on to the services while they are out of the field
+		for ( i = first; i < mlt_deque_count( planted ); i ++ )
+			mlt_properties_inc_ref( MLT_SERVICE_PROPERTIES( ( mlt_service )mlt_deque_peek( planted, i ) ) );
+		for ( i = mlt_deque_count( planted ) - 1; i >= first; i -- )
+			mlt_field_disconnect_service( field, mlt_deque_peek( planted, i ) );
+
+		for ( i = first; i < mlt_deque_count( wanted ); i ++ )
+		{
+			service = mlt_deque_peek( wanted, i );
+			if ( service_type( service ) == transition_type )
+				mlt_field_plant_transition( field, MLT_TRANSITION( service ),
+					mlt_transition_get_a_track( MLT_TRANSITION( service ) ),
+					mlt_transition_get_b_track( MLT_TRANSITION( service ) ) );
+			else if ( service_type( service ) == filter_type )
+				mlt_field_plant_filter( field, MLT_FILTER( service ), mlt_filter_get_track( MLT_FILTER( service ) ) );
+		}
+
+		for ( i = first; i < mlt_deque_count( planted ); i ++ )
+			mlt_service_close( mlt_deque_peek( planted, i ) );
+		self->changes += mlt_deque_count( planted ) - first + mlt_deque_count( wanted ) - first;
+	}
+
+	mlt_deque_close( planted );
+	mlt_deque_close( wanted );
+}
+
+/** Connect the tracks of the update that differ to a live tractor.
+*/
+
+static void update_tractor( update_context self, mlt_tractor live, mlt_tractor tractor )
+{
+	mlt_multitrack multitrack = mlt_tractor_multitrack( live );
+	mlt_multitrack update_multitrack = mlt_tractor_multitrack( tractor );
+	int count = mlt_multitrack_count( update_multitrack );
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		mlt_producer track = mlt_multitrack_track( update_multitrack, i );
+		mlt_producer current = i < mlt_multitrack_count( multitrack ) ? mlt_multitrack_track( multitrack, i ) : NULL;
+
+		if ( current && track_equal( self, current, track ) )
+		{
+			if ( mlt_producer_is_cut( current ) )
+				update_cut( self, current, track );
+		}
+		else
+		{
+			mlt_producer parent = resolve_producer( self, mlt_producer_cut_parent( track ) );
+
+			if ( mlt_producer_is_cut( track ) )
+			{
+				mlt_producer cut = mlt_producer_cut( parent, mlt_producer_get_in( track ), mlt_producer_get_out( track ) );
+				mlt_multitrack_connect( multitrack, cut, i );
+				update_cut( self, cut, track );
+				mlt_producer_close( cut );
+			}
+			else
+			{
+				mlt_multitrack_connect( multitrack, parent, i );
+			}
+			self->changes ++;
+		}
+	}
+	for ( i = mlt_multitrack_count( multitrack ) - 1; i >= count; i -- )
+	{
+		mlt_multitrack_disconnect( multitrack, i );
+		self->changes ++;
+	}
+
+	update_field( self, live, tractor );
+}
+
+/** Bring a live service up to date with its counterpart in the update.
+*/
+
+static void update_service( update_context self, mlt_service live, mlt_service service )
+{
+	if ( live == service )
+		return;
+
+	switch ( service_type( live ) )
+	{
+		case playlist_type:
+			update_playlist( self, MLT_PLAYLIST( live ), MLT_PLAYLIST( service ) );
+			break;
+		case tractor_type:
+			update_tractor( self, MLT_TRACTOR( live ), MLT_TRACTOR( service ) );
+			break;
+		default:
+			break;
+	}
+	update_properties( self, live, service );
+	update_filters( self, live, service );
+}
+
+/** Apply a service network loaded from an updated XML document to a live one.
+ *
+ * The services are matched by their id. The properties that changed are set
+ * on the live services, the entries, tracks, filters and transitions that
+ * changed are replaced, and the services that are new are moved in from the
+ * update. The producers that are kept are not opened again, so their decoders
+ * and caches survive the edit.
+ *
+ * \param live the service returned by the XML producer
+ * \param update the service loaded from the updated document
+ * \return true if the update does not fit the live service network
+ */
+
+int mlt_xml_update( mlt_service live, mlt_service update )
+{
+	struct update_context_s context;
+	update_context self = &context;
+	int i;
+
+	if ( live == NULL || update == NULL || service_type( live ) != service_type( update ) )
+		return 1;
+
+	self->live = mlt_properties_new();
+	self->update = mlt_properties_new();
+	self->properties = 0;
+	self->changes = 0;
+	map_services( self->live, live );
+	map_services( self->update, update );
+
+	// Hold on to the services, as replacing one may release another
+	for ( i = 0; i < mlt_properties_count( self->live ); i ++ )
+		mlt_properties_inc_ref( MLT_SERVICE_PROPERTIES( ( mlt_service )mlt_properties_get_data_at( self->live, i, NULL ) ) );
+	for ( i = 0; i < mlt_properties_count( self->update ); i ++ )
+		mlt_properties_inc_ref( MLT_SERVICE_PROPERTIES( ( mlt_service )mlt_properties_get_data_at( self->update, i, NULL ) ) );
+
+	// The root last, as the update of its tracks and field follows from the rest
+	for ( i = 0; i < mlt_properties_count( self->update ); i ++ )
+	{
+		mlt_service service = mlt_properties_get_data_at( self->update, i, NULL );
+		mlt_service target = resolve( self, service );
+		if ( target != service && target != live )
+			update_service( self, target, service );
+	}
+	update_service( self, live, update );
+
+	// The services moved in no longer need what their elements set
+	for ( i = 0; i < mlt_properties_count( self->update ); i ++ )
+	{
+		mlt_service service = mlt_properties_get_data_at( self->update, i, NULL );
+		mlt_properties_set_data( MLT_SERVICE_PROPERTIES( service ), "_xml_update", NULL, 0, NULL, NULL );
+		mlt_service_close( service );
+	}
+	for ( i = 0; i < mlt_properties_count( self->live ); i ++ )
+		mlt_service_close( mlt_properties_get_data_at( self->live, i, NULL ) );
+
+	mlt_log_verbose( live, "[producer_xml] update changed %d properties and %d services\n", self->properties, self->changes );
+	mlt_properties_close( self->live );
+	mlt_properties_close( self->update );
+
+	return 0;
+}
@@ -18,7 +18,11 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#if defined(SWIGPYTHON)
+%module(threads="1") mlt
+#else
 %module mlt
+#endif
 %include "carrays.i"
 %array_class(unsigned char, UnsignedCharArray);
 
@@ -28,6 +32,30 @@ int mlt_log_get_level( void );
 void mlt_log_set_level( int );
 %}
 
+#if defined(SWIGPYTHON)
+/* Keep the interpreter lock by default, and release it around the calls
+ * that block or render so that other Python threads run meanwhile. The
+ * listeners take it back when the framework calls them.
+ */
+%nothread;
+%thread Mlt::Factory::init;
+%thread Mlt::Factory::close;
+%thread Mlt::Factory::producer;
+%thread Mlt::Properties::wait_for;
+%thread Mlt::Service::get_frame;
+%thread Mlt::Frame::get_image;
+%thread Mlt::Frame::get_audio;
+%thread Mlt::Frame::get_waveform;
+%thread Mlt::Consumer::run;
+%thread Mlt::Consumer::start;
+%thread Mlt::Consumer::stop;
+%thread Mlt::Consumer::purge;
+%thread Mlt::Consumer::~Consumer;
+%thread Mlt::Producer::Producer;
+%thread frame_get_waveform;
+%thread frame_get_image;
+#endif
+
 /** These methods return objects which should be gc'd.
  */
 
@@ -240,19 +268,307 @@ binary_data frame_get_image( Mlt::Frame &frame, mlt_image_format format, int w,
 	return result;
 }
 
+/** A Python object that exports memory of a frame through the buffer
+ * protocol, so that memoryview() and numpy.asarray() read it in place. It
+ * holds a reference to the frame for as long as it or any view of it lives.
+ */
+
+typedef struct
+{
+	PyObject_HEAD
+	Mlt::Frame *frame;
+	void *data;
+	int readonly;
+	int ndim;
+	Py_ssize_t itemsize;
+	const char *format;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+} frame_buffer;
+
+static void frame_buffer_dealloc( PyObject *self )
+{
+	delete ( ( frame_buffer* ) self )->frame;
+	PyObject_Del( self );
+}
+
+static int frame_buffer_get( PyObject *self, Py_buffer *view, int flags )
+{
+	frame_buffer *buffer = ( frame_buffer* ) self;
+	Py_ssize_t size = buffer->itemsize;
+	int contiguous = 1;
+	int i;
+
+	for ( i = buffer->ndim - 1; i >= 0; i-- )
+	{
+		if ( buffer->strides[i] != size )
+			contiguous = 0;
+		size *= buffer->shape[i];
+	}
+	view->obj = NULL;
+	if ( ( flags & PyBUF_WRITABLE ) == PyBUF_WRITABLE && buffer->readonly )
+	{
+		PyErr_SetString( PyExc_BufferError, "the frame buffer is read-only" );
+		return -1;
+	}
+	if ( !contiguous && ( ( flags & PyBUF_STRIDES ) != PyBUF_STRIDES || ( flags & ( PyBUF_C_CONTIGUOUS | PyBUF_F_CONTIGUOUS | PyBUF_ANY_CONTIGUOUS ) & ~PyBUF_STRIDES ) ) )
+	{
+		PyErr_SetString( PyExc_BufferError, "the frame buffer is not contiguous" );
+		return -1;
+	}
+	if ( ( flags & PyBUF_F_CONTIGUOUS ) == PyBUF_F_CONTIGUOUS && buffer->ndim > 1 )
+	{
+		PyErr_SetString( PyExc_BufferError, "the frame buffer is not Fortran contiguous" );
+		return -1;
+	}
+	view->buf = buffer->data;
+	view->obj = self;
+	Py_INCREF( self );
+	view->len = size;
+	view->readonly = buffer->readonly;
+	view->itemsize = buffer->itemsize;
+	view->format = ( flags & PyBUF_FORMAT ) == PyBUF_FORMAT ? ( char* ) buffer->format : NULL;
+	view->ndim = buffer->ndim;
+	view->shape = ( flags & PyBUF_ND ) == PyBUF_ND ? buffer->shape : NULL;
+	view->strides = ( flags & PyBUF_STRIDES ) == PyBUF_STRIDES ? buffer->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs frame_buffer_procs;
+static PyTypeObject frame_buffer_type = { PyVarObject_HEAD_INIT( NULL, 0 ) };
+
+static PyObject *frame_buffer_new( Mlt::Frame &frame, void *data, int readonly, const char *format, int itemsize,
+	int ndim, const Py_ssize_t *shape, const Py_ssize_t *strides )
+{
+	frame_buffer *buffer;
+	int i;
+
+	if ( !frame_buffer_type.tp_name )
+	{
+		frame_buffer_procs.bf_getbuffer = frame_buffer_get;
+		frame_buffer_type.tp_name = "mlt.FrameBuffer";
+		frame_buffer_type.tp_basicsize = sizeof( frame_buffer );
+		frame_buffer_type.tp_dealloc = frame_buffer_dealloc;
+		frame_buffer_type.tp_as_buffer = &frame_buffer_procs;
+		frame_buffer_type.tp_doc = "Memory of a frame for memoryview() or numpy.asarray()";
+#if PY_MAJOR_VERSION < 3
+		frame_buffer_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#else
+		frame_buffer_type.tp_flags = Py_TPFLAGS_DEFAULT;
+#endif
+		if ( PyType_Ready( &frame_buffer_type ) < 0 )
+		{
+			frame_buffer_type.tp_name = NULL;
+			return NULL;
+		}
+	}
+	buffer = PyObject_New( frame_buffer, &frame_buffer_type );
+	if ( !buffer )
+		return NULL;
+	buffer->frame = new Mlt::Frame( frame );
+	buffer->data = data;
+	buffer->readonly = readonly;
+	buffer->format = format;
+	buffer->itemsize = itemsize;
+	buffer->ndim = ndim;
+	for ( i = 0; i < ndim; i++ )
+	{
+		buffer->shape[i] = shape[i];
+		buffer->strides[i] = strides[i];
+	}
+	return ( PyObject* ) buffer;
+}
+
+/** Get the planes of the image of a frame without copying them.
+ *
+ * Each plane is a buffer of rows, columns and, for packed formats,
+ * components, of unsigned 8 or 16-bit samples. Returns None if there is no
+ * image in memory.
+ */
+
+PyObject *frame_get_image_view( Mlt::Frame &frame, mlt_image_format format, int w, int h, int writable = 0 )
+{
+	Mlt::ImageView view;
+	PyObject *result;
+	int i;
+
+	Py_BEGIN_ALLOW_THREADS
+	view = Mlt::ImageView( frame, format, w, h, writable );
+	Py_END_ALLOW_THREADS
+	if ( !view.is_valid( ) )
+		Py_RETURN_NONE;
+	result = PyTuple_New( view.count( ) );
+	for ( i = 0; result && i < view.count( ); i++ )
+	{
+		int components = view.components( i );
+		Py_ssize_t shape[3] = { view.rows( i ), view.columns( i ), components };
+		Py_ssize_t strides[3] = { view.stride( i ), components * view.sample_size( ), view.sample_size( ) };
+		PyObject *plane = frame_buffer_new( view.frame( ), view.plane( i ), !writable,
+			view.sample_size( ) == 2 ? "H" : "B", view.sample_size( ), components > 1 ? 3 : 2, shape, strides );
+		if ( !plane )
+		{
+			Py_DECREF( result );
+			return NULL;
+		}
+		PyTuple_SET_ITEM( result, i, plane );
+	}
+	return result;
+}
+
+/** Get the audio of a frame without copying it.
+ *
+ * The buffer has a row per channel for planar formats and a row per sample
+ * for interleaved ones. Returns None if there is no audio.
+ */
+
+PyObject *frame_get_audio_view( Mlt::Frame &frame, mlt_audio_format format, int frequency, int channels, int samples )
+{
+	Mlt::AudioView view;
+	Py_ssize_t size;
+	const char *type = "B";
+
+	Py_BEGIN_ALLOW_THREADS
+	view = Mlt::AudioView( frame, format, frequency, channels, samples );
+	Py_END_ALLOW_THREADS
+	size = view.sample_size( );
+	if ( !view.is_valid( ) )
+		Py_RETURN_NONE;
+	switch ( view.format( ) )
+	{
+	case mlt_audio_s16:
+		type = "h";
+		break;
+	case mlt_audio_s32:
+	case mlt_audio_s32le:
+		type = "i";
+		break;
+	case mlt_audio_float:
+	case mlt_audio_f32le:
+		type = "f";
+		break;
+	default:
+		break;
+	}
+	if ( view.is_planar( ) )
+	{
+		Py_ssize_t shape[2] = { view.channels( ), view.samples( ) };
+		Py_ssize_t strides[2] = { view.samples( ) * size, size };
+		return frame_buffer_new( view.frame( ), view.data( ), 1, type, size, 2, shape, strides );
+	}
+	else
+	{
+		Py_ssize_t shape[2] = { view.samples( ), view.channels( ) };
+		Py_ssize_t strides[2] = { view.channels( ) * size, size };
+		return frame_buffer_new( view.frame( ), view.data( ), 1, type, size, 2, shape, strides );
+	}
+}
+
+static void python_listener( mlt_properties owner, void *object );
+
+/** A listener that calls a Python callable without arguments.
+ *
+ * Events are fired by the threads of the framework, which do not hold the
+ * interpreter lock, so the callback takes it. Stop the service that fires
+ * the event before the listener is deleted.
+ */
+
+class PythonListener
+{
+	protected:
+		PyObject *callback;
+		Mlt::Event *event;
+
+	public:
+		PythonListener( Mlt::Properties &properties, char *id, PyObject *callback ) :
+			callback( callback )
+		{
+			Py_XINCREF( callback );
+			event = properties.listen( id, this, ( mlt_listener )python_listener );
+		}
+
+		virtual ~PythonListener( )
+		{
+			delete event;
+			Py_XDECREF( callback );
+		}
+
+		void doit( )
+		{
+			PyGILState_STATE state = PyGILState_Ensure( );
+			PyObject *result = PyObject_CallObject( callback, NULL );
+			if ( !result )
+				PyErr_Print( );
+			Py_XDECREF( result );
+			PyGILState_Release( state );
+		}
+};
+
+static void python_listener( mlt_properties owner, void *object )
+{
+	PythonListener *o = static_cast< PythonListener * >( object );
+	o->doit( );
+}
+
 %}
 
+%rename( Listener ) PythonListener;
+
+class PythonListener
+{
+	public:
+		PythonListener( Mlt::Properties &properties, char *id, PyObject *callback );
+		virtual ~PythonListener( );
+};
+
 %typemap(out) binary_data {
         $result =
 %#if PY_MAJOR_VERSION < 3
         PyString_FromStringAndSize(
 %#else
-        PyUnicode_FromStringAndSize(
+        PyBytes_FromStringAndSize(
 %#endif
 	$1.data, $1.size );
 }
 
 binary_data frame_get_waveform(Mlt::Frame&, int, int);
 binary_data frame_get_image(Mlt::Frame&, mlt_image_format, int, int);
+PyObject *frame_get_image_view(Mlt::Frame&, mlt_image_format, int, int, int writable = 0);
+PyObject *frame_get_audio_view(Mlt::Frame&, mlt_audio_format, int, int, int);
+
+%extend Mlt::Frame {
+	PyObject *get_image_view( mlt_image_format format, int w, int h, int writable = 0 )
+	{
+		return frame_get_image_view( *$self, format, w, h, writable );
+	}
+	PyObject *get_audio_view( mlt_audio_format format, int frequency, int channels, int samples )
+	{
+		return frame_get_audio_view( *$self, format, frequency, channels, samples );
+	}
+}
+
+%pythoncode %{
+import threading as _threading
+_render_lock = _threading.Lock()
+
+def render_image(producer, position, image_format, width, height, loop=None, executor=None):
+    """Render the image of a frame of a producer on a thread of an executor.
+
+    Returns an asyncio future of the planes of the image as returned by
+    Frame.get_image_view(), or None if there is no image. The interpreter
+    lock is released while the image renders, so several renders run in
+    parallel, and the default executor of the event loop is used unless
+    another is given. Only the seek and the fetch of the frame are
+    serialised, so one producer can be shared by several renders.
+    """
+    import asyncio
+    def render():
+        with _render_lock:
+            producer.seek(position)
+            frame = producer.get_frame()
+        return frame.get_image_view(image_format, width, height)
+    return (loop or asyncio.get_event_loop()).run_in_executor(executor, render)
+%}
 
 #endif
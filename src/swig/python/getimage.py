@@ -25,6 +25,8 @@ frame.set("consumer_deinterlace", 1)
 
 # Now we are ready to get the image and save it.
 size = (profile.width(), profile.height())
-rgb = frame.get_image(mlt.mlt_image_rgb24, *size)
-img = Image.fromstring('RGB', size, rgb)
+# The view reads the image of the frame in place instead of copying it.
+planes = frame.get_image_view(mlt.mlt_image_rgb24, *size)
+stride = memoryview(planes[0]).strides[0]
+img = Image.frombuffer('RGB', size, planes[0], 'raw', 'RGB', stride, 1)
 img.save(sys.argv[1] + '.png')
@@ -0,0 +1,23 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Render thumbnails of a file in parallel threads from asyncio.
+import asyncio
+import sys
+import mlt
+
+mlt.Factory.init()
+profile = mlt.Profile()
+producer = mlt.Producer(profile, sys.argv[1])
+count = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+
+async def main():
+	step = max(producer.get_length() // count, 1)
+	positions = [i * step for i in range(count)]
+	# The images render concurrently while the event loop stays responsive.
+	images = await asyncio.gather(*[mlt.render_image(producer, position, mlt.mlt_image_rgb24, 160, 90)
+		for position in positions])
+	for position, planes in zip(positions, images):
+		print(position, 'no image' if planes is None else memoryview(planes[0]).shape)
+
+asyncio.run(main())
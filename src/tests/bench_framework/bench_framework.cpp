@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with consumer library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Benchmarks of the framework primitives. Run them with one of the
+// machine-readable output formats of QTest, for example:
+//     ./bench_framework -csv
+//     ./bench_framework -o results.xml,xml
+// and compare the results before and after a change.
+
+#include <QtTest>
+#include <thread>
+#include <vector>
+
+#include <mlt++/Mlt.h>
+using namespace Mlt;
+
+extern "C" {
+#include <framework/mlt_pool.h>
+}
+
+static int slice_noop(int id, int index, int jobs, void* cookie)
+{
+    Q_UNUSED(id)
+    Q_UNUSED(index)
+    Q_UNUSED(jobs)
+    Q_UNUSED(cookie)
+    return 0;
+}
+
+static void pool_worker(int iterations, int size)
+{
+    void* blocks[4];
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < 4; j++)
+            blocks[j] = mlt_pool_alloc(size << j);
+        for (int j = 0; j < 4; j++)
+            mlt_pool_release(blocks[j]);
+    }
+}
+
+class BenchFramework: public QObject
+{
+    Q_OBJECT
+
+public:
+    BenchFramework() {
+        Factory::init();
+    }
+
+private:
+    static Frame* makeImageFrame(mlt_image_format format, int width, int height)
+    {
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame* frame = new Frame(f);
+        mlt_frame_close(f);
+        int size = mlt_image_format_size(format, width, height, NULL);
+        uint8_t* image = (uint8_t*) mlt_pool_alloc(size);
+        for (int i = 0; i < size; i++)
+            image[i] = (i * 53 + 11) & 0xff;
+        frame->set_image(image, size, mlt_pool_release);
+        frame->set("format", format);
+        frame->set("width", width);
+        frame->set("height", height);
+        return frame;
+    }
+
+    static Frame* makeAudioFrame(mlt_audio_format format, int channels, int samples)
+    {
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame* frame = new Frame(f);
+        mlt_frame_close(f);
+        int size = mlt_audio_format_size(format, samples, channels);
+        uint8_t* audio = (uint8_t*) mlt_pool_alloc(size);
+        for (int i = 0; i < size; i++)
+            audio[i] = (i * 29 + 3) & 0xff;
+        mlt_frame_set_audio(frame->get_frame(), audio, format, size, mlt_pool_release);
+        frame->set("audio_channels", channels);
+        frame->set("audio_samples", samples);
+        frame->set("audio_frequency", 48000);
+        return frame;
+    }
+
+    static void addCounts()
+    {
+        QTest::addColumn<int>("count");
+        QTest::newRow("10") << 10;
+        QTest::newRow("100") << 100;
+        QTest::newRow("1000") << 1000;
+        QTest::newRow("10000") << 10000;
+    }
+
+private Q_SLOTS:
+    void PropertiesGet_data()
+    {
+        addCounts();
+    }
+
+    void PropertiesGet()
+    {
+        QFETCH(int, count);
+        Properties p;
+        for (int i = 0; i < count; i++)
+            p.set(QString("property%1").arg(i).toLatin1().constData(), i);
+        QByteArray first("property0");
+        QByteArray last = QString("property%1").arg(count - 1).toLatin1();
+        int sum = 0;
+        QBENCHMARK {
+            sum += p.get_int(first.constData());
+            sum += p.get_int(last.constData());
+        }
+        QVERIFY(sum >= 0);
+    }
+
+    void PropertiesSet_data()
+    {
+        addCounts();
+    }
+
+    void PropertiesSet()
+    {
+        QFETCH(int, count);
+        Properties p;
+        for (int i = 0; i < count; i++)
+            p.set(QString("property%1").arg(i).toLatin1().constData(), i);
+        QByteArray name = QString("property%1").arg(count / 2).toLatin1();
+        int i = 0;
+        QBENCHMARK {
+            p.set(name.constData(), i++);
+            p.set(name.constData(), "string");
+        }
+        QCOMPARE(p.get("property0"), "0");
+    }
+
+    void PropertiesPopulate_data()
+    {
+        addCounts();
+    }
+
+    void PropertiesPopulate()
+    {
+        QFETCH(int, count);
+        std::vector<QByteArray> names;
+        for (int i = 0; i < count; i++)
+            names.push_back(QString("property%1").arg(i).toLatin1());
+        QBENCHMARK {
+            Properties p;
+            for (int i = 0; i < count; i++)
+                p.set(names[i].constData(), i);
+        }
+    }
+
+    void PoolAllocRelease_data()
+    {
+        QTest::addColumn<int>("threads");
+        QTest::newRow("1") << 1;
+        QTest::newRow("2") << 2;
+        QTest::newRow("4") << 4;
+        QTest::newRow("8") << 8;
+    }
+
+    void PoolAllocRelease()
+    {
+        QFETCH(int, threads);
+        QBENCHMARK {
+            std::vector<std::thread> workers;
+            for (int i = 0; i < threads; i++)
+                workers.push_back(std::thread(pool_worker, 10000, 4096));
+            for (auto& worker : workers)
+                worker.join();
+        }
+    }
+
+    void DequePushPop()
+    {
+        mlt_deque deque = mlt_deque_init();
+        QBENCHMARK {
+            for (int i = 0; i < 1000; i++)
+                mlt_deque_push_back(deque, &deque);
+            for (int i = 0; i < 500; i++)
+                mlt_deque_pop_front(deque);
+            for (int i = 0; i < 500; i++)
+                mlt_deque_pop_back(deque);
+        }
+        QCOMPARE(mlt_deque_count(deque), 0);
+        mlt_deque_close(deque);
+    }
+
+    void AnimationGet_data()
+    {
+        QTest::addColumn<int>("keyframes");
+        QTest::newRow("2") << 2;
+        QTest::newRow("10") << 10;
+        QTest::newRow("100") << 100;
+        QTest::newRow("1000") << 1000;
+    }
+
+    void AnimationGet()
+    {
+        QFETCH(int, keyframes);
+        const int interval = 10;
+        const int length = keyframes * interval;
+        QString value;
+        for (int i = 0; i < keyframes; i++)
+            value += QString("%1%2=%3;").arg(i % 2 ? "~" : "").arg(i * interval).arg(i % 7);
+        Properties p;
+        p.set("key", value.toLatin1().constData());
+        p.anim_get_double("key", 0, length);
+        int position = 0;
+        double sum = 0.0;
+        QBENCHMARK {
+            sum += p.anim_get_double("key", position, length);
+            position = (position + 37) % length;
+        }
+        QVERIFY(sum >= 0.0);
+    }
+
+    void SlicesRun_data()
+    {
+        QTest::addColumn<int>("jobs");
+        QTest::newRow("1") << 1;
+        QTest::newRow("4") << 4;
+        QTest::newRow("16") << 16;
+        QTest::newRow("64") << 64;
+    }
+
+    void SlicesRun()
+    {
+        QFETCH(int, jobs);
+        mlt_slices_run_normal(jobs, slice_noop, NULL);
+        QBENCHMARK {
+            mlt_slices_run_normal(jobs, slice_noop, NULL);
+        }
+    }
+
+    void ImageConvert_data()
+    {
+        QTest::addColumn<int>("from");
+        QTest::addColumn<int>("to");
+        QTest::newRow("rgb24 to yuv422") << int(mlt_image_rgb24) << int(mlt_image_yuv422);
+        QTest::newRow("rgb24a to yuv422") << int(mlt_image_rgb24a) << int(mlt_image_yuv422);
+        QTest::newRow("yuv422 to rgb24") << int(mlt_image_yuv422) << int(mlt_image_rgb24);
+        QTest::newRow("yuv422 to rgb24a") << int(mlt_image_yuv422) << int(mlt_image_rgb24a);
+        QTest::newRow("yuv420p to yuv422") << int(mlt_image_yuv420p) << int(mlt_image_yuv422);
+        QTest::newRow("yuv422 to yuv420p") << int(mlt_image_yuv422) << int(mlt_image_yuv420p);
+    }
+
+    void ImageConvert()
+    {
+        QFETCH(int, from);
+        QFETCH(int, to);
+        const int width = 1920;
+        const int height = 1080;
+        Profile profile("atsc_1080p_25");
+        Filter filter(profile, "imageconvert");
+        QVERIFY(filter.is_valid());
+        QBENCHMARK {
+            Frame* frame = makeImageFrame(mlt_image_format(from), width, height);
+            filter.process(*frame);
+            mlt_image_format format = mlt_image_format(to);
+            int w = width;
+            int h = height;
+            frame->get_image(format, w, h);
+            QCOMPARE(int(format), to);
+            delete frame;
+        }
+    }
+
+    void AudioConvert_data()
+    {
+        QTest::addColumn<int>("from");
+        QTest::addColumn<int>("to");
+        QTest::newRow("s16 to float") << int(mlt_audio_s16) << int(mlt_audio_float);
+        QTest::newRow("float to s16") << int(mlt_audio_float) << int(mlt_audio_s16);
+        QTest::newRow("s32le to s16") << int(mlt_audio_s32le) << int(mlt_audio_s16);
+        QTest::newRow("f32le to float") << int(mlt_audio_f32le) << int(mlt_audio_float);
+    }
+
+    void AudioConvert()
+    {
+        QFETCH(int, from);
+        QFETCH(int, to);
+        const int channels = 2;
+        const int samples = 1920;
+        Profile profile("atsc_1080p_25");
+        Filter filter(profile, "audioconvert");
+        QVERIFY(filter.is_valid());
+        QBENCHMARK {
+            Frame* frame = makeAudioFrame(mlt_audio_format(from), channels, samples);
+            filter.process(*frame);
+            mlt_audio_format format = mlt_audio_format(to);
+            int frequency = 48000;
+            int c = channels;
+            int n = samples;
+            frame->get_audio(format, frequency, c, n);
+            QCOMPARE(int(format), to);
+            delete frame;
+        }
+    }
+
+    void Composite_data()
+    {
+        QTest::addColumn<QString>("geometry");
+        QTest::newRow("opaque") << "0/0:100%x100%:100";
+        QTest::newRow("blend") << "0/0:100%x100%:50";
+        QTest::newRow("inset") << "10%/10%:80%x80%:50";
+    }
+
+    void Composite()
+    {
+        QFETCH(QString, geometry);
+        const int width = 1920;
+        const int height = 1080;
+        Profile profile("atsc_1080p_25");
+        Transition transition(profile, "composite");
+        QVERIFY(transition.is_valid());
+        transition.set("geometry", geometry.toLatin1().constData());
+        QBENCHMARK {
+            Frame* a = makeImageFrame(mlt_image_yuv422, width, height);
+            Frame* b = makeImageFrame(mlt_image_yuv422, width, height);
+            mlt_transition_process(transition.get_transition(), a->get_frame(), b->get_frame());
+            mlt_image_format format = mlt_image_yuv422;
+            int w = width;
+            int h = height;
+            QVERIFY(a->get_image(format, w, h, 1) != NULL);
+            delete b;
+            delete a;
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(BenchFramework)
+
+#include "bench_framework.moc"
@@ -0,0 +1,5 @@
+include (../common.pri)
+TARGET   = bench_framework
+SOURCES  = bench_framework.cpp
+CONFIG  -= testcase
+CONFIG  += c++11
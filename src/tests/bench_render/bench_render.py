@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#
+# bench_render.py -- render the reference projects with melt -bench and
+# compare the results with a baseline
+# Copyright (C) 2019 Meltytech, LLC
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+import argparse
+import fnmatch
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# The name, project and extra consumer properties of each scenario
+SCENARIOS = [
+    ('composite_1080p', 'composite_1080p.mlt', []),
+    ('composite_4k', 'composite_4k.mlt', []),
+    ('audio_mix_20', 'audio_mix_20.mlt', ['video_off=1']),
+    ('long_playlist', 'long_playlist.mlt', []),
+    ('titles', 'titles.mlt', []),
+]
+
+# The properties of the avformat consumer, using codecs built into FFmpeg
+AVFORMAT = ['f=matroska', 'vcodec=mpeg4', 'qscale=3', 'acodec=pcm_s16le']
+
+# The allowed change of each metric in percent before it is a regression
+TOLERANCES = {'fps': 10.0, 'cpu_seconds': 15.0, 'peak_rss_kb': 20.0}
+
+# Whether a higher value of each metric is better
+HIGHER_IS_BETTER = {'fps': True, 'cpu_seconds': False, 'peak_rss_kb': False}
+
+
+def default_melt():
+    built = os.path.join(HERE, '..', '..', 'melt', 'melt')
+    if os.access(built, os.X_OK):
+        return built
+    return shutil.which('melt') or 'melt'
+
+
+def run_once(melt, project, consumer, properties, directory):
+    command = [melt, '-bench', os.path.join(HERE, 'projects', project)]
+    if consumer == 'avformat':
+        target = os.path.join(directory, 'output.mkv')
+        command += ['-consumer', 'avformat:' + target] + AVFORMAT
+    else:
+        command += ['-consumer', consumer]
+    command += properties
+    process = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                             stdin=subprocess.DEVNULL, universal_newlines=True)
+    if process.returncode != 0:
+        raise RuntimeError('melt exited with %d: %s' % (process.returncode, process.stderr.strip()[-500:]))
+    try:
+        report = json.loads(process.stdout)
+    except ValueError:
+        raise RuntimeError('melt did not write a report')
+    if report.get('consumer') != consumer:
+        raise RuntimeError('the %s consumer is not available' % consumer)
+    if not report.get('frames'):
+        raise RuntimeError('no frames were rendered')
+    return {
+        'frames': report['frames'],
+        'fps': report['fps'],
+        'cpu_seconds': report.get('user_seconds', 0.0) + report.get('system_seconds', 0.0),
+        'peak_rss_kb': report.get('peak_rss_kb', 0),
+    }
+
+
+def run_scenario(melt, project, consumer, properties, repeat):
+    # Keep the median of the throughput and the best of the costs
+    runs = []
+    with tempfile.TemporaryDirectory(prefix='mlt-bench-') as directory:
+        for i in range(repeat):
+            runs.append(run_once(melt, project, consumer, properties, directory))
+    return {
+        'frames': runs[0]['frames'],
+        'fps': round(statistics.median(r['fps'] for r in runs), 3),
+        'cpu_seconds': round(min(r['cpu_seconds'] for r in runs), 3),
+        'peak_rss_kb': min(r['peak_rss_kb'] for r in runs),
+    }
+
+
+def compare(result, base, tolerances):
+    """Return the problems of a result compared with its baseline."""
+    problems = []
+    if base.get('frames') and base['frames'] != result['frames']:
+        problems.append('rendered %d frames instead of %d' % (result['frames'], base['frames']))
+    limits = dict(tolerances)
+    limits.update(base.get('tolerance', {}))
+    for metric, tolerance in sorted(limits.items()):
+        if not base.get(metric):
+            continue
+        change = 100.0 * (result[metric] - base[metric]) / base[metric]
+        worse = -change if HIGHER_IS_BETTER[metric] else change
+        if worse > tolerance:
+            problems.append('%s %s is %.1f%% worse than %s (tolerance %.1f%%)' %
+                            (metric, result[metric], worse, base[metric], tolerance))
+    return problems
+
+
+def parse_tolerance(value):
+    metric, _, percent = value.partition('=')
+    if metric not in TOLERANCES or not percent:
+        raise argparse.ArgumentTypeError('expected one of %s=percent' % ', '.join(sorted(TOLERANCES)))
+    return metric, float(percent)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Render the reference projects with melt -bench.')
+    parser.add_argument('--melt', default=default_melt(), help='the melt executable')
+    parser.add_argument('--scenario', action='append', default=[],
+                        help='a scenario name or pattern to run, all by default')
+    parser.add_argument('--consumer', action='append', choices=['null', 'avformat'], default=[],
+                        help='a consumer to render to, both by default')
+    parser.add_argument('--repeat', type=int, default=3, help='the runs of each scenario')
+    parser.add_argument('--output', help='write the results to this JSON file')
+    parser.add_argument('--baseline', help='compare the results with this JSON file')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='write the results to the baseline instead of comparing')
+    parser.add_argument('--tolerance', action='append', type=parse_tolerance, default=[],
+                        help='the allowed change of a metric, for example fps=5')
+    args = parser.parse_args()
+
+    consumers = args.consumer or ['null', 'avformat']
+    tolerances = dict(TOLERANCES)
+    tolerances.update(dict(args.tolerance))
+    scenarios = [s for s in SCENARIOS
+                 if not args.scenario or any(fnmatch.fnmatch(s[0], p) for p in args.scenario)]
+    if not scenarios:
+        parser.error('no scenario matches')
+
+    results = {}
+    for name, project, properties in scenarios:
+        for consumer in consumers:
+            key = '%s/%s' % (name, consumer)
+            try:
+                results[key] = run_scenario(args.melt, project, consumer, properties, max(1, args.repeat))
+                print('%-28s %7d frames %9.2f fps %9.2f cpu s %9d kB' %
+                      (key, results[key]['frames'], results[key]['fps'],
+                       results[key]['cpu_seconds'], results[key]['peak_rss_kb']))
+            except (OSError, RuntimeError) as e:
+                results[key] = {'error': str(e)}
+                print('%-28s error: %s' % (key, e))
+            sys.stdout.flush()
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+            f.write('\n')
+
+    failed = any('error' in r for r in results.values())
+    if args.baseline and args.update_baseline:
+        baseline = {}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        for key, result in results.items():
+            if 'error' not in result:
+                # Keep the tolerances chosen for a scenario
+                if 'tolerance' in baseline.get(key, {}):
+                    result = dict(result, tolerance=baseline[key]['tolerance'])
+                baseline[key] = result
+        with open(args.baseline, 'w') as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write('\n')
+    elif args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        for key, result in sorted(results.items()):
+            if 'error' in result:
+                continue
+            if key not in baseline:
+                print('%-28s not in the baseline' % key)
+                continue
+            for problem in compare(result, baseline[key], tolerances):
+                print('%-28s REGRESSION: %s' % (key, problem))
+                failed = True
+        if not failed:
+            print('No regressions.')
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2019 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with consumer library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Random access benchmark. Each media is opened through the loader producer
+// and read at the positions of a few seek patterns, timing how long each
+// position takes from the seek to its image:
+//     random   positions anywhere in the media
+//     stride   every nth frame going forward
+//     reverse  every frame going backward from the end
+//     scrub    bursts of nearby frames around random positions
+// The media is opened again for each pattern, so that one does not warm the
+// caches of the next. For example:
+//     ./bench_seek -count 100 -json seek.json clip1.mp4 clip2.mov
+// prints the percentiles of each media and pattern and writes every timing
+// to seek.json. Compare the results before and after a change.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <mlt++/Mlt.h>
+using namespace Mlt;
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *const PATTERNS[] = { "random", "stride", "reverse", "scrub" };
+static const int PATTERN_COUNT = 4;
+
+struct Options
+{
+    const char *profile = NULL;
+    std::vector<std::string> patterns;
+    int count = 50;
+    int stride = 25;
+    int burst = 8;
+    unsigned seed = 1;
+    const char *json = NULL;
+};
+
+struct Sample
+{
+    int position;
+    double ms;
+};
+
+struct Result
+{
+    std::string resource;
+    std::string codec;
+    std::string pattern;
+    double open_ms = 0;
+    std::vector<Sample> samples;
+    int failures = 0;
+};
+
+static double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::vector<int> positions(const char *pattern, int length, const Options &options)
+{
+    std::vector<int> result;
+    std::mt19937 random(options.seed);
+    std::uniform_int_distribution<int> anywhere(0, length - 1);
+
+    if (!strcmp(pattern, "random")) {
+        for (int i = 0; i < options.count; i++)
+            result.push_back(anywhere(random));
+    } else if (!strcmp(pattern, "stride")) {
+        for (int i = 0; i < options.count; i++)
+            result.push_back((i * options.stride) % length);
+    } else if (!strcmp(pattern, "reverse")) {
+        for (int i = 0; i < options.count; i++)
+            result.push_back(std::max(0, length - 1 - i));
+    } else if (!strcmp(pattern, "scrub")) {
+        // Dragging a playhead: small steps both ways from where it lands
+        std::uniform_int_distribution<int> step(-3, 3);
+        while ((int) result.size() < options.count) {
+            int position = anywhere(random);
+            for (int i = 0; i < options.burst && (int) result.size() < options.count; i++) {
+                result.push_back(position);
+                position = std::min(length - 1, std::max(0, position + step(random)));
+            }
+        }
+    }
+    return result;
+}
+
+static std::string codec_name(Producer &producer)
+{
+    char key[64];
+    int index = producer.get_int("video_index");
+    snprintf(key, sizeof(key), "meta.media.%d.codec.name", index);
+    if (producer.get(key))
+        return producer.get(key);
+    return producer.get("mlt_service") ? producer.get("mlt_service") : "";
+}
+
+static bool run(Profile &profile, const char *resource, const char *pattern, const Options &options, Result &result)
+{
+    Clock::time_point start = Clock::now();
+    Producer producer(profile, "loader", resource);
+
+    if (!producer.is_valid())
+        return false;
+    result.open_ms = elapsed_ms(start);
+    result.resource = resource;
+    result.codec = codec_name(producer);
+    result.pattern = pattern;
+
+    int length = producer.get_length();
+    if (length <= 0)
+        return false;
+
+    for (int position : positions(pattern, length, options)) {
+        mlt_image_format format = mlt_image_yuv422;
+        int width = profile.width();
+        int height = profile.height();
+
+        start = Clock::now();
+        producer.seek(position);
+        Frame *frame = producer.get_frame();
+        uint8_t *image = frame ? frame->get_image(format, width, height) : NULL;
+        double ms = elapsed_ms(start);
+
+        if (image)
+            result.samples.push_back({ position, ms });
+        else
+            result.failures++;
+        delete frame;
+    }
+    return true;
+}
+
+// The nearest rank percentile of sorted timings
+static double percentile(const std::vector<double> &sorted, double percent)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = (size_t) std::ceil(percent / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank ? rank - 1 : 0)];
+}
+
+static void report(const Result &result)
+{
+    std::vector<double> sorted;
+    double total = 0.0;
+
+    for (const Sample &sample : result.samples) {
+        sorted.push_back(sample.ms);
+        total += sample.ms;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    printf("%-32.32s %-10.10s %-8s %5d %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f",
+           result.resource.c_str(), result.codec.c_str(), result.pattern.c_str(), (int) sorted.size(),
+           result.open_ms, sorted.empty() ? 0.0 : total / sorted.size(),
+           percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99),
+           sorted.empty() ? 0.0 : sorted.back());
+    if (result.failures)
+        printf(" (%d failed)", result.failures);
+    printf("\n");
+}
+
+static void json_string(FILE *file, const std::string &value)
+{
+    fputc('"', file);
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if ((unsigned char) c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+static int write_json(const char *filename, const std::vector<Result> &results)
+{
+    FILE *file = fopen(filename, "w");
+
+    if (!file)
+        return 1;
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        std::vector<double> sorted;
+        for (const Sample &sample : result.samples)
+            sorted.push_back(sample.ms);
+        std::sort(sorted.begin(), sorted.end());
+
+        fprintf(file, "  {\n    \"resource\": ");
+        json_string(file, result.resource);
+        fprintf(file, ",\n    \"codec\": ");
+        json_string(file, result.codec);
+        fprintf(file, ",\n    \"pattern\": ");
+        json_string(file, result.pattern);
+        fprintf(file, ",\n    \"open_ms\": %.3f,\n    \"failures\": %d,\n", result.open_ms, result.failures);
+        fprintf(file, "    \"percentiles_ms\": { \"50\": %.3f, \"90\": %.3f, \"99\": %.3f, \"100\": %.3f },\n",
+                percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), percentile(sorted, 100));
+        fprintf(file, "    \"samples\": [");
+        for (size_t j = 0; j < result.samples.size(); j++)
+            fprintf(file, "%s[%d, %.3f]", j ? ", " : "", result.samples[j].position, result.samples[j].ms);
+        fprintf(file, "]\n  }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+    return fclose(file) != 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] media ...\n"
+            "  -profile name   the profile, by default the one of the first media\n"
+            "  -pattern name   random, stride, reverse or scrub, all by default; repeatable\n"
+            "  -count n        the positions of each pattern (50)\n"
+            "  -stride n       the frames between the positions of stride (25)\n"
+            "  -burst n        the positions of each burst of scrub (8)\n"
+            "  -seed n         the seed of the random positions (1)\n"
+            "  -json file      write every timing to a JSON file\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    std::vector<const char *> media;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "-profile") && has_value)
+            options.profile = argv[++i];
+        else if (!strcmp(arg, "-pattern") && has_value)
+            options.patterns.push_back(argv[++i]);
+        else if (!strcmp(arg, "-count") && has_value)
+            options.count = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(arg, "-stride") && has_value)
+            options.stride = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(arg, "-burst") && has_value)
+            options.burst = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(arg, "-seed") && has_value)
+            options.seed = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(arg, "-json") && has_value)
+            options.json = argv[++i];
+        else if (arg[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else
+            media.push_back(arg);
+    }
+    for (const std::string &pattern : options.patterns) {
+        if (std::find_if(PATTERNS, PATTERNS + PATTERN_COUNT,
+                         [&](const char *p) { return pattern == p; }) == PATTERNS + PATTERN_COUNT) {
+            fprintf(stderr, "Unknown pattern %s\n", pattern.c_str());
+            return 1;
+        }
+    }
+    if (options.patterns.empty())
+        options.patterns.assign(PATTERNS, PATTERNS + PATTERN_COUNT);
+    if (media.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Factory::init();
+    Profile profile(options.profile);
+    if (!options.profile) {
+        // Read the media the way it would be edited
+        Producer producer(profile, "loader", media[0]);
+        if (producer.is_valid())
+            profile.from_producer(producer);
+    }
+
+    std::vector<Result> results;
+    int failed = 0;
+    printf("%-32s %-10s %-8s %5s %8s %8s %8s %8s %8s %8s\n",
+           "media", "codec", "pattern", "count", "open", "mean", "p50", "p90", "p99", "max");
+    for (const char *resource : media) {
+        for (const std::string &pattern : options.patterns) {
+            Result result;
+            if (run(profile, resource, pattern.c_str(), options, result)) {
+                report(result);
+                results.push_back(result);
+            } else {
+                fprintf(stderr, "Failed to open %s\n", resource);
+                failed = 1;
+                break;
+            }
+            fflush(stdout);
+        }
+    }
+    if (options.json && write_json(options.json, results)) {
+        fprintf(stderr, "Failed to write %s\n", options.json);
+        failed = 1;
+    }
+    Factory::close();
+    return failed;
+}
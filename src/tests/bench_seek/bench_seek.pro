@@ -0,0 +1,6 @@
+include (../common.pri)
+TARGET   = bench_seek
+SOURCES  = bench_seek.cpp
+QT      -= testlib
+CONFIG  -= testcase
+CONFIG  += c++11
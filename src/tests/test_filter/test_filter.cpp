@@ -18,6 +18,8 @@
 
 #include <QtTest>
 #include <mlt++/Mlt.h>
+#include <framework/mlt_frame.h>
+#include <framework/mlt_pool.h>
 using namespace Mlt;
 
 class TestFilter: public QObject
@@ -70,6 +72,217 @@ private Q_SLOTS:
         delete frame;
     }
 
+    void ImageconvertRgbToYuvMatchesScalar()
+    {
+        // Odd width exercises the scalar tails after the SIMD kernels.
+        const int width = 203;
+        const int height = 3;
+        Profile profile("dv_ntsc");
+        Filter filter(profile, "imageconvert");
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame frame(f);
+        mlt_frame_close(f);
+        uint8_t* rgb = (uint8_t*) mlt_pool_alloc(width * height * 3);
+        for (int i = 0; i < width * height * 3; i++)
+            rgb[i] = (i * 37 + i / 7) & 0xff;
+        QByteArray expected;
+        for (int i = 0; i < height; i++) {
+            uint8_t* s = rgb + i * width * 3;
+            int x;
+            for (x = 0; x + 1 < width; x += 2, s += 6) {
+                int y0, u0, v0, y1, u1, v1;
+                RGB2YUV_601_SCALED(s[0], s[1], s[2], y0, u0, v0);
+                RGB2YUV_601_SCALED(s[3], s[4], s[5], y1, u1, v1);
+                expected.append(char(y0)).append(char((u0 + u1) >> 1));
+                expected.append(char(y1)).append(char((v0 + v1) >> 1));
+            }
+            if (x < width) {
+                int y0, u0, v0;
+                RGB2YUV_601_SCALED(s[0], s[1], s[2], y0, u0, v0);
+                expected.append(char(y0)).append(char(u0));
+            }
+        }
+        frame.set_image(rgb, width * height * 3, mlt_pool_release);
+        frame.set("format", mlt_image_rgb24);
+        frame.set("width", width);
+        frame.set("height", height);
+        filter.process(frame);
+
+        mlt_image_format format = mlt_image_yuv422;
+        int w = width;
+        int h = height;
+        uint8_t* image = frame.get_image(format, w, h);
+        QCOMPARE(format, mlt_image_yuv422);
+        QCOMPARE(QByteArray((const char*) image, width * height * 2), expected);
+    }
+
+    void ImageconvertYuvToRgbaMatchesScalar()
+    {
+        const int width = 45;
+        const int height = 4;
+        Profile profile("dv_ntsc");
+        Filter filter(profile, "imageconvert");
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame frame(f);
+        mlt_frame_close(f);
+        uint8_t* yuv = (uint8_t*) mlt_pool_alloc(width * height * 2);
+        for (int i = 0; i < width * height * 2; i++)
+            yuv[i] = (i * 53 + 11) & 0xff;
+        QByteArray expected;
+        for (int i = 0; i < width * height / 2; i++) {
+            uint8_t* s = yuv + i * 4;
+            int r, g, b;
+            YUV2RGB_601_SCALED(s[0], s[1], s[3], r, g, b);
+            expected.append(char(r)).append(char(g)).append(char(b)).append(char(0xff));
+            YUV2RGB_601_SCALED(s[2], s[1], s[3], r, g, b);
+            expected.append(char(r)).append(char(g)).append(char(b)).append(char(0xff));
+        }
+        frame.set_image(yuv, width * height * 2, mlt_pool_release);
+        frame.set("format", mlt_image_yuv422);
+        frame.set("width", width);
+        frame.set("height", height);
+        filter.process(frame);
+
+        mlt_image_format format = mlt_image_rgb24a;
+        int w = width;
+        int h = height;
+        uint8_t* image = frame.get_image(format, w, h);
+        QCOMPARE(format, mlt_image_rgb24a);
+        QCOMPARE(QByteArray((const char*) image, expected.size()), expected);
+    }
+
+    void ImageconvertRgbaToRgba64ReplicatesBits()
+    {
+        const int width = 37;
+        const int height = 2;
+        Profile profile("dv_ntsc");
+        Filter filter(profile, "imageconvert");
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame frame(f);
+        mlt_frame_close(f);
+        uint8_t* rgba = (uint8_t*) mlt_pool_alloc(width * height * 4);
+        for (int i = 0; i < width * height * 4; i++)
+            rgba[i] = (i * 29 + 3) & 0xff;
+        QByteArray expected;
+        for (int i = 0; i < width * height * 4; i++)
+            expected.append(char(rgba[i])).append(char(rgba[i]));
+        frame.set_image(rgba, width * height * 4, mlt_pool_release);
+        frame.set("format", mlt_image_rgb24a);
+        frame.set("width", width);
+        frame.set("height", height);
+        filter.process(frame);
+
+        mlt_image_format format = mlt_image_rgba64;
+        int w = width;
+        int h = height;
+        uint8_t* image = frame.get_image(format, w, h);
+        QCOMPARE(format, mlt_image_rgba64);
+        QCOMPARE(QByteArray((const char*) image, expected.size()), expected);
+    }
+
+    void AudioconvertDeinterleavesAndCounts()
+    {
+        const int channels = 2;
+        const int samples = 37;
+        Profile profile("dv_ntsc");
+        Filter filter(profile, "audioconvert");
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame frame(f);
+        mlt_frame_close(f);
+        int size = mlt_audio_format_size(mlt_audio_s16, samples, channels);
+        int16_t* pcm = (int16_t*) mlt_pool_alloc(size);
+        for (int i = 0; i < samples * channels; i++)
+            pcm[i] = i * 401 - 16384;
+        mlt_frame_set_audio(frame.get_frame(), pcm, mlt_audio_s16, size, mlt_pool_release);
+        frame.set("audio_channels", channels);
+        frame.set("audio_samples", samples);
+        filter.process(frame);
+
+        mlt_audio_format format = mlt_audio_float;
+        int frequency = 48000;
+        int c = channels;
+        int n = samples;
+        float* audio = (float*) frame.get_audio(format, frequency, c, n);
+        QCOMPARE(format, mlt_audio_float);
+        for (int s = 0; s < samples; s++)
+            for (int i = 0; i < channels; i++)
+                QCOMPARE(audio[i * samples + s], float((s * channels + i) * 401 - 16384) / 32768.0f);
+        QCOMPARE(frame.get_int("audio_conversions"), 1);
+    }
+
+    void ChannelswapKeepsSamplesOfFormat()
+    {
+        const int channels = 3;
+        const int samples = 41;
+        Profile profile("dv_ntsc");
+        Filter filter(profile, "channelswap");
+        filter.set("from", 0);
+        filter.set("to", 2);
+        mlt_frame f = mlt_frame_init(NULL);
+        Frame frame(f);
+        mlt_frame_close(f);
+        int size = mlt_audio_format_size(mlt_audio_s16, samples, channels);
+        int16_t* pcm = (int16_t*) mlt_pool_alloc(size);
+        for (int i = 0; i < samples * channels; i++)
+            pcm[i] = i == 0 ? -32768 : i == 1 ? 32767 : i * 797 - 16001;
+        QVector<int16_t> expected(samples * channels);
+        for (int s = 0; s < samples; s++) {
+            expected[s * channels] = pcm[s * channels + 2];
+            expected[s * channels + 1] = pcm[s * channels + 1];
+            expected[s * channels + 2] = pcm[s * channels];
+        }
+        mlt_frame_set_audio(frame.get_frame(), pcm, mlt_audio_s16, size, mlt_pool_release);
+        frame.set("audio_channels", channels);
+        frame.set("audio_samples", samples);
+        filter.process(frame);
+
+        mlt_audio_format format = mlt_audio_s16;
+        int frequency = 48000;
+        int c = channels;
+        int n = samples;
+        int16_t* audio = (int16_t*) frame.get_audio(format, frequency, c, n);
+        QCOMPARE(format, mlt_audio_s16);
+        QCOMPARE(c, channels);
+        for (int i = 0; i < samples * channels; i++)
+            QCOMPARE(audio[i], expected[i]);
+    }
+
+    void Videostab2AnalyzesThenStabilizes()
+    {
+        Profile profile("dv_pal");
+        QTemporaryDir dir;
+        QByteArray filename = dir.filePath("videostab2.results").toUtf8();
+
+        // The analysis renders the clip twice, the second time after it completed.
+        // Playback is a new instance that loads the results.
+        for (int playback = 0; playback < 2; playback++) {
+            Producer producer(profile, "noise", NULL);
+            producer.set("out", 9);
+            Filter filter(profile, "videostab2");
+            if (!filter.is_valid())
+                QSKIP("videostab2 is not available");
+            filter.set("filename", filename.constData());
+            producer.attach(filter);
+            for (int pass = 0; pass < (playback ? 1 : 2); pass++) {
+                for (int position = 0; position < 10; position++) {
+                    producer.seek(position);
+                    Frame* frame = producer.get_frame();
+                    mlt_image_format format = mlt_image_yuv422;
+                    int width = 0;
+                    int height = 0;
+                    QVERIFY(frame->get_image(format, width, height) != 0);
+                    QCOMPARE(width, profile.width());
+                    QCOMPARE(height, profile.height());
+                    delete frame;
+                }
+            }
+            if (!playback) {
+                QVERIFY(QFile::exists(dir.filePath("videostab2.results")));
+                QVERIFY(filter.get("vectors") != 0);
+            }
+        }
+    }
+
 };
 
 QTEST_APPLESS_MAIN(TestFilter)
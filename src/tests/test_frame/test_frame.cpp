@@ -25,7 +25,9 @@ class TestFrame: public QObject
     Q_OBJECT
 
 public:
-    TestFrame() {}
+    TestFrame() {
+        Factory::init();
+    }
 
 private Q_SLOTS:
     void FrameConstructorAddsReference()
@@ -93,6 +95,231 @@ private Q_SLOTS:
         QCOMPARE(f1.ref_count(), 2);
         mlt_frame_close(frame);
     }
+
+    void MoveConstructorKeepsReference()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        Frame f1(frame);
+        QCOMPARE(f1.ref_count(), 2);
+        Frame f2(std::move(f1));
+        QCOMPARE(f1.is_valid(), false);
+        QCOMPARE(f2.ref_count(), 2);
+        f1 = std::move(f2);
+        QCOMPARE(f2.is_valid(), false);
+        QCOMPARE(f1.ref_count(), 2);
+        mlt_frame_close(frame);
+    }
+
+    void AdoptTakesReference()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        mlt_properties_inc_ref(MLT_FRAME_PROPERTIES(frame));
+        Frame* f1 = new Frame(frame, Adopt());
+        QCOMPARE(f1->ref_count(), 2);
+        delete f1;
+        QCOMPARE(mlt_properties_ref_count(MLT_FRAME_PROPERTIES(frame)), 1);
+        mlt_frame_close(frame);
+    }
+
+    void BorrowedDoesNotChangeReference()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        {
+            Borrowed<Frame> f1(frame);
+            QCOMPARE(f1->ref_count(), 1);
+            f1->set("test", 1);
+        }
+        QCOMPARE(mlt_properties_ref_count(MLT_FRAME_PROPERTIES(frame)), 1);
+        QCOMPARE(mlt_properties_get_int(MLT_FRAME_PROPERTIES(frame), "test"), 1);
+        mlt_frame_close(frame);
+    }
+
+    void ImageViewIsPackedByGetImage()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
+        int width = 16, height = 8;
+        int size = mlt_image_format_size(mlt_image_yuv422, width, height, NULL);
+        uint8_t *buffer = (uint8_t*) mlt_pool_alloc(size);
+        for (int i = 0; i < size; i++)
+            buffer[i] = i;
+        mlt_frame_set_image(frame, buffer, size, mlt_pool_release);
+        mlt_properties_set_int(properties, "format", mlt_image_yuv422);
+        mlt_properties_set_int(properties, "width", width);
+        mlt_properties_set_int(properties, "height", height);
+
+        // Odd offsets split the chroma of yuv422.
+        QVERIFY(mlt_frame_set_image_view(frame, 1, 0, 4, 4) != 0);
+        QCOMPARE(mlt_frame_set_image_view(frame, 2, 1, 10, 6), 0);
+        QCOMPARE(mlt_frame_set_image_view(frame, 2, 1, 6, 4), 0);
+
+        uint8_t *image = NULL;
+        mlt_image_format format = mlt_image_yuv422;
+        int w = 0, h = 0;
+        uint8_t *planes[4];
+        int strides[4];
+        QCOMPARE(mlt_frame_get_image_view(frame, &image, &format, &w, &h, 0), 0);
+        QCOMPARE(w, 6);
+        QCOMPARE(h, 4);
+        QCOMPARE(image, buffer + 2 * width * 2 + 4 * 2);
+        mlt_frame_get_image_planes(frame, planes, strides);
+        QCOMPARE(planes[0], image);
+        QCOMPARE(strides[0], width * 2);
+
+        QCOMPARE(mlt_frame_get_image(frame, &image, &format, &w, &h, 0), 0);
+        QVERIFY(image != buffer);
+        mlt_frame_get_image_planes(frame, planes, strides);
+        QCOMPARE(strides[0], 6 * 2);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w * 2; x++)
+                QCOMPARE(image[y * w * 2 + x], uint8_t((y + 2) * width * 2 + 4 * 2 + x));
+        mlt_frame_close(frame);
+    }
+
+    void ImageViewAddressesRegionInPlace()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
+        int width = 16, height = 8;
+        int size = mlt_image_format_size(mlt_image_yuv422, width, height, NULL);
+        uint8_t *buffer = (uint8_t*) mlt_pool_alloc(size);
+        mlt_frame_set_image(frame, buffer, size, mlt_pool_release);
+        mlt_properties_set_int(properties, "format", mlt_image_yuv422);
+        mlt_properties_set_int(properties, "width", width);
+        mlt_properties_set_int(properties, "height", height);
+        QCOMPARE(mlt_frame_set_image_view(frame, 2, 2, 6, 4), 0);
+
+        Frame f(frame);
+        mlt_frame_close(frame);
+        ImageView view(f, mlt_image_yuv422, 6, 4);
+        QVERIFY(view.is_valid());
+        QCOMPARE(f.ref_count(), 2);
+        QCOMPARE(view.count(), 1);
+        QCOMPARE(view.plane(0), buffer + 2 * width * 2 + 2 * 2);
+        QCOMPARE(view.stride(0), width * 2);
+        QCOMPARE(view.rows(0), 4);
+        QCOMPARE(view.columns(0), 6);
+        QCOMPARE(view.components(0), 2);
+        QCOMPARE(view.sample_size(), 1);
+        QVERIFY(view.plane(1) == NULL);
+    }
+
+    void FieldPlanesAddressEveryOtherLine()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
+        int width = 16, height = 7;
+        int size = mlt_image_format_size(mlt_image_yuv422, width, height, NULL);
+        uint8_t *buffer = (uint8_t*) mlt_pool_alloc(size);
+        uint8_t *planes[4];
+        int strides[4];
+        mlt_frame_set_image(frame, buffer, size, mlt_pool_release);
+        mlt_properties_set_int(properties, "format", mlt_image_yuv422);
+        mlt_properties_set_int(properties, "width", width);
+        mlt_properties_set_int(properties, "height", height);
+
+        QCOMPARE(mlt_frame_get_field_planes(frame, 0, planes, strides), 4);
+        QCOMPARE(planes[0], buffer);
+        QCOMPARE(strides[0], width * 4);
+        QCOMPARE(mlt_frame_get_field_planes(frame, 1, planes, strides), 3);
+        QCOMPARE(planes[0], buffer + width * 2);
+        QCOMPARE(strides[0], width * 4);
+        QVERIFY(planes[1] == NULL);
+        mlt_frame_close(frame);
+    }
+
+    void StaticImageHashIdentifiesContent()
+    {
+        mlt_frame a = mlt_frame_init(NULL);
+        mlt_frame b = mlt_frame_init(NULL);
+        QCOMPARE(mlt_frame_get_static_image(a), uint64_t(0));
+        mlt_frame_set_static_image(a, "colour:red");
+        mlt_frame_set_static_image(b, "colour:red");
+        QVERIFY(mlt_frame_get_static_image(a) != 0);
+        QCOMPARE(mlt_frame_get_static_image(a), mlt_frame_get_static_image(b));
+        mlt_frame_set_static_image(b, "colour:blue");
+        QVERIFY(mlt_frame_get_static_image(a) != mlt_frame_get_static_image(b));
+        mlt_frame_close(a);
+        mlt_frame_close(b);
+    }
+
+    void StaticImageIsClearedByFilter()
+    {
+        Profile profile;
+        Producer producer(profile, "colour:red");
+        Filter filter(profile, "greyscale");
+        QVERIFY(producer.is_valid());
+        QVERIFY(filter.is_valid());
+        Frame *frame = producer.get_frame();
+        QVERIFY(mlt_frame_get_static_image(frame->get_frame()) != 0);
+        delete frame;
+        producer.attach(filter);
+        frame = producer.get_frame();
+        QCOMPARE(mlt_frame_get_static_image(frame->get_frame()), uint64_t(0));
+        delete frame;
+    }
+
+    void ConstantAlphaIsFoundOrKnown()
+    {
+        mlt_frame frame = mlt_frame_init(NULL);
+        uint8_t alpha[16];
+        memset(alpha, 128, sizeof(alpha));
+        QCOMPARE(mlt_frame_get_constant_alpha(frame, NULL, 0), 255);
+        QCOMPARE(mlt_frame_get_constant_alpha(frame, alpha, sizeof(alpha)), 128);
+        alpha[15] = 0;
+        QCOMPARE(mlt_frame_get_constant_alpha(frame, alpha, sizeof(alpha)), -1);
+        mlt_properties_set_int(MLT_FRAME_PROPERTIES(frame), "constant_alpha", 0);
+        QCOMPARE(mlt_frame_get_constant_alpha(frame, alpha, sizeof(alpha)), 0);
+        mlt_frame_close(frame);
+    }
+
+    void AlphaBoxIsFoundAndScaled()
+    {
+        uint8_t alpha[8 * 6];
+        memset(alpha, 0, sizeof(alpha));
+        alpha[2 * 8 + 3] = 255;
+        alpha[3 * 8 + 5] = 1;
+        mlt_rect box = mlt_image_alpha_box(alpha, 8, 6);
+        QCOMPARE(box.x, 3.0);
+        QCOMPARE(box.y, 2.0);
+        QCOMPARE(box.w, 3.0);
+        QCOMPARE(box.h, 2.0);
+        memset(alpha, 0, sizeof(alpha));
+        box = mlt_image_alpha_box(alpha, 8, 6);
+        QCOMPARE(box.w, 0.0);
+
+        mlt_frame frame = mlt_frame_init(NULL);
+        QVERIFY(!mlt_frame_get_alpha_box(frame, 100, 100, &box));
+        box.x = 40; box.y = 30; box.w = 10; box.h = 20;
+        mlt_frame_set_alpha_box(frame, box, 100, 100);
+        QVERIFY(mlt_frame_get_alpha_box(frame, 200, 100, &box));
+        // Grown by 3 source pixels for interpolation
+        QCOMPARE(box.x, 74.0);
+        QCOMPARE(box.y, 27.0);
+        QCOMPARE(box.w, 32.0);
+        QCOMPARE(box.h, 26.0);
+        mlt_frame_clear_image_hints(frame);
+        QVERIFY(!mlt_frame_get_alpha_box(frame, 100, 100, &box));
+        mlt_frame_set_alpha_box(frame, box, 100, 100);
+        QVERIFY(!mlt_frame_get_alpha_box(frame, 100, 100, &box));
+        mlt_frame_close(frame);
+    }
+
+    void SolidColourIsClearedByFilter()
+    {
+        Profile profile;
+        Producer producer(profile, "colour:0xff000080");
+        Filter filter(profile, "greyscale");
+        Frame *frame = producer.get_frame();
+        QVERIFY(frame->get("solid_colour"));
+        QCOMPARE(frame->get_int("constant_alpha"), 0x80);
+        delete frame;
+        producer.attach(filter);
+        frame = producer.get_frame();
+        QVERIFY(!frame->get("solid_colour"));
+        QVERIFY(!frame->get("constant_alpha"));
+        delete frame;
+    }
 };
 
 QTEST_APPLESS_MAIN(TestFrame)
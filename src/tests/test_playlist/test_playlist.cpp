@@ -61,6 +61,42 @@ private Q_SLOTS:
         QCOMPARE(pl.count(), 0);
     }
 
+    void GetClipFillsProducer()
+    {
+        Playlist pl(profile);
+        Producer p(profile, "noise");
+        pl.append(p);
+        Producer clip;
+        QVERIFY(pl.get_clip(0, clip));
+        QVERIFY(clip.is_valid());
+        QCOMPARE(clip.get_length(), p.get_length());
+        QVERIFY(!pl.get_clip(1, clip));
+        QVERIFY(!clip.is_valid());
+    }
+
+    void ParserIndexFindsClips()
+    {
+        Playlist pl(profile);
+        Producer p(profile, "noise");
+        p.set("id", "clip");
+        pl.append(p);
+        pl.blank(10);
+        pl.append(p);
+        Parser parser;
+        parser.index(pl);
+        QCOMPARE(parser.index_count(playlist_type), 1);
+        // The parent and its two cuts, without the blank
+        QCOMPARE(parser.index_count(producer_type), 3);
+        Service *found = parser.index_find("clip");
+        QVERIFY(found);
+        QCOMPARE(found->get_service(), p.get_service());
+        delete found;
+        QVERIFY(!parser.index_find("other"));
+        pl.append(p);
+        parser.index(pl);
+        QCOMPARE(parser.index_count(producer_type), 4);
+    }
+
     void RemoveErrorOnInvalidIndex()
     {
         Playlist pl(profile);
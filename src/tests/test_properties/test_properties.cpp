@@ -449,6 +449,32 @@ private Q_SLOTS:
         QCOMPARE(p->get("key:2"), "value[2]");
     }
 
+    void LoadRereadsChangedFile()
+    {
+        QTemporaryFile tempFile;
+        QVERIFY(tempFile.open());
+        tempFile.write("key1=value1\nkey2=value2\n.sub=value3\n");
+        tempFile.flush();
+        QByteArray fileName = tempFile.fileName().toUtf8();
+        {
+            Properties p(fileName.constData());
+            QCOMPARE(p.get("key1"), "value1");
+            QCOMPARE(p.get("key2.sub"), "value3");
+        }
+        {
+            Properties p(fileName.constData());
+            QCOMPARE(p.count(), 3);
+        }
+        // A change of size is seen even within the same second
+        tempFile.resize(0);
+        tempFile.seek(0);
+        tempFile.write("key1=other\n");
+        tempFile.flush();
+        Properties p(fileName.constData());
+        QCOMPARE(p.get("key1"), "other");
+        QCOMPARE(p.count(), 1);
+    }
+
     void RadixRespondsToLocale()
     {
         Properties p;
@@ -1105,6 +1131,80 @@ private Q_SLOTS:
         QCOMPARE(p.get_animation("key"), mlt_animation(0));
         QCOMPARE(p.get_int("key"), 0);
     }
+
+    void ManyPropertiesAreFound()
+    {
+        Properties p;
+        char name[32];
+        for (int i = 0; i < 1000; i++) {
+            sprintf(name, "_filter%d.key", i);
+            p.set(name, i);
+        }
+        QCOMPARE(p.count(), 1000);
+        for (int i = 0; i < 1000; i++) {
+            sprintf(name, "_filter%d.key", i);
+            QCOMPARE(p.get_int(name), i);
+            QCOMPARE(p.get_name(i), name);
+        }
+        QVERIFY(p.get("_filter1000.key") == 0);
+        p.rename("_filter500.key", "renamed");
+        QVERIFY(p.get("_filter500.key") == 0);
+        QCOMPARE(p.get_int("renamed"), 500);
+        QCOMPARE(p.get_int("_filter499.key"), 499);
+    }
+
+    void SetAndGetByAtom()
+    {
+        Properties p;
+        mlt_atom atom = mlt_atom_intern("key");
+        QCOMPARE(mlt_atom_intern("key"), atom);
+        QCOMPARE(mlt_atom_name(atom), "key");
+        QVERIFY(mlt_properties_get_by_atom(p.get_properties(), atom) == 0);
+        mlt_properties_set_by_atom(p.get_properties(), atom, "value");
+        QCOMPARE(p.get("key"), "value");
+        p.set("key", "other");
+        QCOMPARE(mlt_properties_get_by_atom(p.get_properties(), atom), "other");
+    }
+
+    void GetManyAtPosition()
+    {
+        Properties p;
+        p.set("level", "0=0;100=100");
+        p.set("count", 7);
+        p.set("name", "value");
+        mlt_value values[] = {
+            { mlt_atom_intern("level"), mlt_value_double },
+            { mlt_atom_intern("count"), mlt_value_int },
+            { mlt_atom_intern("name"), mlt_value_string },
+            { mlt_atom_intern("missing"), mlt_value_int },
+        };
+        QCOMPARE(p.get_many(values, 4, 50), 3);
+        QCOMPARE(values[0].value.d, 50.0);
+        QCOMPARE(values[1].value.i, 7);
+        QCOMPARE(values[2].value.s, "value");
+        QVERIFY(!values[3].found);
+        QCOMPARE(values[3].value.i, 0);
+    }
+
+    void ReadsThroughParent()
+    {
+        Properties parent;
+        Properties p;
+        parent.set("meta.media.width", 720);
+        parent.set("resource", "file.mp4");
+        QVERIFY(!mlt_properties_add_parent(p.get_properties(), parent.get_properties(), "meta."));
+        QCOMPARE(p.get_int("meta.media.width"), 720);
+        QVERIFY(p.get("resource") == 0);
+        QCOMPARE(p.count(), 0);
+        p.set("meta.media.width", 1280);
+        QCOMPARE(p.get_int("meta.media.width"), 1280);
+        QCOMPARE(parent.get_int("meta.media.width"), 720);
+        parent.set("meta.media.height", 576);
+        Properties copy;
+        copy.inherit(p);
+        QCOMPARE(copy.get_int("meta.media.width"), 1280);
+        QCOMPARE(copy.get_int("meta.media.height"), 576);
+    }
 };
 
 QTEST_APPLESS_MAIN(TestProperties)
@@ -402,6 +402,139 @@ private Q_SLOTS:
         QCOMPARE(t.count(), 1);
         QCOMPARE(filter.get_track(), 0);
     }
+
+    void ParallelTracksRenderSameImage()
+    {
+        Tractor t(profile);
+        Producer p1(profile, "colour:red");
+        Producer p2(profile, "colour:blue");
+        t.set_track(p1, 0);
+        t.set_track(p2, 1);
+
+        // A soft wipe gives the frames inside the transition some structure.
+        Transition trans(profile, "luma", "%luma01.pgm");
+        trans.set("softness", 0.2);
+        trans.set("in", 10);
+        trans.set("out", 89);
+        t.plant_transition(trans, 0, 1);
+
+        // Cover frames before, inside and after the transition.
+        const int positions[] = {5, 30, 50, 70, 95};
+        int width = profile.width();
+        int height = profile.height();
+        int size = mlt_image_format_size(mlt_image_yuv422, width, height, NULL);
+        QByteArray expected[5];
+        for (int parallel = 0; parallel < 2; parallel++) {
+            t.set("parallel_tracks", parallel);
+            for (int i = 0; i < 5; i++) {
+                t.seek(positions[i]);
+                Frame* frame = t.get_frame();
+                mlt_image_format format = mlt_image_yuv422;
+                int w = width;
+                int h = height;
+                uint8_t* image = frame->get_image(format, w, h);
+                QVERIFY(image != 0);
+                QCOMPARE(w, width);
+                QCOMPARE(h, height);
+                QByteArray rendered((const char*) image, size);
+                if (parallel)
+                    QVERIFY(rendered == expected[i]);
+                else
+                    expected[i] = rendered;
+                delete frame;
+            }
+        }
+    }
+
+    void GeneratedLumaWipesFullRange()
+    {
+        // The wipes are generated at the image size and must reveal all of B.
+        const char* resources[] = {"%luma01.pgm", "%luma07.pgm"};
+        for (const char* resource : resources) {
+            Tractor t(profile);
+            Producer p1(profile, "colour:black");
+            Producer p2(profile, "colour:white");
+            t.set_track(p1, 0);
+            t.set_track(p2, 1);
+            Transition trans(profile, "luma", resource);
+            trans.set("out", 99);
+            t.plant_transition(trans, 0, 1);
+
+            int width = profile.width();
+            int height = profile.height();
+            int previous = -1;
+            for (int position = 0; position < 100; position += 11) {
+                t.seek(position);
+                Frame* frame = t.get_frame();
+                mlt_image_format format = mlt_image_yuv422;
+                uint8_t* image = frame->get_image(format, width, height);
+                QVERIFY(image != 0);
+                int revealed = 0;
+                for (int i = 0; i < width * height; i++)
+                    revealed += image[i * 2] > 128;
+                delete frame;
+
+                QVERIFY(revealed >= previous);
+                previous = revealed;
+                if (position == 0)
+                    QVERIFY(revealed < width * height / 20);
+            }
+            QVERIFY(previous > width * height * 19 / 20);
+        }
+    }
+
+    void ServiceHashFollowsUpstreamChanges()
+    {
+        Tractor t(profile);
+        Producer p1(profile, "colour:red");
+        Producer p2(profile, "colour:blue");
+        t.set_track(p1, 0);
+        t.set_track(p2, 1);
+        Filter f(profile, "brightness");
+        f.set("level", 0.5);
+        p2.attach(f);
+        uint64_t hash = mlt_service_hash(t.get_service());
+        QCOMPARE(mlt_service_hash(t.get_service()), hash);
+
+        int generation = mlt_service_generation(p2.get_service());
+        f.set("level", 0.7);
+        QVERIFY(mlt_service_generation(p2.get_service()) != generation);
+        QVERIFY(mlt_service_hash(t.get_service()) != hash);
+        f.set("level", 0.5);
+        QCOMPARE(mlt_service_hash(t.get_service()), hash);
+
+        // Private properties do not change the hash
+        p1.set("_private", 1);
+        QCOMPARE(mlt_service_hash(t.get_service()), hash);
+    }
+
+    static void onProfileChanged(mlt_properties, int* count)
+    {
+        ++(*count);
+    }
+
+    void ProfileChangedReachesEveryService()
+    {
+        Tractor t(profile);
+        Producer p1(profile, "colour:red");
+        Producer p2(profile, "colour:blue");
+        Playlist playlist(profile);
+        playlist.append(p1, 0, 9);
+        t.set_track(playlist, 0);
+        t.set_track(p2, 1);
+        Filter f(profile, "brightness");
+        p1.attach(f);
+        int counts[4] = {0, 0, 0, 0};
+        mlt_events_listen(t.get_properties(), &counts[0], "profile-changed", (mlt_listener) onProfileChanged);
+        mlt_events_listen(p1.get_properties(), &counts[1], "profile-changed", (mlt_listener) onProfileChanged);
+        mlt_events_listen(p2.get_properties(), &counts[2], "profile-changed", (mlt_listener) onProfileChanged);
+        mlt_events_listen(f.get_properties(), &counts[3], "profile-changed", (mlt_listener) onProfileChanged);
+
+        // The parent of the cut in the playlist is reached once
+        mlt_service_profile_changed(t.get_service());
+        for (int i = 0; i < 4; i++)
+            QCOMPARE(counts[i], 1);
+    }
 };
 
 QTEST_APPLESS_MAIN(TestTractor)
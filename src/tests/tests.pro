@@ -1,5 +1,7 @@
 TEMPLATE = subdirs
-SUBDIRS = test_filter \
+SUBDIRS = bench_framework \
+    bench_seek \
+    test_filter \
     test_frame \
     test_playlist \
     test_properties \